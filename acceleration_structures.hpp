@@ -0,0 +1,631 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "dynamic_state.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+
+// ray traced shadows：VK_KHR_acceleration_structure和VK_KHR_ray_query都支持时，片段着色器沿太阳光用ray query求交代替shadow map
+// BLAS：每个mesh一个，顶点和索引直接从geometry buffer读取；build时开启compaction，之后查询compacted size拷贝到更小的BLAS，原来的BLAS延迟销毁
+// TLAS：每个frame in flight一个，容量固定，实例引用的BLAS没有变化时只refit（UPDATE模式），变化时或者连续refit太多次之后重新build
+// scratch：每个frame in flight一个预先分配的buffer，同一批BLAS按对齐线性分配，TLAS在barrier之后从头复用；放不下的BLAS留到之后的帧
+// 命令录制在自己的command buffer中，和shadow cache一样在场景之前提交，command cache重放的场景命令只读取TLAS
+// 只在主线程使用
+
+// ray traced shadows：BLAS的三角形输入，地址由调用者按geometry buffer中mesh的位置算好，提交BLAS之前数据已经上传完成
+struct BlasGeometry {
+    VkDeviceAddress vertexAddress = 0;
+    VkDeviceSize vertexStride = 0;
+    VkFormat vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;  // compact vertex：R16G16B16A16_SNORM也是必须支持的顶点格式
+    uint32_t vertexCount = 0;
+    VkDeviceAddress indexAddress = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t indexCount = 0;
+};
+
+class AccelerationStructures {
+public:
+    static constexpr uint32_t INVALID_BLAS = UINT32_MAX;
+    static constexpr uint32_t REBUILD_INTERVAL = 240;  // refit：实例移动之后包围盒越来越松，连续refit这么多次之后重新build
+
+    // ray traced shadows：在这一帧的命令完成之后执行，由调用者放进deletion queue
+    using DeferDestroy = std::function<void(std::function<void()>)>;
+
+    struct Stats {
+        uint32_t blasBuilds = 0;  // 这一帧build的BLAS数量
+        uint32_t blasCompactions = 0;  // 这一帧拷贝到compacted BLAS的数量
+        uint32_t pendingBuilds = 0;  // 超过每帧预算，留到之后的帧的BLAS
+        uint32_t oversizedBlas = 0;  // scratch超过预算，永远不会build的BLAS，这些mesh不投射ray traced阴影
+        uint32_t instanceCount = 0;
+        bool tlasRebuilt = false;  // 这一帧的TLAS是build而不是refit
+        VkDeviceSize blasBytes = 0;  // 所有BLAS的大小，compaction之后减少
+    };
+
+    // ray traced shadows：bufferDeviceAddress是1.2的core，ray query的shader需要SPIR-V 1.4
+    static bool supported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
+        VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{};
+        accelerationStructureFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+        VkPhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures{};
+        rayQueryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+        rayQueryFeatures.pNext = &accelerationStructureFeatures;
+        VkPhysicalDeviceBufferDeviceAddressFeatures addressFeatures{};
+        addressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+        addressFeatures.pNext = &rayQueryFeatures;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &addressFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return accelerationStructureFeatures.accelerationStructure && rayQueryFeatures.rayQuery && addressFeatures.bufferDeviceAddress;
+    }
+
+    // ray traced shadows：allocator需要以bufferDeviceAddress模式初始化
+    // scratchBudget和maxBuildsPerFrame限制每帧BLAS build的量，TLAS需要的scratch更大时按TLAS分配
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, DeviceMemoryAllocator& allocator, VkCommandPool commandPool, uint32_t frameCount,
+        uint32_t maxInstances, VkDeviceSize scratchBudget, uint32_t maxBuildsPerFrame, DeferDestroy deferDestroy) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_commandPool = commandPool;
+        m_maxInstances = maxInstances;
+        m_scratchBudget = scratchBudget;
+        m_maxBuildsPerFrame = maxBuildsPerFrame;
+        m_deferDestroy = std::move(deferDestroy);
+
+        m_createAccelerationStructure = loadDeviceFunction<PFN_vkCreateAccelerationStructureKHR>(device, "vkCreateAccelerationStructureKHR");
+        m_destroyAccelerationStructure = loadDeviceFunction<PFN_vkDestroyAccelerationStructureKHR>(device, "vkDestroyAccelerationStructureKHR");
+        m_getBuildSizes = loadDeviceFunction<PFN_vkGetAccelerationStructureBuildSizesKHR>(device, "vkGetAccelerationStructureBuildSizesKHR");
+        m_getAccelerationStructureAddress = loadDeviceFunction<PFN_vkGetAccelerationStructureDeviceAddressKHR>(device, "vkGetAccelerationStructureDeviceAddressKHR");
+        m_cmdBuild = loadDeviceFunction<PFN_vkCmdBuildAccelerationStructuresKHR>(device, "vkCmdBuildAccelerationStructuresKHR");
+        m_cmdCopy = loadDeviceFunction<PFN_vkCmdCopyAccelerationStructureKHR>(device, "vkCmdCopyAccelerationStructureKHR");
+        m_cmdWriteProperties = loadDeviceFunction<PFN_vkCmdWriteAccelerationStructuresPropertiesKHR>(device, "vkCmdWriteAccelerationStructuresPropertiesKHR");
+        m_getBufferAddress = loadDeviceFunction<PFN_vkGetBufferDeviceAddress>(device, "vkGetBufferDeviceAddress");
+
+        VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties{};
+        accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &accelerationStructureProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        m_scratchAlignment = std::max<VkDeviceSize>(accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+
+        // TLAS：按最大实例数量查询一次大小，之后build和refit都在同一个TLAS上，descriptor不需要改变
+        VkAccelerationStructureGeometryKHR geometry = instanceGeometry(0);
+        VkAccelerationStructureBuildGeometryInfoKHR buildInfo = tlasBuildInfo(&geometry);
+        VkAccelerationStructureBuildSizesInfoKHR sizes{};
+        sizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+        m_getBuildSizes(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &m_maxInstances, &sizes);
+        VkDeviceSize scratchSize = std::max({sizes.buildScratchSize, sizes.updateScratchSize, m_scratchBudget});
+
+        std::vector<VkCommandBuffer> commandBuffers(frameCount);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = frameCount;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate acceleration structure command buffers!");
+        }
+
+        m_frames.resize(frameCount);
+        for (uint32_t i = 0; i < frameCount; i++) {
+            Frame& frame = m_frames[i];
+            frame.commandBuffer = commandBuffers[i];
+            frame.tlasBuffer = createBuffer(sizes.accelerationStructureSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, false, "tlas");
+            frame.tlas = createAccelerationStructure(frame.tlasBuffer.buffer, sizes.accelerationStructureSize, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR);
+            frame.instances = createBuffer(VkDeviceSize(sizeof(VkAccelerationStructureInstanceKHR)) * maxInstances,
+                VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR, true, "tlas instances");
+            // scratch：buffer的地址不一定满足scratch的对齐，多分配一个对齐的大小
+            frame.scratch = createBuffer(scratchSize + m_scratchAlignment, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false, "acceleration structure scratch");
+            frame.scratchAddress = alignUp(frame.scratch.address, m_scratchAlignment);
+
+            VkQueryPoolCreateInfo queryInfo{};
+            queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            queryInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+            queryInfo.queryCount = maxBuildsPerFrame;
+            if (vkCreateQueryPool(m_device, &queryInfo, hostAllocator(), &frame.compactedSizes) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create acceleration structure query pool!");
+            }
+        }
+        m_compactedSizes.resize(maxBuildsPerFrame);
+    }
+
+    // ray traced shadows：调用者保证gpu已经空闲
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        for (Blas& blas : m_blas) {
+            if (blas.handle != VK_NULL_HANDLE) {
+                m_destroyAccelerationStructure(m_device, blas.handle, hostAllocator());
+                destroyBuffer(blas.buffer);
+            }
+        }
+        m_blas.clear();
+        m_freeBlas.clear();
+        m_pending.clear();
+        for (Frame& frame : m_frames) {
+            vkFreeCommandBuffers(m_device, m_commandPool, 1, &frame.commandBuffer);
+            m_destroyAccelerationStructure(m_device, frame.tlas, hostAllocator());
+            destroyBuffer(frame.tlasBuffer);
+            destroyBuffer(frame.instances);
+            destroyBuffer(frame.scratch);
+            vkDestroyQueryPool(m_device, frame.compactedSizes, hostAllocator());
+        }
+        m_frames.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // BLAS：只查询大小并排进队列，之后的record中build；返回的handle在removeBlas之前有效
+    uint32_t addBlas(const BlasGeometry& geometry) {
+        uint32_t handle;
+        if (!m_freeBlas.empty()) {
+            handle = m_freeBlas.back();
+            m_freeBlas.pop_back();
+        } else {
+            handle = static_cast<uint32_t>(m_blas.size());
+            m_blas.emplace_back();
+        }
+        Blas& blas = m_blas[handle];
+        blas.geometry = geometry;
+        blas.generation++;
+
+        VkAccelerationStructureGeometryKHR triangles = triangleGeometry(geometry);
+        VkAccelerationStructureBuildGeometryInfoKHR buildInfo = blasBuildInfo(&triangles);
+        uint32_t primitiveCount = geometry.indexCount / 3;
+        VkAccelerationStructureBuildSizesInfoKHR sizes{};
+        sizes.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+        m_getBuildSizes(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &primitiveCount, &sizes);
+        blas.size = sizes.accelerationStructureSize;
+        blas.scratchSize = alignUp(sizes.buildScratchSize, m_scratchAlignment);
+        if (blas.scratchSize > m_scratchBudget || primitiveCount == 0) {
+            blas.state = BlasState::oversized;
+        } else {
+            blas.state = BlasState::pending;
+            m_pending.push_back(handle);
+        }
+        return handle;
+    }
+
+    // BLAS：延迟到这一帧的命令完成之后销毁，in flight的帧的TLAS可能还引用它；handle马上可以复用
+    void removeBlas(uint32_t handle) {
+        Blas& blas = m_blas[handle];
+        if (blas.handle != VK_NULL_HANDLE) {
+            m_deferDestroy([this, accelerationStructure = blas.handle, buffer = blas.buffer]() {
+                m_destroyAccelerationStructure(m_device, accelerationStructure, hostAllocator());
+                destroyBuffer(buffer);
+            });
+            m_blasBytes -= blas.size;
+        }
+        uint32_t generation = blas.generation;
+        blas = {};
+        blas.generation = generation;
+        m_freeBlas.push_back(handle);
+    }
+
+    bool blasReady(uint32_t handle) const {
+        return handle < m_blas.size() && m_blas[handle].handle != VK_NULL_HANDLE;
+    }
+
+    // TLAS：这一帧的实例，transform是完整的世界矩阵；还没有build的BLAS在record时跳过，超过容量时返回false
+    void clearInstances() { m_instances.clear(); }
+    bool addInstance(const glm::mat4& transform, uint32_t blas) {
+        if (m_instances.size() >= m_maxInstances) {
+            return false;
+        }
+        m_instances.push_back({transform, blas});
+        return true;
+    }
+
+    // ray traced shadows：录制compaction、BLAS build和TLAS的build或refit，没有需要做的事情时返回VK_NULL_HANDLE
+    // 调用者保证这个frame in flight上一次的提交已经完成，compacted size的查询结果可以直接读取
+    VkCommandBuffer record(uint32_t frameIndex) {
+        Frame& frame = m_frames[frameIndex];
+        m_stats = {};
+        if (m_pending.empty() && frame.compactions.empty() && m_instances.empty()) {
+            frame.valid = false;
+            m_stats.blasBytes = m_blasBytes;
+            return VK_NULL_HANDLE;
+        }
+
+        VkCommandBuffer commandBuffer = frame.commandBuffer;
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording acceleration structure command buffer!");
+        }
+        // 之前的帧build的BLAS是compaction拷贝和这一帧refit的输入
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+
+        bool blasChanged = recordCompactions(commandBuffer, frame);
+        blasChanged = recordBlasBuilds(commandBuffer, frame) || blasChanged;
+        if (blasChanged) {
+            memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+        }
+        recordTlas(commandBuffer, frame);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record acceleration structure command buffer!");
+        }
+        m_stats.pendingBuilds = static_cast<uint32_t>(m_pending.size());
+        m_stats.blasBytes = m_blasBytes;
+        return commandBuffer;
+    }
+
+    // TLAS：record之后这一帧是否有可以求交的TLAS，没有实例的帧为false
+    bool valid(uint32_t frameIndex) const { return m_frames[frameIndex].valid; }
+    VkAccelerationStructureKHR tlas(uint32_t frameIndex) const { return m_frames[frameIndex].tlas; }
+    VkDeviceAddress tlasAddress(uint32_t frameIndex) const { return accelerationStructureAddress(m_frames[frameIndex].tlas); }
+
+    const Stats& stats() const { return m_stats; }
+
+    // BLAS：BlasGeometry中的地址，buffer需要SHADER_DEVICE_ADDRESS和ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY用法
+    VkDeviceAddress bufferAddress(VkBuffer buffer) const {
+        VkBufferDeviceAddressInfo addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = buffer;
+        return m_getBufferAddress(m_device, &addressInfo);
+    }
+
+private:
+    enum class BlasState {
+        free,
+        pending,
+        built,
+        compacted,
+        oversized,
+    };
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkDeviceAddress address = 0;
+    };
+
+    struct Blas {
+        BlasGeometry geometry;
+        BlasState state = BlasState::free;
+        uint32_t generation = 0;  // compaction的查询结果回来时handle可能已经被复用
+        VkDeviceSize size = 0;
+        VkDeviceSize scratchSize = 0;
+        Buffer buffer;
+        VkAccelerationStructureKHR handle = VK_NULL_HANDLE;
+        VkDeviceAddress address = 0;
+    };
+
+    struct Compaction {
+        uint32_t blas;
+        uint32_t generation;
+    };
+
+    struct Instance {
+        glm::mat4 transform;
+        uint32_t blas;
+    };
+
+    struct Frame {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        Buffer tlasBuffer;
+        VkAccelerationStructureKHR tlas = VK_NULL_HANDLE;
+        Buffer instances;
+        Buffer scratch;
+        VkDeviceAddress scratchAddress = 0;
+        VkQueryPool compactedSizes = VK_NULL_HANDLE;
+        std::vector<Compaction> compactions;  // 这个frame in flight上一次build的BLAS，按query的顺序
+        bool valid = false;
+        uint32_t builtCount = 0;  // refit：上一次build时的实例数量和引用的BLAS地址的hash，都相同时可以refit
+        uint64_t builtTopology = 0;
+        uint32_t refits = 0;
+    };
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    uint32_t m_maxInstances = 0;
+    VkDeviceSize m_scratchBudget = 0;
+    VkDeviceSize m_scratchAlignment = 1;
+    uint32_t m_maxBuildsPerFrame = 0;
+    DeferDestroy m_deferDestroy;
+
+    std::vector<Blas> m_blas;
+    std::vector<uint32_t> m_freeBlas;
+    std::deque<uint32_t> m_pending;
+    std::vector<Instance> m_instances;
+    std::vector<Frame> m_frames;
+    std::vector<uint64_t> m_compactedSizes;
+    VkDeviceSize m_blasBytes = 0;
+    Stats m_stats;
+
+    PFN_vkCreateAccelerationStructureKHR m_createAccelerationStructure = nullptr;
+    PFN_vkDestroyAccelerationStructureKHR m_destroyAccelerationStructure = nullptr;
+    PFN_vkGetAccelerationStructureBuildSizesKHR m_getBuildSizes = nullptr;
+    PFN_vkGetAccelerationStructureDeviceAddressKHR m_getAccelerationStructureAddress = nullptr;
+    PFN_vkCmdBuildAccelerationStructuresKHR m_cmdBuild = nullptr;
+    PFN_vkCmdCopyAccelerationStructureKHR m_cmdCopy = nullptr;
+    PFN_vkCmdWriteAccelerationStructuresPropertiesKHR m_cmdWriteProperties = nullptr;
+    PFN_vkGetBufferDeviceAddress m_getBufferAddress = nullptr;
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+    // compaction：上一次build的BLAS已经完成，compacted size更小时拷贝过去，TLAS在这一帧重新build引用新的地址
+    bool recordCompactions(VkCommandBuffer commandBuffer, Frame& frame) {
+        if (frame.compactions.empty()) {
+            return false;
+        }
+        uint32_t count = static_cast<uint32_t>(frame.compactions.size());
+        VkResult result = vkGetQueryPoolResults(m_device, frame.compactedSizes, 0, count, sizeof(uint64_t) * count, m_compactedSizes.data(), sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        std::vector<Compaction> compactions = std::move(frame.compactions);
+        frame.compactions.clear();
+        if (result != VK_SUCCESS) {
+            return false;  // 结果不可用时保留没有compact的BLAS
+        }
+
+        bool changed = false;
+        for (uint32_t i = 0; i < count; i++) {
+            Blas& blas = m_blas[compactions[i].blas];
+            VkDeviceSize compactedSize = m_compactedSizes[i];
+            if (blas.generation != compactions[i].generation || blas.state != BlasState::built || compactedSize == 0 || compactedSize >= blas.size) {
+                continue;
+            }
+            Buffer buffer = createBuffer(compactedSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, false, "blas");
+            VkAccelerationStructureKHR compacted = createAccelerationStructure(buffer.buffer, compactedSize, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR);
+
+            VkCopyAccelerationStructureInfoKHR copyInfo{};
+            copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+            copyInfo.src = blas.handle;
+            copyInfo.dst = compacted;
+            copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+            m_cmdCopy(commandBuffer, &copyInfo);
+
+            m_deferDestroy([this, accelerationStructure = blas.handle, oldBuffer = blas.buffer]() {
+                m_destroyAccelerationStructure(m_device, accelerationStructure, hostAllocator());
+                destroyBuffer(oldBuffer);
+            });
+            m_blasBytes -= blas.size - compactedSize;
+            blas.handle = compacted;
+            blas.buffer = buffer;
+            blas.size = compactedSize;
+            blas.address = accelerationStructureAddress(compacted);
+            blas.state = BlasState::compacted;
+            m_stats.blasCompactions++;
+            changed = true;
+        }
+        return changed;
+    }
+
+    // BLAS：队列前面的BLAS按scratch和数量预算一次build，之后写入compacted size的查询，下一次录制这个frame in flight时读取
+    bool recordBlasBuilds(VkCommandBuffer commandBuffer, Frame& frame) {
+        std::vector<VkAccelerationStructureGeometryKHR> geometries;
+        std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos;
+        std::vector<VkAccelerationStructureBuildRangeInfoKHR> ranges;
+        std::vector<VkAccelerationStructureKHR> built;
+        geometries.reserve(m_maxBuildsPerFrame);  // buildInfos中的pGeometries指向这里，不能重新分配
+        VkDeviceSize scratchOffset = 0;
+        while (!m_pending.empty() && built.size() < m_maxBuildsPerFrame) {
+            uint32_t handle = m_pending.front();
+            Blas& blas = m_blas[handle];
+            if (blas.state != BlasState::pending) {
+                m_pending.pop_front();  // 排队期间已经被移除
+                continue;
+            }
+            if (scratchOffset + blas.scratchSize > m_scratchBudget) {
+                break;
+            }
+            m_pending.pop_front();
+
+            blas.buffer = createBuffer(blas.size, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, false, "blas");
+            blas.handle = createAccelerationStructure(blas.buffer.buffer, blas.size, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR);
+            blas.address = accelerationStructureAddress(blas.handle);
+            blas.state = BlasState::built;
+            m_blasBytes += blas.size;
+
+            geometries.push_back(triangleGeometry(blas.geometry));
+            VkAccelerationStructureBuildGeometryInfoKHR buildInfo = blasBuildInfo(&geometries.back());
+            buildInfo.dstAccelerationStructure = blas.handle;
+            buildInfo.scratchData.deviceAddress = frame.scratchAddress + scratchOffset;
+            buildInfos.push_back(buildInfo);
+            VkAccelerationStructureBuildRangeInfoKHR range{};
+            range.primitiveCount = blas.geometry.indexCount / 3;
+            ranges.push_back(range);
+            built.push_back(blas.handle);
+            frame.compactions.push_back({handle, blas.generation});
+            scratchOffset += blas.scratchSize;
+        }
+        if (built.empty()) {
+            return false;
+        }
+
+        std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> rangePointers(ranges.size());
+        for (size_t i = 0; i < ranges.size(); i++) {
+            rangePointers[i] = &ranges[i];
+        }
+        m_cmdBuild(commandBuffer, static_cast<uint32_t>(buildInfos.size()), buildInfos.data(), rangePointers.data());
+
+        // compaction：查询需要build完成，同一个query pool每次使用之前重置
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR);
+        uint32_t count = static_cast<uint32_t>(built.size());
+        vkCmdResetQueryPool(commandBuffer, frame.compactedSizes, 0, count);
+        m_cmdWriteProperties(commandBuffer, count, built.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, frame.compactedSizes, 0);
+        m_stats.blasBuilds = count;
+        return true;
+    }
+
+    // TLAS：实例写进这个frame in flight的映射buffer，实例数量和引用的BLAS都没有变化时refit，否则重新build
+    // 阴影不区分正反面，实例关闭三角形的背面剔除
+    void recordTlas(VkCommandBuffer commandBuffer, Frame& frame) {
+        auto* instances = static_cast<VkAccelerationStructureInstanceKHR*>(frame.instances.allocation.mapped);
+        uint32_t count = 0;
+        uint64_t topology = 14695981039346656037ull;  // FNV-1a
+        for (const Instance& instance : m_instances) {
+            if (!blasReady(instance.blas)) {
+                continue;
+            }
+            VkAccelerationStructureInstanceKHR& target = instances[count++];
+            for (int row = 0; row < 3; row++) {
+                for (int column = 0; column < 4; column++) {
+                    target.transform.matrix[row][column] = instance.transform[column][row];  // glm按列存储，VkTransformMatrixKHR是3x4的行
+                }
+            }
+            target.instanceCustomIndex = 0;
+            target.mask = 0xff;
+            target.instanceShaderBindingTableRecordOffset = 0;
+            target.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+            target.accelerationStructureReference = m_blas[instance.blas].address;
+            topology = (topology ^ target.accelerationStructureReference) * 1099511628211ull;
+        }
+        m_stats.instanceCount = count;
+        frame.valid = count > 0;
+        if (count == 0) {
+            return;
+        }
+
+        bool refit = frame.builtCount == count && frame.builtTopology == topology && frame.refits < REBUILD_INTERVAL;
+        VkAccelerationStructureGeometryKHR geometry = instanceGeometry(frame.instances.address);
+        VkAccelerationStructureBuildGeometryInfoKHR buildInfo = tlasBuildInfo(&geometry);
+        buildInfo.mode = refit ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        buildInfo.srcAccelerationStructure = refit ? frame.tlas : VK_NULL_HANDLE;
+        buildInfo.dstAccelerationStructure = frame.tlas;
+        buildInfo.scratchData.deviceAddress = frame.scratchAddress;  // BLAS build之后有barrier，scratch从头复用
+        VkAccelerationStructureBuildRangeInfoKHR range{};
+        range.primitiveCount = count;
+        const VkAccelerationStructureBuildRangeInfoKHR* rangePointer = &range;
+        m_cmdBuild(commandBuffer, 1, &buildInfo, &rangePointer);
+        frame.refits = refit ? frame.refits + 1 : 0;
+        frame.builtCount = count;
+        frame.builtTopology = topology;
+        m_stats.tlasRebuilt = !refit;
+
+        // 场景的片段着色器用ray query读取TLAS
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+        barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr,
+            0, nullptr);
+    }
+
+    // build之间的依赖：之前的写入对之后的build（读取BLAS、读写scratch）可见
+    static void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    static VkAccelerationStructureGeometryKHR triangleGeometry(const BlasGeometry& source) {
+        VkAccelerationStructureGeometryKHR geometry{};
+        geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+        geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+        geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;  // 阴影只关心有没有命中，不需要any hit
+        VkAccelerationStructureGeometryTrianglesDataKHR& triangles = geometry.geometry.triangles;
+        triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+        triangles.vertexFormat = source.vertexFormat;
+        triangles.vertexData.deviceAddress = source.vertexAddress;
+        triangles.vertexStride = source.vertexStride;
+        triangles.maxVertex = source.vertexCount > 0 ? source.vertexCount - 1 : 0;
+        triangles.indexType = source.indexType;
+        triangles.indexData.deviceAddress = source.indexAddress;
+        return geometry;
+    }
+
+    static VkAccelerationStructureBuildGeometryInfoKHR blasBuildInfo(const VkAccelerationStructureGeometryKHR* geometry) {
+        VkAccelerationStructureBuildGeometryInfoKHR buildInfo{};
+        buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+        buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+        buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        buildInfo.geometryCount = 1;
+        buildInfo.pGeometries = geometry;
+        return buildInfo;
+    }
+
+    static VkAccelerationStructureGeometryKHR instanceGeometry(VkDeviceAddress instances) {
+        VkAccelerationStructureGeometryKHR geometry{};
+        geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+        geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+        geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;
+        geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+        geometry.geometry.instances.arrayOfPointers = VK_FALSE;
+        geometry.geometry.instances.data.deviceAddress = instances;
+        return geometry;
+    }
+
+    // refit：TLAS需要ALLOW_UPDATE，build和update的flags必须一致
+    static VkAccelerationStructureBuildGeometryInfoKHR tlasBuildInfo(const VkAccelerationStructureGeometryKHR* geometry) {
+        VkAccelerationStructureBuildGeometryInfoKHR buildInfo{};
+        buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+        buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+        buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+        buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        buildInfo.geometryCount = 1;
+        buildInfo.pGeometries = geometry;
+        return buildInfo;
+    }
+
+    VkAccelerationStructureKHR createAccelerationStructure(VkBuffer buffer, VkDeviceSize size, VkAccelerationStructureTypeKHR type) {
+        VkAccelerationStructureCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+        createInfo.buffer = buffer;
+        createInfo.size = size;
+        createInfo.type = type;
+        VkAccelerationStructureKHR accelerationStructure;
+        if (m_createAccelerationStructure(m_device, &createInfo, hostAllocator(), &accelerationStructure) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create acceleration structure!");
+        }
+        return accelerationStructure;
+    }
+
+    VkDeviceAddress accelerationStructureAddress(VkAccelerationStructureKHR accelerationStructure) const {
+        VkAccelerationStructureDeviceAddressInfoKHR addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+        addressInfo.accelerationStructure = accelerationStructure;
+        return m_getAccelerationStructureAddress(m_device, &addressInfo);
+    }
+
+    // acceleration structure和scratch在device local内存中，实例由cpu每帧写入，使用持久映射的host visible内存
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, bool hostVisible, const char* name) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create acceleration structure buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        VkMemoryPropertyFlags properties = hostVisible ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        buffer.allocation = m_allocator->allocate(memRequirements, properties, true, MemoryCategory::geometry, 0, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+
+        buffer.address = bufferAddress(buffer.buffer);
+        return buffer;
+    }
+
+    void destroyBuffer(const Buffer& buffer) {
+        vkDestroyBuffer(m_device, buffer.buffer, hostAllocator());
+        Allocation allocation = buffer.allocation;
+        m_allocator->free(allocation);
+    }
+};
@@ -0,0 +1,481 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_cache.hpp"
+
+// asset pack：处理好的资源（mesh cache、ktx2压缩纹理、源图片）打包成一个文件，启动时映射一次，不再逐个打开小文件
+// 文件布局：header，紧接着是toc和名字表，然后是16字节对齐的blob；blob按打包时的顺序排列，按加载顺序打包时读取是顺序的
+// 每个blob可以单独用LZ4 block格式压缩，压缩后节省不到1/8的blob保持原样，读取时直接指向映射的内存
+// gpu decompression：ktx2纹理的level数据原样拷贝到image，按ASSET_PACK_BLOCK_SIZE分成独立压缩的LZ4 block，压缩的数据直接交给compute shader，
+// 每个线程解压一个block；cpu只解压读取范围覆盖的block，比如ktx2的header和level index
+// 资源按文件名（不含目录）查找，不在pack中的资源仍然从原来的路径读取；SPIR-V已经由shader registry嵌入可执行文件，不需要打包
+const uint32_t ASSET_PACK_MAGIC = 0x4b415056;  // "VPAK"
+const uint32_t ASSET_PACK_VERSION = 2;  // 2：分块的LZ4，只是增加了compression的取值，version 1的pack仍然可以读取
+const uint64_t ASSET_PACK_ALIGNMENT = 16;
+// gpu decompression：block越小gpu上并行的线程越多，但每个block的match只能引用block内部，压缩率降低
+// 需要是4的整数倍，每个线程写入的uint不和其它线程共享
+const uint32_t ASSET_PACK_BLOCK_SIZE = 16 * 1024;
+
+enum class AssetCompression : uint32_t {
+    none = 0,
+    lz4 = 1,
+    lz4Blocks = 2,  // gpu decompression：uint32的block offset表（block数量加一个元素，相对于表之后的数据），接着是紧密排列的block
+};
+
+struct AssetPackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t namesSize;
+    uint64_t tocOffset;
+    uint64_t namesOffset;
+};
+
+struct AssetPackEntry {
+    uint32_t nameOffset;  // 相对于名字表的开头
+    uint32_t nameLength;
+    uint64_t offset;  // 相对于文件开头，ASSET_PACK_ALIGNMENT对齐
+    uint64_t storedSize;  // pack中的字节数
+    uint64_t size;  // 解压后的字节数
+    uint32_t compression;
+    uint32_t reserved;
+};
+
+// lz4：一个sequence是token（高4位literal长度，低4位match长度减4）、literal、2字节offset和扩展的match长度
+// 贪心匹配，4字节序列的hash表只保存最近一次出现的位置；格式要求最后5个字节是literal，最后一个match在结束前12字节之前开始
+const uint32_t LZ4_HASH_BITS = 16;
+const uint64_t LZ4_MAX_RATIO = 255;  // 一个字节的扩展长度最多表示255个字节，解压后的大小不会超过输入的这个倍数
+const size_t LZ4_MIN_MATCH = 4;
+
+inline void lz4WriteLength(std::vector<char>& out, size_t length) {
+    for (; length >= 255; length -= 255) {
+        out.push_back(static_cast<char>(255));
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+inline std::vector<char> lz4Compress(const char* source, size_t size) {
+    std::vector<char> out;
+    out.reserve(size + size / 255 + 16);
+    std::vector<uint32_t> table(size_t(1) << LZ4_HASH_BITS, UINT32_MAX);
+
+    auto emit = [&](size_t literalStart, size_t literalLength, size_t offset, size_t matchLength) {
+        size_t matchCode = matchLength >= LZ4_MIN_MATCH ? matchLength - LZ4_MIN_MATCH : 0;
+        out.push_back(static_cast<char>((std::min<size_t>(literalLength, 15) << 4) | (matchLength > 0 ? std::min<size_t>(matchCode, 15) : 0)));
+        if (literalLength >= 15) {
+            lz4WriteLength(out, literalLength - 15);
+        }
+        out.insert(out.end(), source + literalStart, source + literalStart + literalLength);
+        if (matchLength == 0) {
+            return;  // 最后一个sequence只有literal
+        }
+        out.push_back(static_cast<char>(offset & 0xff));
+        out.push_back(static_cast<char>(offset >> 8));
+        if (matchCode >= 15) {
+            lz4WriteLength(out, matchCode - 15);
+        }
+    };
+
+    size_t anchor = 0;
+    size_t position = 0;
+    size_t matchStartLimit = size > 12 ? size - 12 : 0;
+    size_t matchEndLimit = size > 5 ? size - 5 : 0;
+    while (position < matchStartLimit) {
+        uint32_t sequence;
+        memcpy(&sequence, source + position, sizeof(sequence));
+        uint32_t hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+        uint32_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(position);
+        if (candidate == UINT32_MAX || position - candidate > 65535 || memcmp(source + candidate, source + position, LZ4_MIN_MATCH) != 0) {
+            position++;
+            continue;
+        }
+        size_t matchEnd = position + LZ4_MIN_MATCH;
+        while (matchEnd < matchEndLimit && source[matchEnd] == source[candidate + (matchEnd - position)]) {
+            matchEnd++;
+        }
+        emit(anchor, position - anchor, position - candidate, matchEnd - position);
+        position = anchor = matchEnd;
+    }
+    emit(anchor, size - anchor, 0, 0);
+    return out;
+}
+
+// lz4：解压到大小已知的目标，数据损坏（越界的offset或者长度）时返回false
+inline bool lz4Decompress(const char* source, size_t sourceSize, char* target, size_t targetSize) {
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(source);
+    size_t in = 0;
+    size_t out = 0;
+    auto readLength = [&](size_t& length) {
+        uint8_t byte;
+        do {
+            if (in >= sourceSize) {
+                return false;
+            }
+            byte = input[in++];
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (in < sourceSize) {
+        uint8_t token = input[in++];
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(literalLength)) {
+            return false;
+        }
+        if (literalLength > sourceSize - in || literalLength > targetSize - out) {
+            return false;
+        }
+        memcpy(target + out, source + in, literalLength);
+        in += literalLength;
+        out += literalLength;
+        if (in == sourceSize) {
+            break;  // 最后一个sequence没有match
+        }
+
+        if (sourceSize - in < 2) {
+            return false;
+        }
+        size_t offset = input[in] | (input[in + 1] << 8);
+        in += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(matchLength)) {
+            return false;
+        }
+        matchLength += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > out || matchLength > targetSize - out) {
+            return false;
+        }
+        for (size_t i = 0; i < matchLength; i++) {  // match可以和自己重叠，逐字节拷贝
+            target[out + i] = target[out - offset + i];
+        }
+        out += matchLength;
+    }
+    return out == targetSize;
+}
+
+// gpu decompression：每个block单独用lz4Compress压缩，压缩后不比原来小的block保持原样，两者按存储的大小区分
+inline std::vector<char> lz4CompressBlocks(const char* source, size_t size) {
+    uint32_t blockCount = static_cast<uint32_t>((size + ASSET_PACK_BLOCK_SIZE - 1) / ASSET_PACK_BLOCK_SIZE);
+    std::vector<uint32_t> offsets(blockCount + 1, 0);
+    std::vector<char> data;
+    for (uint32_t block = 0; block < blockCount; block++) {
+        size_t begin = static_cast<size_t>(block) * ASSET_PACK_BLOCK_SIZE;
+        size_t length = std::min<size_t>(ASSET_PACK_BLOCK_SIZE, size - begin);
+        std::vector<char> compressed = lz4Compress(source + begin, length);
+        if (compressed.size() < length) {
+            data.insert(data.end(), compressed.begin(), compressed.end());
+        } else {
+            data.insert(data.end(), source + begin, source + begin + length);
+        }
+        offsets[block + 1] = static_cast<uint32_t>(data.size());
+    }
+    std::vector<char> out(offsets.size() * sizeof(uint32_t));
+    memcpy(out.data(), offsets.data(), out.size());
+    out.insert(out.end(), data.begin(), data.end());
+    return out;
+}
+
+// gpu decompression：请求的字节范围覆盖的连续block，skip是范围的开头在解压结果中的偏移
+struct AssetBlockSpan {
+    uint32_t firstBlock = 0;
+    uint32_t blockCount = 0;
+    uint64_t outputSize = 0;  // 解压后的字节数，只有blob的最后一个block可能不满
+    uint64_t skip = 0;
+};
+
+inline AssetBlockSpan assetBlockSpan(uint64_t blobSize, uint64_t offset, uint64_t size) {
+    AssetBlockSpan span;
+    span.firstBlock = static_cast<uint32_t>(offset / ASSET_PACK_BLOCK_SIZE);
+    uint64_t endBlock = (offset + size + ASSET_PACK_BLOCK_SIZE - 1) / ASSET_PACK_BLOCK_SIZE;
+    span.blockCount = static_cast<uint32_t>(endBlock - span.firstBlock);
+    uint64_t begin = static_cast<uint64_t>(span.firstBlock) * ASSET_PACK_BLOCK_SIZE;
+    span.outputSize = std::min(endBlock * ASSET_PACK_BLOCK_SIZE, blobSize) - begin;
+    span.skip = offset - begin;
+    return span;
+}
+
+// gpu decompression：cpu上解压span中的block到target（span.outputSize字节），offset表或者block损坏时返回false
+inline bool lz4DecompressBlocks(const char* stored, size_t storedSize, uint64_t blobSize, const AssetBlockSpan& span, char* target) {
+    uint64_t blockCount = (blobSize + ASSET_PACK_BLOCK_SIZE - 1) / ASSET_PACK_BLOCK_SIZE;
+    size_t tableSize = static_cast<size_t>(blockCount + 1) * sizeof(uint32_t);
+    if (storedSize < tableSize || span.firstBlock + span.blockCount > blockCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < span.blockCount; i++) {
+        uint32_t block = span.firstBlock + i;
+        uint32_t begin;
+        uint32_t end;
+        memcpy(&begin, stored + static_cast<size_t>(block) * sizeof(uint32_t), sizeof(begin));
+        memcpy(&end, stored + static_cast<size_t>(block + 1) * sizeof(uint32_t), sizeof(end));
+        size_t length = static_cast<size_t>(std::min<uint64_t>(ASSET_PACK_BLOCK_SIZE, blobSize - static_cast<uint64_t>(block) * ASSET_PACK_BLOCK_SIZE));
+        if (begin > end || end > storedSize - tableSize) {
+            return false;
+        }
+        const char* source = stored + tableSize + begin;
+        char* output = target + static_cast<size_t>(i) * ASSET_PACK_BLOCK_SIZE;
+        if (end - begin == length) {
+            memcpy(output, source, length);
+        } else if (end - begin > length || !lz4Decompress(source, end - begin, output, length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// asset pack：按文件名查找的只读视图，open之后可以在任意线程上查找
+// 压缩的blob在第一次查找时解压并保留到close，返回的指针在close之前一直有效
+class AssetPack {
+public:
+    struct Blob {
+        const char* data = nullptr;
+        size_t size = 0;
+    };
+
+    // asset pack：进程中挂载的pack，模型、纹理和ktx2的加载都先在这里查找
+    static AssetPack& instance() {
+        static AssetPack pack;
+        return pack;
+    }
+
+    // asset pack：文件不存在返回false；文件损坏时抛出异常，避免静默使用一半的资源
+    bool open(const std::string& path) {
+        close();
+        if (!m_file.open(path)) {
+            return false;
+        }
+        AssetPackHeader header;
+        if (m_file.size() < sizeof(header)) {
+            throw std::runtime_error("invalid asset pack: " + path);
+        }
+        memcpy(&header, m_file.data(), sizeof(header));
+        // asset pack：偏移和大小都来自文件，写成offset > size || length > size - offset，不会回绕
+        const uint64_t fileSize = m_file.size();
+        const uint64_t tocSize = static_cast<uint64_t>(header.entryCount) * sizeof(AssetPackEntry);
+        if (header.magic != ASSET_PACK_MAGIC || header.version == 0 || header.version > ASSET_PACK_VERSION
+            || header.tocOffset > fileSize || tocSize > fileSize - header.tocOffset
+            || header.namesOffset > fileSize || header.namesSize > fileSize - header.namesOffset) {
+            throw std::runtime_error("invalid asset pack: " + path);
+        }
+
+        const char* names = m_file.data() + header.namesOffset;
+        m_entries.resize(header.entryCount);
+        memcpy(m_entries.data(), m_file.data() + header.tocOffset, m_entries.size() * sizeof(AssetPackEntry));
+        for (uint32_t i = 0; i < header.entryCount; i++) {
+            const AssetPackEntry& entry = m_entries[i];
+            // lz4：解压后的大小受压缩比的上限限制，损坏的toc不能让find分配任意大的内存
+            if (static_cast<uint64_t>(entry.nameOffset) + entry.nameLength > header.namesSize || entry.offset > fileSize || entry.storedSize > fileSize - entry.offset
+                || entry.offset % ASSET_PACK_ALIGNMENT != 0 || entry.compression > static_cast<uint32_t>(AssetCompression::lz4Blocks)
+                || (entry.compression == static_cast<uint32_t>(AssetCompression::none) && entry.storedSize != entry.size)
+                || entry.size > SIZE_MAX || entry.size / LZ4_MAX_RATIO > entry.storedSize) {
+                throw std::runtime_error("invalid asset pack entry: " + path);
+            }
+            m_byName[std::string(names + entry.nameOffset, entry.nameLength)] = i;
+        }
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_byName.clear();
+        m_entries.clear();
+        m_decoded.clear();
+        m_file.close();
+    }
+
+    bool mounted() const { return m_file.data() != nullptr; }
+    size_t entryCount() const { return m_entries.size(); }
+    bool contains(const std::string& path) const { return m_byName.count(assetName(path)) > 0; }
+
+    // gpu decompression：不在pack中时返回none
+    AssetCompression compression(const std::string& path) const {
+        auto it = m_byName.find(assetName(path));
+        return it == m_byName.end() ? AssetCompression::none : static_cast<AssetCompression>(m_entries[it->second].compression);
+    }
+
+    // asset pack：path可以带目录，只按文件名查找；没有找到时Blob::data为空
+    Blob find(const std::string& path) {
+        auto it = m_byName.find(assetName(path));
+        if (it == m_byName.end()) {
+            return {};
+        }
+        const AssetPackEntry& entry = m_entries[it->second];
+        const char* stored = m_file.data() + entry.offset;
+        if (entry.compression == static_cast<uint32_t>(AssetCompression::none)) {
+            return {stored, static_cast<size_t>(entry.size)};
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<char>& decoded = m_decoded[it->second];
+        if (decoded.empty() && entry.size > 0) {
+            decoded.resize(static_cast<size_t>(entry.size));
+            bool ok = entry.compression == static_cast<uint32_t>(AssetCompression::lz4)
+                ? lz4Decompress(stored, static_cast<size_t>(entry.storedSize), decoded.data(), decoded.size())
+                : lz4DecompressBlocks(stored, static_cast<size_t>(entry.storedSize), entry.size, assetBlockSpan(entry.size, 0, entry.size), decoded.data());
+            if (!ok) {
+                decoded.clear();
+                throw std::runtime_error("corrupted asset pack blob: " + it->first);
+            }
+        }
+        return {decoded.data(), decoded.size()};
+    }
+
+    // asset pack：资源解压后的大小，不在pack中时返回false
+    bool size(const std::string& path, size_t& size) const {
+        auto it = m_byName.find(assetName(path));
+        if (it == m_byName.end()) {
+            return false;
+        }
+        size = static_cast<size_t>(m_entries[it->second].size);
+        return true;
+    }
+
+    // gpu decompression：只读取[offset, offset + size)，分块的blob只解压覆盖的block，不保留解压结果；其它blob和find一样
+    void read(const std::string& path, uint64_t offset, uint64_t size, char* target) {
+        auto it = m_byName.find(assetName(path));
+        if (it == m_byName.end() || offset + size > m_entries[it->second].size) {
+            throw std::runtime_error("failed to read asset pack blob: " + path);
+        }
+        const AssetPackEntry& entry = m_entries[it->second];
+        if (entry.compression != static_cast<uint32_t>(AssetCompression::lz4Blocks)) {
+            memcpy(target, find(path).data + offset, static_cast<size_t>(size));
+            return;
+        }
+        AssetBlockSpan span = assetBlockSpan(entry.size, offset, size);
+        std::vector<char> decoded(static_cast<size_t>(span.outputSize));
+        if (!lz4DecompressBlocks(m_file.data() + entry.offset, static_cast<size_t>(entry.storedSize), entry.size, span, decoded.data())) {
+            throw std::runtime_error("corrupted asset pack blob: " + it->first);
+        }
+        memcpy(target, decoded.data() + span.skip, static_cast<size_t>(size));
+    }
+
+    // gpu decompression：分块的blob中覆盖[offset, offset + size)的block原样复制成compute shader的输入：
+    // 重新从0开始的offset表（span.blockCount加一个元素），接着是这些block的压缩数据；blob不是分块压缩时返回false
+    bool readBlocks(const std::string& path, uint64_t offset, uint64_t size, AssetBlockSpan& span, std::vector<char>& input) const {
+        auto it = m_byName.find(assetName(path));
+        if (it == m_byName.end() || m_entries[it->second].compression != static_cast<uint32_t>(AssetCompression::lz4Blocks)
+            || offset + size > m_entries[it->second].size || size == 0) {
+            return false;
+        }
+        const AssetPackEntry& entry = m_entries[it->second];
+        const char* stored = m_file.data() + entry.offset;
+        uint64_t blockCount = (entry.size + ASSET_PACK_BLOCK_SIZE - 1) / ASSET_PACK_BLOCK_SIZE;
+        size_t tableSize = static_cast<size_t>(blockCount + 1) * sizeof(uint32_t);
+        if (tableSize > entry.storedSize) {
+            throw std::runtime_error("corrupted asset pack blob: " + it->first);
+        }
+        span = assetBlockSpan(entry.size, offset, size);
+        std::vector<uint32_t> offsets(span.blockCount + 1);
+        memcpy(offsets.data(), stored + static_cast<size_t>(span.firstBlock) * sizeof(uint32_t), offsets.size() * sizeof(uint32_t));
+        uint32_t base = offsets[0];
+        if (offsets.back() < base || tableSize + offsets.back() > entry.storedSize) {
+            throw std::runtime_error("corrupted asset pack blob: " + it->first);
+        }
+        for (uint32_t& blockOffset : offsets) {
+            blockOffset -= base;
+        }
+        input.resize(offsets.size() * sizeof(uint32_t) + offsets.back());
+        memcpy(input.data(), offsets.data(), offsets.size() * sizeof(uint32_t));
+        memcpy(input.data() + offsets.size() * sizeof(uint32_t), stored + tableSize + base, offsets.back());
+        return true;
+    }
+
+    static std::string assetName(const std::string& path) {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+private:
+    MappedFile m_file;
+    std::vector<AssetPackEntry> m_entries;
+    std::unordered_map<std::string, uint32_t> m_byName;
+    std::mutex m_mutex;
+    std::unordered_map<uint32_t, std::vector<char>> m_decoded;
+};
+
+// asset pack：打包工具使用，files中的名字是查找用的文件名，按给定的顺序写入；compress为false时全部不压缩
+// compression是压缩时使用的格式，节省不到1/8时仍然不压缩
+// 和mesh cache一样先写入临时文件再重命名
+struct AssetPackSource {
+    std::string name;
+    std::vector<char> data;
+    AssetCompression compression = AssetCompression::lz4;
+};
+
+inline bool writeAssetPack(const std::string& path, const std::vector<AssetPackSource>& files, bool compress) {
+    auto align = [](uint64_t offset) { return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT; };
+
+    std::string names;
+    std::vector<AssetPackEntry> entries(files.size());
+    std::vector<std::vector<char>> compressed(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        AssetPackEntry& entry = entries[i];
+        entry.nameOffset = static_cast<uint32_t>(names.size());
+        entry.nameLength = static_cast<uint32_t>(files[i].name.size());
+        names += files[i].name;
+        entry.size = files[i].data.size();
+        entry.storedSize = entry.size;
+        if (compress && !files[i].data.empty() && files[i].compression != AssetCompression::none) {
+            compressed[i] = files[i].compression == AssetCompression::lz4Blocks ? lz4CompressBlocks(files[i].data.data(), files[i].data.size())
+                : lz4Compress(files[i].data.data(), files[i].data.size());
+            if (compressed[i].size() < entry.size - entry.size / 8) {
+                entry.compression = static_cast<uint32_t>(files[i].compression);
+                entry.storedSize = compressed[i].size();
+            } else {
+                compressed[i].clear();
+            }
+        }
+    }
+
+    AssetPackHeader header{};
+    header.magic = ASSET_PACK_MAGIC;
+    header.version = ASSET_PACK_VERSION;
+    header.entryCount = static_cast<uint32_t>(entries.size());
+    header.namesSize = static_cast<uint32_t>(names.size());
+    header.tocOffset = sizeof(AssetPackHeader);
+    header.namesOffset = header.tocOffset + entries.size() * sizeof(AssetPackEntry);
+    uint64_t offset = align(header.namesOffset + names.size());
+    for (AssetPackEntry& entry : entries) {
+        entry.offset = offset;
+        offset = align(offset + entry.storedSize);
+    }
+
+    std::string tempPath = path + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    const char zeros[ASSET_PACK_ALIGNMENT] = {};
+    uint64_t written = 0;
+    auto write = [&](const char* data, uint64_t size) {
+        file.write(data, static_cast<std::streamsize>(size));
+        written += size;
+    };
+    write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(AssetPackEntry));
+    write(names.data(), names.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        write(zeros, entries[i].offset - written);
+        const std::vector<char>& blob = compressed[i].empty() ? files[i].data : compressed[i];
+        write(blob.data(), blob.size());
+    }
+    file.close();
+    if (!file) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    std::remove(path.c_str());  // 有些平台上rename不会覆盖已有文件
+    return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
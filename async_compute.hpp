@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "timeline_semaphore.hpp"
+
+// async compute：设备有支持compute但不支持图形的queue family时，和这一帧渲染无关的compute在这个队列上提前执行，和图形队列的光栅化重叠
+// 每个frame in flight一个command buffer，提交signal计算队列自己的timeline，图形队列的提交在读取结果的阶段等待这个值
+// semaphore的signal和wait同时完成内存的available和visible，所以两边都不需要barrier；多个queue family访问的资源由调用者创建为CONCURRENT
+// 上一次使用这一帧command buffer的计算提交排在同一帧的图形提交之前，cpu等到图形提交完成后重新录制是安全的
+class AsyncCompute {
+public:
+    // computeFamily等于graphicsFamily时没有专用的计算队列，其它方法都不应该被调用
+    void init(VkDevice device, uint32_t computeFamily, VkQueue computeQueue, uint32_t graphicsFamily, uint32_t frameCount) {
+        m_device = device;
+        m_computeFamily = computeFamily;
+        m_computeQueue = computeQueue;
+        m_graphicsFamily = graphicsFamily;
+        if (!enabled()) {
+            return;
+        }
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = computeFamily;
+        if (vkCreateCommandPool(m_device, &poolInfo, hostAllocator(), &m_commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create async compute command pool!");
+        }
+
+        m_commandBuffers.resize(frameCount);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = frameCount;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate async compute command buffers!");
+        }
+
+        m_timeline.init(device);
+    }
+
+    void cleanup() {
+        if (m_commandPool == VK_NULL_HANDLE) {
+            return;
+        }
+        m_timeline.cleanup();
+        vkDestroyCommandPool(m_device, m_commandPool, hostAllocator());  // command buffer随pool一起释放
+        m_commandPool = VK_NULL_HANDLE;
+        m_commandBuffers.clear();
+    }
+
+    bool enabled() const { return m_computeFamily != m_graphicsFamily; }
+    uint32_t family() const { return m_computeFamily; }
+
+    // async compute：需要被两个队列访问的资源的queue family列表，没有专用队列时只有图形队列
+    std::vector<uint32_t> queueFamilies() const {
+        if (!enabled()) {
+            return {m_graphicsFamily};
+        }
+        return {m_graphicsFamily, m_computeFamily};
+    }
+
+    // async compute：重置并开始录制这一帧的command buffer
+    VkCommandBuffer begin(uint32_t frameIndex) {
+        VkCommandBuffer commandBuffer = m_commandBuffers[frameIndex];
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin async compute command buffer!");
+        }
+        return commandBuffer;
+    }
+
+    // async compute：提交这一帧的command buffer，返回signal的值，图形队列的提交需要等待它
+    uint64_t submit(uint32_t frameIndex) {
+        VkCommandBuffer commandBuffer = m_commandBuffers[frameIndex];
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record async compute command buffer!");
+        }
+
+        uint64_t value = m_timeline.nextValue();
+        VkSemaphore semaphore = m_timeline.handle();
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &value;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &semaphore;
+        if (vkQueueSubmit(m_computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit async compute command buffer!");
+        }
+        return value;
+    }
+
+    VkSemaphore semaphore() const { return m_timeline.handle(); }
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    uint32_t m_computeFamily = 0;
+    uint32_t m_graphicsFamily = 0;
+    VkQueue m_computeQueue = VK_NULL_HANDLE;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> m_commandBuffers;
+    TimelineSemaphore m_timeline;
+};
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "job_pool.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ASYNC_IO_URING 1
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#define ASYNC_IO_DISPATCH 1
+#include <dispatch/dispatch.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// async io：整个文件的异步读取，read马上返回id，读取完成后按完成顺序从wait或poll取回内容
+// linux上使用io_uring（直接用系统调用，不依赖liburing），内核不支持或被禁止时回退到io线程；macos上使用dispatch_io；其它平台只有io线程
+// read和wait/poll只在一个线程上调用（加载纹理的主线程），完成的内容交给调用者，之后的解码在job pool中进行
+class AsyncFileReader {
+public:
+    using ReadId = uint64_t;
+
+    struct Completion {
+        ReadId id = 0;
+        std::string path;
+        std::vector<char> data;
+        bool ok = false;  // 文件不存在或者读取出错时为false，data为空
+    };
+
+    // async io：queueDepth是io_uring同时提交的读取数量上限，也是回退时io线程的数量上限
+    void init(uint32_t queueDepth = 64) {
+        m_queueDepth = queueDepth;
+#if ASYNC_IO_URING
+        if (initUring()) {
+            return;
+        }
+#endif
+#if !ASYNC_IO_DISPATCH
+        m_threads.init(std::min(queueDepth, 4u));  // io线程只等待磁盘，数量不需要和cpu核数相关
+#endif
+    }
+
+    void cleanup() {
+        while (inFlight() > 0) {
+            wait();  // 提交的读取引用了这里的buffer，等它们全部完成
+        }
+#if ASYNC_IO_URING
+        if (m_ringFd >= 0) {
+            munmap(m_sqes, m_sqesSize);
+            if (m_cqRing != m_sqRing) {
+                munmap(m_cqRing, m_cqRingSize);
+            }
+            munmap(m_sqRing, m_sqRingSize);
+            ::close(m_ringFd);
+            m_ringFd = -1;
+            return;
+        }
+#endif
+#if !ASYNC_IO_DISPATCH
+        m_threads.cleanup();
+#endif
+    }
+
+    const char* backend() const {
+#if ASYNC_IO_URING
+        if (m_ringFd >= 0) {
+            return "io_uring";
+        }
+#endif
+#if ASYNC_IO_DISPATCH
+        return "dispatch_io";
+#else
+        return "io threads";
+#endif
+    }
+
+    ReadId read(const std::string& path) {
+        ReadId id = m_nextId++;
+        m_inFlight++;
+#if ASYNC_IO_URING
+        if (m_ringFd >= 0) {
+            readUring(id, path);
+            return id;
+        }
+#endif
+#if ASYNC_IO_DISPATCH
+        readDispatch(id, path);
+#else
+        m_threads.submit([this, id, path]() {
+            Completion completion;
+            completion.id = id;
+            completion.path = path;
+            std::ifstream file(path, std::ios::ate | std::ios::binary);
+            if (file.is_open()) {
+                completion.data.resize(static_cast<size_t>(file.tellg()));
+                file.seekg(0);
+                completion.ok = static_cast<bool>(file.read(completion.data.data(), completion.data.size()));
+            }
+            complete(std::move(completion));
+        });
+#endif
+        return id;
+    }
+
+    size_t inFlight() const { return m_inFlight; }
+
+    // async io：阻塞直到有一个读取完成，必须有还没取回的读取
+    Completion wait() {
+#if ASYNC_IO_URING
+        if (m_ringFd >= 0) {
+            while (m_ready.empty()) {
+                reapUring(true);
+            }
+        }
+#endif
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]() { return !m_ready.empty(); });
+        return takeReady();
+    }
+
+    // async io：不阻塞，没有完成的读取时返回false
+    bool poll(Completion& out) {
+#if ASYNC_IO_URING
+        if (m_ringFd >= 0 && m_ready.empty()) {
+            reapUring(false);
+        }
+#endif
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_ready.empty()) {
+            return false;
+        }
+        out = takeReady();
+        return true;
+    }
+
+    // async io：取回指定的读取，先完成的其它读取暂存起来，之后按id取回；texture cache和异步加载的task同时读取时互不抢走对方的结果
+    Completion wait(ReadId id) {
+        while (m_arrived.count(id) == 0) {
+            Completion completion = wait();
+            m_arrived[completion.id] = std::move(completion);
+        }
+        return takeArrived(id);
+    }
+
+    bool poll(ReadId id, Completion& out) {
+        Completion completion;
+        while (m_arrived.count(id) == 0 && poll(completion)) {
+            m_arrived[completion.id] = std::move(completion);
+        }
+        if (m_arrived.count(id) == 0) {
+            return false;
+        }
+        out = takeArrived(id);
+        return true;
+    }
+
+private:
+    Completion takeArrived(ReadId id) {
+        auto arrived = m_arrived.find(id);
+        Completion completion = std::move(arrived->second);
+        m_arrived.erase(arrived);
+        return completion;
+    }
+
+    // async io：调用者持有m_mutex
+    Completion takeReady() {
+        Completion completion = std::move(m_ready.front());
+        m_ready.pop_front();
+        m_inFlight--;
+        return completion;
+    }
+
+    void complete(Completion completion) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!completion.ok) {
+                completion.data.clear();
+            }
+            m_ready.push_back(std::move(completion));
+        }
+        m_condition.notify_one();
+    }
+
+#if ASYNC_IO_URING
+    // io_uring：一个文件一个请求，短读时从已经读到的位置重新提交剩下的部分；iovec在请求完成前不能移动，所以请求单独分配
+    struct UringRequest {
+        Completion completion;
+        int fd = -1;
+        size_t offset = 0;
+        iovec iov{};
+    };
+
+    bool initUring() {
+        io_uring_params params{};
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, m_queueDepth, &params));
+        if (fd < 0) {
+            return false;  // 内核太旧、被seccomp禁止或者关闭了io_uring
+        }
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) {
+            m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        }
+        m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (m_sqRing == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        m_cqRing = singleMmap ? m_sqRing : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = m_cqRing == MAP_FAILED ? MAP_FAILED : mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing) {
+                munmap(m_cqRing, m_cqRingSize);
+            }
+            munmap(m_sqRing, m_sqRingSize);
+            ::close(fd);
+            return false;
+        }
+
+        char* sq = static_cast<char*>(m_sqRing);
+        char* cq = static_cast<char*>(m_cqRing);
+        m_sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        m_sqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+        m_cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        m_cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+        m_sqEntries = params.sq_entries;
+        m_ringFd = fd;
+        return true;
+    }
+
+    void readUring(ReadId id, const std::string& path) {
+        auto request = std::make_unique<UringRequest>();
+        request->completion.id = id;
+        request->completion.path = path;
+        request->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (request->fd < 0 || fstat(request->fd, &info) != 0) {
+            finishUring(std::move(request), false);
+            return;
+        }
+        request->completion.data.resize(static_cast<size_t>(info.st_size));
+        if (request->completion.data.empty()) {
+            finishUring(std::move(request), true);
+            return;
+        }
+
+        while (m_uringRequests.size() >= m_sqEntries) {
+            reapUring(true);  // 提交的读取达到队列深度，等待其中一个完成
+        }
+        UringRequest* pending = request.get();
+        m_uringRequests[id] = std::move(request);
+        submitUring(*pending);
+    }
+
+    void submitUring(UringRequest& request) {
+        request.iov.iov_base = request.completion.data.data() + request.offset;
+        request.iov.iov_len = request.completion.data.size() - request.offset;
+
+        uint32_t tail = *m_sqTail;  // 只有这个线程写sq，不需要acquire
+        uint32_t index = tail & m_sqMask;
+        io_uring_sqe& sqe = m_sqes[index];
+        sqe = {};
+        sqe.opcode = IORING_OP_READV;  // readv从5.1开始可用，比IORING_OP_READ支持的内核更多
+        sqe.fd = request.fd;
+        sqe.off = request.offset;
+        sqe.addr = reinterpret_cast<uint64_t>(&request.iov);
+        sqe.len = 1;
+        sqe.user_data = request.completion.id;
+        m_sqArray[index] = index;
+        __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+        if (syscall(__NR_io_uring_enter, m_ringFd, 1, 0, 0, nullptr, 0) < 0) {
+            __atomic_store_n(m_sqTail, tail, __ATOMIC_RELEASE);  // 没有被内核取走，撤回这个sqe
+            auto node = m_uringRequests.find(request.completion.id);
+            std::unique_ptr<UringRequest> failed = std::move(node->second);
+            m_uringRequests.erase(node);
+            finishUring(std::move(failed), false);
+        }
+    }
+
+    // io_uring：wait为true时至少等到一个cqe，处理所有已经完成的cqe
+    void reapUring(bool wait) {
+        if (wait && m_uringRequests.empty()) {
+            return;
+        }
+        if (wait) {
+            syscall(__NR_io_uring_enter, m_ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        }
+        uint32_t head = *m_cqHead;
+        uint32_t tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        std::vector<UringRequest*> resubmit;
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+            auto node = m_uringRequests.find(cqe.user_data);
+            UringRequest& request = *node->second;
+            if (cqe.res > 0) {
+                request.offset += static_cast<size_t>(cqe.res);
+            }
+            if (cqe.res > 0 && request.offset < request.completion.data.size()) {
+                resubmit.push_back(&request);  // 短读
+                continue;
+            }
+            bool ok = request.offset == request.completion.data.size();  // res为0时文件被截短，小于0是错误
+            std::unique_ptr<UringRequest> finished = std::move(node->second);
+            m_uringRequests.erase(node);
+            finishUring(std::move(finished), ok);
+        }
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        for (UringRequest* request : resubmit) {
+            submitUring(*request);
+        }
+    }
+
+    void finishUring(std::unique_ptr<UringRequest> request, bool ok) {
+        if (request->fd >= 0) {
+            ::close(request->fd);
+        }
+        request->completion.ok = ok;
+        complete(std::move(request->completion));
+    }
+
+    int m_ringFd = -1;
+    void* m_sqRing = nullptr;
+    void* m_cqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    size_t m_cqRingSize = 0;
+    size_t m_sqesSize = 0;
+    uint32_t* m_sqTail = nullptr;
+    uint32_t* m_sqArray = nullptr;
+    uint32_t m_sqMask = 0;
+    uint32_t m_sqEntries = 0;
+    uint32_t* m_cqHead = nullptr;
+    uint32_t* m_cqTail = nullptr;
+    uint32_t m_cqMask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+    io_uring_sqe* m_sqes = nullptr;
+    std::unordered_map<ReadId, std::unique_ptr<UringRequest>> m_uringRequests;
+#endif
+
+#if ASYNC_IO_DISPATCH
+    // dispatch_io：dispatch_read在全局队列上读取整个文件，完成的handler在dispatch的线程上调用
+    void readDispatch(ReadId id, const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            Completion completion;
+            completion.id = id;
+            completion.path = path;
+            complete(std::move(completion));
+            return;
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        dispatch_read(fd, size, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^(dispatch_data_t data, int error) {
+            __block Completion completion;  // 在下面的block中追加内容
+            completion.id = id;
+            completion.path = path;
+            completion.data.reserve(size);
+            dispatch_data_apply(data, ^bool(dispatch_data_t, size_t, const void* buffer, size_t length) {
+                const char* bytes = static_cast<const char*>(buffer);
+                completion.data.insert(completion.data.end(), bytes, bytes + length);
+                return true;
+            });
+            completion.ok = error == 0 && completion.data.size() == size;
+            ::close(fd);
+            complete(std::move(completion));
+        });
+    }
+#endif
+
+    uint32_t m_queueDepth = 64;
+    ReadId m_nextId = 1;
+    size_t m_inFlight = 0;  // 已经提交但还没有被wait或poll取回的读取
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<Completion> m_ready;
+    std::unordered_map<ReadId, Completion> m_arrived;  // 已经取回但还没有按id取走的读取，只在调用read的线程访问
+#if !ASYNC_IO_DISPATCH
+    JobPool m_threads;  // io_uring不可用时的io线程，和解码的job pool分开，阻塞的读取不占用cpu的工作线程
+#endif
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "async_io.hpp"
+#include "job_pool.hpp"
+#include "timeline_semaphore.hpp"
+#include "upload_context.hpp"
+
+// async task：c++20 coroutine，多步的加载流程（后台导入 → 上传 → 等待gpu）按顺序写在一个函数中，等待时不阻塞任何线程
+// 每个co_await挂起task，条件满足后由AsyncScheduler::pump在调用pump的线程（vulkan的线程）恢复，所以co_await之间可以直接录制上传
+// runOnJobPool的函数在job pool执行，其它awaitable由pump轮询：文件读取、upload context的ticket和timeline的值
+template<typename T = void>
+class Task;
+
+namespace async_task_detail {
+
+// async task：task创建后挂起，被co_await或者spawn时才开始执行，结束时恢复等待它的task
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T result) { value = std::move(result); }
+
+    T take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+
+    void take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+}  // namespace async_task_detail
+
+template<typename T>
+class Task {
+public:
+    using promise_type = async_task_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(Handle handle) : m_handle(handle) {}
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { destroy(); }
+
+    bool done() const { return !m_handle || m_handle.done(); }
+
+    // async task：co_await一个task时直接转到它执行（symmetric transfer），它结束时返回这里，异常在这里重新抛出
+    bool await_ready() const noexcept { return done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+        m_handle.promise().continuation = continuation;
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().take(); }
+
+private:
+    friend class AsyncScheduler;
+
+    void destroy() {
+        if (m_handle) {
+            m_handle.destroy();
+            m_handle = nullptr;
+        }
+    }
+
+    Handle m_handle;
+};
+
+namespace async_task_detail {
+
+template<typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+}  // namespace async_task_detail
+
+// async task：只在一个线程（主线程，或者渲染线程模式下的渲染线程）调用spawn和pump，job pool的线程只通过resumeLater交回task
+class AsyncScheduler {
+public:
+    struct ConditionAwaiter {
+        AsyncScheduler& scheduler;
+        std::function<bool()> condition;
+
+        bool await_ready() const { return condition(); }
+        void await_suspend(std::coroutine_handle<> handle) { scheduler.m_polls.push_back({std::move(condition), handle}); }
+        void await_resume() const noexcept {}
+    };
+
+    // async task：开始执行一个顶层task，第一次co_await之前的部分在这里同步执行
+    void spawn(Task<void> task) {
+        std::coroutine_handle<> handle = task.m_handle;
+        m_tasks.push_back(std::move(task));
+        handle.resume();
+    }
+
+    // async task：每帧调用，恢复job已经完成和条件已经满足的task，回收结束的task；顶层task的异常在这里重新抛出
+    void pump() {
+        std::vector<std::coroutine_handle<>> resumed;
+        {
+            std::lock_guard<std::mutex> lock(m_resumedMutex);
+            resumed.swap(m_resumed);
+        }
+        for (std::coroutine_handle<> handle : resumed) {
+            handle.resume();
+        }
+
+        // 恢复的task可能再次co_await，新的等待加在m_polls中，这一轮不检查
+        std::vector<Poll> polls;
+        polls.swap(m_polls);
+        for (size_t i = 0; i < polls.size(); i++) {
+            if (polls[i].ready()) {
+                polls[i].handle.resume();
+            } else {
+                m_polls.push_back(std::move(polls[i]));
+            }
+        }
+
+        for (size_t i = 0; i < m_tasks.size();) {
+            if (!m_tasks[i].done()) {
+                i++;
+                continue;
+            }
+            Task<void> task = std::move(m_tasks[i]);
+            m_tasks[i] = std::move(m_tasks.back());
+            m_tasks.pop_back();
+            task.await_resume();
+        }
+    }
+
+    size_t pending() const { return m_tasks.size(); }
+
+    // async task：等待所有task结束，job中的task引用了调用者的对象，需要在job pool和file reader之前清理
+    void cleanup() {
+        while (!m_tasks.empty()) {
+            pump();
+            if (!m_tasks.empty()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // async task：job pool的线程调用，task在下一次pump时恢复
+    void resumeLater(std::coroutine_handle<> handle) {
+        std::lock_guard<std::mutex> lock(m_resumedMutex);
+        m_resumed.push_back(handle);
+    }
+
+    // async task：function在job pool中执行，返回值是co_await的结果，抛出的异常在co_await处重新抛出
+    template<typename Function>
+    auto runOnJobPool(JobPool& pool, Function function) {
+        using Result = std::invoke_result_t<Function&>;
+        struct Awaiter {
+            AsyncScheduler& scheduler;
+            JobPool& pool;
+            Function function;
+            std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>> result{};
+            std::exception_ptr error;
+
+            // async task：result和error由job填写，构造时只传入固定的成员
+            Awaiter(AsyncScheduler& scheduler, JobPool& pool, Function function) : scheduler(scheduler), pool(pool), function(std::move(function)) {}
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                pool.submit([this, handle]() {
+                    try {
+                        if constexpr (std::is_void_v<Result>) {
+                            function();
+                        } else {
+                            result = function();
+                        }
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                    scheduler.resumeLater(handle);
+                });
+            }
+            Result await_resume() {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                if constexpr (!std::is_void_v<Result>) {
+                    return std::move(*result);
+                }
+            }
+        };
+        return Awaiter(*this, pool, std::move(function));
+    }
+
+    // async task：整个文件的异步读取，co_await的结果和AsyncFileReader::wait一样，读取失败时ok为false
+    auto readFile(AsyncFileReader& reader, std::string path) {
+        struct Awaiter {
+            AsyncScheduler& scheduler;
+            AsyncFileReader& reader;
+            std::string path;
+            AsyncFileReader::Completion completion;
+
+            // async task：completion由poll填写
+            Awaiter(AsyncScheduler& scheduler, AsyncFileReader& reader, std::string path) : scheduler(scheduler), reader(reader), path(std::move(path)) {}
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                AsyncFileReader::ReadId id = reader.read(path);
+                scheduler.m_polls.push_back({[this, id]() { return reader.poll(id, completion); }, handle});
+            }
+            AsyncFileReader::Completion await_resume() { return std::move(completion); }
+        };
+        return Awaiter(*this, reader, std::move(path));
+    }
+
+    // async task：等待upload context的ticket完成，之后上传的资源可以在渲染中使用
+    ConditionAwaiter uploadComplete(UploadContext& uploadContext, uint64_t ticket) {
+        return until([&uploadContext, ticket]() { return uploadContext.isComplete(ticket); });
+    }
+
+    // async task：等待timeline达到value，这个程序的gpu提交都用timeline同步，不使用fence
+    ConditionAwaiter gpuTimeline(TimelineSemaphore& timeline, uint64_t value) {
+        return until([&timeline, value]() { return timeline.isComplete(value); });
+    }
+
+    // async task：每次pump检查一次condition，为true时恢复
+    ConditionAwaiter until(std::function<bool()> condition) { return ConditionAwaiter{*this, std::move(condition)}; }
+
+private:
+    struct Poll {
+        std::function<bool()> ready;
+        std::coroutine_handle<> handle;
+    };
+
+    std::vector<Task<void>> m_tasks;
+    std::vector<Poll> m_polls;
+    std::mutex m_resumedMutex;  // 保护m_resumed，其它成员只在调用pump的线程访问
+    std::vector<std::coroutine_handle<>> m_resumed;
+};
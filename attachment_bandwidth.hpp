@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// attachment bandwidth：按loadOp/storeOp估计一帧中attachment和显存之间的流量，render graph每次录制时重新统计
+// 估计按tile based gpu的模型：LOAD读一次整个attachment，STORE写一次，CLEAR、DONT_CARE和STORE_OP_NONE不访问显存，resolve写一次单采样的image
+// 立即渲染的gpu上depth test和blend还会反复读写，这里只是下限；compute的storage image访问不计入
+class AttachmentBandwidth {
+public:
+    struct Entry {
+        std::string pass;
+        std::string attachment;
+        uint64_t readBytes = 0;
+        uint64_t writeBytes = 0;
+    };
+
+    // attachment bandwidth：每个像素每个采样的字节数，只列出使用的格式；depth/stencil格式只算depth，stencil没有作为attachment
+    static uint32_t bytesPerPixel(VkFormat format) {
+        switch (format) {
+            case VK_FORMAT_D16_UNORM:
+                return 2;
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+                return 8;
+            case VK_FORMAT_D32_SFLOAT:
+            case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            case VK_FORMAT_D24_UNORM_S8_UINT:
+            case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+            case VK_FORMAT_B8G8R8A8_SRGB:
+            case VK_FORMAT_B8G8R8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            default:
+                return 4;
+        }
+    }
+
+    void reset() { m_entries.clear(); }
+
+    void add(const std::string& pass, const std::string& attachment, VkFormat format, VkExtent2D extent, VkSampleCountFlagBits samples, VkAttachmentLoadOp loadOp,
+        VkAttachmentStoreOp storeOp) {
+        uint64_t bytes = uint64_t(extent.width) * extent.height * bytesPerPixel(format) * uint32_t(samples);
+        Entry entry{pass, attachment};
+        entry.readBytes = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? bytes : 0;
+        entry.writeBytes = storeOp == VK_ATTACHMENT_STORE_OP_STORE ? bytes : 0;
+        m_entries.push_back(entry);
+    }
+
+    // attachment bandwidth：msaa resolve只写单采样的目标
+    void addResolve(const std::string& pass, const std::string& attachment, VkFormat format, VkExtent2D extent) {
+        Entry entry{pass, attachment + " resolve"};
+        entry.writeBytes = uint64_t(extent.width) * extent.height * bytesPerPixel(format);
+        m_entries.push_back(entry);
+    }
+
+    const std::vector<Entry>& entries() const { return m_entries; }
+
+    uint64_t totalBytes() const {
+        uint64_t total = 0;
+        for (const Entry& entry : m_entries) {
+            total += entry.readBytes + entry.writeBytes;
+        }
+        return total;
+    }
+
+    void report(std::ostream& out) const {
+        auto toKB = [](uint64_t bytes) { return std::to_string((bytes + 512) / 1024) + " KB"; };
+        out << "attachment bandwidth per frame: " << toKB(totalBytes()) << '\n';
+        for (const Entry& entry : m_entries) {
+            out << "  " << entry.pass << " / " << entry.attachment << ": read " << toKB(entry.readBytes) << ", write " << toKB(entry.writeBytes) << '\n';
+        }
+    }
+
+private:
+    std::vector<Entry> m_entries;
+};
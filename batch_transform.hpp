@@ -0,0 +1,150 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BATCH_TRANSFORM_SSE 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define BATCH_TRANSFORM_NEON 1
+#endif
+
+// batch transform：很多实例的矩阵乘法，一个矩阵对所有实例不变（sceneModel、viewProj或者父节点），每个实例只有另一个矩阵不同
+// 不变的矩阵在循环外展开到寄存器中：左乘的固定矩阵保留4列，右乘的固定矩阵每个元素广播成一个向量，每个实例16次乘加
+// 应用本身不定义GLM_FORCE_INTRINSICS（vec3需要保持12字节，顶点和ubo的布局都依赖它），所以这里直接用SSE（x86）或者NEON（arm64，Apple GPU的mac）
+// 输入和输出按stride访问列主序的16个float，可以直接读写InstanceData数组和持久映射的instance buffer，不经过中间的vector
+// 其它平台使用和glm相同的标量实现
+struct BatchTransform {
+    // batch transform：TRS直接组合成矩阵，和translate * mat4_cast * scale的结果相同，不做两次4x4矩阵乘法
+    static glm::mat4 compose(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+        glm::mat3 basis = glm::mat3_cast(rotation);
+        glm::mat4 result;
+        result[0] = glm::vec4(basis[0] * scale.x, 0.0f);
+        result[1] = glm::vec4(basis[1] * scale.y, 0.0f);
+        result[2] = glm::vec4(basis[2] * scale.z, 0.0f);
+        result[3] = glm::vec4(position, 1.0f);
+        return result;
+    }
+
+    // batch transform：out[i] = left * right[i]，right和out的每个元素是列主序的mat4，stride是相邻元素的字节距离
+    // out可以是映射的gpu内存，只写不读
+    static void multiplyLeft(const glm::mat4& left, const void* right, size_t rightStride, void* out, size_t outStride, size_t count) {
+#if defined(BATCH_TRANSFORM_SSE)
+        const __m128 l0 = _mm_loadu_ps(&left[0][0]);
+        const __m128 l1 = _mm_loadu_ps(&left[1][0]);
+        const __m128 l2 = _mm_loadu_ps(&left[2][0]);
+        const __m128 l3 = _mm_loadu_ps(&left[3][0]);
+        for (size_t i = 0; i < count; i++) {
+            const float* r = at(right, rightStride, i);
+            float* o = at(out, outStride, i);
+            for (int column = 0; column < 4; column++) {
+                const __m128 c = _mm_loadu_ps(r + column * 4);
+                __m128 sum = _mm_mul_ps(l0, _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 0, 0, 0)));
+                sum = _mm_add_ps(sum, _mm_mul_ps(l1, _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 1, 1, 1))));
+                sum = _mm_add_ps(sum, _mm_mul_ps(l2, _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 2, 2))));
+                sum = _mm_add_ps(sum, _mm_mul_ps(l3, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 3))));
+                _mm_storeu_ps(o + column * 4, sum);
+            }
+        }
+#elif defined(BATCH_TRANSFORM_NEON)
+        const float32x4_t l0 = vld1q_f32(&left[0][0]);
+        const float32x4_t l1 = vld1q_f32(&left[1][0]);
+        const float32x4_t l2 = vld1q_f32(&left[2][0]);
+        const float32x4_t l3 = vld1q_f32(&left[3][0]);
+        for (size_t i = 0; i < count; i++) {
+            const float* r = at(right, rightStride, i);
+            float* o = at(out, outStride, i);
+            for (int column = 0; column < 4; column++) {
+                const float32x4_t c = vld1q_f32(r + column * 4);
+                float32x4_t sum = vmulq_laneq_f32(l0, c, 0);
+                sum = vfmaq_laneq_f32(sum, l1, c, 1);
+                sum = vfmaq_laneq_f32(sum, l2, c, 2);
+                sum = vfmaq_laneq_f32(sum, l3, c, 3);
+                vst1q_f32(o + column * 4, sum);
+            }
+        }
+#else
+        for (size_t i = 0; i < count; i++) {
+            glm::mat4 r;
+            std::memcpy(&r, at(right, rightStride, i), sizeof(r));
+            glm::mat4 result = left * r;
+            std::memcpy(at(out, outStride, i), &result, sizeof(result));
+        }
+#endif
+    }
+
+    // batch transform：out[i] = left[i] * right，固定的right每个元素广播一次，每个实例读取自己的4列
+    static void multiplyRight(const void* left, size_t leftStride, const glm::mat4& right, void* out, size_t outStride, size_t count) {
+#if defined(BATCH_TRANSFORM_SSE)
+        __m128 r[16];
+        for (int k = 0; k < 16; k++) {
+            r[k] = _mm_set1_ps((&right[0][0])[k]);
+        }
+        for (size_t i = 0; i < count; i++) {
+            const float* l = at(left, leftStride, i);
+            float* o = at(out, outStride, i);
+            const __m128 l0 = _mm_loadu_ps(l);
+            const __m128 l1 = _mm_loadu_ps(l + 4);
+            const __m128 l2 = _mm_loadu_ps(l + 8);
+            const __m128 l3 = _mm_loadu_ps(l + 12);
+            for (int column = 0; column < 4; column++) {
+                __m128 sum = _mm_mul_ps(l0, r[column * 4]);
+                sum = _mm_add_ps(sum, _mm_mul_ps(l1, r[column * 4 + 1]));
+                sum = _mm_add_ps(sum, _mm_mul_ps(l2, r[column * 4 + 2]));
+                sum = _mm_add_ps(sum, _mm_mul_ps(l3, r[column * 4 + 3]));
+                _mm_storeu_ps(o + column * 4, sum);
+            }
+        }
+#elif defined(BATCH_TRANSFORM_NEON)
+        const float32x4_t r0 = vld1q_f32(&right[0][0]);
+        const float32x4_t r1 = vld1q_f32(&right[1][0]);
+        const float32x4_t r2 = vld1q_f32(&right[2][0]);
+        const float32x4_t r3 = vld1q_f32(&right[3][0]);
+        const float32x4_t columns[4] = {r0, r1, r2, r3};
+        for (size_t i = 0; i < count; i++) {
+            const float* l = at(left, leftStride, i);
+            float* o = at(out, outStride, i);
+            const float32x4_t l0 = vld1q_f32(l);
+            const float32x4_t l1 = vld1q_f32(l + 4);
+            const float32x4_t l2 = vld1q_f32(l + 8);
+            const float32x4_t l3 = vld1q_f32(l + 12);
+            for (int column = 0; column < 4; column++) {
+                float32x4_t sum = vmulq_laneq_f32(l0, columns[column], 0);
+                sum = vfmaq_laneq_f32(sum, l1, columns[column], 1);
+                sum = vfmaq_laneq_f32(sum, l2, columns[column], 2);
+                sum = vfmaq_laneq_f32(sum, l3, columns[column], 3);
+                vst1q_f32(o + column * 4, sum);
+            }
+        }
+#else
+        for (size_t i = 0; i < count; i++) {
+            glm::mat4 l;
+            std::memcpy(&l, at(left, leftStride, i), sizeof(l));
+            glm::mat4 result = l * right;
+            std::memcpy(at(out, outStride, i), &result, sizeof(result));
+        }
+#endif
+    }
+
+    // batch transform：单个矩阵乘法，transform store中父节点各不相同时使用
+    static glm::mat4 multiply(const glm::mat4& left, const glm::mat4& right) {
+        glm::mat4 result;
+        multiplyLeft(left, &right, sizeof(glm::mat4), &result, sizeof(glm::mat4), 1);
+        return result;
+    }
+
+private:
+    static const float* at(const void* base, size_t stride, size_t index) {
+        return reinterpret_cast<const float*>(static_cast<const char*>(base) + stride * index);
+    }
+
+    static float* at(void* base, size_t stride, size_t index) {
+        return reinterpret_cast<float*>(static_cast<char*>(base) + stride * index);
+    }
+};
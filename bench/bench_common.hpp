@@ -0,0 +1,24 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// renderer bench：链接vulkan_renderer的benchmark共用的计时，和math bench一样输出csv
+// 每个benchmark跑BENCH_REPEATS轮，输出每次操作的最小和中位数纳秒
+const size_t BENCH_REPEATS = 15;
+
+template<typename Function>
+void benchMeasure(const char* name, size_t operationCount, Function run) {
+    run();  // 预热cache和驱动中的延迟初始化
+    std::vector<double> samples;
+    for (size_t i = 0; i < BENCH_REPEATS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / operationCount);
+    }
+    std::sort(samples.begin(), samples.end());
+    std::printf("%s,%.2f,%.2f\n", name, samples.front(), samples[samples.size() / 2]);
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#include "bench_common.hpp"
+#include "../device_capabilities.hpp"
+#include "../device_dispatch.hpp"
+#include "../device_selector.hpp"
+#include "../host_memory.hpp"
+#include "../memory_allocator.hpp"
+#include "../timeline_semaphore.hpp"
+
+// renderer bench：没有窗口和surface，只有一个图形队列；设备按DeviceSelector的分数选择
+// 开启timeline semaphore和可用时的dynamic rendering，和应用一样通过DeviceDispatch调用每帧的函数
+// deviceIndex：不为负数时只使用vkEnumeratePhysicalDevices中的这个设备，在不同的gpu上运行同一个benchmark
+class BenchDevice {
+public:
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    uint32_t graphicsFamily = 0;
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+    DeviceCapabilities capabilities;
+    DeviceMemoryAllocator allocator;
+    TimelineSemaphore timeline;
+
+    void init(int deviceIndex = -1) {
+        VkApplicationInfo appInfo{};
+        appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+        appInfo.pApplicationName = "Renderer Bench";
+        appInfo.apiVersion = VK_API_VERSION_1_3;
+
+        std::vector<const char*> instanceExtensions;
+        VkInstanceCreateInfo instanceInfo{};
+        instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+        instanceInfo.pApplicationInfo = &appInfo;
+#ifdef __APPLE__
+        instanceExtensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+        instanceInfo.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+#endif
+        instanceInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
+        instanceInfo.ppEnabledExtensionNames = instanceExtensions.data();
+        if (vkCreateInstance(&instanceInfo, hostAllocator(), &instance) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create instance!");
+        }
+
+        pickPhysicalDevice(deviceIndex);
+        createDevice();
+        DeviceDispatch::load(device);
+        allocator.init(physicalDevice, device, false);
+        timeline.init(device);
+    }
+
+    void cleanup() {
+        vkDeviceWaitIdle(device);
+        timeline.cleanup();
+        allocator.cleanup();
+        DeviceDispatch::reset();
+        vkDestroyDevice(device, hostAllocator());
+        vkDestroyInstance(instance, hostAllocator());
+    }
+
+    // renderer bench：host visible的buffer，mapped可以直接写入
+    struct HostBuffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    HostBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+        HostBuffer result;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(device, &bufferInfo, hostAllocator(), &result.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bench buffer!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, result.buffer, &memRequirements);
+        result.allocation = allocator.allocate(memRequirements, properties, true, MemoryCategory::other, 0, "bench");
+        vkBindBufferMemory(device, result.buffer, result.allocation.memory, result.allocation.offset);
+        return result;
+    }
+
+    void destroyBuffer(HostBuffer& buffer) {
+        vkDestroyBuffer(device, buffer.buffer, hostAllocator());
+        allocator.free(buffer.allocation);
+    }
+
+private:
+    void pickPhysicalDevice(int deviceIndex) {
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+
+        if (deviceIndex >= 0) {
+            if (static_cast<uint32_t>(deviceIndex) >= devices.size()) {
+                throw std::runtime_error("bench device index out of range!");
+            }
+            devices = {devices[deviceIndex]};
+        }
+
+        uint64_t bestScore = 0;
+        for (VkPhysicalDevice candidate : devices) {
+            DeviceCapabilities candidateCapabilities = DeviceCapabilities::probe(candidate);
+            int family = findGraphicsFamily(candidate);
+            if (family < 0 || !candidateCapabilities.timelineSemaphore) {
+                continue;
+            }
+            uint64_t score = DeviceSelector::score(candidate, {}, false, false).score;
+            if (physicalDevice == VK_NULL_HANDLE || score > bestScore) {
+                physicalDevice = candidate;
+                graphicsFamily = static_cast<uint32_t>(family);
+                capabilities = candidateCapabilities;
+                bestScore = score;
+            }
+        }
+        if (physicalDevice == VK_NULL_HANDLE) {
+            throw std::runtime_error("failed to find a suitable GPU!");
+        }
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        std::fprintf(stderr, "bench device: %s (%s)\n", properties.deviceName, capabilities.summary().c_str());
+    }
+
+    static int findGraphicsFamily(VkPhysicalDevice candidate) {
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> families(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, families.data());
+        for (uint32_t i = 0; i < familyCount; i++) {
+            if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    void createDevice() {
+        float queuePriority = 1.0f;
+        VkDeviceQueueCreateInfo queueInfo{};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = graphicsFamily;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = &queuePriority;
+
+        VkDeviceCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        createInfo.queueCreateInfoCount = 1;
+        createInfo.pQueueCreateInfos = &queueInfo;
+
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+        timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timelineFeatures.timelineSemaphore = VK_TRUE;
+        createInfo.pNext = &timelineFeatures;
+        VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures{};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+        if (capabilities.dynamicRendering) {
+            dynamicRenderingFeatures.pNext = &timelineFeatures;
+            createInfo.pNext = &dynamicRenderingFeatures;
+        }
+
+        std::vector<const char*> extensions;
+#ifdef __APPLE__
+        extensions.push_back("VK_KHR_portability_subset");
+#endif
+        if (capabilities.timelineSemaphoreExtension) {
+            extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        }
+        if (capabilities.dynamicRendering && capabilities.dynamicRenderingExtension) {
+            extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+        }
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+        createInfo.ppEnabledExtensionNames = extensions.data();
+
+        if (vkCreateDevice(physicalDevice, &createInfo, hostAllocator(), &device) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create logical device!");
+        }
+        vkGetDeviceQueue(device, graphicsFamily, 0, &graphicsQueue);
+    }
+};
@@ -0,0 +1,341 @@
+// draw bench：一帧DRAW_COUNT个draw的cpu录制开销，和shadow pass一样每个draw push一次矩阵再drawIndexed
+// loader：通过链接的vulkan库导出的函数录制（每次调用经过loader的trampoline）；dispatch：通过DeviceDispatch中driver的函数地址
+// submit：录制之后提交并等待timeline，包括gpu执行；渲染目标是只有depth的D32图像，使用dynamic rendering，不需要render pass和framebuffer
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstring>
+#include <vector>
+
+#include "bench_device.hpp"
+#include "../shader_registry.hpp"
+
+namespace {
+
+const size_t DRAW_COUNT = 4096;
+const uint32_t TARGET_SIZE = 256;
+const VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+struct DrawPushConstants {
+    glm::mat4 lightViewProj;
+    glm::mat4 model;
+};
+
+struct DrawFunctions {
+    PFN_vkBeginCommandBuffer beginCommandBuffer;
+    PFN_vkEndCommandBuffer endCommandBuffer;
+    PFN_vkCmdBindPipeline cmdBindPipeline;
+    PFN_vkCmdBindVertexBuffers cmdBindVertexBuffers;
+    PFN_vkCmdBindIndexBuffer cmdBindIndexBuffer;
+    PFN_vkCmdPushConstants cmdPushConstants;
+    PFN_vkCmdDrawIndexed cmdDrawIndexed;
+};
+
+DrawFunctions currentDispatch() {
+    return {DeviceDispatch::beginCommandBuffer, DeviceDispatch::endCommandBuffer, DeviceDispatch::cmdBindPipeline, DeviceDispatch::cmdBindVertexBuffers,
+        DeviceDispatch::cmdBindIndexBuffer, DeviceDispatch::cmdPushConstants, DeviceDispatch::cmdDrawIndexed};
+}
+
+class DrawBench {
+public:
+    explicit DrawBench(BenchDevice& bench) : m_bench(bench) {
+        if (!bench.capabilities.dynamicRendering) {
+            throw std::runtime_error("draw bench requires dynamic rendering!");
+        }
+        const char* beginName = bench.capabilities.dynamicRenderingExtension ? "vkCmdBeginRenderingKHR" : "vkCmdBeginRendering";
+        const char* endName = bench.capabilities.dynamicRenderingExtension ? "vkCmdEndRenderingKHR" : "vkCmdEndRendering";
+        m_beginRendering = (PFN_vkCmdBeginRendering) vkGetDeviceProcAddr(bench.device, beginName);
+        m_endRendering = (PFN_vkCmdEndRendering) vkGetDeviceProcAddr(bench.device, endName);
+        createTarget();
+        createPipeline();
+        createGeometry();
+        createCommandBuffer();
+    }
+
+    ~DrawBench() {
+        vkDeviceWaitIdle(m_bench.device);
+        vkDestroyCommandPool(m_bench.device, m_commandPool, hostAllocator());
+        m_bench.destroyBuffer(m_vertexBuffer);
+        m_bench.destroyBuffer(m_indexBuffer);
+        m_bench.destroyBuffer(m_instanceBuffer);
+        vkDestroyPipeline(m_bench.device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_bench.device, m_pipelineLayout, hostAllocator());
+        vkDestroyImageView(m_bench.device, m_depthView, hostAllocator());
+        vkDestroyImage(m_bench.device, m_depthImage, hostAllocator());
+        m_bench.allocator.free(m_depthAllocation);
+    }
+
+    // draw bench：每个draw的push constant不同，和按物体录制的shadow pass一样
+    void record(const DrawFunctions& functions) {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        functions.beginCommandBuffer(m_commandBuffer, &beginInfo);
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_depthImage;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+        barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkRenderingAttachmentInfo depthAttachment{};
+        depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        depthAttachment.imageView = m_depthView;
+        depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.clearValue.depthStencil = {1.0f, 0};
+        VkRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.renderArea = {{0, 0}, {TARGET_SIZE, TARGET_SIZE}};
+        renderingInfo.layerCount = 1;
+        renderingInfo.pDepthAttachment = &depthAttachment;
+        m_beginRendering(m_commandBuffer, &renderingInfo);
+
+        functions.cmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+        VkBuffer vertexBuffers[] = {m_vertexBuffer.buffer, m_instanceBuffer.buffer};
+        VkDeviceSize offsets[] = {0, 0};
+        functions.cmdBindVertexBuffers(m_commandBuffer, 0, 2, vertexBuffers, offsets);
+        functions.cmdBindIndexBuffer(m_commandBuffer, m_indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+        DrawPushConstants constants{};
+        constants.lightViewProj = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 1.0f);
+        for (size_t i = 0; i < DRAW_COUNT; i++) {
+            float x = static_cast<float>(i % 64) / 32.0f - 1.0f;
+            float y = static_cast<float>(i / 64) / 32.0f - 1.0f;
+            constants.model = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(x, y, 0.5f)), glm::vec3(0.01f));
+            functions.cmdPushConstants(m_commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+            functions.cmdDrawIndexed(m_commandBuffer, 3, 1, 0, 0, 0);
+        }
+
+        m_endRendering(m_commandBuffer);
+        functions.endCommandBuffer(m_commandBuffer);
+    }
+
+    // draw bench：录制的command buffer提交到图形队列，等待timeline之后才能重新录制
+    void submitAndWait() {
+        uint64_t value = m_bench.timeline.nextValue();
+        VkSemaphore timelineSemaphore = m_bench.timeline.handle();
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &value;
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &timelineSemaphore;
+        if (DeviceDispatch::queueSubmit(m_bench.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw bench command buffer!");
+        }
+        m_bench.timeline.wait(value);
+    }
+
+private:
+    void createTarget() {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = DEPTH_FORMAT;
+        imageInfo.extent = {TARGET_SIZE, TARGET_SIZE, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(m_bench.device, &imageInfo, hostAllocator(), &m_depthImage) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create draw bench depth image!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_bench.device, m_depthImage, &memRequirements);
+        m_depthAllocation = m_bench.allocator.allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::attachment, 0, "bench depth");
+        vkBindImageMemory(m_bench.device, m_depthImage, m_depthAllocation.memory, m_depthAllocation.offset);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_depthImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = DEPTH_FORMAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+        if (vkCreateImageView(m_bench.device, &viewInfo, hostAllocator(), &m_depthView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create draw bench depth view!");
+        }
+    }
+
+    // draw bench：和shadow cache的pipeline相同的顶点布局，binding 0是位置，binding 1是每个实例的mat4
+    void createPipeline() {
+        SpirvCode code = embeddedShader("shadow.vert");
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size;
+        moduleInfo.pCode = code.words;
+        VkShaderModule vertModule;
+        if (vkCreateShaderModule(m_bench.device, &moduleInfo, hostAllocator(), &vertModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        VkPushConstantRange pushConstantRange{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants)};
+        VkPipelineLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_bench.device, &layoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        VkPipelineShaderStageCreateInfo stage{};
+        stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        stage.module = vertModule;
+        stage.pName = "main";
+
+        VkVertexInputBindingDescription bindings[2] = {
+            {0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX},
+            {1, sizeof(glm::mat4), VK_VERTEX_INPUT_RATE_INSTANCE},
+        };
+        VkVertexInputAttributeDescription attributes[5] = {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0}};
+        for (uint32_t column = 0; column < 4; column++) {
+            attributes[column + 1] = {3 + column, 1, VK_FORMAT_R32G32B32A32_SFLOAT, column * static_cast<uint32_t>(sizeof(glm::vec4))};
+        }
+        VkPipelineVertexInputStateCreateInfo vertexInput{};
+        vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInput.vertexBindingDescriptionCount = 2;
+        vertexInput.pVertexBindingDescriptions = bindings;
+        vertexInput.vertexAttributeDescriptionCount = 5;
+        vertexInput.pVertexAttributeDescriptions = attributes;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        VkViewport viewport{0.0f, 0.0f, static_cast<float>(TARGET_SIZE), static_cast<float>(TARGET_SIZE), 0.0f, 1.0f};
+        VkRect2D scissor{{0, 0}, {TARGET_SIZE, TARGET_SIZE}};
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+
+        VkPipelineRenderingCreateInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.depthAttachmentFormat = DEPTH_FORMAT;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &stage;
+        pipelineInfo.pVertexInputState = &vertexInput;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.layout = m_pipelineLayout;
+        if (vkCreateGraphicsPipelines(m_bench.device, VK_NULL_HANDLE, 1, &pipelineInfo, hostAllocator(), &m_pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+        vkDestroyShaderModule(m_bench.device, vertModule, hostAllocator());
+    }
+
+    // draw bench：一个三角形和一个单位矩阵实例，gpu的工作量很小，录制开销占主要部分
+    void createGeometry() {
+        VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        glm::vec3 vertices[] = {{-1.0f, -1.0f, 0.0f}, {1.0f, -1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}};
+        uint32_t indices[] = {0, 1, 2};
+        glm::mat4 instance(1.0f);
+        m_vertexBuffer = m_bench.createBuffer(sizeof(vertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, hostVisible);
+        m_indexBuffer = m_bench.createBuffer(sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, hostVisible);
+        m_instanceBuffer = m_bench.createBuffer(sizeof(instance), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, hostVisible);
+        std::memcpy(m_vertexBuffer.allocation.mapped, vertices, sizeof(vertices));
+        std::memcpy(m_indexBuffer.allocation.mapped, indices, sizeof(indices));
+        std::memcpy(m_instanceBuffer.allocation.mapped, &instance, sizeof(instance));
+    }
+
+    void createCommandBuffer() {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = m_bench.graphicsFamily;
+        if (vkCreateCommandPool(m_bench.device, &poolInfo, hostAllocator(), &m_commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create command pool!");
+        }
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(m_bench.device, &allocInfo, &m_commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+    }
+
+    BenchDevice& m_bench;
+    PFN_vkCmdBeginRendering m_beginRendering = nullptr;
+    PFN_vkCmdEndRendering m_endRendering = nullptr;
+    VkImage m_depthImage = VK_NULL_HANDLE;
+    VkImageView m_depthView = VK_NULL_HANDLE;
+    Allocation m_depthAllocation;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    BenchDevice::HostBuffer m_vertexBuffer;
+    BenchDevice::HostBuffer m_indexBuffer;
+    BenchDevice::HostBuffer m_instanceBuffer;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+};
+
+}  // namespace
+
+int main() {
+    // draw bench：BenchDevice::init会加载DeviceDispatch，在那之前的值就是loader导出的函数
+    DrawFunctions loader = currentDispatch();
+    BenchDevice bench;
+    bench.init();
+    DrawFunctions dispatch = currentDispatch();
+    {
+        DrawBench draws(bench);
+        std::printf("benchmark,min_ns,median_ns\n");
+        benchMeasure("record_loader_per_draw", DRAW_COUNT, [&]() { draws.record(loader); });
+        benchMeasure("record_dispatch_per_draw", DRAW_COUNT, [&]() { draws.record(dispatch); });
+        benchMeasure("record_submit_per_draw", DRAW_COUNT, [&]() {
+            draws.record(dispatch);
+            draws.submitAndWait();
+        });
+    }
+    bench.cleanup();
+    return 0;
+}
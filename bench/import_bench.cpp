@@ -0,0 +1,113 @@
+// import bench：mesh导入的cpu阶段，不需要vulkan设备；和应用一样解析obj、用flat index map去重，再做mesh optimizer、meshlet和lod
+// 每个阶段单独计时，输入是上一个阶段的结果，输出每个索引的最小和中位数纳秒；第一个参数可以指定obj文件
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "bench_common.hpp"
+#include "../thirdparty/tiny_obj/tiny_obj_loader.h"
+#include "../flat_index_map.hpp"
+#include "../mesh_optimizer.hpp"
+#include "../mesh_simplifier.hpp"
+#include "../meshlet_builder.hpp"
+
+#ifndef BENCH_MODEL_PATH
+#define BENCH_MODEL_PATH "models/AC_Unit.obj"
+#endif
+
+namespace {
+
+// import bench：和应用的非compact Vertex布局相同，去重按字节比较
+struct ImportVertex {
+    glm::vec3 pos;
+    glm::vec3 color;
+    glm::vec2 texCoord;
+};
+
+struct ObjData {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+};
+
+ObjData loadObj(const std::string& path) {
+    ObjData obj;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    if (!tinyobj::LoadObj(&obj.attrib, &obj.shapes, &materials, &warn, &err, path.c_str())) {
+        throw std::runtime_error(warn + err);
+    }
+    return obj;
+}
+
+void dedup(const ObjData& obj, std::vector<ImportVertex>& vertices, std::vector<uint32_t>& indices) {
+    size_t indexCount = 0;
+    for (const auto& shape : obj.shapes) {
+        indexCount += shape.mesh.indices.size();
+    }
+    vertices.clear();
+    indices.clear();
+    indices.reserve(indexCount);
+    FlatIndexMap<ImportVertex> uniqueVertices;
+    uniqueVertices.reserve(indexCount);
+    for (const auto& shape : obj.shapes) {
+        for (const auto& index : shape.mesh.indices) {
+            ImportVertex vertex{};
+            vertex.pos = {obj.attrib.vertices[3 * index.vertex_index + 0], obj.attrib.vertices[3 * index.vertex_index + 1],
+                obj.attrib.vertices[3 * index.vertex_index + 2]};
+            if (index.texcoord_index >= 0) {
+                vertex.texCoord = {obj.attrib.texcoords[2 * index.texcoord_index + 0], 1.0f - obj.attrib.texcoords[2 * index.texcoord_index + 1]};
+            }
+            vertex.color = {1.0f, 1.0f, 1.0f};
+            indices.push_back(uniqueVertices.findOrInsert(vertex, vertices));
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string path = argc > 1 ? argv[1] : BENCH_MODEL_PATH;
+
+    ObjData obj = loadObj(path);
+    std::vector<ImportVertex> vertices;
+    std::vector<uint32_t> indices;
+    dedup(obj, vertices, indices);
+    size_t indexCount = indices.size();
+    std::fprintf(stderr, "import bench: %s, %zu indices, %zu vertices\n", path.c_str(), indexCount, vertices.size());
+
+    std::printf("benchmark,min_ns,median_ns\n");
+    benchMeasure("obj_parse_per_index", indexCount, [&]() { loadObj(path); });
+    benchMeasure("dedup_per_index", indexCount, [&]() { dedup(obj, vertices, indices); });
+
+    std::vector<size_t> clusterStarts;
+    std::vector<uint32_t> cacheOrder;
+    benchMeasure("vertex_cache_per_index", indexCount, [&]() { cacheOrder = optimizeVertexCache(indices, vertices.size(), clusterStarts); });
+    std::vector<uint32_t> overdrawOrder;
+    benchMeasure("overdraw_per_index", indexCount, [&]() {
+        overdrawOrder = optimizeOverdraw(cacheOrder, clusterStarts, &vertices[0].pos.x, sizeof(ImportVertex));
+    });
+    // vertex fetch会改写顶点和索引，每轮从overdraw的结果复制一份
+    std::vector<ImportVertex> fetchVertices;
+    std::vector<uint32_t> fetchIndices;
+    benchMeasure("vertex_fetch_per_index", indexCount, [&]() {
+        fetchVertices = vertices;
+        fetchIndices = overdrawOrder;
+        optimizeVertexFetch(fetchVertices, fetchIndices);
+    });
+    VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+    VertexCacheStats after = analyzeVertexCache(fetchIndices, fetchVertices.size());
+    std::fprintf(stderr, "import bench: acmr %.3f -> %.3f\n", before.acmr, after.acmr);
+
+    const float* positions = &fetchVertices[0].pos.x;
+    benchMeasure("meshlets_per_index", indexCount, [&]() {
+        MeshletData meshlets;
+        buildMeshlets(fetchIndices.data(), fetchIndices.size(), positions, sizeof(ImportVertex), fetchVertices.size(), meshlets);
+    });
+    benchMeasure("lods_per_index", indexCount, [&]() {
+        simplifyMeshLods(fetchIndices.data(), fetchIndices.size(), positions, sizeof(ImportVertex), fetchVertices.size());
+    });
+    return 0;
+}
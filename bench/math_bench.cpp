@@ -0,0 +1,156 @@
+// math bench：应用自己热路径上的数学代码的microbenchmark，不依赖vulkan和窗口
+// 同一份代码编译两次：VulkanTutorial_bench_scalar定义GLM_FORCE_PURE，VulkanTutorial_bench_simd定义GLM_FORCE_INTRINSICS和GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+// glm只有对齐的类型才走simd路径，所以simd版本的vec3也是16字节，Vertex的大小和内存布局和应用中不同
+// 每个benchmark跑REPEATS轮，输出每次操作的最小和中位数纳秒，两个版本的csv可以直接对比
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "../batch_transform.hpp"
+#include "../camera.hpp"
+#include "../flat_index_map.hpp"
+
+#ifndef BENCH_CONFIG
+#define BENCH_CONFIG "default"
+#endif
+
+namespace {
+
+const size_t REPEATS = 15;
+const size_t DRAW_COUNT = 4096;  // batch mvp：一帧的draw数量
+const size_t VERTEX_COUNT = 1 << 16;  // vertex hash：一次去重的顶点数量
+const size_t CAMERA_COUNT = 1024;
+
+// vertex hash：和main.cpp中的Vertex和hash<Vertex>相同
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec3 color;
+    glm::vec2 texCoord;
+};
+
+size_t hashVertex(const Vertex& vertex) {
+    return ((std::hash<glm::vec3>()(vertex.pos) ^ (std::hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^ (std::hash<glm::vec2>()(vertex.texCoord) << 1);
+}
+
+// math bench：结果写到这里，编译器不能把被测代码当成没有用的计算删掉
+volatile float g_floatSink = 0.f;
+volatile size_t g_hashSink = 0;
+
+void consume(const glm::mat4& m) {
+    g_floatSink = g_floatSink + m[0][0] + m[1][1] + m[2][2] + m[3][3];
+}
+
+// math bench：operationCount是每轮run执行的操作次数，用来换算成每次操作的时间
+template <typename Function>
+void measure(const char* name, size_t operationCount, Function run) {
+    run();  // 预热cache
+    std::vector<double> samples;
+    for (size_t i = 0; i < REPEATS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / operationCount);
+    }
+    std::sort(samples.begin(), samples.end());
+    std::printf("%s,%s,%.2f,%.2f\n", BENCH_CONFIG, name, samples.front(), samples[samples.size() / 2]);
+}
+
+// math bench：固定种子的伪随机数，两个版本的输入完全相同
+float nextFloat(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return static_cast<float>(state >> 8) / static_cast<float>(1u << 24) * 2.f - 1.f;
+}
+
+}  // namespace
+
+int main() {
+    uint32_t seed = 1;
+    std::printf("config,benchmark,min_ns,median_ns\n");
+
+    // camera：相机放在不同位置，和每帧的Camera::place + view一样
+    std::vector<Camera> cameras(CAMERA_COUNT);
+    for (Camera& camera : cameras) {
+        camera.init(800, 600);
+        camera.place(glm::vec3(nextFloat(seed), nextFloat(seed), nextFloat(seed)) * 4.f, glm::vec3(0.f));
+    }
+    measure("camera_view", CAMERA_COUNT, [&]() {
+        for (const Camera& camera : cameras) {
+            consume(camera.view());
+        }
+    });
+    measure("camera_project", CAMERA_COUNT, [&]() {
+        for (const Camera& camera : cameras) {
+            consume(camera.project());
+        }
+    });
+
+    // updateUniformBuffer：绕z轴旋转模型
+    std::vector<float> angles(DRAW_COUNT);
+    for (float& angle : angles) {
+        angle = nextFloat(seed) * glm::pi<float>();
+    }
+    measure("model_rotate", DRAW_COUNT, [&]() {
+        for (float angle : angles) {
+            consume(glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 0.0f, 1.0f)));
+        }
+    });
+
+    // batch mvp：每个draw的model乘上这一帧共享的view和projection
+    std::vector<glm::mat4> models(DRAW_COUNT);
+    for (size_t i = 0; i < DRAW_COUNT; i++) {
+        glm::vec3 offset(nextFloat(seed), nextFloat(seed), nextFloat(seed));
+        models[i] = glm::translate(glm::rotate(glm::mat4(1.0f), angles[i], glm::vec3(0.0f, 0.0f, 1.0f)), offset);
+    }
+    std::vector<glm::mat4> mvps(DRAW_COUNT);
+    const glm::mat4 view = cameras[0].view();
+    const glm::mat4 proj = cameras[0].project();
+    measure("batch_mvp", DRAW_COUNT, [&]() {
+        const glm::mat4 viewProj = proj * view;
+        for (size_t i = 0; i < DRAW_COUNT; i++) {
+            mvps[i] = viewProj * models[i];
+        }
+        consume(mvps[DRAW_COUNT / 2]);
+    });
+    // batch transform：同样的计算使用应用中的kernel，两个版本的glm配置下kernel相同
+    measure("batch_mvp_kernel", DRAW_COUNT, [&]() {
+        const glm::mat4 viewProj = proj * view;
+        BatchTransform::multiplyLeft(viewProj, models.data(), sizeof(glm::mat4), mvps.data(), sizeof(glm::mat4), DRAW_COUNT);
+        consume(mvps[DRAW_COUNT / 2]);
+    });
+
+    // loadModel：去重时每个顶点hash一次，simd版本的padding先清零，按字节hash的结果才是确定的
+    std::vector<Vertex> vertices(VERTEX_COUNT);
+    std::memset(static_cast<void*>(vertices.data()), 0, vertices.size() * sizeof(Vertex));
+    for (Vertex& vertex : vertices) {
+        vertex.pos = glm::vec3(nextFloat(seed), nextFloat(seed), nextFloat(seed));
+        vertex.color = glm::vec3(1.0f);
+        vertex.texCoord = glm::vec2(nextFloat(seed), nextFloat(seed));
+    }
+    measure("vertex_hash_glm", VERTEX_COUNT, [&]() {
+        size_t combined = 0;
+        for (const Vertex& vertex : vertices) {
+            combined ^= hashVertex(vertex);
+        }
+        g_hashSink = combined;
+    });
+    measure("vertex_hash_bytes", VERTEX_COUNT, [&]() {
+        uint64_t combined = 0;
+        for (const Vertex& vertex : vertices) {
+            combined ^= hashBytes(&vertex, sizeof(Vertex));
+        }
+        g_hashSink = static_cast<size_t>(combined);
+    });
+
+    return 0;
+}
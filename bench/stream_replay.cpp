@@ -0,0 +1,387 @@
+// stream replay：回放应用用--record-stream记录的命令流，不需要窗口、场景文件和应用逻辑，每次运行的工作量完全相同
+// 用法：VulkanTutorial_stream_replay <path> [--device <index>]，同一个文件在不同的gpu或者不同版本的renderer上回放得到可以对比的csv
+// record：只录制每一帧的command buffer；frame：录制之后提交并等待timeline，包括gpu执行
+// 回放和draw bench一样只画depth，渲染目标是记录时的分辨率；没有材质和着色，比较的是几何、draw数量和提交的开销
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench_device.hpp"
+#include "../shader_registry.hpp"
+#include "../stream_capture.hpp"
+
+namespace {
+
+const VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+// stream replay：和shadow.vert的push constant一致，lightViewProj是记录的相机矩阵
+struct ReplayPushConstants {
+    glm::mat4 viewProj;
+    glm::mat4 model;
+};
+
+class StreamReplay {
+public:
+    StreamReplay(BenchDevice& bench, const StreamCapture& capture) : m_bench(bench), m_capture(capture) {
+        if (!bench.capabilities.dynamicRendering) {
+            throw std::runtime_error("stream replay requires dynamic rendering!");
+        }
+        const char* beginName = bench.capabilities.dynamicRenderingExtension ? "vkCmdBeginRenderingKHR" : "vkCmdBeginRendering";
+        const char* endName = bench.capabilities.dynamicRenderingExtension ? "vkCmdEndRenderingKHR" : "vkCmdEndRendering";
+        m_beginRendering = (PFN_vkCmdBeginRendering) vkGetDeviceProcAddr(bench.device, beginName);
+        m_endRendering = (PFN_vkCmdEndRendering) vkGetDeviceProcAddr(bench.device, endName);
+        m_extent = {std::max(capture.width, 1u), std::max(capture.height, 1u)};
+        createTarget();
+        createPipeline();
+        createGeometry();
+        createCommandBuffer();
+    }
+
+    ~StreamReplay() {
+        vkDeviceWaitIdle(m_bench.device);
+        vkDestroyCommandPool(m_bench.device, m_commandPool, hostAllocator());
+        m_bench.destroyBuffer(m_vertexBuffer);
+        m_bench.destroyBuffer(m_indexBuffer);
+        m_bench.destroyBuffer(m_instanceBuffer);
+        vkDestroyPipeline(m_bench.device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_bench.device, m_pipelineLayout, hostAllocator());
+        vkDestroyImageView(m_bench.device, m_depthView, hostAllocator());
+        vkDestroyImage(m_bench.device, m_depthImage, hostAllocator());
+        m_bench.allocator.free(m_depthAllocation);
+    }
+
+    size_t drawCount() const {
+        size_t count = 0;
+        for (const StreamFrame& frame : m_capture.frames) {
+            count += frame.draws.size();
+        }
+        return count;
+    }
+
+    // stream replay：每个draw push相机和model，按记录的顺序drawIndexed，实例buffer绑定到这一帧的实例
+    void record(size_t frameIndex) {
+        const StreamFrame& frame = m_capture.frames[frameIndex];
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        DeviceDispatch::beginCommandBuffer(m_commandBuffer, &beginInfo);
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_depthImage;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+        barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkRenderingAttachmentInfo depthAttachment{};
+        depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        depthAttachment.imageView = m_depthView;
+        depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.clearValue.depthStencil = {1.0f, 0};
+        VkRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.renderArea = {{0, 0}, m_extent};
+        renderingInfo.layerCount = 1;
+        renderingInfo.pDepthAttachment = &depthAttachment;
+        m_beginRendering(m_commandBuffer, &renderingInfo);
+
+        DeviceDispatch::cmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+        VkBuffer vertexBuffers[] = {m_vertexBuffer.buffer, m_instanceBuffer.buffer};
+        VkDeviceSize offsets[] = {0, m_frameInstances[frameIndex].offset};
+        DeviceDispatch::cmdBindVertexBuffers(m_commandBuffer, 0, 2, vertexBuffers, offsets);
+        DeviceDispatch::cmdBindIndexBuffer(m_commandBuffer, m_indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+
+        ReplayPushConstants constants{};
+        constants.viewProj = frame.viewProj;
+        for (const StreamDraw& draw : frame.draws) {
+            const MeshLocation& mesh = m_meshLocations[draw.mesh];
+            constants.model = draw.model;
+            DeviceDispatch::cmdPushConstants(m_commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+            DeviceDispatch::cmdDrawIndexed(m_commandBuffer, draw.indexCount, m_frameInstances[frameIndex].count, mesh.firstIndex + draw.firstIndex, mesh.vertexOffset, 0);
+        }
+
+        m_endRendering(m_commandBuffer);
+        DeviceDispatch::endCommandBuffer(m_commandBuffer);
+    }
+
+    // stream replay：和draw bench一样提交到图形队列，等待timeline之后才能录制下一帧
+    void submitAndWait() {
+        uint64_t value = m_bench.timeline.nextValue();
+        VkSemaphore timelineSemaphore = m_bench.timeline.handle();
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &value;
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &timelineSemaphore;
+        if (DeviceDispatch::queueSubmit(m_bench.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit stream replay command buffer!");
+        }
+        m_bench.timeline.wait(value);
+    }
+
+private:
+    struct MeshLocation {
+        uint32_t firstIndex;
+        int32_t vertexOffset;
+    };
+
+    struct FrameInstances {
+        VkDeviceSize offset;
+        uint32_t count;
+    };
+
+    void createTarget() {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = DEPTH_FORMAT;
+        imageInfo.extent = {m_extent.width, m_extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        if (vkCreateImage(m_bench.device, &imageInfo, hostAllocator(), &m_depthImage) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create stream replay depth image!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_bench.device, m_depthImage, &memRequirements);
+        m_depthAllocation = m_bench.allocator.allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::attachment, 0, "replay depth");
+        vkBindImageMemory(m_bench.device, m_depthImage, m_depthAllocation.memory, m_depthAllocation.offset);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_depthImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = DEPTH_FORMAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+        if (vkCreateImageView(m_bench.device, &viewInfo, hostAllocator(), &m_depthView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create stream replay depth view!");
+        }
+    }
+
+    // stream replay：和draw bench相同的shadow.vert，binding 0是解量化之后的位置，binding 1是每个实例的mat4
+    void createPipeline() {
+        SpirvCode code = embeddedShader("shadow.vert");
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = code.size;
+        moduleInfo.pCode = code.words;
+        VkShaderModule vertModule;
+        if (vkCreateShaderModule(m_bench.device, &moduleInfo, hostAllocator(), &vertModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader module!");
+        }
+
+        VkPushConstantRange pushConstantRange{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ReplayPushConstants)};
+        VkPipelineLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_bench.device, &layoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        VkPipelineShaderStageCreateInfo stage{};
+        stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        stage.module = vertModule;
+        stage.pName = "main";
+
+        VkVertexInputBindingDescription bindings[2] = {
+            {0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX},
+            {1, sizeof(glm::mat4), VK_VERTEX_INPUT_RATE_INSTANCE},
+        };
+        VkVertexInputAttributeDescription attributes[5] = {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0}};
+        for (uint32_t column = 0; column < 4; column++) {
+            attributes[column + 1] = {3 + column, 1, VK_FORMAT_R32G32B32A32_SFLOAT, column * static_cast<uint32_t>(sizeof(glm::vec4))};
+        }
+        VkPipelineVertexInputStateCreateInfo vertexInput{};
+        vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInput.vertexBindingDescriptionCount = 2;
+        vertexInput.pVertexBindingDescriptions = bindings;
+        vertexInput.vertexAttributeDescriptionCount = 5;
+        vertexInput.pVertexAttributeDescriptions = attributes;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+        VkViewport viewport{0.0f, 0.0f, static_cast<float>(m_extent.width), static_cast<float>(m_extent.height), 0.0f, 1.0f};
+        VkRect2D scissor{{0, 0}, m_extent};
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.pViewports = &viewport;
+        viewportState.scissorCount = 1;
+        viewportState.pScissors = &scissor;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+
+        VkPipelineRenderingCreateInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.depthAttachmentFormat = DEPTH_FORMAT;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &stage;
+        pipelineInfo.pVertexInputState = &vertexInput;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.layout = m_pipelineLayout;
+        if (vkCreateGraphicsPipelines(m_bench.device, VK_NULL_HANDLE, 1, &pipelineInfo, hostAllocator(), &m_pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+        vkDestroyShaderModule(m_bench.device, vertModule, hostAllocator());
+    }
+
+    // stream replay：所有mesh合并到一个顶点buffer和一个索引buffer，所有帧的实例依次放在实例buffer中
+    // 记录时没有实例的帧使用一个单位矩阵
+    void createGeometry() {
+        std::vector<glm::vec3> vertices;
+        std::vector<uint32_t> indices;
+        for (const StreamMesh& mesh : m_capture.meshes) {
+            m_meshLocations.push_back({static_cast<uint32_t>(indices.size()), static_cast<int32_t>(vertices.size())});
+            vertices.insert(vertices.end(), mesh.positions.begin(), mesh.positions.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+        std::vector<glm::mat4> instances;
+        for (const StreamFrame& frame : m_capture.frames) {
+            m_frameInstances.push_back({instances.size() * sizeof(glm::mat4), static_cast<uint32_t>(std::max<size_t>(frame.instances.size(), 1))});
+            if (frame.instances.empty()) {
+                instances.push_back(glm::mat4(1.0f));
+            }
+            instances.insert(instances.end(), frame.instances.begin(), frame.instances.end());
+        }
+
+        VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        VkDeviceSize vertexSize = std::max<VkDeviceSize>(vertices.size() * sizeof(glm::vec3), 4);
+        VkDeviceSize indexSize = std::max<VkDeviceSize>(indices.size() * sizeof(uint32_t), 4);
+        m_vertexBuffer = m_bench.createBuffer(vertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, hostVisible);
+        m_indexBuffer = m_bench.createBuffer(indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, hostVisible);
+        m_instanceBuffer = m_bench.createBuffer(instances.size() * sizeof(glm::mat4), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, hostVisible);
+        std::memcpy(m_vertexBuffer.allocation.mapped, vertices.data(), vertices.size() * sizeof(glm::vec3));
+        std::memcpy(m_indexBuffer.allocation.mapped, indices.data(), indices.size() * sizeof(uint32_t));
+        std::memcpy(m_instanceBuffer.allocation.mapped, instances.data(), instances.size() * sizeof(glm::mat4));
+    }
+
+    void createCommandBuffer() {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = m_bench.graphicsFamily;
+        if (vkCreateCommandPool(m_bench.device, &poolInfo, hostAllocator(), &m_commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create command pool!");
+        }
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        if (vkAllocateCommandBuffers(m_bench.device, &allocInfo, &m_commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+    }
+
+    BenchDevice& m_bench;
+    const StreamCapture& m_capture;
+    PFN_vkCmdBeginRendering m_beginRendering = nullptr;
+    PFN_vkCmdEndRendering m_endRendering = nullptr;
+    VkExtent2D m_extent{};
+    VkImage m_depthImage = VK_NULL_HANDLE;
+    VkImageView m_depthView = VK_NULL_HANDLE;
+    Allocation m_depthAllocation;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    BenchDevice::HostBuffer m_vertexBuffer;
+    BenchDevice::HostBuffer m_indexBuffer;
+    BenchDevice::HostBuffer m_instanceBuffer;
+    std::vector<MeshLocation> m_meshLocations;
+    std::vector<FrameInstances> m_frameInstances;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::string path;
+    int deviceIndex = -1;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--device" && i + 1 < argc) {
+            deviceIndex = std::atoi(argv[++i]);
+        } else {
+            path = argument;
+        }
+    }
+    StreamCapture capture;
+    if (path.empty() || !capture.read(path) || capture.frames.empty()) {
+        std::fprintf(stderr, "usage: %s <stream capture> [--device <index>]\n", argv[0]);
+        return 1;
+    }
+
+    BenchDevice bench;
+    bench.init(deviceIndex);
+    {
+        StreamReplay replay(bench, capture);
+        std::fprintf(stderr, "stream replay: %zu frames, %zu draws, %zu meshes, %ux%u\n", capture.frames.size(), replay.drawCount(), capture.meshes.size(),
+            capture.width, capture.height);
+        std::printf("benchmark,min_ns,median_ns\n");
+        benchMeasure("replay_record_per_draw", std::max<size_t>(replay.drawCount(), 1), [&]() {
+            for (size_t frame = 0; frame < capture.frames.size(); frame++) {
+                replay.record(frame);
+            }
+        });
+        benchMeasure("replay_frame", capture.frames.size(), [&]() {
+            for (size_t frame = 0; frame < capture.frames.size(); frame++) {
+                replay.record(frame);
+                replay.submitAndWait();
+            }
+        });
+    }
+    bench.cleanup();
+    return 0;
+}
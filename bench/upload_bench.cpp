@@ -0,0 +1,54 @@
+// upload bench：staging ring加upload context的上传吞吐，写入ring、录制拷贝、提交并等待timeline
+// 和应用使用同一份StagingRing和UploadContext，拷贝到device local的buffer；输出每次上传的最小和中位数纳秒，除以大小就是吞吐
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench_device.hpp"
+#include "../staging_ring.hpp"
+#include "../upload_context.hpp"
+
+namespace {
+
+const VkDeviceSize RING_SIZE = 64 * 1024 * 1024;
+const VkDeviceSize UPLOAD_SIZES[] = {64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+const size_t UPLOADS_PER_RUN = 8;
+
+}  // namespace
+
+int main() {
+    BenchDevice bench;
+    bench.init();
+
+    StagingRing ring;
+    UploadContext upload;
+    ring.init(bench.device, bench.allocator, RING_SIZE, [&upload](uint64_t ticket) {
+        upload.wait(ticket);
+    });
+    upload.init(bench.device, bench.graphicsFamily, bench.graphicsQueue, bench.graphicsFamily, bench.graphicsQueue, ring, bench.timeline);
+
+    VkDeviceSize largest = UPLOAD_SIZES[sizeof(UPLOAD_SIZES) / sizeof(UPLOAD_SIZES[0]) - 1];
+    BenchDevice::HostBuffer target = bench.createBuffer(largest, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    std::vector<char> source(largest, 0x5a);
+
+    std::printf("benchmark,min_ns,median_ns\n");
+    for (VkDeviceSize size : UPLOAD_SIZES) {
+        std::string name = "upload_" + std::to_string(size / 1024) + "KiB";
+        benchMeasure(name.c_str(), UPLOADS_PER_RUN, [&]() {
+            for (size_t i = 0; i < UPLOADS_PER_RUN; i++) {
+                StagingRing::Region region = ring.allocate(size);
+                std::memcpy(region.mapped, source.data(), size);
+                VkBufferCopy copy{region.offset, 0, size};
+                vkCmdCopyBuffer(upload.commandBuffer(), region.buffer, target.buffer, 1, &copy);
+                upload.wait(upload.submit());
+            }
+        });
+    }
+
+    upload.waitIdle();
+    bench.destroyBuffer(target);
+    upload.cleanup();
+    ring.cleanup();
+    bench.cleanup();
+    return 0;
+}
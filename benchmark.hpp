@@ -0,0 +1,146 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "camera.hpp"
+
+// benchmark：--benchmark启动时相机沿固定路径移动，模拟时间每帧固定前进timeStep，和墙上时间无关，每次运行画面序列相同
+// 先跑warmupFrames帧（等待模型和纹理上传、pipeline编译），再记录measuredFrames帧的cpu和gpu耗时，写入csv后退出
+struct CameraKeyframe {
+    float time;  // 秒，模拟时间
+    glm::vec3 position;
+    glm::vec3 lookAt;
+};
+
+class BenchmarkRun {
+public:
+    void start(uint32_t warmupFrames, uint32_t measuredFrames, float timeStep) {
+        m_warmupFrames = warmupFrames;
+        m_measuredFrames = measuredFrames;
+        m_timeStep = timeStep;
+        m_frame = 0;
+        m_samples.clear();
+        m_samples.reserve(measuredFrames);
+        m_active = true;
+    }
+
+    // stress scene：场景的参数，不为空时写在csv的最后，比较不同参数的结果时区分文件
+    void setLabel(const std::string& label) { m_label = label; }
+
+    bool active() const { return m_active; }
+    bool finished() const { return m_active && m_frame >= m_warmupFrames + m_measuredFrames; }
+    bool measuring() const { return m_frame >= m_warmupFrames; }
+    float time() const { return m_frame * m_timeStep; }
+
+    // benchmark：路径循环播放，关键帧之间用smoothstep插值，关键帧处速度为0没有突变
+    void placeCamera(Camera& camera) const {
+        const float duration = PATH.back().time;
+        float t = time() - duration * static_cast<int>(time() / duration);
+        size_t next = 1;
+        while (next < PATH.size() - 1 && PATH[next].time < t) {
+            next++;
+        }
+        const CameraKeyframe& a = PATH[next - 1];
+        const CameraKeyframe& b = PATH[next];
+        float alpha = glm::smoothstep(a.time, b.time, t);
+        camera.place(glm::mix(a.position, b.position, alpha), glm::mix(a.lookAt, b.lookAt, alpha));
+    }
+
+    // benchmark：每帧结束时调用，warm up期间的帧不记录
+    // gpu耗时来自gpu profiler最近一次读到的结果，比cpu耗时晚frames in flight帧
+    void record(float cpuMs, float gpuMs) {
+        if (measuring() && !finished()) {
+            m_samples.push_back({m_frame - m_warmupFrames, time(), cpuMs, gpuMs});
+        }
+        m_frame++;
+    }
+
+    // benchmark：先是每帧一行，空行之后是平均值和百分位数的汇总
+    bool writeCsv(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        file << "frame,time,cpu_ms,gpu_ms\n";
+        for (const Sample& sample : m_samples) {
+            file << sample.frame << "," << sample.time << "," << sample.cpuMs << "," << sample.gpuMs << "\n";
+        }
+
+        Summary cpu = summarize(&Sample::cpuMs);
+        Summary gpu = summarize(&Sample::gpuMs);
+        file << "\nmetric,cpu_ms,gpu_ms\n";
+        file << "avg," << cpu.avg << "," << gpu.avg << "\n";
+        file << "p50," << cpu.p50 << "," << gpu.p50 << "\n";
+        file << "p95," << cpu.p95 << "," << gpu.p95 << "\n";
+        file << "p99," << cpu.p99 << "," << gpu.p99 << "\n";
+        file << "max," << cpu.max << "," << gpu.max << "\n";
+        if (!m_label.empty()) {
+            file << "\nscene\n" << m_label << "\n";
+        }
+        return static_cast<bool>(file);
+    }
+
+    struct Summary {
+        float avg = 0.f;
+        float p50 = 0.f;
+        float p95 = 0.f;
+        float p99 = 0.f;
+        float max = 0.f;
+    };
+
+    Summary cpuSummary() const { return summarize(&Sample::cpuMs); }
+    Summary gpuSummary() const { return summarize(&Sample::gpuMs); }
+
+private:
+    struct Sample {
+        uint32_t frame;
+        float time;
+        float cpuMs;
+        float gpuMs;
+    };
+
+    // benchmark：绕原点一圈，高度和距离都有变化，覆盖lod切换和纹理streaming的距离
+    inline static const std::vector<CameraKeyframe> PATH = {
+        {0.0f, glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f)},
+        {2.0f, glm::vec3(-2.0f, 2.0f, 1.0f), glm::vec3(0.0f)},
+        {4.0f, glm::vec3(-1.0f, -1.0f, 0.5f), glm::vec3(0.0f)},
+        {6.0f, glm::vec3(4.0f, -4.0f, 3.0f), glm::vec3(0.0f)},
+        {8.0f, glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f)},
+    };
+
+    Summary summarize(float Sample::*field) const {
+        Summary summary;
+        if (m_samples.empty()) {
+            return summary;
+        }
+        std::vector<float> sorted;
+        sorted.reserve(m_samples.size());
+        float total = 0.f;
+        for (const Sample& sample : m_samples) {
+            sorted.push_back(sample.*field);
+            total += sample.*field;
+        }
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](float p) { return sorted[static_cast<size_t>(p * (sorted.size() - 1) + 0.5f)]; };
+        summary.avg = total / sorted.size();
+        summary.p50 = percentile(0.50f);
+        summary.p95 = percentile(0.95f);
+        summary.p99 = percentile(0.99f);
+        summary.max = sorted.back();
+        return summary;
+    }
+
+    bool m_active = false;
+    std::string m_label;
+    uint32_t m_warmupFrames = 0;
+    uint32_t m_measuredFrames = 0;
+    float m_timeStep = 1.0f / 60.0f;
+    uint32_t m_frame = 0;
+    std::vector<Sample> m_samples;
+};
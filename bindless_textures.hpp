@@ -0,0 +1,169 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "descriptor_buffer.hpp"
+
+// bindless：所有纹理放在一个大的combined image sampler数组中，shader用push constant传入的index选择纹理
+// 切换材质不再需要切换descriptor set，不同材质的draw可以合并
+// 数组是partially bound的，没有写入的元素只要不被访问就是合法的
+// 使用update after bind和update unused while pending，新纹理可以直接写入空闲的元素，不需要等待in flight的帧
+// 正在被使用的元素不能修改，替换纹理时写入新的元素，旧元素在使用它的帧完成后再释放
+class BindlessTextureTable {
+public:
+    // bindless：容量受设备的update after bind sampler数量限制
+    // descriptor buffer：descriptorBuffer不为空时纹理数组是descriptor buffer中的一段，不创建pool和set
+    // descriptor buffer中的写入本来就是内存写入，不需要update after bind，容量受普通的sampler数量限制
+    // extraStages：除了fragment shader之外还能访问纹理数组的stage，比如task shader读取hi-z pyramid
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t capacity, DescriptorBuffer* descriptorBuffer = nullptr, VkShaderStageFlags extraStages = 0) {
+        m_device = device;
+        m_descriptorBuffer = descriptorBuffer;
+
+        VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+        indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &indexingProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        m_capacity = std::min({capacity, indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers, indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+            indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages});
+        if (m_descriptorBuffer) {
+            const VkPhysicalDeviceLimits& limits = properties2.properties.limits;
+            m_capacity = std::min({m_capacity, limits.maxPerStageDescriptorSamplers, limits.maxDescriptorSetSamplers,
+                limits.maxPerStageDescriptorSampledImages, limits.maxDescriptorSetSampledImages});
+        }
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        binding.descriptorCount = m_capacity;  // variable descriptor count时这里是上限，实际数量在分配set时指定
+        binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | extraStages;
+
+        VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
+            | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        if (m_descriptorBuffer) {
+            bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+        }
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+        bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        bindingFlagsInfo.bindingCount = 1;
+        bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+        // update after bind的layout不能包含dynamic ubo，所以纹理数组是单独的set
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = m_descriptorBuffer ? DescriptorBuffer::layoutFlags() : static_cast<VkDescriptorSetLayoutCreateFlags>(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_layout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bindless descriptor set layout!");
+        }
+
+        m_freeIndices.clear();
+        for (uint32_t i = m_capacity; i > 0; i--) {
+            m_freeIndices.push_back(i - 1);  // 从0开始分配
+        }
+
+        if (m_descriptorBuffer) {
+            m_bufferOffset = m_descriptorBuffer->allocateSet(m_layout);
+            return;
+        }
+
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSize.descriptorCount = m_capacity;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create bindless descriptor pool!");
+        }
+
+        VkDescriptorSetVariableDescriptorCountAllocateInfo countInfo{};
+        countInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+        countInfo.descriptorSetCount = 1;
+        countInfo.pDescriptorCounts = &m_capacity;
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.pNext = &countInfo;
+        allocInfo.descriptorPool = m_pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_layout;
+
+        if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_set) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate bindless descriptor set!");
+        }
+    }
+
+    void cleanup() {
+        if (m_pool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(m_device, m_pool, hostAllocator());  // set随pool一起释放
+        }
+        vkDestroyDescriptorSetLayout(m_device, m_layout, hostAllocator());
+    }
+
+    // bindless：分配一个空闲元素并写入，返回shader中使用的index；imageLayout是shader访问时image所处的layout
+    uint32_t add(VkImageView view, VkSampler sampler, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        if (m_freeIndices.empty()) {
+            throw std::runtime_error("bindless texture table is full!");
+        }
+        uint32_t index = m_freeIndices.back();
+        m_freeIndices.pop_back();
+
+        if (m_descriptorBuffer) {
+            m_descriptorBuffer->writeCombinedImageSampler(m_bufferOffset, m_layout, 0, index, view, sampler, imageLayout);
+            return index;
+        }
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = imageLayout;
+        imageInfo.imageView = view;
+        imageInfo.sampler = sampler;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = m_set;
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = index;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+        return index;
+    }
+
+    // bindless：调用者保证已经没有in flight的帧使用这个元素，一般通过deletion queue调用
+    void remove(uint32_t index) {
+        m_freeIndices.push_back(index);
+    }
+
+    VkDescriptorSetLayout layout() const { return m_layout; }
+    VkDescriptorSet set() const { return m_set; }
+    VkDeviceSize bufferOffset() const { return m_bufferOffset; }  // descriptor buffer：纹理数组在descriptor buffer中的offset
+    uint32_t capacity() const { return m_capacity; }
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_layout = VK_NULL_HANDLE;
+    VkDescriptorPool m_pool = VK_NULL_HANDLE;
+    VkDescriptorSet m_set = VK_NULL_HANDLE;
+    DescriptorBuffer* m_descriptorBuffer = nullptr;
+    VkDeviceSize m_bufferOffset = 0;
+    uint32_t m_capacity = 0;
+    std::vector<uint32_t> m_freeIndices;
+};
@@ -0,0 +1,450 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+#include "frustum_culling.hpp"
+#include "job_pool.hpp"
+
+// bvh：scene中物体的包围体层次，叶子最多MAX_LEAF_OBJECTS个物体，视锥、射线和范围查询只访问和查询区域相交的子树，是O(log n)
+// 移动的物体用update记录新的包围盒，refit时从它的叶子往上重新计算祖先的包围盒，树的结构不变
+// refit之后树的SAH代价比构建时高出REBUILD_COST_RATIO倍时，在job pool中用当时的包围盒重新构建，构建完成后的下一次refit换上新的树
+// 物体增加或删除需要调用build同步重建，物体的编号是传给build的数组中的index
+class Bvh {
+public:
+    static constexpr uint32_t MAX_LEAF_OBJECTS = 4;
+    static constexpr uint32_t SAH_BIN_COUNT = 16;
+    static constexpr float TRAVERSAL_COST = 1.0f;  // 相对于测试一个物体的代价
+    static constexpr float REBUILD_COST_RATIO = 1.5f;
+
+    // bvh：pool为nullptr时在调用者线程重新构建
+    void init(JobPool* pool) { m_pool = pool; }
+
+    // bvh：等待后台的构建，job中引用的只是共享的快照，等待是为了job pool先于它销毁时不留下未完成的job
+    void cleanup() {
+        if (m_rebuild.valid()) {
+            m_rebuild.wait();
+        }
+        m_rebuild = {};
+    }
+
+    void build(const std::vector<Aabb>& boxes) {
+        CPU_PROFILE_SCOPE("bvh build");
+        cleanup();  // 后台的构建使用的是旧的物体列表
+        m_boxes = boxes;
+        m_dirtyObjects.clear();
+        m_tree = buildTree(m_boxes);
+        m_builtCost = cost(m_tree);
+    }
+
+    size_t objectCount() const { return m_boxes.size(); }
+
+    void update(uint32_t object, const Aabb& box) {
+        m_boxes[object] = box;
+        m_dirtyObjects.push_back(object);
+    }
+
+    // bvh：祖先的包围盒没有变化时停止往上走，只移动了一点的物体通常只更新到叶子附近
+    void refit() {
+        adoptRebuild();
+        if (m_dirtyObjects.empty()) {
+            return;
+        }
+        CPU_PROFILE_SCOPE("bvh refit");
+        for (uint32_t object : m_dirtyObjects) {
+            uint32_t node = m_tree.objectLeaf[object];
+            while (node != INVALID_NODE) {
+                Aabb bounds = nodeBounds(m_tree, node);
+                if (bounds.min == m_tree.nodes[node].bounds.min && bounds.max == m_tree.nodes[node].bounds.max) {
+                    break;
+                }
+                m_tree.nodes[node].bounds = bounds;
+                node = m_tree.nodes[node].parent;
+            }
+        }
+        m_dirtyObjects.clear();
+        if (!m_rebuild.valid() && cost(m_tree) > m_builtCost * REBUILD_COST_RATIO) {
+            startRebuild();
+        }
+    }
+
+    bool rebuilding() const { return m_rebuild.valid(); }
+
+    // bvh：整个子树在所有平面内侧时不再测试子节点，直接输出子树中的全部物体；叶子中的物体逐个测试，结果和FrustumCuller相同
+    // contribution culling：子节点的包围球不比节点大，中心到相机的距离不小于节点包围盒到相机的距离，节点太小时整个子树都太小
+    void queryFrustum(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& visible, const ContributionTest& contribution = {}) const {
+        CPU_PROFILE_SCOPE("bvh frustum query");
+        visible.clear();
+        if (m_tree.nodes.empty()) {
+            return;
+        }
+        std::vector<std::pair<uint32_t, bool>>& stack = m_stack;
+        stack.assign(1, {0, false});
+        while (!stack.empty()) {
+            auto [index, inside] = stack.back();
+            stack.pop_back();
+            const Node& node = m_tree.nodes[index];
+            if (contribution.ratio > 0.0f) {
+                glm::vec3 nearest = glm::clamp(contribution.cameraPosition, node.bounds.min, node.bounds.max);
+                if (!contribution.contributes(nearest, (node.bounds.max - node.bounds.min) * 0.5f)) {
+                    continue;
+                }
+            }
+            if (!inside) {
+                FrustumTest test = testFrustum(node.bounds, planes);
+                if (test == FrustumTest::outside) {
+                    continue;
+                }
+                inside = test == FrustumTest::inside;
+            }
+            if (node.count == 0) {
+                stack.push_back({node.first, inside});
+                stack.push_back({node.first + 1, inside});
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                uint32_t object = m_tree.objects[i];
+                const Aabb& box = m_boxes[object];
+                if (contribution.ratio > 0.0f && !contribution.contributes((box.min + box.max) * 0.5f, (box.max - box.min) * 0.5f)) {
+                    continue;
+                }
+                if (inside || testFrustum(box, planes) != FrustumTest::outside) {
+                    visible.push_back(object);
+                }
+            }
+        }
+    }
+
+    // bvh：射线和物体包围盒最近的交点，先访问更近的子节点，比已经找到的交点远的子树直接跳过
+    // 返回false表示没有交点；起点在包围盒内时距离是0
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& hitObject, float& hitDistance) const {
+        if (m_tree.nodes.empty()) {
+            return false;
+        }
+        glm::vec3 inverseDirection = 1.0f / direction;
+        hitDistance = maxDistance;
+        bool hit = false;
+        std::vector<std::pair<uint32_t, bool>>& stack = m_stack;
+        stack.assign(1, {0, false});
+        while (!stack.empty()) {
+            uint32_t index = stack.back().first;
+            stack.pop_back();
+            const Node& node = m_tree.nodes[index];
+            if (rayDistance(node.bounds, origin, inverseDirection, hitDistance) >= hitDistance) {
+                continue;
+            }
+            if (node.count == 0) {
+                float left = rayDistance(m_tree.nodes[node.first].bounds, origin, inverseDirection, hitDistance);
+                float right = rayDistance(m_tree.nodes[node.first + 1].bounds, origin, inverseDirection, hitDistance);
+                bool leftFirst = left <= right;
+                stack.push_back({leftFirst ? node.first + 1 : node.first, false});  // 远的先入栈，后访问
+                stack.push_back({leftFirst ? node.first : node.first + 1, false});
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                uint32_t object = m_tree.objects[i];
+                float distance = rayDistance(m_boxes[object], origin, inverseDirection, hitDistance);
+                if (distance < hitDistance) {
+                    hitDistance = distance;
+                    hitObject = object;
+                    hit = true;
+                }
+            }
+        }
+        return hit;
+    }
+
+    // bvh：包围盒和box相交的物体
+    void queryOverlap(const Aabb& box, std::vector<uint32_t>& result) const {
+        query(result, [&](const Aabb& bounds) { return glm::all(glm::lessThanEqual(bounds.min, box.max)) && glm::all(glm::lessThanEqual(box.min, bounds.max)); });
+    }
+
+    // bvh：包围盒到center的距离不超过radius的物体，邻近查询
+    void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& result) const {
+        query(result, [&](const Aabb& bounds) {
+            glm::vec3 offset = center - glm::clamp(center, bounds.min, bounds.max);
+            return glm::dot(offset, offset) <= radius * radius;
+        });
+    }
+
+private:
+    static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+
+    // bvh：count为0时是内部节点，两个子节点是first和first + 1；叶子的物体是objects[first, first + count)
+    struct Node {
+        Aabb bounds;
+        uint32_t first = 0;
+        uint32_t count = 0;
+        uint32_t parent = INVALID_NODE;
+    };
+
+    struct Tree {
+        std::vector<Node> nodes;
+        std::vector<uint32_t> objects;
+        std::vector<uint32_t> objectLeaf;  // 每个物体所在的叶子，refit从这里开始
+    };
+
+    enum class FrustumTest { outside, intersecting, inside };
+
+    static Aabb emptyBox() { return {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)}; }
+
+    static void grow(Aabb& box, const Aabb& other) {
+        box.min = glm::min(box.min, other.min);
+        box.max = glm::max(box.max, other.max);
+    }
+
+    static float area(const Aabb& box) {
+        glm::vec3 size = glm::max(box.max - box.min, glm::vec3(0.0f));
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    Aabb nodeBounds(const Tree& tree, uint32_t index) const {
+        const Node& node = tree.nodes[index];
+        if (node.count == 0) {
+            Aabb bounds = tree.nodes[node.first].bounds;
+            grow(bounds, tree.nodes[node.first + 1].bounds);
+            return bounds;
+        }
+        Aabb bounds = emptyBox();
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            grow(bounds, m_boxes[tree.objects[i]]);
+        }
+        return bounds;
+    }
+
+    // bvh：SAH代价，内部节点按面积计TRAVERSAL_COST，叶子按面积乘物体数量，除以根节点的面积
+    static float cost(const Tree& tree) {
+        if (tree.nodes.empty()) {
+            return 0.0f;
+        }
+        float total = 0.0f;
+        for (const Node& node : tree.nodes) {
+            total += area(node.bounds) * (node.count == 0 ? TRAVERSAL_COST : float(node.count));
+        }
+        return total / std::max(area(tree.nodes[0].bounds), 1e-12f);
+    }
+
+    // bvh：和FrustumCuller::testBatch相同的测试，另外用最靠外侧的点判断是否完全在内侧
+    static FrustumTest testFrustum(const Aabb& box, const std::array<glm::vec4, 6>& planes) {
+        glm::vec3 center = (box.min + box.max) * 0.5f;
+        glm::vec3 extent = (box.max - box.min) * 0.5f;
+        FrustumTest result = FrustumTest::inside;
+        for (const glm::vec4& plane : planes) {
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+            if (distance + radius < 0.0f) {
+                return FrustumTest::outside;
+            }
+            if (distance - radius < 0.0f) {
+                result = FrustumTest::intersecting;
+            }
+        }
+        return result;
+    }
+
+    // bvh：slab测试，没有交点或者交点比maxDistance远时返回FLT_MAX
+    static float rayDistance(const Aabb& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance) {
+        glm::vec3 t0 = (box.min - origin) * inverseDirection;
+        glm::vec3 t1 = (box.max - origin) * inverseDirection;
+        glm::vec3 near = glm::min(t0, t1);
+        glm::vec3 far = glm::max(t0, t1);
+        float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        float exit = std::min(std::min(far.x, far.y), std::min(far.z, maxDistance));
+        return enter <= exit ? enter : FLT_MAX;
+    }
+
+    template <typename Overlaps>
+    void query(std::vector<uint32_t>& result, const Overlaps& overlaps) const {
+        result.clear();
+        if (m_tree.nodes.empty()) {
+            return;
+        }
+        std::vector<std::pair<uint32_t, bool>>& stack = m_stack;
+        stack.assign(1, {0, false});
+        while (!stack.empty()) {
+            const Node& node = m_tree.nodes[stack.back().first];
+            stack.pop_back();
+            if (!overlaps(node.bounds)) {
+                continue;
+            }
+            if (node.count == 0) {
+                stack.push_back({node.first, false});
+                stack.push_back({node.first + 1, false});
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (overlaps(m_boxes[m_tree.objects[i]])) {
+                    result.push_back(m_tree.objects[i]);
+                }
+            }
+        }
+    }
+
+    // bvh：自顶向下，每个节点在三个轴上把物体中心分到SAH_BIN_COUNT个bin，选代价最小的bin边界划分
+    // 划分的代价不低于直接作为叶子时停止；所有物体中心重合（无法按bin划分）时按一半数量划分
+    static Tree buildTree(const std::vector<Aabb>& boxes) {
+        Tree tree;
+        uint32_t objectCount = static_cast<uint32_t>(boxes.size());
+        if (objectCount == 0) {
+            return tree;
+        }
+        std::vector<glm::vec3> centers(objectCount);
+        for (uint32_t i = 0; i < objectCount; i++) {
+            centers[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+        }
+        tree.objects.resize(objectCount);
+        std::iota(tree.objects.begin(), tree.objects.end(), 0u);
+        tree.nodes.reserve(2 * objectCount);
+        tree.nodes.push_back({emptyBox(), 0, objectCount, INVALID_NODE});
+
+        std::vector<uint32_t> stack = {0};
+        while (!stack.empty()) {
+            uint32_t index = stack.back();
+            stack.pop_back();
+            uint32_t first = tree.nodes[index].first;
+            uint32_t count = tree.nodes[index].count;
+
+            Aabb bounds = emptyBox();
+            Aabb centerBounds = emptyBox();
+            for (uint32_t i = first; i < first + count; i++) {
+                grow(bounds, boxes[tree.objects[i]]);
+                grow(centerBounds, {centers[tree.objects[i]], centers[tree.objects[i]]});
+            }
+            tree.nodes[index].bounds = bounds;
+            if (count <= MAX_LEAF_OBJECTS) {
+                continue;
+            }
+
+            int bestAxis = -1;
+            uint32_t bestSplit = 0;
+            float bestCost = FLT_MAX;
+            for (int axis = 0; axis < 3; axis++) {
+                float extent = centerBounds.max[axis] - centerBounds.min[axis];
+                if (extent <= 0.0f) {
+                    continue;
+                }
+                std::array<Aabb, SAH_BIN_COUNT> binBounds;
+                std::array<uint32_t, SAH_BIN_COUNT> binCounts{};
+                binBounds.fill(emptyBox());
+                for (uint32_t i = first; i < first + count; i++) {
+                    uint32_t bin = binIndex(centers[tree.objects[i]][axis], centerBounds.min[axis], extent);
+                    grow(binBounds[bin], boxes[tree.objects[i]]);
+                    binCounts[bin]++;
+                }
+                // 从右往左累加，rightArea[i]和rightCount[i]是bin i到最后一个bin
+                std::array<float, SAH_BIN_COUNT> rightArea{};
+                std::array<uint32_t, SAH_BIN_COUNT> rightCount{};
+                Aabb right = emptyBox();
+                uint32_t rightObjects = 0;
+                for (uint32_t bin = SAH_BIN_COUNT; bin-- > 1;) {
+                    grow(right, binBounds[bin]);
+                    rightObjects += binCounts[bin];
+                    rightArea[bin] = area(right);
+                    rightCount[bin] = rightObjects;
+                }
+                Aabb left = emptyBox();
+                uint32_t leftObjects = 0;
+                for (uint32_t split = 1; split < SAH_BIN_COUNT; split++) {
+                    grow(left, binBounds[split - 1]);
+                    leftObjects += binCounts[split - 1];
+                    if (leftObjects == 0 || rightCount[split] == 0) {
+                        continue;
+                    }
+                    float splitCost = area(left) * leftObjects + rightArea[split] * rightCount[split];
+                    if (splitCost < bestCost) {
+                        bestCost = splitCost;
+                        bestAxis = axis;
+                        bestSplit = split;
+                    }
+                }
+            }
+
+            uint32_t* begin = tree.objects.data() + first;
+            uint32_t* end = begin + count;
+            uint32_t* middle = begin + count / 2;
+            if (bestAxis >= 0) {
+                float leafCost = float(count);
+                if (TRAVERSAL_COST + bestCost / std::max(area(bounds), 1e-12f) >= leafCost) {
+                    continue;
+                }
+                float extent = centerBounds.max[bestAxis] - centerBounds.min[bestAxis];
+                middle = std::partition(begin, end, [&](uint32_t object) {
+                    return binIndex(centers[object][bestAxis], centerBounds.min[bestAxis], extent) < bestSplit;
+                });
+            }
+
+            uint32_t leftCount = static_cast<uint32_t>(middle - begin);
+            uint32_t child = static_cast<uint32_t>(tree.nodes.size());
+            tree.nodes.push_back({emptyBox(), first, leftCount, index});
+            tree.nodes.push_back({emptyBox(), first + leftCount, count - leftCount, index});
+            tree.nodes[index].first = child;
+            tree.nodes[index].count = 0;
+            stack.push_back(child);
+            stack.push_back(child + 1);
+        }
+
+        tree.objectLeaf.resize(objectCount);
+        for (uint32_t index = 0; index < tree.nodes.size(); index++) {
+            const Node& node = tree.nodes[index];
+            for (uint32_t i = node.first; node.count > 0 && i < node.first + node.count; i++) {
+                tree.objectLeaf[tree.objects[i]] = index;
+            }
+        }
+        return tree;
+    }
+
+    static uint32_t binIndex(float center, float minimum, float extent) {
+        return std::min(static_cast<uint32_t>((center - minimum) / extent * SAH_BIN_COUNT), SAH_BIN_COUNT - 1);
+    }
+
+    // bvh：job只使用包围盒的快照，构建期间refit继续修改当前的树
+    void startRebuild() {
+        auto snapshot = std::make_shared<std::vector<Aabb>>(m_boxes);
+        if (m_pool == nullptr) {
+            m_tree = buildTree(*snapshot);
+            m_builtCost = cost(m_tree);
+            return;
+        }
+        auto promise = std::make_shared<std::promise<Tree>>();
+        m_rebuild = promise->get_future();
+        m_pool->submit([snapshot, promise]() {
+            CPU_PROFILE_SCOPE("bvh rebuild");
+            try {
+                promise->set_value(buildTree(*snapshot));
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+    }
+
+    // bvh：新的树按快照构建，之后移动的物体用当前的包围盒重新计算一次全部节点；子节点的index总是比父节点大，倒序计算即可
+    void adoptRebuild() {
+        if (!m_rebuild.valid() || m_rebuild.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        m_tree = m_rebuild.get();
+        for (uint32_t index = static_cast<uint32_t>(m_tree.nodes.size()); index-- > 0;) {
+            m_tree.nodes[index].bounds = nodeBounds(m_tree, index);
+        }
+        m_builtCost = cost(m_tree);
+    }
+
+    JobPool* m_pool = nullptr;
+    std::vector<Aabb> m_boxes;
+    std::vector<uint32_t> m_dirtyObjects;
+    Tree m_tree;
+    float m_builtCost = 0.0f;
+    std::future<Tree> m_rebuild;
+    mutable std::vector<std::pair<uint32_t, bool>> m_stack;  // 查询的遍历栈，避免每次分配
+};
@@ -3,7 +3,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-unsigned int k_complement_control_command = 0xFFFFFFFF;
+#include <cstddef>
+
+inline unsigned int k_complement_control_command = 0xFFFFFFFF;
 
 enum class GameCommand : unsigned int
 {
@@ -14,6 +16,13 @@ enum class GameCommand : unsigned int
 	invalid  = (unsigned int)(1 << 31) // lost focus
 };
 
+// input events：update时间段内的一次命令变化，time是相对于这段时间开始的秒数，按时间顺序排列
+struct CameraCommandEvent
+{
+	float time;
+	unsigned int command;
+};
+
 class Camera
 {
 public:
@@ -29,28 +38,54 @@ public:
 
 	void setCommand(unsigned int command) { m_command = command; }
 
-	void update(const float deltaTime)
+	void update(const float deltaTime) { update(deltaTime, nullptr, 0); }
+
+	// input events：在两次命令变化之间分段积分，一段时间中间的按下和松开按实际持续的时间移动，不再对齐到update的边界
+	void update(const float deltaTime, const CameraCommandEvent* events, size_t eventCount)
+	{
+		float time = 0.0f;
+		for (size_t i = 0; i < eventCount; i++)
+		{
+			float eventTime = glm::clamp(events[i].time, time, deltaTime);
+			integrate(eventTime - time);
+			time = eventTime;
+			m_command = events[i].command;
+		}
+		integrate(deltaTime - time);
+	}
+
+	glm::vec3 position() const { return m_pos; }
+	glm::vec3 lookAt() const { return m_lookAt; }
+	float fovy() const { return m_fovy; }
+	float zNear() const { return m_zNear; }
+	float zFar() const { return m_zFar; }
+	int viewportHeight() const { return m_viewportHeight; }
+
+	// simulation：渲染用的相机直接放到模拟插值出来的位置
+	void place(const glm::vec3& pos, const glm::vec3& lookAt)
 	{
-        float speed = 2.0f;
-        glm::vec3 moveDirection(0.f, 0.f, 0.f);
-        bool hasMoveCommand = false;
-        if ((unsigned int)GameCommand::forward & m_command)
-        {
-            moveDirection += m_forward;
-            hasMoveCommand = true;
-        }
-        if ((unsigned int)GameCommand::backward & m_command)
-        {
-            moveDirection -= m_forward;
-            hasMoveCommand = true;
-        }
-        if (hasMoveCommand)
-        {
-            m_pos += moveDirection * deltaTime * speed;
-            m_lookAt = m_pos + m_forward;
-        }
+		m_pos = pos;
+		m_lookAt = lookAt;
 	}
 
+	// world streaming：每帧在相机放好之后调用，速度是位置变化的指数平滑，相机被传送（比如benchmark重新开始）时的一帧跳变很快被平滑掉
+	void trackVelocity(const float deltaTime)
+	{
+		if (m_hasPreviousPos && deltaTime > 0.0f)
+		{
+			glm::vec3 velocity = (m_pos - m_previousPos) / deltaTime;
+			float alpha = glm::min(deltaTime / sg_velocitySmoothing, 1.0f);
+			m_velocity += (velocity - m_velocity) * alpha;
+		}
+		m_previousPos = m_pos;
+		m_hasPreviousPos = true;
+	}
+
+	glm::vec3 velocity() const { return m_velocity; }
+
+	// world streaming：按当前速度外推seconds秒之后的位置
+	glm::vec3 predictPosition(float seconds) const { return m_pos + m_velocity * seconds; }
+
 	glm::mat4 view() const
 	{
 		return glm::lookAt(m_pos, m_lookAt, m_up);
@@ -65,6 +100,44 @@ public:
 	}
 
 private:
+	// input events：按当前命令移动seconds秒，左右平移和前后的速度相同
+	void integrate(const float seconds)
+	{
+		if (seconds <= 0.0f)
+		{
+			return;
+		}
+		float speed = 2.0f;
+		glm::vec3 right = glm::normalize(glm::cross(m_forward, m_up)) * glm::length(m_forward);
+		glm::vec3 moveDirection(0.f, 0.f, 0.f);
+		bool hasMoveCommand = false;
+		if ((unsigned int)GameCommand::forward & m_command)
+		{
+			moveDirection += m_forward;
+			hasMoveCommand = true;
+		}
+		if ((unsigned int)GameCommand::backward & m_command)
+		{
+			moveDirection -= m_forward;
+			hasMoveCommand = true;
+		}
+		if ((unsigned int)GameCommand::left & m_command)
+		{
+			moveDirection -= right;
+			hasMoveCommand = true;
+		}
+		if ((unsigned int)GameCommand::right & m_command)
+		{
+			moveDirection += right;
+			hasMoveCommand = true;
+		}
+		if (hasMoveCommand)
+		{
+			m_pos += moveDirection * seconds * speed;
+			m_lookAt = m_pos + m_forward;
+		}
+	}
+
 	glm::vec3 m_pos = glm::vec3(2.0f, 2.0f, 2.0f);
 	glm::vec3 m_lookAt = glm::vec3(0.0f, 0.0f, 0.0f);
 	glm::vec3 m_up = glm::vec3(0.0f, 0.0f, 1.0f);
@@ -76,5 +149,10 @@ private:
 
     glm::vec3 m_forward = glm::vec3(-2.0f, -2.0f, -2.0f);
 
-	unsigned int m_command;
+	unsigned int m_command = 0;
+
+	static constexpr float sg_velocitySmoothing = 0.25f; // 速度平滑的时间常数，秒
+	glm::vec3 m_previousPos = glm::vec3(0.0f);
+	glm::vec3 m_velocity = glm::vec3(0.0f);
+	bool m_hasPreviousPos = false;
 };
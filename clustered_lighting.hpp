@@ -0,0 +1,275 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// clustered lighting：一个点光源或聚光灯，布局和light_cluster.comp、bindless.frag中的Light一致（std430）
+// color.w是聚光灯外锥角的cos，不大于-1时是点光源；direction.w是内锥角的cos
+struct ClusterLight {
+    glm::vec4 positionRange;  // 世界空间的位置和影响半径
+    glm::vec4 color;  // rgb已经乘上强度
+    glm::vec4 direction;  // 聚光灯朝向，世界空间
+};
+
+// clustered lighting：view frustum按屏幕的GRID_X * GRID_Y个tile和深度上指数划分的GRID_Z个slice分成cluster
+// 每帧compute把光源的包围球和每个cluster在view space的包围盒求交，cluster的光源列表写进cluster buffer
+// cluster buffer的开头是每个cluster的光源数量，之后每个cluster固定MAX_LIGHTS_PER_CLUSTER个光源index的位置，不需要原子操作
+// 聚光灯按它的包围球分配，是保守的；cluster的划分只和投影有关，dynamic resolution改变分辨率时不需要重建
+// 每个frame in flight一套buffer，光源和参数由cpu写入（host visible），cluster buffer由gpu写入（device local）
+// async compute：compute可以在专用的计算队列上执行，queueFamilies有多个时光源和cluster buffer使用CONCURRENT，不需要转移所有权
+class ClusteredLighting {
+public:
+    static constexpr uint32_t GRID_X = 16;
+    static constexpr uint32_t GRID_Y = 9;
+    static constexpr uint32_t GRID_Z = 24;
+    static constexpr uint32_t CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 64;  // 和light_cluster.comp、bindless.frag一致
+    static constexpr uint32_t WORKGROUP_SIZE = 64;  // 和light_cluster.comp的local_size_x一致
+
+    // extraUsage：descriptor buffer需要的device address，光源和cluster buffer在set 0中
+    // queueFamilies：执行compute和片段着色器读取的queue family
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, uint32_t maxLights, uint32_t frameCount,
+        VkBufferUsageFlags extraUsage, const std::vector<uint32_t>& queueFamilies) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_queueFamilies = queueFamilies;
+        m_maxLights = std::max(maxLights, 1u);  // 没有光源时buffer也要存在，set 0的descriptor总是有效
+
+        createPipeline(pipelineCache, shaderCode);
+
+        VkDescriptorPoolSize poolSizes[2] = {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount}, {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * frameCount}};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 2;
+        poolInfo.pPoolSizes = poolSizes;
+        poolInfo.maxSets = frameCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create light cluster descriptor pool!");
+        }
+
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            frame.params = createBuffer(sizeof(Params), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                MemoryCategory::uniform, "light cluster params");
+            frame.lights = createBuffer(lightRange(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | extraUsage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                MemoryCategory::uniform, "lights");
+            frame.clusters = createBuffer(clusterRange(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | extraUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::other,
+                "light clusters");
+
+            VkDescriptorSetAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = m_descriptorPool;
+            allocInfo.descriptorSetCount = 1;
+            allocInfo.pSetLayouts = &m_descriptorSetLayout;
+            if (vkAllocateDescriptorSets(m_device, &allocInfo, &frame.set) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate light cluster descriptor set!");
+            }
+            writeSet(frame);
+        }
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        for (Frame& frame : m_frames) {
+            for (Buffer* buffer : {&frame.params, &frame.lights, &frame.clusters}) {
+                vkDestroyBuffer(m_device, buffer->buffer, hostAllocator());
+                m_allocator->free(buffer->allocation);
+            }
+        }
+        m_frames.clear();
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());  // set随pool一起释放
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // clustered lighting：超过maxLights的光源被忽略，返回这一帧实际的光源数量
+    // 调用者需要保证gpu已经完成上次使用这一帧的命令
+    uint32_t update(uint32_t frameIndex, const ClusterLight* lights, uint32_t lightCount, const glm::mat4& view, const glm::mat4& proj, float zNear, float zFar) {
+        Frame& frame = m_frames[frameIndex];
+        lightCount = std::min(lightCount, m_maxLights);
+        if (lightCount > 0) {
+            memcpy(frame.lights.allocation.mapped, lights, sizeof(ClusterLight) * lightCount);
+        }
+
+        Params params{};
+        params.view = view;
+        params.inverseProj = glm::inverse(proj);
+        params.grid = glm::uvec4(GRID_X, GRID_Y, GRID_Z, lightCount);
+        params.depthRange = glm::vec2(zNear, zFar);
+        memcpy(frame.params.allocation.mapped, &params, sizeof(params));
+        return lightCount;
+    }
+
+    // clustered lighting：ubo中给片段着色器的参数，xy把像素坐标映射到tile，zw把view space深度映射到slice：slice = log(depth) * z + w
+    static glm::vec4 fragmentScale(VkExtent2D renderExtent, float zNear, float zFar) {
+        float sliceScale = float(GRID_Z) / std::log(zFar / zNear);
+        return glm::vec4(float(GRID_X) / float(renderExtent.width), float(GRID_Y) / float(renderExtent.height), sliceScale, -std::log(zNear) * sliceScale);
+    }
+
+    // clustered lighting：在render pass之外录制，之后的barrier让这一帧的片段着色器看到cluster列表
+    // 上一次读取这一帧cluster buffer的提交已经完成（frame in flight的fence），之前不需要barrier
+    // async compute：asyncQueue时录制在计算队列上，计算队列不支持片段着色器阶段的barrier，由图形队列提交时等待semaphore保证可见
+    void record(VkCommandBuffer commandBuffer, uint32_t frameIndex, bool asyncQueue = false) {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_frames[frameIndex].set, 0, nullptr);
+        vkCmdDispatch(commandBuffer, (CLUSTER_COUNT + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+        if (asyncQueue) {
+            return;
+        }
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = m_frames[frameIndex].clusters.buffer;
+        barrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    VkBuffer lightBuffer(uint32_t frameIndex) const { return m_frames[frameIndex].lights.buffer; }
+    VkDeviceSize lightRange() const { return sizeof(ClusterLight) * VkDeviceSize(m_maxLights); }
+    VkBuffer clusterBuffer(uint32_t frameIndex) const { return m_frames[frameIndex].clusters.buffer; }
+    VkDeviceSize clusterRange() const { return sizeof(uint32_t) * VkDeviceSize(CLUSTER_COUNT) * (1 + MAX_LIGHTS_PER_CLUSTER); }
+
+private:
+    // clustered lighting：布局和light_cluster.comp中的Params一致（std140），grid.w是光源数量
+    struct Params {
+        glm::mat4 view;
+        glm::mat4 inverseProj;
+        glm::uvec4 grid;
+        glm::vec2 depthRange;
+    };
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    struct Frame {
+        Buffer params;
+        Buffer lights;
+        Buffer clusters;
+        VkDescriptorSet set = VK_NULL_HANDLE;
+    };
+
+    // clustered lighting：0是参数，1是光源，2是cluster列表
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+        VkDescriptorType types[3] = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = types[i];
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create light cluster descriptor set layout!");
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create light cluster pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create light cluster shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create light cluster compute pipeline!");
+        }
+    }
+
+    // clustered lighting：set引用的buffer在整个程序运行期间不变，只在init时写入
+    void writeSet(const Frame& frame) {
+        VkDescriptorBufferInfo bufferInfos[3] = {{frame.params.buffer, 0, sizeof(Params)}, {frame.lights.buffer, 0, lightRange()}, {frame.clusters.buffer, 0, clusterRange()}};
+        std::array<VkWriteDescriptorSet, 3> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = frame.set;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, const char* name) {
+        Buffer result;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (m_queueFamilies.size() > 1) {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(m_queueFamilies.size());
+            bufferInfo.pQueueFamilyIndices = m_queueFamilies.data();
+        }
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &result.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create light cluster buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, result.buffer, &memRequirements);
+        result.allocation = m_allocator->allocate(memRequirements, properties, true, category, 0, name);
+        vkBindBufferMemory(m_device, result.buffer, result.allocation.memory, result.allocation.offset);
+        return result;
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_maxLights = 0;
+    std::vector<uint32_t> m_queueFamilies;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    std::vector<Frame> m_frames;
+};
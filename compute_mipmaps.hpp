@@ -0,0 +1,233 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "shader_registry.hpp"
+#include "upload_context.hpp"
+
+// mipmap：vkCmdBlitImage需要格式支持linear filter和blit，不支持时用compute shader逐级下采样
+// 每一级创建一对storage image view（上一级作为输入，这一级作为输出），view和descriptor在上传完成后销毁
+class ComputeMipmapGenerator {
+public:
+    void init(VkDevice device, VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        m_device = device;
+
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;  // 0是上一级mip，1是这一级mip
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mipmap descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mipmap pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mipmap shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mipmap compute pipeline!");
+        }
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool isInitialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // mipmap：录制mip生成命令到图形队列的command buffer
+    // image需要STORAGE usage和MUTABLE_FORMAT，storageFormat是storage view使用的unorm格式
+    // 调用前所有level都处于TRANSFER_DST_OPTIMAL并且level 0已经写入，调用后所有level处于SHADER_READ_ONLY_OPTIMAL
+    void generate(UploadContext& uploadContext, VkImage image, VkFormat storageFormat, bool srgb, uint32_t width, uint32_t height, uint32_t mipLevels) {
+        VkCommandBuffer commandBuffer = uploadContext.graphicsCommandBuffer();
+
+        // 所有level转换到GENERAL，storage image只能在GENERAL layout中读写
+        imageBarrier(commandBuffer, image, 0, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        if (mipLevels > 1) {
+            uint32_t passCount = mipLevels - 1;
+            VkDescriptorPool descriptorPool = createDescriptorPool(passCount);
+
+            std::vector<VkImageView> views(mipLevels);
+            for (uint32_t i = 0; i < mipLevels; i++) {
+                views[i] = createLevelView(image, storageFormat, i);
+            }
+
+            std::vector<VkDescriptorSetLayout> layouts(passCount, m_descriptorSetLayout);
+            VkDescriptorSetAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = descriptorPool;
+            allocInfo.descriptorSetCount = passCount;
+            allocInfo.pSetLayouts = layouts.data();
+
+            std::vector<VkDescriptorSet> descriptorSets(passCount);
+            if (vkAllocateDescriptorSets(m_device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate mipmap descriptor sets!");
+            }
+
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+            int32_t mipWidth = static_cast<int32_t>(width);
+            int32_t mipHeight = static_cast<int32_t>(height);
+            for (uint32_t i = 1; i < mipLevels; i++) {
+                mipWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+                mipHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+                writeDescriptorSet(descriptorSets[i - 1], views[i - 1], views[i]);
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &descriptorSets[i - 1], 0, nullptr);
+
+                PushConstants constants{mipWidth, mipHeight, srgb ? 1u : 0u};
+                vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+                vkCmdDispatch(commandBuffer, (mipWidth + 7) / 8, (mipHeight + 7) / 8, 1);
+
+                // 下一级读取之前等待这一级写入完成
+                imageBarrier(commandBuffer, image, i, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+                    VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            }
+
+            // view和descriptor pool在gpu执行完这次上传后才能销毁
+            VkDevice device = m_device;
+            uploadContext.deferUntilComplete([device, descriptorPool, views]() {
+                for (VkImageView view : views) {
+                    vkDestroyImageView(device, view, hostAllocator());
+                }
+                vkDestroyDescriptorPool(device, descriptorPool, hostAllocator());
+            });
+        }
+
+        imageBarrier(commandBuffer, image, 0, mipLevels, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+
+private:
+    struct PushConstants {
+        int32_t dstWidth;
+        int32_t dstHeight;
+        uint32_t srgb;
+    };
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+
+    VkDescriptorPool createDescriptorPool(uint32_t setCount) {
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        poolSize.descriptorCount = setCount * 2;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = setCount;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mipmap descriptor pool!");
+        }
+        return pool;
+    }
+
+    VkImageView createLevelView(VkImage image, VkFormat format, uint32_t level) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+
+        VkImageView view;
+        if (vkCreateImageView(m_device, &viewInfo, hostAllocator(), &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mipmap image view!");
+        }
+        return view;
+    }
+
+    void writeDescriptorSet(VkDescriptorSet descriptorSet, VkImageView srcView, VkImageView dstView) {
+        std::array<VkDescriptorImageInfo, 2> imageInfos{};
+        imageInfos[0] = {VK_NULL_HANDLE, srcView, VK_IMAGE_LAYOUT_GENERAL};
+        imageInfos[1] = {VK_NULL_HANDLE, dstView, VK_IMAGE_LAYOUT_GENERAL};
+
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[i].pImageInfo = &imageInfos[i];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    static void imageBarrier(VkCommandBuffer commandBuffer, VkImage image, uint32_t baseLevel, uint32_t levelCount,
+        VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess, VkAccessFlags dstAccess,
+        VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = image;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+};
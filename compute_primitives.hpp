@@ -0,0 +1,519 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// compute primitives：设备的subgroup属性，选择shader变体和输出benchmark时使用
+struct SubgroupCapabilities {
+    uint32_t size = 1;
+    bool arithmetic = false;  // compute stage支持basic和arithmetic操作
+    bool ballot = false;
+
+    static SubgroupCapabilities query(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceSubgroupProperties subgroup{};
+        subgroup.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &subgroup;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        SubgroupCapabilities capabilities;
+        capabilities.size = subgroup.subgroupSize;
+        if (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) {
+            VkSubgroupFeatureFlags arithmetic = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+            VkSubgroupFeatureFlags ballot = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+            capabilities.arithmetic = (subgroup.supportedOperations & arithmetic) == arithmetic;
+            capabilities.ballot = (subgroup.supportedOperations & ballot) == ballot;
+        }
+        return capabilities;
+    }
+};
+
+// compute primitives：culling、compaction、排序、直方图和light binning共用的uint数组操作：reduce、exclusive scan、stream compaction、256格直方图
+// 和gpu radix sort一样是reduce-then-scan：block求和、一个workgroup scan所有block的和、每个block在起点上scan，不依赖workgroup之间的前进保证
+// 调用者的buffer通过bind得到的Binding传入，同一组buffer只需要bind一次；元素数量可以是常数，也可以由gpu写在counts buffer中，dispatch的大小按上限固定
+// subgroup arithmetic的shader变体在subgroup内完成reduce和scan，设备支持时由调用者选择（SubgroupCapabilities::arithmetic）
+class ComputePrimitives {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 256;  // 和compute_primitives.comp的local_size_x一致
+    static constexpr uint32_t ITEMS_PER_THREAD = 4;
+    static constexpr uint32_t TILE_SIZE = WORKGROUP_SIZE * ITEMS_PER_THREAD;
+    static constexpr uint32_t HISTOGRAM_BINS = 256;
+    static constexpr uint32_t CONSTANT_COUNT = 0xffffffff;  // countIndex：元素数量是record时传入的count
+    static constexpr uint32_t COMPACT_INVALID = 0xffffffff;  // compaction丢弃等于它的元素
+    static constexpr uint32_t MAX_BINDINGS = 16;
+
+    struct Binding {
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        VkBuffer output = VK_NULL_HANDLE;
+    };
+
+    // compute primitives：capacity是一次操作的元素数量上限，决定partials的大小
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, uint32_t capacity) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_capacity = capacity;
+        createPipeline(pipelineCache, shaderCode);
+        m_partials = createBuffer(VkDeviceSize(blockCount(capacity) + 1) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "compute primitives partials");
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNT * MAX_BINDINGS};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;  // benchmark使用的Binding单独释放
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = MAX_BINDINGS;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute primitives descriptor pool!");
+        }
+    }
+
+    // compute primitives：调用者保证gpu已经空闲
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        destroyBuffer(m_partials);
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+    uint32_t capacity() const { return m_capacity; }
+
+    // compute primitives：所有buffer都需要STORAGE_BUFFER_BIT，直方图的output还需要TRANSFER_DST_BIT；counts只用于gpu写入的数量和compaction的结果，不需要时传VK_NULL_HANDLE
+    // 最多MAX_BINDINGS组，和pipeline一起在cleanup时释放
+    Binding bind(VkBuffer input, VkBuffer output, VkBuffer counts) {
+        Binding binding;
+        binding.output = output;
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = m_descriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkAllocateDescriptorSets(m_device, &setInfo, &binding.set) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate compute primitives descriptor set!");
+        }
+
+        // 没有counts时绑定partials，shader不会访问
+        std::array<VkDescriptorBufferInfo, BINDING_COUNT> bufferInfos = {{{input, 0, VK_WHOLE_SIZE}, {output, 0, VK_WHOLE_SIZE},
+            {m_partials.buffer, 0, VK_WHOLE_SIZE}, {counts != VK_NULL_HANDLE ? counts : m_partials.buffer, 0, VK_WHOLE_SIZE}}};
+        std::array<VkWriteDescriptorSet, BINDING_COUNT> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = binding.set;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        return binding;
+    }
+
+    // compute primitives：下面的record函数中count是元素数量，countIndex不是CONSTANT_COUNT时是数量的上限，实际数量从counts[countIndex]读取
+    // 调用之前输入的写入已经对compute shader可见；录制结束时结果对compute shader可见，其他stage由调用者同步；会改变绑定的compute pipeline和descriptor set
+    // 同一个ComputePrimitives的操作共用partials，必须依次执行
+
+    // compute primitives：output[0]是所有元素的和（按uint溢出）
+    void reduce(VkCommandBuffer commandBuffer, const Binding& binding, uint32_t count, uint32_t countIndex = CONSTANT_COUNT) const {
+        PushConstants constants = begin(commandBuffer, binding, OP_REDUCE, count, countIndex);
+        constants.control.x = PASS_BLOCK_REDUCE;
+        dispatch(commandBuffer, constants, constants.sizes.y);
+        constants.control.x = PASS_SCAN_PARTIALS;
+        dispatch(commandBuffer, constants, 1);
+    }
+
+    // compute primitives：output[i]是input中i之前的元素的和
+    void exclusiveScan(VkCommandBuffer commandBuffer, const Binding& binding, uint32_t count, uint32_t countIndex = CONSTANT_COUNT) const {
+        PushConstants constants = begin(commandBuffer, binding, OP_SCAN, count, countIndex);
+        recordScan(commandBuffer, constants);
+    }
+
+    // compute primitives：不等于COMPACT_INVALID的元素按原来的顺序写到output的开头，数量写进counts[outputCountIndex]
+    void compact(VkCommandBuffer commandBuffer, const Binding& binding, uint32_t count, uint32_t outputCountIndex, uint32_t countIndex = CONSTANT_COUNT) const {
+        PushConstants constants = begin(commandBuffer, binding, OP_COMPACT, count, countIndex);
+        constants.control.w = outputCountIndex;
+        recordScan(commandBuffer, constants);
+    }
+
+    // compute primitives：output[0..HISTOGRAM_BINS)是(element >> shift) & 0xff的计数，录制时先清零
+    void histogram(VkCommandBuffer commandBuffer, const Binding& binding, uint32_t count, uint32_t shift = 0, uint32_t countIndex = CONSTANT_COUNT) const {
+        vkCmdFillBuffer(commandBuffer, binding.output, 0, HISTOGRAM_BINS * sizeof(uint32_t), 0);
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        PushConstants constants = begin(commandBuffer, binding, 0, count, countIndex);
+        constants.control.x = PASS_HISTOGRAM;
+        constants.sizes.z = shift;
+        dispatch(commandBuffer, constants, constants.sizes.y);
+    }
+
+    // compute primitives：每个操作对count个随机元素执行iterations次，gpu timestamp测量时间，结果和cpu的计算比较，每个操作输出一行
+    // 单独提交并等待queue空闲，只在启动时或工具中调用；queue需要支持timestamp
+    template <typename Stream>
+    void benchmark(VkPhysicalDevice physicalDevice, VkQueue queue, VkCommandPool commandPool, uint32_t count, uint32_t iterations, bool subgroupVariant,
+        Stream& out) {
+        count = std::min(count, m_capacity);
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        SubgroupCapabilities subgroup = SubgroupCapabilities::query(physicalDevice);
+
+        // 一半的元素是COMPACT_INVALID，其他是16位的随机数；reduce和scan按uint溢出，cpu端同样
+        std::vector<uint32_t> values(count);
+        std::mt19937 random(1);
+        for (uint32_t& value : values) {
+            value = (random() & 1) ? COMPACT_INVALID : random() & 0xffff;
+        }
+
+        VkDeviceSize dataSize = VkDeviceSize(count) * sizeof(uint32_t);
+        Buffer upload = createBuffer(dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            "compute primitives benchmark");
+        memcpy(upload.allocation.mapped, values.data(), dataSize);
+        Buffer input = createBuffer(dataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            "compute primitives benchmark");
+        Buffer counts = createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            "compute primitives benchmark");
+        std::array<Buffer, BENCHMARK_OPS> outputs;
+        std::array<VkDeviceSize, BENCHMARK_OPS> readbackOffsets;
+        VkDeviceSize readbackSize = 0;
+        for (uint32_t op = 0; op < BENCHMARK_OPS; op++) {
+            VkDeviceSize size = op == OP_REDUCE ? sizeof(uint32_t) : op == OP_HISTOGRAM ? HISTOGRAM_BINS * sizeof(uint32_t) : dataSize;
+            outputs[op] = createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "compute primitives benchmark");
+            readbackOffsets[op] = readbackSize;
+            readbackSize += size;
+        }
+        VkDeviceSize countOffset = readbackSize;
+        readbackSize += sizeof(uint32_t);
+        Buffer readback = createBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            "compute primitives benchmark");
+
+        // benchmark的buffer绑定占用BENCHMARK_OPS组，结束时释放
+        std::array<Binding, BENCHMARK_OPS> bindings;
+        for (uint32_t op = 0; op < BENCHMARK_OPS; op++) {
+            bindings[op] = bind(input.buffer, outputs[op].buffer, counts.buffer);
+        }
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = BENCHMARK_OPS * 2;
+        VkQueryPool queryPool;
+        if (vkCreateQueryPool(m_device, &queryPoolInfo, hostAllocator(), &queryPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute primitives query pool!");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate compute primitives command buffer!");
+        }
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        vkCmdResetQueryPool(commandBuffer, queryPool, 0, queryPoolInfo.queryCount);
+        VkBufferCopy uploadCopy{0, 0, dataSize};
+        vkCmdCopyBuffer(commandBuffer, upload.buffer, input.buffer, 1, &uploadCopy);
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        for (uint32_t op = 0; op < BENCHMARK_OPS; op++) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, op * 2);
+            for (uint32_t i = 0; i < iterations; i++) {
+                switch (op) {
+                    case OP_REDUCE:
+                        reduce(commandBuffer, bindings[op], count);
+                        break;
+                    case OP_SCAN:
+                        exclusiveScan(commandBuffer, bindings[op], count);
+                        break;
+                    case OP_COMPACT:
+                        compact(commandBuffer, bindings[op], count, 0);
+                        break;
+                    case OP_HISTOGRAM:
+                        histogram(commandBuffer, bindings[op], count);
+                        break;
+                }
+            }
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, op * 2 + 1);
+        }
+
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        for (uint32_t op = 0; op < BENCHMARK_OPS; op++) {
+            VkBufferCopy copy{0, readbackOffsets[op], (op + 1 < BENCHMARK_OPS ? readbackOffsets[op + 1] : countOffset) - readbackOffsets[op]};
+            vkCmdCopyBuffer(commandBuffer, outputs[op].buffer, readback.buffer, 1, &copy);
+        }
+        VkBufferCopy countCopy{0, countOffset, sizeof(uint32_t)};
+        vkCmdCopyBuffer(commandBuffer, counts.buffer, readback.buffer, 1, &countCopy);
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit compute primitives benchmark!");
+        }
+        vkQueueWaitIdle(queue);
+
+        std::array<uint64_t, BENCHMARK_OPS * 2> timestamps{};
+        vkGetQueryPoolResults(m_device, queryPool, 0, queryPoolInfo.queryCount, sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+        const uint8_t* results = static_cast<const uint8_t*>(readback.allocation.mapped);
+        std::array<bool, BENCHMARK_OPS> valid;
+        valid[OP_REDUCE] = validateReduce(values, results + readbackOffsets[OP_REDUCE]);
+        valid[OP_SCAN] = validateScan(values, results + readbackOffsets[OP_SCAN]);
+        valid[OP_COMPACT] = validateCompact(values, results + readbackOffsets[OP_COMPACT], results + countOffset);
+        valid[OP_HISTOGRAM] = validateHistogram(values, results + readbackOffsets[OP_HISTOGRAM]);
+
+        static const char* NAMES[BENCHMARK_OPS] = {"reduce", "exclusive scan", "compact", "histogram"};
+        out << "compute primitives (" << count << " elements, " << iterations << " iterations, subgroup size " << subgroup.size
+            << (subgroupVariant ? ", subgroup arithmetic" : ", shared memory") << "):\n";
+        for (uint32_t op = 0; op < BENCHMARK_OPS; op++) {
+            double ms = static_cast<double>(timestamps[op * 2 + 1] - timestamps[op * 2]) * properties.limits.timestampPeriod * 1e-6 / iterations;
+            double elementsPerSecond = ms > 0.0 ? count / (ms * 1e-3) : 0.0;
+            out << "  " << NAMES[op] << ": " << ms << " ms, " << elementsPerSecond * 1e-9 << " Gelem/s" << (valid[op] ? "" : ", WRONG RESULT") << "\n";
+        }
+
+        vkFreeCommandBuffers(m_device, commandPool, 1, &commandBuffer);
+        vkDestroyQueryPool(m_device, queryPool, hostAllocator());
+        for (Binding& binding : bindings) {
+            vkFreeDescriptorSets(m_device, m_descriptorPool, 1, &binding.set);
+        }
+        destroyBuffer(upload);
+        destroyBuffer(input);
+        destroyBuffer(counts);
+        destroyBuffer(readback);
+        for (Buffer& output : outputs) {
+            destroyBuffer(output);
+        }
+    }
+
+private:
+    static constexpr uint32_t BINDING_COUNT = 4;
+    // compute primitives：和compute_primitives.comp中的pass和操作编号一致，OP_HISTOGRAM只用于benchmark
+    static constexpr uint32_t PASS_BLOCK_REDUCE = 0;
+    static constexpr uint32_t PASS_SCAN_PARTIALS = 1;
+    static constexpr uint32_t PASS_BLOCK_SCAN = 2;
+    static constexpr uint32_t PASS_HISTOGRAM = 3;
+    static constexpr uint32_t OP_REDUCE = 0;
+    static constexpr uint32_t OP_SCAN = 1;
+    static constexpr uint32_t OP_COMPACT = 2;
+    static constexpr uint32_t OP_HISTOGRAM = 3;
+    static constexpr uint32_t BENCHMARK_OPS = 4;
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    // compute primitives：和compute_primitives.comp的push constant一致
+    struct PushConstants {
+        glm::uvec4 control;  // pass、操作、元素数量在counts中的下标、compaction保留数量在counts中的下标
+        glm::uvec4 sizes;  // 元素数量的上限、block数量、直方图的位移
+    };
+
+    static uint32_t blockCount(uint32_t count) { return (count + TILE_SIZE - 1) / TILE_SIZE; }
+
+    PushConstants begin(VkCommandBuffer commandBuffer, const Binding& binding, uint32_t op, uint32_t count, uint32_t countIndex) const {
+        if (count > m_capacity) {
+            throw std::runtime_error("compute primitives count exceeds capacity!");
+        }
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &binding.set, 0, nullptr);
+        PushConstants constants{};
+        constants.control = glm::uvec4(0, op, countIndex, 0);
+        constants.sizes = glm::uvec4(count, blockCount(count), 0, 0);
+        return constants;
+    }
+
+    void recordScan(VkCommandBuffer commandBuffer, PushConstants& constants) const {
+        constants.control.x = PASS_BLOCK_REDUCE;
+        dispatch(commandBuffer, constants, constants.sizes.y);
+        constants.control.x = PASS_SCAN_PARTIALS;
+        dispatch(commandBuffer, constants, 1);
+        constants.control.x = PASS_BLOCK_SCAN;
+        dispatch(commandBuffer, constants, constants.sizes.y);
+    }
+
+    // compute primitives：每个dispatch读取上一个dispatch写入的partials或结果；没有元素时也dispatch一个workgroup，写出零
+    void dispatch(VkCommandBuffer commandBuffer, const PushConstants& constants, uint32_t groupCount) const {
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, std::max(groupCount, 1u), 1, 1);
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    static uint32_t readUint(const uint8_t* data, size_t index) {
+        uint32_t value;
+        memcpy(&value, data + index * sizeof(uint32_t), sizeof(value));
+        return value;
+    }
+
+    static bool validateReduce(const std::vector<uint32_t>& values, const uint8_t* result) {
+        uint32_t sum = 0;
+        for (uint32_t value : values) {
+            sum += value;
+        }
+        return readUint(result, 0) == sum;
+    }
+
+    static bool validateScan(const std::vector<uint32_t>& values, const uint8_t* result) {
+        uint32_t sum = 0;
+        for (size_t i = 0; i < values.size(); i++) {
+            if (readUint(result, i) != sum) {
+                return false;
+            }
+            sum += values[i];
+        }
+        return true;
+    }
+
+    static bool validateCompact(const std::vector<uint32_t>& values, const uint8_t* result, const uint8_t* count) {
+        uint32_t kept = 0;
+        for (uint32_t value : values) {
+            if (value != COMPACT_INVALID && readUint(result, kept++) != value) {
+                return false;
+            }
+        }
+        return readUint(count, 0) == kept;
+    }
+
+    static bool validateHistogram(const std::vector<uint32_t>& values, const uint8_t* result) {
+        std::array<uint32_t, HISTOGRAM_BINS> bins{};
+        for (uint32_t value : values) {
+            bins[value & 0xff]++;
+        }
+        for (uint32_t i = 0; i < HISTOGRAM_BINS; i++) {
+            if (readUint(result, i) != bins[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute primitives descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute primitives pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute primitives shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute primitives compute pipeline!");
+        }
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, const char* name) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create compute primitives buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        buffer.allocation = m_allocator->allocate(memRequirements, properties, true, MemoryCategory::other, 0, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+        return buffer;
+    }
+
+    void destroyBuffer(Buffer& buffer) {
+        vkDestroyBuffer(m_device, buffer.buffer, hostAllocator());
+        m_allocator->free(buffer.allocation);
+        buffer = {};
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_capacity = 0;
+    Buffer m_partials;  // 每个block一个uint，最后一个是所有元素的和
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+};
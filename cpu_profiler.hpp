@@ -0,0 +1,195 @@
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// startup timer：进程启动的时间，在main之前的静态初始化中取得，trace的时间也从这里开始
+inline const std::chrono::steady_clock::time_point g_processStartTime = std::chrono::steady_clock::now();
+
+// cpu profiler：之前只有calculateFPS的平均帧时间，看不出一帧的cpu时间花在等待、录制还是提交上
+// CPU_PROFILE_SCOPE在作用域开始和结束时取时间，事件写进当前线程自己的buffer，写入不加锁
+// 每个线程第一次记录时注册自己的buffer（只有这一次加锁），buffer写满后从头覆盖，只保留最近的事件
+// 按T键或者程序退出时导出chrome trace格式的json，可以用chrome://tracing或者ui.perfetto.dev打开
+// 名字必须是字符串字面量之类生命周期覆盖整个程序的字符串，事件只保存指针
+// gpu timeline：gpu profiler把校准到steady_clock的pass时间写进一条单独的track，和cpu线程显示在同一条时间线上
+class CpuProfiler {
+    struct ThreadBuffer;
+
+public:
+    using Clock = std::chrono::steady_clock;
+    using Track = ThreadBuffer;  // gpu timeline：不属于任何线程的时间线，比如gpu队列
+
+    static CpuProfiler& instance() {
+        static CpuProfiler profiler;
+        return profiler;
+    }
+
+    void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    Clock::time_point now() const { return Clock::now(); }
+
+    void record(const char* name, Clock::time_point start, Clock::time_point end) {
+        record(threadBuffer(), name, start, end);
+    }
+
+    // gpu timeline：一条track只能由一个线程写入，和线程自己的buffer一样不加锁
+    void record(Track& buffer, const char* name, Clock::time_point start, Clock::time_point end) {
+        uint64_t index = buffer.count.load(std::memory_order_relaxed);
+        Event& event = buffer.events[index % EVENTS_PER_THREAD];
+        event.name = name;
+        event.startNs = nanoseconds(start);
+        event.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        buffer.count.store(index + 1, std::memory_order_release);  // 导出线程看到新的count时事件已经写完
+    }
+
+    // cpu profiler：线程名出现在trace中，不设置时显示为thread加序号
+    void setThreadName(const char* name) { threadBuffer().name = name; }
+
+    // gpu timeline：track在程序结束前不释放，name的要求和事件名字相同
+    Track* createTrack(const char* name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Track* track = registerBuffer();
+        track->name = name;
+        return track;
+    }
+
+    // gpu timeline：运行时才知道的名字（比如gpu profiler的scope）复制一份保存到程序结束，相同的名字返回同一个指针
+    const char* intern(std::string_view name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::string& interned : m_names) {
+            if (interned == name) {
+                return interned.c_str();
+            }
+        }
+        return m_names.emplace_back(name).c_str();
+    }
+
+    // cpu profiler：导出时其它线程可能还在写入，每个buffer只读最近EVENTS_PER_THREAD - EXPORT_GUARD个事件，避开正在被覆盖的位置
+    // hitch detector：since之前结束的事件不导出；otherData是JSON对象的成员（不含花括号），trace viewer显示为metadata
+    bool writeChromeTrace(const std::string& path, Clock::time_point since = {}, std::string_view otherData = {}) {
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        int64_t sinceNs = since == Clock::time_point{} ? INT64_MIN : nanoseconds(since);
+        file << "{";
+        if (!otherData.empty()) {
+            file << "\"otherData\":{" << otherData << "},\n";
+        }
+        file << "\"traceEvents\":[\n";
+        bool first = true;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::unique_ptr<ThreadBuffer>& buffer : m_buffers) {
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+                 << ",\"args\":{\"name\":\"" << (buffer->name != nullptr ? buffer->name : "thread") << " " << buffer->id << "\"}}";
+            first = false;
+
+            uint64_t count = buffer->count.load(std::memory_order_acquire);
+            uint64_t kept = EVENTS_PER_THREAD - EXPORT_GUARD;
+            uint64_t begin = count > kept ? count - kept : 0;
+            for (uint64_t i = begin; i < count; i++) {
+                const Event& event = buffer->events[i % EVENTS_PER_THREAD];
+                if (event.startNs + event.durationNs < sinceNs) {
+                    continue;
+                }
+                // chrome trace的时间单位是微秒，保留小数到纳秒
+                file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                     << ",\"ts\":" << event.startNs / 1000 << "." << threeDigits(event.startNs % 1000)
+                     << ",\"dur\":" << event.durationNs / 1000 << "." << threeDigits(event.durationNs % 1000) << "}";
+            }
+        }
+        file << "\n]}\n";
+        return static_cast<bool>(file);
+    }
+
+private:
+    static constexpr uint64_t EVENTS_PER_THREAD = 64 * 1024;
+    static constexpr uint64_t EXPORT_GUARD = 1024;
+
+    struct Event {
+        const char* name = nullptr;
+        int64_t startNs = 0;
+        int64_t durationNs = 0;
+    };
+
+    // cpu profiler：只有所属线程写入events和count，导出线程只读
+    struct ThreadBuffer {
+        std::vector<Event> events = std::vector<Event>(EVENTS_PER_THREAD);
+        std::atomic<uint64_t> count{0};
+        const char* name = nullptr;
+        uint32_t id = 0;
+    };
+
+    CpuProfiler() : m_origin(g_processStartTime) {}
+
+    // cpu profiler：buffer在程序结束前不释放，线程退出之后它的事件仍然可以导出
+    ThreadBuffer& threadBuffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (buffer == nullptr) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            buffer = registerBuffer();
+        }
+        return *buffer;
+    }
+
+    // cpu profiler：调用者持有m_mutex
+    ThreadBuffer* registerBuffer() {
+        m_buffers.push_back(std::make_unique<ThreadBuffer>());
+        ThreadBuffer* buffer = m_buffers.back().get();
+        buffer->id = static_cast<uint32_t>(m_buffers.size());
+        return buffer;
+    }
+
+    int64_t nanoseconds(Clock::time_point time) const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - m_origin).count();
+    }
+
+    static std::string threeDigits(int64_t value) {
+        std::string digits = std::to_string(value);
+        return std::string(3 - digits.size(), '0') + digits;
+    }
+
+    Clock::time_point m_origin;
+    std::atomic<bool> m_enabled{true};
+    std::mutex m_mutex;  // 保护m_buffers和m_names
+    std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+    std::deque<std::string> m_names;  // deque增长时已有的元素不移动，c_str一直有效
+};
+
+// cpu profiler：作用域计时，关闭时只多一次原子读取
+class CpuProfileScope {
+public:
+    explicit CpuProfileScope(const char* name) : m_name(name), m_active(CpuProfiler::instance().enabled()) {
+        if (m_active) {
+            m_start = CpuProfiler::instance().now();
+        }
+    }
+
+    ~CpuProfileScope() {
+        if (m_active) {
+            CpuProfiler::instance().record(m_name, m_start, CpuProfiler::instance().now());
+        }
+    }
+
+    CpuProfileScope(const CpuProfileScope&) = delete;
+    CpuProfileScope& operator=(const CpuProfileScope&) = delete;
+
+private:
+    const char* m_name;
+    bool m_active;
+    CpuProfiler::Clock::time_point m_start;
+};
+
+#define CPU_PROFILE_CONCAT_INNER(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_INNER(a, b)
+#define CPU_PROFILE_SCOPE(name) CpuProfileScope CPU_PROFILE_CONCAT(cpuProfileScope, __LINE__)(name)
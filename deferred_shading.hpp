@@ -0,0 +1,206 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "shader_registry.hpp"
+
+// deferred shading：legacy render pass的第二个subpass，全屏三角形读取G-buffer的input attachment计算光照
+// G-buffer是同一个render pass中subpass 0的color attachment，这里只需要per-pixel读取，tile based gpu上数据不离开tile memory
+// 每个frame in flight一个descriptor set，和upscale一样在G-buffer的view改变（swap chain重建）时重写
+class DeferredLighting {
+public:
+    // deferred shading：G-buffer的格式，两个都是color attachment必须支持的格式
+    static constexpr VkFormat ALBEDO_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+    static constexpr VkFormat NORMAL_FORMAT = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+    static constexpr uint32_t INPUT_COUNT = 2;
+
+    void init(VkDevice device, VkPipelineCache pipelineCache, const SpirvCode& vertexCode, const SpirvCode& fragmentCode, VkRenderPass renderPass, uint32_t subpass,
+        uint32_t frameCount) {
+        m_device = device;
+
+        std::array<VkDescriptorSetLayoutBinding, INPUT_COUNT> bindings{};
+        for (uint32_t i = 0; i < INPUT_COUNT; i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = INPUT_COUNT;
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create deferred lighting descriptor set layout!");
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, frameCount * INPUT_COUNT};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = frameCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create deferred lighting descriptor pool!");
+        }
+        std::vector<VkDescriptorSetLayout> layouts(frameCount, m_descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_descriptorPool;
+        allocInfo.descriptorSetCount = frameCount;
+        allocInfo.pSetLayouts = layouts.data();
+        m_sets.resize(frameCount);
+        if (vkAllocateDescriptorSets(m_device, &allocInfo, m_sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate deferred lighting descriptor sets!");
+        }
+        m_inputViews.assign(frameCount, {});
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create deferred lighting pipeline layout!");
+        }
+
+        createPipeline(pipelineCache, vertexCode, fragmentCode, renderPass, subpass);
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());  // set随pool一起释放
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_sets.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // deferred shading：在vkCmdNextSubpass之后录制，albedoView和normalView是这个framebuffer的G-buffer attachment
+    // 调用者保证这个frame in flight上一次的提交已经完成，set可以重写
+    void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView albedoView, VkImageView normalView, VkExtent2D extent) {
+        std::array<VkImageView, INPUT_COUNT> views = {albedoView, normalView};
+        if (m_inputViews[frameIndex] != views) {
+            std::array<VkDescriptorImageInfo, INPUT_COUNT> imageInfos{};
+            for (uint32_t i = 0; i < INPUT_COUNT; i++) {
+                imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;  // 和subpass 1中input attachment reference的layout一致
+                imageInfos[i].imageView = views[i];
+            }
+
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = m_sets[frameIndex];
+            write.dstBinding = 0;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            write.descriptorCount = INPUT_COUNT;
+            write.pImageInfo = imageInfos.data();
+            vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+            m_inputViews[frameIndex] = views;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+        VkViewport viewport{0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f};
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        VkRect2D scissor{{0, 0}, extent};
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_sets[frameIndex], 0, nullptr);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    }
+
+private:
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& vertexCode, const SpirvCode& fragmentCode, VkRenderPass renderPass, uint32_t subpass) {
+        std::array<VkShaderModule, 2> modules{};
+        const SpirvCode* codes[2] = {&vertexCode, &fragmentCode};
+        for (size_t i = 0; i < modules.size(); i++) {
+            VkShaderModuleCreateInfo moduleInfo{};
+            moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+            moduleInfo.codeSize = codes[i]->size;
+            moduleInfo.pCode = codes[i]->words;
+            if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &modules[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create deferred lighting shader module!");
+            }
+        }
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+        VkShaderStageFlagBits stageBits[2] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+        for (size_t i = 0; i < stages.size(); i++) {
+            stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stages[i].stage = stageBits[i];
+            stages[i].module = modules[i];
+            stages[i].pName = "main";
+        }
+
+        VkPipelineVertexInputStateCreateInfo vertexInput{};
+        vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.lineWidth = 1.0f;
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};  // subpass 1没有depth attachment
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        VkPipelineColorBlendAttachmentState blendAttachment{};
+        blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &blendAttachment;
+        VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+        pipelineInfo.pStages = stages.data();
+        pipelineInfo.pVertexInputState = &vertexInput;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = m_pipelineLayout;
+        pipelineInfo.renderPass = renderPass;
+        pipelineInfo.subpass = subpass;
+
+        VkResult result = vkCreateGraphicsPipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        for (VkShaderModule module : modules) {
+            vkDestroyShaderModule(m_device, module, hostAllocator());
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create deferred lighting pipeline!");
+        }
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> m_sets;
+    std::vector<std::array<VkImageView, INPUT_COUNT>> m_inputViews;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// deletion queue：之前销毁gpu可能还在使用的资源需要先vkDeviceWaitIdle，整个设备停下来
+// 现在销毁操作和提交编号（frame编号或者timeline值）一起入队，gpu完成该编号之后才真正执行销毁
+// 编号必须单调递增，队列按入队顺序销毁
+class DeletionQueue {
+public:
+    // deletion queue：retireAfter是最后一次可能使用这些资源的提交编号
+    void push(uint64_t retireAfter, std::function<void()> destroy) {
+        m_pending.push_back({retireAfter, std::move(destroy)});
+    }
+
+    // deletion queue：completed及之前的提交已经在gpu上完成，执行对应的销毁
+    void flush(uint64_t completed) {
+        while (!m_pending.empty() && m_pending.front().retireAfter <= completed) {
+            m_pending.front().destroy();
+            m_pending.pop_front();
+        }
+    }
+
+    // deletion queue：程序退出时在vkDeviceWaitIdle之后销毁所有剩余资源
+    void flushAll() {
+        while (!m_pending.empty()) {
+            m_pending.front().destroy();
+            m_pending.pop_front();
+        }
+    }
+
+    size_t size() const { return m_pending.size(); }
+
+private:
+    struct Entry {
+        uint64_t retireAfter;
+        std::function<void()> destroy;
+    };
+
+    std::deque<Entry> m_pending;
+};
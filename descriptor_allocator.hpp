@@ -0,0 +1,129 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+
+// descriptor allocator：之前只有一个刚好放下MAX_FRAMES_IN_FLIGHT个set的pool，set创建时写一次，之后不能再分配
+// 现在每帧有自己的一组pool，一帧内的set都从当前pool分配，pool用完时换一个更大的pool
+// 这一帧上次提交完成之后用vkResetDescriptorPool一次回收整个pool，从不单独释放set，pool不需要FREE_DESCRIPTOR_SET_BIT
+class FrameDescriptorAllocator {
+public:
+    // descriptor allocator：每个set需要多少个某种类型的descriptor，pool的大小是ratio乘以pool能分配的set数量
+    struct PoolSizeRatio {
+        VkDescriptorType type;
+        float ratio;
+    };
+
+    void init(VkDevice device, uint32_t frameCount, const std::vector<PoolSizeRatio>& ratios, uint32_t initialSetsPerPool = 64) {
+        m_device = device;
+        m_ratios = ratios;
+        m_setsPerPool = initialSetsPerPool;
+        m_frames.resize(frameCount);
+    }
+
+    void cleanup() {
+        for (Frame& frame : m_frames) {
+            for (VkDescriptorPool pool : frame.full) {
+                vkDestroyDescriptorPool(m_device, pool, hostAllocator());
+            }
+            if (frame.current != VK_NULL_HANDLE) {
+                vkDestroyDescriptorPool(m_device, frame.current, hostAllocator());
+            }
+        }
+        for (VkDescriptorPool pool : m_freePools) {
+            vkDestroyDescriptorPool(m_device, pool, hostAllocator());
+        }
+        m_frames.clear();
+        m_freePools.clear();
+    }
+
+    // descriptor allocator：调用者需要保证gpu已经完成上次使用这一帧的命令（等待这一帧上次提交的timeline值之后），之前分配的set全部失效
+    void beginFrame(uint32_t frameIndex) {
+        m_currentFrame = frameIndex;
+        Frame& frame = m_frames[frameIndex];
+        if (frame.current != VK_NULL_HANDLE) {
+            frame.full.push_back(frame.current);
+            frame.current = VK_NULL_HANDLE;
+        }
+        for (VkDescriptorPool pool : frame.full) {
+            vkResetDescriptorPool(m_device, pool, 0);
+            m_freePools.push_back(pool);
+        }
+        frame.full.clear();
+    }
+
+    // descriptor allocator：set只在这一帧有效，当前pool满了或者碎片化时换一个pool再试一次
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout) {
+        Frame& frame = m_frames[m_currentFrame];
+        if (frame.current == VK_NULL_HANDLE) {
+            frame.current = acquirePool();
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = frame.current;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        VkDescriptorSet set;
+        VkResult result = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+            frame.full.push_back(frame.current);
+            frame.current = acquirePool();
+            allocInfo.descriptorPool = frame.current;
+            result = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate frame descriptor set!");
+        }
+        return set;
+    }
+
+private:
+    // descriptor allocator：已完成的帧归还的pool优先复用，没有时创建新pool，每次创建都比上一个大一半
+    VkDescriptorPool acquirePool() {
+        if (!m_freePools.empty()) {
+            VkDescriptorPool pool = m_freePools.back();
+            m_freePools.pop_back();
+            return pool;
+        }
+
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for (const PoolSizeRatio& ratio : m_ratios) {
+            poolSizes.push_back({ratio.type, std::max(1u, static_cast<uint32_t>(ratio.ratio * m_setsPerPool))});
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = m_setsPerPool;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create frame descriptor pool!");
+        }
+        m_setsPerPool = std::min(m_setsPerPool + m_setsPerPool / 2, MAX_SETS_PER_POOL);
+        return pool;
+    }
+
+    struct Frame {
+        VkDescriptorPool current = VK_NULL_HANDLE;  // 正在分配的pool
+        std::vector<VkDescriptorPool> full;  // 这一帧已经用满的pool，等这一帧完成之后重置
+    };
+
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    std::vector<PoolSizeRatio> m_ratios;
+    uint32_t m_setsPerPool = 0;
+    uint32_t m_currentFrame = 0;
+    std::vector<Frame> m_frames;
+    std::vector<VkDescriptorPool> m_freePools;
+};
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "dynamic_state.hpp"
+#include "memory_allocator.hpp"
+
+// descriptor buffer：VK_EXT_descriptor_buffer把descriptor直接写进一个持久映射的buffer，不再有descriptor pool和descriptor set
+// 每个set是buffer中的一段，布局由set layout决定，vkGetDescriptorEXT把资源转换成驱动的descriptor数据后直接memcpy进去
+// 绘制时整个buffer只绑定一次，每个set通过vkCmdSetDescriptorBufferOffsetsEXT指定在buffer中的offset，材质再多也只是buffer中多几段
+// 使用descriptor buffer的set layout和pipeline需要DESCRIPTOR_BUFFER标志，并且不能和普通descriptor set混用
+// descriptor buffer不支持dynamic ubo，ubo descriptor中直接写入这一帧数据的device address
+class DescriptorBuffer {
+public:
+    // descriptor buffer：descriptor中的buffer地址需要bufferDeviceAddress，1.2之前的设备不支持
+    static bool supported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2) {
+            return false;
+        }
+        VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{};
+        descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+        VkPhysicalDeviceBufferDeviceAddressFeatures addressFeatures{};
+        addressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+        addressFeatures.pNext = &descriptorBufferFeatures;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &addressFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return descriptorBufferFeatures.descriptorBuffer && addressFeatures.bufferDeviceAddress;
+    }
+
+    // descriptor buffer：allocator需要以bufferDeviceAddress模式初始化，capacity是所有set加起来的字节数
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, DeviceMemoryAllocator& allocator, VkDeviceSize capacity) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_capacity = capacity;
+
+        m_getLayoutSize = loadDeviceFunction<PFN_vkGetDescriptorSetLayoutSizeEXT>(device, "vkGetDescriptorSetLayoutSizeEXT");
+        m_getBindingOffset = loadDeviceFunction<PFN_vkGetDescriptorSetLayoutBindingOffsetEXT>(device, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+        m_getDescriptor = loadDeviceFunction<PFN_vkGetDescriptorEXT>(device, "vkGetDescriptorEXT");
+        m_bindBuffers = loadDeviceFunction<PFN_vkCmdBindDescriptorBuffersEXT>(device, "vkCmdBindDescriptorBuffersEXT");
+        m_setOffsets = loadDeviceFunction<PFN_vkCmdSetDescriptorBufferOffsetsEXT>(device, "vkCmdSetDescriptorBufferOffsetsEXT");
+        m_getBufferAddress = loadDeviceFunction<PFN_vkGetBufferDeviceAddress>(device, "vkGetBufferDeviceAddress");
+
+        m_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &m_properties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+        // descriptor buffer：纹理数组的combined image sampler和ubo、storage buffer放在同一个buffer中，所以两种用途都需要
+        m_usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = capacity;
+        bufferInfo.usage = m_usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &m_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create descriptor buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, m_buffer, &memRequirements);
+        // descriptor buffer：cpu直接写入，和uniform ring一样使用持久映射的host visible内存，device local时gpu读取更快
+        m_allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true, MemoryCategory::uniform,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "descriptor buffer");
+        vkBindBufferMemory(m_device, m_buffer, m_allocation.memory, m_allocation.offset);
+        m_address = bufferAddress(m_buffer);
+    }
+
+    void cleanup() {
+        if (m_buffer == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyBuffer(m_device, m_buffer, hostAllocator());
+        m_allocator->free(m_allocation);
+        m_buffer = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_buffer != VK_NULL_HANDLE; }
+
+    VkDeviceAddress bufferAddress(VkBuffer buffer) const {
+        VkBufferDeviceAddressInfo addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = buffer;
+        return m_getBufferAddress(m_device, &addressInfo);
+    }
+
+    // descriptor buffer：为一个set分配空间，返回绑定时使用的offset，set在程序运行期间不释放
+    VkDeviceSize allocateSet(VkDescriptorSetLayout layout) {
+        VkDeviceSize size;
+        m_getLayoutSize(m_device, layout, &size);
+        VkDeviceSize alignment = m_properties.descriptorBufferOffsetAlignment > 0 ? m_properties.descriptorBufferOffsetAlignment : 1;
+        VkDeviceSize offset = (m_head + alignment - 1) / alignment * alignment;
+        if (offset + size > m_capacity) {
+            throw std::runtime_error("descriptor buffer capacity exceeded!");
+        }
+        m_head = offset + size;
+        return offset;
+    }
+
+    // descriptor buffer：写入的descriptor马上对之后提交的命令可见，调用者保证in flight的帧不会读取正在写的元素
+    void writeUniformBuffer(VkDeviceSize setOffset, VkDescriptorSetLayout layout, uint32_t binding, VkDeviceAddress address, VkDeviceSize range) {
+        VkDescriptorAddressInfoEXT addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+        addressInfo.address = address;
+        addressInfo.range = range;
+        VkDescriptorGetInfoEXT getInfo{};
+        getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+        getInfo.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        getInfo.data.pUniformBuffer = &addressInfo;
+        write(setOffset, layout, binding, 0, getInfo, m_properties.uniformBufferDescriptorSize);
+    }
+
+    void writeStorageBuffer(VkDeviceSize setOffset, VkDescriptorSetLayout layout, uint32_t binding, VkDeviceAddress address, VkDeviceSize range) {
+        VkDescriptorAddressInfoEXT addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+        addressInfo.address = address;
+        addressInfo.range = range;
+        VkDescriptorGetInfoEXT getInfo{};
+        getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+        getInfo.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        getInfo.data.pStorageBuffer = &addressInfo;
+        write(setOffset, layout, binding, 0, getInfo, m_properties.storageBufferDescriptorSize);
+    }
+
+    void writeCombinedImageSampler(VkDeviceSize setOffset, VkDescriptorSetLayout layout, uint32_t binding, uint32_t arrayElement, VkImageView view, VkSampler sampler,
+        VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = imageLayout;
+        imageInfo.imageView = view;
+        imageInfo.sampler = sampler;
+        VkDescriptorGetInfoEXT getInfo{};
+        getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+        getInfo.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        getInfo.data.pCombinedImageSampler = &imageInfo;
+        write(setOffset, layout, binding, arrayElement, getInfo, m_properties.combinedImageSamplerDescriptorSize);
+    }
+
+    // ray traced shadows：acceleration structure的descriptor就是它的device address
+    void writeAccelerationStructure(VkDeviceSize setOffset, VkDescriptorSetLayout layout, uint32_t binding, VkDeviceAddress address) {
+        VkDescriptorGetInfoEXT getInfo{};
+        getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+        getInfo.type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+        getInfo.data.accelerationStructure = address;
+        write(setOffset, layout, binding, 0, getInfo, m_properties.accelerationStructureDescriptorSize);
+    }
+
+    // descriptor buffer：每个command buffer绑定一次，之后切换set只需要setOffsets
+    void bind(VkCommandBuffer commandBuffer) const {
+        VkDescriptorBufferBindingInfoEXT bindingInfo{};
+        bindingInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+        bindingInfo.address = m_address;
+        bindingInfo.usage = m_usage;
+        m_bindBuffers(commandBuffer, 1, &bindingInfo);
+    }
+
+    // descriptor buffer：从firstSet开始的连续set，offset是allocateSet的返回值，所有set都在绑定的第0个buffer中
+    // heap tracker：每个secondary command buffer开头都会调用，buffer index放在栈上的数组中，最多MAX_BOUND_SETS个set
+    static constexpr uint32_t MAX_BOUND_SETS = 8;
+    void setOffsets(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t firstSet, const VkDeviceSize* offsets, uint32_t count) const {
+        if (count > MAX_BOUND_SETS) {
+            throw std::runtime_error("too many descriptor buffer sets bound at once!");
+        }
+        uint32_t bufferIndices[MAX_BOUND_SETS] = {};
+        m_setOffsets(commandBuffer, bindPoint, layout, firstSet, count, bufferIndices, offsets);
+    }
+
+    // descriptor buffer：普通的set layout不能用于descriptor buffer，创建layout时需要加上这个标志
+    static constexpr VkDescriptorSetLayoutCreateFlags layoutFlags() { return VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT; }
+
+private:
+    void write(VkDeviceSize setOffset, VkDescriptorSetLayout layout, uint32_t binding, uint32_t arrayElement, const VkDescriptorGetInfoEXT& getInfo, size_t descriptorSize) {
+        VkDeviceSize bindingOffset;
+        m_getBindingOffset(m_device, layout, binding, &bindingOffset);
+        char* destination = static_cast<char*>(m_allocation.mapped) + setOffset + bindingOffset + arrayElement * descriptorSize;
+        m_getDescriptor(m_device, &getInfo, descriptorSize, destination);
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    Allocation m_allocation;
+    VkDeviceAddress m_address = 0;
+    VkBufferUsageFlags m_usage = 0;
+    VkDeviceSize m_capacity = 0;
+    VkDeviceSize m_head = 0;
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT m_properties{};
+
+    PFN_vkGetDescriptorSetLayoutSizeEXT m_getLayoutSize = nullptr;
+    PFN_vkGetDescriptorSetLayoutBindingOffsetEXT m_getBindingOffset = nullptr;
+    PFN_vkGetDescriptorEXT m_getDescriptor = nullptr;
+    PFN_vkCmdBindDescriptorBuffersEXT m_bindBuffers = nullptr;
+    PFN_vkCmdSetDescriptorBufferOffsetsEXT m_setOffsets = nullptr;
+    PFN_vkGetBufferDeviceAddress m_getBufferAddress = nullptr;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+// device capabilities：之前每个可选功能在创建device时各自枚举一次扩展、各自调用vkGetPhysicalDeviceFeatures2
+// 现在选择物理设备之后probe一次：扩展列表只枚举一次，vulkan 1.2/1.3的设备用VkPhysicalDeviceVulkan11/12/13Features一次查询所有core feature
+// 更早的设备只在扩展存在时把对应的feature结构加入查询，结果中的xxxExtension表示创建device时需要开启扩展（不是core）
+// 每个fast path根据这里的结果选择，不支持时使用原来的实现，比如synchronization2不支持时barrier使用所有stage的并集
+struct DeviceCapabilities {
+    uint32_t apiVersion = 0;
+    std::set<std::string> extensions;
+
+    bool synchronization2 = false;
+    bool synchronization2Extension = false;
+    bool dynamicRendering = false;
+    bool dynamicRenderingExtension = false;
+    bool descriptorIndexing = false;  // bindless纹理需要的descriptor indexing feature全部支持
+    bool descriptorIndexingExtension = false;
+    bool timelineSemaphore = false;
+    bool timelineSemaphoreExtension = false;
+    bool shaderDrawParameters = false;
+    bool memoryBudget = false;
+    bool meshShader = false;  // task shader和mesh shader
+    bool shaderFloat16 = false;  // half precision：shader中的16位浮点运算
+    bool shaderFloat16Extension = false;
+
+    bool hasExtension(const char* name) const { return extensions.count(name) != 0; }
+
+    static DeviceCapabilities probe(VkPhysicalDevice device) {
+        DeviceCapabilities capabilities;
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        capabilities.apiVersion = properties.apiVersion;
+
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+        for (const VkExtensionProperties& extension : availableExtensions) {
+            capabilities.extensions.insert(extension.extensionName);
+        }
+
+        bool core12 = capabilities.apiVersion >= VK_API_VERSION_1_2;
+        bool core13 = capabilities.apiVersion >= VK_API_VERSION_1_3;
+        capabilities.synchronization2Extension = !core13 && capabilities.hasExtension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        capabilities.dynamicRenderingExtension = !core13 && capabilities.hasExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+        capabilities.descriptorIndexingExtension = !core12 && capabilities.hasExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        capabilities.timelineSemaphoreExtension = !core12 && capabilities.hasExtension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        capabilities.memoryBudget = capabilities.hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        capabilities.shaderFloat16Extension = !core12 && capabilities.hasExtension(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
+        bool meshShaderExtension = capabilities.hasExtension(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+
+        // device capabilities：查询结构只加入设备认识的，core版本的结构代替对应扩展的结构
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        VkPhysicalDeviceVulkan11Features vulkan11{};
+        vulkan11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+        VkPhysicalDeviceVulkan12Features vulkan12{};
+        vulkan12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceVulkan13Features vulkan13{};
+        vulkan13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        VkPhysicalDeviceShaderDrawParametersFeatures drawParameters{};
+        drawParameters.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_DRAW_PARAMETERS_FEATURES;
+        VkPhysicalDeviceDescriptorIndexingFeatures indexing{};
+        indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline{};
+        timeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        VkPhysicalDeviceSynchronization2Features synchronization2{};
+        synchronization2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+        VkPhysicalDeviceDynamicRenderingFeatures dynamicRendering{};
+        dynamicRendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+        VkPhysicalDeviceMeshShaderFeaturesEXT meshShader{};
+        meshShader.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        VkPhysicalDeviceShaderFloat16Int8Features float16Int8{};
+        float16Int8.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES;
+
+        if (core12) {
+            chain(features2, vulkan11);
+            chain(features2, vulkan12);
+        } else {
+            chain(features2, drawParameters);
+            if (capabilities.descriptorIndexingExtension) {
+                chain(features2, indexing);
+            }
+            if (capabilities.timelineSemaphoreExtension) {
+                chain(features2, timeline);
+            }
+            if (capabilities.shaderFloat16Extension) {
+                chain(features2, float16Int8);
+            }
+        }
+        if (core13) {
+            chain(features2, vulkan13);
+        } else {
+            if (capabilities.synchronization2Extension) {
+                chain(features2, synchronization2);
+            }
+            if (capabilities.dynamicRenderingExtension) {
+                chain(features2, dynamicRendering);
+            }
+        }
+        if (meshShaderExtension) {
+            chain(features2, meshShader);
+        }
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+
+        if (core12) {
+            capabilities.shaderDrawParameters = vulkan11.shaderDrawParameters;
+            capabilities.descriptorIndexing = vulkan12.runtimeDescriptorArray && vulkan12.descriptorBindingPartiallyBound
+                && vulkan12.descriptorBindingVariableDescriptorCount && vulkan12.descriptorBindingSampledImageUpdateAfterBind
+                && vulkan12.descriptorBindingUpdateUnusedWhilePending;
+            capabilities.timelineSemaphore = vulkan12.timelineSemaphore;
+            capabilities.shaderFloat16 = vulkan12.shaderFloat16;
+        } else {
+            capabilities.shaderDrawParameters = drawParameters.shaderDrawParameters;
+            capabilities.descriptorIndexing = indexing.runtimeDescriptorArray && indexing.descriptorBindingPartiallyBound
+                && indexing.descriptorBindingVariableDescriptorCount && indexing.descriptorBindingSampledImageUpdateAfterBind
+                && indexing.descriptorBindingUpdateUnusedWhilePending;
+            capabilities.timelineSemaphore = timeline.timelineSemaphore;
+            capabilities.shaderFloat16 = float16Int8.shaderFloat16;
+        }
+        if (core13) {
+            capabilities.synchronization2 = vulkan13.synchronization2;
+            capabilities.dynamicRendering = vulkan13.dynamicRendering;
+        } else {
+            capabilities.synchronization2 = synchronization2.synchronization2;
+            capabilities.dynamicRendering = dynamicRendering.dynamicRendering;
+        }
+        capabilities.meshShader = meshShader.taskShader && meshShader.meshShader;
+        return capabilities;
+    }
+
+    // device capabilities：log中的一行，列出支持的fast path
+    std::string summary() const {
+        std::string text = "vulkan " + std::to_string(VK_API_VERSION_MAJOR(apiVersion)) + "." + std::to_string(VK_API_VERSION_MINOR(apiVersion));
+        auto add = [&text](bool supported, const char* name) {
+            if (supported) {
+                text += std::string(", ") + name;
+            }
+        };
+        add(synchronization2, "synchronization2");
+        add(dynamicRendering, "dynamic rendering");
+        add(descriptorIndexing, "descriptor indexing");
+        add(timelineSemaphore, "timeline semaphore");
+        add(memoryBudget, "memory budget");
+        add(meshShader, "mesh shader");
+        add(shaderFloat16, "float16");
+        return text;
+    }
+
+private:
+    // device capabilities：结构加在pNext链的最前面，和createLogicalDevice串联feature的方式一样
+    template<typename Feature>
+    static void chain(VkPhysicalDeviceFeatures2& features2, Feature& feature) {
+        feature.pNext = features2.pNext;
+        features2.pNext = &feature;
+    }
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// device dispatch：链接的vulkan库导出的vkCmd*和vkQueue*是loader的trampoline，每次调用先从command buffer或者queue中取出device的dispatch表再跳转
+// 这里和volk一样用vkGetDeviceProcAddr取得driver的函数地址直接调用，每帧几千次的draw录制少一次间接跳转
+// 只有一个VkDevice所以表是全局的；创建device之前和销毁之后指向loader导出的函数，调用总是合法的
+// 只替换每帧都会执行的路径：draw的录制、command buffer的begin/end、提交和present，初始化时的调用仍然直接使用loader
+struct DeviceDispatch {
+    static inline PFN_vkBeginCommandBuffer beginCommandBuffer = vkBeginCommandBuffer;
+    static inline PFN_vkEndCommandBuffer endCommandBuffer = vkEndCommandBuffer;
+    static inline PFN_vkCmdBindPipeline cmdBindPipeline = vkCmdBindPipeline;
+    static inline PFN_vkCmdBindDescriptorSets cmdBindDescriptorSets = vkCmdBindDescriptorSets;
+    static inline PFN_vkCmdBindVertexBuffers cmdBindVertexBuffers = vkCmdBindVertexBuffers;
+    static inline PFN_vkCmdBindIndexBuffer cmdBindIndexBuffer = vkCmdBindIndexBuffer;
+    static inline PFN_vkCmdPushConstants cmdPushConstants = vkCmdPushConstants;
+    static inline PFN_vkCmdSetViewport cmdSetViewport = vkCmdSetViewport;
+    static inline PFN_vkCmdSetScissor cmdSetScissor = vkCmdSetScissor;
+    static inline PFN_vkCmdDrawIndexed cmdDrawIndexed = vkCmdDrawIndexed;
+    static inline PFN_vkCmdDrawIndexedIndirect cmdDrawIndexedIndirect = vkCmdDrawIndexedIndirect;
+    static inline PFN_vkCmdExecuteCommands cmdExecuteCommands = vkCmdExecuteCommands;
+    static inline PFN_vkCmdPipelineBarrier cmdPipelineBarrier = vkCmdPipelineBarrier;
+    static inline PFN_vkQueueSubmit queueSubmit = vkQueueSubmit;
+    static inline PFN_vkQueuePresentKHR queuePresentKHR = vkQueuePresentKHR;
+
+    // device dispatch：vkCreateDevice之后调用；取不到的函数（比如headless时没有开启swapchain扩展）保持loader的版本
+    static void load(VkDevice device) {
+        loadFunction(device, "vkBeginCommandBuffer", beginCommandBuffer);
+        loadFunction(device, "vkEndCommandBuffer", endCommandBuffer);
+        loadFunction(device, "vkCmdBindPipeline", cmdBindPipeline);
+        loadFunction(device, "vkCmdBindDescriptorSets", cmdBindDescriptorSets);
+        loadFunction(device, "vkCmdBindVertexBuffers", cmdBindVertexBuffers);
+        loadFunction(device, "vkCmdBindIndexBuffer", cmdBindIndexBuffer);
+        loadFunction(device, "vkCmdPushConstants", cmdPushConstants);
+        loadFunction(device, "vkCmdSetViewport", cmdSetViewport);
+        loadFunction(device, "vkCmdSetScissor", cmdSetScissor);
+        loadFunction(device, "vkCmdDrawIndexed", cmdDrawIndexed);
+        loadFunction(device, "vkCmdDrawIndexedIndirect", cmdDrawIndexedIndirect);
+        loadFunction(device, "vkCmdExecuteCommands", cmdExecuteCommands);
+        loadFunction(device, "vkCmdPipelineBarrier", cmdPipelineBarrier);
+        loadFunction(device, "vkQueueSubmit", queueSubmit);
+        loadFunction(device, "vkQueuePresentKHR", queuePresentKHR);
+    }
+
+    // device dispatch：vkDestroyDevice之前调用，函数地址属于被销毁的device
+    static void reset() {
+        beginCommandBuffer = vkBeginCommandBuffer;
+        endCommandBuffer = vkEndCommandBuffer;
+        cmdBindPipeline = vkCmdBindPipeline;
+        cmdBindDescriptorSets = vkCmdBindDescriptorSets;
+        cmdBindVertexBuffers = vkCmdBindVertexBuffers;
+        cmdBindIndexBuffer = vkCmdBindIndexBuffer;
+        cmdPushConstants = vkCmdPushConstants;
+        cmdSetViewport = vkCmdSetViewport;
+        cmdSetScissor = vkCmdSetScissor;
+        cmdDrawIndexed = vkCmdDrawIndexed;
+        cmdDrawIndexedIndirect = vkCmdDrawIndexedIndirect;
+        cmdExecuteCommands = vkCmdExecuteCommands;
+        cmdPipelineBarrier = vkCmdPipelineBarrier;
+        queueSubmit = vkQueueSubmit;
+        queuePresentKHR = vkQueuePresentKHR;
+    }
+
+private:
+    template<typename Function>
+    static void loadFunction(VkDevice device, const char* name, Function& function) {
+        auto loaded = (Function) vkGetDeviceProcAddr(device, name);
+        if (loaded != nullptr) {
+            function = loaded;
+        }
+    }
+};
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "device_dispatch.hpp"
+#include "host_memory.hpp"
+#include "timeline_semaphore.hpp"
+
+// device group：多个物理设备（同型号的多张显卡）组成一个逻辑设备，vulkan 1.1 core，交换链部分由VK_KHR_swapchain提供
+// alternate frame rendering：每帧只在其中一个设备上执行，轮流使用各个设备，gpu瓶颈时帧率最多随设备数量增加
+// multi-instance heap（device local）的内存每个设备各有一份，上传的command buffer在所有设备上执行，所以资源自动在每个设备上复制
+// host visible的内存只有一份，所有设备共享，uniform ring等持久映射的buffer不需要改变
+//
+// timeline：所有提交共用一个timeline，不同设备上的提交完成顺序和提交顺序可能不同，而timeline的值必须单调递增
+// 所以每次提交后追加一个只有同步的batch：等待timeline的上一个值和其它设备完成这次提交，再signal这次的值
+// async compute和transfer queue的跨队列同步只在一个设备上等待，使用device group时关闭；descriptor buffer的device address需要额外的feature，同样关闭
+// 不同帧之间保留gpu结果的功能（shadow cache的缓存和错开更新、hi-z的上一帧depth）在alternate frame rendering时关闭，自动曝光在每个设备上各自适应
+class DeviceGroup {
+public:
+    // device group：在pickPhysicalDevice中调用，physicalDevice属于一个有多个设备的group时选择这个group
+    // present queue：呈现队列和图形队列不同时present acquire的提交使用自己的timeline，调用者只在两者相同时使用device group
+    bool select(VkInstance instance, VkPhysicalDevice physicalDevice) {
+        uint32_t groupCount = 0;
+        vkEnumeratePhysicalDeviceGroups(instance, &groupCount, nullptr);
+        std::vector<VkPhysicalDeviceGroupProperties> groups(groupCount);
+        for (VkPhysicalDeviceGroupProperties& group : groups) {
+            group.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES;
+        }
+        vkEnumeratePhysicalDeviceGroups(instance, &groupCount, groups.data());
+
+        for (const VkPhysicalDeviceGroupProperties& group : groups) {
+            if (group.physicalDeviceCount < 2) {
+                continue;
+            }
+            for (uint32_t i = 0; i < group.physicalDeviceCount; i++) {
+                if (group.physicalDevices[i] == physicalDevice) {
+                    m_devices.assign(group.physicalDevices, group.physicalDevices + group.physicalDeviceCount);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool active() const { return m_devices.size() > 1; }
+    uint32_t deviceCount() const { return static_cast<uint32_t>(m_devices.size()); }
+    uint32_t allDevicesMask() const { return (1u << deviceCount()) - 1; }
+
+    // alternate frame rendering：至少两个设备可以present时帧才轮流在设备之间执行
+    bool alternateFrames() const { return m_frameDevices.size() > 1; }
+    uint32_t frameDeviceCount() const { return static_cast<uint32_t>(m_frameDevices.size()); }
+    bool remotePresent() const { return m_presentMode == VK_DEVICE_GROUP_PRESENT_MODE_REMOTE_BIT_KHR; }
+
+    // device group：加在VkDeviceCreateInfo的pNext链最前面，createInfo在vkCreateDevice之前不能离开这个对象的生命周期
+    void chainDeviceCreateInfo(VkDeviceCreateInfo& createInfo) {
+        if (!active()) {
+            return;
+        }
+        m_deviceCreateInfo = {};
+        m_deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_DEVICE_CREATE_INFO;
+        m_deviceCreateInfo.pNext = createInfo.pNext;
+        m_deviceCreateInfo.physicalDeviceCount = deviceCount();
+        m_deviceCreateInfo.pPhysicalDevices = m_devices.data();
+        createInfo.pNext = &m_deviceCreateInfo;
+    }
+
+    // device group：逻辑设备创建之后调用，查询每个设备能否present，决定present的方式和轮流使用的设备
+    // 每个设备都能present自己的图像时使用LOCAL，否则所有设备的图像都可以由某个设备present时使用REMOTE，都不行时只用能present的设备
+    void init(VkDevice device) {
+        m_device = device;
+        if (!active()) {
+            return;
+        }
+        auto getCapabilities = (PFN_vkGetDeviceGroupPresentCapabilitiesKHR) vkGetDeviceProcAddr(device, "vkGetDeviceGroupPresentCapabilitiesKHR");
+        m_acquireNextImage2 = (PFN_vkAcquireNextImage2KHR) vkGetDeviceProcAddr(device, "vkAcquireNextImage2KHR");
+        VkDeviceGroupPresentCapabilitiesKHR capabilities{};
+        capabilities.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_CAPABILITIES_KHR;
+        if (getCapabilities == nullptr || m_acquireNextImage2 == nullptr || getCapabilities(device, &capabilities) != VK_SUCCESS) {
+            throw std::runtime_error("failed to query device group present capabilities!");
+        }
+
+        uint32_t localDevices = 0;
+        uint32_t remoteSources = 0;
+        for (uint32_t i = 0; i < deviceCount(); i++) {
+            if (capabilities.presentMask[i] & (1u << i)) {
+                localDevices |= 1u << i;
+            }
+            remoteSources |= capabilities.presentMask[i];
+        }
+        uint32_t frameMask = localDevices;
+        m_presentMode = VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR;
+        if (localDevices != allDevicesMask() && (capabilities.modes & VK_DEVICE_GROUP_PRESENT_MODE_REMOTE_BIT_KHR) && remoteSources == allDevicesMask()) {
+            frameMask = allDevicesMask();
+            m_presentMode = VK_DEVICE_GROUP_PRESENT_MODE_REMOTE_BIT_KHR;
+        }
+        for (uint32_t i = 0; i < deviceCount(); i++) {
+            if (frameMask & (1u << i)) {
+                m_frameDevices.push_back(i);
+            }
+        }
+        if (m_frameDevices.empty()) {
+            throw std::runtime_error("failed to find a device in the device group that can present!");
+        }
+    }
+
+    void cleanup() {
+        for (Signal& signal : m_signals) {
+            vkDestroySemaphore(m_device, signal.semaphore, hostAllocator());
+        }
+        m_signals.clear();
+    }
+
+    // device group：加在VkSwapchainCreateInfoKHR的pNext链最前面
+    void chainSwapchainCreateInfo(VkSwapchainCreateInfoKHR& createInfo) {
+        if (!active()) {
+            return;
+        }
+        m_swapchainCreateInfo = {};
+        m_swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SWAPCHAIN_CREATE_INFO_KHR;
+        m_swapchainCreateInfo.pNext = createInfo.pNext;
+        m_swapchainCreateInfo.modes = m_presentMode;
+        createInfo.pNext = &m_swapchainCreateInfo;
+    }
+
+    // alternate frame rendering：每帧开始时调用，返回这一帧执行的设备的mask
+    uint32_t beginFrame() {
+        m_frameDevice = m_frameDevices[m_frameIndex++ % m_frameDevices.size()];
+        return 1u << m_frameDevice;
+    }
+
+    uint32_t frameDeviceMask() const { return 1u << m_frameDevice; }
+
+    // device group：swap chain image对这一帧的设备可用时signal semaphore
+    VkResult acquireNextImage(VkSwapchainKHR swapChain, VkSemaphore semaphore, uint32_t* imageIndex) {
+        VkAcquireNextImageInfoKHR acquireInfo{};
+        acquireInfo.sType = VK_STRUCTURE_TYPE_ACQUIRE_NEXT_IMAGE_INFO_KHR;
+        acquireInfo.swapchain = swapChain;
+        acquireInfo.timeout = UINT64_MAX;
+        acquireInfo.semaphore = semaphore;
+        acquireInfo.deviceMask = frameDeviceMask();
+        return m_acquireNextImage2(m_device, &acquireInfo, imageIndex);
+    }
+
+    // device group：加在VkPresentInfoKHR的pNext链最前面，present这一帧的设备上的图像
+    void chainPresentInfo(VkPresentInfoKHR& presentInfo) {
+        m_presentDeviceMask = frameDeviceMask();
+        m_presentInfo = {};
+        m_presentInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_INFO_KHR;
+        m_presentInfo.pNext = presentInfo.pNext;
+        m_presentInfo.swapchainCount = 1;
+        m_presentInfo.pDeviceMasks = &m_presentDeviceMask;
+        m_presentInfo.mode = m_presentMode;
+        presentInfo.pNext = &m_presentInfo;
+    }
+
+    // timeline：batch的command buffer在deviceMask的设备上执行，batch只能等待和signal binary semaphore，pNext中不能有timeline submit info
+    // batch的等待和binary semaphore的signal在deviceMask的第一个设备上执行，追加的batch在同一个设备上等待其它设备和timeline的上一个值，再signal value
+    void submit(VkQueue queue, VkSubmitInfo batch, uint32_t deviceMask, TimelineSemaphore& timeline, uint64_t value) {
+        uint32_t orderDevice = 0;
+        while ((deviceMask & (1u << orderDevice)) == 0) {
+            orderDevice++;
+        }
+
+        // 其它设备各signal一个binary semaphore，表示它们也完成了这次提交
+        // heap tracker：这些数组每帧都会用到，放在成员中复用容量
+        std::vector<VkSemaphore>& signalSemaphores = m_scratch.signalSemaphores;
+        std::vector<uint32_t>& signalIndices = m_scratch.signalIndices;
+        std::vector<VkSemaphore>& deviceDone = m_scratch.deviceDone;
+        signalSemaphores.assign(batch.pSignalSemaphores, batch.pSignalSemaphores + batch.signalSemaphoreCount);
+        signalIndices.assign(batch.signalSemaphoreCount, orderDevice);
+        deviceDone.clear();
+        for (uint32_t i = 0; i < deviceCount(); i++) {
+            if (i != orderDevice && (deviceMask & (1u << i))) {
+                deviceDone.push_back(acquireSignal(timeline, value));
+                signalSemaphores.push_back(deviceDone.back());
+                signalIndices.push_back(i);
+            }
+        }
+        std::vector<uint32_t>& waitIndices = m_scratch.waitIndices;
+        std::vector<uint32_t>& commandMasks = m_scratch.commandMasks;
+        waitIndices.assign(batch.waitSemaphoreCount, orderDevice);
+        commandMasks.assign(batch.commandBufferCount, deviceMask);
+
+        VkDeviceGroupSubmitInfo groupInfo{};
+        groupInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO;
+        groupInfo.pNext = batch.pNext;
+        groupInfo.waitSemaphoreCount = batch.waitSemaphoreCount;
+        groupInfo.pWaitSemaphoreDeviceIndices = waitIndices.data();
+        groupInfo.commandBufferCount = batch.commandBufferCount;
+        groupInfo.pCommandBufferDeviceMasks = commandMasks.data();
+        groupInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+        groupInfo.pSignalSemaphoreDeviceIndices = signalIndices.data();
+        batch.pNext = &groupInfo;
+        batch.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+        batch.pSignalSemaphores = signalSemaphores.data();
+
+        // 追加的batch：semaphore signal的第一个同步范围包括这个设备上之前提交的所有命令
+        std::vector<VkSemaphore>& orderWaits = m_scratch.orderWaits;
+        std::vector<uint64_t>& orderWaitValues = m_scratch.orderWaitValues;
+        orderWaits.assign(deviceDone.begin(), deviceDone.end());
+        orderWaitValues.assign(deviceDone.size(), 0);
+        if (value > 1) {
+            orderWaits.push_back(timeline.handle());
+            orderWaitValues.push_back(value - 1);
+        }
+        std::vector<VkPipelineStageFlags>& orderStages = m_scratch.orderStages;
+        std::vector<uint32_t>& orderWaitIndices = m_scratch.orderWaitIndices;
+        orderStages.assign(orderWaits.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        orderWaitIndices.assign(orderWaits.size(), orderDevice);
+        VkSemaphore timelineSemaphore = timeline.handle();
+
+        VkTimelineSemaphoreSubmitInfo orderTimeline{};
+        orderTimeline.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        orderTimeline.waitSemaphoreValueCount = static_cast<uint32_t>(orderWaitValues.size());
+        orderTimeline.pWaitSemaphoreValues = orderWaitValues.data();
+        orderTimeline.signalSemaphoreValueCount = 1;
+        orderTimeline.pSignalSemaphoreValues = &value;
+
+        VkDeviceGroupSubmitInfo orderGroup{};
+        orderGroup.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO;
+        orderGroup.pNext = &orderTimeline;
+        orderGroup.waitSemaphoreCount = static_cast<uint32_t>(orderWaitIndices.size());
+        orderGroup.pWaitSemaphoreDeviceIndices = orderWaitIndices.data();
+        orderGroup.signalSemaphoreCount = 1;
+        orderGroup.pSignalSemaphoreDeviceIndices = &orderDevice;
+
+        VkSubmitInfo order{};
+        order.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        order.pNext = &orderGroup;
+        order.waitSemaphoreCount = static_cast<uint32_t>(orderWaits.size());
+        order.pWaitSemaphores = orderWaits.data();
+        order.pWaitDstStageMask = orderStages.data();
+        order.signalSemaphoreCount = 1;
+        order.pSignalSemaphores = &timelineSemaphore;
+
+        VkSubmitInfo batches[] = {batch, order};
+        if (DeviceDispatch::queueSubmit(queue, 2, batches, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit device group command buffer!");
+        }
+    }
+
+private:
+    // device group：binary semaphore在追加的batch中被等待，timeline到达用到它的值之后可以重用
+    struct Signal {
+        VkSemaphore semaphore;
+        uint64_t value;
+    };
+
+    VkSemaphore acquireSignal(TimelineSemaphore& timeline, uint64_t value) {
+        for (Signal& signal : m_signals) {
+            if (signal.value != value && timeline.isComplete(signal.value)) {
+                signal.value = value;
+                return signal.semaphore;
+            }
+        }
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        VkSemaphore semaphore;
+        if (vkCreateSemaphore(m_device, &semaphoreInfo, hostAllocator(), &semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create device group semaphore!");
+        }
+        m_signals.push_back({semaphore, value});
+        return semaphore;
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    std::vector<VkPhysicalDevice> m_devices;
+    std::vector<uint32_t> m_frameDevices;  // alternate frame rendering：轮流使用的设备index
+    VkDeviceGroupPresentModeFlagBitsKHR m_presentMode = VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR;
+    PFN_vkAcquireNextImage2KHR m_acquireNextImage2 = nullptr;
+    uint64_t m_frameIndex = 0;
+    uint32_t m_frameDevice = 0;
+    std::vector<Signal> m_signals;
+
+    struct SubmitScratch {
+        std::vector<VkSemaphore> signalSemaphores;
+        std::vector<uint32_t> signalIndices;
+        std::vector<VkSemaphore> deviceDone;
+        std::vector<uint32_t> waitIndices;
+        std::vector<uint32_t> commandMasks;
+        std::vector<VkSemaphore> orderWaits;
+        std::vector<uint64_t> orderWaitValues;
+        std::vector<VkPipelineStageFlags> orderStages;
+        std::vector<uint32_t> orderWaitIndices;
+    } m_scratch;
+
+    // 链进create info和present info的结构体，调用vulkan函数之前需要一直有效
+    VkDeviceGroupDeviceCreateInfo m_deviceCreateInfo{};
+    VkDeviceGroupSwapchainCreateInfoKHR m_swapchainCreateInfo{};
+    VkDeviceGroupPresentInfoKHR m_presentInfo{};
+    uint32_t m_presentDeviceMask = 0;
+};
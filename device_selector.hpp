@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// device selection：之前选择第一个满足要求的物理设备，双显卡的笔记本上经常是集成显卡
+// 现在每个满足要求的设备打分，选择分数最高的：设备类型最重要，其次是device local的显存、可选扩展和独立的transfer/compute队列
+// 打分只比较满足要求的设备，是否满足要求仍然由isDeviceSuitable判断；override按序号或者名字强制选择某个设备
+struct DeviceScore {
+    uint64_t score = 0;
+    std::string detail;  // 每一项的得分，输出到log说明选择的原因
+};
+
+class DeviceSelector {
+public:
+    // device selection：独立显卡的类型分数超过集成显卡在显存和扩展上能得到的全部分数
+    static DeviceScore score(VkPhysicalDevice device, const std::vector<const char*>& optionalExtensions, bool dedicatedTransfer, bool asyncCompute) {
+        DeviceScore result;
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        add(result, typeScore(properties.deviceType), typeName(properties.deviceType));
+
+        // device selection：集成显卡的device local heap就是系统内存，按GiB计分并且限制上限，不会超过类型的差距
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+        VkDeviceSize localBytes = 0;
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                localBytes = std::max(localBytes, memoryProperties.memoryHeaps[i].size);
+            }
+        }
+        uint64_t localMiB = localBytes >> 20;
+        add(result, std::min<uint64_t>(localMiB >> 10, MAX_HEAP_GIB) * HEAP_GIB_SCORE, std::to_string(localMiB) + " MiB local");
+
+        uint32_t supportedExtensions = 0;
+        for (const char* extension : optionalExtensions) {
+            supportedExtensions += extensionSupported(device, extension) ? 1 : 0;
+        }
+        add(result, supportedExtensions * EXTENSION_SCORE,
+            std::to_string(supportedExtensions) + "/" + std::to_string(optionalExtensions.size()) + " optional extensions");
+
+        if (dedicatedTransfer) {
+            add(result, QUEUE_SCORE, "transfer queue");
+        }
+        if (asyncCompute) {
+            add(result, QUEUE_SCORE, "compute queue");
+        }
+        return result;
+    }
+
+    // device selection：override是设备序号（vkEnumeratePhysicalDevices的顺序）或者名字的一部分，不区分大小写
+    static bool matches(VkPhysicalDevice device, uint32_t index, const std::string& selector) {
+        if (selector.empty()) {
+            return false;
+        }
+        if (std::all_of(selector.begin(), selector.end(), [](unsigned char c) { return std::isdigit(c); })) {
+            return std::stoul(selector) == index;
+        }
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        return lower(properties.deviceName).find(lower(selector)) != std::string::npos;
+    }
+
+private:
+    static constexpr uint64_t MAX_HEAP_GIB = 16;
+    static constexpr uint64_t HEAP_GIB_SCORE = 100;
+    static constexpr uint64_t EXTENSION_SCORE = 50;
+    static constexpr uint64_t QUEUE_SCORE = 200;
+
+    static void add(DeviceScore& result, uint64_t points, const std::string& item) {
+        result.score += points;
+        result.detail += (result.detail.empty() ? "" : ", ") + item + " +" + std::to_string(points);
+    }
+
+    static uint64_t typeScore(VkPhysicalDeviceType type) {
+        switch (type) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 10000;
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 2000;
+            case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 1000;
+            case VK_PHYSICAL_DEVICE_TYPE_CPU: return 0;
+            default: return 500;
+        }
+    }
+
+    static const char* typeName(VkPhysicalDeviceType type) {
+        switch (type) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+            case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+            case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+            default: return "other";
+        }
+    }
+
+    static bool extensionSupported(VkPhysicalDevice device, const char* extensionName) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+        for (const auto& extension : availableExtensions) {
+            if (strcmp(extension.extensionName, extensionName) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static std::string lower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+};
@@ -0,0 +1,277 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+#define GLFW_EXPOSE_NATIVE_WIN32
+#include "GLFW/glfw3native.h"
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "device_capabilities.hpp"
+
+// display mode：窗口模式由合成器（compositor）把swap chain image再合成一次才显示，多一帧左右的延迟，帧间隔也受合成器影响
+// fullscreen：在主显示器上以显示器的原生分辨率和刷新率创建全屏窗口；windows上设备支持VK_EXT_full_screen_exclusive时由应用获取独占，直接flip
+// direct：linux的kiosk上没有窗口系统，通过VK_KHR_display直接在显示器的plane上创建surface，不使用glfw，也没有键盘输入
+// 两种模式都只改变surface和swap chain的创建，之后的acquire、present和重建流程不变
+enum class DisplayMode {
+    windowed,
+    fullscreen,
+    direct,
+};
+
+inline const char* displayModeName(DisplayMode mode) {
+    switch (mode) {
+        case DisplayMode::fullscreen: return "fullscreen";
+        case DisplayMode::direct: return "direct";
+        default: return "windowed";
+    }
+}
+
+// display mode：全屏窗口，大小和刷新率使用主显示器当前的video mode，glfw切换显示器的模式
+inline GLFWwindow* createFullscreenWindow(const char* title) {
+    GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+    if (monitor == nullptr) {
+        throw std::runtime_error("failed to find a monitor for fullscreen!");
+    }
+    const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+    glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
+    return glfwCreateWindow(mode->width, mode->height, title, monitor, nullptr);
+}
+
+// full screen exclusive：APPLICATION_CONTROLLED时驱动只在vkAcquireFullScreenExclusiveModeEXT之后独占显示器
+// 失去独占（比如alt-tab）时acquire和present返回VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT，重建swap chain之后重新获取
+// 扩展的结构在vulkan_win32.h中，其它平台上supported总是false
+class FullScreenExclusive {
+public:
+    static bool supported(const DeviceCapabilities& capabilities, bool surfaceCapabilities2) {
+#ifdef VK_EXT_full_screen_exclusive
+        return surfaceCapabilities2 && capabilities.hasExtension(VK_EXT_FULL_SCREEN_EXCLUSIVE_EXTENSION_NAME);
+#else
+        (void) capabilities;
+        (void) surfaceCapabilities2;
+        return false;
+#endif
+    }
+
+    void init(VkDevice device, GLFWwindow* window) {
+        m_device = device;
+#ifdef VK_EXT_full_screen_exclusive
+        m_acquire = (PFN_vkAcquireFullScreenExclusiveModeEXT) vkGetDeviceProcAddr(device, "vkAcquireFullScreenExclusiveModeEXT");
+        m_release = (PFN_vkReleaseFullScreenExclusiveModeEXT) vkGetDeviceProcAddr(device, "vkReleaseFullScreenExclusiveModeEXT");
+        m_win32Info.sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_WIN32_INFO_EXT;
+        m_win32Info.hmonitor = MonitorFromWindow(glfwGetWin32Window(window), MONITOR_DEFAULTTONEAREST);
+        m_info.sType = VK_STRUCTURE_TYPE_SURFACE_FULL_SCREEN_EXCLUSIVE_INFO_EXT;
+        m_info.pNext = &m_win32Info;
+        m_info.fullScreenExclusive = VK_FULL_SCREEN_EXCLUSIVE_APPLICATION_CONTROLLED_EXT;
+        m_enabled = m_acquire != nullptr && m_release != nullptr;
+#else
+        (void) window;
+#endif
+    }
+
+    bool enabled() const { return m_enabled; }
+
+    // full screen exclusive：结构需要同时放在swap chain的pNext中，查询surface能力时也要使用相同的结构
+    void chainSwapchainCreateInfo(VkSwapchainCreateInfoKHR& createInfo) {
+#ifdef VK_EXT_full_screen_exclusive
+        if (m_enabled) {
+            m_win32Info.pNext = createInfo.pNext;
+            createInfo.pNext = &m_info;
+        }
+#else
+        (void) createInfo;
+#endif
+    }
+
+    // full screen exclusive：每个新的swap chain都需要获取一次；窗口不在前台时失败，下次重建时再试
+    void acquire(VkSwapchainKHR swapChain) {
+#ifdef VK_EXT_full_screen_exclusive
+        if (m_enabled) {
+            m_acquired = m_acquire(m_device, swapChain) == VK_SUCCESS;
+        }
+#else
+        (void) swapChain;
+#endif
+    }
+
+    // full screen exclusive：销毁swap chain之前释放，恢复显示器原来的模式
+    void release(VkSwapchainKHR swapChain) {
+#ifdef VK_EXT_full_screen_exclusive
+        if (m_enabled && m_acquired) {
+            m_release(m_device, swapChain);
+        }
+#else
+        (void) swapChain;
+#endif
+        m_acquired = false;
+    }
+
+    bool acquired() const { return m_acquired; }
+
+    // full screen exclusive：窗口重新获得焦点时在主线程调用，下一帧开始时在录制的线程上重新获取
+    void requestRetry() { m_retry = true; }
+
+    void retry(VkSwapchainKHR swapChain) {
+        if (m_retry.exchange(false) && !m_acquired) {
+            acquire(swapChain);
+        }
+    }
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    bool m_enabled = false;
+    bool m_acquired = false;
+    std::atomic<bool> m_retry{false};
+#ifdef VK_EXT_full_screen_exclusive
+    PFN_vkAcquireFullScreenExclusiveModeEXT m_acquire = nullptr;
+    PFN_vkReleaseFullScreenExclusiveModeEXT m_release = nullptr;
+    VkSurfaceFullScreenExclusiveInfoEXT m_info{};
+    VkSurfaceFullScreenExclusiveWin32InfoEXT m_win32Info{};
+#endif
+};
+
+// direct display：选择第一个连接了显示器的物理设备，使用显示器原生分辨率下刷新率最高的mode，和第一个可以显示到这个显示器上的plane
+// VK_KHR_display的函数是instance扩展函数，和debug messenger一样通过vkGetInstanceProcAddr查询
+// surface属于选到的物理设备，pickPhysicalDevice时只有这个设备的队列支持present
+class DirectDisplay {
+public:
+    void createSurface(VkInstance instance, const VkAllocationCallbacks* allocator, VkSurfaceKHR& surface) {
+        auto getDisplayProperties = (PFN_vkGetPhysicalDeviceDisplayPropertiesKHR) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceDisplayPropertiesKHR");
+        auto getModeProperties = (PFN_vkGetDisplayModePropertiesKHR) vkGetInstanceProcAddr(instance, "vkGetDisplayModePropertiesKHR");
+        auto getPlaneProperties = (PFN_vkGetPhysicalDeviceDisplayPlanePropertiesKHR) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceDisplayPlanePropertiesKHR");
+        auto getPlaneDisplays = (PFN_vkGetDisplayPlaneSupportedDisplaysKHR) vkGetInstanceProcAddr(instance, "vkGetDisplayPlaneSupportedDisplaysKHR");
+        auto getPlaneCapabilities = (PFN_vkGetDisplayPlaneCapabilitiesKHR) vkGetInstanceProcAddr(instance, "vkGetDisplayPlaneCapabilitiesKHR");
+        auto createDisplaySurface = (PFN_vkCreateDisplayPlaneSurfaceKHR) vkGetInstanceProcAddr(instance, "vkCreateDisplayPlaneSurfaceKHR");
+        if (getDisplayProperties == nullptr || getModeProperties == nullptr || getPlaneProperties == nullptr || getPlaneDisplays == nullptr
+            || getPlaneCapabilities == nullptr || createDisplaySurface == nullptr) {
+            throw std::runtime_error("VK_KHR_display is not available for direct presentation!");
+        }
+
+        uint32_t deviceCount = 0;
+        vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
+        std::vector<VkPhysicalDevice> devices(deviceCount);
+        vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
+        for (VkPhysicalDevice device : devices) {
+            uint32_t displayCount = 0;
+            getDisplayProperties(device, &displayCount, nullptr);
+            std::vector<VkDisplayPropertiesKHR> displays(displayCount);
+            getDisplayProperties(device, &displayCount, displays.data());
+            for (const VkDisplayPropertiesKHR& display : displays) {
+                VkDisplayModePropertiesKHR mode;
+                if (!chooseMode(getModeProperties, device, display, mode)) {
+                    continue;
+                }
+                uint32_t planeIndex = 0, stackIndex = 0;
+                if (!choosePlane(getPlaneProperties, getPlaneDisplays, device, display.display, planeIndex, stackIndex)) {
+                    continue;
+                }
+                VkDisplayPlaneCapabilitiesKHR planeCapabilities{};
+                getPlaneCapabilities(device, mode.displayMode, planeIndex, &planeCapabilities);
+
+                VkDisplaySurfaceCreateInfoKHR createInfo{};
+                createInfo.sType = VK_STRUCTURE_TYPE_DISPLAY_SURFACE_CREATE_INFO_KHR;
+                createInfo.displayMode = mode.displayMode;
+                createInfo.planeIndex = planeIndex;
+                createInfo.planeStackIndex = stackIndex;
+                createInfo.transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+                createInfo.globalAlpha = 1.0f;
+                createInfo.alphaMode = chooseAlpha(planeCapabilities.supportedAlpha);
+                createInfo.imageExtent = mode.parameters.visibleRegion;
+                if (createDisplaySurface(instance, &createInfo, allocator, &surface) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to create display surface!");
+                }
+                m_physicalDevice = device;
+                m_extent = mode.parameters.visibleRegion;
+                m_refreshRate = mode.parameters.refreshRate;
+                m_planeIndex = planeIndex;
+                m_name = display.displayName != nullptr ? display.displayName : "unnamed display";
+                return;
+            }
+        }
+        throw std::runtime_error("failed to find a display for direct presentation!");
+    }
+
+    VkPhysicalDevice physicalDevice() const { return m_physicalDevice; }
+    VkExtent2D extent() const { return m_extent; }
+
+    std::string summary() const {
+        return m_name + " " + std::to_string(m_extent.width) + "x" + std::to_string(m_extent.height) + " @ "
+            + std::to_string(m_refreshRate / 1000) + "." + std::to_string(m_refreshRate % 1000 / 100) + " Hz, plane " + std::to_string(m_planeIndex);
+    }
+
+private:
+    // direct display：refreshRate的单位是mHz；没有原生分辨率的mode时使用第一个
+    static bool chooseMode(PFN_vkGetDisplayModePropertiesKHR getModeProperties, VkPhysicalDevice device, const VkDisplayPropertiesKHR& display,
+        VkDisplayModePropertiesKHR& chosen) {
+        uint32_t modeCount = 0;
+        getModeProperties(device, display.display, &modeCount, nullptr);
+        std::vector<VkDisplayModePropertiesKHR> modes(modeCount);
+        getModeProperties(device, display.display, &modeCount, modes.data());
+        if (modes.empty()) {
+            return false;
+        }
+        chosen = modes[0];
+        bool chosenNative = false;
+        for (const VkDisplayModePropertiesKHR& mode : modes) {
+            VkExtent2D region = mode.parameters.visibleRegion;
+            bool native = region.width == display.physicalResolution.width && region.height == display.physicalResolution.height;
+            if ((native && !chosenNative) || (native == chosenNative && mode.parameters.refreshRate > chosen.parameters.refreshRate)) {
+                chosen = mode;
+                chosenNative = native;
+            }
+        }
+        return true;
+    }
+
+    // direct display：plane没有显示其它内容（currentDisplay为空）或者已经在这个显示器上
+    static bool choosePlane(PFN_vkGetPhysicalDeviceDisplayPlanePropertiesKHR getPlaneProperties, PFN_vkGetDisplayPlaneSupportedDisplaysKHR getPlaneDisplays,
+        VkPhysicalDevice device, VkDisplayKHR display, uint32_t& planeIndex, uint32_t& stackIndex) {
+        uint32_t planeCount = 0;
+        getPlaneProperties(device, &planeCount, nullptr);
+        std::vector<VkDisplayPlanePropertiesKHR> planes(planeCount);
+        getPlaneProperties(device, &planeCount, planes.data());
+        for (uint32_t i = 0; i < planeCount; i++) {
+            if (planes[i].currentDisplay != VK_NULL_HANDLE && planes[i].currentDisplay != display) {
+                continue;
+            }
+            uint32_t supportedCount = 0;
+            getPlaneDisplays(device, i, &supportedCount, nullptr);
+            std::vector<VkDisplayKHR> supported(supportedCount);
+            getPlaneDisplays(device, i, &supportedCount, supported.data());
+            for (VkDisplayKHR candidate : supported) {
+                if (candidate == display) {
+                    planeIndex = i;
+                    stackIndex = planes[i].currentStackIndex;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // direct display：swap chain image不透明，优先不和其它plane混合
+    static VkDisplayPlaneAlphaFlagBitsKHR chooseAlpha(VkDisplayPlaneAlphaFlagsKHR supported) {
+        const VkDisplayPlaneAlphaFlagBitsKHR preferred[] = {
+            VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR, VK_DISPLAY_PLANE_ALPHA_GLOBAL_BIT_KHR,
+            VK_DISPLAY_PLANE_ALPHA_PER_PIXEL_BIT_KHR, VK_DISPLAY_PLANE_ALPHA_PER_PIXEL_PREMULTIPLIED_BIT_KHR
+        };
+        for (VkDisplayPlaneAlphaFlagBitsKHR alpha : preferred) {
+            if (supported & alpha) {
+                return alpha;
+            }
+        }
+        return VK_DISPLAY_PLANE_ALPHA_OPAQUE_BIT_KHR;
+    }
+
+    VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+    VkExtent2D m_extent{};
+    uint32_t m_refreshRate = 0;
+    uint32_t m_planeIndex = 0;
+    std::string m_name;
+};
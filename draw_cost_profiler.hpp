@@ -0,0 +1,184 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+
+// draw costs：gpu profiler只能看到pass的耗时，看不出是哪个mesh、哪个材质贵；诊断模式在每个draw前后各写一个timestamp，耗时归到mesh和材质上
+// 两个timestamp都是BOTTOM_OF_PIPE：第一个等之前的draw完成，第二个等这个draw完成，差值近似这个draw独占gpu的时间
+// gpu上相邻的draw本来是重叠执行的，插入timestamp会让它们部分串行，所以总和比pass的耗时大；只用来比较物体之间的相对开销，不用来测帧时间
+// tiled gpu上render pass内的timestamp只有整个pass的粒度，结果没有意义
+// 每个frame in flight一个query pool，结果在下一次使用这个frame in flight时读取，和gpu profiler一样不阻塞
+class DrawCostProfiler {
+public:
+    static constexpr uint32_t MAX_DRAWS = 2048;  // 一帧中计时的draw，超出的draw不计时
+    static constexpr float SMOOTHING = 0.1f;  // 每帧的耗时做指数平均，这一帧没有绘制的物体逐渐衰减到0
+
+    struct Cost {
+        uint32_t id;  // mesh或者材质的编号
+        float ms;
+    };
+
+    // draw costs：不支持timestamp的queue family不初始化，所有接口都直接返回
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t frameCount) {
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+        uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+        if (validBits == 0) {
+            return;
+        }
+        m_validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_timestampPeriod = properties.limits.timestampPeriod;
+
+        m_device = device;
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            VkQueryPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            poolInfo.queryCount = MAX_DRAWS * 2;
+            if (vkCreateQueryPool(m_device, &poolInfo, hostAllocator(), &frame.pool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create draw cost query pool!");
+            }
+            frame.draws.reserve(MAX_DRAWS);
+        }
+    }
+
+    void cleanup() {
+        for (Frame& frame : m_frames) {
+            vkDestroyQueryPool(m_device, frame.pool, hostAllocator());
+        }
+        m_frames.clear();
+    }
+
+    bool initialized() const { return !m_frames.empty(); }
+
+    // draw costs：timeline确认这个frame in flight上一次提交完成之后调用，把每个draw的耗时加到mesh和材质上
+    void collect(uint32_t frame) {
+        if (!initialized() || !m_frames[frame].recorded) {
+            return;
+        }
+        Frame& slot = m_frames[frame];
+        slot.recorded = false;
+        std::fill(m_frameMeshMs.begin(), m_frameMeshMs.end(), 0.0f);
+        std::fill(m_frameMaterialMs.begin(), m_frameMaterialMs.end(), 0.0f);
+        float frameMs = 0.0f;
+        if (!slot.draws.empty()) {
+            // 每个query两个uint64：timestamp和availability，没有WAIT_BIT，还不可用的draw跳过
+            m_results.resize(slot.draws.size() * 2 * 2);
+            VkResult result = vkGetQueryPoolResults(m_device, slot.pool, 0, static_cast<uint32_t>(slot.draws.size() * 2), m_results.size() * sizeof(uint64_t),
+                m_results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+            if (result != VK_SUCCESS && result != VK_NOT_READY) {
+                return;
+            }
+            for (size_t i = 0; i < slot.draws.size(); i++) {
+                const uint64_t* begin = &m_results[i * 4];
+                const uint64_t* end = &m_results[i * 4 + 2];
+                if (begin[1] == 0 || end[1] == 0) {
+                    continue;
+                }
+                uint64_t ticks = ((end[0] & m_validMask) - (begin[0] & m_validMask)) & m_validMask;
+                float ms = static_cast<float>(static_cast<double>(ticks) * m_timestampPeriod * 1e-6);
+                const Draw& draw = slot.draws[i];
+                grow(m_frameMeshMs, m_meshMs, draw.mesh);
+                grow(m_frameMaterialMs, m_materialMs, draw.material);
+                m_frameMeshMs[draw.mesh] += ms;
+                m_frameMaterialMs[draw.material] += ms;
+                frameMs += ms;
+            }
+        }
+        for (size_t i = 0; i < m_meshMs.size(); i++) {
+            m_meshMs[i] += (m_frameMeshMs[i] - m_meshMs[i]) * SMOOTHING;
+        }
+        for (size_t i = 0; i < m_materialMs.size(); i++) {
+            m_materialMs[i] += (m_frameMaterialMs[i] - m_materialMs[i]) * SMOOTHING;
+        }
+        m_totalMs += (frameMs - m_totalMs) * SMOOTHING;
+    }
+
+    // draw costs：录制command buffer开头、render pass之外调用，重置这个frame in flight的query并清空draw记录
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+        if (!initialized()) {
+            return;
+        }
+        vkCmdResetQueryPool(commandBuffer, m_frames[frame].pool, 0, MAX_DRAWS * 2);
+        m_frames[frame].draws.clear();
+        m_frames[frame].recorded = true;
+    }
+
+    // draw costs：begin和end包围一个draw，可以在render pass内部；超过MAX_DRAWS时返回UINT32_MAX，end不写入
+    uint32_t begin(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t mesh, uint32_t material) {
+        if (!initialized() || m_frames[frame].draws.size() == MAX_DRAWS) {
+            return UINT32_MAX;
+        }
+        Frame& slot = m_frames[frame];
+        uint32_t draw = static_cast<uint32_t>(slot.draws.size());
+        slot.draws.push_back({mesh, material});
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot.pool, draw * 2);
+        return draw;
+    }
+
+    void end(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t draw) {
+        if (draw == UINT32_MAX) {
+            return;
+        }
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_frames[frame].pool, draw * 2 + 1);
+    }
+
+    // draw costs：平均耗时最大的count个mesh（materials为true时是材质），从大到小；写进调用者复用的vector
+    void top(uint32_t count, bool materials, std::vector<Cost>& result) const {
+        const std::vector<float>& costs = materials ? m_materialMs : m_meshMs;
+        result.clear();
+        for (size_t i = 0; i < costs.size(); i++) {
+            if (costs[i] > 0.0f) {
+                result.push_back({static_cast<uint32_t>(i), costs[i]});
+            }
+        }
+        size_t kept = std::min<size_t>(count, result.size());
+        std::partial_sort(result.begin(), result.begin() + kept, result.end(), [](const Cost& a, const Cost& b) { return a.ms > b.ms; });
+        result.resize(kept);
+    }
+
+    // draw costs：计时的draw的平均耗时之和
+    float totalMs() const { return m_totalMs; }
+
+private:
+    struct Draw {
+        uint32_t mesh;
+        uint32_t material;
+    };
+
+    struct Frame {
+        VkQueryPool pool = VK_NULL_HANDLE;
+        std::vector<Draw> draws;  // 第i个draw使用query 2i和2i+1
+        bool recorded = false;  // 录制过并且还没有读取
+    };
+
+    static void grow(std::vector<float>& frameCosts, std::vector<float>& costs, uint32_t id) {
+        if (id >= costs.size()) {
+            costs.resize(id + 1, 0.0f);
+            frameCosts.resize(id + 1, 0.0f);
+        }
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    float m_timestampPeriod = 1.f;
+    uint64_t m_validMask = 0;
+    std::vector<Frame> m_frames;
+    std::vector<uint64_t> m_results;
+    std::vector<float> m_meshMs;  // 按mesh编号的平均耗时，mesh slot复用时由下一个物体继承，几帧之后衰减掉
+    std::vector<float> m_materialMs;
+    std::vector<float> m_frameMeshMs;  // collect中这一帧的累计，容量复用
+    std::vector<float> m_frameMaterialMs;
+    float m_totalMs = 0.0f;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+
+// draw sort：每个draw一个packet，key从高位到低位是pass、pipeline、raster state、材质、mesh和depth
+// 按key排序之后相同pipeline、状态和材质的draw相邻，录制时只有相邻两个draw的key在这一段不同时才需要重新绑定
+struct DrawPacket {
+    uint64_t key = 0;
+    uint32_t mesh = 0;
+};
+
+struct DrawSortKey {
+    static constexpr uint32_t PASS_BITS = 4;
+    static constexpr uint32_t PIPELINE_BITS = 4;
+    static constexpr uint32_t STATE_BITS = 4;
+    static constexpr uint32_t MATERIAL_BITS = 16;
+    static constexpr uint32_t MESH_BITS = 20;
+    static constexpr uint32_t DEPTH_BITS = 16;
+    static_assert(PASS_BITS + PIPELINE_BITS + STATE_BITS + MATERIAL_BITS + MESH_BITS + DEPTH_BITS == 64, "sort key must fill 64 bits");
+
+    static constexpr uint32_t DEPTH_SHIFT = 0;
+    static constexpr uint32_t MESH_SHIFT = DEPTH_SHIFT + DEPTH_BITS;
+    static constexpr uint32_t MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+    static constexpr uint32_t STATE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+    static constexpr uint32_t PIPELINE_SHIFT = STATE_SHIFT + STATE_BITS;
+    static constexpr uint32_t PASS_SHIFT = PIPELINE_SHIFT + PIPELINE_BITS;
+
+    // draw sort：超出位数的值被截断，只影响排序的效果，不影响正确性
+    static uint64_t make(uint32_t pass, uint32_t pipeline, uint32_t state, uint32_t material, uint32_t mesh, uint32_t depth) {
+        return field(pass, PASS_BITS, PASS_SHIFT) | field(pipeline, PIPELINE_BITS, PIPELINE_SHIFT) | field(state, STATE_BITS, STATE_SHIFT) |
+            field(material, MATERIAL_BITS, MATERIAL_SHIFT) | field(mesh, MESH_BITS, MESH_SHIFT) | field(depth, DEPTH_BITS, DEPTH_SHIFT);
+    }
+
+    // draw sort：[0, 1]的深度量化成DEPTH_BITS位，不透明的pass从近到远，透明的pass传入1 - depth从远到近
+    static uint32_t quantizeDepth(float depth) {
+        float clamped = depth < 0.0f ? 0.0f : (depth > 1.0f ? 1.0f : depth);
+        return static_cast<uint32_t>(clamped * float((1u << DEPTH_BITS) - 1) + 0.5f);
+    }
+
+private:
+    static uint64_t field(uint32_t value, uint32_t bits, uint32_t shift) {
+        return (uint64_t(value) & ((uint64_t(1) << bits) - 1)) << shift;
+    }
+};
+
+// draw sort：LSD基数排序，每趟8位共8趟，稳定；所有packet这一位相同的趟直接跳过，多数高位字段只有几个值
+// 一帧只有几千个draw，比std::sort的比较排序快
+// frame arena：临时buffer和packets使用同一个memory resource，packets在frame arena中时排序不访问通用的堆
+class DrawSorter {
+public:
+    void sort(std::pmr::vector<DrawPacket>& packets) {
+        CPU_PROFILE_SCOPE("draw sort");
+        std::pmr::vector<DrawPacket> scratch(packets.size(), packets.get_allocator());
+        std::pmr::vector<DrawPacket>* source = &packets;
+        std::pmr::vector<DrawPacket>* target = &scratch;
+        for (uint32_t shift = 0; shift < 64; shift += 8) {
+            std::array<uint32_t, 256> counts{};
+            for (const DrawPacket& packet : *source) {
+                counts[(packet.key >> shift) & 0xFF]++;
+            }
+            if (!packets.empty() && counts[((*source)[0].key >> shift) & 0xFF] == packets.size()) {
+                continue;
+            }
+            uint32_t offset = 0;
+            for (uint32_t& count : counts) {
+                uint32_t bucket = count;
+                count = offset;
+                offset += bucket;
+            }
+            for (const DrawPacket& packet : *source) {
+                (*target)[counts[(packet.key >> shift) & 0xFF]++] = packet;
+            }
+            std::swap(source, target);
+        }
+        if (source != &packets) {
+            packets.swap(scratch);
+        }
+    }
+};
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "shader_registry.hpp"
+
+// dynamic resolution：场景渲染到缩小的offscreen image，再放大到swap chain image
+// controller根据gpu的帧时间调整缩放比例，gpu较弱或者场景变重时降低分辨率，保持帧率而不需要手动降低画质
+// 像素数和比例的平方成正比，所以按时间比例的平方根调整；比例按step量化并且每次改变之后等待cooldownFrames帧
+// 分辨率改变时render graph重新分配transient image，量化和等待避免每帧都重新分配，也让timestamp反映新的分辨率
+class DynamicResolutionController {
+public:
+    void init(float targetMs, float minScale, float maxScale, float step, uint32_t cooldownFrames) {
+        m_targetMs = targetMs;
+        m_minScale = minScale;
+        m_maxScale = maxScale;
+        m_step = step;
+        m_cooldownFrames = cooldownFrames;
+        m_scale = maxScale;
+        m_filteredMs = 0.0f;
+        m_framesSinceChange = 0;
+    }
+
+    // dynamic resolution：每帧调用一次，gpuMs是最近一次完成的帧的gpu时间，没有结果时传入0；返回true表示比例改变
+    bool update(float gpuMs) {
+        m_framesSinceChange++;
+        if (gpuMs <= 0.0f) {
+            return false;
+        }
+        m_filteredMs = m_filteredMs == 0.0f ? gpuMs : m_filteredMs + (gpuMs - m_filteredMs) * FILTER_ALPHA;
+        if (m_framesSinceChange < m_cooldownFrames) {
+            return false;
+        }
+
+        // 超过目标时马上降低；低于目标一定程度时才升高，并且每次最多升高一个step，避免在两个比例之间来回切换
+        float desired = m_scale * std::sqrt(m_targetMs / m_filteredMs);
+        if (m_filteredMs < m_targetMs * RAISE_THRESHOLD) {
+            desired = std::min(desired, m_scale + m_step);
+        } else if (m_filteredMs <= m_targetMs) {
+            return false;
+        }
+        float quantized = std::clamp(std::floor(desired / m_step + 0.5f) * m_step, m_minScale, m_maxScale);
+        if (std::fabs(quantized - m_scale) < m_step * 0.5f) {
+            return false;
+        }
+
+        // 新分辨率的时间按像素数估计，之后的测量继续修正
+        m_filteredMs *= (quantized * quantized) / (m_scale * m_scale);
+        m_scale = quantized;
+        m_framesSinceChange = 0;
+        return true;
+    }
+
+    float scale() const { return m_scale; }
+
+    // dynamic resolution：quality tier改变时调整比例上限，当前比例超过新的上限时马上降低；返回true表示比例改变
+    bool setMaxScale(float maxScale) {
+        m_maxScale = std::max(maxScale, m_minScale);
+        if (m_scale <= m_maxScale) {
+            return false;
+        }
+        m_filteredMs *= (m_maxScale * m_maxScale) / (m_scale * m_scale);
+        m_scale = m_maxScale;
+        m_framesSinceChange = 0;
+        return true;
+    }
+
+    // dynamic resolution：按比例缩放的渲染分辨率，至少1个像素
+    VkExtent2D extent(VkExtent2D fullExtent) const {
+        return {std::max(static_cast<uint32_t>(fullExtent.width * m_scale + 0.5f), 1u), std::max(static_cast<uint32_t>(fullExtent.height * m_scale + 0.5f), 1u)};
+    }
+
+private:
+    static constexpr float FILTER_ALPHA = 0.1f;  // gpu时间的指数平均，timestamp每帧有波动
+    static constexpr float RAISE_THRESHOLD = 0.85f;  // 低于目标的这个比例时才升高分辨率
+
+    float m_targetMs = 16.6f;
+    float m_minScale = 0.5f;
+    float m_maxScale = 1.0f;
+    float m_step = 0.05f;
+    uint32_t m_cooldownFrames = 0;
+    float m_scale = 1.0f;
+    float m_filteredMs = 0.0f;
+    uint32_t m_framesSinceChange = 0;
+};
+
+// dynamic resolution：全屏三角形把offscreen image放大到当前的color attachment，可选对比度自适应锐化
+// 每个frame in flight一个descriptor set，和hi-z读取depth的set一样在source view改变时重写
+// pipeline使用dynamic rendering，只有一个color attachment，没有depth
+class Upscaler {
+public:
+    void init(VkDevice device, VkPipelineCache pipelineCache, const SpirvCode& vertexCode, const SpirvCode& fragmentCode, VkFormat colorFormat, uint32_t frameCount) {
+        m_device = device;
+
+        // dynamic resolution：双线性放大，clamp避免边缘采样到另一侧
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        if (vkCreateSampler(m_device, &samplerInfo, hostAllocator(), &m_sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upscale sampler!");
+        }
+
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = 0;
+        binding.descriptorCount = 1;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upscale descriptor set layout!");
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = frameCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upscale descriptor pool!");
+        }
+        std::vector<VkDescriptorSetLayout> layouts(frameCount, m_descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_descriptorPool;
+        allocInfo.descriptorSetCount = frameCount;
+        allocInfo.pSetLayouts = layouts.data();
+        m_sets.resize(frameCount);
+        if (vkAllocateDescriptorSets(m_device, &allocInfo, m_sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate upscale descriptor sets!");
+        }
+        m_sourceViews.assign(frameCount, VK_NULL_HANDLE);
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upscale pipeline layout!");
+        }
+
+        createPipeline(pipelineCache, vertexCode, fragmentCode, colorFormat);
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());  // set随pool一起释放
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        vkDestroySampler(m_device, m_sampler, hostAllocator());
+        m_sets.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // dynamic resolution：在dynamic rendering之内录制，sourceView处于SHADER_READ_ONLY_OPTIMAL
+    // 调用者保证这个frame in flight上一次的提交已经完成，set可以重写
+    // post processing：srgbSource表示source是sRGB编码的UNORM，输出之前需要解码
+    void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView sourceView, VkExtent2D targetExtent, float sharpness, bool srgbSource = false) {
+        if (m_sourceViews[frameIndex] != sourceView) {
+            VkDescriptorImageInfo imageInfo{};
+            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            imageInfo.imageView = sourceView;
+            imageInfo.sampler = m_sampler;
+
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = m_sets[frameIndex];
+            write.dstBinding = 0;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write.descriptorCount = 1;
+            write.pImageInfo = &imageInfo;
+            vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+            m_sourceViews[frameIndex] = sourceView;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+        VkViewport viewport{0.0f, 0.0f, float(targetExtent.width), float(targetExtent.height), 0.0f, 1.0f};
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        VkRect2D scissor{{0, 0}, targetExtent};
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_sets[frameIndex], 0, nullptr);
+
+        PushConstants constants{{1.0f / float(targetExtent.width), 1.0f / float(targetExtent.height)}, sharpness, srgbSource ? 1.0f : 0.0f};
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    }
+
+private:
+    struct PushConstants {
+        float targetTexelSize[2];
+        float sharpness;
+        float srgbSource;
+    };
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& vertexCode, const SpirvCode& fragmentCode, VkFormat colorFormat) {
+        std::array<VkShaderModule, 2> modules{};
+        const SpirvCode* codes[2] = {&vertexCode, &fragmentCode};
+        for (size_t i = 0; i < modules.size(); i++) {
+            VkShaderModuleCreateInfo moduleInfo{};
+            moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+            moduleInfo.codeSize = codes[i]->size;
+            moduleInfo.pCode = codes[i]->words;
+            if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &modules[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create upscale shader module!");
+            }
+        }
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+        VkShaderStageFlagBits stageBits[2] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+        for (size_t i = 0; i < stages.size(); i++) {
+            stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stages[i].stage = stageBits[i];
+            stages[i].module = modules[i];
+            stages[i].pName = "main";
+        }
+
+        VkPipelineVertexInputStateCreateInfo vertexInput{};
+        vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.lineWidth = 1.0f;
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        VkPipelineColorBlendAttachmentState blendAttachment{};
+        blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &blendAttachment;
+        VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        VkPipelineRenderingCreateInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &colorFormat;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &renderingInfo;
+        pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+        pipelineInfo.pStages = stages.data();
+        pipelineInfo.pVertexInputState = &vertexInput;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateGraphicsPipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        for (VkShaderModule module : modules) {
+            vkDestroyShaderModule(m_device, module, hostAllocator());
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upscale pipeline!");
+        }
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> m_sets;
+    std::vector<VkImageView> m_sourceViews;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// dynamic state：VK_EXT_extended_dynamic_state（1.3中是core）把面剔除、正面方向、图元类型和深度测试变成命令
+// 线框、双面材质和只写深度的pass都使用同一个pipeline，不再需要为每种组合编译一个pipeline
+// polygon mode只有VK_EXT_extended_dynamic_state3提供，不支持时线框模式不可用
+// variable rate shading：per-draw的fragment shading rate也作为dynamic state设置，只在开启了pipelineFragmentShadingRate时录制
+// dynamic state：1.3的设备返回core函数，否则返回扩展的EXT函数
+template<typename Function>
+Function loadDeviceFunction(VkDevice device, const std::string& name) {
+    auto function = (Function) vkGetDeviceProcAddr(device, name.c_str());
+    if (function == nullptr) {
+        function = (Function) vkGetDeviceProcAddr(device, (name + "EXT").c_str());
+    }
+    if (function == nullptr) {
+        throw std::runtime_error("failed to load device function " + name + "!");
+    }
+    return function;
+}
+
+struct RasterState {
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;  // descriptor set：mvp矩阵对y轴进行了反转所以逆时针为正面
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkBool32 depthTestEnable = VK_TRUE;
+    VkBool32 depthWriteEnable = VK_TRUE;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkExtent2D shadingRate = {1, 1};
+    VkFragmentShadingRateCombinerOpKHR shadingRateCombiner = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;  // 和attachment的rate的组合方式
+};
+
+class DynamicStateCommands {
+public:
+    // dynamic state：1.3的设备一定支持，更早的设备需要扩展和extendedDynamicState feature
+    static bool supported(VkPhysicalDevice physicalDevice, bool extensionAvailable) {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        if (properties.apiVersion >= VK_API_VERSION_1_3) {
+            return true;
+        }
+        if (!extensionAvailable) {
+            return false;
+        }
+        VkPhysicalDeviceExtendedDynamicStateFeaturesEXT features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return features.extendedDynamicState;
+    }
+
+    // dynamic state：polygon mode除了extendedDynamicState3PolygonMode还需要fillModeNonSolid才能画线框
+    static bool polygonModeSupported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceExtendedDynamicState3FeaturesEXT features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return features.extendedDynamicState3PolygonMode && features2.features.fillModeNonSolid;
+    }
+
+    void init(VkDevice device, bool polygonMode) {
+        m_setCullMode = loadDeviceFunction<PFN_vkCmdSetCullMode>(device, "vkCmdSetCullMode");
+        m_setFrontFace = loadDeviceFunction<PFN_vkCmdSetFrontFace>(device, "vkCmdSetFrontFace");
+        m_setPrimitiveTopology = loadDeviceFunction<PFN_vkCmdSetPrimitiveTopology>(device, "vkCmdSetPrimitiveTopology");
+        m_setDepthTestEnable = loadDeviceFunction<PFN_vkCmdSetDepthTestEnable>(device, "vkCmdSetDepthTestEnable");
+        m_setDepthWriteEnable = loadDeviceFunction<PFN_vkCmdSetDepthWriteEnable>(device, "vkCmdSetDepthWriteEnable");
+        m_setDepthCompareOp = loadDeviceFunction<PFN_vkCmdSetDepthCompareOp>(device, "vkCmdSetDepthCompareOp");
+        if (polygonMode) {
+            m_setPolygonMode = loadDeviceFunction<PFN_vkCmdSetPolygonModeEXT>(device, "vkCmdSetPolygonModeEXT");
+        }
+    }
+
+    // variable rate shading：init之后调用，扩展的函数没有core版本
+    void enableShadingRate(VkDevice device) {
+        m_setFragmentShadingRate = (PFN_vkCmdSetFragmentShadingRateKHR) vkGetDeviceProcAddr(device, "vkCmdSetFragmentShadingRateKHR");
+        if (m_setFragmentShadingRate == nullptr) {
+            throw std::runtime_error("failed to load device function vkCmdSetFragmentShadingRateKHR!");
+        }
+    }
+
+    bool initialized() const { return m_setCullMode != nullptr; }
+    bool polygonMode() const { return m_setPolygonMode != nullptr; }
+    bool shadingRate() const { return m_setFragmentShadingRate != nullptr; }
+
+    // dynamic state：追加到pipeline的dynamic state中，mesh shader pipeline没有图元装配，不能把topology设置成动态
+    void appendDynamicStates(std::vector<VkDynamicState>& states, bool meshShader) const {
+        states.push_back(VK_DYNAMIC_STATE_CULL_MODE);
+        states.push_back(VK_DYNAMIC_STATE_FRONT_FACE);
+        if (!meshShader) {
+            states.push_back(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY);
+        }
+        states.push_back(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE);
+        states.push_back(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE);
+        states.push_back(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP);
+        if (polygonMode()) {
+            states.push_back(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+        }
+        if (shadingRate()) {
+            states.push_back(VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR);
+        }
+    }
+
+    // dynamic state：绑定pipeline之后调用，两个pipeline的dynamic state不完全相同，切换后之前设置的值不再可靠
+    void invalidate(bool meshShader) {
+        m_valid = false;
+        m_meshShader = meshShader;
+    }
+
+    // dynamic state：只录制和上一次不同的状态，绑定了pipeline之后第一次全部录制
+    void apply(VkCommandBuffer commandBuffer, const RasterState& state) {
+        bool all = !m_valid;
+        if (all || state.cullMode != m_current.cullMode) {
+            m_setCullMode(commandBuffer, state.cullMode);
+        }
+        if (all || state.frontFace != m_current.frontFace) {
+            m_setFrontFace(commandBuffer, state.frontFace);
+        }
+        if (!m_meshShader && (all || state.topology != m_current.topology)) {
+            m_setPrimitiveTopology(commandBuffer, state.topology);
+        }
+        if (all || state.depthTestEnable != m_current.depthTestEnable) {
+            m_setDepthTestEnable(commandBuffer, state.depthTestEnable);
+        }
+        if (all || state.depthWriteEnable != m_current.depthWriteEnable) {
+            m_setDepthWriteEnable(commandBuffer, state.depthWriteEnable);
+        }
+        if (all || state.depthCompareOp != m_current.depthCompareOp) {
+            m_setDepthCompareOp(commandBuffer, state.depthCompareOp);
+        }
+        if (m_setPolygonMode && (all || state.polygonMode != m_current.polygonMode)) {
+            m_setPolygonMode(commandBuffer, state.polygonMode);
+        }
+        // variable rate shading：第一个combiner组合pipeline和图元的rate，这里不使用图元的rate，保留per-draw的值
+        if (m_setFragmentShadingRate && (all || state.shadingRate.width != m_current.shadingRate.width || state.shadingRate.height != m_current.shadingRate.height
+            || state.shadingRateCombiner != m_current.shadingRateCombiner)) {
+            VkFragmentShadingRateCombinerOpKHR combiners[2] = {VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR, state.shadingRateCombiner};
+            m_setFragmentShadingRate(commandBuffer, &state.shadingRate, combiners);
+        }
+        m_current = state;
+        m_valid = true;
+    }
+
+private:
+    PFN_vkCmdSetCullMode m_setCullMode = nullptr;
+    PFN_vkCmdSetFrontFace m_setFrontFace = nullptr;
+    PFN_vkCmdSetPrimitiveTopology m_setPrimitiveTopology = nullptr;
+    PFN_vkCmdSetDepthTestEnable m_setDepthTestEnable = nullptr;
+    PFN_vkCmdSetDepthWriteEnable m_setDepthWriteEnable = nullptr;
+    PFN_vkCmdSetDepthCompareOp m_setDepthCompareOp = nullptr;
+    PFN_vkCmdSetPolygonModeEXT m_setPolygonMode = nullptr;
+    PFN_vkCmdSetFragmentShadingRateKHR m_setFragmentShadingRate = nullptr;
+    RasterState m_current;
+    bool m_valid = false;
+    bool m_meshShader = false;
+};
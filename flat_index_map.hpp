@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// flat index map：按原始字节hash，一次处理8字节，最后用murmur3的finalizer打散所有位
+// 比把glm的hash移位异或在一起的冲突少很多，key需要没有padding（比如Vertex是8个float）
+inline uint64_t hashBytes(const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ size;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ static_cast<uint8_t>(bytes[i])) * 0xc4ceb9fe1a85ec53ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// flat index map：开放寻址的去重表，key本身保存在调用者的数组中，表中只保存index和hash的高32位
+// 每个槽8字节，线性探测时连续的槽在同一个cache line中；查找和插入是一次探测
+// key按字节比较，+0.0和-0.0这种值相等但字节不同的key不会被合并，只是少去重一个顶点
+template<typename Key>
+class FlatIndexMap {
+public:
+    // flat index map：在插入之前预留count个key的空间，负载不超过一半，插入过程中不需要rehash
+    void reserve(size_t count) {
+        size_t capacity = 16;
+        while (capacity < count * 2) {
+            capacity *= 2;
+        }
+        if (m_count == 0 && capacity > m_slots.size()) {
+            m_slots.assign(capacity, Slot{});
+        }
+    }
+
+    // flat index map：返回key在keys中的index，不存在时追加到keys末尾
+    uint32_t findOrInsert(const Key& key, std::vector<Key>& keys) {
+        if ((m_count + 1) * 2 > m_slots.size()) {
+            rehash(m_slots.empty() ? 16 : m_slots.size() * 2, keys);
+        }
+
+        uint64_t hash = hashBytes(&key, sizeof(Key));
+        uint32_t tag = static_cast<uint32_t>(hash >> 32);
+        size_t mask = m_slots.size() - 1;
+        for (size_t i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask) {
+            Slot& slot = m_slots[i];
+            if (slot.index == EMPTY) {
+                slot.index = static_cast<uint32_t>(keys.size());
+                slot.tag = tag;
+                keys.push_back(key);
+                m_count++;
+                return slot.index;
+            }
+            if (slot.tag == tag && memcmp(&keys[slot.index], &key, sizeof(Key)) == 0) {
+                return slot.index;
+            }
+        }
+    }
+
+    size_t size() const { return m_count; }
+
+    void clear() {
+        m_slots.clear();
+        m_count = 0;
+    }
+
+private:
+    static const uint32_t EMPTY = UINT32_MAX;
+
+    struct Slot {
+        uint32_t index = EMPTY;
+        uint32_t tag = 0;
+    };
+
+    // flat index map：扩容时从keys重新计算hash，只有reserve不够时才会发生
+    void rehash(size_t capacity, const std::vector<Key>& keys) {
+        std::vector<Slot> old = std::move(m_slots);
+        m_slots.assign(capacity, Slot{});
+        size_t mask = capacity - 1;
+        for (const Slot& slot : old) {
+            if (slot.index == EMPTY) {
+                continue;
+            }
+            uint64_t hash = hashBytes(&keys[slot.index], sizeof(Key));
+            size_t i = static_cast<size_t>(hash) & mask;
+            while (m_slots[i].index != EMPTY) {
+                i = (i + 1) & mask;
+            }
+            m_slots[i] = slot;
+        }
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_count = 0;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <ostream>
+#include <vector>
+
+// frame arena：每个frame in flight一块线性内存，一帧中的cpu临时数据（draw packet、可见列表、实例矩阵）从当前frame的arena中顺序分配
+// 释放什么也不做，这个frame的timeline值到达之后beginFrame整块重置；同一帧的临时数据在内存中相邻，遍历时cache更友好
+// 容器通过std::pmr::polymorphic_allocator使用它：容器只在构造时绑定一次FrameArenas，分配总是落在当前frame的arena中
+// 重置之前容器必须先release，否则它还以为自己拥有上一轮分配的容量
+// 一轮中放不下时向上游申请新的chunk，下一次重置时合并成一块够大的chunk，稳定之后帧循环中不再分配
+class FrameArena {
+public:
+    static constexpr size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+    FrameArena() = default;
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+    ~FrameArena() { releaseChunks(); }
+
+    void* allocate(size_t bytes, size_t alignment) {
+        size_t offset = alignUp(m_offset, alignment);
+        if (m_chunks.empty() || offset + bytes > m_chunks.back().size) {
+            addChunk(bytes + alignment);
+            offset = alignUp(m_offset, alignment);
+        }
+        m_offset = offset + bytes;
+        m_used += bytes;
+        m_peakUsed = std::max(m_peakUsed, m_used);
+        return m_chunks.back().memory + offset;
+    }
+
+    // frame arena：上一轮用了多个chunk时换成一块总大小的chunk，chunk的大小只增不减
+    void reset() {
+        if (m_chunks.size() > 1) {
+            size_t total = 0;
+            for (const Chunk& chunk : m_chunks) {
+                total += chunk.size;
+            }
+            releaseChunks();
+            addChunk(total);
+        }
+        m_offset = 0;
+        m_used = 0;
+    }
+
+    size_t used() const { return m_used; }
+    size_t peakUsed() const { return m_peakUsed; }
+    size_t capacity() const {
+        size_t total = 0;
+        for (const Chunk& chunk : m_chunks) {
+            total += chunk.size;
+        }
+        return total;
+    }
+    uint64_t overflows() const { return m_overflows; }
+
+private:
+    struct Chunk {
+        std::byte* memory;
+        size_t size;
+    };
+
+    static size_t alignUp(size_t value, size_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+    void addChunk(size_t minSize) {
+        size_t size = std::max({MIN_CHUNK_SIZE, minSize, m_chunks.empty() ? size_t(0) : m_chunks.back().size * 2});
+        if (!m_chunks.empty()) {
+            m_overflows++;
+        }
+        m_chunks.push_back({static_cast<std::byte*>(::operator new(size, std::align_val_t(alignof(std::max_align_t)))), size});
+        m_offset = 0;
+    }
+
+    void releaseChunks() {
+        for (const Chunk& chunk : m_chunks) {
+            ::operator delete(chunk.memory, std::align_val_t(alignof(std::max_align_t)));
+        }
+        m_chunks.clear();
+    }
+
+    std::vector<Chunk> m_chunks;
+    size_t m_offset = 0;  // 在最后一个chunk中的位置
+    size_t m_used = 0;
+    size_t m_peakUsed = 0;
+    uint64_t m_overflows = 0;
+};
+
+// frame arena：所有frame in flight的arena，作为memory resource交给pmr容器
+// 上一次beginFrame选中的arena之外的内存在它们各自的frame重新开始之前一直有效
+class FrameArenas : public std::pmr::memory_resource {
+public:
+    void init(uint32_t frameCount) {
+        m_arenas = std::vector<FrameArena>(frameCount);
+        m_current = 0;
+    }
+
+    // frame arena：在这个frame in flight的timeline等待之后调用，调用之前所有使用它的容器已经release
+    void beginFrame(uint32_t frame) {
+        m_current = frame;
+        m_arenas[frame].reset();
+    }
+
+    // frame arena：丢掉容器的内容和容量，之后的分配落在当前frame的arena中；分配器相同，交换是合法的
+    template <typename Container>
+    static void release(Container& container) {
+        Container(container.get_allocator()).swap(container);
+    }
+
+    const FrameArena& arena(uint32_t frame) const { return m_arenas[frame]; }
+
+    void report(std::ostream& out) const {
+        size_t peak = 0;
+        size_t capacity = 0;
+        uint64_t overflows = 0;
+        for (const FrameArena& arena : m_arenas) {
+            peak = std::max(peak, arena.peakUsed());
+            capacity += arena.capacity();
+            overflows += arena.overflows();
+        }
+        out << "frame arena: peak " << peak / 1024 << " KiB per frame, " << capacity / 1024 << " KiB reserved over " << m_arenas.size() << " frames, "
+            << overflows << " chunk overflows\n";
+    }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override { return m_arenas[m_current].allocate(bytes, alignment); }
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::vector<FrameArena> m_arenas;
+    uint32_t m_current = 0;
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "job_pool.hpp"
+#include "memory_allocator.hpp"
+#include "thirdparty/tinygltf/stb_image_write.h"
+
+// frame capture：不阻塞的截图，请求的帧在提交时多执行一个command buffer，把color target拷贝到ring中一个slot的host visible buffer
+// 之后的帧开始时用timeline的完成值判断拷贝是否完成，完成的slot交给job pool转换成RGBA并编码成png（扩展名是.ppm时写ppm），编码完成后slot才重新使用
+// 没有空闲slot时请求留到之后的帧，cpu和gpu都不等待；只支持8位的RGBA和BGRA格式，swap chain需要TRANSFER_SRC usage
+class FrameCapture {
+public:
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkCommandPool commandPool, JobPool& jobPool, uint32_t ringSize) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_commandPool = commandPool;
+        m_jobPool = &jobPool;
+        m_slots.clear();
+        for (uint32_t i = 0; i < ringSize; i++) {
+            m_slots.push_back(std::make_unique<Slot>());
+        }
+
+        std::vector<VkCommandBuffer> commandBuffers(ringSize);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = ringSize;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate frame capture command buffers!");
+        }
+        for (uint32_t i = 0; i < ringSize; i++) {
+            m_slots[i]->commandBuffer = commandBuffers[i];
+        }
+    }
+
+    // frame capture：调用者保证gpu已经空闲；还没有编码的slot在这里交给job pool并等待，退出前请求的截图不会丢失
+    void cleanup(uint64_t completedValue) {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        collect(completedValue);
+        m_jobPool->wait(m_encodeCounter);
+        for (std::unique_ptr<Slot>& slot : m_slots) {
+            vkFreeCommandBuffers(m_device, m_commandPool, 1, &slot->commandBuffer);
+            if (slot->buffer != VK_NULL_HANDLE) {
+                vkDestroyBuffer(m_device, slot->buffer, hostAllocator());
+                m_allocator->free(slot->allocation);
+            }
+        }
+        m_slots.clear();
+        m_requests.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+    void request(const std::string& path) { m_requests.push_back(path); }
+    bool hasRequest() const { return !m_requests.empty(); }
+    uint32_t written() const { return m_written.load(std::memory_order_relaxed); }
+
+    static bool supportsFormat(VkFormat format) {
+        return bgra(format) || format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+    }
+
+    // frame capture：在这一帧的场景命令之后执行，image在layout中，拷贝之后回到同一个layout；没有请求或者没有空闲slot时返回VK_NULL_HANDLE
+    // 返回的command buffer提交之后调用submitted传入这次提交signal的timeline值
+    VkCommandBuffer record(VkImage image, VkFormat format, VkExtent2D extent, VkImageLayout layout) {
+        if (m_requests.empty() || !supportsFormat(format)) {
+            return VK_NULL_HANDLE;
+        }
+        Slot* slot = nullptr;
+        for (std::unique_ptr<Slot>& candidate : m_slots) {
+            if (candidate->state == SlotState::free) {
+                slot = candidate.get();
+                break;
+            }
+        }
+        if (slot == nullptr) {
+            return VK_NULL_HANDLE;
+        }
+        VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * 4;
+        if (slot->capacity < size) {
+            resize(*slot, size);
+        }
+        slot->path = m_requests.front();
+        m_requests.pop_front();
+        slot->extent = extent;
+        slot->format = format;
+        slot->state = SlotState::recorded;
+
+        VkCommandBuffer commandBuffer = slot->commandBuffer;
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording frame capture command buffer!");
+        }
+
+        // frame capture：color target可能由render pass、dynamic rendering或者post process的compute写入
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = layout;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {extent.width, extent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+        // frame capture：present等待这次提交signal的semaphore，回到原来的layout不需要额外的dst stage
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = layout;
+        VkMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr,
+            1, &barrier);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record frame capture command buffer!");
+        }
+        return commandBuffer;
+    }
+
+    // frame capture：record返回的command buffer已经提交，timeline到达value时拷贝完成
+    void submitted(uint64_t value) {
+        for (std::unique_ptr<Slot>& slot : m_slots) {
+            if (slot->state == SlotState::recorded) {
+                slot->timelineValue = value;
+                slot->state = SlotState::copying;
+            }
+        }
+    }
+
+    // frame capture：每帧调用一次，只检查timeline的值，不等待；编码完成的slot回到空闲
+    void collect(uint64_t completedValue) {
+        for (std::unique_ptr<Slot>& pointer : m_slots) {
+            Slot* slot = pointer.get();
+            if (slot->state == SlotState::encoding && slot->encoded.load(std::memory_order_acquire)) {
+                slot->state = SlotState::free;
+            } else if (slot->state == SlotState::copying && slot->timelineValue <= completedValue) {
+                slot->state = SlotState::encoding;
+                slot->encoded.store(false, std::memory_order_relaxed);
+                m_jobPool->submit([this, slot]() {
+                    bool ok = encode(*slot);
+                    if (ok) {
+                        m_written.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        std::cerr << "failed to write frame capture: " << slot->path << std::endl;
+                    }
+                    slot->encoded.store(true, std::memory_order_release);
+                }, &m_encodeCounter);
+            }
+        }
+    }
+
+private:
+    enum class SlotState : uint8_t {
+        free,
+        recorded,  // 录制了拷贝，还没有提交
+        copying,  // 已经提交，等待timeline
+        encoding,  // job pool正在读取buffer
+    };
+
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkDeviceSize capacity = 0;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        SlotState state = SlotState::free;
+        uint64_t timelineValue = 0;
+        std::string path;
+        VkExtent2D extent{};
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        std::atomic<bool> encoded{false};
+    };
+
+    static bool bgra(VkFormat format) {
+        return format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+    }
+
+    // frame capture：slot第一次使用或者分辨率变大时重新创建buffer，这时slot不在使用中
+    // host cached的内存读取更快，没有时使用普通的host visible内存
+    void resize(Slot& slot, VkDeviceSize size) {
+        if (slot.buffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(m_device, slot.buffer, hostAllocator());
+            m_allocator->free(slot.allocation);
+        }
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &slot.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create frame capture buffer!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, slot.buffer, &memRequirements);
+        slot.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true,
+            MemoryCategory::staging, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, "frame capture readback");
+        vkBindBufferMemory(m_device, slot.buffer, slot.allocation.memory, slot.allocation.offset);
+        slot.capacity = size;
+    }
+
+    // frame capture：在job pool中执行，alpha写成255，present的image不一定写入了有意义的alpha
+    static bool encode(const Slot& slot) {
+        uint32_t width = slot.extent.width;
+        uint32_t height = slot.extent.height;
+        const uint8_t* pixels = static_cast<const uint8_t*>(slot.allocation.mapped);
+        bool swap = bgra(slot.format);
+        bool ppm = slot.path.size() >= 4 && slot.path.compare(slot.path.size() - 4, 4, ".ppm") == 0;
+        uint32_t channels = ppm ? 3 : 4;
+        std::vector<uint8_t> rgba(size_t(width) * height * channels);
+        for (size_t i = 0; i < size_t(width) * height; i++) {
+            const uint8_t* pixel = pixels + i * 4;
+            uint8_t* out = rgba.data() + i * channels;
+            out[0] = pixel[swap ? 2 : 0];
+            out[1] = pixel[1];
+            out[2] = pixel[swap ? 0 : 2];
+            if (!ppm) {
+                out[3] = 255;
+            }
+        }
+        if (ppm) {
+            std::ofstream file(slot.path, std::ios::binary);
+            file << "P6\n" << width << " " << height << "\n255\n";
+            file.write(reinterpret_cast<const char*>(rgba.data()), static_cast<std::streamsize>(rgba.size()));
+            return static_cast<bool>(file);
+        }
+        return stbi_write_png(slot.path.c_str(), static_cast<int>(width), static_cast<int>(height), 4, rgba.data(), static_cast<int>(width * 4)) != 0;
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    JobPool* m_jobPool = nullptr;
+    std::vector<std::unique_ptr<Slot>> m_slots;  // Slot有atomic，不能移动
+    std::deque<std::string> m_requests;
+    JobPool::Counter m_encodeCounter;
+    std::atomic<uint32_t> m_written{0};
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// frame pacing：之前drawFrame先阻塞在timeline上，再阻塞在vkAcquireNextImageKHR上，输入在很早之前就已经采样，画面上屏时已经过时
+// VK_KHR_present_id给每次present一个递增的id，VK_KHR_present_wait可以等待某个id真正显示出来，显示的时间点近似vblank
+// 每帧开始时等上一帧显示，用相邻两次显示的间隔估计刷新周期，然后睡到下一个vblank减去一帧的耗时再采样输入和录制
+// 一帧的耗时用采样到present返回的cpu时间加上PACING_MARGIN估计，margin覆盖gpu执行和合成器的时间
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static bool supported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDevicePresentWaitFeaturesKHR waitFeatures{};
+        waitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        VkPhysicalDevicePresentIdFeaturesKHR idFeatures{};
+        idFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        idFeatures.pNext = &waitFeatures;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &idFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return idFeatures.presentId && waitFeatures.presentWait;
+    }
+
+    void init(VkDevice device) {
+        m_device = device;
+        m_waitForPresent = (PFN_vkWaitForPresentKHR) vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+    }
+
+    bool initialized() const { return m_waitForPresent != nullptr; }
+
+    // frame pacing：在采样输入之前调用，等上一帧显示后睡到这一帧应该开始的时间
+    // 等待超时或者swap chain失效时不睡眠，下一帧重新开始估计
+    void pace(VkSwapchainKHR swapChain) {
+        if (m_presentedId != 0 && m_presentedId != m_waitedId) {
+            VkResult result = m_waitForPresent(m_device, swapChain, m_presentedId, PRESENT_WAIT_TIMEOUT_NS);
+            Clock::time_point now = Clock::now();
+            if (result == VK_SUCCESS) {
+                // 相邻id的显示间隔才是刷新周期的样本，掉帧时间隔是多个周期，不计入平均
+                if (m_waitedId != 0 && m_presentedId == m_waitedId + 1) {
+                    float interval = std::chrono::duration<float>(now - m_lastDisplay).count();
+                    if (m_refreshPeriod == 0.f) {
+                        m_refreshPeriod = interval;
+                    } else if (interval < m_refreshPeriod * 1.5f) {
+                        m_refreshPeriod = m_refreshPeriod * (1 - ALPHA) + interval * ALPHA;
+                    }
+                }
+                m_lastDisplay = now;
+                m_waitedId = m_presentedId;
+
+                auto wake = m_lastDisplay + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(m_refreshPeriod - m_frameCost - PACING_MARGIN));
+                if (m_refreshPeriod > 0.f && wake > now) {
+                    std::this_thread::sleep_until(wake);
+                }
+            } else {
+                m_waitedId = 0;  // 超时、VK_ERROR_OUT_OF_DATE_KHR等情况，重新开始测量
+            }
+        }
+        m_sampleTime = Clock::now();
+        m_paced = true;
+    }
+
+    // frame pacing：分配这次present的id，返回的结构链接到VkPresentInfoKHR的pNext
+    // multiple views：一次present多个swap chain时只有第一个（主窗口，pace等待的swap chain）有id，其它是0
+    const VkPresentIdKHR* nextPresentId(uint32_t swapchainCount = 1) {
+        m_pendingId = ++m_nextId;
+        m_presentIds.assign(swapchainCount, 0);
+        m_presentIds[0] = m_pendingId;
+        m_presentIdInfo = {};
+        m_presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        m_presentIdInfo.swapchainCount = swapchainCount;
+        m_presentIdInfo.pPresentIds = m_presentIds.data();
+        return &m_presentIdInfo;
+    }
+
+    // frame pacing：vkQueuePresentKHR返回之后调用，这一帧调用过pace时记录cpu耗时
+    void presented() {
+        m_presentedId = m_pendingId;
+        if (m_paced) {
+            float cost = std::chrono::duration<float>(Clock::now() - m_sampleTime).count();
+            m_frameCost = m_frameCost * (1 - ALPHA) + cost * ALPHA;
+            m_paced = false;
+        }
+    }
+
+    // frame pacing：swap chain重建后旧的id不再有效，id本身继续递增
+    void reset() {
+        m_presentedId = 0;
+        m_waitedId = 0;
+    }
+
+    // input latency：用0超时检查id是否已经显示，不阻塞
+    bool displayed(VkSwapchainKHR swapChain, uint64_t presentId) const {
+        return m_waitForPresent(m_device, swapChain, presentId, 0) == VK_SUCCESS;
+    }
+
+    uint64_t presentedId() const { return m_presentedId; }
+    // input latency：pace等到的id和显示的时间，等待失败时id是0
+    uint64_t waitedId() const { return m_waitedId; }
+    Clock::time_point lastDisplay() const { return m_lastDisplay; }
+
+    float refreshPeriod() const { return m_refreshPeriod; }
+    float frameCost() const { return m_frameCost; }
+
+private:
+    static constexpr uint64_t PRESENT_WAIT_TIMEOUT_NS = 100 * 1000 * 1000;
+    static constexpr float PACING_MARGIN = 0.002f;  // 秒
+    static constexpr float ALPHA = 1.f / 16;
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    PFN_vkWaitForPresentKHR m_waitForPresent = nullptr;
+    VkPresentIdKHR m_presentIdInfo{};
+    std::vector<uint64_t> m_presentIds;
+    uint64_t m_nextId = 0;
+    uint64_t m_pendingId = 0;
+    uint64_t m_presentedId = 0;  // 最近一次present的id
+    uint64_t m_waitedId = 0;  // 最近一次确认已经显示的id
+    Clock::time_point m_lastDisplay;
+    Clock::time_point m_sampleTime;
+    bool m_paced = false;
+    float m_refreshPeriod = 0.f;
+    float m_frameCost = 0.f;
+};
+
+// present policy：swap chain的present mode，运行时切换后重建swap chain
+// vsync是FIFO，所有设备都支持；adaptive vsync是FIFO_RELAXED，晚到的帧马上显示而不是再等一个vblank；immediate不等待vblank，用于benchmark
+enum class PresentPolicy {
+    mailbox,
+    vsync,
+    adaptiveVsync,
+    immediate,
+    count
+};
+
+inline const char* presentPolicyName(PresentPolicy policy) {
+    switch (policy) {
+        case PresentPolicy::mailbox: return "mailbox";
+        case PresentPolicy::vsync: return "vsync";
+        case PresentPolicy::adaptiveVsync: return "adaptive vsync";
+        case PresentPolicy::immediate: return "immediate";
+        default: return "unknown";
+    }
+}
+
+// present policy：首选的mode不支持时，immediate退到mailbox，其余都退到FIFO
+inline VkPresentModeKHR choosePresentMode(PresentPolicy policy, const std::vector<VkPresentModeKHR>& availablePresentModes) {
+    auto available = [&](VkPresentModeKHR mode) {
+        for (VkPresentModeKHR availableMode : availablePresentModes) {
+            if (availableMode == mode) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    switch (policy) {
+        case PresentPolicy::immediate:
+            if (available(VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+                return VK_PRESENT_MODE_IMMEDIATE_KHR;
+            }
+            [[fallthrough]];
+        case PresentPolicy::mailbox:
+            if (available(VK_PRESENT_MODE_MAILBOX_KHR)) {
+                return VK_PRESENT_MODE_MAILBOX_KHR;
+            }
+            break;
+        case PresentPolicy::adaptiveVsync:
+            if (available(VK_PRESENT_MODE_FIFO_RELAXED_KHR)) {
+                return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            }
+            break;
+        default:
+            break;
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// frame limiter：mailbox和immediate不限制帧率，限制到目标帧率可以省电
+// 睡眠的精度一般只有1ms左右，先睡到deadline之前SPIN_THRESHOLD，剩下的时间自旋
+// deadline按周期递增，落后超过一个周期时从当前时间重新开始，不会为了追赶连续出几帧
+class FrameLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // frame limiter：targetFps为0时不限制
+    void setTarget(float targetFps) {
+        m_targetFps = targetFps;
+        m_deadline = Clock::time_point();
+    }
+
+    float target() const { return m_targetFps; }
+
+    // thermal governor：和用户选择的上限分开保存，L键切换时不会丢失，0表示不限制
+    void setCeiling(float ceilingFps) {
+        m_ceilingFps = ceilingFps;
+        m_deadline = Clock::time_point();
+    }
+
+    // frame limiter：生效的上限是两者中较小的非0值
+    float effectiveTarget() const {
+        if (m_ceilingFps <= 0.f || (m_targetFps > 0.f && m_targetFps < m_ceilingFps)) {
+            return m_targetFps;
+        }
+        return m_ceilingFps;
+    }
+
+    void wait() {
+        float targetFps = effectiveTarget();
+        if (targetFps <= 0.f) {
+            return;
+        }
+        auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+        Clock::time_point now = Clock::now();
+        if (m_deadline == Clock::time_point() || now > m_deadline + period) {
+            m_deadline = now;
+        }
+        if (m_deadline - now > SPIN_THRESHOLD) {
+            std::this_thread::sleep_until(m_deadline - SPIN_THRESHOLD);
+        }
+        while (Clock::now() < m_deadline) {
+            std::this_thread::yield();
+        }
+        m_deadline += period;
+    }
+
+private:
+    static constexpr Clock::duration SPIN_THRESHOLD = std::chrono::microseconds(1500);
+
+    float m_targetFps = 0.f;
+    float m_ceilingFps = 0.f;
+    Clock::time_point m_deadline;
+};
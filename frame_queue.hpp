@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// frame queue：模拟、主线程和渲染线程之间交换数据的无锁结构，热循环中任何一边都不会因为另一边持有锁而阻塞
+// SpscRing：有界的单生产者单消费者队列，用于不能丢失的事件（按键、点击），满了push返回false
+// TripleBuffer：只关心最新值的快照（模拟状态、窗口标题），三个缓冲轮换，写的一边永远有自己的缓冲，读的一边取最新发布的那个
+template<typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // frame queue：只在生产者线程调用
+    bool push(T value) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        m_items[head & (Capacity - 1)] = std::move(value);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // frame queue：只在消费者线程调用
+    bool pop(T& out) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = std::move(m_items[tail & (Capacity - 1)]);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T m_items[Capacity]{};
+    alignas(64) std::atomic<size_t> m_head{0};  // 生产者写，两个计数器分开cache line避免false sharing
+    alignas(64) std::atomic<size_t> m_tail{0};  // 消费者写
+};
+
+template<typename T>
+class TripleBuffer {
+public:
+    // frame queue：写入back()之后publish，只在生产者线程调用；publish之后back()是另一个缓冲，内容是旧的
+    T& back() { return m_buffers[m_back]; }
+
+    void publish() {
+        uint32_t previous = m_middle.exchange(m_back | FRESH, std::memory_order_acq_rel);
+        m_back = previous & INDEX_MASK;
+    }
+
+    // frame queue：有新发布的值时换到front()并返回true，只在消费者线程调用
+    bool update() {
+        if ((m_middle.load(std::memory_order_relaxed) & FRESH) == 0) {
+            return false;
+        }
+        uint32_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T& front() const { return m_buffers[m_front]; }
+
+private:
+    static constexpr uint32_t INDEX_MASK = 3;
+    static constexpr uint32_t FRESH = 4;  // middle是发布之后还没有被取走的值
+
+    T m_buffers[3]{};
+    alignas(64) uint32_t m_back = 0;  // 生产者独占
+    alignas(64) std::atomic<uint32_t> m_middle{1};
+    alignas(64) uint32_t m_front = 2;  // 消费者独占
+};
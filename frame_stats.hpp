@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// frame stats：之前calculateFPS只有指数滑动平均，偶尔的卡顿被平均掉，看不出来
+// 最近WINDOW帧的帧时间放在ring buffer中，需要统计时复制一份排序，得到百分位数、1% low和卡顿次数
+// 统计只在窗口标题更新或者导出时计算，每帧只写入ring buffer
+struct FrameTimeSummary {
+    uint32_t frameCount = 0;  // 窗口中的帧数
+    float averageFps = 0.f;
+    float p50Ms = 0.f;
+    float p95Ms = 0.f;
+    float p99Ms = 0.f;
+    float maxMs = 0.f;
+    float onePercentLowFps = 0.f;  // 最慢1%帧的平均帧率
+    uint32_t hitches = 0;  // 窗口中的卡顿帧数
+    uint64_t totalHitches = 0;  // 启动以来的卡顿帧数
+};
+
+class FrameTimeStats {
+public:
+    static constexpr uint32_t WINDOW = 1024;
+    // frame stats：帧时间超过滑动平均HITCH_FACTOR倍的帧算作卡顿
+    static constexpr float HITCH_FACTOR = 2.0f;
+
+    void push(float seconds) {
+        bool hitch = m_average > 0.f && seconds > m_average * HITCH_FACTOR;
+        m_average = m_average == 0.f ? seconds : m_average * (1 - ALPHA) + seconds * ALPHA;
+        if (hitch) {
+            m_totalHitches++;
+        }
+
+        m_samples[m_next] = {seconds, hitch};
+        m_next = (m_next + 1) % WINDOW;
+        m_count = std::min(m_count + 1, WINDOW);
+        m_frameIndex++;
+    }
+
+    FrameTimeSummary summary() const {
+        FrameTimeSummary summary;
+        summary.totalHitches = m_totalHitches;
+        summary.frameCount = m_count;
+        if (m_count == 0) {
+            return summary;
+        }
+
+        std::vector<float>& sorted = m_sorted;  // heap tracker：排序用的副本复用上一次的容量，窗口标题更新时不分配
+        sorted.clear();
+        float total = 0.f;
+        for (uint32_t i = 0; i < m_count; i++) {
+            sorted.push_back(m_samples[i].seconds);
+            total += m_samples[i].seconds;
+            summary.hitches += m_samples[i].hitch ? 1 : 0;
+        }
+        std::sort(sorted.begin(), sorted.end());
+
+        auto percentile = [&sorted](float p) {
+            size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5f);
+            return sorted[index] * 1000.f;
+        };
+        summary.averageFps = total > 0.f ? m_count / total : 0.f;
+        summary.p50Ms = percentile(0.50f);
+        summary.p95Ms = percentile(0.95f);
+        summary.p99Ms = percentile(0.99f);
+        summary.maxMs = sorted.back() * 1000.f;
+
+        size_t lowCount = std::max<size_t>(1, sorted.size() / 100);
+        float lowTotal = 0.f;
+        for (size_t i = sorted.size() - lowCount; i < sorted.size(); i++) {
+            lowTotal += sorted[i];
+        }
+        summary.onePercentLowFps = lowTotal > 0.f ? lowCount / lowTotal : 0.f;
+        return summary;
+    }
+
+    // frame stats：按时间顺序导出窗口中的帧，frame是启动以来的帧序号
+    bool writeCsv(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        file << "frame,ms,hitch\n";
+        uint32_t oldest = (m_next + WINDOW - m_count) % WINDOW;
+        for (uint32_t i = 0; i < m_count; i++) {
+            const Sample& sample = m_samples[(oldest + i) % WINDOW];
+            file << (m_frameIndex - m_count + i) << "," << sample.seconds * 1000.f << "," << (sample.hitch ? 1 : 0) << "\n";
+        }
+        return static_cast<bool>(file);
+    }
+
+private:
+    static constexpr float ALPHA = 1.f / 100;
+
+    struct Sample {
+        float seconds = 0.f;
+        bool hitch = false;
+    };
+
+    Sample m_samples[WINDOW];
+    uint32_t m_next = 0;
+    uint32_t m_count = 0;
+    uint64_t m_frameIndex = 0;
+    float m_average = 0.f;
+    uint64_t m_totalHitches = 0;
+    mutable std::vector<float> m_sorted;
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// free ranges：按起始位置排序的空闲区间，first fit分配，释放时合并相邻区间
+// geometry buffer的顶点和索引区域、meshlet buffer的各个区域都按元素index分配，模型卸载时归还
+class FreeRanges {
+public:
+    void reset(uint32_t count) {
+        m_ranges.clear();
+        if (count > 0) {
+            m_ranges.push_back({0, count});
+        }
+    }
+
+    bool take(uint32_t count, uint32_t& outFirst) {
+        for (auto it = m_ranges.begin(); it != m_ranges.end(); ++it) {
+            if (it->count >= count) {
+                outFirst = it->first;
+                it->first += count;
+                it->count -= count;
+                if (it->count == 0) {
+                    m_ranges.erase(it);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void give(uint32_t first, uint32_t count) {
+        if (count == 0) {
+            return;
+        }
+
+        auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), first, [](const Range& range, uint32_t value) { return range.first < value; });
+        it = m_ranges.insert(it, {first, count});
+
+        if (it + 1 != m_ranges.end() && it->first + it->count == (it + 1)->first) {
+            it->count += (it + 1)->count;
+            m_ranges.erase(it + 1);
+        }
+        if (it != m_ranges.begin() && (it - 1)->first + (it - 1)->count == it->first) {
+            (it - 1)->count += it->count;
+            m_ranges.erase(it);
+        }
+    }
+
+    // free ranges：所有空闲区间的元素总数
+    uint64_t freeCount() const {
+        uint64_t total = 0;
+        for (const Range& range : m_ranges) {
+            total += range.count;
+        }
+        return total;
+    }
+
+private:
+    struct Range {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    std::vector<Range> m_ranges;
+};
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "cpu_profiler.hpp"
+#include "job_pool.hpp"
+
+// frustum culling：轴对齐包围盒，min大于max表示空
+struct Aabb {
+    glm::vec3 min{0.0f};
+    glm::vec3 max{0.0f};
+};
+
+// contribution culling：包围球半径r、中心到相机的距离d时，投影到屏幕上的直径约为r / d * 视口高度 / tan(fovy / 2)个像素
+// 直径小于minPixels的物体剔除，等价于r < ratio * d，ratio为0时不剔除
+struct ContributionTest {
+    glm::vec3 cameraPosition{0.0f};
+    float ratio = 0.0f;
+
+    static ContributionTest make(const glm::vec3& cameraPosition, float fovy, uint32_t viewportHeight, float minPixels) {
+        return {cameraPosition, viewportHeight > 0 ? minPixels * std::tan(fovy * 0.5f) / float(viewportHeight) : 0.0f};
+    }
+
+    bool contributes(const glm::vec3& center, const glm::vec3& extent) const {
+        glm::vec3 offset = center - cameraPosition;
+        return glm::dot(extent, extent) >= ratio * ratio * glm::dot(offset, offset);
+    }
+};
+
+// frustum culling：变换后的包围盒，中心做完整的变换，半长按矩阵元素的绝对值累加（Arvo的方法），不需要变换8个角
+inline Aabb transformAabb(const Aabb& box, const glm::mat4& transform) {
+    glm::vec3 center = (box.min + box.max) * 0.5f;
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+    glm::vec3 newCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+    glm::vec3 newExtent(0.0f);
+    for (int column = 0; column < 3; column++) {
+        newExtent += glm::abs(glm::vec3(transform[column])) * extent[column];
+    }
+    return {newCenter - newExtent, newCenter + newExtent};
+}
+
+// frustum culling：每帧把物体的世界空间包围盒按SoA排成BATCH_SIZE个一组，对6个平面一次测试一组
+// AVX一条指令处理8个，SSE和NEON分两半各处理4个，都不支持时逐个测试；物体数量达到parallelMinObjects时按组分段在job pool中测试
+// 输出的可见列表是按原来顺序排列的物体index
+class FrustumCuller {
+public:
+    static constexpr size_t BATCH_SIZE = 8;
+
+    // frustum culling：从viewProj的行提取平面（Gribb-Hartmann），vulkan的深度范围是[0, 1]，所以near平面只是第三行
+    // 平面的法线指向视锥内部，n·p + w >= 0表示在平面内侧
+    static std::array<glm::vec4, 6> extractPlanes(const glm::mat4& viewProj) {
+        glm::vec4 row0(viewProj[0][0], viewProj[1][0], viewProj[2][0], viewProj[3][0]);
+        glm::vec4 row1(viewProj[0][1], viewProj[1][1], viewProj[2][1], viewProj[3][1]);
+        glm::vec4 row2(viewProj[0][2], viewProj[1][2], viewProj[2][2], viewProj[3][2]);
+        glm::vec4 row3(viewProj[0][3], viewProj[1][3], viewProj[2][3], viewProj[3][3]);
+        std::array<glm::vec4, 6> planes = {row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2};
+        for (glm::vec4& plane : planes) {
+            plane /= std::max(glm::length(glm::vec3(plane)), 1e-12f);
+        }
+        return planes;
+    }
+
+    // frustum culling：返回的列表在下次调用之前有效；pool为nullptr时只在调用者线程测试
+    // contribution culling：在同一次遍历中测试，ratio为0时跳过
+    const std::vector<uint32_t>& cull(const glm::mat4& viewProj, const std::vector<Aabb>& boxes, JobPool* pool, size_t parallelMinObjects,
+        const ContributionTest& contribution = {}) {
+        CPU_PROFILE_SCOPE("frustum culling");
+        std::array<glm::vec4, 6> planes = extractPlanes(viewProj);
+        size_t batchCount = (boxes.size() + BATCH_SIZE - 1) / BATCH_SIZE;
+        m_batches.resize(batchCount);
+        m_masks.resize(batchCount);
+
+        auto cullRange = [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                fillBatch(m_batches[b], boxes, b * BATCH_SIZE);
+                m_masks[b] = testBatch(m_batches[b], planes);
+                if (contribution.ratio > 0.0f) {
+                    m_masks[b] &= testContribution(m_batches[b], contribution);
+                }
+            }
+        };
+        if (pool != nullptr && boxes.size() >= parallelMinObjects && pool->threadCount() > 1) {
+            size_t segmentCount = std::min<size_t>(pool->threadCount() + 1, batchCount);  // 调用者等待时也执行一段
+            size_t perSegment = (batchCount + segmentCount - 1) / segmentCount;
+            pool->parallelFor(segmentCount, [&](size_t segment) {
+                cullRange(segment * perSegment, std::min(batchCount, (segment + 1) * perSegment));
+            });
+        } else {
+            cullRange(0, batchCount);
+        }
+
+        // frustum culling：最后一组多出来的lane不输出
+        m_visible.clear();
+        for (size_t b = 0; b < batchCount; b++) {
+            uint32_t mask = m_masks[b];
+            size_t valid = std::min(BATCH_SIZE, boxes.size() - b * BATCH_SIZE);
+            mask &= valid == BATCH_SIZE ? 0xFFFFFFFFu : (1u << valid) - 1;
+            while (mask != 0) {
+                uint32_t lane = countTrailingZeros(mask);
+                m_visible.push_back(static_cast<uint32_t>(b * BATCH_SIZE + lane));
+                mask &= mask - 1;
+            }
+        }
+        return m_visible;
+    }
+
+private:
+    struct alignas(32) Batch {
+        float centerX[BATCH_SIZE];
+        float centerY[BATCH_SIZE];
+        float centerZ[BATCH_SIZE];
+        float extentX[BATCH_SIZE];
+        float extentY[BATCH_SIZE];
+        float extentZ[BATCH_SIZE];
+    };
+
+    static uint32_t countTrailingZeros(uint32_t value) {
+        uint32_t count = 0;
+        while ((value & 1u) == 0) {
+            value >>= 1;
+            count++;
+        }
+        return count;
+    }
+
+    // frustum culling：最后一组不足BATCH_SIZE个时，多出来的lane填一个空的包围盒
+    static void fillBatch(Batch& batch, const std::vector<Aabb>& boxes, size_t first) {
+        for (size_t lane = 0; lane < BATCH_SIZE; lane++) {
+            size_t index = first + lane;
+            glm::vec3 center(0.0f);
+            glm::vec3 extent(-1.0f);
+            if (index < boxes.size()) {
+                center = (boxes[index].min + boxes[index].max) * 0.5f;
+                extent = (boxes[index].max - boxes[index].min) * 0.5f;
+            }
+            batch.centerX[lane] = center.x;
+            batch.centerY[lane] = center.y;
+            batch.centerZ[lane] = center.z;
+            batch.extentX[lane] = extent.x;
+            batch.extentY[lane] = extent.y;
+            batch.extentZ[lane] = extent.z;
+        }
+    }
+
+    // frustum culling：包围盒在平面内侧的最远点是中心加上半长乘法线分量的绝对值，这个点在外侧时整个包围盒都在外侧
+    // 返回的第i位为1表示第i个lane可见
+    static uint32_t testBatch(const Batch& batch, const std::array<glm::vec4, 6>& planes) {
+#if defined(__AVX__)
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        __m256 cx = _mm256_load_ps(batch.centerX), cy = _mm256_load_ps(batch.centerY), cz = _mm256_load_ps(batch.centerZ);
+        __m256 ex = _mm256_load_ps(batch.extentX), ey = _mm256_load_ps(batch.extentY), ez = _mm256_load_ps(batch.extentZ);
+        for (const glm::vec4& plane : planes) {
+            __m256 distance = _mm256_set1_ps(plane.w);
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.x), cx));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.y), cy));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.z), cz));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), ex));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.y)), ey));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.z)), ez));
+            visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        return static_cast<uint32_t>(_mm256_movemask_ps(visible));
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+        uint32_t mask = 0;
+        for (size_t half = 0; half < BATCH_SIZE; half += 4) {
+            __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            __m128 cx = _mm_load_ps(batch.centerX + half), cy = _mm_load_ps(batch.centerY + half), cz = _mm_load_ps(batch.centerZ + half);
+            __m128 ex = _mm_load_ps(batch.extentX + half), ey = _mm_load_ps(batch.extentY + half), ez = _mm_load_ps(batch.extentZ + half);
+            for (const glm::vec4& plane : planes) {
+                __m128 distance = _mm_set1_ps(plane.w);
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.x), cx));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), cy));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), cz));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+                visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+            }
+            mask |= static_cast<uint32_t>(_mm_movemask_ps(visible)) << half;
+        }
+        return mask;
+#elif defined(__ARM_NEON)
+        uint32_t mask = 0;
+        for (size_t half = 0; half < BATCH_SIZE; half += 4) {
+            uint32x4_t visible = vdupq_n_u32(0xFFFFFFFFu);
+            float32x4_t cx = vld1q_f32(batch.centerX + half), cy = vld1q_f32(batch.centerY + half), cz = vld1q_f32(batch.centerZ + half);
+            float32x4_t ex = vld1q_f32(batch.extentX + half), ey = vld1q_f32(batch.extentY + half), ez = vld1q_f32(batch.extentZ + half);
+            for (const glm::vec4& plane : planes) {
+                float32x4_t distance = vdupq_n_f32(plane.w);
+                distance = vmlaq_n_f32(distance, cx, plane.x);
+                distance = vmlaq_n_f32(distance, cy, plane.y);
+                distance = vmlaq_n_f32(distance, cz, plane.z);
+                distance = vmlaq_n_f32(distance, ex, std::abs(plane.x));
+                distance = vmlaq_n_f32(distance, ey, std::abs(plane.y));
+                distance = vmlaq_n_f32(distance, ez, std::abs(plane.z));
+                visible = vandq_u32(visible, vcgeq_f32(distance, vdupq_n_f32(0.0f)));
+            }
+            const uint32_t laneBits[4] = {1u, 2u, 4u, 8u};
+            uint32_t bits = vaddvq_u32(vandq_u32(visible, vld1q_u32(laneBits)));
+            mask |= bits << half;
+        }
+        return mask;
+#else
+        uint32_t mask = 0;
+        for (size_t lane = 0; lane < BATCH_SIZE; lane++) {
+            bool visible = true;
+            for (const glm::vec4& plane : planes) {
+                float distance = plane.w + plane.x * batch.centerX[lane] + plane.y * batch.centerY[lane] + plane.z * batch.centerZ[lane] +
+                    std::abs(plane.x) * batch.extentX[lane] + std::abs(plane.y) * batch.extentY[lane] + std::abs(plane.z) * batch.extentZ[lane];
+                visible = visible && distance >= 0.0f;
+            }
+            mask |= visible ? 1u << lane : 0u;
+        }
+        return mask;
+#endif
+    }
+
+    // contribution culling：只有乘加和比较，编译器可以自动向量化；半长为-1的空lane结果不影响，cull会丢掉它
+    static uint32_t testContribution(const Batch& batch, const ContributionTest& contribution) {
+        float ratioSquared = contribution.ratio * contribution.ratio;
+        uint32_t mask = 0;
+        for (size_t lane = 0; lane < BATCH_SIZE; lane++) {
+            float dx = batch.centerX[lane] - contribution.cameraPosition.x;
+            float dy = batch.centerY[lane] - contribution.cameraPosition.y;
+            float dz = batch.centerZ[lane] - contribution.cameraPosition.z;
+            float radiusSquared = batch.extentX[lane] * batch.extentX[lane] + batch.extentY[lane] * batch.extentY[lane] + batch.extentZ[lane] * batch.extentZ[lane];
+            mask |= radiusSquared >= ratioSquared * (dx * dx + dy * dy + dz * dz) ? 1u << lane : 0u;
+        }
+        return mask;
+    }
+
+    std::vector<Batch> m_batches;
+    std::vector<uint32_t> m_masks;
+    std::vector<uint32_t> m_visible;
+};
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "device_dispatch.hpp"
+#include "free_ranges.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+
+// geometry buffer：之前每个mesh都有自己的vertex buffer和index buffer，绘制不同mesh之间需要重新绑定
+// 现在所有mesh共享一个device local的大buffer，前半部分存放顶点，后半部分存放索引
+// 每个mesh只记录vertexOffset和firstIndex，每帧绑定一次后用多个vkCmdDrawIndexed（或者一次indirect draw）绘制全部mesh
+// split vertex streams：positionSize不为0时顶点区域再分成位置和其它属性两段，两段都按顶点index寻址，vertexOffset对两个binding同样有效
+// 顶点格式的前positionSize字节是位置，上传时用splitVertices把交错的顶点拆开写入两段
+// sparse binding：传入sparseQueue时buffer按最大容量创建但不绑定内存，allocate分到的范围覆盖的页在这时才提交内存，free之后没有mesh使用的页归还
+// 容量只是地址空间，不需要按最坏情况预留显存；sparse内存cpu不可见，上传全部经过staging ring
+
+// geometry buffer：mesh在共享buffer中的位置，单位是顶点和索引而不是字节，可以直接传给vkCmdDrawIndexed
+// 16位索引：firstIndex以indexType的大小为单位，索引区域按这个类型绑定时直接使用
+struct MeshRange {
+    int32_t vertexOffset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+};
+
+class GeometryBuffer {
+public:
+    // vertexStride：所有mesh使用同一种顶点格式，这样vertexOffset可以按顶点计数
+    // positionSize：为0时顶点交错存放在一段中，否则位置和其它属性分成两段
+    // extraUsage：比如mesh shader把顶点区域作为storage buffer读取
+    // sparseQueue：支持VK_QUEUE_SPARSE_BINDING_BIT的队列，设备需要启用sparseBinding和sparseResidencyBuffer；VK_NULL_HANDLE时一次分配全部内存
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, uint32_t vertexStride, uint32_t positionSize, uint32_t maxVertices, uint32_t maxIndices,
+        const std::vector<uint32_t>& queueFamilies, VkBufferUsageFlags extraUsage = 0, VkQueue sparseQueue = VK_NULL_HANDLE) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_sparseQueue = sparseQueue;
+        m_vertexStride = vertexStride;
+        m_positionSize = positionSize;
+        m_attributeRegionOffset = splitStreams() ? attributeRegionOffset(positionSize, maxVertices) : 0;
+        m_indexRegionOffset = splitStreams() ? m_attributeRegionOffset + static_cast<VkDeviceSize>(attributeStride()) * maxVertices
+                                             : static_cast<VkDeviceSize>(vertexStride) * maxVertices;
+        m_indexRegionOffset = alignUp(m_indexRegionOffset, sizeof(uint32_t));  // 索引偏移需要4字节对齐
+
+        m_freeVertices.reset(maxVertices);
+        m_freeIndices.reset(maxIndices);
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = m_indexRegionOffset + static_cast<VkDeviceSize>(sizeof(uint32_t)) * maxIndices;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | extraUsage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (sparse()) {
+            bufferInfo.flags = VK_BUFFER_CREATE_SPARSE_BINDING_BIT | VK_BUFFER_CREATE_SPARSE_RESIDENCY_BIT;  // 没有绑定内存的页不会被访问
+        }
+
+        // 多个queue family都会访问时使用CONCURRENT，传输队列上传新mesh时图形队列可能正在读取其它mesh，整块buffer的所有权无法来回转移
+        if (queueFamilies.size() > 1) {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+            bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+        }
+
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &m_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create geometry buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, m_buffer, &memRequirements);
+        if (sparse()) {
+            // sparse binding：alignment是sparse block的大小，每一页单独从allocator分配，size和alignment都是一页
+            m_pageRequirements = memRequirements;
+            m_pageRequirements.size = memRequirements.alignment;
+            m_pages.assign(static_cast<size_t>((memRequirements.size + memRequirements.alignment - 1) / memRequirements.alignment), PageState{});
+
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+            if (vkCreateFence(m_device, &fenceInfo, hostAllocator(), &m_bindFence) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create geometry buffer bind fence!");
+            }
+            return;
+        }
+        // zero staging：优先使用host visible的device local内存，这样mesh数据可以直接写入
+        m_allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, MemoryCategory::geometry,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "geometry buffer");
+        vkBindBufferMemory(m_device, m_buffer, m_allocation.memory, m_allocation.offset);
+    }
+
+    void cleanup() {
+        vkDestroyBuffer(m_device, m_buffer, hostAllocator());
+        if (!sparse()) {
+            m_allocator->free(m_allocation);
+            return;
+        }
+        for (PageState& page : m_pages) {
+            if (page.references > 0) {
+                m_allocator->free(page.allocation);
+            }
+        }
+        m_pages.clear();
+        vkDestroyFence(m_device, m_bindFence, hostAllocator());
+    }
+
+    // geometry buffer：为mesh分配顶点和索引空间，空间不足时抛出异常
+    // 16位索引：索引区域按4字节的槽分配，两个16位索引占一个槽，所有mesh的索引都从4字节对齐的位置开始
+    MeshRange allocate(uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType = VK_INDEX_TYPE_UINT32) {
+        uint32_t vertexOffset, firstSlot;
+        uint32_t slotCount = indexSlots(indexCount, indexType);
+        if (!m_freeVertices.take(vertexCount, vertexOffset)) {
+            throw std::runtime_error("geometry buffer out of vertex space!");
+        }
+        if (!m_freeIndices.take(slotCount, firstSlot)) {
+            m_freeVertices.give(vertexOffset, vertexCount);
+            throw std::runtime_error("geometry buffer out of index space!");
+        }
+
+        MeshRange mesh{};
+        mesh.vertexOffset = static_cast<int32_t>(vertexOffset);
+        mesh.vertexCount = vertexCount;
+        mesh.firstIndex = firstSlot * (sizeof(uint32_t) / indexSize(indexType));
+        mesh.indexCount = indexCount;
+        mesh.indexType = indexType;
+        updatePages(mesh, true);
+        return mesh;
+    }
+
+    // skinning：只分配顶点空间，用作蒙皮结果的输出，索引仍然使用绑定姿势的范围；free对indexCount为0的范围同样有效
+    MeshRange allocateVertices(uint32_t vertexCount) {
+        uint32_t vertexOffset;
+        if (!m_freeVertices.take(vertexCount, vertexOffset)) {
+            throw std::runtime_error("geometry buffer out of vertex space!");
+        }
+        MeshRange mesh{};
+        mesh.vertexOffset = static_cast<int32_t>(vertexOffset);
+        mesh.vertexCount = vertexCount;
+        updatePages(mesh, true);
+        return mesh;
+    }
+
+    // geometry buffer：释放mesh空间，调用者需要保证gpu已经不再使用该mesh
+    void free(const MeshRange& mesh) {
+        updatePages(mesh, false);
+        m_freeVertices.give(static_cast<uint32_t>(mesh.vertexOffset), mesh.vertexCount);
+        m_freeIndices.give(mesh.firstIndex / (sizeof(uint32_t) / indexSize(mesh.indexType)), indexSlots(mesh.indexCount, mesh.indexType));
+    }
+
+    // world streaming：空闲的顶点和索引空间的字节数，空闲区间不一定连续
+    VkDeviceSize freeBytes() const {
+        return static_cast<VkDeviceSize>(m_freeVertices.freeCount()) * m_vertexStride + static_cast<VkDeviceSize>(m_freeIndices.freeCount()) * sizeof(uint32_t);
+    }
+
+    // geometry buffer：顶点绑定在offset 0，索引绑定在索引区域开头，之后所有mesh都不需要重新绑定
+    // 16位索引：索引类型改变时调用bindIndices重新绑定，按索引类型排序绘制可以减少切换
+    // split vertex streams：位置是binding 0，其它属性是binding 1；只读取位置的pipeline没有binding 1，多绑定的buffer不会被读取
+    void bind(VkCommandBuffer commandBuffer, VkIndexType indexType = VK_INDEX_TYPE_UINT32) const {
+        VkBuffer buffers[2] = {m_buffer, m_buffer};
+        VkDeviceSize offsets[2] = {0, m_attributeRegionOffset};
+        DeviceDispatch::cmdBindVertexBuffers(commandBuffer, 0, splitStreams() ? 2 : 1, buffers, offsets);
+        bindIndices(commandBuffer, indexType);
+    }
+
+    void bindIndices(VkCommandBuffer commandBuffer, VkIndexType indexType) const {
+        DeviceDispatch::cmdBindIndexBuffer(commandBuffer, m_buffer, m_indexRegionOffset, indexType);
+    }
+
+    static VkDeviceSize indexSize(VkIndexType indexType) { return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+    VkBuffer buffer() const { return m_buffer; }
+    bool sparse() const { return m_sparseQueue != VK_NULL_HANDLE; }
+    // sparse binding：当前提交了内存的字节数，不是sparse时是整个buffer
+    VkDeviceSize committedBytes() const { return sparse() ? m_committedPages * m_pageRequirements.alignment : m_allocation.size; }
+    VkDeviceSize vertexRegionSize() const { return m_indexRegionOffset; }
+
+    // zero staging：buffer是否可以由cpu直接写入，为false时需要通过staging ring拷贝
+    bool hostVisible() const { return m_allocation.mapped != nullptr; }
+    void* mapped() const { return m_allocation.mapped; }
+
+    // geometry buffer：mesh数据在buffer中的字节偏移，用于拷贝命令
+    // split vertex streams：vertexByteOffset是位置（交错时是整个顶点）所在的位置，其它属性在attributeByteOffset
+    uint32_t vertexStride() const { return m_vertexStride; }
+    bool splitStreams() const { return m_positionSize != 0; }
+    uint32_t positionStride() const { return splitStreams() ? m_positionSize : m_vertexStride; }
+    uint32_t attributeStride() const { return splitStreams() ? m_vertexStride - m_positionSize : 0; }
+    VkDeviceSize attributeRegionOffset() const { return m_attributeRegionOffset; }
+    // split vertex streams：属性区域的位置只由init的参数决定，pipeline可以在buffer创建之前用它设置specialization
+    static VkDeviceSize attributeRegionOffset(uint32_t positionSize, uint32_t maxVertices) {
+        return alignUp(static_cast<VkDeviceSize>(positionSize) * maxVertices, REGION_ALIGNMENT);
+    }
+    VkDeviceSize vertexByteOffset(const MeshRange& mesh) const { return static_cast<VkDeviceSize>(mesh.vertexOffset) * positionStride(); }
+    VkDeviceSize vertexByteSize(const MeshRange& mesh) const { return static_cast<VkDeviceSize>(mesh.vertexCount) * positionStride(); }
+    VkDeviceSize attributeByteOffset(const MeshRange& mesh) const {
+        return m_attributeRegionOffset + static_cast<VkDeviceSize>(mesh.vertexOffset) * attributeStride();
+    }
+    VkDeviceSize attributeByteSize(const MeshRange& mesh) const { return static_cast<VkDeviceSize>(mesh.vertexCount) * attributeStride(); }
+
+    // split vertex streams：把交错的顶点拆成位置和其它属性两个连续的数组
+    void splitVertices(const void* vertices, uint32_t vertexCount, void* positions, void* attributes) const {
+        const char* source = static_cast<const char*>(vertices);
+        char* positionTarget = static_cast<char*>(positions);
+        char* attributeTarget = static_cast<char*>(attributes);
+        uint32_t attributeSize = attributeStride();
+        for (uint32_t i = 0; i < vertexCount; i++) {
+            memcpy(positionTarget + static_cast<size_t>(i) * m_positionSize, source, m_positionSize);
+            memcpy(attributeTarget + static_cast<size_t>(i) * attributeSize, source + m_positionSize, attributeSize);
+            source += m_vertexStride;
+        }
+    }
+    VkDeviceSize indexByteOffset(const MeshRange& mesh) const { return m_indexRegionOffset + static_cast<VkDeviceSize>(mesh.firstIndex) * indexSize(mesh.indexType); }
+    VkDeviceSize indexByteSize(const MeshRange& mesh) const { return static_cast<VkDeviceSize>(mesh.indexCount) * indexSize(mesh.indexType); }
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    Allocation m_allocation;
+    uint32_t m_vertexStride = 0;
+    uint32_t m_positionSize = 0;
+    VkDeviceSize m_attributeRegionOffset = 0;
+    VkDeviceSize m_indexRegionOffset = 0;
+
+    // sparse binding：每一页被多少个mesh范围覆盖，相邻的小mesh共用一页，计数归零时才解除绑定
+    struct PageState {
+        uint32_t references = 0;
+        Allocation allocation;
+    };
+    VkQueue m_sparseQueue = VK_NULL_HANDLE;
+    VkFence m_bindFence = VK_NULL_HANDLE;
+    VkMemoryRequirements m_pageRequirements{};
+    std::vector<PageState> m_pages;
+    VkDeviceSize m_committedPages = 0;
+
+    // sparse binding：mesh的位置、属性和索引三段字节范围覆盖的页加减引用，变化的页合并成一次vkQueueBindSparse
+    // 等待fence之后才返回：调用者随后录制的拷贝或compute写入都在绑定完成之后提交，只有需要新页的分配会等待
+    // 索引按4字节的槽计算，16位索引补齐的半个槽也在范围内
+    void updatePages(const MeshRange& mesh, bool commit) {
+        if (!sparse()) {
+            return;
+        }
+        std::vector<VkSparseMemoryBind> binds;
+        std::vector<Allocation> released;
+        auto update = [&](VkDeviceSize offset, VkDeviceSize size) {
+            if (size == 0) {
+                return;
+            }
+            VkDeviceSize pageSize = m_pageRequirements.alignment;
+            for (VkDeviceSize page = offset / pageSize; page <= (offset + size - 1) / pageSize; page++) {
+                PageState& state = m_pages[static_cast<size_t>(page)];
+                VkSparseMemoryBind bind{};
+                bind.resourceOffset = page * pageSize;
+                bind.size = std::min(pageSize, m_pages.size() * pageSize - bind.resourceOffset);
+                if (commit && state.references++ == 0) {
+                    state.allocation = m_allocator->allocate(m_pageRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, MemoryCategory::geometry, 0, "geometry buffer page");
+                    bind.memory = state.allocation.memory;
+                    bind.memoryOffset = state.allocation.offset;
+                    binds.push_back(bind);
+                    m_committedPages++;
+                } else if (!commit && --state.references == 0) {
+                    binds.push_back(bind);  // memory为VK_NULL_HANDLE：解除绑定
+                    released.push_back(state.allocation);
+                    state.allocation = Allocation{};
+                    m_committedPages--;
+                }
+            }
+        };
+        update(vertexByteOffset(mesh), vertexByteSize(mesh));
+        update(attributeByteOffset(mesh), attributeByteSize(mesh));
+        update(m_indexRegionOffset + static_cast<VkDeviceSize>(mesh.firstIndex) * indexSize(mesh.indexType),
+            static_cast<VkDeviceSize>(indexSlots(mesh.indexCount, mesh.indexType)) * sizeof(uint32_t));
+        if (binds.empty()) {
+            return;
+        }
+
+        VkSparseBufferMemoryBindInfo bufferBind{};
+        bufferBind.buffer = m_buffer;
+        bufferBind.bindCount = static_cast<uint32_t>(binds.size());
+        bufferBind.pBinds = binds.data();
+        VkBindSparseInfo bindInfo{};
+        bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+        bindInfo.bufferBindCount = 1;
+        bindInfo.pBufferBinds = &bufferBind;
+        vkResetFences(m_device, 1, &m_bindFence);
+        if (vkQueueBindSparse(m_sparseQueue, 1, &bindInfo, m_bindFence) != VK_SUCCESS) {
+            throw std::runtime_error("failed to bind geometry buffer pages!");
+        }
+        vkWaitForFences(m_device, 1, &m_bindFence, VK_TRUE, UINT64_MAX);
+        for (Allocation& allocation : released) {
+            m_allocator->free(allocation);  // 解除绑定完成之后内存才可以给其它资源使用
+        }
+    }
+
+    // split vertex streams：属性区域按16字节对齐，mesh shader按uint读取，vertex input的offset也没有对齐问题
+    static constexpr VkDeviceSize REGION_ALIGNMENT = 16;
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+    // 顶点和索引区域各自维护按起始位置排序的空闲区间，first fit分配，释放时合并相邻区间
+    FreeRanges m_freeVertices;
+    FreeRanges m_freeIndices;
+
+    static uint32_t indexSlots(uint32_t indexCount, VkIndexType indexType) {
+        return indexType == VK_INDEX_TYPE_UINT16 ? (indexCount + 1) / 2 : indexCount;
+    }
+};
@@ -0,0 +1,480 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "tiny_gltf.h"
+
+#include "mapped_file.hpp"
+#include "material_table.hpp"
+
+// gltf：accessor在buffer中的位置，stride是相邻元素的距离，等于elementSize时数据紧密排列可以整段拷贝
+struct GltfAccessorView {
+    const uint8_t* data = nullptr;
+    size_t count = 0;
+    size_t stride = 0;
+    size_t elementSize = 0;
+    int componentType = 0;
+    int type = 0;
+    bool normalized = false;
+
+    bool tight() const { return stride == elementSize; }
+    const uint8_t* element(size_t i) const { return data + i * stride; }
+};
+
+// gltf：检查accessor没有越界，sparse accessor需要先展开，这里不支持
+inline GltfAccessorView gltfAccessorView(const tinygltf::Model& model, int accessorIndex) {
+    const tinygltf::Accessor& accessor = model.accessors.at(accessorIndex);
+    if (accessor.sparse.isSparse || accessor.bufferView < 0) {
+        throw std::runtime_error("unsupported gltf accessor (sparse or without buffer view)!");
+    }
+    const tinygltf::BufferView& bufferView = model.bufferViews.at(accessor.bufferView);
+    const tinygltf::Buffer& buffer = model.buffers.at(bufferView.buffer);
+
+    GltfAccessorView view;
+    int stride = accessor.ByteStride(bufferView);
+    if (stride <= 0) {
+        throw std::runtime_error("invalid gltf accessor stride!");
+    }
+    view.count = accessor.count;
+    view.stride = static_cast<size_t>(stride);
+    view.elementSize = static_cast<size_t>(tinygltf::GetComponentSizeInBytes(accessor.componentType) * tinygltf::GetNumComponentsInType(accessor.type));
+    view.componentType = accessor.componentType;
+    view.type = accessor.type;
+    view.normalized = accessor.normalized;
+
+    size_t offset = bufferView.byteOffset + accessor.byteOffset;
+    size_t end = view.count == 0 ? offset : offset + (view.count - 1) * view.stride + view.elementSize;
+    if (end > bufferView.byteOffset + bufferView.byteLength || end > buffer.data.size()) {
+        throw std::runtime_error("gltf accessor out of buffer range!");
+    }
+    view.data = buffer.data.data() + offset;
+    return view;
+}
+
+// gltf：float或者归一化的整数分量，uv允许用unsigned byte和unsigned short保存
+inline float gltfComponent(const GltfAccessorView& view, size_t i, size_t component) {
+    const uint8_t* element = view.element(i);
+    switch (view.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+        float value;
+        memcpy(&value, element + component * sizeof(float), sizeof(value));
+        return value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        uint16_t value;
+        memcpy(&value, element + component * sizeof(uint16_t), sizeof(value));
+        return view.normalized ? value / 65535.0f : value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        return view.normalized ? element[component] / 255.0f : element[component];
+    default:
+        throw std::runtime_error("unsupported gltf vertex component type!");
+    }
+}
+
+// gltf：索引可以是8、16或32位
+inline uint32_t gltfIndex(const GltfAccessorView& view, size_t i) {
+    const uint8_t* element = view.element(i);
+    switch (view.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        return element[0];
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        uint16_t value;
+        memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+        uint32_t value;
+        memcpy(&value, element, sizeof(value));
+        return value;
+    }
+    default:
+        throw std::runtime_error("unsupported gltf index component type!");
+    }
+}
+
+// gltf：图片不在加载时解码，只保存原始的编码数据，之后交给texture cache和其它纹理一起并行解码
+// 外部图片因为TINYGLTF_NO_EXTERNAL_IMAGE只保留uri，不会调用这个函数，由texture cache按路径读取
+inline bool keepEncodedGltfImage(tinygltf::Image* image, const int, std::string*, std::string*, int, int, const unsigned char* bytes, int size, void*) {
+    image->image.assign(bytes, bytes + size);
+    image->as_is = true;
+    return true;
+}
+
+// gltf：.glb是二进制容器，其余按.gltf的json读取
+// mapped file：tinygltf直接解析映射的文件，不先读进它自己的vector；外部的.bin仍然由tinygltf按base dir读取
+inline void loadGltfModel(const std::string& path, tinygltf::Model& model) {
+    tinygltf::TinyGLTF loader;
+    loader.SetImageLoader(keepEncodedGltfImage, nullptr);
+
+    MappedFile file;
+    if (!file.open(path)) {
+        throw std::runtime_error("failed to open gltf model: " + path);
+    }
+    size_t separator = path.find_last_of("/\\");
+    std::string baseDir = separator == std::string::npos ? "" : path.substr(0, separator);  // 和tinygltf的GetBaseDir一致
+
+    std::string warn, err;
+    bool binary = path.size() >= 4 && path.compare(path.size() - 4, 4, ".glb") == 0;
+    bool loaded = binary
+        ? loader.LoadBinaryFromMemory(&model, &err, &warn, reinterpret_cast<const unsigned char*>(file.data()), static_cast<unsigned int>(file.size()), baseDir)
+        : loader.LoadASCIIFromString(&model, &err, &warn, file.data(), static_cast<unsigned int>(file.size()), baseDir);
+    if (!loaded) {
+        throw std::runtime_error("failed to load gltf model: " + path + " " + warn + err);
+    }
+}
+
+// skinning：node的本地变换分成T、R、S，动画的channel替换其中一个分量；有matrix的node不能被动画，直接使用matrix
+struct GltfNodePose {
+    glm::vec3 translation{0.0f};
+    glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+    glm::vec3 scale{1.0f};
+    glm::mat4 matrix{1.0f};
+    bool hasMatrix = false;
+
+    glm::mat4 local() const {
+        if (hasMatrix) {
+            return matrix;
+        }
+        return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+    }
+};
+
+inline GltfNodePose gltfNodePose(const tinygltf::Node& node) {
+    GltfNodePose pose;
+    if (node.matrix.size() == 16) {
+        for (int i = 0; i < 16; i++) {
+            glm::value_ptr(pose.matrix)[i] = static_cast<float>(node.matrix[i]);  // gltf和glm都是列主序
+        }
+        pose.hasMatrix = true;
+        return pose;
+    }
+    if (node.translation.size() == 3) {
+        pose.translation = glm::vec3(node.translation[0], node.translation[1], node.translation[2]);
+    }
+    if (node.rotation.size() == 4) {
+        pose.rotation = glm::quat(static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]), static_cast<float>(node.rotation[1]),
+            static_cast<float>(node.rotation[2]));  // gltf是xyzw，glm::quat构造参数是wxyz
+    }
+    if (node.scale.size() == 3) {
+        pose.scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+    }
+    return pose;
+}
+
+// gltf：node有matrix时直接使用，否则按T * R * S组合
+inline glm::mat4 gltfNodeTransform(const tinygltf::Node& node) {
+    return gltfNodePose(node).local();
+}
+
+// gltf：场景中引用mesh的node，同一个mesh可以被多个node以不同的变换引用
+// skinning：skin不为-1时顶点由joint的变换决定，transform（包括node自己的变换）按gltf的规定不使用
+struct GltfMeshInstance {
+    int mesh;
+    glm::mat4 transform;
+    int skin = -1;
+};
+
+// gltf：遍历默认场景的node树，累积父节点的变换；没有场景时每个mesh画一次
+inline std::vector<GltfMeshInstance> collectGltfMeshInstances(const tinygltf::Model& model) {
+    std::vector<GltfMeshInstance> instances;
+    if (model.scenes.empty()) {
+        for (size_t i = 0; i < model.meshes.size(); i++) {
+            instances.push_back({static_cast<int>(i), glm::mat4(1.0f)});
+        }
+        return instances;
+    }
+
+    struct Pending {
+        int node;
+        glm::mat4 parent;
+    };
+    std::vector<Pending> stack;
+    const tinygltf::Scene& scene = model.scenes.at(model.defaultScene >= 0 ? model.defaultScene : 0);
+    for (int node : scene.nodes) {
+        stack.push_back({node, glm::mat4(1.0f)});
+    }
+    while (!stack.empty()) {
+        Pending pending = stack.back();
+        stack.pop_back();
+        const tinygltf::Node& node = model.nodes.at(pending.node);
+        glm::mat4 transform = pending.parent * gltfNodeTransform(node);
+        if (node.mesh >= 0) {
+            instances.push_back({node.mesh, transform, node.skin});
+        }
+        for (int child : node.children) {
+            stack.push_back({child, transform});
+        }
+    }
+    return instances;
+}
+
+// gltf：材质的base color纹理对应的image，没有时返回-1
+// KHR_texture_basisu的纹理source可以为空，这时使用扩展中的ktx2图片
+inline int gltfBaseColorImage(const tinygltf::Model& model, int materialIndex) {
+    if (materialIndex < 0) {
+        return -1;
+    }
+    int textureIndex = model.materials.at(materialIndex).pbrMetallicRoughness.baseColorTexture.index;
+    if (textureIndex < 0) {
+        return -1;
+    }
+    const tinygltf::Texture& texture = model.textures.at(textureIndex);
+    if (texture.source >= 0) {
+        return texture.source;
+    }
+    auto basisu = texture.extensions.find("KHR_texture_basisu");
+    if (basisu != texture.extensions.end() && basisu->second.Has("source")) {
+        return basisu->second.Get("source").GetNumberAsInt();
+    }
+    return -1;
+}
+
+// materials：gltf材质中使用的部分，texture是base color纹理（没有时是调用者的默认纹理）；没有材质时是默认值
+inline MaterialDesc gltfMaterial(const tinygltf::Model& model, int materialIndex, TextureHandle texture) {
+    MaterialDesc desc;
+    desc.texture = texture;
+    if (materialIndex < 0) {
+        return desc;
+    }
+    const tinygltf::Material& material = model.materials.at(materialIndex);
+    const std::vector<double>& factor = material.pbrMetallicRoughness.baseColorFactor;
+    if (factor.size() == 4) {
+        desc.baseColorFactor = glm::vec4(float(factor[0]), float(factor[1]), float(factor[2]), float(factor[3]));
+    }
+    desc.doubleSided = material.doubleSided;
+    return desc;
+}
+
+inline bool isGltfPath(const std::string& path) {
+    auto endsWith = [&](const std::string& suffix) {
+        return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return endsWith(".gltf") || endsWith(".glb");
+}
+
+// skinning：skin的joint是node编号，inverseBindMatrices把mesh空间变换到joint的绑定空间，没有accessor时是单位矩阵
+struct GltfSkin {
+    std::vector<int> joints;
+    std::vector<glm::mat4> inverseBindMatrices;
+};
+
+// skinning：动画的一个channel，times递增；rotation的values是xyzw，CUBICSPLINE只取关键帧的值按LINEAR插值
+struct GltfAnimationChannel {
+    enum class Path { translation, rotation, scale };
+    int node = -1;
+    Path path = Path::translation;
+    bool step = false;
+    std::vector<float> times;
+    std::vector<glm::vec4> values;
+};
+
+// skinning：模型的node树、所有skin和第一个动画，cpu每帧按时间计算joint矩阵，蒙皮本身在compute中进行
+// 上传之后tinygltf::Model被释放，需要的数据在load时拷贝出来
+class GltfSkeleton {
+public:
+    static constexpr uint32_t BOUNDS_SAMPLES = 64;  // animatedBounds在动画中均匀采样的时刻数量
+
+    void load(const tinygltf::Model& model) {
+        size_t nodeCount = model.nodes.size();
+        m_parents.assign(nodeCount, -1);
+        m_rest.resize(nodeCount);
+        for (size_t i = 0; i < nodeCount; i++) {
+            m_rest[i] = gltfNodePose(model.nodes[i]);
+            for (int child : model.nodes[i].children) {
+                m_parents.at(child) = static_cast<int>(i);
+            }
+        }
+        // 父节点在子节点之前，evaluate按这个顺序一次遍历就能得到世界变换
+        m_order.clear();
+        std::vector<int> stack;
+        for (size_t i = 0; i < nodeCount; i++) {
+            if (m_parents[i] < 0) {
+                stack.push_back(static_cast<int>(i));
+            }
+        }
+        while (!stack.empty()) {
+            int node = stack.back();
+            stack.pop_back();
+            m_order.push_back(node);
+            for (int child : model.nodes[node].children) {
+                stack.push_back(child);
+            }
+        }
+
+        m_skins.clear();
+        for (const tinygltf::Skin& source : model.skins) {
+            GltfSkin skin;
+            skin.joints = source.joints;
+            skin.inverseBindMatrices.assign(skin.joints.size(), glm::mat4(1.0f));
+            if (source.inverseBindMatrices >= 0) {
+                GltfAccessorView view = gltfAccessorView(model, source.inverseBindMatrices);
+                if (view.type != TINYGLTF_TYPE_MAT4 || view.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || view.count < skin.joints.size()) {
+                    throw std::runtime_error("unsupported gltf inverse bind matrices!");
+                }
+                for (size_t j = 0; j < skin.joints.size(); j++) {
+                    memcpy(glm::value_ptr(skin.inverseBindMatrices[j]), view.element(j), sizeof(glm::mat4));
+                }
+            }
+            m_skins.push_back(std::move(skin));
+        }
+
+        m_channels.clear();
+        m_duration = 0.0f;
+        if (model.animations.empty()) {
+            return;
+        }
+        const tinygltf::Animation& animation = model.animations[0];
+        for (const tinygltf::AnimationChannel& source : animation.channels) {
+            GltfAnimationChannel channel;
+            if (source.target_node < 0 || m_rest.at(source.target_node).hasMatrix) {
+                continue;
+            }
+            if (source.target_path == "translation") {
+                channel.path = GltfAnimationChannel::Path::translation;
+            } else if (source.target_path == "rotation") {
+                channel.path = GltfAnimationChannel::Path::rotation;
+            } else if (source.target_path == "scale") {
+                channel.path = GltfAnimationChannel::Path::scale;
+            } else {
+                continue;  // morph target的weights不支持
+            }
+            channel.node = source.target_node;
+            const tinygltf::AnimationSampler& sampler = animation.samplers.at(source.sampler);
+            channel.step = sampler.interpolation == "STEP";
+            bool cubic = sampler.interpolation == "CUBICSPLINE";  // 每个关键帧是in tangent、值和out tangent
+
+            GltfAccessorView input = gltfAccessorView(model, sampler.input);
+            GltfAccessorView output = gltfAccessorView(model, sampler.output);
+            size_t components = channel.path == GltfAnimationChannel::Path::rotation ? 4 : 3;
+            if (output.count < input.count * (cubic ? 3 : 1) || input.count == 0) {
+                throw std::runtime_error("invalid gltf animation sampler!");
+            }
+            channel.times.resize(input.count);
+            channel.values.resize(input.count, glm::vec4(0.0f));
+            for (size_t k = 0; k < input.count; k++) {
+                channel.times[k] = gltfComponent(input, k, 0);
+                size_t element = cubic ? k * 3 + 1 : k;
+                for (size_t c = 0; c < components; c++) {
+                    channel.values[k][c] = gltfComponent(output, element, c);
+                }
+            }
+            m_duration = std::max(m_duration, channel.times.back());
+            m_channels.push_back(std::move(channel));
+        }
+    }
+
+    bool animated() const { return !m_channels.empty() && m_duration > 0.0f; }
+    float duration() const { return m_duration; }
+    const std::vector<GltfSkin>& skins() const { return m_skins; }
+
+    // skinning：time按动画长度循环，结果是每个node的世界变换（模型空间），容量在帧之间复用
+    void evaluate(float time, std::vector<glm::mat4>& globals) const {
+        std::vector<GltfNodePose>& poses = m_scratchPoses;
+        poses = m_rest;
+        float t = animated() ? std::fmod(time, m_duration) : 0.0f;
+        for (const GltfAnimationChannel& channel : m_channels) {
+            GltfNodePose& pose = poses[channel.node];
+            glm::vec4 value = sample(channel, t);
+            switch (channel.path) {
+            case GltfAnimationChannel::Path::translation:
+                pose.translation = glm::vec3(value);
+                break;
+            case GltfAnimationChannel::Path::rotation:
+                pose.rotation = glm::normalize(glm::quat(value.w, value.x, value.y, value.z));
+                break;
+            case GltfAnimationChannel::Path::scale:
+                pose.scale = glm::vec3(value);
+                break;
+            }
+        }
+        globals.resize(poses.size());
+        for (int node : m_order) {
+            glm::mat4 local = poses[node].local();
+            globals[node] = m_parents[node] >= 0 ? globals[m_parents[node]] * local : local;
+        }
+    }
+
+    // skinning：joint j的矩阵是prefix * global(joint) * inverseBind，prefix让调用者把量化等变换合并进去
+    void jointMatrices(const std::vector<glm::mat4>& globals, uint32_t skin, const glm::mat4& prefix, std::vector<glm::mat4>& out) const {
+        const GltfSkin& source = m_skins.at(skin);
+        out.resize(source.joints.size());
+        for (size_t j = 0; j < source.joints.size(); j++) {
+            out[j] = prefix * globals.at(source.joints[j]) * source.inverseBindMatrices[j];
+        }
+    }
+
+    // skinning：蒙皮后的顶点是各个joint变换的凸组合，不会超出每个joint变换后的绑定包围盒的并集
+    // 在动画中均匀采样（包括开头的姿势），采样之间的运动用margin（包围盒大小的比例）覆盖
+    void animatedBounds(uint32_t skin, const glm::vec3& bindMin, const glm::vec3& bindMax, float margin, glm::vec3& outMin, glm::vec3& outMax) const {
+        outMin = glm::vec3(FLT_MAX);
+        outMax = glm::vec3(-FLT_MAX);
+        std::vector<glm::mat4> globals;
+        std::vector<glm::mat4> joints;
+        uint32_t samples = animated() ? BOUNDS_SAMPLES : 1;
+        for (uint32_t i = 0; i < samples; i++) {
+            evaluate(m_duration * static_cast<float>(i) / static_cast<float>(samples), globals);
+            jointMatrices(globals, skin, glm::mat4(1.0f), joints);
+            for (const glm::mat4& joint : joints) {
+                for (int corner = 0; corner < 8; corner++) {
+                    glm::vec3 point((corner & 1) ? bindMax.x : bindMin.x, (corner & 2) ? bindMax.y : bindMin.y, (corner & 4) ? bindMax.z : bindMin.z);
+                    glm::vec3 transformed = glm::vec3(joint * glm::vec4(point, 1.0f));
+                    outMin = glm::min(outMin, transformed);
+                    outMax = glm::max(outMax, transformed);
+                }
+            }
+        }
+        if (outMin.x > outMax.x) {  // skin没有joint
+            outMin = bindMin;
+            outMax = bindMax;
+        }
+        glm::vec3 padding = (outMax - outMin) * margin;
+        outMin -= padding;
+        outMax += padding;
+    }
+
+private:
+    std::vector<int> m_parents;
+    std::vector<int> m_order;
+    std::vector<GltfNodePose> m_rest;
+    std::vector<GltfSkin> m_skins;
+    std::vector<GltfAnimationChannel> m_channels;
+    float m_duration = 0.0f;
+    mutable std::vector<GltfNodePose> m_scratchPoses;  // evaluate的临时空间，只在主线程使用
+
+    // skinning：时间在第一个关键帧之前或最后一个之后时使用端点的值
+    static glm::vec4 sample(const GltfAnimationChannel& channel, float time) {
+        if (time <= channel.times.front()) {
+            return channel.values.front();
+        }
+        if (time >= channel.times.back()) {
+            return channel.values.back();
+        }
+        size_t next = static_cast<size_t>(std::upper_bound(channel.times.begin(), channel.times.end(), time) - channel.times.begin());
+        size_t previous = next - 1;
+        if (channel.step) {
+            return channel.values[previous];
+        }
+        float span = channel.times[next] - channel.times[previous];
+        float t = span > 0.0f ? (time - channel.times[previous]) / span : 0.0f;
+        const glm::vec4& a = channel.values[previous];
+        const glm::vec4& b = channel.values[next];
+        if (channel.path == GltfAnimationChannel::Path::rotation) {
+            glm::quat q = glm::slerp(glm::quat(a.w, a.x, a.y, a.z), glm::quat(b.w, b.x, b.y, b.z), t);
+            return glm::vec4(q.x, q.y, q.z, q.w);
+        }
+        return glm::mix(a, b, t);
+    }
+};
@@ -0,0 +1,365 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// gpu culling：布局和instance_cull.comp中的CullParams一致（std140）
+struct GpuCullParams {
+    glm::vec4 planes[6];
+    glm::mat4 sceneModel;
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    glm::mat4 viewProj;
+    glm::vec2 pyramidSize;
+    uint32_t instanceCount;
+    uint32_t drawCount;
+    uint32_t instanceCapacity;  // update填写
+    uint32_t drawCapacity;  // update填写
+    uint32_t pyramidLevels;
+    uint32_t occlusion;
+    uint32_t historyValid;
+    alignas(16) glm::vec4 contribution;  // contribution culling：xyz是相机位置，w是ContributionTest的ratio
+};
+
+// gpu culling：frustum culling在compute shader中完成，cpu每帧只写入scene list和每个mesh的draw命令模板，不再遍历实例
+// 剔除把可见的实例压缩到visible buffer（同时作为binding 2的顶点输入），再把可见数量写进每个mesh的instanceCount
+// 每个mesh的draw是maxDrawCount为1的vkCmdDrawIndexedIndirectCount，count由gpu写入，没有可见实例时不产生任何draw
+// hi-z：开启occlusion时分两个阶段，record在第一次绘制之前用上一帧的pyramid剔除，recordLate在pyramid用第一阶段的depth重新生成之后
+// 测试第一阶段被挡住的实例，补画其中可见的实例；上一帧挡住、这一帧露出来的实例在同一帧就画出来，不会闪烁
+// visible buffer、draw命令和draw数量每个阶段各一份
+// 每个frame in flight一套buffer，cpu写入的三个buffer是host visible的，gpu写入的三个是device local的
+class GpuInstanceCuller {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;  // 和instance_cull.comp的local_size_x一致
+
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, uint32_t instanceStride, uint32_t maxInstances,
+        uint32_t maxDraws, uint32_t frameCount) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_instanceStride = instanceStride;
+        m_maxInstances = maxInstances;
+        m_maxDraws = maxDraws;
+        m_drawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCount) vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+        if (m_drawIndexedIndirectCount == nullptr) {
+            throw std::runtime_error("failed to load vkCmdDrawIndexedIndirectCountKHR!");
+        }
+
+        createPipeline(pipelineCache, shaderCode);
+
+        VkDescriptorPoolSize poolSizes[3] = {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, frameCount}, {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * frameCount},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, frameCount}};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 3;
+        poolInfo.pPoolSizes = poolSizes;
+        poolInfo.maxSets = frameCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu culling descriptor pool!");
+        }
+
+        VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            frame.params = createBuffer(sizeof(GpuCullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, hostVisible, "gpu culling params");
+            frame.sceneInstances = createBuffer(VkDeviceSize(instanceStride) * maxInstances, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, hostVisible, "gpu culling scene");
+            frame.visibleInstances = createBuffer(PHASE_COUNT * VkDeviceSize(instanceStride) * maxInstances, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "gpu culling visible");
+            frame.drawCommands = createBuffer(PHASE_COUNT * sizeof(VkDrawIndexedIndirectCommand) * maxDraws, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                hostVisible, "gpu culling draws");
+            frame.counts = createBuffer(sizeof(uint32_t) * (COUNT_HEADER + PHASE_COUNT * maxDraws),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                "gpu culling counts");
+            frame.candidates = createBuffer(sizeof(uint32_t) * maxInstances, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                "gpu culling candidates");
+            frame.descriptorSet = allocateDescriptorSet(frame);
+        }
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        for (Frame& frame : m_frames) {
+            for (Buffer* buffer : {&frame.params, &frame.sceneInstances, &frame.visibleInstances, &frame.drawCommands, &frame.counts, &frame.candidates}) {
+                vkDestroyBuffer(m_device, buffer->buffer, hostAllocator());
+                m_allocator->free(buffer->allocation);
+            }
+        }
+        m_frames.clear();
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // gpu culling：写入这一帧的参数和scene list，超过容量的实例被丢弃；调用者需要保证gpu已经完成上次使用这一帧的命令
+    void update(uint32_t frameIndex, GpuCullParams params, const void* instances) {
+        Frame& frame = m_frames[frameIndex];
+        params.instanceCount = std::min(params.instanceCount, m_maxInstances);
+        params.drawCount = std::min(params.drawCount, m_maxDraws);
+        params.instanceCapacity = m_maxInstances;
+        params.drawCapacity = m_maxDraws;
+        memcpy(frame.params.allocation.mapped, &params, sizeof(params));
+        memcpy(frame.sceneInstances.allocation.mapped, instances, size_t(m_instanceStride) * params.instanceCount);
+        m_instanceCount = params.instanceCount;
+    }
+
+    // gpu culling：draw的indexCount、firstIndex和vertexOffset由cpu写入两个阶段，instanceCount由gpu写入
+    void setDraw(uint32_t frameIndex, uint32_t draw, uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset) {
+        if (draw >= m_maxDraws) {
+            throw std::runtime_error("gpu culling draw capacity exceeded!");
+        }
+        VkDrawIndexedIndirectCommand command{indexCount, 0, firstIndex, vertexOffset, 0};
+        for (uint32_t phase = 0; phase < PHASE_COUNT; phase++) {
+            memcpy(static_cast<VkDrawIndexedIndirectCommand*>(m_frames[frameIndex].drawCommands.allocation.mapped) + phase * m_maxDraws + draw, &command, sizeof(command));
+        }
+    }
+
+    // hi-z：binding 6在这一帧的set中引用pyramid，pyramid重建之后在这一帧第一次使用时重写，这时gpu已经完成上次使用这个set的命令
+    // 没有开启occlusion时也需要一个有效的image，shader只在params.occlusion不为0时读取
+    void setPyramid(uint32_t frameIndex, VkImageView view, VkSampler sampler) {
+        Frame& frame = m_frames[frameIndex];
+        if (frame.pyramidView == view) {
+            return;
+        }
+        VkDescriptorImageInfo imageInfo{sampler, view, VK_IMAGE_LAYOUT_GENERAL};
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = frame.descriptorSet;
+        write.dstBinding = 6;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+        frame.pyramidView = view;
+    }
+
+    // gpu culling：第一阶段，在render pass之外录制，结束时的barrier让draw的indirect读取和顶点输入看到compute的写入
+    // dispatch的大小按最大容量，超出这一帧数量的线程直接返回，录制的命令不依赖实例数量，command cache可以重用
+    void record(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+        Frame& frame = m_frames[frameIndex];
+        vkCmdFillBuffer(commandBuffer, frame.counts.buffer, 0, VK_WHOLE_SIZE, 0);
+        bufferBarrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        bind(commandBuffer, frame);
+        dispatch(commandBuffer, 0, 0, m_maxInstances);
+        bufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        dispatch(commandBuffer, 2, 0, m_maxDraws);
+        drawBarrier(commandBuffer);
+    }
+
+    // hi-z：第二阶段，在pyramid生成之后、第二次绘制之前录制；第一阶段的candidates和数量在前面的barrier中已经可见
+    void recordLate(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+        bufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        bind(commandBuffer, m_frames[frameIndex]);
+        dispatch(commandBuffer, 1, 1, m_maxInstances);
+        bufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        dispatch(commandBuffer, 2, 1, m_maxDraws);
+        drawBarrier(commandBuffer);
+    }
+
+    // gpu culling：在调用之前绑定好这个mesh的索引类型、push constant和这个阶段的binding 2
+    void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t draw, uint32_t phase) const {
+        const Frame& frame = m_frames[frameIndex];
+        uint32_t slot = phase * m_maxDraws + draw;
+        m_drawIndexedIndirectCount(commandBuffer, frame.drawCommands.buffer, sizeof(VkDrawIndexedIndirectCommand) * slot, frame.counts.buffer,
+            sizeof(uint32_t) * (COUNT_HEADER + slot), 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    void bindVisibleInstances(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t binding, uint32_t phase) const {
+        VkDeviceSize offset = VkDeviceSize(phase) * m_instanceStride * m_maxInstances;
+        vkCmdBindVertexBuffers(commandBuffer, binding, 1, &m_frames[frameIndex].visibleInstances.buffer, &offset);
+    }
+
+    uint32_t instanceCount() const { return m_instanceCount; }
+
+private:
+    static constexpr uint32_t PHASE_COUNT = 2;
+    static constexpr uint32_t COUNT_HEADER = 3;  // 两个阶段的可见数量和candidates的数量，和instance_cull.comp一致
+
+    struct PushConstants {
+        uint32_t pass;
+        uint32_t phase;
+    };
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    struct Frame {
+        Buffer params;
+        Buffer sceneInstances;
+        Buffer visibleInstances;
+        Buffer drawCommands;
+        Buffer counts;
+        Buffer candidates;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkImageView pyramidView = VK_NULL_HANDLE;  // binding 6最近一次写入的pyramid
+    };
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, 7> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;  // 0是参数，1到5是buffer，6是hi-z，和instance_cull.comp中的binding一致
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : i == 6 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu culling descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu culling pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu culling shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu culling compute pipeline!");
+        }
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, const char* name) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu culling buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        bool mapped = (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+        buffer.allocation = m_allocator->allocate(memRequirements, properties, mapped, MemoryCategory::geometry, 0, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+        return buffer;
+    }
+
+    // gpu culling：buffer在整个程序运行期间不变，buffer的descriptor只在创建时写入一次
+    VkDescriptorSet allocateDescriptorSet(const Frame& frame) {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_descriptorSetLayout;
+        VkDescriptorSet set;
+        if (vkAllocateDescriptorSets(m_device, &allocInfo, &set) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate gpu culling descriptor set!");
+        }
+
+        std::array<VkDescriptorBufferInfo, 6> bufferInfos = {{
+            {frame.params.buffer, 0, VK_WHOLE_SIZE},
+            {frame.sceneInstances.buffer, 0, VK_WHOLE_SIZE},
+            {frame.visibleInstances.buffer, 0, VK_WHOLE_SIZE},
+            {frame.drawCommands.buffer, 0, VK_WHOLE_SIZE},
+            {frame.counts.buffer, 0, VK_WHOLE_SIZE},
+            {frame.candidates.buffer, 0, VK_WHOLE_SIZE},
+        }};
+        std::array<VkWriteDescriptorSet, 6> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = set;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        return set;
+    }
+
+    void bind(VkCommandBuffer commandBuffer, const Frame& frame) const {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+    }
+
+    void dispatch(VkCommandBuffer commandBuffer, uint32_t pass, uint32_t phase, uint32_t threadCount) const {
+        PushConstants constants{pass, phase};
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (threadCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+    }
+
+    static void drawBarrier(VkCommandBuffer commandBuffer) {
+        bufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+    }
+
+    // gpu culling：这些buffer只在这个类中使用，global memory barrier就足够了
+    static void bufferBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_instanceStride = 0;
+    uint32_t m_maxInstances = 0;
+    uint32_t m_maxDraws = 0;
+    uint32_t m_instanceCount = 0;
+    PFN_vkCmdDrawIndexedIndirectCount m_drawIndexedIndirectCount = nullptr;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    std::vector<Frame> m_frames;
+};
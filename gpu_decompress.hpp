@@ -0,0 +1,224 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "asset_pack.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// gpu decompression：asset pack中分块压缩的blob原样写入host visible的buffer，gpu_decompress.comp解压到device local的buffer，
+// 之后用普通的拷贝命令从解压结果拷贝到目标image或buffer；cpu只复制压缩的数据，跨PCIe的也是压缩后的大小
+// compute需要图形队列，录制在upload context的graphicsCommandBuffer中，目标资源的拷贝和layout转换也在同一个command buffer中
+// 每次解压的buffer单独创建，上传完成之后销毁，多个资源可以同时解压
+class GpuDecompressor {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;  // 和gpu_decompress.comp的local_size_x一致
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    // gpu decompression：output中从span.skip开始是请求的字节范围
+    struct Job {
+        AssetBlockSpan span;
+        uint32_t inputSize = 0;
+        Buffer input;
+        Buffer output;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    };
+
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, VkDeviceSize maxStorageBufferRange) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_maxStorageBufferRange = maxStorageBufferRange;
+        createPipeline(pipelineCache, shaderCode);
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // gpu decompression：输入和输出都需要在maxStorageBufferRange之内，shader中的偏移是32位
+    bool fits(const AssetBlockSpan& span, size_t inputSize) const {
+        return initialized() && inputSize <= m_maxStorageBufferRange && span.outputSize <= m_maxStorageBufferRange && span.outputSize < UINT32_MAX
+            && inputSize < UINT32_MAX;
+    }
+
+    // gpu decompression：input是AssetPack::readBlocks的结果，创建这次解压的buffer并写入输入
+    Job begin(const AssetBlockSpan& span, const std::vector<char>& input) {
+        Job job;
+        job.span = span;
+        job.inputSize = static_cast<uint32_t>(input.size());
+        // 两个buffer都按uint访问，大小向上取整
+        job.input = createBuffer((input.size() + 3) / 4 * 4, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::staging, "gpu decompression input");
+        memcpy(job.input.allocation.mapped, input.data(), input.size());
+        job.output = createBuffer((span.outputSize + 3) / 4 * 4, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::texture, "gpu decompression output");
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &job.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu decompression descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = job.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkAllocateDescriptorSets(m_device, &allocInfo, &job.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate gpu decompression descriptor set!");
+        }
+
+        std::array<VkDescriptorBufferInfo, 2> bufferInfos{};
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        const Buffer* buffers[2] = {&job.input, &job.output};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            bufferInfos[i] = {buffers[i]->buffer, 0, VK_WHOLE_SIZE};
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = job.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        return job;
+    }
+
+    // gpu decompression：结束时的barrier让之后录制在同一个command buffer中的拷贝读取job.output
+    void record(VkCommandBuffer commandBuffer, const Job& job) const {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &job.descriptorSet, 0, nullptr);
+        PushConstants constants{job.span.blockCount, ASSET_PACK_BLOCK_SIZE, static_cast<uint32_t>(job.span.outputSize), job.inputSize};
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, (job.span.blockCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // gpu decompression：从解压结果拷贝的命令完成之后调用，通常交给UploadContext::deferUntilComplete
+    void finish(Job& job) {
+        vkDestroyDescriptorPool(m_device, job.descriptorPool, hostAllocator());
+        for (Buffer* buffer : {&job.input, &job.output}) {
+            vkDestroyBuffer(m_device, buffer->buffer, hostAllocator());
+            m_allocator->free(buffer->allocation);
+        }
+        job = Job{};
+    }
+
+private:
+    struct PushConstants {
+        uint32_t blockCount;
+        uint32_t blockSize;
+        uint32_t outputSize;
+        uint32_t inputSize;
+    };
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu decompression descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu decompression pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu decompression shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu decompression compute pipeline!");
+        }
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, const char* name) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu decompression buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        buffer.allocation = m_allocator->allocate(memRequirements, properties, true, category, 0, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+        return buffer;
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkDeviceSize m_maxStorageBufferRange = 0;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+};
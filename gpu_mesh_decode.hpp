@@ -0,0 +1,269 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "mesh_cache.hpp"
+#include "shader_registry.hpp"
+
+// mesh codec：编码的mesh cache按submesh上传，submesh用到的顶点block和索引block原样写入host visible的buffer，
+// mesh_decode.comp直接解码到geometry buffer中分配的位置，不经过staging ring，cpu只复制编码后的数据
+// 和GpuDecompressor一样录制在upload context的graphicsCommandBuffer中，每次上传的输入buffer单独创建，上传完成之后销毁
+// geometry buffer的位置、其它属性和索引分别按这次写入的范围绑定，整个buffer不需要在maxStorageBufferRange之内
+class GpuMeshDecoder {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;  // 和mesh_decode.comp的local_size_x一致
+
+    // mesh codec：geometry buffer中这个submesh的写入位置；没有分开属性时attributeSize为0
+    struct Target {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize positionOffset = 0;
+        VkDeviceSize positionSize = 0;
+        VkDeviceSize attributeOffset = 0;
+        VkDeviceSize attributeSize = 0;
+        VkDeviceSize indexOffset = 0;
+        VkDeviceSize indexSize = 0;
+        uint32_t positionStride = 0;
+    };
+
+    struct Job {
+        uint32_t vertexThreads = 0;
+        uint32_t indexBlocks = 0;
+        std::array<uint32_t, 16> constants{};
+        VkBuffer input = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    };
+
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, const VkPhysicalDeviceLimits& limits) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_maxStorageBufferRange = limits.maxStorageBufferRange;
+        m_offsetAlignment = std::max<VkDeviceSize>(limits.minStorageBufferOffsetAlignment, sizeof(uint32_t));
+        createPipeline(pipelineCache, shaderCode);
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // mesh codec：所有submesh的输入和输出范围都在maxStorageBufferRange之内时才能在gpu上解码，否则由加载线程在cpu上解码
+    // 多出的m_offsetAlignment是绑定的起点向下对齐之后增加的范围
+    bool fits(const MeshCacheView& cache, uint32_t vertexStride) const {
+        if (!initialized() || !cache.encoded || cache.vertexBytes + cache.indexBytes > m_maxStorageBufferRange) {
+            return false;
+        }
+        for (uint32_t i = 0; i < cache.submeshCount; i++) {
+            const MeshCacheSubmesh& submesh = cache.submeshes[i];
+            uint32_t indexCount = 0;
+            for (uint32_t l = 0; l < submesh.lodCount; l++) {
+                indexCount += cache.lods[submesh.firstLod + l].indexCount;
+            }
+            if (static_cast<VkDeviceSize>(submesh.vertexCount) * vertexStride + m_offsetAlignment > m_maxStorageBufferRange
+                || static_cast<VkDeviceSize>(indexCount) * cache.indexSize + m_offsetAlignment > m_maxStorageBufferRange) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // mesh codec：indexCount是submesh所有level的索引数，从submesh.firstIndex开始连续；复制用到的block并重新计算偏移表
+    Job begin(const MeshCacheView& cache, uint32_t vertexStride, const MeshCacheSubmesh& submesh, uint32_t indexCount, const Target& target) {
+        const uint32_t* vertexStream = static_cast<const uint32_t*>(cache.vertices);
+        const uint32_t* indexStream = static_cast<const uint32_t*>(cache.indices);
+        uint32_t firstVertexBlock = submesh.firstVertex / MESH_CODEC_BLOCK;
+        uint32_t vertexBlocks = meshCodecBlockCount(submesh.firstVertex + submesh.vertexCount) - firstVertexBlock;
+        uint32_t firstIndexBlock = submesh.firstIndex / MESH_CODEC_BLOCK;
+        uint32_t indexBlocks = meshCodecBlockCount(indexCount);
+        std::vector<uint32_t>& input = m_inputScratch;
+        input.clear();
+        auto appendBlocks = [&input](const uint32_t* stream, uint32_t streamBlocks, uint32_t first, uint32_t count) {
+            const uint32_t* data = stream + streamBlocks + 1;
+            for (uint32_t b = 0; b <= count; b++) {
+                input.push_back(stream[first + b] - stream[first]);
+            }
+            input.insert(input.end(), data + stream[first], data + stream[first + count]);
+        };
+        appendBlocks(vertexStream, meshCodecBlockCount(cache.vertexCount), firstVertexBlock, vertexBlocks);
+        uint32_t indexTable = static_cast<uint32_t>(input.size());
+        appendBlocks(indexStream, meshCodecBlockCount(cache.indexCount), firstIndexBlock, indexBlocks);
+
+        Job job;
+        job.vertexThreads = vertexBlocks * (vertexStride / sizeof(uint32_t));
+        job.indexBlocks = indexBlocks;
+        VkDescriptorBufferInfo positions = window(target.buffer, target.positionOffset, target.positionSize);
+        VkDescriptorBufferInfo attributes = target.attributeSize != 0 ? window(target.buffer, target.attributeOffset, target.attributeSize) : positions;
+        VkDescriptorBufferInfo indices = window(target.buffer, target.indexOffset, target.indexSize);
+        uint32_t strideWords = vertexStride / sizeof(uint32_t);
+        job.constants = {
+            vertexBlocks, strideWords, target.attributeSize != 0 ? target.positionStride / static_cast<uint32_t>(sizeof(uint32_t)) : strideWords,
+            submesh.firstVertex - firstVertexBlock * MESH_CODEC_BLOCK,
+            wordOffset(target.positionOffset, positions), wordOffset(target.attributeOffset, attributes), submesh.vertexCount, 0,
+            indexBlocks, indexCount, cache.indexSize, indexTable,
+            wordOffset(target.indexOffset, indices), 0, 0, 0,
+        };
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = input.size() * sizeof(uint32_t);
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &job.input) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mesh decode input buffer!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, job.input, &memRequirements);
+        job.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true,
+            MemoryCategory::staging, 0, "mesh decode input");
+        vkBindBufferMemory(m_device, job.input, job.allocation.memory, job.allocation.offset);
+        memcpy(job.allocation.mapped, input.data(), bufferInfo.size);
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &job.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mesh decode descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = job.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkAllocateDescriptorSets(m_device, &allocInfo, &job.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate mesh decode descriptor set!");
+        }
+
+        std::array<VkDescriptorBufferInfo, 4> bufferInfos = {VkDescriptorBufferInfo{job.input, 0, VK_WHOLE_SIZE}, positions, attributes, indices};
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = job.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        return job;
+    }
+
+    // mesh codec：顶点和索引在同一次dispatch中解码，结束时的barrier让之后的绘制（dstStages中的读取）看到解码的结果
+    void record(VkCommandBuffer commandBuffer, const Job& job, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages) const {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &job.descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(job.constants), job.constants.data());
+        uint32_t threads = std::max(job.vertexThreads, job.indexBlocks);
+        vkCmdDispatch(commandBuffer, (threads + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 2, 1);
+
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // mesh codec：解码的命令完成之后调用，通常交给UploadContext::deferUntilComplete
+    void finish(Job& job) {
+        vkDestroyDescriptorPool(m_device, job.descriptorPool, hostAllocator());
+        vkDestroyBuffer(m_device, job.input, hostAllocator());
+        m_allocator->free(job.allocation);
+        job = Job{};
+    }
+
+private:
+    // mesh codec：绑定的起点向下对齐到minStorageBufferOffsetAlignment，16位索引的范围向上补齐到uint
+    VkDescriptorBufferInfo window(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) const {
+        VkDeviceSize start = offset / m_offsetAlignment * m_offsetAlignment;
+        return {buffer, start, (offset + size - start + 3) / 4 * 4};
+    }
+
+    static uint32_t wordOffset(VkDeviceSize offset, const VkDescriptorBufferInfo& window) {
+        return static_cast<uint32_t>((offset - window.offset) / sizeof(uint32_t));
+    }
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mesh decode descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(Job::constants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mesh decode pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mesh decode shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create mesh decode compute pipeline!");
+        }
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkDeviceSize m_maxStorageBufferRange = 0;
+    VkDeviceSize m_offsetAlignment = sizeof(uint32_t);
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    std::vector<uint32_t> m_inputScratch;  // 主线程上传时复用
+};
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// gpu mesh import：obj面上的corner（位置编号、uv编号）上传到gpu，顶点去重、编号和索引重映射在mesh_dedup.comp中完成
+// 去重用开放寻址的hash表代替排序：插入是一个pass，之后对槽做一次scan就得到连续的顶点编号，不需要多轮的radix sort
+// 顶点按槽的顺序编号，不是第一次出现的顺序，导入之后的optimizeMesh按索引重新排列顶点
+// key是编号而不是顶点的值：文件中重复写出的相同位置不会合并，顶点可能比cpu按值去重多一些，绘制结果相同
+// 结果写进host visible的buffer由cpu读回，后面的优化、拆分、meshlet和mesh cache都在cpu上，和cpu导入共用
+// 每次导入的buffer单独创建，读回之后销毁，多个模型可以同时导入
+class GpuMeshImporter {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 256;  // 和mesh_dedup.comp的local_size_x一致
+    static constexpr uint32_t VERTEX_FLOATS = 8;  // 和mesh_dedup.comp写入的顶点一致：pos、color、texCoord
+    static constexpr uint32_t NO_TEX_COORD = UINT32_MAX;
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    // gpu mesh import：一次导入的所有buffer，corners、positions和texCoords由cpu写入，groupSums、vertices和indices由cpu读回
+    struct Job {
+        uint32_t cornerCount = 0;
+        uint32_t tableSize = 0;
+        std::array<Buffer, 9> buffers;  // 和mesh_dedup.comp的binding顺序一致
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        uint32_t* corners() const { return static_cast<uint32_t*>(buffers[0].allocation.mapped); }  // 每个corner两个uint
+        float* positions() const { return static_cast<float*>(buffers[1].allocation.mapped); }
+        float* texCoords() const { return static_cast<float*>(buffers[2].allocation.mapped); }
+        uint32_t vertexCount() const { return static_cast<const uint32_t*>(buffers[6].allocation.mapped)[tableSize / WORKGROUP_SIZE]; }
+        const float* vertices() const { return static_cast<const float*>(buffers[7].allocation.mapped); }
+        const uint32_t* indices() const { return static_cast<const uint32_t*>(buffers[8].allocation.mapped); }
+    };
+
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, VkDeviceSize maxStorageBufferRange) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_maxStorageBufferRange = maxStorageBufferRange;
+        createPipeline(pipelineCache, shaderCode);
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // gpu mesh import：最大的buffer（hash表的两个数组和最坏情况下每个corner一个顶点的输出）需要在maxStorageBufferRange之内
+    // 初始化之后不变，可以在job pool中调用
+    bool fits(size_t cornerCount, size_t positionCount, size_t texCoordCount) const {
+        if (!initialized() || cornerCount == 0 || cornerCount > UINT32_MAX / 2 || positionCount >= UINT32_MAX || texCoordCount >= UINT32_MAX) {
+            return false;
+        }
+        VkDeviceSize largest = std::max({VkDeviceSize(tableSizeFor(cornerCount)) * sizeof(uint32_t), VkDeviceSize(cornerCount) * VERTEX_FLOATS * sizeof(float),
+            VkDeviceSize(positionCount) * 3 * sizeof(float)});
+        return largest <= m_maxStorageBufferRange;
+    }
+
+    // gpu mesh import：创建这次导入的buffer和descriptor set，调用者之后写入corners、positions和texCoords（可以在其它线程）
+    Job begin(uint32_t cornerCount, uint32_t positionCount, uint32_t texCoordCount) {
+        Job job;
+        job.cornerCount = cornerCount;
+        job.tableSize = tableSizeFor(cornerCount);
+        uint32_t groupCount = job.tableSize / WORKGROUP_SIZE;
+
+        VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        VkMemoryPropertyFlags deviceLocal = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        const struct {
+            VkDeviceSize size;
+            VkMemoryPropertyFlags properties;
+            const char* name;
+        } layouts[9] = {
+            {VkDeviceSize(cornerCount) * 2 * sizeof(uint32_t), hostVisible, "gpu mesh import corners"},
+            {VkDeviceSize(positionCount) * 3 * sizeof(float), hostVisible, "gpu mesh import positions"},
+            {VkDeviceSize(std::max(texCoordCount, 1u)) * 2 * sizeof(float), hostVisible, "gpu mesh import uvs"},  // 没有uv时也需要一个有效的buffer
+            {VkDeviceSize(job.tableSize) * sizeof(uint32_t), deviceLocal, "gpu mesh import table"},
+            {VkDeviceSize(cornerCount) * sizeof(uint32_t), deviceLocal, "gpu mesh import corner slots"},
+            {VkDeviceSize(job.tableSize) * sizeof(uint32_t), deviceLocal, "gpu mesh import slot vertices"},
+            {VkDeviceSize(groupCount + 1) * sizeof(uint32_t), hostVisible, "gpu mesh import group sums"},
+            {VkDeviceSize(cornerCount) * VERTEX_FLOATS * sizeof(float), hostVisible, "gpu mesh import vertices"},
+            {VkDeviceSize(cornerCount) * sizeof(uint32_t), hostVisible, "gpu mesh import indices"},
+        };
+        for (size_t i = 0; i < job.buffers.size(); i++) {
+            VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | (i == 3 ? VK_BUFFER_USAGE_TRANSFER_DST_BIT : 0);
+            // 读回的buffer优先使用host cached的内存，cpu读取uncached的内存很慢
+            VkMemoryPropertyFlags preferred = i >= 6 ? VK_MEMORY_PROPERTY_HOST_CACHED_BIT : 0;
+            job.buffers[i] = createBuffer(layouts[i].size, usage, layouts[i].properties, preferred, layouts[i].name);
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<uint32_t>(job.buffers.size())};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &job.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu mesh import descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = job.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkAllocateDescriptorSets(m_device, &allocInfo, &job.descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate gpu mesh import descriptor set!");
+        }
+
+        std::array<VkDescriptorBufferInfo, 9> bufferInfos{};
+        std::array<VkWriteDescriptorSet, 9> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            bufferInfos[i] = {job.buffers[i].buffer, 0, VK_WHOLE_SIZE};
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = job.descriptorSet;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        return job;
+    }
+
+    // gpu mesh import：在图形队列的upload command buffer中录制，结束时的barrier让host在上传完成之后读到结果
+    void record(VkCommandBuffer commandBuffer, const Job& job) const {
+        vkCmdFillBuffer(commandBuffer, job.buffers[3].buffer, 0, VK_WHOLE_SIZE, 0);
+        bufferBarrier(commandBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &job.descriptorSet, 0, nullptr);
+        uint32_t groupCount = job.tableSize / WORKGROUP_SIZE;
+        uint32_t cornerGroups = (job.cornerCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+        const uint32_t passGroups[5] = {cornerGroups, groupCount, 1, groupCount, cornerGroups};
+        for (uint32_t pass = 0; pass < 5; pass++) {
+            if (pass > 0) {
+                bufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            }
+            PushConstants constants{pass, job.cornerCount, job.tableSize - 1, groupCount};
+            vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            // dispatch的x最多DISPATCH_WIDTH，更多的workgroup放到y；槽的workgroup数量是2的幂，正好铺满，corner的pass多出的线程直接返回
+            uint32_t width = std::min(passGroups[pass], DISPATCH_WIDTH);
+            vkCmdDispatch(commandBuffer, width, (passGroups[pass] + width - 1) / width, 1);
+        }
+        bufferBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+    }
+
+    // gpu mesh import：上传完成、结果读回之后调用
+    void finish(Job& job) {
+        vkDestroyDescriptorPool(m_device, job.descriptorPool, hostAllocator());
+        for (Buffer& buffer : job.buffers) {
+            vkDestroyBuffer(m_device, buffer.buffer, hostAllocator());
+            m_allocator->free(buffer.allocation);
+        }
+        job = Job{};
+    }
+
+private:
+    static constexpr uint32_t DISPATCH_WIDTH = 32768;  // 2的幂，不超过maxComputeWorkGroupCount保证的最小值65535
+
+    struct PushConstants {
+        uint32_t pass;
+        uint32_t cornerCount;
+        uint32_t tableMask;
+        uint32_t groupCount;
+    };
+
+    // gpu mesh import：槽的数量至少是corner的两倍（load factor不超过0.5，线性探测很短），是2的幂并且是workgroup的整数倍
+    static uint32_t tableSizeFor(size_t cornerCount) {
+        uint32_t size = WORKGROUP_SIZE;
+        while (size < cornerCount * 2) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, 9> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu mesh import descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu mesh import pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu mesh import shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu mesh import compute pipeline!");
+        }
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred, const char* name) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create gpu mesh import buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        buffer.allocation = m_allocator->allocate(memRequirements, properties, true, MemoryCategory::geometry, preferred, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+        return buffer;
+    }
+
+    // gpu mesh import：这些buffer只在这个类中使用，global memory barrier就足够了
+    static void bufferBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkDeviceSize m_maxStorageBufferRange = 0;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+};
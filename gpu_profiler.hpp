@@ -0,0 +1,353 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+#include "host_memory.hpp"
+
+// gpu profiler：之前只有cpu上calculateFPS的平均帧时间，看不出gpu在哪个pass上花了多少时间
+// 每个frame in flight一个timestamp query pool，pass前后各写一个timestamp，差值乘timestampPeriod得到纳秒
+// 结果在下一次使用这个frame in flight时读取，这时timeline已经确认gpu完成了上一次提交，读取不会阻塞
+// scope按名字分配固定的query序号，command cache重复提交同一份录制时序号也不变
+// pipeline statistics：可选的每个scope一个VK_QUERY_TYPE_PIPELINE_STATISTICS query，统计顶点、图元和shader调用次数
+// 同一类型的query不能嵌套，只有不包含其它scope的pass级scope开启统计
+// gpu timeline：VK_EXT_calibrated_timestamps同时读取gpu和host的时钟，timestamp换算到steady_clock之后写进cpu profiler的"gpu queue" track
+// 导出的trace中cpu的录制、提交和gpu的执行在同一条时间线上，可以看到提交之间gpu空闲的间隙和gpu等待cpu的时间
+class GpuProfiler {
+public:
+    // pipeline statistics：结果按flag的bit顺序排列
+    enum PipelineStatistic {
+        inputAssemblyVertices,
+        inputAssemblyPrimitives,
+        vertexShaderInvocations,
+        clippingPrimitives,
+        fragmentShaderInvocations,
+        PIPELINE_STATISTIC_COUNT
+    };
+
+    static constexpr VkQueryPipelineStatisticFlags PIPELINE_STATISTIC_FLAGS =
+        VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT | VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+        VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+    struct ScopeStats {
+        std::string name;
+        float minMs = 0.f;
+        float avgMs = 0.f;
+        float maxMs = 0.f;
+        bool hasStatistics = false;
+        uint64_t statistics[PIPELINE_STATISTIC_COUNT] = {};  // 最近一次有效的结果
+    };
+
+    // gpu profiler：不支持timestamp的queue family（timestampValidBits为0）不初始化，所有接口都直接返回
+    // pipeline statistics：pipelineStatistics为true时设备必须开启了pipelineStatisticsQuery feature
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamily, uint32_t frameCount, bool pipelineStatistics) {
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+        uint32_t validBits = queueFamilies[queueFamily].timestampValidBits;
+        if (validBits == 0) {
+            return;
+        }
+        m_validMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_timestampPeriod = properties.limits.timestampPeriod;
+
+        m_device = device;
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            VkQueryPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            poolInfo.queryCount = MAX_SCOPES * 2;
+            if (vkCreateQueryPool(m_device, &poolInfo, hostAllocator(), &frame.pool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create timestamp query pool!");
+            }
+            if (!pipelineStatistics) {
+                continue;
+            }
+            VkQueryPoolCreateInfo statisticsInfo{};
+            statisticsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+            statisticsInfo.queryCount = MAX_SCOPES;
+            statisticsInfo.pipelineStatistics = PIPELINE_STATISTIC_FLAGS;
+            if (vkCreateQueryPool(m_device, &statisticsInfo, hostAllocator(), &frame.statisticsPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create pipeline statistics query pool!");
+            }
+        }
+    }
+
+    // gpu timeline：设备开启了VK_EXT_calibrated_timestamps之后调用，不支持device时间域时不校准
+    // host的时间域和steady_clock相同时（linux上steady_clock是CLOCK_MONOTONIC）一次调用同时取两个时钟，否则在调用前后读取steady_clock取中点，误差是调用耗时的一半
+    void enableCalibration(VkInstance instance, VkPhysicalDevice physicalDevice) {
+        if (!initialized()) {
+            return;
+        }
+        auto getTimeDomains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+        auto getCalibratedTimestamps = (PFN_vkGetCalibratedTimestampsEXT) vkGetDeviceProcAddr(m_device, "vkGetCalibratedTimestampsEXT");
+        if (getTimeDomains == nullptr || getCalibratedTimestamps == nullptr) {
+            return;
+        }
+        uint32_t count = 0;
+        getTimeDomains(physicalDevice, &count, nullptr);
+        std::vector<VkTimeDomainEXT> domains(count);
+        getTimeDomains(physicalDevice, &count, domains.data());
+        if (std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) == domains.end()) {
+            return;
+        }
+#if defined(__linux__)
+        m_hostTimeDomain = std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT) != domains.end();
+#endif
+        m_getCalibratedTimestamps = getCalibratedTimestamps;
+        if (m_track == nullptr) {
+            m_track = CpuProfiler::instance().createTrack("gpu queue");
+        }
+        calibrate();
+    }
+
+    bool calibrated() const { return m_getCalibratedTimestamps != nullptr && m_calibrationTime != CpuProfiler::Clock::time_point{}; }
+
+    void cleanup() {
+        m_getCalibratedTimestamps = nullptr;
+        m_calibrationTime = {};
+        for (Frame& frame : m_frames) {
+            vkDestroyQueryPool(m_device, frame.pool, hostAllocator());
+            if (frame.statisticsPool != VK_NULL_HANDLE) {
+                vkDestroyQueryPool(m_device, frame.statisticsPool, hostAllocator());
+            }
+        }
+        m_frames.clear();
+    }
+
+    bool initialized() const { return !m_frames.empty(); }
+    bool statisticsEnabled() const { return initialized() && m_frames[0].statisticsPool != VK_NULL_HANDLE; }
+
+    // gpu profiler：timeline确认这个frame in flight上一次提交完成之后调用，读取它的timestamp并累计到滑动窗口
+    void collect(uint32_t frame) {
+        if (!initialized() || m_frames[frame].recordedScopes == 0) {
+            return;
+        }
+        Frame& slot = m_frames[frame];
+        // 每个query两个uint64：timestamp和availability，没有WAIT_BIT，还不可用的query跳过
+        std::vector<uint64_t>& results = m_results;  // heap tracker：每帧复用
+        results.resize(slot.recordedScopes * 2 * 2);
+        VkResult result = vkGetQueryPoolResults(m_device, slot.pool, 0, slot.recordedScopes * 2, results.size() * sizeof(uint64_t), results.data(),
+            2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (result != VK_SUCCESS && result != VK_NOT_READY) {
+            return;
+        }
+        // gpu timeline：两个时钟的频率有微小的差别，每隔CALIBRATION_INTERVAL重新校准，误差不会累积
+        bool timeline = m_getCalibratedTimestamps != nullptr && CpuProfiler::instance().enabled();
+        if (timeline && CpuProfiler::Clock::now() - m_calibrationTime > CALIBRATION_INTERVAL) {
+            calibrate();
+        }
+        timeline = timeline && calibrated();
+        for (uint32_t scope = 0; scope < slot.recordedScopes; scope++) {
+            const uint64_t* begin = &results[scope * 4];
+            const uint64_t* end = &results[scope * 4 + 2];
+            if (begin[1] == 0 || end[1] == 0) {
+                continue;
+            }
+            uint64_t ticks = ((end[0] & m_validMask) - (begin[0] & m_validMask)) & m_validMask;
+            addSample(scope, static_cast<float>(static_cast<double>(ticks) * m_timestampPeriod * 1e-6));
+            if (timeline) {
+                CpuProfiler::instance().record(*m_track, m_scopes[scope].traceName, hostTime(begin[0]), hostTime(end[0]));
+            }
+        }
+
+        for (uint32_t scope = 0; scope < slot.recordedScopes; scope++) {
+            if (!(slot.statisticsScopes & (1u << scope))) {
+                continue;
+            }
+            uint64_t values[PIPELINE_STATISTIC_COUNT + 1] = {};  // 最后一个是availability
+            result = vkGetQueryPoolResults(m_device, slot.statisticsPool, scope, 1, sizeof(values), values, sizeof(values),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+            if ((result == VK_SUCCESS || result == VK_NOT_READY) && values[PIPELINE_STATISTIC_COUNT] != 0) {
+                std::copy(values, values + PIPELINE_STATISTIC_COUNT, m_scopes[scope].statistics);
+                m_scopes[scope].hasStatistics = true;
+            }
+        }
+    }
+
+    // gpu profiler：录制command buffer开头调用，重置这个frame in flight的所有query
+    // query在reset之后到写入之前不可用，没有写入的scope不会读到上一次的值
+    void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame) {
+        if (!initialized()) {
+            return;
+        }
+        vkCmdResetQueryPool(commandBuffer, m_frames[frame].pool, 0, MAX_SCOPES * 2);
+        if (m_frames[frame].statisticsPool != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, m_frames[frame].statisticsPool, 0, MAX_SCOPES);
+        }
+    }
+
+    // gpu profiler：begin和end必须在同一个command buffer中，并且不能在render pass或者dynamic rendering内部
+    // begin等待之前的命令开始执行就写入（TOP_OF_PIPE），end等待之前的命令全部完成（BOTTOM_OF_PIPE）
+    // pipeline statistics：statistics为true时同时开始统计query，这个scope之内不能再有开启统计的scope
+    // scope之内执行secondary command buffer时需要inheritedQueries feature，并且inheritance的pipelineStatistics包含PIPELINE_STATISTIC_FLAGS
+    uint32_t begin(VkCommandBuffer commandBuffer, uint32_t frame, std::string_view name, bool statistics = false) {
+        if (!initialized()) {
+            return UINT32_MAX;
+        }
+        uint32_t scope = scopeIndex(name);
+        if (scope == UINT32_MAX) {
+            return scope;
+        }
+        Frame& slot = m_frames[frame];
+        slot.recordedScopes = std::max(slot.recordedScopes, scope + 1);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.pool, scope * 2);
+        if (statistics && slot.statisticsPool != VK_NULL_HANDLE) {
+            vkCmdBeginQuery(commandBuffer, slot.statisticsPool, scope, 0);
+            slot.statisticsScopes |= 1u << scope;
+        } else {
+            slot.statisticsScopes &= ~(1u << scope);
+        }
+        return scope;
+    }
+
+    void end(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t scope) {
+        if (scope == UINT32_MAX) {
+            return;
+        }
+        Frame& slot = m_frames[frame];
+        if (slot.statisticsScopes & (1u << scope)) {
+            vkCmdEndQuery(commandBuffer, slot.statisticsPool, scope);
+        }
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot.pool, scope * 2 + 1);
+    }
+
+    // gpu profiler：最近WINDOW次有效样本的min/avg/max，按scope第一次出现的顺序
+    // heap tracker：写进调用者复用的vector，name的容量也会保留
+    void stats(std::vector<ScopeStats>& result) const {
+        size_t count = 0;
+        for (const Scope& scope : m_scopes) {
+            if (scope.count == 0) {
+                continue;
+            }
+            if (count == result.size()) {
+                result.emplace_back();
+            }
+            ScopeStats& stats = result[count++];
+            stats.name = scope.name;
+            stats.minMs = scope.samples[0];
+            stats.maxMs = scope.samples[0];
+            float sum = 0.f;
+            for (uint32_t i = 0; i < scope.count; i++) {
+                stats.minMs = std::min(stats.minMs, scope.samples[i]);
+                stats.maxMs = std::max(stats.maxMs, scope.samples[i]);
+                sum += scope.samples[i];
+            }
+            stats.avgMs = sum / scope.count;
+            stats.hasStatistics = scope.hasStatistics;
+            std::copy(scope.statistics, scope.statistics + PIPELINE_STATISTIC_COUNT, stats.statistics);
+        }
+        result.resize(count);
+    }
+
+    // benchmark：某个scope最近一次读到的耗时，没有结果时返回0
+    float latestMs(std::string_view name) const {
+        for (const Scope& scope : m_scopes) {
+            if (scope.name == name && scope.count > 0) {
+                return scope.samples[(scope.next + WINDOW - 1) % WINDOW];
+            }
+        }
+        return 0.f;
+    }
+
+private:
+    static constexpr uint32_t MAX_SCOPES = 32;  // statisticsScopes是32位的mask
+    static constexpr uint32_t WINDOW = 120;
+    static constexpr std::chrono::seconds CALIBRATION_INTERVAL{1};
+
+    struct Frame {
+        VkQueryPool pool = VK_NULL_HANDLE;
+        VkQueryPool statisticsPool = VK_NULL_HANDLE;  // pipeline statistics：没有开启时为空
+        uint32_t recordedScopes = 0;  // 录制过的最大scope序号加一，读取前面这些query
+        uint32_t statisticsScopes = 0;  // 最近一次录制中开启了统计的scope
+    };
+
+    struct Scope {
+        std::string name;
+        const char* traceName = nullptr;  // gpu timeline：cpu profiler中保存到程序结束的名字
+        float samples[WINDOW] = {};
+        uint32_t count = 0;
+        uint32_t next = 0;
+        bool hasStatistics = false;
+        uint64_t statistics[PIPELINE_STATISTIC_COUNT] = {};
+    };
+
+    // gpu profiler：超过MAX_SCOPES的scope不计时
+    uint32_t scopeIndex(std::string_view name) {
+        for (uint32_t i = 0; i < m_scopes.size(); i++) {
+            if (m_scopes[i].name == name) {
+                return i;
+            }
+        }
+        if (m_scopes.size() == MAX_SCOPES) {
+            return UINT32_MAX;
+        }
+        m_scopes.emplace_back();
+        m_scopes.back().name = name;
+        m_scopes.back().traceName = CpuProfiler::instance().intern(name);
+        return static_cast<uint32_t>(m_scopes.size() - 1);
+    }
+
+    void addSample(uint32_t scope, float ms) {
+        Scope& entry = m_scopes[scope];
+        entry.samples[entry.next] = ms;
+        entry.next = (entry.next + 1) % WINDOW;
+        entry.count = std::min(entry.count + 1, WINDOW);
+    }
+
+    // gpu timeline：同时读取device和host的时钟，记录一对对应的时间
+    void calibrate() {
+        VkCalibratedTimestampInfoEXT infos[2]{};
+        infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+        infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+        uint64_t timestamps[2] = {};
+        uint64_t maxDeviation = 0;
+        CpuProfiler::Clock::time_point before = CpuProfiler::Clock::now();
+        if (m_getCalibratedTimestamps(m_device, m_hostTimeDomain ? 2 : 1, infos, timestamps, &maxDeviation) != VK_SUCCESS) {
+            return;
+        }
+        CpuProfiler::Clock::time_point after = CpuProfiler::Clock::now();
+        m_calibrationTicks = timestamps[0] & m_validMask;
+        m_calibrationHost = m_hostTimeDomain
+            ? CpuProfiler::Clock::time_point(std::chrono::duration_cast<CpuProfiler::Clock::duration>(std::chrono::nanoseconds(timestamps[1])))
+            : before + (after - before) / 2;
+        m_calibrationTime = after;
+    }
+
+    // gpu timeline：timestamp可能早于校准的时间，差值按validBits的回绕取有符号数
+    CpuProfiler::Clock::time_point hostTime(uint64_t timestamp) const {
+        uint64_t forward = ((timestamp & m_validMask) - m_calibrationTicks) & m_validMask;
+        double ticks = forward > m_validMask / 2 ? -static_cast<double>((m_calibrationTicks - (timestamp & m_validMask)) & m_validMask) : static_cast<double>(forward);
+        return m_calibrationHost + std::chrono::duration_cast<CpuProfiler::Clock::duration>(std::chrono::duration<double, std::nano>(ticks * m_timestampPeriod));
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    float m_timestampPeriod = 1.f;
+    uint64_t m_validMask = 0;
+    std::vector<Frame> m_frames;
+    std::vector<Scope> m_scopes;
+    std::vector<uint64_t> m_results;
+    PFN_vkGetCalibratedTimestampsEXT m_getCalibratedTimestamps = nullptr;  // gpu timeline：没有开启校准时为空
+    bool m_hostTimeDomain = false;
+    uint64_t m_calibrationTicks = 0;
+    CpuProfiler::Clock::time_point m_calibrationHost;
+    CpuProfiler::Clock::time_point m_calibrationTime;  // 最近一次校准的cpu时间，默认值表示还没有校准
+    CpuProfiler::Track* m_track = nullptr;
+};
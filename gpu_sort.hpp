@@ -0,0 +1,239 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// gpu radix sort：调用者buffer中的uvec2 (key, value)按key升序稳定排序，cpu端的同类排序是draw_sort.hpp的DrawSorter
+// 每趟8位一共4趟，每趟三个dispatch：block直方图、整个直方图的scan、按tile稳定地scatter；元素在调用者的buffer和内部的scratch之间交替，4趟之后回到调用者的buffer
+// 元素数量由gpu写入（比如粒子的存活数量），从count buffer读取，dispatch的大小按容量固定，超出数量的block只写零直方图
+// 没有使用onesweep的decoupled look-back：它需要workgroup之间的前进保证，vulkan没有提供；reduce-then-scan多两次dispatch，但在所有设备上正确
+// subgroup ranking的shader变体用ballot计算tile内的名次，设备支持compute stage的ballot时由调用者选择
+class GpuRadixSort {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 256;  // 和radix_sort.comp的local_size_x一致
+    static constexpr uint32_t ITEMS_PER_THREAD = 16;
+    static constexpr uint32_t TILE_SIZE = WORKGROUP_SIZE * ITEMS_PER_THREAD;
+    static constexpr uint32_t RADIX = 256;
+    static constexpr uint32_t KEY_BITS = 32;
+    static constexpr uint32_t DIGIT_BITS = 8;
+
+    static bool subgroupRankingSupported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceSubgroupProperties subgroup{};
+        subgroup.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &subgroup;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        VkSubgroupFeatureFlags operations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+        return (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) && (subgroup.supportedOperations & operations) == operations;
+    }
+
+    // gpu radix sort：elements至少有capacity个uvec2；countBuffer中的uint是元素数量，record时选择下标，大于capacity时按capacity排序
+    // 两个buffer都需要STORAGE_BUFFER_BIT，由调用者持有
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, uint32_t capacity, VkBuffer elements,
+        VkBuffer countBuffer) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_capacity = capacity;
+        m_blockCount = (capacity + TILE_SIZE - 1) / TILE_SIZE;
+        createPipeline(pipelineCache, shaderCode);
+        m_scratch = createBuffer(VkDeviceSize(capacity) * sizeof(glm::uvec2), "radix sort scratch");
+        m_histograms = createBuffer(VkDeviceSize(RADIX) * m_blockCount * sizeof(uint32_t), "radix sort histograms");
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNT};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create radix sort descriptor pool!");
+        }
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = m_descriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkAllocateDescriptorSets(m_device, &setInfo, &m_descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate radix sort descriptor set!");
+        }
+
+        std::array<VkDescriptorBufferInfo, BINDING_COUNT> bufferInfos = {{{elements, 0, VK_WHOLE_SIZE}, {m_scratch.buffer, 0, VK_WHOLE_SIZE},
+            {m_histograms.buffer, 0, VK_WHOLE_SIZE}, {countBuffer, 0, VK_WHOLE_SIZE}}};
+        std::array<VkWriteDescriptorSet, BINDING_COUNT> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = m_descriptorSet;
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    // gpu radix sort：调用者保证gpu已经空闲
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        destroyBuffer(m_scratch);
+        destroyBuffer(m_histograms);
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // gpu radix sort：调用之前元素和数量的写入已经对compute shader可见；录制结束时排序结果对compute shader可见，其他stage由调用者同步
+    // 会改变绑定的compute pipeline和descriptor set
+    void record(VkCommandBuffer commandBuffer, uint32_t countIndex) const {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+        PushConstants constants{};
+        constants.sizes = glm::uvec4(m_capacity, m_blockCount, 0, 0);
+        for (uint32_t shift = 0; shift < KEY_BITS; shift += DIGIT_BITS) {
+            uint32_t direction = (shift / DIGIT_BITS) & 1;
+            constants.control = glm::uvec4(PASS_HISTOGRAM, shift, direction, countIndex);
+            dispatch(commandBuffer, constants, m_blockCount);
+            constants.control.x = PASS_SCAN;
+            dispatch(commandBuffer, constants, 1);
+            constants.control.x = PASS_SCATTER;
+            dispatch(commandBuffer, constants, m_blockCount);
+        }
+    }
+
+private:
+    static constexpr uint32_t BINDING_COUNT = 4;
+    // gpu radix sort：和radix_sort.comp中的pass编号一致
+    static constexpr uint32_t PASS_HISTOGRAM = 0;
+    static constexpr uint32_t PASS_SCAN = 1;
+    static constexpr uint32_t PASS_SCATTER = 2;
+    static_assert(KEY_BITS / DIGIT_BITS % 2 == 0, "the sorted elements must end up in the caller's buffer");
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    // gpu radix sort：和radix_sort.comp的push constant一致
+    struct PushConstants {
+        glm::uvec4 control;  // pass、这一趟的位移、方向、元素数量在count buffer中的下标
+        glm::uvec4 sizes;  // 容量、block数量
+    };
+
+    // gpu radix sort：每个dispatch读取上一个dispatch写入的直方图或元素
+    void dispatch(VkCommandBuffer commandBuffer, const PushConstants& constants, uint32_t groupCount) const {
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create radix sort descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create radix sort pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create radix sort shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create radix sort compute pipeline!");
+        }
+    }
+
+    Buffer createBuffer(VkDeviceSize size, const char* name) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create radix sort buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        buffer.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, MemoryCategory::other, 0, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+        return buffer;
+    }
+
+    void destroyBuffer(Buffer& buffer) {
+        vkDestroyBuffer(m_device, buffer.buffer, hostAllocator());
+        m_allocator->free(buffer.allocation);
+        buffer = {};
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_capacity = 0;
+    uint32_t m_blockCount = 0;
+    Buffer m_scratch;
+    Buffer m_histograms;  // digit为主序，每个digit m_blockCount个uint
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <ostream>
+
+// heap tracker：HostMemoryTracker只看到驱动通过VkAllocationCallbacks的分配，应用自己的new（std::string、std::vector、std::function）看不到
+// 全局operator new的替换定义在renderer.cpp中（HEAP_TRACKER_IMPLEMENTATION），开启时每次分配给当前线程的计数加一，关闭时只多一次原子读取
+// 计数是thread_local的：帧循环只读取自己所在线程（主线程或者渲染线程）的计数，工作线程、加载线程和驱动线程的分配不算进这一帧
+// 直接调用malloc的分配（stb、驱动内部）不经过operator new，不在统计范围中
+class HeapTracker {
+public:
+    static void setEnabled(bool enabled) { s_enabled.store(enabled, std::memory_order_relaxed); }
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    // heap tracker：当前线程在开启期间operator new的次数，只增加
+    static uint64_t threadAllocations() { return t_allocations; }
+
+    static void countAllocation() {
+        if (s_enabled.load(std::memory_order_relaxed)) {
+            t_allocations++;
+        }
+    }
+
+private:
+    static inline std::atomic<bool> s_enabled{false};
+    static inline thread_local uint64_t t_allocations = 0;
+};
+
+// heap tracker：帧循环每帧调用beginFrame/endFrame，连续settleFrames个steady state的帧之后才开始检查
+// 前几帧vector增长到最终的容量、gpu profiler第一次遇到scope名字，这些一次性的分配不算
+// steady state由调用者判断（没有加载、上传、resize等），不是steady state时重新开始计数
+// 检查的帧有分配时输出前LOG_LIMIT次，abortOnAllocation为true时输出后马上abort，相当于assert
+class FrameHeapCheck {
+public:
+    static constexpr uint64_t LOG_LIMIT = 8;
+
+    void init(uint32_t settleFrames, bool abortOnAllocation) {
+        m_settleFrames = settleFrames;
+        m_abortOnAllocation = abortOnAllocation;
+    }
+
+    void beginFrame() { m_frameStart = HeapTracker::threadAllocations(); }
+
+    // heap tracker：输出在这一帧的计数之后，下一帧beginFrame重新取起点，日志本身的分配不算进任何一帧
+    void endFrame(bool steady) {
+        uint64_t allocations = HeapTracker::threadAllocations() - m_frameStart;
+        m_lastFrameAllocations = allocations;
+        if (!steady) {
+            m_steadyFrames = 0;
+            return;
+        }
+        if (m_steadyFrames < m_settleFrames) {
+            m_steadyFrames++;
+            return;
+        }
+        m_checkedFrames++;
+        if (allocations == 0) {
+            return;
+        }
+        m_allocatingFrames++;
+        m_totalAllocations += allocations;
+        m_peakFrameAllocations = std::max(m_peakFrameAllocations, allocations);
+        if (m_abortOnAllocation) {
+            std::fprintf(stderr, "heap tracker: steady-state frame %llu made %llu heap allocations\n", static_cast<unsigned long long>(m_checkedFrames),
+                static_cast<unsigned long long>(allocations));
+            std::abort();
+        }
+        if (m_allocatingFrames <= LOG_LIMIT) {
+            std::fprintf(stderr, "heap tracker: steady-state frame %llu made %llu heap allocations%s\n", static_cast<unsigned long long>(m_checkedFrames),
+                static_cast<unsigned long long>(allocations), m_allocatingFrames == LOG_LIMIT ? " (further frames are counted in the exit report)" : "");
+        }
+    }
+
+    uint64_t lastFrameAllocations() const { return m_lastFrameAllocations; }
+
+    void report(std::ostream& out) const {
+        out << "heap tracker: " << m_allocatingFrames << " of " << m_checkedFrames << " steady-state frames allocated";
+        if (m_allocatingFrames > 0) {
+            out << ", " << m_totalAllocations << " allocations, peak " << m_peakFrameAllocations << " per frame";
+        }
+        out << '\n';
+    }
+
+private:
+    uint32_t m_settleFrames = 0;
+    bool m_abortOnAllocation = false;
+    uint64_t m_frameStart = 0;
+    uint64_t m_lastFrameAllocations = 0;
+    uint32_t m_steadyFrames = 0;
+    uint64_t m_checkedFrames = 0;
+    uint64_t m_allocatingFrames = 0;
+    uint64_t m_totalAllocations = 0;
+    uint64_t m_peakFrameAllocations = 0;
+};
+
+#ifdef HEAP_TRACKER_IMPLEMENTATION
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// heap tracker：替换所有形式的全局operator new/delete，分配直接使用malloc；对齐的版本在Windows上必须和_aligned_free配对
+// 替换函数不内联：gcc把内联之后的new和free配对检查成不匹配的分配函数
+#if defined(_MSC_VER)
+#define HEAP_TRACKER_NOINLINE __declspec(noinline)
+#else
+#define HEAP_TRACKER_NOINLINE __attribute__((noinline))
+#endif
+namespace heap_tracker_detail {
+inline void* allocate(std::size_t size) {
+    HeapTracker::countAllocation();
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+inline void* allocateAligned(std::size_t size, std::align_val_t alignment) {
+    HeapTracker::countAllocation();
+    std::size_t align = static_cast<std::size_t>(alignment);
+    size = (std::max<std::size_t>(size, 1) + align - 1) / align * align;  // aligned_alloc要求大小是对齐的整数倍
+#ifdef _WIN32
+    return _aligned_malloc(size, align);
+#else
+    return std::aligned_alloc(align, size);
+#endif
+}
+
+inline void freeAligned(void* pointer) {
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+}  // namespace heap_tracker_detail
+
+HEAP_TRACKER_NOINLINE void* operator new(std::size_t size) {
+    if (void* pointer = heap_tracker_detail::allocate(size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+HEAP_TRACKER_NOINLINE void* operator new[](std::size_t size) { return operator new(size); }
+HEAP_TRACKER_NOINLINE void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return heap_tracker_detail::allocate(size); }
+HEAP_TRACKER_NOINLINE void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return heap_tracker_detail::allocate(size); }
+HEAP_TRACKER_NOINLINE void* operator new(std::size_t size, std::align_val_t alignment) {
+    if (void* pointer = heap_tracker_detail::allocateAligned(size, alignment)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+HEAP_TRACKER_NOINLINE void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+HEAP_TRACKER_NOINLINE void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return heap_tracker_detail::allocateAligned(size, alignment); }
+HEAP_TRACKER_NOINLINE void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return heap_tracker_detail::allocateAligned(size, alignment); }
+
+HEAP_TRACKER_NOINLINE void operator delete(void* pointer) noexcept { std::free(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete[](void* pointer) noexcept { std::free(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete(void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete[](void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete(void* pointer, std::align_val_t) noexcept { heap_tracker_detail::freeAligned(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete[](void* pointer, std::align_val_t) noexcept { heap_tracker_detail::freeAligned(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { heap_tracker_detail::freeAligned(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { heap_tracker_detail::freeAligned(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { heap_tracker_detail::freeAligned(pointer); }
+HEAP_TRACKER_NOINLINE void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { heap_tracker_detail::freeAligned(pointer); }
+#endif
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+
+// hitch detector：卡顿帧发生时的上下文，检测到时由调用者采样
+struct HitchContext {
+    uint64_t frame = 0;
+    uint32_t swapChainRecreations = 0;  // 启动以来重建swap chain的次数，detector比较前后两帧判断这一帧是否重建
+    uint64_t uploadBatchesInFlight = 0;  // 已经分配还没有完成的上传ticket数量，包括录制中的batch
+    size_t uploadRequestsWaiting = 0;  // upload scheduler中等待预算的请求
+    uint32_t pipelineCompilesInFlight = 0;
+    bool loading = false;
+};
+
+// hitch detector：线上偶尔的卡顿很难复现，frame stats只能统计次数
+// 最近HISTORY帧的帧时间取中位数，超过factor倍并且超过minMs的帧算作卡顿；cpu profiler每个线程的ring buffer和gpu timeline一直保留最近的事件
+// 检测到卡顿后再等待captureSeconds，让卡顿之后的事件和gpu结果（晚几帧读取）也写进ring buffer，然后导出卡顿前后各captureSeconds的trace和上下文
+// 一次导出之后的captureSeconds内不再检测，连续卡顿只导出第一次；最多导出maxCaptures个文件
+// 只在主线程调用
+class HitchDetector {
+public:
+    static constexpr uint32_t HISTORY = 120;
+
+    void init(float factor, float minMs, float captureSeconds, uint32_t maxCaptures, std::string pathPrefix) {
+        m_factor = factor;
+        m_minSeconds = minMs / 1000.f;
+        m_captureDuration = std::chrono::duration_cast<CpuProfiler::Clock::duration>(std::chrono::duration<float>(captureSeconds));
+        m_maxCaptures = maxCaptures;
+        m_pathPrefix = std::move(pathPrefix);
+        m_enabled = true;
+    }
+
+    // hitch detector：每帧调用一次，seconds是上一帧的帧时间；导出了trace时返回文件路径，否则返回空
+    std::string push(float seconds, const HitchContext& context) {
+        if (!m_enabled) {
+            return {};
+        }
+        CpuProfiler::Clock::time_point now = CpuProfiler::Clock::now();
+        std::string written;
+        if (m_pending && now >= m_pendingCapture.dumpTime) {
+            written = writeCapture();
+        }
+
+        bool recreated = m_hasPrevious && context.swapChainRecreations != m_previousRecreations;
+        m_previousRecreations = context.swapChainRecreations;
+        m_hasPrevious = true;
+
+        // 中位数不包括这一帧，卡顿帧也进入历史，连续的慢帧会逐渐抬高中位数
+        float median = this->median();
+        bool hitch = m_count >= HISTORY / 2 && seconds > m_minSeconds && seconds > median * m_factor;
+        m_history[m_next] = seconds;
+        m_next = (m_next + 1) % HISTORY;
+        m_count = std::min(m_count + 1, HISTORY);
+
+        if (hitch && !m_pending && now >= m_cooldownEnd && m_captures < m_maxCaptures) {
+            CpuProfiler::Clock::time_point frameStart = now - std::chrono::duration_cast<CpuProfiler::Clock::duration>(std::chrono::duration<float>(seconds));
+            CpuProfiler::instance().record("hitch", frameStart, now);  // trace中标出卡顿的帧
+            m_pending = true;
+            m_pendingCapture = {context, recreated, seconds * 1000.f, median * 1000.f, frameStart - m_captureDuration, now + m_captureDuration};
+            m_cooldownEnd = m_pendingCapture.dumpTime + m_captureDuration;
+        }
+        return written;
+    }
+
+    uint32_t captures() const { return m_captures; }
+
+private:
+    struct Capture {
+        HitchContext context;
+        bool swapChainRecreated = false;
+        float frameMs = 0.f;
+        float medianMs = 0.f;
+        CpuProfiler::Clock::time_point since;
+        CpuProfiler::Clock::time_point dumpTime;
+    };
+
+    float median() {
+        if (m_count == 0) {
+            return 0.f;
+        }
+        m_sorted.assign(m_history, m_history + m_count);  // heap tracker：容量在第一次之后复用
+        std::nth_element(m_sorted.begin(), m_sorted.begin() + m_count / 2, m_sorted.end());
+        return m_sorted[m_count / 2];
+    }
+
+    std::string writeCapture() {
+        m_pending = false;
+        const Capture& capture = m_pendingCapture;
+        std::ostringstream otherData;
+        otherData << "\"frame\":" << capture.context.frame << ",\"frameMs\":" << capture.frameMs << ",\"medianMs\":" << capture.medianMs
+                  << ",\"swapChainRecreated\":" << (capture.swapChainRecreated ? "true" : "false")
+                  << ",\"uploadBatchesInFlight\":" << capture.context.uploadBatchesInFlight
+                  << ",\"uploadRequestsWaiting\":" << capture.context.uploadRequestsWaiting
+                  << ",\"pipelineCompilesInFlight\":" << capture.context.pipelineCompilesInFlight
+                  << ",\"loading\":" << (capture.context.loading ? "true" : "false");
+        std::string path = m_pathPrefix + std::to_string(capture.context.frame) + ".json";
+        if (!CpuProfiler::instance().writeChromeTrace(path, capture.since, otherData.str())) {
+            return {};
+        }
+        m_captures++;
+        return path;
+    }
+
+    bool m_enabled = false;
+    float m_factor = 2.f;
+    float m_minSeconds = 0.f;
+    CpuProfiler::Clock::duration m_captureDuration{};
+    uint32_t m_maxCaptures = 0;
+    std::string m_pathPrefix;
+    float m_history[HISTORY] = {};
+    uint32_t m_next = 0;
+    uint32_t m_count = 0;
+    std::vector<float> m_sorted;
+    uint32_t m_previousRecreations = 0;
+    bool m_hasPrevious = false;
+    bool m_pending = false;
+    Capture m_pendingCapture;
+    CpuProfiler::Clock::time_point m_cooldownEnd;
+    uint32_t m_captures = 0;
+};
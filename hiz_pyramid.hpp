@@ -0,0 +1,319 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+#include "upload_context.hpp"
+
+// hi-z：把depth逐级缩小成R32_SFLOAT的mip pyramid，每个texel是它覆盖的区域中最远的深度
+// level 0是depth的一半大小，每一级再缩小一半，只要包围盒最近的深度比覆盖它的texel都远，包围盒就被完全挡住
+// pyramid一直处于GENERAL layout，cull shader通过sampler读取全部level，生成时每一级绑定上一级的单level view
+// 一帧生成的pyramid同时被这一帧第二阶段和下一帧第一阶段的剔除读取，所有访问都在同一个队列上，barrier按提交顺序生效
+class HiZPyramid {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 8;  // 和hiz_reduce.comp的local_size一致
+    // hi-z：resize时旧的image可能还被in flight的帧使用，由调用者延迟销毁
+    using RetireFunction = std::function<void(std::function<void()>)>;
+
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, uint32_t frameCount, RetireFunction retire) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_frameCount = frameCount;
+        m_retire = std::move(retire);
+
+        // hi-z：只用texelFetch读取，不会过滤，clamp让越界的坐标读到边缘
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+        if (vkCreateSampler(m_device, &samplerInfo, hostAllocator(), &m_sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hi-z sampler!");
+        }
+
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;  // 0是上一级（或depth），1是这一级
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hi-z descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hi-z pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hi-z shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hi-z compute pipeline!");
+        }
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        destroyPyramid(m_pyramid);
+        m_pyramid = {};
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        vkDestroySampler(m_device, m_sampler, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // hi-z：按depth的大小重新创建pyramid，内容是未定义的，调用者在下一次build之前不能用它剔除
+    // layout转换录制进upload context，调用者负责submit，之后提交的帧排在它后面
+    void resize(VkExtent2D depthExtent, UploadContext& uploadContext) {
+        if (m_pyramid.image != VK_NULL_HANDLE) {
+            Pyramid old = m_pyramid;
+            m_retire([this, old]() { destroyPyramid(old); });
+        }
+        m_pyramid = {};
+        m_pyramid.extent = {std::max(depthExtent.width / 2, 1u), std::max(depthExtent.height / 2, 1u)};
+        m_pyramid.levels = 1;
+        while ((std::max(m_pyramid.extent.width, m_pyramid.extent.height) >> m_pyramid.levels) > 0) {
+            m_pyramid.levels++;
+        }
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {m_pyramid.extent.width, m_pyramid.extent.height, 1};
+        imageInfo.mipLevels = m_pyramid.levels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = VK_FORMAT_R32_SFLOAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateImage(m_device, &imageInfo, hostAllocator(), &m_pyramid.image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hi-z image!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_device, m_pyramid.image, &memRequirements);
+        m_pyramid.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::attachment, 0, "hi-z pyramid");
+        vkBindImageMemory(m_device, m_pyramid.image, m_pyramid.allocation.memory, m_pyramid.allocation.offset);
+
+        m_pyramid.view = createView(0, m_pyramid.levels);
+        for (uint32_t level = 0; level < m_pyramid.levels; level++) {
+            m_pyramid.levelViews.push_back(createView(level, 1));
+        }
+
+        // hi-z：level 1以上的set只引用pyramid自己，创建时写入；level 0读取depth，每个frame in flight一个，depth的view变化时重写
+        VkDescriptorPoolSize poolSizes[2] = {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_pyramid.levels + m_frameCount},
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, m_pyramid.levels + m_frameCount}};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 2;
+        poolInfo.pPoolSizes = poolSizes;
+        poolInfo.maxSets = m_pyramid.levels + m_frameCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_pyramid.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hi-z descriptor pool!");
+        }
+        for (uint32_t level = 1; level < m_pyramid.levels; level++) {
+            m_pyramid.levelSets.push_back(allocateSet());
+            writeSet(m_pyramid.levelSets.back(), m_pyramid.levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL, m_pyramid.levelViews[level]);
+        }
+        for (uint32_t frame = 0; frame < m_frameCount; frame++) {
+            m_pyramid.depthSets.push_back(allocateSet());
+        }
+        m_pyramid.depthViews.assign(m_frameCount, VK_NULL_HANDLE);
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_pyramid.image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_pyramid.levels, 0, 1};
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(uploadContext.graphicsCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+            1, &barrier);
+    }
+
+    // hi-z：在render pass之外录制，depthView此时处于SHADER_READ_ONLY_OPTIMAL，结束时的barrier让之后的compute读取看到全部level
+    void build(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView depthView, VkExtent2D depthExtent) {
+        if (m_pyramid.depthViews[frameIndex] != depthView) {
+            writeSet(m_pyramid.depthSets[frameIndex], depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_pyramid.levelViews[0]);
+            m_pyramid.depthViews[frameIndex] = depthView;
+        }
+
+        // hi-z：上一次的读取（上一帧的第二阶段剔除和这一帧的第一阶段剔除）完成之后才能覆盖
+        memoryBarrier(commandBuffer, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+        VkExtent2D srcExtent = depthExtent;
+        for (uint32_t level = 0; level < m_pyramid.levels; level++) {
+            VkExtent2D dstExtent = levelExtent(level);
+            VkDescriptorSet set = level == 0 ? m_pyramid.depthSets[frameIndex] : m_pyramid.levelSets[level - 1];
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &set, 0, nullptr);
+
+            PushConstants constants{{int32_t(srcExtent.width), int32_t(srcExtent.height)}, {int32_t(dstExtent.width), int32_t(dstExtent.height)}};
+            vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatch(commandBuffer, (dstExtent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (dstExtent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+            // 下一级读取这一级的写入，最后一级之后是cull shader的读取
+            memoryBarrier(commandBuffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+            srcExtent = dstExtent;
+        }
+    }
+
+    // hi-z：包含全部level的view，cull shader按包围盒在屏幕上的大小选择level
+    VkImageView view() const { return m_pyramid.view; }
+    VkSampler sampler() const { return m_sampler; }
+    VkExtent2D extent() const { return m_pyramid.extent; }
+    uint32_t levelCount() const { return m_pyramid.levels; }
+
+private:
+    struct PushConstants {
+        int32_t srcSize[2];
+        int32_t dstSize[2];
+    };
+
+    struct Pyramid {
+        VkImage image = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkImageView view = VK_NULL_HANDLE;
+        std::vector<VkImageView> levelViews;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        std::vector<VkDescriptorSet> levelSets;
+        std::vector<VkDescriptorSet> depthSets;
+        std::vector<VkImageView> depthViews;  // 每个depth set最近一次写入的depth view
+        VkExtent2D extent{};
+        uint32_t levels = 0;
+    };
+
+    VkExtent2D levelExtent(uint32_t level) const {
+        return {std::max(m_pyramid.extent.width >> level, 1u), std::max(m_pyramid.extent.height >> level, 1u)};
+    }
+
+    VkImageView createView(uint32_t baseLevel, uint32_t levelCount) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_pyramid.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, baseLevel, levelCount, 0, 1};
+        VkImageView view;
+        if (vkCreateImageView(m_device, &viewInfo, hostAllocator(), &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create hi-z image view!");
+        }
+        return view;
+    }
+
+    VkDescriptorSet allocateSet() {
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_pyramid.descriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_descriptorSetLayout;
+        VkDescriptorSet set;
+        if (vkAllocateDescriptorSets(m_device, &allocInfo, &set) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate hi-z descriptor set!");
+        }
+        return set;
+    }
+
+    void writeSet(VkDescriptorSet set, VkImageView srcView, VkImageLayout srcLayout, VkImageView dstView) {
+        VkDescriptorImageInfo srcInfo{m_sampler, srcView, srcLayout};
+        VkDescriptorImageInfo dstInfo{VK_NULL_HANDLE, dstView, VK_IMAGE_LAYOUT_GENERAL};
+        std::array<VkWriteDescriptorSet, 2> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = set;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[i].pImageInfo = i == 0 ? &srcInfo : &dstInfo;
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    void destroyPyramid(const Pyramid& pyramid) {
+        if (pyramid.image == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyDescriptorPool(m_device, pyramid.descriptorPool, hostAllocator());
+        for (VkImageView view : pyramid.levelViews) {
+            vkDestroyImageView(m_device, view, hostAllocator());
+        }
+        vkDestroyImageView(m_device, pyramid.view, hostAllocator());
+        vkDestroyImage(m_device, pyramid.image, hostAllocator());
+        Allocation allocation = pyramid.allocation;
+        m_allocator->free(allocation);
+    }
+
+    // hi-z：pyramid和depth都只在compute shader中访问，layout不变，global memory barrier就足够了
+    static void memoryBarrier(VkCommandBuffer commandBuffer, VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_frameCount = 0;
+    RetireFunction m_retire;
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    Pyramid m_pyramid;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// host image copy：之前纹理的像素先写入staging ring，再由上传队列的copyBufferToImage写入image，layout转换也是命令
+// VK_EXT_host_image_copy让cpu直接把内存中的像素写入optimal tiling的image，layout转换用vkTransitionImageLayoutEXT在host上完成
+// 调用返回时写入已经完成，之后提交的命令可以直接使用；不同的image可以在多个工作线程上同时写入，同一个image需要调用者同步
+// image创建时需要VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT，有的设备上这个usage会让gpu读取变慢，usable检查了optimalDeviceAccess
+class HostImageCopy {
+public:
+    static bool supported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures{};
+        hostImageCopyFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &hostImageCopyFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return hostImageCopyFeatures.hostImageCopy;
+    }
+
+    void init(VkDevice device, VkPhysicalDevice physicalDevice) {
+        m_device = device;
+        m_physicalDevice = physicalDevice;
+        m_copyMemoryToImage = (PFN_vkCopyMemoryToImageEXT) vkGetDeviceProcAddr(device, "vkCopyMemoryToImageEXT");
+        m_transitionImageLayout = (PFN_vkTransitionImageLayoutEXT) vkGetDeviceProcAddr(device, "vkTransitionImageLayoutEXT");
+
+        // host image copy：可以作为写入目标的layout由设备报告，先查询数量再查询内容
+        VkPhysicalDeviceHostImageCopyPropertiesEXT copyProperties{};
+        copyProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &copyProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        m_dstLayouts.resize(copyProperties.copyDstLayoutCount);
+        copyProperties.pCopyDstLayouts = m_dstLayouts.data();
+        copyProperties.copySrcLayoutCount = 0;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+    }
+
+    bool initialized() const { return m_copyMemoryToImage != nullptr && m_transitionImageLayout != nullptr; }
+
+    // host image copy：格式在optimal tiling下支持host transfer，并且加上HOST_TRANSFER usage之后gpu访问不会变慢
+    // layout：所有写入都在layout中进行，它必须在设备报告的copyDstLayouts中
+    bool usable(VkFormat format, VkImageUsageFlags usage, VkImageCreateFlags flags, VkImageLayout layout) const {
+        if (!initialized() || std::find(m_dstLayouts.begin(), m_dstLayouts.end(), layout) == m_dstLayouts.end()) {
+            return false;
+        }
+        VkFormatProperties3 formatProperties3{};
+        formatProperties3.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3;
+        VkFormatProperties2 formatProperties2{};
+        formatProperties2.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+        formatProperties2.pNext = &formatProperties3;
+        vkGetPhysicalDeviceFormatProperties2(m_physicalDevice, format, &formatProperties2);
+        if (!(formatProperties3.optimalTilingFeatures & VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT)) {
+            return false;
+        }
+
+        VkPhysicalDeviceImageFormatInfo2 formatInfo{};
+        formatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+        formatInfo.format = format;
+        formatInfo.type = VK_IMAGE_TYPE_2D;
+        formatInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        formatInfo.usage = usage | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+        formatInfo.flags = flags;
+        VkHostImageCopyDevicePerformanceQueryEXT performance{};
+        performance.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_COPY_DEVICE_PERFORMANCE_QUERY_EXT;
+        VkImageFormatProperties2 imageProperties{};
+        imageProperties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+        imageProperties.pNext = &performance;
+        if (vkGetPhysicalDeviceImageFormatProperties2(m_physicalDevice, &formatInfo, &imageProperties) != VK_SUCCESS) {
+            return false;
+        }
+        return performance.optimalDeviceAccess;
+    }
+
+    // host image copy：在host上转换image的所有mip level，旧的内容按oldLayout保留，UNDEFINED时丢弃
+    void transition(VkImage image, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout) const {
+        VkHostImageLayoutTransitionInfoEXT transitionInfo{};
+        transitionInfo.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT;
+        transitionInfo.image = image;
+        transitionInfo.oldLayout = oldLayout;
+        transitionInfo.newLayout = newLayout;
+        transitionInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+        if (m_transitionImageLayout(m_device, 1, &transitionInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to transition image layout on host!");
+        }
+    }
+
+    // host image copy：把紧密排列的像素（或压缩块）写入一个mip level，image已经在layout中
+    void copy(VkImage image, VkImageLayout layout, const void* pixels, uint32_t width, uint32_t height, uint32_t mipLevel = 0) const {
+        VkMemoryToImageCopyEXT region{};
+        region.sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT;
+        region.pHostPointer = pixels;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mipLevel, 0, 1};
+        region.imageExtent = {width, height, 1};
+
+        VkCopyMemoryToImageInfoEXT copyInfo{};
+        copyInfo.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT;
+        copyInfo.dstImage = image;
+        copyInfo.dstImageLayout = layout;
+        copyInfo.regionCount = 1;
+        copyInfo.pRegions = &region;
+        if (m_copyMemoryToImage(m_device, &copyInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to copy memory to image!");
+        }
+    }
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+    PFN_vkCopyMemoryToImageEXT m_copyMemoryToImage = nullptr;
+    PFN_vkTransitionImageLayoutEXT m_transitionImageLayout = nullptr;
+    std::vector<VkImageLayout> m_dstLayouts;
+};
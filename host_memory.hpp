@@ -0,0 +1,340 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// host memory：之前所有vkCreate/vkDestroy的pAllocator都是nullptr，驱动在cpu上分配多少内存完全看不到
+// 开启时所有调用都传入这里的VkAllocationCallbacks，按VkSystemAllocationScope统计当前字节数、峰值和分配次数
+// 驱动可能在任意线程回调，统计全部使用原子变量；每次分配前面放一个header记录大小，释放时不需要查表
+// 创建和销毁同一个对象必须传入相同的callbacks，所以setEnabled只能在创建instance之前调用一次
+// arena：开启后command scope的分配（只在一次vulkan调用之内存在）从每个线程的线性arena中分配，线程上没有live的分配时整块重置
+// object scope的小分配按大小分级，释放后留在pool的free list中给下一次同级的分配，不再每次malloc/free
+// endFrame记录每帧每个scope的分配次数，报告中的per frame就是帧循环中驱动的分配churn
+class HostMemoryTracker {
+public:
+    static constexpr size_t SCOPE_COUNT = 5;  // command、object、cache、device、instance
+
+    struct ScopeStats {
+        uint64_t bytes = 0;
+        uint64_t peakBytes = 0;
+        uint64_t liveAllocations = 0;
+        uint64_t totalAllocations = 0;
+        uint64_t backedAllocations = 0;  // arena：由arena（command）或者pool（object）提供的次数
+        uint64_t lastFrameAllocations = 0;
+        uint64_t peakFrameAllocations = 0;
+    };
+
+    static HostMemoryTracker& instance() {
+        static HostMemoryTracker tracker;
+        return tracker;
+    }
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+
+    // arena：和setEnabled一样在创建instance之前调用，释放时按header中记录的来源处理，中途切换也不会出错
+    void setArenas(bool enabled) { m_arenas = enabled; }
+
+    // arena：每帧结束时调用一次，记录这一帧每个scope新增的分配次数
+    void endFrame() {
+        for (Counters& counters : m_scopes) {
+            uint64_t total = counters.totalAllocations.load(std::memory_order_relaxed);
+            uint64_t frameAllocations = total - counters.frameStartAllocations;
+            counters.frameStartAllocations = total;
+            counters.lastFrameAllocations = frameAllocations;
+            counters.peakFrameAllocations = std::max(counters.peakFrameAllocations, frameAllocations);
+        }
+    }
+
+    // host memory：关闭时返回nullptr，驱动使用自己的分配器
+    const VkAllocationCallbacks* callbacks() const { return m_enabled ? &m_callbacks : nullptr; }
+
+    ScopeStats scopeStats(VkSystemAllocationScope scope) const {
+        const Counters& counters = m_scopes[scopeIndex(scope)];
+        ScopeStats stats;
+        stats.bytes = counters.bytes.load(std::memory_order_relaxed);
+        stats.peakBytes = counters.peakBytes.load(std::memory_order_relaxed);
+        stats.liveAllocations = counters.liveAllocations.load(std::memory_order_relaxed);
+        stats.totalAllocations = counters.totalAllocations.load(std::memory_order_relaxed);
+        stats.backedAllocations = counters.backedAllocations.load(std::memory_order_relaxed);
+        stats.lastFrameAllocations = counters.lastFrameAllocations;
+        stats.peakFrameAllocations = counters.peakFrameAllocations;
+        return stats;
+    }
+
+    uint64_t totalBytes() const {
+        uint64_t total = 0;
+        for (const Counters& counters : m_scopes) {
+            total += counters.bytes.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // arena：上一帧所有scope的分配次数
+    uint64_t lastFrameAllocations() const {
+        uint64_t total = 0;
+        for (const Counters& counters : m_scopes) {
+            total += counters.lastFrameAllocations;
+        }
+        return total;
+    }
+
+    // host memory：所有scope合计的最高值
+    uint64_t peakBytes() const { return m_peakBytes.load(std::memory_order_relaxed); }
+
+    void writeReport(std::ostream& out) const {
+        if (!m_enabled) {
+            out << "host allocations: not tracked" << std::endl;
+            return;
+        }
+        static const char* const SCOPE_NAMES[SCOPE_COUNT] = {"command", "object", "cache", "device", "instance"};
+        out << "host allocations: " << totalBytes() / 1024 << " KB (peak " << peakBytes() / 1024 << " KB)" << std::endl;
+        for (size_t i = 0; i < SCOPE_COUNT; i++) {
+            ScopeStats stats = scopeStats(static_cast<VkSystemAllocationScope>(i));
+            out << "  " << SCOPE_NAMES[i] << ": " << stats.bytes / 1024 << " KB (peak " << stats.peakBytes / 1024 << " KB), " << stats.liveAllocations << " live, "
+                << stats.totalAllocations << " total, " << stats.backedAllocations << " from " << (i == 0 ? "arena" : "pool") << ", per frame "
+                << stats.lastFrameAllocations << " (max " << stats.peakFrameAllocations << ")" << std::endl;
+        }
+        out << "  driver internal: " << m_internalBytes.load(std::memory_order_relaxed) / 1024 << " KB (peak " << m_internalPeakBytes.load(std::memory_order_relaxed) / 1024
+            << " KB)" << std::endl;
+    }
+
+private:
+    struct Counters {
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> peakBytes{0};
+        std::atomic<uint64_t> liveAllocations{0};
+        std::atomic<uint64_t> totalAllocations{0};
+        std::atomic<uint64_t> backedAllocations{0};
+        uint64_t frameStartAllocations = 0;  // 以下只在调用endFrame的线程访问
+        uint64_t lastFrameAllocations = 0;
+        uint64_t peakFrameAllocations = 0;
+    };
+
+    // arena：分配的来源，释放时按来源归还
+    enum class Source : uint32_t { heap, pool, arena };
+
+    // host memory：放在返回给驱动的指针前面，raw是malloc返回的原始指针，pool时是整个block，arena时是所属的Arena
+    struct Header {
+        void* raw;
+        size_t size;
+        uint32_t scope;
+        Source source;
+        uint32_t sizeClass;
+    };
+
+    // arena：command scope的线性分配，ARENA_SIZE放不下时回到malloc
+    static constexpr size_t ARENA_SIZE = 64 * 1024;
+    struct Arena {
+        std::unique_ptr<char[]> buffer;
+        size_t offset = 0;
+        uint32_t live = 0;
+    };
+
+    // pool：object scope中不超过POOL_MAX_SIZE、alignment不超过POOL_ALIGNMENT的分配，按2的幂分级
+    static constexpr size_t POOL_MIN_SIZE = 32;
+    static constexpr size_t POOL_MAX_SIZE = 4096;
+    static constexpr size_t POOL_ALIGNMENT = 16;
+    static constexpr size_t POOL_CLASS_COUNT = 8;  // 32到4096
+    struct Pool {
+        std::mutex mutex;
+        std::vector<void*> freeBlocks;
+    };
+
+    HostMemoryTracker() {
+        m_callbacks.pUserData = this;
+        m_callbacks.pfnAllocation = allocation;
+        m_callbacks.pfnReallocation = reallocation;
+        m_callbacks.pfnFree = free;
+        m_callbacks.pfnInternalAllocation = internalAllocation;
+        m_callbacks.pfnInternalFree = internalFree;
+    }
+
+    static size_t scopeIndex(VkSystemAllocationScope scope) { return std::min(static_cast<size_t>(scope), SCOPE_COUNT - 1); }
+
+    static Header* header(void* memory) { return reinterpret_cast<Header*>(memory) - 1; }
+
+    static void updatePeak(std::atomic<uint64_t>& peak, uint64_t value) {
+        uint64_t current = peak.load(std::memory_order_relaxed);
+        while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    void added(uint32_t scope, size_t size) {
+        Counters& counters = m_scopes[scope];
+        updatePeak(counters.peakBytes, counters.bytes.fetch_add(size, std::memory_order_relaxed) + size);
+        counters.liveAllocations.fetch_add(1, std::memory_order_relaxed);
+        counters.totalAllocations.fetch_add(1, std::memory_order_relaxed);
+        updatePeak(m_peakBytes, m_totalBytes.fetch_add(size, std::memory_order_relaxed) + size);
+    }
+
+    void removed(uint32_t scope, size_t size) {
+        Counters& counters = m_scopes[scope];
+        counters.bytes.fetch_sub(size, std::memory_order_relaxed);
+        counters.liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+        m_totalBytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    static uintptr_t alignAddress(uintptr_t address, size_t alignment) { return (address + alignment - 1) & ~(uintptr_t(alignment) - 1); }
+
+    static Arena& threadArena() {
+        static thread_local Arena arena;
+        return arena;
+    }
+
+    static uint32_t poolClass(size_t size) {
+        uint32_t sizeClass = 0;
+        while ((POOL_MIN_SIZE << sizeClass) < size) {
+            sizeClass++;
+        }
+        return sizeClass;
+    }
+
+    static size_t poolBlockSize(uint32_t sizeClass) { return (POOL_MIN_SIZE << sizeClass) + POOL_ALIGNMENT + sizeof(Header); }
+
+    // arena：放不下或者没有开启时返回nullptr
+    void* arenaAllocation(size_t size, size_t alignment) {
+        Arena& arena = threadArena();
+        if (!arena.buffer) {
+            arena.buffer = std::make_unique<char[]>(ARENA_SIZE);
+        }
+        uintptr_t base = reinterpret_cast<uintptr_t>(arena.buffer.get());
+        uintptr_t address = alignAddress(base + arena.offset + sizeof(Header), alignment);
+        if (address + size > base + ARENA_SIZE) {
+            return nullptr;
+        }
+        void* memory = reinterpret_cast<void*>(address);
+        *header(memory) = {&arena, size, 0, Source::arena, 0};
+        arena.offset = address + size - base;
+        arena.live++;
+        return memory;
+    }
+
+    void* poolAllocation(size_t size, uint32_t scope) {
+        uint32_t sizeClass = poolClass(size);
+        void* raw = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_pools[sizeClass].mutex);
+            if (!m_pools[sizeClass].freeBlocks.empty()) {
+                raw = m_pools[sizeClass].freeBlocks.back();
+                m_pools[sizeClass].freeBlocks.pop_back();
+            }
+        }
+        if (raw == nullptr) {
+            raw = std::malloc(poolBlockSize(sizeClass));
+            if (raw == nullptr) {
+                return nullptr;
+            }
+        }
+        void* memory = reinterpret_cast<void*>(alignAddress(reinterpret_cast<uintptr_t>(raw) + sizeof(Header), POOL_ALIGNMENT));
+        *header(memory) = {raw, size, scope, Source::pool, sizeClass};
+        return memory;
+    }
+
+    // host memory：header之后按alignment对齐，最多浪费alignment + sizeof(Header)字节
+    static void* VKAPI_PTR allocation(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+        if (size == 0) {
+            return nullptr;
+        }
+        HostMemoryTracker* tracker = static_cast<HostMemoryTracker*>(userData);
+        alignment = std::max(alignment, alignof(Header));
+        uint32_t scopeSlot = static_cast<uint32_t>(scopeIndex(scope));
+        void* memory = nullptr;
+        if (tracker->m_arenas && scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+            memory = tracker->arenaAllocation(size, alignment);
+        } else if (tracker->m_arenas && scope == VK_SYSTEM_ALLOCATION_SCOPE_OBJECT && size <= POOL_MAX_SIZE && alignment <= POOL_ALIGNMENT) {
+            memory = tracker->poolAllocation(size, scopeSlot);
+        }
+        if (memory != nullptr) {
+            tracker->m_scopes[scopeSlot].backedAllocations.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            void* raw = std::malloc(size + alignment + sizeof(Header));
+            if (raw == nullptr) {
+                return nullptr;
+            }
+            memory = reinterpret_cast<void*>(alignAddress(reinterpret_cast<uintptr_t>(raw) + sizeof(Header), alignment));
+            *header(memory) = {raw, size, scopeSlot, Source::heap, 0};
+        }
+        tracker->added(scopeSlot, size);
+        return memory;
+    }
+
+    // host memory：规范要求新分配满足alignment并保留原内容，这里总是分配新的内存再复制
+    static void* VKAPI_PTR reallocation(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+        if (original == nullptr) {
+            return allocation(userData, size, alignment, scope);
+        }
+        if (size == 0) {
+            free(userData, original);
+            return nullptr;
+        }
+        void* memory = allocation(userData, size, alignment, scope);
+        if (memory != nullptr) {
+            std::memcpy(memory, original, std::min(size, header(original)->size));
+            free(userData, original);
+        }
+        return memory;
+    }
+
+    static void VKAPI_PTR free(void* userData, void* memory) {
+        if (memory == nullptr) {
+            return;
+        }
+        HostMemoryTracker* tracker = static_cast<HostMemoryTracker*>(userData);
+        Header* memoryHeader = header(memory);
+        tracker->removed(memoryHeader->scope, memoryHeader->size);
+        switch (memoryHeader->source) {
+            case Source::arena: {
+                // arena：command scope在同一个线程的同一次调用中分配和释放，最后一个释放时回到起点
+                Arena* arena = static_cast<Arena*>(memoryHeader->raw);
+                if (--arena->live == 0) {
+                    arena->offset = 0;
+                }
+                break;
+            }
+            case Source::pool: {
+                Pool& pool = tracker->m_pools[memoryHeader->sizeClass];
+                std::lock_guard<std::mutex> lock(pool.mutex);
+                pool.freeBlocks.push_back(memoryHeader->raw);
+                break;
+            }
+            case Source::heap:
+                std::free(memoryHeader->raw);
+                break;
+        }
+    }
+
+    // host memory：驱动自己分配的可执行内存等，只是通知，不经过上面的分配函数
+    static void VKAPI_PTR internalAllocation(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope) {
+        HostMemoryTracker* tracker = static_cast<HostMemoryTracker*>(userData);
+        updatePeak(tracker->m_internalPeakBytes, tracker->m_internalBytes.fetch_add(size, std::memory_order_relaxed) + size);
+    }
+
+    static void VKAPI_PTR internalFree(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope) {
+        static_cast<HostMemoryTracker*>(userData)->m_internalBytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    bool m_enabled = false;
+    bool m_arenas = false;
+    VkAllocationCallbacks m_callbacks{};
+    std::array<Counters, SCOPE_COUNT> m_scopes;
+    std::array<Pool, POOL_CLASS_COUNT> m_pools;  // 进程结束时由操作系统回收free list中的block
+    std::atomic<uint64_t> m_totalBytes{0};
+    std::atomic<uint64_t> m_peakBytes{0};
+    std::atomic<uint64_t> m_internalBytes{0};
+    std::atomic<uint64_t> m_internalPeakBytes{0};
+};
+
+// host memory：所有vkCreate/vkDestroy/vkAllocateMemory/vkFreeMemory的pAllocator
+inline const VkAllocationCallbacks* hostAllocator() {
+    return HostMemoryTracker::instance().callbacks();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// idle rendering：连续settleFrames帧画面没有变化（没有输入、没有动画、没有进行中的上传）之后进入idle，不再绘制和present
+// settleFrames让自动曝光、阴影缓存这类跨多帧收敛的效果先稳定下来，idle时显示的是收敛后的最后一帧
+// 输入回调在任意线程调用notifyActivity，渲染的线程下一次检查时马上退出idle并重新开始计数
+class IdleDetector {
+public:
+    void init(uint32_t settleFrames) { m_settleFrames = settleFrames; }
+
+    // idle rendering：任意线程调用，比如glfw的输入、窗口大小变化和窗口需要重绘的回调
+    void notifyActivity() {
+        m_activity.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);  // 和waitForActivity检查之后开始等待之间互斥，避免丢失唤醒
+        }
+        m_condition.notify_all();
+    }
+
+    // idle rendering：渲染的线程在每帧结束时调用，frameStatic是这一帧和上一帧相比没有任何变化
+    void endFrame(bool frameStatic) {
+        uint64_t activity = m_activity.load(std::memory_order_acquire);
+        if (!frameStatic || activity != m_seenActivity) {
+            m_seenActivity = activity;
+            m_staticFrames = 0;
+            return;
+        }
+        if (m_staticFrames < m_settleFrames) {
+            m_staticFrames++;
+        }
+    }
+
+    bool idle() const { return m_settleFrames > 0 && m_staticFrames >= m_settleFrames; }
+
+    // idle rendering：上次检查之后有新的输入时退出idle并返回true
+    bool woken() {
+        uint64_t activity = m_activity.load(std::memory_order_acquire);
+        if (activity == m_seenActivity) {
+            return false;
+        }
+        m_seenActivity = activity;
+        m_staticFrames = 0;
+        return true;
+    }
+
+    // idle rendering：没有glfw事件循环的线程（render thread）在idle时等待输入或者超时
+    void waitForActivity(float seconds) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait_for(lock, std::chrono::duration<float>(seconds),
+            [this]() { return m_activity.load(std::memory_order_acquire) != m_seenActivity; });
+    }
+
+private:
+    uint32_t m_settleFrames = 0;
+    uint32_t m_staticFrames = 0;  // 以下两个只在渲染的线程访问
+    uint64_t m_seenActivity = 0;
+    std::atomic<uint64_t> m_activity{0};
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "device_dispatch.hpp"
+
+// image barrier：收集多个image的layout转换，录制时合并成一次vkCmdPipelineBarrier
+// 每个barrier单独录制时驱动要分别处理同步，同一批上传的N张纹理只需要一次等待
+// stage取所有barrier的并集，只有stage相同或相近的转换适合放在同一批
+// synchronization2：设备支持时用vkCmdPipelineBarrier2录制，每个barrier保留自己的stage，不再等待并集中无关的stage
+class ImageBarrierBatch {
+public:
+    // synchronization2：创建device之后设置一次，nullptr时使用vkCmdPipelineBarrier
+    static void setPipelineBarrier2(PFN_vkCmdPipelineBarrier2 pipelineBarrier2) { s_pipelineBarrier2 = pipelineBarrier2; }
+
+    void add(const VkImageMemoryBarrier& barrier, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+        m_barriers.push_back(barrier);
+        m_stages.push_back({srcStage, dstStage});
+        m_srcStages |= srcStage;
+        m_dstStages |= dstStage;
+    }
+
+    // image barrier：录制进调用者提供的command buffer并清空，可以继续收集下一批
+    void record(VkCommandBuffer commandBuffer) {
+        if (m_barriers.empty()) {
+            return;
+        }
+        if (s_pipelineBarrier2 != nullptr) {
+            recordBarrier2(commandBuffer);
+            clear();
+            return;
+        }
+        DeviceDispatch::cmdPipelineBarrier(commandBuffer, m_srcStages, m_dstStages, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(m_barriers.size()), m_barriers.data());
+        clear();
+    }
+
+    void clear() {
+        m_barriers.clear();
+        m_stages.clear();
+        m_srcStages = 0;
+        m_dstStages = 0;
+    }
+
+    bool empty() const { return m_barriers.empty(); }
+    size_t size() const { return m_barriers.size(); }
+
+private:
+    struct Stages {
+        VkPipelineStageFlags src;
+        VkPipelineStageFlags dst;
+    };
+
+    // synchronization2：旧的stage和access的位在VkPipelineStageFlags2/VkAccessFlags2中的值相同，可以直接转换
+    void recordBarrier2(VkCommandBuffer commandBuffer) {
+        m_barriers2.resize(m_barriers.size());
+        for (size_t i = 0; i < m_barriers.size(); i++) {
+            const VkImageMemoryBarrier& barrier = m_barriers[i];
+            VkImageMemoryBarrier2& barrier2 = m_barriers2[i];
+            barrier2 = {};
+            barrier2.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            barrier2.srcStageMask = m_stages[i].src;
+            barrier2.srcAccessMask = barrier.srcAccessMask;
+            barrier2.dstStageMask = m_stages[i].dst;
+            barrier2.dstAccessMask = barrier.dstAccessMask;
+            barrier2.oldLayout = barrier.oldLayout;
+            barrier2.newLayout = barrier.newLayout;
+            barrier2.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+            barrier2.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+            barrier2.image = barrier.image;
+            barrier2.subresourceRange = barrier.subresourceRange;
+        }
+        VkDependencyInfo dependency{};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency.imageMemoryBarrierCount = static_cast<uint32_t>(m_barriers2.size());
+        dependency.pImageMemoryBarriers = m_barriers2.data();
+        s_pipelineBarrier2(commandBuffer, &dependency);
+    }
+
+    static inline PFN_vkCmdPipelineBarrier2 s_pipelineBarrier2 = nullptr;
+
+    std::vector<VkImageMemoryBarrier> m_barriers;
+    std::vector<Stages> m_stages;
+    std::vector<VkImageMemoryBarrier2> m_barriers2;
+    VkPipelineStageFlags m_srcStages = 0;
+    VkPipelineStageFlags m_dstStages = 0;
+};
+
+// image barrier：image最近一次访问的layout、stage和access；读取之后的stages是所有读取的stage的并集，之后的写入等待它们
+struct ImageState {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkAccessFlags accesses = 0;
+
+    static constexpr VkAccessFlags WRITE_ACCESSES = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    // image barrier：每个layout的典型访问，纹理的上传、拷贝和采样使用；不认识的layout等待所有命令，总是正确但最慢
+    static ImageState forLayout(VkImageLayout layout) {
+        switch (layout) {
+            case VK_IMAGE_LAYOUT_UNDEFINED:
+                return {layout, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0};  // 不关心原来的内容，不等待任何操作
+            case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+                return {layout, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT};
+            case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+                return {layout, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT};
+            case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+                return {layout, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT};  // 主要是fragment shader中的纹理采样
+            case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+                return {layout, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT};
+            case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+                return {layout, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT};
+            case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+                return {layout, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT};
+            case VK_IMAGE_LAYOUT_GENERAL:
+                return {layout, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+            case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+                return {layout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0};  // present由semaphore同步
+            default:
+                return {layout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT};
+        }
+    }
+};
+
+// image barrier：按image的每个mip level跟踪最近一次的访问，转换时由跟踪的状态生成barrier，不再为每一对layout手写stage和access
+// 同一个layout的读取之后再读取不需要barrier，只累计读取的stage；相邻的mip level状态相同时合并成一个barrier，由ImageBarrierBatch合并成一次
+// 跟踪的顺序是录制的顺序，调用者保证command buffer按录制的顺序提交；array layer不分开跟踪
+// 上传可能在多个线程中录制，状态由mutex保护
+class ImageStateTracker {
+public:
+    // image barrier：expected是调用者认为image当前的状态，没有跟踪过的level，或者跟踪的layout和expected不同时使用expected
+    // layout在tracker之外改变（render graph、queue family转移、mipmap生成中的barrier）时跟踪的状态会过期，layout不同时以调用者为准
+    void transition(ImageBarrierBatch& barriers, VkImage image, const VkImageSubresourceRange& range, const ImageState& expected, const ImageState& next) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<ImageState>& levels = m_images[image];
+        uint32_t end = range.baseMipLevel + range.levelCount;
+        if (levels.size() < end) {
+            levels.resize(end, expected);
+        }
+
+        bool pending = false;
+        VkImageMemoryBarrier barrier{};
+        VkPipelineStageFlags srcStages = 0;
+        auto flush = [&]() {
+            if (pending) {
+                barriers.add(barrier, srcStages, next.stages);
+                pending = false;
+            }
+        };
+        for (uint32_t level = range.baseMipLevel; level < end; level++) {
+            ImageState& state = levels[level];
+            ImageState current = state.layout == expected.layout ? state : expected;
+            if (current.layout == next.layout && ((current.accesses | next.accesses) & ImageState::WRITE_ACCESSES) == 0) {
+                state.stages |= next.stages;  // 读之后读
+                state.accesses |= next.accesses;
+                flush();
+                continue;
+            }
+            VkAccessFlags srcAccess = current.accesses & ImageState::WRITE_ACCESSES;  // 之前只有读取时只需要执行依赖
+            VkPipelineStageFlags stages = current.stages != 0 ? current.stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+            bool merge = pending && barrier.oldLayout == current.layout && barrier.srcAccessMask == srcAccess && srcStages == stages
+                && barrier.subresourceRange.baseMipLevel + barrier.subresourceRange.levelCount == level;
+            if (merge) {
+                barrier.subresourceRange.levelCount++;
+            } else {
+                flush();
+                barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.srcAccessMask = srcAccess;
+                barrier.dstAccessMask = next.accesses;
+                barrier.oldLayout = current.layout;
+                barrier.newLayout = next.layout;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = image;
+                barrier.subresourceRange = {range.aspectMask, level, 1, range.baseArrayLayer, range.layerCount};
+                srcStages = stages;
+                pending = true;
+            }
+            state = next;
+        }
+        flush();
+    }
+
+    // image barrier：image销毁时调用，句柄之后可能被新的image复用
+    void forget(VkImage image) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_images.erase(image);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::unordered_map<VkImage, std::vector<ImageState>> m_images;
+};
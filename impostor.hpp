@@ -0,0 +1,575 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "bindless_textures.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// impostor：远处的mesh画成一个面向相机的四边形，片段着色器从预先烘焙的atlas中取出离视线方向最近的一个方向的颜色和深度
+// 每个mesh烘焙frames×frames个方向，方向按octahedral展开排列成一个tile，tile的每个cell是一个方向的正交投影
+// 深度是cell平面前后的距离，片段着色器用它重建表面的位置，写入gl_FragDepth并用位置的导数重建法线
+// 方向的映射和每个方向投影的基在这里和impostor.vert中各有一份，必须一致
+
+// octahedral：uv在[0, 1]²内，中间的菱形是z为正的半球，z为负的半球折到四个角
+inline glm::vec3 octahedralDecode(const glm::vec2& uv) {
+    glm::vec2 p = uv * 2.0f - 1.0f;
+    glm::vec3 direction(p, 1.0f - std::abs(p.x) - std::abs(p.y));
+    if (direction.z < 0.0f) {
+        glm::vec2 folded = (1.0f - glm::abs(glm::vec2(direction.y, direction.x)));
+        direction.x = direction.x >= 0.0f ? folded.x : -folded.x;
+        direction.y = direction.y >= 0.0f ? folded.y : -folded.y;
+    }
+    return glm::normalize(direction);
+}
+
+// impostor：从direction方向看向mesh时cell的右和上，direction接近z轴时换一个参考方向
+inline void impostorFrameBasis(const glm::vec3& direction, glm::vec3& right, glm::vec3& up) {
+    glm::vec3 reference = std::abs(direction.z) > 0.999f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+    right = glm::normalize(glm::cross(reference, direction));
+    up = glm::cross(direction, right);
+}
+
+// impostor：atlas中的一个tile，page为UINT32_MAX时没有分配
+struct ImpostorTile {
+    uint32_t page = UINT32_MAX;
+    uint32_t slot = 0;
+
+    bool valid() const { return page != UINT32_MAX; }
+};
+
+// impostor：每个实例的顶点属性，布局和impostor.vert的location 0到7一致
+struct ImpostorInstance {
+    glm::mat4 localToWorld;  // 实例矩阵乘上sceneModel
+    glm::vec4 centerRadius;  // 烘焙时的包围球，在sceneModel之前的空间
+    glm::vec4 tile;  // xy是tile在page中的uv偏移，zw是tile的uv大小
+    glm::uvec4 textures;  // x是albedo的bindless index，y是depth的bindless index，z是每个方向的frame数
+    glm::vec4 color;  // instancing：实例颜色
+};
+static_assert(sizeof(ImpostorInstance) == 128, "ImpostorInstance must match the impostor.vert attribute layout");
+
+// impostor：page是两张同样大小的color image，albedo和depth，在bindless数组中各占一个元素，一次render pass同时写入
+// page在第一次需要时创建，page数量有上限；tile归还之后可以被其它mesh复用
+// 烘焙录制在调用者传入的command buffer中（图形队列），page在render pass前后都是SHADER_READ_ONLY_OPTIMAL，只清除和写入这个tile的区域
+// 每一帧的实例按page分组写入这一帧的instance buffer，每个page一次draw，片段着色器中纹理的index在一次draw内是uniform的
+class ImpostorAtlas {
+public:
+    static constexpr VkFormat ALBEDO_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+    static constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_R16_SFLOAT;  // color attachment和线性过滤都是必须支持的
+    static constexpr VkFormat BAKE_DEPTH_FORMAT = VK_FORMAT_D16_UNORM;
+    static constexpr uint32_t INSTANCE_BINDING = 0;
+
+    // impostor：画一个方向，调用之前已经开始render pass、绑定了pipeline并设置了这个cell的viewport；viewProj是这个方向的正交投影
+    using DrawMesh = std::function<void(VkCommandBuffer, const glm::mat4& viewProj)>;
+
+    // impostor：每个page一次draw，first是这一帧instance buffer中的偏移
+    struct PageDraw {
+        uint32_t page;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // impostor：烘焙pipeline使用调用者的pipeline layout（场景的layout，纹理数组在set 1），bindings和attributes是场景的顶点格式
+    // pipelineFlags是场景pipeline需要的flag，比如使用descriptor buffer
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, BindlessTextureTable& bindless, VkPipelineCache pipelineCache, const SpirvCode& vertexCode,
+        const SpirvCode& fragmentCode, VkPipelineLayout pipelineLayout, VkPipelineCreateFlags pipelineFlags, const std::vector<VkVertexInputBindingDescription>& bindings,
+        const std::vector<VkVertexInputAttributeDescription>& attributes, uint32_t atlasSize, uint32_t cellSize, uint32_t frames, uint32_t maxPages, uint32_t maxInstances,
+        uint32_t frameCount) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_bindless = &bindless;
+        m_atlasSize = atlasSize;
+        m_cellSize = cellSize;
+        m_frames = frames;
+        m_maxPages = maxPages;
+        m_tilesPerRow = atlasSize / (cellSize * frames);
+        if (m_tilesPerRow == 0) {
+            throw std::runtime_error("impostor tile does not fit in the atlas!");
+        }
+
+        m_bakeDepth = createImage(BAKE_DEPTH_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, "impostor bake depth");
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        if (vkCreateSampler(m_device, &samplerInfo, hostAllocator(), &m_sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create impostor sampler!");
+        }
+
+        createRenderPass();
+        createPipeline(pipelineCache, vertexCode, fragmentCode, pipelineLayout, pipelineFlags, bindings, attributes);
+
+        m_maxInstances = maxInstances;
+        m_frameData.resize(frameCount);
+        for (Frame& frame : m_frameData) {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = VkDeviceSize(sizeof(ImpostorInstance)) * maxInstances;
+            bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &frame.buffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create impostor instance buffer!");
+            }
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(m_device, frame.buffer, &memRequirements);
+            frame.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true,
+                MemoryCategory::geometry, 0, "impostor instances");
+            vkBindBufferMemory(m_device, frame.buffer, frame.allocation.memory, frame.allocation.offset);
+        }
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        for (Frame& frame : m_frameData) {
+            vkDestroyBuffer(m_device, frame.buffer, hostAllocator());
+            m_allocator->free(frame.allocation);
+        }
+        m_frameData.clear();
+        for (Page& page : m_pages) {
+            vkDestroyFramebuffer(m_device, page.framebuffer, hostAllocator());
+            destroyImage(page.albedo);
+            destroyImage(page.depth);
+        }
+        m_pages.clear();
+        m_freeSlots.clear();
+        destroyImage(m_bakeDepth);
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyRenderPass(m_device, m_renderPass, hostAllocator());
+        vkDestroySampler(m_device, m_sampler, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // impostor：分配一个tile，空闲的tile用完时创建新的page，page数量达到上限时返回false
+    bool allocate(ImpostorTile& tile) {
+        if (m_freeSlots.empty()) {
+            if (m_pages.size() >= m_maxPages) {
+                return false;
+            }
+            addPage();
+        }
+        uint32_t slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        uint32_t tilesPerPage = m_tilesPerRow * m_tilesPerRow;
+        tile.page = slot / tilesPerPage;
+        tile.slot = slot % tilesPerPage;
+        return true;
+    }
+
+    // impostor：调用者保证已经没有in flight的帧使用这个tile，一般通过deletion queue调用
+    void free(const ImpostorTile& tile) {
+        m_freeSlots.push_back(tile.page * m_tilesPerRow * m_tilesPerRow + tile.slot);
+    }
+
+    // impostor：把一个mesh烘焙进tile，center和radius是包围球；drawMesh对每个方向调用一次
+    // page第一次使用时整张转换到SHADER_READ_ONLY_OPTIMAL，之后render pass只清除这个tile，其它tile的内容保留
+    void bake(VkCommandBuffer commandBuffer, const ImpostorTile& tile, const glm::vec3& center, float radius, const DrawMesh& drawMesh) {
+        Page& page = m_pages[tile.page];
+        if (!page.initialized) {
+            std::array<VkImageMemoryBarrier, 2> barriers{};
+            VkImage images[2] = {page.albedo.image, page.depth.image};
+            for (size_t i = 0; i < barriers.size(); i++) {
+                barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                barriers[i].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barriers[i].image = images[i];
+                barriers[i].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+                barriers[i].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+            }
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr,
+                static_cast<uint32_t>(barriers.size()), barriers.data());
+            page.initialized = true;
+        }
+
+        uint32_t tileSize = m_cellSize * m_frames;
+        VkOffset2D origin = tileOrigin(tile);
+        std::array<VkClearValue, 3> clearValues{};
+        clearValues[0].color = {{0.0f, 0.0f, 0.0f, 0.0f}};  // alpha为0的像素在片段着色器中丢弃
+        clearValues[1].color = {{1.0f, 0.0f, 0.0f, 0.0f}};
+        clearValues[2].depthStencil = {1.0f, 0};
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = m_renderPass;
+        renderPassInfo.framebuffer = page.framebuffer;
+        renderPassInfo.renderArea = {origin, {tileSize, tileSize}};
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+        renderPassInfo.pClearValues = clearValues.data();
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+
+        for (uint32_t y = 0; y < m_frames; y++) {
+            for (uint32_t x = 0; x < m_frames; x++) {
+                VkRect2D cell{{origin.x + static_cast<int32_t>(x * m_cellSize), origin.y + static_cast<int32_t>(y * m_cellSize)}, {m_cellSize, m_cellSize}};
+                VkViewport viewport{float(cell.offset.x), float(cell.offset.y), float(m_cellSize), float(m_cellSize), 0.0f, 1.0f};
+                vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+                vkCmdSetScissor(commandBuffer, 0, 1, &cell);
+                glm::vec3 direction = octahedralDecode((glm::vec2(x, y) + 0.5f) / static_cast<float>(m_frames));
+                drawMesh(commandBuffer, frameViewProj(direction, center, radius));
+            }
+        }
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    // impostor：写入这一帧的实例，按page分组，超过容量的实例被丢弃
+    // 调用者需要保证gpu已经完成上次使用这一帧的命令（等待in flight fence之后）
+    void writeInstances(uint32_t frameIndex, std::vector<ImpostorInstance>& instances, const std::vector<uint32_t>& pages) {
+        Frame& frame = m_frameData[frameIndex];
+        frame.draws.clear();
+        m_order.resize(instances.size());
+        for (uint32_t i = 0; i < m_order.size(); i++) {
+            m_order[i] = i;
+        }
+        std::stable_sort(m_order.begin(), m_order.end(), [&pages](uint32_t a, uint32_t b) { return pages[a] < pages[b]; });
+
+        ImpostorInstance* mapped = static_cast<ImpostorInstance*>(frame.allocation.mapped);
+        uint32_t count = std::min(static_cast<uint32_t>(m_order.size()), m_maxInstances);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t page = pages[m_order[i]];
+            mapped[i] = instances[m_order[i]];
+            if (frame.draws.empty() || frame.draws.back().page != page) {
+                frame.draws.push_back({page, i, 0});
+            }
+            frame.draws.back().count++;
+        }
+    }
+
+    // impostor：调用之前已经绑定了场景的set 0和set 1（或者descriptor buffer的offset）；pipeline由调用者按场景的attachment创建
+    // 绑定pipeline之后重新设置viewport和scissor，之前的draw可能用shader object设置
+    void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkPipeline pipeline, VkExtent2D extent) const {
+        const Frame& frame = m_frameData[frameIndex];
+        if (frame.draws.empty()) {
+            return;
+        }
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        VkViewport viewport{0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f};
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        VkRect2D scissor{{0, 0}, extent};
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, &frame.buffer, &offset);
+        for (const PageDraw& pageDraw : frame.draws) {
+            vkCmdDraw(commandBuffer, 6, pageDraw.count, 0, pageDraw.first);
+        }
+    }
+
+    // impostor：draw使用的pipeline的顶点格式，只有实例数据，四边形的顶点由gl_VertexIndex生成
+    static void vertexInput(std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes) {
+        bindings = {{INSTANCE_BINDING, sizeof(ImpostorInstance), VK_VERTEX_INPUT_RATE_INSTANCE}};
+        attributes.clear();
+        for (uint32_t i = 0; i < 4; i++) {
+            attributes.push_back({i, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(offsetof(ImpostorInstance, localToWorld) + sizeof(glm::vec4) * i)});
+        }
+        attributes.push_back({4, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(offsetof(ImpostorInstance, centerRadius))});
+        attributes.push_back({5, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(offsetof(ImpostorInstance, tile))});
+        attributes.push_back({6, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_UINT, static_cast<uint32_t>(offsetof(ImpostorInstance, textures))});
+        attributes.push_back({7, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(offsetof(ImpostorInstance, color))});
+    }
+
+    // impostor：tile在page中的uv区域，xy是偏移，zw是大小
+    glm::vec4 tileRect(const ImpostorTile& tile) const {
+        VkOffset2D origin = tileOrigin(tile);
+        float size = static_cast<float>(m_cellSize * m_frames) / static_cast<float>(m_atlasSize);
+        return glm::vec4(static_cast<float>(origin.x) / m_atlasSize, static_cast<float>(origin.y) / m_atlasSize, size, size);
+    }
+
+    uint32_t albedoIndex(uint32_t page) const { return m_pages[page].albedoIndex; }
+    uint32_t depthIndex(uint32_t page) const { return m_pages[page].depthIndex; }
+    uint32_t frames() const { return m_frames; }
+    size_t pageCount() const { return m_pages.size(); }
+    const std::vector<PageDraw>& draws(uint32_t frameIndex) const { return m_frameData[frameIndex].draws; }
+
+private:
+    struct Image {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    struct Page {
+        Image albedo;
+        Image depth;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        uint32_t albedoIndex = 0;
+        uint32_t depthIndex = 0;
+        bool initialized = false;  // 第一次烘焙时转换layout
+    };
+
+    struct Frame {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+        std::vector<PageDraw> draws;
+    };
+
+    // impostor：direction方向的正交投影，x向右、y向下是cell中的uv，z从包围球靠近相机的一侧0到另一侧1
+    static glm::mat4 frameViewProj(const glm::vec3& direction, const glm::vec3& center, float radius) {
+        glm::vec3 right, up;
+        impostorFrameBasis(direction, right, up);
+        glm::mat4 m(0.0f);
+        for (int i = 0; i < 3; i++) {
+            m[i][0] = right[i] / radius;
+            m[i][1] = -up[i] / radius;
+            m[i][2] = -direction[i] / (2.0f * radius);
+        }
+        m[3][0] = -glm::dot(center, right) / radius;
+        m[3][1] = glm::dot(center, up) / radius;
+        m[3][2] = (radius + glm::dot(center, direction)) / (2.0f * radius);
+        m[3][3] = 1.0f;
+        return m;
+    }
+
+    VkOffset2D tileOrigin(const ImpostorTile& tile) const {
+        uint32_t tileSize = m_cellSize * m_frames;
+        return {static_cast<int32_t>(tile.slot % m_tilesPerRow * tileSize), static_cast<int32_t>(tile.slot / m_tilesPerRow * tileSize)};
+    }
+
+    void addPage() {
+        Page page;
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        page.albedo = createImage(ALBEDO_FORMAT, usage, VK_IMAGE_ASPECT_COLOR_BIT, "impostor albedo");
+        page.depth = createImage(DEPTH_FORMAT, usage, VK_IMAGE_ASPECT_COLOR_BIT, "impostor depth");
+
+        std::array<VkImageView, 3> attachments = {page.albedo.view, page.depth.view, m_bakeDepth.view};
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = m_renderPass;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = m_atlasSize;
+        framebufferInfo.height = m_atlasSize;
+        framebufferInfo.layers = 1;
+        if (vkCreateFramebuffer(m_device, &framebufferInfo, hostAllocator(), &page.framebuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create impostor framebuffer!");
+        }
+        page.albedoIndex = m_bindless->add(page.albedo.view, m_sampler);
+        page.depthIndex = m_bindless->add(page.depth.view, m_sampler);
+
+        uint32_t pageIndex = static_cast<uint32_t>(m_pages.size());
+        uint32_t tilesPerPage = m_tilesPerRow * m_tilesPerRow;
+        for (uint32_t i = tilesPerPage; i > 0; i--) {
+            m_freeSlots.push_back(pageIndex * tilesPerPage + i - 1);  // 从page的左上角开始分配
+        }
+        m_pages.push_back(page);
+    }
+
+    Image createImage(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, const char* name) {
+        Image image;
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {m_atlasSize, m_atlasSize, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateImage(m_device, &imageInfo, hostAllocator(), &image.image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create impostor image!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_device, image.image, &memRequirements);
+        image.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::texture, 0, name);
+        vkBindImageMemory(m_device, image.image, image.allocation.memory, image.allocation.offset);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange = {aspect, 0, 1, 0, 1};
+        if (vkCreateImageView(m_device, &viewInfo, hostAllocator(), &image.view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create impostor image view!");
+        }
+        return image;
+    }
+
+    void destroyImage(Image& image) {
+        vkDestroyImageView(m_device, image.view, hostAllocator());
+        vkDestroyImage(m_device, image.image, hostAllocator());
+        m_allocator->free(image.allocation);
+        image = {};
+    }
+
+    // impostor：两个color attachment在render pass前后都是SHADER_READ_ONLY_OPTIMAL，清除只作用于render area，其它tile保留
+    // 依赖的src包括片段着色器的读取，之前提交的帧采样同一个page的其它tile完成之后才转换layout
+    void createRenderPass() {
+        std::array<VkAttachmentDescription, 3> attachments{};
+        VkFormat formats[3] = {ALBEDO_FORMAT, DEPTH_FORMAT, BAKE_DEPTH_FORMAT};
+        for (size_t i = 0; i < attachments.size(); i++) {
+            attachments[i].format = formats[i];
+            attachments[i].samples = VK_SAMPLE_COUNT_1_BIT;
+            attachments[i].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            attachments[i].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+            attachments[i].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachments[i].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachments[i].initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            attachments[i].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
+        attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // 烘焙用的depth只在render pass中使用
+        attachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        attachments[2].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        std::array<VkAttachmentReference, 2> colorRefs = {{{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}, {1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}}};
+        VkAttachmentReference depthRef{2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
+        subpass.pColorAttachments = colorRefs.data();
+        subpass.pDepthStencilAttachment = &depthRef;
+
+        std::array<VkSubpassDependency, 2> dependencies{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+        if (vkCreateRenderPass(m_device, &renderPassInfo, hostAllocator(), &m_renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create impostor render pass!");
+        }
+    }
+
+    // impostor：不剔除背面，烘焙的方向可能从mesh的内侧看过去；shader只读取位置和uv
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& vertexCode, const SpirvCode& fragmentCode, VkPipelineLayout pipelineLayout,
+        VkPipelineCreateFlags pipelineFlags, const std::vector<VkVertexInputBindingDescription>& bindings, const std::vector<VkVertexInputAttributeDescription>& attributes) {
+        const SpirvCode* codes[2] = {&vertexCode, &fragmentCode};
+        VkShaderStageFlagBits stageFlags[2] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+        std::array<VkShaderModule, 2> modules{};
+        std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+        for (size_t i = 0; i < stages.size(); i++) {
+            VkShaderModuleCreateInfo moduleInfo{};
+            moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+            moduleInfo.codeSize = codes[i]->size;
+            moduleInfo.pCode = codes[i]->words;
+            if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &modules[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create impostor shader module!");
+            }
+            stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stages[i].stage = stageFlags[i];
+            stages[i].module = modules[i];
+            stages[i].pName = "main";
+        }
+
+        VkPipelineVertexInputStateCreateInfo vertexInput{};
+        vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInput.vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size());
+        vertexInput.pVertexBindingDescriptions = bindings.data();
+        vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+        vertexInput.pVertexAttributeDescriptions = attributes.data();
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.lineWidth = 1.0f;
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        std::array<VkPipelineColorBlendAttachmentState, 2> blendAttachments{};
+        blendAttachments[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        blendAttachments[1].colorWriteMask = VK_COLOR_COMPONENT_R_BIT;
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.attachmentCount = static_cast<uint32_t>(blendAttachments.size());
+        colorBlending.pAttachments = blendAttachments.data();
+        VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.flags = pipelineFlags;
+        pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+        pipelineInfo.pStages = stages.data();
+        pipelineInfo.pVertexInputState = &vertexInput;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = pipelineLayout;
+        pipelineInfo.renderPass = m_renderPass;
+        pipelineInfo.subpass = 0;
+
+        VkResult result = vkCreateGraphicsPipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        for (VkShaderModule module : modules) {
+            vkDestroyShaderModule(m_device, module, hostAllocator());
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create impostor bake pipeline!");
+        }
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    BindlessTextureTable* m_bindless = nullptr;
+    uint32_t m_atlasSize = 0;
+    uint32_t m_cellSize = 0;
+    uint32_t m_frames = 0;
+    uint32_t m_maxPages = 0;
+    uint32_t m_tilesPerRow = 0;
+    uint32_t m_maxInstances = 0;
+    Image m_bakeDepth;
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkRenderPass m_renderPass = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    std::vector<Page> m_pages;
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<Frame> m_frameData;
+    std::vector<uint32_t> m_order;  // writeInstances的临时数组，容量在帧之间复用
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "device_dispatch.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+
+// multi draw indirect：cpu剔除之后的draw命令和每个draw的数据（model矩阵、纹理）写进这一帧的两个buffer
+// 状态相同的一段draw用一条vkCmdDrawIndexedIndirect提交，shader用gl_DrawID加上push constant中的起点读取这个draw的数据
+// 和instance buffer一样每个frame in flight一套持久映射的buffer，每帧都重新写入，cache的command buffer只引用buffer中的位置
+class IndirectDrawBuffer {
+public:
+    // dataStride：每个draw的数据的字节数，和shader中storage buffer的数组元素一致；extraUsage：descriptor buffer需要的device address
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, uint32_t dataStride, uint32_t capacity, uint32_t frameCount, VkBufferUsageFlags extraUsage) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_dataStride = dataStride;
+        m_capacity = capacity;
+
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            frame.commands = createBuffer(sizeof(VkDrawIndexedIndirectCommand) * VkDeviceSize(capacity), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, "indirect draws");
+            frame.data = createBuffer(VkDeviceSize(dataStride) * capacity, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | extraUsage, "indirect draw data");
+        }
+    }
+
+    void cleanup() {
+        for (Frame& frame : m_frames) {
+            for (Buffer* buffer : {&frame.commands, &frame.data}) {
+                vkDestroyBuffer(m_device, buffer->buffer, hostAllocator());
+                m_allocator->free(buffer->allocation);
+            }
+        }
+        m_frames.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    uint32_t capacity() const { return m_capacity; }
+
+    // multi draw indirect：调用者需要保证gpu已经完成上次使用这一帧的命令，index不能超过capacity
+    void write(uint32_t frameIndex, uint32_t index, const VkDrawIndexedIndirectCommand& command, const void* data) {
+        Frame& frame = m_frames[frameIndex];
+        memcpy(static_cast<char*>(frame.commands.allocation.mapped) + sizeof(command) * index, &command, sizeof(command));
+        memcpy(static_cast<char*>(frame.data.allocation.mapped) + size_t(m_dataStride) * index, data, m_dataStride);
+    }
+
+    // multi draw indirect：drawCount大于1需要multiDrawIndirect feature
+    void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t firstDraw, uint32_t drawCount) const {
+        DeviceDispatch::cmdDrawIndexedIndirect(commandBuffer, m_frames[frameIndex].commands.buffer, sizeof(VkDrawIndexedIndirectCommand) * VkDeviceSize(firstDraw), drawCount,
+            sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    VkBuffer dataBuffer(uint32_t frameIndex) const { return m_frames[frameIndex].data.buffer; }
+    VkDeviceSize dataRange() const { return VkDeviceSize(m_dataStride) * m_capacity; }
+
+private:
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    struct Frame {
+        Buffer commands;
+        Buffer data;
+    };
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const char* name) {
+        Buffer result;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &result.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create indirect draw buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, result.buffer, &memRequirements);
+        result.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true, MemoryCategory::geometry, 0,
+            name);
+        vkBindBufferMemory(m_device, result.buffer, result.allocation.memory, result.allocation.offset);
+        return result;
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_dataStride = 0;
+    uint32_t m_capacity = 0;
+    std::vector<Frame> m_frames;
+};
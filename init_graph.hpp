@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "job_pool.hpp"
+#include "startup_timer.hpp"
+
+// init graph：initVulkan的步骤和它们之间的依赖，依赖完成的步骤马上开始，不再严格按顺序执行
+// main步骤在调用run的线程上按添加顺序执行（隐含依赖上一个main步骤），因为allocator、staging ring和upload context只能在一个线程使用
+// worker步骤只依赖显式声明的步骤，在job pool中和main步骤同时执行；main步骤用到worker步骤的结果时需要显式依赖它
+// 每个步骤写进startup timer，结束后输出并行执行的耗时和所有步骤串行执行的耗时之和
+class InitGraph {
+public:
+    using Clock = StartupTimer::Clock;
+    using StepId = uint32_t;
+
+    enum class Affinity {
+        main,
+        worker,
+    };
+
+    StepId add(const char* name, Affinity affinity, std::function<void()> function) {
+        StepId id = static_cast<StepId>(m_steps.size());
+        Step step;
+        step.name = name;
+        step.affinity = affinity;
+        step.function = std::move(function);
+        m_steps.push_back(std::move(step));
+        if (affinity == Affinity::main) {
+            if (m_lastMain != NO_STEP) {
+                depends(id, {m_lastMain});
+            }
+            m_lastMain = id;
+        }
+        return id;
+    }
+
+    void depends(StepId step, std::initializer_list<StepId> dependencies) {
+        for (StepId dependency : dependencies) {
+            m_steps[dependency].dependents.push_back(step);
+            m_steps[step].remaining++;
+        }
+    }
+
+    // init graph：执行所有步骤，任何一个步骤抛出异常后不再开始新的步骤，等已经开始的worker步骤结束后在调用者线程重新抛出
+    void run(JobPool& pool, StartupTimer& timer) {
+        m_pool = &pool;
+        m_timer = &timer;
+        Clock::time_point start = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (StepId id = 0; id < m_steps.size(); id++) {
+                if (m_steps[id].remaining == 0) {
+                    schedule(id);
+                }
+            }
+        }
+
+        while (true) {
+            StepId next = NO_STEP;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_error ? m_runningWorkers == 0 : !m_mainReady.empty() || m_finished == m_steps.size(); });
+                if (m_error) {
+                    std::rethrow_exception(m_error);
+                }
+                if (m_finished == m_steps.size()) {
+                    break;
+                }
+                next = m_mainReady.front();
+                m_mainReady.pop_front();
+            }
+            execute(next);
+        }
+        m_wallMs = milliseconds(start, Clock::now());
+    }
+
+    float wallMs() const { return m_wallMs; }
+
+    float serialMs() const {
+        float total = 0.f;
+        for (const Step& step : m_steps) {
+            total += step.durationMs;
+        }
+        return total;
+    }
+
+    void report(std::ostream& out) const {
+        size_t workerSteps = 0;
+        for (const Step& step : m_steps) {
+            workerSteps += step.affinity == Affinity::worker ? 1 : 0;
+        }
+        out << "init graph: " << m_steps.size() << " steps (" << workerSteps << " on job pool), " << m_wallMs << " ms (serial " << serialMs() << " ms, saved "
+            << std::max(0.f, serialMs() - m_wallMs) << " ms)" << std::endl;
+    }
+
+private:
+    static constexpr StepId NO_STEP = UINT32_MAX;
+
+    struct Step {
+        const char* name = nullptr;
+        Affinity affinity = Affinity::main;
+        std::function<void()> function;
+        std::vector<StepId> dependents;
+        uint32_t remaining = 0;  // 还没完成的依赖数量
+        float durationMs = 0.f;
+    };
+
+    // init graph：调用者持有m_mutex
+    void schedule(StepId id) {
+        if (m_steps[id].affinity == Affinity::main) {
+            m_mainReady.push_back(id);
+            m_condition.notify_one();
+            return;
+        }
+        m_runningWorkers++;
+        m_pool->submit([this, id]() { execute(id); });
+    }
+
+    void execute(StepId id) {
+        Step& step = m_steps[id];
+        Clock::time_point start = Clock::now();
+        std::exception_ptr error;
+        try {
+            step.function();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        Clock::time_point end = Clock::now();
+        m_timer->record(step.name, start, end);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        step.durationMs = milliseconds(start, end);
+        if (step.affinity == Affinity::worker) {
+            m_runningWorkers--;
+        }
+        if (error && !m_error) {
+            m_error = error;
+        }
+        m_finished++;
+        if (!m_error) {
+            for (StepId dependent : step.dependents) {
+                if (--m_steps[dependent].remaining == 0) {
+                    schedule(dependent);
+                }
+            }
+        }
+        m_condition.notify_one();
+    }
+
+    static float milliseconds(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<float, std::chrono::milliseconds::period>(to - from).count();
+    }
+
+    std::vector<Step> m_steps;
+    StepId m_lastMain = NO_STEP;
+    JobPool* m_pool = nullptr;
+    StartupTimer* m_timer = nullptr;
+    float m_wallMs = 0.f;
+
+    std::mutex m_mutex;  // run期间保护下面的成员和步骤的remaining、durationMs
+    std::condition_variable m_condition;
+    std::deque<StepId> m_mainReady;
+    size_t m_finished = 0;
+    uint32_t m_runningWorkers = 0;
+    std::exception_ptr m_error;
+};
+
+// init graph：步骤名是调用的代码，和STARTUP_STEP一样是字符串字面量
+#define INIT_STEP(graph, affinity, ...) (graph).add(#__VA_ARGS__, affinity, [&]() { __VA_ARGS__; })
+
+// progressive startup：第一帧不需要的初始化步骤不放进init graph，第一帧之后每帧在主线程执行一个，按添加顺序
+// ready返回false时这一帧不执行，下一帧再检查，渲染不等待；步骤和main步骤一样可以使用allocator和upload context
+// 每个步骤写进startup timer和cpu profiler，全部完成后finished返回true
+class DeferredInit {
+public:
+    using Clock = StartupTimer::Clock;
+
+    void add(const char* name, std::function<void()> function, std::function<bool()> ready = nullptr) {
+        m_steps.push_back({name, std::move(function), std::move(ready)});
+    }
+
+    bool finished() const { return m_next == m_steps.size(); }
+    size_t stepCount() const { return m_steps.size(); }
+    float totalMs() const { return m_totalMs; }
+
+    // progressive startup：执行了一个步骤时返回true
+    bool runNext(StartupTimer& timer) {
+        if (finished() || (m_steps[m_next].ready && !m_steps[m_next].ready())) {
+            return false;
+        }
+        Step& step = m_steps[m_next++];
+        Clock::time_point start = Clock::now();
+        step.function();
+        Clock::time_point end = Clock::now();
+        timer.record(step.name, start, end);
+        m_totalMs += std::chrono::duration<float, std::chrono::milliseconds::period>(end - start).count();
+        step.function = nullptr;  // 释放捕获的状态
+        return true;
+    }
+
+private:
+    struct Step {
+        const char* name;
+        std::function<void()> function;
+        std::function<bool()> ready;
+    };
+
+    std::vector<Step> m_steps;
+    size_t m_next = 0;
+    float m_totalMs = 0.f;
+};
+
+// progressive startup：步骤在initVulkan返回之后执行，只捕获this
+#define DEFERRED_INIT_STEP(deferred, ...) (deferred).add(#__VA_ARGS__, [this]() { __VA_ARGS__; })
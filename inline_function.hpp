@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// inline function：std::function的捕获超过实现的small buffer（libstdc++是16字节）时每次构造都在堆上分配
+// render graph每帧重新声明pass，pass的lambda捕获十几个handle和标志，这里的可调用对象直接放在Capacity字节的内部buffer中，永远不分配
+// 捕获超过Capacity时编译失败，需要增大Capacity或者把捕获的值放进一个结构体按指针捕获；只能移动，不能复制
+template <typename Signature, size_t Capacity = 64>
+class InlineFunction;
+
+template <typename Result, typename... Args, size_t Capacity>
+class InlineFunction<Result(Args...), Capacity> {
+public:
+    InlineFunction() = default;
+    InlineFunction(std::nullptr_t) {}
+
+    template <typename Function, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Function>, InlineFunction>>>
+    InlineFunction(Function&& function) {
+        emplace(std::forward<Function>(function));
+    }
+
+    InlineFunction(InlineFunction&& other) noexcept { moveFrom(other); }
+
+    InlineFunction& operator=(InlineFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    InlineFunction(const InlineFunction&) = delete;
+    InlineFunction& operator=(const InlineFunction&) = delete;
+
+    ~InlineFunction() { reset(); }
+
+    explicit operator bool() const { return m_invoke != nullptr; }
+
+    Result operator()(Args... args) const {
+        return m_invoke(const_cast<unsigned char*>(m_storage), std::forward<Args>(args)...);
+    }
+
+    void reset() {
+        if (m_manage != nullptr) {
+            m_manage(m_storage, nullptr);
+        }
+        m_invoke = nullptr;
+        m_manage = nullptr;
+    }
+
+private:
+    template <typename Function>
+    void emplace(Function&& function) {
+        using Stored = std::decay_t<Function>;
+        static_assert(sizeof(Stored) <= Capacity, "callable does not fit the inline storage, increase Capacity");
+        static_assert(alignof(Stored) <= alignof(std::max_align_t), "callable is over-aligned for the inline storage");
+        static_assert(std::is_nothrow_move_constructible_v<Stored>, "callable must be nothrow move constructible");
+        new (m_storage) Stored(std::forward<Function>(function));
+        m_invoke = [](void* storage, Args... args) -> Result {
+            return (*static_cast<Stored*>(storage))(std::forward<Args>(args)...);
+        };
+        // inline function：destination不为空时先移动到destination再析构，为空时只析构
+        m_manage = [](void* storage, void* destination) {
+            Stored* stored = static_cast<Stored*>(storage);
+            if (destination != nullptr) {
+                new (destination) Stored(std::move(*stored));
+            }
+            stored->~Stored();
+        };
+    }
+
+    void moveFrom(InlineFunction& other) {
+        if (other.m_manage == nullptr) {
+            return;
+        }
+        other.m_manage(other.m_storage, m_storage);
+        m_invoke = other.m_invoke;
+        m_manage = other.m_manage;
+        other.m_invoke = nullptr;
+        other.m_manage = nullptr;
+    }
+
+    alignas(std::max_align_t) unsigned char m_storage[Capacity];
+    Result (*m_invoke)(void*, Args...) = nullptr;
+    void (*m_manage)(void*, void*) = nullptr;
+};
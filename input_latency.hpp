@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// input latency：按键到画面显示的延迟，之前只能估计
+// 输入事件在glfw回调中记录时间，render thread时经过frame packet传递；帧开始采样输入时取走最早的一个，present时和这一帧的present id关联
+// 有present wait时等到id显示（frame pacing等待上一帧时就是显示的时间，否则下一帧开始时用0超时轮询，最多晚一帧），没有时只能测到present返回
+// 样本按swap chain image数量和frames in flight分组放进1ms一格的直方图，两者都会增加排队的帧；每个样本还记录present时gpu还没完成的帧数
+struct InputLatencySummary {
+    uint64_t count = 0;
+    float p50Ms = 0.f;
+    float p95Ms = 0.f;
+    float p99Ms = 0.f;
+    float averageQueuedFrames = 0.f;  // present时还没有完成的帧数的平均
+};
+
+class InputLatencyTracker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t BINS = 250;  // 最后一格包括所有更长的延迟
+    static constexpr size_t MAX_PENDING = 16;  // 显示一直没有确认（例如窗口被遮挡）时丢弃最早的样本
+
+    // input latency：toDisplay为false时没有present wait，测量到present返回
+    void init(bool toDisplay) {
+        m_toDisplay = toDisplay;
+    }
+
+    bool toDisplay() const { return m_toDisplay; }
+
+    // input latency：记录一次输入；同一帧采样的多次输入只保留最早的
+    void input(Clock::time_point time) {
+        if (m_pendingInput == Clock::time_point() || time < m_pendingInput) {
+            m_pendingInput = time;
+        }
+    }
+
+    // input latency：vkQueuePresentKHR返回之后调用，presentId是这次present的id；这一帧没有采样到输入时什么也不做
+    void presented(uint64_t presentId, uint32_t imageCount, uint32_t framesInFlight, uint32_t queuedFrames) {
+        if (m_pendingInput == Clock::time_point()) {
+            return;
+        }
+        Pending pending{presentId, m_pendingInput, histogramIndex(imageCount, framesInFlight), queuedFrames};
+        m_pendingInput = Clock::time_point();
+        if (!m_toDisplay) {
+            complete(pending, Clock::now());
+            return;
+        }
+        if (m_pending.size() == MAX_PENDING) {
+            m_pending.erase(m_pending.begin());
+        }
+        m_pending.push_back(pending);
+    }
+
+    // input latency：present wait确认presentId在time显示，id不超过它的present都已经显示
+    void displayed(uint64_t presentId, Clock::time_point time) {
+        size_t completed = 0;
+        while (completed < m_pending.size() && m_pending[completed].presentId <= presentId) {
+            complete(m_pending[completed], time);
+            completed++;
+        }
+        m_pending.erase(m_pending.begin(), m_pending.begin() + completed);
+    }
+
+    // input latency：还没有确认显示的最早的present id，没有时返回0
+    uint64_t oldestPending() const { return m_pending.empty() ? 0 : m_pending.front().presentId; }
+
+    // input latency：swap chain重建后旧的present id不能再等待
+    void reset() {
+        m_pending.clear();
+    }
+
+    InputLatencySummary summary() const {
+        InputLatencySummary summary;
+        std::vector<uint64_t>& bins = m_mergedBins;  // heap tracker：窗口标题更新时复用
+        bins.assign(BINS, 0);
+        uint64_t queuedTotal = 0;
+        for (const Histogram& histogram : m_histograms) {
+            for (uint32_t i = 0; i < BINS; i++) {
+                bins[i] += histogram.bins[i];
+            }
+            summary.count += histogram.count;
+            queuedTotal += histogram.queuedFrames;
+        }
+        fillSummary(summary, bins.data(), queuedTotal);
+        return summary;
+    }
+
+    // input latency：每个分组每个非空的格一行，ms是格的下界
+    bool writeCsv(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        file << "image_count,frames_in_flight,ms,count\n";
+        for (const Histogram& histogram : m_histograms) {
+            for (uint32_t i = 0; i < BINS; i++) {
+                if (histogram.bins[i] != 0) {
+                    file << histogram.imageCount << "," << histogram.framesInFlight << "," << i << "," << histogram.bins[i] << "\n";
+                }
+            }
+        }
+        return static_cast<bool>(file);
+    }
+
+    // input latency：每个分组一行的摘要，导出直方图时打印
+    template <typename Stream>
+    void report(Stream& out) const {
+        out << "input latency (" << (m_toDisplay ? "to display" : "to present call") << "):\n";
+        for (const Histogram& histogram : m_histograms) {
+            InputLatencySummary summary;
+            summary.count = histogram.count;
+            fillSummary(summary, histogram.bins.data(), histogram.queuedFrames);
+            out << "  " << histogram.imageCount << " swap chain images, " << histogram.framesInFlight << " frames in flight: " << summary.count << " samples, p50 "
+                << summary.p50Ms << " ms, p95 " << summary.p95Ms << " ms, p99 " << summary.p99Ms << " ms, " << summary.averageQueuedFrames << " frames queued\n";
+        }
+    }
+
+private:
+    struct Pending {
+        uint64_t presentId = 0;
+        Clock::time_point inputTime;
+        size_t histogram = 0;
+        uint32_t queuedFrames = 0;
+    };
+
+    struct Histogram {
+        uint32_t imageCount = 0;
+        uint32_t framesInFlight = 0;
+        std::vector<uint64_t> bins;
+        uint64_t count = 0;
+        uint64_t queuedFrames = 0;  // 所有样本的和
+    };
+
+    // input latency：分组只在image数量或frames in flight改变时增加，数量很少
+    size_t histogramIndex(uint32_t imageCount, uint32_t framesInFlight) {
+        for (size_t i = 0; i < m_histograms.size(); i++) {
+            if (m_histograms[i].imageCount == imageCount && m_histograms[i].framesInFlight == framesInFlight) {
+                return i;
+            }
+        }
+        m_histograms.push_back({imageCount, framesInFlight, std::vector<uint64_t>(BINS, 0), 0, 0});
+        return m_histograms.size() - 1;
+    }
+
+    void complete(const Pending& pending, Clock::time_point time) {
+        float ms = std::chrono::duration<float, std::milli>(time - pending.inputTime).count();
+        uint32_t bin = std::min(static_cast<uint32_t>(std::max(ms, 0.f)), BINS - 1);
+        Histogram& histogram = m_histograms[pending.histogram];
+        histogram.bins[bin]++;
+        histogram.count++;
+        histogram.queuedFrames += pending.queuedFrames;
+    }
+
+    // input latency：百分位数取所在格的中点
+    static void fillSummary(InputLatencySummary& summary, const uint64_t* bins, uint64_t queuedTotal) {
+        if (summary.count == 0) {
+            return;
+        }
+        auto percentile = [&](float p) {
+            uint64_t target = static_cast<uint64_t>(p * (summary.count - 1));
+            uint64_t seen = 0;
+            for (uint32_t i = 0; i < BINS; i++) {
+                seen += bins[i];
+                if (seen > target) {
+                    return i + 0.5f;
+                }
+            }
+            return BINS - 0.5f;
+        };
+        summary.p50Ms = percentile(0.50f);
+        summary.p95Ms = percentile(0.95f);
+        summary.p99Ms = percentile(0.99f);
+        summary.averageQueuedFrames = static_cast<float>(queuedTotal) / summary.count;
+    }
+
+    bool m_toDisplay = false;
+    Clock::time_point m_pendingInput;  // 最早的还没有被帧采样的输入，没有时是epoch
+    std::vector<Pending> m_pending;  // 按present id递增
+    std::vector<Histogram> m_histograms;
+    mutable std::vector<uint64_t> m_mergedBins;
+};
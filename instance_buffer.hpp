@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "device_dispatch.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+
+// instancing：每个实例的数据作为VK_VERTEX_INPUT_RATE_INSTANCE的顶点属性读取，一次draw绘制instanceCount个实例
+// 和uniform ring一样每个frame in flight一个持久映射的buffer，cpu每帧把scene list写进这一帧的buffer，不需要staging和barrier
+// 实例数量一般只有几千个，放在host visible内存中，顶点着色器每个实例只读取一次
+class InstanceBuffer {
+public:
+    // stride：每个实例的字节数；capacity：每帧最多的实例数量
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, uint32_t stride, uint32_t capacity, uint32_t frameCount) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_stride = stride;
+        m_capacity = capacity;
+
+        m_frames.resize(frameCount);
+        for (auto& frame : m_frames) {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = VkDeviceSize(stride) * capacity;
+            bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &frame.buffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create instance buffer!");
+            }
+
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(m_device, frame.buffer, &memRequirements);
+            frame.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true, MemoryCategory::geometry, 0,
+                "instance buffer");
+            vkBindBufferMemory(m_device, frame.buffer, frame.allocation.memory, frame.allocation.offset);
+        }
+    }
+
+    void cleanup() {
+        for (auto& frame : m_frames) {
+            vkDestroyBuffer(m_device, frame.buffer, hostAllocator());
+            m_allocator->free(frame.allocation);
+        }
+        m_frames.clear();
+    }
+
+    // instancing：写入某一帧的全部实例，返回实际写入的数量，超过capacity的实例被丢弃
+    // 调用者需要保证gpu已经完成上次使用这一帧的命令（等待in flight fence之后）
+    uint32_t write(uint32_t frameIndex, const void* instances, uint32_t count) {
+        count = std::min(count, m_capacity);
+        memcpy(m_frames[frameIndex].allocation.mapped, instances, size_t(m_stride) * count);
+        return count;
+    }
+
+    // batch transform：按索引从scene list中取出实例直接写入映射的内存，不需要先拷贝到中间的数组
+    uint32_t gather(uint32_t frameIndex, const void* instances, const uint32_t* indices, uint32_t count) {
+        count = std::min(count, m_capacity);
+        const char* source = static_cast<const char*>(instances);
+        char* target = static_cast<char*>(m_frames[frameIndex].allocation.mapped);
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(target + size_t(m_stride) * i, source + size_t(m_stride) * indices[i], m_stride);
+        }
+        return count;
+    }
+
+    void bind(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t binding) const {
+        VkDeviceSize offset = 0;
+        DeviceDispatch::cmdBindVertexBuffers(commandBuffer, binding, 1, &m_frames[frameIndex].buffer, &offset);
+    }
+
+    uint32_t capacity() const { return m_capacity; }
+    // stream capture：读取这一帧已经写入的实例，host coherent内存读取很慢，只用于调试和记录
+    const void* mapped(uint32_t frameIndex) const { return m_frames[frameIndex].allocation.mapped; }
+
+private:
+    struct Frame {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_stride = 0;
+    uint32_t m_capacity = 0;
+    std::vector<Frame> m_frames;
+};
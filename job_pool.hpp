@@ -0,0 +1,284 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+
+// job pool：固定数量的cpu工作线程，用于图片解码这类和vulkan无关的耗时工作
+// job中不能调用vulkan函数或者访问staging ring等只在主线程使用的对象，结果通过job自己的同步方式交回主线程
+// 例外是录制command buffer：ParallelRecorder给每个job独立的command pool，不需要外部同步
+// work stealing：每个工作线程有自己的deque，在自己的线程中submit的job放到自己deque的末尾，自己从末尾取（最近提交的数据还在cache中）
+// 自己的deque为空时从其它deque的头部偷取最早提交的job；不是工作线程的线程（主线程）submit到一个共享的deque，工作线程同样从它偷取
+// 每个deque有自己的锁，取job时只和偷取同一个deque的线程竞争，不再所有线程争一个队列
+class JobPool {
+public:
+    // job counter：submit时加一，job完成后减一，wait(counter)等待归零，用来表示一组job之间的依赖
+    struct Counter {
+        std::atomic<uint32_t> remaining{0};
+        bool done() const { return remaining.load(std::memory_order_acquire) == 0; }
+    };
+
+    struct Stats {
+        uint64_t executed = 0;  // 所有线程执行的job数量
+        uint64_t stolen = 0;  // 其中从别的deque偷取的数量
+        uint64_t executedByWaiters = 0;  // 其中由等待counter的非工作线程执行的数量
+    };
+
+    // job pool：threadCount为0时使用硬件线程数减一，给主线程留一个核；主线程wait时也执行job，所以合起来等于硬件线程数
+    void init(uint32_t threadCount = 0) {
+        if (threadCount == 0) {
+            unsigned hardwareThreads = std::thread::hardware_concurrency();  // 无法得知时返回0，先判断再减一
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+        m_stop = false;
+        m_queues.clear();
+        for (uint32_t i = 0; i <= threadCount; i++) {  // 最后一个是非工作线程共享的deque
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+        for (uint32_t i = 0; i < threadCount; i++) {
+            m_threads.emplace_back(&JobPool::run, this, i);
+        }
+    }
+
+    void cleanup() {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_stop = true;
+        }
+        m_sleepCondition.notify_all();
+        for (auto& thread : m_threads) {
+            thread.join();  // 工作线程在所有deque为空后才退出
+        }
+        m_threads.clear();
+    }
+
+    void submit(std::function<void()> job, Counter* counter = nullptr) {
+        if (counter != nullptr) {
+            counter->remaining.fetch_add(1, std::memory_order_relaxed);
+        }
+        Queue& queue = *m_queues[currentQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back({std::move(job), counter});
+        }
+        m_pending.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);  // 和工作线程检查m_pending之后开始等待之间互斥，避免丢失唤醒
+        }
+        m_sleepCondition.notify_one();
+    }
+
+    // job counter：等待counter归零，等待的线程同时执行job（先取自己的deque，再偷取），job中调用也不会因为所有线程都在等待而死锁
+    void wait(const Counter& counter) {
+        CPU_PROFILE_SCOPE("job wait");
+        uint32_t queue = currentQueue();
+        while (!counter.done()) {
+            if (!runOne(queue)) {
+                std::this_thread::yield();  // 剩下的job正在其它线程上执行
+            }
+        }
+    }
+
+    // job pool：把[0, count)分成count个job并等待全部完成，job抛出的第一个异常在调用者线程重新抛出
+    // 调用者线程参与执行，可以在job中嵌套调用
+    // heap tracker：job按模板参数传入，不构造std::function；每个job只捕获共享状态的指针和序号，放得进std::function内部的buffer，提交时不分配
+    template <typename Function>
+    void parallelFor(size_t count, const Function& job) {
+        struct Shared {
+            const Function* job = nullptr;
+            std::mutex mutex;
+            std::exception_ptr error;
+            Counter counter;
+        };
+        Shared shared;
+        shared.job = &job;
+        Shared* state = &shared;
+        for (size_t i = 0; i < count; i++) {
+            submit([state, i]() {
+                try {
+                    (*state->job)(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->error) {
+                        state->error = std::current_exception();
+                    }
+                }
+            }, &shared.counter);
+        }
+
+        wait(shared.counter);
+        if (shared.error) {
+            std::rethrow_exception(shared.error);
+        }
+    }
+
+    uint32_t threadCount() const { return static_cast<uint32_t>(m_threads.size()); }
+
+    Stats stats() const {
+        Stats stats;
+        for (const auto& queue : m_queues) {
+            stats.executed += queue->executed.load(std::memory_order_relaxed);
+            stats.stolen += queue->stolen.load(std::memory_order_relaxed);
+        }
+        stats.executedByWaiters = m_queues.empty() ? 0 : m_queues.back()->executed.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // job pool：cleanup之后也可以调用，输出整个运行期间的统计
+    void report(std::ostream& out) const {
+        Stats total = stats();
+        out << "job system: " << (m_queues.empty() ? 0 : m_queues.size() - 1) << " workers, " << total.executed << " jobs, " << total.stolen << " stolen, "
+            << total.executedByWaiters << " run by waiting threads" << '\n';
+        for (size_t i = 0; i + 1 < m_queues.size(); i++) {
+            out << "  worker " << i << ": " << m_queues[i]->executed.load(std::memory_order_relaxed) << " jobs, "
+                << m_queues[i]->stolen.load(std::memory_order_relaxed) << " stolen" << '\n';
+        }
+    }
+
+private:
+    struct Job {
+        std::function<void()> function;
+        Counter* counter = nullptr;
+    };
+
+    // heap tracker：std::deque在两端进出时不断释放和重新分配内部的块，每帧的parallelFor都会分配
+    // 这里是容量按2的幂增长的环形数组，容量只增不减，稳定之后submit和取job都不分配
+    class JobRing {
+    public:
+        bool empty() const { return m_count == 0; }
+
+        void push_back(Job job) {
+            if (m_count == m_jobs.size()) {
+                grow();
+            }
+            m_jobs[(m_head + m_count) & (m_jobs.size() - 1)] = std::move(job);
+            m_count++;
+        }
+
+        Job& front() { return m_jobs[m_head]; }
+        Job& back() { return m_jobs[(m_head + m_count - 1) & (m_jobs.size() - 1)]; }
+
+        // job已经被移走，这里清空槽位，job捕获的对象不留到下一次覆盖
+        void pop_front() {
+            m_jobs[m_head] = Job{};
+            m_head = (m_head + 1) & (m_jobs.size() - 1);
+            m_count--;
+        }
+
+        void pop_back() {
+            back() = Job{};
+            m_count--;
+        }
+
+    private:
+        void grow() {
+            std::vector<Job> jobs(std::max<size_t>(16, m_jobs.size() * 2));
+            for (size_t i = 0; i < m_count; i++) {
+                jobs[i] = std::move(m_jobs[(m_head + i) & (m_jobs.size() - 1)]);
+            }
+            m_jobs.swap(jobs);
+            m_head = 0;
+        }
+
+        std::vector<Job> m_jobs;
+        size_t m_head = 0;
+        size_t m_count = 0;
+    };
+
+    // work stealing：executed和stolen按执行job的线程统计，非工作线程都记在共享deque上
+    struct Queue {
+        std::mutex mutex;
+        JobRing jobs;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+    };
+
+    // work stealing：当前线程是这个pool的工作线程时返回它的deque，否则返回共享的deque；不同的JobPool各自判断
+    uint32_t currentQueue() const {
+        if (t_worker.pool == this) {
+            return t_worker.index;
+        }
+        return static_cast<uint32_t>(m_queues.size() - 1);
+    }
+
+    // work stealing：自己的deque从末尾取，其它deque从头部偷取，从下一个deque开始轮流，避免所有线程先偷同一个
+    bool runOne(uint32_t queueIndex) {
+        Job job;
+        bool found = false;
+        bool stolen = false;
+        {
+            Queue& own = *m_queues[queueIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                found = true;
+            }
+        }
+        for (size_t offset = 1; !found && offset < m_queues.size(); offset++) {
+            Queue& victim = *m_queues[(queueIndex + offset) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                found = stolen = true;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
+
+        {
+            CPU_PROFILE_SCOPE("job");
+            job.function();
+        }
+        Queue& self = *m_queues[queueIndex];
+        self.executed.fetch_add(1, std::memory_order_relaxed);
+        if (stolen) {
+            self.stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (job.counter != nullptr) {
+            job.counter->remaining.fetch_sub(1, std::memory_order_release);  // 最后访问counter，之后等待者可能已经销毁它
+        }
+        return true;
+    }
+
+    void run(uint32_t index) {
+        CpuProfiler::instance().setThreadName("job worker");
+        t_worker = {this, index};
+        while (true) {
+            if (runOne(index)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_sleepCondition.wait(lock, [this]() { return m_stop || m_pending.load(std::memory_order_acquire) > 0; });
+            if (m_stop && m_pending.load(std::memory_order_acquire) == 0) {
+                return;
+            }
+        }
+    }
+
+    struct WorkerSlot {
+        const JobPool* pool;
+        uint32_t index;
+    };
+    static inline thread_local WorkerSlot t_worker{nullptr, 0};
+
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::atomic<uint32_t> m_pending{0};  // 所有deque中还没有被取走的job数量
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCondition;
+    bool m_stop = false;
+};
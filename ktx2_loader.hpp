@@ -0,0 +1,179 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "asset_pack.hpp"
+
+// ktx2：块压缩纹理（BC7/ASTC）的容器格式，每个mip的压缩块直接按vkFormat上传，不需要cpu解码
+// 这里只支持没有supercompression的2D纹理，basis universal需要转码库，生成文件时使用toktx --encode的非basis模式，比如：
+//   toktx --t2 --genmipmap --target_type RGBA --assign_oetf srgb --encode astc texture_astc.ktx2 texture.jpg
+struct Ktx2Level {
+    VkDeviceSize offset;  // 相对于文件开头的偏移
+    VkDeviceSize size;
+    uint32_t width;
+    uint32_t height;
+};
+
+struct Ktx2Texture {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<Ktx2Level> levels;  // levels[0]是最大的一级
+};
+
+// ktx2：块压缩格式的块大小（像素）和每块字节数，不是块压缩格式时返回false
+inline bool ktx2BlockFootprint(VkFormat format, uint32_t& blockWidth, uint32_t& blockHeight, uint32_t& blockBytes) {
+    blockWidth = 4;
+    blockHeight = 4;
+    if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK) {
+        // BC1和BC4每块8字节，其它16字节
+        bool half = format <= VK_FORMAT_BC1_RGBA_SRGB_BLOCK || format == VK_FORMAT_BC4_UNORM_BLOCK || format == VK_FORMAT_BC4_SNORM_BLOCK;
+        blockBytes = half ? 8 : 16;
+        return true;
+    }
+    if (format >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK && format <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK) {
+        // ETC2 RGB、RGB A1和EAC R11每块8字节，ETC2 RGBA8和EAC R11G11 16字节
+        bool full = format == VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK || format == VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK || format >= VK_FORMAT_EAC_R11G11_UNORM_BLOCK;
+        blockBytes = full ? 16 : 8;
+        return true;
+    }
+    if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+        // ASTC：每块都是16字节，UNORM和SRGB两两相邻，按VkFormat的顺序排列
+        static const uint8_t FOOTPRINTS[14][2] = {{4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6}, {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}};
+        const uint8_t* footprint = FOOTPRINTS[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+        blockWidth = footprint[0];
+        blockHeight = footprint[1];
+        blockBytes = 16;
+        return true;
+    }
+    return false;
+}
+
+// ktx2：只读取header和level index，level数据用readKtx2Level按需读取，这样mip可以逐级流式加载
+// 文件不存在返回false，文件格式不支持时抛出异常
+// asset pack：文件在挂载的pack中时从映射的内存读取
+// gpu decompression：分块压缩的文件只解压header和level index所在的block，level数据留给gpu解压
+inline bool loadKtx2(const std::string& filename, Ktx2Texture& texture) {
+    AssetPack& pack = AssetPack::instance();
+    std::ifstream file;
+    size_t fileSize = 0;
+    bool packed = pack.size(filename, fileSize);
+    if (!packed) {
+        file.open(filename, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        fileSize = (size_t) file.tellg();
+    }
+    auto read = [&](size_t offset, char* target, size_t size) {
+        if (packed) {
+            pack.read(filename, offset, size, target);
+        } else {
+            file.seekg(static_cast<std::streamoff>(offset));
+            file.read(target, static_cast<std::streamsize>(size));
+        }
+    };
+
+    std::vector<char> header(std::min<size_t>(fileSize, 80));
+    read(0, header.data(), header.size());
+
+    static const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    const size_t levelIndexOffset = 80;  // identifier + header(9 * uint32) + index(4 * uint32 + 2 * uint64)
+    if (fileSize < levelIndexOffset || memcmp(header.data(), identifier, sizeof(identifier)) != 0) {
+        throw std::runtime_error("invalid ktx2 file: " + filename);
+    }
+
+    auto readU32 = [&](size_t offset) { uint32_t value; memcpy(&value, header.data() + offset, sizeof(value)); return value; };
+    auto readU64 = [&](size_t offset) { uint64_t value; memcpy(&value, header.data() + offset, sizeof(value)); return value; };
+
+    texture.format = static_cast<VkFormat>(readU32(12));
+    texture.width = readU32(20);
+    texture.height = readU32(24);
+    uint32_t pixelDepth = readU32(28);
+    uint32_t layerCount = readU32(32);
+    uint32_t faceCount = readU32(36);
+    uint32_t levelCount = readU32(40);
+    uint32_t supercompressionScheme = readU32(44);
+
+    if (texture.format == VK_FORMAT_UNDEFINED || supercompressionScheme != 0) {
+        throw std::runtime_error("ktx2 basis/supercompressed textures are not supported: " + filename);
+    }
+    if (pixelDepth > 1 || layerCount > 1 || faceCount != 1 || texture.width == 0 || texture.height == 0) {
+        throw std::runtime_error("only 2D ktx2 textures are supported: " + filename);
+    }
+    uint32_t blockWidth, blockHeight, blockBytes;
+    if (!ktx2BlockFootprint(texture.format, blockWidth, blockHeight, blockBytes)) {
+        throw std::runtime_error("ktx2 texture is not block compressed: " + filename);
+    }
+
+    // level index：levelCount来自文件，先和尺寸允许的mip数比较，之后的大小计算都在size_t中进行，不会回绕
+    uint32_t maxLevels = 1;
+    while ((std::max(texture.width, texture.height) >> maxLevels) > 0) {
+        maxLevels++;
+    }
+    levelCount = levelCount > 0 ? levelCount : 1;  // 0表示需要运行时生成mip，压缩格式无法blit，当作只有一级
+    if (levelCount > maxLevels) {
+        throw std::runtime_error("invalid ktx2 level count: " + filename);
+    }
+    const size_t levelIndexSize = static_cast<size_t>(levelCount) * 24;
+    if (levelIndexSize > fileSize - levelIndexOffset) {
+        throw std::runtime_error("truncated ktx2 level index: " + filename);
+    }
+
+    header.resize(levelIndexOffset + levelIndexSize);
+    read(levelIndexOffset, header.data() + levelIndexOffset, levelIndexSize);
+
+    texture.levels.resize(levelCount);
+    for (uint32_t i = 0; i < levelCount; i++) {
+        Ktx2Level& level = texture.levels[i];
+        level.offset = readU64(levelIndexOffset + i * 24);
+        level.size = readU64(levelIndexOffset + i * 24 + 8);
+        level.width = texture.width >> i > 0 ? texture.width >> i : 1;
+        level.height = texture.height >> i > 0 ? texture.height >> i : 1;
+
+        if (level.offset > fileSize || level.size > fileSize - level.offset) {
+            throw std::runtime_error("truncated ktx2 level data: " + filename);
+        }
+        // vkCmdCopyBufferToImage按块读取整个level，size小于块数据时会读到staging的数据之外
+        uint64_t levelBytes = static_cast<uint64_t>((level.width + blockWidth - 1) / blockWidth) * ((level.height + blockHeight - 1) / blockHeight) * blockBytes;
+        if (level.size < levelBytes) {
+            throw std::runtime_error("ktx2 level is smaller than its compressed blocks: " + filename);
+        }
+    }
+
+    return true;
+}
+
+// ktx2：读取一个level的压缩块数据，可以在后台线程调用
+inline std::vector<char> readKtx2Level(const std::string& filename, const Ktx2Level& level) {
+    size_t packedSize = 0;
+    if (AssetPack::instance().size(filename, packedSize)) {
+        if (level.offset > packedSize || level.size > packedSize - level.offset) {
+            throw std::runtime_error("failed to read ktx2 level: " + filename);
+        }
+        std::vector<char> data(static_cast<size_t>(level.size));
+        AssetPack::instance().read(filename, level.offset, level.size, data.data());
+        return data;
+    }
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open ktx2 file: " + filename);
+    }
+
+    std::vector<char> data(static_cast<size_t>(level.size));
+    file.seekg(static_cast<std::streamoff>(level.offset));
+    file.read(data.data(), data.size());
+    if (!file) {
+        throw std::runtime_error("failed to read ktx2 level: " + filename);
+    }
+    return data;
+}
@@ -6,15 +6,21 @@
 #define GLM_ENABLE_EXPERIMENTAL  // model loading：gtx/hash是glm的一个实验性扩展需要打开
 #include <glm/glm.hpp>  // vertex input：顶点数据
 #include <glm/gtx/hash.hpp>
+#include <glm/gtc/packing.hpp>  // compact vertex：snorm和半精度打包
 
 // texture image: 引入纹理的库
-#define STB_IMAGE_IMPLEMENTATION
+// vulkan renderer：stb、tinyobjloader和tinygltf的实现在renderer.cpp中（vulkan_renderer库）
+#include "staging_decode.hpp"
 #include "thirdparty/stb/stb_image.h"
 
 
 // model loading：加载obj文件
-#define TINYOBJLOADER_IMPLEMENTATION
 #include "thirdparty/tiny_obj/tiny_obj_loader.h"
+// gltf：图片交给stb和texture cache解码，不使用tinygltf自带的stb和外部图片读取
+#define TINYGLTF_NO_STB_IMAGE
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#define TINYGLTF_NO_EXTERNAL_IMAGE
+#include "gltf_loader.hpp"
 
 #include <iostream>
 #include <fstream>  // shader module：读取文件
@@ -23,23 +29,241 @@
 #include <vector>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>  // mipmap：计算mip数量
+#include <cfloat>  // gltf：没有min和max的accessor计算包围盒
 #include <optional>  // 物理设备
 #include <set>  // 窗口表面：去重物理设备用于逻辑队列创建
+#include <deque>  // texture streaming：上传中的mip level
+#include <atomic>  // render thread：窗口回调和渲染线程共享的标记
+#include <mutex>  // parallel decode：解码完成的job交回主线程
+#include <condition_variable>
+#include <algorithm>  // texture atlas：按高度排序小纹理
+#include <memory>  // model loader：映射的缓存文件和gltf模型随加载结果移动
 #include <vulkan/vk_enum_string_helper.h>  // 帮助把VkResult转换成string，string_VkResult
 
 #include "camera.hpp"
+#include "memory_allocator.hpp"
+#include "staging_ring.hpp"
+#include "upload_context.hpp"
+#include "async_compute.hpp"
+#include "geometry_buffer.hpp"
+#include "uniform_ring.hpp"
+#include "instance_buffer.hpp"
+#include "bvh.hpp"
+#include "frustum_culling.hpp"
+#include "software_occlusion.hpp"
+#include "gpu_culling.hpp"
+#include "gpu_decompress.hpp"
+#include "gpu_mesh_decode.hpp"
+#include "static_batcher.hpp"
+#include "gpu_mesh_import.hpp"
+#include "dynamic_resolution.hpp"
+#include "quality_manager.hpp"
+#include "thermal_governor.hpp"
+#include "shading_rate.hpp"
+#include "post_process.hpp"
+#include "attachment_bandwidth.hpp"
+#include "deferred_shading.hpp"
+#include "clustered_lighting.hpp"
+#include "shadow_cache.hpp"
+#include "impostor.hpp"
+#include "acceleration_structures.hpp"
+#include "skinning.hpp"
+#include "particles.hpp"
+#include "compute_primitives.hpp"
+#include "terrain.hpp"
+#include "frame_capture.hpp"
+#include "video_encode.hpp"
+#include "occlusion_queries.hpp"
+#include "hiz_pyramid.hpp"
+#include "indirect_draws.hpp"
+#include "object_buffer.hpp"
+#include "material_table.hpp"
+#include "deletion_queue.hpp"
+#include "residency.hpp"
+#include "compute_mipmaps.hpp"
+#include "ktx2_loader.hpp"
+#include "texture_streamer.hpp"
+#include "async_io.hpp"
+#include "texture_cache.hpp"
+#include "job_pool.hpp"
+#include "sampler_cache.hpp"
+#include "bindless_textures.hpp"
+#include "texture_atlas.hpp"
+#include "image_barriers.hpp"
+#include "mesh_cache.hpp"
+#include "flat_index_map.hpp"
+#include "obj_stream.hpp"
+#include "mesh_optimizer.hpp"
+#include "mesh_simplifier.hpp"
+#include "model_loader.hpp"
+#include "slot_map.hpp"
+#include "async_task.hpp"
+#include "world_streaming.hpp"
+#include "stress_scene.hpp"
+#include "upload_scheduler.hpp"
+#include "meshlet_buffer.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_desc.hpp"
+#include "pipeline_library.hpp"
+#include "pipeline_compiler.hpp"
+#include "shader_statistics.hpp"
+#include "dynamic_state.hpp"
+#include "shader_object.hpp"
+#include "shader_registry.hpp"
+#include "descriptor_allocator.hpp"
+#include "draw_sort.hpp"
+#include "descriptor_buffer.hpp"
+#include "timeline_semaphore.hpp"
+#include "device_group.hpp"
+#include "device_selector.hpp"
+#include "device_capabilities.hpp"
+#include "device_dispatch.hpp"
+#include "batch_transform.hpp"
+#include "transform_store.hpp"
+#include "frame_pacer.hpp"
+#include "host_image_copy.hpp"
+#include "stream_capture.hpp"
+#include "telemetry_export.hpp"
+#include "window_view.hpp"
+#include "parallel_recorder.hpp"
+#include "simulation.hpp"
+#include "render_thread.hpp"
+#include "idle_detector.hpp"
+#include "resize_coalescer.hpp"
+#include "render_graph.hpp"
+#include "gpu_profiler.hpp"
+#include "draw_cost_profiler.hpp"
+#include "cpu_profiler.hpp"
+#include "frame_stats.hpp"
+#include "input_latency.hpp"
+#include "hitch_detector.hpp"
+#include "benchmark.hpp"
+#include "startup_timer.hpp"
+#include "init_graph.hpp"
+#include "host_memory.hpp"
+#include "heap_tracker.hpp"
+#include "frame_arena.hpp"
+#include "regression.hpp"
+#include "validation_log.hpp"
+#include "asset_pack.hpp"
+#include "portability_profile.hpp"
+#include "display_mode.hpp"
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
+// gltf：扩展名是.gltf或.glb时按gltf加载，每个primitive一个mesh，不经过mesh cache
 const std::string MODEL_PATH = "/Users/sichaoshu/workspace/VulkanTutorial/VulkanTutorial/models/AC_Unit.obj";
+// mesh cache：第一次导入后写入的二进制缓存，和模型放在一起替换扩展名，源文件改变时自动重建
+const std::string MESH_CACHE_EXTENSION = ".meshcache";
+// pipeline cache：驱动编译shader的结果，退出时写入，下次启动时复用
+const std::string PIPELINE_CACHE_PATH = "/Users/sichaoshu/workspace/VulkanTutorial/VulkanTutorial/pipeline.cache";
 const std::string TEXTURE_PATH = "/Users/sichaoshu/workspace/VulkanTutorial/VulkanTutorial/textures/texture.jpg";
+// asset pack：VulkanTutorial_pack生成的资源包，存在时模型的mesh cache、ktx2和图片先在pack中按文件名查找，不存在时全部从文件读取
+const std::string ASSET_PACK_PATH = "/Users/sichaoshu/workspace/VulkanTutorial/VulkanTutorial/assets.pack";
+// mapped file：纹理文件映射之后直接解码，内核预读代替async io的读取，内容不复制到堆上；关闭时回到AsyncFileReader
+const bool MAPPED_ASSET_READS = true;
+// ktx2：预先压缩好的纹理和原图放在一起，替换原图扩展名得到文件名，桌面gpu一般支持BC7，apple和移动端gpu支持ASTC
+// 都不存在或者设备不支持时回退到原图
+const std::string TEXTURE_BC7_SUFFIX = "_bc7.ktx2";
+const std::string TEXTURE_ASTC_SUFFIX = "_astc.ktx2";
+// texture streaming：ktx2纹理启动时只上传长宽不超过这个尺寸的mip，更高精度的mip在相机靠近时由后台线程加载
+const uint32_t TEXTURE_STREAM_TAIL_SIZE = 128;
+// texture streaming：相机到模型的距离小于这个值时需要level 0，距离每增加一倍需要的精度降低一级
+const float TEXTURE_STREAM_DISTANCE = 1.0f;
+// host image copy：支持VK_EXT_host_image_copy时解码的纹理由工作线程直接写入image，完整上传的ktx2纹理不经过staging也没有提交
+const bool HOST_IMAGE_COPY = true;
+// half precision：支持shaderFloat16时forward的bindless.frag使用HALF_PRECISION变体，颜色、纹理和光照累积用fp16计算，位置、深度和阴影仍然是fp32
+const bool HALF_PRECISION_SHADERS = true;
+// shader registry：shader按源文件名从嵌入的SPIR-V中查找，static_assert检查它们都在CMakeLists.txt的SHADER_SOURCES中
+constexpr std::string_view DEPTH_VERT_SHADER = "27_shader_depth.vert";  // 非compact顶点格式
+constexpr std::string_view BINDLESS_FRAG_SHADER = "bindless.frag";  // bindless：按push constant的index采样纹理数组
+constexpr std::string_view BINDLESS_RAY_QUERY_FRAG_SHADER = "bindless_ray_query.frag";  // ray traced shadows：bindless.frag定义RAY_QUERY_SHADOWS的变体
+constexpr std::string_view BINDLESS_FP16_FRAG_SHADER = "bindless_fp16.frag";  // half precision：bindless.frag定义HALF_PRECISION的变体
+constexpr std::string_view BINDLESS_RAY_QUERY_FP16_FRAG_SHADER = "bindless_ray_query_fp16.frag";  // 同时定义RAY_QUERY_SHADOWS和HALF_PRECISION
+constexpr std::string_view COMPACT_VERT_SHADER = "compact.vert";  // compact vertex：读取量化的顶点
+constexpr std::string_view POSITION_ONLY_VERT_SHADER = "position_only.vert";  // split vertex streams：depth prepass只读取位置
+constexpr std::string_view MIPMAP_SHADER = "mipmap_downsample.comp";  // mipmap：compute下采样
+constexpr std::string_view MESHLET_TASK_SHADER = "meshlet_cull.task";  // meshlet：task shader剔除meshlet
+constexpr std::string_view MESHLET_MESH_SHADER = "meshlet.mesh";  // meshlet：mesh shader输出meshlet的三角形
+constexpr std::string_view INSTANCE_CULL_SHADER = "instance_cull.comp";  // gpu culling：compute剔除实例并写入indirect draw的count
+constexpr std::string_view HIZ_REDUCE_SHADER = "hiz_reduce.comp";  // hi-z：depth逐级取最大值生成pyramid
+constexpr std::string_view UPSCALE_VERT_SHADER = "upscale.vert";  // dynamic resolution：全屏三角形
+constexpr std::string_view UPSCALE_FRAG_SHADER = "upscale.frag";  // dynamic resolution：双线性放大和锐化
+constexpr std::string_view SHADING_RATE_SHADER = "shading_rate.comp";  // variable rate shading：按亮度和运动生成rate image
+constexpr std::string_view GBUFFER_FRAG_SHADER = "gbuffer.frag";  // deferred shading：subpass 0写入G-buffer
+constexpr std::string_view DEFERRED_LIGHTING_FRAG_SHADER = "deferred_lighting.frag";  // deferred shading：subpass 1读取input attachment计算光照
+constexpr std::string_view LIGHT_CLUSTER_SHADER = "light_cluster.comp";  // clustered lighting：把光源分进view space的cluster
+constexpr std::string_view SHADOW_VERT_SHADER = "shadow.vert";  // shadow cache：只写depth的caster
+constexpr std::string_view POST_PREFILTER_SHADER = "post_prefilter.comp";  // post processing：bloom缩小和亮度直方图
+constexpr std::string_view POST_BLUR_SHADER = "post_blur.comp";  // post processing：bloom的gaussian
+constexpr std::string_view POST_EXPOSURE_SHADER = "post_exposure.comp";  // post processing：subgroup归约直方图得到曝光
+constexpr std::string_view POST_TONEMAP_SHADER = "post_tonemap.comp";  // post processing：bloom合成、tonemap和锐化
+constexpr std::string_view MESH_DEDUP_SHADER = "mesh_dedup.comp";  // gpu mesh import：hash表去重obj的corner并重映射索引
+constexpr std::string_view GPU_DECOMPRESS_SHADER = "gpu_decompress.comp";  // gpu decompression：每个线程解压asset pack的一个LZ4 block
+constexpr std::string_view IMPOSTOR_BAKE_VERT_SHADER = "impostor_bake.vert";  // impostor：把mesh投影到atlas的一个frame
+constexpr std::string_view IMPOSTOR_BAKE_FRAG_SHADER = "impostor_bake.frag";  // impostor：写入albedo和到包围球的深度
+constexpr std::string_view IMPOSTOR_VERT_SHADER = "impostor.vert";  // impostor：面向相机的四边形，选择最近的frame
+constexpr std::string_view IMPOSTOR_FRAG_SHADER = "impostor.frag";  // impostor：采样atlas并重建表面深度
+constexpr std::string_view SKINNING_SHADER = "skinning.comp";  // skinning：每个顶点按joint矩阵蒙皮，写进这一帧的顶点范围
+constexpr std::string_view PARTICLE_COMP_SHADER = "particles.comp";  // particles：发射、模拟、压缩和排序
+constexpr std::string_view PARTICLE_VERT_SHADER = "particle.vert";  // particles：面向相机的四边形
+constexpr std::string_view PARTICLE_FRAG_SHADER = "particle.frag";  // particles：圆形的软边粒子
+constexpr std::string_view TERRAIN_CULL_SHADER = "terrain_cull.comp";  // terrain：CDLOD四叉树的选择和视锥剔除
+constexpr std::string_view TERRAIN_VERT_SHADER = "terrain.vert";  // terrain：patch网格的高度采样和level之间的morph
+constexpr std::string_view TERRAIN_FRAG_SHADER = "terrain.frag";  // terrain：按坡度和高度着色
+constexpr std::string_view VIDEO_CONVERT_SHADER = "video_convert.comp";  // video encode：color target转换成NV12
+constexpr std::string_view OCCLUSION_BOX_VERT_SHADER = "occlusion_box.vert";  // occlusion queries：mesh的包围盒
+constexpr std::string_view RADIX_SORT_SHADER = "radix_sort.comp";  // gpu radix sort：粒子按距离排序
+constexpr std::string_view RADIX_SORT_SUBGROUP_SHADER = "radix_sort_subgroup.comp";  // gpu radix sort：ballot计算tile内名次的变体
+constexpr std::string_view COMPUTE_PRIMITIVES_SHADER = "compute_primitives.comp";  // compute primitives：reduce、scan、compaction、直方图
+constexpr std::string_view COMPUTE_PRIMITIVES_SUBGROUP_SHADER = "compute_primitives_subgroup.comp";  // compute primitives：subgroup arithmetic的变体
+constexpr std::string_view MESH_DECODE_SHADER = "mesh_decode.comp";  // mesh codec：编码的顶点和索引解码到geometry buffer
+constexpr std::string_view PULLED_VERT_SHADER = "pulled.vert";  // vertex pulling：从storage buffer读取顶点
+static_assert(findEmbeddedShader(DEPTH_VERT_SHADER) && findEmbeddedShader(BINDLESS_FRAG_SHADER) && findEmbeddedShader(COMPACT_VERT_SHADER)
+    && findEmbeddedShader(MIPMAP_SHADER) && findEmbeddedShader(MESHLET_TASK_SHADER) && findEmbeddedShader(MESHLET_MESH_SHADER)
+    && findEmbeddedShader(INSTANCE_CULL_SHADER) && findEmbeddedShader(HIZ_REDUCE_SHADER) && findEmbeddedShader(UPSCALE_VERT_SHADER)
+    && findEmbeddedShader(UPSCALE_FRAG_SHADER) && findEmbeddedShader(SHADING_RATE_SHADER) && findEmbeddedShader(GBUFFER_FRAG_SHADER)
+    && findEmbeddedShader(DEFERRED_LIGHTING_FRAG_SHADER) && findEmbeddedShader(LIGHT_CLUSTER_SHADER) && findEmbeddedShader(SHADOW_VERT_SHADER)
+    && findEmbeddedShader(POST_PREFILTER_SHADER) && findEmbeddedShader(POST_BLUR_SHADER) && findEmbeddedShader(POST_EXPOSURE_SHADER)
+    && findEmbeddedShader(POST_TONEMAP_SHADER) && findEmbeddedShader(MESH_DEDUP_SHADER) && findEmbeddedShader(GPU_DECOMPRESS_SHADER)
+    && findEmbeddedShader(IMPOSTOR_BAKE_VERT_SHADER) && findEmbeddedShader(IMPOSTOR_BAKE_FRAG_SHADER) && findEmbeddedShader(IMPOSTOR_VERT_SHADER)
+    && findEmbeddedShader(IMPOSTOR_FRAG_SHADER) && findEmbeddedShader(BINDLESS_RAY_QUERY_FRAG_SHADER)
+    && findEmbeddedShader(BINDLESS_FP16_FRAG_SHADER) && findEmbeddedShader(BINDLESS_RAY_QUERY_FP16_FRAG_SHADER)
+    && findEmbeddedShader(SKINNING_SHADER) && findEmbeddedShader(PARTICLE_COMP_SHADER) && findEmbeddedShader(PARTICLE_VERT_SHADER)
+    && findEmbeddedShader(PARTICLE_FRAG_SHADER) && findEmbeddedShader(TERRAIN_CULL_SHADER) && findEmbeddedShader(TERRAIN_VERT_SHADER)
+    && findEmbeddedShader(TERRAIN_FRAG_SHADER) && findEmbeddedShader(VIDEO_CONVERT_SHADER)
+    && findEmbeddedShader(OCCLUSION_BOX_VERT_SHADER)
+    && findEmbeddedShader(RADIX_SORT_SHADER) && findEmbeddedShader(RADIX_SORT_SUBGROUP_SHADER)
+    && findEmbeddedShader(COMPUTE_PRIMITIVES_SHADER) && findEmbeddedShader(COMPUTE_PRIMITIVES_SUBGROUP_SHADER)
+    && findEmbeddedShader(MESH_DECODE_SHADER) && findEmbeddedShader(PULLED_VERT_SHADER),
+    "shader missing from SHADER_SOURCES");
 
 // frames in flight：fence等待前一帧完成cpu才能继续执行，这样cpu占用降低
 // 解决方法是允许多个帧同时进行录制command buffer
 // 定义同时处理的帧数量为2，也就是cpu录制这一帧给gpu渲染后然后立刻录制下一帧，如果下一帧录制提交给gpu结束后再准备录制这一帧发现这一帧gpu渲染没结束才阻塞
 // 定义成2时因为如果有更多帧同时录制可能造成帧延迟，也就是gpu当前渲染出来的几帧前的cpu数据
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// latency mode：每帧的资源按最大值MAX_FRAMES_IN_FLIGHT创建，实际同时进行的帧数m_framesInFlight在运行时用数字键1-3切换
+// 1延迟最低但是cpu和gpu不能重叠，3在gpu瓶颈的场景吞吐量更高
+const int MAX_FRAMES_IN_FLIGHT = 3;
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+// staging ring：所有上传共享的持久映射staging buffer大小
+const VkDeviceSize STAGING_RING_SIZE = 64 * 1024 * 1024;
+
+// geometry buffer：所有mesh共享的顶点和索引容量
+const uint32_t GEOMETRY_MAX_VERTICES = 1024 * 1024;
+const uint32_t GEOMETRY_MAX_INDICES = 4 * 1024 * 1024;
+// sparse binding：支持sparseResidencyBuffer时geometry buffer的容量只占地址空间，mesh用到的页才提交内存，不支持时一次分配全部容量
+const bool SPARSE_GEOMETRY = true;
+// meshlet：所有模型共享的meshlet buffer容量，meshlet边界上的顶点会重复，顶点容量比geometry buffer大
+const uint32_t MESHLET_BUFFER_MAX_MESHLETS = 64 * 1024;
+const uint32_t MESHLET_BUFFER_MAX_VERTICES = 2 * GEOMETRY_MAX_VERTICES;
+const uint32_t MESHLET_BUFFER_MAX_TRIANGLES = GEOMETRY_MAX_INDICES / 3;
+
+// uniform ring：每帧uniform buffer的大小，256字节对齐时可以放4096个ubo
+const VkDeviceSize UNIFORM_RING_FRAME_SIZE = 1024 * 1024;
 
 // 验证层扩展名
 const std::vector<const char*> validationLayers = {
@@ -47,14 +271,403 @@ const std::vector<const char*> validationLayers = {
 };
 
 // 逻辑设备：设备扩展支持
+// portability profile：VK_KHR_portability_subset不在这里，设备暴露时由PortabilityProfile开启
 const std::vector<const char*> deviceExtensions = {
-    // 逻辑设备：在mac上的vulkan运行时必须开启该extension
-#ifdef __APPLE__
-    "VK_KHR_portability_subset",
-#endif
     VK_KHR_SWAPCHAIN_EXTENSION_NAME  // swapchain：必须开启扩展才支持swapchain
 };
 
+// bindless：纹理数组的最大元素数量，实际容量还受设备限制
+const uint32_t BINDLESS_TEXTURE_CAPACITY = 4096;
+// descriptor buffer：所有set共享的descriptor buffer大小，纹理数组占大部分
+const VkDeviceSize DESCRIPTOR_BUFFER_SIZE = 1024 * 1024;
+// texture atlas：长宽都不超过TEXTURE_ATLAS_MAX_SIZE的纹理打包进TEXTURE_ATLAS_SIZE大小的atlas page
+// 每个纹理四周留TEXTURE_ATLAS_PADDING像素，mip只生成到padding缩小到1像素的那一级
+const uint32_t TEXTURE_ATLAS_MAX_SIZE = 256;
+const uint32_t TEXTURE_ATLAS_SIZE = 2048;
+const uint32_t TEXTURE_ATLAS_PADDING = 4;
+const uint32_t TEXTURE_ATLAS_MIP_LEVELS = 3;
+
+// memory budget：在窗口标题显示显存预算和使用量
+const bool SHOW_MEMORY_STATS = true;
+// memory report：所有vulkan对象传入统计用的VkAllocationCallbacks，记录驱动的cpu内存；M键把显存和cpu内存的报告写到MEMORY_REPORT_PATH
+const bool TRACK_HOST_ALLOCATIONS = true;
+// host arena：统计时command scope的分配使用每个线程的线性arena，object scope的小分配使用分级pool，报告中列出每帧的分配次数
+const bool HOST_ALLOCATION_ARENAS = true;
+// heap tracker：统计帧循环所在线程每帧operator new的次数，连续HEAP_CHECK_SETTLE_FRAMES个steady state的帧之后，有分配的帧输出到stderr，--heap-check同样开启
+// steady state：没有模型导入、上传、纹理streaming和resize，也没有功能键和swap chain重建；退出时输出有分配的帧数
+const bool CHECK_FRAME_ALLOCATIONS = false;
+const uint32_t HEAP_CHECK_SETTLE_FRAMES = 120;
+// heap tracker：为true时第一个有分配的steady state帧直接abort，在调试器中停在分配之后
+const bool HEAP_CHECK_ABORT = false;
+const std::string MEMORY_REPORT_PATH = "memory_report.txt";
+// gpu profiler：在窗口标题显示每个pass最近120帧gpu耗时的min/avg/max毫秒
+const bool SHOW_GPU_TIMINGS = true;
+// pipeline statistics：设备支持pipelineStatisticsQuery时每个render graph pass统计顶点、图元和shader调用次数，显示在gpu耗时后面
+// mesh shader绘制不经过input assembly和vertex shader，这两项是0
+const bool USE_PIPELINE_STATISTICS = false;
+// draw costs：--draw-costs时每个draw前后写timestamp，窗口标题显示最贵的mesh，G键和程序退出时打印耗时最大的DRAW_COST_TOP_COUNT个mesh和材质
+// 诊断模式关闭multi draw indirect、并行录制和command cache，每个mesh一个draw，每帧重新录制
+const uint32_t DRAW_COST_TOP_COUNT = 10;
+// cpu profiler：记录CPU_PROFILE_SCOPE标记的作用域，T键和程序退出时把最近的事件导出到CPU_TRACE_PATH
+const bool ENABLE_CPU_PROFILER = true;
+const std::string CPU_TRACE_PATH = "cpu_trace.json";
+// gpu timeline：设备支持VK_EXT_calibrated_timestamps时gpu profiler的pass时间校准到cpu的时钟，作为"gpu queue" track一起导出到CPU_TRACE_PATH
+const bool GPU_TIMELINE = true;
+// hitch detector：帧时间超过最近120帧中位数HITCH_FACTOR倍并且超过HITCH_MIN_MS时，把卡顿前后各HITCH_CAPTURE_SECONDS秒的cpu/gpu trace和上下文
+// （swap chain重建、进行中的上传和pipeline编译）导出到HITCH_TRACE_PREFIX加帧序号的json，最多HITCH_MAX_CAPTURES个；需要ENABLE_CPU_PROFILER
+const bool HITCH_CAPTURE = true;
+const float HITCH_FACTOR = 2.0f;
+const float HITCH_MIN_MS = 10.0f;
+const float HITCH_CAPTURE_SECONDS = 1.0f;
+const uint32_t HITCH_MAX_CAPTURES = 8;
+const std::string HITCH_TRACE_PREFIX = "hitch_";
+// frame stats：窗口标题每TITLE_UPDATE_INTERVAL秒更新一次，glfwSetWindowTitle要和窗口系统通信，不适合每帧调用；C键导出帧时间到FRAME_TIMES_PATH
+// input latency：C键同时导出按键到显示的延迟直方图到INPUT_LATENCY_PATH，按swap chain image数量和frames in flight分组
+const float TITLE_UPDATE_INTERVAL = 0.5f;
+const std::string FRAME_TIMES_PATH = "frame_times.csv";
+const std::string INPUT_LATENCY_PATH = "input_latency.csv";
+// telemetry：--telemetry shm:<name>或者unix:<path>时每TELEMETRY_INTERVAL秒发布一条帧时间、gpu耗时、显存和上传队列的二进制记录，格式见telemetry_export.hpp
+const float TELEMETRY_INTERVAL = 0.1f;
+// late latch：command buffer录制完成、vkQueueSubmit之前重新取模拟插值的相机，改写ubo中的view和viewProj；benchmark时不使用
+const bool LATE_LATCH_CAMERA = true;
+// idle rendering：连续IDLE_SETTLE_FRAMES帧画面没有变化后停止绘制，等待输入，最多IDLE_WAKE_INTERVAL秒醒来重新检查；headless和benchmark时不使用
+const bool IDLE_RENDERING = true;
+const uint32_t IDLE_SETTLE_FRAMES = 30;
+const float IDLE_WAKE_INTERVAL = 1.0f;
+// benchmark：--benchmark参数启动时按固定相机路径和固定时间步长运行，记录的帧数和输出路径
+// benchmark时关闭frame pacing和帧率上限，present policy使用immediate（不支持时退到mailbox或FIFO）
+const uint32_t BENCHMARK_WARMUP_FRAMES = 300;
+const uint32_t BENCHMARK_MEASURED_FRAMES = 1200;
+const float BENCHMARK_TIME_STEP = 1.0f / 60.0f;
+const std::string BENCHMARK_OUTPUT_PATH = "benchmark.csv";
+// regression：--regression跑完benchmark后和REGRESSION_BASELINE_DIR中这块gpu、这个场景的baseline比较，报告写到REGRESSION_REPORT_PATH，有回归时退出码为1
+// --update-baseline用这次的结果覆盖baseline；--scene指定模型文件代替MODEL_PATH，run_regression.sh用它依次跑固定的场景
+// 相对阈值：帧时间和gpu时间、启动时间、内存分别允许增加的比例
+const std::string REGRESSION_BASELINE_DIR = "baselines";
+const std::string REGRESSION_REPORT_PATH = "regression_report.json";
+const float REGRESSION_FRAME_TIME_TOLERANCE = 0.10f;
+const float REGRESSION_STARTUP_TOLERANCE = 0.25f;
+const float REGRESSION_MEMORY_TOLERANCE = 0.05f;
+// headless：--headless参数启动时不创建窗口和surface，用同样的pipeline渲染到MAX_FRAMES_IN_FLIGHT个离屏image，跑HEADLESS_FRAME_COUNT帧后退出
+// 和--benchmark一起使用时跑完benchmark才退出；退出前把最后一帧写到HEADLESS_OUTPUT_PATH（ppm），空字符串表示不输出
+const uint32_t HEADLESS_FRAME_COUNT = 600;
+const std::string HEADLESS_OUTPUT_PATH = "headless.ppm";
+// frame capture：F12或者--capture N（每N帧一次）截取swap chain image，拷贝录制在这一帧的提交中，完成后由job pool写成CAPTURE_PATH_PREFIX<帧号>.png
+// 最多CAPTURE_RING_SIZE个截图同时在拷贝或者编码，超出的请求留到之后的帧；渲染线程不等待gpu和编码
+const uint32_t CAPTURE_RING_SIZE = 3;
+const std::string CAPTURE_PATH_PREFIX = "capture_";
+// stream capture：--record-stream <path>在启动的上传完成之后记录STREAM_CAPTURE_FRAMES帧的draw packet、相机和实例，写入path后继续运行
+// 用VulkanTutorial_stream_replay回放，见stream_capture.hpp
+const uint32_t STREAM_CAPTURE_FRAMES = 300;
+// shader statistics：打开或者--shader-stats时用VK_KHR_pipeline_executable_properties收集每个pipeline变体各阶段的寄存器、spill、指令数和occupancy
+// 新的或者改变了的统计在创建后的下一帧打印，退出时写入SHADER_STATISTICS_PATH；程序内的pipeline library在打开时不使用，统计的是完整优化的pipeline
+const bool SHADER_STATISTICS = false;
+const std::string SHADER_STATISTICS_PATH = "shader_statistics.csv";
+// video encode：--encode <path>时用编码队列把每一帧编码成H.264写到path（Annex B，可以是给推流程序读取的管道），设备没有H.264编码队列时不编码
+// 画面不经过cpu，转换和编码在gpu上；编码队列落后VIDEO_ENCODE_SLOTS帧时丢弃新的帧，渲染不等待；IDR间隔VIDEO_ENCODE_IDR_PERIOD帧，viewer最多等这么久就能开始解码
+const uint32_t VIDEO_ENCODE_SLOTS = 3;
+const uint32_t VIDEO_ENCODE_FRAME_RATE = 60;
+const uint32_t VIDEO_ENCODE_BITRATE = 8000000;
+const uint32_t VIDEO_ENCODE_IDR_PERIOD = 60;
+// startup timings：在控制台输出启动阶段的耗时，比如并行解码图片节省的时间
+const bool SHOW_STARTUP_TIMINGS = true;
+// progressive startup：impostor、粒子、遮挡查询、compute primitives和地形不参与第一帧，第一帧之后每帧创建一个，创建完成前相应的pass跳过
+// 场景pipeline已经在后台编译、模型和纹理已经在后台加载，第一帧只等待设备、swap chain和占位mesh；benchmark和warmup时全部在initVulkan中创建
+const bool PROGRESSIVE_STARTUP = true;
+// work stealing：退出时输出job system执行和偷取的job数量
+const bool SHOW_JOB_STATS = true;
+// flat index map：导入模型时再用原来的unordered_map去重一次，输出两种方式的耗时
+const bool BENCHMARK_VERTEX_DEDUP = false;
+// 16位索引：顶点超过65536个的mesh在导入时拆成多个submesh，所有mesh都可以使用16位索引；关闭时大mesh使用32位索引
+const bool SPLIT_MESHES_FOR_UINT16 = true;
+// compact vertex：gpu上使用12字节的PackedVertex，关闭时使用32字节的Vertex，mesh cache保存的是gpu格式
+const bool COMPACT_VERTICES = true;
+// split vertex streams：geometry buffer中位置和其它顶点属性分成两段，binding 0只有位置，binding 1是uv（非compact格式还有颜色）
+// depth prepass和shadow只绑定binding 0，每个顶点读取8字节（compact）或12字节；关闭时所有属性交错在binding 0中，mesh cache的格式不受影响
+const bool SPLIT_VERTEX_STREAMS = true;
+// vertex pulling：为true时场景pipeline和depth prepass没有逐顶点的vertex input，pulled.vert按gl_VertexIndex从geometry buffer读取顶点
+// geometry buffer以storage buffer的方式放在set 2中（不支持mesh shader时set 2只有这一个binding），实例数据仍然是逐实例的顶点属性
+const bool VERTEX_PULLING = false;
+// meshlet：设备支持VK_EXT_mesh_shader时obj模型按meshlet绘制，task shader剔除不可见的meshlet；关闭或者不支持时使用vkCmdDrawIndexed
+const bool USE_MESH_SHADERS = true;
+// pipeline library：设备支持VK_EXT_graphics_pipeline_library时pipeline分四部分编译后快速link，优化的pipeline在后台编译完成后替换
+const bool USE_PIPELINE_LIBRARY = true;
+// pipeline variants：为true时meshlet和depth prepass的pipeline编译完成之前draw回退到场景pipeline，不在第一次需要时等待编译；benchmark时总是等待
+const bool ASYNC_PIPELINE_VARIANTS = true;
+// dynamic rendering：设备支持时用vkCmdBeginRendering直接指定每帧的image view，不创建render pass和framebuffer
+const bool USE_DYNAMIC_RENDERING = true;
+// dynamic state：面剔除、深度测试等状态在命令中设置，双面材质和线框（F键，需要VK_EXT_extended_dynamic_state3）不需要额外的pipeline
+const bool USE_EXTENDED_DYNAMIC_STATE = true;
+// shader object：设备支持VK_EXT_shader_object时不创建pipeline，直接绑定shader，需要dynamic rendering和extended dynamic state
+const bool USE_SHADER_OBJECTS = true;
+// descriptor buffer：设备支持VK_EXT_descriptor_buffer时descriptor直接写进buffer，绘制时只设置offset，不使用descriptor pool和set
+const bool USE_DESCRIPTOR_BUFFER = true;
+// frame pacing：设备支持VK_KHR_present_id和VK_KHR_present_wait时，每帧睡到下一个vblank之前再采样输入，降低输入到显示的延迟，P键开关
+const bool USE_PRESENT_PACING = true;
+// live resize：拖动窗口大小时继续使用旧的swap chain（支持VK_EXT_swapchain_maintenance1时由呈现引擎按比例缩放），大小RESIZE_SETTLE_TIME秒没有变化后才重建一次
+const bool LIVE_RESIZE = true;
+const float RESIZE_SETTLE_TIME = 0.15f;
+// display mode：windowed经过合成器；fullscreen是主显示器上的全屏窗口，windows上支持时获取full screen exclusive；direct通过VK_KHR_display直接显示，不需要窗口系统
+// 命令行--fullscreen和--direct可以替换
+const DisplayMode DISPLAY_MODE = DisplayMode::windowed;
+// command cache：静态场景重新提交上次录制的command buffer，只有影响命令的状态变化时才重新录制
+const bool CACHE_COMMAND_BUFFERS = true;
+// parallel recording：mesh数量达到PARALLEL_RECORD_MIN_DRAWS时draw分段在job pool中录制进secondary command buffer，太少时分段的开销更大
+const bool PARALLEL_COMMAND_RECORDING = true;
+// simulation：相机和模型旋转以SIMULATION_TICK_RATE的固定频率更新，开启时在自己的线程中运行，关闭时主线程每帧补齐落后的tick
+const bool USE_SIMULATION_THREAD = true;
+const float SIMULATION_TICK_RATE = 60.0f;
+// render thread：开启时vulkan的录制、提交和present在自己的线程，主线程只处理glfw事件和功能键以外的输入；headless时没有事件，不使用
+const bool USE_RENDER_THREAD = true;
+const size_t PARALLEL_RECORD_MIN_DRAWS = 512;
+// present policy：启动时的present mode，V键循环切换，切换时重建swap chain
+const PresentPolicy DEFAULT_PRESENT_POLICY = PresentPolicy::mailbox;
+// frame limiter：帧率上限，0表示不限制，L键在FRAME_RATE_CAPS之间循环
+const float DEFAULT_FRAME_RATE_CAP = 0.f;
+const float FRAME_RATE_CAPS[] = {0.f, 30.f, 60.f, 120.f};
+// lod：选择投影到屏幕上误差不超过quality tier的lodPixelError像素的最粗level
+// 换到更粗的level还要求误差低于阈值的(1 - LOD_HYSTERESIS)，相机在切换距离附近移动时level不会每帧来回跳
+const float LOD_HYSTERESIS = 0.25f;
+// impostor：已经在最粗的lod level、投影到屏幕上的包围球直径低于IMPOSTOR_PIXEL_SIZE像素的mesh画成面向相机的四边形，同样使用LOD_HYSTERESIS
+// 每个mesh在resident之后烘焙IMPOSTOR_FRAMES * IMPOSTOR_FRAMES个方向，每个方向IMPOSTOR_CELL_SIZE²像素，每帧最多烘焙IMPOSTOR_BAKES_PER_FRAME个
+// atlas的page是IMPOSTOR_ATLAS_SIZE²的albedo和depth，page用完时其余的mesh不使用impostor；deferred shading时关闭
+const bool IMPOSTORS = true;
+const float IMPOSTOR_PIXEL_SIZE = 32.0f;
+const uint32_t IMPOSTOR_FRAMES = 8;
+const uint32_t IMPOSTOR_CELL_SIZE = 32;
+const uint32_t IMPOSTOR_ATLAS_SIZE = 2048;
+const uint32_t IMPOSTOR_MAX_PAGES = 2;
+const uint32_t IMPOSTOR_BAKES_PER_FRAME = 1;
+const uint32_t IMPOSTOR_MAX_INSTANCES = 4096;
+// instancing：scene list中的每个实例在instance buffer中有一个transform和颜色，每个mesh一次draw绘制全部实例
+// I键在1个实例和INSTANCE_GRID_SIZE * INSTANCE_GRID_SIZE个排成网格的实例之间切换，INSTANCE_SPACING是网格间距
+const uint32_t INSTANCE_GRID_SIZE = 32;
+const float INSTANCE_SPACING = 2.5f;
+// stress scene：--stress时每个网格格子中的mesh排成边长ceil(sqrt(meshes))的小网格，STRESS_MESH_SPACING是mesh之间的距离，格子的间距随之变大
+const float STRESS_MESH_SPACING = 1.25f;
+// frustum culling：每帧用相机的视锥剔除scene list中的实例，只有可见的实例写进instance buffer
+// 实例数量达到CULLING_PARALLEL_MIN_OBJECTS时在job pool中分段测试，几千个实例单线程的simd测试只需要几微秒
+const bool FRUSTUM_CULLING = true;
+const size_t CULLING_PARALLEL_MIN_OBJECTS = 16384;
+// contribution culling：投影到屏幕上的包围球直径小于这个像素数的实例在同一次剔除中丢掉，远处的小物体不再绘制，0关闭
+const float CONTRIBUTION_CULLING_PIXELS = 2.0f;
+// bvh：实例数量达到BVH_CULLING_MIN_OBJECTS时cpu的frustum culling改为查询实例的bvh，数量少时simd逐个测试更快
+// 左键点击时用bvh做射线拾取，输出点中的实例
+const size_t BVH_CULLING_MIN_OBJECTS = 1024;
+// software occlusion：cpu的frustum culling之后，离相机最近的实例的mesh在cpu上画进WIDTH x HEIGHT的depth buffer，被它挡住的实例不绘制
+// 只有完整分辨率（lod 0）的三角形不超过SOFTWARE_OCCLUDER_MAX_TRIANGLES的mesh才作为遮挡体：简化的lod可能凸出到真实轮廓之外，挡住其实可见的物体
+// 每帧最多画MAX_TRIANGLES个三角形
+// 只在gpu culling不可用时使用，gpu culling有自己的hi-z遮挡剔除
+const bool SOFTWARE_OCCLUSION = true;
+const uint32_t SOFTWARE_OCCLUSION_WIDTH = 256;
+const uint32_t SOFTWARE_OCCLUSION_HEIGHT = 128;
+const size_t SOFTWARE_OCCLUSION_MAX_TRIANGLES = 16384;
+const uint32_t SOFTWARE_OCCLUDER_MAX_TRIANGLES = 512;
+// gpu culling：设备支持VK_KHR_draw_indirect_count时实例的剔除在compute shader中完成，每个mesh一个vkCmdDrawIndexedIndirectCount
+// cpu不再遍历实例，录制的命令也不依赖可见数量；mesh数量超过GPU_CULLING_MAX_DRAWS或者不支持时回退到cpu的frustum culling
+const bool GPU_CULLING = true;
+const uint32_t GPU_CULLING_MAX_DRAWS = 4096;
+// hi-z：gpu culling时再用depth的hi-z pyramid剔除被挡住的实例，分两个阶段绘制避免上一帧的depth造成闪烁
+// 需要render graph（dynamic rendering）在两次绘制之间生成pyramid，并且depth格式支持采样
+const bool OCCLUSION_CULLING = true;
+// occlusion queries：没有使用hi-z时，索引数量达到OCCLUSION_QUERY_MIN_INDICES的mesh在不透明的绘制之后画包围盒，结果通过VK_EXT_conditional_rendering
+// 决定下一帧是否绘制这个mesh，gpu自己跳过draw，cpu不读取结果；只在场景是原点的单个实例时使用，每帧最多OCCLUSION_QUERY_MAX_OBJECTS个
+const bool OCCLUSION_QUERIES = true;
+const uint32_t OCCLUSION_QUERY_MIN_INDICES = 3000;
+const uint32_t OCCLUSION_QUERY_MAX_OBJECTS = 256;
+// msaa：color和depth的采样数上限，1是关闭；实际使用quality tier的msaaSamples，设备不支持时降到color和depth attachment都支持的最大值
+// 多重采样的attachment是transient的，在render pass中resolve到swap chain image，tile based gpu上多重采样的数据不写出tile memory
+// 第二阶段的绘制需要保留多重采样的depth和color，所以开启msaa时不使用hi-z遮挡剔除
+const uint32_t MSAA_SAMPLES = 4;
+static_assert(MSAA_SAMPLES != 0 && (MSAA_SAMPLES & (MSAA_SAMPLES - 1)) == 0 && MSAA_SAMPLES <= 64, "MSAA_SAMPLES must be a power of two sample count");
+// dynamic resolution：场景渲染到大小是swap chain的MIN_SCALE到100%的offscreen image，再放大到swap chain image
+// 比例由gpu的帧时间决定，超过DYNAMIC_RESOLUTION_TARGET_MS时降低；需要render graph（dynamic rendering）和gpu timestamp
+// UPSCALE_SHARPNESS为0时只做双线性放大，大于0时再做对比度自适应的锐化
+const bool DYNAMIC_RESOLUTION = true;
+const float DYNAMIC_RESOLUTION_TARGET_MS = 1000.0f / 60.0f;
+const float DYNAMIC_RESOLUTION_MIN_SCALE = 0.5f;
+const float DYNAMIC_RESOLUTION_STEP = 0.05f;
+const uint32_t DYNAMIC_RESOLUTION_COOLDOWN_FRAMES = 30;
+const float UPSCALE_SHARPNESS = 0.2f;
+// quality：第一次启动时按设备类型和显存选择tier（low到ultra），tier决定msaa、dynamic resolution的比例上限、lod误差、shadow map大小和各向异性
+// 运行时gpu帧时间长时间超过QUALITY_TARGET_MS时降一级，余量很大时升一级；结果按设备保存在QUALITY_TIER_PATH，下次启动时只在启动时生效的设置也使用它
+// AUTO_QUALITY为false时固定使用high，benchmark时不调整也不读取保存的tier，结果可以比较
+const bool AUTO_QUALITY = true;
+const float QUALITY_TARGET_MS = DYNAMIC_RESOLUTION_TARGET_MS;
+const char* const QUALITY_TIER_PATH = "quality_tier.txt";
+// thermal governor：按os的温度状态和每像素gpu耗时的上升趋势，在降频之前降低帧率上限和dynamic resolution的比例上限，benchmark时关闭
+const bool THERMAL_GOVERNOR = true;
+// post processing：场景画进HDR的scene color，再由compute pass完成bloom、自动曝光、tonemap和锐化，需要render graph（dynamic rendering）
+// 分辨率不变时由tonemap锐化，缩小时由upscale在放大之后锐化；设备不支持compute中的subgroup arithmetic时使用固定曝光
+const bool POST_PROCESSING = true;
+const float POST_SHARPNESS = 0.2f;
+const float BLOOM_THRESHOLD = 1.0f;
+const float BLOOM_INTENSITY = 0.1f;
+// attachment bandwidth：开启时scene color优先使用4字节的B10G11R11_UFLOAT（没有alpha，只有正数，post processing都不需要），
+// 相机的zFar / zNear不超过D16_MAX_DEPTH_RATIO时depth使用D16，zFar处的精度仍然好于深度的1%；bloom是storage image，仍然使用RGBA16F
+// SHOW_ATTACHMENT_BANDWIDTH时窗口标题显示render graph每帧attachment的读写量估计，第一帧之后输出每个attachment的明细
+const bool BANDWIDTH_AWARE_FORMATS = true;
+const float D16_MAX_DEPTH_RATIO = 500.0f;
+const bool SHOW_ATTACHMENT_BANDWIDTH = true;
+// depth prepass：先用只有vertex shader的pipeline写入depth，forward pass的depth比较改成EQUAL并关闭写入，每个像素只执行一次fragment shader
+// Z键运行时开关，gpu profiler中depth prepass和forward两个pass的时间对比说明这个场景是否值得；需要render graph和dynamic state
+// meshlet的draw不进入prepass，在forward中照常LESS测试和写入；线框模式时关闭
+const bool DEPTH_PREPASS = false;
+// variable rate shading：VK_KHR_fragment_shading_rate，选择了更粗的lod的mesh以2x2的rate绘制
+// 支持rate attachment时每帧forward之后按亮度对比度和屏幕运动生成下一帧的rate image，每个texel覆盖SHADING_RATE_TEXEL_SIZE大小的一块
+// rate image需要读取场景的color，这时场景总是画进offscreen的scene color再由upscale pass复制到swap chain；msaa时只使用per-draw的rate
+const bool VARIABLE_RATE_SHADING = true;
+const uint32_t SHADING_RATE_TEXEL_SIZE = 16;
+const float SHADING_RATE_LUMA_THRESHOLD = 0.04f;  // 一块中亮度的最大值和最小值的差
+const float SHADING_RATE_MOTION_THRESHOLD = 8.0f;  // 每帧移动的像素数
+// deferred shading：给tile based gpu（apple M系列）的延迟着色，一个render pass中两个subpass
+// subpass 0把albedo和法线写进G-buffer，subpass 1把它们作为input attachment读取，计算光照写进swap chain image
+// G-buffer是transient attachment（storeOp是DONT_CARE、LAZILY_ALLOCATED内存），subpass之间的依赖是BY_REGION，G-buffer的数据不离开tile memory
+// 需要render pass的subpass，开启时不使用dynamic rendering（也就没有render graph中的pass和shader object），msaa固定为1；桌面gpu默认使用forward
+const bool DEFERRED_SHADING = false;
+// clustered lighting：点光源和聚光灯按view space的cluster（屏幕上的tile乘上深度上指数划分的slice）分组，每帧在compute中完成
+// forward的片段着色器只遍历自己所在cluster的光源，开销取决于局部的光源密度而不是光源总数；CLUSTERED_LIGHT_COUNT为0时没有光照
+// 光源分布在实例网格的范围上方，每4个中有一个朝下的聚光灯，随模型的旋转角绕自己的初始位置移动
+const uint32_t CLUSTERED_LIGHT_COUNT = 1024;
+const float CLUSTERED_LIGHT_RANGE = 2.5f;
+// async compute：设备有只支持计算不支持图形的queue family时，light clustering在它的队列上执行，和上一帧的光栅化重叠
+// 图形队列的提交在片段着色器阶段等待计算队列的timeline；没有这样的queue family或者关闭时compute录制在图形队列的command buffer中
+const bool ASYNC_COMPUTE = true;
+// device group：选择的gpu属于有多个物理设备的device group（同型号的多张显卡）时创建跨所有设备的逻辑设备，帧轮流在各个设备上渲染
+// 只有一个设备时没有影响；使用时关闭async compute、transfer queue、descriptor buffer、hi-z occlusion culling和shadow cache的缓存，见device_group.hpp
+const bool USE_DEVICE_GROUP = true;
+// device selection：满足要求的物理设备中选择分数最高的；PREFERRED_GPU或者环境变量VULKAN_TUTORIAL_GPU（优先）是设备序号或者名字的一部分时强制选择
+const char* const PREFERRED_GPU = "";
+const char* const PREFERRED_GPU_ENV = "VULKAN_TUTORIAL_GPU";
+// multiple views：主窗口之外再打开的窗口数量，每个窗口有自己的swap chain和相机，和主窗口共享device、pipeline layout、geometry和纹理
+// 额外的view直接画进自己的swap chain（没有render graph、后处理、点光源和阴影），和主窗口一起提交和present，见window_view.hpp
+// 需要dynamic rendering，图形队列需要能present；不为0时不使用device group和descriptor buffer
+const uint32_t EXTRA_VIEW_COUNT = 0;
+// shadow cache：太阳光的cascaded shadow map，静态caster画进cache，只有cascade的矩阵、静态caster或者光源改变时重新绘制，动态caster每次更新时画在cache的副本上
+// 场景中只有模型的旋转会移动caster：旋转时所有mesh都是动态caster，R键暂停旋转之后它们变成静态caster，相机不动时shadow没有gpu开销
+// SHADOW_STAGGER时cascade i每2^i帧更新一次；SHADOW_CACHE为false时每次更新都重新绘制所有caster，用来对比开销
+const bool SHADOW_CACHE = true;
+const bool SHADOW_STAGGER = true;
+const glm::vec3 SUN_DIRECTION(-0.4f, -0.3f, -1.0f);  // 光线前进的方向，使用前归一化
+const glm::vec3 SUN_COLOR(0.9f, 0.85f, 0.75f);
+// ray traced shadows：设备支持ray query时前向着色的片段着色器向太阳发射一条ray代替shadow map，没有分辨率和cascade的接缝问题
+// 每个mesh一个BLAS，build之后按查询到的大小compact；每个frame in flight一个TLAS，实例的BLAS不变时refit，否则重新build
+// 每帧最多build RAY_TRACED_SHADOW_BUILDS_PER_FRAME个BLAS，共用RAY_TRACED_SHADOW_SCRATCH_BUDGET的scratch，还没有build的mesh这几帧不投射阴影
+// 可见的caster超过RAY_TRACED_SHADOW_MAX_INSTANCES、deferred shading和device group时使用shadow map
+const bool RAY_TRACED_SHADOWS = true;
+const uint32_t RAY_TRACED_SHADOW_MAX_INSTANCES = 131072;
+const uint32_t RAY_TRACED_SHADOW_BUILDS_PER_FRAME = 16;
+const VkDeviceSize RAY_TRACED_SHADOW_SCRATCH_BUDGET = 32 * 1024 * 1024;
+// skinning：gltf中有skin的primitive每帧在compute shader中按第一个动画蒙皮一次，结果写进geometry buffer中每个frame in flight一份的顶点范围
+// depth prepass、shadow和主pass都绘制蒙皮后的顶点，顶点着色器不变；包围盒是动画采样的并集，再扩大SKINNING_BOUNDS_MARGIN倍的大小
+// 最多SKINNING_MAX_VERTICES个蒙皮顶点，每帧最多SKINNING_MAX_JOINTS个joint矩阵，超过时其余的mesh保持上一次的姿势；R键同时暂停动画
+// 有可见的蒙皮mesh时ray traced shadows回到shadow map，BLAS不随蒙皮更新
+const bool GPU_SKINNING = true;
+const uint32_t SKINNING_MAX_VERTICES = 1 << 20;
+const uint32_t SKINNING_MAX_JOINTS = 4096;
+const float SKINNING_BOUNDS_MARGIN = 0.1f;
+// particles：PARTICLE_CAPACITY个粒子的发射、模拟和draw参数全部在compute shader中，cpu每帧只计算发射数量；在forward pass的最后用instanced四边形绘制
+// 每秒发射PARTICLE_EMIT_RATE个，寿命在PARTICLE_LIFETIME_MIN和PARTICLE_LIFETIME_MAX之间，空闲的编号用完时不再发射；R键同时暂停粒子
+// PARTICLE_ADDITIVE为true时加法混合，不需要排序；为false时alpha混合，每帧在gpu上按距离从远到近排序；deferred shading和device group时关闭
+const bool PARTICLES = true;
+const bool PARTICLE_ADDITIVE = true;
+const uint32_t PARTICLE_CAPACITY = 1 << 20;
+const float PARTICLE_EMIT_RATE = 300000.0f;
+const float PARTICLE_LIFETIME_MIN = 1.5f;
+const float PARTICLE_LIFETIME_MAX = 3.0f;
+// compute primitives：reduce、exclusive scan、stream compaction和直方图的共用模块，一次最多COMPUTE_PRIMITIVES_CAPACITY个元素，设备支持subgroup arithmetic时使用subgroup的变体
+// COMPUTE_PRIMITIVES_BENCHMARK为true时启动时对COMPUTE_PRIMITIVES_BENCHMARK_ELEMENTS个元素测量每个操作的gpu时间并和cpu的结果比较，输出到控制台
+const uint32_t COMPUTE_PRIMITIVES_CAPACITY = 1 << 22;
+const bool COMPUTE_PRIMITIVES_BENCHMARK = false;
+const uint32_t COMPUTE_PRIMITIVES_BENCHMARK_ELEMENTS = 1 << 22;
+const uint32_t COMPUTE_PRIMITIVES_BENCHMARK_ITERATIONS = 10;
+// terrain：高度图地形，tile在相机靠近时从TERRAIN_PATH按需读取，文件不存在时启动时生成一张程序化的地形（TERRAIN_GENERATED_*）
+// compute shader每帧从四叉树的根节点向下选择patch，level l覆盖到TERRAIN_LOD_RANGE * 2^l，最高level范围之外的部分不绘制
+// 可见的patch数量只取决于范围，和地形大小无关，最多TERRAIN_MAX_PATCHES个；tile缓存最多TERRAIN_CACHE_TILES个，每帧上传TERRAIN_UPLOADS_PER_FRAME个
+// TERRAIN_LOD_RANGE至少是level 0 patch边长（16个采样间距）的2.5倍，相邻patch的level最多差一级；deferred shading和device group时关闭
+const bool TERRAIN = true;
+const std::string TERRAIN_PATH = "/Users/sichaoshu/workspace/VulkanTutorial/VulkanTutorial/terrain.height";
+const glm::vec3 TERRAIN_ORIGIN(0.0f, 0.0f, -0.6f);  // 地形中心，模型在压平的区域上
+const float TERRAIN_LOD_RANGE = 1.0f;
+const uint32_t TERRAIN_LEVELS = 5;
+const uint32_t TERRAIN_MAX_PATCHES = 4096;
+const uint32_t TERRAIN_CACHE_TILES = 128;
+const uint32_t TERRAIN_UPLOADS_PER_FRAME = 4;
+const uint32_t TERRAIN_GENERATED_TILES = 16;  // 每边的tile数量，每个tile 128个采样间距
+const float TERRAIN_GENERATED_SPACING = 0.02f;
+const float TERRAIN_GENERATED_AMPLITUDE = 1.5f;
+const float TERRAIN_GENERATED_FLAT_RADIUS = 2.0f;
+// multi draw indirect：cpu剔除时draw命令和每个draw的object编号每帧写进indirect buffer，pipeline和raster state相同的draw一次vkCmdDrawIndexedIndirect提交
+// 录制的命令数量和mesh数量无关；可见的mesh超过INDIRECT_MAX_DRAWS或者设备不支持multiDrawIndirect时逐个draw
+const bool MULTI_DRAW_INDIRECT = true;
+const uint32_t INDIRECT_MAX_DRAWS = 16384;
+// scene objects：每帧可见的mesh的model矩阵、材质编号和包围盒按mesh编号写进storage buffer，每个frame in flight SCENE_OBJECT_CAPACITY * 112字节
+// mesh编号超过容量时不使用multi draw indirect
+const uint32_t SCENE_OBJECT_CAPACITY = 16384;
+// materials：纹理和baseColorFactor相同的mesh共用一个材质，每个frame in flight MATERIAL_CAPACITY * 48字节
+const uint32_t MATERIAL_CAPACITY = 4096;
+// transform store：模型和实例的变换是entity，同一层的entity达到这个数量时在job pool中分块更新
+const size_t TRANSFORM_PARALLEL_MIN_ENTITIES = 4096;
+// parallel import：顶点组装和去重按这个数量的索引分块，每块是一个job
+const size_t OBJ_IMPORT_CHUNK_SIZE = 3 * 65536;
+// obj stream：流式解析obj，边解析边组装去重，不构建tinyobj的完整attrib和index数组，大文件的峰值内存接近输出的大小
+// 关闭时使用tinyobj加上并行去重；每解析这么多字节把映射中读过的页面交还给内核
+const bool STREAMING_OBJ_IMPORT = true;
+const size_t OBJ_STREAM_CHUNK_SIZE = 16 * 1024 * 1024;
+// gpu mesh import：不小于这个大小的obj在job pool中只解析出corner的编号，顶点去重和索引重映射在compute shader中完成，结果读回之后继续优化和写入缓存
+// 设备的maxStorageBufferRange放不下时在cpu上去重
+const bool GPU_MESH_IMPORT = true;
+const size_t GPU_MESH_IMPORT_MIN_BYTES = 64 * 1024 * 1024;
+// gpu decompression：pack中分块压缩的ktx2纹理，一次上传的level数据不小于这个大小时压缩的block原样交给compute shader解压，再从解压结果拷贝到image
+// 更小的数据在cpu上只解压覆盖的block，一次dispatch和临时buffer的开销不值得；这样的纹理的上传都在图形队列上
+const bool GPU_ASSET_DECOMPRESSION = true;
+const VkDeviceSize GPU_DECOMPRESSION_MIN_BYTES = 256 * 1024;
+// mesh codec：pack中编码的mesh cache上传时由compute shader直接解码到geometry buffer，关闭时或者设备放不下时在加载线程中用cpu解码
+const bool GPU_MESH_DECODE = true;
+// static batching：gltf中没有蒙皮、不超过STATIC_BATCH_MAX_MESH_VERTICES个顶点的primitive在加载时按材质和位置合并，顶点变换到模型空间
+// 场景包围盒最长的轴分成STATIC_BATCH_GRID格，同一格同一材质的primitive合并成不超过STATIC_BATCH_MAX_VERTICES个顶点（16位索引）的mesh
+// 合并的primitive不再和其它node共享顶点，大的primitive仍然按node单独绘制
+const bool STATIC_BATCHING = true;
+const uint32_t STATIC_BATCH_MAX_MESH_VERTICES = 4096;
+const uint32_t STATIC_BATCH_MAX_VERTICES = 65536;
+const uint32_t STATIC_BATCH_GRID = 8;
+// world streaming：--world指定manifest时代替单个模型，世界按xy平面上WORLD_CHUNK_SIZE的网格分成chunk，按相机当前位置和预测位置的距离流式加载和卸载
+// 距离在加载半径和卸载半径之间时保持原来的状态；预测位置是相机速度外推WORLD_PREDICTION_SECONDS秒
+// 每帧最多开始WORLD_MAX_CHUNK_LOADS_PER_FRAME个chunk，同时最多WORLD_MAX_CHUNK_LOADS_IN_FLIGHT个chunk在导入或上传（导入的预算）
+// 上传和其它模型一样经过upload scheduler；常驻的顶点、索引和meshlet不超过WORLD_RESIDENT_BUDGET，
+// 也不超过geometry buffer的空闲空间和显存预算中WORLD_MEMORY_BUDGET_FRACTION以内的剩余空间
+const float WORLD_CHUNK_SIZE = 16.0f;
+const float WORLD_LOAD_RADIUS = 24.0f;
+const float WORLD_UNLOAD_RADIUS = 32.0f;
+const float WORLD_PREDICTION_SECONDS = 1.0f;
+const uint32_t WORLD_MAX_CHUNK_LOADS_PER_FRAME = 1;
+const uint32_t WORLD_MAX_CHUNK_LOADS_IN_FLIGHT = 2;
+const VkDeviceSize WORLD_RESIDENT_BUDGET = 256 * 1024 * 1024;
+const float WORLD_MEMORY_BUDGET_FRACTION = 0.9f;
+// upload scheduler：每帧最多上传UPLOAD_BYTES_PER_FRAME字节、录制UPLOAD_COPIES_PER_FRAME个拷贝命令，很多资源同时加载完成时上传分散到之后的帧
+// 模型按submesh分开申请，流式纹理的level按不超过UPLOAD_TEXTURE_REGION_BYTES的行区域分开申请；可见的在前，同样可见的按距离
+const VkDeviceSize UPLOAD_BYTES_PER_FRAME = 16 * 1024 * 1024;
+const uint32_t UPLOAD_COPIES_PER_FRAME = 256;
+const VkDeviceSize UPLOAD_TEXTURE_REGION_BYTES = 4 * 1024 * 1024;
+// residency：记录每张纹理最后一次在视锥中被使用的帧，device local的使用量超过预算的RESIDENCY_HIGH_FRACTION时，
+// 把至少RESIDENCY_IDLE_FRAMES帧没有使用的纹理按最久没有使用的顺序去掉最高一级mip，直到低于RESIDENCY_LOW_FRACTION；每帧最多降级RESIDENCY_MAX_DROPS_PER_FRAME张
+// 不超过RESIDENCY_MIN_TEXTURE_SIZE的纹理不再降级；vkAllocateMemory失败时先等待gpu空闲、释放deletion queue中的资源再重试，下一帧按超出预算处理
+const bool RESIDENCY_MANAGEMENT = true;
+const float RESIDENCY_HIGH_FRACTION = 0.9f;
+const float RESIDENCY_LOW_FRACTION = 0.8f;
+const uint64_t RESIDENCY_IDLE_FRAMES = 120;
+const uint32_t RESIDENCY_MAX_DROPS_PER_FRAME = 2;
+const uint32_t RESIDENCY_MIN_TEXTURE_SIZE = 256;
+// defragment：纹理block的占用率不超过DEFRAG_MAX_OCCUPANCY并且其中全是可以搬移的纹理时，把纹理逐个拷贝到其它block，清空的block还给驱动
+// 每帧最多开始拷贝DEFRAG_BYTES_PER_FRAME字节（至少一张），只在没有进行中的上传时进行
+const bool DEFRAGMENT_MEMORY = true;
+const float DEFRAG_MAX_OCCUPANCY = 0.5f;
+const VkDeviceSize DEFRAG_BYTES_PER_FRAME = 8 * 1024 * 1024;
+// validation log：verbose消息只在调试验证层本身时打开；每个message id逐条输出的次数和每秒逐条输出的总数，其余的只计数
+const bool VALIDATION_VERBOSE = false;
+const uint32_t VALIDATION_MESSAGE_LIMIT = 5;
+const uint32_t VALIDATION_MESSAGES_PER_SECOND = 20;
+
 
 #ifdef NDEBUG  // C的宏，assert中也用到这个
 const bool enableValidationLayers = false;
@@ -85,6 +698,8 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
 struct QueueFamilyIndices {
     std::optional<uint32_t> graphicsFamily;  // 图形queue family
     std::optional<uint32_t> presentFamily;  // 窗口表面：用于展示的queue family，支持物理设备将图像呈现到创建的surface
+    std::optional<uint32_t> transferFamily;  // transfer queue：只支持传输的queue family，通常对应独立显卡的DMA引擎，没有则上传使用图形队列
+    std::optional<uint32_t> computeFamily;  // async compute：支持计算但不支持图形的queue family，没有则compute使用图形队列
 
     bool isComplete() {
         return graphicsFamily.has_value() && presentFamily.has_value();
@@ -101,12 +716,34 @@ struct SwapChainSupportDetails {
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+// split vertex streams：顶点格式的前positionSize字节是位置，分开时位置是binding 0，其余属性是binding 1，两个binding的stride各自只包含自己的部分
+inline std::vector<VkVertexInputBindingDescription> vertexStreamBindings(uint32_t stride, uint32_t positionSize, bool splitStreams) {
+    VkVertexInputBindingDescription position{0, splitStreams ? positionSize : stride, VK_VERTEX_INPUT_RATE_VERTEX};
+    if (!splitStreams) {
+        return {position};
+    }
+    return {position, {1, stride - positionSize, VK_VERTEX_INPUT_RATE_VERTEX}};
+}
+
+// split vertex streams：交错格式的attribute移到binding 1，offset减去位置的大小
+template <size_t N>
+void splitVertexAttributes(std::array<VkVertexInputAttributeDescription, N>& attributes, uint32_t positionSize) {
+    for (VkVertexInputAttributeDescription& attribute : attributes) {
+        if (attribute.offset >= positionSize) {
+            attribute.binding = 1;
+            attribute.offset -= positionSize;
+        }
+    }
+}
+
 // vertex input：顶点数据定义
 struct Vertex {
     glm::vec3 pos;  // depth buffering：改成vec3增加深度值
     glm::vec3 color;
     glm::vec2 texCoord;  // texture mapping：uv坐标
 
+    static constexpr uint32_t POSITION_SIZE = sizeof(glm::vec3);  // split vertex streams：binding 0中每个顶点的字节数
+
     // 描述上传数据到gpu后如何加载到vs中
     // 主要描述数据之间的间距以及数据是逐顶点还是逐实例
     static VkVertexInputBindingDescription getBindingDescription() {
@@ -118,9 +755,14 @@ struct Vertex {
         return bindingDescription;
     }
 
+    // split vertex streams：分开时返回位置和其它属性两个binding
+    static std::vector<VkVertexInputBindingDescription> getBindingDescriptions(bool splitStreams) {
+        return vertexStreamBindings(sizeof(Vertex), POSITION_SIZE, splitStreams);
+    }
+
     // 描述如何从绑定的顶点数据块中提取顶点属性
     // 描述传递给顶点着色器的属性的类型，从哪个bind加载它们以及在哪个偏移量
-    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions(bool splitStreams = false) {
         std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};  // 2个描述分别是pos和color
 
         attributeDescriptions[0].binding = 0;  // binding位置
@@ -139,6 +781,9 @@ struct Vertex {
         attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
         attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
 
+        if (splitStreams) {
+            splitVertexAttributes(attributeDescriptions, POSITION_SIZE);
+        }
         return attributeDescriptions;
     }
 
@@ -148,6 +793,10 @@ struct Vertex {
     }
 };
 
+// flat index map：Vertex按字节hash和比较，不能有padding
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex must not contain padding");
+static_assert(offsetof(Vertex, pos) == 0, "split vertex streams expect the position first");
+
 // modal loading：作为哈希键需要完成哈希函数，指定std::hash的模版特化来实现
 namespace std {
     template<> struct hash<Vertex> {
@@ -157,37 +806,510 @@ namespace std {
     };
 }
 
+// compact vertex：位置按mesh的包围盒量化成16位snorm，w分量补齐到4字节对齐；uv是半精度浮点，超出[0, 1]的repeat uv也能表示
+// 导入的obj没有顶点颜色（Vertex中的color总是白色），所以不保存颜色，shader输出常量白色
+struct PackedVertex {
+    int16_t pos[4];
+    uint16_t texCoord[2];
+
+    static constexpr uint32_t POSITION_SIZE = sizeof(int16_t) * 4;  // split vertex streams：binding 0中每个顶点的字节数
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(PackedVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return bindingDescription;
+    }
+
+    static std::vector<VkVertexInputBindingDescription> getBindingDescriptions(bool splitStreams) {
+        return vertexStreamBindings(sizeof(PackedVertex), POSITION_SIZE, splitStreams);
+    }
+
+    // location和Vertex保持一致，compact.vert没有location 1的颜色输入
+    static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions(bool splitStreams = false) {
+        std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
+
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_SNORM;  // shader中读到的是[-1, 1]的浮点数
+        attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 2;
+        attributeDescriptions[1].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[1].offset = offsetof(PackedVertex, texCoord);
+
+        if (splitStreams) {
+            splitVertexAttributes(attributeDescriptions, POSITION_SIZE);
+        }
+        return attributeDescriptions;
+    }
+};
+
+// instancing：binding 2每个实例后移一次，mat4占用location 3到6，location 7是颜色，shader中乘在顶点颜色上
+// 顶点着色器总是读取实例属性，不使用实例化时scene list中只有一个单位矩阵和白色的实例
+// split vertex streams：binding 1留给顶点的属性，不分开时binding 1不存在
+struct InstanceData {
+    glm::mat4 transform;  // 乘在ubo的sceneModel左边
+    glm::vec4 color;
+
+    static constexpr uint32_t BINDING = 2;
+
+    static VkVertexInputBindingDescription getBindingDescription() {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = BINDING;
+        bindingDescription.stride = sizeof(InstanceData);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+        return bindingDescription;
+    }
+
+    static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 5> attributeDescriptions{};
+        for (uint32_t column = 0; column < 4; column++) {  // 矩阵按列占用连续的location
+            attributeDescriptions[column].binding = BINDING;
+            attributeDescriptions[column].location = 3 + column;
+            attributeDescriptions[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+            attributeDescriptions[column].offset = offsetof(InstanceData, transform) + column * sizeof(glm::vec4);
+        }
+
+        attributeDescriptions[4].binding = BINDING;
+        attributeDescriptions[4].location = 7;
+        attributeDescriptions[4].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        attributeDescriptions[4].offset = offsetof(InstanceData, color);
+
+        return attributeDescriptions;
+    }
+};
+
+// split vertex streams：场景pipeline的顶点输入，gpu顶点格式的binding（分开时是两个）加上binding 2的实例
+// positionOnly时只有location 0的位置和实例矩阵，depth prepass和shadow使用，分开时完全不读取binding 1
+inline void gpuVertexInput(bool positionOnly, std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes) {
+    if (COMPACT_VERTICES) {  // compact vertex：顶点格式和shader一起切换
+        auto packedAttributes = PackedVertex::getAttributeDescriptions(SPLIT_VERTEX_STREAMS);
+        bindings = PackedVertex::getBindingDescriptions(SPLIT_VERTEX_STREAMS);
+        attributes.assign(packedAttributes.begin(), packedAttributes.end());
+    } else {
+        auto vertexAttributes = Vertex::getAttributeDescriptions(SPLIT_VERTEX_STREAMS);
+        bindings = Vertex::getBindingDescriptions(SPLIT_VERTEX_STREAMS);
+        attributes.assign(vertexAttributes.begin(), vertexAttributes.end());
+    }
+    auto instanceAttributes = InstanceData::getAttributeDescriptions();
+    if (positionOnly) {
+        bindings.resize(1);
+        attributes.resize(1);
+        attributes.insert(attributes.end(), instanceAttributes.begin(), instanceAttributes.begin() + 4);  // location 7的颜色不需要
+    } else {
+        attributes.insert(attributes.end(), instanceAttributes.begin(), instanceAttributes.end());
+    }
+    bindings.push_back(InstanceData::getBindingDescription());
+}
+
+// vertex pulling：只有binding 2的实例，location 0到2的顶点属性由pulled.vert自己读取
+inline void pulledVertexInput(std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes) {
+    auto instanceAttributes = InstanceData::getAttributeDescriptions();
+    bindings = {InstanceData::getBindingDescription()};
+    attributes.assign(instanceAttributes.begin(), instanceAttributes.end());
+}
+
+// meshlet：meshlet.mesh的specialization constant，顺序和constant_id一致，pipeline和shader object使用同一份
+// split vertex streams：attributeWordOffset是属性区域在顶点区域中的uint偏移，geometry buffer创建之前就可以确定
+class MeshletSpecialization {
+public:
+    MeshletSpecialization() {
+        uint32_t positionSize = COMPACT_VERTICES ? PackedVertex::POSITION_SIZE : Vertex::POSITION_SIZE;
+        m_data.compactVertices = COMPACT_VERTICES ? VK_TRUE : VK_FALSE;
+        m_data.splitStreams = SPLIT_VERTEX_STREAMS ? VK_TRUE : VK_FALSE;
+        m_data.attributeWordOffset = SPLIT_VERTEX_STREAMS
+            ? static_cast<uint32_t>(GeometryBuffer::attributeRegionOffset(positionSize, GEOMETRY_MAX_VERTICES) / sizeof(uint32_t)) : 0;
+        m_entries[0] = {0, offsetof(Data, compactVertices), sizeof(VkBool32)};
+        m_entries[1] = {1, offsetof(Data, splitStreams), sizeof(VkBool32)};
+        m_entries[2] = {2, offsetof(Data, attributeWordOffset), sizeof(uint32_t)};
+        m_info.mapEntryCount = static_cast<uint32_t>(m_entries.size());
+        m_info.pMapEntries = m_entries.data();
+        m_info.dataSize = sizeof(m_data);
+        m_info.pData = &m_data;
+    }
+    MeshletSpecialization(const MeshletSpecialization&) = delete;
+    MeshletSpecialization& operator=(const MeshletSpecialization&) = delete;
+
+    const VkSpecializationInfo* info() const { return &m_info; }
+
+private:
+    struct Data {
+        VkBool32 compactVertices;
+        VkBool32 splitStreams;
+        uint32_t attributeWordOffset;
+    };
+    Data m_data{};
+    std::array<VkSpecializationMapEntry, 3> m_entries{};
+    VkSpecializationInfo m_info{};
+};
+
+// compact vertex：把包围盒映射到[-1, 1]，返回的矩阵是解量化的变换，乘在model矩阵右边
+inline glm::mat4 vertexDequantizeTransform(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 extent = glm::max((boundsMax - boundsMin) * 0.5f, glm::vec3(1e-6f));  // 扁平的mesh某个轴上范围为0
+    return glm::scale(glm::translate(glm::mat4(1.0f), center), extent);
+}
+
+// compact vertex：center和extent与vertexDequantizeTransform使用的包围盒一致
+inline PackedVertex packVertex(const glm::vec3& pos, const glm::vec2& texCoord, const glm::vec3& center, const glm::vec3& extent) {
+    PackedVertex packed;
+    glm::vec3 normalized = (pos - center) / extent;
+    for (int k = 0; k < 3; k++) {
+        packed.pos[k] = static_cast<int16_t>(glm::packSnorm1x16(normalized[k]));
+    }
+    packed.pos[3] = 0;
+    packed.texCoord[0] = glm::packHalf1x16(texCoord.x);
+    packed.texCoord[1] = glm::packHalf1x16(texCoord.y);
+    return packed;
+}
+
+// frustum culling：gpu格式顶点的包围盒，和m_meshTransforms中的变换在同一个空间，PackedVertex是[-1, 1]中的量化坐标
+inline glm::vec3 gpuVertexPosition(const void* vertices, uint32_t index) {
+    if (COMPACT_VERTICES) {
+        const PackedVertex& packed = static_cast<const PackedVertex*>(vertices)[index];
+        return glm::vec3(glm::unpackSnorm1x16(packed.pos[0]), glm::unpackSnorm1x16(packed.pos[1]), glm::unpackSnorm1x16(packed.pos[2]));
+    }
+    return static_cast<const Vertex*>(vertices)[index].pos;
+}
+
+inline Aabb gpuVertexBounds(const void* vertices, uint32_t vertexCount) {
+    Aabb bounds{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+    for (uint32_t i = 0; i < vertexCount; i++) {
+        glm::vec3 pos = gpuVertexPosition(vertices, i);
+        bounds.min = glm::min(bounds.min, pos);
+        bounds.max = glm::max(bounds.max, pos);
+    }
+    return bounds;
+}
+
+inline std::vector<PackedVertex> packVertices(const std::vector<Vertex>& vertices, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    glm::vec3 extent = glm::max((boundsMax - boundsMin) * 0.5f, glm::vec3(1e-6f));
+    std::vector<PackedVertex> packed(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        packed[i] = packVertex(vertices[i].pos, vertices[i].texCoord, center, extent);
+    }
+    return packed;
+}
+
+// model loader：后台线程产生的模型数据，顶点已经是gpu的格式，索引已经是上传的大小
+// mesh cache命中时数据在映射的文件中，否则在vertices和indices中；gltf只在后台解析，上传时直接写入目标位置
+// gpu mesh import：job pool中解析出的obj，corners是每个corner的位置编号和uv编号，去重在主线程提交的compute中进行
+struct PendingObjImport {
+    std::vector<uint32_t> corners;
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    std::string cachePath;
+    uint64_t sourceHash = 0;
+    std::chrono::high_resolution_clock::time_point startTime;
+};
+
+// mesh codec：cached表示数据在缓存中（映射的文件或者asset pack），gpuDecode时顶点和索引仍然是编码的流，由uploadSubmesh交给gpu解码
+// 编码的缓存在cpu上解码时结果在vertices和indices中，其它数组仍然指向缓存
+struct LoadedModel {
+    std::unique_ptr<MappedFile> cacheFile;
+    MeshCacheView cache;
+    bool cached = false;
+    bool gpuDecode = false;
+    std::vector<char> vertices;
+    std::vector<char> indices;
+    std::vector<MeshCacheSubmesh> submeshes;
+    MeshletData meshlets;
+    std::vector<MeshCacheLod> lods;
+    uint32_t vertexStride = 0;
+    uint32_t indexSize = 0;
+    glm::vec3 boundsMin{0.0f};
+    glm::vec3 boundsMax{0.0f};
+    std::unique_ptr<tinygltf::Model> gltf;
+    std::unique_ptr<PendingObjImport> gpuImport;  // gpu mesh import：不为空时还没有去重，其它成员还没有填写
+
+    const void* vertexData() const { return cached && !cache.encoded ? cache.vertices : vertices.data(); }
+    const void* indexData() const { return cached && !cache.encoded ? cache.indices : indices.data(); }
+    const MeshCacheSubmesh* submeshData() const { return cached ? cache.submeshes : submeshes.data(); }
+    uint32_t submeshCount() const { return cached ? cache.submeshCount : static_cast<uint32_t>(submeshes.size()); }
+    const Meshlet* meshletData() const { return cached ? cache.meshlets : meshlets.meshlets.data(); }
+    const uint32_t* meshletVertexData() const { return cached ? cache.meshletVertices : meshlets.vertices.data(); }
+    const uint32_t* meshletTriangleData() const { return cached ? cache.meshletTriangles : meshlets.triangles.data(); }
+    const MeshCacheLod* lodData() const { return cached ? cache.lods : lods.data(); }
+};
+
 // descriptor set layout：mvp矩阵，glm矩阵数据的二进制方式与着色器期望的方式一致，所以能直接拷贝到vkbuffer
 // alignas是为了保证类型对齐，vulkan有要求对齐方式
 // 另一种保证对齐的方法是在include glm之前使用#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES，不过在嵌套体结构中会失效
+// push constant：model矩阵每个draw不同，通过DrawPushConstants传入，ubo只放每帧一份的数据
 struct UniformBufferObject {
-    alignas(16) glm::mat4 model;
-    alignas(16) glm::mat4 view;
-    alignas(16) glm::mat4 proj;
+    alignas(16) glm::mat4 view;  // clustered lighting：片段着色器用它计算view depth，meshlet剔除用它求相机位置
+    // view projection：cpu上乘好的proj * view，顶点着色器对每个顶点只做矩阵乘向量，不再每个顶点计算proj * view
+    alignas(16) glm::mat4 viewProj;
+    // meshlet：meshlet包围体在量化之前的模型空间，task shader用这个矩阵变换到世界空间
+    // command cache：所有mesh共同的旋转也在这里，push constant中每个mesh的矩阵不随时间变化，录制好的command buffer可以重用
+    alignas(16) glm::mat4 sceneModel;
+    // hi-z：task shader的meshlet遮挡剔除，x是pyramid在bindless数组中的index，y不为0时开启（task shader记录第一阶段画过的meshlet）
+    // z不为0时pyramid中是上一帧的depth，第一阶段可以用它剔除
+    alignas(16) glm::uvec4 hiz;
+    // clustered lighting：片段着色器查找cluster的参数，见ClusteredLighting::fragmentScale，clusterGrid.w是光源数量
+    alignas(16) glm::uvec4 clusterGrid;
+    alignas(16) glm::vec4 clusterScale;
+    // shadow cache：每个cascade内容绘制时的矩阵和远端的view depth，sunColor.w为0时不计算太阳光
+    alignas(16) glm::mat4 shadowViewProj[ShadowCache::CASCADE_COUNT];
+    alignas(16) glm::vec4 shadowSplits;
+    alignas(16) glm::vec4 sunDirection;
+    alignas(16) glm::vec4 sunColor;
+};
+
+// lod：mesh的一个level在geometry buffer中的索引范围，firstIndex相对于MeshRange的firstIndex，level 0是完整的mesh
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;  // 模型空间的几何误差
+};
+
+// lod：levels为空的mesh没有lod，绘制MeshRange的全部索引；center是选择level时测量距离的点，current是上一帧选择的level
+struct MeshLodChain {
+    std::vector<MeshLod> levels;
+    glm::vec3 center{0.0f};
+    uint32_t current = 0;
+};
+
+// pipeline compiler：一个graphics pipeline的全部fixed function状态，create info中的指针指向这里，编译完成之前不能移动
+struct GraphicsPipelineState {
+    std::vector<VkPipelineShaderStageCreateInfo> stages;
+    std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+    std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    VkPipelineViewportStateCreateInfo viewportState{};
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    std::array<VkPipelineColorBlendAttachmentState, 2> colorBlendAttachments{};  // deferred shading：subpass 0有两个G-buffer attachment
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    std::vector<VkDynamicState> dynamicStates;
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED;  // dynamic rendering：pRenderingInfo指向这里
+    VkPipelineRenderingCreateInfo renderingInfo{};
+};
+
+// pipeline desc：renderer的graphics pipeline变体，fillPipelineState按这些描述填写固定功能状态
+// scene：forward或者G-buffer；depth prepass没有color attachment，split vertex streams时只读取位置
+// meshlet：没有顶点输入和图元装配；view：其它窗口的pipeline，单采样，不剔除背面，光栅化状态全部是静态的
+// vertex pulling：scene和depth prepass换成只有实例的pulled，view pipeline仍然使用fixed function的顶点输入
+constexpr PipelineDesc SCENE_PIPELINE_DESC{.vertexInput = VERTEX_PULLING ? VertexInputDesc::pulled : VertexInputDesc::scene,
+    .colorAttachments = DEFERRED_SHADING ? 2u : 1u};
+constexpr PipelineDesc DEPTH_PREPASS_PIPELINE_DESC{
+    .vertexInput = VERTEX_PULLING ? VertexInputDesc::pulled : SPLIT_VERTEX_STREAMS ? VertexInputDesc::positionOnly : VertexInputDesc::scene, .colorAttachments = 0};
+constexpr PipelineDesc MESHLET_PIPELINE_DESC{.vertexInput = VertexInputDesc::none, .colorAttachments = DEFERRED_SHADING ? 2u : 1u};
+constexpr PipelineDesc VIEW_PIPELINE_DESC{
+    .raster = {.cullMode = VK_CULL_MODE_NONE}, .sceneSamples = false, .dynamicRasterState = false, .shadingRateAttachment = false};
+// impostor：forward pass中的四边形，只有实例数据；光栅化状态是静态的，depth prepass之后也用LESS比较（prepass中没有impostor）
+constexpr PipelineDesc IMPOSTOR_PIPELINE_DESC{.vertexInput = VertexInputDesc::impostor, .raster = {.cullMode = VK_CULL_MODE_NONE}, .dynamicRasterState = false};
+// particles：forward pass最后的透明四边形，深度测试但不写入深度
+constexpr PipelineDesc PARTICLE_PIPELINE_DESC{.vertexInput = VertexInputDesc::particle, .raster = {.cullMode = VK_CULL_MODE_NONE},
+    .depth = {.writeEnable = false}, .blend = {.enable = true, .additive = PARTICLE_ADDITIVE}, .dynamicRasterState = false};
+// terrain：forward pass最先绘制的patch网格，没有顶点输入，索引是所有patch共用的
+constexpr PipelineDesc TERRAIN_PIPELINE_DESC{.vertexInput = VertexInputDesc::terrain, .dynamicRasterState = false};
+// occlusion queries：不剔除背面，相机靠近时包围盒的背面也能通过测试；深度测试但不写入，也不写color
+constexpr PipelineDesc OCCLUSION_BOX_PIPELINE_DESC{.vertexInput = VertexInputDesc::occlusionBox, .raster = {.cullMode = VK_CULL_MODE_NONE},
+    .depth = {.writeEnable = false}, .blend = {.writeMask = 0}, .dynamicRasterState = false};
+static_assert(PipelineKey<SCENE_PIPELINE_DESC>::value != PipelineKey<DEPTH_PREPASS_PIPELINE_DESC>::value
+        && PipelineKey<SCENE_PIPELINE_DESC>::value != PipelineKey<MESHLET_PIPELINE_DESC>::value
+        && PipelineKey<SCENE_PIPELINE_DESC>::value != PipelineKey<VIEW_PIPELINE_DESC>::value
+        && PipelineKey<SCENE_PIPELINE_DESC>::value != PipelineKey<IMPOSTOR_PIPELINE_DESC>::value
+        && PipelineKey<IMPOSTOR_PIPELINE_DESC>::value != PipelineKey<PARTICLE_PIPELINE_DESC>::value
+        && PipelineKey<SCENE_PIPELINE_DESC>::value != PipelineKey<TERRAIN_PIPELINE_DESC>::value
+        && PipelineKey<TERRAIN_PIPELINE_DESC>::value != PipelineKey<OCCLUSION_BOX_PIPELINE_DESC>::value,
+    "pipeline variants must have distinct keys");
+
+// depth prepass：depth是prepass只写depth，shade是prepass之后的forward pass，depth比较为EQUAL
+enum class DepthPrepassPhase {
+    off,
+    depth,
+    shade,
+};
+
+// meshlet：task shader和mesh shader的push constant，放在DrawPushConstants之后，布局和meshlet_cull.task中的MeshletDraw一致
+const uint32_t MESHLET_PUSH_CONSTANT_OFFSET = 96;
+// hi-z：phase是正在录制的剔除阶段，和m_cullPhase相同
+struct MeshletPushConstants {
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    int32_t vertexOffset;
+    uint32_t phase;
+};
+
+// bindless：每个draw的push constant，布局和bindless.frag中的DrawParams一致
+// texture atlas：uvScale和uvOffset把模型的uv映射到atlas page中的区域，不在atlas中的纹理是(1, 1)和(0, 0)
+// push constant：model矩阵也在这里，录制draw时直接写进command buffer，不需要写ubo也不需要绑定descriptor set
+// multi draw indirect：indirect不为0时shader忽略前面的字段，set 0 binding 1的第drawDataBase + gl_DrawID个元素是这个draw的object编号
+// scene objects：model和材质从binding 5的SceneObject中读取
+// materials：场景的片段着色器按materialIndex读取binding 7的材质，textureIndex和uv只有impostor烘焙使用
+struct DrawPushConstants {
+    alignas(16) glm::mat4 model;  // compact vertex：解量化变换，shader中再乘上ubo的sceneModel
+    uint32_t textureIndex;
+    uint32_t materialIndex;  // 在uvScale的8字节对齐留下的空位中
+    alignas(8) glm::vec2 uvScale;
+    glm::vec2 uvOffset;
+    uint32_t drawDataBase;
+    uint32_t indirect;
+};
+static_assert(sizeof(DrawPushConstants) == 96, "DrawPushConstants must match the std430 DrawParams array stride");
+static_assert(sizeof(DrawPushConstants) <= MESHLET_PUSH_CONSTANT_OFFSET, "DrawPushConstants overlaps MeshletPushConstants");
+static_assert(MESHLET_PUSH_CONSTANT_OFFSET + sizeof(MeshletPushConstants) <= 128, "push constants exceed the guaranteed maxPushConstantsSize");
+
+// multiple views：一个额外窗口的view，窗口、swap chain和同步对象在WindowView中，相机、实例数据、pipeline和这一帧的ubo是这个view自己的
+// WindowView的地址注册为glfw的user pointer，不能移动，所以用unique_ptr保存
+struct ExtraView {
+    WindowView target;
+    Camera camera;
+    InstanceBuffer instances;
+    VkPipeline pipeline = VK_NULL_HANDLE;  // 颜色格式是这个窗口的swap chain格式
+    uint32_t uniformOffset = 0;
+    uint32_t instanceCount = 0;
 };
 
 class HelloTriangleApplication {
 public:
+    // benchmark：在run之前调用
+    void enableBenchmark() {
+        m_benchmark.start(BENCHMARK_WARMUP_FRAMES, BENCHMARK_MEASURED_FRAMES, BENCHMARK_TIME_STEP);
+        m_pacingEnabled = false;
+        m_presentPolicy = PresentPolicy::immediate;
+    }
+
+    // regression：在run之前调用，总是和benchmark一起使用
+    void enableRegression(bool updateBaseline) {
+        enableBenchmark();
+        m_regression = true;
+        m_updateBaseline = updateBaseline;
+    }
+
+    void setScene(const std::string& path) { m_modelPath = path; }
+
+    // world streaming：在run之前调用，manifest在第一帧之前读取
+    void setWorld(const std::string& path) { m_worldPath = path; }
+
+    // stress scene：在run之前调用，代替m_modelPath和--world生成程序化的场景，参数不对时返回false
+    bool setStressScene(const std::string& parameters) {
+        if (!m_stressSettings.parse(parameters)) {
+            return false;
+        }
+        m_stressScene = true;
+        m_instanceGrid = true;
+        m_benchmark.setLabel(m_stressSettings.label());
+        return true;
+    }
+
+    int exitCode() const { return m_exitCode; }
+
+    // warmup：在run之前调用，安装时运行，不需要显示器，创建所有pipeline写入pipeline cache之后退出
+    void enableWarmup() {
+        m_warmup = true;
+        enableHeadless();
+    }
+
+    // video encode：在run之前调用，设备创建时需要知道是否要编码队列
+    void setVideoEncodeOutput(const std::string& path) { m_videoEncodePath = path; }
+
+    // frame capture：在run之前调用，每interval帧截取一次，0表示只在按F12时截取
+    void setCaptureInterval(uint32_t interval) { m_captureInterval = interval; }
+
+    // telemetry：在run之前调用，target的格式见TelemetryExport::open
+    void setTelemetryTarget(const std::string& target) { m_telemetryTarget = target; }
+
+    // stream capture：在run之前调用，geometry buffer创建时需要TRANSFER_SRC才能读回mesh
+    void setStreamCapture(const std::string& path) { m_streamCapturePath = path; }
+
+    // shader statistics：在run之前调用，设备创建时需要知道是否启用扩展
+    void enableShaderStatistics() { m_shaderStatisticsRequested = true; }
+
+    // heap tracker：在run之前调用
+    void enableHeapCheck() { m_heapCheck = true; }
+
+    // draw costs：在run之前调用，设备创建之后创建query pool
+    void enableDrawCosts() { m_drawCostsRequested = true; }
+
+    // display mode：在run之前调用，headless时不使用
+    void setDisplayMode(DisplayMode mode) { m_displayMode = mode; }
+
+    // headless：在run之前调用，没有窗口所以也没有键盘输入，frame pacing需要swap chain
+    void enableHeadless() {
+        m_headless = true;
+        m_pacingEnabled = false;
+    }
+
     void run() {
-        initWindow();
+        HostMemoryTracker::instance().setEnabled(TRACK_HOST_ALLOCATIONS);  // memory report：必须在创建instance之前
+        HostMemoryTracker::instance().setArenas(HOST_ALLOCATION_ARENAS);
+        HeapTracker::setEnabled(m_heapCheck);
+        m_frameHeapCheck.init(HEAP_CHECK_SETTLE_FRAMES, HEAP_CHECK_ABORT);
+        CpuProfiler::instance().setEnabled(ENABLE_CPU_PROFILER);
+        CpuProfiler::instance().setThreadName("main");
+        if (m_warmup) {
+            warmUpPipelineCache();
+            return;
+        }
+        if (!m_telemetryTarget.empty() && !m_telemetry.open(m_telemetryTarget)) {
+            std::cerr << "telemetry: failed to open " << m_telemetryTarget << std::endl;
+        }
+        STARTUP_STEP(m_startupTimer, initWindow());
         initVulkan();
         m_camera.init(swapChainExtent.width, swapChainExtent.height);
+        m_simulation.start(m_camera, SIMULATION_TICK_RATE, USE_SIMULATION_THREAD && !m_benchmark.active());
         mainLoop();
+        writeCpuTrace();
         cleanup();
     }
 
 private:
-    GLFWwindow* window;
+    GLFWwindow* window = nullptr;
+    bool m_headless = false;  // headless：没有window和surface，swapChainImages是自己创建的离屏image
+    bool m_warmup = false;  // warmup：只编译pipeline，不进入mainloop
+    DisplayMode m_displayMode = DISPLAY_MODE;
+    DirectDisplay m_directDisplay;  // display mode：direct时surface所在的显示器
+    FullScreenExclusive m_fullScreenExclusive;  // display mode：fullscreen时windows上的独占模式
+    bool m_surfaceCapabilities2 = false;  // instance启用了VK_KHR_get_surface_capabilities2
+    std::vector<Allocation> m_offscreenAllocations;  // headless：离屏image的内存
+    uint32_t m_headlessFrames = 0;  // headless：已经提交的帧数
+    uint32_t m_lastImageIndex = 0;  // headless：最后一次提交渲染的image，退出时读回
+    bool m_closeRequested = false;  // headless：没有glfwWindowShouldClose，benchmark结束时设置
+    StartupTimer m_startupTimer;  // startup timer：启动步骤的耗时和time to first frame
+    std::string m_modelPath = MODEL_PATH;  // regression：--scene可以替换
+    std::string m_worldPath;  // world streaming：--world的manifest，为空时只加载m_modelPath
+    bool m_stressScene = false;  // stress scene：--stress
+    StressSceneSettings m_stressSettings;
+    bool m_regression = false;
+    bool m_updateBaseline = false;
+    int m_exitCode = EXIT_SUCCESS;
 
     VkInstance instance;
     VkDebugUtilsMessengerEXT debugMessenger;  // 验证层：回调message
-    VkSurfaceKHR surface;  // 窗口表面
+    ValidationLog m_validationLog;  // validation log：回调的计数、限流和后台输出
+    VkSurfaceKHR surface = VK_NULL_HANDLE;  // 窗口表面
 
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;  // 物理设备
+    DeviceCapabilities m_capabilities;  // device capabilities：选择物理设备之后probe一次，创建device时按这里开启feature和扩展
+    PortabilityProfile m_portability;  // portability profile：设备暴露VK_KHR_portability_subset时按subset的限制调整
     VkDevice device;  // 逻辑设备
 
+    DeviceMemoryAllocator m_allocator;  // memory allocator：所有buffer和image的内存都从这里子分配
+
     VkQueue graphicsQueue;  // 逻辑设备：图形队列
     VkQueue presentQueue;  // 窗口表面：展示队列，用于呈现图像给surface
+    VkQueue transferQueue;  // transfer queue：上传队列，没有独立的传输queue family时等于graphicsQueue
+    VkQueue computeQueue;  // async compute：计算队列，没有独立的计算queue family时等于graphicsQueue
+    // present queue：图形和呈现queue family不同时，呈现队列每帧提交一个只有acquire barrier的command buffer，等渲染完成，signal m_presentReadySemaphores供present等待
+    // 呈现队列的提交signal自己的m_presentTimeline，m_presentSubmitNumbers记录每个frame in flight最近一次提交的值
+    uint32_t m_graphicsFamily = 0;
+    uint32_t m_presentFamily = 0;
+    bool m_separatePresentQueue = false;
+    VkCommandPool m_presentCommandPool = VK_NULL_HANDLE;
+    VkCommandBuffer m_presentCommandBuffers[MAX_FRAMES_IN_FLIGHT] = {};
+    VkSemaphore m_presentReadySemaphores[MAX_FRAMES_IN_FLIGHT] = {};
+    TimelineSemaphore m_presentTimeline;
+    uint64_t m_presentSubmitNumbers[MAX_FRAMES_IN_FLIGHT] = {};
 
     // swapchain
     VkSwapchainKHR swapChain;
@@ -197,89 +1319,521 @@ private:
     std::vector<VkImageView> swapChainImageViews;  // imageview：需要用view来读取swapchain image
     std::vector<VkFramebuffer> swapChainFramebuffers;  // framebuffer
 
-    VkRenderPass renderPass;  // renderpass
+    VkRenderPass renderPass = VK_NULL_HANDLE;  // renderpass：dynamic rendering时不创建
+    // dynamic rendering：core 1.3或者VK_KHR_dynamic_rendering，函数通过vkGetDeviceProcAddr查询，两种来源的签名相同
+    bool m_dynamicRenderingSupported = false;
+    PFN_vkCmdBeginRendering m_vkCmdBeginRendering = nullptr;
+    PFN_vkCmdEndRendering m_vkCmdEndRendering = nullptr;
+    // dynamic state：不支持时pipeline中的状态是固定的，所有mesh单面填充绘制
+    DynamicStateCommands m_dynamicStates;
+    bool m_wireframeSupported = false;
+    bool m_wireframe = false;
+    // shader object：初始化之后graphicsPipeline和m_meshletPipeline都不创建，绘制时绑定这些shader
+    ShaderObjectBackend m_shaderObjects;
+    VkShaderEXT m_vertexShaderObject = VK_NULL_HANDLE;
+    VkShaderEXT m_fragmentShaderObject = VK_NULL_HANDLE;
+    VkShaderEXT m_taskShaderObject = VK_NULL_HANDLE;
+    VkShaderEXT m_meshShaderObject = VK_NULL_HANDLE;
+    VkShaderEXT m_meshletFragmentShaderObject = VK_NULL_HANDLE;
     VkDescriptorSetLayout descriptorSetLayout;  // descriptor set layout：描述了shader中的binding
     VkPipelineLayout pipelineLayout;  // fixed function：用于传递uniform
-    VkPipeline graphicsPipeline;  // pipeline
+    VkPipeline graphicsPipeline = VK_NULL_HANDLE;  // pipeline
+    PipelineCache m_pipelineCache;  // pipeline cache：所有pipeline共享，启动时从磁盘读取
+    // pipeline compiler：graphicsPipeline和m_meshletPipeline在工作线程编译，future有效时pipeline还没有取出
+    PipelineCompiler m_pipelineCompiler;
+    std::future<VkPipeline> m_graphicsPipelineFuture;
+    std::future<VkPipeline> m_meshletPipelineFuture;
+    bool m_pipelineLibrarySupported = false;
+    GraphicsPipelineLibrary m_pipelineLibrary;  // pipeline library：graphicsPipeline的四个部分，优化的link在后台进行
+    // meshlet：mesh shader路径，set 2是geometry buffer的顶点和meshlet buffer，只在m_meshShaderSupported时创建
+    bool m_meshShaderSupported = false;
+    PFN_vkCmdDrawMeshTasksEXT m_vkCmdDrawMeshTasksEXT = nullptr;
+    VkDescriptorSetLayout m_meshletSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool m_meshletDescriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet m_meshletSet = VK_NULL_HANDLE;
+    // descriptor buffer：初始化之后set 0、1、2都是m_descriptorBuffer中的一段，set 0每个frame in flight一段，每帧重新写入ubo的地址
+    DescriptorBuffer m_descriptorBuffer;
+    std::vector<VkDeviceSize> m_frameDescriptorOffsets;
+    VkDeviceSize m_meshletDescriptorOffset = 0;
+    VkPipeline m_meshletPipeline = VK_NULL_HANDLE;
+    // depth prepass：只有vertex shader、没有color attachment的pipeline；m_prepassPhase是正在录制的pass，recordDraws据此选择pipeline和depth比较
+    bool m_depthPrepass = DEPTH_PREPASS;
+    VkPipeline m_depthPrepassPipeline = VK_NULL_HANDLE;
+    std::future<VkPipeline> m_depthPrepassPipelineFuture;
+    DepthPrepassPhase m_prepassPhase = DepthPrepassPhase::off;
+    // impostor：m_meshImpostors和其它per-mesh数组使用同一个编号；ticket完成之后baked才为true，active的mesh不在m_drawPackets中
+    struct MeshImpostor {
+        ImpostorTile tile;
+        uint64_t ticket = 0;
+        bool baked = false;
+        bool active = false;
+    };
+    ImpostorAtlas m_impostors;
+    VkPipeline m_impostorPipeline = VK_NULL_HANDLE;
+    // particles：m_particleEmitDebt是还没有发射的小数部分，跨帧累计
+    ParticleSystem m_particles;
+    VkPipeline m_particlePipeline = VK_NULL_HANDLE;
+    VkCommandBuffer m_particleCommands = VK_NULL_HANDLE;
+    float m_particleEmitDebt = 0.0f;
+    ComputePrimitives m_computePrimitives;
+    // terrain：m_terrainFile由worker步骤打开或者生成，createTerrain把它交给m_terrain
+    TerrainFile m_terrainFile;
+    bool m_terrainFileReady = false;
+    JobPool::Counter m_terrainFileJob;  // progressive startup：在job pool中打开高度图
+    DeferredInit m_deferredInit;  // progressive startup：第一帧之后才执行的初始化步骤
+    TerrainRenderer m_terrain;
+    VkPipeline m_terrainPipeline = VK_NULL_HANDLE;
+    VkCommandBuffer m_terrainCommands = VK_NULL_HANDLE;
+    FrameCapture m_frameCapture;
+    bool m_swapChainCapturable = false;  // frame capture：swap chain image有TRANSFER_SRC usage
+    uint32_t m_captureInterval = 0;
+    uint32_t m_capturedFrames = 0;  // frame capture：--capture计数的帧数
+    std::string m_videoEncodePath;  // video encode：为空时不编码
+    std::string m_streamCapturePath;  // stream capture：为空时不记录
+    std::string m_telemetryTarget;  // telemetry：为空时不发布
+    TelemetryExport m_telemetry;
+    TelemetryRecord m_telemetryRecord{};
+    float m_telemetryTimer = 0.f;
+    StreamCapture m_streamCapture;
+    std::map<std::pair<int32_t, uint32_t>, uint32_t> m_streamCaptureMeshes;  // stream capture：geometry buffer中的位置到记录的mesh编号
+    bool m_streamCaptureWritten = false;
+    std::optional<uint32_t> m_videoEncodeFamily;
+    VkQueue m_videoEncodeQueue = VK_NULL_HANDLE;
+    VideoEncoder m_videoEncoder;
+    // occlusion queries：m_occlusionQueryObjects是这一帧查询的mesh，每帧重新填写
+    bool m_conditionalRenderingSupported = false;
+    OcclusionQueries m_occlusionQueries;
+    VkPipeline m_occlusionBoxPipeline = VK_NULL_HANDLE;
+    std::vector<uint32_t> m_occlusionQueryObjects;
+    std::vector<MeshImpostor> m_meshImpostors;
+    std::vector<ImpostorInstance> m_impostorInstances;
+    std::vector<uint32_t> m_impostorPages;
 
     VkCommandPool commandPool;  // command buffer：命令池
 
+    // staging ring：所有上传共享的staging空间，空间按upload context的ticket回收
+    StagingRing m_stagingRing;
+    // upload context：批量录制上传命令，一次提交，通过ticket查询完成情况
+    UploadContext m_uploadContext;
+    uint64_t m_sceneUploadTicket {0};  // 模型和纹理上传的ticket
+    // synchronization2：纹理每个mip level最近一次的layout、stage和access，addLayoutTransition由它生成barrier
+    ImageStateTracker m_imageStates;
+
     // depth buffering：创建depth资源
-    VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
+    // render graph：dynamic rendering时depth是render graph的transient image，这里只在render pass路径创建
+    VkImage depthImage = VK_NULL_HANDLE;
+    Allocation depthImageAllocation;
+    VkImageView depthImageView = VK_NULL_HANDLE;
+    // msaa：render pass的多重采样color attachment，resolve到swap chain image；dynamic rendering时由render graph创建
+    VkSampleCountFlagBits m_msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    VkImage m_msaaColorImage = VK_NULL_HANDLE;
+    Allocation m_msaaColorAllocation;
+    VkImageView m_msaaColorView = VK_NULL_HANDLE;
+    // deferred shading：render pass路径中subpass 0写入、subpass 1读取的G-buffer，只在DEFERRED_SHADING时创建
+    VkImage m_gbufferAlbedoImage = VK_NULL_HANDLE;
+    Allocation m_gbufferAlbedoAllocation;
+    VkImageView m_gbufferAlbedoView = VK_NULL_HANDLE;
+    VkImage m_gbufferNormalImage = VK_NULL_HANDLE;
+    Allocation m_gbufferNormalAllocation;
+    VkImageView m_gbufferNormalView = VK_NULL_HANDLE;
+    DeferredLighting m_deferredLighting;
+    // dynamic resolution：m_renderExtent是场景的渲染分辨率，没有开启时等于swapChainExtent
+    DynamicResolutionController m_resolution;
+    QualityManager m_quality;  // quality：AUTO_QUALITY为false时保持默认的high
+    ThermalGovernor m_thermalGovernor;
+    Upscaler m_upscaler;
+    VkExtent2D m_renderExtent{};
+    // variable rate shading：m_shadingRate只在使用rate attachment时初始化，m_prevViewProj是上一帧的viewProj，用于重投影
+    ShadingRateSupport m_shadingRateSupport;
+    bool m_shadingRateAttachmentSupported = false;
+    VkFragmentShadingRateCombinerOpKHR m_shadingRateCombiner = VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+    ShadingRateImage m_shadingRate;
+    glm::mat4 m_prevViewProj{1.0f};
+    PostProcess m_postProcess;  // post processing：只在使用render graph时初始化
+    VkFormat m_hdrColorFormat = PostProcess::HDR_FORMAT;  // attachment bandwidth：post processing时scene color的格式，创建逻辑设备时选择
+    AttachmentBandwidth m_attachmentBandwidth;  // attachment bandwidth：最近一次录制的render graph的估计
+    float m_frameDeltaTime = 0.0f;  // post processing：自动曝光按上一帧的时间靠近目标
+    RenderGraph m_renderGraph;
+    GpuProfiler m_gpuProfiler;  // gpu profiler：设备不支持timestamp时没有初始化
+    bool m_drawCostsRequested = false;
+    DrawCostProfiler m_drawCosts;  // draw costs：只在请求并且支持timestamp时初始化
+    std::vector<DrawCostProfiler::Cost> m_drawCostScratch;  // heap tracker：top的结果复用容量
+    bool m_inheritedQueries = false;  // pipeline statistics：secondary command buffer可以在统计query之内执行
 
     // image texture：导入纹理
-    VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
+    JobPool m_jobPool;  // job system：解码、剔除、变换更新和录制共用的work stealing工作线程
+    AsyncFileReader m_fileReader;  // async io：纹理文件的读取
+    TextureCache m_textureCache;  // texture cache：按路径和内容去重，引用计数归零后通过deletion queue释放
+    TextureHandle m_modelTexture = INVALID_TEXTURE_HANDLE;
+    TextureStreamer m_textureStreamer;  // texture streaming：只有ktx2纹理需要，mip尾部之外的level在后台读取
+    TextureHandle m_streamedTexture = INVALID_TEXTURE_HANDLE;  // texture streaming：正在流式加载的纹理
+    std::vector<Ktx2Level> m_textureLevels;  // texture streaming：每个level的尺寸，上传时使用
+    // gpu decompression：m_textureLevelsGpu为true的level从streamer得到的是压缩的block；m_textureStreamGraphics时所有level在图形队列上拷贝
+    std::vector<bool> m_textureLevelsGpu;
+    std::string m_streamedTexturePath;
+    bool m_textureStreamGraphics = false;
+    std::deque<std::pair<uint32_t, uint64_t>> m_textureStreamUploads;  // texture streaming：已提交上传的level和upload ticket
+    // residency：纹理最后一次被使用的帧；降级中的纹理在拷贝完成后换成少一级mip的image
+    ResidencyTracker m_textureResidency;
+    uint64_t m_residencyFrame = 0;
+    bool m_memoryPressure = false;  // residency：vkAllocateMemory失败过，下一帧按超出预算处理
+    // defragment：搬移到其它block的纹理也在这里等待拷贝完成，新image的尺寸和mip数量不变
+    struct MipDrop {
+        TextureHandle handle;
+        Texture texture;  // 新的image，view在拷贝完成后创建
+        uint64_t ticket;
+    };
+    std::vector<MipDrop> m_mipDrops;
+    std::vector<uint32_t> m_residencyVictims;  // residency：updateResidency的临时数组
+    // upload scheduler：等待授权的level区域，firstRow和rowCount的单位是4行一组的压缩块，同一个level的区域共享读取的数据
+    struct TextureStreamRegion {
+        uint32_t level;
+        uint32_t firstRow;
+        uint32_t rowCount;
+        VkDeviceSize rowBytes;
+        std::shared_ptr<std::vector<char>> data;
+        UploadScheduler::RequestId request;
+    };
+    std::deque<TextureStreamRegion> m_textureStreamRegions;
+    ComputeMipmapGenerator m_computeMipmaps;  // mipmap：格式不支持linear blit时使用，第一次需要时才创建
     // sampler：设置纹理采样
-    VkImageView textureImageView;  // 本质上就是image view
+    BindlessTextureTable m_bindlessTextures;  // bindless：所有纹理的descriptor数组，set 1
+    std::vector<Texture> m_atlasPages;  // texture atlas：打包小纹理的page，作为普通纹理创建
+    std::vector<uint32_t> m_atlasPageRefs;  // texture atlas：每个page中还存在的纹理数量
+    SamplerCache m_samplerCache;  // sampler cache：相同参数的sampler只创建一次，由cache负责销毁
     VkSampler textureSampler;
 
-    // model loading：从模型加载的顶点和索引用vector保存
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-    // vertex buffer：buffer和memory分离，能更好的资源复用aliasing
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
-    // index buffer：index buffer和memory
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
-
-    std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
-    std::vector<void*> uniformBuffersMapped;
+    // geometry buffer：所有mesh的顶点和索引都在同一个buffer中，m_meshes记录每个mesh的位置
+    GeometryBuffer m_geometryBuffer;
+    std::vector<char> m_vertexUploadScratch;  // split vertex streams：上传时交错格式的顶点，拆开之后写入geometry buffer
+    std::vector<MeshRange> m_meshes;
+    std::vector<glm::mat4> m_meshTransforms;  // compact vertex：每个mesh的解量化变换，不量化时是单位矩阵
+    std::vector<Aabb> m_meshBounds;  // frustum culling：导入时计算的包围盒，已经乘上m_meshTransforms，sceneModel之前的空间
+    std::vector<TextureHandle> m_meshTextures;  // bindless：每个mesh使用的纹理，draw时通过push constant传入bindless index
+    std::vector<ModelHandle> m_meshModels;  // model loader：每个mesh属于哪个模型，占位mesh是INVALID_MODEL_HANDLE；卸载的模型的handle已经无效
+    std::vector<uint32_t> m_freeMeshSlots;  // world streaming：卸载的模型留下的mesh编号，新的mesh优先复用，绘制的数量不随chunk的加载卸载增长
+    MeshletBuffer m_meshletBuffer;  // meshlet：所有mesh的meshlet，只在m_meshShaderSupported时创建
+    std::vector<MeshletRange> m_meshMeshlets;  // meshlet：每个mesh的meshlet，meshletCount为0的mesh使用vkCmdDrawIndexed
+    std::vector<MeshLodChain> m_meshLods;  // lod：每个mesh的level，在updateUniformBuffer中按相机距离选择
+    std::vector<bool> m_meshDoubleSided;  // dynamic state：gltf材质的doubleSided，这些mesh不做面剔除
+    std::vector<std::vector<glm::vec3>> m_meshOccluders;  // software occlusion：mesh空间中不带索引的三角形，乘过m_meshTransforms，空表示不是遮挡体
+    std::vector<uint32_t> m_meshMaterials;  // materials：每个mesh在m_materials中的编号，doubleSided同时记录在m_meshDoubleSided
+    MaterialTable m_materials;
+    // model loader：请求过的模型，slot map：handle是generational handle，记录紧密存放
+    struct ModelRecord {
+        std::string path;
+        TextureHandle texture;  // 没有材质纹理的mesh使用的纹理
+        ModelState state;
+        uint64_t uploadTicket;
+        std::chrono::high_resolution_clock::time_point requestTime;
+        glm::mat4 placement{1.0f};  // world streaming：模型在世界中的位置，乘在每个mesh的变换左边
+        uint32_t worldChunk = UINT32_MAX;  // world streaming：所属的chunk，不属于世界时是UINT32_MAX
+        VkDeviceSize residentBytes = 0;  // world streaming：顶点、索引和meshlet占用的字节数
+        std::vector<TextureHandle> textures;  // gltf：材质引用的纹理，卸载模型时释放
+    };
+    SlotMap<ModelRecord> m_models;
+    // world streaming：正在上传的模型，beginMeshUpload记录mesh属于哪个模型并乘上placement，bytes累计分配的空间
+    struct MeshOwner {
+        ModelHandle model = INVALID_MODEL_HANDLE;
+        glm::mat4 placement{1.0f};
+        VkDeviceSize bytes = 0;
+    };
+    MeshOwner m_meshOwner;
+    WorldStreamer m_worldStreamer;
+    std::vector<uint32_t> m_worldLoads;  // world streaming：update的输出，容量在帧之间复用
+    std::vector<uint32_t> m_worldUnloads;
+    std::vector<std::vector<ModelHandle>> m_worldChunkModels;  // world streaming：每个chunk请求的模型，卸载时释放
+    UploadScheduler m_uploadScheduler;  // upload scheduler：模型和流式纹理的上传每帧按优先级授权
+    AsyncScheduler m_asyncScheduler;  // async task：模型加载的coroutine，每帧在updateModelLoads中恢复
+    ModelHandle m_model = INVALID_MODEL_HANDLE;
+
+    // uniform ring：每帧一个持久映射的buffer，m_frameUniformOffset是这一帧ubo的dynamic offset
+    // push constant：每个mesh的model矩阵在push constant中，ubo每帧只写一次
+    UniformRing m_uniformRing;
+    uint32_t m_frameUniformOffset = 0;
+    VkShaderStageFlags m_drawPushConstantStages = 0;  // push constant：DrawPushConstants所在range的stage，push时必须全部指定
+    // instancing：scene list在cpu上，每帧写进这一帧的instance buffer，m_instanceCount是这一帧写入的数量
+    InstanceBuffer m_instanceBuffer;
+    std::vector<InstanceData> m_sceneInstances;
+    bool m_instanceGrid = false;
+    // transform store：m_modelEntity是所有mesh共同的旋转（ubo的sceneModel），实例是网格根节点的子节点
+    // m_entityInstances是entity对应的scene list中的实例，不是实例时是INVALID_ENTITY
+    TransformStore m_transforms;
+    uint32_t m_modelEntity = TransformStore::INVALID_ENTITY;
+    std::vector<uint32_t> m_entityInstances;
+    uint32_t m_instanceCount = 1;
+    // stress scene：每帧旋转的实例entity和它们的初始角度
+    std::vector<uint32_t> m_movingEntities;
+    std::vector<float> m_movingAngles;
+    // frame arena：只在一帧之内使用的cpu数据的内存，drawFrame在timeline等待之后release下面的pmr容器并重置这一帧的arena
+    // 声明在这些容器之前，析构时容器先释放
+    FrameArenas m_frameArenas;
+    // frustum culling：每个实例的世界空间包围盒和剔除之后的实例，每帧重新计算
+    // batch transform：m_instanceWorld是实例变换乘sceneModel的结果；可见实例只记录索引，instance buffer从scene list直接写入映射的内存
+    FrustumCuller m_frustumCuller;
+    // software occlusion：m_occlusionBoxes是这一帧frustum culling之后可见实例的世界包围盒，m_occluderOrder按到相机的距离排序
+    SoftwareOcclusion m_softwareOcclusion;
+    std::vector<Aabb> m_occlusionBoxes;
+    std::vector<std::pair<float, uint32_t>> m_occluderOrder;
+    std::vector<uint32_t> m_occluderMeshes;
+    std::vector<Aabb> m_instanceBounds;
+    std::pmr::vector<glm::mat4> m_instanceWorld{&m_frameArenas};
+    std::pmr::vector<uint32_t> m_visibleIndices{&m_frameArenas};
+    // bvh：实例在世界空间的包围盒，模型绕z轴旋转时不需要refit（见instanceBvhModelBounds）
+    // m_instanceBvhStale表示scene list改变了，下次使用之前重新构建
+    Bvh m_instanceBvh;
+    Aabb m_bvhModelBounds;
+    bool m_instanceBvhStale = true;
+    std::vector<uint32_t> m_bvhVisible;
+    // gpu culling：可见的实例由gpu写入这一帧的visible buffer，m_instanceCount是scene list的实例数量
+    GpuInstanceCuller m_gpuCuller;
+    GpuMeshImporter m_gpuMeshImporter;
+    GpuDecompressor m_gpuDecompressor;  // gpu decompression：只在GPU_ASSET_DECOMPRESSION时初始化
+    HostImageCopy m_hostImageCopy;  // host image copy：只在HOST_IMAGE_COPY并且设备支持时初始化
+    GpuMeshDecoder m_gpuMeshDecoder;  // mesh codec：只在GPU_MESH_DECODE时初始化，初始化之后加载线程只读取它
+    bool m_drawIndirectCountSupported = false;
+    // hi-z：m_hizHistoryValid表示pyramid中是上一帧的depth，m_cullPhase是正在录制的阶段（0是第一阶段，1是补画）
+    HiZPyramid m_hiz;
+    uint32_t m_hizBindlessIndex = UINT32_MAX;  // hi-z：task shader通过bindless数组读取pyramid
+    // draw sort：每次录制之前按sort key排好的可见mesh，recordDraws按这个顺序录制
+    DrawSorter m_drawSorter;
+    std::pmr::vector<DrawPacket> m_drawPackets{&m_frameArenas};
+    // multi draw indirect：m_drawPackets的第p个draw是indirect buffer的第p个命令
+    IndirectDrawBuffer m_indirectDraws;
+    SceneObjectBuffer m_sceneObjects;  // scene objects：按mesh编号的SceneObject，set 0的binding 5
+    // clustered lighting：m_lights是光源的初始位置，m_frameLights是这一帧移动之后写进light buffer的光源
+    ClusteredLighting m_clusteredLighting;
+    AsyncCompute m_asyncCompute;
+    uint64_t m_asyncComputeValue = 0;  // async compute：这一帧图形提交需要等待的计算队列timeline值，0表示这一帧没有计算提交
+    std::vector<ClusterLight> m_lights;
+    std::vector<ClusterLight> m_frameLights;
+    // shadow cache：m_shadowInstances是所有实例（不经过相机的剔除），只在这一帧有shadow命令时写入
+    // m_shadowStaticVersion在静态caster改变时增加，m_shadowSceneModel和m_shadowCasterMeshes是上一帧的状态，用来发现变化
+    ShadowCache m_shadowCache;
+    InstanceBuffer m_shadowInstances;
+    uint64_t m_shadowStaticVersion = 0;
+    uint64_t m_shadowFrame = 0;
+    glm::mat4 m_shadowSceneModel{0.0f};
+    size_t m_shadowCasterMeshes = 0;
+    VkCommandBuffer m_shadowCommands = VK_NULL_HANDLE;
+    bool m_shadowCastersDynamic = true;
+    // ray traced shadows：m_meshBlas是每个mesh slot的BLAS，mesh第一次可见时创建；m_rayTracedShadowsActive是这一帧使用ray query而不是shadow map
+    AccelerationStructures m_accelerationStructures;
+    std::vector<uint32_t> m_meshBlas;
+    VkCommandBuffer m_accelerationCommands = VK_NULL_HANDLE;
+    bool m_rayTracedShadowsSupported = false;
+    bool m_shaderFloat16Supported = false;  // half precision：HALF_PRECISION_SHADERS并且设备支持shaderFloat16
+    bool m_rayTracedShadowsActive = false;
+    // skinning：每个蒙皮mesh的source和每帧的输出范围，m_meshes中的vertexOffset每帧换成这一帧的输出，bindVertexOffset是上传的绑定姿势
+    struct SkinnedMesh {
+        size_t mesh;
+        int32_t bindVertexOffset;
+        std::array<MeshRange, MAX_FRAMES_IN_FLIGHT> outputs;
+        uint32_t sourceVertex;
+        uint32_t vertexCount;
+        std::shared_ptr<const GltfSkeleton> skeleton;
+        uint32_t skin;
+        glm::mat4 quantize;  // 解量化变换的逆，合并进joint矩阵，compact vertex时输出是量化坐标
+    };
+    ComputeSkinning m_skinning;
+    std::vector<SkinnedMesh> m_skinnedMeshes;
+    std::vector<glm::mat4> m_skinningGlobals;  // 容量在帧之间复用
+    std::vector<glm::mat4> m_skinningJoints;
+    float m_skinningTime = 0.0f;
+    VkCommandBuffer m_skinningCommands = VK_NULL_HANDLE;
+    bool m_skinnedVisible = false;
+    bool m_skinnedAnimating = false;
+    bool m_modelAnimating = true;
+    bool m_multiDrawIndirectSupported = false;
+    bool m_sparseGeometrySupported = false;  // sparse binding：设备启用了sparseBinding和sparseResidencyBuffer
+    bool m_occlusionCulling = false;
+    bool m_hizHistoryValid = false;
+    uint32_t m_cullPhase = 0;
 
     // descriptor set：descriptor pool和set
-    VkDescriptorPool descriptorPool;
-    std::vector<VkDescriptorSet> descriptorSets;
+    // descriptor allocator：set 0每帧从这一帧的pool分配并写入，fence之后整个pool一起重置
+    FrameDescriptorAllocator m_frameDescriptors;
+    VkDescriptorSet m_frameDescriptorSet = VK_NULL_HANDLE;
+    // command cache：重用的command buffer引用的set不能每帧重新分配，每个frame in flight一个固定的set，内容只是这一帧的uniform ring buffer
+    VkDescriptorPool m_cachedFrameSetPool = VK_NULL_HANDLE;
+    std::array<VkDescriptorSet, MAX_FRAMES_IN_FLIGHT> m_cachedFrameSets{};
+
+    // command cache：每个(swap chain image, frame in flight)一个command buffer，key是录制时影响命令内容的状态的hash
+    // key不变时直接重新提交，场景、pipeline或者swap chain变化时key改变，这个command buffer下次使用时重新录制
+    struct CachedCommandBuffer {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        uint64_t key = 0;
+    };
+    std::vector<CachedCommandBuffer> m_commandCache;
+    ParallelRecorder m_parallelRecorder;
 
     // frames in flight：command buffer和同步对象对每个帧都创建一个，全改成vector
     std::vector<VkCommandBuffer> commandBuffers;  // command buffer：在command pool被销毁时会自动释放所以不需要显示清理
 
     // rendering：同步原语
+    // timeline semaphore：acquire和present只能使用binary semaphore，cpu等待gpu全部通过图形队列的timeline，不再有每帧的fence
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
+    DeviceGroup m_deviceGroup;  // device group：只有一个设备时inactive，所有提交和present不变
+    std::vector<std::unique_ptr<ExtraView>> m_extraViews;  // multiple views：设备不支持时在createExtraViews中清空
+    // heap tracker：drawFrame中提交和present用到的数组，每帧清空后复用容量，稳定之后不再分配
+    struct SubmitScratch {
+        std::vector<VkCommandBuffer> viewCommandBuffers;
+        std::vector<VkSemaphore> viewWaitSemaphores;
+        std::vector<VkPipelineStageFlags> viewWaitStages;
+        std::vector<VkSemaphore> viewSignalSemaphores;
+        std::vector<uint64_t> viewWaitValues;
+        std::vector<uint64_t> viewSignalValues;
+        std::vector<VkSemaphore> presentWaitSemaphores;
+        std::vector<VkSwapchainKHR> swapChains;
+        std::vector<uint32_t> imageIndices;
+        std::vector<VkResult> presentResults;
+
+        void clear() {
+            viewCommandBuffers.clear();
+            viewWaitSemaphores.clear();
+            viewWaitStages.clear();
+            viewSignalSemaphores.clear();
+            viewWaitValues.clear();
+            viewSignalValues.clear();
+            presentWaitSemaphores.clear();
+            swapChains.clear();
+            imageIndices.clear();
+            presentResults.clear();
+        }
+    };
+    SubmitScratch m_submitScratch;
+    std::vector<VkCommandBuffer> m_parallelSecondaries;  // parallel recording：每段的secondary，复用容量
+    TimelineSemaphore m_timeline;
     uint32_t currentFrame = 0;
-
-    bool framebufferResized = false;  // swap chain recreation：标记是否发生调整window大小的操作
+    // latency mode：m_requestedFramesInFlight由按键设置，drawFrame开始时等gpu空闲再切换，m_cpuAheadFrames是cpu领先gpu的平均帧数
+    uint32_t m_framesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+    uint32_t m_requestedFramesInFlight = DEFAULT_FRAMES_IN_FLIGHT;
+    float m_cpuAheadFrames = 0.f;
+    // frame pacing：m_pacingEnabled由P键切换，不支持时m_framePacer没有初始化
+    FramePacer m_framePacer;
+    bool m_pacingEnabled = USE_PRESENT_PACING;
+    InputLatencyTracker m_inputLatency;  // input latency：只在渲染的线程使用，render thread时输入时间经过frame packet
+    // present policy：m_presentPolicyChanged和窗口大小变化一样在present之后触发swap chain重建
+    PresentPolicy m_presentPolicy = DEFAULT_PRESENT_POLICY;
+    bool m_presentPolicyChanged = false;
+    FrameLimiter m_frameLimiter;
+
+    // deletion queue：m_frameNumber是最近一次帧提交signal的timeline值，m_frameSubmitNumbers记录每个frame in flight最近一次提交的值
+    // timeline到达某个值之后，该值及之前的提交都已完成，它们使用过的资源可以销毁
+    DeletionQueue m_deletionQueue;
+    uint64_t m_frameNumber = 0;
+    uint64_t m_frameSubmitNumbers[MAX_FRAMES_IN_FLIGHT] = {};
+
+    ResizeCoalescer m_resizeCoalescer;  // swap chain recreation：记录调整window大小的操作，render thread：在主线程通知
+    bool m_surfaceMaintenanceSupported = false;  // live resize：instance启用了VK_KHR_get_surface_capabilities2和VK_EXT_surface_maintenance1
+    bool m_presentScalingSupported = false;  // live resize：设备启用了VK_EXT_swapchain_maintenance1，创建swap chain时设置present scaling
+    std::vector<VkSwapchainKHR> m_retiredSwapChains;  // swap chain recreation：已经被替换，等新swap chain的第一帧之后再销毁
 
     // fps记录
-    float m_averageDuration {0.f};
-    int m_frameCount {0};
-    int m_fps {0};
+    // frame stats：最近的帧时间和百分位统计，m_titleTimer累计到TITLE_UPDATE_INTERVAL时更新窗口标题
+    FrameTimeStats m_frameStats;
+    HitchDetector m_hitchDetector;
+    uint32_t m_swapChainRecreations = 0;  // hitch detector：卡顿的上下文
+    float m_titleTimer {TITLE_UPDATE_INTERVAL};
+    BenchmarkRun m_benchmark;  // benchmark：没有--benchmark参数时不激活
 
     // camera
+    // simulation：m_camera只用于渲染，位置每帧从m_simulation插值得到，m_modelAngle是插值后的模型旋转
     Camera m_camera;
     unsigned int m_gameCommand {0};
+    FixedStepSimulation m_simulation;
+    RenderThread m_renderThread;  // render thread：和主线程交换frame packet
+    FramePacket m_framePacket;  // heap tracker：每帧复用，按键和点击的vector不重新分配
+    std::string m_windowTitle;  // heap tracker：窗口标题每次更新都复用这个string
+    std::vector<GpuProfiler::ScopeStats> m_gpuScopeStats;
+    bool m_heapCheck = CHECK_FRAME_ALLOCATIONS;
+    bool m_shaderStatisticsRequested = SHADER_STATISTICS;
+    ShaderStatistics m_shaderStatistics;  // shader statistics：只在请求并且设备支持时初始化
+    FrameHeapCheck m_frameHeapCheck;
+    bool m_heapCheckSkipFrame = false;  // heap tracker：这一帧处理了功能键或者重建了swap chain，允许分配
+    IdleDetector m_idleDetector;
+    SimulationState m_lastFrameState;  // idle rendering：上一帧的相机和模型旋转
+    float m_modelAngle {0.f};
 
     void initWindow() {
+        m_frameLimiter.setTarget(DEFAULT_FRAME_RATE_CAP);
+        if (!hasWindow()) {
+            return;  // headless：没有显示器的机器上glfwInit也可能失败，完全不使用glfw，direct：kiosk上没有窗口系统
+        }
         glfwInit();
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
-        window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+        if (m_displayMode == DisplayMode::fullscreen) {
+            window = createFullscreenWindow("Vulkan");  // display mode：主显示器的原生分辨率和刷新率
+        } else {
+            window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+        }
 
         // swap chain recreation：设置window大小改变回调处理
         glfwSetWindowUserPointer(window, this);  // 存储this指针
         glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
 
         glfwSetKeyCallback(window, keyCallback);
+        glfwSetMouseButtonCallback(window, mouseButtonCallback);
+        glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+        glfwSetWindowFocusCallback(window, windowFocusCallback);
+
+        // multiple views：窗口只能在主线程创建，swap chain在createExtraViews中创建
+        for (uint32_t i = 0; i < EXTRA_VIEW_COUNT; i++) {
+            m_extraViews.push_back(std::make_unique<ExtraView>());
+            m_extraViews.back()->target.createWindow(i, WIDTH, HEIGHT, [this]() { m_idleDetector.notifyActivity(); });
+        }
     }
 
     // swap chain recreation：回调函数，在window大小变化时处理
     // 使用静态函数是因为glfw不知道this类型的成员函数是什么，但是可以通过glfwSetWindowUserPointer获取到this指针
     static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
         auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));  // 取出this指针
-        app->framebufferResized = true;
+        app->m_resizeCoalescer.notify();
+        app->m_renderThread.setFramebufferSize(width, height);
+        app->m_idleDetector.notifyActivity();
+    }
+
+    // full screen exclusive：alt-tab回来之后重新获取独占
+    static void windowFocusCallback(GLFWwindow* window, int focused) {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        if (focused) {
+            app->m_fullScreenExclusive.requestRetry();
+            app->m_idleDetector.notifyActivity();
+        }
+    }
+
+    // idle rendering：窗口被遮挡后重新显示等情况需要重新present
+    static void windowRefreshCallback(GLFWwindow* window) {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        app->m_idleDetector.notifyActivity();
+    }
+
+    // display mode：direct和headless一样不使用glfw，没有窗口和输入事件
+    bool hasWindow() const { return !m_headless && m_displayMode != DisplayMode::direct; }
+
+    bool useRenderThread() const { return USE_RENDER_THREAD && hasWindow(); }
+
+    // input latency：在glfw回调中记录输入的时间，由采样输入的帧取走
+    void markInput() {
+        InputLatencyTracker::Clock::time_point now = InputLatencyTracker::Clock::now();
+        if (useRenderThread()) {
+            m_renderThread.markInput(now);
+        } else {
+            m_inputLatency.input(now);
+        }
     }
 
     void onKey(int key, int scancode, int action, int mods)
     {
+        FixedStepSimulation::Clock::time_point time = FixedStepSimulation::Clock::now();  // input events：移动命令变化的时间
+        unsigned int previousCommand = m_gameCommand;
         if (action == GLFW_PRESS)
         {
+            markInput();
             switch (key)
             {
                 case GLFW_KEY_A:
@@ -295,6 +1849,11 @@ private:
                     m_gameCommand |= (unsigned int)GameCommand::right;
                     break;
                 default:
+                    if (useRenderThread()) {
+                        m_renderThread.pushKey(key);  // render thread：功能键修改渲染的状态，交给渲染线程在下一帧开始时处理
+                    } else {
+                        onActionKey(key);
+                    }
                     break;
             }
         }
@@ -318,149 +1877,1060 @@ private:
                     break;
             }
         }
-        m_camera.setCommand(m_gameCommand);
+        if (m_gameCommand != previousCommand) {
+            m_simulation.pushCommand(time, m_gameCommand);
+        }
     }
 
-    static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
-    {
-        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));  // 取出this指针
-        app->onKey(key, scancode, action, mods);
+    void writeFrameTimes() {
+        FrameTimeSummary summary = m_frameStats.summary();
+        if (m_frameStats.writeCsv(FRAME_TIMES_PATH)) {
+            std::cout << "frame times: " << FRAME_TIMES_PATH << ", " << summary.frameCount << " frames, p50 " << summary.p50Ms << " ms, p95 " << summary.p95Ms << " ms, p99 "
+                      << summary.p99Ms << " ms, max " << summary.maxMs << " ms, 1% low " << summary.onePercentLowFps << " FPS, " << summary.totalHitches << " hitches total" << std::endl;
+        } else {
+            std::cerr << "failed to write frame times: " << FRAME_TIMES_PATH << std::endl;
+        }
+        if (m_inputLatency.writeCsv(INPUT_LATENCY_PATH)) {
+            m_inputLatency.report(std::cout);
+        } else {
+            std::cerr << "failed to write input latency: " << INPUT_LATENCY_PATH << std::endl;
+        }
     }
 
-    void initVulkan() {
-        createInstance();
-        setupDebugMessenger();  // 验证层：创建回调message
-        createSurface();  // 窗口表面：创建完instance之后立刻创建，因为会影响物理设备选择
-        pickPhysicalDevice();  // 物理设备
-        createLogicalDevice();  // 逻辑设备
-        createSwapChain();  // swapchain
-        createImageViews();  // imageview
-        createRenderPass();  // renderpass
-        createDescriptorSetLayout();  // descriptor set layout
-        createGraphicsPipeline();  // pipeline
-        createCommandPool();  // command buffer
-        createDepthResources();  // 在framebuffer之前创建作为attachment
-        createFramebuffers();  // framebuffer
-        createTextureImage();  // texture image
-        createTextureImageView();
-        createTextureSampler();
-        loadModel();
-        createVertexBuffer();  // vertex buffer
-        createIndexBuffer();  // index buffer
-        createUniformBuffers();  // ubo
-        createDescriptorPool();  // descriptor pool
-        createDescriptorSets();  // descriptor set
-        createCommandBuffers();  // command buffer
-        createSyncObjects();  // rendering
+    void writeMemoryReport() {
+        std::ofstream file(MEMORY_REPORT_PATH);
+        m_allocator.writeReport(file);
+        HostMemoryTracker::instance().writeReport(file);
+        if (file) {
+            std::cout << "memory report: " << MEMORY_REPORT_PATH << std::endl;
+        } else {
+            std::cerr << "failed to write memory report: " << MEMORY_REPORT_PATH << std::endl;
+        }
     }
 
-    float calculateDeltaTime()
-    {
-        static auto s_lastTickTimePoint = std::chrono::high_resolution_clock::now();  // static记录一次
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - s_lastTickTimePoint).count();
-        s_lastTickTimePoint = currentTime;
-
-        return deltaTime;
+    // draw costs：mesh后面是所属的模型，材质后面是纹理handle和baseColorFactor；平均耗时是最近几十帧的指数平均
+    void reportDrawCosts(std::ostream& out) {
+        if (!m_drawCosts.initialized()) {
+            return;
+        }
+        out << "draw costs: " << m_drawCosts.totalMs() << " ms in timed draws" << std::endl;
+        m_drawCosts.top(DRAW_COST_TOP_COUNT, false, m_drawCostScratch);
+        for (const DrawCostProfiler::Cost& cost : m_drawCostScratch) {
+            out << "  mesh " << cost.id << " " << cost.ms << " ms";
+            if (cost.id < m_meshModels.size() && m_models.contains(m_meshModels[cost.id])) {
+                out << " (" << m_models.get(m_meshModels[cost.id]).path << ")";
+            }
+            out << std::endl;
+        }
+        m_drawCosts.top(DRAW_COST_TOP_COUNT, true, m_drawCostScratch);
+        for (const DrawCostProfiler::Cost& cost : m_drawCostScratch) {
+            const MaterialDesc& desc = m_materials.desc(cost.id);
+            out << "  material " << cost.id << " " << cost.ms << " ms (texture " << desc.texture << ", color " << desc.baseColorFactor.r << " " << desc.baseColorFactor.g
+                << " " << desc.baseColorFactor.b << " " << desc.baseColorFactor.a << (desc.doubleSided ? ", double sided" : "") << ")" << std::endl;
+        }
     }
 
-    static constexpr float sg_fpsAlpha = 1.f / 100;
-    void calculateFPS(float deltaTime)
-    {
-        m_frameCount++;
-
-        if (m_frameCount == 1)
-        {
-            m_averageDuration = deltaTime;
+    void writeCpuTrace() {
+        if (!ENABLE_CPU_PROFILER) {
+            return;
         }
-        else
-        {
-            m_averageDuration = m_averageDuration * (1 - sg_fpsAlpha) + deltaTime * sg_fpsAlpha;
+        if (CpuProfiler::instance().writeChromeTrace(CPU_TRACE_PATH)) {
+            std::cout << "cpu trace: " << CPU_TRACE_PATH << std::endl;
+        } else {
+            std::cerr << "failed to write cpu trace: " << CPU_TRACE_PATH << std::endl;
         }
+    }
 
-        m_fps = static_cast<int>(1.f / m_averageDuration);
+    void cycleFrameRateCap() {
+        const size_t capCount = sizeof(FRAME_RATE_CAPS) / sizeof(FRAME_RATE_CAPS[0]);
+        size_t next = 0;
+        for (size_t i = 0; i < capCount; i++) {
+            if (FRAME_RATE_CAPS[i] == m_frameLimiter.target()) {
+                next = (i + 1) % capCount;
+                break;
+            }
+        }
+        m_frameLimiter.setTarget(FRAME_RATE_CAPS[next]);
     }
 
-    void tickOneFrame(const float deltaTime)
+    // render thread：移动键以外的按键，没有渲染线程时在glfw回调中直接处理
+    void onActionKey(int key) {
+        m_heapCheckSkipFrame = true;  // heap tracker：功能键可以重建场景、写报告，这一帧不检查
+        switch (key) {
+            case GLFW_KEY_I:  // instancing：切换单个实例和实例网格
+                m_instanceGrid = !m_instanceGrid;
+                buildSceneInstances();
+                break;
+            case GLFW_KEY_R:  // shadow cache：暂停模型的旋转，静止的mesh成为静态caster
+                m_modelAnimating = !m_modelAnimating;
+                m_simulation.setAnimating(m_modelAnimating);
+                break;
+            case GLFW_KEY_F:  // dynamic state：切换线框，不需要重新创建pipeline
+                m_wireframe = m_wireframeSupported && !m_wireframe;
+                break;
+            case GLFW_KEY_Z:  // depth prepass：开关只写depth的pass
+                m_depthPrepass = !m_depthPrepass;
+                break;
+            case GLFW_KEY_1:  // latency mode：切换同时进行的帧数
+            case GLFW_KEY_2:
+            case GLFW_KEY_3:
+                m_requestedFramesInFlight = static_cast<uint32_t>(key - GLFW_KEY_0);
+                break;
+            case GLFW_KEY_P:  // frame pacing：开关低延迟模式
+                m_pacingEnabled = !m_pacingEnabled;
+                break;
+            case GLFW_KEY_V:  // present policy：循环切换present mode
+                m_presentPolicy = static_cast<PresentPolicy>((static_cast<int>(m_presentPolicy) + 1) % static_cast<int>(PresentPolicy::count));
+                m_presentPolicyChanged = true;
+                break;
+            case GLFW_KEY_L:  // frame limiter：循环切换帧率上限
+                cycleFrameRateCap();
+                break;
+            case GLFW_KEY_T:  // cpu profiler：导出chrome trace
+                writeCpuTrace();
+                break;
+            case GLFW_KEY_C:  // frame stats：导出帧时间
+                writeFrameTimes();
+                break;
+            case GLFW_KEY_M:  // memory report：导出内存报告
+                writeMemoryReport();
+                break;
+            case GLFW_KEY_G:  // draw costs：打印当前视野中最贵的mesh和材质
+                reportDrawCosts(std::cout);
+                break;
+            case GLFW_KEY_F12:  // frame capture：截取下一帧
+                requestCapture();
+                break;
+            default:
+                break;
+        }
+    }
+
+    static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
     {
-        calculateFPS(deltaTime);
-        glfwSetWindowTitle(window, std::string("Waku - " + std::to_string(m_fps) + " FPS").c_str());  // 设置fps
-        glfwPollEvents();  // 事件循环处理
-        m_camera.update(deltaTime);
-        drawFrame();  // rendering
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));  // 取出this指针
+        app->m_idleDetector.notifyActivity();
+        app->onKey(key, scancode, action, mods);
     }
 
-    void mainLoop() {
-        while (!glfwWindowShouldClose(window)){
-            const float deltaTime = calculateDeltaTime();
-            tickOneFrame(deltaTime);
+    static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
+    {
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));  // 取出this指针
+        app->m_idleDetector.notifyActivity();
+        if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+            app->pickAtCursor();
         }
-
-        vkDeviceWaitIdle(device);  // rendering：mainloop退出时因为drawFrame中操作是异步的原因可能draw和present依然在进行，需要等待逻辑设备完成操作后才清理资源
     }
 
-    // swap chain recreation：单独提取出swap chain清理方便重建时调用
-    void cleanupSwapChain() {
-        vkDestroyImageView(device, depthImageView, nullptr);
-        vkDestroyImage(device, depthImage, nullptr);
-        vkFreeMemory(device, depthImageMemory, nullptr);
+    // render thread：光标和窗口大小只能在主线程读取，转换成ndc之后交给渲染线程求交
+    void pickAtCursor() {
+        int width = 0, height = 0;
+        glfwGetWindowSize(window, &width, &height);
+        if (width == 0 || height == 0) {
+            return;
+        }
+        double cursorX = 0.0, cursorY = 0.0;
+        glfwGetCursorPos(window, &cursorX, &cursorY);
+        glm::vec2 ndc(2.0f * float(cursorX) / width - 1.0f, 2.0f * float(cursorY) / height - 1.0f);
+        markInput();
+        if (useRenderThread()) {
+            m_renderThread.pushPick(ndc);
+        } else {
+            pickInstance(ndc);
+        }
+    }
 
-        for (auto framebuffer : swapChainFramebuffers) {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
+    // bvh：光标位置在near和far平面上的两个点反投影到世界空间，两点之间的射线和实例的包围盒求最近的交点
+    // project()翻转了y，ndc的y和窗口坐标一样向下；包围盒是保守的，点中的是包围盒最近的实例
+    void pickInstance(glm::vec2 ndc) {
+        if (m_sceneInstances.empty()) {
+            return;
         }
 
-        for (auto imageView : swapChainImageViews) {
-            vkDestroyImageView(device, imageView, nullptr);
+        updateInstanceBvh();
+        glm::mat4 inverseViewProj = glm::inverse(m_camera.project() * m_camera.view());
+        glm::vec4 nearPoint = inverseViewProj * glm::vec4(ndc, 0.0f, 1.0f);
+        glm::vec4 farPoint = inverseViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+        glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+        glm::vec3 ray = glm::vec3(farPoint) / farPoint.w - origin;
+        float length = glm::length(ray);
+        uint32_t instance = 0;
+        float distance = 0.0f;
+        if (length > 0.0f && m_instanceBvh.raycast(origin, ray / length, length, instance, distance)) {
+            glm::vec3 position(m_sceneInstances[instance].transform[3]);
+            std::cout << "picked instance " << instance << " at (" << position.x << ", " << position.y << ", " << position.z << "), distance "
+                      << distance << std::endl;
+        } else {
+            std::cout << "picked nothing" << std::endl;
         }
+    }
 
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+    // startup timer：每个步骤自动计时，第一帧提交后输出
+    // init graph：步骤按依赖执行，模型的导入在模型加载线程上从一开始就进行，graphics pipeline在job pool中创建并提交编译，
+    // 和主线程上创建attachment、解码上传纹理同时进行；其余步骤都要用allocator、command pool或upload context，仍然在主线程按顺序执行
+    void initVulkan() {
+        STARTUP_STEP(m_startupTimer, m_jobPool.init());  // job pool：init graph的worker步骤和模型导入都需要
+        STARTUP_STEP(m_startupTimer, mountAssetPack());  // asset pack：模型导入和纹理加载之前映射
+        const InitGraph::Affinity MAIN = InitGraph::Affinity::main;
+        const InitGraph::Affinity WORKER = InitGraph::Affinity::worker;
+        InitGraph graph;
+        INIT_STEP(graph, MAIN, m_uploadScheduler.init(UPLOAD_BYTES_PER_FRAME, UPLOAD_COPIES_PER_FRAME));
+        if (HITCH_CAPTURE && ENABLE_CPU_PROFILER) {
+            m_hitchDetector.init(HITCH_FACTOR, HITCH_MIN_MS, HITCH_CAPTURE_SECONDS, HITCH_MAX_CAPTURES, HITCH_TRACE_PREFIX);
+        }
+        INIT_STEP(graph, MAIN, requestSceneModels());  // model loader：第一帧不等待模型，纹理在上传之前填入
+        INIT_STEP(graph, MAIN, createInstance());
+        INIT_STEP(graph, MAIN, setupDebugMessenger());  // 验证层：创建回调message
+        INIT_STEP(graph, MAIN, createSurface());  // 窗口表面：创建完instance之后立刻创建，因为会影响物理设备选择
+        INIT_STEP(graph, MAIN, pickPhysicalDevice());  // 物理设备
+        INIT_STEP(graph, MAIN, createLogicalDevice());  // 逻辑设备
+        INIT_STEP(graph, MAIN, createSwapChain());  // swapchain
+        INIT_STEP(graph, MAIN, createImageViews());  // imageview
+        InitGraph::StepId renderPassStep = INIT_STEP(graph, MAIN, createRenderPass());  // renderpass
+        InitGraph::StepId setLayoutStep = INIT_STEP(graph, MAIN, createDescriptorSetLayout());  // descriptor set layout
+        InitGraph::StepId compilerStep = INIT_STEP(graph, MAIN, m_pipelineCompiler.init());  // pipeline compiler：需要在提交pipeline之前启动
+        InitGraph::StepId pipelineStep = INIT_STEP(graph, WORKER, createGraphicsPipeline());  // pipeline：只创建vulkan对象，不使用allocator
+        graph.depends(pipelineStep, {renderPassStep, setLayoutStep, compilerStep});
+        INIT_STEP(graph, MAIN, createDynamicResolution());  // dynamic resolution
+        INIT_STEP(graph, MAIN, createCommandPool());  // command buffer
+        INIT_STEP(graph, MAIN, createStagingRing());  // staging ring
+        INIT_STEP(graph, MAIN, createDepthResources());  // 在framebuffer之前创建作为attachment
+        INIT_STEP(graph, MAIN, createFramebuffers());  // framebuffer
+        INIT_STEP(graph, MAIN, createTextureSampler());  // bindless：纹理写入数组时需要sampler
+        INIT_STEP(graph, MAIN, createGpuDecompressor());  // gpu decompression：纹理在texture cache创建时上传
+        INIT_STEP(graph, MAIN, createGpuMeshDecoder());  // mesh codec：geometry buffer按它是否初始化加上storage usage
+        INIT_STEP(graph, MAIN, createTextureCache());  // texture cache
+        INIT_STEP(graph, MAIN, m_modelTexture = m_textureCache.acquire(TEXTURE_PATH));  // texture image
+        INIT_STEP(graph, MAIN, if (m_model != INVALID_MODEL_HANDLE) { m_models.get(m_model).texture = m_modelTexture; });  // model loader：模型自己没有纹理时使用
+        INIT_STEP(graph, MAIN, createGeometryBuffer());  // geometry buffer
+        INIT_STEP(graph, MAIN, createGpuMeshImporter());  // gpu mesh import：模型的task在第一帧之后才恢复，这时已经创建
+        INIT_STEP(graph, MAIN, createSkinning());  // skinning：gltf上传时写入source，需要geometry buffer
+        INIT_STEP(graph, MAIN, if (m_stressScene) { createStressScene(); } else { createPlaceholderMesh(m_modelTexture); });  // model loader：模型在后台加载，完成前绘制占位mesh
+        INIT_STEP(graph, MAIN, submitSceneUploads());  // upload context：纹理和占位mesh的上传一次提交
+        INIT_STEP(graph, MAIN, createUniformBuffers());  // ubo
+        INIT_STEP(graph, MAIN, createShadingRateImage());  // variable rate shading
+        INIT_STEP(graph, MAIN, createPostProcess());  // post processing
+        INIT_STEP(graph, MAIN, createDescriptorPool());  // descriptor pool
+        INIT_STEP(graph, MAIN, createDescriptorSets());  // descriptor set
+        INIT_STEP(graph, MAIN, createCommandBuffers());  // command buffer
+        INIT_STEP(graph, MAIN, m_frameCapture.init(device, m_allocator, commandPool, m_jobPool, CAPTURE_RING_SIZE));  // frame capture
+        INIT_STEP(graph, MAIN, createVideoEncoder());  // video encode
+        InitGraph::StepId syncStep = INIT_STEP(graph, MAIN, createSyncObjects());  // rendering
+        graph.depends(syncStep, {pipelineStep});  // pipeline layout和push constant stage在录制第一帧时使用
+        INIT_STEP(graph, MAIN, createExtraViews());  // multiple views：在pipeline layout之后，同样通过上一个main步骤依赖它
+        if (useProgressiveStartup()) {
+            deferStartupSteps();  // progressive startup：下面的步骤在第一帧之后执行
+        } else {
+            INIT_STEP(graph, MAIN, createImpostors());  // impostor：烘焙和绘制的pipeline使用pipeline layout
+            INIT_STEP(graph, MAIN, createParticles());  // particles：绘制的pipeline使用pipeline layout
+            INIT_STEP(graph, MAIN, createComputePrimitives());  // compute primitives：benchmark需要command pool
+            INIT_STEP(graph, MAIN, createOcclusionQueries());  // occlusion queries：包围盒的pipeline使用pipeline layout
+            InitGraph::StepId terrainFileStep = INIT_STEP(graph, WORKER, openTerrainFile());  // terrain：只读写文件，和前面的步骤同时执行
+            InitGraph::StepId terrainStep = INIT_STEP(graph, MAIN, createTerrain());
+            graph.depends(terrainStep, {terrainFileStep});
+        }
+        graph.run(m_jobPool, m_startupTimer);
+        if (SHOW_STARTUP_TIMINGS) {
+            graph.report(std::cout);
+        }
     }
 
-    void cleanup() {
-        cleanupSwapChain();
+    // progressive startup：benchmark每次运行的负载要相同，warmup要编译所有pipeline，都在第一帧之前创建全部子系统
+    bool useProgressiveStartup() const {
+        return PROGRESSIVE_STARTUP && !m_benchmark.active() && !m_warmup;
+    }
 
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-        vkDestroyRenderPass(device, renderPass, nullptr);
+    // progressive startup：和initVulkan中的顺序相同；每个子系统没有创建时，帧循环中用到它的地方已经按未初始化跳过
+    // terrain：高度图先在job pool中打开（第一次运行时生成），打开之后下一帧才创建，渲染线程不等待文件
+    void deferStartupSteps() {
+        DEFERRED_INIT_STEP(m_deferredInit, m_jobPool.submit([this]() { openTerrainFile(); }, &m_terrainFileJob));
+        DEFERRED_INIT_STEP(m_deferredInit, createImpostors());
+        DEFERRED_INIT_STEP(m_deferredInit, createParticles());
+        DEFERRED_INIT_STEP(m_deferredInit, createComputePrimitives());
+        DEFERRED_INIT_STEP(m_deferredInit, createOcclusionQueries());
+        m_deferredInit.add("createTerrain()", [this]() { createTerrain(); }, [this]() { return m_terrainFileJob.done(); });
+    }
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-            vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+    // progressive startup：第一帧提交之后每帧执行一个延后的步骤，全部完成时输出耗时
+    void runDeferredInit() {
+        if (!m_deferredInit.runNext(m_startupTimer) || !m_deferredInit.finished()) {
+            return;
         }
+        if (SHOW_STARTUP_TIMINGS) {
+            float sinceStart = std::chrono::duration<float, std::chrono::milliseconds::period>(StartupTimer::Clock::now() - g_processStartTime).count();
+            std::cout << "progressive startup: " << m_deferredInit.stepCount() << " deferred steps " << m_deferredInit.totalMs() << " ms, all done at "
+                << sinceStart << " ms" << std::endl;
+        }
+    }
 
-        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
-
-        vkDestroySampler(device, textureSampler, nullptr);
-        vkDestroyImageView(device, textureImageView, nullptr);
-
-        vkDestroyImage(device, textureImage, nullptr);
-        vkFreeMemory(device, textureImageMemory, nullptr);
+    // warmup：驱动安装或者更新之后第一次启动时所有pipeline都要冷编译，安装时用--warmup提前编译一次
+    // 初始化时已经提交了所有变体（graphics、meshlet、depth prepass、library的快速link和后台优化link，以及各个pass的pipeline），
+    // 只有compute mipmap是第一次用compute生成mipmap时才创建，这里提前创建；cleanup等待所有编译完成后写回pipeline cache
+    // headless的离屏image格式和窗口模式一般选到的surface格式相同，render pass和dynamic rendering的格式也就相同
+    void warmUpPipelineCache() {
+        auto start = std::chrono::steady_clock::now();
+        initVulkan();
+        if (!m_computeMipmaps.isInitialized()) {
+            m_computeMipmaps.init(device, m_pipelineCache.handle(), embeddedShader(MIPMAP_SHADER));
+        }
+        vkDeviceWaitIdle(device);
+        cleanup();
+        auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "warmup: pipeline cache written to " << PIPELINE_CACHE_PATH << " in " << milliseconds << " ms" << std::endl;
+    }
 
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+    float calculateDeltaTime()
+    {
+        static auto s_lastTickTimePoint = std::chrono::high_resolution_clock::now();  // static记录一次
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float deltaTime = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - s_lastTickTimePoint).count();
+        s_lastTickTimePoint = currentTime;
 
-        vkDestroyBuffer(device, indexBuffer, nullptr);
-        vkFreeMemory(device, indexBufferMemory, nullptr);
+        return deltaTime;
+    }
 
-        vkDestroyBuffer(device, vertexBuffer, nullptr);
-        vkFreeMemory(device, vertexBufferMemory, nullptr);
+    static constexpr float sg_fpsAlpha = 1.f / 100;
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-            vkDestroyFence(device, inFlightFences[i], nullptr);
-        }
+    void tickOneFrame(const float deltaTime)
+    {
+        CPU_PROFILE_SCOPE("tickOneFrame");
+        m_frameHeapCheck.beginFrame();
+        m_frameStats.push(deltaTime);
+        detectHitch(deltaTime);
+        m_frameDeltaTime = deltaTime;
+        m_allocator.updateBudget();  // memory budget：每帧刷新堆预算
+        m_titleTimer += deltaTime;
+        if (hasWindow() && m_titleTimer >= TITLE_UPDATE_INTERVAL) {
+            m_titleTimer = 0.f;
+            updateWindowTitle();
+        }
+        m_shaderStatistics.report(std::cout);  // shader statistics：pipeline compiler的线程记录，这里打印
+        m_telemetryTimer += deltaTime;
+        if (m_telemetry.active() && m_telemetryTimer >= TELEMETRY_INTERVAL) {
+            m_telemetryTimer = 0.f;
+            publishTelemetry();
+        }
+        if (!m_benchmark.active()) {
+            m_frameLimiter.wait();  // frame limiter：在采样输入之前等待，和frame pacing一样让输入尽量新
+        }
+        if (m_pacingEnabled && m_framePacer.initialized()) {
+            m_framePacer.pace(swapChain);  // frame pacing：在采样输入之前睡眠，输入尽量接近显示的时间
+        }
+        if (useRenderThread()) {
+            applyFramePacket();  // render thread：事件已经在主线程处理，这里取走积累的输入
+        } else if (hasWindow()) {
+            glfwPollEvents();  // 事件循环处理
+        }
+        updateInputLatency();
+        if (m_benchmark.active()) {
+            // benchmark：相机和旋转只由模拟时间决定，不读键盘输入，和模拟线程的旋转速度相同
+            m_benchmark.placeCamera(m_camera);
+            m_modelAngle = glm::radians(90.0f) * m_benchmark.time();
+        } else {
+            if (!useRenderThread()) {
+                m_simulation.update();  // simulation：没有模拟线程时在这里执行落后的tick，render thread：由主线程执行
+            }
+            SimulationState simulationState = m_simulation.interpolated();
+            m_camera.place(simulationState.cameraPosition, simulationState.cameraLookAt);
+            m_modelAngle = simulationState.modelAngle;
+        }
+        m_camera.trackVelocity(deltaTime);  // world streaming：预测chunk的加载需要相机速度
+        m_uploadContext.poll();  // upload context：非阻塞回收已完成的上传
+        m_uploadScheduler.beginFrame();  // upload scheduler：在恢复等待上传的task之前授权这一帧的上传
+        updateModelLoads();
+        updateWorldStreaming();
+        updateTextureStreaming();
+        replaceCopiedTextures();
+        updateResidency();
+        updateDefragmentation();
+        updateImpostors();
+        updatePipelines();
+        drawFrame();  // rendering
+        if (useIdleRendering()) {
+            m_idleDetector.endFrame(isFrameStatic());
+        }
+        if (!m_startupTimer.firstFrameRecorded()) {
+            m_startupTimer.firstFrame();
+            if (SHOW_STARTUP_TIMINGS) {
+                m_startupTimer.report(std::cout);
+            }
+            if (SHOW_ATTACHMENT_BANDWIDTH && m_dynamicRenderingSupported) {
+                m_attachmentBandwidth.report(std::cout);
+            }
+        } else if (!m_deferredInit.finished()) {
+            runDeferredInit();
+        }
+        if (m_benchmark.active()) {
+            updateBenchmark(deltaTime);
+        }
+        if (m_heapCheck) {
+            m_frameHeapCheck.endFrame(!m_heapCheckSkipFrame && !isLoading() && m_startupTimer.firstFrameRecorded());
+            m_heapCheckSkipFrame = false;
+        }
+    }
+
+    // benchmark：deltaTime是上一帧开始到这一帧开始的cpu时间，gpu时间是profiler最近读到的整帧耗时
+    void updateBenchmark(float deltaTime) {
+        m_benchmark.record(deltaTime * 1000.f, m_gpuProfiler.latestMs("frame"));
+        if (!m_benchmark.finished()) {
+            return;
+        }
+        BenchmarkRun::Summary cpu = m_benchmark.cpuSummary();
+        BenchmarkRun::Summary gpu = m_benchmark.gpuSummary();
+        if (m_benchmark.writeCsv(BENCHMARK_OUTPUT_PATH)) {
+            std::cout << "benchmark: " << (m_stressScene ? m_stressSettings.label() + ", " : "") << BENCHMARK_MEASURED_FRAMES << " frames, cpu avg " << cpu.avg << " ms p99 " << cpu.p99 << " ms, gpu avg " << gpu.avg
+                      << " ms p99 " << gpu.p99 << " ms, " << BENCHMARK_OUTPUT_PATH << std::endl;
+        } else {
+            std::cerr << "failed to write benchmark results: " << BENCHMARK_OUTPUT_PATH << std::endl;
+        }
+        if (m_regression) {
+            checkRegression(cpu, gpu);
+        }
+        requestClose();
+    }
+
+    // regression：帧时间的绝对阈值0.2ms，启动50ms，内存1MB，小于这些的变化当作噪声
+    void checkRegression(const BenchmarkRun::Summary& cpu, const BenchmarkRun::Summary& gpu) {
+        const float frameMs = 0.2f;
+        std::vector<RegressionMetric> metrics = {
+            {"cpu_p50_ms", cpu.p50, REGRESSION_FRAME_TIME_TOLERANCE, frameMs},
+            {"cpu_p95_ms", cpu.p95, REGRESSION_FRAME_TIME_TOLERANCE, frameMs},
+            {"cpu_p99_ms", cpu.p99, REGRESSION_FRAME_TIME_TOLERANCE, frameMs},
+            {"gpu_p50_ms", gpu.p50, REGRESSION_FRAME_TIME_TOLERANCE, frameMs},
+            {"gpu_p95_ms", gpu.p95, REGRESSION_FRAME_TIME_TOLERANCE, frameMs},
+            {"gpu_p99_ms", gpu.p99, REGRESSION_FRAME_TIME_TOLERANCE, frameMs},
+            {"startup_ms", m_startupTimer.firstFrameMs(), REGRESSION_STARTUP_TOLERANCE, 50.f},
+            {"device_memory_peak_mb", m_allocator.stats().peakAllocatedBytes / (1024.f * 1024.f), REGRESSION_MEMORY_TOLERANCE, 1.f},
+            {"host_memory_peak_mb", HostMemoryTracker::instance().peakBytes() / (1024.f * 1024.f), REGRESSION_MEMORY_TOLERANCE, 1.f},
+        };
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        std::string baselinePath = RegressionCheck::baselinePath(REGRESSION_BASELINE_DIR, properties.deviceName, properties.driverVersion, m_modelPath);
+
+        RegressionCheck check;
+        bool baselineCreated = m_updateBaseline || !check.loadBaseline(baselinePath);
+        if (baselineCreated && !RegressionCheck::writeBaseline(baselinePath, metrics)) {
+            std::cerr << "failed to write regression baseline: " << baselinePath << std::endl;
+            m_exitCode = EXIT_FAILURE;
+        }
+        std::vector<RegressionResult> results = check.compare(metrics);
+        if (!RegressionCheck::writeReport(REGRESSION_REPORT_PATH, properties.deviceName, m_modelPath, baselinePath, baselineCreated, results)) {
+            std::cerr << "failed to write regression report: " << REGRESSION_REPORT_PATH << std::endl;
+            m_exitCode = EXIT_FAILURE;
+        }
+
+        for (const RegressionResult& result : results) {
+            if (result.regressed) {
+                std::cout << "regression: " << result.metric.name << " " << result.metric.value << " (baseline " << result.baseline << ")" << std::endl;
+            }
+        }
+        if (!RegressionCheck::passed(results)) {
+            m_exitCode = EXIT_FAILURE;
+        }
+        std::cout << "regression: " << (baselineCreated ? "baseline written, " : "") << (RegressionCheck::passed(results) ? "passed" : "FAILED") << ", "
+                  << REGRESSION_REPORT_PATH << std::endl;
+    }
+
+    void requestClose() {
+        if (!hasWindow()) {
+            m_closeRequested = true;
+        } else {
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+    }
+
+    // headless：benchmark时由benchmark决定什么时候结束，否则跑HEADLESS_FRAME_COUNT帧
+    // display mode：direct时一直运行到benchmark结束或者进程被终止
+    bool shouldClose() const {
+        if (hasWindow()) {
+            return glfwWindowShouldClose(window);
+        }
+        return m_closeRequested || (m_headless && !m_benchmark.active() && m_headlessFrames >= HEADLESS_FRAME_COUNT);
+    }
+
+    // pipeline library：后台优化的pipeline完成后替换快速link的版本，旧的pipeline等使用它的帧完成后再销毁
+    // pipeline variants：meshlet和depth prepass的变体在录制之前非阻塞地取出，编译完成之前draw使用graphicsPipeline，不产生编译的卡顿
+    void updatePipelines() {
+        if (ASYNC_PIPELINE_VARIANTS && !m_benchmark.active()) {
+            pollPipeline(m_meshletPipelineFuture, m_meshletPipeline);
+            pollPipeline(m_depthPrepassPipelineFuture, m_depthPrepassPipeline);
+        } else {
+            waitPipeline(m_meshletPipelineFuture, m_meshletPipeline);  // benchmark：每次运行从第一帧开始使用相同的pipeline，结果可以比较
+            waitPipeline(m_depthPrepassPipelineFuture, m_depthPrepassPipeline);
+        }
+        if (m_graphicsPipelineFuture.valid()) {
+            return;  // pipeline compiler：快速link的pipeline还没有被使用过，优化的pipeline等它取出之后再替换
+        }
+        VkPipeline optimized = m_pipelineLibrary.takeOptimized();
+        if (optimized == VK_NULL_HANDLE) {
+            return;
+        }
+        VkPipeline linked = graphicsPipeline;
+        graphicsPipeline = optimized;
+        m_deletionQueue.push(m_frameNumber, [this, linked]() {
+            vkDestroyPipeline(device, linked, hostAllocator());
+        });
+    }
+
+    // telemetry：和窗口标题相同的统计，写进复用的记录，不分配
+    void publishTelemetry() {
+        TelemetryRecord& record = m_telemetryRecord;
+        record.frame = m_frameNumber;
+        FrameTimeSummary frameTimes = m_frameStats.summary();
+        record.averageFps = frameTimes.averageFps;
+        record.p50Ms = frameTimes.p50Ms;
+        record.p95Ms = frameTimes.p95Ms;
+        record.p99Ms = frameTimes.p99Ms;
+        record.maxMs = frameTimes.maxMs;
+        record.onePercentLowFps = frameTimes.onePercentLowFps;
+        record.hitches = frameTimes.hitches;
+
+        record.gpuFrameMs = m_gpuProfiler.latestMs("frame");
+        m_gpuProfiler.stats(m_gpuScopeStats);
+        record.scopeCount = static_cast<uint32_t>(std::min<size_t>(m_gpuScopeStats.size(), TelemetryRecord::MAX_SCOPES));
+        for (uint32_t i = 0; i < record.scopeCount; i++) {
+            TelemetryScope& scope = record.scopes[i];
+            std::memset(scope.name, 0, sizeof(scope.name));
+            m_gpuScopeStats[i].name.copy(scope.name, sizeof(scope.name) - 1);
+            scope.avgMs = m_gpuScopeStats[i].avgMs;
+            scope.maxMs = m_gpuScopeStats[i].maxMs;
+        }
+
+        const UploadScheduler::FrameStats& uploads = m_uploadScheduler.frameStats();
+        record.uploadBytes = uploads.bytes;
+        record.uploadCopies = uploads.copies;
+        record.uploadPending = static_cast<uint32_t>(uploads.pending);
+        m_uploadContext.poll();
+        record.uploadBatchesInFlight = static_cast<uint32_t>(m_uploadContext.inFlightBatches());
+
+        const MemoryStats& memory = m_allocator.stats();
+        record.deviceLocalUsage = memory.deviceLocalUsage();
+        record.deviceLocalBudget = memory.deviceLocalBudget();
+        record.hostBytes = TRACK_HOST_ALLOCATIONS ? HostMemoryTracker::instance().totalBytes() : 0;
+        for (size_t i = 0; i < memory.categoryBytes.size(); i++) {
+            record.categoryBytes[i] = memory.categoryBytes[i];
+        }
+        m_telemetry.publish(record);
+    }
+
+    // 窗口标题显示fps，memory budget：开启时附加显存使用量/预算和各类资源占用
+    // heap tracker：标题写进复用的m_windowTitle，数字由appendTitle格式化到栈上的buffer，容量稳定之后更新标题不再分配
+    void updateWindowTitle() {
+        std::string& title = m_windowTitle;
+        title.clear();
+        // frame stats：平均帧率、帧时间中位数和p99、1% low，以及窗口中的卡顿次数
+        FrameTimeSummary frameTimes = m_frameStats.summary();
+        appendTitle("Waku - %d FPS", static_cast<int>(frameTimes.averageFps + 0.5f));  // 设置fps
+        appendTitle(" (p50 %.2f ms, p99 %.2f ms, 1%% low %d FPS, %u hitches)", frameTimes.p50Ms, frameTimes.p99Ms,
+            static_cast<int>(frameTimes.onePercentLowFps + 0.5f), frameTimes.hitches);
+
+        // latency mode：当前的frames in flight和cpu平均领先gpu的帧数，保留一位小数
+        title += " - ";
+        title += presentPolicyName(m_presentPolicy);
+        if (m_frameLimiter.effectiveTarget() > 0.f) {
+            appendTitle(" capped %d", static_cast<int>(m_frameLimiter.effectiveTarget()));
+        }
+        if (m_thermalGovernor.level() > 0) {
+            appendTitle(" thermal %u", m_thermalGovernor.level());
+        }
+        appendTitle(" - %u frames in flight, cpu ahead %.1f", m_framesInFlight, m_cpuAheadFrames);
+        InputLatencySummary latency = m_inputLatency.summary();
+        if (latency.count > 0) {
+            appendTitle(" - input latency p50 %.1f ms p99 %.1f ms", latency.p50Ms, latency.p99Ms);
+        }
+
+        if (SHOW_GPU_TIMINGS) {
+            auto toK = [](uint64_t count) { return static_cast<unsigned long long>((count + 500) / 1000); };
+            m_gpuProfiler.stats(m_gpuScopeStats);
+            for (const GpuProfiler::ScopeStats& stats : m_gpuScopeStats) {
+                title += " - ";
+                title += stats.name;
+                appendTitle(" %.2f/%.2f/%.2f ms", stats.minMs, stats.avgMs, stats.maxMs);
+                if (stats.hasStatistics) {  // pipeline statistics：顶点、图元、vs调用、裁剪后图元、fs调用
+                    appendTitle(" (ia %lluk verts %lluk prims, vs %lluk, clip %lluk, fs %lluk)", toK(stats.statistics[GpuProfiler::inputAssemblyVertices]),
+                        toK(stats.statistics[GpuProfiler::inputAssemblyPrimitives]), toK(stats.statistics[GpuProfiler::vertexShaderInvocations]),
+                        toK(stats.statistics[GpuProfiler::clippingPrimitives]), toK(stats.statistics[GpuProfiler::fragmentShaderInvocations]));
+                }
+            }
+        }
+
+        if (m_drawCosts.initialized()) {
+            m_drawCosts.top(1, false, m_drawCostScratch);
+            appendTitle(" - draws %.2f ms", m_drawCosts.totalMs());
+            if (!m_drawCostScratch.empty()) {
+                appendTitle(", top mesh %u %.2f ms", m_drawCostScratch[0].id, m_drawCostScratch[0].ms);
+            }
+        }
+
+        if (SHOW_MEMORY_STATS) {
+            const MemoryStats& stats = m_allocator.stats();
+            auto toMB = [](VkDeviceSize bytes) { return static_cast<unsigned long long>(bytes / (1024 * 1024)); };
+
+            appendTitle(" - VRAM %llu/%llu MB", toMB(stats.deviceLocalUsage()), toMB(stats.deviceLocalBudget()));
+            if (!stats.budgetExtension) {
+                title += " (estimated)";
+            }
+            for (size_t i = 0; i < stats.categoryBytes.size(); i++) {
+                if (stats.categoryBytes[i] > 0) {
+                    appendTitle(" %s %llu", memoryCategoryName(static_cast<MemoryCategory>(i)), toMB(stats.categoryBytes[i]));
+                }
+            }
+            if (TRACK_HOST_ALLOCATIONS) {
+                appendTitle(" - host %llu MB, %llu allocs/frame", toMB(HostMemoryTracker::instance().totalBytes()),
+                    static_cast<unsigned long long>(HostMemoryTracker::instance().lastFrameAllocations()));
+            }
+            if (m_heapCheck) {
+                appendTitle(", heap %llu/frame", static_cast<unsigned long long>(m_frameHeapCheck.lastFrameAllocations()));
+            }
+            // upload scheduler：这一帧授权的上传和还在等待的请求
+            const UploadScheduler::FrameStats& uploads = m_uploadScheduler.frameStats();
+            if (uploads.granted > 0 || uploads.pending > 0) {
+                appendTitle(" - upload %llu KB, %u copies, %zu pending", static_cast<unsigned long long>(uploads.bytes / 1024), uploads.copies, uploads.pending);
+            }
+        }
+
+        // attachment bandwidth：render graph最近一次录制的估计，render pass的路径没有统计
+        if (SHOW_ATTACHMENT_BANDWIDTH && m_dynamicRenderingSupported) {
+            appendTitle(" - attachments %llu MB/frame", static_cast<unsigned long long>((m_attachmentBandwidth.totalBytes() + 512 * 1024) / (1024 * 1024)));
+        }
+
+        if (m_sceneInstances.size() > 1 && useGpuCulling()) {  // gpu culling：可见数量只在gpu上，cpu不回读
+            appendTitle(" - instances %u (gpu culled)", m_instanceCount);
+        } else if (m_sceneInstances.size() > 1) {  // frustum culling：可见的实例数量
+            appendTitle(" - instances %u/%zu", m_instanceCount, m_sceneInstances.size());
+        }
+
+        if (useRenderThread()) {
+            m_renderThread.setTitle(title);  // render thread：glfwSetWindowTitle只能在主线程调用
+        } else {
+            glfwSetWindowTitle(window, title.c_str());
+        }
+    }
+
+    // heap tracker：printf格式追加到m_windowTitle，超过buffer的部分截断
+    template <typename... Args>
+    void appendTitle(const char* format, Args... args) {
+        char buffer[160];
+        int length = std::snprintf(buffer, sizeof(buffer), format, args...);
+        if (length > 0) {
+            m_windowTitle.append(buffer, std::min(static_cast<size_t>(length), sizeof(buffer) - 1));
+        }
+    }
+
+    bool useIdleRendering() const { return IDLE_RENDERING && hasWindow() && !m_benchmark.active(); }
+
+    // idle rendering：和上一帧相比相机、模型旋转都没有变化，移动键按住时相机一直在动，也不会是静止的
+    // 模型导入、纹理streaming和上传完成时画面会变化，进行中时不算静止
+    bool isFrameStatic() {
+        SimulationState state{m_camera.position(), m_camera.lookAt(), m_modelAngle};
+        bool unchanged = state.cameraPosition == m_lastFrameState.cameraPosition && state.cameraLookAt == m_lastFrameState.cameraLookAt &&
+            state.modelAngle == m_lastFrameState.modelAngle;
+        m_lastFrameState = state;
+        return unchanged && !isLoading();
+    }
+
+    // idle rendering、heap tracker：resize、上传、纹理streaming或者模型导入还在进行
+    // hitch detector：上下文每帧采样，只有检测到卡顿时才保存
+    void detectHitch(float deltaTime) {
+        HitchContext context;
+        context.frame = m_frameNumber;
+        context.swapChainRecreations = m_swapChainRecreations;
+        context.uploadBatchesInFlight = m_uploadContext.pendingTicket() - m_uploadContext.completedTicket() - 1;
+        context.uploadRequestsWaiting = m_uploadScheduler.frameStats().pending;
+        context.pipelineCompilesInFlight = m_pipelineCompiler.inFlight();
+        context.loading = isLoading();
+        std::string path = m_hitchDetector.push(deltaTime, context);
+        if (!path.empty()) {
+            m_heapCheckSkipFrame = true;  // heap tracker：导出trace时分配内存
+            std::cout << "hitch trace: " << path << std::endl;
+        }
+    }
+
+    bool isLoading() {
+        if (m_resizeCoalescer.pending() || !m_uploadContext.idle() || !m_uploadScheduler.idle() || (m_textureStreamer.isRunning() && m_textureStreamer.busy())) {
+            return true;
+        }
+        for (const ModelRecord& record : m_models) {
+            if (record.state == ModelState::loading || record.state == ModelState::uploading) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // idle rendering：idle时不绘制，等待输入或者IDLE_WAKE_INTERVAL；返回true表示仍然idle，这次循环跳过这一帧
+    // 没有渲染线程时glfwWaitEventsTimeout同时处理事件，输入回调通知detector
+    bool waitWhileIdle() {
+        if (!m_idleDetector.idle()) {
+            return false;
+        }
+        if (useRenderThread()) {
+            m_idleDetector.waitForActivity(IDLE_WAKE_INTERVAL);
+        } else {
+            glfwWaitEventsTimeout(IDLE_WAKE_INTERVAL);
+        }
+        calculateDeltaTime();  // 丢掉等待的时间，恢复后第一帧的deltaTime不包括idle
+        return !m_idleDetector.woken() && !shouldClose();
+    }
+
+    void mainLoop() {
+        m_idleDetector.init(useIdleRendering() ? IDLE_SETTLE_FRAMES : 0);
+        if (useRenderThread()) {
+            runRenderThread();
+        } else {
+            while (!shouldClose()) {
+                if (waitWhileIdle()) {
+                    continue;
+                }
+                const float deltaTime = calculateDeltaTime();
+                tickOneFrame(deltaTime);
+            }
+        }
+        m_simulation.stop();
+
+        vkDeviceWaitIdle(device);  // rendering：mainloop退出时因为drawFrame中操作是异步的原因可能draw和present依然在进行，需要等待逻辑设备完成操作后才清理资源
+
+        if (m_headless && !HEADLESS_OUTPUT_PATH.empty() && m_headlessFrames > 0) {
+            if (writeHeadlessImage(HEADLESS_OUTPUT_PATH)) {
+                std::cout << "headless: " << m_headlessFrames << " frames, last frame written to " << HEADLESS_OUTPUT_PATH << std::endl;
+            } else {
+                std::cerr << "failed to write headless image: " << HEADLESS_OUTPUT_PATH << std::endl;
+            }
+        }
+    }
+
+    // render thread：渲染线程运行原来的帧循环，主线程等待事件，没有事件时每个模拟tick醒来一次
+    // 没有模拟线程时由主线程推进模拟；渲染线程结束（窗口关闭或者抛出异常）后主线程join，异常在这里重新抛出
+    void runRenderThread() {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(window, &width, &height);
+        m_renderThread.setFramebufferSize(width, height);
+        m_renderThread.start([this]() {
+            while (!shouldClose()) {
+                if (waitWhileIdle()) {
+                    continue;
+                }
+                const float deltaTime = calculateDeltaTime();
+                tickOneFrame(deltaTime);
+            }
+            glfwPostEmptyEvent();  // 唤醒等待事件的主线程
+        });
+
+        std::string title;
+        while (m_renderThread.running()) {
+            glfwWaitEventsTimeout(1.0 / SIMULATION_TICK_RATE);
+            m_simulation.update();
+            if (m_renderThread.takeTitle(title)) {
+                glfwSetWindowTitle(window, title.c_str());
+            }
+        }
+        m_renderThread.join();
+    }
+
+    // input latency：frame pacing刚等到的present使用等待返回的时间，其余的用0超时轮询，轮询到的显示时间最多晚一帧
+    void updateInputLatency() {
+        if (!m_framePacer.initialized() || m_inputLatency.oldestPending() == 0) {
+            return;
+        }
+        if (m_pacingEnabled && m_framePacer.waitedId() != 0) {
+            m_inputLatency.displayed(m_framePacer.waitedId(), m_framePacer.lastDisplay());
+        }
+        InputLatencyTracker::Clock::time_point now = InputLatencyTracker::Clock::now();
+        uint64_t presentId = m_inputLatency.oldestPending();
+        while (presentId != 0 && m_framePacer.displayed(swapChain, presentId)) {
+            m_inputLatency.displayed(presentId, now);
+            presentId = m_inputLatency.oldestPending();
+        }
+    }
 
-        vkDestroyCommandPool(device, commandPool, nullptr);
+    // render thread：渲染线程每帧开始时执行主线程积累的功能键和点击
+    void applyFramePacket() {
+        m_renderThread.take(m_framePacket);
+        if (m_framePacket.inputTime != std::chrono::steady_clock::time_point()) {
+            m_inputLatency.input(m_framePacket.inputTime);
+        }
+        for (int key : m_framePacket.keys) {
+            onActionKey(key);
+        }
+        for (glm::vec2 ndc : m_framePacket.picks) {
+            pickInstance(ndc);
+        }
+    }
+
+    // render thread：渲染线程不能调用glfw的窗口函数，framebuffer大小来自主线程
+    void getFramebufferSize(int& width, int& height) {
+        if (m_displayMode == DisplayMode::direct) {
+            width = static_cast<int>(m_directDisplay.extent().width);  // display mode：显示器mode的分辨率
+            height = static_cast<int>(m_directDisplay.extent().height);
+        } else if (useRenderThread() && m_renderThread.running()) {
+            m_renderThread.framebufferSize(width, height);
+        } else {
+            glfwGetFramebufferSize(window, &width, &height);
+        }
+    }
+
+    // headless：最后一帧已经在TRANSFER_SRC_OPTIMAL，复制到host visible的buffer后写成ppm，只在退出时调用一次，提交之后直接等待完成
+    bool writeHeadlessImage(const std::string& path) {
+        const uint32_t width = swapChainExtent.width;
+        const uint32_t height = swapChainExtent.height;
+        VkBuffer readbackBuffer;
+        Allocation readbackAllocation;
+        createBuffer(VkDeviceSize(width) * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            readbackBuffer, readbackAllocation, MemoryCategory::staging, "headless readback");
+
+        // batch pool：一次性的命令也使用upload context中复用的command buffer，离屏image属于图形队列
+        VkCommandBuffer commandBuffer = m_uploadContext.graphicsCommandBuffer();
+
+        // headless：layout在帧末尾已经转换，这里只需要让color attachment的写入对传输可见
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {width, height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, swapChainImages[m_lastImageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+        m_uploadContext.wait(m_uploadContext.submit());
+
+        // headless：离屏image和swap chain一样是BGRA，ppm是RGB
+        std::ofstream file(path, std::ios::binary);
+        if (file) {
+            file << "P6\n" << width << " " << height << "\n255\n";
+            const uint8_t* pixels = static_cast<const uint8_t*>(readbackAllocation.mapped);
+            std::vector<uint8_t> row(size_t(width) * 3);
+            for (uint32_t y = 0; y < height; y++) {
+                for (uint32_t x = 0; x < width; x++) {
+                    const uint8_t* pixel = pixels + (size_t(y) * width + x) * 4;
+                    row[x * 3 + 0] = pixel[2];
+                    row[x * 3 + 1] = pixel[1];
+                    row[x * 3 + 2] = pixel[0];
+                }
+                file.write(reinterpret_cast<const char*>(row.data()), row.size());
+            }
+        }
+        bool written = static_cast<bool>(file);
+
+        vkDestroyBuffer(device, readbackBuffer, hostAllocator());
+        m_allocator.free(readbackAllocation);
+        return written;
+    }
+
+    // swap chain recreation：单独提取出swap chain清理方便重建时调用
+    void cleanupSwapChain() {
+        vkDestroyImageView(device, depthImageView, hostAllocator());
+        vkDestroyImage(device, depthImage, hostAllocator());
+        m_allocator.free(depthImageAllocation);
+        vkDestroyImageView(device, m_msaaColorView, hostAllocator());
+        vkDestroyImage(device, m_msaaColorImage, hostAllocator());
+        m_allocator.free(m_msaaColorAllocation);
+        vkDestroyImageView(device, m_gbufferAlbedoView, hostAllocator());
+        vkDestroyImage(device, m_gbufferAlbedoImage, hostAllocator());
+        m_allocator.free(m_gbufferAlbedoAllocation);
+        vkDestroyImageView(device, m_gbufferNormalView, hostAllocator());
+        vkDestroyImage(device, m_gbufferNormalImage, hostAllocator());
+        m_allocator.free(m_gbufferNormalAllocation);
+
+        for (auto framebuffer : swapChainFramebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, hostAllocator());
+        }
+
+        for (auto imageView : swapChainImageViews) {
+            vkDestroyImageView(device, imageView, hostAllocator());
+        }
+
+        if (m_headless) {
+            for (size_t i = 0; i < swapChainImages.size(); i++) {
+                vkDestroyImage(device, swapChainImages[i], hostAllocator());
+                m_allocator.free(m_offscreenAllocations[i]);
+            }
+            return;
+        }
+
+        for (VkSwapchainKHR oldSwapChain : m_retiredSwapChains) {
+            vkDestroySwapchainKHR(device, oldSwapChain, hostAllocator());
+        }
+        m_retiredSwapChains.clear();
+        m_fullScreenExclusive.release(swapChain);
+        vkDestroySwapchainKHR(device, swapChain, hostAllocator());
+    }
+
+    void cleanup() {
+        m_textureStreamer.stop();  // texture streaming：先停止后台线程
+        m_asyncScheduler.cleanup();  // async task：等待导入中的模型完成，它们使用job pool
+        m_instanceBvh.cleanup();  // bvh：后台的重新构建在job pool中
+        m_fileReader.cleanup();
+        if (m_shaderStatistics.active() && m_shaderStatistics.pipelineCount() > 0) {
+            if (m_shaderStatistics.writeCsv(SHADER_STATISTICS_PATH)) {
+                std::cout << "shader statistics: " << SHADER_STATISTICS_PATH << ", " << m_shaderStatistics.pipelineCount() << " pipelines" << std::endl;
+            } else {
+                std::cerr << "failed to write shader statistics: " << SHADER_STATISTICS_PATH << std::endl;
+            }
+        }
+        reportDrawCosts(std::cout);
+        m_jobPool.wait(m_terrainFileJob);  // progressive startup：高度图可能还在打开
+        m_frameCapture.cleanup(m_timeline.completedValue());  // frame capture：mainloop退出时已经vkDeviceWaitIdle，等待编码完成后job pool才退出
+        m_jobPool.cleanup();
+        if (SHOW_JOB_STATS) {
+            m_jobPool.report(std::cout);
+        }
+        if (m_heapCheck) {
+            m_frameHeapCheck.report(std::cout);
+            m_frameArenas.report(std::cout);
+        }
+        m_uploadContext.waitIdle();  // upload context：先执行上传完成的callback，它们可能引用下面要销毁的资源
+        m_textureCache.release(m_modelTexture, m_frameNumber);  // texture cache：引用计数归零，销毁进入deletion queue
+        for (const ModelRecord& record : m_models) {
+            for (TextureHandle texture : record.textures) {
+                m_textureCache.release(texture, m_frameNumber);
+            }
+        }
+        m_deletionQueue.flushAll();  // deletion queue：mainloop退出时已经vkDeviceWaitIdle
+        for (std::unique_ptr<ExtraView>& view : m_extraViews) {
+            view->target.cleanup(instance);  // multiple views：swap chain在deletion queue中的旧资源已经销毁
+            view->instances.cleanup();
+            vkDestroyPipeline(device, view->pipeline, hostAllocator());
+        }
+        m_extraViews.clear();
+        m_renderGraph.cleanup();
+        cleanupSwapChain();
+
+        // pipeline compiler：没有用到过的pipeline也要等待编译完成，然后和其它pipeline一起销毁
+        waitPipeline(m_graphicsPipelineFuture, graphicsPipeline);
+        waitPipeline(m_meshletPipelineFuture, m_meshletPipeline);
+        waitPipeline(m_depthPrepassPipelineFuture, m_depthPrepassPipeline);
+        m_pipelineCompiler.cleanup();
+        m_pipelineLibrary.cleanup();  // pipeline library：等待后台的优化link，它也写入pipeline cache
+        // pipeline cache：所有pipeline都已经创建过，包括第一次需要时才创建的compute mipmap
+        if (!m_pipelineCache.save()) {
+            std::cerr << "failed to write pipeline cache: " << PIPELINE_CACHE_PATH << std::endl;
+        }
+        m_pipelineCache.cleanup();
+
+        vkDestroyPipeline(device, graphicsPipeline, hostAllocator());
+        if (m_meshletPipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, m_meshletPipeline, hostAllocator());
+        }
+        if (m_depthPrepassPipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, m_depthPrepassPipeline, hostAllocator());
+        }
+        if (m_particlePipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, m_particlePipeline, hostAllocator());
+        }
+        if (m_terrainPipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, m_terrainPipeline, hostAllocator());
+        }
+        if (m_impostorPipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, m_impostorPipeline, hostAllocator());
+        }
+        if (m_occlusionBoxPipeline != VK_NULL_HANDLE) {
+            vkDestroyPipeline(device, m_occlusionBoxPipeline, hostAllocator());
+        }
+        m_shaderObjects.cleanup();
+        vkDestroyPipelineLayout(device, pipelineLayout, hostAllocator());
+        m_deferredLighting.cleanup();
+        vkDestroyRenderPass(device, renderPass, hostAllocator());
+
+        m_uniformRing.cleanup();
+        m_instanceBuffer.cleanup();
+        m_indirectDraws.cleanup();
+        m_sceneObjects.cleanup();
+        m_materials.cleanup();
+        m_gpuCuller.cleanup();
+        m_gpuMeshImporter.cleanup();
+        m_skinning.cleanup();
+        m_particles.cleanup();
+        m_computePrimitives.cleanup();
+        m_terrain.cleanup();
+        m_occlusionQueries.cleanup();
+        m_videoEncoder.cleanup();  // video encode：mainloop退出时已经vkDeviceWaitIdle，编码队列也已经空闲
+        m_gpuDecompressor.cleanup();
+        m_gpuMeshDecoder.cleanup();
+        m_clusteredLighting.cleanup();
+        m_shadowCache.cleanup();
+        m_shadowInstances.cleanup();
+        m_accelerationStructures.cleanup();
+        m_impostors.cleanup();
+        m_hiz.cleanup();
+        m_upscaler.cleanup();
+        m_shadingRate.cleanup();
+        m_postProcess.cleanup();
+        m_descriptorBuffer.cleanup();
+
+        m_frameDescriptors.cleanup();
+        if (m_cachedFrameSetPool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(device, m_cachedFrameSetPool, hostAllocator());
+        }
+        if (m_meshletDescriptorPool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(device, m_meshletDescriptorPool, hostAllocator());
+        }
+
+        m_samplerCache.cleanup();
+        for (MipDrop& drop : m_mipDrops) {
+            vkDestroyImage(device, drop.texture.image, hostAllocator());
+            m_allocator.free(drop.texture.allocation);
+        }
+        m_textureCache.cleanup();  // texture cache：销毁仍被引用的纹理
+        m_bindlessTextures.cleanup();
+
+        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, hostAllocator());
+        if (m_meshletSetLayout != VK_NULL_HANDLE) {
+            vkDestroyDescriptorSetLayout(device, m_meshletSetLayout, hostAllocator());
+        }
+
+        m_geometryBuffer.cleanup();
+        m_meshletBuffer.cleanup();
+
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            vkDestroySemaphore(device, renderFinishedSemaphores[i], hostAllocator());
+            vkDestroySemaphore(device, imageAvailableSemaphores[i], hostAllocator());
+        }
+        if (m_separatePresentQueue) {
+            for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+                vkDestroySemaphore(device, m_presentReadySemaphores[i], hostAllocator());
+            }
+            vkDestroyCommandPool(device, m_presentCommandPool, hostAllocator());
+            m_presentTimeline.cleanup();
+        }
 
-        vkDestroyDevice(device, nullptr);
+        m_parallelRecorder.cleanup();
+        m_asyncCompute.cleanup();
+        vkDestroyCommandPool(device, commandPool, hostAllocator());
+        m_gpuProfiler.cleanup();
+        m_drawCosts.cleanup();
+
+        m_uploadContext.cleanup();
+        m_stagingRing.cleanup();
+        m_deviceGroup.cleanup();
+        m_timeline.cleanup();
+        m_computeMipmaps.cleanup();
+
+        m_allocator.cleanup();  // memory allocator：所有资源销毁后再把block还给驱动
+
+        ImageBarrierBatch::setPipelineBarrier2(nullptr);
+        DeviceDispatch::reset();
+        vkDestroyDevice(device, hostAllocator());
 
         if (enableValidationLayers) {
-            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+            DestroyDebugUtilsMessengerEXT(instance, debugMessenger, hostAllocator());
         }
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
-        vkDestroyInstance(instance, nullptr);
+        vkDestroySurfaceKHR(instance, surface, hostAllocator());  // headless：surface是VK_NULL_HANDLE，不做任何事
+        vkDestroyInstance(instance, hostAllocator());
+        m_validationLog.cleanup();  // validation log：输出剩下的消息和performance warning的报告
+        AssetPack::instance().close();  // asset pack：模型的mesh cache可能指向pack，模型销毁之后再关闭
 
+        if (!hasWindow()) {
+            return;
+        }
         glfwDestroyWindow(window);
 
         glfwTerminate();
@@ -468,22 +2938,94 @@ private:
     
     // swap chain recreation：window surface变化导致swap chain不兼容需要重新创建，比如window大小改变
     // 这里不会重建renderpass，理论上swap chain format可能在应用程序生命周期中变化，比如从sdr变成hdr，就需要重建renderpass
+    // deletion queue：旧swap chain相关资源可能还在被in flight的帧使用，交给deletion queue在这些帧完成后销毁
+    void retireSwapChain() {
+        VkSwapchainKHR oldSwapChain = swapChain;
+        m_fullScreenExclusive.release(oldSwapChain);  // full screen exclusive：新的swap chain创建之后重新获取
+        VkImageView oldDepthImageView = depthImageView;
+        VkImage oldDepthImage = depthImage;
+        Allocation oldDepthImageAllocation = depthImageAllocation;
+        VkImageView oldMsaaColorView = m_msaaColorView;
+        VkImage oldMsaaColorImage = m_msaaColorImage;
+        Allocation oldMsaaColorAllocation = m_msaaColorAllocation;
+        VkImageView oldAlbedoView = m_gbufferAlbedoView;
+        VkImage oldAlbedoImage = m_gbufferAlbedoImage;
+        Allocation oldAlbedoAllocation = m_gbufferAlbedoAllocation;
+        VkImageView oldNormalView = m_gbufferNormalView;
+        VkImage oldNormalImage = m_gbufferNormalImage;
+        Allocation oldNormalAllocation = m_gbufferNormalAllocation;
+        std::vector<VkFramebuffer> oldFramebuffers = swapChainFramebuffers;
+        std::vector<VkImageView> oldImageViews = swapChainImageViews;
+
+        m_deletionQueue.push(m_frameNumber, [=, this]() mutable {
+            vkDestroyImageView(device, oldDepthImageView, hostAllocator());
+            vkDestroyImage(device, oldDepthImage, hostAllocator());
+            m_allocator.free(oldDepthImageAllocation);
+            vkDestroyImageView(device, oldMsaaColorView, hostAllocator());
+            vkDestroyImage(device, oldMsaaColorImage, hostAllocator());
+            m_allocator.free(oldMsaaColorAllocation);
+            vkDestroyImageView(device, oldAlbedoView, hostAllocator());
+            vkDestroyImage(device, oldAlbedoImage, hostAllocator());
+            m_allocator.free(oldAlbedoAllocation);
+            vkDestroyImageView(device, oldNormalView, hostAllocator());
+            vkDestroyImage(device, oldNormalImage, hostAllocator());
+            m_allocator.free(oldNormalAllocation);
+
+            for (auto framebuffer : oldFramebuffers) {
+                vkDestroyFramebuffer(device, framebuffer, hostAllocator());
+            }
+
+            for (auto imageView : oldImageViews) {
+                vkDestroyImageView(device, imageView, hostAllocator());
+            }
+        });
+
+        // swap chain recreation：gpu完成最后一帧之后呈现引擎可能还在显示旧的image，swap chain本身等新swap chain的第一帧提交之后再入队
+        m_retiredSwapChains.push_back(oldSwapChain);
+    }
+
+    // swap chain recreation：drawFrame在新swap chain上提交一帧之后调用，这一帧完成时旧的image已经被新的present替换
+    void retireOldSwapChains(uint64_t timelineValue) {
+        for (VkSwapchainKHR oldSwapChain : m_retiredSwapChains) {
+            m_deletionQueue.push(timelineValue, [this, oldSwapChain]() {
+                vkDestroySwapchainKHR(device, oldSwapChain, hostAllocator());
+            });
+        }
+        m_retiredSwapChains.clear();
+    }
+
     void recreateSwapChain() {
+        m_heapCheckSkipFrame = true;
+        m_swapChainRecreations++;
+        m_resizeCoalescer.clear();  // live resize：之后的大小变化重新计时，这次读取的是当前最新的大小
         int width = 0, height = 0;
-        glfwGetFramebufferSize(window, &width, &height);
+        getFramebufferSize(width, height);
         while (width == 0 || height == 0) {  // 如果window最小化则暂停glfw处理，直到程序到前台再重建swap chain
-            glfwGetFramebufferSize(window, &width, &height);
-            glfwWaitEvents();
+            if (useRenderThread() && m_renderThread.running()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));  // render thread：主线程继续处理事件，等它更新framebuffer大小
+            } else {
+                glfwWaitEvents();
+            }
+            getFramebufferSize(width, height);
         }
 
-        vkDeviceWaitIdle(device);
-
-        cleanupSwapChain();
+        // deletion queue：不再vkDeviceWaitIdle，旧资源延迟销毁，新资源立即创建，in flight的帧继续使用旧资源
+        VkSwapchainKHR oldSwapChain = swapChain;
+        retireSwapChain();
+        m_framePacer.reset();
+        m_inputLatency.reset();
 
-        createSwapChain();  // 重建swap chain。可以把旧的swap chain传给VkSwapchainCreateInfoKHR的oldSwapChain字段避免创建新swap chain之前停止所有渲染
+        createSwapChain(oldSwapChain);  // 重建swap chain，把旧的swap chain传给oldSwapchain字段，呈现引擎可以复用资源并且不需要停止渲染
+        updateRenderExtent();  // dynamic resolution：比例不变，分辨率跟随swap chain
         createImageViews();  // 直接基于swap chain需要重建
         createDepthResources();  // depth buffering：分辨率改变需要重新创建depth
         createFramebuffers();  // 直接基于swap chain需要重建
+        if (m_hiz.initialized()) {
+            resizeHiZPyramid();  // hi-z：pyramid的大小跟随depth
+        }
+        if (m_shadingRate.initialized()) {
+            resizeShadingRateImage();
+        }
     }
 
     void createInstance() {
@@ -516,6 +3058,7 @@ private:
         // 验证层：在instance中开启验证层
         VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo{};
         if (enableValidationLayers) {
+            m_validationLog.init(VALIDATION_MESSAGE_LIMIT, VALIDATION_MESSAGES_PER_SECOND);
             createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
             createInfo.ppEnabledLayerNames = validationLayers.data();
             
@@ -530,7 +3073,8 @@ private:
             createInfo.pNext = nullptr;
         }
 
-        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {  // 可以用string_VkResult打印VkResult
+        PortabilityProfile::configureMoltenVK();  // portability profile：MoltenVK在创建instance时读取配置
+        if (vkCreateInstance(&createInfo, hostAllocator(), &instance) != VK_SUCCESS) {  // 可以用string_VkResult打印VkResult
             throw std::runtime_error("failed to create instance!");
         }
     }
@@ -539,9 +3083,14 @@ private:
     void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo) {
         createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+        if (VALIDATION_VERBOSE) {
+            createInfo.messageSeverity |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+        }
         createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-        createInfo.pfnUserCallback = debugCallback;
+        // validation log：回调只计数和拷贝消息，输出在后台线程上
+        createInfo.pfnUserCallback = ValidationLog::callback;
+        createInfo.pUserData = &m_validationLog;
     }
 
     // 验证层：创建回调message
@@ -552,14 +3101,24 @@ private:
         populateDebugMessengerCreateInfo(createInfo);
 
         // 这里不是vk开头的函数，因为本来需要用vkCreateDebugUtilsMessengerEXT来创建，但是因为是扩展所以需要用vkGetInstanceProcAddr来查找函数地址
-        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
+        if (CreateDebugUtilsMessengerEXT(instance, &createInfo, hostAllocator(), &debugMessenger) != VK_SUCCESS) {
             throw std::runtime_error("failed to set up debug messenger!");
         }
     }
 
     // 窗口表面：创建surface，surface链接了vulkan和window，也就是没有surface vulkan无法渲然到窗口上。glfw函数做了多平台适配
+    // display mode：direct时surface在显示器的plane上，由DirectDisplay选择显示器和mode
     void createSurface() {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
+        if (m_headless) {
+            return;
+        }
+        std::cout << "display mode: " << displayModeName(m_displayMode) << std::endl;
+        if (m_displayMode == DisplayMode::direct) {
+            m_directDisplay.createSurface(instance, hostAllocator(), surface);
+            std::cout << "direct display: " << m_directDisplay.summary() << std::endl;
+            return;
+        }
+        if (glfwCreateWindowSurface(instance, window, hostAllocator(), &surface) != VK_SUCCESS) {
             throw std::runtime_error("failed to create window surface!");
         }
     }
@@ -576,16 +3135,90 @@ private:
         std::vector<VkPhysicalDevice> devices(deviceCount);
         vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());  // 获得所有物理设备
 
-        for (const auto& device : devices) {
-            if (isDeviceSuitable(device)) {  // 检查物理设备是否符合要求
-                physicalDevice = device;
-                break;
+        // device selection：每个设备输出满足要求时的分数或者不满足的原因，override匹配并且满足要求时直接使用
+        const char* environmentOverride = std::getenv(PREFERRED_GPU_ENV);
+        std::string preferred = environmentOverride != nullptr ? environmentOverride : PREFERRED_GPU;
+        VkPhysicalDevice preferredDevice = VK_NULL_HANDLE;
+        uint64_t bestScore = 0;
+        for (uint32_t i = 0; i < deviceCount; i++) {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(devices[i], &properties);
+            const char* rejectReason = deviceRejectReason(devices[i]);  // 检查物理设备是否符合要求
+            if (rejectReason != nullptr) {
+                std::cout << "physical device " << i << ": " << properties.deviceName << " rejected (" << rejectReason << ")" << std::endl;
+                continue;
+            }
+            QueueFamilyIndices indices = findQueueFamilies(devices[i]);
+            DeviceScore score = DeviceSelector::score(devices[i], optionalDeviceExtensions(), indices.transferFamily.has_value(),
+                indices.computeFamily.has_value());
+            std::cout << "physical device " << i << ": " << properties.deviceName << " score " << score.score << " (" << score.detail << ")" << std::endl;
+            if (preferredDevice == VK_NULL_HANDLE && DeviceSelector::matches(devices[i], i, preferred)) {
+                preferredDevice = devices[i];
+            }
+            if (physicalDevice == VK_NULL_HANDLE || score.score > bestScore) {
+                physicalDevice = devices[i];
+                bestScore = score.score;
             }
         }
 
         if (physicalDevice == VK_NULL_HANDLE) {
             throw std::runtime_error("failed to find a suitable GPU!");
         }
+        VkPhysicalDeviceProperties selectedProperties;
+        if (preferredDevice != VK_NULL_HANDLE) {
+            physicalDevice = preferredDevice;
+            vkGetPhysicalDeviceProperties(physicalDevice, &selectedProperties);
+            std::cout << "physical device: " << selectedProperties.deviceName << " selected by override \"" << preferred << "\"" << std::endl;
+        } else {
+            if (!preferred.empty()) {
+                std::cout << "physical device: override \"" << preferred << "\" matched no suitable device" << std::endl;
+            }
+            vkGetPhysicalDeviceProperties(physicalDevice, &selectedProperties);
+            std::cout << "physical device: " << selectedProperties.deviceName << " selected with the highest score" << std::endl;
+        }
+        m_capabilities = DeviceCapabilities::probe(physicalDevice);
+        std::cout << "device capabilities: " << m_capabilities.summary() << std::endl;
+        m_portability = PortabilityProfile::probe(physicalDevice, m_capabilities);
+        std::cout << "portability profile: " << m_portability.summary() << std::endl;
+        // portability profile：顶点输入的stride必须是minVertexInputBindingStrideAlignment的倍数，使用的顶点格式在这里检查一次
+        // split vertex streams：分开时检查位置和属性两个binding各自的stride
+        std::vector<VkVertexInputBindingDescription> vertexBindings;
+        std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+        gpuVertexInput(false, vertexBindings, vertexAttributes);
+        for (const VkVertexInputBindingDescription& binding : vertexBindings) {
+            if (!m_portability.strideSupported(binding.stride)) {
+                throw std::runtime_error("vertex binding stride is not supported by the portability subset!");
+            }
+        }
+        if (AUTO_QUALITY) {
+            m_quality.init(physicalDevice, QUALITY_TARGET_MS, QUALITY_TIER_PATH, !m_benchmark.active());
+            std::cout << "quality tier: " << QualityManager::name(m_quality.tier()) << std::endl;
+        }
+        m_thermalGovernor.init(THERMAL_GOVERNOR && !m_benchmark.active());
+        m_msaaSamples = chooseMsaaSamples();
+
+        // device group：选择的gpu所在的group有多个设备时使用整个group，present queue和图形队列不同时不使用
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+        if (USE_DEVICE_GROUP && EXTRA_VIEW_COUNT == 0 && !m_headless && indices.graphicsFamily == indices.presentFamily && m_deviceGroup.select(instance, physicalDevice)) {
+            std::cout << "device group: " << m_deviceGroup.deviceCount() << " physical devices" << std::endl;
+        }
+    }
+
+    // msaa：framebuffer的color和depth都支持的采样数中不超过MSAA_SAMPLES和quality tier的最大值，dynamic rendering使用相同的限制
+    // deferred shading：G-buffer和光照subpass都是单采样
+    VkSampleCountFlagBits chooseMsaaSamples() {
+        if (DEFERRED_SHADING) {
+            return VK_SAMPLE_COUNT_1_BIT;
+        }
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+        for (uint32_t samples = std::min(MSAA_SAMPLES, m_quality.settings().msaaSamples); samples > 1; samples /= 2) {
+            if (counts & samples) {
+                return static_cast<VkSampleCountFlagBits>(samples);
+            }
+        }
+        return VK_SAMPLE_COUNT_1_BIT;
     }
 
     // 逻辑设备：创建逻辑设备
@@ -598,6 +3231,22 @@ private:
             indices.graphicsFamily.value(),
             indices.presentFamily.value()
         };
+        if (indices.transferFamily.has_value()) {
+            uniqueQueueFamilies.insert(indices.transferFamily.value());
+        }
+        if (indices.computeFamily.has_value()) {
+            uniqueQueueFamilies.insert(indices.computeFamily.value());
+        }
+        // video encode：编码队列只在--encode时创建；device group的每帧在不同的设备上渲染，不编码
+        if (!m_videoEncodePath.empty() && !m_deviceGroup.active() && VideoEncoder::supported(m_capabilities)) {
+            m_videoEncodeFamily = VideoEncoder::findQueueFamily(physicalDevice);
+        }
+        if (!m_videoEncodePath.empty() && !m_videoEncodeFamily.has_value()) {
+            std::cout << "video encode: no H.264 encode queue on this device" << std::endl;
+        }
+        if (m_videoEncodeFamily.has_value()) {
+            uniqueQueueFamilies.insert(m_videoEncodeFamily.value());
+        }
 
         // 0.0到1.0分配队列优先级来影响Command Buffer执行的调用，即使只有一个queue也是必须的
         float queuePriority = 1.0f;
@@ -613,6 +3262,25 @@ private:
         VkPhysicalDeviceFeatures deviceFeatures{};
         deviceFeatures.samplerAnisotropy = VK_TRUE;  // sampler：允许支持各向异性采样，可选操作需要打开
 
+        // ktx2：块压缩格式也是可选feature，打开之后对应格式才会在format properties中报告支持
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+        deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+        deviceFeatures.textureCompressionASTC_LDR = supportedFeatures.textureCompressionASTC_LDR;
+        deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;  // dynamic state：线框模式
+        // pipeline statistics：parallel recording时secondary command buffer在query之内执行，需要inheritedQueries
+        bool pipelineStatisticsSupported = USE_PIPELINE_STATISTICS && supportedFeatures.pipelineStatisticsQuery;
+        bool calibratedTimestampsSupported = GPU_TIMELINE && ENABLE_CPU_PROFILER && m_capabilities.hasExtension(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        deviceFeatures.pipelineStatisticsQuery = pipelineStatisticsSupported;
+        deviceFeatures.inheritedQueries = pipelineStatisticsSupported && supportedFeatures.inheritedQueries;
+        m_inheritedQueries = deviceFeatures.inheritedQueries;
+        deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;  // multi draw indirect：一条命令多个draw
+        m_multiDrawIndirectSupported = MULTI_DRAW_INDIRECT && supportedFeatures.multiDrawIndirect;
+        // sparse binding：部分绑定的buffer需要sparseResidencyBuffer；device group的绑定需要指定每个设备，这里不处理
+        m_sparseGeometrySupported = SPARSE_GEOMETRY && supportedFeatures.sparseBinding && supportedFeatures.sparseResidencyBuffer && !m_deviceGroup.active();
+        deviceFeatures.sparseBinding = m_sparseGeometrySupported;
+        deviceFeatures.sparseResidencyBuffer = m_sparseGeometrySupported;
+
         // device的创建信息
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -622,35 +3290,460 @@ private:
 
         createInfo.pEnabledFeatures = &deviceFeatures;
 
-        // swapchain：开启swapchain拓展，如果是mac也需要mac拓展
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        // bindless：descriptor indexing的feature通过pNext传入，isDeviceSuitable已经检查过支持
+        VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures = bindlessFeatures();
+        createInfo.pNext = &indexingFeatures;
+
+        // meshlet：mesh shader是可选的，只开启task shader和mesh shader，不支持时所有mesh使用vkCmdDrawIndexed
+        m_meshShaderSupported = USE_MESH_SHADERS && m_capabilities.meshShader;
+        VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+        meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        meshShaderFeatures.taskShader = VK_TRUE;
+        meshShaderFeatures.meshShader = VK_TRUE;
+        if (m_meshShaderSupported) {
+            indexingFeatures.pNext = &meshShaderFeatures;
+        }
 
-        // 之前device和instance的validation layer设置是分开的，但是现在基本只用instance，这里是为了兼容
-        if (enableValidationLayers) {
-            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
-            createInfo.ppEnabledLayerNames = validationLayers.data();
-        } else {
-            createInfo.enabledLayerCount = 0;
+        // pipeline library：同样是可选的，不支持时pipeline完整编译
+        m_pipelineLibrarySupported = USE_PIPELINE_LIBRARY && m_capabilities.hasExtension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)
+            && m_capabilities.hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) && GraphicsPipelineLibrary::supported(physicalDevice);
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipelineLibraryFeatures{};
+        pipelineLibraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        pipelineLibraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+        if (m_pipelineLibrarySupported) {
+            pipelineLibraryFeatures.pNext = &indexingFeatures;
+            createInfo.pNext = &pipelineLibraryFeatures;
         }
 
-        // 创建device，这里不需要instance参与创建
-        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create logical device!");
+        // dynamic rendering：可选，不支持时使用render pass和framebuffer，feature放在pNext链的最前面
+        // deferred shading：G-buffer在subpass之间传递，需要render pass
+        m_dynamicRenderingSupported = USE_DYNAMIC_RENDERING && !DEFERRED_SHADING && m_capabilities.dynamicRendering;
+        VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures{};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+        if (m_dynamicRenderingSupported) {
+            dynamicRenderingFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &dynamicRenderingFeatures;
         }
 
-        // 创建queue
-        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);  // 窗口表面：创建queue
-    }
+        // dynamic state：1.3中extended dynamic state的命令是core，不需要feature；更早的设备开启扩展的feature
+        bool extendedDynamicStateExtension = m_capabilities.hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+        bool extendedDynamicStateSupported = USE_EXTENDED_DYNAMIC_STATE && DynamicStateCommands::supported(physicalDevice, extendedDynamicStateExtension);
+        VkPhysicalDeviceProperties deviceProperties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+        extendedDynamicStateExtension = extendedDynamicStateSupported && extendedDynamicStateExtension && deviceProperties.apiVersion < VK_API_VERSION_1_3;
+        VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures{};
+        extendedDynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+        extendedDynamicStateFeatures.extendedDynamicState = VK_TRUE;
+        if (extendedDynamicStateExtension) {
+            extendedDynamicStateFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &extendedDynamicStateFeatures;
+        }
+        bool dynamicPolygonMode = extendedDynamicStateSupported && m_capabilities.hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)
+            && DynamicStateCommands::polygonModeSupported(physicalDevice);
+        VkPhysicalDeviceExtendedDynamicState3FeaturesEXT extendedDynamicState3Features{};
+        extendedDynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+        extendedDynamicState3Features.extendedDynamicState3PolygonMode = VK_TRUE;
+        if (dynamicPolygonMode) {
+            extendedDynamicState3Features.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &extendedDynamicState3Features;
+        }
+
+        // shader object：所有状态都是动态的，RasterState仍然由DynamicStateCommands设置，所以也要求extended dynamic state
+        bool shaderObjectSupported = USE_SHADER_OBJECTS && m_dynamicRenderingSupported && extendedDynamicStateSupported
+            && m_capabilities.hasExtension(VK_EXT_SHADER_OBJECT_EXTENSION_NAME) && ShaderObjectBackend::supported(physicalDevice);
+        VkPhysicalDeviceShaderObjectFeaturesEXT shaderObjectFeatures{};
+        shaderObjectFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+        shaderObjectFeatures.shaderObject = VK_TRUE;
+        if (shaderObjectSupported) {
+            shaderObjectFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &shaderObjectFeatures;
+        }
+        m_wireframeSupported = (dynamicPolygonMode || shaderObjectSupported) && supportedFeatures.fillModeNonSolid;
+
+        // variable rate shading：per-draw的rate通过dynamic state设置，需要extended dynamic state；rate image还需要render graph读取depth
+        // combiner不支持MAX时rate image直接替换per-draw的rate
+        bool shadingRateExtension = m_capabilities.hasExtension(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+        if (VARIABLE_RATE_SHADING) {
+            m_shadingRateSupport = ShadingRateImage::query(instance, physicalDevice, m_msaaSamples, shadingRateExtension);
+        }
+        m_shadingRateSupport.pipeline = m_shadingRateSupport.pipeline && extendedDynamicStateSupported;
+        m_shadingRateAttachmentSupported = m_shadingRateSupport.attachment && m_dynamicRenderingSupported && m_msaaSamples == VK_SAMPLE_COUNT_1_BIT
+            && supportsDepthSampling();
+        m_shadingRateCombiner = m_shadingRateSupport.nonTrivialCombinerOps ? VK_FRAGMENT_SHADING_RATE_COMBINER_OP_MAX_KHR : VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR;
+        deviceFeatures.shaderStorageImageExtendedFormats = m_shadingRateAttachmentSupported;  // r8ui的rate image
+        VkPhysicalDeviceFragmentShadingRateFeaturesKHR shadingRateFeatures{};
+        shadingRateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+        shadingRateFeatures.pipelineFragmentShadingRate = m_shadingRateSupport.pipeline;
+        shadingRateFeatures.attachmentFragmentShadingRate = m_shadingRateAttachmentSupported;
+        bool shadingRateEnabled = m_shadingRateSupport.pipeline || m_shadingRateAttachmentSupported;
+        if (shadingRateEnabled) {
+            shadingRateFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &shadingRateFeatures;
+        }
+
+        // multi draw indirect：顶点着色器使用gl_DrawID，isDeviceSuitable已经检查过支持
+        VkPhysicalDeviceShaderDrawParametersFeatures drawParametersFeatures{};
+        drawParametersFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_DRAW_PARAMETERS_FEATURES;
+        drawParametersFeatures.shaderDrawParameters = VK_TRUE;
+        drawParametersFeatures.pNext = const_cast<void*>(createInfo.pNext);
+        createInfo.pNext = &drawParametersFeatures;
+
+        // descriptor buffer：buffer中的ubo和storage buffer descriptor使用device address，同时开启bufferDeviceAddress
+        // device group：多个设备时device address需要bufferDeviceAddressMultiDevice，这里直接不使用descriptor buffer
+        // multiple views：view的ubo只通过dynamic offset选择，descriptor buffer中每帧只有主窗口的descriptor
+        bool descriptorBufferSupported = USE_DESCRIPTOR_BUFFER && !m_deviceGroup.active() && EXTRA_VIEW_COUNT == 0 && m_capabilities.hasExtension(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)
+            && DescriptorBuffer::supported(physicalDevice);
+        VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{};
+        descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+        descriptorBufferFeatures.descriptorBuffer = VK_TRUE;
+        VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddressFeatures{};
+        bufferDeviceAddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+        bufferDeviceAddressFeatures.bufferDeviceAddress = VK_TRUE;
+        if (descriptorBufferSupported) {
+            bufferDeviceAddressFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            descriptorBufferFeatures.pNext = &bufferDeviceAddressFeatures;
+            createInfo.pNext = &descriptorBufferFeatures;
+        }
+
+        // ray traced shadows：BLAS的输入和TLAS的实例使用device address，和descriptor buffer共用bufferDeviceAddress
+        // device group：和descriptor buffer一样需要bufferDeviceAddressMultiDevice，多个设备时使用shadow map
+        m_rayTracedShadowsSupported = RAY_TRACED_SHADOWS && !m_deviceGroup.active() && !DEFERRED_SHADING
+            && m_capabilities.hasExtension(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME) && m_capabilities.hasExtension(VK_KHR_RAY_QUERY_EXTENSION_NAME)
+            && m_capabilities.hasExtension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME) && AccelerationStructures::supported(physicalDevice);
+        VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{};
+        accelerationStructureFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR;
+        accelerationStructureFeatures.accelerationStructure = VK_TRUE;
+        VkPhysicalDeviceRayQueryFeaturesKHR rayQueryFeatures{};
+        rayQueryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+        rayQueryFeatures.rayQuery = VK_TRUE;
+        rayQueryFeatures.pNext = &accelerationStructureFeatures;
+        if (m_rayTracedShadowsSupported) {
+            accelerationStructureFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            if (!descriptorBufferSupported) {
+                bufferDeviceAddressFeatures.pNext = accelerationStructureFeatures.pNext;
+                accelerationStructureFeatures.pNext = &bufferDeviceAddressFeatures;
+            }
+            createInfo.pNext = &rayQueryFeatures;
+        }
+
+        // frame pacing：present id和present wait两个扩展都需要
+        bool presentPacingSupported = USE_PRESENT_PACING && !m_headless && m_capabilities.hasExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME)
+            && m_capabilities.hasExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME) && FramePacer::supported(physicalDevice);
+        VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+        presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+        presentIdFeatures.presentId = VK_TRUE;
+        VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+        presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+        presentWaitFeatures.presentWait = VK_TRUE;
+        if (presentPacingSupported) {
+            presentWaitFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            presentIdFeatures.pNext = &presentWaitFeatures;
+            createInfo.pNext = &presentIdFeatures;
+        }
+
+        // host image copy：扩展依赖copy_commands2和format_feature_flags2，这里只在它们是core的1.3设备上使用
+        // device group：host写入只到达一个设备的image实例，不使用
+        bool hostImageCopySupported = HOST_IMAGE_COPY && !m_deviceGroup.active() && m_capabilities.apiVersion >= VK_API_VERSION_1_3
+            && m_capabilities.hasExtension(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME) && HostImageCopy::supported(physicalDevice);
+        VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures{};
+        hostImageCopyFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+        hostImageCopyFeatures.hostImageCopy = VK_TRUE;
+        if (hostImageCopySupported) {
+            hostImageCopyFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &hostImageCopyFeatures;
+        }
+
+        // half precision：1.2之前shaderFloat16来自VK_KHR_shader_float16_int8，1.2开始是core，feature结构相同
+        m_shaderFloat16Supported = HALF_PRECISION_SHADERS && m_capabilities.shaderFloat16;
+        VkPhysicalDeviceShaderFloat16Int8Features float16Features{};
+        float16Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES;
+        float16Features.shaderFloat16 = VK_TRUE;
+        if (m_shaderFloat16Supported) {
+            float16Features.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &float16Features;
+        }
+
+        // shader statistics：只是诊断用的扩展，请求时才启用
+        bool shaderStatisticsSupported = m_shaderStatisticsRequested && m_capabilities.hasExtension(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME)
+            && ShaderStatistics::supported(physicalDevice);
+        VkPhysicalDevicePipelineExecutablePropertiesFeaturesKHR shaderStatisticsFeatures{};
+        shaderStatisticsFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_EXECUTABLE_PROPERTIES_FEATURES_KHR;
+        shaderStatisticsFeatures.pipelineExecutableInfo = VK_TRUE;
+        if (shaderStatisticsSupported) {
+            shaderStatisticsFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &shaderStatisticsFeatures;
+        } else if (m_shaderStatisticsRequested) {
+            std::cerr << "shader statistics: VK_KHR_pipeline_executable_properties is not supported" << std::endl;
+        }
+
+        // live resize：present scaling需要VK_EXT_swapchain_maintenance1，instance启用了surface maintenance才能查询支持的scaling
+        m_presentScalingSupported = LIVE_RESIZE && m_surfaceMaintenanceSupported
+            && m_capabilities.hasExtension(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME) && ResizeCoalescer::scalingSupported(physicalDevice);
+        VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchainMaintenanceFeatures{};
+        swapchainMaintenanceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+        swapchainMaintenanceFeatures.swapchainMaintenance1 = VK_TRUE;
+        if (m_presentScalingSupported) {
+            swapchainMaintenanceFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &swapchainMaintenanceFeatures;
+        }
+
+        // occlusion queries：每个设备的query结果不同，device group时不使用；deferred shading的G-buffer pass没有包围盒的pipeline
+        m_conditionalRenderingSupported = OCCLUSION_QUERIES && !DEFERRED_SHADING && !m_deviceGroup.active()
+            && m_capabilities.hasExtension(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME) && OcclusionQueries::supported(physicalDevice);
+        VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures{};
+        conditionalRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+        conditionalRenderingFeatures.conditionalRendering = VK_TRUE;
+        if (m_conditionalRenderingSupported) {
+            conditionalRenderingFeatures.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &conditionalRenderingFeatures;
+        }
+
+        // timeline semaphore：isDeviceSuitable已经检查过支持
+        VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+        timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timelineFeatures.timelineSemaphore = VK_TRUE;
+        timelineFeatures.pNext = const_cast<void*>(createInfo.pNext);
+        createInfo.pNext = &timelineFeatures;
+
+        // synchronization2：可选，支持时image barrier保留每个barrier自己的stage，见ImageBarrierBatch
+        VkPhysicalDeviceSynchronization2Features synchronization2Features{};
+        synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+        synchronization2Features.synchronization2 = VK_TRUE;
+        if (m_capabilities.synchronization2) {
+            synchronization2Features.pNext = const_cast<void*>(createInfo.pNext);
+            createInfo.pNext = &synchronization2Features;
+        }
+
+        // portability profile：设备暴露VK_KHR_portability_subset时必须开启，查询到的subset feature原样传入
+        void* portabilityFeatures = m_portability.featureChain();
+        if (portabilityFeatures != nullptr) {
+            static_cast<VkBaseOutStructure*>(portabilityFeatures)->pNext = static_cast<VkBaseOutStructure*>(const_cast<void*>(createInfo.pNext));
+            createInfo.pNext = portabilityFeatures;
+        }
+
+        // swapchain：开启swapchain拓展
+        // memory budget：VK_EXT_memory_budget是可选扩展，支持时才开启
+        std::vector<const char*> enabledExtensions = requiredDeviceExtensions();
+        if (m_portability.active) {
+            enabledExtensions.push_back("VK_KHR_portability_subset");
+        }
+        // display mode：fullscreen时设备支持就由应用控制独占
+        bool fullScreenExclusiveSupported = m_displayMode == DisplayMode::fullscreen && !m_headless
+            && FullScreenExclusive::supported(m_capabilities, m_surfaceCapabilities2);
+        if (fullScreenExclusiveSupported) {
+            enabledExtensions.push_back("VK_EXT_full_screen_exclusive");
+        }
+        bool memoryBudgetSupported = m_capabilities.memoryBudget;
+        if (memoryBudgetSupported) {
+            enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+        // bindless：vulkan 1.2之前的设备通过扩展提供descriptor indexing
+        if (m_capabilities.descriptorIndexingExtension) {
+            enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        }
+        // timeline semaphore：vulkan 1.2之前的设备通过扩展提供
+        if (m_capabilities.timelineSemaphoreExtension) {
+            enabledExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        }
+        // synchronization2：vulkan 1.3之前的设备通过扩展提供
+        if (m_capabilities.synchronization2 && m_capabilities.synchronization2Extension) {
+            enabledExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        }
+        if (m_meshShaderSupported) {
+            enabledExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+        }
+        if (m_pipelineLibrarySupported) {
+            enabledExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+        }
+        // dynamic rendering：1.3之前的设备通过扩展提供
+        if (m_dynamicRenderingSupported && m_capabilities.dynamicRenderingExtension) {
+            enabledExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+        }
+        if (extendedDynamicStateExtension) {
+            enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+        }
+        if (dynamicPolygonMode) {
+            enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+        }
+        if (shaderObjectSupported) {
+            enabledExtensions.push_back(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
+        }
+        if (descriptorBufferSupported) {
+            enabledExtensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+        }
+        // ray traced shadows：acceleration structure扩展依赖deferred host operations，即使只在设备上build
+        if (m_rayTracedShadowsSupported) {
+            enabledExtensions.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+        }
+        // variable rate shading：扩展依赖VK_KHR_create_renderpass2，1.2的设备是core
+        if (shadingRateEnabled) {
+            enabledExtensions.push_back(VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME);
+            if (m_capabilities.hasExtension(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME)) {
+                enabledExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+            }
+        }
+        // gpu culling：vulkan 1.2的drawIndirectCount需要Vulkan12Features，这里和其它功能一样使用扩展
+        m_drawIndirectCountSupported = GPU_CULLING && m_capabilities.hasExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        if (m_drawIndirectCountSupported) {
+            enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+        if (presentPacingSupported) {
+            enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        }
+        if (m_presentScalingSupported) {
+            enabledExtensions.push_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+        }
+        if (hostImageCopySupported) {
+            enabledExtensions.push_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+        }
+        if (m_shaderFloat16Supported && m_capabilities.shaderFloat16Extension) {
+            enabledExtensions.push_back(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
+        }
+        if (shaderStatisticsSupported) {
+            enabledExtensions.push_back(VK_KHR_PIPELINE_EXECUTABLE_PROPERTIES_EXTENSION_NAME);
+        }
+        if (m_conditionalRenderingSupported) {
+            enabledExtensions.push_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+        }
+        if (calibratedTimestampsSupported) {
+            enabledExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+        }
+        if (m_videoEncodeFamily.has_value()) {
+            for (const char* extension : VideoEncoder::extensions()) {
+                enabledExtensions.push_back(extension);
+            }
+        }
+
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+        createInfo.ppEnabledExtensionNames = enabledExtensions.data();
+
+        // 之前device和instance的validation layer设置是分开的，但是现在基本只用instance，这里是为了兼容
+        if (enableValidationLayers) {
+            createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
+            createInfo.ppEnabledLayerNames = validationLayers.data();
+        } else {
+            createInfo.enabledLayerCount = 0;
+        }
+
+        // 创建device，这里不需要instance参与创建
+        m_deviceGroup.chainDeviceCreateInfo(createInfo);
+        if (vkCreateDevice(physicalDevice, &createInfo, hostAllocator(), &device) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create logical device!");
+        }
+        if (fullScreenExclusiveSupported) {
+            m_fullScreenExclusive.init(device, window);
+        }
+        DeviceDispatch::load(device);  // device dispatch：之后每帧的录制和提交直接调用driver的函数
+        m_deviceGroup.init(device);
+        if (m_capabilities.synchronization2) {
+            ImageBarrierBatch::setPipelineBarrier2((PFN_vkCmdPipelineBarrier2) vkGetDeviceProcAddr(device,
+                m_capabilities.synchronization2Extension ? "vkCmdPipelineBarrier2KHR" : "vkCmdPipelineBarrier2"));
+        }
+        if (m_deviceGroup.active()) {
+            std::cout << "device group: alternate frame rendering on " << m_deviceGroup.frameDeviceCount() << " of " << m_deviceGroup.deviceCount() << " devices, "
+                << (m_deviceGroup.remotePresent() ? "remote" : "local") << " present" << std::endl;
+        }
+
+        // 创建queue
+        vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
+        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);  // 窗口表面：创建queue
+        m_graphicsFamily = indices.graphicsFamily.value();
+        m_presentFamily = indices.presentFamily.value();
+        m_separatePresentQueue = m_graphicsFamily != m_presentFamily;
+        m_hdrColorFormat = findHdrColorFormat();
+        if (indices.transferFamily.has_value()) {
+            vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue);
+        } else {
+            transferQueue = graphicsQueue;
+        }
+        if (indices.computeFamily.has_value()) {
+            vkGetDeviceQueue(device, indices.computeFamily.value(), 0, &computeQueue);
+        } else {
+            computeQueue = graphicsQueue;
+        }
+        if (m_videoEncodeFamily.has_value()) {
+            vkGetDeviceQueue(device, m_videoEncodeFamily.value(), 0, &m_videoEncodeQueue);
+        }
+
+        // meshlet：扩展函数需要通过vkGetDeviceProcAddr查询
+        if (m_meshShaderSupported) {
+            m_vkCmdDrawMeshTasksEXT = (PFN_vkCmdDrawMeshTasksEXT) vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT");
+            m_meshShaderSupported = m_vkCmdDrawMeshTasksEXT != nullptr;
+        }
+        // dynamic rendering：1.3的设备返回core函数，否则返回扩展的KHR函数
+        if (m_dynamicRenderingSupported) {
+            m_vkCmdBeginRendering = (PFN_vkCmdBeginRendering) vkGetDeviceProcAddr(device, "vkCmdBeginRendering");
+            m_vkCmdEndRendering = (PFN_vkCmdEndRendering) vkGetDeviceProcAddr(device, "vkCmdEndRendering");
+            if (m_vkCmdBeginRendering == nullptr || m_vkCmdEndRendering == nullptr) {
+                m_vkCmdBeginRendering = (PFN_vkCmdBeginRendering) vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR");
+                m_vkCmdEndRendering = (PFN_vkCmdEndRendering) vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR");
+            }
+            if (m_vkCmdBeginRendering == nullptr || m_vkCmdEndRendering == nullptr) {
+                throw std::runtime_error("failed to load dynamic rendering functions!");
+            }
+        }
+        // dynamic state：需要在提交pipeline编译之前初始化，pipeline的dynamic state取决于支持情况
+        // shader object：扩展本身提供vkCmdSetPolygonModeEXT
+        if (extendedDynamicStateSupported) {
+            m_dynamicStates.init(device, dynamicPolygonMode || shaderObjectSupported);
+            if (m_shadingRateSupport.pipeline) {
+                m_dynamicStates.enableShadingRate(device);  // variable rate shading：per-draw的rate
+            }
+        }
+        if (shaderObjectSupported) {
+            m_shaderObjects.init(device, m_meshShaderSupported, m_shadingRateAttachmentSupported ? VK_SHADER_CREATE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_EXT : 0);
+        }
+
+        m_allocator.init(physicalDevice, device, memoryBudgetSupported, descriptorBufferSupported || m_rayTracedShadowsSupported);
+        m_gpuProfiler.init(physicalDevice, device, indices.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT, pipelineStatisticsSupported);
+        if (calibratedTimestampsSupported) {
+            m_gpuProfiler.enableCalibration(instance, physicalDevice);
+        }
+        if (m_drawCostsRequested) {
+            m_drawCosts.init(physicalDevice, device, indices.graphicsFamily.value(), MAX_FRAMES_IN_FLIGHT);
+        }
+        m_renderGraph.init(device, &m_allocator, [this](std::function<void()> destroy) {
+            m_deletionQueue.push(m_frameNumber, std::move(destroy));  // render graph：重新分配时in flight的帧可能还在使用旧的transient image
+        }, m_allocator.hasMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT));
+        if (presentPacingSupported) {
+            m_framePacer.init(device);
+        }
+        if (hostImageCopySupported) {
+            m_hostImageCopy.init(device, physicalDevice);
+        }
+        if (shaderStatisticsSupported) {
+            m_shaderStatistics.init(device);
+        }
+        m_inputLatency.init(m_framePacer.initialized());
+        if (descriptorBufferSupported) {
+            m_descriptorBuffer.init(physicalDevice, device, m_allocator, DESCRIPTOR_BUFFER_SIZE);
+        }
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_samplerCache.init(device, properties.limits.maxSamplerAllocationCount, m_portability.samplerMipLodBias);  // sampler cache：超过设备上限时报错
+        m_pipelineCache.init(physicalDevice, device, PIPELINE_CACHE_PATH);
+        m_pipelineLibrary.init(device, m_pipelineCache.handle(), (descriptorBufferSupported ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0)
+            | (m_shadingRateAttachmentSupported ? VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR : 0));
+    }
 
     // swapchain：创建swapchain
-    void createSwapChain() {
+    void createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE) {
+        m_swapChainCapturable = m_headless;  // headless：离屏image总是可以作为拷贝的源
+        if (m_headless) {
+            createOffscreenTargets();
+            return;
+        }
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
         
         // 获取最佳配置
         VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
-        VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+        VkPresentModeKHR presentMode = choosePresentMode(m_presentPolicy, swapChainSupport.presentModes);  // present policy：按当前策略选择
         VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
         // 如果坚持最小image数量可能发生必须等待驱动完成操作才能获取另一个图像进行渲染，所以这里多请求一个图像。同时不超过最大值
@@ -669,30 +3762,38 @@ private:
         createInfo.imageExtent = extent;
         createInfo.imageArrayLayers = 1;  // 指定每个image包含的层数，这里用一层
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;  // 指定对图像进行的操作，这里是让渲染的图像转移到swapchain image上
+        // frame capture：截图从swap chain image拷贝，surface不支持TRANSFER_SRC时不截图
+        if (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) {
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            m_swapChainCapturable = true;
+        }
 
         // 处理跨越多个queuefamily使用image
-        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
-        uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
-
-        if (indices.graphicsFamily != indices.presentFamily) {  // 如果队列簇不同，一个image一次由一个queue拥有，另一个queue使用之前需明确转移所有权
-            createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-            createInfo.queueFamilyIndexCount = 2;
-            createInfo.pQueueFamilyIndices = queueFamilyIndices;
-        } else {  // 图像可以在多个queue中使用不需要转移所有权
-            createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        }
+        // present queue：之前队列簇不同时使用CONCURRENT，每次访问image都可能更慢（比如不能压缩）
+        // 现在总是EXCLUSIVE，队列簇不同时图形队列在帧末尾release，呈现队列acquire之后再present，见recordPresentAcquire
+        createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
         createInfo.preTransform = swapChainSupport.capabilities.currentTransform;  // 指定图像变换，比如旋转90度
         createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;  // 指定是否应该用alpha通道与其它window混合
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;  // 开启表示不关心被遮挡的像素颜色，比如被其它窗口遮挡
 
-        createInfo.oldSwapchain = VK_NULL_HANDLE;  // swapchain在程序中可能被无效化，比如窗口大小改变需要重新创建，必须在这里指定对旧swapchain引用，这里暂时不需要
+        createInfo.oldSwapchain = oldSwapChain;  // swapchain在程序中可能被无效化，比如窗口大小改变需要重新创建，必须在这里指定对旧swapchain引用
+
+        // live resize：拖动窗口时在重建之前继续present旧的image，由呈现引擎缩放到新的窗口大小，不显示拉伸或者未定义的区域
+        VkSwapchainPresentScalingCreateInfoEXT scalingInfo{};
+        if (m_presentScalingSupported && ResizeCoalescer::chooseScaling(instance, physicalDevice, surface, presentMode, scalingInfo)) {
+            scalingInfo.pNext = createInfo.pNext;
+            createInfo.pNext = &scalingInfo;
+        }
 
         // 创建swapchain
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+        m_deviceGroup.chainSwapchainCreateInfo(createInfo);
+        m_fullScreenExclusive.chainSwapchainCreateInfo(createInfo);
+        if (vkCreateSwapchainKHR(device, &createInfo, hostAllocator(), &swapChain) != VK_SUCCESS) {
             throw std::runtime_error("failed to create swap chain!");
         }
+        m_fullScreenExclusive.acquire(swapChain);
 
         // 创建image
         vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
@@ -704,33 +3805,71 @@ private:
         swapChainExtent = extent;
     }
 
+    // headless：代替swap chain image，每个frame in flight一个，drawFrame用currentFrame作为imageIndex
+    // 格式和窗口模式一般选到的surface格式相同，pipeline、render pass和command cache都不需要区分两种模式
+    void createOffscreenTargets() {
+        swapChain = VK_NULL_HANDLE;
+        swapChainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+        swapChainExtent = {WIDTH, HEIGHT};
+        swapChainImages.resize(MAX_FRAMES_IN_FLIGHT);
+        m_offscreenAllocations.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            createImage(WIDTH, HEIGHT, 1, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], m_offscreenAllocations[i], MemoryCategory::attachment, "offscreen target");
+        }
+    }
+
+    // headless：color target在帧末尾的layout，离屏image准备读回，swap chain image准备present
+    VkImageLayout colorTargetFinalLayout() const {
+        return m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    }
+
     // imageview: view描述了如何访问图像以及哪一部分，这里为每个swapchain image创建view，创建后图像可作为color target
     void createImageViews() {
         swapChainImageViews.resize(swapChainImages.size());
 
         for (size_t i = 0; i < swapChainImages.size(); i++) {
-            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+            swapChainImageViews[i] = createImageView(swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
         }
     }
 
     // renderpass：在pipeline之前创建
+    // dynamic rendering：attachment的格式改为在pipeline创建时通过VkPipelineRenderingCreateInfo指定，layout转换由recordCommandBuffer中的barrier完成
     void createRenderPass() {
+        if (m_dynamicRenderingSupported) {
+            return;
+        }
+        if (DEFERRED_SHADING) {
+            createDeferredRenderPass();
+            return;
+        }
+
         // attachment
         VkAttachmentDescription colorAttachment{};
         colorAttachment.format = swapChainImageFormat;  // 与swapchain image一致
-        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;  // 没有开启抗锯齿所以是1
+        colorAttachment.samples = m_msaaSamples;  // msaa：多重采样时这是transient的attachment，resolve到下面的resolveAttachment
         colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;  // 渲染前处理attachment，适用于color和depth。这里做清除
         colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;  // 渲染后处理attachment，适用于color和depth。这里将内容存储在内存中
         colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;  // 适用于stencil
         colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // 适用于stencil
         // layout问题：cpu往往线性读写图像，而gpu适合tile的方式读写图像，需要不同布局
         colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;  // 指定渲染前图像的布局。这里是不关心布局，也意味着图像会被清除
-        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;  // 指定renderpass完成后转换的布局，这里是在swapchain用于展示
+        colorAttachment.finalLayout = colorTargetFinalLayout();  // 指定renderpass完成后转换的布局，这里是在swapchain用于展示，headless时用于读回
+
+        // msaa：多重采样的color在subpass结束时resolve到swap chain image，之后不再需要，不写回内存
+        bool msaa = m_msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+        VkAttachmentDescription resolveAttachment = colorAttachment;
+        resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;  // resolve覆盖全部像素
+        if (msaa) {
+            colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        }
 
         // depth buffering：创建depth attchment
         VkAttachmentDescription depthAttachment{};
         depthAttachment.format = findDepthFormat();
-        depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        depthAttachment.samples = m_msaaSamples;
         depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
         depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;  // 渲染之后深度数据不需要所以不关心存储
         depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -754,6 +3893,14 @@ private:
         subpass.pColorAttachments = &colorAttachmentRef;  // fs结果写入这个attachment
         subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
+        // msaa：resolve attachment和color attachment一一对应
+        VkAttachmentReference resolveAttachmentRef{};
+        resolveAttachmentRef.attachment = 2;
+        resolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        if (msaa) {
+            subpass.pResolveAttachments = &resolveAttachmentRef;
+        }
+
 
         // rendering：设置subpass依赖关系，用于自动处理图像布局转换
         // 现在有一个subpass但是这之前和之后的操作算作隐式subpass
@@ -770,10 +3917,10 @@ private:
         dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;  // 需要颜色写入时并且在阶段内进行等待
 
         // renderpass
-        std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
+        std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, resolveAttachment};
         VkRenderPassCreateInfo renderPassInfo{};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.attachmentCount = msaa ? 3 : 2;
         renderPassInfo.pAttachments = attachments.data();
         renderPassInfo.subpassCount = 1;
         renderPassInfo.pSubpasses = &subpass;
@@ -781,125 +3928,401 @@ private:
         renderPassInfo.dependencyCount = 1;
         renderPassInfo.pDependencies = &dependency;
 
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+        if (vkCreateRenderPass(device, &renderPassInfo, hostAllocator(), &renderPass) != VK_SUCCESS) {
             throw std::runtime_error("failed to create render pass!");
         }
     }
 
+    // deferred shading：attachment 0是swap chain image，1是depth，2和3是G-buffer的albedo和法线
+    // subpass 0写入G-buffer和depth，subpass 1把G-buffer作为input attachment读取并写入swap chain image
+    // G-buffer和depth的storeOp都是DONT_CARE，subpass 0到1的依赖是BY_REGION，每个tile的光照只依赖这个tile的G-buffer
+    void createDeferredRenderPass() {
+        std::array<VkAttachmentDescription, 4> attachments{};
+        VkAttachmentDescription& colorAttachment = attachments[0];
+        colorAttachment.format = swapChainImageFormat;
+        colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;  // 光照subpass覆盖全部像素
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        colorAttachment.finalLayout = colorTargetFinalLayout();
+
+        VkAttachmentDescription& depthAttachment = attachments[1];
+        depthAttachment = colorAttachment;
+        depthAttachment.format = findDepthFormat();
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+        // G-buffer清除为0，光照subpass用albedo的alpha区分没有几何的像素
+        VkFormat gbufferFormats[2] = {DeferredLighting::ALBEDO_FORMAT, DeferredLighting::NORMAL_FORMAT};
+        for (uint32_t i = 0; i < 2; i++) {
+            VkAttachmentDescription& gbufferAttachment = attachments[2 + i];
+            gbufferAttachment = depthAttachment;
+            gbufferAttachment.format = gbufferFormats[i];
+            gbufferAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;  // subpass 1中的layout，之后不再使用
+        }
+
+        std::array<VkAttachmentReference, 2> gbufferWriteRefs = {{{2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}, {3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}}};
+        std::array<VkAttachmentReference, 2> gbufferReadRefs = {{{2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}, {3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}}};
+        VkAttachmentReference depthAttachmentRef{1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+        VkAttachmentReference colorAttachmentRef{0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+        // input_attachment_index对应pInputAttachments的下标，gbuffer.frag的location对应pColorAttachments的下标
+        std::array<VkSubpassDescription, 2> subpasses{};
+        subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpasses[0].colorAttachmentCount = static_cast<uint32_t>(gbufferWriteRefs.size());
+        subpasses[0].pColorAttachments = gbufferWriteRefs.data();
+        subpasses[0].pDepthStencilAttachment = &depthAttachmentRef;
+        subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpasses[1].inputAttachmentCount = static_cast<uint32_t>(gbufferReadRefs.size());
+        subpasses[1].pInputAttachments = gbufferReadRefs.data();
+        subpasses[1].colorAttachmentCount = 1;
+        subpasses[1].pColorAttachments = &colorAttachmentRef;
+
+        // 0：depth的clear和G-buffer的写入，和forward的依赖相同
+        // 1：swap chain image第一次在subpass 1中使用，layout转换要等imageAvailableSemaphore的stage
+        // 2：subpass 0的G-buffer写入在同一像素的input attachment读取之前完成
+        std::array<VkSubpassDependency, 3> dependencies{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].dstSubpass = 1;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcAccessMask = 0;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[2].srcSubpass = 0;
+        dependencies[2].dstSubpass = 1;
+        dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+        dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;  // tile based gpu不需要等整个G-buffer写完
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+        renderPassInfo.pSubpasses = subpasses.data();
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+
+        if (vkCreateRenderPass(device, &renderPassInfo, hostAllocator(), &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create deferred render pass!");
+        }
+    }
+
     // descriptor set layout：提供pipeline创建的shader中每个descriptor binding的所有细节，类似于设置顶点属性和顶点索引
     void createDescriptorSetLayout() {
         VkDescriptorSetLayoutBinding uboLayoutBinding{};
         uboLayoutBinding.binding = 0;  // shader使用的binding
         uboLayoutBinding.descriptorCount = 1;  // 如果是数组那么指定数组的数量，比如骨骼动画中每个bone有单独的变换可以设置成变换的数组
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;  // descriptor是一个ubo
+        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;  // uniform ring：dynamic ubo，绑定时通过dynamic offset选择slice
+        if (m_descriptorBuffer.initialized()) {
+            uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;  // descriptor buffer：没有dynamic ubo，descriptor中直接是slice的地址
+        }
         uboLayoutBinding.pImmutableSamplers = nullptr;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;  // 着色器阶段，这里是vs
-
-        // texture mapping：使得着色器可以通过采样器访问图像资源
-        VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-        samplerLayoutBinding.binding = 1;
-        samplerLayoutBinding.descriptorCount = 1;
-        samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        samplerLayoutBinding.pImmutableSamplers = nullptr;
-        samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;  // 片段着色器使用，不过顶点着色器使用也是可能的比如对高度采样然后对顶点网格进行动态变形
-        
-        std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};  // 绑定ubo和sampler
+        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;  // 着色器阶段，clustered lighting：片段着色器读取cluster参数
+        if (m_meshShaderSupported) {  // meshlet：task shader剔除和mesh shader变换顶点也读取ubo
+            uboLayoutBinding.stageFlags |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+        }
+
+        // multi draw indirect：binding 1是这一帧每个draw的object编号，顶点阶段读取，片段阶段从顶点阶段得到编号
+        VkDescriptorSetLayoutBinding drawDataBinding{};
+        drawDataBinding.binding = 1;
+        drawDataBinding.descriptorCount = 1;
+        drawDataBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        drawDataBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        // clustered lighting：binding 2是这一帧的光源，binding 3是light_cluster.comp写入的cluster列表，只在片段阶段读取
+        VkDescriptorSetLayoutBinding lightBinding = drawDataBinding;
+        lightBinding.binding = 2;
+        lightBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        VkDescriptorSetLayoutBinding clusterBinding = lightBinding;
+        clusterBinding.binding = 3;
+
+        // shadow cache：binding 4是cascade的depth array，sampler带比较
+        VkDescriptorSetLayoutBinding shadowBinding = lightBinding;
+        shadowBinding.binding = 4;
+        shadowBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+        // scene objects：binding 5是按mesh编号的SceneObject，顶点阶段读取model，片段阶段读取纹理
+        VkDescriptorSetLayoutBinding objectBinding = drawDataBinding;
+        objectBinding.binding = 5;
+
+        // ray traced shadows：binding 6是这一帧的TLAS，只在支持时存在
+        VkDescriptorSetLayoutBinding tlasBinding = lightBinding;
+        tlasBinding.binding = 6;
+        tlasBinding.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+
+        // materials：binding 7是材质表，片段阶段按材质编号读取；TLAS可能不存在，所以排在数组的最后
+        VkDescriptorSetLayoutBinding materialBinding = lightBinding;
+        materialBinding.binding = 7;
+
+        // bindless：纹理不再是每帧set中的binding 1，而是set 1的纹理数组，片段着色器用材质中的index访问
+        std::array<VkDescriptorSetLayoutBinding, 8> bindings = {uboLayoutBinding, drawDataBinding, lightBinding, clusterBinding, shadowBinding, objectBinding,
+            materialBinding, tlasBinding};
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.flags = m_descriptorBuffer.initialized() ? DescriptorBuffer::layoutFlags() : 0;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size()) - (m_rayTracedShadowsSupported ? 0 : 1);
         layoutInfo.pBindings = bindings.data();
 
-        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, hostAllocator(), &descriptorSetLayout) != VK_SUCCESS) {
             throw std::runtime_error("failed to create descriptor set layout!");
         }
+
+        // meshlet：set 2依次是geometry buffer的顶点、meshlet、meshlet顶点、meshlet三角形和meshlet visibility，只在启动时写入一次
+        // vertex pulling：pulled.vert也读取binding 0，不支持mesh shader时set 2只有binding 0
+        if (useGeometrySet()) {
+            std::array<VkDescriptorSetLayoutBinding, 1 + MeshletBuffer::regionCount> meshletBindings{};
+            for (uint32_t i = 0; i < meshletBindings.size(); i++) {
+                meshletBindings[i].binding = i;
+                meshletBindings[i].descriptorCount = 1;
+                meshletBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                meshletBindings[i].stageFlags = m_meshShaderSupported ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : 0;
+            }
+            if (VERTEX_PULLING) {
+                meshletBindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+            }
+            VkDescriptorSetLayoutCreateInfo meshletLayoutInfo{};
+            meshletLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            meshletLayoutInfo.flags = layoutInfo.flags;
+            meshletLayoutInfo.bindingCount = m_meshShaderSupported ? static_cast<uint32_t>(meshletBindings.size()) : 1;
+            meshletLayoutInfo.pBindings = meshletBindings.data();
+            if (vkCreateDescriptorSetLayout(device, &meshletLayoutInfo, hostAllocator(), &m_meshletSetLayout) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create meshlet descriptor set layout!");
+            }
+        }
+
+        m_bindlessTextures.init(physicalDevice, device, BINDLESS_TEXTURE_CAPACITY, m_descriptorBuffer.initialized() ? &m_descriptorBuffer : nullptr,
+            m_meshShaderSupported ? VK_SHADER_STAGE_TASK_BIT_EXT : 0);  // hi-z：task shader读取pyramid
+
+        // descriptor buffer：set只是buffer中的一段，layout创建之后就可以分配，内容在createDescriptorSets和每帧写入
+        if (m_descriptorBuffer.initialized()) {
+            m_frameDescriptorOffsets.resize(MAX_FRAMES_IN_FLIGHT);
+            for (VkDeviceSize& offset : m_frameDescriptorOffsets) {
+                offset = m_descriptorBuffer.allocateSet(descriptorSetLayout);
+            }
+            if (useGeometrySet()) {
+                m_meshletDescriptorOffset = m_descriptorBuffer.allocateSet(m_meshletSetLayout);
+            }
+        }
     }
 
-    // pipeline：创建pipeline
+    // pipeline：pipeline layout在主线程创建，pipeline本身交给pipeline compiler在工作线程编译
+    // pipeline compiler：这里不等待，recordCommandBuffer第一次用到某个pipeline时才等待它的future
     void createGraphicsPipeline() {
-        auto vertShaderCode = readFile("/Users/sichaoshu/workspace/VulkanTutorial/VulkanTutorial/shaders/vert.spv");
-        auto fragShaderCode = readFile("/Users/sichaoshu/workspace/VulkanTutorial/VulkanTutorial/shaders/frag.spv");
-        
-        // shader module在pipeline创建之后可以被销毁，因为创建管道时被编译和链接到机器码
-        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+        // fixed function：shader中的uniform需要pipelinelayout来指定
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        // bindless：set 0是每帧的ubo，set 1是纹理数组
+        // meshlet：两条路径共享同一个pipeline layout，set 2和task、mesh shader的push constant只在支持mesh shader时加入
+        std::array<VkDescriptorSetLayout, 3> setLayouts = {descriptorSetLayout, m_bindlessTextures.layout(), m_meshletSetLayout};
+        pipelineLayoutInfo.setLayoutCount = useGeometrySet() ? 3 : 2;
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();  // descriptor set layout：指定pipeline需要使用的descriptor set layout
+        // bindless：push constant传入这个draw的纹理index
+        // push constant：model矩阵在vertex shader和mesh shader中使用
+        m_drawPushConstantStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        if (m_meshShaderSupported) {
+            m_drawPushConstantStages |= VK_SHADER_STAGE_MESH_BIT_EXT;
+        }
+        std::array<VkPushConstantRange, 2> pushConstantRanges{};
+        pushConstantRanges[0].stageFlags = m_drawPushConstantStages;
+        pushConstantRanges[0].offset = 0;
+        pushConstantRanges[0].size = sizeof(DrawPushConstants);
+        pushConstantRanges[1].stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+        pushConstantRanges[1].offset = MESHLET_PUSH_CONSTANT_OFFSET;
+        pushConstantRanges[1].size = sizeof(MeshletPushConstants);
+        pipelineLayoutInfo.pushConstantRangeCount = m_meshShaderSupported ? 2 : 1;  // 指定了pushConstant，也是传递uniform的方式
+        pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, hostAllocator(), &pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
 
-        VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-        vertShaderStageInfo.module = vertShaderModule;
-        vertShaderStageInfo.pName = "main";  // 指定调用函数，这意味着可以将多个shader组合在一个shader module中并用不同入口点区分
+        // shader object：shader和pipeline layout使用相同的set layout和push constant，绑定descriptor时仍然使用pipelineLayout
+        if (m_shaderObjects.initialized()) {
+            createShaderObjects(std::vector<VkDescriptorSetLayout>(setLayouts.begin(), setLayouts.begin() + pipelineLayoutInfo.setLayoutCount),
+                std::vector<VkPushConstantRange>(pushConstantRanges.begin(), pushConstantRanges.begin() + pipelineLayoutInfo.pushConstantRangeCount));
+            return;
+        }
 
-        VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragShaderStageInfo.module = fragShaderModule;
-        fragShaderStageInfo.pName = "main";
+        // deferred shading：光照pipeline只有一个，不经过pipeline compiler
+        if (DEFERRED_SHADING) {
+            m_deferredLighting.init(device, m_pipelineCache.handle(), embeddedShader(UPSCALE_VERT_SHADER), embeddedShader(DEFERRED_LIGHTING_FRAG_SHADER), renderPass, 1,
+                MAX_FRAMES_IN_FLIGHT);
+        }
+
+        m_graphicsPipelineFuture = m_pipelineCompiler.submit([this]() { return buildGraphicsPipeline(); });
+        if (m_meshShaderSupported) {
+            m_meshletPipelineFuture = m_pipelineCompiler.submit([this]() { return buildMeshletPipeline(); });
+        }
+        if (m_dynamicRenderingSupported && m_dynamicStates.initialized()) {
+            m_depthPrepassPipelineFuture = m_pipelineCompiler.submit([this]() { return buildDepthPrepassPipeline(); });
+        }
+    }
+
+    // ray traced shadows：支持时场景使用RAY_QUERY_SHADOWS的变体，TLAS无效的帧ubo让它回到shadow map；multiple views的pipeline总是使用bindless.frag
+    // half precision：支持shaderFloat16时再选择HALF_PRECISION的变体；gbuffer.frag输出的是fp32的gbuffer，不使用
+    std::string_view sceneFragShader() const {
+        if (DEFERRED_SHADING) {
+            return GBUFFER_FRAG_SHADER;
+        }
+        if (m_shaderFloat16Supported) {
+            return m_rayTracedShadowsSupported ? BINDLESS_RAY_QUERY_FP16_FRAG_SHADER : BINDLESS_FP16_FRAG_SHADER;
+        }
+        return m_rayTracedShadowsSupported ? BINDLESS_RAY_QUERY_FRAG_SHADER : BINDLESS_FRAG_SHADER;
+    }
+
+    // vertex pulling：pulled.vert和meshlet.mesh一样用MeshletSpecialization选择顶点格式，其它vertex shader没有specialization constant
+    std::string_view sceneVertShader() const {
+        if (VERTEX_PULLING) {
+            return PULLED_VERT_SHADER;
+        }
+        return COMPACT_VERTICES ? COMPACT_VERT_SHADER : DEPTH_VERT_SHADER;
+    }
+
+    // shader object：和buildGraphicsPipeline、buildMeshletPipeline使用相同的shader和specialization
+    void createShaderObjects(const std::vector<VkDescriptorSetLayout>& setLayouts, const std::vector<VkPushConstantRange>& pushConstantRanges) {
+        auto vertShaderCode = embeddedShader(sceneVertShader());
+        auto fragShaderCode = embeddedShader(sceneFragShader());
+        MeshletSpecialization vertexSpecialization;
+        std::vector<VkShaderEXT> shaders = m_shaderObjects.createLinked({
+            {VK_SHADER_STAGE_VERTEX_BIT, vertShaderCode, VERTEX_PULLING ? vertexSpecialization.info() : nullptr},
+            {VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderCode, nullptr},
+        }, setLayouts, pushConstantRanges);
+        m_vertexShaderObject = shaders[0];
+        m_fragmentShaderObject = shaders[1];
+
+        GraphicsPipelineState state;
+        fillPipelineState(state, SCENE_PIPELINE_DESC);
+        m_shaderObjects.setVertexInput(state.bindingDescriptions, state.attributeDescriptions);
+
+        if (m_meshShaderSupported) {
+            auto taskShaderCode = embeddedShader(MESHLET_TASK_SHADER);
+            auto meshShaderCode = embeddedShader(MESHLET_MESH_SHADER);
+            MeshletSpecialization specialization;
+
+            shaders = m_shaderObjects.createLinked({
+                {VK_SHADER_STAGE_TASK_BIT_EXT, taskShaderCode, nullptr},
+                {VK_SHADER_STAGE_MESH_BIT_EXT, meshShaderCode, specialization.info()},
+                {VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderCode, nullptr},
+            }, setLayouts, pushConstantRanges);
+            m_taskShaderObject = shaders[0];
+            m_meshShaderObject = shaders[1];
+            m_meshletFragmentShaderObject = shaders[2];
+        }
+    }
+
+    // pipeline compiler：future还没有取过结果时等待编译完成，之后直接返回pipeline
+    VkPipeline waitPipeline(std::future<VkPipeline>& future, VkPipeline& pipeline) {
+        if (future.valid()) {
+            pipeline = future.get();
+        }
+        return pipeline;
+    }
+
+    // pipeline variants：编译完成时取出结果并返回true，还在编译时不等待，返回false
+    bool pollPipeline(std::future<VkPipeline>& future, VkPipeline& pipeline) {
+        if (future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            pipeline = future.get();
+        }
+        return pipeline != VK_NULL_HANDLE;
+    }
+
+    // pipeline compiler：两条路径共享的fixed function状态，每个编译job有自己的一份，create info中的指针指向state
+    // dynamic state：meshShader为true时不把图元类型设置成动态
+    // pipeline desc：固定功能状态来自desc，desc之外只有msaa采样数、attachment格式和设备支持的功能
+    VkGraphicsPipelineCreateInfo fillPipelineState(GraphicsPipelineState& state, const PipelineDesc& desc) {
+        bool meshShader = desc.vertexInput == VertexInputDesc::none;
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
-        
         // fixed function：描述顶点数据格式
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        VkPipelineVertexInputStateCreateInfo& vertexInputInfo = state.vertexInputInfo;
         vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
         // vertex input：设置管道接受的顶点格式
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getAttributeDescriptions();
+        if (desc.vertexInput == VertexInputDesc::impostor) {
+            ImpostorAtlas::vertexInput(state.bindingDescriptions, state.attributeDescriptions);
+        } else if (desc.vertexInput == VertexInputDesc::particle) {
+            ParticleSystem::vertexInput(state.bindingDescriptions, state.attributeDescriptions);
+        } else if (desc.vertexInput == VertexInputDesc::pulled) {
+            pulledVertexInput(state.bindingDescriptions, state.attributeDescriptions);
+        } else if (!meshShader && desc.vertexInput != VertexInputDesc::terrain && desc.vertexInput != VertexInputDesc::occlusionBox) {
+            gpuVertexInput(desc.vertexInput == VertexInputDesc::positionOnly, state.bindingDescriptions, state.attributeDescriptions);
+        }
 
-        vertexInputInfo.vertexBindingDescriptionCount = 1;  // 主要描述数据之间的间距以及数据是逐顶点还是逐实例
-        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());;  // 传递给顶点着色器的属性的类型，从哪个bind加载它们以及在哪个偏移量
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+        vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(state.bindingDescriptions.size());  // 主要描述数据之间的间距以及数据是逐顶点还是逐实例
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(state.attributeDescriptions.size());  // 传递给顶点着色器的属性的类型，从哪个bind加载它们以及在哪个偏移量
+        vertexInputInfo.pVertexBindingDescriptions = state.bindingDescriptions.data();
+        vertexInputInfo.pVertexAttributeDescriptions = state.attributeDescriptions.data();
 
         // fixed function：决定图元类型以及是否开启图元复用
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        VkPipelineInputAssemblyStateCreateInfo& inputAssembly = state.inputAssembly;
         inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssembly.topology = desc.topology;
         inputAssembly.primitiveRestartEnable = VK_FALSE;
 
         // fixed function：设置viewport和scissor，viewport和window分辨率一样，定义图像到framebuffer转换，scissor定义实际存储区域
-        VkPipelineViewportStateCreateInfo viewportState{};
+        VkPipelineViewportStateCreateInfo& viewportState = state.viewportState;
         viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
         viewportState.viewportCount = 1;
         viewportState.scissorCount = 1;
 
         // fixed function：设置光栅化器
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        VkPipelineRasterizationStateCreateInfo& rasterizer = state.rasterizer;
         rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
         rasterizer.depthClampEnable = VK_FALSE;  // 如果是ture则远近平面片段会被截断到深度范围而不是直接丢弃
         rasterizer.rasterizerDiscardEnable = VK_FALSE;  // 如果为ture则图形不会通过光栅化，不会有输出
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;  // 确定如何生成片段，比如可以选择输出线框或者输出顶点
+        rasterizer.polygonMode = desc.raster.polygonMode;  // 确定如何生成片段，比如可以选择输出线框或者输出顶点
         rasterizer.lineWidth = 1.0f;  // 线条粗细
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;  // 面剔除，这里剔除背面
-        rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;  // descriptor set：因为mvp矩阵对y轴进行了反转所以视逆时针为正面
+        rasterizer.cullMode = desc.raster.cullMode;  // 面剔除，场景剔除背面
+        rasterizer.frontFace = desc.raster.frontFace;
         rasterizer.depthBiasEnable = VK_FALSE;  // 主要是用于shadow map的深度偏移，可以添加常值或者片段斜率作为偏移量
 
         // fixed function：硬件抗锯齿
-        VkPipelineMultisampleStateCreateInfo multisampling{};
+        VkPipelineMultisampleStateCreateInfo& multisampling = state.multisampling;
         multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
         multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.rasterizationSamples = desc.sceneSamples ? m_msaaSamples : VK_SAMPLE_COUNT_1_BIT;  // msaa：和color、depth attachment的采样数一致
 
         // depth buffering：pipeline启用深度模版测试，这里只使用深度测试
-        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        VkPipelineDepthStencilStateCreateInfo& depthStencil = state.depthStencil;
         depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-        depthStencil.depthTestEnable = VK_TRUE;  // 是否深度测试
-        depthStencil.depthWriteEnable = VK_TRUE;  // 是否深度写入
-        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        depthStencil.depthTestEnable = desc.depth.testEnable ? VK_TRUE : VK_FALSE;  // 是否深度测试
+        depthStencil.depthWriteEnable = desc.depth.writeEnable ? VK_TRUE : VK_FALSE;  // 是否深度写入
+        depthStencil.depthCompareOp = desc.depth.compareOp;
         depthStencil.depthBoundsTestEnable = VK_FALSE;  // 深度测试边界
         depthStencil.stencilTestEnable = VK_FALSE;  // 是否开启模版测试
 
         // fixed function：片段着色器返回需要与framebuffer混合，这里进行设置
-        VkPipelineColorBlendAttachmentState colorBlendAttachment{};  // 每个attachment的混合设置
-        // 控制blend后颜色写入通道，这里开启rgba
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;  // 是否开启blend
+        for (VkPipelineColorBlendAttachmentState& colorBlendAttachment : state.colorBlendAttachments) {  // 每个attachment的混合设置
+            // 控制blend后颜色写入通道，场景开启rgba
+            colorBlendAttachment.colorWriteMask = desc.blend.writeMask;
+            colorBlendAttachment.blendEnable = desc.blend.enable ? VK_TRUE : VK_FALSE;  // 是否开启blend
+            if (desc.blend.enable) {  // pipeline desc：标准的alpha混合，additive时是加法混合
+                colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+                colorBlendAttachment.dstColorBlendFactor = desc.blend.additive ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+                colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+                colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+                colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+                colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+            }
+        }
 
-        VkPipelineColorBlendStateCreateInfo colorBlending{};  // 全局混合设置，开启后将禁用上面的设置
+        VkPipelineColorBlendStateCreateInfo& colorBlending = state.colorBlending;  // 全局混合设置，开启后将禁用上面的设置
         colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
         colorBlending.logicOpEnable = VK_FALSE;
         colorBlending.logicOp = VK_LOGIC_OP_COPY;
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
+        colorBlending.attachmentCount = desc.colorAttachments;  // deferred shading：和subpass 0的color attachment数量一致
+        colorBlending.pAttachments = state.colorBlendAttachments.data();
         colorBlending.blendConstants[0] = 0.0f;
         colorBlending.blendConstants[1] = 0.0f;
         colorBlending.blendConstants[2] = 0.0f;
@@ -907,35 +4330,29 @@ private:
 
 
         // fixed function：大部分管道状态需要预编译进PSO中，而有些dynamic state可以直接更改而不需要重现创建管道
-        std::vector<VkDynamicState> dynamicStates = {  // viewport和scissor设置成动态状态
+        std::vector<VkDynamicState>& dynamicStates = state.dynamicStates;
+        dynamicStates = {  // viewport和scissor设置成动态状态
             VK_DYNAMIC_STATE_VIEWPORT,
             VK_DYNAMIC_STATE_SCISSOR
         };
-        VkPipelineDynamicStateCreateInfo dynamicState{};
+        // dynamic state：上面rasterizer和depthStencil中的对应设置被忽略，由录制时的RasterState决定
+        if (desc.dynamicRasterState && m_dynamicStates.initialized()) {
+            m_dynamicStates.appendDynamicStates(dynamicStates, meshShader);
+        }
+        VkPipelineDynamicStateCreateInfo& dynamicState = state.dynamicState;
         dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
         dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
         dynamicState.pDynamicStates = dynamicStates.data();
 
-        // fixed function：shader中的uniform需要pipelinelayout来指定
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;  // descriptor set layout：指定pipeline需要使用的descriptor set layout
-        pipelineLayoutInfo.pushConstantRangeCount = 0;  // 指定了pushConstant，也是传递uniform的方式
-
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create pipeline layout!");
-        }
-
         // pipeline：创建pipeline，综合之前的设置
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
         // 设置shader stage
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.stageCount = static_cast<uint32_t>(state.stages.size());
+        pipelineInfo.pStages = state.stages.data();
         // 设置fixed function
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pVertexInputState = meshShader ? nullptr : &vertexInputInfo;  // meshlet：mesh shader pipeline没有顶点输入和图元装配
+        pipelineInfo.pInputAssemblyState = meshShader ? nullptr : &inputAssembly;
         pipelineInfo.pViewportState = &viewportState;
         pipelineInfo.pRasterizationState = &rasterizer;
         pipelineInfo.pMultisampleState = &multisampling;
@@ -947,38 +4364,174 @@ private:
         // 设置render pass
         pipelineInfo.renderPass = renderPass;
         pipelineInfo.subpass = 0;
+        // dynamic rendering：没有render pass，pipeline只需要知道attachment的格式，不再依赖render pass的兼容性
+        if (m_dynamicRenderingSupported) {
+            state.colorFormat = sceneColorFormat();
+            state.renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+            state.renderingInfo.colorAttachmentCount = desc.colorAttachments == 0 ? 0 : 1;  // deferred shading：两个G-buffer attachment只在render pass中使用
+            state.renderingInfo.pColorAttachmentFormats = &state.colorFormat;
+            state.renderingInfo.depthAttachmentFormat = findDepthFormat();
+            pipelineInfo.pNext = &state.renderingInfo;
+        }
+        // descriptor buffer：pipeline只能使用descriptor buffer绑定的set
+        if (m_descriptorBuffer.initialized()) {
+            pipelineInfo.flags |= VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+        }
+        // variable rate shading：dynamic rendering中使用rate attachment的pipeline需要这个flag
+        if (desc.shadingRateAttachment && m_dynamicRenderingSupported && m_shadingRateAttachmentSupported) {
+            pipelineInfo.flags |= VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+        }
+        pipelineInfo.flags |= m_shaderStatistics.createFlags();
         // 管道派生，如果管道与现有管道有很多共同功能则创建成本更低，并且同一父管道的子管道间切换更快。这里可以设置现有管道句柄
         pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        return pipelineInfo;
+    }
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+    // pipeline：在pipeline compiler的工作线程上执行
+    // deferred shading：fragment shader改为写入G-buffer的gbuffer.frag，meshlet pipeline相同
+    VkPipeline buildGraphicsPipeline() {
+        auto vertShaderCode = embeddedShader(sceneVertShader());
+        auto fragShaderCode = embeddedShader(sceneFragShader());
+        
+        // shader module在pipeline创建之后可以被销毁，因为创建管道时被编译和链接到机器码
+        VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
+        VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+
+        GraphicsPipelineState state;
+        state.stages.resize(2);
+        VkPipelineShaderStageCreateInfo& vertShaderStageInfo = state.stages[0];
+        vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertShaderStageInfo.module = vertShaderModule;
+        vertShaderStageInfo.pName = "main";  // 指定调用函数，这意味着可以将多个shader组合在一个shader module中并用不同入口点区分
+        MeshletSpecialization vertexSpecialization;
+        vertShaderStageInfo.pSpecializationInfo = VERTEX_PULLING ? vertexSpecialization.info() : nullptr;
+
+        VkPipelineShaderStageCreateInfo& fragShaderStageInfo = state.stages[1];
+        fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragShaderStageInfo.module = fragShaderModule;
+        fragShaderStageInfo.pName = "main";
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = fillPipelineState(state, SCENE_PIPELINE_DESC);
+
+        // pipeline library：四部分分别编译，快速link的pipeline马上可以使用，优化的pipeline在后台编译完成后由updatePipelines替换
+        // shader statistics：打开时直接编译完整的pipeline，统计对应实际使用的优化结果
+        VkPipeline pipeline;
+        if (m_pipelineLibrarySupported && !m_shaderStatistics.active()) {
+            std::vector<VkPipeline> parts = {
+                m_pipelineLibrary.createPart(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, pipelineInfo),
+                m_pipelineLibrary.createPart(VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, pipelineInfo),
+                m_pipelineLibrary.createPart(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, pipelineInfo),
+                m_pipelineLibrary.createPart(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, pipelineInfo),
+            };
+            pipeline = m_pipelineLibrary.link(parts, pipelineLayout);
+            m_pipelineLibrary.linkOptimizedAsync(parts, pipelineLayout);
+        } else if (vkCreateGraphicsPipelines(device, m_pipelineCache.handle(), 1, &pipelineInfo, hostAllocator(), &pipeline) != VK_SUCCESS) {
             throw std::runtime_error("failed to create graphics pipeline!");
         }
+        m_shaderStatistics.record(pipeline, "scene " + std::string(sceneVertShader()) + " " + std::string(sceneFragShader()));
 
-        vkDestroyShaderModule(device, fragShaderModule, nullptr);
-        vkDestroyShaderModule(device, vertShaderModule, nullptr);
+        vkDestroyShaderModule(device, fragShaderModule, hostAllocator());
+        vkDestroyShaderModule(device, vertShaderModule, hostAllocator());
+        return pipeline;
+    }
+
+    // meshlet：mesh shader pipeline没有顶点输入和图元装配，其它状态和fragment shader与上面相同，同样在工作线程上执行
+    VkPipeline buildMeshletPipeline() {
+        VkShaderModule taskShaderModule = createShaderModule(embeddedShader(MESHLET_TASK_SHADER));
+        VkShaderModule meshShaderModule = createShaderModule(embeddedShader(MESHLET_MESH_SHADER));
+        VkShaderModule fragShaderModule = createShaderModule(embeddedShader(sceneFragShader()));
+
+        MeshletSpecialization specialization;
+
+        GraphicsPipelineState state;
+        state.stages.resize(3);
+        VkShaderStageFlagBits stages[3] = {VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT, VK_SHADER_STAGE_FRAGMENT_BIT};
+        VkShaderModule modules[3] = {taskShaderModule, meshShaderModule, fragShaderModule};
+        for (size_t i = 0; i < state.stages.size(); i++) {
+            state.stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            state.stages[i].stage = stages[i];
+            state.stages[i].module = modules[i];
+            state.stages[i].pName = "main";
+        }
+        state.stages[1].pSpecializationInfo = specialization.info();
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = fillPipelineState(state, MESHLET_PIPELINE_DESC);
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, m_pipelineCache.handle(), 1, &pipelineInfo, hostAllocator(), &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create meshlet pipeline!");
+        }
+        m_shaderStatistics.record(pipeline, "meshlet " + std::string(sceneFragShader()));
+
+        vkDestroyShaderModule(device, fragShaderModule, hostAllocator());
+        vkDestroyShaderModule(device, meshShaderModule, hostAllocator());
+        vkDestroyShaderModule(device, taskShaderModule, hostAllocator());
+        return pipeline;
+    }
+
+    // depth prepass：和graphicsPipeline相同的vertex shader、顶点格式和pipeline layout，没有fragment shader和color attachment
+    // depth比较和写入是dynamic state，prepass和forward使用同一份fillPipelineState
+    // split vertex streams：分开时换成position_only.vert，顶点输入只有位置的binding和实例，prepass不读取binding 1
+    // vertex pulling：和场景pipeline一样使用pulled.vert，位置由同一段代码计算
+    VkPipeline buildDepthPrepassPipeline() {
+        std::string_view vertShader = SPLIT_VERTEX_STREAMS && !VERTEX_PULLING ? POSITION_ONLY_VERT_SHADER : sceneVertShader();
+        VkShaderModule vertShaderModule = createShaderModule(embeddedShader(vertShader));
+        MeshletSpecialization vertexSpecialization;
+
+        GraphicsPipelineState state;
+        state.stages.resize(1);
+        state.stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        state.stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        state.stages[0].module = vertShaderModule;
+        state.stages[0].pName = "main";
+        state.stages[0].pSpecializationInfo = VERTEX_PULLING ? vertexSpecialization.info() : nullptr;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo = fillPipelineState(state, DEPTH_PREPASS_PIPELINE_DESC);
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, m_pipelineCache.handle(), 1, &pipelineInfo, hostAllocator(), &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth prepass pipeline!");
+        }
+        m_shaderStatistics.record(pipeline, "depth prepass " + std::string(vertShader));
+
+        vkDestroyShaderModule(device, vertShaderModule, hostAllocator());
+        return pipeline;
     }
 
     // framebuffer：renderpass创建时声明的attachment还需要通过framebuffer进行绑定，renderpass指定了格式而实际资源在framebuffer中
     // 这里用到了一个color attachment，但是需要不止一个framebuffer因为要对每个swap chain的image创建framebuffer并在绘制时使用对应的framebuffer
+    // dynamic rendering：image view在每帧开始渲染时传入，不需要framebuffer，resize时也不用重建
     void createFramebuffers() {
+        if (m_dynamicRenderingSupported) {
+            return;
+        }
         swapChainFramebuffers.resize(swapChainImageViews.size());
 
         for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-            std::array<VkImageView, 2> attachments = {
-                swapChainImageViews[i],
-                depthImageView
+            // msaa：多重采样时swap chain image是resolve attachment
+            bool msaa = m_msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+            std::array<VkImageView, 4> attachments = {
+                msaa ? m_msaaColorView : swapChainImageViews[i],
+                depthImageView,
+                swapChainImageViews[i]
             };
+            // deferred shading：attachment顺序和createDeferredRenderPass一致
+            uint32_t attachmentCount = msaa ? 3 : 2;
+            if (DEFERRED_SHADING) {
+                attachments = {swapChainImageViews[i], depthImageView, m_gbufferAlbedoView, m_gbufferNormalView};
+                attachmentCount = 4;
+            }
 
             VkFramebufferCreateInfo framebufferInfo{};
             framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
             framebufferInfo.renderPass = renderPass;  // 指定framebuffer兼容的renderpass，大致意味着需要使用相同数量和类型的附件
-            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+            framebufferInfo.attachmentCount = attachmentCount;
             framebufferInfo.pAttachments = attachments.data();  // 指定imageview会被绑定到attachment中
             framebufferInfo.width = swapChainExtent.width;
             framebufferInfo.height = swapChainExtent.height;
             framebufferInfo.layers = 1;
 
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
+            if (vkCreateFramebuffer(device, &framebufferInfo, hostAllocator(), &swapChainFramebuffers[i]) != VK_SUCCESS) {
                 throw std::runtime_error("failed to create framebuffer!");
             }
         }
@@ -996,22 +4549,105 @@ private:
         poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
         poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();  // 每个pool只能分配单一类型队列上提交的command buffer，因为要记录绘图命令所以选择图形队列
 
-        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+        if (vkCreateCommandPool(device, &poolInfo, hostAllocator(), &commandPool) != VK_SUCCESS) {
             throw std::runtime_error("failed to create command pool!");
         }
     }
 
+    // staging ring：创建持久映射的staging ring，空间不够时等待最早的上传ticket
+    // transfer queue：有独立传输队列时上传在传输队列上执行，否则在图形队列上和渲染命令按提交顺序排队
+    void createStagingRing() {
+        m_timeline.init(device);
+        // residency：显存不足时等待gpu空闲，已完成的提交等待销毁的资源立即释放；这一帧还没有提交，它推迟销毁的资源不受影响
+        m_allocator.setPressureHandler([this]() {
+            vkDeviceWaitIdle(device);
+            size_t pending = m_deletionQueue.size();
+            m_deletionQueue.flush(m_timeline.completedValue());
+            m_memoryPressure = true;
+            return m_deletionQueue.size() < pending;
+        });
+        m_stagingRing.init(device, m_allocator, STAGING_RING_SIZE, [this](uint64_t ticket) {
+            m_uploadContext.wait(ticket);
+        });
+
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+        uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+        // device group：跨队列的同步只在一个设备上等待，不使用独立的传输队列和计算队列
+        uint32_t transferFamily = m_deviceGroup.active() ? graphicsFamily : queueFamilyIndices.transferFamily.value_or(graphicsFamily);
+        m_uploadContext.init(device, transferFamily, transferQueue, graphicsFamily, graphicsQueue, m_stagingRing, m_timeline, &m_deviceGroup);
+
+        // async compute：command pool和timeline也在这里创建，clustered lighting创建buffer时需要知道是否有计算队列
+        uint32_t computeFamily = ASYNC_COMPUTE && !m_deviceGroup.active() ? queueFamilyIndices.computeFamily.value_or(graphicsFamily) : graphicsFamily;
+        m_asyncCompute.init(device, computeFamily, computeQueue, graphicsFamily, MAX_FRAMES_IN_FLIGHT);
+    }
+
+    // upload context：提交初始化期间录制的所有上传，不在cpu上等待
+    // 渲染提交在图形队列上排在acquire之后，handoff的barrier保证渲染读取时数据已经写入
+    void submitSceneUploads() {
+        m_sceneUploadTicket = m_uploadContext.submit();
+    }
+
     // depth buffering：深度图像创建，需要image，memory，imageview三个资源
     void createDepthResources() {
+        if (m_dynamicRenderingSupported) {
+            return;  // render graph：depth由graph创建，分辨率改变时graph自己重新分配
+        }
         VkFormat depthFormat = findDepthFormat();
 
+        // transient attachment：depth的内容在render pass之后不再需要（storeOp是DONT_CARE）
+        // tile based gpu（MoltenVK/apple和移动端）支持LAZILY_ALLOCATED内存时，attachment只存在于tile memory中，不占用显存也没有读写带宽
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        VkMemoryPropertyFlags preferred = 0;
+        if (m_allocator.hasMemoryType(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+            usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            preferred = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        }
+
         // depth大小和swapchain图像大小一致，使用tiling像素布局，存在设备的本地内存
-        createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
-        depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+        createImage(swapChainExtent.width, swapChainExtent.height, 1, depthFormat, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageAllocation, MemoryCategory::attachment, "depth", preferred,
+            0, m_msaaSamples);
+        depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+
+        // msaa：多重采样的color和depth一样只在render pass之内使用，同样是transient attachment
+        m_msaaColorImage = VK_NULL_HANDLE;
+        m_msaaColorAllocation = {};
+        m_msaaColorView = VK_NULL_HANDLE;
+        if (m_msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+            VkImageUsageFlags colorUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+            createImage(swapChainExtent.width, swapChainExtent.height, 1, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL, colorUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_msaaColorImage,
+                m_msaaColorAllocation, MemoryCategory::attachment, "msaa color", preferred, 0, m_msaaSamples);
+            m_msaaColorView = createImageView(m_msaaColorImage, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }
+
+        // deferred shading：G-buffer只在一个render pass的两个subpass之间使用，和depth一样是transient attachment
+        m_gbufferAlbedoImage = VK_NULL_HANDLE;
+        m_gbufferAlbedoAllocation = {};
+        m_gbufferAlbedoView = VK_NULL_HANDLE;
+        m_gbufferNormalImage = VK_NULL_HANDLE;
+        m_gbufferNormalAllocation = {};
+        m_gbufferNormalView = VK_NULL_HANDLE;
+        if (DEFERRED_SHADING) {
+            VkImageUsageFlags gbufferUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+            createImage(swapChainExtent.width, swapChainExtent.height, 1, DeferredLighting::ALBEDO_FORMAT, VK_IMAGE_TILING_OPTIMAL, gbufferUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                m_gbufferAlbedoImage, m_gbufferAlbedoAllocation, MemoryCategory::attachment, "gbuffer albedo", preferred);
+            m_gbufferAlbedoView = createImageView(m_gbufferAlbedoImage, DeferredLighting::ALBEDO_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+            createImage(swapChainExtent.width, swapChainExtent.height, 1, DeferredLighting::NORMAL_FORMAT, VK_IMAGE_TILING_OPTIMAL, gbufferUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                m_gbufferNormalImage, m_gbufferNormalAllocation, MemoryCategory::attachment, "gbuffer normal", preferred);
+            m_gbufferNormalView = createImageView(m_gbufferNormalImage, DeferredLighting::NORMAL_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }
     }
 
     // depth buffering：检查哪些格式支持
     VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
+        VkFormat format = findSupportedFormatOrUndefined(candidates, tiling, features);
+        if (format == VK_FORMAT_UNDEFINED) {
+            throw std::runtime_error("failed to find supported format!");
+        }
+        return format;
+    }
+
+    // ktx2：和findSupportedFormat相同，但没有支持的格式时返回VK_FORMAT_UNDEFINED，用于可以回退的可选格式
+    VkFormat findSupportedFormatOrUndefined(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
         for (VkFormat format : candidates) {
             VkFormatProperties props;
             vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
@@ -1023,13 +4659,18 @@ private:
             }
         }
 
-        throw std::runtime_error("failed to find supported format!");
+        return VK_FORMAT_UNDEFINED;
     }
 
     // depth buffering：获取depth image格式。因为一般不需要程序访问depth的texel所以不一定需要特定的格式
+    // attachment bandwidth：D16作为depth attachment是必须支持的，精度够用时放在最前面，depth的读写量减半
     VkFormat findDepthFormat() {
+        std::vector<VkFormat> candidates = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT};
+        if (BANDWIDTH_AWARE_FORMATS && m_camera.zFar() / m_camera.zNear() <= D16_MAX_DEPTH_RATIO) {
+            candidates.insert(candidates.begin(), VK_FORMAT_D16_UNORM);
+        }
         return findSupportedFormat(
-        {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+            candidates,
             VK_IMAGE_TILING_OPTIMAL,
             VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT  // 注意这里是feature不是usage
         );  // 检哪些格式支持，首先看32bit的格式，S8表示8bit stencil
@@ -1040,52 +4681,1052 @@ private:
         return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
     }
 
-    // texture image：创建texture image，会使用command buffer所以需要在command pool构建后执行
-    void createTextureImage() {
-        int texWidth, texHeight, texChannels;
-        stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);  // 强制加载一个alpha通道即使没有alpha，保证图片都能读取
-        VkDeviceSize imageSize = texWidth * texHeight * 4;
-
-        if (!pixels) {
-            throw std::runtime_error("failed to load texture image!");
+    void mountAssetPack() {
+        if (AssetPack::instance().open(ASSET_PACK_PATH) && SHOW_STARTUP_TIMINGS) {
+            std::cout << "asset pack: " << AssetPack::instance().entryCount() << " assets" << std::endl;
         }
+    }
+
+    // texture cache：纹理的加载和销毁由cache调用，相同路径或相同内容的纹理只加载一次
+    void createTextureCache() {
+        m_fileReader.init();
+        if (SHOW_STARTUP_TIMINGS) {
+            std::cout << "async file io: " << (MAPPED_ASSET_READS ? "mapped files" : m_fileReader.backend()) << std::endl;
+        }
+        m_textureCache.init(m_deletionQueue,
+            [this](const std::vector<TextureCache::LoadRequest>& requests) { return createTextures(requests); },
+            [this](const Texture& texture) { destroyTexture(texture); }, MAPPED_ASSET_READS ? nullptr : &m_fileReader);
+    }
+
+    // texture image：创建texture image，会使用command buffer所以需要在command pool构建后执行
+    // 有ktx2压缩版本的纹理直接上传，其余的图片在job pool中并行解码
+    std::vector<Texture> createTextures(const std::vector<TextureCache::LoadRequest>& requests) {
+        std::vector<Texture> textures(requests.size());
+        std::vector<size_t> decodeIndices;
+        for (size_t i = 0; i < requests.size(); i++) {
+            if (!createCompressedTexture(requests[i].handle, requests[i].path, textures[i])) {
+                decodeIndices.push_back(i);
+            }
+        }
+
+        decodeTextures(requests, decodeIndices, textures);
+        return textures;
+    }
+
+    // parallel decode：工作线程把图片直接解码到主线程预先分配的staging空间，主线程按完成顺序记录上传命令
+    // staging ring只在主线程使用，解码前用stbi_info_from_memory只读取header得到尺寸来分配空间
+    void decodeTextures(const std::vector<TextureCache::LoadRequest>& requests, const std::vector<size_t>& indices, std::vector<Texture>& textures) {
+        struct DecodeJob {
+            size_t index;
+            int width;
+            int height;
+            StagingRing::Region staging;
+            float decodeMs = 0.0f;
+            bool failed = false;
+        };
+
+        auto startTime = std::chrono::high_resolution_clock::now();
+        float serialMs = 0.0f;  // 所有job解码时间之和，也就是在主线程上串行解码需要的时间
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        VkDeviceSize alignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+
+        // texture atlas：小纹理打包进atlas，其余纹理单独创建image
+        std::vector<size_t> atlasIndices;
+        std::vector<size_t> imageIndices;
+        for (size_t index : indices) {
+            const FileBytes& fileData = requests[index].fileData;
+            int texWidth, texHeight, texChannels;
+            if (!stbi_info_from_memory(reinterpret_cast<const stbi_uc*>(fileData.data()), static_cast<int>(fileData.size()), &texWidth, &texHeight, &texChannels)) {
+                throw std::runtime_error("failed to load texture image!");
+            }
+            if (static_cast<uint32_t>(std::max(texWidth, texHeight)) <= TEXTURE_ATLAS_MAX_SIZE) {
+                atlasIndices.push_back(index);
+            } else {
+                imageIndices.push_back(index);
+            }
+        }
+        if (!atlasIndices.empty()) {
+            serialMs += packAtlasTextures(requests, atlasIndices, textures, alignment);
+        }
+
+        // host image copy：工作线程解码到自己的内存后直接写入image的level 0，不分配staging空间，也不录制拷贝命令
+        // 一轮的字节数仍然按staging ring的一半限制，同时存在的解码结果不会太多
+        bool hostCopy = hostCopyDecodedTextures();
+
+        size_t next = 0;
+        while (next < imageIndices.size()) {
+            // staging ring：一轮job的staging空间都属于还没提交的上传，总量限制在ring的一半以内，避免耗尽ring
+            std::vector<DecodeJob> jobs;
+            VkDeviceSize waveBytes = 0;
+            while (next < imageIndices.size()) {
+                const TextureCache::LoadRequest& request = requests[imageIndices[next]];
+                int texWidth, texHeight, texChannels;
+                if (!stbi_info_from_memory(reinterpret_cast<const stbi_uc*>(request.fileData.data()), static_cast<int>(request.fileData.size()), &texWidth, &texHeight, &texChannels)) {
+                    throw std::runtime_error("failed to load texture image!");
+                }
+
+                VkDeviceSize imageSize = static_cast<VkDeviceSize>(texWidth) * texHeight * 4;  // 强制加载alpha通道
+                if (!jobs.empty() && waveBytes + imageSize > m_stagingRing.capacity() / 2) {
+                    break;
+                }
+
+                DecodeJob job{};
+                job.index = imageIndices[next];
+                job.width = texWidth;
+                job.height = texHeight;
+                if (!hostCopy) {
+                    job.staging = m_stagingRing.allocate(imageSize, alignment);
+                }
+                jobs.push_back(job);
+                waveBytes += imageSize;
+                next++;
+            }
+
+            // image barrier：解码开始前创建这一轮所有的image，layout转换合并成一个barrier
+            ImageBarrierBatch barriers;
+            for (const DecodeJob& job : jobs) {
+                createDecodedTextureImage(textures[job.index], static_cast<uint32_t>(job.width), static_cast<uint32_t>(job.height), 0, barriers, hostCopy);
+            }
+            barriers.record(m_uploadContext.commandBuffer());
+
+            std::mutex mutex;
+            std::condition_variable finishedCondition;
+            std::deque<size_t> finished;
+            for (size_t j = 0; j < jobs.size(); j++) {
+                m_jobPool.submit([&, j]() {
+                    DecodeJob& job = jobs[j];
+                    const FileBytes& fileData = requests[job.index].fileData;
+                    auto decodeStart = std::chrono::high_resolution_clock::now();
+
+                    int texWidth, texHeight, texChannels;
+                    if (hostCopy) {
+                        stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(fileData.data()), static_cast<int>(fileData.size()),
+                            &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+                        job.failed = !pixels;
+                        try {
+                            if (pixels) {
+                                m_hostImageCopy.copy(textures[job.index].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, pixels, static_cast<uint32_t>(job.width), static_cast<uint32_t>(job.height));
+                            }
+                        } catch (const std::exception&) {
+                            job.failed = true;  // 异常不能离开工作线程，和解码失败一样由主线程抛出
+                        }
+                        stbi_image_free(pixels);
+                    } else {
+                        ScopedStagingDecode stagingDecode(job.staging.mapped, static_cast<size_t>(job.staging.size));  // staging decode：输出buffer就是staging空间
+                        stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(fileData.data()), static_cast<int>(fileData.size()),
+                            &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);  // 强制加载一个alpha通道即使没有alpha，保证图片都能读取
+                        if (!pixels) {
+                            job.failed = true;
+                        } else if (pixels != job.staging.mapped) {  // 输出没有落在staging空间时回退到拷贝
+                            memcpy(job.staging.mapped, pixels, static_cast<size_t>(job.staging.size));
+                            stbi_image_free(pixels);  // 清理原始像素阵列
+                        }
+                    }
+                    job.decodeMs = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - decodeStart).count();
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished.push_back(j);
+                    finishedCondition.notify_one();
+                });
+            }
+
+            // 每完成一个job就记录它的上传命令，不需要等整轮解码结束；失败时等所有job结束再抛出，job引用了这里的局部变量
+            bool failed = false;
+            for (size_t done = 0; done < jobs.size(); done++) {
+                size_t j;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    finishedCondition.wait(lock, [&]() { return !finished.empty(); });
+                    j = finished.front();
+                    finished.pop_front();
+                }
+
+                DecodeJob& job = jobs[j];
+                serialMs += job.decodeMs;
+                if (job.failed || failed) {
+                    failed = true;
+                    continue;
+                }
+                uploadDecodedTexture(textures[job.index], job.staging, hostCopy);
+            }
+            if (failed) {
+                throw std::runtime_error("failed to load texture image!");
+            }
+
+            // 还有下一轮时先提交，gpu完成后这一轮的staging空间可以被回收
+            if (next < imageIndices.size()) {
+                m_uploadContext.submit();
+            }
+        }
+
+        if (SHOW_STARTUP_TIMINGS && !indices.empty()) {
+            float wallMs = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+            std::cout << "texture decode: " << indices.size() << " images on " << m_jobPool.threadCount() << " threads, "
+                << wallMs << " ms (serial decode " << serialMs << " ms, saved " << std::max(0.0f, serialMs - wallMs) << " ms)" << std::endl;
+        }
+    }
+
+    // texture atlas：小纹理并行解码到内存，在主线程按高度从大到小打包进atlas page，每个page作为一张纹理上传
+    // 打包进atlas的纹理共享page的image、view和bindless元素，只记录uv的缩放和偏移，返回所有解码时间之和
+    float packAtlasTextures(const std::vector<TextureCache::LoadRequest>& requests, const std::vector<size_t>& indices, std::vector<Texture>& textures, VkDeviceSize alignment) {
+        struct AtlasImage {
+            size_t index;
+            int width = 0;
+            int height = 0;
+            stbi_uc* pixels = nullptr;
+            float decodeMs = 0.0f;
+        };
+
+        std::vector<AtlasImage> images(indices.size());
+        std::mutex mutex;
+        std::condition_variable finishedCondition;
+        size_t finished = 0;
+        for (size_t j = 0; j < images.size(); j++) {
+            images[j].index = indices[j];
+            m_jobPool.submit([&, j]() {
+                AtlasImage& image = images[j];
+                const FileBytes& fileData = requests[image.index].fileData;
+                auto decodeStart = std::chrono::high_resolution_clock::now();
+                int texChannels;
+                image.pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(fileData.data()), static_cast<int>(fileData.size()),
+                    &image.width, &image.height, &texChannels, STBI_rgb_alpha);
+                image.decodeMs = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - decodeStart).count();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                finished++;
+                finishedCondition.notify_one();
+            });
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finishedCondition.wait(lock, [&]() { return finished == images.size(); });
+        }
+
+        float serialMs = 0.0f;
+        bool failed = false;
+        for (const AtlasImage& image : images) {
+            serialMs += image.decodeMs;
+            failed = failed || !image.pixels;
+        }
+        if (failed) {
+            for (const AtlasImage& image : images) {
+                stbi_image_free(image.pixels);
+            }
+            throw std::runtime_error("failed to load texture image!");
+        }
+
+        std::sort(images.begin(), images.end(), [](const AtlasImage& a, const AtlasImage& b) { return a.height > b.height; });
+
+        const VkDeviceSize pageBytes = static_cast<VkDeviceSize>(TEXTURE_ATLAS_SIZE) * TEXTURE_ATLAS_SIZE * 4;
+        const float pageSize = static_cast<float>(TEXTURE_ATLAS_SIZE);
+        size_t next = 0;
+        while (next < images.size()) {
+            ShelfPacker packer;
+            packer.init(TEXTURE_ATLAS_SIZE, TEXTURE_ATLAS_PADDING);
+            StagingRing::Region staging = m_stagingRing.allocate(pageBytes, alignment);
+            memset(staging.mapped, 0, static_cast<size_t>(pageBytes));
+
+            uint32_t page = static_cast<uint32_t>(m_atlasPages.size());
+            m_atlasPages.emplace_back();
+            m_atlasPageRefs.push_back(0);
+
+            std::vector<size_t> placed;
+            AtlasRect rect;
+            while (next < images.size() && packer.pack(static_cast<uint32_t>(images[next].width), static_cast<uint32_t>(images[next].height), rect)) {
+                blitToAtlas(images[next].pixels, static_cast<uint8_t*>(staging.mapped), TEXTURE_ATLAS_SIZE, rect, TEXTURE_ATLAS_PADDING);
+                stbi_image_free(images[next].pixels);
+
+                Texture& texture = textures[images[next].index];
+                texture.format = VK_FORMAT_R8G8B8A8_SRGB;
+                texture.width = rect.width;
+                texture.height = rect.height;
+                texture.atlasPage = page;
+                texture.uvScale[0] = rect.width / pageSize;
+                texture.uvScale[1] = rect.height / pageSize;
+                texture.uvOffset[0] = rect.x / pageSize;
+                texture.uvOffset[1] = rect.y / pageSize;
+                m_atlasPageRefs[page]++;
+                placed.push_back(images[next].index);
+                next++;
+            }
+
+            // texture atlas：mip数量受padding限制，更低的mip会混入相邻纹理
+            ImageBarrierBatch barriers;
+            createDecodedTextureImage(m_atlasPages[page], TEXTURE_ATLAS_SIZE, TEXTURE_ATLAS_SIZE, TEXTURE_ATLAS_MIP_LEVELS, barriers);
+            barriers.record(m_uploadContext.commandBuffer());
+            uploadDecodedTexture(m_atlasPages[page], staging);
+            for (size_t index : placed) {
+                textures[index].view = m_atlasPages[page].view;
+                textures[index].bindlessIndex = m_atlasPages[page].bindlessIndex;
+                textures[index].mipLevels = m_atlasPages[page].mipLevels;
+            }
+
+            // 还有下一个page时先提交，staging空间可以被回收
+            if (next < images.size()) {
+                m_uploadContext.submit();
+            }
+        }
+
+        return serialMs;
+    }
+
+    // texture image：解码纹理的usage和flags，host image copy按同样的组合检查支持
+    void decodedTextureUsage(VkFormat format, VkImageUsageFlags& usage, VkImageCreateFlags& flags) {
+        // mipmap：blit需要格式在optimal tiling下支持linear filter，否则用compute shader生成
+        // compute路径用unorm的storage view写入srgb image，需要MUTABLE_FORMAT；srgb格式本身一般不支持STORAGE，所以还需要EXTENDED_USAGE，
+        // usage只要对某一个view格式有效即可；unorm也不支持storage时不生成mip
+        // residency：降级时level 1之后的mip拷贝到新的image，也需要TRANSFER_SRC
+        usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        flags = 0;
+        if (!supportsLinearBlit(format) && supportsComputeMipmaps()) {
+            usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+            flags |= VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+        }
+    }
+
+    // mipmap：compute生成mip时写入的unorm storage view需要格式支持STORAGE
+    bool supportsComputeMipmaps() {
+        VkImageFormatProperties properties;
+        return vkGetPhysicalDeviceImageFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT, 0,
+                   &properties) == VK_SUCCESS;
+    }
+
+    // host image copy：解码的纹理在TRANSFER_DST_OPTIMAL中写入level 0，之后的mip仍然由gpu生成
+    bool hostCopyDecodedTextures() {
+        VkImageUsageFlags usage;
+        VkImageCreateFlags flags;
+        decodedTextureUsage(VK_FORMAT_R8G8B8A8_SRGB, usage, flags);
+        return m_hostImageCopy.usable(VK_FORMAT_R8G8B8A8_SRGB, usage, flags, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+    }
 
-        // 创建staging buffer这里在host创建，这样才能把数据map
-        // VK_MEMORY_PROPERTY_HOST_COHERENT_BIT确保host visible
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    // texture image：为解码的纹理创建image，mipLevels为0时使用完整的mip链
+    // image barrier：到TRANSFER_DST_OPTIMAL的layout转换加入barriers，由调用者和其它纹理的转换一起录制
+    // host image copy：hostCopy时image可以由cpu写入，layout直接在host上转换，不加入barriers
+    void createDecodedTextureImage(Texture& texture, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels, ImageBarrierBatch& barriers, bool hostCopy = false) {
+        texture.format = VK_FORMAT_R8G8B8A8_SRGB;
+        texture.width = texWidth;
+        texture.height = texHeight;
+        // mipmap：每一级长宽减半直到1x1，log2得到可以减半的次数，加1是原图
+        texture.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+        if (mipLevels > 0) {
+            texture.mipLevels = std::min(texture.mipLevels, mipLevels);
+        }
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);  // 建立映射
-            memcpy(data, pixels, static_cast<size_t>(imageSize));
-        vkUnmapMemory(device, stagingBufferMemory);
+        VkImageUsageFlags usage;
+        VkImageCreateFlags flags;
+        decodedTextureUsage(texture.format, usage, flags);
+        if (hostCopy) {
+            usage |= VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+        }
+        if (!supportsLinearBlit(texture.format) && !(usage & VK_IMAGE_USAGE_STORAGE_BIT)) {
+            texture.mipLevels = 1;  // mipmap：blit和compute都不可用
+        }
 
-        stbi_image_free(pixels);  // 清理原始像素阵列
+        // mipmap：列出image会使用的两种view格式，驱动可以对MUTABLE_FORMAT的image保留压缩
+        std::array<VkFormat, 2> viewFormats = {texture.format, VK_FORMAT_R8G8B8A8_UNORM};
+        VkImageFormatListCreateInfo formatList{};
+        formatList.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO;
+        formatList.viewFormatCount = static_cast<uint32_t>(viewFormats.size());
+        formatList.pViewFormats = viewFormats.data();
 
-        // 上面buffer构建完成后也可以在shader中访问，但是最好创建image进行快速二维检索颜色
-        // 下面把buffer数据传给image
-        // 创建image对象
-        createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+        // 创建image对象，像素数据先写入staging空间再通过拷贝命令传给image，这样image可以使用optimal tiling进行快速二维检索
+        createImage(texture.width, texture.height, texture.mipLevels, texture.format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.allocation, MemoryCategory::texture, "decoded texture", 0, flags,
+            VK_SAMPLE_COUNT_1_BIT, (flags & VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT) ? &formatList : nullptr);
 
         // 把image布局转换到VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL，旧layout是undefined因为我们不关心image原本的内容
-        transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-        // 拷贝buffer内容到image
-            copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-        // 转换image布局，允许让着色器进行采样
-        transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        if (hostCopy) {
+            m_hostImageCopy.transition(texture.image, texture.mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+            return;
+        }
+        addLayoutTransition(barriers, texture.image, texture.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.mipLevels);
+    }
+
+    // texture image：解码后的像素已经在staging空间中，image的layout转换已经录制，拷贝并生成mip
+    // host image copy：hostCopied时level 0已经由cpu写入，没有传输队列的命令，也不需要转移所有权
+    void uploadDecodedTexture(Texture& texture, const StagingRing::Region& staging, bool hostCopied = false) {
+        bool blitMipmaps = supportsLinearBlit(texture.format) || texture.mipLevels == 1;  // mipmap：只有一级时generateMipmaps只转换layout
+
+        if (!hostCopied) {
+            // 拷贝buffer内容到image
+            copyBufferToImage(m_uploadContext.commandBuffer(), staging.buffer, staging.offset, texture.image, texture.width, texture.height);
+            // transfer queue：把所有level交给图形队列，layout保持TRANSFER_DST_OPTIMAL，生成mipmap时再转换
+            // 生成mipmap需要图形队列（blit和compute在传输队列上都不可用），最后转换到SHADER_READ_ONLY_OPTIMAL允许让着色器进行采样
+            VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mipLevels, 0, 1};
+            m_uploadContext.handoffImage(texture.image, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        }
+
+        if (blitMipmaps) {
+            generateMipmaps(texture.image, static_cast<int32_t>(texture.width), static_cast<int32_t>(texture.height), texture.mipLevels);
+        } else {
+            if (!m_computeMipmaps.isInitialized()) {
+                m_computeMipmaps.init(device, m_pipelineCache.handle(), embeddedShader(MIPMAP_SHADER));
+            }
+            m_computeMipmaps.generate(m_uploadContext, texture.image, VK_FORMAT_R8G8B8A8_UNORM, true, texture.width, texture.height, texture.mipLevels);
+        }
+
+        // staging ring：不需要销毁staging buffer，ring空间在提交完成后自动回收
+        createTextureView(texture);
+    }
+
+    // ktx2：按设备支持的格式选择BC7或ASTC文件，压缩块直接拷贝到image，mip也从文件读取不需要生成
+    // 压缩文件和原图放在一起，比如texture.jpg对应texture_bc7.ktx2和texture_astc.ktx2
+    // 没有可用的文件或者设备不支持时返回false，由调用者回退到未压缩的纹理
+    bool createCompressedTexture(TextureHandle handle, const std::string& sourcePath, Texture& texture) {
+        std::vector<VkFormat> candidates = {VK_FORMAT_BC7_SRGB_BLOCK, VK_FORMAT_ASTC_4x4_SRGB_BLOCK};
+#ifdef __APPLE__
+        std::swap(candidates[0], candidates[1]);  // apple gpu上ASTC是原生格式，优先使用
+#endif
+        VkFormat format = findSupportedFormatOrUndefined(candidates, VK_IMAGE_TILING_OPTIMAL,
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+        if (format == VK_FORMAT_UNDEFINED) {
+            return false;
+        }
+
+        // gltf：嵌入模型的图片没有对应的ktx2文件，材质直接引用的.ktx2图片不需要替换扩展名
+        if (sourcePath.find('#') != std::string::npos) {
+            return false;
+        }
+        Ktx2Texture ktx;
+        std::string path = sourcePath.size() > 5 && sourcePath.compare(sourcePath.size() - 5, 5, ".ktx2") == 0 ? sourcePath
+            : sourcePath.substr(0, sourcePath.find_last_of('.')) + (format == VK_FORMAT_BC7_SRGB_BLOCK ? TEXTURE_BC7_SUFFIX : TEXTURE_ASTC_SUFFIX);
+        if (!loadKtx2(path, ktx)) {
+            return false;
+        }
+        if (ktx.format != format) {
+            throw std::runtime_error("unexpected ktx2 texture format: " + path);  // 比如编码时没有指定srgb
+        }
+
+        texture.format = format;
+        texture.width = ktx.width;
+        texture.height = ktx.height;
+        texture.mipLevels = static_cast<uint32_t>(ktx.levels.size());
+
+        // texture streaming：启动时只上传mip尾部，其余level保持TRANSFER_DST_OPTIMAL直到流式加载
+        // 目前只有一个后台streamer，同时只有一张纹理流式加载，其余纹理完整上传
+        texture.residentLevel = 0;
+        if (!m_textureStreamer.isRunning()) {
+            while (texture.residentLevel + 1 < texture.mipLevels && std::max(ktx.levels[texture.residentLevel].width, ktx.levels[texture.residentLevel].height) > TEXTURE_STREAM_TAIL_SIZE) {
+                texture.residentLevel++;
+            }
+        }
+
+        // gpu decompression：compute只能在图形队列上执行，分块压缩的纹理的layout转换和所有level的拷贝都录制在图形队列的command buffer中，image不在队列之间转移
+        bool graphicsUpload = m_gpuDecompressor.initialized() && AssetPack::instance().compression(path) == AssetCompression::lz4Blocks;
+        VkCommandBuffer commandBuffer = graphicsUpload ? m_uploadContext.graphicsCommandBuffer() : m_uploadContext.commandBuffer();
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;  // residency：降级时作为拷贝的src
+
+        // host image copy：完整上传并且不在gpu上解压时，所有level由cpu直接写入SHADER_READ_ONLY_OPTIMAL的image，没有staging空间和命令
+        // 流式加载的纹理之后还要在上传队列上拷贝level，仍然使用原来的路径
+        if (!graphicsUpload && texture.residentLevel == 0 && m_hostImageCopy.usable(format, usage, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)) {
+            createImage(texture.width, texture.height, texture.mipLevels, format, VK_IMAGE_TILING_OPTIMAL, usage | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.allocation, MemoryCategory::texture, "compressed texture");
+            m_hostImageCopy.transition(texture.image, texture.mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            for (uint32_t i = 0; i < texture.mipLevels; i++) {
+                const Ktx2Level& level = ktx.levels[i];
+                std::vector<char> data = readKtx2Level(path, level);
+                m_hostImageCopy.copy(texture.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, data.data(), level.width, level.height, i);
+            }
+            createTextureView(texture);
+            return true;
+        }
+
+        createImage(texture.width, texture.height, texture.mipLevels, format, VK_IMAGE_TILING_OPTIMAL, usage,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture.image, texture.allocation, MemoryCategory::texture, "compressed texture");
+        transitionImageLayout(commandBuffer, texture.image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.mipLevels);
+
+        // gpu decompression：ktx2中小的level在前，需要上传的level是文件中连续的一段，一起解压
+        VkDeviceSize begin = ktx.levels[texture.residentLevel].offset;
+        VkDeviceSize end = begin;
+        for (uint32_t i = texture.residentLevel; i < texture.mipLevels; i++) {
+            begin = std::min(begin, ktx.levels[i].offset);
+            end = std::max(end, ktx.levels[i].offset + ktx.levels[i].size);
+        }
+        AssetBlockSpan span;
+        std::vector<char> input;
+        if (graphicsUpload && gpuDecompressible(path, begin, end - begin) && AssetPack::instance().readBlocks(path, begin, end - begin, span, input)) {
+            GpuDecompressor::Job job = m_gpuDecompressor.begin(span, input);
+            m_gpuDecompressor.record(commandBuffer, job);
+            for (uint32_t i = texture.residentLevel; i < texture.mipLevels; i++) {
+                const Ktx2Level& level = ktx.levels[i];
+                copyBufferToImage(commandBuffer, job.output.buffer, span.skip + (level.offset - begin), texture.image, level.width, level.height, i);
+            }
+            m_uploadContext.deferUntilComplete([this, job]() mutable { m_gpuDecompressor.finish(job); });
+        } else {
+            // staging ring：压缩格式的buffer offset必须是块大小（BC7和ASTC 4x4都是16字节）的整数倍
+            VkPhysicalDeviceProperties properties{};
+            vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+            VkDeviceSize alignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+            for (uint32_t i = texture.residentLevel; i < texture.mipLevels; i++) {
+                const Ktx2Level& level = ktx.levels[i];
+                std::vector<char> data = readKtx2Level(path, level);
+                StagingRing::Region staging = m_stagingRing.allocate(level.size, alignment);
+                memcpy(staging.mapped, data.data(), data.size());
+                copyBufferToImage(commandBuffer, staging.buffer, staging.offset, texture.image, level.width, level.height, i);
+            }
+        }
+
+        // transfer queue：已经写入的level交给图形队列时直接转换到SHADER_READ_ONLY_OPTIMAL；在图形队列上上传时只是layout转换
+        if (graphicsUpload) {
+            transitionImageLayout(commandBuffer, texture.image, format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                texture.mipLevels - texture.residentLevel, texture.residentLevel);
+        } else {
+            VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, texture.residentLevel, texture.mipLevels - texture.residentLevel, 0, 1};
+            m_uploadContext.handoffImage(texture.image, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        }
+
+        // gpu decompression：可以gpu解压的level在后台线程只复制压缩的block，cpu不解压
+        if (texture.residentLevel > 0) {
+            std::vector<Ktx2Level> levels = ktx.levels;
+            std::vector<bool> gpuLevels(levels.size(), false);
+            for (uint32_t i = 0; i < texture.residentLevel; i++) {
+                gpuLevels[i] = graphicsUpload && gpuDecompressible(path, levels[i].offset, levels[i].size);
+            }
+            m_textureStreamer.start(texture.residentLevel, [path, levels, gpuLevels](uint32_t level) {
+                AssetBlockSpan span;
+                std::vector<char> input;
+                if (gpuLevels[level] && AssetPack::instance().readBlocks(path, levels[level].offset, levels[level].size, span, input)) {
+                    return input;
+                }
+                return readKtx2Level(path, levels[level]);
+            });
+            m_textureLevels = std::move(levels);
+            m_textureLevelsGpu = std::move(gpuLevels);
+            m_streamedTexturePath = path;
+            m_textureStreamGraphics = graphicsUpload;
+            m_streamedTexture = handle;
+        }
+
+        createTextureView(texture);
+        return true;
+    }
+
+    // gpu decompression：pack中分块压缩并且足够大的范围交给gpu解压；只按大小判断，读取数据之前就可以决定
+    // 输入的大小按最坏情况（所有block都没有压缩）估计
+    bool gpuDecompressible(const std::string& path, VkDeviceSize offset, VkDeviceSize size) {
+        size_t blobSize = 0;
+        if (!m_gpuDecompressor.initialized() || size < GPU_DECOMPRESSION_MIN_BYTES || AssetPack::instance().compression(path) != AssetCompression::lz4Blocks
+            || !AssetPack::instance().size(path, blobSize)) {
+            return false;
+        }
+        AssetBlockSpan span = assetBlockSpan(blobSize, offset, size);
+        return m_gpuDecompressor.fits(span, static_cast<size_t>(span.outputSize + (span.blockCount + 1) * sizeof(uint32_t)));
+    }
+
+    // texture cache：引用计数归零并且使用它的帧完成后由deletion queue调用
+    void destroyTexture(const Texture& texture) {
+        // texture atlas：image、view和bindless元素属于atlas page，page中最后一个纹理释放时才销毁
+        if (texture.atlasPage != UINT32_MAX) {
+            if (--m_atlasPageRefs[texture.atlasPage] == 0) {
+                destroyTexture(m_atlasPages[texture.atlasPage]);
+            }
+            return;
+        }
+
+        m_bindlessTextures.remove(texture.bindlessIndex);
+        vkDestroyImageView(device, texture.view, hostAllocator());
+        m_imageStates.forget(texture.image);
+        vkDestroyImage(device, texture.image, hostAllocator());
+        Allocation allocation = texture.allocation;
+        m_allocator.free(allocation);
+    }
+
+    // texture streaming：根据相机距离请求需要的mip，上传后台读取完成的level，上传完成后切换到包含新level的image view
+    void updateTextureStreaming() {
+        if (!m_textureStreamer.isRunning()) {
+            return;
+        }
+        Texture& texture = m_textureCache.get(m_streamedTexture);
+
+        // 模型在原点，距离每增加一倍屏幕上的texel密度大约减半，需要的mip降低一级
+        float distance = glm::length(m_camera.position());
+        uint32_t wantedLevel = 0;
+        if (distance > TEXTURE_STREAM_DISTANCE) {
+            wantedLevel = static_cast<uint32_t>(std::floor(std::log2(distance / TEXTURE_STREAM_DISTANCE)));
+        }
+        m_textureStreamer.request(wantedLevel);
+
+        // upload scheduler：读取完成的level按4行一组的压缩块分成不超过UPLOAD_TEXTURE_REGION_BYTES的区域，每个区域单独申请
+        // 模型在原点，和选择level一样按到原点的距离排序；同一张纹理的区域优先级相同，按顺序授权
+        // gpu decompression：压缩的level整个解压，作为一个区域申请，字节数是上传的压缩数据
+        TextureStreamer::LoadedLevel loaded;
+        while (m_textureStreamer.popLoaded(loaded)) {
+            const Ktx2Level& level = m_textureLevels[loaded.level];
+            auto data = std::make_shared<std::vector<char>>(std::move(loaded.data));
+            uint32_t blockRows = (level.height + 3) / 4;
+            VkDeviceSize rowBytes = level.size / blockRows;
+            uint32_t rowsPerRegion = static_cast<uint32_t>(std::max<VkDeviceSize>(1, UPLOAD_TEXTURE_REGION_BYTES / rowBytes));
+            if (m_textureLevelsGpu[loaded.level]) {
+                UploadScheduler::RequestId request = m_uploadScheduler.request(data->size(), 1, [this]() { return uploadPriority({glm::vec3(0.0f), glm::vec3(0.0f)}); });
+                m_textureStreamRegions.push_back({loaded.level, 0, blockRows, rowBytes, data, request});
+                continue;
+            }
+            for (uint32_t row = 0; row < blockRows; row += rowsPerRegion) {
+                uint32_t rows = std::min(rowsPerRegion, blockRows - row);
+                UploadScheduler::RequestId request = m_uploadScheduler.request(rows * rowBytes, 1, [this]() { return uploadPriority({glm::vec3(0.0f), glm::vec3(0.0f)}); });
+                m_textureStreamRegions.push_back({loaded.level, row, rows, rowBytes, data, request});
+            }
+        }
+
+        bool uploaded = false;
+        while (!m_textureStreamRegions.empty() && m_uploadScheduler.granted(m_textureStreamRegions.front().request)) {
+            const TextureStreamRegion& region = m_textureStreamRegions.front();
+            const Ktx2Level& level = m_textureLevels[region.level];
+            VkCommandBuffer commandBuffer = m_textureStreamGraphics ? m_uploadContext.graphicsCommandBuffer() : m_uploadContext.commandBuffer();
+            if (m_textureLevelsGpu[region.level]) {
+                size_t blobSize = 0;
+                AssetPack::instance().size(m_streamedTexturePath, blobSize);
+                GpuDecompressor::Job job = m_gpuDecompressor.begin(assetBlockSpan(blobSize, level.offset, level.size), *region.data);
+                m_gpuDecompressor.record(commandBuffer, job);
+                copyBufferToImage(commandBuffer, job.output.buffer, job.span.skip, texture.image, level.width, level.height, region.level);
+                m_uploadContext.deferUntilComplete([this, job]() mutable { m_gpuDecompressor.finish(job); });
+            } else {
+                VkPhysicalDeviceProperties properties{};
+                vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+                VkDeviceSize alignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+                VkDeviceSize size = region.rowCount * region.rowBytes;
+                StagingRing::Region staging = m_stagingRing.allocate(size, alignment);
+                memcpy(staging.mapped, region.data->data() + region.firstRow * region.rowBytes, size);
+                uint32_t y = region.firstRow * 4;
+                copyBufferToImage(commandBuffer, staging.buffer, staging.offset, texture.image, level.width, std::min(region.rowCount * 4, level.height - y),
+                    region.level, static_cast<int32_t>(y));
+            }
+
+            // level的最后一个区域录制之后整个level交给图形队列，在图形队列上拷贝时只转换layout
+            if (region.firstRow + region.rowCount == (level.height + 3) / 4) {
+                if (m_textureStreamGraphics) {
+                    transitionImageLayout(commandBuffer, texture.image, texture.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        1, region.level);
+                } else {
+                    VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, region.level, 1, 0, 1};
+                    m_uploadContext.handoffImage(texture.image, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+                }
+                m_textureStreamUploads.push_back({region.level, m_uploadContext.pendingTicket()});
+            }
+            m_textureStreamRegions.pop_front();
+            uploaded = true;
+        }
+        if (uploaded) {
+            m_uploadContext.submit();
+        }
+
+        // level按从低精度到高精度的顺序上传，view的baseMipLevel只在上传完成后前移
+        uint32_t residentLevel = texture.residentLevel;
+        while (!m_textureStreamUploads.empty() && m_uploadContext.isComplete(m_textureStreamUploads.front().second)) {
+            residentLevel = m_textureStreamUploads.front().first;
+            m_textureStreamUploads.pop_front();
+        }
+        if (residentLevel == texture.residentLevel) {
+            return;
+        }
+
+        // 未上传的level不是SHADER_READ_ONLY_OPTIMAL，不能只靠sampler的minLod限制，需要重建不包含它们的view
+        // bindless：旧view和它的数组元素可能还被已提交的帧使用，新view写入新的元素，旧的交给deletion queue
+        VkImageView oldView = texture.view;
+        uint32_t oldBindlessIndex = texture.bindlessIndex;
+        m_deletionQueue.push(m_frameNumber, [this, oldView, oldBindlessIndex]() {
+            vkDestroyImageView(device, oldView, hostAllocator());
+            m_bindlessTextures.remove(oldBindlessIndex);
+        });
+        texture.residentLevel = residentLevel;
+        createTextureView(texture);
+    }
+
+    // 拷贝完成的纹理换成新的image，旧的image和view可能还被已提交的帧使用，交给deletion queue
+    // 拷贝期间纹理被释放时新的image还没有被使用，直接销毁；拷贝在降级的那一帧提交，之后的帧释放旧image时timeline已经排在拷贝之后
+    // defragment：搬移的纹理同样在这里替换，handle不变，材质每帧重新解析纹理的bindless元素
+    void replaceCopiedTextures() {
+        for (size_t i = 0; i < m_mipDrops.size();) {
+            MipDrop& drop = m_mipDrops[i];
+            if (!m_uploadContext.isComplete(drop.ticket)) {
+                i++;
+                continue;
+            }
+            if (m_textureCache.contains(drop.handle)) {
+                Texture& texture = m_textureCache.get(drop.handle);
+                Texture old = texture;
+                m_deletionQueue.push(m_frameNumber, [this, old]() { destroyTexture(old); });
+                texture.image = drop.texture.image;
+                texture.allocation = drop.texture.allocation;
+                texture.width = drop.texture.width;
+                texture.height = drop.texture.height;
+                texture.mipLevels = drop.texture.mipLevels;
+                createTextureView(texture);
+            } else {
+                vkDestroyImage(device, drop.texture.image, hostAllocator());
+                m_allocator.free(drop.texture.allocation);
+            }
+            m_mipDrops.erase(m_mipDrops.begin() + i);
+        }
+    }
+
+    // residency：记录视锥中的mesh使用的纹理，device local的使用量接近预算时按最久没有使用的顺序降级纹理
+    // 视锥和上传的优先级一样按导入时的包围盒判断，不考虑遮挡；不在视锥中的纹理只登记，第一次登记的帧算作使用过
+    void updateResidency() {
+        if (!RESIDENCY_MANAGEMENT) {
+            return;
+        }
+        m_residencyFrame++;
+        std::array<glm::vec4, 6> planes = FrustumCuller::extractPlanes(m_camera.project() * m_camera.view() * m_transforms.world(m_modelEntity));
+        for (size_t i = 0; i < m_meshes.size(); i++) {
+            if (m_meshes[i].indexCount == 0 || !isMeshVisible(i)) {
+                continue;
+            }
+            const Aabb& bounds = m_meshBounds[i];
+            bool visible = std::all_of(planes.begin(), planes.end(), [&bounds](const glm::vec4& plane) {
+                glm::vec3 farthest = glm::mix(bounds.min, bounds.max, glm::greaterThanEqual(glm::vec3(plane), glm::vec3(0.0f)));
+                return glm::dot(glm::vec3(plane), farthest) + plane.w >= 0.0f;
+            });
+            if (visible) {
+                m_textureResidency.touch(m_meshTextures[i], m_residencyFrame);
+            } else {
+                m_textureResidency.track(m_meshTextures[i], m_residencyFrame);
+            }
+        }
+
+        // memory budget：stats在这一帧开始时刷新，降级中的纹理按已经释放的字节数计算
+        const MemoryStats& stats = m_allocator.stats();
+        VkDeviceSize usage = stats.deviceLocalUsage();
+        bool pressure = m_memoryPressure;
+        m_memoryPressure = false;
+        if (!pressure && usage <= static_cast<VkDeviceSize>(static_cast<double>(stats.deviceLocalBudget()) * RESIDENCY_HIGH_FRACTION)) {
+            return;
+        }
+        VkDeviceSize target = static_cast<VkDeviceSize>(static_cast<double>(stats.deviceLocalBudget()) * RESIDENCY_LOW_FRACTION);
+        VkDeviceSize released = 0;
+        for (const MipDrop& drop : m_mipDrops) {
+            if (m_textureCache.contains(drop.handle)) {
+                released += releasedBytes(m_textureCache.get(drop.handle), drop.texture);
+            }
+        }
+
+        // 打包进atlas的纹理共享page的image不能单独降级；流式加载中的纹理和只剩mip尾部的纹理也跳过
+        m_textureResidency.leastRecentlyUsed(m_residencyFrame, RESIDENCY_IDLE_FRAMES, m_residencyVictims);
+        uint32_t drops = 0;
+        for (uint32_t handle : m_residencyVictims) {
+            if (usage <= target + released || drops >= RESIDENCY_MAX_DROPS_PER_FRAME) {
+                break;
+            }
+            if (!m_textureCache.contains(handle)) {
+                m_textureResidency.forget(handle);  // 纹理已经释放
+                continue;
+            }
+            const Texture& texture = m_textureCache.get(handle);
+            bool dropping = std::any_of(m_mipDrops.begin(), m_mipDrops.end(), [handle](const MipDrop& drop) { return drop.handle == handle; });
+            if (dropping || texture.atlasPage != UINT32_MAX || handle == m_streamedTexture || texture.residentLevel != 0 || texture.mipLevels < 2
+                || std::max(texture.width, texture.height) <= RESIDENCY_MIN_TEXTURE_SIZE) {
+                continue;
+            }
+            released += dropTextureMip(handle);
+            drops++;
+        }
+        if (drops > 0) {
+            m_uploadContext.submit();
+        }
+    }
+
+    // residency：纹理去掉最高一级mip，其余level在图形队列上拷贝到新的image，返回拷贝完成后释放的字节数
+    // 旧image拷贝期间仍然在被采样，拷贝前后都是SHADER_READ_ONLY_OPTIMAL；新image在updateResidency中等拷贝完成后替换
+    VkDeviceSize dropTextureMip(TextureHandle handle) {
+        const Texture& texture = m_textureCache.get(handle);
+        Texture dropped;
+        dropped.format = texture.format;
+        dropped.width = std::max(1u, texture.width / 2);
+        dropped.height = std::max(1u, texture.height / 2);
+        dropped.mipLevels = texture.mipLevels - 1;
+        createImage(dropped.width, dropped.height, dropped.mipLevels, dropped.format, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, dropped.image,
+            dropped.allocation, MemoryCategory::texture, "residency texture");
+
+        VkCommandBuffer commandBuffer = m_uploadContext.graphicsCommandBuffer();
+        ImageBarrierBatch barriers;
+        addLayoutTransition(barriers, texture.image, texture.format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dropped.mipLevels, 1);
+        addLayoutTransition(barriers, dropped.image, dropped.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, dropped.mipLevels);
+        barriers.record(commandBuffer);
+
+        // 压缩格式的level尺寸不是块大小的整数倍时拷贝范围到达level的边缘，两边的level尺寸相同
+        std::vector<VkImageCopy> regions(dropped.mipLevels);
+        for (uint32_t i = 0; i < dropped.mipLevels; i++) {
+            regions[i].srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i + 1, 0, 1};
+            regions[i].dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+            regions[i].extent = {std::max(1u, texture.width >> (i + 1)), std::max(1u, texture.height >> (i + 1)), 1};
+        }
+        vkCmdCopyImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dropped.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()), regions.data());
+
+        addLayoutTransition(barriers, texture.image, texture.format, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, dropped.mipLevels, 1);
+        addLayoutTransition(barriers, dropped.image, dropped.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, dropped.mipLevels);
+        barriers.record(commandBuffer);
+
+        m_mipDrops.push_back({handle, dropped, m_uploadContext.pendingTicket()});
+        return releasedBytes(texture, dropped);
+    }
+
+    static VkDeviceSize releasedBytes(const Texture& texture, const Texture& dropped) {
+        return texture.allocation.size > dropped.allocation.size ? texture.allocation.size - dropped.allocation.size : 0;
+    }
+
+    // defragment：纹理streaming和residency长时间运行之后，block中留下很多零散的空闲区间，新的纹理只能申请新的block
+    // 选一个占用率低、其中全是可以搬移的纹理的block，allocator在清空期间不再从它分配，纹理逐帧用图形队列拷贝到其它block
+    // 拷贝完成后replaceCopiedTextures换成新的image，旧image由deletion queue释放，block中最后一个子分配释放时还给驱动
+    // 新加载的纹理可能还在等待上传完成，layout不是SHADER_READ_ONLY_OPTIMAL，所以只在没有进行中的上传时开始拷贝
+    void updateDefragmentation() {
+        if (!DEFRAGMENT_MEMORY || !m_uploadContext.idle()) {
+            return;
+        }
+        const MemoryBlock* block = m_allocator.evacuatingBlock();
+        if (block == nullptr) {
+            block = selectDefragBlock();
+            if (block == nullptr) {
+                return;
+            }
+            m_allocator.beginEvacuation(*block);
+        }
+
+        VkDeviceSize copied = 0;
+        for (size_t i = 0; i < m_textureCache.size() && copied < DEFRAG_BYTES_PER_FRAME; i++) {
+            TextureHandle handle = m_textureCache.handleAt(i);
+            if (m_textureCache.get(handle).allocation.block == block && movableTexture(handle)) {
+                copied += moveTexture(handle);
+            }
+        }
+        if (copied > 0) {
+            m_uploadContext.submit();
+        }
+    }
+
+    // defragment：atlas中的纹理共享page的image，流式加载中的纹理还在上传level，降级或者搬移中的纹理已经有新的image
+    bool movableTexture(TextureHandle handle) const {
+        const Texture& texture = m_textureCache.get(handle);
+        bool copying = std::any_of(m_mipDrops.begin(), m_mipDrops.end(), [handle](const MipDrop& drop) { return drop.handle == handle; });
+        return !copying && texture.allocation.block != nullptr && texture.atlasPage == UINT32_MAX && handle != m_streamedTexture && texture.residentLevel == 0;
+    }
+
+    // defragment：block的全部子分配都是可以搬移的纹理才能清空；占用率最低的block需要拷贝的字节最少
+    const MemoryBlock* selectDefragBlock() {
+        std::unordered_map<const MemoryBlock*, VkDeviceSize> movableBytes;
+        for (size_t i = 0; i < m_textureCache.size(); i++) {
+            TextureHandle handle = m_textureCache.handleAt(i);
+            if (movableTexture(handle)) {
+                const Allocation& allocation = m_textureCache.get(handle).allocation;
+                movableBytes[allocation.block] += allocation.size;
+            }
+        }
+        const MemoryBlock* best = nullptr;
+        VkDeviceSize bestUsed = 0;
+        for (const auto& [block, bytes] : movableBytes) {
+            VkDeviceSize used = DeviceMemoryAllocator::usedBytes(*block);
+            if (bytes != used || static_cast<double>(used) > static_cast<double>(block->size) * DEFRAG_MAX_OCCUPANCY || !m_allocator.canEvacuate(*block)) {
+                continue;
+            }
+            if (best == nullptr || used < bestUsed) {
+                best = block;
+                bestUsed = used;
+            }
+        }
+        return best;
+    }
+
+    // defragment：整个mip链拷贝到新的image，尺寸和格式不变，旧image拷贝期间仍然在被采样，拷贝前后都是SHADER_READ_ONLY_OPTIMAL
+    // 新image的分配跳过正在清空的block；资源名沿用旧的分配，memory report中的统计不变
+    VkDeviceSize moveTexture(TextureHandle handle) {
+        const Texture& texture = m_textureCache.get(handle);
+        Texture moved;
+        moved.format = texture.format;
+        moved.width = texture.width;
+        moved.height = texture.height;
+        moved.mipLevels = texture.mipLevels;
+        createImage(moved.width, moved.height, moved.mipLevels, moved.format, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, moved.image,
+            moved.allocation, MemoryCategory::texture, texture.allocation.name);
+
+        VkCommandBuffer commandBuffer = m_uploadContext.graphicsCommandBuffer();
+        ImageBarrierBatch barriers;
+        addLayoutTransition(barriers, texture.image, texture.format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, moved.mipLevels);
+        addLayoutTransition(barriers, moved.image, moved.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, moved.mipLevels);
+        barriers.record(commandBuffer);
+
+        std::vector<VkImageCopy> regions(moved.mipLevels);
+        for (uint32_t i = 0; i < moved.mipLevels; i++) {
+            regions[i].srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+            regions[i].dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+            regions[i].extent = {std::max(1u, texture.width >> i), std::max(1u, texture.height >> i), 1};
+        }
+        vkCmdCopyImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, moved.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()), regions.data());
+
+        addLayoutTransition(barriers, texture.image, texture.format, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, moved.mipLevels);
+        addLayoutTransition(barriers, moved.image, moved.format, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, moved.mipLevels);
+        barriers.record(commandBuffer);
+
+        m_mipDrops.push_back({handle, moved, m_uploadContext.pendingTicket()});
+        return texture.allocation.size;
+    }
+
+    // impostor：resident的模型的mesh在上传的图形队列command buffer中烘焙level 0，和mipmap生成一样排在这次上传的拷贝之后
+    // 这个command buffer单独绑定纹理数组和geometry buffer；tile在ticket完成之后才被selectImpostors使用
+    // atlas满了时剩下的mesh等卸载的模型归还tile，占位mesh不烘焙
+    void updateImpostors() {
+        if (!useImpostors()) {
+            return;
+        }
+        for (MeshImpostor& impostor : m_meshImpostors) {
+            if (impostor.tile.valid() && !impostor.baked && m_uploadContext.isComplete(impostor.ticket)) {
+                impostor.baked = true;
+            }
+        }
+
+        uint32_t baked = 0;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        for (size_t i = 0; i < m_meshes.size() && baked < IMPOSTOR_BAKES_PER_FRAME; i++) {
+            MeshImpostor& impostor = m_meshImpostors[i];
+            const MeshRange& mesh = m_meshes[i];
+            if (impostor.tile.valid() || mesh.indexCount == 0 || m_meshModels[i] == INVALID_MODEL_HANDLE || !isMeshVisible(i)) {
+                continue;
+            }
+            if (!m_impostors.allocate(impostor.tile)) {
+                break;
+            }
+            if (commandBuffer == VK_NULL_HANDLE) {
+                commandBuffer = m_uploadContext.graphicsCommandBuffer();
+                if (m_descriptorBuffer.initialized()) {
+                    m_descriptorBuffer.bind(commandBuffer);
+                    VkDeviceSize bindlessOffset = m_bindlessTextures.bufferOffset();
+                    m_descriptorBuffer.setOffsets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, &bindlessOffset, 1);
+                } else {
+                    VkDescriptorSet bindlessSet = m_bindlessTextures.set();
+                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &bindlessSet, 0, nullptr);
+                }
+                m_geometryBuffer.bind(commandBuffer, VK_INDEX_TYPE_UINT32);
+            }
+            m_geometryBuffer.bindIndices(commandBuffer, mesh.indexType);
+
+            // 烘焙最细的level，lod只影响近处的mesh
+            const MeshLodChain& lods = m_meshLods[i];
+            uint32_t firstIndex = mesh.firstIndex + (lods.levels.empty() ? 0 : lods.levels[0].firstIndex);
+            uint32_t indexCount = lods.levels.empty() ? mesh.indexCount : lods.levels[0].indexCount;
+            const Aabb& bounds = m_meshBounds[i];
+            glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+            float radius = std::max(glm::length(bounds.max - bounds.min) * 0.5f, 1e-4f);
+            DrawPushConstants pushConstants = meshPushConstants(i);
+            m_impostors.bake(commandBuffer, impostor.tile, center, radius, [&](VkCommandBuffer cmd, const glm::mat4& viewProj) {
+                pushConstants.model = viewProj * m_meshTransforms[i];
+                vkCmdPushConstants(cmd, pipelineLayout, m_drawPushConstantStages, 0, sizeof(pushConstants), &pushConstants);
+                vkCmdDrawIndexed(cmd, indexCount, 1, firstIndex, mesh.vertexOffset, 0);
+            });
+            impostor.ticket = m_uploadContext.pendingTicket();
+            baked++;
+        }
+        if (baked > 0) {
+            m_uploadContext.submit();
+        }
+    }
+
+    // mipmap：检查格式是否可以用linear filter的vkCmdBlitImage生成mip
+    bool supportsLinearBlit(VkFormat imageFormat) {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, imageFormat, &formatProperties);
+
+        VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+        return (formatProperties.optimalTilingFeatures & required) == required;
+    }
+
+    // mipmap：在图形队列上用vkCmdBlitImage逐级生成mip，每一级从上一级缩小一半
+    // 调用前所有level处于TRANSFER_DST_OPTIMAL并且level 0已经写入，调用后所有level处于SHADER_READ_ONLY_OPTIMAL
+    void generateMipmaps(VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
+        VkCommandBuffer commandBuffer = m_uploadContext.graphicsCommandBuffer();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = image;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.subresourceRange.levelCount = 1;  // 每次只转换一个level
+
+        int32_t mipWidth = texWidth;
+        int32_t mipHeight = texHeight;
+
+        for (uint32_t i = 1; i < mipLevels; i++) {
+            // 上一级写入完成后转换成blit的src
+            barrier.subresourceRange.baseMipLevel = i - 1;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier);
+
+            // src和dst区域，dst是src的一半，尺寸为1时不再减半
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = {0, 0, 0};
+            blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = i - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = 1;
+            blit.dstOffsets[0] = {0, 0, 0};
+            blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1};
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = i;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = 1;
+
+            // src和dst是同一个image的不同level，VK_FILTER_LINEAR需要格式支持linear filter
+            vkCmdBlitImage(commandBuffer,
+                image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit,
+                VK_FILTER_LINEAR);
+
+            // 上一级已经不再使用，转换成shader读取
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier);
+
+            if (mipWidth > 1) mipWidth /= 2;
+            if (mipHeight > 1) mipHeight /= 2;
+        }
 
-        // 传输完成清楚staging buffer
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        // 最后一级没有作为blit的src，直接从TRANSFER_DST转换
+        barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
     }
 
-    // sampler：创建texture image view
-    void createTextureImageView() {
-        textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+    // sampler：创建texture image view，texture streaming：只包含已经常驻的level
+    // bindless：新view写入纹理数组的空闲元素，shader通过bindlessIndex访问
+    void createTextureView(Texture& texture) {
+        texture.view = createImageView(texture.image, texture.format, VK_IMAGE_ASPECT_COLOR_BIT, texture.mipLevels - texture.residentLevel, texture.residentLevel);
+        texture.bindlessIndex = m_bindlessTextures.add(texture.view, textureSampler);
     }
 
-    // sampler：创建采样器
+    // sampler：创建采样器，sampler cache：从cache获取，其他材质使用相同参数时共享
     void createTextureSampler() {
         VkPhysicalDeviceProperties properties{};
         vkGetPhysicalDeviceProperties(physicalDevice, &properties);  // 通过物理设备查询最佳采样数量
@@ -1098,20 +5739,21 @@ private:
         samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
         samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
         samplerInfo.anisotropyEnable = VK_TRUE;  // 开启各向异性过滤，一般开启
-        samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;  // 限制用于计算texel颜色的样本数量
+        samplerInfo.maxAnisotropy = std::min(properties.limits.maxSamplerAnisotropy, m_quality.settings().maxAnisotropy);  // 限制用于计算texel颜色的样本数量，quality tier较低时减少
         samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;  // 指定环绕模式为border时的颜色
         samplerInfo.unnormalizedCoordinates = VK_FALSE;  // 指定坐标系统，这里是01坐标，也可以是0 width，0 height坐标
         samplerInfo.compareEnable = VK_FALSE;  // 用于shadow map的PCF，开启后texel会首先与一个值比较然后把结果用于过滤
         samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;  // 用于PCF
         samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.minLod = 0.0f;  // mipmap：lod范围覆盖整个mip链
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;  // texture cache：所有纹理共享sampler，mip数量由image view限制
+        samplerInfo.mipLodBias = 0.0f;
 
-        if (vkCreateSampler(device, &samplerInfo, nullptr, &textureSampler) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create texture sampler!");
-        }
+        textureSampler = m_samplerCache.get(samplerInfo);
     }
 
     // sampler：texture采样以及swap chain都要image view
-    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags) {
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, uint32_t baseMipLevel = 0) {
         VkImageViewCreateInfo viewInfo{};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         viewInfo.image = image;
@@ -1125,13 +5767,13 @@ private:
         viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
         // subresourcerange描述如何使用图像以及哪一部分，这里用作color target
         viewInfo.subresourceRange.aspectMask = aspectFlags;  // depth buffering：可能是color也可能是depth所以写成参数
-        viewInfo.subresourceRange.baseMipLevel = 0;
-        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseMipLevel = baseMipLevel;  // texture streaming：只包含已经常驻的level
+        viewInfo.subresourceRange.levelCount = mipLevels;
         viewInfo.subresourceRange.baseArrayLayer = 0;
         viewInfo.subresourceRange.layerCount = 1;
 
         VkImageView imageView;
-        if (vkCreateImageView(device, &viewInfo, nullptr, &imageView) != VK_SUCCESS) {
+        if (vkCreateImageView(device, &viewInfo, hostAllocator(), &imageView) != VK_SUCCESS) {
             throw std::runtime_error("failed to create image view!");
         }
 
@@ -1139,14 +5781,17 @@ private:
     }
 
     // image texture：创建image
-    void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+    void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, Allocation& imageAllocation, MemoryCategory category,
+        const char* name, VkMemoryPropertyFlags preferred = 0, VkImageCreateFlags flags = 0, VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT, const void* next = nullptr) {
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.pNext = next;  // mipmap：MUTABLE_FORMAT的image可以链接VkImageFormatListCreateInfo
         imageInfo.imageType = VK_IMAGE_TYPE_2D;  // 指定image类型，处理成什么坐标系，可以是一维二维三维
         imageInfo.extent.width = width;
         imageInfo.extent.height = height;
         imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.flags = flags;  // mipmap：compute生成mip时需要MUTABLE_FORMAT
         imageInfo.arrayLayers = 1;
         imageInfo.format = format;  // 格式和buffer一样否则拷贝会失败
         imageInfo.tiling = tiling;  // 可以是linear或optimal，linear是行主序，optimal是优化排序，如果要直接访问需要用linear，但我们使用了staging buffer处理直接访问所以这里用optimize达到image最佳访问
@@ -1154,10 +5799,10 @@ private:
         //很少会选择preinitialized，除非是和tiling linear结合使用的staging image，这种情况会把texel数据传到image并且不丢失数据的情况下把图像作为传输源
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         imageInfo.usage = usage;  // 作为传输目标，并且包含sampled bit用于着色器访问
-        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;  // 可以设置多重采样，只有attchment的image需要设置
+        imageInfo.samples = samples;  // 可以设置多重采样，只有attchment的image需要设置
         imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;  // 被一个queuefamily使用
 
-        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+        if (vkCreateImage(device, &imageInfo, hostAllocator(), &image) != VK_SUCCESS) {
             throw std::runtime_error("failed to create image!");
         }
 
@@ -1165,83 +5810,43 @@ private:
         VkMemoryRequirements memRequirements;
         vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate image memory!");
-        }
+        // memory allocator：optimal tiling的image和buffer放在不同pool，避免违反bufferImageGranularity
+        imageAllocation = m_allocator.allocate(memRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR, category, preferred, name);
 
-        vkBindImageMemory(device, image, imageMemory, 0);
+        vkBindImageMemory(device, image, imageAllocation.memory, imageAllocation.offset);
     }
 
     // image texture：处理layout转换，确保image处于正确layout中
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-        // 使用pipeline barrier用于同步访问资源
-        // 比如buffer读取之前完成buffer写入
-        // 使用VK_SHARING_MODE_EXCLUSIVE时，可以用于image layout转换和转移queuefamily所有权
-        VkImageMemoryBarrier barrier{};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.oldLayout = oldLayout;  // 旧layout，如果不关心现有内容可以使用undefined
-        barrier.newLayout = newLayout;  // 新layout
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;  // 如果转移queue family所有权需要设置queue family索引，否则必须设置ignored因为ignored不是默认值
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = image;  // 指定影响的image
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-
-        VkPipelineStageFlags sourceStage;  // 指定发生在barrier之前的操作和资源
-        VkPipelineStageFlags destinationStage;  // 指定在barrier上等待的操作和资源
-
-        if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {  // undefined到传输操作
-            barrier.srcAccessMask = 0;  // 写操作不需要等待任何操作，指定空掩码
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;  // 写操作进行等待
-
-            sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;  // VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT是最早的管线阶段，也就是不等待
-            destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;  // VK_PIPELINE_STAGE_TRANSFER_BIT并不是一个真实管线阶段，而是传输的伪阶段
-        } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {  // 传输操作到shader读取操作
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;  // 需要写操作先发生
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;  // shader读取，主要是fragment shader进行纹理采样，所以fs设置时需要指定是否有读取操作
-
-            sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;  // 需要transfer阶段先发生
-            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;  // shader读取阶段等待
-        } else {
-            throw std::invalid_argument("unsupported layout transition!");
-        }
-
-        // 提交barrier命令
-        vkCmdPipelineBarrier(
-            commandBuffer,
-            sourceStage, destinationStage,  // sourceStage指定哪个管线阶段发生的操作在barrier之前发生，destinationStage指定哪个管线阶段发生的操作在barrier上等待
-            0,  // 可以设置成VK_DEPENDENCY_BY_REGION_BIT，把barrier设置区域状态，允许写完的区域进行读取，更细粒度
-            0, nullptr,  // 内存屏障，memory barrier
-            0, nullptr,  // 缓冲区内存屏障，buffer memory barrier
-            1, &barrier  // 图像内存屏障，image memory barrier
-        );
+    // image barrier：录制进调用者提供的command buffer，一般是upload context当前的command buffer，和其它上传一起提交
+    void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels,
+        uint32_t baseMipLevel = 0) {
+        ImageBarrierBatch barriers;
+        addLayoutTransition(barriers, image, format, oldLayout, newLayout, mipLevels, baseMipLevel);
+        barriers.record(commandBuffer);
+    }
 
-        endSingleTimeCommands(commandBuffer);
+    // image barrier：只生成barrier加入batch，多张image的转换由batch合并成一次vkCmdPipelineBarrier
+    void addLayoutTransition(ImageBarrierBatch& barriers, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels,
+        uint32_t baseMipLevel = 0) {
+        // 使用pipeline barrier用于同步访问资源，比如image读取之前完成image写入，同时转换layout
+        // synchronization2：stage和access由m_imageStates按image最近一次的访问生成，任意两个layout之间都可以转换，同一个layout的读取之间不录制barrier
+        VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, baseMipLevel, mipLevels, 0, 1};
+        m_imageStates.transition(barriers, image, range, ImageState::forLayout(oldLayout), ImageState::forLayout(newLayout));
     }
 
     // image texture：辅助函数用于拷贝buffer到image
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
+    // upload scheduler：offsetY不为0时只拷贝从这一行开始的height行，压缩格式需要是块高度的整数倍
+    void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevel = 0,
+        int32_t offsetY = 0) {
         VkBufferImageCopy region{};  // 决定buffer哪一部分拷贝到image哪一部分
-        region.bufferOffset = 0;
+        region.bufferOffset = bufferOffset;  // staging ring：数据在ring中的偏移
         region.bufferRowLength = 0;
         region.bufferImageHeight = 0;
         region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.mipLevel = mipLevel;
         region.imageSubresource.baseArrayLayer = 0;
         region.imageSubresource.layerCount = 1;
-        region.imageOffset = {0, 0, 0};
+        region.imageOffset = {0, offsetY, 0};
         region.imageExtent = {
             width,
             height,
@@ -1250,517 +5855,4519 @@ private:
 
         // 执行拷贝命令，其中VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL是因为我们假设这时候image已经是最佳布局
         vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-        endSingleTimeCommands(commandBuffer);
     }
 
-    // model loading：obj文件加载，obj文件由位置、法线、纹理坐标、面组成，面通过顶点组成，顶点通过索引指向一个位置、法线、纹理坐标，使其可以重复使用整个顶点也可以重复使用顶点的属性
-    void loadModel() {
-        tinyobj::attrib_t attrib;  // attrib_t存有所有vertices、normals、texcoords
-        std::vector<tinyobj::shape_t> shapes;  // shape_t存有独立对象和其面，面由一个顶点数组组成
-        std::vector<tinyobj::material_t> materials;  // obj每个面可以定义材料和纹理这里暂时不用
-        std::string warn, err;
-
-        // obj文件中一个面其实可以包含任意数量顶点而不只是三角形，不过loadObj会默认对多个顶点的面进行三角形处理
-        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
-            throw std::runtime_error(warn + err);
+    // model loader：在job pool中执行，只读取文件和使用job pool，不访问vulkan对象和主线程的成员
+    // mesh cache：缓存有效时直接使用映射的文件，否则导入obj并写入缓存；gltf在这里只解析，上传时直接写入目标位置
+    LoadedModel loadModelData(const std::string& path) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        LoadedModel model;
+        if (isGltfPath(path)) {
+            model.gltf = std::make_unique<tinygltf::Model>();
+            loadGltfModel(path, *model.gltf);
+            if (SHOW_STARTUP_TIMINGS) {
+                float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+                std::cout << "gltf parse: " << model.gltf->meshes.size() << " meshes, " << model.gltf->images.size() << " images, " << ms << " ms" << std::endl;
+            }
+            return model;
         }
 
-        std::unordered_map<Vertex, uint32_t> uniqueVertices{};  // 顶点去重，每个vertex对应一个index
-
-        for (const auto& shape : shapes) {
-            for (const auto& index : shape.mesh.indices) {  // 遍历顶点索引
-                Vertex vertex{};
+        // compact vertex：缓存中是gpu的顶点格式，切换COMPACT_VERTICES后顶点大小不同，缓存自动失效
+        std::string cachePath = path.substr(0, path.find_last_of('.')) + MESH_CACHE_EXTENSION;
+        model.vertexStride = COMPACT_VERTICES ? sizeof(PackedVertex) : sizeof(Vertex);
+        // mesh codec：编码的缓存能在gpu上解码时保持编码的流，否则在这里解码；m_gpuMeshDecoder在加载开始之前已经初始化，这里只读取
+        auto cacheHit = [&](const char* source) {
+            model.cached = true;
+            model.gpuDecode = model.cache.encoded && m_gpuMeshDecoder.fits(model.cache, model.vertexStride);
+            if (model.cache.encoded && !model.gpuDecode) {
+                decodeMeshCache(model.cache, model.vertexStride, model.vertices, model.indices);
+            }
+            model.indexSize = model.cache.indexSize;
+            model.boundsMin = glm::vec3(model.cache.boundsMin[0], model.cache.boundsMin[1], model.cache.boundsMin[2]);
+            model.boundsMax = glm::vec3(model.cache.boundsMax[0], model.cache.boundsMax[1], model.cache.boundsMax[2]);
+            if (SHOW_STARTUP_TIMINGS) {
+                float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+                const char* encoding = !model.cache.encoded ? "" : model.gpuDecode ? ", gpu decode" : ", cpu decoded";
+                std::cout << "mesh cache hit (" << source << encoding << "): " << model.cache.vertexCount << " vertices, " << model.cache.indexCount << " indices ("
+                    << model.indexSize * 8 << " bit, " << model.cache.submeshCount << " submeshes), " << ms << " ms" << std::endl;
+            }
+        };
+
+        // asset pack：pack中的缓存直接指向映射的pack，不打开也不hash源文件；顶点格式不一致时回到下面的文件缓存
+        AssetPack::Blob packed = AssetPack::instance().find(cachePath);
+        if (packed.data != nullptr && readMeshCache(packed.data, packed.size, 0, model.vertexStride, model.cache, false)) {
+            cacheHit("asset pack");
+            return model;
+        }
+
+        MappedFile source;
+        if (!source.open(path)) {
+            throw std::runtime_error("failed to open model file: " + path);
+        }
+        uint64_t sourceHash = hashMeshSource(source.data(), source.size());
+        size_t sourceSize = source.size();
+        source.close();
+
+        model.cacheFile = std::make_unique<MappedFile>();
+        if (model.cacheFile->open(cachePath) && readMeshCache(*model.cacheFile, sourceHash, model.vertexStride, model.cache)) {
+            cacheHit("file");
+            return model;
+        }
+        model.cacheFile.reset();
+
+        if (GPU_MESH_IMPORT && sourceSize >= GPU_MESH_IMPORT_MIN_BYTES) {
+            model.gpuImport = parseObjCorners(path);
+            model.gpuImport->cachePath = cachePath;
+            model.gpuImport->sourceHash = sourceHash;
+            model.gpuImport->startTime = startTime;
+            return model;
+        }
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        importObj(path, vertices, indices);
+        finishObjImport(model, cachePath, sourceHash, vertices, indices, startTime);
+        return model;
+    }
+
+    // model loader：去重之后的obj在job pool中优化、拆分、构建meshlet和lod，写入mesh cache并填写model
+    void finishObjImport(LoadedModel& model, const std::string& cachePath, uint64_t sourceHash, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+        std::chrono::high_resolution_clock::time_point startTime) {
+        optimizeMesh(vertices, indices);
+
+        model.boundsMin = vertices.empty() ? glm::vec3(0.0f) : vertices[0].pos;
+        model.boundsMax = model.boundsMin;
+        for (const Vertex& vertex : vertices) {
+            model.boundsMin = glm::min(model.boundsMin, vertex.pos);
+            model.boundsMax = glm::max(model.boundsMax, vertex.pos);
+        }
+
+        // 16位索引：导入时决定索引大小，拆分只复制边界上的顶点，包围盒不变
+        MeshCacheSubmesh whole{};
+        whole.vertexCount = static_cast<uint32_t>(vertices.size());
+        whole.indexCount = static_cast<uint32_t>(indices.size());
+        model.submeshes = {whole};
+        bool uint16Indices = vertices.size() <= 65536 || SPLIT_MESHES_FOR_UINT16;
+        if (vertices.size() > 65536 && SPLIT_MESHES_FOR_UINT16) {
+            splitMesh(vertices, indices, model.submeshes);
+        }
+
+        // meshlet：按submesh构建，位置使用量化之前的Vertex，索引和meshlet顶点都相对于submesh的第一个顶点
+        // 不管设备是否支持mesh shader都写入缓存，缓存和设备无关
+        for (MeshCacheSubmesh& submesh : model.submeshes) {
+            submesh.firstMeshlet = static_cast<uint32_t>(model.meshlets.meshlets.size());
+            buildMeshlets(indices.data() + submesh.firstIndex, submesh.indexCount, &vertices[submesh.firstVertex].pos.x, sizeof(Vertex),
+                submesh.vertexCount, model.meshlets);
+            submesh.meshletCount = static_cast<uint32_t>(model.meshlets.meshlets.size()) - submesh.firstMeshlet;
+        }
+
+        // lod：每个submesh单独简化，简化的索引同样重新排序顶点cache，追加在索引数组的最后
+        std::vector<std::vector<SimplifiedLod>> simplified(model.submeshes.size());
+        m_jobPool.parallelFor(model.submeshes.size(), [&](size_t i) {
+            const MeshCacheSubmesh& submesh = model.submeshes[i];
+            simplified[i] = simplifyMeshLods(indices.data() + submesh.firstIndex, submesh.indexCount, &vertices[submesh.firstVertex].pos.x, sizeof(Vertex),
+                submesh.vertexCount);
+            for (SimplifiedLod& lod : simplified[i]) {
+                std::vector<size_t> clusterStarts;
+                lod.indices = optimizeVertexCache(lod.indices, submesh.vertexCount, clusterStarts);
+            }
+        });
+        for (size_t i = 0; i < model.submeshes.size(); i++) {
+            MeshCacheSubmesh& submesh = model.submeshes[i];
+            submesh.firstLod = static_cast<uint32_t>(model.lods.size());
+            model.lods.push_back({submesh.firstIndex, submesh.indexCount, 0.0f, 0});
+            for (const SimplifiedLod& lod : simplified[i]) {
+                model.lods.push_back({static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod.indices.size()), lod.error, 0});
+                indices.insert(indices.end(), lod.indices.begin(), lod.indices.end());
+            }
+            submesh.lodCount = static_cast<uint32_t>(model.lods.size()) - submesh.firstLod;
+        }
+        std::vector<uint16_t> narrowedIndices;
+        const void* indexData = indices.data();
+        model.indexSize = sizeof(uint32_t);
+        if (uint16Indices) {
+            narrowedIndices = narrowIndices(indices);
+            indexData = narrowedIndices.data();
+            model.indexSize = sizeof(uint16_t);
+        }
+
+        std::vector<PackedVertex> packedVertices;
+        const void* vertexData = vertices.data();
+        if (COMPACT_VERTICES) {
+            packedVertices = packVertices(vertices, model.boundsMin, model.boundsMax);
+            vertexData = packedVertices.data();
+        }
+
+        if (!writeMeshCache(cachePath, sourceHash, model.vertexStride, vertexData, static_cast<uint32_t>(vertices.size()),
+                indexData, static_cast<uint32_t>(indices.size()), model.indexSize, model.submeshes, model.meshlets, model.lods, &model.boundsMin.x, &model.boundsMax.x)) {
+            std::cerr << "failed to write mesh cache: " << cachePath << std::endl;  // 不影响这次运行，下次启动会重新导入
+        }
+        model.vertices.assign(static_cast<const char*>(vertexData), static_cast<const char*>(vertexData) + vertices.size() * model.vertexStride);
+        model.indices.assign(static_cast<const char*>(indexData), static_cast<const char*>(indexData) + indices.size() * model.indexSize);
+        if (SHOW_STARTUP_TIMINGS) {
+            float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+            std::cout << "mesh import: " << vertices.size() << " vertices, " << indices.size() << " indices (" << model.indexSize * 8 << " bit, "
+                << model.submeshes.size() << " submeshes) on " << m_jobPool.threadCount() << " threads, " << ms << " ms" << std::endl;
+        }
+    }
+
+    // model loader：返回的handle立即可以查询状态，模型在后台读取，完成后由updateModelLoads恢复的task上传
+    // world streaming：placement是模型在世界中的位置，worldChunk不是UINT32_MAX时上传受每帧的上传预算限制，完成后通知m_worldStreamer
+    ModelHandle requestModel(const std::string& path, TextureHandle texture, const glm::mat4& placement = glm::mat4(1.0f), uint32_t worldChunk = UINT32_MAX) {
+        ModelRecord record{};
+        record.path = path;
+        record.texture = texture;
+        record.state = ModelState::loading;
+        record.requestTime = std::chrono::high_resolution_clock::now();
+        record.placement = placement;
+        record.worldChunk = worldChunk;
+        ModelHandle handle = m_models.insert(std::move(record));
+        m_asyncScheduler.spawn(loadModelAsync(handle));
+        return handle;
+    }
+
+    // world streaming：有--world时读取manifest，chunk在updateWorldStreaming中按相机位置请求；否则请求单个模型
+    // stress scene：程序化的mesh属于一个没有文件的模型，在createStressScene中和启动时的上传一起提交
+    void requestSceneModels() {
+        if (m_stressScene) {
+            ModelRecord record{};
+            record.path = "stress: " + m_stressSettings.label();
+            record.texture = INVALID_TEXTURE_HANDLE;
+            record.state = ModelState::resident;
+            record.requestTime = std::chrono::high_resolution_clock::now();
+            m_model = m_models.insert(std::move(record));
+            return;
+        }
+        if (m_worldPath.empty()) {
+            m_model = requestModel(m_modelPath, INVALID_TEXTURE_HANDLE);
+            return;
+        }
+        WorldStreamer::Settings settings;
+        settings.chunkSize = WORLD_CHUNK_SIZE;
+        settings.loadRadius = WORLD_LOAD_RADIUS;
+        settings.unloadRadius = WORLD_UNLOAD_RADIUS;
+        settings.predictionSeconds = WORLD_PREDICTION_SECONDS;
+        settings.maxLoadsPerFrame = WORLD_MAX_CHUNK_LOADS_PER_FRAME;
+        settings.maxLoadsInFlight = WORLD_MAX_CHUNK_LOADS_IN_FLIGHT;
+        m_worldStreamer.init(loadWorldManifest(m_worldPath), settings);
+        m_worldChunkModels.resize(m_worldStreamer.chunkCount());
+        if (SHOW_STARTUP_TIMINGS) {
+            std::cout << "world streaming: " << m_worldPath << ", " << m_worldStreamer.chunkCount() << " chunks" << std::endl;
+        }
+    }
+
+    // async task：导入 → 上传 → 等待上传完成，co_await之间的部分在主线程执行；m_models可能移动记录，每次恢复后重新通过handle访问
+    // 导入失败时这个模型不绘制，程序继续运行
+    Task<> loadModelAsync(ModelHandle handle) {
+        std::string path = m_models.get(handle).path;
+        LoadedModel data;
+        try {
+            data = co_await m_asyncScheduler.runOnJobPool(m_jobPool, [this, path]() { return loadModelData(path); });
+            if (data.gpuImport) {
+                data = co_await importObjOnGpu(std::move(data));
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "failed to load model " << path << ": " << e.what() << std::endl;
+            m_models.get(handle).state = ModelState::failed;
+            finishWorldModel(handle);
+            co_return;
+        }
+
+        // upload scheduler：gltf整体申请一次，obj每个submesh申请一次，大模型的上传分散到多帧；每次授权之后录制并提交，等待最后一次提交完成
+        // 其它模型的上传可能在两次授权之间进行，m_meshOwner每次重新设置
+        // world streaming：geometry buffer或meshlet buffer放不下时模型失败，已经分配的mesh在上传完成之后归还
+        bool worldModel = m_models.get(handle).worldChunk != UINT32_MAX;
+        Aabb bounds = transformAabb({data.boundsMin, data.boundsMax}, m_models.get(handle).placement);  // gltf在上传之前没有包围盒，只用位置
+        uint32_t pieceCount = data.gltf ? 1 : data.submeshCount();
+        bool uploadFailed = false;
+        uint64_t ticket = 0;
+        for (uint32_t piece = 0; piece < pieceCount && !uploadFailed; piece++) {
+            UploadScheduler::RequestId request = data.gltf
+                ? m_uploadScheduler.request(gltfUploadBytes(*data.gltf), gltfUploadCopies(*data.gltf), [this, bounds]() { return uploadPriority(bounds); })
+                : m_uploadScheduler.request(submeshUploadBytes(data, piece), submeshUploadCopies(data, piece), [this, bounds]() { return uploadPriority(bounds); });
+            co_await m_asyncScheduler.until([this, request]() { return m_uploadScheduler.granted(request); });
+
+            m_meshOwner = {handle, m_models.get(handle).placement, 0};
+            try {
+                if (data.gltf) {
+                    m_models.get(handle).textures = uploadGltf(*data.gltf, path, m_models.get(handle).texture);
+                } else {
+                    uploadSubmesh(data, piece, m_models.get(handle).texture);
+                }
+            } catch (const std::exception& e) {
+                if (!worldModel) {
+                    throw;
+                }
+                std::cerr << "failed to upload model " << path << ": " << e.what() << std::endl;
+                uploadFailed = true;
+            }
+            m_models.get(handle).residentBytes += m_meshOwner.bytes;
+            m_meshOwner = {};
+            ticket = m_uploadContext.submit();
+        }
+        m_models.get(handle).uploadTicket = ticket;
+        m_models.get(handle).state = ModelState::uploading;
+        data = LoadedModel{};  // mesh cache：数据已经拷贝到staging，释放映射的文件
+
+        co_await m_asyncScheduler.uploadComplete(m_uploadContext, ticket);
+        if (uploadFailed) {
+            m_models.get(handle).state = ModelState::failed;
+            finishWorldModel(handle);
+            releaseModelMeshes(handle);
+            co_return;
+        }
+        m_models.get(handle).state = ModelState::resident;
+        finishWorldModel(handle);
+        if (SHOW_STARTUP_TIMINGS) {
+            float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - m_models.get(handle).requestTime).count();
+            std::cout << "model resident: " << path << ", " << ms << " ms after request" << std::endl;
+        }
+    }
+
+    // gpu mesh import：corner写入host visible的buffer，compute录制在upload context的图形队列command buffer中，和其它上传一起提交
+    // 上传完成之后在job pool中读回顶点和索引，接着做和cpu导入相同的优化；buffer在读回之后回到主线程销毁
+    static_assert(sizeof(Vertex) == GpuMeshImporter::VERTEX_FLOATS * sizeof(float), "mesh_dedup.comp writes the Vertex layout");
+    Task<LoadedModel> importObjOnGpu(LoadedModel model) {
+        PendingObjImport& pending = *model.gpuImport;
+        size_t cornerCount = pending.corners.size() / 2;
+        size_t positionCount = pending.positions.size() / 3;
+        size_t texCoordCount = pending.texCoords.size() / 2;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        if (!m_gpuMeshImporter.fits(cornerCount, positionCount, texCoordCount)) {
+            co_await m_asyncScheduler.runOnJobPool(m_jobPool, [&]() {
+                dedupObjCorners(pending, vertices, indices);
+                finishObjImport(model, pending.cachePath, pending.sourceHash, vertices, indices, pending.startTime);
+            });
+            model.gpuImport.reset();
+            co_return model;
+        }
+
+        GpuMeshImporter::Job job = m_gpuMeshImporter.begin(static_cast<uint32_t>(cornerCount), static_cast<uint32_t>(positionCount), static_cast<uint32_t>(texCoordCount));
+        co_await m_asyncScheduler.runOnJobPool(m_jobPool, [&]() {
+            memcpy(job.corners(), pending.corners.data(), pending.corners.size() * sizeof(uint32_t));
+            memcpy(job.positions(), pending.positions.data(), pending.positions.size() * sizeof(float));
+            memcpy(job.texCoords(), pending.texCoords.data(), pending.texCoords.size() * sizeof(float));
+            std::vector<uint32_t>().swap(pending.corners);  // 已经在gpu可见的内存中，提前释放
+            std::vector<float>().swap(pending.positions);
+            std::vector<float>().swap(pending.texCoords);
+        });
+
+        auto gpuStart = std::chrono::high_resolution_clock::now();
+        m_gpuMeshImporter.record(m_uploadContext.graphicsCommandBuffer(), job);
+        uint64_t ticket = m_uploadContext.submit();
+        co_await m_asyncScheduler.uploadComplete(m_uploadContext, ticket);
+        if (SHOW_STARTUP_TIMINGS) {
+            float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - gpuStart).count();
+            std::cout << "gpu mesh import: " << cornerCount << " corners -> " << job.vertexCount() << " vertices, " << ms << " ms" << std::endl;
+        }
+
+        co_await m_asyncScheduler.runOnJobPool(m_jobPool, [&]() {
+            vertices.resize(job.vertexCount());
+            memcpy(vertices.data(), job.vertices(), vertices.size() * sizeof(Vertex));
+            indices.assign(job.indices(), job.indices() + cornerCount);
+        });
+        m_gpuMeshImporter.finish(job);
+
+        co_await m_asyncScheduler.runOnJobPool(m_jobPool, [&]() {
+            finishObjImport(model, pending.cachePath, pending.sourceHash, vertices, indices, pending.startTime);
+        });
+        model.gpuImport.reset();
+        co_return model;
+    }
+
+    ModelState modelState(ModelHandle handle) const { return m_models.get(handle).state; }
+    bool isModelResident(ModelHandle handle) const { return m_models.get(handle).state == ModelState::resident; }
+
+    // model loader：每帧调用，恢复导入完成或上传完成的模型task
+    // 上传和这一帧的渲染在不同的提交中，渲染不需要等待，只是在resident之前不绘制这个模型
+    void updateModelLoads() { m_asyncScheduler.pump(); }
+
+    // world streaming：每帧补充上传预算，按相机位置和预测位置决定加载和卸载哪些chunk
+    // manifest中的位置在sceneModel之前的空间，相机位置用上一帧的sceneModel变换过去
+    void updateWorldStreaming() {
+        if (!m_worldStreamer.initialized()) {
+            return;
+        }
+        glm::mat4 toWorld = glm::inverse(m_transforms.world(m_modelEntity));
+        glm::vec3 position = glm::vec3(toWorld * glm::vec4(m_camera.position(), 1.0f));
+        glm::vec3 predicted = glm::vec3(toWorld * glm::vec4(m_camera.predictPosition(WORLD_PREDICTION_SECONDS), 1.0f));
+        m_worldStreamer.update(position, predicted, worldResidentBudget(), m_worldLoads, m_worldUnloads);
+
+        for (uint32_t chunk : m_worldUnloads) {
+            for (ModelHandle handle : m_worldChunkModels[chunk]) {
+                if (m_models.contains(handle)) {
+                    releaseModel(handle);
+                }
+            }
+            m_worldChunkModels[chunk].clear();
+            m_worldStreamer.unloaded(chunk);
+        }
+        for (uint32_t chunk : m_worldLoads) {
+            const std::vector<uint32_t>& entries = m_worldStreamer.chunk(chunk).entries;
+            m_worldStreamer.loadStarted(chunk, static_cast<uint32_t>(entries.size()));
+            for (uint32_t index : entries) {
+                const WorldEntry& entry = m_worldStreamer.entry(index);
+                m_worldChunkModels[chunk].push_back(requestModel(entry.path, m_modelTexture, glm::translate(glm::mat4(1.0f), entry.position), chunk));
+            }
+        }
+    }
+
+    // world streaming：常驻预算是WORLD_RESIDENT_BUDGET、geometry buffer的空闲空间和显存预算的剩余空间中最小的，后两个加上已经常驻的部分
+    // geometry buffer是启动时分配的，加载模型本身不改变显存的使用量，剩余空间限制的是gltf纹理和其它动态分配
+    VkDeviceSize worldResidentBudget() const {
+        const MemoryStats& stats = m_allocator.stats();
+        VkDeviceSize resident = m_worldStreamer.residentBytes();
+        VkDeviceSize budget = static_cast<VkDeviceSize>(static_cast<double>(stats.deviceLocalBudget()) * WORLD_MEMORY_BUDGET_FRACTION);
+        VkDeviceSize headroom = budget > stats.deviceLocalUsage() ? budget - stats.deviceLocalUsage() : 0;
+        return std::min({WORLD_RESIDENT_BUDGET, resident + m_geometryBuffer.freeBytes(), resident + headroom});
+    }
+
+    // upload scheduler：bounds在sceneModel之前的空间，视锥和相机位置用上一帧的sceneModel变换过去
+    // 可见是包围盒和视锥相交，距离是相机到包围盒的距离，相机在包围盒内时为0
+    UploadPriority uploadPriority(const Aabb& bounds) const {
+        glm::mat4 sceneModel = m_transforms.world(m_modelEntity);
+        UploadPriority priority;
+        for (const glm::vec4& plane : FrustumCuller::extractPlanes(m_camera.project() * m_camera.view() * sceneModel)) {
+            glm::vec3 farthest = glm::mix(bounds.min, bounds.max, glm::greaterThanEqual(glm::vec3(plane), glm::vec3(0.0f)));
+            if (glm::dot(glm::vec3(plane), farthest) + plane.w < 0.0f) {
+                priority.visible = false;
+                break;
+            }
+        }
+        glm::vec3 camera = glm::vec3(glm::inverse(sceneModel) * glm::vec4(m_camera.position(), 1.0f));
+        priority.distance = glm::length(camera - glm::clamp(camera, bounds.min, bounds.max));
+        return priority;
+    }
+
+    // upload scheduler：submesh的顶点、所有lod的索引和meshlet的字节数
+    static VkDeviceSize submeshUploadBytes(const LoadedModel& model, uint32_t index) {
+        const MeshCacheSubmesh& submesh = model.submeshData()[index];
+        VkDeviceSize bytes = static_cast<VkDeviceSize>(submesh.vertexCount) * model.vertexStride;
+        const MeshCacheLod* lods = model.lodData() + submesh.firstLod;
+        for (uint32_t l = 0; l < submesh.lodCount; l++) {
+            bytes += static_cast<VkDeviceSize>(lods[l].indexCount) * model.indexSize;
+        }
+        const Meshlet* meshlets = model.meshletData() + submesh.firstMeshlet;
+        for (uint32_t m = 0; m < submesh.meshletCount; m++) {
+            bytes += sizeof(Meshlet) + sizeof(uint32_t) * (meshlets[m].vertexCount + meshlets[m].triangleCount);
+        }
+        return bytes;
+    }
+
+    // upload scheduler：beginMeshUpload和uploadMeshlets录制的拷贝命令数，host visible的buffer直接写入，没有拷贝命令
+    uint32_t meshUploadCopies() const { return m_geometryBuffer.hostVisible() ? 0 : (m_geometryBuffer.splitStreams() ? 3 : 2); }
+
+    uint32_t submeshUploadCopies(const LoadedModel& model, uint32_t index) const {
+        bool meshlets = m_meshShaderSupported && model.submeshData()[index].meshletCount > 0 && !m_meshletBuffer.hostVisible();
+        return meshUploadCopies() + (meshlets ? 3 : 0);
+    }
+
+    // upload scheduler：gltf的上传大小按所有buffer估计，拷贝命令按primitive数量估计
+    static VkDeviceSize gltfUploadBytes(const tinygltf::Model& model) {
+        VkDeviceSize bytes = 0;
+        for (const tinygltf::Buffer& buffer : model.buffers) {
+            bytes += buffer.data.size();
+        }
+        return bytes;
+    }
+
+    uint32_t gltfUploadCopies(const tinygltf::Model& model) const {
+        uint32_t primitives = 0;
+        for (const tinygltf::Mesh& mesh : model.meshes) {
+            primitives += static_cast<uint32_t>(mesh.primitives.size());
+        }
+        return primitives * meshUploadCopies();
+    }
+
+    // world streaming：模型resident或者失败之后告诉streamer，失败的模型占用0字节
+    void finishWorldModel(ModelHandle handle) {
+        const ModelRecord& record = m_models.get(handle);
+        if (record.worldChunk != UINT32_MAX) {
+            m_worldStreamer.modelFinished(record.worldChunk, record.state == ModelState::resident ? record.residentBytes : 0);
+        }
+    }
+
+    // world streaming：卸载模型，mesh从这一帧开始不再绘制，geometry和meshlet空间、mesh编号和纹理在in flight的帧结束之后归还
+    // 只用于已经resident或者失败的模型，加载中的模型由task继续访问记录
+    void releaseModel(ModelHandle handle) {
+        releaseModelMeshes(handle);
+        for (TextureHandle texture : m_models.get(handle).textures) {
+            m_textureCache.release(texture, m_frameNumber);
+        }
+        m_models.erase(handle);
+    }
+
+    // world streaming：归还的mesh区间清零，gpu culling路径对所有mesh编号调用setDraw，清零之后画0个索引
+    // 清零的编号在归还之前不会再被当作这个模型的mesh；gltf中多个node共享的顶点和索引只释放一次
+    void releaseModelMeshes(ModelHandle handle) {
+        std::vector<MeshRange> ranges;
+        std::vector<MeshletRange> meshlets;
+        std::vector<ImpostorTile> tiles;
+        std::vector<uint32_t> slots;
+        std::vector<SkinnedMesh> skinned;
+        // skinning：m_meshes中是这一帧的输出范围，先换回绑定姿势的范围，输出和source和其它空间一起延迟归还
+        for (auto it = m_skinnedMeshes.begin(); it != m_skinnedMeshes.end();) {
+            if (m_meshModels[it->mesh] != handle) {
+                ++it;
+                continue;
+            }
+            m_meshes[it->mesh].vertexOffset = it->bindVertexOffset;
+            skinned.push_back(std::move(*it));
+            it = m_skinnedMeshes.erase(it);
+        }
+        for (size_t i = 0; i < m_meshModels.size(); i++) {
+            const MeshRange& mesh = m_meshes[i];
+            if (m_meshModels[i] != handle || (mesh.vertexCount == 0 && mesh.indexCount == 0)) {
+                continue;
+            }
+            bool shared = std::any_of(ranges.begin(), ranges.end(), [&](const MeshRange& range) {
+                return range.vertexOffset == mesh.vertexOffset && range.firstIndex == mesh.firstIndex;
+            });
+            if (!shared) {
+                ranges.push_back(mesh);
+            }
+            if (m_meshMeshlets[i].meshletCount > 0) {
+                meshlets.push_back(m_meshMeshlets[i]);
+            }
+            if (m_meshImpostors[i].tile.valid()) {
+                tiles.push_back(m_meshImpostors[i].tile);
+            }
+            m_meshes[i] = {};
+            m_meshMeshlets[i] = {};
+            m_meshLods[i] = {};
+            m_meshImpostors[i] = {};
+            if (m_meshBlas[i] != AccelerationStructures::INVALID_BLAS) {
+                m_accelerationStructures.removeBlas(m_meshBlas[i]);  // ray traced shadows：BLAS自己延迟销毁，引用它的TLAS下一次record时不再包含它
+                m_meshBlas[i] = AccelerationStructures::INVALID_BLAS;
+            }
+            slots.push_back(static_cast<uint32_t>(i));
+        }
+        if (slots.empty()) {
+            return;
+        }
+        m_deletionQueue.push(m_frameNumber, [this, ranges = std::move(ranges), meshlets = std::move(meshlets), tiles = std::move(tiles), slots = std::move(slots),
+                                                skinned = std::move(skinned)]() {
+            for (const MeshRange& range : ranges) {
+                m_geometryBuffer.free(range);
+            }
+            for (const SkinnedMesh& mesh : skinned) {
+                for (const MeshRange& output : mesh.outputs) {
+                    m_geometryBuffer.free(output);
+                }
+                m_skinning.freeSource(mesh.sourceVertex, mesh.vertexCount);
+            }
+            for (const MeshletRange& range : meshlets) {
+                m_meshletBuffer.free(range);
+            }
+            for (const ImpostorTile& tile : tiles) {
+                m_impostors.free(tile);
+            }
+            for (uint32_t slot : slots) {
+                m_materials.release(m_meshMaterials[slot]);  // materials：使用它的帧已经完成
+            }
+            m_freeMeshSlots.insert(m_freeMeshSlots.end(), slots.begin(), slots.end());
+        });
+    }
+
+    // model loader：占位mesh属于INVALID_MODEL_HANDLE，只在有模型还没有resident时绘制
+    // world streaming：卸载的模型留下的mesh仍然记录着已经无效的handle，不绘制；世界中的模型加载时不绘制占位mesh
+    bool isMeshVisible(size_t mesh) const {
+        ModelHandle handle = m_meshModels[mesh];
+        if (handle != INVALID_MODEL_HANDLE) {
+            return m_models.contains(handle) && m_models.get(handle).state == ModelState::resident;
+        }
+        for (const ModelRecord& record : m_models) {
+            if (record.worldChunk == UINT32_MAX && (record.state == ModelState::loading || record.state == ModelState::uploading)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // model loader：模型加载期间绘制的单位立方体，和模型一起在启动时的上传中提交
+    void createPlaceholderMesh(TextureHandle texture) {
+        std::vector<Vertex> vertices;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 pos((corner & 1) ? 0.5f : -0.5f, (corner & 2) ? 0.5f : -0.5f, (corner & 4) ? 0.5f : -0.5f);
+            vertices.push_back({pos, glm::vec3(1.0f), glm::vec2((corner & 1) ? 1.0f : 0.0f, (corner & 2) ? 1.0f : 0.0f)});
+        }
+        const std::vector<uint16_t> indices = {
+            0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  // -z, +z
+            0, 1, 4, 1, 5, 4,  2, 6, 3, 3, 6, 7,  // -y, +y
+            0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5,  // -x, +x
+        };
+
+        glm::vec3 boundsMin(-0.5f);
+        glm::vec3 boundsMax(0.5f);
+        if (COMPACT_VERTICES) {
+            std::vector<PackedVertex> packed = packVertices(vertices, boundsMin, boundsMax);
+            uploadMesh(packed.data(), static_cast<uint32_t>(packed.size()), indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT16,
+                vertexDequantizeTransform(boundsMin, boundsMax), texture);
+        } else {
+            uploadMesh(vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(), static_cast<uint32_t>(indices.size()), VK_INDEX_TYPE_UINT16,
+                glm::mat4(1.0f), texture);
+        }
+    }
+
+    // stress scene：生成纹理和mesh，第i个mesh使用第i % materials个材质，材质k是第k % textures张纹理乘上随k变化的颜色
+    // 每个mesh的placement是它在格子中的位置，实例的transform把整个格子放到网格上；每个mesh上传之后提交一次，staging ring不会被没有提交的上传占满
+    void createStressScene() {
+        const StressSceneSettings& settings = m_stressSettings;
+        std::vector<std::string> paths;
+        std::vector<std::vector<char>> files;
+        for (uint32_t t = 0; t < settings.textures; t++) {
+            paths.push_back("stress#" + std::to_string(t));  // texture cache：#让loader不查找同名的ktx2
+            files.push_back(generateStressTexture(t, settings.seed));
+        }
+        std::vector<TextureHandle> textures = paths.empty() ? std::vector<TextureHandle>{} : m_textureCache.acquire(paths, std::move(files));
+        m_models.get(m_model).textures = textures;  // 和模型的纹理一样在卸载或者cleanup时释放
+
+        uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(settings.meshes))));
+        float half = (side - 1) * 0.5f;
+        for (uint32_t m = 0; m < settings.meshes; m++) {
+            StressMesh generated = generateStressMesh(m, settings.seed);
+            std::vector<Vertex> vertices(generated.positions.size());
+            glm::vec3 boundsMin(FLT_MAX);
+            glm::vec3 boundsMax(-FLT_MAX);
+            for (size_t v = 0; v < vertices.size(); v++) {
+                vertices[v] = {generated.positions[v], glm::vec3(1.0f), generated.uvs[v]};
+                boundsMin = glm::min(boundsMin, generated.positions[v]);
+                boundsMax = glm::max(boundsMax, generated.positions[v]);
+            }
+
+            uint32_t material = m % settings.materials;
+            TextureHandle texture = textures.empty() ? m_modelTexture : textures[material % textures.size()];
+            glm::vec3 offset((m % side - half) * STRESS_MESH_SPACING, (m / side - half) * STRESS_MESH_SPACING, 0.0f);
+            m_meshOwner = {m_model, glm::translate(glm::mat4(1.0f), offset), 0};
+            uint32_t indexCount = static_cast<uint32_t>(generated.indices.size());
+            size_t mesh;
+            if (COMPACT_VERTICES) {
+                std::vector<PackedVertex> packed = packVertices(vertices, boundsMin, boundsMax);
+                mesh = uploadMesh(packed.data(), static_cast<uint32_t>(packed.size()), generated.indices.data(), indexCount, VK_INDEX_TYPE_UINT16,
+                    vertexDequantizeTransform(boundsMin, boundsMax), texture);
+            } else {
+                mesh = uploadMesh(vertices.data(), static_cast<uint32_t>(vertices.size()), generated.indices.data(), indexCount, VK_INDEX_TYPE_UINT16,
+                    glm::mat4(1.0f), texture);
+            }
+            glm::vec4 color(0.4f + 0.6f * stressRandom(settings.seed, material, 9), 0.4f + 0.6f * stressRandom(settings.seed, material, 10),
+                0.4f + 0.6f * stressRandom(settings.seed, material, 11), 1.0f);
+            setMeshMaterial(mesh, {texture, color});
+            m_models.get(m_model).residentBytes += m_meshOwner.bytes;
+            m_meshOwner = {};
+            m_uploadContext.submit();
+        }
+    }
+
+    // 16位索引：每个submesh作为一个mesh上传，共享模型的纹理和解量化变换
+    // meshlet：支持mesh shader时同时上传submesh的meshlet
+    // lod：submesh所有level的索引连续上传到mesh的索引区域，MeshRange的indexCount是所有level的总数
+    // upload scheduler：每个submesh单独申请上传预算，由loadModelAsync逐个调用
+    void uploadSubmesh(const LoadedModel& model, uint32_t index, TextureHandle texture) {
+        VkIndexType indexType = model.indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        const char* vertexData = static_cast<const char*>(model.vertexData());
+        const char* indexData = static_cast<const char*>(model.indexData());
+        const MeshCacheSubmesh& submesh = model.submeshData()[index];
+        const MeshCacheLod* lods = model.lodData() + submesh.firstLod;
+        uint32_t indexCount = 0;
+        for (uint32_t l = 0; l < submesh.lodCount; l++) {
+            indexCount += lods[l].indexCount;
+        }
+
+        size_t mesh;
+        if (model.gpuDecode) {
+            mesh = uploadEncodedSubmesh(model, submesh, indexCount, indexType, texture);
+        } else {
+            // frustum culling：从加载结果中读取顶点，不读取可能是write combined的geometry buffer
+            const char* submeshVertices = vertexData + static_cast<size_t>(submesh.firstVertex) * model.vertexStride;
+            MeshUploadTarget target = beginMeshUpload(submesh.vertexCount, indexCount, indexType, meshTransform(model.boundsMin, model.boundsMax),
+                gpuVertexBounds(submeshVertices, submesh.vertexCount), texture);
+            writeMeshVertices(target, submeshVertices);
+            uint32_t cursor = 0;
+            for (uint32_t l = 0; l < submesh.lodCount; l++) {
+                memcpy(static_cast<char*>(target.indices) + static_cast<size_t>(cursor) * model.indexSize,
+                    indexData + static_cast<size_t>(lods[l].firstIndex) * model.indexSize, static_cast<size_t>(lods[l].indexCount) * model.indexSize);
+                cursor += lods[l].indexCount;
+            }
+            mesh = target.mesh;
+            // software occlusion：只用level 0，三角形太多时这个mesh不作为遮挡体；更粗的level不保证在真实轮廓之内，不能代替
+            if (submesh.lodCount > 0) {
+                setMeshOccluder(mesh, submeshVertices, submesh.vertexCount, indexData + static_cast<size_t>(lods[0].firstIndex) * model.indexSize,
+                    lods[0].indexCount, indexType);
+            }
+        }
+        MeshLodChain& chain = m_meshLods[mesh];
+        chain.center = glm::vec3(m_meshOwner.placement * glm::vec4((model.boundsMin + model.boundsMax) * 0.5f, 1.0f));
+        uint32_t cursor = 0;
+        for (uint32_t l = 0; l < submesh.lodCount; l++) {
+            chain.levels.push_back({cursor, lods[l].indexCount, lods[l].error});
+            cursor += lods[l].indexCount;
+        }
+
+        if (m_meshShaderSupported && submesh.meshletCount > 0) {
+            m_meshMeshlets[mesh] = uploadMeshlets(model.meshletData() + submesh.firstMeshlet, submesh.meshletCount,
+                model.meshletVertexData(), model.meshletTriangleData());
+        }
+    }
+
+    // mesh codec：编码的submesh不经过staging ring，分配mesh之后录制解码的dispatch，compute写入之后的barrier覆盖所有读取顶点和索引的stage
+    // 编码的缓存中submesh所有level的索引已经按level顺序连续，解码结果和上面逐个level的拷贝相同
+    // frustum culling：cpu上没有解码的顶点，包围盒使用整个模型的包围盒（紧凑顶点时就是量化范围[-1, 1]），比submesh自己的包围盒保守
+    size_t uploadEncodedSubmesh(const LoadedModel& model, const MeshCacheSubmesh& submesh, uint32_t indexCount, VkIndexType indexType, TextureHandle texture) {
+        Aabb bounds = COMPACT_VERTICES ? Aabb{glm::vec3(-1.0f), glm::vec3(1.0f)} : Aabb{model.boundsMin, model.boundsMax};
+        MeshRange range = m_geometryBuffer.allocate(submesh.vertexCount, indexCount, indexType);
+        size_t mesh = allocateMeshSlot(range, meshTransform(model.boundsMin, model.boundsMax), bounds, texture);
+        GpuMeshDecoder::Target target;
+        target.buffer = m_geometryBuffer.buffer();
+        target.positionOffset = m_geometryBuffer.vertexByteOffset(range);
+        target.positionSize = m_geometryBuffer.vertexByteSize(range);
+        target.attributeOffset = m_geometryBuffer.attributeByteOffset(range);
+        target.attributeSize = m_geometryBuffer.attributeByteSize(range);
+        target.indexOffset = m_geometryBuffer.indexByteOffset(range);
+        target.indexSize = m_geometryBuffer.indexByteSize(range);
+        target.positionStride = m_geometryBuffer.positionStride();
+        m_meshOwner.bytes += target.positionSize + target.attributeSize + target.indexSize;
+
+        VkAccessFlags access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        VkPipelineStageFlags stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        if (m_meshShaderSupported) {  // meshlet：mesh shader路径把顶点作为storage buffer读取
+            access |= VK_ACCESS_SHADER_READ_BIT;
+            stages |= VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+        }
+        if (GPU_SKINNING) {  // skinning：compute shader读取geometry buffer中的顶点
+            access |= VK_ACCESS_SHADER_READ_BIT;
+            stages |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        }
+        GpuMeshDecoder::Job job = m_gpuMeshDecoder.begin(model.cache, model.vertexStride, submesh, indexCount, target);
+        m_gpuMeshDecoder.record(m_uploadContext.graphicsCommandBuffer(), job, access, stages);
+        m_uploadContext.deferUntilComplete([this, job]() mutable { m_gpuMeshDecoder.finish(job); });
+        return mesh;
+    }
+
+    // meshlet：meshlet的顶点和三角形区间在上传时重新定位到meshlet buffer中的位置
+    // 和geometry buffer一样，host visible时直接写入，否则通过staging ring拷贝
+    MeshletRange uploadMeshlets(const Meshlet* meshlets, uint32_t meshletCount, const uint32_t* meshletVertices, const uint32_t* meshletTriangles) {
+        uint32_t vertexCount = 0;
+        uint32_t triangleCount = 0;
+        for (uint32_t i = 0; i < meshletCount; i++) {
+            vertexCount += meshlets[i].vertexCount;
+            triangleCount += meshlets[i].triangleCount;
+        }
+
+        MeshletRange range;
+        range.firstMeshlet = m_meshletBuffer.allocate(MeshletBuffer::meshlets, meshletCount);
+        range.meshletCount = meshletCount;
+        range.firstVertex = m_meshletBuffer.allocate(MeshletBuffer::vertices, vertexCount);
+        range.vertexCount = vertexCount;
+        range.firstTriangle = m_meshletBuffer.allocate(MeshletBuffer::triangles, triangleCount);
+        range.triangleCount = triangleCount;
+        uint32_t firstVertex = range.firstVertex;
+        uint32_t firstTriangle = range.firstTriangle;
+
+        VkDeviceSize meshletBytes = sizeof(Meshlet) * meshletCount;
+        VkDeviceSize vertexBytes = sizeof(uint32_t) * vertexCount;
+        VkDeviceSize triangleBytes = sizeof(uint32_t) * triangleCount;
+        m_meshOwner.bytes += meshletBytes + vertexBytes + triangleBytes;
+        char* meshletTarget;
+        char* vertexTarget;
+        char* triangleTarget;
+        if (m_meshletBuffer.hostVisible()) {
+            char* mapped = static_cast<char*>(m_meshletBuffer.mapped());
+            meshletTarget = mapped + m_meshletBuffer.byteOffset(MeshletBuffer::meshlets, range.firstMeshlet);
+            vertexTarget = mapped + m_meshletBuffer.byteOffset(MeshletBuffer::vertices, firstVertex);
+            triangleTarget = mapped + m_meshletBuffer.byteOffset(MeshletBuffer::triangles, firstTriangle);
+        } else {
+            StagingRing::Region staging = m_stagingRing.allocate(meshletBytes + vertexBytes + triangleBytes);
+            copyBuffer(staging.buffer, staging.offset, m_meshletBuffer.buffer(), m_meshletBuffer.byteOffset(MeshletBuffer::meshlets, range.firstMeshlet), meshletBytes);
+            copyBuffer(staging.buffer, staging.offset + meshletBytes, m_meshletBuffer.buffer(), m_meshletBuffer.byteOffset(MeshletBuffer::vertices, firstVertex), vertexBytes);
+            copyBuffer(staging.buffer, staging.offset + meshletBytes + vertexBytes, m_meshletBuffer.buffer(),
+                m_meshletBuffer.byteOffset(MeshletBuffer::triangles, firstTriangle), triangleBytes);
+            VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+            m_uploadContext.handoffSharedBuffer(m_meshletBuffer.buffer(), m_meshletBuffer.byteOffset(MeshletBuffer::meshlets, range.firstMeshlet), meshletBytes,
+                VK_ACCESS_SHADER_READ_BIT, stages);
+            m_uploadContext.handoffSharedBuffer(m_meshletBuffer.buffer(), m_meshletBuffer.byteOffset(MeshletBuffer::vertices, firstVertex), vertexBytes,
+                VK_ACCESS_SHADER_READ_BIT, stages);
+            m_uploadContext.handoffSharedBuffer(m_meshletBuffer.buffer(), m_meshletBuffer.byteOffset(MeshletBuffer::triangles, firstTriangle), triangleBytes,
+                VK_ACCESS_SHADER_READ_BIT, stages);
+            meshletTarget = static_cast<char*>(staging.mapped);
+            vertexTarget = meshletTarget + meshletBytes;
+            triangleTarget = vertexTarget + vertexBytes;
+        }
+
+        // meshlet：输入的meshlet在模型的数组中不一定连续排列，逐个拷贝并改写offset
+        uint32_t vertexCursor = 0;
+        uint32_t triangleCursor = 0;
+        for (uint32_t i = 0; i < meshletCount; i++) {
+            Meshlet meshlet = meshlets[i];
+            memcpy(vertexTarget + sizeof(uint32_t) * vertexCursor, meshletVertices + meshlet.vertexOffset, sizeof(uint32_t) * meshlet.vertexCount);
+            memcpy(triangleTarget + sizeof(uint32_t) * triangleCursor, meshletTriangles + meshlet.triangleOffset, sizeof(uint32_t) * meshlet.triangleCount);
+            meshlet.vertexOffset = firstVertex + vertexCursor;
+            meshlet.triangleOffset = firstTriangle + triangleCursor;
+            memcpy(meshletTarget + sizeof(Meshlet) * i, &meshlet, sizeof(Meshlet));
+            vertexCursor += meshlet.vertexCount;
+            triangleCursor += meshlet.triangleCount;
+        }
+        return range;
+    }
+
+    // gltf：每个primitive上传为一个mesh，变换是node的世界变换乘上primitive自己的解量化变换
+    // 顶点属性在gltf中通常是分开的accessor，逐个顶点直接写到geometry buffer或staging中的最终位置，不组装中间数组
+    // 索引的类型和上传的类型一致并且紧密排列时整段拷贝bufferView，同一个mesh被多个node引用时只上传一次
+    // 返回从texture cache取得的纹理，卸载模型时释放
+    std::vector<TextureHandle> uploadGltf(const tinygltf::Model& model, const std::string& path, TextureHandle fallbackTexture) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        size_t drawCount = 0;
+
+        // gltf：所有材质的图片一次交给texture cache，没有命中的一起并行解码
+        // 外部图片按路径读取（可以有_bc7.ktx2版本），嵌入的图片用模型路径加image index作为key
+        std::string baseDir = path.substr(0, path.find_last_of("/\\") + 1);
+        std::vector<std::string> imageKeys;
+        std::vector<std::vector<char>> imageData;
+        std::vector<int> imageSlots(model.images.size(), -1);
+        for (size_t m = 0; m < model.materials.size(); m++) {
+            int image = gltfBaseColorImage(model, static_cast<int>(m));
+            if (image < 0 || imageSlots.at(image) >= 0) {
+                continue;
+            }
+            const tinygltf::Image& source = model.images[image];
+            imageSlots[image] = static_cast<int>(imageKeys.size());
+            if (!source.uri.empty()) {
+                imageKeys.push_back(baseDir + source.uri);
+                imageData.emplace_back();
+            } else {
+                imageKeys.push_back(path + "#image" + std::to_string(image));
+                imageData.emplace_back(source.image.begin(), source.image.end());
+            }
+        }
+        std::vector<TextureHandle> imageTextures;
+        if (!imageKeys.empty()) {
+            imageTextures = m_textureCache.acquire(imageKeys, std::move(imageData));
+        }
+
+        // skinning：模型有skin时解析一次node层级和第一个动画，这个模型所有蒙皮的mesh共用
+        std::shared_ptr<GltfSkeleton> skeleton;
+        if (m_skinning.initialized() && !model.skins.empty()) {
+            skeleton = std::make_shared<GltfSkeleton>();
+            skeleton->load(model);
+        }
+
+        size_t vertexTotal = 0;
+        size_t indexTotal = 0;
+        size_t skinnedCount = 0;
+        std::vector<GltfMeshInstance> instances = collectGltfMeshInstances(model);
+        auto materialTexture = [&](int material) {
+            int image = gltfBaseColorImage(model, material);
+            return image >= 0 ? imageTextures[imageSlots[image]] : fallbackTexture;
+        };
+        std::vector<std::vector<bool>> batched(instances.size());
+        size_t batchedPrimitives = 0;
+        size_t batchCount = 0;
+        if (STATIC_BATCHING) {
+            uploadGltfStaticBatches(model, instances, skeleton != nullptr, materialTexture, batched, batchedPrimitives, batchCount, vertexTotal, indexTotal);
+            drawCount += batchCount;
+        }
+
+        std::vector<std::vector<size_t>> uploadedPrimitives(model.meshes.size());  // 每个primitive在m_meshes中的位置
+        for (size_t n = 0; n < instances.size(); n++) {
+            const GltfMeshInstance& instance = instances[n];
+            const tinygltf::Mesh& mesh = model.meshes.at(instance.mesh);
+            std::vector<size_t>& uploaded = uploadedPrimitives[instance.mesh];
+            for (size_t p = 0; p < mesh.primitives.size(); p++) {
+                if (p < batched[n].size() && batched[n][p]) {
+                    continue;  // static batching：已经合并上传
+                }
+                const tinygltf::Primitive& primitive = mesh.primitives[p];
+                auto position = primitive.attributes.find("POSITION");
+                if (primitive.mode != TINYGLTF_MODE_TRIANGLES || position == primitive.attributes.end()) {
+                    continue;  // 只支持三角形列表，strip和fan需要先转换
+                }
+
+                // gltf：POSITION的accessor必须有min和max，量化直接使用，缺少时才遍历顶点
+                const tinygltf::Accessor& positionAccessor = model.accessors.at(position->second);
+                GltfAccessorView positions = gltfAccessorView(model, position->second);
+                if (positions.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || positions.type != TINYGLTF_TYPE_VEC3) {
+                    throw std::runtime_error("unsupported gltf position format!");
+                }
+                glm::vec3 boundsMin(0.0f);
+                glm::vec3 boundsMax(0.0f);
+                if (positionAccessor.minValues.size() == 3 && positionAccessor.maxValues.size() == 3) {
+                    boundsMin = glm::vec3(positionAccessor.minValues[0], positionAccessor.minValues[1], positionAccessor.minValues[2]);
+                    boundsMax = glm::vec3(positionAccessor.maxValues[0], positionAccessor.maxValues[1], positionAccessor.maxValues[2]);
+                } else if (positions.count > 0) {
+                    boundsMin = glm::vec3(FLT_MAX);
+                    boundsMax = glm::vec3(-FLT_MAX);
+                    for (size_t i = 0; i < positions.count; i++) {
+                        glm::vec3 pos(gltfComponent(positions, i, 0), gltfComponent(positions, i, 1), gltfComponent(positions, i, 2));
+                        boundsMin = glm::min(boundsMin, pos);
+                        boundsMax = glm::max(boundsMax, pos);
+                    }
+                }
+
+                // skinning：joint编号按8位保存；蒙皮的顶点已经在模型空间，不乘node的变换，量化使用动画中的包围盒
+                // 每个node的姿势不同，不和其它node共享；source放不下时按普通mesh上传
+                auto joints = primitive.attributes.find("JOINTS_0");
+                auto weights = primitive.attributes.find("WEIGHTS_0");
+                uint32_t vertexCount = static_cast<uint32_t>(positions.count);
+                uint32_t skinSource = ComputeSkinning::NO_SPACE;
+                if (skeleton && instance.skin >= 0 && joints != primitive.attributes.end() && weights != primitive.attributes.end()
+                    && skeleton->skins().at(instance.skin).joints.size() <= 256) {
+                    skinSource = m_skinning.allocateSource(vertexCount);
+                }
+                bool skinned = skinSource != ComputeSkinning::NO_SPACE;
+                glm::vec3 bindMin = boundsMin;
+                glm::vec3 bindMax = boundsMax;
+                if (skinned) {
+                    skeleton->animatedBounds(static_cast<uint32_t>(instance.skin), bindMin, bindMax, SKINNING_BOUNDS_MARGIN, boundsMin, boundsMax);
+                }
+                glm::mat4 dequantize = COMPACT_VERTICES ? vertexDequantizeTransform(boundsMin, boundsMax) : glm::mat4(1.0f);
+                glm::mat4 transform = skinned ? dequantize : instance.transform * dequantize;
+                Aabb vertexBounds = COMPACT_VERTICES ? Aabb{glm::vec3(-1.0f), glm::vec3(1.0f)} : Aabb{boundsMin, boundsMax};  // frustum culling：gpu格式的坐标
+                TextureHandle texture = materialTexture(primitive.material);
+                MaterialDesc material = gltfMaterial(model, primitive.material, texture);
+                drawCount++;
+                if (p < uploaded.size() && !skinned) {
+                    MeshRange shared = m_meshes[uploaded[p]];  // 其它node已经上传过，共享顶点和索引
+                    setMeshMaterial(allocateMeshSlot(shared, transform, vertexBounds, texture), material);  // meshlet：gltf的primitive没有构建meshlet，使用vkCmdDrawIndexed
+                    continue;
+                }
+
+                // gltf：材质指定使用哪一组uv，没有uv时全部是0
+                int texCoordSet = primitive.material >= 0 ? model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.texCoord : 0;
+                auto texCoord = primitive.attributes.find("TEXCOORD_" + std::to_string(texCoordSet));
+                GltfAccessorView texCoords;
+                if (texCoord != primitive.attributes.end()) {
+                    texCoords = gltfAccessorView(model, texCoord->second);
+                }
+
+                GltfAccessorView indexView;
+                if (primitive.indices >= 0) {
+                    indexView = gltfAccessorView(model, primitive.indices);
+                }
+                uint32_t indexCount = primitive.indices >= 0 ? static_cast<uint32_t>(indexView.count) : vertexCount;
+                VkIndexType indexType = vertexCount <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;  // 16位索引：和obj一样按顶点数选择
+                MeshUploadTarget target;
+                try {
+                    target = beginMeshUpload(vertexCount, indexCount, indexType, transform, vertexBounds, texture);
+                } catch (...) {
+                    if (skinned) {
+                        m_skinning.freeSource(skinSource, vertexCount);
+                    }
+                    throw;
+                }
+                setMeshMaterial(target.mesh, material);
+                if (skinned) {
+                    addSkinnedMesh(target.mesh, skinSource, vertexCount, skeleton, static_cast<uint32_t>(instance.skin), glm::inverse(dequantize));
+                    writeSkinSource(model, positions, joints->second, weights->second, skinSource, vertexCount);
+                    skinnedCount++;
+                }
+
+                glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+                glm::vec3 extent = glm::max((boundsMax - boundsMin) * 0.5f, glm::vec3(1e-6f));
+                for (uint32_t i = 0; i < vertexCount; i++) {
+                    glm::vec3 pos(gltfComponent(positions, i, 0), gltfComponent(positions, i, 1), gltfComponent(positions, i, 2));
+                    glm::vec2 uv(0.0f);
+                    if (texCoords.data && i < texCoords.count) {
+                        uv = glm::vec2(gltfComponent(texCoords, i, 0), gltfComponent(texCoords, i, 1));  // gltf的uv原点在左上角，不需要像obj一样翻转
+                    }
+                    if (COMPACT_VERTICES) {
+                        static_cast<PackedVertex*>(target.vertices)[i] = packVertex(pos, uv, center, extent);
+                    } else {
+                        static_cast<Vertex*>(target.vertices)[i] = Vertex{pos, glm::vec3(1.0f), uv};
+                    }
+                }
+                finishMeshUpload(target);
+
+                size_t indexSize = static_cast<size_t>(GeometryBuffer::indexSize(indexType));
+                if (primitive.indices >= 0 && indexView.tight() && indexView.elementSize == indexSize) {
+                    memcpy(target.indices, indexView.data, indexCount * indexSize);
+                } else {
+                    for (uint32_t i = 0; i < indexCount; i++) {
+                        uint32_t index = primitive.indices >= 0 ? gltfIndex(indexView, i) : i;
+                        if (index >= vertexCount) {
+                            throw std::runtime_error("gltf index out of range!");
+                        }
+                        if (indexType == VK_INDEX_TYPE_UINT16) {
+                            static_cast<uint16_t*>(target.indices)[i] = static_cast<uint16_t>(index);
+                        } else {
+                            static_cast<uint32_t*>(target.indices)[i] = index;
+                        }
+                    }
+                }
+
+                if (p >= uploaded.size()) {
+                    uploaded.push_back(target.mesh);
+                }
+                vertexTotal += vertexCount;
+                indexTotal += indexCount;
+            }
+        }
+
+        if (SHOW_STARTUP_TIMINGS) {
+            float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+            std::cout << "gltf upload: " << model.meshes.size() << " meshes, " << drawCount << " draws, " << vertexTotal << " vertices, "
+                << indexTotal << " indices, " << imageTextures.size() << " textures, " << skinnedCount << " skinned, " << batchedPrimitives
+                << " primitives in " << batchCount << " static batches, " << ms << " ms" << std::endl;
+        }
+        return imageTextures;
+    }
+
+    // static batching：找出可以合并的primitive，planStaticBatches分组之后每个batch上传为一个mesh，变换只有解量化
+    // 位置乘上node的世界变换之后按batch的包围盒量化；索引加上primitive在batch中的第一个顶点
+    // 只有一个primitive的batch不在这里上传，batched保持false，由uploadGltf按原来的方式处理
+    template <typename MaterialTexture>
+    void uploadGltfStaticBatches(const tinygltf::Model& model, const std::vector<GltfMeshInstance>& instances, bool hasSkeleton, MaterialTexture&& materialTexture,
+        std::vector<std::vector<bool>>& batched, size_t& batchedPrimitives, size_t& batchCount, size_t& vertexTotal, size_t& indexTotal) {
+        struct Candidate {
+            uint32_t instance;
+            uint32_t primitive;
+            uint32_t indexCount;
+        };
+        std::vector<StaticBatchItem> items;
+        std::vector<Candidate> candidates;
+        for (uint32_t n = 0; n < instances.size(); n++) {
+            const GltfMeshInstance& instance = instances[n];
+            if (hasSkeleton && instance.skin >= 0) {
+                continue;  // skinning：蒙皮的mesh每帧变形，不是静态的
+            }
+            const tinygltf::Mesh& mesh = model.meshes.at(instance.mesh);
+            for (uint32_t p = 0; p < mesh.primitives.size(); p++) {
+                const tinygltf::Primitive& primitive = mesh.primitives[p];
+                auto position = primitive.attributes.find("POSITION");
+                if (primitive.mode != TINYGLTF_MODE_TRIANGLES || position == primitive.attributes.end()) {
+                    continue;
+                }
+                const tinygltf::Accessor& accessor = model.accessors.at(position->second);
+                if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor.type != TINYGLTF_TYPE_VEC3 || accessor.count == 0
+                    || accessor.count > STATIC_BATCH_MAX_MESH_VERTICES || accessor.minValues.size() != 3 || accessor.maxValues.size() != 3) {
+                    continue;
+                }
+                Aabb bounds{glm::vec3(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]),
+                    glm::vec3(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2])};
+                uint32_t indexCount = primitive.indices >= 0 ? static_cast<uint32_t>(model.accessors.at(primitive.indices).count) : static_cast<uint32_t>(accessor.count);
+                items.push_back({static_cast<uint32_t>(primitive.material + 1), transformAabb(bounds, instance.transform), static_cast<uint32_t>(accessor.count)});
+                candidates.push_back({n, p, indexCount});
+            }
+        }
+
+        for (const StaticBatch& batch : planStaticBatches(items, STATIC_BATCH_GRID, STATIC_BATCH_MAX_VERTICES)) {
+            if (batch.items.size() < 2) {
+                continue;
+            }
+            uint32_t indexCount = 0;
+            for (uint32_t item : batch.items) {
+                indexCount += candidates[item].indexCount;
+            }
+            const Candidate& first = candidates[batch.items[0]];
+            int materialIndex = model.meshes.at(instances[first.instance].mesh).primitives[first.primitive].material;
+            TextureHandle texture = materialTexture(materialIndex);
+            glm::mat4 dequantize = COMPACT_VERTICES ? vertexDequantizeTransform(batch.bounds.min, batch.bounds.max) : glm::mat4(1.0f);
+            Aabb vertexBounds = COMPACT_VERTICES ? Aabb{glm::vec3(-1.0f), glm::vec3(1.0f)} : batch.bounds;  // frustum culling：gpu格式的坐标
+            MeshUploadTarget target = beginMeshUpload(batch.vertexCount, indexCount, VK_INDEX_TYPE_UINT16, dequantize, vertexBounds, texture);
+            setMeshMaterial(target.mesh, gltfMaterial(model, materialIndex, texture));
+
+            glm::vec3 center = (batch.bounds.min + batch.bounds.max) * 0.5f;
+            glm::vec3 extent = glm::max((batch.bounds.max - batch.bounds.min) * 0.5f, glm::vec3(1e-6f));
+            uint32_t vertexCursor = 0;
+            uint32_t indexCursor = 0;
+            for (uint32_t item : batch.items) {
+                const Candidate& candidate = candidates[item];
+                const GltfMeshInstance& instance = instances[candidate.instance];
+                const tinygltf::Primitive& primitive = model.meshes.at(instance.mesh).primitives[candidate.primitive];
+                GltfAccessorView positions = gltfAccessorView(model, primitive.attributes.at("POSITION"));
+                int texCoordSet = primitive.material >= 0 ? model.materials[primitive.material].pbrMetallicRoughness.baseColorTexture.texCoord : 0;
+                auto texCoord = primitive.attributes.find("TEXCOORD_" + std::to_string(texCoordSet));
+                GltfAccessorView texCoords;
+                if (texCoord != primitive.attributes.end()) {
+                    texCoords = gltfAccessorView(model, texCoord->second);
+                }
+                uint32_t vertexCount = items[item].vertexCount;
+                for (uint32_t i = 0; i < vertexCount; i++) {
+                    glm::vec3 local(gltfComponent(positions, i, 0), gltfComponent(positions, i, 1), gltfComponent(positions, i, 2));
+                    glm::vec3 pos = glm::vec3(instance.transform * glm::vec4(local, 1.0f));
+                    glm::vec2 uv(0.0f);
+                    if (texCoords.data && i < texCoords.count) {
+                        uv = glm::vec2(gltfComponent(texCoords, i, 0), gltfComponent(texCoords, i, 1));
+                    }
+                    if (COMPACT_VERTICES) {
+                        static_cast<PackedVertex*>(target.vertices)[vertexCursor + i] = packVertex(pos, uv, center, extent);
+                    } else {
+                        static_cast<Vertex*>(target.vertices)[vertexCursor + i] = Vertex{pos, glm::vec3(1.0f), uv};
+                    }
+                }
+
+                GltfAccessorView indexView;
+                if (primitive.indices >= 0) {
+                    indexView = gltfAccessorView(model, primitive.indices);
+                }
+                uint16_t* indices = static_cast<uint16_t*>(target.indices) + indexCursor;
+                for (uint32_t i = 0; i < candidate.indexCount; i++) {
+                    uint32_t index = primitive.indices >= 0 ? gltfIndex(indexView, i) : i;
+                    if (index >= vertexCount) {
+                        throw std::runtime_error("gltf index out of range!");
+                    }
+                    indices[i] = static_cast<uint16_t>(vertexCursor + index);
+                }
+
+                if (batched[candidate.instance].size() <= candidate.primitive) {
+                    batched[candidate.instance].resize(candidate.primitive + 1, false);
+                }
+                batched[candidate.instance][candidate.primitive] = true;
+                vertexCursor += vertexCount;
+                indexCursor += candidate.indexCount;
+            }
+            finishMeshUpload(target);
+            batchedPrimitives += batch.items.size();
+            batchCount++;
+            vertexTotal += batch.vertexCount;
+            indexTotal += indexCount;
+        }
+    }
+
+    // skinning：绑定姿势的float位置、joint编号和权重写进source，上传的顶点之后只提供位置之外的属性
+    void writeSkinSource(const tinygltf::Model& model, const GltfAccessorView& positions, int jointAccessor, int weightAccessor, uint32_t first, uint32_t vertexCount) {
+        GltfAccessorView joints = gltfAccessorView(model, jointAccessor);
+        GltfAccessorView weights = gltfAccessorView(model, weightAccessor);
+        if (joints.type != TINYGLTF_TYPE_VEC4 || weights.type != TINYGLTF_TYPE_VEC4 || joints.count < vertexCount || weights.count < vertexCount) {
+            throw std::runtime_error("unsupported gltf skin attributes!");
+        }
+        ComputeSkinning::SkinVertex* target = m_skinning.sourceVertices(first);
+        for (uint32_t i = 0; i < vertexCount; i++) {
+            glm::vec3 pos(gltfComponent(positions, i, 0), gltfComponent(positions, i, 1), gltfComponent(positions, i, 2));
+            glm::uvec4 joint(0);
+            glm::vec4 weight(0.0f);
+            for (int k = 0; k < 4; k++) {
+                joint[k] = static_cast<uint32_t>(gltfComponent(joints, i, k));  // JOINTS_0是不归一化的unsigned byte或unsigned short
+                weight[k] = gltfComponent(weights, i, k);
+            }
+            target[i] = ComputeSkinning::packSkinVertex(pos, joint, weight);
+        }
+    }
+
+    // skinning：每个frame in flight一个只有顶点的输出范围，和绑定姿势使用同一段索引；先记录再分配，分配失败时releaseModelMeshes归还已经分配的部分
+    void addSkinnedMesh(size_t mesh, uint32_t sourceVertex, uint32_t vertexCount, std::shared_ptr<const GltfSkeleton> skeleton, uint32_t skin, const glm::mat4& quantize) {
+        m_skinnedMeshes.push_back({mesh, m_meshes[mesh].vertexOffset, {}, sourceVertex, vertexCount, std::move(skeleton), skin, quantize});
+        for (MeshRange& output : m_skinnedMeshes.back().outputs) {
+            output = m_geometryBuffer.allocateVertices(vertexCount);
+            m_meshOwner.bytes += m_geometryBuffer.vertexByteSize(output) + m_geometryBuffer.attributeByteSize(output);
+        }
+    }
+
+    // compact vertex：量化时位置相对于模型的包围盒，mesh cache：包围盒保存在缓存中不需要重新遍历顶点
+    static glm::mat4 meshTransform(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+        return COMPACT_VERTICES ? vertexDequantizeTransform(boundsMin, boundsMax) : glm::mat4(1.0f);
+    }
+
+    // model loading：obj文件加载，obj文件由位置、法线、纹理坐标、面组成，面通过顶点组成，顶点通过索引指向一个位置、法线、纹理坐标，使其可以重复使用整个顶点也可以重复使用顶点的属性
+    // mesh optimizer：只在导入时运行，结果写入mesh cache，输出优化前后的acmr和atvr
+    void optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+        if (indices.empty()) {
+            return;
+        }
+        auto startTime = std::chrono::high_resolution_clock::now();
+        VertexCacheStats before = analyzeVertexCache(indices, vertices.size());
+
+        std::vector<size_t> clusterStarts;
+        indices = optimizeVertexCache(indices, vertices.size(), clusterStarts);
+        indices = optimizeOverdraw(indices, clusterStarts, &vertices[0].pos.x, sizeof(Vertex));
+        optimizeVertexFetch(vertices, indices);
+
+        if (SHOW_STARTUP_TIMINGS) {
+            VertexCacheStats after = analyzeVertexCache(indices, vertices.size());
+            float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+            std::cout << "mesh optimize: acmr " << before.acmr << " -> " << after.acmr << ", atvr " << before.atvr << " -> " << after.atvr
+                << ", " << clusterStarts.size() << " clusters, " << ms << " ms" << std::endl;
+        }
+    }
+
+    void importObj(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+        if (STREAMING_OBJ_IMPORT && !BENCHMARK_VERTEX_DEDUP) {
+            importObjStreaming(path, vertices, indices);
+            return;
+        }
+        tinyobj::attrib_t attrib;  // attrib_t存有所有vertices、normals、texcoords
+        std::vector<tinyobj::shape_t> shapes;  // shape_t存有独立对象和其面，面由一个顶点数组组成
+        std::vector<tinyobj::material_t> materials;  // obj每个面可以定义材料和纹理这里暂时不用
+        std::string warn, err;
+
+        // obj文件中一个面其实可以包含任意数量顶点而不只是三角形，不过loadObj会默认对多个顶点的面进行三角形处理
+        // mapped file：tinyobj从映射的文件读取，mtl和按文件名读取时一样从工作目录查找
+        MappedFile file;
+        if (!file.open(path)) {
+            throw std::runtime_error("failed to open model file: " + path);
+        }
+        MemoryStreamBuf fileBuffer(file.view());
+        std::istream fileStream(&fileBuffer);
+        tinyobj::MaterialFileReader materialReader("");
+        if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &fileStream, &materialReader)) {
+            throw std::runtime_error(warn + err);
+        }
+
+        // parallel import：每个shape的索引按OBJ_IMPORT_CHUNK_SIZE分块，多个小shape和一个大shape都能分给所有线程
+        struct ImportChunk {
+            const std::vector<tinyobj::index_t>* objIndices;
+            size_t begin;
+            size_t end;
+            size_t indexOffset;  // 在最终索引数组中的位置
+            std::vector<Vertex> vertices;  // 块内去重后的顶点
+            std::vector<uint32_t> indices;  // 指向块内的vertices，合并后改成全局index
+        };
+
+        size_t indexCount = 0;
+        std::vector<ImportChunk> chunks;
+        for (const auto& shape : shapes) {
+            const std::vector<tinyobj::index_t>& objIndices = shape.mesh.indices;
+            for (size_t begin = 0; begin < objIndices.size(); begin += OBJ_IMPORT_CHUNK_SIZE) {
+                ImportChunk chunk{};
+                chunk.objIndices = &objIndices;
+                chunk.begin = begin;
+                chunk.end = std::min(begin + OBJ_IMPORT_CHUNK_SIZE, objIndices.size());
+                chunk.indexOffset = indexCount;
+                indexCount += chunk.end - chunk.begin;
+                chunks.push_back(std::move(chunk));
+            }
+        }
+
+        // flat index map：顶点去重，每个vertex对应一个index，按索引数量预留空间，去重过程中不会rehash
+        auto dedupStart = std::chrono::high_resolution_clock::now();
+        m_jobPool.parallelFor(chunks.size(), [&](size_t i) {
+            ImportChunk& chunk = chunks[i];
+            FlatIndexMap<Vertex> uniqueVertices;
+            uniqueVertices.reserve(chunk.end - chunk.begin);
+            chunk.indices.reserve(chunk.end - chunk.begin);
+            for (size_t j = chunk.begin; j < chunk.end; j++) {  // 遍历顶点索引
+                // 重复或者不重复的顶点都会创建一个index，找不到相同的vertex时加入到vertices
+                chunk.indices.push_back(uniqueVertices.findOrInsert(makeObjVertex(attrib, (*chunk.objIndices)[j]), chunk.vertices));
+            }
+        });
+
+        // parallel import：按块的顺序把块内的顶点合并去重，顶点顺序和单线程时一样是第一次出现的顺序
+        // 合并只遍历块内去重后的顶点，块内的索引改成全局index可以再并行
+        size_t chunkVertexCount = 0;
+        for (const ImportChunk& chunk : chunks) {
+            chunkVertexCount += chunk.vertices.size();
+        }
+        FlatIndexMap<Vertex> uniqueVertices;
+        uniqueVertices.reserve(chunkVertexCount);
+        vertices.reserve(chunkVertexCount);
+        std::vector<std::vector<uint32_t>> remaps(chunks.size());
+        for (size_t i = 0; i < chunks.size(); i++) {
+            remaps[i].reserve(chunks[i].vertices.size());
+            for (const Vertex& vertex : chunks[i].vertices) {
+                remaps[i].push_back(uniqueVertices.findOrInsert(vertex, vertices));
+            }
+            std::vector<Vertex>().swap(chunks[i].vertices);  // 已经合并，提前释放
+        }
+
+        indices.resize(indexCount);
+        m_jobPool.parallelFor(chunks.size(), [&](size_t i) {
+            const std::vector<uint32_t>& remap = remaps[i];
+            uint32_t* dst = indices.data() + chunks[i].indexOffset;
+            for (uint32_t index : chunks[i].indices) {
+                *dst++ = remap[index];
+            }
+        });
+
+        if (BENCHMARK_VERTEX_DEDUP) {
+            float flatMs = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - dedupStart).count();
+            auto mapStart = std::chrono::high_resolution_clock::now();
+            std::vector<Vertex> mapVertices;
+            std::vector<uint32_t> mapIndices;
+            dedupWithUnorderedMap(attrib, shapes, mapVertices, mapIndices);
+            float mapMs = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - mapStart).count();
+            std::cout << "vertex dedup: " << indexCount << " indices, flat index map " << flatMs << " ms (" << vertices.size() << " vertices), unordered_map "
+                << mapMs << " ms (" << mapVertices.size() << " vertices)" << std::endl;
+        }
+    }
+
+    // obj stream：单线程，每个corner组装之后马上去重，顶点顺序和tinyobj路径一样是第一次出现的顺序
+    // 没有uv的面uv为0；索引数组按文件大小估计预留，避免大文件的多次扩容
+    void importObjStreaming(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+        MappedFile file;
+        if (!file.open(path)) {
+            throw std::runtime_error("failed to open model file: " + path);
+        }
+        auto startTime = std::chrono::high_resolution_clock::now();
+        FlatIndexMap<Vertex> uniqueVertices;
+        indices.reserve(file.size() / 16);  // 一个三角形的f行大约30到50字节
+        ObjStreamStats stats = parseObjStream(file, OBJ_STREAM_CHUNK_SIZE, [&](const float* position, const float* texCoord) {
+            Vertex vertex{};
+            vertex.pos = {position[0], position[1], position[2]};
+            if (texCoord != nullptr) {
+                vertex.texCoord = {texCoord[0], 1.0f - texCoord[1]};  // 和makeObjVertex一样翻转纹理的y
+            }
+            vertex.color = {1.0f, 1.0f, 1.0f};
+            indices.push_back(uniqueVertices.findOrInsert(vertex, vertices));
+        });
+
+        if (SHOW_STARTUP_TIMINGS) {
+            float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+            std::cout << "obj stream: " << stats.positions << " positions, " << stats.texCoords << " uvs, " << stats.triangles << " triangles -> "
+                << vertices.size() << " vertices, " << ms << " ms" << std::endl;
+        }
+    }
+
+    // gpu mesh import：和importObjStreaming相同的解析，只记录每个corner引用的位置和uv编号，不组装顶点
+    std::unique_ptr<PendingObjImport> parseObjCorners(const std::string& path) {
+        MappedFile file;
+        if (!file.open(path)) {
+            throw std::runtime_error("failed to open model file: " + path);
+        }
+        auto startTime = std::chrono::high_resolution_clock::now();
+        auto pending = std::make_unique<PendingObjImport>();
+        pending->corners.reserve(file.size() / 16 * 2);  // 和importObjStreaming的估计一样，每个corner两个uint
+        ObjStreamStats stats = parseObjStreamIndices(file, OBJ_STREAM_CHUNK_SIZE, pending->positions, pending->texCoords, [&](size_t position, size_t texCoord) {
+            pending->corners.push_back(static_cast<uint32_t>(position));
+            pending->corners.push_back(texCoord == SIZE_MAX ? GpuMeshImporter::NO_TEX_COORD : static_cast<uint32_t>(texCoord));
+        });
+        if (stats.positions >= UINT32_MAX || stats.texCoords >= UINT32_MAX) {
+            throw std::runtime_error("obj has too many vertices for 32-bit corner indices!");
+        }
+
+        if (SHOW_STARTUP_TIMINGS) {
+            float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+            std::cout << "obj corners: " << stats.positions << " positions, " << stats.texCoords << " uvs, " << stats.triangles << " triangles, " << ms << " ms"
+                << std::endl;
+        }
+        return pending;
+    }
+
+    // gpu mesh import：设备放不下时的cpu去重，顶点和importObjStreaming相同
+    static void dedupObjCorners(const PendingObjImport& pending, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+        FlatIndexMap<Vertex> uniqueVertices;
+        indices.reserve(pending.corners.size() / 2);
+        for (size_t i = 0; i < pending.corners.size(); i += 2) {
+            Vertex vertex{};
+            const float* position = &pending.positions[pending.corners[i] * size_t(3)];
+            vertex.pos = {position[0], position[1], position[2]};
+            if (pending.corners[i + 1] != GpuMeshImporter::NO_TEX_COORD) {
+                const float* texCoord = &pending.texCoords[pending.corners[i + 1] * size_t(2)];
+                vertex.texCoord = {texCoord[0], 1.0f - texCoord[1]};
+            }
+            vertex.color = {1.0f, 1.0f, 1.0f};
+            indices.push_back(uniqueVertices.findOrInsert(vertex, vertices));
+        }
+    }
+
+    // model loading：从obj的索引组装顶点，位置和uv通过各自的索引读取
+    static Vertex makeObjVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& index) {
+        Vertex vertex{};
+
+        vertex.pos = {
+            attrib.vertices[3 * index.vertex_index + 0],
+            attrib.vertices[3 * index.vertex_index + 1],
+            attrib.vertices[3 * index.vertex_index + 2]
+        };
+
+        vertex.texCoord = {
+            attrib.texcoords[2 * index.texcoord_index + 0],
+            1.0f - attrib.texcoords[2 * index.texcoord_index + 1]  // 翻转纹理的y，因为obj认为y的0点在图像底部而我们把图像传给vulkan是自顶向下传输
+        };
+
+        vertex.color = {1.0f, 1.0f, 1.0f};
+        return vertex;
+    }
+
+    // flat index map：原来的去重方式，只用于BENCHMARK_VERTEX_DEDUP对比
+    static void dedupWithUnorderedMap(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+        std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+
+        for (const auto& shape : shapes) {
+            for (const auto& index : shape.mesh.indices) {
+                Vertex vertex = makeObjVertex(attrib, index);
+
+                // 顶点去重，使用index，这需要Vertex类实现相等测试和哈希函数
+                // 如果map没找到相同的vertex那么把vertex索引加入到map，并增加到vertices
+                if (uniqueVertices.count(vertex) == 0) {
+                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+                    vertices.push_back(vertex);
+                }
+
+                // 重复或者不重复的顶点都会创建一个index
+                indices.push_back(uniqueVertices[vertex]);
+            }
+        }
+    }
+    
+    // geometry buffer：创建所有mesh共享的device local buffer
+    // vertex buffer：buffer是内存区域，用于向显卡提供读取的数据。buffer不会自动分配内存需要手动分配
+    void createGeometryBuffer() {
+        // transfer queue：传输队列和图形队列不同时两边都会访问这个buffer
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+        std::vector<uint32_t> queueFamilies = {queueFamilyIndices.graphicsFamily.value()};
+        if (queueFamilyIndices.transferFamily.has_value()) {
+            queueFamilies.push_back(queueFamilyIndices.transferFamily.value());
+        }
+
+        // meshlet：mesh shader按storage buffer读取geometry buffer的顶点区域
+        // descriptor buffer：set 2中的storage buffer descriptor使用buffer的device address
+        VkBufferUsageFlags addressUsage = m_descriptorBuffer.initialized() ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0;
+        // vertex pulling：pulled.vert同样按storage buffer读取
+        VkBufferUsageFlags extraUsage = useGeometrySet() ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | addressUsage : 0;
+        if (GPU_SKINNING) {  // skinning：compute shader写入蒙皮后的顶点
+            extraUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        }
+        if (m_gpuMeshDecoder.initialized()) {  // mesh codec：compute shader写入解码的顶点和索引
+            extraUsage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        }
+        if (m_rayTracedShadowsSupported) {  // ray traced shadows：BLAS build直接读取geometry buffer中的位置和索引
+            extraUsage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+        }
+        if (!m_streamCapturePath.empty()) {  // stream capture：读回draw引用的mesh
+            extraUsage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        }
+        uint32_t positionSize = SPLIT_VERTEX_STREAMS ? (COMPACT_VERTICES ? PackedVertex::POSITION_SIZE : Vertex::POSITION_SIZE) : 0;
+        // sparse binding：页的绑定提交到上传队列，和之后的拷贝在同一个线程上按顺序提交
+        uint32_t uploadFamily = queueFamilyIndices.transferFamily.value_or(queueFamilyIndices.graphicsFamily.value());
+        uint32_t familyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+        std::vector<VkQueueFamilyProperties> familyProperties(familyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, familyProperties.data());
+        bool sparseQueue = m_sparseGeometrySupported && (familyProperties[uploadFamily].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT);
+        m_geometryBuffer.init(device, m_allocator, COMPACT_VERTICES ? sizeof(PackedVertex) : sizeof(Vertex), positionSize, GEOMETRY_MAX_VERTICES, GEOMETRY_MAX_INDICES,
+            queueFamilies, extraUsage, sparseQueue ? transferQueue : VK_NULL_HANDLE);
+        if (m_geometryBuffer.sparse()) {
+            std::cout << "geometry buffer: sparse binding, pages committed on demand" << std::endl;
+        }
+        if (m_meshShaderSupported) {
+            m_meshletBuffer.init(device, m_allocator, MESHLET_BUFFER_MAX_MESHLETS, MESHLET_BUFFER_MAX_VERTICES, MESHLET_BUFFER_MAX_TRIANGLES, queueFamilies, addressUsage);
+        }
+        m_materials.init(device, m_allocator, MATERIAL_CAPACITY, MAX_FRAMES_IN_FLIGHT, addressUsage);  // materials：mesh分配编号时就需要材质
+    }
+
+    // geometry buffer：为mesh分配空间，通过staging ring把顶点和索引拷贝到共享buffer中
+    // staging buffer：device local内存cpu不可见，所以数据先写入host可见的staging空间，再通过复制命令复制到device buffer中
+    // geometry buffer：meshVertices是geometry buffer使用的顶点格式，transform在绘制时乘在model矩阵右边
+    // 16位索引：meshIndices的类型由indexType决定
+    // 返回mesh编号，可能是复用的编号
+    size_t uploadMesh(const void* meshVertices, uint32_t vertexCount, const void* meshIndices, uint32_t indexCount, VkIndexType indexType,
+        const glm::mat4& transform, TextureHandle texture) {
+        MeshUploadTarget target = beginMeshUpload(vertexCount, indexCount, indexType, transform, gpuVertexBounds(meshVertices, vertexCount), texture);
+        writeMeshVertices(target, meshVertices);
+        memcpy(target.indices, meshIndices, static_cast<size_t>(indexCount) * GeometryBuffer::indexSize(indexType));
+        setMeshOccluder(target.mesh, meshVertices, vertexCount, meshIndices, indexCount, indexType);
+        return target.mesh;
+    }
+
+    // software occlusion：三角形不超过SOFTWARE_OCCLUDER_MAX_TRIANGLES时把位置解码并乘上mesh的变换，展开成不带索引的三角形保存
+    // vertices是gpu的顶点格式，indices相对于vertices的第一个顶点
+    void setMeshOccluder(size_t mesh, const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount, VkIndexType indexType) {
+        std::vector<glm::vec3>& occluder = m_meshOccluders[mesh];
+        occluder.clear();
+        if (!SOFTWARE_OCCLUSION || indexCount / 3 > SOFTWARE_OCCLUDER_MAX_TRIANGLES) {
+            return;
+        }
+        occluder.reserve(indexCount - indexCount % 3);
+        for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+            uint32_t corners[3];
+            for (uint32_t k = 0; k < 3; k++) {
+                corners[k] = indexType == VK_INDEX_TYPE_UINT16 ? static_cast<const uint16_t*>(indices)[i + k] : static_cast<const uint32_t*>(indices)[i + k];
+            }
+            if (corners[0] >= vertexCount || corners[1] >= vertexCount || corners[2] >= vertexCount) {
+                continue;
+            }
+            for (uint32_t corner : corners) {
+                occluder.push_back(glm::vec3(m_meshTransforms[mesh] * glm::vec4(gpuVertexPosition(vertices, corner), 1.0f)));
+            }
+        }
+    }
+
+    // gltf：顶点和索引的写入位置，是geometry buffer本身或者staging ring中的空间
+    // split vertex streams：分开时vertices是交错格式的临时空间，写完之后finishMeshUpload拆到positions和attributes中
+    struct MeshUploadTarget {
+        void* vertices;
+        void* indices;
+        void* positions;
+        void* attributes;
+        uint32_t vertexCount;
+        size_t mesh;  // world streaming：mesh编号可能是复用的，不一定是m_meshes的最后一个
+    };
+
+    // split vertex streams：已经是交错格式的顶点直接拆开写入，不经过临时空间
+    void writeMeshVertices(const MeshUploadTarget& target, const void* vertices) {
+        if (m_geometryBuffer.splitStreams()) {
+            m_geometryBuffer.splitVertices(vertices, target.vertexCount, target.positions, target.attributes);
+        } else {
+            memcpy(target.vertices, vertices, static_cast<size_t>(target.vertexCount) * m_geometryBuffer.vertexStride());
+        }
+    }
+
+    // split vertex streams：调用者写完target.vertices之后调用，不分开时什么也不做
+    void finishMeshUpload(const MeshUploadTarget& target) {
+        if (m_geometryBuffer.splitStreams()) {
+            m_geometryBuffer.splitVertices(target.vertices, target.vertexCount, target.positions, target.attributes);
+        }
+    }
+
+    // gltf：分配mesh并录制拷贝命令，返回的位置由调用者直接写入，在提交upload context之前写完即可
+    // frustum culling：bounds是gpu格式顶点的包围盒，乘上transform之后保存
+    MeshUploadTarget beginMeshUpload(uint32_t vertexCount, uint32_t indexCount, VkIndexType indexType, const glm::mat4& transform, const Aabb& bounds,
+        TextureHandle texture) {
+        MeshRange mesh = m_geometryBuffer.allocate(vertexCount, indexCount, indexType);
+        size_t slot = allocateMeshSlot(mesh, transform, bounds, texture);
+
+        VkDeviceSize vertexSize = m_geometryBuffer.vertexByteSize(mesh);
+        VkDeviceSize attributeSize = m_geometryBuffer.attributeByteSize(mesh);
+        VkDeviceSize indexSize = m_geometryBuffer.indexByteSize(mesh);
+        m_meshOwner.bytes += vertexSize + attributeSize + indexSize;
+        bool split = m_geometryBuffer.splitStreams();
+        void* scratch = nullptr;
+        if (split) {  // split vertex streams：调用者按交错格式写入这里
+            m_vertexUploadScratch.resize(static_cast<size_t>(vertexCount) * m_geometryBuffer.vertexStride());
+            scratch = m_vertexUploadScratch.data();
+        }
+
+        // zero staging：buffer是host visible时直接写入最终位置，新分配的空间gpu还没有使用，host coherent内存在下次vkQueueSubmit时对gpu可见
+        if (m_geometryBuffer.hostVisible()) {
+            char* mapped = static_cast<char*>(m_geometryBuffer.mapped());
+            char* positions = mapped + m_geometryBuffer.vertexByteOffset(mesh);
+            return {split ? scratch : positions, mapped + m_geometryBuffer.indexByteOffset(mesh), positions, mapped + m_geometryBuffer.attributeByteOffset(mesh), vertexCount, slot};
+        }
+
+        // staging ring：顶点和索引放在同一段staging空间中，索引紧跟在顶点后面；分开时顺序是位置、其它属性、索引
+        auto alignStaging = [](VkDeviceSize offset) { return (offset + sizeof(uint32_t) - 1) / sizeof(uint32_t) * sizeof(uint32_t); };
+        VkDeviceSize attributeStagingOffset = alignStaging(vertexSize);
+        VkDeviceSize indexStagingOffset = alignStaging(attributeStagingOffset + attributeSize);
+        StagingRing::Region staging = m_stagingRing.allocate(indexStagingOffset + indexSize);
+
+        copyBuffer(staging.buffer, staging.offset, m_geometryBuffer.buffer(), m_geometryBuffer.vertexByteOffset(mesh), vertexSize);
+        if (split) {
+            copyBuffer(staging.buffer, staging.offset + attributeStagingOffset, m_geometryBuffer.buffer(), m_geometryBuffer.attributeByteOffset(mesh), attributeSize);
+        }
+        copyBuffer(staging.buffer, staging.offset + indexStagingOffset, m_geometryBuffer.buffer(), m_geometryBuffer.indexByteOffset(mesh), indexSize);
+
+        // meshlet：mesh shader路径把顶点作为storage buffer读取
+        VkAccessFlags vertexAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        VkPipelineStageFlags vertexStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+        if (m_meshShaderSupported) {
+            vertexAccess |= VK_ACCESS_SHADER_READ_BIT;
+            vertexStages |= VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+        }
+        m_uploadContext.handoffSharedBuffer(m_geometryBuffer.buffer(), m_geometryBuffer.vertexByteOffset(mesh), vertexSize, vertexAccess, vertexStages);
+        if (split) {
+            m_uploadContext.handoffSharedBuffer(m_geometryBuffer.buffer(), m_geometryBuffer.attributeByteOffset(mesh), attributeSize, vertexAccess, vertexStages);
+        }
+        m_uploadContext.handoffSharedBuffer(m_geometryBuffer.buffer(), m_geometryBuffer.indexByteOffset(mesh), indexSize,
+            VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+        // staging ring：ring是持久映射的host coherent内存，直接写入mapped地址，下次vkQueueSubmit时保证对gpu可见
+        char* mapped = static_cast<char*>(staging.mapped);
+        return {split ? scratch : mapped, mapped + indexStagingOffset, mapped, mapped + attributeStagingOffset, vertexCount, slot};
+    }
+
+    // world streaming：mesh的所有per-mesh数组使用同一个编号，优先复用卸载的模型留下的编号
+    // 记录的变换和包围盒乘上m_meshOwner.placement；meshlet、lod和doubleSided重置，由调用者按需设置
+    size_t allocateMeshSlot(const MeshRange& range, const glm::mat4& transform, const Aabb& bounds, TextureHandle texture) {
+        glm::mat4 placed = m_meshOwner.placement * transform;
+        if (m_freeMeshSlots.empty()) {
+            m_meshes.push_back(range);
+            m_meshTransforms.push_back(placed);
+            m_meshBounds.push_back(transformAabb(bounds, placed));
+            m_meshTextures.push_back(texture);
+            m_meshModels.push_back(m_meshOwner.model);
+            m_meshMeshlets.push_back({});  // meshlet：有meshlet的mesh由uploadMeshlets设置
+            m_meshLods.push_back({});  // lod：有lod的mesh由uploadSubmesh设置
+            m_meshImpostors.push_back({});  // impostor：resident之后在updateImpostors中烘焙
+            m_meshBlas.push_back(AccelerationStructures::INVALID_BLAS);  // ray traced shadows：第一次可见时在updateRayTracedShadows中创建
+            m_meshDoubleSided.push_back(false);
+            m_meshOccluders.push_back({});  // software occlusion：uploadMesh和uploadSubmesh按三角形数量设置
+            m_meshMaterials.push_back(m_materials.acquire({texture}));  // materials：默认材质只有纹理，gltf的mesh由setMeshMaterial替换
+            return m_meshes.size() - 1;
+        }
+        size_t slot = m_freeMeshSlots.back();
+        m_freeMeshSlots.pop_back();
+        m_meshes[slot] = range;
+        m_meshTransforms[slot] = placed;
+        m_meshBounds[slot] = transformAabb(bounds, placed);
+        m_meshTextures[slot] = texture;
+        m_meshModels[slot] = m_meshOwner.model;
+        m_meshMeshlets[slot] = {};
+        m_meshLods[slot] = {};
+        m_meshImpostors[slot] = {};
+        m_meshBlas[slot] = AccelerationStructures::INVALID_BLAS;
+        m_meshDoubleSided[slot] = false;
+        m_meshOccluders[slot].clear();
+        m_meshMaterials[slot] = m_materials.acquire({texture});  // 卸载时已经释放了上一个材质
+        return slot;
+    }
+
+    // materials：替换mesh的材质，面剔除跟随材质的doubleSided
+    void setMeshMaterial(size_t slot, const MaterialDesc& desc) {
+        uint32_t material = m_materials.acquire(desc);
+        m_materials.release(m_meshMaterials[slot]);
+        m_meshMaterials[slot] = material;
+        m_meshDoubleSided[slot] = desc.doubleSided;
+    }
+
+    // descriptor set layout：根据frames in flight创建多个ubo，避免更新的ubo正在被使用。不使用staging buffer因为每帧都会更新ubo，反而造成性能下降
+    // uniform ring：每帧一个buffer，slice的offset需要满足minUniformBufferOffsetAlignment
+    void createUniformBuffers() {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        VkBufferUsageFlags extraUsage = m_descriptorBuffer.initialized() ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0;  // descriptor buffer：ubo descriptor使用地址
+        m_uniformRing.init(device, m_allocator, properties.limits.minUniformBufferOffsetAlignment, sizeof(UniformBufferObject), UNIFORM_RING_FRAME_SIZE, MAX_FRAMES_IN_FLIGHT, extraUsage);
+
+        m_instanceBuffer.init(device, m_allocator, sizeof(InstanceData), instanceCapacity(), MAX_FRAMES_IN_FLIGHT);
+        m_frameArenas.init(MAX_FRAMES_IN_FLIGHT);
+        m_indirectDraws.init(device, m_allocator, sizeof(uint32_t), INDIRECT_MAX_DRAWS, MAX_FRAMES_IN_FLIGHT, extraUsage);  // set 0总是引用它
+        m_sceneObjects.init(device, m_allocator, SCENE_OBJECT_CAPACITY, MAX_FRAMES_IN_FLIGHT, extraUsage);
+        m_clusteredLighting.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(LIGHT_CLUSTER_SHADER), lightCount(), MAX_FRAMES_IN_FLIGHT, extraUsage,
+            m_asyncCompute.queueFamilies());
+        createLights();
+        createShadowCache();
+        if (m_rayTracedShadowsSupported) {
+            m_accelerationStructures.init(physicalDevice, device, m_allocator, commandPool, MAX_FRAMES_IN_FLIGHT, RAY_TRACED_SHADOW_MAX_INSTANCES,
+                RAY_TRACED_SHADOW_SCRATCH_BUDGET, RAY_TRACED_SHADOW_BUILDS_PER_FRAME,
+                [this](std::function<void()> destroy) { m_deletionQueue.push(m_frameNumber, std::move(destroy)); });
+        }
+        if (m_drawIndirectCountSupported) {
+            m_gpuCuller.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(INSTANCE_CULL_SHADER), sizeof(InstanceData), instanceCapacity(),
+                GPU_CULLING_MAX_DRAWS, MAX_FRAMES_IN_FLIGHT);
+            m_hiz.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(HIZ_REDUCE_SHADER), MAX_FRAMES_IN_FLIGHT, [this](std::function<void()> destroy) {
+                m_deletionQueue.push(m_frameNumber, std::move(destroy));
+            });
+            // alternate frame rendering：上一帧的depth在另一个设备上
+            m_occlusionCulling = OCCLUSION_CULLING && m_dynamicRenderingSupported && supportsDepthSampling() && m_msaaSamples == VK_SAMPLE_COUNT_1_BIT
+                && !m_deviceGroup.alternateFrames();
+            resizeHiZPyramid();
+        }
+        m_instanceBvh.init(&m_jobPool);
+        if (SOFTWARE_OCCLUSION) {
+            m_softwareOcclusion.init(SOFTWARE_OCCLUSION_WIDTH, SOFTWARE_OCCLUSION_HEIGHT);
+        }
+        buildSceneInstances();
+    }
+
+    // gpu mesh import：导入的buffer每次单独创建，这里只创建pipeline
+    void createGpuMeshImporter() {
+        if (!GPU_MESH_IMPORT) {
+            return;
+        }
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_gpuMeshImporter.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(MESH_DEDUP_SHADER), properties.limits.maxStorageBufferRange);
+    }
+
+    // skinning：geometry buffer的顶点区域是storage buffer，布局和蒙皮输出使用的顶点格式一致
+    void createSkinning() {
+        if (!GPU_SKINNING) {
+            return;
+        }
+        ComputeSkinning::VertexLayout layout{};
+        uint32_t positionSize = COMPACT_VERTICES ? PackedVertex::POSITION_SIZE : Vertex::POSITION_SIZE;
+        layout.positionStride = m_geometryBuffer.positionStride() / sizeof(uint32_t);
+        if (m_geometryBuffer.splitStreams()) {
+            layout.attributeRegion = static_cast<uint32_t>(m_geometryBuffer.attributeRegionOffset() / sizeof(uint32_t));
+            layout.attributeStride = m_geometryBuffer.attributeStride() / sizeof(uint32_t);
+            layout.attributeSkip = 0;
+        } else {
+            layout.attributeRegion = 0;
+            layout.attributeStride = m_geometryBuffer.vertexStride() / sizeof(uint32_t);
+            layout.attributeSkip = positionSize / sizeof(uint32_t);
+        }
+        layout.attributeWords = (m_geometryBuffer.vertexStride() - positionSize) / sizeof(uint32_t);
+        layout.compact = COMPACT_VERTICES ? 1 : 0;
+        m_skinning.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(SKINNING_SHADER), commandPool, MAX_FRAMES_IN_FLIGHT, SKINNING_MAX_VERTICES,
+            SKINNING_MAX_JOINTS, m_geometryBuffer.buffer(), m_geometryBuffer.vertexRegionSize(), layout);
+    }
+
+    // gpu decompression：解压的buffer每次单独创建，这里只创建pipeline
+    void createGpuDecompressor() {
+        if (!GPU_ASSET_DECOMPRESSION) {
+            return;
+        }
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_gpuDecompressor.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(GPU_DECOMPRESS_SHADER), properties.limits.maxStorageBufferRange);
+    }
+
+    // mesh codec：和gpu decompression一样只创建pipeline，每次上传的输入buffer单独创建
+    void createGpuMeshDecoder() {
+        if (!GPU_MESH_DECODE) {
+            return;
+        }
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_gpuMeshDecoder.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(MESH_DECODE_SHADER), properties.limits);
+    }
+
+    // shadow cache：shadow pipeline只读取位置和实例矩阵，顶点格式和场景的pipeline相同
+    void createShadowCache() {
+        std::vector<VkVertexInputBindingDescription> bindings;
+        std::vector<VkVertexInputAttributeDescription> attributes;
+        gpuVertexInput(true, bindings, attributes);  // split vertex streams：分开时只读取位置的binding
+        m_shadowCache.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(SHADOW_VERT_SHADER), bindings, attributes, m_quality.settings().shadowMapSize, commandPool,
+            MAX_FRAMES_IN_FLIGHT);
+        m_shadowInstances.init(device, m_allocator, sizeof(InstanceData), instanceCapacity(), MAX_FRAMES_IN_FLIGHT);
+    }
+
+    // clustered lighting：光源的位置、颜色和类型由index确定（整数hash），每次启动相同
+    void createLights() {
+        auto hash = [](uint32_t x) {
+            x ^= x >> 16;
+            x *= 0x7feb352du;
+            x ^= x >> 15;
+            x *= 0x846ca68bu;
+            x ^= x >> 16;
+            return static_cast<float>(x & 0xffffff) / static_cast<float>(0x1000000);
+        };
+        float half = instanceGridSize() * instanceSpacing() * 0.5f;
+        m_lights.resize(lightCount());
+        for (uint32_t i = 0; i < lightCount(); i++) {
+            ClusterLight& light = m_lights[i];
+            glm::vec3 position((hash(i * 4) * 2.0f - 1.0f) * half, (hash(i * 4 + 1) * 2.0f - 1.0f) * half, 0.5f + hash(i * 4 + 2) * 1.5f);
+            light.positionRange = glm::vec4(position, CLUSTERED_LIGHT_RANGE);
+            float hue = hash(i * 4 + 3) * 6.0f;
+            glm::vec3 color = glm::clamp(glm::vec3(std::abs(hue - 3.0f) - 1.0f, 2.0f - std::abs(hue - 2.0f), 2.0f - std::abs(hue - 4.0f)), 0.0f, 1.0f);
+            bool spot = i % 4 == 3;
+            light.color = glm::vec4(color * 1.5f, spot ? 0.8f : -2.0f);
+            light.direction = glm::vec4(0.0f, 0.0f, -1.0f, 0.9f);
+        }
+        m_frameLights.resize(m_lights.size());
+    }
+
+    // hi-z：没有开启occlusion时cull shader不读取pyramid，只创建1x1的pyramid让descriptor有效
+    // bindless数组中的元素随pyramid一起替换，旧元素在使用它的帧完成之后释放；pyramid一直处于GENERAL
+    void resizeHiZPyramid() {
+        m_hiz.resize(m_occlusionCulling ? m_renderExtent : VkExtent2D{1, 1}, m_uploadContext);
+        m_uploadContext.submit();
+        m_hizHistoryValid = false;
+        if (m_meshShaderSupported) {
+            if (m_hizBindlessIndex != UINT32_MAX) {
+                uint32_t oldIndex = m_hizBindlessIndex;
+                m_deletionQueue.push(m_frameNumber, [this, oldIndex]() { m_bindlessTextures.remove(oldIndex); });
+            }
+            m_hizBindlessIndex = m_bindlessTextures.add(m_hiz.view(), m_hiz.sampler(), VK_IMAGE_LAYOUT_GENERAL);
+        }
+    }
+
+    // dynamic resolution：upscale pass只能在render graph中声明，gpu profiler不可用时没有帧时间
+    // variable rate shading：rate image的场景pass结束后由upscale pass复制到swap chain，没有开启dynamic resolution时也需要upscaler
+    void createDynamicResolution() {
+        m_resolution.init(DYNAMIC_RESOLUTION_TARGET_MS, DYNAMIC_RESOLUTION_MIN_SCALE, maxResolutionScale(), DYNAMIC_RESOLUTION_STEP,
+            DYNAMIC_RESOLUTION_COOLDOWN_FRAMES);
+        if ((DYNAMIC_RESOLUTION && m_dynamicRenderingSupported && m_gpuProfiler.initialized()) || m_shadingRateAttachmentSupported || usePostProcessing()) {
+            m_upscaler.init(device, m_pipelineCache.handle(), embeddedShader(UPSCALE_VERT_SHADER), embeddedShader(UPSCALE_FRAG_SHADER), swapChainImageFormat,
+                MAX_FRAMES_IN_FLIGHT);
+        }
+        updateRenderExtent();
+    }
+
+    bool useDynamicResolution() const {
+        return DYNAMIC_RESOLUTION && m_gpuProfiler.initialized() && m_upscaler.initialized();
+    }
+
+    // quality：按最近完成的帧的gpu时间调整tier，lod误差在下一次selectMeshLods时生效；返回true表示渲染分辨率的比例改变
+    // msaa、shadow map和各向异性需要重新创建attachment、pipeline和sampler，运行时不改变，保存的tier在下次启动时生效
+    bool updateQualityTier() {
+        if (!m_gpuProfiler.initialized() || !m_quality.update(m_gpuProfiler.latestMs("frame"))) {
+            return false;
+        }
+        std::cout << "quality tier: " << QualityManager::name(m_quality.tier()) << std::endl;
+        return useDynamicResolution() && m_resolution.setMaxScale(maxResolutionScale());
+    }
+
+    // thermal governor：gpu时间除以比例的平方得到和分辨率无关的每像素耗时；level改变时调整frame limiter和比例上限，返回true表示比例改变
+    bool updateThermalGovernor() {
+        float gpuMs = m_gpuProfiler.initialized() ? m_gpuProfiler.latestMs("frame") : 0.0f;
+        float scale = useDynamicResolution() ? m_resolution.scale() : 1.0f;
+        if (!m_thermalGovernor.update(gpuMs / (scale * scale), m_frameDeltaTime)) {
+            return false;
+        }
+        ThermalLevel level = m_thermalGovernor.settings();
+        std::cout << "thermal governor: level " << m_thermalGovernor.level() << " (os " << ThermalGovernor::name(m_thermalGovernor.osState()) << "), cap "
+                  << level.frameRateCap << " fps, max resolution scale " << level.maxResolutionScale << std::endl;
+        m_frameLimiter.setCeiling(level.frameRateCap);
+        return useDynamicResolution() && m_resolution.setMaxScale(maxResolutionScale());
+    }
+
+    // dynamic resolution：比例上限是quality tier和thermal governor中较小的一个
+    float maxResolutionScale() const {
+        return std::min(m_quality.settings().maxResolutionScale, m_thermalGovernor.settings().maxResolutionScale);
+    }
+
+    // variable rate shading：rate image的大小跟随m_renderExtent，旧的image在使用它的帧完成之后销毁
+    void createShadingRateImage() {
+        if (!m_shadingRateAttachmentSupported) {
+            return;
+        }
+        m_shadingRate.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(SHADING_RATE_SHADER), m_shadingRateSupport, SHADING_RATE_TEXEL_SIZE,
+            MAX_FRAMES_IN_FLIGHT, [this](std::function<void()> destroy) {
+            m_deletionQueue.push(m_frameNumber, std::move(destroy));
+        });
+        resizeShadingRateImage();
+    }
+
+    void resizeShadingRateImage() {
+        m_shadingRate.resize(m_renderExtent, m_uploadContext);
+        m_uploadContext.submit();
+    }
+
+    bool useShadingRateAttachment() const {
+        return m_shadingRate.initialized();
+    }
+
+    // post processing：pass在render graph中声明，对应的forward pipeline在之前创建，所以只由配置和dynamic rendering决定
+    bool usePostProcessing() const {
+        return POST_PROCESSING && m_dynamicRenderingSupported;
+    }
+
+    // post processing：forward的color attachment格式，pipeline、secondary command buffer的继承信息和graph中的scene color都使用它
+    VkFormat sceneColorFormat() const {
+        return usePostProcessing() ? m_hdrColorFormat : swapChainImageFormat;
+    }
+
+    // attachment bandwidth：scene color只作为attachment和被采样，B10G11R11作为color attachment不是必须支持的，不支持时回退到RGBA16F
+    VkFormat findHdrColorFormat() {
+        std::vector<VkFormat> candidates = {PostProcess::HDR_FORMAT};
+        if (BANDWIDTH_AWARE_FORMATS) {
+            candidates.insert(candidates.begin(), VK_FORMAT_B10G11R11_UFLOAT_PACK32);
+        }
+        return findSupportedFormat(candidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+    }
+
+    void createPostProcess() {
+        if (!usePostProcessing()) {
+            return;
+        }
+        PostProcessSettings settings;
+        settings.bloomThreshold = BLOOM_THRESHOLD;
+        settings.bloomIntensity = BLOOM_INTENSITY;
+        m_postProcess.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(POST_PREFILTER_SHADER), embeddedShader(POST_BLUR_SHADER),
+            embeddedShader(POST_EXPOSURE_SHADER), embeddedShader(POST_TONEMAP_SHADER), settings, PostProcess::autoExposureSupported(physicalDevice),
+            MAX_FRAMES_IN_FLIGHT, m_uploadContext);
+        m_uploadContext.submit();
+    }
+
+    void updateRenderExtent() {
+        m_renderExtent = useDynamicResolution() ? m_resolution.extent(swapChainExtent) : swapChainExtent;
+    }
+
+    bool supportsDepthSampling() {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, findDepthFormat(), &formatProperties);
+        return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+    }
+
+    bool useOcclusionCulling() const {
+        return m_occlusionCulling && useGpuCulling();
+    }
+
+    // hi-z：meshlet的遮挡剔除在task shader中，pyramid和visibility区域的读写需要task stage的barrier
+    bool useMeshletOcclusion() const {
+        return m_meshShaderSupported && useOcclusionCulling();
+    }
+
+    void meshletOcclusionBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // instancing：网格以原点为中心排在z = 0的平面上，每个实例绕z轴转一个不同的角度，颜色随位置变化以便区分
+    // transform store：实例的transform由entity的世界矩阵得到，这里只创建entity，updateTransforms写入scene list
+    void buildSceneInstances() {
+        m_sceneInstances.clear();
+        m_shadowStaticVersion++;  // shadow cache：实例是caster
+        m_instanceBvhStale = true;
+        m_transforms.clear();
+        m_entityInstances.clear();
+        m_movingEntities.clear();
+        m_movingAngles.clear();
+        m_modelEntity = createEntity(TransformStore::INVALID_ENTITY, glm::vec3(0.0f), 0.0f, UINT32_MAX);
+        uint32_t gridEntity = createEntity(TransformStore::INVALID_ENTITY, glm::vec3(0.0f), 0.0f, UINT32_MAX);
+        if (!m_instanceGrid) {
+            m_sceneInstances.push_back({glm::mat4(1.0f), glm::vec4(1.0f)});
+            createEntity(gridEntity, glm::vec3(0.0f), 0.0f, 0);
+            updateTransforms();
+            return;
+        }
+        // stress scene：实例按行填满网格，最后一行可能不满；被选中运动的实例在updateUniformBuffer中每帧旋转
+        uint32_t gridSize = instanceGridSize();
+        float spacing = instanceSpacing();
+        float half = (gridSize - 1) * 0.5f;
+        for (uint32_t i = 0; i < instanceCapacity(); i++) {
+            uint32_t x = i % gridSize;
+            uint32_t y = i / gridSize;
+            glm::vec3 offset((x - half) * spacing, (y - half) * spacing, 0.0f);
+            float angle = static_cast<float>(x * 7 + y * 13) * 0.37f;
+            InstanceData instance;
+            instance.color = glm::vec4(0.5f + 0.5f * x / gridSize, 0.5f + 0.5f * y / gridSize, 1.0f, 1.0f);
+            uint32_t entity = createEntity(gridEntity, offset, angle, static_cast<uint32_t>(m_sceneInstances.size()));
+            if (m_stressScene && stressRandom(m_stressSettings.seed, i, 12) < m_stressSettings.motion) {
+                m_movingEntities.push_back(entity);
+                m_movingAngles.push_back(angle);
+            }
+            m_sceneInstances.push_back(instance);
+        }
+        updateTransforms();
+    }
+
+    // stress scene：--stress时网格的实例数、边长、间距和光源数由参数决定
+    uint32_t instanceCapacity() const { return m_stressScene ? m_stressSettings.instances : INSTANCE_GRID_SIZE * INSTANCE_GRID_SIZE; }
+    uint32_t instanceGridSize() const { return static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(instanceCapacity())))); }
+    float instanceSpacing() const {
+        if (!m_stressScene) {
+            return INSTANCE_SPACING;
+        }
+        return std::ceil(std::sqrt(static_cast<float>(m_stressSettings.meshes))) * STRESS_MESH_SPACING;
+    }
+    uint32_t lightCount() const { return m_stressScene ? m_stressSettings.lights : CLUSTERED_LIGHT_COUNT; }
+
+    // transform store：绕z轴旋转angle的entity，instance是scene list中的实例，UINT32_MAX表示不是实例
+    uint32_t createEntity(uint32_t parent, const glm::vec3& position, float angle, uint32_t instance) {
+        uint32_t entity = m_transforms.create(parent, position, glm::angleAxis(angle, glm::vec3(0.0f, 0.0f, 1.0f)));
+        m_entityInstances.push_back(instance);
+        return entity;
+    }
+
+    // transform store：世界矩阵改变的实例直接写进scene list，bvh已经构建时同时更新它们的包围盒，下次使用bvh之前refit
+    void updateTransforms() {
+        m_transforms.update(&m_jobPool, TRANSFORM_PARALLEL_MIN_ENTITIES);
+        bool updateBvh = !m_instanceBvhStale && m_instanceBvh.objectCount() == m_sceneInstances.size();
+        for (uint32_t entity : m_transforms.changed()) {
+            uint32_t instance = m_entityInstances[entity];
+            if (instance == UINT32_MAX) {
+                continue;
+            }
+            m_sceneInstances[instance].transform = m_transforms.world(entity);
+            if (updateBvh) {
+                m_instanceBvh.update(instance, transformAabb(m_bvhModelBounds, m_sceneInstances[instance].transform));
+            }
+        }
+    }
+
+    // descriptor set：创建pool用于分配descriptor set
+    // descriptor allocator：pool按需创建，每个set平均使用的descriptor数量决定pool的大小
+    void createDescriptorPool() {
+        // bindless：纹理数组在BindlessTextureTable自己的update after bind pool中
+        // ray traced shadows：没有启用扩展时pool中不能有acceleration structure
+        std::vector<FrameDescriptorAllocator::PoolSizeRatio> frameRatios = {{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f}, {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5.0f},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f}};
+        if (m_rayTracedShadowsSupported) {
+            frameRatios.push_back({VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1.0f});
+        }
+        m_frameDescriptors.init(device, MAX_FRAMES_IN_FLIGHT, frameRatios);
+
+        // meshlet：set 2只有一个，引用的buffer在整个程序运行期间不变
+        // descriptor buffer：set 2在descriptor buffer中，不需要pool
+        if (useGeometrySet() && !m_descriptorBuffer.initialized()) {
+            VkDescriptorPoolSize meshletPoolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_meshShaderSupported ? 1u + MeshletBuffer::regionCount : 1u};
+            VkDescriptorPoolCreateInfo meshletPoolInfo{};
+            meshletPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            meshletPoolInfo.poolSizeCount = 1;
+            meshletPoolInfo.pPoolSizes = &meshletPoolSize;
+            meshletPoolInfo.maxSets = 1;
+            if (vkCreateDescriptorPool(device, &meshletPoolInfo, hostAllocator(), &m_meshletDescriptorPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create meshlet descriptor pool!");
+            }
+        }
+
+        // command cache：每个frame in flight一个固定的set 0
+        if (CACHE_COMMAND_BUFFERS && !m_descriptorBuffer.initialized()) {
+            std::array<VkDescriptorPoolSize, 4> cachedPoolSizes = {{{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, MAX_FRAMES_IN_FLIGHT},
+                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * MAX_FRAMES_IN_FLIGHT}, {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_FRAMES_IN_FLIGHT},
+                {VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, MAX_FRAMES_IN_FLIGHT}}};
+            VkDescriptorPoolCreateInfo cachedPoolInfo{};
+            cachedPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+            cachedPoolInfo.poolSizeCount = static_cast<uint32_t>(cachedPoolSizes.size()) - (m_rayTracedShadowsSupported ? 0 : 1);
+            cachedPoolInfo.pPoolSizes = cachedPoolSizes.data();
+            cachedPoolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+            if (vkCreateDescriptorPool(device, &cachedPoolInfo, hostAllocator(), &m_cachedFrameSetPool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create cached frame descriptor pool!");
+            }
+        }
+    }
+
+    // descriptor set：每帧的set在writeFrameDescriptorSet中分配，这里只创建整个程序运行期间不变的set
+    void createDescriptorSets() {
+        if (useGeometrySet()) {
+            createMeshletDescriptorSet();
+        }
+        if (m_cachedFrameSetPool != VK_NULL_HANDLE) {
+            createCachedFrameSets();
+        }
+    }
+
+    // command cache：set 0引用的buffer和range在整个程序运行期间不变，每帧不同的只是dynamic offset和buffer内容
+    void createCachedFrameSets() {
+        std::array<VkDescriptorSetLayout, MAX_FRAMES_IN_FLIGHT> layouts;
+        layouts.fill(descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_cachedFrameSetPool;
+        allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+        allocInfo.pSetLayouts = layouts.data();
+        if (vkAllocateDescriptorSets(device, &allocInfo, m_cachedFrameSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate cached frame descriptor sets!");
+        }
+
+        // binding 4是shadow map的image，buffer的binding是0到3、5和7
+        constexpr uint32_t bindingCount = 6;
+        std::array<VkDescriptorBufferInfo, bindingCount * MAX_FRAMES_IN_FLIGHT> bufferInfos{};
+        std::array<VkWriteDescriptorSet, (bindingCount + 1) * MAX_FRAMES_IN_FLIGHT> descriptorWrites{};
+        VkDescriptorImageInfo shadowInfo{m_shadowCache.sampler(), m_shadowCache.view(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};  // shadow cache：所有帧共用
+        for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            bufferInfos[bindingCount * i] = {m_uniformRing.buffer(i), 0, m_uniformRing.blockRange()};
+            bufferInfos[bindingCount * i + 1] = {m_indirectDraws.dataBuffer(i), 0, m_indirectDraws.dataRange()};  // multi draw indirect：这一帧每个draw的object编号
+            bufferInfos[bindingCount * i + 2] = {m_clusteredLighting.lightBuffer(i), 0, m_clusteredLighting.lightRange()};  // clustered lighting：光源和cluster列表
+            bufferInfos[bindingCount * i + 3] = {m_clusteredLighting.clusterBuffer(i), 0, m_clusteredLighting.clusterRange()};
+            bufferInfos[bindingCount * i + 4] = {m_sceneObjects.buffer(i), 0, m_sceneObjects.range()};  // scene objects：按mesh编号的object数据
+            bufferInfos[bindingCount * i + 5] = {m_materials.buffer(i), 0, m_materials.range()};  // materials：材质表
+            for (uint32_t binding = 0; binding < bindingCount; binding++) {
+                VkWriteDescriptorSet& write = descriptorWrites[bindingCount * i + binding];
+                write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.dstSet = m_cachedFrameSets[i];
+                write.dstBinding = binding == 4 ? 5 : binding == 5 ? 7 : binding;
+                write.descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                write.descriptorCount = 1;
+                write.pBufferInfo = &bufferInfos[bindingCount * i + binding];
+            }
+            VkWriteDescriptorSet& shadowWrite = descriptorWrites[bindingCount * MAX_FRAMES_IN_FLIGHT + i];
+            shadowWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            shadowWrite.dstSet = m_cachedFrameSets[i];
+            shadowWrite.dstBinding = 4;
+            shadowWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            shadowWrite.descriptorCount = 1;
+            shadowWrite.pImageInfo = &shadowInfo;
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+        // ray traced shadows：每个frame in flight的TLAS对象不变，build和refit只改变内容
+        if (m_accelerationStructures.initialized()) {
+            std::array<VkAccelerationStructureKHR, MAX_FRAMES_IN_FLIGHT> tlases;
+            std::array<VkWriteDescriptorSetAccelerationStructureKHR, MAX_FRAMES_IN_FLIGHT> tlasInfos{};
+            std::array<VkWriteDescriptorSet, MAX_FRAMES_IN_FLIGHT> tlasWrites{};
+            for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+                tlases[i] = m_accelerationStructures.tlas(i);
+                tlasInfos[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+                tlasInfos[i].accelerationStructureCount = 1;
+                tlasInfos[i].pAccelerationStructures = &tlases[i];
+                tlasWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                tlasWrites[i].pNext = &tlasInfos[i];
+                tlasWrites[i].dstSet = m_cachedFrameSets[i];
+                tlasWrites[i].dstBinding = 6;
+                tlasWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+                tlasWrites[i].descriptorCount = 1;
+            }
+            vkUpdateDescriptorSets(device, static_cast<uint32_t>(tlasWrites.size()), tlasWrites.data(), 0, nullptr);
+        }
+    }
+
+    // meshlet：binding 0是geometry buffer的整个顶点区域，binding 1到4是meshlet buffer的四个区域
+    // vertex pulling：不支持mesh shader时只写binding 0
+    void createMeshletDescriptorSet() {
+        int regionCount = m_meshShaderSupported ? MeshletBuffer::regionCount : 0;
+        if (m_descriptorBuffer.initialized()) {
+            VkBuffer meshletBuffer = m_meshletBuffer.buffer();
+            m_descriptorBuffer.writeStorageBuffer(m_meshletDescriptorOffset, m_meshletSetLayout, 0, m_descriptorBuffer.bufferAddress(m_geometryBuffer.buffer()),
+                m_geometryBuffer.vertexRegionSize());
+            for (int region = 0; region < regionCount; region++) {
+                MeshletBuffer::Region r = static_cast<MeshletBuffer::Region>(region);
+                m_descriptorBuffer.writeStorageBuffer(m_meshletDescriptorOffset, m_meshletSetLayout, region + 1,
+                    m_descriptorBuffer.bufferAddress(meshletBuffer) + m_meshletBuffer.regionOffset(r), m_meshletBuffer.regionSize(r));
+            }
+            return;
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_meshletDescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &m_meshletSetLayout;
+        if (vkAllocateDescriptorSets(device, &allocInfo, &m_meshletSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate meshlet descriptor set!");
+        }
+
+        std::array<VkDescriptorBufferInfo, 1 + MeshletBuffer::regionCount> bufferInfos{};
+        bufferInfos[0] = {m_geometryBuffer.buffer(), 0, m_geometryBuffer.vertexRegionSize()};
+        for (int region = 0; region < regionCount; region++) {
+            MeshletBuffer::Region r = static_cast<MeshletBuffer::Region>(region);
+            bufferInfos[region + 1] = {m_meshletBuffer.buffer(), m_meshletBuffer.regionOffset(r), m_meshletBuffer.regionSize(r)};
+        }
+
+        std::array<VkWriteDescriptorSet, 1 + MeshletBuffer::regionCount> descriptorWrites{};
+        for (uint32_t i = 0; i < descriptorWrites.size(); i++) {
+            descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[i].dstSet = m_meshletSet;
+            descriptorWrites[i].dstBinding = i;
+            descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[i].descriptorCount = 1;
+            descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(1 + regionCount), descriptorWrites.data(), 0, nullptr);
+    }
+
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferAllocation, MemoryCategory category, const char* name) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;  // buffer大小
+        bufferInfo.usage = usage;  // 数据用法，这里作为顶点缓冲区
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;  // 和swap chain image一样buffer也可以在多个队列中共享，这里是独占访问
+
+        if (vkCreateBuffer(device, &bufferInfo, hostAllocator(), &buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create buffer!");
+        }
+
+        // 为buffer分配内存
+        // 这里体现了aliasing资源复用，把buffer这种资源概念和实际物理内存分离，方便复用
+        // findMemoryType包含三个字段如下：
+        // size：所需内存大小，和buffer大小可能不同
+        // alignment：buffer在分配的内存区域中的偏移量，和buffer的usage和flags有关
+        // memoryTypeBits：适用于buffer内存类型的位字段
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);  // 查询内存需求
+
+        // 要找到适合buffer的内存类型，并且需要能够写入，所以需要提供属性
+        // VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT属性表示可以映射从而可以从cpu写入顶点数据
+        // VK_MEMORY_PROPERTY_HOST_COHERENT_BIT属性用于cache一致性，因为结束映射时驱动程序可能不会立刻把数据写入buffer，也有可能反过来buffer数据在映射内存中不可见
+        // memory allocator：不再每个buffer调用一次vkAllocateMemory，而是从对应内存类型的block中按alignment子分配
+        bufferAllocation = m_allocator.allocate(memRequirements, properties, true, category, 0, name);  // memory report：name只用于统计
+
+        vkBindBufferMemory(device, buffer, bufferAllocation.memory, bufferAllocation.offset);  // 关联内存和buffer，offset是子分配在block中的偏移
+    }
+
+    // staging buffer：把数据从staging buffer复制到vertex buffer
+    // 内存传输操作需要command buffer
+    void copyBuffer(VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size) {
+        VkCommandBuffer commandBuffer = m_uploadContext.commandBuffer();
+
+        VkBufferCopy copyRegion{};  // 定义拷贝区域
+        copyRegion.srcOffset = srcOffset;  // staging ring：源数据在ring中的偏移
+        copyRegion.dstOffset = dstOffset;  // geometry buffer：mesh在共享buffer中的偏移
+        copyRegion.size = size;
+        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+    }
+
+    // command buffer：创建command buffer
+    void createCommandBuffers() {
+        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);  // frames in flight：每个帧创建一个command buffer
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;  // 指定command pool
+        // 指定分配command buffer的主从关系
+        // VK_COMMAND_BUFFER_LEVEL_PRIMARY：可以提交到队列执行，但不能从其它command buffer中被调用
+        // VK_COMMAND_BUFFER_LEVEL_SECONDARY：不能提交，但可以被primary command buffer调用。对于复用常用操作有帮助
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+
+        // parallel recording：每个工作线程一段
+        m_parallelRecorder.init(device, findQueueFamilies(physicalDevice).graphicsFamily.value(), m_jobPool.threadCount() + 1);  // 主线程等待时也录制一段
+    }
+
+    // command buffer：记录command，将command和swapchain image索引作为参数传入
+    // parallel recording：recordTarget选择secondary command buffer所在的pool，command cache的每个条目有自己的一组
+    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, size_t recordTarget) {
+        CPU_PROFILE_SCOPE("recordCommandBuffer");
+        bool parallel = useParallelRecording();
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        if (DeviceDispatch::beginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        // gpu profiler：query pool属于录制时的frame in flight，command cache的条目也按frame in flight区分
+        m_gpuProfiler.beginFrame(commandBuffer, currentFrame);
+        m_drawCosts.beginFrame(commandBuffer, currentFrame);
+        uint32_t frameScope = m_gpuProfiler.begin(commandBuffer, currentFrame, "frame");
+
+        // gpu culling：compute在render pass之前写入visible buffer和draw的count
+        if (useGpuCulling()) {
+            uint32_t cullScope = m_gpuProfiler.begin(commandBuffer, currentFrame, "gpu culling");
+            m_gpuCuller.record(commandBuffer, currentFrame);
+            m_gpuProfiler.end(commandBuffer, currentFrame, cullScope);
+        }
+
+        // occlusion queries：这一帧的query在render pass之前reset，结果在所有pass之后拷贝
+        m_occlusionQueries.recordReset(commandBuffer);
+
+        // clustered lighting：cluster列表在render pass之前生成，光源数量为0时compute只写入0
+        // async compute：有计算队列时在updateUniformBuffer中单独提交，这里不录制
+        if (!m_asyncCompute.enabled()) {
+            uint32_t lightScope = m_gpuProfiler.begin(commandBuffer, currentFrame, "light clustering");
+            m_clusteredLighting.record(commandBuffer, currentFrame);
+            m_gpuProfiler.end(commandBuffer, currentFrame, lightScope);
+        }
+
+        // render graph：dynamic rendering时一帧由render graph描述，barrier和depth都由graph管理
+        if (m_dynamicRenderingSupported) {
+            recordFrameGraph(commandBuffer, imageIndex, recordTarget);
+        } else {
+            // 启动render pass
+            uint32_t forwardScope = m_gpuProfiler.begin(commandBuffer, currentFrame, "forward", m_inheritedQueries || !parallel);
+            VkRenderPassBeginInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = renderPass;
+            renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+            renderPassInfo.renderArea.offset = {0, 0};  // 指定渲染区域大小。定义着色器加载和存储的位置
+            renderPassInfo.renderArea.extent = swapChainExtent;  // 指定渲染区域大小
+
+            std::array<VkClearValue, 4> clearValues{};
+            clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+            clearValues[1].depthStencil = {1.0f, 0};  // depth buffering：范围0 1，1是最远距离所以设置成1
+            clearValues[2].color = {{0.0f, 0.0f, 0.0f, 0.0f}};  // deferred shading：G-buffer清除为0，forward时只使用前两个
+            clearValues[3].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+
+            renderPassInfo.clearValueCount = DEFERRED_SHADING ? 4 : 2;
+            renderPassInfo.pClearValues = clearValues.data();  // 定义了VK_ATTACHMENT_LOAD_OP_CLEAR的清除值，用于颜色附件加载操作
+
+            // 所有命令函数都是vkCmd前缀，返回都是void所以记录结束前不能错误处理
+            // VK_SUBPASS_CONTENTS_INLINE：render pass命令被嵌入在primary command buffer中
+            // VK_SUBPASS_CONTENTS_SECONDARY_COOMAND_BUFFERS：render pass命令从secondary command buffer中执行
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+            recordScene(commandBuffer, imageIndex, recordTarget);
+
+            // deferred shading：secondary command buffer只录制subpass 0，光照的全屏三角形直接录制在primary中
+            if (DEFERRED_SHADING) {
+                vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+                m_deferredLighting.draw(commandBuffer, currentFrame, m_gbufferAlbedoView, m_gbufferNormalView, swapChainExtent);
+            }
+
+            vkCmdEndRenderPass(commandBuffer);
+            m_gpuProfiler.end(commandBuffer, currentFrame, forwardScope);
+            if (m_separatePresentQueue) {  // present queue：render pass已经转换到PRESENT_SRC，只需要release所有权
+                VkImageMemoryBarrier barrier = presentOwnershipBarrier(imageIndex);
+                barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+                DeviceDispatch::cmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+            }
+        }
+
+        m_occlusionQueries.recordCopy(commandBuffer);
+        m_gpuProfiler.end(commandBuffer, currentFrame, frameScope);
+
+        if (DeviceDispatch::endCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+
+    }
+
+    // parallel recording：draw足够多时分段在工作线程中录制，render pass的内容全部来自secondary command buffer
+    void recordScene(VkCommandBuffer commandBuffer, uint32_t imageIndex, size_t recordTarget) {
+        if (useParallelRecording()) {
+            recordParallelDraws(commandBuffer, imageIndex, recordTarget);
+        } else {
+            recordTerrain(commandBuffer, m_dynamicStates);
+            recordDrawState(commandBuffer, m_dynamicStates);
+            recordDraws(commandBuffer, 0, m_drawPackets.size(), m_dynamicStates);
+            recordImpostors(commandBuffer, m_dynamicStates);
+            recordOcclusionQueries(commandBuffer, m_dynamicStates);
+            recordParticles(commandBuffer, m_dynamicStates);
+        }
+    }
+
+    // impostor：在forward pass的mesh之后绘制，set 0和set 1已经由recordDrawState绑定，pipeline layout相同
+    void recordImpostors(VkCommandBuffer commandBuffer, DynamicStateCommands& dynamicStates) {
+        if (!useImpostors() || m_impostors.draws(currentFrame).empty()) {
+            return;
+        }
+        m_impostors.draw(commandBuffer, currentFrame, m_impostorPipeline, m_renderExtent);
+        dynamicStates.invalidate(false);
+    }
+
+    // terrain：在所有mesh之前绘制，使用自己的pipeline layout、descriptor set和索引，之后recordDrawState重新绑定场景的状态
+    void recordTerrain(VkCommandBuffer commandBuffer, DynamicStateCommands& dynamicStates) {
+        if (!useTerrain()) {
+            return;
+        }
+        m_terrain.draw(commandBuffer, currentFrame, m_terrainPipeline, m_renderExtent);
+        dynamicStates.invalidate(false);
+    }
+
+    bool useTerrain() const {
+        return m_terrainPipeline != VK_NULL_HANDLE;
+    }
+
+    // particles：透明的粒子在所有不透明的mesh和impostor之后绘制，set 0已经由recordDrawState绑定
+    void recordParticles(VkCommandBuffer commandBuffer, DynamicStateCommands& dynamicStates) {
+        if (m_particlePipeline == VK_NULL_HANDLE) {
+            return;
+        }
+        m_particles.draw(commandBuffer, m_particlePipeline, m_renderExtent);
+        dynamicStates.invalidate(false);
+    }
+
+    // impostor：forward路径的pipeline创建之后才使用；deferred shading的G-buffer需要法线，不使用impostor
+    bool useImpostors() const {
+        return IMPOSTORS && !DEFERRED_SHADING && m_impostorPipeline != VK_NULL_HANDLE;
+    }
+
+    // render graph：swap chain image是外部image，进入时不关心内容，结束时转换到present layout（呈现队列不同时同时release所有权）
+    // depth是transient image，storeOp是DONT_CARE，之后增加的shadow、post、compute pass也在这里声明
+    // command cache：transient image只在swap chain重建（分辨率改变）时重新分配，这时cache key中的swapChain也变了，旧的录制不会再提交
+    // attachment bandwidth：每个pass的loadOp/storeOp同时交给m_attachmentBandwidth统计，和实际录制的一致
+    void recordFrameGraph(VkCommandBuffer commandBuffer, uint32_t imageIndex, size_t recordTarget) {
+        m_renderGraph.reset();
+        m_attachmentBandwidth.reset();
+        RenderGraphHandle color = m_renderGraph.importImage("swapchain", swapChainImages[imageIndex], swapChainImageViews[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, colorTargetFinalLayout());  // 等待imageAvailable的stage
+        if (m_separatePresentQueue) {
+            m_renderGraph.setFinalOwnership(color, m_graphicsFamily, m_presentFamily);
+        }
+
+        RenderGraphImageDesc depthDesc;
+        depthDesc.format = findDepthFormat();
+        depthDesc.extent = m_renderExtent;
+        depthDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencilComponent(depthDesc.format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+        depthDesc.samples = m_msaaSamples;
+        RenderGraphHandle depth = m_renderGraph.createImage("depth", depthDesc);
+
+        // dynamic resolution：分辨率缩小时场景画进transient的scene color，最后的upscale pass放大到swap chain image
+        // variable rate shading：rate image需要采样场景的color，分辨率不变时upscale pass只是复制
+        bool scaled = m_renderExtent.width != swapChainExtent.width || m_renderExtent.height != swapChainExtent.height;
+        bool shadingRate = useShadingRateAttachment();
+        VkImageView shadingRateView = shadingRate ? m_shadingRate.view() : VK_NULL_HANDLE;
+        // post processing：scene color是HDR的，tonemap的输出再由upscale pass复制或放大到swap chain
+        bool post = m_postProcess.initialized();
+        bool offscreen = scaled || shadingRate || post;
+        RenderGraphHandle scene = color;
+        if (offscreen) {
+            RenderGraphImageDesc sceneDesc;
+            sceneDesc.format = sceneColorFormat();
+            sceneDesc.extent = m_renderExtent;
+            scene = m_renderGraph.createImage("scene color", sceneDesc);
+        }
+
+        // msaa：多重采样的color是只作为attachment的transient image，forward pass结束时resolve到scene
+        bool msaa = m_msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+        RenderGraphHandle msaaColor = scene;
+        if (msaa) {
+            RenderGraphImageDesc msaaDesc;
+            msaaDesc.format = sceneColorFormat();
+            msaaDesc.extent = m_renderExtent;
+            msaaDesc.samples = m_msaaSamples;
+            msaaColor = m_renderGraph.createImage("msaa color", msaaDesc);
+        }
+
+        bool occlusion = useOcclusionCulling();
+        // hi-z：上一帧生成的pyramid在这一帧的第一阶段被task shader读取，上一帧第二阶段读取visibility之后才能再写入
+        if (useMeshletOcclusion()) {
+            meshletOcclusionBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, VK_ACCESS_SHADER_WRITE_BIT,
+                VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        }
+        // depth prepass：只有depth attachment，forward pass接着读取这里写入的depth
+        bool prepass = useDepthPrepass();
+        if (prepass) {
+            uint32_t depthPrepass = m_renderGraph.addPass("depth prepass", [this, depth](VkCommandBuffer cmd, const RenderGraph& graph) {
+                beginDynamicRendering(cmd, m_renderExtent, VK_NULL_HANDLE, graph.view(depth), 0, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE);
+                m_cullPhase = 0;
+                m_prepassPhase = DepthPrepassPhase::depth;
+                recordDrawState(cmd, m_dynamicStates);
+                recordDraws(cmd, 0, m_drawPackets.size(), m_dynamicStates);
+                m_prepassPhase = DepthPrepassPhase::off;
+                m_vkCmdEndRendering(cmd);
+            });
+            m_renderGraph.write(depthPrepass, depth, RenderGraphAccess::depthAttachmentWrite);
+            m_attachmentBandwidth.add("depth prepass", "depth", depthDesc.format, m_renderExtent, m_msaaSamples, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE);
+        }
+        // attachment bandwidth：depth只在之后的hi-z或者rate image需要时保存；有prepass时forward不写depth，STORE_OP_NONE保留prepass的结果而不写回
+        VkAttachmentStoreOp forwardDepthStore = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        if (occlusion || shadingRate) {
+            forwardDepthStore = prepass && !useTerrain() ? VK_ATTACHMENT_STORE_OP_NONE : VK_ATTACHMENT_STORE_OP_STORE;  // terrain：forward中写入了depth
+        }
+        uint32_t forward = m_renderGraph.addPass("forward", [this, scene, msaaColor, depth, imageIndex, recordTarget, msaa, prepass, forwardDepthStore,
+            shadingRateView](VkCommandBuffer cmd, const RenderGraph& graph) {
+            VkRenderingFlags flags = useParallelRecording() ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+            beginDynamicRendering(cmd, m_renderExtent, graph.view(msaaColor), graph.view(depth), flags, VK_ATTACHMENT_LOAD_OP_CLEAR, forwardDepthStore,
+                msaa ? graph.view(scene) : VK_NULL_HANDLE, prepass, shadingRateView);
+            m_cullPhase = 0;
+            m_prepassPhase = prepass ? DepthPrepassPhase::shade : DepthPrepassPhase::off;
+            recordScene(cmd, imageIndex, recordTarget);
+            m_prepassPhase = DepthPrepassPhase::off;
+            m_vkCmdEndRendering(cmd);
+        });
+        m_renderGraph.write(forward, scene, RenderGraphAccess::colorAttachmentWrite);  // msaa：resolve的写入也是color attachment output阶段
+        if (msaa) {
+            m_renderGraph.write(forward, msaaColor, RenderGraphAccess::colorAttachmentWrite);
+        }
+        m_renderGraph.write(forward, depth, RenderGraphAccess::depthAttachmentWrite);
+        VkFormat sceneFormat = offscreen ? sceneColorFormat() : swapChainImageFormat;
+        m_attachmentBandwidth.add("forward", "color", sceneFormat, m_renderExtent, m_msaaSamples, VK_ATTACHMENT_LOAD_OP_CLEAR,
+            msaa ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE);
+        if (msaa) {
+            m_attachmentBandwidth.addResolve("forward", "color", sceneFormat, m_renderExtent);
+        }
+        m_attachmentBandwidth.add("forward", "depth", depthDesc.format, m_renderExtent, m_msaaSamples, prepass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+            forwardDepthStore);
+
+        // hi-z：第一阶段的depth生成pyramid，再测试第一阶段被挡住的实例；pass只写graph之外的资源，标记成副作用
+        // 补画的实例通常很少，直接在primary中录制，不使用parallel recording的secondary
+        if (occlusion) {
+            uint32_t hiz = m_renderGraph.addPass("hi-z", [this, depth](VkCommandBuffer cmd, const RenderGraph& graph) {
+                // hi-z：第一阶段task shader对pyramid的读取完成之后才能覆盖，写入的visibility在第二阶段读取
+                if (useMeshletOcclusion()) {
+                    meshletOcclusionBarrier(cmd, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, VK_ACCESS_SHADER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT, VK_ACCESS_SHADER_READ_BIT);
+                }
+                m_hiz.build(cmd, currentFrame, graph.view(depth), m_renderExtent);
+                m_gpuCuller.recordLate(cmd, currentFrame);
+                if (useMeshletOcclusion()) {
+                    meshletOcclusionBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT,
+                        VK_ACCESS_SHADER_READ_BIT);
+                }
+            });
+            m_renderGraph.read(hiz, depth, RenderGraphAccess::sampledCompute);
+            m_renderGraph.setSideEffect(hiz);
+
+            uint32_t late = m_renderGraph.addPass("forward late", [this, scene, depth, shadingRate, shadingRateView](VkCommandBuffer cmd, const RenderGraph& graph) {
+                beginDynamicRendering(cmd, m_renderExtent, graph.view(scene), graph.view(depth), 0, VK_ATTACHMENT_LOAD_OP_LOAD,
+                    shadingRate ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_NULL_HANDLE, false, shadingRateView);
+                m_cullPhase = 1;
+                recordDrawState(cmd, m_dynamicStates);
+                recordDraws(cmd, 0, m_drawPackets.size(), m_dynamicStates);
+                m_cullPhase = 0;
+                m_vkCmdEndRendering(cmd);
+            });
+            m_renderGraph.write(late, scene, RenderGraphAccess::colorAttachmentWrite);
+            m_renderGraph.write(late, depth, RenderGraphAccess::depthAttachmentWrite);
+            m_attachmentBandwidth.add("forward late", "color", sceneFormat, m_renderExtent, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_LOAD, VK_ATTACHMENT_STORE_OP_STORE);
+            m_attachmentBandwidth.add("forward late", "depth", depthDesc.format, m_renderExtent, m_msaaSamples, VK_ATTACHMENT_LOAD_OP_LOAD,
+                shadingRate ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE);
+        }
+
+        // variable rate shading：这一帧完整的color和depth生成下一帧的rate image；pass只写graph之外的资源，标记成副作用
+        if (shadingRate) {
+            uint32_t rate = m_renderGraph.addPass("shading rate", [this, scene, depth](VkCommandBuffer cmd, const RenderGraph& graph) {
+                m_shadingRate.generate(cmd, currentFrame, graph.view(scene), graph.view(depth));
+            });
+            m_renderGraph.read(rate, scene, RenderGraphAccess::sampledCompute);
+            m_renderGraph.read(rate, depth, RenderGraphAccess::sampledCompute);
+            m_renderGraph.setSideEffect(rate);
+        }
+
+        // post processing：三个compute pass，bloom的两个image都是半分辨率的transient image，和scene color、输出一样由graph分配
+        RenderGraphHandle upscaleSource = scene;
+        if (post) {
+            RenderGraphImageDesc bloomDesc;
+            bloomDesc.format = PostProcess::HDR_FORMAT;
+            bloomDesc.extent = PostProcess::bloomExtent(m_renderExtent);
+            RenderGraphHandle bloom = m_renderGraph.createImage("bloom", bloomDesc);
+            RenderGraphHandle bloomBlurred = m_renderGraph.createImage("bloom blurred", bloomDesc);
+            RenderGraphImageDesc outputDesc;
+            outputDesc.format = PostProcess::OUTPUT_FORMAT;
+            outputDesc.extent = m_renderExtent;
+            upscaleSource = m_renderGraph.createImage("post output", outputDesc);
+
+            uint32_t prefilter = m_renderGraph.addPass("bloom prefilter", [this, scene, bloom](VkCommandBuffer cmd, const RenderGraph& graph) {
+                m_postProcess.recordPrefilter(cmd, currentFrame, graph.view(scene), graph.view(bloom), m_renderExtent);
+            });
+            m_renderGraph.read(prefilter, scene, RenderGraphAccess::sampledCompute);
+            m_renderGraph.write(prefilter, bloom, RenderGraphAccess::storageWriteCompute);
+
+            uint32_t blur = m_renderGraph.addPass("bloom blur", [this, bloom, bloomBlurred](VkCommandBuffer cmd, const RenderGraph& graph) {
+                m_postProcess.recordBlur(cmd, currentFrame, graph.view(bloom), graph.view(bloomBlurred), m_renderExtent);
+            });
+            m_renderGraph.read(blur, bloom, RenderGraphAccess::sampledCompute);
+            m_renderGraph.write(blur, bloomBlurred, RenderGraphAccess::storageWriteCompute);
+
+            RenderGraphHandle output = upscaleSource;
+            uint32_t tonemap = m_renderGraph.addPass("tonemap", [this, scene, bloomBlurred, output](VkCommandBuffer cmd, const RenderGraph& graph) {
+                m_postProcess.recordTonemap(cmd, currentFrame, graph.view(scene), graph.view(bloomBlurred), graph.view(output), m_renderExtent);
+            });
+            m_renderGraph.read(tonemap, scene, RenderGraphAccess::sampledCompute);
+            m_renderGraph.read(tonemap, bloomBlurred, RenderGraphAccess::sampledCompute);
+            m_renderGraph.write(tonemap, output, RenderGraphAccess::storageWriteCompute);
+        }
+
+        // dynamic resolution：全屏三角形覆盖整个swap chain image，不需要清除；分辨率相同时不锐化
+        if (offscreen) {
+            uint32_t upscale = m_renderGraph.addPass("upscale", [this, color, upscaleSource, scaled, post](VkCommandBuffer cmd, const RenderGraph& graph) {
+                beginDynamicRendering(cmd, swapChainExtent, graph.view(color), VK_NULL_HANDLE, 0, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE);
+                m_upscaler.draw(cmd, currentFrame, graph.view(upscaleSource), swapChainExtent, scaled ? UPSCALE_SHARPNESS : 0.0f, post);
+                m_vkCmdEndRendering(cmd);
+            });
+            m_renderGraph.read(upscale, upscaleSource, RenderGraphAccess::sampledFragment);
+            m_attachmentBandwidth.add("upscale", "swapchain", swapChainImageFormat, swapChainExtent, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+                VK_ATTACHMENT_STORE_OP_STORE);
+            m_renderGraph.write(upscale, color, RenderGraphAccess::colorAttachmentWrite);
+        }
+
+        m_renderGraph.compile();
+        uint32_t passScope = UINT32_MAX;  // gpu profiler：每个pass前后写timestamp
+        m_renderGraph.execute(commandBuffer, [this, &passScope](VkCommandBuffer cmd, std::string_view name, bool begin) {
+            if (begin) {
+                bool statistics = m_inheritedQueries || !useParallelRecording();  // pipeline statistics：pass之间不嵌套，可以开启统计
+                passScope = m_gpuProfiler.begin(cmd, currentFrame, name, statistics);
+            } else {
+                m_gpuProfiler.end(cmd, currentFrame, passScope);
+            }
+        });
+    }
+
+    // command buffer：绑定pipeline、设置viewport和绑定descriptor，primary和每个secondary command buffer开头都需要
+    void recordDrawState(VkCommandBuffer commandBuffer, DynamicStateCommands& dynamicStates) {
+        // pipeline compiler：第一帧在这里等待graphicsPipeline编译完成
+        // depth prepass：prepass绑定只写depth的pipeline，shader object不绑定fragment shader
+        bool depthOnly = m_prepassPhase == DepthPrepassPhase::depth;
+        if (m_shaderObjects.initialized()) {
+            m_shaderObjects.bindVertexShaders(commandBuffer, m_vertexShaderObject, depthOnly ? VK_NULL_HANDLE : m_fragmentShaderObject);
+        } else if (depthOnly) {
+            DeviceDispatch::cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_depthPrepassPipeline);  // pipeline variants：useDepthPrepass保证已经编译完成
+        } else {
+            DeviceDispatch::cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, waitPipeline(m_graphicsPipelineFuture, graphicsPipeline));  // 第二个参数指定图形还是计算管道
+        }
+        dynamicStates.invalidate(false);
+
+        // pipeline指定了动态属性，这里进行设置
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float) m_renderExtent.width;  // dynamic resolution：场景的渲染分辨率
+        viewport.height = (float) m_renderExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        DeviceDispatch::cmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = m_renderExtent;
+        DeviceDispatch::cmdSetScissor(commandBuffer, 0, 1, &scissor);
+        if (m_shaderObjects.initialized()) {
+            m_shaderObjects.setStaticState(commandBuffer, viewport, scissor, m_msaaSamples);  // shader object：没有pipeline提供的固定状态
+        }
+        
+        // geometry buffer：顶点和索引每帧只绑定一次，所有mesh共享
+        // 16位索引：只有索引类型和上一个mesh不同时才重新绑定索引
+        m_geometryBuffer.bind(commandBuffer, VK_INDEX_TYPE_UINT32);
+        if (useGpuCulling()) {
+            m_gpuCuller.bindVisibleInstances(commandBuffer, currentFrame, InstanceData::BINDING, m_cullPhase);  // gpu culling：compute压缩之后这个阶段的可见实例
+        } else {
+            m_instanceBuffer.bind(commandBuffer, currentFrame, InstanceData::BINDING);  // instancing：这一帧的实例数据
+        }
+
+        // descriptor buffer：绑定整个buffer，三个set只是不同的offset，和descriptor set一样每帧只设置一次
+        if (m_descriptorBuffer.initialized()) {
+            m_descriptorBuffer.bind(commandBuffer);
+            VkDeviceSize setOffsets[] = {m_frameDescriptorOffsets[currentFrame], m_bindlessTextures.bufferOffset(), m_meshletDescriptorOffset};
+            m_descriptorBuffer.setOffsets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, setOffsets, useGeometrySet() ? 3 : 2);
+        } else {
+            // bindless：纹理数组每帧只绑定一次
+            VkDescriptorSet bindlessSet = m_bindlessTextures.set();
+            DeviceDispatch::cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &bindlessSet, 0, nullptr);
+            // meshlet：set 2同样只绑定一次，两条路径的pipeline layout相同，切换pipeline不会使已绑定的set失效
+            if (useGeometrySet()) {
+                DeviceDispatch::cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &m_meshletSet, 0, nullptr);
+            }
+            // descriptor set：绑定descriptor set到shader中实际的descriptor
+            // push constant：ubo只有每帧的数据，set 0和set 1一样每帧只绑定一次
+            DeviceDispatch::cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &m_frameDescriptorSet, 1, &m_frameUniformOffset);
+        }
+    }
+
+    // draw sort：可见的mesh按pipeline、raster state和材质排序，pipeline、面剔除和索引类型只在相邻的key不同时切换
+    // 不透明的pass中每个mesh只有一个draw，mesh字段已经决定了顺序，depth字段留作0，这样相机移动不会改变录制的命令
+    // multi draw indirect：每帧在录制之前调用，packet的顺序只取决于command cache key中的状态，cache的command buffer引用的位置仍然有效
+    void buildDrawPackets(uint32_t currentImage) {
+        m_drawPackets.clear();
+        for (size_t i = 0; i < m_meshes.size(); i++) {
+            if (!isMeshVisible(i) || m_meshImpostors[i].active) {
+                continue;  // model loader：模型还没有resident；impostor：这一帧画成impostor
+            }
+            uint32_t state = (m_meshDoubleSided[i] ? 1u : 0u) | (m_meshes[i].indexType == VK_INDEX_TYPE_UINT32 ? 0u : 2u);
+            uint32_t material = m_meshMaterials[i];
+            uint32_t pipeline = isMeshletDraw(i) ? 1u : 0u;  // recordDrawState绑定的是graphicsPipeline，meshlet排在后面
+            m_drawPackets.push_back({DrawSortKey::make(0, pipeline, state, material, static_cast<uint32_t>(i), 0), static_cast<uint32_t>(i)});
+        }
+        m_drawSorter.sort(m_drawPackets);
+        // materials：纹理可能在上一帧之后被替换或者移进atlas，每帧重新解析，内容不变的材质不写入
+        m_materials.write(currentImage, [this](const MaterialDesc& desc) {
+            const Texture& texture = m_textureCache.get(desc.texture);
+            GpuMaterial material{};
+            material.baseColorFactor = desc.baseColorFactor;
+            material.uvScale = glm::vec2(texture.uvScale[0], texture.uvScale[1]);
+            material.uvOffset = glm::vec2(texture.uvOffset[0], texture.uvOffset[1]);
+            material.baseColorTexture = texture.bindlessIndex;
+            return material;
+        });
+        // scene objects：每个可见的mesh写在自己的编号上，draw只记录编号
+        for (const DrawPacket& packet : m_drawPackets) {
+            if (packet.mesh < m_sceneObjects.capacity()) {
+                m_sceneObjects.write(currentImage, packet.mesh, sceneObject(packet.mesh));
+            }
+        }
+        if (!useMultiDrawIndirect()) {
+            return;
+        }
+        for (size_t p = 0; p < m_drawPackets.size(); p++) {
+            uint32_t i = m_drawPackets[p].mesh;
+            VkDrawIndexedIndirectCommand command{};
+            meshIndexRange(i, command.firstIndex, command.indexCount);
+            command.instanceCount = m_instanceCount;
+            command.vertexOffset = m_meshes[i].vertexOffset;
+            m_indirectDraws.write(currentImage, static_cast<uint32_t>(p), command, &i);
+        }
+    }
 
-                vertex.pos = {
-                    attrib.vertices[3 * index.vertex_index + 0],
-                    attrib.vertices[3 * index.vertex_index + 1],
-                    attrib.vertices[3 * index.vertex_index + 2]
-                };
+    // scene objects：和meshPushConstants相同的model和材质，加上包围盒
+    SceneObject sceneObject(size_t mesh) const {
+        DrawPushConstants pushConstants = meshPushConstants(mesh);
+        SceneObject object{};
+        object.model = pushConstants.model;
+        object.boundsMin = glm::vec4(m_meshBounds[mesh].min, 0.0f);
+        object.boundsMax = glm::vec4(m_meshBounds[mesh].max, 0.0f);
+        object.materialIndex = pushConstants.materialIndex;
+        return object;
+    }
 
-                vertex.texCoord = {
-                    attrib.texcoords[2 * index.texcoord_index + 0],
-                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]  // 翻转纹理的y，因为obj认为y的0点在图像底部而我们把图像传给vulkan是自顶向下传输
-                };
+    // multi draw indirect：gpu culling时每个mesh已经是indirect count draw，不使用这条路径；draw costs需要每个mesh单独计时
+    bool useMultiDrawIndirect() const {
+        return m_multiDrawIndirectSupported && !useGpuCulling() && !m_drawCosts.initialized() && m_drawPackets.size() <= m_indirectDraws.capacity() && m_meshes.size() <= m_sceneObjects.capacity();
+    }
 
-                vertex.color = {1.0f, 1.0f, 1.0f};
+    // bindless：切换纹理只需要push constant，不需要绑定其他descriptor set
+    // push constant：model矩阵和纹理一起push，每个draw只有这一条命令
+    DrawPushConstants meshPushConstants(size_t mesh) const {
+        const Texture& texture = m_textureCache.get(m_meshTextures[mesh]);
+        DrawPushConstants pushConstants{};
+        pushConstants.model = m_meshTransforms[mesh];
+        pushConstants.textureIndex = texture.bindlessIndex;
+        pushConstants.materialIndex = m_meshMaterials[mesh];
+        pushConstants.uvScale = glm::vec2(texture.uvScale[0], texture.uvScale[1]);
+        pushConstants.uvOffset = glm::vec2(texture.uvOffset[0], texture.uvOffset[1]);
+        return pushConstants;
+    }
 
-                // 顶点去重，使用index，这需要Vertex类实现相等测试和哈希函数
-                // 如果map没找到相同的vertex那么把vertex索引加入到map，并增加到vertices
-                if (uniqueVertices.count(vertex) == 0) {
-                    uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-                    vertices.push_back(vertex);
+    // meshlet：meshlet是用level 0构建的，选择了更粗的level时使用vkCmdDrawIndexed
+    // instancing：task shader只绘制一个实例，有多个实例或者实例被剔除时使用vkCmdDrawIndexed
+    // pipeline variants：meshlet pipeline还在编译时回退到graphicsPipeline的vkCmdDrawIndexed
+    bool isMeshletDraw(size_t mesh) const {
+        return m_meshMeshlets[mesh].meshletCount > 0 && m_meshLods[mesh].current == 0 && m_instanceCount == 1
+            && (m_shaderObjects.initialized() || m_meshletPipeline != VK_NULL_HANDLE);
+    }
+
+    // command buffer：录制m_drawPackets中[begin, end)范围的draw，调用之前已经用recordDrawState绑定了graphicsPipeline和32位索引
+    // depth prepass：prepass中跳过meshlet的draw；prepass之后的forward中其它draw只有depth相等的片段执行fragment shader
+    void recordDraws(VkCommandBuffer commandBuffer, size_t begin, size_t end, DynamicStateCommands& dynamicStates) {
+        bool depthOnly = m_prepassPhase == DepthPrepassPhase::depth;
+        VkPipeline vertexPipeline = depthOnly ? m_depthPrepassPipeline : graphicsPipeline;
+        VkPipeline boundPipeline = vertexPipeline;
+        bool boundMeshletShaders = false;  // shader object：当前绑定的是task和mesh shader
+        bool multiDraw = useMultiDrawIndirect();
+
+        // instanceCount：用于实例化渲染，instancing：scene list中的全部实例
+        // firstIndex：mesh的索引在索引区域中的偏移
+        // vertexOffset：加到每个索引上的值，mesh的顶点在顶点区域中的偏移
+        // firstInstance：实例化的偏移量，定义gl_InstanceIndex最小值
+        VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;
+        for (size_t p = begin; p < end; p++) {
+            size_t i = m_drawPackets[p].mesh;
+            const MeshRange& mesh = m_meshes[i];
+
+            // meshlet：有meshlet的mesh由task shader剔除，每个task workgroup测试32个meshlet
+            MeshletRange meshlets = m_meshMeshlets[i];
+            if (!isMeshletDraw(i)) {
+                meshlets.meshletCount = 0;
+            }
+            // hi-z：meshlet绘制的单个实例不参与实例剔除，第二阶段由task shader补画第一阶段被上一帧depth挡住的meshlet
+            bool meshletDraw = meshlets.meshletCount > 0;
+            if (depthOnly && meshletDraw) {
+                continue;
+            }
+            if (m_shaderObjects.initialized()) {
+                if (meshletDraw != boundMeshletShaders) {
+                    boundMeshletShaders = meshletDraw;
+                    if (meshletDraw) {
+                        m_shaderObjects.bindMeshShaders(commandBuffer, m_taskShaderObject, m_meshShaderObject, m_meshletFragmentShaderObject);
+                    } else {
+                        m_shaderObjects.bindVertexShaders(commandBuffer, m_vertexShaderObject, m_fragmentShaderObject);
+                    }
+                    dynamicStates.invalidate(meshletDraw);
+                }
+            } else {
+                VkPipeline pipeline = meshletDraw ? m_meshletPipeline : vertexPipeline;
+                if (pipeline != boundPipeline) {
+                    boundPipeline = pipeline;
+                    DeviceDispatch::cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, boundPipeline);
+                    dynamicStates.invalidate(meshletDraw);
+                }
+            }
+            // dynamic state：双面材质和线框只改变命令中的状态，和其它mesh使用同一个pipeline
+            if (dynamicStates.initialized()) {
+                RasterState rasterState;
+                rasterState.cullMode = m_meshDoubleSided[i] ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+                rasterState.polygonMode = m_wireframe ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+                // variable rate shading：更粗的lod说明mesh很远，降低per-draw的rate；rate image和它按combiner组合
+                if (m_meshLods[i].current > 0) {
+                    rasterState.shadingRate = m_shadingRateSupport.maxRate;
+                }
+                rasterState.shadingRateCombiner = useShadingRateAttachment() ? m_shadingRateCombiner : VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR;
+                if (m_prepassPhase == DepthPrepassPhase::shade && !meshletDraw) {
+                    rasterState.depthCompareOp = VK_COMPARE_OP_EQUAL;
+                    rasterState.depthWriteEnable = VK_FALSE;
                 }
+                dynamicStates.apply(commandBuffer, rasterState);
+            }
 
-                // 重复或者不重复的顶点都会创建一个index
-                indices.push_back(uniqueVertices[vertex]);
+            // multi draw indirect：key中pipeline和raster state（包括索引类型）相同的一段packet一起提交，push constant只有这一段的起点
+            // occlusion queries：使用predicate的mesh单独一个draw，不和相邻的packet合并
+            size_t runEnd = p + 1;
+            DrawPushConstants pushConstants{};
+            if (multiDraw && !meshletDraw) {
+                uint64_t runKey = m_drawPackets[p].key >> DrawSortKey::STATE_SHIFT;
+                while (!occlusionPredicated(i) && runEnd < end && (m_drawPackets[runEnd].key >> DrawSortKey::STATE_SHIFT) == runKey
+                    && !occlusionPredicated(m_drawPackets[runEnd].mesh)) {
+                    runEnd++;
+                }
+                pushConstants.drawDataBase = static_cast<uint32_t>(p);
+                pushConstants.indirect = 1;
+            } else {
+                pushConstants = meshPushConstants(i);
+            }
+            DeviceDispatch::cmdPushConstants(commandBuffer, pipelineLayout, m_drawPushConstantStages, 0, sizeof(pushConstants), &pushConstants);
+
+            if (meshlets.meshletCount > 0) {
+                MeshletPushConstants meshletConstants{meshlets.firstMeshlet, meshlets.meshletCount, mesh.vertexOffset, m_cullPhase};
+                DeviceDispatch::cmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, MESHLET_PUSH_CONSTANT_OFFSET,
+                    sizeof(meshletConstants), &meshletConstants);
+                bool conditional = beginOcclusionConditional(commandBuffer, i);
+                uint32_t costDraw = m_drawCosts.begin(commandBuffer, currentFrame, static_cast<uint32_t>(i), m_meshMaterials[i]);
+                m_vkCmdDrawMeshTasksEXT(commandBuffer, (meshlets.meshletCount + 31) / 32, 1, 1);
+                m_drawCosts.end(commandBuffer, currentFrame, costDraw);
+                endOcclusionConditional(commandBuffer, conditional);
+                continue;
+            }
+
+            if (mesh.indexType != boundIndexType) {
+                boundIndexType = mesh.indexType;
+                m_geometryBuffer.bindIndices(commandBuffer, boundIndexType);
+            }
+            bool conditional = beginOcclusionConditional(commandBuffer, i);
+            uint32_t costDraw = m_drawCosts.begin(commandBuffer, currentFrame, static_cast<uint32_t>(i), m_meshMaterials[i]);  // draw costs：诊断模式没有multi draw，一个draw只有一个mesh
+            if (useGpuCulling()) {
+                m_gpuCuller.draw(commandBuffer, currentFrame, static_cast<uint32_t>(i), m_cullPhase);  // gpu culling：索引范围在updateUniformBuffer中写入
+            } else if (multiDraw) {
+                m_indirectDraws.draw(commandBuffer, currentFrame, static_cast<uint32_t>(p), static_cast<uint32_t>(runEnd - p));
+                p = runEnd - 1;
+            } else {
+                uint32_t firstIndex, indexCount;
+                meshIndexRange(i, firstIndex, indexCount);
+                DeviceDispatch::cmdDrawIndexed(commandBuffer, indexCount, m_instanceCount, firstIndex, mesh.vertexOffset, 0);
             }
+            m_drawCosts.end(commandBuffer, currentFrame, costDraw);
+            endOcclusionConditional(commandBuffer, conditional);
+        }
+    }
+
+    // occlusion queries：上一帧包围盒没有通过深度测试时gpu跳过之间的draw；begin和end在同一个command buffer和同一个render pass中
+    bool beginOcclusionConditional(VkCommandBuffer commandBuffer, size_t mesh) const {
+        return m_occlusionQueries.initialized() && m_occlusionQueries.beginConditional(commandBuffer, static_cast<uint32_t>(mesh));
+    }
+
+    void endOcclusionConditional(VkCommandBuffer commandBuffer, bool conditional) const {
+        if (conditional) {
+            m_occlusionQueries.endConditional(commandBuffer);
         }
     }
-    
-    // vertex buffer：buffer是内存区域，用于向显卡提供读取的数据。buffer不会自动分配内存需要手动分配
-    void createVertexBuffer() {
-        // staging buffer：之前使用host可见的buffer作为vertex buffer，现在选择device buffer作为vertex buffer
-        // 所以staging buffer选择VK_BUFFER_USAGE_TRANSFER_SRC_BIT用于内存传输
-        // host可见buffer可以直接map，然后把数据通过复制命令复制到device buffer中
-        VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        // VK_BUFFER_USAGE_VERTEX_BUFFER_BIT：缓冲区作为内存传输操作的src
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    bool occlusionPredicated(size_t mesh) const {
+        return m_occlusionQueries.initialized() && m_occlusionQueries.predicated(static_cast<uint32_t>(mesh));
+    }
 
-        // 复制顶点数据到buffer中
-        // 根据之前设置的属性VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT需要将buffer内存映射到cpu可访问内存
-        // 结束映射时保持cache两种方法：
-        // 第一种，一致性使用VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-        // 第二种，写入映射内存后调用vkFlushMappedMemoryRanges刷新数据到buffer，读取映射内存数据前用vkInvalidateMappedMemoryRanges让buffer把数据同步到映射内存中
-        // 使用一致性内存并不是gpu实际可见，gpu传输数据在后台发生，只能保证下次vkQueueSubmit时传输完成
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-            memcpy(data, vertices.data(), (size_t) bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+    // lod：当前level在索引区域中的范围，没有lod的mesh是整个mesh
+    void meshIndexRange(size_t mesh, uint32_t& firstIndex, uint32_t& indexCount) const {
+        const MeshLodChain& lods = m_meshLods[mesh];
+        firstIndex = m_meshes[mesh].firstIndex;
+        indexCount = m_meshes[mesh].indexCount;
+        if (!lods.levels.empty()) {
+            firstIndex += lods.levels[lods.current].firstIndex;
+            indexCount = lods.levels[lods.current].indexCount;
+        }
+    }
 
-        // VK_BUFFER_USAGE_TRANSFER_DST_BIT：缓冲区作为内存传输的dst
-        // VK_BUFFER_USAGE_VERTEX_BUFFER_BIT：用于vertex buffer
-        // VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT：选择device buffer
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+    // stream capture：记录这一帧排序之后的draw packet，和recordDraws一样使用选择的lod，没有剔除的实例由每个draw全部绘制
+    // 启动时的上传完成之前不开始记录，记录满STREAM_CAPTURE_FRAMES帧后写入文件
+    void captureStreamFrame(uint32_t currentImage, const glm::mat4& sceneModel, const glm::mat4& viewProj) {
+        if (m_streamCapturePath.empty() || m_streamCaptureWritten) {
+            return;
+        }
+        if (m_streamCapture.frames.empty() && !(m_uploadContext.idle() && m_uploadScheduler.idle())) {
+            return;
+        }
 
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+        std::vector<size_t> newMeshes;
+        for (const DrawPacket& packet : m_drawPackets) {
+            const MeshRange& mesh = m_meshes[packet.mesh];
+            auto key = std::make_pair(mesh.vertexOffset, mesh.firstIndex);
+            if (m_streamCaptureMeshes.emplace(key, static_cast<uint32_t>(m_streamCapture.meshes.size() + newMeshes.size())).second) {
+                newMeshes.push_back(packet.mesh);
+            }
+        }
+        if (!newMeshes.empty()) {
+            captureStreamMeshes(newMeshes);
+        }
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        StreamFrame frame;
+        frame.viewProj = viewProj;
+        // gpu culling：实例buffer由gpu写入，记录的是全部实例
+        const InstanceData* instances = useGpuCulling() ? m_sceneInstances.data() : static_cast<const InstanceData*>(m_instanceBuffer.mapped(currentImage));
+        for (uint32_t i = 0; i < m_instanceCount; i++) {
+            frame.instances.push_back(instances[i].transform);
+        }
+        for (const DrawPacket& packet : m_drawPackets) {
+            const MeshRange& mesh = m_meshes[packet.mesh];
+            StreamDraw draw{};
+            draw.mesh = m_streamCaptureMeshes[std::make_pair(mesh.vertexOffset, mesh.firstIndex)];
+            meshIndexRange(packet.mesh, draw.firstIndex, draw.indexCount);
+            draw.firstIndex -= mesh.firstIndex;
+            draw.model = sceneModel * m_meshTransforms[packet.mesh];
+            frame.draws.push_back(draw);
+        }
+        m_streamCapture.frames.push_back(std::move(frame));
+
+        if (m_streamCapture.frames.size() >= STREAM_CAPTURE_FRAMES) {
+            m_streamCapture.width = swapChainExtent.width;
+            m_streamCapture.height = swapChainExtent.height;
+            bool written = m_streamCapture.write(m_streamCapturePath);
+            std::cout << "stream capture: " << m_streamCapture.frames.size() << " frames, " << m_streamCapture.meshes.size() << " meshes "
+                << (written ? "written to " : "failed to write ") << m_streamCapturePath << std::endl;
+            m_streamCapture = StreamCapture{};
+            m_streamCaptureMeshes.clear();
+            m_streamCaptureWritten = true;
+        }
     }
 
-    // index buffer：使用staging buffer传数据给index buffer
-    void createIndexBuffer() {
-        VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    // stream capture：从geometry buffer读回mesh的位置和索引，同一帧第一次出现的mesh一起拷贝，提交之后直接等待
+    // compact vertex：位置是snorm16，这里转换成浮点数，解量化变换已经在draw的model中
+    void captureStreamMeshes(const std::vector<size_t>& meshes) {
+        std::vector<VkBufferCopy> regions;
+        std::vector<VkDeviceSize> offsets;
+        VkDeviceSize total = 0;
+        for (size_t i : meshes) {
+            const MeshRange& mesh = m_meshes[i];
+            offsets.push_back(total);
+            regions.push_back({m_geometryBuffer.vertexByteOffset(mesh), total, m_geometryBuffer.vertexByteSize(mesh)});
+            total += (m_geometryBuffer.vertexByteSize(mesh) + 3) / 4 * 4;
+            regions.push_back({m_geometryBuffer.indexByteOffset(mesh), total, m_geometryBuffer.indexByteSize(mesh)});
+            total += (m_geometryBuffer.indexByteSize(mesh) + 3) / 4 * 4;
+        }
+        regions.erase(std::remove_if(regions.begin(), regions.end(), [](const VkBufferCopy& region) { return region.size == 0; }), regions.end());
+
+        VkBuffer readbackBuffer;
+        Allocation readbackAllocation;
+        createBuffer(std::max<VkDeviceSize>(total, 4), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            readbackBuffer, readbackAllocation, MemoryCategory::staging, "stream capture readback");
+
+        // stream capture：skinning和mesh decode由compute写入，上传由传输写入，之前的提交都要对拷贝可见
+        VkCommandBuffer commandBuffer = m_uploadContext.graphicsCommandBuffer();
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        if (!regions.empty()) {
+            vkCmdCopyBuffer(commandBuffer, m_geometryBuffer.buffer(), readbackBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+        }
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        m_uploadContext.wait(m_uploadContext.submit());
+
+        const char* data = static_cast<const char*>(readbackAllocation.mapped);
+        uint32_t positionStride = m_geometryBuffer.positionStride();
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const MeshRange& mesh = m_meshes[meshes[m]];
+            StreamMesh captured;
+            const char* positions = data + offsets[m];
+            for (uint32_t v = 0; v < mesh.vertexCount; v++) {
+                const char* vertex = positions + static_cast<size_t>(v) * positionStride;
+                glm::vec3 position;
+                if (COMPACT_VERTICES) {
+                    int16_t quantized[3];
+                    memcpy(quantized, vertex, sizeof(quantized));
+                    position = glm::max(glm::vec3(quantized[0], quantized[1], quantized[2]) / 32767.0f, glm::vec3(-1.0f));
+                } else {
+                    memcpy(&position, vertex, sizeof(position));
+                }
+                captured.positions.push_back(position);
+            }
+            const char* indices = positions + (m_geometryBuffer.vertexByteSize(mesh) + 3) / 4 * 4;
+            for (uint32_t k = 0; k < mesh.indexCount; k++) {
+                if (mesh.indexType == VK_INDEX_TYPE_UINT16) {
+                    uint16_t index;
+                    memcpy(&index, indices + static_cast<size_t>(k) * sizeof(uint16_t), sizeof(index));
+                    captured.indices.push_back(index);
+                } else {
+                    uint32_t index;
+                    memcpy(&index, indices + static_cast<size_t>(k) * sizeof(uint32_t), sizeof(index));
+                    captured.indices.push_back(index);
+                }
+            }
+            m_streamCapture.meshes.push_back(std::move(captured));
+        }
 
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+        vkDestroyBuffer(device, readbackBuffer, hostAllocator());
+        m_allocator.free(readbackAllocation);
+    }
 
-        void* data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-            memcpy(data, indices.data(), (size_t) bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+    // meshlet：set 2引用geometry buffer的顶点区域，mesh shader和vertex pulling都读取它
+    bool useGeometrySet() const {
+        return m_meshShaderSupported || VERTEX_PULLING;
+    }
 
-        // VK_BUFFER_USAGE_INDEX_BUFFER_BIT：用于index buffer
-        createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+    bool useGpuCulling() const {
+        return m_gpuCuller.initialized() && m_meshes.size() <= GPU_CULLING_MAX_DRAWS;
+    }
 
-        copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+    // depth prepass：只在render graph路径中使用，legacy render pass只有一个subpass；线框的depth和填充的prepass不一致
+    // pipeline variants：prepass的pipeline编译完成之前不使用prepass，forward直接用LESS比较
+    bool useDepthPrepass() const {
+        return m_depthPrepass && m_dynamicRenderingSupported && !m_wireframe && (m_shaderObjects.initialized() || m_depthPrepassPipeline != VK_NULL_HANDLE);
+    }
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+    // draw costs：query的序号按录制顺序分配，只在primary中录制
+    bool useParallelRecording() const {
+        return PARALLEL_COMMAND_RECORDING && !m_drawCosts.initialized() && m_parallelRecorder.segmentCount() > 1 && m_meshes.size() >= PARALLEL_RECORD_MIN_DRAWS;
     }
 
-    // descriptor set layout：根据frames in flight创建多个ubo，避免更新的ubo正在被使用。不使用staging buffer因为每帧都会更新ubo，反而造成性能下降
-    void createUniformBuffers() {
-        VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+    // parallel recording：pipeline的future在主线程取出，job中的waitPipeline只读取已经编译好的pipeline；变体已经在updatePipelines中取出
+    // 每段有自己的DynamicStateCommands副本，状态跟踪只在段内有效
+    void recordParallelDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, size_t recordTarget) {
+        waitPipeline(m_graphicsPipelineFuture, graphicsPipeline);
+
+        VkCommandBufferInheritanceRenderingInfo renderingInheritance{};
+        VkFormat colorFormat = sceneColorFormat();
+        VkCommandBufferInheritanceInfo inheritance{};
+        inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        if (m_dynamicRenderingSupported) {
+            renderingInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+            renderingInheritance.colorAttachmentCount = 1;
+            renderingInheritance.pColorAttachmentFormats = &colorFormat;
+            renderingInheritance.depthAttachmentFormat = findDepthFormat();
+            renderingInheritance.stencilAttachmentFormat = hasStencilComponent(renderingInheritance.depthAttachmentFormat)
+                ? renderingInheritance.depthAttachmentFormat : VK_FORMAT_UNDEFINED;
+            renderingInheritance.rasterizationSamples = m_msaaSamples;
+            inheritance.pNext = &renderingInheritance;
+        } else {
+            inheritance.renderPass = renderPass;
+            inheritance.subpass = 0;
+            inheritance.framebuffer = swapChainFramebuffers[imageIndex];
+        }
+        if (m_inheritedQueries) {
+            inheritance.pipelineStatistics = GpuProfiler::PIPELINE_STATISTIC_FLAGS;  // pipeline statistics：primary中的统计query覆盖secondary的draw
+        }
+
+        m_parallelRecorder.beginTarget(recordTarget);
+        uint32_t segmentCount = m_parallelRecorder.segmentCount();
+        size_t drawsPerSegment = (m_drawPackets.size() + segmentCount - 1) / segmentCount;
+        std::vector<VkCommandBuffer>& secondaries = m_parallelSecondaries;
+        secondaries.assign(segmentCount, VK_NULL_HANDLE);
+        m_jobPool.parallelFor(segmentCount, [&](size_t segment) {
+            VkCommandBuffer secondary = m_parallelRecorder.beginSecondary(recordTarget, static_cast<uint32_t>(segment), inheritance);
+            DynamicStateCommands dynamicStates = m_dynamicStates;
+            if (segment == 0) {
+                recordTerrain(secondary, dynamicStates);  // terrain：和单线程录制一样在所有mesh之前
+            }
+            recordDrawState(secondary, dynamicStates);
+            size_t begin = std::min(segment * drawsPerSegment, m_drawPackets.size());
+            recordDraws(secondary, begin, std::min(begin + drawsPerSegment, m_drawPackets.size()), dynamicStates);
+            if (segment + 1 == segmentCount) {
+                recordImpostors(secondary, dynamicStates);  // impostor：和单线程录制一样在所有mesh之后
+                recordOcclusionQueries(secondary, dynamicStates);
+                recordParticles(secondary, dynamicStates);
+            }
+            if (DeviceDispatch::endCommandBuffer(secondary) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+            secondaries[segment] = secondary;
+        });
+
+        DeviceDispatch::cmdExecuteCommands(commandBuffer, segmentCount, secondaries.data());  // 按段的顺序执行，和单线程录制的draw顺序一致
+    }
+
+    // dynamic rendering：render pass的initialLayout、finalLayout和subpass dependency改为显式的barrier
+    // render graph：barrier由graph在pass之前录制，这里只开始渲染
+    // hi-z：第二阶段的绘制loadOp是LOAD，接着第一阶段的color和depth绘制；第一阶段的depth之后要生成pyramid，storeOp是STORE
+    // msaa：resolveView不为空时colorView是多重采样的transient image，结束时平均resolve到resolveView，多重采样的color不写回内存
+    // dynamic resolution：extent是render area，场景pass是m_renderExtent；depthView为空时没有depth attachment
+    // depth prepass：colorView为空时没有color attachment；loadDepth为true时清除color但保留prepass写入的depth
+    // variable rate shading：shadingRateView不为空时作为fragment shading rate attachment，一直处于GENERAL
+    void beginDynamicRendering(VkCommandBuffer commandBuffer, VkExtent2D extent, VkImageView colorView, VkImageView depthView, VkRenderingFlags flags, VkAttachmentLoadOp loadOp,
+        VkAttachmentStoreOp depthStoreOp, VkImageView resolveView = VK_NULL_HANDLE, bool loadDepth = false, VkImageView shadingRateView = VK_NULL_HANDLE) {
+        VkRenderingAttachmentInfo colorAttachment{};
+        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        colorAttachment.imageView = colorView;
+        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.loadOp = loadOp;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        if (resolveView != VK_NULL_HANDLE) {
+            colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+            colorAttachment.resolveImageView = resolveView;
+            colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        }
+        colorAttachment.clearValue.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+        VkRenderingAttachmentInfo depthAttachment{};
+        depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        depthAttachment.imageView = depthView;
+        depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthAttachment.loadOp = loadDepth ? VK_ATTACHMENT_LOAD_OP_LOAD : loadOp;
+        depthAttachment.storeOp = depthStoreOp;
+        depthAttachment.clearValue.depthStencil = {1.0f, 0};
+
+        VkRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.flags = flags;  // parallel recording：内容来自secondary command buffer
+        renderingInfo.renderArea.offset = {0, 0};
+        renderingInfo.renderArea.extent = extent;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = colorView != VK_NULL_HANDLE ? 1 : 0;
+        renderingInfo.pColorAttachments = colorView != VK_NULL_HANDLE ? &colorAttachment : nullptr;
+        renderingInfo.pDepthAttachment = depthView != VK_NULL_HANDLE ? &depthAttachment : nullptr;
+
+        VkRenderingFragmentShadingRateAttachmentInfoKHR shadingRateAttachment{};
+        shadingRateAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR;
+        shadingRateAttachment.imageView = shadingRateView;
+        shadingRateAttachment.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        shadingRateAttachment.shadingRateAttachmentTexelSize = m_shadingRate.texelSize();
+        if (shadingRateView != VK_NULL_HANDLE) {
+            renderingInfo.pNext = &shadingRateAttachment;
+        }
+        m_vkCmdBeginRendering(commandBuffer, &renderingInfo);
+    }
+
+    // rendering：创建同步对象。因为许多vulkan api调用是异步的，在操作完成前就返回了
+    // semaphore：用于控制同队列或不同队列之间的队列操作顺序，队列操作指提交给队列的工作
+    // 有binary和timeline两种类型semaphore。这里queue分别是graphics和presentation queue，只用binary semaphore
+    // semaphore造成的等待只会发生在gpu上，cpu需要fence
+    // fence：控制cpu上执行顺序，如果host需要知道gpu完成了什么就需要用fence。一般避免fence
+    // timeline semaphore：cpu也可以查询和等待timeline的值，fence的作用由m_timeline代替，它在createStagingRing中创建
+    void createSyncObjects() {
+        // frames in flight：每帧创建同步对象
+        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        // 第一个semaphore用于swap chain获取图像准备渲染
+        // 第二个semaphore用于表示渲染完成可以进行present
+        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+            if (vkCreateSemaphore(device, &semaphoreInfo, hostAllocator(), &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphoreInfo, hostAllocator(), &renderFinishedSemaphores[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create synchronization objects for a frame!");
+            }
+        }
+
+        if (!m_separatePresentQueue) {
+            return;
+        }
+
+        // present queue：acquire barrier的command buffer从呈现queue family的pool分配，每帧重新录制
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = m_presentFamily;
+        if (vkCreateCommandPool(device, &poolInfo, hostAllocator(), &m_presentCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create present command pool!");
+        }
 
-        uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-        uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_presentCommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+        if (vkAllocateCommandBuffers(device, &allocInfo, m_presentCommandBuffers) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate present command buffers!");
+        }
 
         for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
+            if (vkCreateSemaphore(device, &semaphoreInfo, hostAllocator(), &m_presentReadySemaphores[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create present semaphore!");
+            }
+        }
+        m_presentTimeline.init(device);
+    }
 
-            vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+    // multiple views：额外的view画进自己的swap chain image，需要dynamic rendering；present queue和图形队列不同时image需要转移所有权，这里不支持
+    // 不满足时销毁额外的窗口，只渲染主窗口
+    void createExtraViews() {
+        if (m_extraViews.empty()) {
+            return;
+        }
+        if (!m_dynamicRenderingSupported || m_separatePresentQueue) {
+            std::cout << "multiple views: requires dynamic rendering and a graphics queue that can present, extra windows closed" << std::endl;
+            for (std::unique_ptr<ExtraView>& view : m_extraViews) {
+                view->target.cleanup(instance);
+            }
+            m_extraViews.clear();
+            return;
+        }
+        VkFormat depthFormat = findDepthFormat();
+        for (size_t i = 0; i < m_extraViews.size(); i++) {
+            ExtraView& view = *m_extraViews[i];
+            view.target.init(instance, physicalDevice, device, m_allocator, m_graphicsFamily, depthFormat, hasStencilComponent(depthFormat), MAX_FRAMES_IN_FLIGHT,
+                [this](std::function<void()> destroy) { m_deletionQueue.push(m_frameNumber, std::move(destroy)); });
+            view.pipeline = buildViewPipeline(view.target.format());
+            view.instances.init(device, m_allocator, sizeof(InstanceData), instanceCapacity(), MAX_FRAMES_IN_FLIGHT);
+            // multiple views：相机从主相机的初始位置绕场景的z轴转开，n个view和主窗口平分一圈
+            float angle = glm::radians(360.0f) * static_cast<float>(i + 1) / static_cast<float>(m_extraViews.size() + 1);
+            view.camera.place(glm::angleAxis(angle, glm::vec3(0.0f, 0.0f, 1.0f)) * m_camera.position(), m_camera.lookAt());
         }
     }
 
-    // descriptor set：创建pool用于分配descriptor set
-    void createDescriptorPool() {
-        std::array<VkDescriptorPoolSize, 2> poolSizes{};
-        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;  // descriptor类型
-        poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);  // descriptor数量
-        // texture mapping：再创建一个pool防止pool分配空间不足
-        poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;  // 使用sampler类型
-        poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    // multiple views：和buildGraphicsPipeline相同的shader和顶点格式，颜色格式换成窗口的swap chain格式，单采样，不使用rate attachment
+    // 光栅化状态全部是静态的，不剔除背面，双面材质不需要切换状态
+    VkPipeline buildViewPipeline(VkFormat colorFormat) {
+        VkShaderModule vertShaderModule = createShaderModule(embeddedShader(COMPACT_VERTICES ? COMPACT_VERT_SHADER : DEPTH_VERT_SHADER));
+        VkShaderModule fragShaderModule = createShaderModule(embeddedShader(BINDLESS_FRAG_SHADER));
+
+        GraphicsPipelineState state;
+        state.stages.resize(2);
+        VkShaderStageFlagBits stages[2] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+        VkShaderModule modules[2] = {vertShaderModule, fragShaderModule};
+        for (size_t i = 0; i < state.stages.size(); i++) {
+            state.stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            state.stages[i].stage = stages[i];
+            state.stages[i].module = modules[i];
+            state.stages[i].pName = "main";
+        }
 
-        VkDescriptorPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-        poolInfo.pPoolSizes = poolSizes.data();
-        poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);  // descriptor set最大数量
+        VkGraphicsPipelineCreateInfo pipelineInfo = fillPipelineState(state, VIEW_PIPELINE_DESC);
+        state.colorFormat = colorFormat;
 
-        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create descriptor pool!");
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, m_pipelineCache.handle(), 1, &pipelineInfo, hostAllocator(), &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create view pipeline!");
         }
+        m_shaderStatistics.record(pipeline, "view " + std::to_string(colorFormat));
+        vkDestroyShaderModule(device, fragShaderModule, hostAllocator());
+        vkDestroyShaderModule(device, vertShaderModule, hostAllocator());
+        return pipeline;
     }
 
-    // descriptor set：创建descriptor set
-    void createDescriptorSets() {
-        std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
-        VkDescriptorSetAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = descriptorPool;  // 指定descriptor pool
-        allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);  // 为每一帧创建一个descriptor set
-        allocInfo.pSetLayouts = layouts.data();  // 设置layout
+    // impostor：烘焙pipeline读取场景的顶点格式，去掉实例的binding和location 3之后的实例属性
+    // 绘制的pipeline和场景pipeline使用同一个pipeline layout和attachment格式，在主线程直接创建
+    void createImpostors() {
+        if (!IMPOSTORS || DEFERRED_SHADING) {
+            return;
+        }
+        std::vector<VkVertexInputBindingDescription> bindings;
+        std::vector<VkVertexInputAttributeDescription> attributes;
+        gpuVertexInput(false, bindings, attributes);
+        bindings.pop_back();
+        attributes.erase(std::remove_if(attributes.begin(), attributes.end(), [](const VkVertexInputAttributeDescription& attribute) {
+            return attribute.location >= 3;
+        }), attributes.end());
+        VkPipelineCreateFlags flags = m_descriptorBuffer.initialized() ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+        m_impostors.init(device, m_allocator, m_bindlessTextures, m_pipelineCache.handle(), embeddedShader(IMPOSTOR_BAKE_VERT_SHADER),
+            embeddedShader(IMPOSTOR_BAKE_FRAG_SHADER), pipelineLayout, flags, bindings, attributes, IMPOSTOR_ATLAS_SIZE, IMPOSTOR_CELL_SIZE, IMPOSTOR_FRAMES,
+            IMPOSTOR_MAX_PAGES, IMPOSTOR_MAX_INSTANCES, MAX_FRAMES_IN_FLIGHT);
+
+        VkShaderModule vertShaderModule = createShaderModule(embeddedShader(IMPOSTOR_VERT_SHADER));
+        VkShaderModule fragShaderModule = createShaderModule(embeddedShader(IMPOSTOR_FRAG_SHADER));
+        GraphicsPipelineState state;
+        state.stages.resize(2);
+        VkShaderStageFlagBits stages[2] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+        VkShaderModule modules[2] = {vertShaderModule, fragShaderModule};
+        for (size_t i = 0; i < state.stages.size(); i++) {
+            state.stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            state.stages[i].stage = stages[i];
+            state.stages[i].module = modules[i];
+            state.stages[i].pName = "main";
+        }
+        VkGraphicsPipelineCreateInfo pipelineInfo = fillPipelineState(state, IMPOSTOR_PIPELINE_DESC);
+        if (vkCreateGraphicsPipelines(device, m_pipelineCache.handle(), 1, &pipelineInfo, hostAllocator(), &m_impostorPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create impostor pipeline!");
+        }
+        m_shaderStatistics.record(m_impostorPipeline, "impostor");
+        vkDestroyShaderModule(device, fragShaderModule, hostAllocator());
+        vkDestroyShaderModule(device, vertShaderModule, hostAllocator());
+    }
+
+    // particles：和impostor一样使用场景的pipeline layout，顶点着色器只读取set 0的ubo；状态只有一份，device group交替渲染时两个设备的模拟会分开
+    void createParticles() {
+        if (!PARTICLES || DEFERRED_SHADING || m_deviceGroup.alternateFrames()) {
+            return;
+        }
+        std::string_view sortShader = GpuRadixSort::subgroupRankingSupported(physicalDevice) ? RADIX_SORT_SUBGROUP_SHADER : RADIX_SORT_SHADER;
+        m_particles.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(PARTICLE_COMP_SHADER), commandPool, MAX_FRAMES_IN_FLIGHT, PARTICLE_CAPACITY,
+            !PARTICLE_ADDITIVE, embeddedShader(sortShader));
+
+        VkShaderModule vertShaderModule = createShaderModule(embeddedShader(PARTICLE_VERT_SHADER));
+        VkShaderModule fragShaderModule = createShaderModule(embeddedShader(PARTICLE_FRAG_SHADER));
+        GraphicsPipelineState state;
+        state.stages.resize(2);
+        VkShaderStageFlagBits stages[2] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+        VkShaderModule modules[2] = {vertShaderModule, fragShaderModule};
+        for (size_t i = 0; i < state.stages.size(); i++) {
+            state.stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            state.stages[i].stage = stages[i];
+            state.stages[i].module = modules[i];
+            state.stages[i].pName = "main";
+        }
+        VkGraphicsPipelineCreateInfo pipelineInfo = fillPipelineState(state, PARTICLE_PIPELINE_DESC);
+        if (vkCreateGraphicsPipelines(device, m_pipelineCache.handle(), 1, &pipelineInfo, hostAllocator(), &m_particlePipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create particle pipeline!");
+        }
+        m_shaderStatistics.record(m_particlePipeline, "particle");
+        vkDestroyShaderModule(device, fragShaderModule, hostAllocator());
+        vkDestroyShaderModule(device, vertShaderModule, hostAllocator());
+    }
 
-        descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate descriptor sets!");
+    void createComputePrimitives() {
+        bool subgroup = SubgroupCapabilities::query(physicalDevice).arithmetic;
+        m_computePrimitives.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(subgroup ? COMPUTE_PRIMITIVES_SUBGROUP_SHADER : COMPUTE_PRIMITIVES_SHADER),
+            COMPUTE_PRIMITIVES_CAPACITY);
+        if (COMPUTE_PRIMITIVES_BENCHMARK) {
+            m_computePrimitives.benchmark(physicalDevice, graphicsQueue, commandPool, COMPUTE_PRIMITIVES_BENCHMARK_ELEMENTS, COMPUTE_PRIMITIVES_BENCHMARK_ITERATIONS,
+                subgroup, std::cout);
         }
+    }
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            VkDescriptorBufferInfo bufferInfo{};  // 指定descriptor引用的ubo
-            bufferInfo.buffer = uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
-
-            // texture mapping：绑定image和sampler到descriptor中
-            VkDescriptorImageInfo imageInfo{};
-            imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageInfo.imageView = textureImageView;
-            imageInfo.sampler = textureSampler;
-
-            std::array<VkWriteDescriptorSet, 2> descriptorWrites{};  // 填充descriptor set
-            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[0].dstSet = descriptorSets[i];
-            descriptorWrites[0].dstBinding = 0;  // ubo绑定到索引0
-            descriptorWrites[0].dstArrayElement = 0;  // 指定descriptor数组开始的索引
-            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrites[0].descriptorCount = 1;  // 指定descriptor数组更新多少个元素
-            descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-            // texture mapping：绑定image和sampler到descriptor中
-            descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrites[1].dstSet = descriptorSets[i];
-            descriptorWrites[1].dstBinding = 1;
-            descriptorWrites[1].dstArrayElement = 0;
-            descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptorWrites[1].descriptorCount = 1;
-            descriptorWrites[1].pImageInfo = &imageInfo;
-
-            vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);  // 除了write还可以接受copy参数用于复制descriptor
-        }
-    }
-
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
-        VkBufferCreateInfo bufferInfo{};
-        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferInfo.size = size;  // buffer大小
-        bufferInfo.usage = usage;  // 数据用法，这里作为顶点缓冲区
-        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;  // 和swap chain image一样buffer也可以在多个队列中共享，这里是独占访问
+    // occlusion queries：包围盒的pipeline和impostor、particles一样使用场景的pipeline layout，只有顶点着色器，push constant是DrawPushConstants的model
+    void createOcclusionQueries() {
+        if (!m_conditionalRenderingSupported) {
+            return;
+        }
+        m_occlusionQueries.init(device, m_allocator, OCCLUSION_QUERY_MAX_OBJECTS, MAX_FRAMES_IN_FLIGHT);
+
+        VkShaderModule vertShaderModule = createShaderModule(embeddedShader(OCCLUSION_BOX_VERT_SHADER));
+        GraphicsPipelineState state;
+        state.stages.resize(1);
+        state.stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        state.stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        state.stages[0].module = vertShaderModule;
+        state.stages[0].pName = "main";
+        VkGraphicsPipelineCreateInfo pipelineInfo = fillPipelineState(state, OCCLUSION_BOX_PIPELINE_DESC);
+        if (vkCreateGraphicsPipelines(device, m_pipelineCache.handle(), 1, &pipelineInfo, hostAllocator(), &m_occlusionBoxPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create occlusion box pipeline!");
+        }
+        m_shaderStatistics.record(m_occlusionBoxPipeline, "occlusion box");
+        vkDestroyShaderModule(device, vertShaderModule, hostAllocator());
+    }
 
-        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create buffer!");
+    // occlusion queries：hi-z剔除被挡住的实例时不需要；包围盒在sceneModel之前的空间，实例的变换不是单位矩阵时不对应
+    bool useOcclusionQueries() const {
+        return m_occlusionBoxPipeline != VK_NULL_HANDLE && !useOcclusionCulling() && m_sceneInstances.size() == 1
+            && m_sceneInstances[0].transform == glm::mat4(1.0f);
+    }
+
+    // occlusion queries：在buildDrawPackets之后选择这一帧查询的mesh；相机在包围盒里面（加上近平面的距离）时包围盒被近平面裁掉，结果会是0，这样的mesh不查询
+    // 下一帧也就不使用predicate；列表只在mesh出现、消失或者相机进出包围盒时改变，其它帧command cache仍然有效
+    void updateOcclusionQueries(const glm::mat4& sceneModel) {
+        m_occlusionQueryObjects.clear();
+        if (m_occlusionQueries.initialized() && useOcclusionQueries() && m_instanceCount > 0) {
+            glm::vec3 camera = glm::vec3(glm::inverse(sceneModel) * glm::vec4(m_camera.position(), 1.0f));
+            float margin = m_camera.zNear() * 2.0f;
+            for (const DrawPacket& packet : m_drawPackets) {
+                uint32_t firstIndex, indexCount;
+                meshIndexRange(packet.mesh, firstIndex, indexCount);
+                if (indexCount < OCCLUSION_QUERY_MIN_INDICES) {
+                    continue;
+                }
+                const Aabb& bounds = m_meshBounds[packet.mesh];
+                if (glm::all(glm::greaterThan(camera, bounds.min - margin)) && glm::all(glm::lessThan(camera, bounds.max + margin))) {
+                    continue;
+                }
+                m_occlusionQueryObjects.push_back(packet.mesh);
+            }
+            std::sort(m_occlusionQueryObjects.begin(), m_occlusionQueryObjects.end());
+        }
+        if (m_occlusionQueries.initialized()) {
+            m_occlusionQueries.beginFrame(currentFrame, m_occlusionQueryObjects);
         }
+    }
 
-        // 为buffer分配内存
-        // 这里体现了aliasing资源复用，把buffer这种资源概念和实际物理内存分离，方便复用
-        // findMemoryType包含三个字段如下：
-        // size：所需内存大小，和buffer大小可能不同
-        // alignment：buffer在分配的内存区域中的偏移量，和buffer的usage和flags有关
-        // memoryTypeBits：适用于buffer内存类型的位字段
-        VkMemoryRequirements memRequirements;
-        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);  // 查询内存需求
+    // occlusion queries：在不透明的mesh和impostor之后、透明的粒子之前，depth已经完整；每个query一个包围盒，set 0已经由recordDrawState绑定
+    void recordOcclusionQueries(VkCommandBuffer commandBuffer, DynamicStateCommands& dynamicStates) {
+        const std::vector<uint32_t>& queried = m_occlusionQueries.queried();
+        if (!m_occlusionQueries.initialized() || queried.empty()) {
+            return;
+        }
+        DeviceDispatch::cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_occlusionBoxPipeline);
+        VkViewport viewport{0.0f, 0.0f, static_cast<float>(m_renderExtent.width), static_cast<float>(m_renderExtent.height), 0.0f, 1.0f};
+        VkRect2D scissor{{0, 0}, m_renderExtent};
+        DeviceDispatch::cmdSetViewport(commandBuffer, 0, 1, &viewport);
+        DeviceDispatch::cmdSetScissor(commandBuffer, 0, 1, &scissor);
+        for (uint32_t query = 0; query < queried.size(); query++) {
+            const Aabb& bounds = m_meshBounds[queried[query]];
+            DrawPushConstants pushConstants{};
+            pushConstants.model = glm::translate(glm::mat4(1.0f), (bounds.min + bounds.max) * 0.5f)
+                * glm::scale(glm::mat4(1.0f), glm::max((bounds.max - bounds.min) * 0.5f, glm::vec3(1e-4f)));
+            DeviceDispatch::cmdPushConstants(commandBuffer, pipelineLayout, m_drawPushConstantStages, 0, sizeof(pushConstants), &pushConstants);
+            m_occlusionQueries.beginQuery(commandBuffer, query);
+            vkCmdDraw(commandBuffer, 36, 1, 0, 0);
+            m_occlusionQueries.endQuery(commandBuffer, query);
+        }
+        dynamicStates.invalidate(false);
+    }
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        // 要找到适合buffer的内存类型，并且需要能够写入，所以需要提供属性
-        // VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT属性表示可以映射从而可以从cpu写入顶点数据
-        // VK_MEMORY_PROPERTY_HOST_COHERENT_BIT属性用于cache一致性，因为结束映射时驱动程序可能不会立刻把数据写入buffer，也有可能反过来buffer数据在映射内存中不可见
-        allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    // particles：发射数量按时间累计，小数部分留到下一帧；暂停时时间步长为0，粒子停在原处也不发射
+    // 发射器在模型上方，粒子像喷泉一样向上喷出再落下
+    void updateParticles(uint32_t currentImage) {
+        m_particleCommands = VK_NULL_HANDLE;
+        if (!m_particles.initialized()) {
+            return;
+        }
+        float deltaTime = m_modelAnimating ? std::min(m_frameDeltaTime, 0.1f) : 0.0f;  // 卡顿的帧不会一次发射大量粒子
+        m_particleEmitDebt += PARTICLE_EMIT_RATE * deltaTime;
+        uint32_t emitCount = static_cast<uint32_t>(std::min(m_particleEmitDebt, static_cast<float>(PARTICLE_CAPACITY)));
+        m_particleEmitDebt -= static_cast<float>(emitCount);
+
+        ParticleEmitter emitter;
+        emitter.position = glm::vec3(0.0f, 0.0f, 0.6f);
+        emitter.radius = 0.05f;
+        emitter.velocity = glm::vec3(0.0f, 0.0f, 1.6f);
+        emitter.spread = 0.5f;
+        emitter.gravity = glm::vec3(0.0f, 0.0f, -1.8f);
+        emitter.minLifetime = PARTICLE_LIFETIME_MIN;
+        emitter.maxLifetime = PARTICLE_LIFETIME_MAX;
+        emitter.size = 0.006f;
+        m_particleCommands = m_particles.record(currentImage, emitter, emitCount, deltaTime, m_camera.position());
+    }
 
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate buffer memory!");
+    // terrain：在worker线程打开高度图，文件不存在或者格式不对时重新生成；生成的地形中心压平，外面是fBm的起伏
+    void openTerrainFile() {
+        if (!TERRAIN || DEFERRED_SHADING) {
+            return;
         }
+        m_terrainFileReady = m_terrainFile.open(TERRAIN_PATH);
+        if (!m_terrainFileReady) {
+            if (!TerrainFile::generate(TERRAIN_PATH, TERRAIN_GENERATED_TILES, 128, TERRAIN_GENERATED_SPACING, TERRAIN_GENERATED_AMPLITUDE,
+                    TERRAIN_GENERATED_FLAT_RADIUS, 1)) {
+                std::cerr << "failed to write terrain: " << TERRAIN_PATH << std::endl;
+                return;
+            }
+            m_terrainFileReady = m_terrainFile.open(TERRAIN_PATH);
+        }
+    }
 
-        vkBindBufferMemory(device, buffer, bufferMemory, 0);  // 关联内存和buffer
+    // terrain：绘制的pipeline使用TerrainRenderer的pipeline layout，不使用descriptor buffer；状态只有一份，device group交替渲染时关闭
+    // video encode：编码的大小是启动时swap chain的大小，之后窗口大小变化时转换的shader缩放到这个大小
+    void createVideoEncoder() {
+        if (!m_videoEncodeFamily.has_value()) {
+            return;
+        }
+        VideoEncoder::Settings settings;
+        settings.slotCount = VIDEO_ENCODE_SLOTS;
+        settings.frameRate = VIDEO_ENCODE_FRAME_RATE;
+        settings.bitrate = VIDEO_ENCODE_BITRATE;
+        settings.idrPeriod = VIDEO_ENCODE_IDR_PERIOD;
+        if (m_videoEncoder.init(instance, physicalDevice, device, m_allocator, m_pipelineCache.handle(), embeddedShader(VIDEO_CONVERT_SHADER), commandPool,
+                m_graphicsFamily, m_videoEncodeFamily.value(), m_videoEncodeQueue, swapChainExtent, settings, m_videoEncodePath)) {
+            std::cout << "video encode: " << swapChainExtent.width << "x" << swapChainExtent.height << " H.264 to " << m_videoEncodePath << std::endl;
+        }
     }
 
-    // image texture：创建短期command buffer，因为很多地方要用到所以从copybuffer中提取出函数
-    VkCommandBuffer beginSingleTimeCommands() {
-        // 分配command buffer
-        // 这种command buffer执行一次后立即销毁，所以是短期的
-        // 优化短期command buffer可以单独创建command pool，command pool设置标志VK_COMMAND_POOL_CREATE_TRANSIENT_BIT
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commandPool;
-        allocInfo.commandBufferCount = 1;
+    void createTerrain() {
+        if (!m_terrainFileReady || m_deviceGroup.alternateFrames()) {
+            return;
+        }
+        m_terrain.init(device, m_allocator, m_pipelineCache.handle(), embeddedShader(TERRAIN_CULL_SHADER), commandPool, m_jobPool, std::move(m_terrainFile),
+            MAX_FRAMES_IN_FLIGHT, TERRAIN_ORIGIN, TERRAIN_LOD_RANGE, TERRAIN_LEVELS, TERRAIN_CACHE_TILES, TERRAIN_UPLOADS_PER_FRAME, TERRAIN_MAX_PATCHES);
+
+        VkShaderModule vertShaderModule = createShaderModule(embeddedShader(TERRAIN_VERT_SHADER));
+        VkShaderModule fragShaderModule = createShaderModule(embeddedShader(TERRAIN_FRAG_SHADER));
+        GraphicsPipelineState state;
+        state.stages.resize(2);
+        VkShaderStageFlagBits stages[2] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
+        VkShaderModule modules[2] = {vertShaderModule, fragShaderModule};
+        for (size_t i = 0; i < state.stages.size(); i++) {
+            state.stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            state.stages[i].stage = stages[i];
+            state.stages[i].module = modules[i];
+            state.stages[i].pName = "main";
+        }
+        VkGraphicsPipelineCreateInfo pipelineInfo = fillPipelineState(state, TERRAIN_PIPELINE_DESC);
+        pipelineInfo.layout = m_terrain.pipelineLayout();
+        pipelineInfo.flags &= ~VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;  // descriptor buffer：terrain的set是普通的descriptor set
+        if (vkCreateGraphicsPipelines(device, m_pipelineCache.handle(), 1, &pipelineInfo, hostAllocator(), &m_terrainPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create terrain pipeline!");
+        }
+        m_shaderStatistics.record(m_terrainPipeline, "terrain");
+        vkDestroyShaderModule(device, fragShaderModule, hostAllocator());
+        vkDestroyShaderModule(device, vertShaderModule, hostAllocator());
+    }
+
+    // terrain：按主相机选择patch和需要读取的tile，multiple views的其它窗口不绘制地形
+    void updateTerrain(uint32_t currentImage, const glm::mat4& viewProj) {
+        m_terrainCommands = VK_NULL_HANDLE;
+        if (!m_terrain.initialized()) {
+            return;
+        }
+        m_terrainCommands = m_terrain.record(currentImage, viewProj, m_camera.position(), -glm::normalize(SUN_DIRECTION));
+    }
+
+    // multiple views：在主窗口的ubo之后为每个acquire到image的view写一个ubo，只替换view和proj
+    // cluster和shadow cascade是按主相机划分的，view中关闭点光源，shadowSplits为0时所有片段都在cascade之外，太阳光不带阴影
+    // 实例不做剔除，全部交给光栅化的裁剪；mesh使用level 0，lod和剔除都按主相机选择
+    void updateExtraViews(uint32_t currentImage, const UniformBufferObject& ubo) {
+        for (std::unique_ptr<ExtraView>& view : m_extraViews) {
+            if (!view->target.acquired()) {
+                continue;
+            }
+            VkExtent2D extent = view->target.extent();
+            view->camera.init(extent.width, extent.height);
+            UniformBufferObject viewUbo = ubo;
+            viewUbo.view = view->camera.view();
+            viewUbo.viewProj = view->camera.project() * viewUbo.view;
+            viewUbo.hiz = glm::uvec4(0);
+            viewUbo.clusterGrid.w = 0;
+            viewUbo.shadowSplits = glm::vec4(0.0f);
+            view->uniformOffset = m_uniformRing.push(viewUbo);
+            view->instanceCount = view->instances.write(currentImage, m_sceneInstances.data(), static_cast<uint32_t>(m_sceneInstances.size()));
+        }
+    }
+
+    // multiple views：每个view一个command buffer，绑定和主窗口相同的geometry、bindless纹理和每帧的descriptor set，只有dynamic offset不同
+    void recordExtraViews(uint32_t currentImage, std::vector<VkCommandBuffer>& commandBuffers) {
+        CPU_PROFILE_SCOPE("recordExtraViews");
+        for (std::unique_ptr<ExtraView>& view : m_extraViews) {
+            if (!view->target.acquired()) {
+                continue;
+            }
+            VkCommandBuffer commandBuffer = view->target.begin(currentImage, m_vkCmdBeginRendering);
+            DeviceDispatch::cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, view->pipeline);
+            VkExtent2D extent = view->target.extent();
+            VkViewport viewport{0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f};
+            VkRect2D scissor{{0, 0}, extent};
+            DeviceDispatch::cmdSetViewport(commandBuffer, 0, 1, &viewport);
+            DeviceDispatch::cmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+            m_geometryBuffer.bind(commandBuffer, VK_INDEX_TYPE_UINT32);
+            view->instances.bind(commandBuffer, currentImage, InstanceData::BINDING);
+            VkDescriptorSet bindlessSet = m_bindlessTextures.set();
+            DeviceDispatch::cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &bindlessSet, 0, nullptr);
+            DeviceDispatch::cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &m_frameDescriptorSet, 1, &view->uniformOffset);
+
+            VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;
+            for (size_t i = 0; i < m_meshes.size(); i++) {
+                if (!isMeshVisible(i)) {
+                    continue;
+                }
+                const MeshRange& mesh = m_meshes[i];
+                if (mesh.indexType != boundIndexType) {
+                    boundIndexType = mesh.indexType;
+                    m_geometryBuffer.bindIndices(commandBuffer, boundIndexType);
+                }
+                DrawPushConstants pushConstants = meshPushConstants(i);
+                DeviceDispatch::cmdPushConstants(commandBuffer, pipelineLayout, m_drawPushConstantStages, 0, sizeof(pushConstants), &pushConstants);
+                DeviceDispatch::cmdDrawIndexed(commandBuffer, mesh.indexCount, view->instanceCount, mesh.firstIndex, mesh.vertexOffset, 0);
+            }
+            view->target.end(commandBuffer, m_vkCmdEndRendering);
+            commandBuffers.push_back(commandBuffer);
+        }
+    }
 
-        VkCommandBuffer commandBuffer;
-        vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);  // allocate次数实际有限，一般需要自定义分配器，通过offset拆分对象分配
+    // present queue：swap chain image在图形队列和呈现队列之间转移所有权的barrier，release和acquire两边的layout和范围必须一致
+    // dynamic rendering时release是render graph的最终barrier，同时转换到PRESENT_SRC，render pass的finalLayout已经是PRESENT_SRC
+    VkImageMemoryBarrier presentOwnershipBarrier(uint32_t imageIndex) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = m_dynamicRenderingSupported ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        barrier.srcQueueFamilyIndex = m_separatePresentQueue ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = m_separatePresentQueue ? m_presentFamily : VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = swapChainImages[imageIndex];
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        return barrier;
+    }
 
+    // present queue：呈现队列一侧的acquire，src的access被忽略，srcStage和等待renderFinished的stage一致，形成依赖链
+    void recordPresentAcquire(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;  // 告诉驱动只使用一次command buffer
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (DeviceDispatch::beginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording present command buffer!");
+        }
+
+        VkImageMemoryBarrier barrier = presentOwnershipBarrier(imageIndex);
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = 0;
+        DeviceDispatch::cmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        if (DeviceDispatch::endCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record present command buffer!");
+        }
+    }
+
+    // descriptor set layout：更新ubo
+    void updateUniformBuffer(uint32_t currentImage) {
+        CPU_PROFILE_SCOPE("updateUniformBuffer");
+        // simulation：旋转角由模拟按固定步长推进，每秒转90度
+        // transform store：旋转写进模型的entity，和实例的变换一起更新
+        m_transforms.setRotation(m_modelEntity, glm::angleAxis(m_modelAngle, glm::vec3(0.0f, 0.0f, 1.0f)));
+        // stress scene：运动的实例绕自己的z轴以模型两倍的速度旋转，每帧都更新transform和instance bvh
+        for (size_t i = 0; i < m_movingEntities.size(); i++) {
+            m_transforms.setRotation(m_movingEntities[i], glm::angleAxis(m_movingAngles[i] + m_modelAngle * 2.0f, glm::vec3(0.0f, 0.0f, 1.0f)));
+        }
+        updateTransforms();
+        glm::mat4 model = m_transforms.world(m_modelEntity);
+
+        UniformBufferObject ubo{};
+        glm::mat4 proj = m_camera.project();
+        ubo.view = m_camera.view();
+        ubo.viewProj = proj * ubo.view;
+        ubo.sceneModel = model;  // meshlet：包围体不包含解量化变换
+        // hi-z：m_hizHistoryValid在updateGpuCulling中更新，这里还是这一帧第一阶段使用的值
+        ubo.hiz = glm::uvec4(m_hizBindlessIndex, useMeshletOcclusion(), m_hizHistoryValid && useMeshletOcclusion(), 0);
+
+        // clustered lighting：光源绕初始位置转半径0.5的圆，相位随index不同
+        for (size_t i = 0; i < m_lights.size(); i++) {
+            float phase = m_modelAngle + static_cast<float>(i) * 0.73f;
+            m_frameLights[i] = m_lights[i];
+            m_frameLights[i].positionRange += glm::vec4(std::cos(phase) * 0.5f, std::sin(phase) * 0.5f, 0.0f, 0.0f);
+        }
+        uint32_t lightCount = m_clusteredLighting.update(currentImage, m_frameLights.data(), static_cast<uint32_t>(m_frameLights.size()), ubo.view, proj,
+            m_camera.zNear(), m_camera.zFar());
+        ubo.clusterGrid = glm::uvec4(ClusteredLighting::GRID_X, ClusteredLighting::GRID_Y, ClusteredLighting::GRID_Z, lightCount);
+        ubo.clusterScale = ClusteredLighting::fragmentScale(m_renderExtent, m_camera.zNear(), m_camera.zFar());
+        // async compute：光源和参数已经写入，马上提交，计算队列在cpu录制和提交图形命令的同时开始分配cluster
+        m_asyncComputeValue = 0;
+        if (m_asyncCompute.enabled()) {
+            m_clusteredLighting.record(m_asyncCompute.begin(currentImage), currentImage, true);
+            m_asyncComputeValue = m_asyncCompute.submit(currentImage);
+        }
+        updateSkinning(currentImage);
+        updateParticles(currentImage);
+        updateTerrain(currentImage, ubo.viewProj);
+        updateRayTracedShadows(currentImage, model);
+        updateShadows(currentImage, model, proj, ubo);
+
+        // uniform ring：每帧只写入一个ubo，记录dynamic offset供录制command buffer时使用
+        m_uniformRing.beginFrame(currentImage);
+        m_frameUniformOffset = m_uniformRing.push(ubo);
+        updateExtraViews(currentImage, ubo);  // multiple views：view的ubo在同一个ring中，descriptor set不变
+        writeFrameDescriptorSet(currentImage);
+        selectMeshLods(model, ubo.view, proj);
+        selectImpostors(currentImage, model, ubo.view, proj, ubo.viewProj);
+
+        if (useGpuCulling()) {
+            updateGpuCulling(currentImage, model, ubo.viewProj);
+            m_instanceCount = static_cast<uint32_t>(m_sceneInstances.size());
+        } else {
+            if (cullInstances(model, ubo.viewProj)) {
+                m_instanceCount = m_instanceBuffer.gather(currentImage, m_sceneInstances.data(), m_visibleIndices.data(), static_cast<uint32_t>(m_visibleIndices.size()));
+            } else {
+                m_instanceCount = m_instanceBuffer.write(currentImage, m_sceneInstances.data(), static_cast<uint32_t>(m_sceneInstances.size()));
+            }
+        }
+        buildDrawPackets(currentImage);
+        captureStreamFrame(currentImage, model, ubo.viewProj);
+        updateOcclusionQueries(model);
+
+        // variable rate shading：这一帧结束时生成rate image，depth从这一帧的裁剪空间重投影到上一帧
+        const glm::mat4& viewProj = ubo.viewProj;
+        if (useShadingRateAttachment()) {
+            m_shadingRate.update(currentImage, m_prevViewProj * glm::inverse(viewProj), SHADING_RATE_LUMA_THRESHOLD, SHADING_RATE_MOTION_THRESHOLD,
+                m_shadingRateSupport.maxRate);
+        }
+        m_prevViewProj = viewProj;
+
+        // post processing：分辨率缩小时锐化留给upscale，在放大之后进行
+        if (m_postProcess.initialized()) {
+            bool scaled = m_renderExtent.width != swapChainExtent.width || m_renderExtent.height != swapChainExtent.height;
+            m_postProcess.update(currentImage, m_renderExtent, scaled ? 0.0f : POST_SHARPNESS, m_frameDeltaTime);
+        }
+    }
+
+    // skinning：动画时间只在m_modelAnimating时前进，每个模型的node姿势每帧只计算一次；所有可见的蒙皮mesh每帧都dispatch
+    // 这一帧的输出范围在这个frame in flight上一次的提交完成之后才写入，m_meshes中的vertexOffset换成它，之后录制的所有pass都读取蒙皮结果
+    // joint矩阵放不下时这个mesh使用绑定姿势的范围
+    void updateSkinning(uint32_t currentImage) {
+        m_skinningCommands = VK_NULL_HANDLE;
+        m_skinnedVisible = false;
+        m_skinnedAnimating = false;
+        if (m_skinnedMeshes.empty()) {
+            return;
+        }
+        if (m_modelAnimating) {
+            m_skinningTime += m_frameDeltaTime;
+        }
+        m_skinning.beginFrame(currentImage);
+        const GltfSkeleton* evaluated = nullptr;
+        for (const SkinnedMesh& skinned : m_skinnedMeshes) {
+            MeshRange& mesh = m_meshes[skinned.mesh];
+            mesh.vertexOffset = skinned.bindVertexOffset;
+            if (!isMeshVisible(skinned.mesh)) {
+                continue;
+            }
+            m_skinnedVisible = true;
+            if (skinned.skeleton.get() != evaluated) {  // 同一个模型的mesh在m_skinnedMeshes中相邻
+                evaluated = skinned.skeleton.get();
+                evaluated->evaluate(m_skinningTime, m_skinningGlobals);
+            }
+            evaluated->jointMatrices(m_skinningGlobals, skinned.skin, skinned.quantize, m_skinningJoints);
+            const MeshRange& output = skinned.outputs[currentImage];
+            if (m_skinning.add(currentImage, m_skinningJoints.data(), static_cast<uint32_t>(m_skinningJoints.size()), skinned.sourceVertex, skinned.vertexCount,
+                    static_cast<uint32_t>(skinned.bindVertexOffset), static_cast<uint32_t>(output.vertexOffset))) {
+                mesh.vertexOffset = output.vertexOffset;
+                m_skinnedAnimating = m_skinnedAnimating || (m_modelAnimating && evaluated->animated());
+            }
+        }
+        m_skinningCommands = m_skinning.record(currentImage);
+    }
+
+    // ray traced shadows：可见的mesh第一次出现时创建BLAS，每个实例的每个mesh是TLAS的一个实例，世界矩阵和drawShadowCasters使用的相同
+    // 这一帧的TLAS没有实例（BLAS都还没有build）或者实例超过容量时m_rayTracedShadowsActive为false，updateShadows照常更新shadow map
+    void updateRayTracedShadows(uint32_t currentImage, const glm::mat4& sceneModel) {
+        m_accelerationCommands = VK_NULL_HANDLE;
+        m_rayTracedShadowsActive = false;
+        if (!m_accelerationStructures.initialized()) {
+            return;
+        }
+        VkDeviceAddress geometryAddress = m_accelerationStructures.bufferAddress(m_geometryBuffer.buffer());
+        m_accelerationStructures.clearInstances();
+        bool fits = !m_skinnedVisible;  // skinning：BLAS不随蒙皮更新，有可见的蒙皮mesh时使用shadow map
+        for (size_t i = 0; i < m_meshes.size() && fits; i++) {
+            const MeshRange& mesh = m_meshes[i];
+            if (!isMeshVisible(i) || mesh.indexCount == 0) {
+                continue;
+            }
+            if (m_meshBlas[i] == AccelerationStructures::INVALID_BLAS) {
+                // shadow使用完整的mesh（level 0），和drawShadowCasters一样
+                BlasGeometry geometry{};
+                geometry.vertexAddress = geometryAddress + m_geometryBuffer.vertexByteOffset(mesh);
+                geometry.vertexStride = m_geometryBuffer.positionStride();
+                geometry.vertexFormat = COMPACT_VERTICES ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
+                geometry.vertexCount = mesh.vertexCount;
+                geometry.indexAddress = geometryAddress + m_geometryBuffer.indexByteOffset(mesh);
+                geometry.indexType = mesh.indexType;
+                geometry.indexCount = mesh.indexCount;
+                m_meshBlas[i] = m_accelerationStructures.addBlas(geometry);
+            }
+            glm::mat4 meshModel = sceneModel * m_meshTransforms[i];
+            for (const InstanceData& instance : m_sceneInstances) {
+                if (!m_accelerationStructures.addInstance(instance.transform * meshModel, m_meshBlas[i])) {
+                    fits = false;
+                    break;
+                }
+            }
+        }
+        if (!fits) {
+            m_accelerationStructures.clearInstances();  // 没有实例时仍然录制还没有完成的BLAS build和compaction
+        }
+        m_accelerationCommands = m_accelerationStructures.record(currentImage);
+        m_rayTracedShadowsActive = fits && m_accelerationStructures.valid(currentImage);
+    }
+
+    // shadow cache：sceneModel和上一帧不同时所有mesh都是动态caster，静态版本每个移动的帧都增加，停下来的第一帧重新绘制一次cache
+    // 实例网格切换和模型加载完成（可见mesh的数量改变）也改变静态caster，cascade的矩阵是保存在ShadowCache中的绘制时的矩阵
+    void updateShadows(uint32_t currentImage, const glm::mat4& sceneModel, const glm::mat4& proj, UniformBufferObject& ubo) {
+        size_t casterMeshes = 0;
+        for (size_t i = 0; i < m_meshes.size(); i++) {
+            casterMeshes += isMeshVisible(i) ? 1 : 0;
+        }
+        bool moving = sceneModel != m_shadowSceneModel || m_skinnedAnimating;  // skinning：播放动画时蒙皮的mesh每帧都在移动
+        if (moving || casterMeshes != m_shadowCasterMeshes) {
+            m_shadowStaticVersion++;
+        }
+        m_shadowSceneModel = sceneModel;
+        m_shadowCasterMeshes = casterMeshes;
+        m_shadowCastersDynamic = moving || !SHADOW_CACHE;
+        bool hasCasters = casterMeshes > 0 && !m_sceneInstances.empty();
+
+        Aabb casterBounds{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+        if (hasCasters) {
+            Aabb modelBounds = transformAabb(residentModelBounds(), sceneModel);
+            for (const InstanceData& instance : m_sceneInstances) {
+                Aabb box = transformAabb(modelBounds, instance.transform);
+                casterBounds.min = glm::min(casterBounds.min, box.min);
+                casterBounds.max = glm::max(casterBounds.max, box.max);
+            }
+        }
+
+        glm::vec3 sunDirection = glm::normalize(SUN_DIRECTION);
+        ubo.sunDirection = glm::vec4(sunDirection, m_rayTracedShadowsActive ? 1.0f : 0.0f);
+        ubo.sunColor = glm::vec4(SUN_COLOR, 1.0f);
+        m_shadowCommands = VK_NULL_HANDLE;
+        if (m_rayTracedShadowsActive) {
+            return;  // ray traced shadows：shadow map这一帧不使用，静态版本照常记录，回到shadow map时cache按版本重新绘制
+        }
+        bool work = m_shadowCache.update(m_shadowFrame++, ubo.view, proj, m_camera.zNear(), m_camera.zFar(), sunDirection, casterBounds, m_shadowStaticVersion,
+            hasCasters && !m_shadowCastersDynamic, hasCasters && m_shadowCastersDynamic, SHADOW_STAGGER && !m_deviceGroup.alternateFrames(),
+            SHADOW_CACHE && !m_deviceGroup.alternateFrames());  // alternate frame rendering：每个设备有自己的shadow map，每帧都完整绘制
+        if (work) {
+            m_shadowInstances.write(currentImage, m_sceneInstances.data(), static_cast<uint32_t>(m_sceneInstances.size()));
+            m_shadowCommands = m_shadowCache.record(currentImage, [this, currentImage](VkCommandBuffer commandBuffer, VkPipelineLayout layout, ShadowCasters casters) {
+                drawShadowCasters(commandBuffer, layout, currentImage, casters);
+            });
+        }
 
-        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        for (uint32_t i = 0; i < ShadowCache::CASCADE_COUNT; i++) {
+            ubo.shadowViewProj[i] = m_shadowCache.cascadeViewProj(i);
+        }
+        ubo.shadowSplits = m_shadowCache.splits();
+    }
 
-        return commandBuffer;
+    // shadow cache：场景中所有caster属于同一组，不是这一组时什么都不画；shadow使用完整的mesh（level 0），lod切换不改变cache
+    void drawShadowCasters(VkCommandBuffer commandBuffer, VkPipelineLayout layout, uint32_t currentImage, ShadowCasters casters) {
+        if ((casters == ShadowCasters::dynamicCasters) != m_shadowCastersDynamic) {
+            return;
+        }
+        m_geometryBuffer.bind(commandBuffer, VK_INDEX_TYPE_UINT32);
+        m_shadowInstances.bind(commandBuffer, currentImage, InstanceData::BINDING);
+        VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;
+        for (size_t i = 0; i < m_meshes.size(); i++) {
+            if (!isMeshVisible(i)) {
+                continue;
+            }
+            const MeshRange& mesh = m_meshes[i];
+            if (mesh.indexType != boundIndexType) {
+                boundIndexType = mesh.indexType;
+                m_geometryBuffer.bindIndices(commandBuffer, boundIndexType);
+            }
+            glm::mat4 model = m_shadowSceneModel * m_meshTransforms[i];
+            DeviceDispatch::cmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_VERTEX_BIT, offsetof(ShadowCache::PushConstants, model), sizeof(model), &model);
+            DeviceDispatch::cmdDrawIndexed(commandBuffer, mesh.indexCount, static_cast<uint32_t>(m_sceneInstances.size()), mesh.firstIndex, mesh.vertexOffset, 0);
+        }
     }
 
-    // image texture：结束command buffer录制并执行
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer) {
-        vkEndCommandBuffer(commandBuffer);
+    // frustum culling：所有已经显示的mesh的包围盒的并集，没有mesh显示时是空的包围盒
+    Aabb residentModelBounds() const {
+        Aabb modelBounds{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+        for (size_t i = 0; i < m_meshes.size(); i++) {
+            if (isMeshVisible(i)) {
+                modelBounds.min = glm::min(modelBounds.min, m_meshBounds[i].min);
+                modelBounds.max = glm::max(modelBounds.max, m_meshBounds[i].max);
+            }
+        }
+        return modelBounds;
+    }
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffer;
+    // gpu culling：参数、scene list和每个mesh当前lod的索引范围写进这一帧的buffer，关闭FRUSTUM_CULLING时平面全部为0，所有实例都可见
+    // hi-z：这一帧会重新生成pyramid，下一帧的第一阶段可以用它剔除
+    void updateGpuCulling(uint32_t currentImage, const glm::mat4& sceneModel, const glm::mat4& viewProj) {
+        GpuCullParams params{};
+        if (FRUSTUM_CULLING) {
+            std::array<glm::vec4, 6> planes = FrustumCuller::extractPlanes(viewProj);
+            std::copy(planes.begin(), planes.end(), params.planes);
+        }
+        Aabb modelBounds = residentModelBounds();
+        params.sceneModel = sceneModel;
+        params.boundsMin = glm::vec4(modelBounds.min, 1.0f);
+        params.boundsMax = glm::vec4(modelBounds.max, 1.0f);
+        params.viewProj = viewProj;
+        params.pyramidSize = glm::vec2(m_hiz.extent().width, m_hiz.extent().height);
+        params.pyramidLevels = m_hiz.levelCount();
+        params.occlusion = useOcclusionCulling();
+        params.historyValid = m_hizHistoryValid;
+        if (FRUSTUM_CULLING) {
+            ContributionTest contribution = contributionTest();
+            params.contribution = glm::vec4(contribution.cameraPosition, contribution.ratio);
+        }
+        m_hizHistoryValid = useOcclusionCulling();
+        m_gpuCuller.setPyramid(currentImage, m_hiz.view(), m_hiz.sampler());
+        params.instanceCount = static_cast<uint32_t>(m_sceneInstances.size());
+        params.drawCount = static_cast<uint32_t>(m_meshes.size());
+        m_gpuCuller.update(currentImage, params, m_sceneInstances.data());
+
+        // upload scheduler：模型的submesh分多帧上传，resident之前已经分配的mesh画0个索引
+        for (size_t i = 0; i < m_meshes.size(); i++) {
+            uint32_t firstIndex, indexCount;
+            meshIndexRange(i, firstIndex, indexCount);
+            indexCount = isMeshVisible(i) ? indexCount : 0;
+            m_gpuCuller.setDraw(currentImage, static_cast<uint32_t>(i), indexCount, firstIndex, m_meshes[i].vertexOffset);
+        }
+    }
 
-        vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(graphicsQueue);  // 这里简单等待队列执行完成，也可以用fence，使用fence就能安排多个传输并等待所有完成而不是一次执行一个传输，比如创建多个command buffer进行传输
+    // contribution culling：阈值按相机的fovy和视口高度换算成半径和距离的比值，cpu和gpu的剔除使用同一个测试
+    ContributionTest contributionTest() const {
+        return ContributionTest::make(m_camera.position(), m_camera.fovy(), static_cast<uint32_t>(m_camera.viewportHeight()), CONTRIBUTION_CULLING_PIXELS);
+    }
 
-        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    // frustum culling：实例的包围盒是所有已经显示的mesh的包围盒的并集，乘上实例的transform和sceneModel
+    // bvh：实例数量达到BVH_CULLING_MIN_OBJECTS时查询bvh，包围盒比逐个测试时大一些
+    // batch transform：可见实例的索引写入m_visibleIndices，返回false表示没有剔除，所有实例都可见
+    bool cullInstances(const glm::mat4& sceneModel, const glm::mat4& viewProj) {
+        if (!FRUSTUM_CULLING) {
+            return false;
+        }
+        if (m_sceneInstances.size() >= BVH_CULLING_MIN_OBJECTS) {
+            updateInstanceBvh();
+            m_instanceBvh.queryFrustum(FrustumCuller::extractPlanes(viewProj), m_bvhVisible, contributionTest());
+            m_visibleIndices.assign(m_bvhVisible.begin(), m_bvhVisible.end());
+            cullOccludedInstances(sceneModel, viewProj);
+            return true;
+        }
+        Aabb modelBounds = residentModelBounds();
+
+        // batch transform：所有实例的transform * sceneModel一次算完，sceneModel在循环外展开
+        m_instanceWorld.resize(m_sceneInstances.size());
+        m_instanceBounds.resize(m_sceneInstances.size());
+        if (!m_sceneInstances.empty()) {
+            BatchTransform::multiplyRight(&m_sceneInstances[0].transform, sizeof(InstanceData), sceneModel, m_instanceWorld.data(), sizeof(glm::mat4),
+                m_sceneInstances.size());
+        }
+        for (size_t i = 0; i < m_sceneInstances.size(); i++) {
+            m_instanceBounds[i] = transformAabb(modelBounds, m_instanceWorld[i]);
+        }
+        const std::vector<uint32_t>& visible = m_frustumCuller.cull(viewProj, m_instanceBounds, &m_jobPool, CULLING_PARALLEL_MIN_OBJECTS, contributionTest());
+        m_visibleIndices.assign(visible.begin(), visible.end());
+        cullOccludedInstances(sceneModel, viewProj);
+        return true;
     }
 
+    // software occlusion：离相机最近的可见实例依次把所有显示的mesh的遮挡体画进depth buffer，直到三角形预算用完，然后用它测试m_visibleIndices中的实例
+    // 画过遮挡体的实例最近的角不会比自己的表面远，测试总是通过；m_visibleIndices保持原来的顺序
+    void cullOccludedInstances(const glm::mat4& sceneModel, const glm::mat4& viewProj) {
+        if (!m_softwareOcclusion.initialized() || m_visibleIndices.size() < 2) {
+            return;
+        }
+        CPU_PROFILE_SCOPE("software occlusion");
+        m_occluderMeshes.clear();
+        size_t instanceTriangles = 0;
+        for (size_t mesh = 0; mesh < m_meshes.size(); mesh++) {
+            if (isMeshVisible(mesh) && !m_meshOccluders[mesh].empty()) {
+                m_occluderMeshes.push_back(static_cast<uint32_t>(mesh));
+                instanceTriangles += m_meshOccluders[mesh].size() / 3;
+            }
+        }
+        Aabb modelBounds = residentModelBounds();
+        if (m_occluderMeshes.empty() || instanceTriangles > SOFTWARE_OCCLUSION_MAX_TRIANGLES || glm::any(glm::greaterThan(modelBounds.min, modelBounds.max))) {
+            return;
+        }
 
-    // staging buffer：把数据从staging buffer复制到vertex buffer
-    // 内存传输操作需要command buffer
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-        VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+        m_occlusionBoxes.resize(m_visibleIndices.size());
+        m_occluderOrder.resize(m_visibleIndices.size());
+        glm::vec3 cameraPosition = m_camera.position();
+        for (size_t i = 0; i < m_visibleIndices.size(); i++) {
+            m_occlusionBoxes[i] = transformAabb(modelBounds, m_sceneInstances[m_visibleIndices[i]].transform * sceneModel);
+            glm::vec3 offset = (m_occlusionBoxes[i].min + m_occlusionBoxes[i].max) * 0.5f - cameraPosition;
+            m_occluderOrder[i] = {glm::dot(offset, offset), static_cast<uint32_t>(i)};
+        }
+        std::sort(m_occluderOrder.begin(), m_occluderOrder.end());
 
-        VkBufferCopy copyRegion{};  // 定义拷贝区域
-        copyRegion.size = size;
-        vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+        m_softwareOcclusion.begin(viewProj);
+        for (size_t n = 0; n < m_occluderOrder.size() && (n + 1) * instanceTriangles <= SOFTWARE_OCCLUSION_MAX_TRIANGLES; n++) {
+            glm::mat4 modelViewProj = viewProj * m_sceneInstances[m_visibleIndices[m_occluderOrder[n].second]].transform * sceneModel;
+            for (uint32_t mesh : m_occluderMeshes) {
+                m_softwareOcclusion.addOccluder(m_meshOccluders[mesh].data(), m_meshOccluders[mesh].size(), modelViewProj);
+            }
+        }
+        m_softwareOcclusion.rasterize(&m_jobPool);
 
-        endSingleTimeCommands(commandBuffer);
+        size_t kept = 0;
+        for (size_t i = 0; i < m_visibleIndices.size(); i++) {
+            if (m_softwareOcclusion.visible(m_occlusionBoxes[i])) {
+                m_visibleIndices[kept++] = m_visibleIndices[i];
+            }
+        }
+        m_visibleIndices.resize(kept);
     }
 
-    // vertex buffer：根据缓冲区需求typeFilter以及自己的需求porperties来找到合适的内存类型
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties memProperties;  // 包含memoryTypes和memoryHeaps。memoryHeaps是内存堆，是不同的内存资源，不同堆的性能会不同
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);  // 查询可用的内存类型
+    // bvh：sceneModel只是绕z轴的旋转，模型包围盒换成绕z轴任意旋转都包含模型的包围盒，实例的包围盒就不随旋转变化
+    // 只有scene list或者显示的mesh改变时才需要更新；更新所有实例之后refit，树的质量变差时bvh在后台重新构建
+    Aabb instanceBvhModelBounds() const {
+        Aabb modelBounds = residentModelBounds();
+        if (glm::any(glm::greaterThan(modelBounds.min, modelBounds.max))) {
+            return modelBounds;
+        }
+        glm::vec2 corner = glm::max(glm::abs(glm::vec2(modelBounds.min)), glm::abs(glm::vec2(modelBounds.max)));
+        float radius = glm::length(corner);
+        return {glm::vec3(-radius, -radius, modelBounds.min.z), glm::vec3(radius, radius, modelBounds.max.z)};
+    }
 
-        // 迭代内存类型，typeFilter表示适合的内存类型，和i进行and判断排除不适用的内存类型，然后查看当前内存类型的属性是否符合properties指定的属性
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-            if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
+    void updateInstanceBvh() {
+        Aabb modelBounds = instanceBvhModelBounds();
+        bool boundsChanged = modelBounds.min != m_bvhModelBounds.min || modelBounds.max != m_bvhModelBounds.max;
+        m_bvhModelBounds = modelBounds;
+        if (m_instanceBvhStale || m_instanceBvh.objectCount() != m_sceneInstances.size()) {
+            std::vector<Aabb> boxes(m_sceneInstances.size());
+            for (size_t i = 0; i < m_sceneInstances.size(); i++) {
+                boxes[i] = transformAabb(modelBounds, m_sceneInstances[i].transform);
+            }
+            m_instanceBvh.build(boxes);
+            m_instanceBvhStale = false;
+            return;
+        }
+        if (boundsChanged) {
+            for (size_t i = 0; i < m_sceneInstances.size(); i++) {
+                m_instanceBvh.update(static_cast<uint32_t>(i), transformAabb(modelBounds, m_sceneInstances[i].transform));
             }
         }
-
-        throw std::runtime_error("failed to find suitable memory type!");
+        m_instanceBvh.refit();
     }
 
-    // command buffer：创建command buffer
-    void createCommandBuffers() {
-        commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);  // frames in flight：每个帧创建一个command buffer
-
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = commandPool;  // 指定command pool
-        // 指定分配command buffer的主从关系
-        // VK_COMMAND_BUFFER_LEVEL_PRIMARY：可以提交到队列执行，但不能从其它command buffer中被调用
-        // VK_COMMAND_BUFFER_LEVEL_SECONDARY：不能提交，但可以被primary command buffer调用。对于复用常用操作有帮助
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
-
-        if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate command buffers!");
+    // descriptor allocator：set 0引用这一帧的uniform ring buffer，实际的offset是绑定时的dynamic offset
+    // descriptor buffer：这一帧的那一段直接写入ubo slice的地址，gpu已经完成了上次使用这一段的帧
+    void writeFrameDescriptorSet(uint32_t currentImage) {
+        if (m_cachedFrameSets[currentImage] != VK_NULL_HANDLE) {
+            m_frameDescriptorSet = m_cachedFrameSets[currentImage];  // command cache：内容在createDescriptorSets中写入，不会改变
+            return;
+        }
+        if (m_descriptorBuffer.initialized()) {
+            VkDeviceAddress address = m_descriptorBuffer.bufferAddress(m_uniformRing.buffer(currentImage)) + m_frameUniformOffset;
+            m_descriptorBuffer.writeUniformBuffer(m_frameDescriptorOffsets[currentImage], descriptorSetLayout, 0, address, sizeof(UniformBufferObject));
+            m_descriptorBuffer.writeStorageBuffer(m_frameDescriptorOffsets[currentImage], descriptorSetLayout, 1,
+                m_descriptorBuffer.bufferAddress(m_indirectDraws.dataBuffer(currentImage)), m_indirectDraws.dataRange());
+            m_descriptorBuffer.writeStorageBuffer(m_frameDescriptorOffsets[currentImage], descriptorSetLayout, 2,
+                m_descriptorBuffer.bufferAddress(m_clusteredLighting.lightBuffer(currentImage)), m_clusteredLighting.lightRange());
+            m_descriptorBuffer.writeStorageBuffer(m_frameDescriptorOffsets[currentImage], descriptorSetLayout, 3,
+                m_descriptorBuffer.bufferAddress(m_clusteredLighting.clusterBuffer(currentImage)), m_clusteredLighting.clusterRange());
+            m_descriptorBuffer.writeCombinedImageSampler(m_frameDescriptorOffsets[currentImage], descriptorSetLayout, 4, 0, m_shadowCache.view(), m_shadowCache.sampler());
+            m_descriptorBuffer.writeStorageBuffer(m_frameDescriptorOffsets[currentImage], descriptorSetLayout, 5,
+                m_descriptorBuffer.bufferAddress(m_sceneObjects.buffer(currentImage)), m_sceneObjects.range());
+            m_descriptorBuffer.writeStorageBuffer(m_frameDescriptorOffsets[currentImage], descriptorSetLayout, 7,
+                m_descriptorBuffer.bufferAddress(m_materials.buffer(currentImage)), m_materials.range());
+            if (m_accelerationStructures.initialized()) {
+                m_descriptorBuffer.writeAccelerationStructure(m_frameDescriptorOffsets[currentImage], descriptorSetLayout, 6,
+                    m_accelerationStructures.tlasAddress(currentImage));
+            }
+            return;
         }
+
+        m_frameDescriptorSet = m_frameDescriptors.allocate(descriptorSetLayout);
+
+        VkDescriptorBufferInfo bufferInfo{};  // 指定descriptor引用的ubo
+        bufferInfo.buffer = m_uniformRing.buffer(currentImage);
+        bufferInfo.offset = 0;  // uniform ring：实际的offset是绑定时的dynamic offset加上这里的offset
+        bufferInfo.range = m_uniformRing.blockRange();
+
+        VkDescriptorBufferInfo drawDataInfo{m_indirectDraws.dataBuffer(currentImage), 0, m_indirectDraws.dataRange()};  // multi draw indirect：这一帧每个draw的object编号
+        VkDescriptorBufferInfo objectInfo{m_sceneObjects.buffer(currentImage), 0, m_sceneObjects.range()};  // scene objects：按mesh编号的object数据
+        VkDescriptorBufferInfo materialInfo{m_materials.buffer(currentImage), 0, m_materials.range()};  // materials：材质表
+
+        VkDescriptorBufferInfo lightInfo{m_clusteredLighting.lightBuffer(currentImage), 0, m_clusteredLighting.lightRange()};  // clustered lighting：光源和cluster列表
+        VkDescriptorBufferInfo clusterInfo{m_clusteredLighting.clusterBuffer(currentImage), 0, m_clusteredLighting.clusterRange()};
+        VkDescriptorImageInfo shadowInfo{m_shadowCache.sampler(), m_shadowCache.view(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};  // shadow cache：cascade的depth array
+
+        // ray traced shadows：TLAS的handle通过pNext传入
+        VkAccelerationStructureKHR tlas = m_accelerationStructures.initialized() ? m_accelerationStructures.tlas(currentImage) : VK_NULL_HANDLE;
+        VkWriteDescriptorSetAccelerationStructureKHR tlasInfo{};
+        tlasInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+        tlasInfo.accelerationStructureCount = 1;
+        tlasInfo.pAccelerationStructures = &tlas;
+
+        std::array<VkWriteDescriptorSet, 8> descriptorWrites{};  // 填充descriptor set
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = m_frameDescriptorSet;
+        descriptorWrites[0].dstBinding = 0;  // ubo绑定到索引0
+        descriptorWrites[0].dstArrayElement = 0;  // 指定descriptor数组开始的索引
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrites[0].descriptorCount = 1;  // 指定descriptor数组更新多少个元素
+        descriptorWrites[0].pBufferInfo = &bufferInfo;
+        descriptorWrites[1] = descriptorWrites[0];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[1].pBufferInfo = &drawDataInfo;
+        descriptorWrites[2] = descriptorWrites[1];
+        descriptorWrites[2].dstBinding = 2;
+        descriptorWrites[2].pBufferInfo = &lightInfo;
+        descriptorWrites[3] = descriptorWrites[1];
+        descriptorWrites[3].dstBinding = 3;
+        descriptorWrites[3].pBufferInfo = &clusterInfo;
+        descriptorWrites[4] = descriptorWrites[1];
+        descriptorWrites[4].dstBinding = 4;
+        descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[4].pBufferInfo = nullptr;
+        descriptorWrites[4].pImageInfo = &shadowInfo;
+        descriptorWrites[5] = descriptorWrites[1];
+        descriptorWrites[5].dstBinding = 5;
+        descriptorWrites[5].pBufferInfo = &objectInfo;
+        descriptorWrites[6] = descriptorWrites[1];
+        descriptorWrites[6].dstBinding = 7;
+        descriptorWrites[6].pBufferInfo = &materialInfo;
+        descriptorWrites[7] = descriptorWrites[1];  // ray traced shadows：TLAS排在最后，没有时不写入
+        descriptorWrites[7].pNext = &tlasInfo;
+        descriptorWrites[7].dstBinding = 6;
+        descriptorWrites[7].descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+        descriptorWrites[7].pBufferInfo = nullptr;
+        uint32_t writeCount = static_cast<uint32_t>(descriptorWrites.size()) - (m_accelerationStructures.initialized() ? 0 : 1);
+
+        vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);  // 除了write还可以接受copy参数用于复制descriptor
     }
 
-    // command buffer：记录command，将command和swapchain image索引作为参数传入
-    void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    // lod：误差投影到屏幕上的像素数是error / depth * (proj[1][1] * 高度 / 2)，depth是level中心在view space的深度
+    // 从上一帧的level出发，误差超过阈值时换到更精细的level，换到更粗的level需要误差低于更严格的阈值
+    void selectMeshLods(const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj) {
+        float pixelsPerUnit = std::abs(proj[1][1]) * static_cast<float>(m_renderExtent.height) * 0.5f;  // dynamic resolution：实际渲染的像素
+        float pixelError = m_quality.settings().lodPixelError;
+        for (MeshLodChain& chain : m_meshLods) {
+            if (chain.levels.empty()) {
+                continue;
+            }
+            float depth = std::max(-(view * model * glm::vec4(chain.center, 1.0f)).z, 1e-3f);
+            auto projectedError = [&](uint32_t level) { return chain.levels[level].error / depth * pixelsPerUnit; };
 
-        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-            throw std::runtime_error("failed to begin recording command buffer!");
+            uint32_t level = chain.current;
+            while (level > 0 && projectedError(level) > pixelError) {
+                level--;
+            }
+            if (level == chain.current) {
+                while (level + 1 < chain.levels.size() && projectedError(level + 1) <= pixelError * (1.0f - LOD_HYSTERESIS)) {
+                    level++;
+                }
+            }
+            chain.current = level;
         }
+    }
 
-        // 启动render pass
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-        renderPassInfo.renderArea.offset = {0, 0};  // 指定渲染区域大小。定义着色器加载和存储的位置
-        renderPassInfo.renderArea.extent = swapChainExtent;  // 指定渲染区域大小
-
-        std::array<VkClearValue, 2> clearValues{};
-        clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-        clearValues[1].depthStencil = {1.0f, 0};  // depth buffering：范围0 1，1是最远距离所以设置成1
-
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();  // 定义了VK_ATTACHMENT_LOAD_OP_CLEAR的清除值，用于颜色附件加载操作
-
-        // 所有命令函数都是vkCmd前缀，返回都是void所以记录结束前不能错误处理
-        // VK_SUBPASS_CONTENTS_INLINE：render pass命令被嵌入在primary command buffer中
-        // VK_SUBPASS_CONTENTS_SECONDARY_COOMAND_BUFFERS：render pass命令从secondary command buffer中执行
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);  // 第二个参数指定图形还是计算管道
-
-            // pipeline指定了动态属性，这里进行设置
-            VkViewport viewport{};
-            viewport.x = 0.0f;
-            viewport.y = 0.0f;
-            viewport.width = (float) swapChainExtent.width;
-            viewport.height = (float) swapChainExtent.height;
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-            VkRect2D scissor{};
-            scissor.offset = {0, 0};
-            scissor.extent = swapChainExtent;
-            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-            
-            // vertex buffer：绑定顶点
-            VkBuffer vertexBuffers[] = {vertexBuffer};
-            VkDeviceSize offsets[] = {0};
-            vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    // impostor：mesh的包围球投影到屏幕上的直径低于IMPOSTOR_PIXEL_SIZE * (1 - LOD_HYSTERESIS)时换成impostor，超过IMPOSTOR_PIXEL_SIZE时换回mesh
+    // 和lod一样按整个mesh判断，有lod的mesh还要求已经在最粗的level；active的mesh的每个在视锥中的实例写一个ImpostorInstance
+    // 实例数量超过IMPOSTOR_MAX_INSTANCES时剩下的mesh这一帧继续画mesh
+    void selectImpostors(uint32_t currentImage, const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj, const glm::mat4& viewProj) {
+        m_impostorInstances.clear();
+        m_impostorPages.clear();
+        if (!useImpostors()) {
+            return;
+        }
+        float pixelsPerUnit = std::abs(proj[1][1]) * static_cast<float>(m_renderExtent.height) * 0.5f;
+        std::array<glm::vec4, 6> planes = FrustumCuller::extractPlanes(viewProj);
+        for (size_t i = 0; i < m_meshes.size(); i++) {
+            MeshImpostor& impostor = m_meshImpostors[i];
+            const MeshLodChain& lods = m_meshLods[i];
+            if (!impostor.baked || !isMeshVisible(i) || (!lods.levels.empty() && lods.current + 1 != lods.levels.size())) {
+                impostor.active = false;
+                continue;
+            }
+            const Aabb& bounds = m_meshBounds[i];
+            glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+            float radius = std::max(glm::length(bounds.max - bounds.min) * 0.5f, 1e-4f);
+            float depth = std::max(-(view * model * glm::vec4(center, 1.0f)).z, 1e-3f);
+            float diameter = 2.0f * radius / depth * pixelsPerUnit;
+            impostor.active = diameter <= IMPOSTOR_PIXEL_SIZE * (impostor.active ? 1.0f : 1.0f - LOD_HYSTERESIS);
+            if (!impostor.active) {
+                continue;
+            }
 
-            // index buffer：绑定索引，可能是uint16或32
-            vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+            size_t first = m_impostorInstances.size();
+            glm::vec4 tile = m_impostors.tileRect(impostor.tile);
+            glm::uvec4 textures(m_impostors.albedoIndex(impostor.tile.page), m_impostors.depthIndex(impostor.tile.page), m_impostors.frames(), 0);
+            for (const InstanceData& instance : m_sceneInstances) {
+                glm::mat4 localToWorld = instance.transform * model;
+                glm::vec3 worldCenter(localToWorld * glm::vec4(center, 1.0f));
+                float scale = std::max({glm::length(glm::vec3(localToWorld[0])), glm::length(glm::vec3(localToWorld[1])), glm::length(glm::vec3(localToWorld[2]))});
+                bool visible = std::all_of(planes.begin(), planes.end(), [&](const glm::vec4& plane) {
+                    return glm::dot(glm::vec3(plane), worldCenter) + plane.w >= -radius * scale;
+                });
+                if (visible) {
+                    m_impostorInstances.push_back({localToWorld, glm::vec4(center, radius), tile, textures, instance.color});
+                    m_impostorPages.push_back(impostor.tile.page);
+                }
+            }
+            if (m_impostorInstances.size() > IMPOSTOR_MAX_INSTANCES) {
+                m_impostorInstances.resize(first);
+                m_impostorPages.resize(first);
+                impostor.active = false;
+            }
+        }
+        m_impostors.writeInstances(currentImage, m_impostorInstances, m_impostorPages);
+    }
 
-            // descriptor set：绑定descriptor set到shader中实际的descriptor
-            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+    // command cache：swap chain重建后image数量可能变多，只增加不释放，command buffer随command pool一起销毁
+    // 同一个frame in flight的command buffer只在这个frame in flight中提交，等待timeline之后它们都不在使用中，可以重新录制
+    VkCommandBuffer cachedCommandBuffer(uint32_t imageIndex) {
+        size_t cacheSize = swapChainImages.size() * MAX_FRAMES_IN_FLIGHT;
+        if (m_commandCache.size() < cacheSize) {
+            std::vector<VkCommandBuffer> added(cacheSize - m_commandCache.size());
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = static_cast<uint32_t>(added.size());
+            if (vkAllocateCommandBuffers(device, &allocInfo, added.data()) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate cached command buffers!");
+            }
+            for (VkCommandBuffer commandBuffer : added) {
+                m_commandCache.push_back({commandBuffer, 0});
+            }
+        }
 
-            // instanceCount：用于实例化渲染
-            // firstVertex：顶点缓冲区的偏移量，定义gl_VertexIndex最小值
-            // firstInstance：实例化的偏移量，定义gl_InstanceIndex最小值
-            vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+        CachedCommandBuffer& cached = m_commandCache[imageIndex * MAX_FRAMES_IN_FLIGHT + currentFrame];
+        if (cached.key != commandCacheKey()) {
+            vkResetCommandBuffer(cached.commandBuffer, 0);
+            recordCommandBuffer(cached.commandBuffer, imageIndex, &cached - m_commandCache.data());
+            cached.key = commandCacheKey();  // pipeline compiler：录制时可能取出了编译好的pipeline，用录制之后的状态
+        }
+        return cached.commandBuffer;
+    }
 
-        vkCmdEndRenderPass(commandBuffer);
+    // command cache：recordCommandBuffer读取的所有可能变化的状态，ubo的内容不在其中
+    // swap chain的handle代表image view、framebuffer和extent，set 0和dynamic offset在cache模式下每个frame in flight固定
+    uint64_t commandCacheKey() {
+        uint64_t key = 0xcbf29ce484222325ull;
+        auto mix = [&key](uint64_t value) {
+            key = (key ^ value) * 0x100000001b3ull;
+        };
+        auto mixFloat = [&mix](float value) {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            mix(bits);
+        };
 
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
+        mix(reinterpret_cast<uint64_t>(swapChain));
+        mix(m_renderExtent.width);  // dynamic resolution：比例改变时transient image和viewport都变了
+        mix(m_renderExtent.height);
+        mix(reinterpret_cast<uint64_t>(graphicsPipeline));
+        mix(reinterpret_cast<uint64_t>(m_meshletPipeline));
+        mix(reinterpret_cast<uint64_t>(m_frameDescriptorSet));
+        mix(m_frameUniformOffset);
+        mix(m_wireframe);
+        if (m_drawCosts.initialized()) {
+            mix(m_frameNumber);  // draw costs：每帧重新录制，draw和query的对应关系在录制时记录
         }
-
+        mix(useDepthPrepass());
+        mix(reinterpret_cast<uint64_t>(useShadingRateAttachment() ? m_shadingRate.view() : VK_NULL_HANDLE));
+        mix(m_instanceCount);
+        mix(useGpuCulling());
+        mix(useOcclusionCulling());
+        mix(useMultiDrawIndirect());
+        mix(m_meshes.size());
+        for (size_t i = 0; i < m_meshes.size(); i++) {
+            bool visible = isMeshVisible(i);
+            mix(visible);
+            if (!visible) {
+                continue;
+            }
+            const Texture& texture = m_textureCache.get(m_meshTextures[i]);
+            mix(texture.bindlessIndex);
+            mixFloat(texture.uvScale[0]);
+            mixFloat(texture.uvScale[1]);
+            mixFloat(texture.uvOffset[0]);
+            mixFloat(texture.uvOffset[1]);
+            mix(m_meshLods[i].current);
+            mix(m_meshMeshlets[i].meshletCount);
+            mix(m_meshDoubleSided[i]);  // draw sort：影响draw的顺序
+            mix(m_meshMaterials[i]);  // materials：材质的内容在buffer中，只有编号在命令中
+            mix(m_meshImpostors[i].active);
+            mix(static_cast<uint32_t>(m_meshes[i].vertexOffset));  // skinning：蒙皮mesh每个frame in flight使用不同的顶点范围
+        }
+        mix(reinterpret_cast<uint64_t>(m_particlePipeline));  // particles：粒子数量由gpu写进indirect参数，录制的命令不变
+        mix(reinterpret_cast<uint64_t>(m_terrainPipeline));  // terrain：相机和tile表在每帧的参数buffer中，patch数量由gpu写入
+        if (m_occlusionQueries.initialized()) {
+            mix(m_occlusionQueries.key());  // occlusion queries：包围盒和predicate的位置由查询的列表决定
+        }
+        // impostor：实例写在这一帧的buffer中，录制的命令只依赖每个page的实例数量
+        mix(reinterpret_cast<uint64_t>(m_impostorPipeline));
+        if (useImpostors()) {
+            for (const ImpostorAtlas::PageDraw& draw : m_impostors.draws(currentFrame)) {
+                mix(draw.page);
+                mix(draw.count);
+            }
+        }
+        return key != 0 ? key : 1;  // 0表示还没有录制
     }
 
-    // rendering：创建同步对象。因为许多vulkan api调用是异步的，在操作完成前就返回了
-    // semaphore：用于控制同队列或不同队列之间的队列操作顺序，队列操作指提交给队列的工作
-    // 有binary和timeline两种类型semaphore。这里queue分别是graphics和presentation queue，只用binary semaphore
-    // semaphore造成的等待只会发生在gpu上，cpu需要fence
-    // fence：控制cpu上执行顺序，如果host需要知道gpu完成了什么就需要用fence。一般避免fence
-    void createSyncObjects() {
-        // frames in flight：每帧创建同步对象
-        imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    // latency mode：统计cpu领先gpu的帧数，也就是已经提交但gpu还没有完成的帧
+    // 切换帧数时先等待所有提交完成，这样所有frame in flight的command buffer、semaphore和ring都空闲，从第0帧重新开始
+    void updateFramesInFlight() {
+        uint64_t completed = m_timeline.completedValue();
+        uint32_t pending = 0;
+        for (uint32_t i = 0; i < m_framesInFlight; i++) {
+            if (m_frameSubmitNumbers[i] > completed) {
+                pending++;
+            }
+        }
+        m_cpuAheadFrames = m_cpuAheadFrames * (1 - sg_fpsAlpha) + pending * sg_fpsAlpha;
 
-        VkSemaphoreCreateInfo semaphoreInfo{};
-        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        if (m_requestedFramesInFlight == m_framesInFlight) {
+            return;
+        }
+        m_timeline.wait(m_timeline.submittedValue());
+        m_presentTimeline.wait(m_presentTimeline.submittedValue());
+        m_framesInFlight = m_requestedFramesInFlight;
+        currentFrame = 0;
+    }
 
-        VkFenceCreateInfo fenceInfo{};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;  // 这个标志是在已经发出了信号的情况才创建fence，用于避免第一帧在没有上一帧发出信号的情况下被阻塞
+    // present queue：在呈现队列上等待renderFinished，执行acquire barrier，signal presentReady和呈现队列的timeline
+    void submitPresentAcquire(uint32_t imageIndex) {
+        VkCommandBuffer commandBuffer = m_presentCommandBuffers[currentFrame];
+        vkResetCommandBuffer(commandBuffer, 0);
+        recordPresentAcquire(commandBuffer, imageIndex);
+
+        VkSemaphore waitSemaphore = renderFinishedSemaphores[currentFrame];
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        uint64_t presentValue = m_presentTimeline.nextValue();
+        VkSemaphore signalSemaphores[] = {m_presentReadySemaphores[currentFrame], m_presentTimeline.handle()};
+        uint64_t waitValues[] = {0};
+        uint64_t signalValues[] = {0, presentValue};
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+        timelineInfo.signalSemaphoreValueCount = 2;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
 
-        // 第一个semaphore用于swap chain获取图像准备渲染
-        // 第二个semaphore用于表示渲染完成可以进行present
-        // fence用于等待前一帧，避免cpu覆盖了gpu还在用的command buffer
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
-                throw std::runtime_error("failed to create synchronization objects for a frame!");
-            }
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &waitSemaphore;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        submitInfo.signalSemaphoreCount = 2;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+        if (DeviceDispatch::queueSubmit(presentQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit present acquire command buffer!");
         }
-
+        m_presentSubmitNumbers[currentFrame] = presentValue;
     }
 
-    // descriptor set layout：更新ubo
-    void updateUniformBuffer(uint32_t currentImage) {
-        static auto startTime = std::chrono::high_resolution_clock::now();  // static记录一次
+    // rendering
+    // frame arena：上一帧的临时数据已经用完，先丢掉容器的容量，再重置这个frame in flight的arena
+    void beginFrameArena() {
+        FrameArenas::release(m_drawPackets);
+        FrameArenas::release(m_visibleIndices);
+        FrameArenas::release(m_instanceWorld);
+        m_frameArenas.beginFrame(currentFrame);
+    }
 
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    // frame capture：文件名使用下一次提交的timeline值
+    void requestCapture() {
+        m_frameCapture.request(CAPTURE_PATH_PREFIX + std::to_string(m_timeline.submittedValue() + 1) + ".png");
+    }
 
-        UniformBufferObject ubo{};
-        ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));  // 使用时间来旋转而不是帧数，每秒转90度
+    // frame capture：呈现队列不同时image在场景的command buffer末尾已经release给呈现队列，device group的image只在一个设备上，这两种情况不截图
+    VkCommandBuffer recordCapture(uint32_t imageIndex) {
+        if (m_captureInterval != 0 && m_capturedFrames++ % m_captureInterval == 0) {
+            requestCapture();
+        }
+        if (!m_frameCapture.hasRequest() || !m_swapChainCapturable || m_separatePresentQueue || m_deviceGroup.active()) {
+            return VK_NULL_HANDLE;
+        }
+        return m_frameCapture.record(swapChainImages[imageIndex], swapChainImageFormat, swapChainExtent, colorTargetFinalLayout());
+    }
 
-        ubo.view = m_camera.view();
-        ubo.proj = m_camera.project();
+    // video encode：和截图一样，image已经release给呈现队列或者在device group的其它设备上时不编码
+    VkCommandBuffer recordVideoInput(uint32_t imageIndex) {
+        if (!m_videoEncoder.initialized() || !m_swapChainCapturable || m_separatePresentQueue || m_deviceGroup.active()) {
+            return VK_NULL_HANDLE;
+        }
+        return m_videoEncoder.recordInput(swapChainImages[imageIndex], swapChainImageFormat, swapChainExtent, colorTargetFinalLayout());
+    }
 
-        memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+    // late latch：ubo在持久映射的host coherent ring中，command buffer只引用slot的dynamic offset，提交之前改写的内容gpu执行时才读取
+    // 相机在acquire之前采样，acquire的阻塞和录制都会推迟它；这里重新推进模拟并按现在的时间插值，render thread时还包含主线程新处理的输入
+    // 剔除、cluster、shadow cascade和lod仍然使用这一帧开始时的相机，两次采样之间只有acquire和录制的时间，相机的移动很小
+    void latchCamera(uint32_t currentImage) {
+        if (!LATE_LATCH_CAMERA || m_benchmark.active()) {
+            return;
+        }
+        CPU_PROFILE_SCOPE("latchCamera");
+        if (!useRenderThread()) {
+            m_simulation.update();
+        }
+        SimulationState state = m_simulation.interpolated();
+        m_camera.place(state.cameraPosition, state.cameraLookAt);
+        glm::mat4 view = m_camera.view();
+        glm::mat4 viewProj = m_camera.project() * view;
+        m_uniformRing.overwrite(currentImage, m_frameUniformOffset + offsetof(UniformBufferObject, view), &view, sizeof(view));
+        m_uniformRing.overwrite(currentImage, m_frameUniformOffset + offsetof(UniformBufferObject, viewProj), &viewProj, sizeof(viewProj));
     }
 
-    // rendering
     void drawFrame() {
-        vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);  // 绘制开始前等待上一帧结束，这样command buffer和semaphor可用。避免第一帧被阻塞需要设置VK_FENCE_CREATE_SIGNALED_BIT
+        CPU_PROFILE_SCOPE("drawFrame");
+        updateFramesInFlight();
+
+        // timeline semaphore：绘制开始前等待这个frame in flight上一次提交的值，这样command buffer和semaphore可用。第一帧的值是0马上返回
+        // cpu profiler：代替之前的vkWaitForFences
+        {
+            CPU_PROFILE_SCOPE("timeline wait");
+            m_timeline.wait(m_frameSubmitNumbers[currentFrame]);
+            m_presentTimeline.wait(m_presentSubmitNumbers[currentFrame]);  // present queue：acquire的command buffer和semaphore也可以重用
+        }
+        m_gpuProfiler.collect(currentFrame);  // gpu profiler：上一次提交已经完成，timestamp可以直接读取
+        m_drawCosts.collect(currentFrame);
+        beginFrameArena();
+        bool resolutionChanged = useDynamicResolution() && m_resolution.update(m_gpuProfiler.latestMs("frame"));
+        resolutionChanged |= updateQualityTier();
+        resolutionChanged |= updateThermalGovernor();
+        if (resolutionChanged) {
+            updateRenderExtent();  // dynamic resolution：按最近完成的帧的gpu时间调整渲染分辨率
+            if (m_hiz.initialized() && m_occlusionCulling) {
+                resizeHiZPyramid();
+            }
+            if (m_shadingRate.initialized()) {
+                resizeShadingRateImage();
+            }
+        }
+        m_deletionQueue.flush(m_timeline.completedValue());  // deletion queue：队列按顺序执行，timeline的当前值之前的提交都已完成
+        m_frameCapture.collect(m_timeline.completedValue());  // frame capture：拷贝完成的截图交给job pool编码
+        if (m_videoEncoder.initialized()) {
+            m_videoEncoder.collect();  // video encode：编码完成的帧写出码流
+        }
+        m_frameDescriptors.beginFrame(currentFrame);  // descriptor allocator：这一帧上次分配的set已经不再使用
 
         // 从swap chain取图像
         // semaphore是完成使用图像时发出的同步对象，是可以开始绘制的时间点。这里也可以使用fence来同步，但现在只用semaphore
         // imageIndex输出可用的swap chain image索引，使用该索引来选择VkFrameBuffer
-        uint32_t imageIndex;
-        VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-        
-        // swap chain recreation：VK_ERROR_OUT_OF_DATE_KHR表示surface和swap chain不兼容，需要重建swap chain，一般改变window会发生
-        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-            recreateSwapChain();
-            return;
-        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {  // VK_SUBOPTIMAL_KHR：swap chain仍然可以present到surface但是surface属性不完全匹配
-            throw std::runtime_error("failed to acquire swap chain image!");
+        // headless：离屏image和frame in flight一一对应，上面的timeline等待之后就可以重用
+        uint32_t imageIndex = currentFrame;
+        VkResult result = VK_SUCCESS;
+        if (!m_headless) {
+            m_fullScreenExclusive.retry(swapChain);
+            {
+                CPU_PROFILE_SCOPE("vkAcquireNextImageKHR");
+                if (m_deviceGroup.active()) {
+                    m_deviceGroup.beginFrame();  // alternate frame rendering：这一帧在下一个设备上执行
+                    result = m_deviceGroup.acquireNextImage(swapChain, imageAvailableSemaphores[currentFrame], &imageIndex);
+                } else {
+                    result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+                }
+            }
+
+            // swap chain recreation：VK_ERROR_OUT_OF_DATE_KHR表示surface和swap chain不兼容，需要重建swap chain，一般改变window会发生
+            // full screen exclusive：失去独占时同样重建，新的swap chain重新获取独占
+            if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT) {
+                recreateSwapChain();
+                return;
+            } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {  // VK_SUBOPTIMAL_KHR：swap chain仍然可以present到surface但是surface属性不完全匹配
+                throw std::runtime_error("failed to acquire swap chain image!");
+            }
+            // multiple views：主窗口的image之后，没有空出来的image的view这一帧不绘制
+            for (std::unique_ptr<ExtraView>& view : m_extraViews) {
+                view->target.acquire(currentFrame);
+            }
         }
 
         // descriptor set layout：更新ubo
         updateUniformBuffer(currentFrame);
 
-        // swap chain recreation：确定提交时重置fence，避免在swap chain检查前重置，可能造成提前退出drawframe而command buffer未提交导致fence信号发不出来导致死锁
-        vkResetFences(device, 1, &inFlightFences[currentFrame]);  // 手动重置fence为无信号
+        // timeline semaphore：不需要重置，swap chain重建提前返回时没有分配timeline值，也就不会等待一个永远不会signal的值
 
         // 记录command buffer
-        vkResetCommandBuffer(commandBuffers[currentFrame], /*VkCommandBufferResetFlagBits*/ 0);
-        recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+        // command cache：开启时key没有变化就直接提交上次录制的command buffer
+        VkCommandBuffer commandBuffer = CACHE_COMMAND_BUFFERS ? cachedCommandBuffer(imageIndex) : commandBuffers[currentFrame];
+        if (!CACHE_COMMAND_BUFFERS) {
+            vkResetCommandBuffer(commandBuffer, /*VkCommandBufferResetFlagBits*/ 0);
+            recordCommandBuffer(commandBuffer, imageIndex, currentFrame);
+        }
+        m_submitScratch.clear();  // heap tracker：提交和present的数组复用上一帧的容量
+        std::vector<VkCommandBuffer>& viewCommandBuffers = m_submitScratch.viewCommandBuffers;
+        recordExtraViews(currentFrame, viewCommandBuffers);
 
         // 配置队列提交和同步
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};  // 指定等待semaphore
+        // async compute：第二个等待是计算队列的timeline，只阻塞读取cluster列表的片段着色器，顶点处理和之前的pass可以和compute重叠
+        VkSemaphore waitSemaphores[2] = {imageAvailableSemaphores[currentFrame]};  // 指定等待semaphore
         // 注意如果是写入attachment阶段阻塞，那么和srcSubpass默认设置有冲突，如果不改默认设置则这里要改成VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};  // 指定等待阶段，这里是写入颜色附件阶段。获得新的image再写入
-        submitInfo.waitSemaphoreCount = 1;
+        VkPipelineStageFlags waitStages[2] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};  // 指定等待阶段，这里是写入颜色附件阶段。获得新的image再写入
+        uint64_t waitValues[2] = {0};
+        uint32_t waitCount = m_headless ? 0 : 1;  // headless：没有acquire，不需要等待
+        if (m_asyncComputeValue != 0) {
+            waitSemaphores[waitCount] = m_asyncCompute.semaphore();
+            waitStages[waitCount] = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            waitValues[waitCount] = m_asyncComputeValue;
+            waitCount++;
+        }
+        submitInfo.waitSemaphoreCount = waitCount;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
 
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+        // shadow cache：有shadow命令时在场景之前执行，场景的command buffer采样它写入的shadow map
+        // ray traced shadows：acceleration structure的build在场景之前执行，TLAS最后的barrier让片段着色器读取它
+        // skinning：蒙皮在所有pass之前执行，最后的barrier让shadow和场景的vertex input读到这一帧的顶点
+        // particles：模拟和排序在场景之前执行，最后的barrier让draw读取实例和indirect参数
+        // terrain：tile上传和四叉树选择在场景之前执行，最后的barrier让draw读取高度、patch和indirect参数
+        // frame capture：截图的拷贝在场景之后执行，image从最终的layout拷贝后再回到这个layout
+        // video encode：转换成NV12同样在场景之后，编码队列的提交等待这次提交的timeline
+        VkCommandBuffer submitCommandBuffers[8];
+        uint32_t submitCommandBufferCount = 0;
+        for (VkCommandBuffer extra : {m_skinningCommands, m_particleCommands, m_terrainCommands, m_accelerationCommands, m_shadowCommands}) {
+            if (extra != VK_NULL_HANDLE) {
+                submitCommandBuffers[submitCommandBufferCount++] = extra;
+            }
+        }
+        submitCommandBuffers[submitCommandBufferCount++] = commandBuffer;
+        VkCommandBuffer captureCommands = recordCapture(imageIndex);
+        if (captureCommands != VK_NULL_HANDLE) {
+            submitCommandBuffers[submitCommandBufferCount++] = captureCommands;
+        }
+        VkCommandBuffer videoCommands = recordVideoInput(imageIndex);
+        if (videoCommands != VK_NULL_HANDLE) {
+            submitCommandBuffers[submitCommandBufferCount++] = videoCommands;
+        }
+        submitInfo.commandBufferCount = submitCommandBufferCount;
+        submitInfo.pCommandBuffers = submitCommandBuffers;
 
         // 指定command buffer完成后发出的信号
-        VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-        submitInfo.signalSemaphoreCount = 1;
+        // timeline semaphore：同时signal timeline，binary semaphore的值会被忽略
+        // headless：没有present，只signal timeline
+        uint64_t timelineValue = m_timeline.nextValue();
+        if (captureCommands != VK_NULL_HANDLE) {
+            m_frameCapture.submitted(timelineValue);
+        }
+        VkSemaphore signalSemaphores[] = {m_timeline.handle(), renderFinishedSemaphores[currentFrame]};
+        uint64_t signalValues[] = {timelineValue, 0};
+        submitInfo.signalSemaphoreCount = m_headless ? 1 : 2;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        // 提交到队列，fence会在执行完成后发出信号，这里保证安全重用command buffer
-        if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to submit draw command buffer!");
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+        timelineInfo.signalSemaphoreValueCount = submitInfo.signalSemaphoreCount;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
+        submitInfo.pNext = &timelineInfo;
+
+        // multiple views：view在同一次vkQueueSubmit的第二个batch中，只有它等待view的acquire，主窗口的绘制不等待额外的窗口
+        // timeline移到最后一个batch signal，semaphore的signal之前提交顺序中所有的命令都已经完成，包括第一个batch
+        std::vector<VkSemaphore>& viewWaitSemaphores = m_submitScratch.viewWaitSemaphores;
+        std::vector<VkPipelineStageFlags>& viewWaitStages = m_submitScratch.viewWaitStages;
+        std::vector<VkSemaphore>& viewSignalSemaphores = m_submitScratch.viewSignalSemaphores;
+        std::vector<uint64_t>& viewWaitValues = m_submitScratch.viewWaitValues;
+        std::vector<uint64_t>& viewSignalValues = m_submitScratch.viewSignalValues;
+        VkSubmitInfo viewSubmitInfo{};
+        VkTimelineSemaphoreSubmitInfo viewTimelineInfo{};
+        if (!viewCommandBuffers.empty()) {
+            for (std::unique_ptr<ExtraView>& view : m_extraViews) {
+                if (view->target.acquired()) {
+                    viewWaitSemaphores.push_back(view->target.acquireSemaphore(currentFrame));
+                    viewWaitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+                    viewSignalSemaphores.push_back(view->target.renderFinishedSemaphore());
+                }
+            }
+            viewSignalSemaphores.push_back(m_timeline.handle());
+            viewWaitValues.assign(viewWaitSemaphores.size(), 0);
+            viewSignalValues.assign(viewSignalSemaphores.size(), 0);
+            viewSignalValues.back() = timelineValue;
+
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &signalSemaphores[1];
+            timelineInfo.signalSemaphoreValueCount = 1;
+            timelineInfo.pSignalSemaphoreValues = &signalValues[1];
+
+            viewSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            viewSubmitInfo.waitSemaphoreCount = static_cast<uint32_t>(viewWaitSemaphores.size());
+            viewSubmitInfo.pWaitSemaphores = viewWaitSemaphores.data();
+            viewSubmitInfo.pWaitDstStageMask = viewWaitStages.data();
+            viewSubmitInfo.commandBufferCount = static_cast<uint32_t>(viewCommandBuffers.size());
+            viewSubmitInfo.pCommandBuffers = viewCommandBuffers.data();
+            viewSubmitInfo.signalSemaphoreCount = static_cast<uint32_t>(viewSignalSemaphores.size());
+            viewSubmitInfo.pSignalSemaphores = viewSignalSemaphores.data();
+            viewTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            viewTimelineInfo.waitSemaphoreValueCount = viewSubmitInfo.waitSemaphoreCount;
+            viewTimelineInfo.pWaitSemaphoreValues = viewWaitValues.data();
+            viewTimelineInfo.signalSemaphoreValueCount = viewSubmitInfo.signalSemaphoreCount;
+            viewTimelineInfo.pSignalSemaphoreValues = viewSignalValues.data();
+            viewSubmitInfo.pNext = &viewTimelineInfo;
+        }
+        VkSubmitInfo submitInfos[] = {submitInfo, viewSubmitInfo};
+        latchCamera(currentFrame);
+
+        // 提交到队列，timeline到达timelineValue后可以安全重用command buffer
+        {
+            CPU_PROFILE_SCOPE("vkQueueSubmit");
+            if (m_deviceGroup.active()) {
+                // device group：command buffer只在这一帧的设备上执行，timeline由追加的batch按顺序signal；没有async compute，只等待acquire
+                submitInfo.pNext = nullptr;
+                submitInfo.signalSemaphoreCount = 1;
+                submitInfo.pSignalSemaphores = &renderFinishedSemaphores[currentFrame];
+                m_deviceGroup.submit(graphicsQueue, submitInfo, m_deviceGroup.frameDeviceMask(), m_timeline, timelineValue);
+            } else if (DeviceDispatch::queueSubmit(graphicsQueue, viewCommandBuffers.empty() ? 1 : 2, submitInfos, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit draw command buffer!");
+            }
+        }
+        m_frameSubmitNumbers[currentFrame] = m_frameNumber = timelineValue;
+        if (videoCommands != VK_NULL_HANDLE) {
+            m_videoEncoder.submit(m_timeline.handle(), timelineValue);
+        }
+
+        if (m_headless) {
+            m_lastImageIndex = imageIndex;
+            m_headlessFrames++;
+            currentFrame = (currentFrame + 1) % m_framesInFlight;
+            HostMemoryTracker::instance().endFrame();
+            return;
+        }
+
+        // present queue：呈现队列先acquire image的所有权，present等待acquire完成
+        VkSemaphore presentWaitSemaphore = renderFinishedSemaphores[currentFrame];
+        if (m_separatePresentQueue) {
+            submitPresentAcquire(imageIndex);
+            presentWaitSemaphore = m_presentReadySemaphores[currentFrame];
         }
 
         // presentation，渲染完成后将结果提交回swap chain并present上屏幕
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = signalSemaphores;  // 等待的信号量，这里等待command buffer完成
+        // multiple views：这一帧绘制的view和主窗口一起present，第一个总是主窗口，每个swap chain的结果在presentResults中
+        std::vector<VkSemaphore>& presentWaitSemaphores = m_submitScratch.presentWaitSemaphores;
+        std::vector<VkSwapchainKHR>& swapChains = m_submitScratch.swapChains;
+        std::vector<uint32_t>& imageIndices = m_submitScratch.imageIndices;
+        presentWaitSemaphores.push_back(presentWaitSemaphore);
+        swapChains.push_back(swapChain);
+        imageIndices.push_back(imageIndex);
+        for (std::unique_ptr<ExtraView>& view : m_extraViews) {
+            if (view->target.acquired()) {
+                presentWaitSemaphores.push_back(view->target.renderFinishedSemaphore());
+                swapChains.push_back(view->target.swapchain());
+                imageIndices.push_back(view->target.imageIndex());
+            }
+        }
+        std::vector<VkResult>& presentResults = m_submitScratch.presentResults;
+        presentResults.assign(swapChains.size(), VK_SUCCESS);
+
+        presentInfo.waitSemaphoreCount = static_cast<uint32_t>(presentWaitSemaphores.size());
+        presentInfo.pWaitSemaphores = presentWaitSemaphores.data();  // 等待的信号量，这里等待command buffer完成
 
-        VkSwapchainKHR swapChains[] = {swapChain};
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = swapChains;  // 指定图像传输的swap chain
+        presentInfo.swapchainCount = static_cast<uint32_t>(swapChains.size());
+        presentInfo.pSwapchains = swapChains.data();  // 指定图像传输的swap chain
 
-        presentInfo.pImageIndices = &imageIndex;  // 传输的swap chain image索引
+        presentInfo.pImageIndices = imageIndices.data();  // 传输的swap chain image索引
+        presentInfo.pResults = presentResults.data();
+        if (m_framePacer.initialized()) {
+            presentInfo.pNext = m_framePacer.nextPresentId(presentInfo.swapchainCount);  // frame pacing：关闭低延迟模式时也分配id，打开时马上可以等待
+        }
+        if (m_deviceGroup.active()) {
+            m_deviceGroup.chainPresentInfo(presentInfo);
+        }
 
-        result = vkQueuePresentKHR(presentQueue, &presentInfo);  // 向swapchain提交present图像请求
+        {
+            CPU_PROFILE_SCOPE("vkQueuePresentKHR");
+            result = DeviceDispatch::queuePresentKHR(presentQueue, &presentInfo);  // 向swapchain提交present图像请求
+        }
+        if (m_framePacer.initialized()) {
+            m_framePacer.presented();
+        }
+        // input latency：present时gpu还没有完成的帧（包括这一帧）也是排队的一部分
+        m_inputLatency.presented(m_framePacer.initialized() ? m_framePacer.presentedId() : 0, static_cast<uint32_t>(swapChainImages.size()), m_framesInFlight,
+            static_cast<uint32_t>(m_frameNumber - m_timeline.completedValue()));
+        if (swapChains.size() > 1) {
+            for (size_t i = 1, view = 0; i < swapChains.size(); view++) {
+                if (m_extraViews[view]->target.acquired()) {
+                    m_extraViews[view]->target.presented(presentResults[i++]);
+                }
+            }
+            result = presentResults[0];
+        }
+        if (!m_retiredSwapChains.empty()) {
+            retireOldSwapChains(timelineValue);
+        }
 
         // swap chain recreation：这里如果swap chain属性不完全符合surface也要重建
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
-            framebufferResized = false;
+        // live resize：拖动中旧的swap chain仍然可以present（SUBOPTIMAL），等大小settle之后再重建；OUT_OF_DATE时不能再使用，马上重建
+        bool resizeSettled = m_resizeCoalescer.settled(LIVE_RESIZE ? RESIZE_SETTLE_TIME : 0.0f);
+        bool resizeInProgress = LIVE_RESIZE && m_resizeCoalescer.pending() && !resizeSettled;
+        bool exclusiveLost = result == VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT;
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || exclusiveLost || (result == VK_SUBOPTIMAL_KHR && !resizeInProgress) || resizeSettled || m_presentPolicyChanged) {
+            m_presentPolicyChanged = false;
             recreateSwapChain();
         } else if (result != VK_SUCCESS) {
             throw std::runtime_error("failed to present swap chain image!");
         }
 
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;  // frames in flight：切换资源
+        currentFrame = (currentFrame + 1) % m_framesInFlight;  // frames in flight：切换资源
+        HostMemoryTracker::instance().endFrame();  // host arena：这一帧驱动的分配次数
     }
 
 
     // shader module：把shader代码包装进VkShaderModule
-    VkShaderModule createShaderModule(const std::vector<char>& code) {
+    VkShaderModule createShaderModule(const SpirvCode& code) {
         VkShaderModuleCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = code.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());  // 字节码指针式uint32_t所以要转换
+        createInfo.codeSize = code.size;
+        createInfo.pCode = code.words;  // shader registry：嵌入的SPIR-V本身就是uint32_t数组，不需要转换
 
         VkShaderModule shaderModule;
-        if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+        if (vkCreateShaderModule(device, &createInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
             throw std::runtime_error("failed to create shader module!");
         }
 
@@ -1780,22 +10387,12 @@ private:
         return availableFormats[0];
     }
 
-    // swapchain：寻找最佳presentation mode配置。包含四种模式
+    // swapchain：presentation mode包含四种模式，present policy：choosePresentMode按m_presentPolicy选择，不支持时回退
     // 补充：显示器刷新时有一段时间需要重置状态，产生垂直空白vertical blank
     // VK_PRESENT_MODE_IMMEDIATE_KHR：应用程序提交的图像立刻上屏，可能导致画面撕裂
     // VK_PRESENT_MODE_FIFO_KHR：swapchain是队列，显示器刷新时，也就是垂直空白时，从中取图像，如果队列满了则应用程序需要等待，类似垂直同步
     // VK_PRESENT_MODE_FIFO_RELAXED_KHR：和上一个模式一样，除了在应用程序有延迟并且最后一次垂直空白时队列为空，图像不是等待下一个垂直空白而是立即传输，可能画面撕裂
     // VK_PRESENT_MODE_MAILBOX_KHR：三重缓冲，第二种模式变体，队列满时不阻塞程序，而是将队列中图像替换成最新图像
-    VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) {
-        // 尽量选择三重缓冲
-        for (const auto& availablePresentMode : availablePresentModes) {
-            if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return availablePresentMode;
-            }
-        }
-
-        return VK_PRESENT_MODE_FIFO_KHR;
-    }
 
     // swapchain：寻找最佳surface基本能力，extent主要是配置image的分辨率
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
@@ -1803,7 +10400,7 @@ private:
             return capabilities.currentExtent;  // 一般分辨率等于window分辨率，直接返回
         } else {  // 有些window管理器返回最大值，表示在minImageExtent和maxImageExtent之间选择和窗口最匹配分辨率
             int width, height;
-            glfwGetFramebufferSize(window, &width, &height);  // 查询window分辨率
+            getFramebufferSize(width, height);  // 查询window分辨率
 
             VkExtent2D actualExtent = {
                 static_cast<uint32_t>(width),
@@ -1846,13 +10443,19 @@ private:
     }
 
     bool isDeviceSuitable(VkPhysicalDevice device) {
+        return deviceRejectReason(device) == nullptr;
+    }
+
+    // device selection：返回第一个不满足的要求，输出到log；全部满足时返回nullptr
+    const char* deviceRejectReason(VkPhysicalDevice device) {
         QueueFamilyIndices indices = findQueueFamilies(device);
+        DeviceCapabilities capabilities = DeviceCapabilities::probe(device);
 
         // swapchain：检查设备extension支持，这里主要要检查swapchain是否支持
         bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-        bool swapChainAdequate = false;
-        if (extensionsSupported) {
+        bool swapChainAdequate = m_headless;  // headless：没有surface，不检查swap chain
+        if (extensionsSupported && !m_headless) {
             SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
             // swapchain：只需要用到一种surface格式以及presentation mode
             swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -1862,7 +10465,48 @@ private:
         VkPhysicalDeviceFeatures supportedFeatures;
         vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-        return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+        if (!indices.isComplete()) {
+            return "no graphics or present queue";
+        }
+        if (!extensionsSupported) {
+            return "missing required extensions";
+        }
+        if (!swapChainAdequate) {
+            return "no swap chain format or present mode";
+        }
+        if (!supportedFeatures.samplerAnisotropy) {
+            return "no sampler anisotropy";
+        }
+        if (!capabilities.descriptorIndexing) {
+            return "no descriptor indexing for bindless textures";
+        }
+        if (!capabilities.timelineSemaphore) {
+            return "no timeline semaphore";
+        }
+        if (!capabilities.shaderDrawParameters) {
+            return "no shader draw parameters";
+        }
+        return nullptr;
+    }
+
+    // device selection：程序会使用的可选扩展，支持得越多打分越高
+    static std::vector<const char*> optionalDeviceExtensions() {
+        return {VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME, VK_EXT_SHADER_OBJECT_EXTENSION_NAME,
+            VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME,
+            VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+            VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME, VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, VK_KHR_RAY_QUERY_EXTENSION_NAME};
+    }
+
+    // bindless：纹理数组需要descriptor indexing（vulkan 1.2核心，之前是VK_EXT_descriptor_indexing）的这些feature
+    VkPhysicalDeviceDescriptorIndexingFeatures bindlessFeatures() {
+        VkPhysicalDeviceDescriptorIndexingFeatures features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        features.runtimeDescriptorArray = VK_TRUE;  // shader中不指定大小的数组
+        features.descriptorBindingPartiallyBound = VK_TRUE;  // 没有写入的元素只要不被访问就合法
+        features.descriptorBindingVariableDescriptorCount = VK_TRUE;
+        features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;  // 绑定后仍然可以写入
+        features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;  // in flight时写入没有被使用的元素
+        return features;
     }
 
     // swapchain：检查设备是否支持所有extension
@@ -1873,7 +10517,8 @@ private:
         std::vector<VkExtensionProperties> availableExtensions(extensionCount);
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-        std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
+        std::vector<const char*> extensions = requiredDeviceExtensions();
+        std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
         // 查询设备是否有所有extension
         for (const auto& extension : availableExtensions) {
@@ -1883,6 +10528,33 @@ private:
         return requiredExtensions.empty();
     }
 
+    // headless：不需要swapchain扩展，没有显示输出的设备也可以使用
+    std::vector<const char*> requiredDeviceExtensions() const {
+        std::vector<const char*> extensions;
+        for (const char* extension : deviceExtensions) {
+            if (!m_headless || strcmp(extension, VK_KHR_SWAPCHAIN_EXTENSION_NAME) != 0) {
+                extensions.push_back(extension);
+            }
+        }
+        return extensions;
+    }
+
+    // 检查设备是否支持单个可选extension
+    bool isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions) {
+            if (strcmp(extension.extensionName, extensionName) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     // 物理设备：检查设备提供的queuefamily
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
         QueueFamilyIndices indices;
@@ -1893,36 +10565,67 @@ private:
         std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
         vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
+        std::optional<uint32_t> graphicsAndPresentFamily;
         int i = 0;
         for (const auto& queueFamily : queueFamilies) {
-            if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {  // 检查queuefamily是否支持图形功能
+            if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value()) {  // 检查queuefamily是否支持图形功能
                 indices.graphicsFamily = i;
             }
 
             // 窗口表面：检查queuefamily是否支持呈现功能
             VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            if (!m_headless) {
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+            }
 
-            if (presentSupport) {
+            if (presentSupport && !indices.presentFamily.has_value()) {
                 indices.presentFamily = i;
             }
+            if (presentSupport && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !graphicsAndPresentFamily.has_value()) {
+                graphicsAndPresentFamily = i;
+            }
 
-            if (indices.isComplete()) {
-                break;
+            // transfer queue：只支持传输而不支持图形和计算的queue family，所以需要遍历所有queue family而不是找到图形队列就停止
+            bool transferOnly = (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+            if (transferOnly && !indices.transferFamily.has_value()) {
+                indices.transferFamily = i;
+            }
+
+            // async compute：和transfer queue一样需要遍历所有queue family，只有不支持图形的family才是独立的硬件队列
+            bool computeOnly = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+            if (computeOnly && !indices.computeFamily.has_value()) {
+                indices.computeFamily = i;
             }
 
             i++;
         }
 
+        // present queue：优先选同时支持图形和呈现的queue family，这样swap chain image不需要在两个queue family之间转移所有权
+        if (graphicsAndPresentFamily.has_value()) {
+            indices.graphicsFamily = graphicsAndPresentFamily;
+            indices.presentFamily = graphicsAndPresentFamily;
+        }
+        // headless：不present，presentFamily只是让isComplete和各处的队列创建逻辑保持不变
+        if (m_headless) {
+            indices.presentFamily = indices.graphicsFamily;
+        }
+
         return indices;
     }
 
     std::vector<const char*> getRequiredExtensions() {
         uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);  // vulkan对于平台没有api支持，需要添加扩展，使用glfw函数返回扩展信息
+        const char** glfwExtensions = nullptr;
+        if (hasWindow()) {  // headless：不创建surface，不需要窗口系统的扩展
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);  // vulkan对于平台没有api支持，需要添加扩展，使用glfw函数返回扩展信息
+        }
 
         std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        // display mode：direct的surface来自VK_KHR_display，不需要窗口系统的扩展
+        if (!m_headless && m_displayMode == DisplayMode::direct) {
+            extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+            extensions.push_back(VK_KHR_DISPLAY_EXTENSION_NAME);
+        }
 
         // 验证层：应用接受验证层debug信息需要使用回调，需要开启扩展
         // 验证层需要链接libVkLayer_khronos_validation.dylib
@@ -1935,8 +10638,36 @@ private:
         extensions.emplace_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
 #endif
 
+        // live resize：查询present scaling的能力需要这两个instance扩展，没有时拖动中不设置scaling
+        // display mode：full screen exclusive也需要VK_KHR_get_surface_capabilities2
+        bool surfaceCapabilities2 = !m_headless && isInstanceExtensionSupported(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+        m_surfaceMaintenanceSupported = LIVE_RESIZE && surfaceCapabilities2 && isInstanceExtensionSupported(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+        m_surfaceCapabilities2 = surfaceCapabilities2 && (m_surfaceMaintenanceSupported || m_displayMode == DisplayMode::fullscreen);
+        if (m_surfaceCapabilities2) {
+            extensions.push_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+        }
+        if (m_surfaceMaintenanceSupported) {
+            extensions.push_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+        }
+
         return extensions;
     }
+
+    // live resize：检查instance是否支持单个可选extension
+    bool isInstanceExtensionSupported(const char* extensionName) {
+        uint32_t extensionCount;
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions.data());
+
+        for (const auto& extension : availableExtensions) {
+            if (strcmp(extension.extensionName, extensionName) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
         
     // 验证层：检查验证层是否可用，先获取数量再获取可用layer
     bool checkValidationLayerSupport() {
@@ -1963,38 +10694,49 @@ private:
 
         return true;
     }
-
-    // shader module：读取spriv文件
-    static std::vector<char> readFile(const std::string& filename) {
-        // ate：从文件末端读取，好处是可以使用读取位置确定文件大小并分配缓冲
-        // binary：作为二进制读取，避免文本转换
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-        if (!file.is_open()) {
-            throw std::runtime_error("failed to open file!");
-        }
-
-        size_t fileSize = (size_t) file.tellg();  // tellg返回当前指针位置，因为ate所以返回了文件大小
-        std::vector<char> buffer(fileSize);
-
-        file.seekg(0);  // 从0开始读取
-        file.read(buffer.data(), fileSize);
-
-        file.close();
-
-        return buffer;
-    }
-
-    // 验证层：VKAPI_ATTR和VKAPI_CALL用于确保函数具有正确签名，让vulkan能正确调用
-    static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
-        std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
-
-        return VK_FALSE;
-    }
 };
 
-int main() {
+int main(int argc, char** argv) {
     HelloTriangleApplication app;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--benchmark") {
+            app.enableBenchmark();
+        } else if (argument == "--headless") {
+            app.enableHeadless();
+        } else if (argument == "--warmup") {
+            app.enableWarmup();
+        } else if (argument == "--heap-check") {
+            app.enableHeapCheck();
+        } else if (argument == "--shader-stats") {
+            app.enableShaderStatistics();
+        } else if (argument == "--draw-costs") {
+            app.enableDrawCosts();
+        } else if (argument == "--fullscreen") {
+            app.setDisplayMode(DisplayMode::fullscreen);
+        } else if (argument == "--direct") {
+            app.setDisplayMode(DisplayMode::direct);
+        } else if (argument == "--regression" || argument == "--update-baseline") {
+            app.enableRegression(argument == "--update-baseline");
+        } else if (argument == "--scene" && i + 1 < argc) {
+            app.setScene(argv[++i]);
+        } else if (argument == "--world" && i + 1 < argc) {
+            app.setWorld(argv[++i]);
+        } else if (argument == "--stress" && i + 1 < argc) {
+            if (!app.setStressScene(argv[++i])) {
+                std::cerr << "invalid --stress parameters: " << argv[i] << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (argument == "--encode" && i + 1 < argc) {
+            app.setVideoEncodeOutput(argv[++i]);
+        } else if (argument == "--telemetry" && i + 1 < argc) {
+            app.setTelemetryTarget(argv[++i]);
+        } else if (argument == "--record-stream" && i + 1 < argc) {
+            app.setStreamCapture(argv[++i]);
+        } else if (argument == "--capture" && i + 1 < argc) {
+            app.setCaptureInterval(static_cast<uint32_t>(std::stoul(argv[++i])));
+        }
+    }
 
     try {
         app.run();
@@ -2003,5 +10745,5 @@ int main() {
         return EXIT_FAILURE;
     }
 
-    return EXIT_SUCCESS;
+    return app.exitCode();
 }
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <streambuf>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// mapped file：只读的文件映射，posix上使用mmap，windows上使用MapViewOfFile，页面在第一次访问时才从磁盘读入
+// 资源文件（mesh cache、obj、gltf、纹理）都通过它读取，解析和解码直接读取映射的内存，不再先复制到堆上的buffer
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept : m_data(other.m_data), m_size(other.m_size) {
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            m_data = other.m_data;
+            m_size = other.m_size;
+            other.m_data = nullptr;
+            other.m_size = 0;
+        }
+        return *this;
+    }
+    ~MappedFile() { close(); }
+
+    // mapped file：文件不存在或为空时返回false
+    bool open(const std::string& path) {
+        close();
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // 映射建立后可以关闭fd
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        m_data = static_cast<const char*>(mapped);
+        m_size = static_cast<size_t>(info.st_size);
+        madvise(mapped, m_size, MADV_SEQUENTIAL);  // 顺序读取，允许内核预读
+#else
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);  // mapping对象保持文件打开
+        if (mapping == nullptr) {
+            return false;
+        }
+        void* mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);  // view保持mapping对象
+        if (mapped == nullptr) {
+            return false;
+        }
+        m_data = static_cast<const char*>(mapped);
+        m_size = static_cast<size_t>(size.QuadPart);
+#endif
+        return true;
+    }
+
+    void close() {
+        if (m_data) {
+#ifndef _WIN32
+            munmap(const_cast<char*>(m_data), m_size);
+#else
+            UnmapViewOfFile(m_data);
+#endif
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    std::span<const char> view() const { return {m_data, m_size}; }
+
+    // mapped file：让内核开始异步读入整个文件，马上返回；一批文件都先prefetch，读取和前面文件的处理重叠
+    void prefetch() const {
+        if (!m_data) {
+            return;
+        }
+#ifndef _WIN32
+        madvise(const_cast<char*>(m_data), m_size, MADV_WILLNEED);
+#else
+        WIN32_MEMORY_RANGE_ENTRY range{const_cast<char*>(m_data), m_size};
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+    }
+
+    // obj stream：顺序读过的范围交还给内核，常驻内存不随文件大小增长，之后再访问会重新从磁盘读入；只处理范围内完整的页面
+    // windows上映射的页面由系统按working set回收，什么也不做
+    void discard(size_t offset, size_t size) {
+#ifndef _WIN32
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t begin = (offset + page - 1) / page * page;
+        size_t end = std::min(offset + size, m_size) / page * page;
+        if (end > begin) {
+            madvise(const_cast<char*>(m_data) + begin, end - begin, MADV_DONTNEED);
+        }
+#else
+        (void)offset;
+        (void)size;
+#endif
+    }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// mapped file：一段只读的文件内容，来自映射的文件、一直映射着的asset pack或者拥有的内存（异步读取的结果、gltf中嵌入的图片）
+// 移动之后数据的地址不变，持有者可以放进vector
+class FileBytes {
+public:
+    FileBytes() = default;
+    explicit FileBytes(MappedFile mapped) : m_mapped(std::move(mapped)), m_view(m_mapped.view()) {}
+    explicit FileBytes(std::vector<char> owned) : m_owned(std::move(owned)), m_view(m_owned.data(), m_owned.size()) {}
+
+    // mapped file：不拥有的内存，调用者保证它比FileBytes活得久，比如asset pack
+    static FileBytes borrow(const char* data, size_t size) {
+        FileBytes bytes;
+        bytes.m_view = {data, size};
+        return bytes;
+    }
+
+    const char* data() const { return m_view.data(); }
+    size_t size() const { return m_view.size(); }
+    bool empty() const { return m_view.empty(); }
+    std::span<const char> view() const { return m_view; }
+
+private:
+    MappedFile m_mapped;
+    std::vector<char> m_owned;
+    std::span<const char> m_view;
+};
+
+// mapped file：只读的std::streambuf，让只接受istream的解析器（tinyobj）直接读取映射的内存
+class MemoryStreamBuf : public std::streambuf {
+public:
+    explicit MemoryStreamBuf(std::span<const char> bytes) {
+        char* begin = const_cast<char*>(bytes.data());
+        setg(begin, begin, begin + bytes.size());
+    }
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "texture_cache.hpp"
+
+// materials：之前材质是隐含的，每个mesh只有一张纹理，gltf的baseColorFactor没有使用
+// 材质的描述是纹理和标量参数，相同描述的mesh共用一个材质编号；doubleSided决定面剔除，仍然是raster state，不在shader中使用
+struct MaterialDesc {
+    TextureHandle texture = 0;
+    glm::vec4 baseColorFactor = glm::vec4(1.0f);
+    bool doubleSided = false;
+
+    bool operator==(const MaterialDesc& other) const {
+        return texture == other.texture && baseColorFactor == other.baseColorFactor && doubleSided == other.doubleSided;
+    }
+};
+
+// materials：gpu上的材质，布局和shader中的Material一致（std430，数组元素按16字节对齐）
+// 纹理在bindless数组中的index和atlas中的区域每帧从纹理解析，纹理替换（streaming、atlas）之后材质跟着更新
+struct GpuMaterial {
+    glm::vec4 baseColorFactor;
+    glm::vec2 uvScale;
+    glm::vec2 uvOffset;
+    uint32_t baseColorTexture;
+    uint32_t padding[3];
+};
+static_assert(sizeof(GpuMaterial) == 48, "GpuMaterial must match the std430 Material array stride");
+
+// materials：所有材质放在一个storage buffer中，set 0的binding 7一次绑定，片段着色器按scene object或push constant中的材质编号读取
+// 纹理的选择不再是draw之间的状态，不透明的场景只按pipeline和raster state分成multi draw，和材质数量无关
+// 和scene objects一样每个frame in flight一份持久映射的buffer；每帧解析所有材质，只写入和这一帧上次写入的内容不同的元素
+// 材质按引用计数共用，计数为0的编号放进空闲列表，调用者保证释放时gpu已经完成使用它的帧
+class MaterialTable {
+public:
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, uint32_t capacity, uint32_t frameCount, VkBufferUsageFlags extraUsage) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_capacity = capacity;
+
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = range();
+            bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | extraUsage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &frame.buffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create material buffer!");
+            }
+
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(m_device, frame.buffer, &memRequirements);
+            frame.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true,
+                MemoryCategory::other, 0, "materials");
+            vkBindBufferMemory(m_device, frame.buffer, frame.allocation.memory, frame.allocation.offset);
+            frame.written.reserve(capacity);
+        }
+        m_entries.reserve(capacity);
+    }
+
+    void cleanup() {
+        for (Frame& frame : m_frames) {
+            vkDestroyBuffer(m_device, frame.buffer, hostAllocator());
+            m_allocator->free(frame.allocation);
+        }
+        m_frames.clear();
+        m_entries.clear();
+        m_freeIds.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // materials：相同描述的材质已经存在时增加引用计数，否则分配新的编号；材质数量在加载时才变化，线性查找
+    uint32_t acquire(const MaterialDesc& desc) {
+        for (uint32_t id = 0; id < m_entries.size(); id++) {
+            if (m_entries[id].references > 0 && m_entries[id].desc == desc) {
+                m_entries[id].references++;
+                return id;
+            }
+        }
+        uint32_t id;
+        if (!m_freeIds.empty()) {
+            id = m_freeIds.back();
+            m_freeIds.pop_back();
+        } else {
+            if (m_entries.size() >= m_capacity) {
+                throw std::runtime_error("material table is full!");
+            }
+            id = static_cast<uint32_t>(m_entries.size());
+            m_entries.emplace_back();
+        }
+        m_entries[id] = {desc, 1};
+        return id;
+    }
+
+    void release(uint32_t id) {
+        if (--m_entries[id].references == 0) {
+            m_freeIds.push_back(id);
+        }
+    }
+
+    const MaterialDesc& desc(uint32_t id) const { return m_entries[id].desc; }
+
+    // materials：resolve把描述转换成GpuMaterial；调用者需要保证gpu已经完成上次使用这一帧的命令
+    template <typename Resolve>
+    void write(uint32_t frameIndex, Resolve&& resolve) {
+        Frame& frame = m_frames[frameIndex];
+        GpuMaterial* mapped = static_cast<GpuMaterial*>(frame.allocation.mapped);
+        if (frame.written.size() < m_entries.size()) {
+            frame.written.resize(m_entries.size(), GpuMaterial{});
+            frame.valid.resize(m_entries.size(), false);
+        }
+        for (uint32_t id = 0; id < m_entries.size(); id++) {
+            if (m_entries[id].references == 0) {
+                continue;
+            }
+            GpuMaterial material = resolve(m_entries[id].desc);
+            if (frame.valid[id] && memcmp(&material, &frame.written[id], sizeof(material)) == 0) {
+                continue;
+            }
+            memcpy(mapped + id, &material, sizeof(material));
+            frame.written[id] = material;
+            frame.valid[id] = true;
+        }
+    }
+
+    VkBuffer buffer(uint32_t frameIndex) const { return m_frames[frameIndex].buffer; }
+    VkDeviceSize range() const { return VkDeviceSize(sizeof(GpuMaterial)) * m_capacity; }
+
+private:
+    struct Entry {
+        MaterialDesc desc;
+        uint32_t references = 0;
+    };
+
+    struct Frame {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+        std::vector<GpuMaterial> written;  // 这一帧的buffer中每个元素的内容
+        std::vector<bool> valid;
+    };
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_capacity = 0;
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_freeIds;
+    std::vector<Frame> m_frames;
+};
@@ -0,0 +1,552 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_memory.hpp"
+
+// memory allocator：vkAllocateMemory次数受maxMemoryAllocationCount限制（很多设备只有4096），并且每次分配驱动开销很大
+// 所以按内存类型建立pool，每个pool一次申请一大块VkDeviceMemory（block），buffer和image从block中按offset/size切分
+
+struct MemoryBlock;
+
+// memory budget：按用途统计分配的字节数，用于判断显存被什么占用
+enum class MemoryCategory : uint32_t {
+    geometry,
+    texture,
+    attachment,
+    staging,
+    uniform,
+    other,
+    count
+};
+
+inline const char* memoryCategoryName(MemoryCategory category) {
+    switch (category) {
+        case MemoryCategory::geometry: return "geometry";
+        case MemoryCategory::texture: return "texture";
+        case MemoryCategory::attachment: return "attachment";
+        case MemoryCategory::staging: return "staging";
+        case MemoryCategory::uniform: return "uniform";
+        default: return "other";
+    }
+}
+
+// memory budget：一个内存堆的预算和使用量
+// budget和usage来自VK_EXT_memory_budget，包括其它进程和驱动内部的使用，不支持扩展时usage只有本进程申请的block
+struct HeapBudget {
+    VkDeviceSize budget = 0;
+    VkDeviceSize usage = 0;
+    VkDeviceSize blockBytes = 0;  // 本进程从这个堆申请的VkDeviceMemory总大小
+    VkDeviceSize allocatedBytes = 0;  // 其中实际被子分配使用的字节数
+    VkMemoryHeapFlags flags = 0;
+};
+
+struct MemoryStats {
+    uint32_t heapCount = 0;
+    std::array<HeapBudget, VK_MAX_MEMORY_HEAPS> heaps{};
+    std::array<VkDeviceSize, static_cast<size_t>(MemoryCategory::count)> categoryBytes{};
+    std::array<VkDeviceSize, static_cast<size_t>(MemoryCategory::count)> categoryPeakBytes{};  // memory report：启动以来的最高值
+    uint32_t deviceAllocationCount = 0;
+    VkDeviceSize allocatedBytes = 0;  // 所有堆子分配的字节数
+    VkDeviceSize peakAllocatedBytes = 0;  // regression：启动以来的最高值
+    bool budgetExtension = false;  // false表示budget是估算值
+
+    // memory budget：所有device local堆的预算和使用量之和
+    VkDeviceSize deviceLocalBudget() const { return sumDeviceLocal(&HeapBudget::budget); }
+    VkDeviceSize deviceLocalUsage() const { return sumDeviceLocal(&HeapBudget::usage); }
+
+private:
+    VkDeviceSize sumDeviceLocal(VkDeviceSize HeapBudget::*field) const {
+        VkDeviceSize total = 0;
+        for (uint32_t i = 0; i < heapCount; i++) {
+            if (heaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                total += heaps[i].*field;
+            }
+        }
+        return total;
+    }
+};
+
+// memory allocator：一次子分配的结果，buffer/image绑定时使用memory和offset
+struct Allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;  // host visible的block会持久映射，这里是已经加上offset的地址，不需要再调用vkMapMemory
+    uint32_t memoryTypeIndex = 0;
+    MemoryCategory category = MemoryCategory::other;
+    const char* name = nullptr;  // memory report：资源名，必须是字符串字面量
+    MemoryBlock* block = nullptr;
+};
+
+// memory report：同名资源的当前字节数、峰值和数量
+struct NamedMemoryUsage {
+    VkDeviceSize bytes = 0;
+    VkDeviceSize peakBytes = 0;
+    uint32_t count = 0;
+};
+
+// memory allocator：block内的空闲区间，按offset排序便于释放时合并相邻区间
+struct FreeRange {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+struct MemoryBlock {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    void* mapped = nullptr;
+    std::vector<FreeRange> freeRanges;
+    uint32_t allocationCount = 0;
+    uint32_t poolIndex = 0;
+    uint32_t memoryTypeIndex = 0;
+    bool dedicated = false;  // 大资源单独占用一个block，释放后直接还给驱动
+};
+
+class DeviceMemoryAllocator {
+public:
+    static constexpr VkDeviceSize k_defaultBlockSize = 64ull * 1024 * 1024;
+
+    // memoryBudgetSupported：设备开启了VK_EXT_memory_budget
+    // descriptor buffer：bufferDeviceAddress为true时所有block都带DEVICE_ADDRESS标志，block中的buffer都可以查询device address
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudgetSupported, bool bufferDeviceAddress = false) {
+        m_physicalDevice = physicalDevice;
+        m_device = device;
+        m_bufferDeviceAddress = bufferDeviceAddress;
+
+        // 内存类型不会在运行时改变，只查询一次，避免每次分配都调用vkGetPhysicalDeviceMemoryProperties
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memProperties);
+
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+        m_stats.heapCount = m_memProperties.memoryHeapCount;
+        m_stats.budgetExtension = memoryBudgetSupported;
+        for (uint32_t i = 0; i < m_memProperties.memoryHeapCount; i++) {
+            m_stats.heaps[i].flags = m_memProperties.memoryHeaps[i].flags;
+        }
+        updateBudget();
+    }
+
+    void cleanup() {
+        for (auto& pool : m_pools) {
+            for (auto& block : pool) {
+                destroyBlock(*block);
+            }
+            pool.clear();
+        }
+        m_evacuating = nullptr;
+    }
+
+    // memory allocator：根据缓冲区需求typeFilter以及自己的需求porperties来找到合适的内存类型
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+        // 迭代内存类型，typeFilter表示适合的内存类型，和i进行and判断排除不适用的内存类型，然后查看当前内存类型的属性是否符合properties指定的属性
+        for (uint32_t i = 0; i < m_memProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (m_memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return i;
+            }
+        }
+
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    // zero staging：优先选择还满足preferred的内存类型，没有则回退到只满足required的类型
+    // ReBAR和UMA（比如apple silicon）上device local内存也是host visible的，数据可以直接写入最终buffer而不需要staging拷贝
+    // 没有ReBAR的独立显卡host visible device local堆只有256MB左右，所以host visible的偏好只有资源不超过堆大小1/4时才使用，避免挤占这块小堆
+    uint32_t findPreferredMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred, VkDeviceSize size) const {
+        if (preferred != 0) {
+            for (uint32_t i = 0; i < m_memProperties.memoryTypeCount; i++) {
+                VkMemoryPropertyFlags flags = m_memProperties.memoryTypes[i].propertyFlags;
+                VkDeviceSize heapSize = m_memProperties.memoryHeaps[m_memProperties.memoryTypes[i].heapIndex].size;
+                bool fitsHeap = !(preferred & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) || size <= heapSize / 4;
+                if ((typeFilter & (1 << i)) && (flags & (required | preferred)) == (required | preferred) && fitsHeap) {
+                    return i;
+                }
+            }
+        }
+        return findMemoryType(typeFilter, required);
+    }
+
+    // memory allocator：linear表示buffer或linear tiling的image，optimal tiling的image传false
+    // linear和optimal资源放在不同pool中，这样相邻资源永远不会违反bufferImageGranularity
+    // memory budget：category只用于统计，不影响分配策略
+    // zero staging：preferred是可选的内存属性，结果是否host visible通过allocation.mapped判断
+    // memory report：name只用于统计，同名的资源合并
+    Allocation allocate(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, bool linear, MemoryCategory category = MemoryCategory::other,
+        VkMemoryPropertyFlags preferred = 0, const char* name = "unnamed") {
+        Allocation allocation = allocateFromPool(memRequirements, properties, preferred, linear);
+        allocation.category = category;
+        allocation.name = name;
+
+        size_t categoryIndex = static_cast<size_t>(category);
+        m_stats.categoryBytes[categoryIndex] += allocation.size;
+        m_stats.categoryPeakBytes[categoryIndex] = std::max(m_stats.categoryPeakBytes[categoryIndex], m_stats.categoryBytes[categoryIndex]);
+        m_stats.heaps[heapIndex(allocation.memoryTypeIndex)].allocatedBytes += allocation.size;
+        m_stats.allocatedBytes += allocation.size;
+        m_stats.peakAllocatedBytes = std::max(m_stats.peakAllocatedBytes, m_stats.allocatedBytes);
+
+        NamedMemoryUsage& named = m_named[name];
+        named.bytes += allocation.size;
+        named.peakBytes = std::max(named.peakBytes, named.bytes);
+        named.count++;
+        return allocation;
+    }
+
+    void free(Allocation& allocation) {
+        if (allocation.block == nullptr) {
+            return;
+        }
+
+        MemoryBlock* block = allocation.block;
+        block->allocationCount--;
+
+        m_stats.categoryBytes[static_cast<size_t>(allocation.category)] -= allocation.size;
+        m_stats.heaps[heapIndex(allocation.memoryTypeIndex)].allocatedBytes -= allocation.size;
+        m_stats.allocatedBytes -= allocation.size;
+        NamedMemoryUsage& named = m_named[allocation.name];
+        named.bytes -= allocation.size;
+        named.count--;
+
+        // 插入空闲区间并与前后相邻的区间合并
+        auto it = std::lower_bound(block->freeRanges.begin(), block->freeRanges.end(), allocation.offset,
+            [](const FreeRange& range, VkDeviceSize offset) { return range.offset < offset; });
+        it = block->freeRanges.insert(it, {allocation.offset, allocation.size});
+
+        if (it + 1 != block->freeRanges.end() && it->offset + it->size == (it + 1)->offset) {
+            it->size += (it + 1)->size;
+            block->freeRanges.erase(it + 1);
+        }
+        if (it != block->freeRanges.begin() && (it - 1)->offset + (it - 1)->size == it->offset) {
+            (it - 1)->size += it->size;
+            block->freeRanges.erase(it);
+        }
+
+        // 空block归还给驱动，普通pool保留最后一个block避免反复申请释放
+        // defragment：正在清空的block空了之后清空结束，保留下来的最后一个block重新可以分配
+        if (block->allocationCount == 0) {
+            if (block == m_evacuating) {
+                m_evacuating = nullptr;
+                m_evacuatedBlocks++;
+            }
+            auto& pool = m_pools[block->poolIndex];
+            size_t normalBlocks = std::count_if(pool.begin(), pool.end(), [](const auto& b) { return !b->dedicated; });
+            if (block->dedicated || normalBlocks > 1) {
+                destroyBlock(*block);
+                pool.erase(std::find_if(pool.begin(), pool.end(), [block](const auto& b) { return b.get() == block; }));
+            }
+        }
+
+        allocation = Allocation{};
+    }
+
+    // defragment：block中子分配使用的字节数，对齐产生的空隙算作空闲
+    static VkDeviceSize usedBytes(const MemoryBlock& block) {
+        VkDeviceSize freeBytes = 0;
+        for (const FreeRange& range : block.freeRanges) {
+            freeBytes += range.size;
+        }
+        return block.size - freeBytes;
+    }
+
+    // defragment：block清空之后可以还给驱动（不是dedicated，pool中还有别的普通block），并且别的普通block的空闲字节放得下它的内容
+    // 空闲字节可能分散在多个区间中，放不下的子分配会申请新的block，所以调用者只选择占用率低的block
+    bool canEvacuate(const MemoryBlock& block) const {
+        if (block.dedicated || m_evacuating != nullptr) {
+            return false;
+        }
+        VkDeviceSize otherFree = 0;
+        size_t normalBlocks = 0;
+        for (const auto& other : m_pools[block.poolIndex]) {
+            if (other->dedicated) {
+                continue;
+            }
+            normalBlocks++;
+            if (other.get() != &block) {
+                otherFree += other->size - usedBytes(*other);
+            }
+        }
+        return normalBlocks > 1 && otherFree >= usedBytes(block);
+    }
+
+    // defragment：清空期间新的分配跳过这个block，调用者把其中的资源逐个拷贝到新的分配，最后一个子分配释放时清空结束
+    // 同一时间只清空一个block
+    void beginEvacuation(const MemoryBlock& block) {
+        if (!canEvacuate(block)) {
+            throw std::runtime_error("memory block cannot be evacuated!");
+        }
+        m_evacuating = &block;
+    }
+
+    // defragment：没有正在清空的block时是nullptr，block还给驱动之后指针不再有效，所以只用来比较allocation.block
+    const MemoryBlock* evacuatingBlock() const { return m_evacuating; }
+    uint32_t evacuatedBlocks() const { return m_evacuatedBlocks; }
+
+    const VkPhysicalDeviceMemoryProperties& memoryProperties() const { return m_memProperties; }
+
+    // memory allocator：是否存在包含properties的内存类型，比如tile based gpu上的LAZILY_ALLOCATED
+    bool hasMemoryType(VkMemoryPropertyFlags properties) const {
+        for (uint32_t i = 0; i < m_memProperties.memoryTypeCount; i++) {
+            if ((m_memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t deviceAllocationCount() const { return m_deviceAllocationCount; }
+
+    // memory budget：刷新每个堆的budget和usage，每帧调用一次，查询本身很便宜但结果只在帧之间有意义
+    void updateBudget() {
+        if (m_stats.budgetExtension) {
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+            budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+            VkPhysicalDeviceMemoryProperties2 memProperties2{};
+            memProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            memProperties2.pNext = &budgetProperties;
+            vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &memProperties2);
+
+            for (uint32_t i = 0; i < m_stats.heapCount; i++) {
+                m_stats.heaps[i].budget = budgetProperties.heapBudget[i];
+                m_stats.heaps[i].usage = budgetProperties.heapUsage[i];
+            }
+        } else {
+            // 没有扩展时按堆大小的80%估算预算，剩下的留给系统和其它进程
+            for (uint32_t i = 0; i < m_stats.heapCount; i++) {
+                m_stats.heaps[i].budget = m_memProperties.memoryHeaps[i].size * 8 / 10;
+                m_stats.heaps[i].usage = m_stats.heaps[i].blockBytes;
+            }
+        }
+        m_stats.deviceAllocationCount = m_deviceAllocationCount;
+    }
+
+    const MemoryStats& stats() const { return m_stats; }
+
+    // residency：vkAllocateMemory失败时调用handler，handler释放已经不再使用的资源后返回true，分配再尝试一次
+    // handler中不能分配设备内存；释放内存的free可以调用
+    using PressureHandler = std::function<bool()>;
+    void setPressureHandler(PressureHandler handler) { m_pressureHandler = std::move(handler); }
+    uint32_t pressureEvents() const { return m_pressureEvents; }
+
+    // memory report：堆、类别和资源名的当前值和峰值，以及每种内存类型的block碎片情况
+    // 碎片：block中空闲字节数、空闲区间数和最大的空闲区间，最大区间远小于空闲总数时新的大资源只能申请新的block
+    void writeReport(std::ostream& out) const {
+        auto toKB = [](VkDeviceSize bytes) { return std::to_string(bytes / 1024) + " KB"; };
+
+        out << "device memory: " << m_deviceAllocationCount << " VkDeviceMemory allocations" << (m_stats.budgetExtension ? "" : ", budget estimated") << std::endl;
+        for (uint32_t i = 0; i < m_stats.heapCount; i++) {
+            const HeapBudget& heap = m_stats.heaps[i];
+            out << "  heap " << i << ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "") << ": usage " << toKB(heap.usage) << " / budget "
+                << toKB(heap.budget) << ", blocks " << toKB(heap.blockBytes) << ", allocated " << toKB(heap.allocatedBytes) << std::endl;
+        }
+
+        out << "categories:" << std::endl;
+        for (size_t i = 0; i < m_stats.categoryBytes.size(); i++) {
+            out << "  " << memoryCategoryName(static_cast<MemoryCategory>(i)) << ": " << toKB(m_stats.categoryBytes[i]) << " (peak " << toKB(m_stats.categoryPeakBytes[i]) << ")"
+                << std::endl;
+        }
+
+        // memory report：按当前字节数从大到小
+        std::vector<std::pair<std::string, NamedMemoryUsage>> named(m_named.begin(), m_named.end());
+        std::sort(named.begin(), named.end(), [](const auto& a, const auto& b) { return a.second.bytes > b.second.bytes; });
+        out << "resources:" << std::endl;
+        for (const auto& [name, usage] : named) {
+            out << "  " << name << ": " << toKB(usage.bytes) << " in " << usage.count << " allocations (peak " << toKB(usage.peakBytes) << ")" << std::endl;
+        }
+
+        out << "blocks:" << (m_evacuatedBlocks > 0 ? " (" + std::to_string(m_evacuatedBlocks) + " emptied by defragment)" : "") << std::endl;
+        for (size_t poolIndex = 0; poolIndex < m_pools.size(); poolIndex++) {
+            const auto& pool = m_pools[poolIndex];
+            if (pool.empty()) {
+                continue;
+            }
+            VkDeviceSize blockBytes = 0;
+            VkDeviceSize freeBytes = 0;
+            VkDeviceSize largestFree = 0;
+            size_t freeRanges = 0;
+            size_t dedicated = 0;
+            for (const auto& block : pool) {
+                blockBytes += block->size;
+                dedicated += block->dedicated ? 1 : 0;
+                freeRanges += block->freeRanges.size();
+                for (const FreeRange& range : block->freeRanges) {
+                    freeBytes += range.size;
+                    largestFree = std::max(largestFree, range.size);
+                }
+            }
+            out << "  memory type " << poolIndex / 2 << (poolIndex % 2 ? " linear" : " optimal") << ": " << pool.size() << " blocks (" << dedicated << " dedicated) "
+                << toKB(blockBytes) << ", free " << toKB(freeBytes) << " in " << freeRanges << " ranges, largest " << toKB(largestFree) << std::endl;
+        }
+    }
+
+private:
+    VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties m_memProperties{};
+    uint32_t m_maxAllocationCount = 0;
+    uint32_t m_deviceAllocationCount = 0;
+    bool m_bufferDeviceAddress = false;
+    MemoryStats m_stats;
+    std::map<std::string, NamedMemoryUsage> m_named;  // memory report：只在分配和释放时更新
+    PressureHandler m_pressureHandler;
+    bool m_inPressureHandler = false;
+    uint32_t m_pressureEvents = 0;
+    const MemoryBlock* m_evacuating = nullptr;  // defragment：正在清空的block
+    uint32_t m_evacuatedBlocks = 0;
+
+    // 每种内存类型有linear和optimal两个pool
+    std::array<std::vector<std::unique_ptr<MemoryBlock>>, VK_MAX_MEMORY_TYPES * 2> m_pools;
+
+    uint32_t heapIndex(uint32_t memoryTypeIndex) const {
+        return m_memProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    }
+
+    Allocation allocateFromPool(const VkMemoryRequirements& memRequirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferred, bool linear) {
+        uint32_t memoryTypeIndex = findPreferredMemoryType(memRequirements.memoryTypeBits, properties, preferred, memRequirements.size);
+        uint32_t poolIndex = memoryTypeIndex * 2 + (linear ? 1 : 0);
+
+        VkDeviceSize blockSize = preferredBlockSize(memoryTypeIndex);
+
+        // 超过半个block的资源单独分配，避免一个大资源把整个block占满造成浪费
+        if (memRequirements.size > blockSize / 2) {
+            MemoryBlock& block = createBlock(poolIndex, memoryTypeIndex, memRequirements.size, true);
+            return suballocate(block, memoryTypeIndex, 0, memRequirements.size);
+        }
+
+        for (auto& block : m_pools[poolIndex]) {
+            if (block->dedicated || block.get() == m_evacuating) {
+                continue;
+            }
+
+            VkDeviceSize offset;
+            size_t rangeIndex;
+            if (findFreeRange(*block, memRequirements.size, memRequirements.alignment, offset, rangeIndex)) {
+                return suballocateRange(*block, memoryTypeIndex, rangeIndex, offset, memRequirements.size);
+            }
+        }
+
+        // 没有空间则创建新的block
+        MemoryBlock& block = createBlock(poolIndex, memoryTypeIndex, blockSize, false);
+        return suballocate(block, memoryTypeIndex, 0, memRequirements.size);
+    }
+
+    // 小堆（比如256MB的host visible device local堆）用堆大小的1/8作为block大小
+    VkDeviceSize preferredBlockSize(uint32_t memoryTypeIndex) const {
+        VkDeviceSize heapSize = m_memProperties.memoryHeaps[m_memProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+        return std::min(k_defaultBlockSize, heapSize / 8);
+    }
+
+    MemoryBlock& createBlock(uint32_t poolIndex, uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated) {
+        if (m_deviceAllocationCount >= m_maxAllocationCount) {
+            throw std::runtime_error("exceeded maxMemoryAllocationCount!");
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = memoryTypeIndex;
+        VkMemoryAllocateFlagsInfo flagsInfo{};
+        flagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+        flagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+        if (m_bufferDeviceAddress) {
+            allocInfo.pNext = &flagsInfo;
+        }
+
+        auto block = std::make_unique<MemoryBlock>();
+        block->size = size;
+        block->poolIndex = poolIndex;
+        block->memoryTypeIndex = memoryTypeIndex;
+        block->dedicated = dedicated;
+        block->freeRanges.push_back({0, size});
+
+        VkResult result = vkAllocateMemory(m_device, &allocInfo, hostAllocator(), &block->memory);
+        if (result != VK_SUCCESS && m_pressureHandler && !m_inPressureHandler) {
+            // residency：显存不足时先让handler释放可以立即释放的资源，而不是直接失败
+            m_pressureEvents++;
+            m_inPressureHandler = true;
+            bool released = m_pressureHandler();
+            m_inPressureHandler = false;
+            if (released) {
+                result = vkAllocateMemory(m_device, &allocInfo, hostAllocator(), &block->memory);
+            }
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate device memory block!");
+        }
+        m_deviceAllocationCount++;
+        m_stats.heaps[heapIndex(memoryTypeIndex)].blockBytes += size;
+
+        // host visible内存整个block持久映射，同一个VkDeviceMemory不能被映射两次，所以子分配只能共享这一次映射
+        if (m_memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            vkMapMemory(m_device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+        }
+
+        m_pools[poolIndex].push_back(std::move(block));
+        return *m_pools[poolIndex].back();
+    }
+
+    void destroyBlock(MemoryBlock& block) {
+        if (block.mapped != nullptr) {
+            vkUnmapMemory(m_device, block.memory);
+        }
+        vkFreeMemory(m_device, block.memory, hostAllocator());
+        m_deviceAllocationCount--;
+        m_stats.heaps[heapIndex(block.memoryTypeIndex)].blockBytes -= block.size;
+    }
+
+    // first fit：找到第一个对齐后放得下的空闲区间
+    bool findFreeRange(const MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset, size_t& outRangeIndex) const {
+        for (size_t i = 0; i < block.freeRanges.size(); i++) {
+            const FreeRange& range = block.freeRanges[i];
+            VkDeviceSize alignedOffset = (range.offset + alignment - 1) / alignment * alignment;
+            if (alignedOffset + size <= range.offset + range.size) {
+                outOffset = alignedOffset;
+                outRangeIndex = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Allocation suballocate(MemoryBlock& block, uint32_t memoryTypeIndex, VkDeviceSize offset, VkDeviceSize size) {
+        return suballocateRange(block, memoryTypeIndex, 0, offset, size);
+    }
+
+    // 从空闲区间中切出[offset, offset + size)，对齐产生的前部空隙保留为空闲区间
+    Allocation suballocateRange(MemoryBlock& block, uint32_t memoryTypeIndex, size_t rangeIndex, VkDeviceSize offset, VkDeviceSize size) {
+        FreeRange range = block.freeRanges[rangeIndex];
+        block.freeRanges.erase(block.freeRanges.begin() + rangeIndex);
+
+        VkDeviceSize rangeEnd = range.offset + range.size;
+        VkDeviceSize allocEnd = offset + size;
+        auto insertPos = block.freeRanges.begin() + rangeIndex;
+        if (allocEnd < rangeEnd) {
+            insertPos = block.freeRanges.insert(insertPos, {allocEnd, rangeEnd - allocEnd});
+        }
+        if (offset > range.offset) {
+            block.freeRanges.insert(insertPos, {range.offset, offset - range.offset});
+        }
+
+        block.allocationCount++;
+
+        Allocation allocation{};
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = size;
+        allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + offset : nullptr;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.block = &block;
+        return allocation;
+    }
+};
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "mesh_codec.hpp"
+#include "meshlet_builder.hpp"
+
+// mesh cache：导入后的模型保存成二进制文件，包含去重后的顶点、16位或32位索引、submesh表、meshlet、lod表和包围盒
+// 源文件的hash、格式版本和顶点大小都一致时缓存才有效，否则重新导入并覆盖缓存
+// 文件布局：header，然后是16字节对齐的submesh表、顶点数组、索引数组、meshlet的三个数组和lod表，可以直接从映射的内存拷贝到staging
+const uint32_t MESH_CACHE_MAGIC = 0x48534d56;  // "VMSH"
+const uint32_t MESH_CACHE_VERSION = 6;  // Vertex或者导入方式改变时增加，2：导入时运行mesh optimizer，3：16位索引和submesh，4：meshlet，5：lod，6：编码的顶点和索引
+
+// mesh codec：encoding为MESH_CACHE_ENCODED时vertexOffset和indexOffset指向mesh_codec.hpp的编码流，只有打包工具写入这种缓存
+// 编码的缓存中每个submesh所有level的索引连续，按level的顺序排列，第一个索引在MESH_CODEC_BLOCK的整数倍上，submesh的索引block不和其它submesh共用
+const uint32_t MESH_CACHE_RAW = 0;
+const uint32_t MESH_CACHE_ENCODED = 1;
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t indexSize;  // 2或4字节
+    uint32_t submeshCount;
+    uint32_t encoding;
+    uint64_t submeshOffset;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t meshletCount;
+    uint32_t meshletVertexCount;
+    uint32_t meshletTriangleCount;
+    uint32_t lodCount;
+    uint64_t meshletOffset;
+    uint64_t meshletVertexOffset;
+    uint64_t meshletTriangleOffset;
+    uint64_t lodOffset;
+};
+
+// mesh cache：16位索引：顶点数超过65536时拆成多个submesh，索引相对于submesh的第一个顶点
+// meshlet：每个submesh的meshlet是连续的一段，meshlet中的顶点index同样相对于submesh的第一个顶点
+// 默认都是0：没有meshlet和lod的submesh不需要写出后面的字段
+struct MeshCacheSubmesh {
+    uint32_t firstVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    uint32_t firstMeshlet = 0;
+    uint32_t meshletCount = 0;
+    uint32_t firstLod = 0;
+    uint32_t lodCount = 0;
+};
+
+// lod：level 0是submesh本身的索引，更粗的level的索引追加在索引数组的最后，和level 0共享submesh的顶点
+// error是简化引入的几何误差，单位是模型空间的距离
+struct MeshCacheLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+    uint32_t reserved;
+};
+
+// mesh cache：指向映射内存中的数据，MappedFile关闭后失效
+// mesh codec：encoded时vertices和indices是编码流，vertexBytes和indexBytes是流的大小
+struct MeshCacheView {
+    const void* vertices = nullptr;
+    uint32_t vertexCount = 0;
+    const void* indices = nullptr;
+    uint32_t indexCount = 0;
+    uint32_t indexSize = 0;
+    bool encoded = false;
+    uint64_t vertexBytes = 0;
+    uint64_t indexBytes = 0;
+    const MeshCacheSubmesh* submeshes = nullptr;
+    uint32_t submeshCount = 0;
+    const Meshlet* meshlets = nullptr;
+    uint32_t meshletCount = 0;
+    const uint32_t* meshletVertices = nullptr;
+    uint32_t meshletVertexCount = 0;
+    const uint32_t* meshletTriangles = nullptr;
+    uint32_t meshletTriangleCount = 0;
+    const MeshCacheLod* lods = nullptr;
+    uint32_t lodCount = 0;
+    float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+    float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+};
+
+// mesh cache：一次处理8字节的64位FNV-1a，用于判断源文件是否改变而不是安全用途
+inline uint64_t hashMeshSource(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash ^= word;
+        hash *= 1099511628211ull;
+    }
+    for (; i < size; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// mesh cache：校验header，任何字段不匹配或者文件被截断都返回false
+// asset pack：pack中的缓存在打包时已经和源文件对应，checkSource为false时不比较sourceHash，也就不需要读取源文件
+inline bool readMeshCache(const char* data, size_t size, uint64_t sourceHash, uint32_t vertexStride, MeshCacheView& view, bool checkSource = true) {
+    if (size < sizeof(MeshCacheHeader)) {
+        return false;
+    }
+    MeshCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || (checkSource && header.sourceHash != sourceHash)
+        || header.vertexStride != vertexStride) {
+        return false;
+    }
+
+    if ((header.indexSize != sizeof(uint16_t) && header.indexSize != sizeof(uint32_t)) || header.encoding > MESH_CACHE_ENCODED) {
+        return false;
+    }
+    bool encoded = header.encoding == MESH_CACHE_ENCODED;
+    uint64_t submeshBytes = static_cast<uint64_t>(header.submeshCount) * sizeof(MeshCacheSubmesh);
+    uint64_t vertexBytes = static_cast<uint64_t>(header.vertexCount) * vertexStride;
+    uint64_t indexBytes = static_cast<uint64_t>(header.indexCount) * header.indexSize;
+    if (encoded) {  // mesh codec：流的大小由偏移表决定，同时检查每个block的大小
+        if (header.vertexOffset > size || header.indexOffset > size || header.vertexOffset % sizeof(uint32_t) != 0 || header.indexOffset % sizeof(uint32_t) != 0) {
+            return false;
+        }
+        vertexBytes = validateVertexStream(reinterpret_cast<const uint32_t*>(data + header.vertexOffset), (size - header.vertexOffset) / sizeof(uint32_t),
+            header.vertexCount, vertexStride) * sizeof(uint32_t);
+        indexBytes = validateIndexStream(reinterpret_cast<const uint32_t*>(data + header.indexOffset), (size - header.indexOffset) / sizeof(uint32_t),
+            header.indexCount) * sizeof(uint32_t);
+        if (vertexBytes == 0 || indexBytes == 0) {
+            return false;
+        }
+    }
+    uint64_t meshletBytes = static_cast<uint64_t>(header.meshletCount) * sizeof(Meshlet);
+    uint64_t meshletVertexBytes = static_cast<uint64_t>(header.meshletVertexCount) * sizeof(uint32_t);
+    uint64_t meshletTriangleBytes = static_cast<uint64_t>(header.meshletTriangleCount) * sizeof(uint32_t);
+    uint64_t lodBytes = static_cast<uint64_t>(header.lodCount) * sizeof(MeshCacheLod);
+    // mesh cache：偏移来自文件（asset pack中的缓存不检查source hash），写成offset > size || bytes > size - offset，偏移很大时不会回绕
+    auto outOfRange = [size](uint64_t offset, uint64_t bytes) { return offset > size || bytes > size - offset; };
+    if (outOfRange(header.submeshOffset, submeshBytes) || outOfRange(header.vertexOffset, vertexBytes) || outOfRange(header.indexOffset, indexBytes)
+        || outOfRange(header.meshletOffset, meshletBytes) || outOfRange(header.meshletVertexOffset, meshletVertexBytes)
+        || outOfRange(header.meshletTriangleOffset, meshletTriangleBytes) || outOfRange(header.lodOffset, lodBytes)
+        || header.lodOffset % sizeof(uint32_t) != 0 || header.submeshOffset % sizeof(uint32_t) != 0 || header.indexOffset % sizeof(uint32_t) != 0 || header.meshletOffset % sizeof(uint32_t) != 0
+        || header.meshletVertexOffset % sizeof(uint32_t) != 0 || header.meshletTriangleOffset % sizeof(uint32_t) != 0) {
+        return false;
+    }
+
+    view.vertices = data + header.vertexOffset;
+    view.vertexCount = header.vertexCount;
+    view.indices = data + header.indexOffset;
+    view.indexCount = header.indexCount;
+    view.indexSize = header.indexSize;
+    view.encoded = encoded;
+    view.vertexBytes = vertexBytes;
+    view.indexBytes = indexBytes;
+    view.submeshes = reinterpret_cast<const MeshCacheSubmesh*>(data + header.submeshOffset);
+    view.submeshCount = header.submeshCount;
+    view.meshlets = reinterpret_cast<const Meshlet*>(data + header.meshletOffset);
+    view.meshletCount = header.meshletCount;
+    view.meshletVertices = reinterpret_cast<const uint32_t*>(data + header.meshletVertexOffset);
+    view.meshletVertexCount = header.meshletVertexCount;
+    view.meshletTriangles = reinterpret_cast<const uint32_t*>(data + header.meshletTriangleOffset);
+    view.meshletTriangleCount = header.meshletTriangleCount;
+    view.lods = reinterpret_cast<const MeshCacheLod*>(data + header.lodOffset);
+    view.lodCount = header.lodCount;
+    for (uint32_t i = 0; i < view.submeshCount; i++) {
+        const MeshCacheSubmesh& submesh = view.submeshes[i];
+        if (static_cast<uint64_t>(submesh.firstVertex) + submesh.vertexCount > view.vertexCount
+            || static_cast<uint64_t>(submesh.firstIndex) + submesh.indexCount > view.indexCount
+            || static_cast<uint64_t>(submesh.firstMeshlet) + submesh.meshletCount > view.meshletCount
+            || static_cast<uint64_t>(submesh.firstLod) + submesh.lodCount > view.lodCount) {
+            return false;
+        }
+        // mesh codec：编码的缓存中submesh的level连续并且从block边界开始
+        if (encoded && submesh.firstIndex % MESH_CODEC_BLOCK != 0) {
+            return false;
+        }
+        for (uint32_t l = 0; encoded && l < submesh.lodCount; l++) {
+            uint32_t expected = l == 0 ? submesh.firstIndex : view.lods[submesh.firstLod + l - 1].firstIndex + view.lods[submesh.firstLod + l - 1].indexCount;
+            if (view.lods[submesh.firstLod + l].firstIndex != expected) {
+                return false;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < view.lodCount; i++) {
+        if (static_cast<uint64_t>(view.lods[i].firstIndex) + view.lods[i].indexCount > view.indexCount) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < view.meshletCount; i++) {
+        const Meshlet& meshlet = view.meshlets[i];
+        if (static_cast<uint64_t>(meshlet.vertexOffset) + meshlet.vertexCount > view.meshletVertexCount
+            || static_cast<uint64_t>(meshlet.triangleOffset) + meshlet.triangleCount > view.meshletTriangleCount
+            || meshlet.vertexCount > MESHLET_MAX_VERTICES || meshlet.triangleCount > MESHLET_MAX_TRIANGLES) {
+            return false;
+        }
+    }
+    memcpy(view.boundsMin, header.boundsMin, sizeof(view.boundsMin));
+    memcpy(view.boundsMax, header.boundsMax, sizeof(view.boundsMax));
+    return true;
+}
+
+inline bool readMeshCache(const MappedFile& file, uint64_t sourceHash, uint32_t vertexStride, MeshCacheView& view) {
+    return readMeshCache(file.data(), file.size(), sourceHash, vertexStride, view);
+}
+
+// mesh cache：按header和16字节对齐的各个数组写入out，view中的计数和指针就是写入的内容，encoded时顶点和索引是编码流
+inline void serializeMeshCache(std::ostream& out, uint64_t sourceHash, uint32_t vertexStride, const MeshCacheView& view) {
+    auto align16 = [](uint64_t offset) { return (offset + 15) / 16 * 16; };
+
+    uint64_t submeshBytes = static_cast<uint64_t>(view.submeshCount) * sizeof(MeshCacheSubmesh);
+    uint64_t vertexBytes = view.encoded ? view.vertexBytes : static_cast<uint64_t>(view.vertexCount) * vertexStride;
+    uint64_t indexBytes = view.encoded ? view.indexBytes : static_cast<uint64_t>(view.indexCount) * view.indexSize;
+    uint64_t meshletBytes = static_cast<uint64_t>(view.meshletCount) * sizeof(Meshlet);
+    uint64_t meshletVertexBytes = static_cast<uint64_t>(view.meshletVertexCount) * sizeof(uint32_t);
+    uint64_t meshletTriangleBytes = static_cast<uint64_t>(view.meshletTriangleCount) * sizeof(uint32_t);
+
+    MeshCacheHeader header{};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.vertexStride = vertexStride;
+    header.vertexCount = view.vertexCount;
+    header.indexCount = view.indexCount;
+    header.indexSize = view.indexSize;
+    header.submeshCount = view.submeshCount;
+    header.encoding = view.encoded ? MESH_CACHE_ENCODED : MESH_CACHE_RAW;
+    header.submeshOffset = align16(sizeof(MeshCacheHeader));
+    header.vertexOffset = align16(header.submeshOffset + submeshBytes);
+    header.indexOffset = align16(header.vertexOffset + vertexBytes);
+    header.meshletCount = view.meshletCount;
+    header.meshletVertexCount = view.meshletVertexCount;
+    header.meshletTriangleCount = view.meshletTriangleCount;
+    header.meshletOffset = align16(header.indexOffset + indexBytes);
+    header.meshletVertexOffset = align16(header.meshletOffset + meshletBytes);
+    header.meshletTriangleOffset = align16(header.meshletVertexOffset + meshletVertexBytes);
+    header.lodCount = view.lodCount;
+    header.lodOffset = align16(header.meshletTriangleOffset + meshletTriangleBytes);
+    memcpy(header.boundsMin, view.boundsMin, sizeof(header.boundsMin));
+    memcpy(header.boundsMax, view.boundsMax, sizeof(header.boundsMax));
+
+    const char zeros[16] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(zeros, static_cast<std::streamsize>(header.submeshOffset - sizeof(header)));
+    out.write(reinterpret_cast<const char*>(view.submeshes), static_cast<std::streamsize>(submeshBytes));
+    out.write(zeros, static_cast<std::streamsize>(header.vertexOffset - header.submeshOffset - submeshBytes));
+    out.write(static_cast<const char*>(view.vertices), static_cast<std::streamsize>(vertexBytes));
+    out.write(zeros, static_cast<std::streamsize>(header.indexOffset - header.vertexOffset - vertexBytes));
+    out.write(static_cast<const char*>(view.indices), static_cast<std::streamsize>(indexBytes));
+    out.write(zeros, static_cast<std::streamsize>(header.meshletOffset - header.indexOffset - indexBytes));
+    out.write(reinterpret_cast<const char*>(view.meshlets), static_cast<std::streamsize>(meshletBytes));
+    out.write(zeros, static_cast<std::streamsize>(header.meshletVertexOffset - header.meshletOffset - meshletBytes));
+    out.write(reinterpret_cast<const char*>(view.meshletVertices), static_cast<std::streamsize>(meshletVertexBytes));
+    out.write(zeros, static_cast<std::streamsize>(header.meshletTriangleOffset - header.meshletVertexOffset - meshletVertexBytes));
+    out.write(reinterpret_cast<const char*>(view.meshletTriangles), static_cast<std::streamsize>(meshletTriangleBytes));
+    out.write(zeros, static_cast<std::streamsize>(header.lodOffset - header.meshletTriangleOffset - meshletTriangleBytes));
+    out.write(reinterpret_cast<const char*>(view.lods), static_cast<std::streamsize>(static_cast<uint64_t>(view.lodCount) * sizeof(MeshCacheLod)));
+}
+
+// mesh cache：先写入临时文件再重命名，写入中途退出不会留下损坏的缓存
+// 写入失败（比如模型目录只读）时返回false，调用者仍然可以使用导入的数据
+inline bool writeMeshCache(const std::string& path, uint64_t sourceHash, uint32_t vertexStride, const void* vertices, uint32_t vertexCount,
+    const void* indices, uint32_t indexCount, uint32_t indexSize, const std::vector<MeshCacheSubmesh>& submeshes, const MeshletData& meshlets,
+    const std::vector<MeshCacheLod>& lods, const float boundsMin[3], const float boundsMax[3]) {
+    MeshCacheView view;
+    view.vertices = vertices;
+    view.vertexCount = vertexCount;
+    view.indices = indices;
+    view.indexCount = indexCount;
+    view.indexSize = indexSize;
+    view.submeshes = submeshes.data();
+    view.submeshCount = static_cast<uint32_t>(submeshes.size());
+    view.meshlets = meshlets.meshlets.data();
+    view.meshletCount = static_cast<uint32_t>(meshlets.meshlets.size());
+    view.meshletVertices = meshlets.vertices.data();
+    view.meshletVertexCount = static_cast<uint32_t>(meshlets.vertices.size());
+    view.meshletTriangles = meshlets.triangles.data();
+    view.meshletTriangleCount = static_cast<uint32_t>(meshlets.triangles.size());
+    view.lods = lods.data();
+    view.lodCount = static_cast<uint32_t>(lods.size());
+    memcpy(view.boundsMin, boundsMin, sizeof(view.boundsMin));
+    memcpy(view.boundsMax, boundsMax, sizeof(view.boundsMax));
+
+    std::string tempPath = path + ".tmp";
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    serializeMeshCache(file, sourceHash, vertexStride, view);
+    file.close();
+    if (!file) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    std::remove(path.c_str());  // 有些平台上rename不会覆盖已有文件
+    return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+// mesh codec：打包工具把程序写入的缓存转换成编码的缓存；不是有效的未编码缓存时返回false，调用者原样打包
+// 每个submesh的level重新排列成从block边界开始的连续一段，submesh之间的空隙填0，lod表和submesh表跟着更新
+inline bool encodeMeshCache(const char* data, size_t size, std::vector<char>& out) {
+    MeshCacheHeader header;
+    MeshCacheView view;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.vertexStride % sizeof(uint32_t) != 0 || !readMeshCache(data, size, 0, header.vertexStride, view, false) || view.encoded) {
+        return false;
+    }
+
+    std::vector<MeshCacheSubmesh> submeshes(view.submeshes, view.submeshes + view.submeshCount);
+    std::vector<MeshCacheLod> lods(view.lods, view.lods + view.lodCount);
+    std::vector<char> indices;
+    const char* source = static_cast<const char*>(view.indices);
+    uint32_t cursor = 0;
+    auto append = [&](uint32_t firstIndex, uint32_t indexCount) {
+        indices.insert(indices.end(), source + static_cast<size_t>(firstIndex) * view.indexSize, source + static_cast<size_t>(firstIndex + indexCount) * view.indexSize);
+        cursor += indexCount;
+    };
+    for (MeshCacheSubmesh& submesh : submeshes) {
+        cursor = meshCodecBlockCount(cursor) * MESH_CODEC_BLOCK;
+        indices.resize(static_cast<size_t>(cursor) * view.indexSize, 0);
+        uint32_t firstIndex = submesh.firstIndex;
+        submesh.firstIndex = cursor;
+        if (submesh.lodCount == 0) {
+            append(firstIndex, submesh.indexCount);
+        }
+        for (uint32_t l = 0; l < submesh.lodCount; l++) {
+            MeshCacheLod& lod = lods[submesh.firstLod + l];
+            uint32_t lodFirst = lod.firstIndex;
+            lod.firstIndex = cursor;
+            append(lodFirst, lod.indexCount);
+        }
+    }
+
+    std::vector<uint32_t> vertexStream;
+    std::vector<uint32_t> indexStream;
+    encodeVertexStream(view.vertices, view.vertexCount, header.vertexStride, vertexStream);
+    encodeIndexStream(indices.data(), cursor, view.indexSize, indexStream);
+    view.encoded = true;
+    view.vertices = vertexStream.data();
+    view.vertexBytes = vertexStream.size() * sizeof(uint32_t);
+    view.indices = indexStream.data();
+    view.indexBytes = indexStream.size() * sizeof(uint32_t);
+    view.indexCount = cursor;
+    view.submeshes = submeshes.data();
+    view.lods = lods.data();
+
+    std::ostringstream stream(std::ios::binary);
+    serializeMeshCache(stream, header.sourceHash, header.vertexStride, view);
+    std::string bytes = stream.str();
+    out.assign(bytes.begin(), bytes.end());
+    return true;
+}
+
+// mesh codec：cpu解码整个缓存的顶点和索引，gpu解码不可用时在加载线程调用；view需要是readMeshCache检查过的编码缓存
+inline void decodeMeshCache(const MeshCacheView& view, uint32_t vertexStride, std::vector<char>& vertices, std::vector<char>& indices) {
+    vertices.resize(static_cast<size_t>(view.vertexCount) * vertexStride);
+    indices.resize(static_cast<size_t>(view.indexCount) * view.indexSize);
+    decodeVertexStream(static_cast<const uint32_t*>(view.vertices), view.vertexCount, vertexStride, vertices.data());
+    decodeIndexStream(static_cast<const uint32_t*>(view.indices), view.indexCount, view.indexSize, indices.data());
+}
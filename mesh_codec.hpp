@@ -0,0 +1,267 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// mesh codec：asset pack中的mesh cache把顶点和索引编码成分块的流，上传时由mesh_decode.comp直接解码到geometry buffer，cpu不再展开数据
+// 两种流的布局相同：开头是blockCount + 1个uint的block偏移表（单位是uint，相对于偏移表之后），然后是每个block的数据，所有数据按uint对齐
+// 每个block是MESH_CODEC_BLOCK个顶点或索引，block之间相互独立，gpu上每个block（顶点流是每个block的每个uint）由一个线程解码
+// 顶点流：按字节拆成vertexStride个通道，每个字节和同一通道的上一个顶点做差（block开头和0做差）再zigzag，每16个顶点一组选择0、2、4或8位宽度
+// block开头每个通道一个uint的header，16组各2位的宽度编号，之后按通道顺序是各组的数据，每个值从低位开始装进uint，不会跨越uint
+// 索引流：block开头是宽度header（编号对应4、8、16或32位）和第一个索引，之后是每个索引和上一个索引之差的zigzag，同样每16个一组
+// 和meshoptimizer的索引codec不同，没有edge fifo，fifo的解码只能顺序进行；顶点缓存优化后的索引差值大多很小，8位的组占多数
+const uint32_t MESH_CODEC_BLOCK = 256;
+const uint32_t MESH_CODEC_GROUP = 16;
+const uint32_t MESH_CODEC_GROUPS = MESH_CODEC_BLOCK / MESH_CODEC_GROUP;
+
+inline uint32_t meshCodecBlockCount(uint32_t count) {
+    return (count + MESH_CODEC_BLOCK - 1) / MESH_CODEC_BLOCK;
+}
+
+// mesh codec：宽度编号对应的位数，顶点流和索引流各一张表；一组16个值占用的uint数是位数的一半
+inline uint32_t meshCodecVertexBits(uint32_t code) {
+    static const uint32_t BITS[4] = {0, 2, 4, 8};
+    return BITS[code & 3];
+}
+
+inline uint32_t meshCodecIndexBits(uint32_t code) {
+    static const uint32_t BITS[4] = {4, 8, 16, 32};
+    return BITS[code & 3];
+}
+
+// mesh codec：header中所有组的数据占用的uint数
+template <typename Bits>
+uint32_t meshCodecGroupWords(uint32_t header, Bits&& bits) {
+    uint32_t words = 0;
+    for (uint32_t g = 0; g < MESH_CODEC_GROUPS; g++) {
+        words += bits(header >> (g * 2)) * MESH_CODEC_GROUP / 32;
+    }
+    return words;
+}
+
+namespace mesh_codec_detail {
+
+inline uint32_t zigzag(int32_t value) { return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31); }
+inline int32_t unzigzag(uint32_t value) { return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1); }
+
+// mesh codec：一组最大的值需要的最小宽度编号
+template <typename Bits>
+uint32_t groupCode(const uint32_t* values, uint32_t count, Bits&& bits) {
+    uint32_t maxValue = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        maxValue = std::max(maxValue, values[i]);
+    }
+    for (uint32_t code = 0; code < 3; code++) {
+        if (bits(code) >= 32 || maxValue < (1u << bits(code))) {
+            return code;
+        }
+    }
+    return 3;
+}
+
+template <typename Bits>
+void writeGroup(const uint32_t* values, uint32_t count, uint32_t code, Bits&& bits, std::vector<uint32_t>& out) {
+    uint32_t width = bits(code);
+    if (width == 0) {
+        return;
+    }
+    size_t first = out.size();
+    out.resize(first + width * MESH_CODEC_GROUP / 32, 0);
+    for (uint32_t i = 0; i < count; i++) {
+        out[first + i * width / 32] |= values[i] << (i * width % 32);
+    }
+}
+
+inline uint32_t readValue(const uint32_t* group, uint32_t i, uint32_t width) {
+    if (width == 0) {
+        return 0;
+    }
+    uint32_t mask = width == 32 ? ~0u : (1u << width) - 1;
+    return (group[i * width / 32] >> (i * width % 32)) & mask;
+}
+
+// mesh codec：偏移表单调并且最后一项在数据范围之内，返回整个流的uint数，无效时返回0
+inline size_t streamWords(const uint32_t* stream, size_t words, uint32_t blockCount) {
+    if (words < static_cast<size_t>(blockCount) + 1 || stream[0] != 0) {
+        return 0;
+    }
+    for (uint32_t b = 0; b < blockCount; b++) {
+        if (stream[b + 1] < stream[b]) {
+            return 0;
+        }
+    }
+    size_t total = static_cast<size_t>(blockCount) + 1 + stream[blockCount];
+    return total <= words ? total : 0;
+}
+
+}  // namespace mesh_codec_detail
+
+// mesh codec：vertexStride需要是4的倍数，结果追加到out
+inline void encodeVertexStream(const void* vertices, uint32_t vertexCount, uint32_t vertexStride, std::vector<uint32_t>& out) {
+    using namespace mesh_codec_detail;
+    const uint8_t* bytes = static_cast<const uint8_t*>(vertices);
+    uint32_t blockCount = meshCodecBlockCount(vertexCount);
+    size_t table = out.size();
+    out.resize(table + blockCount + 1, 0);
+    size_t data = out.size();
+    std::vector<uint32_t> deltas(MESH_CODEC_BLOCK);
+    for (uint32_t b = 0; b < blockCount; b++) {
+        out[table + b] = static_cast<uint32_t>(out.size() - data);
+        uint32_t first = b * MESH_CODEC_BLOCK;
+        uint32_t count = std::min(MESH_CODEC_BLOCK, vertexCount - first);
+        size_t headerStart = out.size();
+        out.resize(headerStart + vertexStride, 0);
+        for (uint32_t c = 0; c < vertexStride; c++) {
+            uint8_t previous = 0;
+            for (uint32_t v = 0; v < count; v++) {
+                uint8_t value = bytes[static_cast<size_t>(first + v) * vertexStride + c];
+                deltas[v] = zigzag(static_cast<int8_t>(static_cast<uint8_t>(value - previous))) & 0xff;
+                previous = value;
+            }
+            uint32_t header = 0;
+            for (uint32_t g = 0; g * MESH_CODEC_GROUP < count; g++) {
+                uint32_t groupCount = std::min(MESH_CODEC_GROUP, count - g * MESH_CODEC_GROUP);
+                uint32_t code = groupCode(deltas.data() + g * MESH_CODEC_GROUP, groupCount, meshCodecVertexBits);
+                writeGroup(deltas.data() + g * MESH_CODEC_GROUP, groupCount, code, meshCodecVertexBits, out);
+                header |= code << (g * 2);
+            }
+            out[headerStart + c] = header;
+        }
+    }
+    out[table + blockCount] = static_cast<uint32_t>(out.size() - data);
+}
+
+// mesh codec：indexSize是2或4；block的第一个差值总是0，header之后的第二个uint就是第一个索引
+inline void encodeIndexStream(const void* indices, uint32_t indexCount, uint32_t indexSize, std::vector<uint32_t>& out) {
+    using namespace mesh_codec_detail;
+    auto indexAt = [&](uint32_t i) {
+        if (indexSize == sizeof(uint16_t)) {
+            return static_cast<uint32_t>(static_cast<const uint16_t*>(indices)[i]);
+        }
+        return static_cast<const uint32_t*>(indices)[i];
+    };
+    uint32_t blockCount = meshCodecBlockCount(indexCount);
+    size_t table = out.size();
+    out.resize(table + blockCount + 1, 0);
+    size_t data = out.size();
+    std::vector<uint32_t> deltas(MESH_CODEC_BLOCK);
+    for (uint32_t b = 0; b < blockCount; b++) {
+        out[table + b] = static_cast<uint32_t>(out.size() - data);
+        uint32_t first = b * MESH_CODEC_BLOCK;
+        uint32_t count = std::min(MESH_CODEC_BLOCK, indexCount - first);
+        uint32_t previous = indexAt(first);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t value = indexAt(first + i);
+            deltas[i] = zigzag(static_cast<int32_t>(value - previous));
+            previous = value;
+        }
+        size_t headerStart = out.size();
+        out.push_back(0);
+        out.push_back(indexAt(first));
+        uint32_t header = 0;
+        for (uint32_t g = 0; g * MESH_CODEC_GROUP < count; g++) {
+            uint32_t groupCount = std::min(MESH_CODEC_GROUP, count - g * MESH_CODEC_GROUP);
+            uint32_t code = groupCode(deltas.data() + g * MESH_CODEC_GROUP, groupCount, meshCodecIndexBits);
+            writeGroup(deltas.data() + g * MESH_CODEC_GROUP, groupCount, code, meshCodecIndexBits, out);
+            header |= code << (g * 2);
+        }
+        // mesh codec：没有值的组编号为0，仍然按4位计算大小，补上这些组的空间让解码器只依赖header
+        for (uint32_t g = (count + MESH_CODEC_GROUP - 1) / MESH_CODEC_GROUP; g < MESH_CODEC_GROUPS; g++) {
+            out.resize(out.size() + meshCodecIndexBits(0) * MESH_CODEC_GROUP / 32, 0);
+        }
+        out[headerStart] = header;
+    }
+    out[table + blockCount] = static_cast<uint32_t>(out.size() - data);
+}
+
+// mesh codec：每个block的大小和header一致时返回流的uint数，否则返回0；读取之前调用，解码时不再检查
+inline size_t validateVertexStream(const uint32_t* stream, size_t words, uint32_t vertexCount, uint32_t vertexStride) {
+    uint32_t blockCount = meshCodecBlockCount(vertexCount);
+    size_t total = mesh_codec_detail::streamWords(stream, words, blockCount);
+    if (total == 0 || vertexStride % sizeof(uint32_t) != 0) {
+        return 0;
+    }
+    const uint32_t* data = stream + blockCount + 1;
+    for (uint32_t b = 0; b < blockCount; b++) {
+        uint32_t size = stream[b + 1] - stream[b];
+        if (size < vertexStride) {
+            return 0;
+        }
+        uint32_t expected = vertexStride;
+        for (uint32_t c = 0; c < vertexStride; c++) {
+            expected += meshCodecGroupWords(data[stream[b] + c], meshCodecVertexBits);
+        }
+        if (expected != size) {
+            return 0;
+        }
+    }
+    return total;
+}
+
+inline size_t validateIndexStream(const uint32_t* stream, size_t words, uint32_t indexCount) {
+    uint32_t blockCount = meshCodecBlockCount(indexCount);
+    size_t total = mesh_codec_detail::streamWords(stream, words, blockCount);
+    if (total == 0) {
+        return 0;
+    }
+    const uint32_t* data = stream + blockCount + 1;
+    for (uint32_t b = 0; b < blockCount; b++) {
+        uint32_t size = stream[b + 1] - stream[b];
+        if (size < 2 || size != 2 + meshCodecGroupWords(data[stream[b]], meshCodecIndexBits)) {
+            return 0;
+        }
+    }
+    return total;
+}
+
+// mesh codec：cpu解码，gpu不可用时使用，和mesh_decode.comp的结果相同；流需要先经过validate
+inline void decodeVertexStream(const uint32_t* stream, uint32_t vertexCount, uint32_t vertexStride, void* vertices) {
+    using namespace mesh_codec_detail;
+    uint8_t* bytes = static_cast<uint8_t*>(vertices);
+    uint32_t blockCount = meshCodecBlockCount(vertexCount);
+    const uint32_t* data = stream + blockCount + 1;
+    for (uint32_t b = 0; b < blockCount; b++) {
+        const uint32_t* block = data + stream[b];
+        const uint32_t* group = block + vertexStride;
+        uint32_t first = b * MESH_CODEC_BLOCK;
+        uint32_t count = std::min(MESH_CODEC_BLOCK, vertexCount - first);
+        for (uint32_t c = 0; c < vertexStride; c++) {
+            uint8_t previous = 0;
+            for (uint32_t g = 0; g < MESH_CODEC_GROUPS; g++) {
+                uint32_t width = meshCodecVertexBits(block[c] >> (g * 2));
+                for (uint32_t i = 0; i < MESH_CODEC_GROUP && g * MESH_CODEC_GROUP + i < count; i++) {
+                    previous = static_cast<uint8_t>(previous + unzigzag(readValue(group, i, width)));
+                    bytes[static_cast<size_t>(first + g * MESH_CODEC_GROUP + i) * vertexStride + c] = previous;
+                }
+                group += width * MESH_CODEC_GROUP / 32;
+            }
+        }
+    }
+}
+
+inline void decodeIndexStream(const uint32_t* stream, uint32_t indexCount, uint32_t indexSize, void* indices) {
+    using namespace mesh_codec_detail;
+    uint32_t blockCount = meshCodecBlockCount(indexCount);
+    const uint32_t* data = stream + blockCount + 1;
+    for (uint32_t b = 0; b < blockCount; b++) {
+        const uint32_t* block = data + stream[b];
+        const uint32_t* group = block + 2;
+        uint32_t previous = block[1];
+        uint32_t first = b * MESH_CODEC_BLOCK;
+        uint32_t count = std::min(MESH_CODEC_BLOCK, indexCount - first);
+        for (uint32_t g = 0; g < MESH_CODEC_GROUPS; g++) {
+            uint32_t width = meshCodecIndexBits(block[0] >> (g * 2));
+            for (uint32_t i = 0; i < MESH_CODEC_GROUP && g * MESH_CODEC_GROUP + i < count; i++) {
+                previous += static_cast<uint32_t>(unzigzag(readValue(group, i, width)));
+                uint32_t index = first + g * MESH_CODEC_GROUP + i;
+                if (indexSize == sizeof(uint16_t)) {
+                    static_cast<uint16_t*>(indices)[index] = static_cast<uint16_t>(previous);
+                } else {
+                    static_cast<uint32_t*>(indices)[index] = previous;
+                }
+            }
+            group += width * MESH_CODEC_GROUP / 32;
+        }
+    }
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mesh_cache.hpp"
+
+// mesh optimizer：导入后对索引和顶点重新排序，结果写入mesh cache，运行时不需要再做
+// 1. tipsify把三角形排成post transform vertex cache友好的顺序
+// 2. 按tipsify的cluster做overdraw排序，朝外的cluster先画，更容易挡住后面的三角形
+// 3. 按索引第一次使用的顺序重排顶点，顶点读取也变成顺序访问
+const uint32_t MESH_OPTIMIZER_CACHE_SIZE = 16;  // 模拟的fifo cache大小，大部分gpu的有效大小在16到32之间
+
+// mesh optimizer：用fifo cache模拟顶点变换次数
+// acmr是每个三角形平均的变换次数（最好0.5，最差3），atvr是每个顶点平均的变换次数（最好1）
+struct VertexCacheStats {
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+inline VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = MESH_OPTIMIZER_CACHE_SIZE) {
+    std::vector<uint32_t> cacheTime(vertexCount, 0);  // 顶点进入cache时的时间，时间差超过cacheSize就已经被挤出
+    std::vector<bool> used(vertexCount, false);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    size_t usedCount = 0;
+    for (uint32_t index : indices) {
+        if (time - cacheTime[index] > cacheSize) {
+            cacheTime[index] = time++;
+            misses++;
+        }
+        if (!used[index]) {
+            used[index] = true;
+            usedCount++;
+        }
+    }
+
+    VertexCacheStats stats;
+    if (!indices.empty()) {
+        stats.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+        stats.atvr = static_cast<float>(misses) / static_cast<float>(usedCount);
+    }
+    return stats;
+}
+
+// mesh optimizer：Sander等人的tipsify，从当前顶点扇出所有三角形，下一个顶点优先选择还在cache中并且剩余三角形多的
+// 没有候选时从最近输出的顶点中找还有三角形的（dead end），再没有就按顺序找下一个，这些位置作为cluster的起点
+inline std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, std::vector<size_t>& clusterStarts,
+    uint32_t cacheSize = MESH_OPTIMIZER_CACHE_SIZE) {
+    size_t triangleCount = indices.size() / 3;
+
+    // 每个顶点相邻的三角形
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (uint32_t index : indices) {
+        liveTriangles[index]++;
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (size_t k = 0; k < 3; k++) {
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    clusterStarts.clear();
+
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 0;  // 按顺序查找下一个还有三角形的顶点
+    int64_t fanning = vertexCount > 0 ? 0 : -1;
+    bool restart = true;
+    while (fanning >= 0) {
+        uint32_t vertex = static_cast<uint32_t>(fanning);
+        if (restart) {
+            clusterStarts.push_back(result.size());
+            restart = false;
+        }
+
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; a++) {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            emitted[t] = true;
+            for (size_t k = 0; k < 3; k++) {
+                uint32_t v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+        }
+
+        // 下一个顶点：扇出后仍然在cache中的顶点优先，越早进入cache的越快被挤出，所以优先级越高
+        fanning = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveTriangles[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                fanning = v;
+            }
+        }
+
+        if (fanning < 0) {
+            restart = true;
+            while (!deadEnd.empty()) {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[v] > 0) {
+                    fanning = v;
+                    break;
+                }
+            }
+        }
+        while (fanning < 0 && cursor < vertexCount) {
+            if (liveTriangles[cursor] > 0) {
+                fanning = static_cast<int64_t>(cursor);
+            }
+            cursor++;
+        }
+    }
+    return result;
+}
+
+// mesh optimizer：cluster按(cluster中心 - 模型中心)和cluster平均法线的点积从大到小排序，和视角无关
+// cluster内部顺序不变，cluster之间本来就是cache miss，重排几乎不影响acmr
+inline std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<size_t>& clusterStarts,
+    const float* positions, size_t positionStride) {
+    auto position = [&](uint32_t index) {
+        return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + index * positionStride);
+    };
+
+    float meshCenter[3] = {0.0f, 0.0f, 0.0f};
+    for (uint32_t index : indices) {
+        const float* p = position(index);
+        for (int k = 0; k < 3; k++) {
+            meshCenter[k] += p[k];
+        }
+    }
+    for (int k = 0; k < 3; k++) {
+        meshCenter[k] /= std::max<size_t>(indices.size(), 1);
+    }
+
+    struct Cluster {
+        size_t begin;
+        size_t end;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    for (size_t c = 0; c < clusterStarts.size(); c++) {
+        Cluster cluster{clusterStarts[c], c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : indices.size(), 0.0f};
+        if (cluster.begin == cluster.end) {
+            continue;
+        }
+
+        // 面积加权的中心和法线，未归一化的叉积长度就是两倍面积
+        float center[3] = {0.0f, 0.0f, 0.0f};
+        float normal[3] = {0.0f, 0.0f, 0.0f};
+        float area = 0.0f;
+        for (size_t i = cluster.begin; i < cluster.end; i += 3) {
+            const float* p0 = position(indices[i]);
+            const float* p1 = position(indices[i + 1]);
+            const float* p2 = position(indices[i + 2]);
+            float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            float triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++) {
+                center[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * triangleArea;
+                normal[k] += n[k];
+            }
+            area += triangleArea;
+        }
+        float normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area > 0.0f && normalLength > 0.0f) {
+            for (int k = 0; k < 3; k++) {
+                cluster.sortKey += (center[k] / area - meshCenter[k]) * normal[k] / normalLength;
+            }
+        }
+        clusters.push_back(cluster);
+    }
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (const Cluster& cluster : clusters) {
+        result.insert(result.end(), indices.begin() + cluster.begin, indices.begin() + cluster.end);
+    }
+    return result;
+}
+
+// mesh optimizer：顶点按索引中第一次出现的顺序重排，没有被引用的顶点被丢弃，索引改成新的顺序
+template<typename Vertex>
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = static_cast<uint32_t>(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices = std::move(result);
+}
+
+// 16位索引：按三角形顺序贪心拆分，submesh的顶点数达到maxVertices时开始下一个，索引改成submesh内的局部索引
+// 跨越边界的顶点在两个submesh中各保存一份；顶点已经按第一次使用排序时，每个submesh的顶点仍然是顺序读取
+template<typename Vertex>
+void splitMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<MeshCacheSubmesh>& submeshes, uint32_t maxVertices = 65536) {
+    std::vector<uint32_t> remap(vertices.size(), 0);
+    std::vector<uint32_t> remapSubmesh(vertices.size(), UINT32_MAX);  // remap属于哪个submesh
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    submeshes.clear();
+
+    MeshCacheSubmesh current{};
+    uint32_t submeshIndex = 0;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        uint32_t added = 0;
+        for (size_t k = 0; k < 3; k++) {
+            added += remapSubmesh[indices[t + k]] != submeshIndex ? 1 : 0;
+        }
+        if (current.vertexCount + added > maxVertices) {
+            submeshes.push_back(current);
+            current = {};
+            current.firstVertex = static_cast<uint32_t>(result.size());
+            current.firstIndex = static_cast<uint32_t>(t);
+            submeshIndex++;
+        }
+
+        for (size_t k = 0; k < 3; k++) {
+            uint32_t& index = indices[t + k];
+            if (remapSubmesh[index] != submeshIndex) {
+                remapSubmesh[index] = submeshIndex;
+                remap[index] = current.vertexCount++;
+                result.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        current.indexCount += 3;
+    }
+    if (current.indexCount > 0) {
+        submeshes.push_back(current);
+    }
+    vertices = std::move(result);
+}
+
+// 16位索引：调用者保证所有索引都小于65536
+inline std::vector<uint16_t> narrowIndices(const std::vector<uint32_t>& indices) {
+    std::vector<uint16_t> result(indices.size());
+    for (size_t i = 0; i < indices.size(); i++) {
+        result[i] = static_cast<uint16_t>(indices[i]);
+    }
+    return result;
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// lod：Garland和Heckbert的quadric error metric，边坍缩到已有的端点上，简化后的索引和原模型共享顶点
+// 每个顶点的quadric是相邻三角形平面距离平方的面积加权和，坍缩u到v的代价是(Qu + Qv)在v位置的值
+// 在网格边界上的顶点（包括uv接缝，接缝两边是不同的顶点）不移动，这样简化后不会出现裂缝
+// 一次运行依次输出多个目标三角形数量的结果，后面的level在前一个level的基础上继续坍缩，quadric一直累积
+const float LOD_TRIANGLE_RATIOS[] = {0.5f, 0.25f, 0.125f};  // 相对于原模型的三角形数量
+const float LOD_MIN_REDUCTION = 0.9f;  // 三角形数量没有降到上一级的这个比例以下时不再生成更粗的level
+
+// lod：error是坍缩引入的最大几何误差，单位和顶点位置相同，绘制时投影到屏幕上选择level
+struct SimplifiedLod {
+    std::vector<uint32_t> indices;
+    float error = 0.0f;
+};
+
+// lod：对称的4x4矩阵只保存10个分量，weight是面积权重的和，cost / weight是平均的距离平方
+struct Quadric {
+    double a2 = 0, b2 = 0, c2 = 0, ab = 0, ac = 0, bc = 0, ad = 0, bd = 0, cd = 0, d2 = 0;
+    double weight = 0;
+
+    static Quadric plane(double a, double b, double c, double d, double w) {
+        Quadric q;
+        q.a2 = w * a * a; q.b2 = w * b * b; q.c2 = w * c * c;
+        q.ab = w * a * b; q.ac = w * a * c; q.bc = w * b * c;
+        q.ad = w * a * d; q.bd = w * b * d; q.cd = w * c * d;
+        q.d2 = w * d * d;
+        q.weight = w;
+        return q;
+    }
+
+    void add(const Quadric& q) {
+        a2 += q.a2; b2 += q.b2; c2 += q.c2; ab += q.ab; ac += q.ac; bc += q.bc;
+        ad += q.ad; bd += q.bd; cd += q.cd; d2 += q.d2; weight += q.weight;
+    }
+
+    double evaluate(const float* p) const {
+        double x = p[0], y = p[1], z = p[2];
+        double result = a2 * x * x + b2 * y * y + c2 * z * z + 2 * (ab * x * y + ac * x * z + bc * y * z) + 2 * (ad * x + bd * y + cd * z) + d2;
+        return std::max(result, 0.0);
+    }
+};
+
+// lod：indices是局部索引，positions按positionStride读取vertexCount个顶点，返回的level按三角形数量从多到少排列
+// 没有达到LOD_MIN_REDUCTION的level被丢弃，所以返回的数量可能少于LOD_TRIANGLE_RATIOS
+inline std::vector<SimplifiedLod> simplifyMeshLods(const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount) {
+    auto position = [&](uint32_t index) {
+        return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + index * positionStride);
+    };
+    auto triangleNormal = [&](uint32_t i0, uint32_t i1, uint32_t i2, double n[3]) {
+        const float* p0 = position(i0);
+        const float* p1 = position(i1);
+        const float* p2 = position(i2);
+        double e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        double e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    };
+
+    std::vector<uint32_t> current(indices, indices + indexCount);
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t + 2 < current.size(); t += 3) {
+        double n[3];
+        triangleNormal(current[t], current[t + 1], current[t + 2], n);
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0) {
+            continue;
+        }
+        double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+        const float* p0 = position(current[t]);
+        Quadric q = Quadric::plane(a, b, c, -(a * p0[0] + b * p0[1] + c * p0[2]), length * 0.5);
+        for (size_t k = 0; k < 3; k++) {
+            quadrics[current[t + k]].add(q);
+        }
+    }
+
+    // lod：有向边a->b没有对应的b->a时是边界边，两个端点都锁定
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::vector<uint64_t> edges;
+        edges.reserve(current.size());
+        for (size_t t = 0; t + 2 < current.size(); t += 3) {
+            for (size_t k = 0; k < 3; k++) {
+                uint64_t a = current[t + k], b = current[t + (k + 1) % 3];
+                edges.push_back(a << 32 | b);
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (uint64_t edge : edges) {
+            uint64_t reversed = (edge & 0xffffffffull) << 32 | edge >> 32;
+            if (!std::binary_search(edges.begin(), edges.end(), reversed)) {
+                locked[edge >> 32] = true;
+                locked[edge & 0xffffffffull] = true;
+            }
+        }
+    }
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    std::vector<SimplifiedLod> lods;
+    double maxError = 0.0;
+    size_t previousCount = current.size();
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+
+    for (float ratio : LOD_TRIANGLE_RATIOS) {
+        size_t targetIndexCount = static_cast<size_t>(indexCount / 3 * ratio) * 3;
+        while (current.size() > targetIndexCount) {
+            // 每一轮重新建立顶点到三角形的邻接
+            std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+            for (uint32_t index : current) {
+                adjacencyOffsets[index + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+            }
+            adjacency.resize(current.size());
+            std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < current.size(); i++) {
+                adjacency[cursor[current[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+
+            std::vector<Collapse> collapses;
+            collapses.reserve(current.size() * 2);
+            for (size_t t = 0; t + 2 < current.size(); t += 3) {
+                for (size_t k = 0; k < 3; k++) {
+                    uint32_t a = current[t + k], b = current[t + (k + 1) % 3];
+                    for (int direction = 0; direction < 2; direction++) {
+                        uint32_t from = direction == 0 ? a : b;
+                        uint32_t to = direction == 0 ? b : a;
+                        if (locked[from]) {
+                            continue;
+                        }
+                        Quadric q = quadrics[from];
+                        q.add(quadrics[to]);
+                        collapses.push_back({from, to, q.evaluate(position(to)) / std::max(q.weight, 1e-12)});
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+            // lod：代价从小到大坍缩，一轮中一个顶点的1-ring只参与一次坍缩，翻转检查使用的位置都是最新的
+            for (uint32_t v = 0; v < vertexCount; v++) {
+                remap[v] = v;
+            }
+            std::fill(touched.begin(), touched.end(), false);
+            size_t removeTarget = (current.size() - targetIndexCount) / 3;
+            size_t removed = 0;
+            for (const Collapse& collapse : collapses) {
+                if (removed >= removeTarget) {
+                    break;
+                }
+                if (touched[collapse.from] || touched[collapse.to]) {
+                    continue;
+                }
+
+                // 不包含to的三角形把from换成to之后，法线变化不能超过约75度，否则三角形会翻转或者变成细长的三角形
+                bool valid = true;
+                size_t shared = 0;
+                for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && valid; a++) {
+                    const uint32_t* triangle = &current[adjacency[a] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                        shared++;
+                        continue;
+                    }
+                    uint32_t moved[3];
+                    for (size_t k = 0; k < 3; k++) {
+                        moved[k] = triangle[k] == collapse.from ? collapse.to : triangle[k];
+                    }
+                    double before[3], after[3];
+                    triangleNormal(triangle[0], triangle[1], triangle[2], before);
+                    triangleNormal(moved[0], moved[1], moved[2], after);
+                    double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+                    double lengths = std::sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2])
+                        * std::sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+                    valid = dot > 0.25 * lengths;
+                }
+                if (!valid) {
+                    continue;
+                }
+
+                for (uint32_t a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; a++) {
+                    const uint32_t* triangle = &current[adjacency[a] * 3];
+                    touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+                }
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to].add(quadrics[collapse.from]);
+                maxError = std::max(maxError, collapse.cost);
+                removed += shared;
+            }
+            if (removed == 0) {
+                break;  // 剩下的边都被锁定或者会翻转
+            }
+
+            std::vector<uint32_t> next;
+            next.reserve(current.size());
+            for (size_t t = 0; t + 2 < current.size(); t += 3) {
+                uint32_t i0 = remap[current[t]], i1 = remap[current[t + 1]], i2 = remap[current[t + 2]];
+                if (i0 != i1 && i1 != i2 && i0 != i2) {
+                    next.push_back(i0);
+                    next.push_back(i1);
+                    next.push_back(i2);
+                }
+            }
+            current = std::move(next);
+        }
+
+        if (current.size() > previousCount * LOD_MIN_REDUCTION || current.empty()) {
+            break;
+        }
+        lods.push_back({current, static_cast<float>(std::sqrt(maxError))});
+        previousCount = current.size();
+    }
+    return lods;
+}
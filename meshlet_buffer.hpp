@@ -0,0 +1,130 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "free_ranges.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "meshlet_builder.hpp"
+
+// meshlet：mesh的meshlet在共享buffer中的位置，firstMeshlet是task shader读取的起点
+// world streaming：meshlet顶点和三角形的区间只用于卸载时归还
+struct MeshletRange {
+    uint32_t firstMeshlet = 0;
+    uint32_t meshletCount = 0;
+    uint32_t firstVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstTriangle = 0;
+    uint32_t triangleCount = 0;
+};
+
+// meshlet：所有mesh的meshlet、meshlet顶点和三角形放在同一个storage buffer的三个区域中，和geometry buffer一样只绑定一次
+// visibility区域每个meshlet一个uint，由task shader写入，记录第一阶段画过的meshlet，不从cpu上传
+// 区域的起点按256字节对齐，满足所有设备的minStorageBufferOffsetAlignment
+// world streaming：卸载的模型归还meshlet，每个区域和geometry buffer一样维护空闲区间；visibility和meshlets使用相同的index，不单独分配
+class MeshletBuffer {
+public:
+    enum Region {
+        meshlets,
+        vertices,
+        triangles,
+        visibility,
+        regionCount,
+    };
+
+    // extraUsage：比如descriptor buffer需要查询buffer的device address
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, uint32_t maxMeshlets, uint32_t maxVertices, uint32_t maxTriangles,
+        const std::vector<uint32_t>& queueFamilies, VkBufferUsageFlags extraUsage = 0) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_capacity[meshlets] = maxMeshlets;
+        m_capacity[vertices] = maxVertices;
+        m_capacity[triangles] = maxTriangles;
+        m_capacity[visibility] = maxMeshlets;
+        for (int region = 0; region < visibility; region++) {
+            m_free[region].reset(m_capacity[region]);
+        }
+
+        VkDeviceSize offset = 0;
+        VkDeviceSize elementSizes[regionCount] = {sizeof(Meshlet), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t)};
+        for (int region = 0; region < regionCount; region++) {
+            m_regionOffset[region] = offset;
+            m_regionSize[region] = elementSizes[region] * m_capacity[region];
+            offset = (offset + m_regionSize[region] + 255) / 256 * 256;
+        }
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = offset;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | extraUsage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (queueFamilies.size() > 1) {  // geometry buffer：传输队列上传时图形队列可能正在读取其它mesh
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+            bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+        }
+
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &m_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create meshlet buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, m_buffer, &memRequirements);
+        m_allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, MemoryCategory::geometry,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "meshlet buffer");
+        vkBindBufferMemory(m_device, m_buffer, m_allocation.memory, m_allocation.offset);
+    }
+
+    void cleanup() {
+        if (m_buffer == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyBuffer(m_device, m_buffer, hostAllocator());
+        m_allocator->free(m_allocation);
+        m_buffer = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_buffer != VK_NULL_HANDLE; }
+
+    // meshlet：分配count个元素，返回元素index，空间不足时抛出异常
+    uint32_t allocate(Region region, uint32_t count) {
+        uint32_t first = 0;
+        if (!m_free[region].take(count, first)) {
+            throw std::runtime_error("meshlet buffer out of space!");
+        }
+        return first;
+    }
+
+    // world streaming：归还一个mesh的meshlet，调用者需要保证gpu已经不再使用
+    void free(const MeshletRange& range) {
+        m_free[meshlets].give(range.firstMeshlet, range.meshletCount);
+        m_free[vertices].give(range.firstVertex, range.vertexCount);
+        m_free[triangles].give(range.firstTriangle, range.triangleCount);
+    }
+
+    VkBuffer buffer() const { return m_buffer; }
+    bool hostVisible() const { return m_allocation.mapped != nullptr; }
+    void* mapped() const { return m_allocation.mapped; }
+
+    // meshlet：元素在buffer中的字节偏移，用于拷贝命令；regionOffset和regionSize用于descriptor
+    VkDeviceSize byteOffset(Region region, uint32_t element) const {
+        VkDeviceSize elementSize = region == meshlets ? sizeof(Meshlet) : sizeof(uint32_t);
+        return m_regionOffset[region] + elementSize * element;
+    }
+    VkDeviceSize regionOffset(Region region) const { return m_regionOffset[region]; }
+    VkDeviceSize regionSize(Region region) const { return m_regionSize[region]; }
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    Allocation m_allocation;
+    uint32_t m_capacity[regionCount] = {};
+    FreeRanges m_free[visibility];
+    VkDeviceSize m_regionOffset[regionCount] = {};
+    VkDeviceSize m_regionSize[regionCount] = {};
+};
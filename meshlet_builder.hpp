@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// meshlet：导入时把mesh切成最多64个顶点、124个三角形的小块，mesh shader每个workgroup输出一个meshlet
+// 每个meshlet带有包围球和法线锥，task shader按meshlet做视锥剔除和背面剔除，不可见的meshlet不会启动mesh shader
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;  // 124 * 3个uint8索引加上顶点数据刚好放进大部分gpu的输出限制
+
+// meshlet：布局和meshlet.task、meshlet.mesh中的std430结构一致，写入mesh cache后直接上传
+// 包围体在量化之前的模型空间中；coneCutoff为1时法线锥退化，不做背面剔除
+struct Meshlet {
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;  // 法线锥半角的正弦，剔除条件是dot(center - camera, axis) >= cutoff * |center - camera| + radius
+    uint32_t vertexOffset;  // 在meshlet顶点数组中的位置
+    uint32_t triangleOffset;  // 在meshlet三角形数组中的位置
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// meshlet：vertices是meshlet的局部顶点到mesh顶点的index，triangles每个元素是一个三角形的3个8位局部索引
+struct MeshletData {
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> vertices;
+    std::vector<uint32_t> triangles;
+};
+
+// meshlet：包围球取包围盒中心，半径是到最远顶点的距离
+// 法线锥的轴是三角形法线的平均方向，最小的夹角余弦小于等于0时锥超过半球，背面剔除不可能成立
+inline void computeMeshletBounds(Meshlet& meshlet, const MeshletData& data, const float* positions, size_t positionStride) {
+    auto position = [&](uint32_t index) {
+        return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) + index * positionStride);
+    };
+
+    float boundsMin[3] = {INFINITY, INFINITY, INFINITY};
+    float boundsMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        const float* p = position(data.vertices[meshlet.vertexOffset + i]);
+        for (int k = 0; k < 3; k++) {
+            boundsMin[k] = std::min(boundsMin[k], p[k]);
+            boundsMax[k] = std::max(boundsMax[k], p[k]);
+        }
+    }
+    float radius = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        meshlet.center[k] = (boundsMin[k] + boundsMax[k]) * 0.5f;
+    }
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+        const float* p = position(data.vertices[meshlet.vertexOffset + i]);
+        float dx = p[0] - meshlet.center[0], dy = p[1] - meshlet.center[1], dz = p[2] - meshlet.center[2];
+        radius = std::max(radius, dx * dx + dy * dy + dz * dz);
+    }
+    meshlet.radius = std::sqrt(radius);
+
+    std::vector<float> normals;
+    normals.reserve(meshlet.triangleCount * 3);
+    float axis[3] = {0.0f, 0.0f, 0.0f};
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+        uint32_t packed = data.triangles[meshlet.triangleOffset + t];
+        const float* p0 = position(data.vertices[meshlet.vertexOffset + (packed & 0xff)]);
+        const float* p1 = position(data.vertices[meshlet.vertexOffset + ((packed >> 8) & 0xff)]);
+        const float* p2 = position(data.vertices[meshlet.vertexOffset + ((packed >> 16) & 0xff)]);
+        float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0f) {
+            continue;  // 退化三角形没有方向
+        }
+        for (int k = 0; k < 3; k++) {
+            normals.push_back(n[k] / length);
+            axis[k] += n[k] / length;
+        }
+    }
+
+    meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+    meshlet.coneCutoff = 1.0f;
+    float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (axisLength == 0.0f) {
+        return;
+    }
+    float minDot = 1.0f;
+    for (size_t i = 0; i < normals.size(); i += 3) {
+        minDot = std::min(minDot, (normals[i] * axis[0] + normals[i + 1] * axis[1] + normals[i + 2] * axis[2]) / axisLength);
+    }
+    if (minDot <= 0.0f) {
+        return;
+    }
+    for (int k = 0; k < 3; k++) {
+        meshlet.coneAxis[k] = axis[k] / axisLength;
+    }
+    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);  // 法线锥两边各加90度再取反，cos(a + 90)取反就是sin(a)
+}
+
+// meshlet：按三角形顺序贪心切分，顶点数或三角形数超过限制时开始下一个meshlet，结果追加到data
+// 索引应该已经经过mesh optimizer排序，相邻的三角形共享顶点，每个meshlet的顶点复用率更高
+inline void buildMeshlets(const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride, size_t vertexCount, MeshletData& data) {
+    std::vector<uint32_t> owner(vertexCount, UINT32_MAX);  // 顶点当前属于哪个meshlet
+    std::vector<uint8_t> localIndex(vertexCount, 0);
+
+    Meshlet current{};
+    current.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+    current.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+    uint32_t currentId = static_cast<uint32_t>(data.meshlets.size());
+    auto finish = [&]() {
+        computeMeshletBounds(current, data, positions, positionStride);
+        data.meshlets.push_back(current);
+        current = Meshlet{};
+        current.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+        current.triangleOffset = static_cast<uint32_t>(data.triangles.size());
+        currentId++;
+    };
+
+    for (size_t t = 0; t + 2 < indexCount; t += 3) {
+        uint32_t added = 0;
+        for (size_t k = 0; k < 3; k++) {
+            added += owner[indices[t + k]] != currentId ? 1 : 0;
+        }
+        if (current.vertexCount + added > MESHLET_MAX_VERTICES || current.triangleCount + 1 > MESHLET_MAX_TRIANGLES) {
+            finish();
+        }
+
+        uint32_t packed = 0;
+        for (size_t k = 0; k < 3; k++) {
+            uint32_t index = indices[t + k];
+            if (owner[index] != currentId) {
+                owner[index] = currentId;
+                localIndex[index] = static_cast<uint8_t>(current.vertexCount++);
+                data.vertices.push_back(index);
+            }
+            packed |= static_cast<uint32_t>(localIndex[index]) << (8 * k);
+        }
+        data.triangles.push_back(packed);
+        current.triangleCount++;
+    }
+    if (current.triangleCount > 0) {
+        finish();
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// model loader：模型的读取、导入和优化在后台执行，启动时不再阻塞在loadModel中
+// async task：每个模型是一个coroutine，导入在job pool中执行，完成后在主线程录制上传，upload context的ticket完成后模型才变成resident
+// 后台只产生cpu上的数据，上传命令的录制和vulkan对象的创建仍然在主线程，和texture streamer一样；在resident之前绘制占位mesh
+enum class ModelState {
+    loading,  // 后台导入中
+    uploading,  // 上传已提交，等待gpu
+    resident,  // 可以绘制
+    failed,
+};
+
+// slot map：和TextureHandle一样是SlotMap的generational handle，INVALID_MODEL_HANDLE等于SlotMap::INVALID
+using ModelHandle = uint32_t;
+const ModelHandle INVALID_MODEL_HANDLE = UINT32_MAX;
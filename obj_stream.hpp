@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "mesh_cache.hpp"
+
+// obj stream：按行流式解析映射的obj文件，每读到一个面就拆成三角形，逐个corner交给回调
+// tinyobj::LoadObj先把整个文件变成attrib_t和每个shape的index_t数组（每个corner 12字节），法线也全部保存，之后才开始组装顶点
+// 这里只保留面引用需要的位置和uv数组，corner在解析的同时去重组装，不产生中间的索引数组；法线、材质、分组都跳过
+// 每解析完chunkSize字节，映射中已经读过的页面交还给内核，常驻内存接近位置和uv数组加上输出的大小
+// 支持v、vt和f（v、v/vt、v//vn、v/vt/vn以及负数的相对索引），不支持行尾的\续行
+namespace obj_stream_detail {
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+inline const char* skipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+inline const char* skipLine(const char* p, const char* end) {
+    while (p < end && *p != '\n') {
+        p++;
+    }
+    return p < end ? p + 1 : end;
+}
+
+// obj stream：十进制浮点数，只累积前19位有效数字，乘10的幂用double计算，结果和strtof最多相差float的最后一位
+// 没有数字时返回p本身
+inline const char* parseFloat(const char* p, const char* end, float& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for (; p < end && isDigit(*p); p++) {
+        any = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            digits += mantissa != 0 ? 1 : 0;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                digits += mantissa != 0 ? 1 : 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any) {
+        return start;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negativeExponent = *e == '-';
+            e++;
+        }
+        if (e < end && isDigit(*e)) {
+            int value = 0;
+            for (; e < end && isDigit(*e); e++) {
+                value = std::min(value * 10 + (*e - '0'), 10000);
+            }
+            exponent += negativeExponent ? -value : value;
+            p = e;
+        }
+    }
+    double result = static_cast<double>(mantissa) * std::pow(10.0, exponent);
+    value = static_cast<float>(negative ? -result : result);
+    return p;
+}
+
+inline const char* parseInt(const char* p, const char* end, int64_t& value) {
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p >= end || !isDigit(*p)) {
+        return start;
+    }
+    int64_t result = 0;
+    for (; p < end && isDigit(*p); p++) {
+        result = result * 10 + (*p - '0');
+    }
+    value = negative ? -result : result;
+    return p;
+}
+
+// obj stream：obj的索引从1开始，负数相对于当前已经读到的数量
+inline size_t resolveIndex(int64_t index, size_t count) {
+    int64_t resolved = index < 0 ? static_cast<int64_t>(count) + index : index - 1;
+    if (index == 0 || resolved < 0 || resolved >= static_cast<int64_t>(count)) {
+        throw std::runtime_error("obj index out of range!");
+    }
+    return static_cast<size_t>(resolved);
+}
+}  // namespace obj_stream_detail
+
+struct ObjStreamStats {
+    size_t positions = 0;
+    size_t texCoords = 0;
+    size_t triangles = 0;
+};
+
+// obj stream：索引形式的解析，位置和uv追加到positions（每个3个float）和texCoords（每个2个float）
+// corner(size_t position, size_t texCoord)收到的是这两个数组中的编号，texCoord在面没有uv时为SIZE_MAX，每个三角形连续调用三次
+// gpu mesh import直接上传这些编号，在gpu上去重
+template <typename Corner>
+ObjStreamStats parseObjStreamIndices(MappedFile& file, size_t chunkSize, std::vector<float>& positions, std::vector<float>& texCoords, Corner&& corner) {
+    using namespace obj_stream_detail;
+    const char* data = file.data();
+    const char* end = data + file.size();
+    ObjStreamStats stats;
+
+    struct FaceCorner {
+        size_t position;
+        size_t texCoord;  // SIZE_MAX表示没有uv
+    };
+    auto emit = [&](const FaceCorner& c) { corner(c.position, c.texCoord); };
+    auto distance2 = [&](const FaceCorner& a, const FaceCorner& b) {
+        float dx = positions[b.position * 3] - positions[a.position * 3];
+        float dy = positions[b.position * 3 + 1] - positions[a.position * 3 + 1];
+        float dz = positions[b.position * 3 + 2] - positions[a.position * 3 + 2];
+        return dx * dx + dy * dy + dz * dz;
+    };
+    std::vector<FaceCorner> face;  // 当前面的corner，容量在面之间复用
+
+    size_t discarded = 0;
+    const char* p = data;
+    while (p < end) {
+        // obj stream：读过的部分超过一个chunk时交还给内核
+        size_t offset = static_cast<size_t>(p - data);
+        if (offset - discarded >= chunkSize) {
+            file.discard(discarded, offset - discarded);
+            discarded = offset;
+        }
+
+        p = skipSpaces(p, end);
+        if (p + 1 < end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            p += 2;
+            for (int i = 0; i < 3; i++) {
+                float value = 0.0f;
+                const char* start = skipSpaces(p, end);
+                const char* next = parseFloat(start, end, value);
+                if (next == start) {
+                    throw std::runtime_error("obj vertex has fewer than three coordinates!");
+                }
+                positions.push_back(value);
+                p = next;
+            }
+        } else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+            p += 3;
+            for (int i = 0; i < 2; i++) {  // 只有u时v为0，和tinyobj一致
+                float value = 0.0f;
+                p = parseFloat(skipSpaces(p, end), end, value);
+                texCoords.push_back(value);
+            }
+        } else if (p + 1 < end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            p += 2;
+            size_t positionCount = positions.size() / 3;
+            size_t texCoordCount = texCoords.size() / 2;
+            face.clear();
+            while (true) {
+                p = skipSpaces(p, end);
+                int64_t index = 0;
+                const char* next = parseInt(p, end, index);
+                if (next == p) {
+                    break;
+                }
+                p = next;
+                FaceCorner current{resolveIndex(index, positionCount), SIZE_MAX};
+                if (p < end && *p == '/') {
+                    p++;
+                    int64_t texCoord = 0;
+                    next = parseInt(p, end, texCoord);
+                    if (next != p) {
+                        current.texCoord = resolveIndex(texCoord, texCoordCount);
+                        p = next;
+                    }
+                    if (p < end && *p == '/') {  // 法线不使用
+                        int64_t normal = 0;
+                        p = parseInt(p + 1, end, normal);
+                    }
+                }
+                face.push_back(current);
+            }
+
+            // obj stream：四边形和tinyobj一样沿较短的对角线拆分，输出的三角形相同；更多边的面按fan拆分，只适用于凸多边形
+            if (face.size() == 4) {
+                bool split02 = distance2(face[0], face[2]) < distance2(face[1], face[3]);
+                const uint32_t order[2][6] = {{0, 1, 3, 1, 2, 3}, {0, 1, 2, 0, 2, 3}};
+                for (uint32_t i : order[split02 ? 1 : 0]) {
+                    emit(face[i]);
+                }
+                stats.triangles += 2;
+            } else {
+                for (size_t i = 2; i < face.size(); i++) {
+                    emit(face[0]);
+                    emit(face[i - 1]);
+                    emit(face[i]);
+                    stats.triangles++;
+                }
+            }
+        }
+        p = skipLine(p, end);
+    }
+
+    stats.positions = positions.size() / 3;
+    stats.texCoords = texCoords.size() / 2;
+    return stats;
+}
+
+// obj stream：corner(const float* position, const float* texCoord)，texCoord在面没有uv时为nullptr，每个三角形连续调用三次
+// 指针只在回调期间有效
+template <typename Corner>
+ObjStreamStats parseObjStream(MappedFile& file, size_t chunkSize, Corner&& corner) {
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    return parseObjStreamIndices(file, chunkSize, positions, texCoords, [&](size_t position, size_t texCoord) {
+        corner(&positions[position * 3], texCoord == SIZE_MAX ? nullptr : &texCoords[texCoord * 2]);
+    });
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+
+// scene objects：每个mesh的数据，布局和shader中的SceneObject一致（std430，数组元素按16字节对齐）
+// 包围盒在sceneModel之前的空间，已经乘上mesh的变换，和m_meshBounds相同
+// materials：纹理和atlas区域在材质表中，这里只有材质编号
+struct SceneObject {
+    alignas(16) glm::mat4 model;  // compact vertex：解量化变换，shader中再乘上ubo的sceneModel
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    uint32_t materialIndex;
+    uint32_t padding[3];
+};
+static_assert(sizeof(SceneObject) == 112, "SceneObject must match the std430 SceneObject array stride");
+
+// scene objects：所有mesh的SceneObject按mesh编号排在一个storage buffer中，set 0的binding 5一次绑定覆盖整个场景
+// storage buffer的range只受maxStorageBufferRange限制，不像ubo受maxUniformBufferRange（常见64KB）限制；compute pass也可以按mesh编号读取
+// 和indirect draw buffer一样每个frame in flight一份持久映射的buffer，每帧写入可见的mesh，cache的command buffer只引用buffer
+class SceneObjectBuffer {
+public:
+    // extraUsage：descriptor buffer需要的device address
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, uint32_t capacity, uint32_t frameCount, VkBufferUsageFlags extraUsage) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_capacity = capacity;
+
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = range();
+            bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | extraUsage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &frame.buffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create scene object buffer!");
+            }
+
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(m_device, frame.buffer, &memRequirements);
+            frame.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true,
+                MemoryCategory::geometry, 0, "scene objects");
+            vkBindBufferMemory(m_device, frame.buffer, frame.allocation.memory, frame.allocation.offset);
+        }
+    }
+
+    void cleanup() {
+        for (Frame& frame : m_frames) {
+            vkDestroyBuffer(m_device, frame.buffer, hostAllocator());
+            m_allocator->free(frame.allocation);
+        }
+        m_frames.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    uint32_t capacity() const { return m_capacity; }
+
+    // scene objects：调用者需要保证gpu已经完成上次使用这一帧的命令，index不能超过capacity
+    void write(uint32_t frameIndex, uint32_t index, const SceneObject& object) {
+        memcpy(static_cast<SceneObject*>(m_frames[frameIndex].allocation.mapped) + index, &object, sizeof(object));
+    }
+
+    VkBuffer buffer(uint32_t frameIndex) const { return m_frames[frameIndex].buffer; }
+    VkDeviceSize range() const { return VkDeviceSize(sizeof(SceneObject)) * m_capacity; }
+
+private:
+    struct Frame {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_capacity = 0;
+    std::vector<Frame> m_frames;
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+
+// occlusion queries：比hi-z便宜的遮挡剔除，大的物体在不透明的绘制之后画一次包围盒，不写color和depth，每个物体一个occlusion query
+// render pass结束之后vkCmdCopyQueryPoolResults把结果拷贝进predicate buffer，下一帧的draw用VK_EXT_conditional_rendering读取，结果为0时gpu跳过这个draw
+// 延迟一帧，cpu不读取结果；每个frame in flight一个query pool和一段predicate，上一帧的段由上一帧的command buffer写入，同一个队列上的barrier保证顺序
+// 物体用调用者的编号表示，每帧的列表按编号排序；上一帧没有查询的物体这一帧不使用predicate，照常绘制
+class OcclusionQueries {
+public:
+    static bool supported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalFeatures{};
+        conditionalFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &conditionalFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return conditionalFeatures.conditionalRendering;
+    }
+
+    // occlusion queries：capacity是每帧查询的物体上限，frameCount是frame in flight的最大值
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, uint32_t capacity, uint32_t frameCount) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_capacity = capacity;
+        m_beginConditionalRendering = (PFN_vkCmdBeginConditionalRenderingEXT) vkGetDeviceProcAddr(device, "vkCmdBeginConditionalRenderingEXT");
+        m_endConditionalRendering = (PFN_vkCmdEndConditionalRenderingEXT) vkGetDeviceProcAddr(device, "vkCmdEndConditionalRenderingEXT");
+        if (m_beginConditionalRendering == nullptr || m_endConditionalRendering == nullptr) {
+            throw std::runtime_error("failed to load conditional rendering functions!");
+        }
+
+        m_pools.resize(frameCount);
+        for (VkQueryPool& pool : m_pools) {
+            VkQueryPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            poolInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+            poolInfo.queryCount = capacity;
+            if (vkCreateQueryPool(device, &poolInfo, hostAllocator(), &pool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create occlusion query pool!");
+            }
+        }
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = sizeof(uint32_t) * VkDeviceSize(capacity) * frameCount;
+        bufferInfo.usage = VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(device, &bufferInfo, hostAllocator(), &m_predicates) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create conditional rendering buffer!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, m_predicates, &memRequirements);
+        m_predicateAllocation = allocator.allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true, MemoryCategory::other,
+            0, "occlusion predicates");
+        vkBindBufferMemory(device, m_predicates, m_predicateAllocation.memory, m_predicateAllocation.offset);
+        // occlusion queries：初始值都是1（绘制），第一次拷贝之前不会被读取，只是保险
+        std::fill_n(static_cast<uint32_t*>(m_predicateAllocation.mapped), size_t(capacity) * frameCount, 1u);
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        for (VkQueryPool pool : m_pools) {
+            vkDestroyQueryPool(m_device, pool, hostAllocator());
+        }
+        m_pools.clear();
+        vkDestroyBuffer(m_device, m_predicates, hostAllocator());
+        m_allocator->free(m_predicateAllocation);
+        m_predicates = VK_NULL_HANDLE;
+        m_current.clear();
+        m_previous.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+    uint32_t capacity() const { return m_capacity; }
+
+    // occlusion queries：每帧录制之前调用一次，objects是这一帧要查询的物体，按编号排序，超过capacity的部分丢弃
+    // 上一帧的列表和frame in flight保留下来，这一帧的draw读取它们的结果
+    void beginFrame(uint32_t frameIndex, const std::vector<uint32_t>& objects) {
+        m_previous.swap(m_current);
+        m_previousFrame = m_currentFrame;
+        m_currentFrame = frameIndex;
+        m_current.assign(objects.begin(), objects.begin() + std::min<size_t>(objects.size(), m_capacity));
+    }
+
+    const std::vector<uint32_t>& queried() const { return m_current; }
+
+    // occlusion queries：在render pass之外录制，query在使用之前必须reset
+    void recordReset(VkCommandBuffer commandBuffer) const {
+        if (!m_current.empty()) {
+            vkCmdResetQueryPool(commandBuffer, m_pools[m_currentFrame], 0, static_cast<uint32_t>(m_current.size()));
+        }
+    }
+
+    // occlusion queries：query是物体在queried()中的位置；列表中的每个query都必须begin和end，否则拷贝时的WAIT_BIT会一直等待
+    void beginQuery(VkCommandBuffer commandBuffer, uint32_t query) const {
+        vkCmdBeginQuery(commandBuffer, m_pools[m_currentFrame], query, 0);  // 不需要PRECISE_BIT，条件渲染只关心是否为0
+    }
+
+    void endQuery(VkCommandBuffer commandBuffer, uint32_t query) const {
+        vkCmdEndQuery(commandBuffer, m_pools[m_currentFrame], query);
+    }
+
+    // occlusion queries：在render pass结束之后录制；上一次使用这一段的帧的条件渲染读取完成之后才能覆盖，拷贝完成之后下一帧的条件渲染才能读取
+    void recordCopy(VkCommandBuffer commandBuffer) const {
+        if (m_current.empty()) {
+            return;
+        }
+        VkDeviceSize offset = predicateOffset(m_currentFrame, 0);
+        VkDeviceSize size = sizeof(uint32_t) * VkDeviceSize(m_current.size());
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = m_predicates;
+        barrier.offset = offset;
+        barrier.size = size;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        vkCmdCopyQueryPoolResults(commandBuffer, m_pools[m_currentFrame], 0, static_cast<uint32_t>(m_current.size()), m_predicates, offset, sizeof(uint32_t),
+            VK_QUERY_RESULT_WAIT_BIT);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    // occlusion queries：上一帧和这一帧都查询了object时开始条件渲染并返回true，之后的draw结束时调用endConditional
+    // 这一帧不查询的物体（比如相机进入了包围盒）不使用上一帧的结果
+    bool beginConditional(VkCommandBuffer commandBuffer, uint32_t object) const {
+        if (!predicated(object)) {
+            return false;
+        }
+        auto found = std::lower_bound(m_previous.begin(), m_previous.end(), object);
+        VkConditionalRenderingBeginInfoEXT beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+        beginInfo.buffer = m_predicates;
+        beginInfo.offset = predicateOffset(m_previousFrame, static_cast<uint32_t>(found - m_previous.begin()));
+        m_beginConditionalRendering(commandBuffer, &beginInfo);
+        return true;
+    }
+
+    bool predicated(uint32_t object) const {
+        return std::binary_search(m_previous.begin(), m_previous.end(), object) && std::binary_search(m_current.begin(), m_current.end(), object);
+    }
+
+    void endConditional(VkCommandBuffer commandBuffer) const {
+        m_endConditionalRendering(commandBuffer);
+    }
+
+    // command cache：录制的命令引用的frame in flight、查询的物体和读取的predicate位置
+    uint64_t key() const {
+        uint64_t key = 0xcbf29ce484222325ull;
+        auto mix = [&key](uint64_t value) {
+            key = (key ^ value) * 0x100000001b3ull;
+        };
+        mix(m_currentFrame);
+        mix(m_previousFrame);
+        for (const std::vector<uint32_t>* list : {&m_current, &m_previous}) {
+            mix(list->size());
+            for (uint32_t object : *list) {
+                mix(object);
+            }
+        }
+        return key;
+    }
+
+private:
+    VkDeviceSize predicateOffset(uint32_t frameIndex, uint32_t query) const {
+        return sizeof(uint32_t) * (VkDeviceSize(frameIndex) * m_capacity + query);
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_capacity = 0;
+    PFN_vkCmdBeginConditionalRenderingEXT m_beginConditionalRendering = nullptr;
+    PFN_vkCmdEndConditionalRenderingEXT m_endConditionalRendering = nullptr;
+    std::vector<VkQueryPool> m_pools;
+    VkBuffer m_predicates = VK_NULL_HANDLE;
+    Allocation m_predicateAllocation;
+    std::vector<uint32_t> m_current;  // 这一帧查询的物体
+    std::vector<uint32_t> m_previous;  // 上一帧查询的物体，结果在m_previousFrame的段中
+    uint32_t m_currentFrame = 0;
+    uint32_t m_previousFrame = 0;
+};
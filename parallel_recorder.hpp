@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "device_dispatch.hpp"
+#include "host_memory.hpp"
+
+// parallel recording：draw分成多段，每段在job pool中录制进自己的secondary command buffer，primary按段的顺序vkCmdExecuteCommands
+// command pool必须外部同步，每个录制目标（frame in flight，或者command cache的一个条目）为每一段创建自己的pool
+// 一段对应一个job，job只在一个线程上执行，所以段之间不共享pool，也不需要加锁
+class ParallelRecorder {
+public:
+    void init(VkDevice device, uint32_t queueFamily, uint32_t segmentCount) {
+        m_device = device;
+        m_queueFamily = queueFamily;
+        m_segmentCount = segmentCount;
+    }
+
+    void cleanup() {
+        for (Target& target : m_targets) {
+            for (Segment& segment : target.segments) {
+                vkDestroyCommandPool(m_device, segment.pool, hostAllocator());  // secondary command buffer随pool一起释放
+            }
+        }
+        m_targets.clear();
+    }
+
+    uint32_t segmentCount() const { return m_segmentCount; }
+
+    // parallel recording：重新录制某个目标之前调用，调用者需要保证gpu已经完成使用这个目标的primary，之前的secondary全部失效
+    void beginTarget(size_t targetIndex) {
+        while (m_targets.size() <= targetIndex) {
+            m_targets.push_back(createTarget());
+        }
+        for (Segment& segment : m_targets[targetIndex].segments) {
+            vkResetCommandPool(m_device, segment.pool, 0);
+            segment.used = 0;
+        }
+    }
+
+    // parallel recording：在job中调用，返回已经begin的secondary command buffer，每段每次录制只取一个
+    // secondary不继承任何状态，pipeline、descriptor和dynamic state都要在里面重新设置
+    VkCommandBuffer beginSecondary(size_t targetIndex, uint32_t segmentIndex, const VkCommandBufferInheritanceInfo& inheritance) {
+        Segment& segment = m_targets[targetIndex].segments[segmentIndex];
+        if (segment.used == segment.commandBuffers.size()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = segment.pool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+            VkCommandBuffer commandBuffer;
+            if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate secondary command buffer!");
+            }
+            segment.commandBuffers.push_back(commandBuffer);
+        }
+        VkCommandBuffer commandBuffer = segment.commandBuffers[segment.used++];
+
+        // command cache：同一次录制可能被提交多次，不使用ONE_TIME_SUBMIT
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritance;
+        if (DeviceDispatch::beginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording secondary command buffer!");
+        }
+        return commandBuffer;
+    }
+
+private:
+    struct Segment {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> commandBuffers;
+        size_t used = 0;
+    };
+
+    struct Target {
+        std::vector<Segment> segments;
+    };
+
+    Target createTarget() {
+        Target target;
+        target.segments.resize(m_segmentCount);
+        for (Segment& segment : target.segments) {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;  // 整个pool一起重置，不需要单独重置command buffer
+            poolInfo.queueFamilyIndex = m_queueFamily;
+            if (vkCreateCommandPool(m_device, &poolInfo, hostAllocator(), &segment.pool) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create secondary command pool!");
+            }
+        }
+        return target;
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    uint32_t m_queueFamily = 0;
+    uint32_t m_segmentCount = 0;
+    std::vector<Target> m_targets;
+};
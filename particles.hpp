@@ -0,0 +1,382 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "gpu_sort.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// particles：发射和模拟参数，record时写进particles.comp的push constant
+struct ParticleEmitter {
+    glm::vec3 position{0.0f};
+    float radius = 0.0f;  // 在这个半径的球内均匀发射
+    glm::vec3 velocity{0.0f};
+    float spread = 0.0f;  // 初速度在每个轴上的随机扰动
+    glm::vec3 gravity{0.0f};
+    float minLifetime = 1.0f;
+    float maxLifetime = 1.0f;
+    float size = 0.01f;  // 四边形的半边长，世界空间
+};
+
+// particles：粒子的发射、模拟、压缩和draw参数全部在compute shader中完成，cpu每帧只提交发射数量和时间步长，不访问任何一个粒子
+// 存活列表有两份交替使用：模拟读取上一帧的列表，存活的粒子通过原子计数追加到另一份，同时写入这一帧的实例数据，死亡的粒子回到空闲列表
+// 发射从空闲列表原子地取出编号，追加到同一份列表；最后一个线程把存活数量写进vkCmdDrawIndirect的instanceCount和下一帧模拟的dispatch参数
+// sorted时按到相机的距离从远到近排序实例（alpha混合需要），GpuRadixSort只排序存活的粒子，数量由gpu读取，dispatch数量和粒子数量无关
+// 所有状态只有一份，同一个队列中前后帧的命令按提交顺序执行，开头的barrier等待上一帧的draw读完实例和draw参数
+class ParticleSystem {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;  // 和particles.comp的local_size_x一致
+    static constexpr uint32_t INSTANCE_BINDING = 0;
+    static constexpr uint32_t INSTANCE_STRIDE = 20;  // vec4位置和大小，加上RGBA8的颜色
+
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, VkCommandPool commandPool,
+        uint32_t frameCount, uint32_t capacity, bool sorted, const SpirvCode& sortShaderCode) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_commandPool = commandPool;
+        m_capacity = capacity;
+        m_sorted = sorted;
+        m_needsReset = true;
+        createPipeline(pipelineCache, shaderCode);
+
+        VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        m_particles = createBuffer(VkDeviceSize(capacity) * sizeof(glm::vec4) * 2, storage, "particles");
+        m_alive = createBuffer(VkDeviceSize(capacity) * sizeof(uint32_t) * 2, storage, "particle alive lists");
+        m_dead = createBuffer(VkDeviceSize(capacity) * sizeof(uint32_t), storage, "particle dead list");
+        m_state = createBuffer(sizeof(State), storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, "particle state");
+        m_instances = createBuffer(VkDeviceSize(capacity) * INSTANCE_STRIDE, storage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "particle instances");
+        if (sorted) {
+            m_keys = createBuffer(VkDeviceSize(capacity) * sizeof(glm::uvec2), storage, "particle sort keys");
+            m_sortedInstances = createBuffer(VkDeviceSize(capacity) * INSTANCE_STRIDE, storage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "particle sorted instances");
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNT};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = 1;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create particle descriptor pool!");
+        }
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = m_descriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkAllocateDescriptorSets(m_device, &setInfo, &m_descriptorSet) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate particle descriptor set!");
+        }
+
+        // particles：不排序时binding 5和6不会被访问，绑定实例buffer让descriptor有效
+        VkBuffer keys = sorted ? m_keys.buffer : m_instances.buffer;
+        VkBuffer sortedInstances = sorted ? m_sortedInstances.buffer : m_instances.buffer;
+        std::array<VkDescriptorBufferInfo, BINDING_COUNT> bufferInfos = {{{m_particles.buffer, 0, VK_WHOLE_SIZE}, {m_alive.buffer, 0, VK_WHOLE_SIZE},
+            {m_dead.buffer, 0, VK_WHOLE_SIZE}, {m_state.buffer, 0, VK_WHOLE_SIZE}, {m_instances.buffer, 0, VK_WHOLE_SIZE}, {keys, 0, VK_WHOLE_SIZE},
+            {sortedInstances, 0, VK_WHOLE_SIZE}}};
+        std::array<VkWriteDescriptorSet, BINDING_COUNT> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = m_descriptorSet;
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        if (sorted) {  // particles：元素数量是State开头的aliveCount
+            m_sort.init(device, allocator, pipelineCache, sortShaderCode, capacity, m_keys.buffer, m_state.buffer);
+        }
+
+        m_commandBuffers.resize(frameCount);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = frameCount;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate particle command buffers!");
+        }
+    }
+
+    // particles：调用者保证gpu已经空闲
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_commandBuffers.size()), m_commandBuffers.data());
+        m_commandBuffers.clear();
+        m_sort.cleanup();
+        for (Buffer* buffer : {&m_particles, &m_alive, &m_dead, &m_state, &m_instances, &m_keys, &m_sortedInstances}) {
+            if (buffer->buffer != VK_NULL_HANDLE) {
+                destroyBuffer(*buffer);
+            }
+        }
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+    bool sorted() const { return m_sorted; }
+
+    // particles：录制这一帧的发射、模拟和排序，emitCount由调用者按发射速率累计；deltaTime为0时粒子停在原处
+    // 调用者保证这个frame in flight上一次的提交已经完成，command buffer可以重新录制
+    VkCommandBuffer record(uint32_t frameIndex, const ParticleEmitter& emitter, uint32_t emitCount, float deltaTime, const glm::vec3& cameraPosition) {
+        VkCommandBuffer commandBuffer = m_commandBuffers[frameIndex];
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording particle command buffer!");
+        }
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+
+        PushConstants constants{};
+        constants.control = glm::uvec4(0, m_parity, emitCount, m_seed++);
+        constants.sort = glm::uvec4(m_capacity, 0, 0, 0);
+        constants.emitterRadius = glm::vec4(emitter.position, emitter.radius);
+        constants.velocitySpread = glm::vec4(emitter.velocity, emitter.spread);
+        constants.gravityDelta = glm::vec4(emitter.gravity, deltaTime);
+        constants.lifetimeSize = glm::vec4(emitter.minLifetime, emitter.maxLifetime, emitter.size, 0.0f);
+        constants.camera = glm::vec4(cameraPosition, 0.0f);
+
+        // particles：上一帧的draw读完实例和draw参数、模拟读完dispatch参数之后才能改写
+        barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+        if (m_needsReset) {  // particles：所有编号进入空闲列表，计数和参数清零
+            dispatch(commandBuffer, constants, PASS_RESET, groups(m_capacity));
+            computeBarrier(commandBuffer);
+            m_needsReset = false;
+        }
+
+        dispatchIndirect(commandBuffer, constants, PASS_SIMULATE);
+        computeBarrier(commandBuffer);
+        if (emitCount > 0) {
+            dispatch(commandBuffer, constants, PASS_EMIT, groups(emitCount));
+            computeBarrier(commandBuffer);
+        }
+        dispatch(commandBuffer, constants, PASS_FINISH, 1);
+        barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+        if (m_sorted) {
+            // particles：key、排序和拷贝都只处理存活的粒子，和下一帧的模拟一样每个存活的粒子一个线程
+            dispatchIndirect(commandBuffer, constants, PASS_SORT_KEYS);
+            computeBarrier(commandBuffer);
+            m_sort.record(commandBuffer, m_parity ^ 1);
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+            dispatchIndirect(commandBuffer, constants, PASS_GATHER);
+        }
+
+        barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record particle command buffer!");
+        }
+        m_parity ^= 1;
+        return commandBuffer;
+    }
+
+    // particles：调用之前已经开始了场景的render pass；pipeline由调用者按场景的attachment创建，只有实例的顶点输入
+    // 录制的命令和粒子数量无关，instanceCount由gpu写入，command cache可以一直复用
+    void draw(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkExtent2D extent) const {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        VkViewport viewport{0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f};
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        VkRect2D scissor{{0, 0}, extent};
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        VkDeviceSize offset = 0;
+        VkBuffer instances = m_sorted ? m_sortedInstances.buffer : m_instances.buffer;
+        vkCmdBindVertexBuffers(commandBuffer, INSTANCE_BINDING, 1, &instances, &offset);
+        vkCmdDrawIndirect(commandBuffer, m_state.buffer, offsetof(State, draw), 1, sizeof(VkDrawIndirectCommand));
+    }
+
+    // particles：draw使用的pipeline的顶点格式，每个实例是位置、大小和颜色，四边形的顶点由gl_VertexIndex生成
+    static void vertexInput(std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes) {
+        bindings = {{INSTANCE_BINDING, INSTANCE_STRIDE, VK_VERTEX_INPUT_RATE_INSTANCE}};
+        attributes = {{0, INSTANCE_BINDING, VK_FORMAT_R32G32B32A32_SFLOAT, 0}, {1, INSTANCE_BINDING, VK_FORMAT_R8G8B8A8_UNORM, sizeof(glm::vec4)}};
+    }
+
+private:
+    static constexpr uint32_t BINDING_COUNT = 7;
+    // particles：和particles.comp中的pass编号一致
+    static constexpr uint32_t PASS_RESET = 0;
+    static constexpr uint32_t PASS_SIMULATE = 1;
+    static constexpr uint32_t PASS_EMIT = 2;
+    static constexpr uint32_t PASS_FINISH = 3;
+    static constexpr uint32_t PASS_SORT_KEYS = 4;
+    static constexpr uint32_t PASS_GATHER = 5;
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    // particles：和particles.comp的State一致，dispatch和draw直接作为indirect参数
+    struct State {
+        uint32_t aliveCount[2];
+        int32_t deadCount;
+        uint32_t padding;
+        VkDispatchIndirectCommand dispatch;
+        uint32_t padding2;
+        VkDrawIndirectCommand draw;
+    };
+
+    // particles：和particles.comp的push constant一致
+    struct PushConstants {
+        glm::uvec4 control;  // pass、这一帧读取的存活列表、发射数量、随机种子
+        glm::uvec4 sort;  // 容量
+        glm::vec4 emitterRadius;
+        glm::vec4 velocitySpread;
+        glm::vec4 gravityDelta;
+        glm::vec4 lifetimeSize;
+        glm::vec4 camera;
+    };
+
+    static uint32_t groups(uint32_t count) { return (count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE; }
+
+    void dispatch(VkCommandBuffer commandBuffer, PushConstants& constants, uint32_t pass, uint32_t groupCount) {
+        constants.control.x = pass;
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+    }
+
+    // particles：线程数是上一次FINISH写入的存活数量
+    void dispatchIndirect(VkCommandBuffer commandBuffer, PushConstants& constants, uint32_t pass) {
+        constants.control.x = pass;
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatchIndirect(commandBuffer, m_state.buffer, offsetof(State, dispatch));
+    }
+
+    static void barrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = srcAccess;
+        memoryBarrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    static void computeBarrier(VkCommandBuffer commandBuffer) {
+        barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create particle descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create particle pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create particle shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create particle compute pipeline!");
+        }
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const char* name) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create particle buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        buffer.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true, MemoryCategory::other, 0, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+        return buffer;
+    }
+
+    void destroyBuffer(Buffer& buffer) {
+        vkDestroyBuffer(m_device, buffer.buffer, hostAllocator());
+        m_allocator->free(buffer.allocation);
+        buffer = {};
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    uint32_t m_capacity = 0;
+    bool m_sorted = false;
+    bool m_needsReset = true;
+    uint32_t m_parity = 0;  // 这一帧模拟读取的存活列表
+    uint32_t m_seed = 0;
+    Buffer m_particles;  // 每个粒子两个vec4：位置和年龄，速度和寿命
+    Buffer m_alive;
+    Buffer m_dead;
+    Buffer m_state;
+    Buffer m_instances;
+    Buffer m_keys;
+    Buffer m_sortedInstances;
+    GpuRadixSort m_sort;
+    std::vector<VkCommandBuffer> m_commandBuffers;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+};
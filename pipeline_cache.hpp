@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_memory.hpp"
+
+// pipeline cache：所有pipeline都通过同一个VkPipelineCache创建，启动时从磁盘读取，退出时写回
+// 驱动可以直接复用上次编译的shader机器码，不需要每次启动都重新编译
+// 缓存数据开头是VkPipelineCacheHeaderVersionOne，vendorID、deviceID或者pipelineCacheUUID不一致时（换了gpu或者驱动更新）丢弃旧数据
+class PipelineCache {
+public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path) {
+        m_device = device;
+        m_path = path;
+        vkGetPhysicalDeviceProperties(physicalDevice, &m_properties);
+
+        std::vector<char> data = readValidCache();
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = data.size();
+        cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+        if (vkCreatePipelineCache(m_device, &cacheInfo, hostAllocator(), &m_cache) != VK_SUCCESS) {
+            // 驱动也可能因为数据损坏拒绝，这时用空的缓存重新创建
+            cacheInfo.initialDataSize = 0;
+            cacheInfo.pInitialData = nullptr;
+            if (vkCreatePipelineCache(m_device, &cacheInfo, hostAllocator(), &m_cache) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create pipeline cache!");
+            }
+        }
+    }
+
+    // pipeline cache：先写入临时文件再重命名，写入中途崩溃不会留下损坏的缓存；写入失败时返回false，下次启动重新编译
+    bool save() const {
+        size_t size = 0;
+        if (vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS || size == 0) {
+            return false;
+        }
+        std::vector<char> data(size);
+        if (vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) != VK_SUCCESS) {
+            return false;
+        }
+
+        std::string tempPath = m_path + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(data.data(), static_cast<std::streamsize>(size));
+        file.close();
+        if (!file) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        std::remove(m_path.c_str());  // 有些平台上rename不会覆盖已有文件
+        return std::rename(tempPath.c_str(), m_path.c_str()) == 0;
+    }
+
+    void cleanup() {
+        if (m_cache == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyPipelineCache(m_device, m_cache, hostAllocator());
+        m_cache = VK_NULL_HANDLE;
+    }
+
+    VkPipelineCache handle() const { return m_cache; }
+
+private:
+    // pipeline cache：文件不存在、被截断或者header和这个设备不一致时返回空数据
+    std::vector<char> readValidCache() const {
+        std::ifstream file(m_path, std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            return {};
+        }
+        std::vector<char> data(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(data.data(), data.size());
+        if (!file || data.size() < sizeof(VkPipelineCacheHeaderVersionOne)) {
+            return {};
+        }
+
+        VkPipelineCacheHeaderVersionOne header;
+        memcpy(&header, data.data(), sizeof(header));
+        if (header.headerSize < sizeof(header) || header.headerSize > data.size() || header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+            || header.vendorID != m_properties.vendorID || header.deviceID != m_properties.deviceID
+            || memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+            return {};
+        }
+        return data;
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPipelineCache m_cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties m_properties{};
+    std::string m_path;
+};
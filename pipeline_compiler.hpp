@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "job_pool.hpp"
+
+// pipeline compiler：pipeline的编译在专用的工作线程上进行，提交后马上返回future，主线程第一次需要时才等待
+// vkCreateGraphicsPipelines和vkCreateShaderModule可以在任意线程调用，所有线程共享内部同步的pipeline cache
+// 和job pool分开是因为job pool的job不能调用vulkan，而且图片解码的parallelFor不应该排在pipeline编译后面
+class PipelineCompiler {
+public:
+    using Job = std::function<VkPipeline()>;
+
+    void init(uint32_t threadCount = 0) {
+        m_pool.init(threadCount);
+    }
+
+    // pipeline compiler：还在队列中的job会先执行完，调用之前应该已经等待了所有future并销毁了返回的pipeline
+    void cleanup() {
+        m_pool.cleanup();
+    }
+
+    // pipeline compiler：job抛出的异常在future.get()时重新抛出
+    std::future<VkPipeline> submit(Job job) {
+        auto task = std::make_shared<std::packaged_task<VkPipeline()>>(std::move(job));
+        std::future<VkPipeline> future = task->get_future();
+        m_inFlight.fetch_add(1, std::memory_order_relaxed);
+        m_pool.submit([this, task]() {
+            (*task)();  // 异常保存在future中，这里不会抛出
+            m_inFlight.fetch_sub(1, std::memory_order_relaxed);
+        });
+        return future;
+    }
+
+    uint32_t threadCount() const { return m_pool.threadCount(); }
+    // hitch detector：已经提交还没有编译完成的pipeline数量
+    uint32_t inFlight() const { return m_inFlight.load(std::memory_order_relaxed); }
+
+private:
+    JobPool m_pool;
+    std::atomic<uint32_t> m_inFlight{0};
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+// pipeline desc：graphics pipeline的固定功能状态（顶点输入、图元、光栅化、深度、混合、attachment）用constexpr的值描述
+// 每种pipeline是一个constexpr的PipelineDesc，fillPipelineState按描述填写Vk*CreateInfo，增加一种pipeline不需要复制整段填写代码
+// key在编译期计算，不同的描述key不同，可以在编译期检查变体之间没有重复，也可以直接作为查找pipeline的key，运行时不需要hash
+// 只和设备或者窗口有关的值（msaa采样数、attachment格式、dynamic state是否支持）不属于描述，填写时从renderer读取
+
+// pipeline desc：scene是场景的完整顶点格式，positionOnly只有位置和实例矩阵，none是没有顶点输入的mesh shader pipeline
+// impostor只有每个实例的ImpostorInstance，四边形的顶点由gl_VertexIndex生成；particle同样只有实例数据，是ParticleSystem写入的实例
+// terrain没有顶点输入但有图元装配，顶点位置由gl_VertexIndex和storage buffer中的patch得到；occlusionBox同样没有顶点输入，立方体的顶点由gl_VertexIndex生成
+// pulled是vertex pulling的场景pipeline，只有逐实例的属性，顶点由vertex shader按gl_VertexIndex从storage buffer读取
+enum class VertexInputDesc : uint8_t {
+    scene,
+    positionOnly,
+    none,
+    impostor,
+    particle,
+    terrain,
+    occlusionBox,
+    pulled,
+};
+
+struct RasterDesc {
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;  // descriptor set：因为mvp矩阵对y轴进行了反转所以视逆时针为正面
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+};
+
+struct DepthDesc {
+    bool testEnable = true;
+    bool writeEnable = true;
+    VkCompareOp compareOp = VK_COMPARE_OP_LESS;
+};
+
+struct BlendDesc {
+    bool enable = false;
+    bool additive = false;  // particles：为true时目标的系数是ONE，结果和绘制顺序无关
+    VkColorComponentFlags writeMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+};
+
+struct PipelineDesc {
+    VertexInputDesc vertexInput = VertexInputDesc::scene;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    RasterDesc raster;
+    DepthDesc depth;
+    BlendDesc blend;
+    uint32_t colorAttachments = 1;
+    bool sceneSamples = true;  // 为true时使用场景的msaa采样数，否则单采样
+    bool dynamicRasterState = true;  // 为true时在支持时使用extended dynamic state，光栅化和深度状态由录制时的RasterState决定
+    bool shadingRateAttachment = true;  // variable rate shading：是否可以使用rate attachment
+
+    // pipeline desc：FNV-1a，逐个字段混入，字段之间没有padding的问题
+    constexpr uint64_t key() const {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        auto mix = [&hash](uint64_t value) {
+            for (int i = 0; i < 8; i++) {
+                hash ^= (value >> (i * 8)) & 0xff;
+                hash *= 0x100000001b3ull;
+            }
+        };
+        mix(static_cast<uint64_t>(vertexInput));
+        mix(static_cast<uint64_t>(topology));
+        mix(raster.cullMode);
+        mix(static_cast<uint64_t>(raster.frontFace));
+        mix(static_cast<uint64_t>(raster.polygonMode));
+        mix(depth.testEnable);
+        mix(depth.writeEnable);
+        mix(static_cast<uint64_t>(depth.compareOp));
+        mix(blend.enable);
+        mix(blend.additive);
+        mix(blend.writeMask);
+        mix(colorAttachments);
+        mix(sceneSamples);
+        mix(dynamicRasterState);
+        mix(shadingRateAttachment);
+        return hash;
+    }
+};
+
+// pipeline desc：模板参数是描述本身，value是编译期常量，比如作为switch的case或者数组中的key
+template <const PipelineDesc& Desc>
+struct PipelineKey {
+    static constexpr uint64_t value = Desc.key();
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "host_memory.hpp"
+
+// pipeline library：VK_EXT_graphics_pipeline_library把pipeline拆成四部分分别编译
+// vertex input、pre-rasterization（顶点阶段的shader、viewport和光栅化）、fragment shader和fragment output
+// 部分编译好之后link只是把它们拼起来，比完整编译快很多，新的pipeline变体只需要编译变化的部分
+// link出来的pipeline没有跨阶段的优化，所以同时在后台线程用link time optimization重新link，完成后替换
+class GraphicsPipelineLibrary {
+public:
+    // pipeline library：需要VK_KHR_pipeline_library和VK_EXT_graphics_pipeline_library扩展，并且开启graphicsPipelineLibrary feature
+    static bool supported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return features.graphicsPipelineLibrary;
+    }
+
+    // linkFlags：部分和link出来的pipeline都需要的标志，比如descriptor buffer
+    void init(VkDevice device, VkPipelineCache pipelineCache, VkPipelineCreateFlags linkFlags = 0) {
+        m_device = device;
+        m_pipelineCache = pipelineCache;
+        m_linkFlags = linkFlags;
+    }
+
+    // pipeline library：info是完整pipeline的创建信息，只使用part对应的状态，其它状态由驱动忽略，可以在pipeline compiler的线程中调用
+    // pStages中不属于这一部分的shader stage需要去掉，RETAIN_LINK_TIME_OPTIMIZATION_INFO保留后台优化link需要的信息
+    VkPipeline createPart(VkGraphicsPipelineLibraryFlagsEXT part, VkGraphicsPipelineCreateInfo info) {
+        std::vector<VkPipelineShaderStageCreateInfo> stages;
+        for (uint32_t i = 0; i < info.stageCount; i++) {
+            bool fragment = info.pStages[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT;
+            if ((fragment && part == VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT)
+                || (!fragment && part == VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT)) {
+                stages.push_back(info.pStages[i]);
+            }
+        }
+        info.stageCount = static_cast<uint32_t>(stages.size());
+        info.pStages = stages.empty() ? nullptr : stages.data();
+
+        VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+        libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+        libraryInfo.flags = part;
+        libraryInfo.pNext = const_cast<void*>(info.pNext);
+        info.pNext = &libraryInfo;
+        info.flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+
+        VkPipeline library;
+        if (vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &info, hostAllocator(), &library) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline library!");
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_libraries.push_back(library);
+        return library;
+    }
+
+    // pipeline library：快速link，不做跨阶段优化，可以在需要新变体的那一帧直接调用
+    VkPipeline link(const std::vector<VkPipeline>& parts, VkPipelineLayout layout) const {
+        return linkParts(parts, layout, 0);
+    }
+
+    // pipeline library：在后台线程做link time optimization，完成后takeOptimized返回结果，一次只有一个后台任务
+    void linkOptimizedAsync(const std::vector<VkPipeline>& parts, VkPipelineLayout layout) {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_optimized = VK_NULL_HANDLE;
+        m_thread = std::thread([this, parts, layout]() {
+            // VkPipelineCache是内部同步的，主线程同时创建其它pipeline也没有问题
+            try {
+                m_optimized = linkParts(parts, layout, VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT);
+            } catch (const std::exception&) {
+                // 优化的link失败时继续使用快速link的pipeline
+            }
+        });
+    }
+
+    // pipeline library：主线程每帧调用，后台link完成后返回一次优化的pipeline，之后所有权属于调用者
+    VkPipeline takeOptimized() {
+        return m_optimized.exchange(VK_NULL_HANDLE);
+    }
+
+    // pipeline library：等待后台link，销毁所有部分和没有被取走的优化pipeline，link出来的pipeline由调用者销毁
+    void cleanup() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        VkPipeline optimized = takeOptimized();
+        if (optimized != VK_NULL_HANDLE) {
+            vkDestroyPipeline(m_device, optimized, hostAllocator());
+        }
+        for (VkPipeline library : m_libraries) {
+            vkDestroyPipeline(m_device, library, hostAllocator());
+        }
+        m_libraries.clear();
+    }
+
+private:
+    VkPipeline linkParts(const std::vector<VkPipeline>& parts, VkPipelineLayout layout, VkPipelineCreateFlags flags) const {
+        VkPipelineLibraryCreateInfoKHR libraryInfo{};
+        libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+        libraryInfo.libraryCount = static_cast<uint32_t>(parts.size());
+        libraryInfo.pLibraries = parts.data();
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &libraryInfo;
+        pipelineInfo.flags = flags | m_linkFlags;
+        pipelineInfo.layout = layout;
+
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &pipelineInfo, hostAllocator(), &pipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to link graphics pipeline library!");
+        }
+        return pipeline;
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+    VkPipelineCreateFlags m_linkFlags = 0;
+    std::mutex m_mutex;  // 保护m_libraries
+    std::vector<VkPipeline> m_libraries;
+    std::thread m_thread;
+    std::atomic<VkPipeline> m_optimized{VK_NULL_HANDLE};
+};
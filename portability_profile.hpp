@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "device_capabilities.hpp"
+
+// portability profile：MoltenVK这样的portability实现在Metal之上模拟vulkan，设备会暴露VK_KHR_portability_subset
+// 之前mac上无条件要求这个扩展，并且不查询它的feature，不支持的功能只能靠验证层报错
+// 现在只要设备暴露这个扩展（任何平台）就进入这个配置：开启扩展，查询subset的feature和minVertexInputBindingStrideAlignment，
+// 创建device时原样传入查询到的feature，渲染器中用到的受限功能（顶点stride、sampler的mipLodBias）按结果调整
+// tile memory和shared memory已经有对应的路径：transient attachment使用LAZILY_ALLOCATED（Apple GPU上是memoryless），
+// geometry buffer在device local并且host visible的内存上跳过staging（Apple GPU是统一内存），这里只输出是否会走这些路径
+struct PortabilityProfile {
+    bool active = false;
+    uint32_t minVertexInputBindingStrideAlignment = 1;
+#ifdef VK_KHR_portability_subset
+    VkPhysicalDevicePortabilitySubsetFeaturesKHR features{};
+#endif
+    bool samplerMipLodBias = true;
+    bool unifiedMemory = false;  // 存在device local并且host visible的内存类型
+    bool lazilyAllocatedMemory = false;  // 存在LAZILY_ALLOCATED的内存类型，transient attachment不占用实际内存
+
+    // portability profile：MoltenVK在创建instance时读取环境变量，必须在vkCreateInstance之前设置；用户已经设置的值优先
+    // argument buffer：descriptor set对应Metal的argument buffer，绑定一次descriptor set不再逐个设置资源，bindless纹理数组也需要
+    // 异步提交：vkQueueSubmit不等待Metal的command buffer提交完成
+    // MTLHeap：内存从heap中分配，创建image和buffer不需要每次向Metal申请
+    // 并行编译：pipeline compiler的多个工作线程同时编译时MoltenVK不串行化Metal的shader编译
+    static void configureMoltenVK() {
+#ifdef __APPLE__
+        setenv("MVK_CONFIG_USE_METAL_ARGUMENT_BUFFERS", "1", 0);
+        setenv("MVK_CONFIG_SYNCHRONOUS_QUEUE_SUBMITS", "0", 0);
+        setenv("MVK_CONFIG_USE_MTLHEAP", "1", 0);
+        setenv("MVK_CONFIG_SHOULD_MAXIMIZE_CONCURRENT_COMPILATION", "1", 0);
+#endif
+    }
+
+    static PortabilityProfile probe(VkPhysicalDevice device, const DeviceCapabilities& capabilities) {
+        PortabilityProfile profile;
+        profile.active = capabilities.hasExtension("VK_KHR_portability_subset");
+
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+            VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+            if ((flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+                profile.unifiedMemory = true;
+            }
+            if (flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+                profile.lazilyAllocatedMemory = true;
+            }
+        }
+        if (!profile.active) {
+            return profile;
+        }
+
+#ifdef VK_KHR_portability_subset
+        // portability profile：feature和property都是扩展的结构，需要通过vkGetPhysicalDevice*2查询
+        profile.features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PORTABILITY_SUBSET_FEATURES_KHR;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &profile.features;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+        profile.features.pNext = nullptr;
+        profile.samplerMipLodBias = profile.features.samplerMipLodBias;
+
+        VkPhysicalDevicePortabilitySubsetPropertiesKHR portabilityProperties{};
+        portabilityProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PORTABILITY_SUBSET_PROPERTIES_KHR;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &portabilityProperties;
+        vkGetPhysicalDeviceProperties2(device, &properties2);
+        profile.minVertexInputBindingStrideAlignment = portabilityProperties.minVertexInputBindingStrideAlignment > 0
+            ? portabilityProperties.minVertexInputBindingStrideAlignment : 1;
+#else
+        // portability profile：没有定义VK_ENABLE_BETA_EXTENSIONS时头文件中没有subset的结构，按最严格的情况处理
+        profile.samplerMipLodBias = false;
+        profile.minVertexInputBindingStrideAlignment = 4;
+#endif
+        return profile;
+    }
+
+    // portability profile：创建device时传入查询到的feature，表示使用的就是设备报告的subset
+    void* featureChain() {
+#ifdef VK_KHR_portability_subset
+        return active ? &features : nullptr;
+#else
+        return nullptr;
+#endif
+    }
+
+    bool strideSupported(uint32_t stride) const {
+        return stride % minVertexInputBindingStrideAlignment == 0;
+    }
+
+    // portability profile：不支持samplerMipLodBias时bias必须是0
+    float mipLodBias(float bias) const {
+        return samplerMipLodBias ? bias : 0.0f;
+    }
+
+    std::string summary() const {
+        std::string text = active ? "portability subset" : "full vulkan";
+        if (active) {
+            text += ", stride alignment " + std::to_string(minVertexInputBindingStrideAlignment);
+            if (!samplerMipLodBias) {
+                text += ", no mip lod bias";
+            }
+        }
+        text += unifiedMemory ? ", unified memory (zero-staging geometry)" : ", discrete memory";
+        if (lazilyAllocatedMemory) {
+            text += ", lazily allocated attachments";
+        }
+        return text;
+    }
+};
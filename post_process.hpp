@@ -0,0 +1,391 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+#include "upload_context.hpp"
+
+// post processing：forward把HDR的场景画进HDR_FORMAT的scene color，之后三个compute pass生成LDR的输出，再由upscale pass写到swap chain
+// prefilter：场景缩小到一半分辨率、提取bloom，同时统计亮度直方图，两者共用一次全分辨率的读取
+// blur：半分辨率的bloom在shared memory中完成横竖两个方向的gaussian，一次dispatch
+// tonemap：先由一个workgroup用subgroup运算把直方图归约成曝光，再把bloom合成、曝光、tonemap、锐化和sRGB编码合并成一次dispatch
+// 三个pass的image都是render graph的transient image，barrier和layout由graph管理；直方图和曝光是跨帧的buffer，barrier由这里录制
+// 直方图和曝光只有一份，所有帧在同一个队列上按顺序访问，prefilter开头的barrier等待上一帧的tonemap
+struct PostProcessSettings {
+    float bloomThreshold = 1.0f;  // 亮度超过它的部分进入bloom
+    float bloomIntensity = 0.1f;
+    float minLogLuma = -10.0f;  // 直方图覆盖的log2亮度范围
+    float logLumaRange = 12.0f;
+    float adaptSpeed = 1.5f;  // 曝光每秒向目标靠近的速度
+    float exposureKey = 0.18f;  // 平均亮度映射到的中灰
+    float fixedExposure = 1.0f;  // 不支持subgroup运算时使用的固定曝光
+};
+
+class PostProcess {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 16;  // 和post_*.comp的local_size一致
+    static constexpr uint32_t HISTOGRAM_BINS = 256;  // 和post_prefilter.comp、post_exposure.comp一致
+    static constexpr VkFormat HDR_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;  // scene color和bloom
+    static constexpr VkFormat OUTPUT_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;  // sRGB编码的值，SRGB格式不能作为storage image
+
+    // post processing：自动曝光需要compute stage中的subgroup arithmetic，vulkan 1.1只保证basic
+    static bool autoExposureSupported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceSubgroupProperties subgroup{};
+        subgroup.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &subgroup;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        VkSubgroupFeatureFlags operations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+        return (subgroup.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) && (subgroup.supportedOperations & operations) == operations;
+    }
+
+    static VkExtent2D bloomExtent(VkExtent2D sceneExtent) {
+        return {(sceneExtent.width + 1) / 2, (sceneExtent.height + 1) / 2};
+    }
+
+    // post processing：autoExposure为false时不创建曝光的pipeline，tonemap使用settings中的固定曝光
+    // 直方图清零和曝光的初始值录制进upload context，调用者负责submit
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& prefilterCode, const SpirvCode& blurCode,
+        const SpirvCode& exposureCode, const SpirvCode& tonemapCode, const PostProcessSettings& settings, bool autoExposure, uint32_t frameCount,
+        UploadContext& uploadContext) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_settings = settings;
+        m_autoExposure = autoExposure;
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;  // tonemap双线性放大bloom，其它输入用texelFetch
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        if (vkCreateSampler(m_device, &samplerInfo, hostAllocator(), &m_sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create post processing sampler!");
+        }
+
+        // post processing：所有pass共用一个layout，0是输入，1是输出，2是参数，3是直方图，4是曝光，5是tonemap的bloom；pass没有使用的binding不写入
+        std::array<VkDescriptorSetLayoutBinding, 6> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = DESCRIPTOR_TYPES[i];
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create post processing descriptor set layout!");
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create post processing pipeline layout!");
+        }
+
+        m_pipelines[prefilterPass] = createPipeline(pipelineCache, prefilterCode);
+        m_pipelines[blurPass] = createPipeline(pipelineCache, blurCode);
+        if (m_autoExposure) {
+            m_pipelines[exposurePass] = createPipeline(pipelineCache, exposureCode);
+        }
+        m_pipelines[tonemapPass] = createPipeline(pipelineCache, tonemapCode);
+
+        m_histogram = createBuffer(HISTOGRAM_BINS * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::other, "luminance histogram");
+        m_exposure = createBuffer(sizeof(float) * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryCategory::other, "exposure");
+
+        VkDescriptorPoolSize poolSizes[4] = {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 * frameCount}, {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3 * frameCount},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, PASS_COUNT * frameCount}, {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * frameCount}};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 4;
+        poolInfo.pPoolSizes = poolSizes;
+        poolInfo.maxSets = PASS_COUNT * frameCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create post processing descriptor pool!");
+        }
+
+        // post processing：参数每帧由cpu写入，录制的命令只引用buffer，command cache重放时使用最新的值
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            frame.params = createBuffer(sizeof(Params), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                MemoryCategory::uniform, "post processing params");
+
+            std::vector<VkDescriptorSetLayout> layouts(PASS_COUNT, m_descriptorSetLayout);
+            VkDescriptorSetAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = m_descriptorPool;
+            allocInfo.descriptorSetCount = PASS_COUNT;
+            allocInfo.pSetLayouts = layouts.data();
+            if (vkAllocateDescriptorSets(m_device, &allocInfo, frame.sets.data()) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate post processing descriptor sets!");
+            }
+            writeBuffers(frame);
+        }
+
+        VkCommandBuffer commandBuffer = uploadContext.graphicsCommandBuffer();
+        float initial = 1.0f;
+        uint32_t initialBits;
+        memcpy(&initialBits, &initial, sizeof(initialBits));
+        vkCmdFillBuffer(commandBuffer, m_histogram.buffer, 0, VK_WHOLE_SIZE, 0);
+        vkCmdFillBuffer(commandBuffer, m_exposure.buffer, 0, VK_WHOLE_SIZE, initialBits);  // 曝光和平均亮度都从1开始
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        for (Frame& frame : m_frames) {
+            destroyBuffer(frame.params);
+        }
+        m_frames.clear();
+        destroyBuffer(m_histogram);
+        destroyBuffer(m_exposure);
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());  // set随pool一起释放
+        for (VkPipeline pipeline : m_pipelines) {
+            if (pipeline != VK_NULL_HANDLE) {
+                vkDestroyPipeline(m_device, pipeline, hostAllocator());
+            }
+        }
+        m_pipelines = {};
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        vkDestroySampler(m_device, m_sampler, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+    bool autoExposure() const { return m_autoExposure; }
+
+    // post processing：deltaTime是上一帧到这一帧的时间，曝光按它向目标靠近；sharpness为0时tonemap不锐化
+    // 调用者需要保证gpu已经完成上次使用这一帧的命令
+    void update(uint32_t frameIndex, VkExtent2D sceneExtent, float sharpness, float deltaTime) {
+        VkExtent2D bloom = bloomExtent(sceneExtent);
+        Params params{};
+        params.sceneSize = glm::ivec2(sceneExtent.width, sceneExtent.height);
+        params.bloomSize = glm::ivec2(bloom.width, bloom.height);
+        params.bloomThreshold = m_settings.bloomThreshold;
+        params.bloomIntensity = m_settings.bloomIntensity;
+        params.sharpness = sharpness;
+        params.deltaTime = deltaTime;
+        params.minLogLuma = m_settings.minLogLuma;
+        params.logLumaRange = m_settings.logLumaRange;
+        params.adaptSpeed = m_settings.adaptSpeed;
+        params.exposureKey = m_settings.exposureKey;
+        params.fixedExposure = m_settings.fixedExposure;
+        params.autoExposure = m_autoExposure ? 1 : 0;
+        memcpy(m_frames[frameIndex].params.allocation.mapped, &params, sizeof(params));
+    }
+
+    // post processing：以下都在render pass之外录制，输入处于SHADER_READ_ONLY_OPTIMAL，输出处于GENERAL，由render graph转换
+    // 开头的barrier让上一帧的曝光计算和tonemap完成之后再累加直方图
+    void recordPrefilter(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView sceneView, VkImageView bloomView, VkExtent2D sceneExtent) {
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        dispatch(commandBuffer, frameIndex, prefilterPass, {sceneView, bloomView, VK_NULL_HANDLE}, bloomExtent(sceneExtent));
+    }
+
+    void recordBlur(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView sourceView, VkImageView bloomView, VkExtent2D sceneExtent) {
+        dispatch(commandBuffer, frameIndex, blurPass, {sourceView, bloomView, VK_NULL_HANDLE}, bloomExtent(sceneExtent));
+    }
+
+    // post processing：曝光在tonemap之前由一个workgroup计算，两次buffer的读写之间需要barrier
+    void recordTonemap(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView sceneView, VkImageView bloomView, VkImageView outputView,
+        VkExtent2D sceneExtent) {
+        if (m_autoExposure) {
+            memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[exposurePass]);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_frames[frameIndex].sets[exposurePass], 0, nullptr);
+            vkCmdDispatch(commandBuffer, 1, 1, 1);
+            memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_ACCESS_SHADER_READ_BIT);
+        }
+        dispatch(commandBuffer, frameIndex, tonemapPass, {sceneView, outputView, bloomView}, sceneExtent);
+    }
+
+private:
+    enum Pass : uint32_t { prefilterPass, blurPass, exposurePass, tonemapPass, PASS_COUNT };
+
+    static constexpr VkDescriptorType DESCRIPTOR_TYPES[6] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER};
+
+    // post processing：布局和post_*.comp中的Params一致（std140）
+    struct Params {
+        glm::ivec2 sceneSize;
+        glm::ivec2 bloomSize;
+        float bloomThreshold;
+        float bloomIntensity;
+        float sharpness;
+        float deltaTime;
+        float minLogLuma;
+        float logLumaRange;
+        float adaptSpeed;
+        float exposureKey;
+        float fixedExposure;
+        uint32_t autoExposure;
+    };
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    // post processing：每个pass一个set，views是最近一次写入binding 0、1、5的image view
+    struct Frame {
+        Buffer params;
+        std::array<VkDescriptorSet, PASS_COUNT> sets{};
+        std::array<std::array<VkImageView, 3>, PASS_COUNT> views{};
+    };
+
+    // post processing：每个pass只写入它的shader使用的buffer binding
+    void writeBuffers(Frame& frame) {
+        VkDescriptorBufferInfo paramsInfo{frame.params.buffer, 0, sizeof(Params)};
+        VkDescriptorBufferInfo histogramInfo{m_histogram.buffer, 0, VK_WHOLE_SIZE};
+        VkDescriptorBufferInfo exposureInfo{m_exposure.buffer, 0, VK_WHOLE_SIZE};
+        std::vector<VkWriteDescriptorSet> writes;
+        auto write = [&](Pass pass, uint32_t binding, const VkDescriptorBufferInfo* info) {
+            VkWriteDescriptorSet descriptorWrite{};
+            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrite.dstSet = frame.sets[pass];
+            descriptorWrite.dstBinding = binding;
+            descriptorWrite.descriptorCount = 1;
+            descriptorWrite.descriptorType = DESCRIPTOR_TYPES[binding];
+            descriptorWrite.pBufferInfo = info;
+            writes.push_back(descriptorWrite);
+        };
+        for (uint32_t pass = 0; pass < PASS_COUNT; pass++) {
+            write(static_cast<Pass>(pass), 2, &paramsInfo);
+        }
+        write(prefilterPass, 3, &histogramInfo);
+        write(exposurePass, 3, &histogramInfo);
+        write(exposurePass, 4, &exposureInfo);
+        write(tonemapPass, 4, &exposureInfo);
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    // post processing：views依次是binding 0的输入、binding 1的输出和binding 5的第二个输入，VK_NULL_HANDLE表示pass没有使用
+    // render graph重新分配transient image时view会变，只在变化时重写set，调用者保证这个frame in flight上一次的提交已经完成
+    void dispatch(VkCommandBuffer commandBuffer, uint32_t frameIndex, Pass pass, const std::array<VkImageView, 3>& views, VkExtent2D extent) {
+        Frame& frame = m_frames[frameIndex];
+        if (frame.views[pass] != views) {
+            VkDescriptorImageInfo imageInfos[3] = {{m_sampler, views[0], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}, {VK_NULL_HANDLE, views[1], VK_IMAGE_LAYOUT_GENERAL},
+                {m_sampler, views[2], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}};
+            uint32_t bindings[3] = {0, 1, 5};
+            std::array<VkWriteDescriptorSet, 3> writes{};
+            uint32_t writeCount = 0;
+            for (uint32_t i = 0; i < 3; i++) {
+                if (views[i] == VK_NULL_HANDLE) {
+                    continue;
+                }
+                VkWriteDescriptorSet& write = writes[writeCount++];
+                write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.dstSet = frame.sets[pass];
+                write.dstBinding = bindings[i];
+                write.descriptorCount = 1;
+                write.descriptorType = DESCRIPTOR_TYPES[bindings[i]];
+                write.pImageInfo = &imageInfos[i];
+            }
+            vkUpdateDescriptorSets(m_device, writeCount, writes.data(), 0, nullptr);
+            frame.views[pass] = views;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines[pass]);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &frame.sets[pass], 0, nullptr);
+        vkCmdDispatch(commandBuffer, (extent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (extent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+    }
+
+    VkPipeline createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create post processing shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkPipeline pipeline;
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create post processing compute pipeline!");
+        }
+        return pipeline;
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, const char* name) {
+        Buffer result;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &result.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create post processing buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, result.buffer, &memRequirements);
+        bool mapped = (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+        result.allocation = m_allocator->allocate(memRequirements, properties, mapped, category, 0, name);
+        vkBindBufferMemory(m_device, result.buffer, result.allocation.memory, result.allocation.offset);
+        return result;
+    }
+
+    void destroyBuffer(Buffer& buffer) {
+        vkDestroyBuffer(m_device, buffer.buffer, hostAllocator());
+        m_allocator->free(buffer.allocation);
+        buffer = {};
+    }
+
+    static void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    PostProcessSettings m_settings;
+    bool m_autoExposure = false;
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    std::array<VkPipeline, PASS_COUNT> m_pipelines{};
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    Buffer m_histogram;
+    Buffer m_exposure;
+    std::vector<Frame> m_frames;
+};
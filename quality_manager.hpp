@@ -0,0 +1,154 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// quality：画质分级，从集成显卡到工作站使用同一份程序
+enum class QualityTier : uint32_t {
+    low,
+    medium,
+    high,
+    ultra,
+};
+
+// quality：每个tier控制的设置；msaa、shadow map和各向异性在创建资源时读取一次，分辨率上限和lod误差每帧读取
+struct QualitySettings {
+    uint32_t msaaSamples = 4;  // 上限，仍然受设备支持的采样数和MSAA_SAMPLES限制
+    float maxResolutionScale = 1.0f;  // dynamic resolution的比例上限
+    float lodPixelError = 1.0f;  // lod选择允许的屏幕误差（像素），越大越早换到粗的level
+    uint32_t shadowMapSize = 2048;
+    float maxAnisotropy = 16.0f;  // 上限，仍然受maxSamplerAnisotropy限制
+};
+
+// quality：第一次启动时按设备类型和最大的device local heap选择tier，之后运行时按gpu帧时间调整，调整的结果保存到文件
+// 下次启动时同一个设备直接使用保存的tier，相当于把第一次运行当作benchmark，只在启动时生效的设置（msaa、shadow map、各向异性）也跟着调整
+// 运行时的调整是比dynamic resolution慢得多的一级：帧时间的长时间平均超过目标DOWNGRADE_RATIO倍时降一级，低于UPGRADE_RATIO倍时升一级，最高到设备分类的tier
+// 每次调整之后等待COOLDOWN_FRAMES帧，让新的设置反映到帧时间上
+class QualityManager {
+public:
+    static constexpr uint32_t COOLDOWN_FRAMES = 600;
+    static constexpr float DOWNGRADE_RATIO = 1.15f;
+    static constexpr float UPGRADE_RATIO = 0.6f;
+
+    static const char* name(QualityTier tier) {
+        static const char* NAMES[] = {"low", "medium", "high", "ultra"};
+        return NAMES[static_cast<uint32_t>(tier)];
+    }
+
+    static QualitySettings settings(QualityTier tier) {
+        switch (tier) {
+            case QualityTier::low:
+                return {1, 0.75f, 4.0f, 1024, 2.0f};
+            case QualityTier::medium:
+                return {2, 0.85f, 2.0f, 1024, 4.0f};
+            case QualityTier::high:
+                return {4, 1.0f, 1.0f, 2048, 16.0f};
+            case QualityTier::ultra:
+                return {8, 1.0f, 0.5f, 4096, 16.0f};
+        }
+        return {};
+    }
+
+    // quality：软件实现和虚拟设备按最低的一级处理；集成显卡和显存小的独立显卡降一级，显存大的独立显卡升到ultra
+    static QualityTier classify(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+        VkDeviceSize localHeap = 0;
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+            if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                localHeap = std::max(localHeap, memoryProperties.memoryHeaps[i].size);
+            }
+        }
+        constexpr VkDeviceSize GIB = 1024ull * 1024 * 1024;
+        switch (properties.deviceType) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+                return localHeap >= 8 * GIB ? QualityTier::ultra : localHeap >= 4 * GIB ? QualityTier::high : QualityTier::medium;
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+                return localHeap >= 4 * GIB ? QualityTier::medium : QualityTier::low;  // 集成显卡的heap是共享的系统内存
+            default:
+                return QualityTier::low;
+        }
+    }
+
+    // quality：path中保存了这个设备的tier时使用它，否则按classify选择；adaptive为false时不调整也不保存
+    void init(VkPhysicalDevice physicalDevice, float targetMs, std::string path, bool adaptive) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        m_vendorId = properties.vendorID;
+        m_deviceId = properties.deviceID;
+        m_targetMs = targetMs;
+        m_path = std::move(path);
+        m_adaptive = adaptive;
+        m_ceiling = classify(physicalDevice);
+        m_tier = m_ceiling;
+        if (adaptive) {
+            loadTier();
+        }
+        m_filteredMs = 0.0f;
+        m_framesSinceChange = 0;
+    }
+
+    QualityTier tier() const { return m_tier; }
+    QualitySettings settings() const { return settings(m_tier); }
+
+    // quality：每帧调用一次，gpuMs是最近一次完成的帧的gpu时间，没有结果时传入0；返回true表示tier改变
+    bool update(float gpuMs) {
+        m_framesSinceChange++;
+        if (!m_adaptive || gpuMs <= 0.0f) {
+            return false;
+        }
+        m_filteredMs = m_filteredMs == 0.0f ? gpuMs : m_filteredMs + (gpuMs - m_filteredMs) * FILTER_ALPHA;
+        if (m_framesSinceChange < COOLDOWN_FRAMES) {
+            return false;
+        }
+        uint32_t tier = static_cast<uint32_t>(m_tier);
+        if (m_filteredMs > m_targetMs * DOWNGRADE_RATIO && m_tier != QualityTier::low) {
+            tier--;
+        } else if (m_filteredMs < m_targetMs * UPGRADE_RATIO && m_tier < m_ceiling) {
+            tier++;
+        } else {
+            return false;
+        }
+        m_tier = static_cast<QualityTier>(tier);
+        m_framesSinceChange = 0;
+        m_filteredMs = 0.0f;
+        saveTier();
+        return true;
+    }
+
+private:
+    static constexpr float FILTER_ALPHA = 0.01f;  // 比dynamic resolution慢得多的平均，短暂的峰值不会改变tier
+
+    // quality：文件是一行"vendorID deviceID tier"，换了设备时忽略
+    void loadTier() {
+        std::ifstream file(m_path);
+        uint32_t vendorId = 0;
+        uint32_t deviceId = 0;
+        uint32_t tier = 0;
+        if (file >> vendorId >> deviceId >> tier && vendorId == m_vendorId && deviceId == m_deviceId && tier <= static_cast<uint32_t>(QualityTier::ultra)) {
+            m_tier = static_cast<QualityTier>(tier);
+            m_ceiling = std::max(m_ceiling, m_tier);
+        }
+    }
+
+    void saveTier() const {
+        std::ofstream file(m_path);
+        file << m_vendorId << " " << m_deviceId << " " << static_cast<uint32_t>(m_tier) << "\n";
+    }
+
+    uint32_t m_vendorId = 0;
+    uint32_t m_deviceId = 0;
+    float m_targetMs = 16.6f;
+    std::string m_path;
+    bool m_adaptive = false;
+    QualityTier m_tier = QualityTier::high;
+    QualityTier m_ceiling = QualityTier::high;  // 运行时升级的上限
+    float m_filteredMs = 0.0f;
+    uint32_t m_framesSinceChange = 0;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// regression：--regression在benchmark结束后把这次的指标和保存的baseline比较，超过阈值算回归
+// baseline按gpu和场景分开保存，每行一个"名字 值"，不存在时用这次的结果创建；报告是json，退出码非0表示有回归
+// 所有指标都是越小越好；同时要求超过相对阈值和绝对阈值，避免本来就很小的值因为噪声被判成回归
+struct RegressionMetric {
+    std::string name;
+    float value = 0.f;
+    float relativeTolerance = 0.1f;  // 比baseline大10%以上
+    float absoluteTolerance = 0.f;  // 并且差值超过这个数
+};
+
+struct RegressionResult {
+    RegressionMetric metric;
+    float baseline = 0.f;
+    bool hasBaseline = false;
+    bool regressed = false;
+};
+
+class RegressionCheck {
+public:
+    // regression：文件名中只保留字母数字，gpu名字中的空格和括号换成下划线
+    static std::string sanitize(const std::string& name) {
+        std::string result;
+        for (char c : name) {
+            bool alphanumeric = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+            result += alphanumeric || c == '-' || c == '.' ? c : '_';
+        }
+        return result;
+    }
+
+    // regression：baseline目录/<gpu名字>_<driver版本>/<场景文件名>.baseline，驱动升级也会带来性能变化，所以驱动版本也区分
+    static std::string baselinePath(const std::string& directory, const std::string& gpuName, uint32_t driverVersion, const std::string& scenePath) {
+        std::string scene = std::filesystem::path(scenePath).filename().string();
+        return directory + "/" + sanitize(gpuName) + "_" + std::to_string(driverVersion) + "/" + sanitize(scene) + ".baseline";
+    }
+
+    // regression：返回false表示baseline不存在或者无法读取
+    bool loadBaseline(const std::string& path) {
+        m_baseline.clear();
+        std::ifstream file(path);
+        if (!file) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream stream(line);
+            std::string name;
+            float value;
+            if (stream >> name >> value) {
+                m_baseline.push_back({name, value});
+            }
+        }
+        return !m_baseline.empty();
+    }
+
+    static bool writeBaseline(const std::string& path, const std::vector<RegressionMetric>& metrics) {
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        for (const RegressionMetric& metric : metrics) {
+            file << metric.name << " " << metric.value << "\n";
+        }
+        return static_cast<bool>(file);
+    }
+
+    // regression：baseline中没有的指标不判断，只在报告中输出
+    std::vector<RegressionResult> compare(const std::vector<RegressionMetric>& metrics) const {
+        std::vector<RegressionResult> results;
+        for (const RegressionMetric& metric : metrics) {
+            RegressionResult result;
+            result.metric = metric;
+            for (const auto& [name, value] : m_baseline) {
+                if (name == metric.name) {
+                    result.baseline = value;
+                    result.hasBaseline = true;
+                }
+            }
+            float delta = metric.value - result.baseline;
+            result.regressed = result.hasBaseline && delta > result.baseline * metric.relativeTolerance && delta > metric.absoluteTolerance;
+            results.push_back(result);
+        }
+        return results;
+    }
+
+    static bool passed(const std::vector<RegressionResult>& results) {
+        for (const RegressionResult& result : results) {
+            if (result.regressed) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool writeReport(const std::string& path, const std::string& gpuName, const std::string& scenePath, const std::string& baselinePath, bool baselineCreated,
+        const std::vector<RegressionResult>& results) {
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        file << "{\n  \"gpu\": \"" << escape(gpuName) << "\",\n  \"scene\": \"" << escape(scenePath) << "\",\n  \"baseline\": \"" << escape(baselinePath) << "\",\n"
+             << "  \"baseline_created\": " << (baselineCreated ? "true" : "false") << ",\n  \"passed\": " << (passed(results) ? "true" : "false") << ",\n  \"metrics\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const RegressionResult& result = results[i];
+            file << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << result.metric.name << "\", \"value\": " << result.metric.value;
+            if (result.hasBaseline) {
+                file << ", \"baseline\": " << result.baseline << ", \"change\": " << (result.baseline > 0.f ? result.metric.value / result.baseline - 1.f : 0.f);
+            }
+            file << ", \"relative_tolerance\": " << result.metric.relativeTolerance << ", \"absolute_tolerance\": " << result.metric.absoluteTolerance
+                 << ", \"regressed\": " << (result.regressed ? "true" : "false") << "}";
+        }
+        file << "\n  ]\n}\n";
+        return static_cast<bool>(file);
+    }
+
+private:
+    static std::string escape(const std::string& text) {
+        std::string result;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result;
+    }
+
+    std::vector<std::pair<std::string, float>> m_baseline;
+};
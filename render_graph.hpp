@@ -0,0 +1,651 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "image_barriers.hpp"
+#include "inline_function.hpp"
+#include "memory_allocator.hpp"
+
+// render graph：之前一帧只有recordCommandBuffer里写死的一个pass，增加pass需要像transitionImageLayout那样手写barrier
+// 现在pass声明自己读写哪些image和访问方式，compile时剔除结果没有被使用的pass，按访问方式计算最少的barrier和layout转换
+// graph创建的transient image只在一帧之内有效，生命周期不重叠的transient image共用同一块内存（aliasing）
+// graph每次录制command buffer时重新构建，transient image在描述和生命周期不变时沿用上一次创建的image
+// heap tracker：重新构建不分配内存，pass的lambda放在InlineFunction中，pass和resource的vector、compile的临时数组都复用上一帧的容量
+// 名字必须是字符串字面量（或者至少和graph活得一样久），graph只保存指针
+using RenderGraphHandle = uint32_t;
+
+enum class RenderGraphAccess {
+    colorAttachmentWrite,
+    depthAttachmentWrite,
+    depthAttachmentRead,
+    sampledFragment,
+    sampledCompute,
+    storageReadCompute,
+    storageWriteCompute,
+    transferSrc,
+    transferDst
+};
+
+// render graph：transient image的描述，usage由pass的访问方式推导，不需要调用者填写
+struct RenderGraphImageDesc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent{};
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;  // msaa：多重采样的image只能作为attachment
+};
+
+class RenderGraph {
+public:
+    using ExecuteFunction = InlineFunction<void(VkCommandBuffer, const RenderGraph&), 96>;
+    // render graph：重新分配transient image时旧的image可能还被in flight的帧使用，由调用者延迟销毁（一般是deletion queue）
+    using RetireFunction = std::function<void(std::function<void()>)>;
+    // render graph：execute在每个pass（包括它之前的barrier）前后调用，begin为true表示pass开始，gpu profiler用它写timestamp
+    using PassScope = InlineFunction<void(VkCommandBuffer, std::string_view name, bool begin)>;
+
+    // render graph：lazilyAllocated为true时只作为attachment的transient image使用LAZILY_ALLOCATED内存，不参与aliasing
+    void init(VkDevice device, DeviceMemoryAllocator* allocator, RetireFunction retire, bool lazilyAllocated) {
+        m_device = device;
+        m_allocator = allocator;
+        m_retire = std::move(retire);
+        m_lazilyAllocated = lazilyAllocated;
+    }
+
+    void cleanup() {
+        destroyPhysical(m_physical);
+        m_physical = {};
+    }
+
+    // render graph：开始构建新的一帧，上一帧声明的pass和resource全部清空，transient image保留
+    // heap tracker：pass的uses和barriers交给spare列表，下一次addPass取回，vector的容量不释放
+    void reset() {
+        m_resources.clear();
+        for (Pass& pass : m_passes) {
+            pass.uses.clear();
+            pass.barriers.clear();
+            m_spareUses.push_back(std::move(pass.uses));
+            m_spareBarriers.push_back(std::move(pass.barriers));
+        }
+        m_passes.clear();
+        m_compiled = false;
+    }
+
+    // render graph：外部image（比如swap chain image），initial是进入graph时的状态，finalLayout是graph结束时转换到的layout
+    // 外部image的写入视为副作用，写入它的pass不会被剔除
+    RenderGraphHandle importImage(std::string_view name, VkImage image, VkImageView view, VkImageAspectFlags aspect,
+        VkImageLayout initialLayout, VkPipelineStageFlags initialStage, VkAccessFlags initialAccess, VkImageLayout finalLayout) {
+        Resource resource;
+        resource.name = name;
+        resource.imported = true;
+        resource.image = image;
+        resource.view = view;
+        resource.desc.aspect = aspect;
+        resource.initial = {initialLayout, initialStage, initialAccess};
+        resource.finalLayout = finalLayout;
+        m_resources.push_back(resource);
+        return static_cast<RenderGraphHandle>(m_resources.size() - 1);
+    }
+
+    // render graph：graph结束时的转换同时转移queue family所有权，present queue的release
+    void setFinalOwnership(RenderGraphHandle handle, uint32_t srcQueueFamily, uint32_t dstQueueFamily) {
+        m_resources[handle].srcQueueFamily = srcQueueFamily;
+        m_resources[handle].dstQueueFamily = dstQueueFamily;
+    }
+
+    RenderGraphHandle createImage(std::string_view name, const RenderGraphImageDesc& desc) {
+        Resource resource;
+        resource.name = name;
+        resource.desc = desc;
+        m_resources.push_back(resource);
+        return static_cast<RenderGraphHandle>(m_resources.size() - 1);
+    }
+
+    // render graph：pass按添加顺序执行，read/write声明之后compile
+    uint32_t addPass(std::string_view name, ExecuteFunction execute) {
+        Pass pass;
+        pass.name = name;
+        pass.execute = std::move(execute);
+        if (!m_spareUses.empty()) {
+            pass.uses = std::move(m_spareUses.back());
+            m_spareUses.pop_back();
+        }
+        if (!m_spareBarriers.empty()) {
+            pass.barriers = std::move(m_spareBarriers.back());
+            m_spareBarriers.pop_back();
+        }
+        m_passes.push_back(std::move(pass));
+        return static_cast<uint32_t>(m_passes.size() - 1);
+    }
+
+    void read(uint32_t pass, RenderGraphHandle handle, RenderGraphAccess access) {
+        m_passes[pass].uses.push_back({handle, access, false});
+    }
+
+    void write(uint32_t pass, RenderGraphHandle handle, RenderGraphAccess access) {
+        m_passes[pass].uses.push_back({handle, access, true});
+    }
+
+    // render graph：没有写外部image的pass（比如只写调试输出）可以标记成副作用，避免被剔除
+    void setSideEffect(uint32_t pass) { m_passes[pass].sideEffect = true; }
+
+    // render graph：pass执行时查询image，transient image在compile之后才有
+    VkImage image(RenderGraphHandle handle) const {
+        const Resource& resource = m_resources[handle];
+        return resource.imported ? resource.image : physicalImage(resource).image;
+    }
+
+    VkImageView view(RenderGraphHandle handle) const {
+        const Resource& resource = m_resources[handle];
+        return resource.imported ? resource.view : physicalImage(resource).view;
+    }
+
+    void compile() {
+        cullPasses();
+        computeLifetimes();
+        allocateTransients();
+        computeBarriers();
+        m_compiled = true;
+    }
+
+    // render graph：按顺序录制保留的pass，每个pass之前的barrier合并成一次vkCmdPipelineBarrier
+    void execute(VkCommandBuffer commandBuffer, const PassScope& scope = {}) {
+        if (!m_compiled) {
+            throw std::runtime_error("render graph executed before compile!");
+        }
+        for (Pass& pass : m_passes) {
+            if (pass.culled) {
+                continue;
+            }
+            if (scope) {
+                scope(commandBuffer, pass.name, true);
+            }
+            recordBarriers(commandBuffer, pass.barriers);
+            pass.execute(commandBuffer, *this);
+            if (scope) {
+                scope(commandBuffer, pass.name, false);
+            }
+        }
+        recordBarriers(commandBuffer, m_finalBarriers);
+    }
+
+    uint32_t culledPassCount() const {
+        return static_cast<uint32_t>(std::count_if(m_passes.begin(), m_passes.end(), [](const Pass& pass) { return pass.culled; }));
+    }
+    uint32_t aliasedImageCount() const { return m_aliasedImageCount; }
+
+private:
+    struct State {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags stage = 0;  // 最近一次写入的stage，或者最近一次写入之后所有读取的stage
+        VkAccessFlags access = 0;  // 最近一次写入的access，只有写入需要make available
+    };
+
+    struct Use {
+        RenderGraphHandle handle;
+        RenderGraphAccess access;
+        bool write;
+    };
+
+    struct Barrier {
+        VkImageMemoryBarrier barrier;
+        VkPipelineStageFlags srcStage;
+        VkPipelineStageFlags dstStage;
+    };
+
+    struct Pass {
+        std::string_view name;
+        ExecuteFunction execute;
+        std::vector<Use> uses;
+        std::vector<Barrier> barriers;
+        bool sideEffect = false;
+        bool culled = false;
+    };
+
+    struct Resource {
+        std::string_view name;
+        bool imported = false;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        RenderGraphImageDesc desc;
+        State initial;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        uint32_t srcQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+        uint32_t dstQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+        VkImageUsageFlags usage = 0;
+        VkPipelineStageFlags allStages = 0;  // 所有访问的并集，aliasing的第一次使用用它等待上一帧
+        VkAccessFlags allWrites = 0;
+        uint32_t firstPass = UINT32_MAX;
+        uint32_t lastPass = 0;
+        uint32_t transientIndex = UINT32_MAX;  // 在m_physical.images中的位置
+    };
+
+    // render graph：transient image的key，描述和生命周期都不变时沿用已经创建的image和内存
+    struct TransientKey {
+        RenderGraphImageDesc desc;
+        VkImageUsageFlags usage;
+        uint32_t firstPass;
+        uint32_t lastPass;
+
+        bool operator==(const TransientKey& other) const {
+            return desc.format == other.desc.format && desc.extent.width == other.desc.extent.width && desc.extent.height == other.desc.extent.height &&
+                desc.aspect == other.desc.aspect && desc.samples == other.desc.samples && usage == other.usage && firstPass == other.firstPass && lastPass == other.lastPass;
+        }
+    };
+
+    struct PhysicalImage {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        uint32_t slot = 0;
+    };
+
+    // render graph：一个slot是一块内存，生命周期不重叠的image绑定在同一个slot的offset 0上
+    struct Physical {
+        std::vector<TransientKey> keys;
+        std::vector<PhysicalImage> images;
+        std::vector<Allocation> slots;
+        std::vector<std::vector<uint32_t>> slotImages;  // 每个slot中的transient，按第一次使用排序
+    };
+
+    static void accessInfo(RenderGraphAccess access, VkPipelineStageFlags& stage, VkAccessFlags& accessMask, VkImageLayout& layout, VkImageUsageFlags& usage) {
+        switch (access) {
+            case RenderGraphAccess::colorAttachmentWrite:
+                stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+                accessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+                layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+                break;
+            case RenderGraphAccess::depthAttachmentWrite:
+                stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+                accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+                layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+                usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                break;
+            case RenderGraphAccess::depthAttachmentRead:
+                stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+                accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+                layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+                usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+                break;
+            case RenderGraphAccess::sampledFragment:
+                stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+                accessMask = VK_ACCESS_SHADER_READ_BIT;
+                layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+                break;
+            case RenderGraphAccess::sampledCompute:
+                stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+                accessMask = VK_ACCESS_SHADER_READ_BIT;
+                layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+                break;
+            case RenderGraphAccess::storageReadCompute:
+                stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+                accessMask = VK_ACCESS_SHADER_READ_BIT;
+                layout = VK_IMAGE_LAYOUT_GENERAL;
+                usage = VK_IMAGE_USAGE_STORAGE_BIT;
+                break;
+            case RenderGraphAccess::storageWriteCompute:
+                stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+                accessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+                layout = VK_IMAGE_LAYOUT_GENERAL;
+                usage = VK_IMAGE_USAGE_STORAGE_BIT;
+                break;
+            case RenderGraphAccess::transferSrc:
+                stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+                accessMask = VK_ACCESS_TRANSFER_READ_BIT;
+                layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+                usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+                break;
+            case RenderGraphAccess::transferDst:
+                stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+                accessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+                break;
+        }
+    }
+
+    static constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    const PhysicalImage& physicalImage(const Resource& resource) const {
+        if (resource.transientIndex == UINT32_MAX) {
+            throw std::runtime_error("render graph image used before compile!");
+        }
+        return m_physical.images[resource.transientIndex];
+    }
+
+    // render graph：从后往前，写外部image或者有副作用的pass保留，保留的pass读取的resource标记为需要，写入需要的resource的pass也保留
+    // 一个pass写入但不读的resource被完整覆盖，更早的写入不再需要
+    void cullPasses() {
+        std::vector<bool>& needed = m_needed;
+        needed.assign(m_resources.size(), false);
+        for (size_t i = m_passes.size(); i-- > 0;) {
+            Pass& pass = m_passes[i];
+            bool keep = pass.sideEffect;
+            for (const Use& use : pass.uses) {
+                if (use.write && (m_resources[use.handle].imported || needed[use.handle])) {
+                    keep = true;
+                }
+            }
+            pass.culled = !keep;
+            if (!keep) {
+                continue;
+            }
+            for (const Use& use : pass.uses) {
+                if (use.write) {
+                    needed[use.handle] = false;
+                }
+            }
+            for (const Use& use : pass.uses) {
+                if (!use.write) {
+                    needed[use.handle] = true;
+                }
+            }
+        }
+    }
+
+    void computeLifetimes() {
+        for (uint32_t i = 0; i < m_passes.size(); i++) {
+            if (m_passes[i].culled) {
+                continue;
+            }
+            for (const Use& use : m_passes[i].uses) {
+                Resource& resource = m_resources[use.handle];
+                VkPipelineStageFlags stage;
+                VkAccessFlags access;
+                VkImageLayout layout;
+                VkImageUsageFlags usage;
+                accessInfo(use.access, stage, access, layout, usage);
+                resource.usage |= usage;
+                resource.allStages |= stage;
+                if (use.write) {
+                    resource.allWrites |= access & WRITE_ACCESS;
+                }
+                resource.firstPass = std::min(resource.firstPass, i);
+                resource.lastPass = std::max(resource.lastPass, i);
+            }
+        }
+    }
+
+    // render graph：transient image的描述或生命周期变了就重新创建，旧的image交给m_retire延迟销毁
+    void allocateTransients() {
+        std::vector<uint32_t>& transients = m_transientResources;
+        transients.clear();
+        std::vector<TransientKey>& keys = m_transientKeys;
+        keys.clear();
+        for (uint32_t i = 0; i < m_resources.size(); i++) {
+            Resource& resource = m_resources[i];
+            if (resource.imported || resource.firstPass == UINT32_MAX) {
+                continue;  // 没有被保留的pass使用的transient image不分配
+            }
+            resource.transientIndex = static_cast<uint32_t>(transients.size());
+            transients.push_back(i);
+            keys.push_back({resource.desc, resource.usage, resource.firstPass, resource.lastPass});
+        }
+        if (keys == m_physical.keys) {
+            return;
+        }
+
+        Physical old = std::move(m_physical);
+        m_physical = {};
+        if (!old.images.empty()) {
+            m_retire([this, old]() { destroyPhysical(old); });
+        }
+        m_physical.keys = keys;
+        m_physical.images.resize(keys.size());
+
+        std::vector<VkMemoryRequirements> requirements(keys.size());
+        std::vector<bool> lazy(keys.size(), false);
+        for (size_t i = 0; i < keys.size(); i++) {
+            const TransientKey& key = keys[i];
+            VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            lazy[i] = m_lazilyAllocated && (key.usage & ~attachmentUsage) == 0;
+
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = {key.desc.extent.width, key.desc.extent.height, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = key.desc.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = key.usage | (lazy[i] ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+            imageInfo.samples = key.desc.samples;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            if (vkCreateImage(m_device, &imageInfo, hostAllocator(), &m_physical.images[i].image) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create render graph image!");
+            }
+            vkGetImageMemoryRequirements(m_device, m_physical.images[i].image, &requirements[i]);
+        }
+
+        // render graph：按大小从大到小放进第一个生命周期不重叠、内存类型兼容的slot，lazily allocated的image单独一个slot
+        std::vector<uint32_t> order(keys.size());
+        for (uint32_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return requirements[a].size > requirements[b].size; });
+
+        struct Slot {
+            VkMemoryRequirements requirements;
+            std::vector<uint32_t> images;
+            bool lazy;
+        };
+        std::vector<Slot> slots;
+        for (uint32_t i : order) {
+            Slot* target = nullptr;
+            for (Slot& slot : slots) {
+                if (lazy[i] || slot.lazy || (slot.requirements.memoryTypeBits & requirements[i].memoryTypeBits) == 0) {
+                    continue;
+                }
+                bool overlaps = false;
+                for (uint32_t other : slot.images) {
+                    if (keys[i].firstPass <= keys[other].lastPass && keys[other].firstPass <= keys[i].lastPass) {
+                        overlaps = true;
+                    }
+                }
+                if (!overlaps) {
+                    target = &slot;
+                    break;
+                }
+            }
+            if (target == nullptr) {
+                slots.push_back({requirements[i], {}, lazy[i]});
+                target = &slots.back();
+            }
+            target->requirements.size = std::max(target->requirements.size, requirements[i].size);
+            target->requirements.alignment = std::max(target->requirements.alignment, requirements[i].alignment);
+            target->requirements.memoryTypeBits &= requirements[i].memoryTypeBits;
+            target->images.push_back(i);
+        }
+
+        m_aliasedImageCount = 0;
+        for (uint32_t s = 0; s < slots.size(); s++) {
+            const Slot& slot = slots[s];
+            m_physical.slots.push_back(m_allocator->allocate(slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::attachment,
+                slot.lazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0, "render graph transient"));
+            const Allocation& allocation = m_physical.slots.back();
+            for (uint32_t i : slot.images) {
+                vkBindImageMemory(m_device, m_physical.images[i].image, allocation.memory, allocation.offset);
+                m_physical.images[i].slot = s;
+                m_physical.images[i].view = createView(m_physical.images[i].image, keys[i].desc);
+            }
+            m_aliasedImageCount += static_cast<uint32_t>(slot.images.size() - 1);
+        }
+
+        // 同一个slot中的image按第一次使用排序，computeBarriers用它找到上一个占用这块内存的image
+        // 这里保存的是transient的序号，key不变时序号不变，resource的序号每帧可能不同
+        m_physical.slotImages.assign(slots.size(), {});
+        for (uint32_t i = 0; i < keys.size(); i++) {
+            m_physical.slotImages[m_physical.images[i].slot].push_back(i);
+        }
+        for (std::vector<uint32_t>& images : m_physical.slotImages) {
+            std::sort(images.begin(), images.end(), [&](uint32_t a, uint32_t b) { return keys[a].firstPass < keys[b].firstPass; });
+        }
+    }
+
+    VkImageView createView(VkImage image, const RenderGraphImageDesc& desc) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = desc.format;
+        // depth stencil格式的attachment view只用depth aspect，barrier仍然覆盖两个aspect
+        VkImageAspectFlags aspect = (desc.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? static_cast<VkImageAspectFlags>(VK_IMAGE_ASPECT_DEPTH_BIT) : desc.aspect;
+        viewInfo.subresourceRange = {aspect, 0, 1, 0, 1};
+        VkImageView view;
+        if (vkCreateImageView(m_device, &viewInfo, hostAllocator(), &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create render graph image view!");
+        }
+        return view;
+    }
+
+    void destroyPhysical(const Physical& physical) {
+        for (const PhysicalImage& image : physical.images) {
+            vkDestroyImageView(m_device, image.view, hostAllocator());
+            vkDestroyImage(m_device, image.image, hostAllocator());
+        }
+        for (Allocation allocation : physical.slots) {
+            m_allocator->free(allocation);
+        }
+    }
+
+    // render graph：transient image每帧从UNDEFINED开始，内容被丢弃
+    // 第一次使用要等上一个占用同一块内存的image的访问完成，slot中第一个image等待的是上一帧最后一个image，用整个slot访问的并集
+    State initialState(uint32_t r) const {
+        const Resource& resource = m_resources[r];
+        if (resource.imported) {
+            return resource.initial;
+        }
+        const std::vector<uint32_t>& images = m_physical.slotImages[m_physical.images[resource.transientIndex].slot];
+        State state;
+        size_t position = std::find(images.begin(), images.end(), resource.transientIndex) - images.begin();
+        if (position == 0) {
+            for (uint32_t other : images) {
+                state.stage |= m_resources[m_transientResources[other]].allStages;
+                state.access |= m_resources[m_transientResources[other]].allWrites;
+            }
+        } else {
+            const Resource& previous = m_resources[m_transientResources[images[position - 1]]];
+            state.stage = previous.allStages;
+            state.access = previous.allWrites;
+        }
+        return state;
+    }
+
+    // render graph：读之后读并且layout相同时不需要barrier，其余情况（写之后读、写之后写、读之后写、layout变化）都需要
+    void computeBarriers() {
+        std::vector<State>& states = m_states;
+        std::vector<bool>& touched = m_touched;
+        states.assign(m_resources.size(), State{});
+        touched.assign(m_resources.size(), false);
+        for (Pass& pass : m_passes) {
+            pass.barriers.clear();
+            if (pass.culled) {
+                continue;
+            }
+            for (const Use& use : pass.uses) {
+                State& state = states[use.handle];
+                if (!touched[use.handle]) {
+                    state = initialState(use.handle);
+                    touched[use.handle] = true;
+                }
+
+                VkPipelineStageFlags stage;
+                VkAccessFlags access;
+                VkImageLayout layout;
+                VkImageUsageFlags usage;
+                accessInfo(use.access, stage, access, layout, usage);
+
+                bool lastWasWrite = (state.access & WRITE_ACCESS) != 0;
+                if (!use.write && !lastWasWrite && state.layout == layout && state.stage != 0) {
+                    state.stage |= stage;  // 读之后读，记录读的stage供之后的写等待
+                    continue;
+                }
+
+                Barrier barrier{};
+                barrier.barrier = imageBarrier(use.handle, state.layout, layout);
+                barrier.barrier.srcAccessMask = state.access;
+                barrier.barrier.dstAccessMask = access;
+                barrier.srcStage = state.stage != 0 ? state.stage : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+                barrier.dstStage = stage;
+                pass.barriers.push_back(barrier);
+
+                state.layout = layout;
+                state.stage = stage;
+                state.access = use.write ? (access & WRITE_ACCESS) : 0;
+            }
+        }
+
+        // render graph：外部image转换到finalLayout，有queue family所有权转移时即使layout相同也需要barrier
+        m_finalBarriers.clear();
+        for (uint32_t r = 0; r < m_resources.size(); r++) {
+            const Resource& resource = m_resources[r];
+            if (!resource.imported || !touched[r]) {
+                continue;
+            }
+            if (states[r].layout == resource.finalLayout && resource.srcQueueFamily == resource.dstQueueFamily) {
+                continue;
+            }
+            Barrier barrier{};
+            barrier.barrier = imageBarrier(r, states[r].layout, resource.finalLayout);
+            barrier.barrier.srcAccessMask = states[r].access;
+            barrier.barrier.dstAccessMask = 0;
+            barrier.barrier.srcQueueFamilyIndex = resource.srcQueueFamily;
+            barrier.barrier.dstQueueFamilyIndex = resource.dstQueueFamily;
+            barrier.srcStage = states[r].stage;
+            barrier.dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+            m_finalBarriers.push_back(barrier);
+        }
+    }
+
+    VkImageMemoryBarrier imageBarrier(RenderGraphHandle handle, VkImageLayout oldLayout, VkImageLayout newLayout) const {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image(handle);
+        barrier.subresourceRange = {m_resources[handle].desc.aspect, 0, 1, 0, 1};
+        return barrier;
+    }
+
+    void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers) {
+        ImageBarrierBatch& batch = m_barrierBatch;
+        for (const Barrier& barrier : barriers) {
+            batch.add(barrier.barrier, barrier.srcStage, barrier.dstStage);
+        }
+        batch.record(commandBuffer);
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    RetireFunction m_retire;
+    bool m_lazilyAllocated = false;
+
+    std::vector<Resource> m_resources;
+    std::vector<Pass> m_passes;
+    std::vector<Barrier> m_finalBarriers;
+    bool m_compiled = false;
+
+    Physical m_physical;
+    std::vector<uint32_t> m_transientResources;  // transient序号到这一帧resource序号
+    uint32_t m_aliasedImageCount = 0;
+
+    // heap tracker：reset留下的vector和compile的临时数组，每帧复用
+    std::vector<std::vector<Use>> m_spareUses;
+    std::vector<std::vector<Barrier>> m_spareBarriers;
+    std::vector<bool> m_needed;
+    std::vector<bool> m_touched;
+    std::vector<State> m_states;
+    std::vector<TransientKey> m_transientKeys;
+    ImageBarrierBatch m_barrierBatch;
+};
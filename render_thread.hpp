@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+#include "frame_queue.hpp"
+
+// render thread：主线程只处理glfw事件（glfw的窗口函数大多只能在主线程调用），所有vulkan的录制、提交、acquire和present在渲染线程
+// present或acquire阻塞时主线程照样处理输入，移动键直接交给模拟，其它输入放进frame packet，渲染线程在每帧开始时取走
+// 渲染线程需要的窗口状态（framebuffer大小）也通过packet传递；窗口标题反过来由渲染线程交给主线程设置
+// frame queue：输入经过无锁的spsc ring，framebuffer大小是原子变量，标题是triple buffer，两个线程的循环中都没有锁
+struct FramePacket {
+    int framebufferWidth = 0;
+    int framebufferHeight = 0;
+    std::vector<int> keys;  // 按下的功能键，按顺序处理
+    std::vector<glm::vec2> picks;  // 鼠标点击位置的ndc坐标
+    std::chrono::steady_clock::time_point inputTime;  // input latency：上一次take之后最早的输入，没有输入时是epoch
+};
+
+class RenderThread {
+public:
+    // render thread：loop返回或者抛出异常后线程结束，异常在join时从主线程重新抛出
+    void start(std::function<void()> loop) {
+        m_running = true;
+        m_thread = std::thread([this, loop]() {
+            CpuProfiler::instance().setThreadName("render");
+            try {
+                loop();
+            } catch (...) {
+                m_error = std::current_exception();
+            }
+            m_running = false;
+        });
+    }
+
+    bool running() const { return m_running; }
+
+    void join() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        if (m_error) {
+            std::exception_ptr error = m_error;
+            m_error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    // render thread：以下三个在主线程调用
+    // frame queue：framebuffer大小打包进一个64位原子变量，宽和高总是一起更新
+    void setFramebufferSize(int width, int height) {
+        m_framebufferSize.store((uint64_t(uint32_t(width)) << 32) | uint32_t(height), std::memory_order_relaxed);
+    }
+
+    // frame queue：输入队列满时丢弃这次输入，渲染线程每帧都会清空队列，只有渲染线程卡住时才会发生
+    void pushKey(int key) { m_inputs.push({key, glm::vec2(0.0f), false}); }
+
+    void pushPick(glm::vec2 ndc) { m_inputs.push({0, ndc, true}); }
+
+    // input latency：移动键不经过输入队列，所以时间单独传递；只保留渲染线程取走之前最早的一次
+    void markInput(std::chrono::steady_clock::time_point time) {
+        int64_t expected = 0;
+        m_inputTime.compare_exchange_strong(expected, time.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
+    // render thread：渲染线程每帧开始时取走积累的输入，framebuffer大小是最新的值
+    // heap tracker：packet由调用者持有，每帧清空后复用keys和picks的容量
+    void take(FramePacket& packet) {
+        packet.keys.clear();
+        packet.picks.clear();
+        framebufferSize(packet.framebufferWidth, packet.framebufferHeight);
+        packet.inputTime = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(m_inputTime.exchange(0, std::memory_order_relaxed)));
+        Input input;
+        while (m_inputs.pop(input)) {
+            if (input.pick) {
+                packet.picks.push_back(input.ndc);
+            } else {
+                packet.keys.push_back(input.key);
+            }
+        }
+    }
+
+    void framebufferSize(int& width, int& height) const {
+        uint64_t size = m_framebufferSize.load(std::memory_order_relaxed);
+        width = int(uint32_t(size >> 32));
+        height = int(uint32_t(size));
+    }
+
+    // render thread：渲染线程设置，主线程取走后调用glfwSetWindowTitle
+    // heap tracker：复制进triple buffer中复用的string，三个buffer的容量稳定之后不再分配
+    void setTitle(const std::string& title) {
+        m_titles.back().assign(title);
+        m_titles.publish();
+    }
+
+    bool takeTitle(std::string& title) {
+        if (!m_titles.update()) {
+            return false;
+        }
+        title = m_titles.front();
+        return true;
+    }
+
+private:
+    std::thread m_thread;
+    std::atomic<bool> m_running{false};
+    std::exception_ptr m_error;  // 线程结束前写入，join之后读取
+
+    // frame queue：主线程是输入和framebuffer大小的生产者，渲染线程是窗口标题的生产者，都是单生产者单消费者
+    struct Input {
+        int key;
+        glm::vec2 ndc;
+        bool pick;  // true时是点击，否则是按键
+    };
+    SpscRing<Input, 256> m_inputs;
+    std::atomic<uint64_t> m_framebufferSize{0};
+    std::atomic<int64_t> m_inputTime{0};
+    TripleBuffer<std::string> m_titles;
+};
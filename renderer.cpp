@@ -0,0 +1,31 @@
+// vulkan renderer：第三方库的实现放在库自己的编译单元，main.cpp和benchmark只包含声明
+// 之前stb、tinyobjloader和tinygltf的实现在main.cpp中，修改应用代码时每次都要重新编译它们，benchmark也无法复用
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+
+// heap tracker：全局operator new/delete的替换，整个程序只能有一份，放在库的编译单元中
+#define HEAP_TRACKER_IMPLEMENTATION
+#include "heap_tracker.hpp"
+
+// staging decode：stb的内存分配替换成可以直接返回staging空间的版本，宏只在实现所在的编译单元生效
+#include "staging_decode.hpp"
+#define STBI_MALLOC(size) stagingDecodeMalloc(size)
+#define STBI_REALLOC(p, size) stagingDecodeRealloc(p, size)
+#define STBI_FREE(p) stagingDecodeFree(p)
+#define STB_IMAGE_IMPLEMENTATION
+#include "thirdparty/stb/stb_image.h"
+
+// frame capture：png编码使用tinygltf附带的stb_image_write
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "thirdparty/tinygltf/stb_image_write.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "thirdparty/tiny_obj/tiny_obj_loader.h"
+
+// gltf：图片交给stb和texture cache解码，不使用tinygltf自带的stb和外部图片读取
+#define TINYGLTF_IMPLEMENTATION
+#define TINYGLTF_NO_STB_IMAGE
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#define TINYGLTF_NO_EXTERNAL_IMAGE
+#include "gltf_loader.hpp"
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// residency：记录每个资源最后一次被使用的帧，显存接近预算时按最久没有使用的顺序选出可以降级或释放的资源
+// 帧编号由调用者维护，每帧加一；track只登记没有记录的资源，刚加载还没有被看见的资源不会立刻被当作最久没有使用
+// 资源销毁后调用forget，调用者也可以在选出的资源已经无效时再forget
+// 只在主线程使用
+class ResidencyTracker {
+public:
+    void track(uint32_t handle, uint64_t frame) {
+        m_lastUsed.try_emplace(handle, frame);
+    }
+
+    void touch(uint32_t handle, uint64_t frame) {
+        m_lastUsed[handle] = frame;
+    }
+
+    void forget(uint32_t handle) {
+        m_lastUsed.erase(handle);
+    }
+
+    // residency：至少idleFrames帧没有使用的资源，最久没有使用的在前；结果写入out，容量在帧之间复用
+    void leastRecentlyUsed(uint64_t frame, uint64_t idleFrames, std::vector<uint32_t>& out) const {
+        out.clear();
+        for (const auto& [handle, lastUsed] : m_lastUsed) {
+            if (frame - lastUsed >= idleFrames) {
+                out.push_back(handle);
+            }
+        }
+        std::sort(out.begin(), out.end(), [this](uint32_t a, uint32_t b) {
+            uint64_t lastA = m_lastUsed.at(a);
+            uint64_t lastB = m_lastUsed.at(b);
+            return lastA != lastB ? lastA < lastB : a < b;  // 同一帧使用的按handle排序，结果不依赖hash表的顺序
+        });
+    }
+
+    uint64_t lastUsed(uint32_t handle) const {
+        auto it = m_lastUsed.find(handle);
+        return it != m_lastUsed.end() ? it->second : 0;
+    }
+
+    size_t size() const { return m_lastUsed.size(); }
+
+private:
+    std::unordered_map<uint32_t, uint64_t> m_lastUsed;
+};
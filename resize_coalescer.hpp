@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <chrono>
+
+// live resize：拖动窗口边框时每一帧都有新的framebuffer大小，之前每次present之后都重建swap chain、depth和跟随分辨率的资源
+// 现在窗口回调只记录最后一次事件的时间，present仍然成功（VK_SUCCESS或者VK_SUBOPTIMAL_KHR）时继续使用旧的swap chain
+// 大小在settle时间内没有再变化才重建一次；拖动中旧的image由呈现引擎缩放到窗口（swapchain maintenance1的present scaling）
+// acquire或者present返回VK_ERROR_OUT_OF_DATE_KHR时旧的swap chain已经不能使用，仍然马上重建
+class ResizeCoalescer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // live resize：任意线程调用，一般是主线程的glfw回调
+    void notify() {
+        m_lastEvent.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        m_pending.store(true, std::memory_order_release);
+    }
+
+    bool pending() const { return m_pending.load(std::memory_order_acquire); }
+
+    // live resize：有没有处理的事件，并且最后一次事件之后已经过了seconds
+    bool settled(float seconds) const {
+        if (!pending()) {
+            return false;
+        }
+        Clock::time_point last{Clock::duration(m_lastEvent.load(std::memory_order_relaxed))};
+        return std::chrono::duration<float>(Clock::now() - last).count() >= seconds;
+    }
+
+    // live resize：VK_EXT_swapchain_maintenance1的feature，instance还需要VK_EXT_surface_maintenance1才能查询scaling能力
+    static bool scalingSupported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT maintenanceFeatures{};
+        maintenanceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &maintenanceFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return maintenanceFeatures.swapchainMaintenance1;
+    }
+
+    // live resize：查询presentMode下的scaling能力，按比例缩放（letterbox）优先，其次拉伸，最后1:1，居中对齐
+    // 呈现引擎都不支持时返回false，swap chain不设置scaling，拖动中的显示由平台决定
+    static bool chooseScaling(VkInstance instance, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkPresentModeKHR presentMode,
+        VkSwapchainPresentScalingCreateInfoEXT& scalingInfo) {
+        auto getCapabilities2 = (PFN_vkGetPhysicalDeviceSurfaceCapabilities2KHR) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceSurfaceCapabilities2KHR");
+        if (getCapabilities2 == nullptr) {
+            return false;
+        }
+        VkSurfacePresentModeEXT surfacePresentMode{};
+        surfacePresentMode.sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_EXT;
+        surfacePresentMode.presentMode = presentMode;
+        VkPhysicalDeviceSurfaceInfo2KHR surfaceInfo{};
+        surfaceInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SURFACE_INFO_2_KHR;
+        surfaceInfo.pNext = &surfacePresentMode;
+        surfaceInfo.surface = surface;
+        VkSurfacePresentScalingCapabilitiesEXT scalingCapabilities{};
+        scalingCapabilities.sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_SCALING_CAPABILITIES_EXT;
+        VkSurfaceCapabilities2KHR capabilities2{};
+        capabilities2.sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_2_KHR;
+        capabilities2.pNext = &scalingCapabilities;
+        if (getCapabilities2(physicalDevice, &surfaceInfo, &capabilities2) != VK_SUCCESS) {
+            return false;
+        }
+
+        VkPresentScalingFlagsEXT scaling = scalingCapabilities.supportedPresentScaling;
+        scalingInfo = {};
+        scalingInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_SCALING_CREATE_INFO_EXT;
+        if (scaling & VK_PRESENT_SCALING_ASPECT_RATIO_STRETCH_BIT_EXT) {
+            scalingInfo.scalingBehavior = VK_PRESENT_SCALING_ASPECT_RATIO_STRETCH_BIT_EXT;
+        } else if (scaling & VK_PRESENT_SCALING_STRETCH_BIT_EXT) {
+            scalingInfo.scalingBehavior = VK_PRESENT_SCALING_STRETCH_BIT_EXT;
+        } else if (scaling & VK_PRESENT_SCALING_ONE_TO_ONE_BIT_EXT) {
+            scalingInfo.scalingBehavior = VK_PRESENT_SCALING_ONE_TO_ONE_BIT_EXT;
+        } else {
+            return false;
+        }
+        scalingInfo.presentGravityX = chooseGravity(scalingCapabilities.supportedPresentGravityX);
+        scalingInfo.presentGravityY = chooseGravity(scalingCapabilities.supportedPresentGravityY);
+        return true;
+    }
+
+    // live resize：重建swap chain之前调用，之后的事件重新开始计时；重建读取的是那时最新的framebuffer大小
+    void clear() {
+        m_pending.store(false, std::memory_order_release);
+    }
+
+private:
+    static VkPresentGravityFlagsEXT chooseGravity(VkPresentGravityFlagsEXT supported) {
+        if (supported & VK_PRESENT_GRAVITY_CENTERED_BIT_EXT) {
+            return VK_PRESENT_GRAVITY_CENTERED_BIT_EXT;
+        }
+        if (supported & VK_PRESENT_GRAVITY_MIN_BIT_EXT) {
+            return VK_PRESENT_GRAVITY_MIN_BIT_EXT;
+        }
+        return 0;
+    }
+
+    std::atomic<bool> m_pending{false};
+    std::atomic<Clock::rep> m_lastEvent{0};
+};
@@ -0,0 +1,35 @@
+#!/bin/bash
+
+if test \( $# -lt 1 \);
+then
+    echo "Usage: ./run_regression.sh executable [--update-baseline]"
+    echo ""
+    echo "  executable          -   path to the built VulkanTutorial"
+    echo "  --update-baseline   -   overwrite the stored baselines with this run"
+    echo ""
+    exit 1
+fi
+
+EXECUTABLE="$1"
+MODE="--regression"
+if test \( \( -n "$2" \) -a \( "$2" = "--update-baseline" \) \);then
+    MODE="--update-baseline"
+fi
+
+SCENES="models/AC_Unit.obj"
+
+FAILED=0
+for SCENE in ${SCENES}
+do
+    NAME=$(basename "${SCENE}" .obj)
+    echo "regression: ${SCENE}"
+    "${EXECUTABLE}" ${MODE} --headless --scene "${SCENE}"
+    if test $? -ne 0;then
+        FAILED=1
+    fi
+    if test -f regression_report.json;then
+        mv regression_report.json "regression_report_${NAME}.json"
+    fi
+done
+
+exit ${FAILED}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "host_memory.hpp"
+
+// sampler cache：sampler只由创建参数决定，不同纹理可以共享同一个sampler
+// 按VkSamplerCreateInfo的内容hash去重，避免每个材质都创建sampler导致超出maxSamplerAllocationCount
+// sampler和cache同生命周期，程序退出时统一销毁
+class SamplerCache {
+public:
+    // portability profile：portability subset不支持samplerMipLodBias时，cache中创建的sampler的bias都是0
+    void init(VkDevice device, uint32_t maxSamplerAllocationCount, bool mipLodBiasSupported = true) {
+        m_device = device;
+        m_maxSamplers = maxSamplerAllocationCount;
+        m_mipLodBiasSupported = mipLodBiasSupported;
+    }
+
+    void cleanup() {
+        for (auto& item : m_samplers) {
+            vkDestroySampler(m_device, item.second, hostAllocator());
+        }
+        m_samplers.clear();
+    }
+
+    // sampler cache：参数相同时返回已有的sampler，pNext需要为空，扩展结构体无法按值比较
+    VkSampler get(const VkSamplerCreateInfo& createInfo) {
+        if (createInfo.pNext != nullptr) {
+            throw std::runtime_error("sampler cache does not support pNext chains!");
+        }
+
+        VkSamplerCreateInfo info = createInfo;
+        if (!m_mipLodBiasSupported) {
+            info.mipLodBias = 0.0f;
+        }
+        Key key(info);
+        auto it = m_samplers.find(key);
+        if (it != m_samplers.end()) {
+            return it->second;
+        }
+
+        if (m_samplers.size() >= m_maxSamplers) {
+            throw std::runtime_error("exceeded maxSamplerAllocationCount!");
+        }
+
+        VkSampler sampler;
+        if (vkCreateSampler(m_device, &info, hostAllocator(), &sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create texture sampler!");
+        }
+        m_samplers[key] = sampler;
+        return sampler;
+    }
+
+    size_t size() const { return m_samplers.size(); }
+
+private:
+    // sampler cache：去掉sType和pNext之后的创建参数，float按位比较
+    struct Key {
+        VkSamplerCreateInfo info;
+
+        explicit Key(const VkSamplerCreateInfo& createInfo) : info(createInfo) {
+            info.pNext = nullptr;
+        }
+
+        bool operator==(const Key& other) const {
+            return info.flags == other.info.flags
+                && info.magFilter == other.info.magFilter
+                && info.minFilter == other.info.minFilter
+                && info.mipmapMode == other.info.mipmapMode
+                && info.addressModeU == other.info.addressModeU
+                && info.addressModeV == other.info.addressModeV
+                && info.addressModeW == other.info.addressModeW
+                && sameBits(info.mipLodBias, other.info.mipLodBias)
+                && info.anisotropyEnable == other.info.anisotropyEnable
+                && sameBits(info.maxAnisotropy, other.info.maxAnisotropy)
+                && info.compareEnable == other.info.compareEnable
+                && info.compareOp == other.info.compareOp
+                && sameBits(info.minLod, other.info.minLod)
+                && sameBits(info.maxLod, other.info.maxLod)
+                && info.borderColor == other.info.borderColor
+                && info.unnormalizedCoordinates == other.info.unnormalizedCoordinates;
+        }
+
+        static bool sameBits(float a, float b) { return bits(a) == bits(b); }
+        static uint32_t bits(float value) { uint32_t result; memcpy(&result, &value, sizeof(result)); return result; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            const VkSamplerCreateInfo& info = key.info;
+            uint32_t fields[] = {
+                info.flags, static_cast<uint32_t>(info.magFilter), static_cast<uint32_t>(info.minFilter), static_cast<uint32_t>(info.mipmapMode),
+                static_cast<uint32_t>(info.addressModeU), static_cast<uint32_t>(info.addressModeV), static_cast<uint32_t>(info.addressModeW),
+                Key::bits(info.mipLodBias), info.anisotropyEnable, Key::bits(info.maxAnisotropy), info.compareEnable,
+                static_cast<uint32_t>(info.compareOp), Key::bits(info.minLod), Key::bits(info.maxLod),
+                static_cast<uint32_t>(info.borderColor), info.unnormalizedCoordinates
+            };
+
+            uint64_t hash = 14695981039346656037ull;  // FNV-1a
+            for (uint32_t field : fields) {
+                hash ^= field;
+                hash *= 1099511628211ull;
+            }
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    uint32_t m_maxSamplers = 0;
+    bool m_mipLodBiasSupported = true;
+    std::unordered_map<Key, VkSampler, KeyHash> m_samplers;
+};
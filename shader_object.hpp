@@ -0,0 +1,179 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "dynamic_state.hpp"
+#include "shader_registry.hpp"
+
+// shader object：VK_EXT_shader_object直接绑定编译好的shader，不创建pipeline，内容变化时没有pipeline的编译开销
+// 所有状态都通过命令设置，RasterState中的状态由DynamicStateCommands设置，其余固定的状态由setStaticState每个command buffer设置一次
+// shader object只能和dynamic rendering一起使用，不支持时使用pipeline路径
+class ShaderObjectBackend {
+public:
+    struct Stage {
+        VkShaderStageFlagBits stage;
+        SpirvCode code;
+        const VkSpecializationInfo* specialization;
+    };
+
+    static bool supported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceShaderObjectFeaturesEXT features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return features.shaderObject;
+    }
+
+    // shader object：meshShader为true时task和mesh stage也需要在绘制时绑定，顶点路径把它们绑定为空
+    // variable rate shading：fragmentFlags加在所有fragment shader上，使用rate attachment时需要VK_SHADER_CREATE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_EXT
+    void init(VkDevice device, bool meshShader, VkShaderCreateFlagsEXT fragmentFlags = 0) {
+        m_device = device;
+        m_meshShader = meshShader;
+        m_fragmentFlags = fragmentFlags;
+        m_createShaders = loadDeviceFunction<PFN_vkCreateShadersEXT>(device, "vkCreateShadersEXT");
+        m_destroyShader = loadDeviceFunction<PFN_vkDestroyShaderEXT>(device, "vkDestroyShaderEXT");
+        m_bindShaders = loadDeviceFunction<PFN_vkCmdBindShadersEXT>(device, "vkCmdBindShadersEXT");
+        m_setVertexInput = loadDeviceFunction<PFN_vkCmdSetVertexInputEXT>(device, "vkCmdSetVertexInputEXT");
+        m_setViewportWithCount = loadDeviceFunction<PFN_vkCmdSetViewportWithCount>(device, "vkCmdSetViewportWithCount");
+        m_setScissorWithCount = loadDeviceFunction<PFN_vkCmdSetScissorWithCount>(device, "vkCmdSetScissorWithCount");
+        m_setRasterizerDiscardEnable = loadDeviceFunction<PFN_vkCmdSetRasterizerDiscardEnable>(device, "vkCmdSetRasterizerDiscardEnable");
+        m_setPrimitiveRestartEnable = loadDeviceFunction<PFN_vkCmdSetPrimitiveRestartEnable>(device, "vkCmdSetPrimitiveRestartEnable");
+        m_setDepthBiasEnable = loadDeviceFunction<PFN_vkCmdSetDepthBiasEnable>(device, "vkCmdSetDepthBiasEnable");
+        m_setStencilTestEnable = loadDeviceFunction<PFN_vkCmdSetStencilTestEnable>(device, "vkCmdSetStencilTestEnable");
+        m_setRasterizationSamples = loadDeviceFunction<PFN_vkCmdSetRasterizationSamplesEXT>(device, "vkCmdSetRasterizationSamplesEXT");
+        m_setSampleMask = loadDeviceFunction<PFN_vkCmdSetSampleMaskEXT>(device, "vkCmdSetSampleMaskEXT");
+        m_setAlphaToCoverageEnable = loadDeviceFunction<PFN_vkCmdSetAlphaToCoverageEnableEXT>(device, "vkCmdSetAlphaToCoverageEnableEXT");
+        m_setColorBlendEnable = loadDeviceFunction<PFN_vkCmdSetColorBlendEnableEXT>(device, "vkCmdSetColorBlendEnableEXT");
+        m_setColorWriteMask = loadDeviceFunction<PFN_vkCmdSetColorWriteMaskEXT>(device, "vkCmdSetColorWriteMaskEXT");
+    }
+
+    void cleanup() {
+        for (VkShaderEXT shader : m_shaders) {
+            m_destroyShader(m_device, shader, hostAllocator());
+        }
+        m_shaders.clear();
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // shader object：一组stage一次创建并链接，驱动可以像pipeline一样做跨stage的优化
+    // set layout和push constant必须和绑定descriptor时使用的pipeline layout一致
+    std::vector<VkShaderEXT> createLinked(const std::vector<Stage>& stages, const std::vector<VkDescriptorSetLayout>& setLayouts,
+        const std::vector<VkPushConstantRange>& pushConstantRanges) {
+        std::vector<VkShaderCreateInfoEXT> createInfos(stages.size());
+        for (size_t i = 0; i < stages.size(); i++) {
+            VkShaderCreateInfoEXT& info = createInfos[i];
+            info.sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+            info.flags = stages.size() > 1 ? VK_SHADER_CREATE_LINK_STAGE_BIT_EXT : 0;
+            if (stages[i].stage == VK_SHADER_STAGE_FRAGMENT_BIT) {
+                info.flags |= m_fragmentFlags;
+            }
+            info.stage = stages[i].stage;
+            info.nextStage = i + 1 < stages.size() ? static_cast<VkShaderStageFlags>(stages[i + 1].stage) : 0;
+            info.codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+            info.codeSize = stages[i].code.size;
+            info.pCode = stages[i].code.words;
+            info.pName = "main";
+            info.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+            info.pSetLayouts = setLayouts.data();
+            info.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+            info.pPushConstantRanges = pushConstantRanges.data();
+            info.pSpecializationInfo = stages[i].specialization;
+        }
+
+        std::vector<VkShaderEXT> shaders(stages.size());
+        if (m_createShaders(m_device, static_cast<uint32_t>(createInfos.size()), createInfos.data(), hostAllocator(), shaders.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shader objects!");
+        }
+        m_shaders.insert(m_shaders.end(), shaders.begin(), shaders.end());
+        return shaders;
+    }
+
+    // shader object：顶点路径只使用vertex input，mesh shader直接读取geometry buffer
+    void setVertexInput(const std::vector<VkVertexInputBindingDescription>& bindings, const std::vector<VkVertexInputAttributeDescription>& attributes) {
+        m_bindings.clear();
+        for (const VkVertexInputBindingDescription& binding : bindings) {
+            VkVertexInputBindingDescription2EXT description{};
+            description.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT;
+            description.binding = binding.binding;
+            description.stride = binding.stride;
+            description.inputRate = binding.inputRate;
+            description.divisor = 1;
+            m_bindings.push_back(description);
+        }
+        m_attributes.clear();
+        for (const VkVertexInputAttributeDescription& attribute : attributes) {
+            VkVertexInputAttributeDescription2EXT description{};
+            description.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT;
+            description.location = attribute.location;
+            description.binding = attribute.binding;
+            description.format = attribute.format;
+            description.offset = attribute.offset;
+            m_attributes.push_back(description);
+        }
+    }
+
+    // shader object：pipeline中固定的状态，和createGraphicsPipeline中的设置一致：不混合、不使用模版和深度偏移，采样数和attachment一致
+    void setStaticState(VkCommandBuffer commandBuffer, const VkViewport& viewport, const VkRect2D& scissor, VkSampleCountFlagBits samples) {
+        m_setViewportWithCount(commandBuffer, 1, &viewport);
+        m_setScissorWithCount(commandBuffer, 1, &scissor);
+        m_setRasterizerDiscardEnable(commandBuffer, VK_FALSE);
+        m_setPrimitiveRestartEnable(commandBuffer, VK_FALSE);
+        m_setDepthBiasEnable(commandBuffer, VK_FALSE);
+        m_setStencilTestEnable(commandBuffer, VK_FALSE);
+        m_setRasterizationSamples(commandBuffer, samples);
+        VkSampleMask sampleMask[2] = {~0u, ~0u};  // 64个采样需要两个mask
+        m_setSampleMask(commandBuffer, samples, sampleMask);
+        m_setAlphaToCoverageEnable(commandBuffer, VK_FALSE);
+        VkBool32 blendEnable = VK_FALSE;
+        m_setColorBlendEnable(commandBuffer, 0, 1, &blendEnable);
+        VkColorComponentFlags writeMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        m_setColorWriteMask(commandBuffer, 0, 1, &writeMask);
+        m_setVertexInput(commandBuffer, static_cast<uint32_t>(m_bindings.size()), m_bindings.data(), static_cast<uint32_t>(m_attributes.size()), m_attributes.data());
+    }
+
+    // shader object：绑定vertex和fragment，task和mesh绑定为空
+    void bindVertexShaders(VkCommandBuffer commandBuffer, VkShaderEXT vertex, VkShaderEXT fragment) {
+        VkShaderStageFlagBits stages[4] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT, VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT};
+        VkShaderEXT shaders[4] = {vertex, fragment, VK_NULL_HANDLE, VK_NULL_HANDLE};
+        m_bindShaders(commandBuffer, m_meshShader ? 4 : 2, stages, shaders);
+    }
+
+    // shader object：绑定task、mesh和fragment，vertex绑定为空
+    void bindMeshShaders(VkCommandBuffer commandBuffer, VkShaderEXT task, VkShaderEXT mesh, VkShaderEXT fragment) {
+        VkShaderStageFlagBits stages[4] = {VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT, VK_SHADER_STAGE_FRAGMENT_BIT, VK_SHADER_STAGE_VERTEX_BIT};
+        VkShaderEXT shaders[4] = {task, mesh, fragment, VK_NULL_HANDLE};
+        m_bindShaders(commandBuffer, 4, stages, shaders);
+    }
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    bool m_meshShader = false;
+    VkShaderCreateFlagsEXT m_fragmentFlags = 0;
+    std::vector<VkShaderEXT> m_shaders;
+    std::vector<VkVertexInputBindingDescription2EXT> m_bindings;
+    std::vector<VkVertexInputAttributeDescription2EXT> m_attributes;
+
+    PFN_vkCreateShadersEXT m_createShaders = nullptr;
+    PFN_vkDestroyShaderEXT m_destroyShader = nullptr;
+    PFN_vkCmdBindShadersEXT m_bindShaders = nullptr;
+    PFN_vkCmdSetVertexInputEXT m_setVertexInput = nullptr;
+    PFN_vkCmdSetViewportWithCount m_setViewportWithCount = nullptr;
+    PFN_vkCmdSetScissorWithCount m_setScissorWithCount = nullptr;
+    PFN_vkCmdSetRasterizerDiscardEnable m_setRasterizerDiscardEnable = nullptr;
+    PFN_vkCmdSetPrimitiveRestartEnable m_setPrimitiveRestartEnable = nullptr;
+    PFN_vkCmdSetDepthBiasEnable m_setDepthBiasEnable = nullptr;
+    PFN_vkCmdSetStencilTestEnable m_setStencilTestEnable = nullptr;
+    PFN_vkCmdSetRasterizationSamplesEXT m_setRasterizationSamples = nullptr;
+    PFN_vkCmdSetSampleMaskEXT m_setSampleMask = nullptr;
+    PFN_vkCmdSetAlphaToCoverageEnableEXT m_setAlphaToCoverageEnable = nullptr;
+    PFN_vkCmdSetColorBlendEnableEXT m_setColorBlendEnable = nullptr;
+    PFN_vkCmdSetColorWriteMaskEXT m_setColorWriteMask = nullptr;
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// shader registry：SPIR-V在构建时嵌入可执行文件，按shaders目录中的源文件名查找，比如"compact.vert"
+// 启动时不读取shader文件，也不依赖部署时shader放在哪个目录
+struct SpirvCode {
+    const uint32_t* words = nullptr;
+    size_t size = 0;  // 字节数，和VkShaderModuleCreateInfo的codeSize一致
+};
+
+struct EmbeddedShader {
+    std::string_view name;
+    SpirvCode code;
+};
+
+// CMakeLists.txt生成，包含EMBEDDED_SHADERS数组，每个SHADER_SOURCES一项
+#include "embedded_shaders.hpp"
+
+// shader registry：constexpr查找，可以用static_assert在编译时检查shader是否在SHADER_SOURCES中
+constexpr const EmbeddedShader* findEmbeddedShader(std::string_view name) {
+    for (const EmbeddedShader& shader : EMBEDDED_SHADERS) {
+        if (shader.name == name) {
+            return &shader;
+        }
+    }
+    return nullptr;
+}
+
+inline SpirvCode embeddedShader(std::string_view name) {
+    const EmbeddedShader* shader = findEmbeddedShader(name);
+    if (shader == nullptr) {
+        throw std::runtime_error("failed to find embedded shader " + std::string(name) + "!");
+    }
+    return shader->code;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// shader statistics：VK_KHR_pipeline_executable_properties报告驱动编译出的每个executable（一般是一个shader stage）的统计
+// 寄存器数量、spill、指令数和occupancy（wave或者warp的数量）都由驱动决定是否报告以及叫什么名字，这里按驱动给的名字原样记录
+// pipeline创建时需要VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR，驱动可能因此多做工作，所以只在打开时使用
+// 同一个名字的pipeline重新创建（比如swap chain重建）时替换之前的记录，统计和上一次不同才打印；退出时写入csv，两次运行的csv可以直接diff
+class ShaderStatistics {
+public:
+    static bool supported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDevicePipelineExecutablePropertiesFeaturesKHR executableFeatures{};
+        executableFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PIPELINE_EXECUTABLE_PROPERTIES_FEATURES_KHR;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &executableFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return executableFeatures.pipelineExecutableInfo;
+    }
+
+    void init(VkDevice device) {
+        m_device = device;
+        m_getExecutableProperties = (PFN_vkGetPipelineExecutablePropertiesKHR) vkGetDeviceProcAddr(device, "vkGetPipelineExecutablePropertiesKHR");
+        m_getExecutableStatistics = (PFN_vkGetPipelineExecutableStatisticsKHR) vkGetDeviceProcAddr(device, "vkGetPipelineExecutableStatisticsKHR");
+    }
+
+    bool active() const { return m_getExecutableProperties != nullptr && m_getExecutableStatistics != nullptr; }
+
+    // shader statistics：要报告的pipeline创建时加上的flag，没有打开时为0
+    VkPipelineCreateFlags createFlags() const { return active() ? VK_PIPELINE_CREATE_CAPTURE_STATISTICS_BIT_KHR : 0; }
+
+    // shader statistics：name区分pipeline的变体，比如使用的shader；可以在pipeline compiler的工作线程中调用
+    void record(VkPipeline pipeline, const std::string& name) {
+        if (!active() || pipeline == VK_NULL_HANDLE) {
+            return;
+        }
+        VkPipelineInfoKHR pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INFO_KHR;
+        pipelineInfo.pipeline = pipeline;
+        uint32_t executableCount = 0;
+        if (m_getExecutableProperties(m_device, &pipelineInfo, &executableCount, nullptr) != VK_SUCCESS) {
+            return;
+        }
+        std::vector<VkPipelineExecutablePropertiesKHR> properties(executableCount);
+        for (VkPipelineExecutablePropertiesKHR& property : properties) {
+            property.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_PROPERTIES_KHR;
+        }
+        if (m_getExecutableProperties(m_device, &pipelineInfo, &executableCount, properties.data()) != VK_SUCCESS) {
+            return;
+        }
+
+        std::vector<Executable> executables;
+        for (uint32_t i = 0; i < executableCount; i++) {
+            Executable executable;
+            executable.name = properties[i].name;
+            executable.stages = properties[i].stages;
+            executable.subgroupSize = properties[i].subgroupSize;
+
+            VkPipelineExecutableInfoKHR executableInfo{};
+            executableInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_INFO_KHR;
+            executableInfo.pipeline = pipeline;
+            executableInfo.executableIndex = i;
+            uint32_t statisticCount = 0;
+            if (m_getExecutableStatistics(m_device, &executableInfo, &statisticCount, nullptr) == VK_SUCCESS) {
+                std::vector<VkPipelineExecutableStatisticKHR> statistics(statisticCount);
+                for (VkPipelineExecutableStatisticKHR& statistic : statistics) {
+                    statistic.sType = VK_STRUCTURE_TYPE_PIPELINE_EXECUTABLE_STATISTIC_KHR;
+                }
+                if (m_getExecutableStatistics(m_device, &executableInfo, &statisticCount, statistics.data()) == VK_SUCCESS) {
+                    for (uint32_t j = 0; j < statisticCount; j++) {
+                        executable.statistics.push_back({statistics[j].name, formatValue(statistics[j])});
+                    }
+                }
+            }
+            executables.push_back(std::move(executable));
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<Executable>& recorded = m_pipelines[name];
+        if (recorded != executables) {
+            recorded = std::move(executables);
+            m_changed.push_back(name);
+            m_hasChanges.store(true, std::memory_order_release);
+        }
+    }
+
+    // shader statistics：打印上次调用之后新增或者改变的pipeline，在主线程每帧调用，工作线程只记录；没有变化时不加锁
+    void report(std::ostream& out) {
+        if (!m_hasChanges.exchange(false, std::memory_order_acquire)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::string& name : m_changed) {
+            for (const Executable& executable : m_pipelines[name]) {
+                out << "shader stats: " << name << " [" << executable.name << "] subgroup " << executable.subgroupSize;
+                for (const Statistic& statistic : executable.statistics) {
+                    out << ", " << statistic.name << " " << statistic.value;
+                }
+                out << std::endl;
+            }
+        }
+        m_changed.clear();
+    }
+
+    // shader statistics：每个统计一行，按pipeline名字排序
+    bool writeCsv(const std::string& path) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ofstream file(path);
+        if (!file) {
+            return false;
+        }
+        file << "pipeline,executable,stages,subgroup_size,statistic,value\n";
+        for (const auto& [name, executables] : m_pipelines) {
+            for (const Executable& executable : executables) {
+                for (const Statistic& statistic : executable.statistics) {
+                    file << name << "," << executable.name << "," << executable.stages << "," << executable.subgroupSize << "," << statistic.name << ","
+                         << statistic.value << "\n";
+                }
+            }
+        }
+        return static_cast<bool>(file);
+    }
+
+    size_t pipelineCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pipelines.size();
+    }
+
+private:
+    struct Statistic {
+        std::string name;
+        std::string value;
+        bool operator==(const Statistic&) const = default;
+    };
+
+    struct Executable {
+        std::string name;
+        VkShaderStageFlags stages = 0;
+        uint32_t subgroupSize = 0;
+        std::vector<Statistic> statistics;
+        bool operator==(const Executable&) const = default;
+    };
+
+    static std::string formatValue(const VkPipelineExecutableStatisticKHR& statistic) {
+        switch (statistic.format) {
+            case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_BOOL32_KHR:
+                return statistic.value.b32 ? "true" : "false";
+            case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_INT64_KHR:
+                return std::to_string(statistic.value.i64);
+            case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_UINT64_KHR:
+                return std::to_string(statistic.value.u64);
+            case VK_PIPELINE_EXECUTABLE_STATISTIC_FORMAT_FLOAT64_KHR:
+                return std::to_string(statistic.value.f64);
+            default:
+                return "";
+        }
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    PFN_vkGetPipelineExecutablePropertiesKHR m_getExecutableProperties = nullptr;
+    PFN_vkGetPipelineExecutableStatisticsKHR m_getExecutableStatistics = nullptr;
+    std::mutex m_mutex;  // 保护m_pipelines和m_changed，pipeline compiler的多个线程同时记录
+    std::map<std::string, std::vector<Executable>> m_pipelines;
+    std::vector<std::string> m_changed;
+    std::atomic<bool> m_hasChanges{false};
+};
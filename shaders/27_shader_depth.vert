@@ -1,20 +1,56 @@
-#version 450
+#version 460
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
-    mat4 proj;
+    mat4 viewProj;  // view projection：cpu上乘好的proj * view
+    mat4 sceneModel;
 } ubo;
 
+// push constant：每个draw的model矩阵，布局和main.cpp中的DrawPushConstants一致
+layout(push_constant) uniform DrawParams {
+    mat4 model;
+    layout(offset = 88) uint drawDataBase;
+    uint indirect;
+} draw;
+
+// multi draw indirect：indirect不为0时第gl_DrawID个draw的object编号从这一帧的draw数据中读取
+// scene objects：model从按mesh编号的object数据中读取
+layout(std430, binding = 1) readonly buffer DrawObjectBuffer {
+    uint drawObjects[];
+};
+struct SceneObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint materialIndex;
+};
+layout(std430, binding = 5) readonly buffer SceneObjectBuffer {
+    SceneObject objects[];
+};
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
+// instancing：binding 2每个实例的数据，mat4占用location 3到6
+layout(location = 3) in mat4 inInstanceTransform;
+layout(location = 7) in vec4 inInstanceColor;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragDrawData;
+layout(location = 3) out vec3 fragWorldPos;  // deferred shading：gbuffer.frag用它的导数重建面法线，forward的bindless.frag不读取
+
+// split vertex streams：position_only.vert的depth prepass和这里的位置必须逐位一致
+invariant gl_Position;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    fragColor = inColor;
+    uint object = draw.indirect != 0 ? drawObjects[draw.drawDataBase + gl_DrawID] : 0;
+    mat4 model = draw.indirect != 0 ? objects[object].model : draw.model;
+    // view projection：从右向左逐个做矩阵乘向量，每个顶点4次mat4 * vec4，不计算矩阵之间的乘积
+    vec4 worldPos = inInstanceTransform * (ubo.sceneModel * (model * vec4(inPosition, 1.0)));
+    gl_Position = ubo.viewProj * worldPos;
+    fragWorldPos = worldPos.xyz;
+    fragColor = inColor * inInstanceColor.rgb;
     fragTexCoord = inTexCoord;
+    fragDrawData = object;
 }
@@ -0,0 +1,191 @@
+#version 450
+
+// ray traced shadows：定义RAY_QUERY_SHADOWS编译成bindless_ray_query.frag，在TLAS有效（sunDirection.w不为0）的帧中向太阳发射ray代替shadow map
+#ifdef RAY_QUERY_SHADOWS
+#extension GL_EXT_ray_query : require
+#endif
+
+// half precision：定义HALF_PRECISION编译成bindless_fp16.frag（和RAY_QUERY_SHADOWS一起是bindless_ray_query_fp16.frag），需要shaderFloat16
+// 颜色、纹理结果和光照的累加用16位浮点，寄存器减半，移动和apple的gpu上16位运算的吞吐是32位的两倍
+// 位置、深度、导数、阴影坐标和光源距离仍然是32位，它们的范围和精度16位不够；颜色最后写进8位或者16位的attachment，half的10位尾数足够
+#ifdef HALF_PRECISION
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+#define mfloat float16_t
+#define mvec3 f16vec3
+#define mvec4 f16vec4
+#else
+#define mfloat float
+#define mvec3 vec3
+#define mvec4 vec4
+#endif
+
+// bindless：所有纹理在set 1的数组中，材质中的纹理index在一个draw内是uniform的，不需要nonuniformEXT
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// materials：push constant传入这个draw的材质编号；model矩阵在offset 0，只在顶点阶段使用
+layout(push_constant) uniform DrawParams {
+    layout(offset = 68) uint materialIndex;
+    layout(offset = 88) uint drawDataBase;
+    uint indirect;
+} draw;
+
+// materials：材质表，布局和GpuMaterial一致
+struct Material {
+    vec4 baseColorFactor;
+    vec2 uvScale;
+    vec2 uvOffset;
+    uint baseColorTexture;
+};
+layout(std430, binding = 7) readonly buffer MaterialBuffer {
+    Material materials[];
+};
+
+// multi draw indirect：indirect不为0时材质编号从顶点阶段传来的编号对应的object数据中读取
+// 一次multi draw中不同的draw属于不同的invocation group，index仍然是dynamically uniform
+struct SceneObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint materialIndex;
+};
+layout(std430, binding = 5) readonly buffer SceneObjectBuffer {
+    SceneObject objects[];
+};
+
+// clustered lighting：ubo的前面部分和顶点阶段相同，clusterGrid和clusterScale由ClusteredLighting填写
+// shadow cache：shadowViewProj是每个cascade内容绘制时的矩阵，shadowSplits是每个cascade远端的view depth
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 viewProj;  // view projection：cpu上乘好的proj * view
+    mat4 sceneModel;
+    uvec4 hiz;
+    uvec4 clusterGrid;  // w是光源数量，为0时不计算光照
+    vec4 clusterScale;  // xy把像素坐标映射到tile，slice = log(depth) * z + w
+    mat4 shadowViewProj[3];
+    vec4 shadowSplits;
+    vec4 sunDirection;  // 光线前进的方向，w不为0时使用ray traced shadows
+    vec4 sunColor;  // w为0时没有太阳光
+} ubo;
+
+// clustered lighting：光源和light_cluster.comp写入的cluster列表，布局见ClusterLight和ClusteredLighting
+struct Light {
+    vec4 positionRange;
+    vec4 color;  // w是聚光灯外锥角的cos，不大于-1时是点光源
+    vec4 direction;  // w是聚光灯内锥角的cos
+};
+layout(std430, binding = 2) readonly buffer LightBuffer {
+    Light lights[];
+};
+layout(std430, binding = 3) readonly buffer ClusterBuffer {
+    uint clusterLights[];
+};
+
+layout(binding = 4) uniform sampler2DArrayShadow shadowMap;
+#ifdef RAY_QUERY_SHADOWS
+layout(binding = 6) uniform accelerationStructureEXT sceneTlas;
+#endif
+
+const uint SHADOW_CASCADE_COUNT = 3;  // 和ShadowCache::CASCADE_COUNT一致
+const uint MAX_LIGHTS_PER_CLUSTER = 64;  // 和ClusteredLighting::MAX_LIGHTS_PER_CLUSTER一致
+const float AMBIENT = 0.25;
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragDrawData;
+layout(location = 3) in vec3 fragWorldPos;
+
+layout(location = 0) out vec4 outColor;
+
+// clustered lighting：只遍历这个像素所在cluster的光源，衰减在半径处平滑地降到0
+// 顶点没有法线，和gbuffer.frag一样用世界坐标的导数重建面法线，需要在uniform控制流中计算
+mvec3 clusteredLighting(vec3 normal) {
+    float depth = -(ubo.view * vec4(fragWorldPos, 1.0)).z;
+    uvec2 tile = min(uvec2(gl_FragCoord.xy * ubo.clusterScale.xy), ubo.clusterGrid.xy - 1);
+    uint slice = uint(clamp(log(max(depth, 1e-4)) * ubo.clusterScale.z + ubo.clusterScale.w, 0.0, float(ubo.clusterGrid.z - 1)));
+    uint cluster = tile.x + ubo.clusterGrid.x * (tile.y + ubo.clusterGrid.y * slice);
+    uint clusterCount = ubo.clusterGrid.x * ubo.clusterGrid.y * ubo.clusterGrid.z;
+
+    mvec3 lighting = mvec3(0.0);
+    uint count = clusterLights[cluster];
+    uint base = clusterCount + cluster * MAX_LIGHTS_PER_CLUSTER;
+    for (uint i = 0; i < count; i++) {
+        Light light = lights[clusterLights[base + i]];
+        vec3 toLight = light.positionRange.xyz - fragWorldPos;
+        float distance = length(toLight);
+        if (distance >= light.positionRange.w) {
+            continue;
+        }
+        vec3 direction = toLight / distance;
+        float falloff = clamp(1.0 - (distance * distance) / (light.positionRange.w * light.positionRange.w), 0.0, 1.0);
+        float attenuation = falloff * falloff;
+        if (light.color.w > -1.0) {
+            attenuation *= smoothstep(light.color.w, light.direction.w, dot(-direction, light.direction.xyz));
+        }
+        lighting += mvec3(light.color.rgb) * mfloat(max(dot(normal, direction), 0.0) * attenuation);
+    }
+    return lighting;
+}
+
+// shadow cache：按view depth选择cascade，比较sampler的bilinear加上2x2的偏移，超出最后一个cascade的片段不在阴影中
+float sunShadow(float depth) {
+    uint cascade = 0;
+    while (cascade < SHADOW_CASCADE_COUNT && depth > ubo.shadowSplits[cascade]) {
+        cascade++;
+    }
+    if (cascade == SHADOW_CASCADE_COUNT) {
+        return 1.0;
+    }
+    vec4 position = ubo.shadowViewProj[cascade] * vec4(fragWorldPos, 1.0);
+    vec3 coord = position.xyz / position.w;
+    vec2 uv = coord.xy * 0.5 + 0.5;
+    vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float shadow = 0.0;
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            vec2 offset = (vec2(x, y) - 0.5) * texel;
+            shadow += texture(shadowMap, vec4(uv + offset, float(cascade), coord.z));
+        }
+    }
+    return shadow * 0.25;
+}
+
+#ifdef RAY_QUERY_SHADOWS
+// ray traced shadows：只需要知道有没有遮挡，任意一个命中就结束；起点沿法线偏移避免和自己所在的三角形相交
+float rayTracedShadow(vec3 normal) {
+    rayQueryEXT query;
+    rayQueryInitializeEXT(query, sceneTlas, gl_RayFlagsTerminateOnFirstHitEXT | gl_RayFlagsOpaqueEXT | gl_RayFlagsSkipClosestHitShaderEXT, 0xff,
+        fragWorldPos + normal * 1e-3, 1e-3, -ubo.sunDirection.xyz, 1e4);
+    while (rayQueryProceedEXT(query)) {
+    }
+    return rayQueryGetIntersectionTypeEXT(query, true) == gl_RayQueryCommittedIntersectionNoneEXT ? 1.0 : 0.0;
+}
+#endif
+
+void main() {
+    // texture atlas：fract在page内实现repeat，fract在边界处不连续，用原始uv的导数选择mip
+    // texture atlas：uvScale和uvOffset把uv映射到atlas page中的区域，不在atlas中的纹理是(1, 1)和(0, 0)
+    Material material = materials[draw.indirect != 0 ? objects[fragDrawData].materialIndex : draw.materialIndex];
+    vec2 uv = fract(fragTexCoord) * material.uvScale + material.uvOffset;
+    // instancing：fragColor是顶点颜色乘上实例颜色
+    mvec4 color = mvec4(vec4(fragColor, 1.0)) * mvec4(material.baseColorFactor)
+        * mvec4(textureGrad(textures[material.baseColorTexture], uv, dFdx(fragTexCoord) * material.uvScale, dFdy(fragTexCoord) * material.uvScale));
+
+    vec3 normal = normalize(cross(dFdy(fragWorldPos), dFdx(fragWorldPos)));
+    if (ubo.clusterGrid.w != 0 || ubo.sunColor.w != 0.0) {
+        mvec3 lighting = mvec3(AMBIENT);
+        if (ubo.clusterGrid.w != 0) {
+            lighting += clusteredLighting(normal);
+        }
+        if (ubo.sunColor.w != 0.0) {
+            float depth = -(ubo.view * vec4(fragWorldPos, 1.0)).z;
+#ifdef RAY_QUERY_SHADOWS
+            float shadow = ubo.sunDirection.w != 0.0 ? rayTracedShadow(normal) : sunShadow(depth);
+#else
+            float shadow = sunShadow(depth);
+#endif
+            lighting += mvec3(ubo.sunColor.rgb) * mfloat(max(dot(normal, -ubo.sunDirection.xyz), 0.0) * shadow);
+        }
+        color.rgb *= lighting;
+    }
+    outColor = vec4(color);
+}
@@ -0,0 +1,24 @@
+#version 450
+
+// deferred shading：subpass 1的fragment shader，全屏三角形的每个像素从input attachment读取subpass 0在同一位置写入的G-buffer
+// subpassLoad只能读取当前像素，tile based gpu上数据直接来自tile memory
+// 一个方向光加环境光，光的方向在世界空间
+layout(input_attachment_index = 0, binding = 0) uniform subpassInput gbufferAlbedo;
+layout(input_attachment_index = 1, binding = 1) uniform subpassInput gbufferNormal;
+
+layout(location = 0) in vec2 fragUV;
+layout(location = 0) out vec4 outColor;
+
+const vec3 LIGHT_DIRECTION = vec3(0.4, 0.3, 0.866);  // 指向光源
+const float AMBIENT = 0.3;
+
+void main() {
+    vec4 albedo = subpassLoad(gbufferAlbedo);
+    if (albedo.a == 0.0) {
+        outColor = vec4(0.0, 0.0, 0.0, 1.0);  // 和forward的清除颜色一致
+        return;
+    }
+    vec3 normal = normalize(subpassLoad(gbufferNormal).xyz * 2.0 - 1.0);
+    float diffuse = max(dot(normal, normalize(LIGHT_DIRECTION)), 0.0);
+    outColor = vec4(albedo.rgb * (AMBIENT + (1.0 - AMBIENT) * diffuse), 1.0);
+}
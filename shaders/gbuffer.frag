@@ -0,0 +1,59 @@
+#version 450
+
+// deferred shading：subpass 0的fragment shader，纹理和bindless.frag相同，结果写进G-buffer而不是计算最终颜色
+// 顶点没有法线，用世界坐标在屏幕上的导数重建面法线；Vulkan的屏幕y向下，cross(dFdy, dFdx)朝向相机
+// bindless：所有纹理在set 1的数组中，材质中的纹理index在一个draw内是uniform的，不需要nonuniformEXT
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// materials：push constant传入这个draw的材质编号；model矩阵在offset 0，只在顶点阶段使用
+layout(push_constant) uniform DrawParams {
+    layout(offset = 68) uint materialIndex;
+    layout(offset = 88) uint drawDataBase;
+    uint indirect;
+} draw;
+
+// materials：材质表，布局和GpuMaterial一致
+struct Material {
+    vec4 baseColorFactor;
+    vec2 uvScale;
+    vec2 uvOffset;
+    uint baseColorTexture;
+};
+layout(std430, binding = 7) readonly buffer MaterialBuffer {
+    Material materials[];
+};
+
+// multi draw indirect：indirect不为0时材质编号从顶点阶段传来的编号对应的object数据中读取
+// 一次multi draw中不同的draw属于不同的invocation group，index仍然是dynamically uniform
+struct SceneObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint materialIndex;
+};
+layout(std430, binding = 5) readonly buffer SceneObjectBuffer {
+    SceneObject objects[];
+};
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragDrawData;
+layout(location = 3) in vec3 fragWorldPos;
+
+// deferred shading：alpha为1表示这个像素有几何，清除值0的像素在光照subpass中输出背景色
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;  // A2B10G10R10，法线映射到[0, 1]
+
+void main() {
+    // texture atlas：fract在page内实现repeat，fract在边界处不连续，用原始uv的导数选择mip
+    // texture atlas：uvScale和uvOffset把uv映射到atlas page中的区域，不在atlas中的纹理是(1, 1)和(0, 0)
+    Material material = materials[draw.indirect != 0 ? objects[fragDrawData].materialIndex : draw.materialIndex];
+    vec2 uv = fract(fragTexCoord) * material.uvScale + material.uvOffset;
+    // instancing：fragColor是顶点颜色乘上实例颜色
+    vec4 color = vec4(fragColor, 1.0) * material.baseColorFactor
+        * textureGrad(textures[material.baseColorTexture], uv, dFdx(fragTexCoord) * material.uvScale, dFdy(fragTexCoord) * material.uvScale);
+    outAlbedo = vec4(color.rgb, 1.0);
+
+    vec3 normal = normalize(cross(dFdy(fragWorldPos), dFdx(fragWorldPos)));
+    outNormal = vec4(normal * 0.5 + 0.5, 0.0);
+}
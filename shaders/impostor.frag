@@ -0,0 +1,66 @@
+#version 450
+
+// impostor：视线和frame平面（过包围球中心、垂直于frame方向）的交点决定cell中的uv，depth把交点沿frame方向移到烘焙的表面
+// 表面的位置写入gl_FragDepth，和场景的mesh正确地互相遮挡；法线和bindless.frag一样用世界坐标的导数重建
+// 纹理的index来自实例，每个page一次draw，一次draw内是uniform的，不需要nonuniformEXT
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// impostor：远处只有环境光和太阳光，不计算cluster的点光源，也不采样shadow map（超出最后一个cascade的片段不在阴影中）
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 viewProj;  // view projection：cpu上乘好的proj * view
+    mat4 sceneModel;
+    uvec4 hiz;
+    uvec4 clusterGrid;  // w是光源数量
+    vec4 clusterScale;
+    mat4 shadowViewProj[3];
+    vec4 shadowSplits;
+    vec4 sunDirection;  // 光线前进的方向
+    vec4 sunColor;  // w为0时没有太阳光
+} ubo;
+
+const float AMBIENT = 0.25;  // 和bindless.frag一致
+
+layout(location = 0) in vec3 fragLocalPos;
+layout(location = 1) flat in vec3 fragLocalCamera;
+layout(location = 2) flat in vec3 fragFrameDirection;
+layout(location = 3) flat in vec3 fragFrameRight;
+layout(location = 4) flat in vec3 fragFrameUp;
+layout(location = 5) flat in vec4 fragCenterRadius;
+layout(location = 6) flat in vec4 fragCell;
+layout(location = 7) flat in uvec2 fragTextures;
+layout(location = 8) flat in vec3 fragColor;
+layout(location = 9) flat in mat4 fragLocalToWorld;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec3 center = fragCenterRadius.xyz;
+    float radius = fragCenterRadius.w;
+    vec3 ray = normalize(fragLocalPos - fragLocalCamera);
+    float t = dot(center - fragLocalCamera, fragFrameDirection) / min(dot(ray, fragFrameDirection), -1e-4);
+    vec3 offset = fragLocalCamera + ray * t - center;
+    vec2 cellUv = vec2(0.5 + 0.5 * dot(offset, fragFrameRight) / radius, 0.5 - 0.5 * dot(offset, fragFrameUp) / radius);
+    vec2 uv = fragCell.xy + clamp(cellUv, 0.0, 1.0) * fragCell.zw;
+
+    vec4 albedo = textureLod(textures[fragTextures.x], uv, 0.0);
+    float depth = textureLod(textures[fragTextures.y], uv, 0.0).r;
+    // 烘焙的正交投影中depth 0是包围球靠近相机的一侧，1是另一侧
+    vec3 surface = center + offset + fragFrameDirection * (radius * (1.0 - 2.0 * depth));
+    vec3 worldPos = (fragLocalToWorld * vec4(surface, 1.0)).xyz;
+    vec4 clip = ubo.viewProj * vec4(worldPos, 1.0);
+    gl_FragDepth = clip.z / clip.w;
+    vec3 normal = normalize(cross(dFdy(worldPos), dFdx(worldPos)));  // 导数在丢弃片段之前计算
+
+    if (albedo.a < 0.5 || any(lessThan(cellUv, vec2(0.0))) || any(greaterThan(cellUv, vec2(1.0)))) {
+        discard;
+    }
+    outColor = vec4(albedo.rgb * fragColor, 1.0);
+    if (ubo.clusterGrid.w != 0 || ubo.sunColor.w != 0.0) {
+        vec3 lighting = vec3(AMBIENT);
+        if (ubo.sunColor.w != 0.0) {
+            lighting += ubo.sunColor.rgb * max(dot(normal, -ubo.sunDirection.xyz), 0.0);
+        }
+        outColor.rgb *= lighting;
+    }
+}
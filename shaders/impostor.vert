@@ -0,0 +1,91 @@
+#version 450
+
+// impostor：每个实例一个面向相机的四边形，6个顶点由gl_VertexIndex生成，实例数据的布局和ImpostorInstance一致
+// 四边形在mesh空间中垂直于视线，大小覆盖包围球在透视投影下的轮廓；离视线方向最近的frame和它的基在这里选好，整个四边形使用同一个frame
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 viewProj;  // view projection：cpu上乘好的proj * view
+} ubo;
+
+layout(location = 0) in mat4 inLocalToWorld;
+layout(location = 4) in vec4 inCenterRadius;
+layout(location = 5) in vec4 inTile;
+layout(location = 6) in uvec4 inTextures;
+layout(location = 7) in vec4 inColor;
+
+layout(location = 0) out vec3 fragLocalPos;
+layout(location = 1) flat out vec3 fragLocalCamera;
+layout(location = 2) flat out vec3 fragFrameDirection;
+layout(location = 3) flat out vec3 fragFrameRight;
+layout(location = 4) flat out vec3 fragFrameUp;
+layout(location = 5) flat out vec4 fragCenterRadius;
+layout(location = 6) flat out vec4 fragCell;  // xy是cell在page中的uv偏移，zw是cell的uv大小
+layout(location = 7) flat out uvec2 fragTextures;
+layout(location = 8) flat out vec3 fragColor;
+layout(location = 9) flat out mat4 fragLocalToWorld;
+
+const vec2 CORNERS[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+// octahedral：和impostor.hpp中的octahedralDecode一致，encode是它的逆
+vec3 octahedralDecode(vec2 uv) {
+    vec2 p = uv * 2.0 - 1.0;
+    vec3 direction = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+    if (direction.z < 0.0) {
+        vec2 folded = 1.0 - abs(direction.yx);
+        direction.xy = vec2(direction.x >= 0.0 ? folded.x : -folded.x, direction.y >= 0.0 ? folded.y : -folded.y);
+    }
+    return normalize(direction);
+}
+
+vec2 octahedralEncode(vec3 direction) {
+    direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+    vec2 p = direction.xy;
+    if (direction.z < 0.0) {
+        vec2 folded = 1.0 - abs(direction.yx);
+        p = vec2(direction.x >= 0.0 ? folded.x : -folded.x, direction.y >= 0.0 ? folded.y : -folded.y);
+    }
+    return p * 0.5 + 0.5;
+}
+
+// impostor：和impostor.hpp中的impostorFrameBasis一致
+void frameBasis(vec3 direction, out vec3 right, out vec3 up) {
+    vec3 reference = abs(direction.z) > 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0);
+    right = normalize(cross(reference, direction));
+    up = cross(direction, right);
+}
+
+void main() {
+    vec3 center = inCenterRadius.xyz;
+    float radius = inCenterRadius.w;
+    vec3 cameraWorld = -(transpose(mat3(ubo.view)) * ubo.view[3].xyz);
+    vec3 localCamera = (inverse(inLocalToWorld) * vec4(cameraWorld, 1.0)).xyz;
+    vec3 toCamera = localCamera - center;
+    float distance = max(length(toCamera), radius * 1.001);
+    vec3 viewDirection = toCamera / max(length(toCamera), 1e-6);
+
+    float frames = float(inTextures.z);
+    vec2 frame = min(floor(octahedralEncode(viewDirection) * frames), vec2(frames - 1.0));
+    vec3 frameDirection = octahedralDecode((frame + 0.5) / frames);
+    vec3 frameRight, frameUp;
+    frameBasis(frameDirection, frameRight, frameUp);
+
+    // 包围球的轮廓是半角asin(r / d)的圆锥，在过中心的平面上半径是r * d / sqrt(d² - r²)
+    vec3 right, up;
+    frameBasis(viewDirection, right, up);
+    float extent = radius * distance / sqrt(distance * distance - radius * radius);
+    vec2 corner = CORNERS[gl_VertexIndex];
+    vec3 localPos = center + (right * corner.x + up * corner.y) * extent;
+    gl_Position = ubo.viewProj * (inLocalToWorld * vec4(localPos, 1.0));
+
+    vec2 cellSize = inTile.zw / frames;
+    fragLocalPos = localPos;
+    fragLocalCamera = localCamera;
+    fragFrameDirection = frameDirection;
+    fragFrameRight = frameRight;
+    fragFrameUp = frameUp;
+    fragCenterRadius = inCenterRadius;
+    fragCell = vec4(inTile.xy + frame * cellSize, cellSize);
+    fragTextures = inTextures.xy;
+    fragColor = inColor.rgb;
+    fragLocalToWorld = inLocalToWorld;
+}
@@ -0,0 +1,23 @@
+#version 450
+
+// impostor：albedo写入纹理的颜色，不带光照和实例颜色；depth写入正交投影的depth，impostor.frag用它重建表面的位置
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// texture atlas：和bindless.frag相同，uvScale和uvOffset把uv映射到atlas page中的区域
+layout(push_constant) uniform DrawParams {
+    layout(offset = 64) uint textureIndex;
+    vec2 uvScale;
+    vec2 uvOffset;
+} draw;
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out float outDepth;
+
+void main() {
+    vec2 uv = fract(fragTexCoord) * draw.uvScale + draw.uvOffset;
+    vec4 color = textureGrad(textures[draw.textureIndex], uv, dFdx(fragTexCoord) * draw.uvScale, dFdy(fragTexCoord) * draw.uvScale);
+    outAlbedo = vec4(color.rgb, 1.0);
+    outDepth = gl_FragCoord.z;
+}
@@ -0,0 +1,17 @@
+#version 450
+
+// impostor：烘焙一个方向，model是这个方向的正交投影乘上mesh的矩阵（包含compact vertex的解量化），布局和DrawPushConstants一致
+// 没有实例，只读取位置和uv
+layout(push_constant) uniform DrawParams {
+    mat4 model;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec2 fragTexCoord;
+
+void main() {
+    gl_Position = draw.model * vec4(inPosition, 1.0);
+    fragTexCoord = inTexCoord;
+}
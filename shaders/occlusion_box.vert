@@ -0,0 +1,28 @@
+#version 450
+
+// occlusion queries：mesh包围盒的36个顶点由gl_VertexIndex生成，push constant的model把[-1, 1]的立方体变换到sceneModel之前空间的包围盒
+// 没有fragment shader，pipeline不写color和depth，只统计通过深度测试的采样
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 viewProj;
+    mat4 sceneModel;
+} ubo;
+
+layout(push_constant) uniform Params {
+    mat4 model;  // 和DrawPushConstants的model一致
+} params;
+
+// 每个面两个三角形，立方体的顶点编号的三个bit是x、y、z
+const uint CUBE_INDICES[36] = uint[](
+    0u, 2u, 1u, 1u, 2u, 3u,
+    4u, 5u, 6u, 5u, 7u, 6u,
+    0u, 1u, 4u, 1u, 5u, 4u,
+    2u, 6u, 3u, 3u, 6u, 7u,
+    0u, 4u, 2u, 2u, 4u, 6u,
+    1u, 3u, 5u, 3u, 7u, 5u);
+
+void main() {
+    uint corner = CUBE_INDICES[gl_VertexIndex];
+    vec3 position = vec3(float(corner & 1u), float((corner >> 1) & 1u), float((corner >> 2) & 1u)) * 2.0 - 1.0;
+    gl_Position = ubo.viewProj * ubo.sceneModel * params.model * vec4(position, 1.0);
+}
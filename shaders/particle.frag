@@ -0,0 +1,15 @@
+#version 450
+
+// particles：圆形的软边粒子，alpha随到中心的距离衰减；混合方式由pipeline决定，加法混合时不需要排序
+layout(location = 0) in vec2 fragCorner;
+layout(location = 1) flat in vec4 fragColor;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    float falloff = 1.0 - dot(fragCorner, fragCorner);
+    if (falloff <= 0.0) {
+        discard;
+    }
+    outColor = vec4(fragColor.rgb, fragColor.a * falloff * falloff);
+}
@@ -0,0 +1,26 @@
+#version 450
+
+// particles：每个实例一个面向相机的四边形，6个顶点由gl_VertexIndex生成，实例数据的布局和ParticleSystem::vertexInput一致
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 viewProj;  // view projection：cpu上乘好的proj * view
+} ubo;
+
+layout(location = 0) in vec4 inPositionSize;
+layout(location = 1) in vec4 inColor;
+
+layout(location = 0) out vec2 fragCorner;
+layout(location = 1) flat out vec4 fragColor;
+
+const vec2 CORNERS[6] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+void main() {
+    // view矩阵的前两行是相机的right和up在世界空间中的方向
+    vec3 right = vec3(ubo.view[0][0], ubo.view[1][0], ubo.view[2][0]);
+    vec3 up = vec3(ubo.view[0][1], ubo.view[1][1], ubo.view[2][1]);
+    vec2 corner = CORNERS[gl_VertexIndex];
+    vec3 position = inPositionSize.xyz + (right * corner.x + up * corner.y) * inPositionSize.w;
+    gl_Position = ubo.viewProj * vec4(position, 1.0);
+    fragCorner = corner;
+    fragColor = inColor;
+}
@@ -0,0 +1,44 @@
+#version 460
+
+// split vertex streams：depth prepass只读取binding 0的位置和binding 2的实例矩阵，不读取颜色和uv的binding 1
+// 位置的计算和compact.vert、27_shader_depth.vert完全相同，三者都声明invariant，forward pass的depth和prepass逐位一致
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 viewProj;  // view projection：cpu上乘好的proj * view
+    mat4 sceneModel;
+} ubo;
+
+// push constant：布局和main.cpp中的DrawPushConstants一致
+layout(push_constant) uniform DrawParams {
+    mat4 model;
+    layout(offset = 88) uint drawDataBase;
+    uint indirect;
+} draw;
+
+// multi draw indirect：indirect不为0时第gl_DrawID个draw的object编号从这一帧的draw数据中读取
+// scene objects：model从按mesh编号的object数据中读取
+layout(std430, binding = 1) readonly buffer DrawObjectBuffer {
+    uint drawObjects[];
+};
+struct SceneObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint materialIndex;
+};
+layout(std430, binding = 5) readonly buffer SceneObjectBuffer {
+    SceneObject objects[];
+};
+
+layout(location = 0) in vec3 inPosition;
+// instancing：binding 2每个实例的数据，mat4占用location 3到6
+layout(location = 3) in mat4 inInstanceTransform;
+
+invariant gl_Position;
+
+void main() {
+    uint object = draw.indirect != 0 ? drawObjects[draw.drawDataBase + gl_DrawID] : 0;
+    mat4 model = draw.indirect != 0 ? objects[object].model : draw.model;
+    vec4 worldPos = inInstanceTransform * (ubo.sceneModel * (model * vec4(inPosition, 1.0)));
+    gl_Position = ubo.viewProj * worldPos;
+}
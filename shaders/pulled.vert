@@ -0,0 +1,81 @@
+#version 460
+
+// vertex pulling：没有逐顶点的vertex input，按gl_VertexIndex从set 2的geometry buffer顶点区域读取uint再解码
+// gl_VertexIndex已经包含drawIndexed的vertexOffset，和fixed function读取的是同一个顶点；顶点格式和meshlet.mesh的解码相同
+// 实例数据仍然是binding 2的逐实例属性：gpu culling每个阶段绑定不同的可见实例buffer，只需要换vertex buffer
+layout(constant_id = 0) const bool COMPACT_VERTICES = true;
+layout(constant_id = 1) const bool SPLIT_VERTEX_STREAMS = true;
+layout(constant_id = 2) const uint ATTRIBUTE_WORD_OFFSET = 0;
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 viewProj;  // view projection：cpu上乘好的proj * view
+    mat4 sceneModel;
+} ubo;
+
+// push constant：每个draw的model矩阵，布局和main.cpp中的DrawPushConstants一致
+layout(push_constant) uniform DrawParams {
+    mat4 model;
+    layout(offset = 88) uint drawDataBase;
+    uint indirect;
+} draw;
+
+// multi draw indirect：indirect不为0时第gl_DrawID个draw的object编号从这一帧的draw数据中读取
+// scene objects：model从按mesh编号的object数据中读取
+layout(std430, binding = 1) readonly buffer DrawObjectBuffer {
+    uint drawObjects[];
+};
+struct SceneObject {
+    mat4 model;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint materialIndex;
+};
+layout(std430, binding = 5) readonly buffer SceneObjectBuffer {
+    SceneObject objects[];
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer Vertices {
+    uint vertexWords[];
+};
+
+// instancing：binding 2每个实例的数据，mat4占用location 3到6
+layout(location = 3) in mat4 inInstanceTransform;
+layout(location = 7) in vec4 inInstanceColor;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragDrawData;
+layout(location = 3) out vec3 fragWorldPos;  // deferred shading：gbuffer.frag用它的导数重建面法线，forward的bindless.frag不读取
+
+// depth prepass：vertex pulling时prepass也使用这个shader，两个pass的位置逐位一致
+invariant gl_Position;
+
+void main() {
+    uint vertex = uint(gl_VertexIndex);
+    vec3 position;
+    vec3 color = vec3(1.0);  // compact vertex：没有顶点颜色
+    vec2 texCoord;
+    if (COMPACT_VERTICES) {
+        uint base = vertex * (SPLIT_VERTEX_STREAMS ? 2 : 3);
+        uint attribute = SPLIT_VERTEX_STREAMS ? ATTRIBUTE_WORD_OFFSET + vertex : base + 2;
+        position = vec3(unpackSnorm2x16(vertexWords[base]), unpackSnorm2x16(vertexWords[base + 1]).x);
+        texCoord = unpackHalf2x16(vertexWords[attribute]);
+    } else {
+        uint base = vertex * (SPLIT_VERTEX_STREAMS ? 3 : 8);
+        uint attribute = SPLIT_VERTEX_STREAMS ? ATTRIBUTE_WORD_OFFSET + vertex * 5 : base + 3;
+        position = uintBitsToFloat(uvec3(vertexWords[base], vertexWords[base + 1], vertexWords[base + 2]));
+        color = uintBitsToFloat(uvec3(vertexWords[attribute], vertexWords[attribute + 1], vertexWords[attribute + 2]));
+        texCoord = uintBitsToFloat(uvec2(vertexWords[attribute + 3], vertexWords[attribute + 4]));
+    }
+
+    uint object = draw.indirect != 0 ? drawObjects[draw.drawDataBase + gl_DrawID] : 0;
+    mat4 model = draw.indirect != 0 ? objects[object].model : draw.model;
+    // view projection：从右向左逐个做矩阵乘向量，每个顶点4次mat4 * vec4，不计算矩阵之间的乘积
+    vec4 worldPos = inInstanceTransform * (ubo.sceneModel * (model * vec4(position, 1.0)));
+    gl_Position = ubo.viewProj * worldPos;
+    fragWorldPos = worldPos.xyz;
+    fragColor = color * inInstanceColor.rgb;
+    fragTexCoord = texCoord;
+    fragDrawData = object;
+}
@@ -0,0 +1,15 @@
+#version 450
+
+// shadow cache：只写depth，model是sceneModel乘上mesh的矩阵（包含compact vertex的解量化），布局和ShadowCache::PushConstants一致
+layout(push_constant) uniform ShadowParams {
+    mat4 lightViewProj;
+    mat4 model;
+} shadow;
+
+layout(location = 0) in vec3 inPosition;
+// instancing：binding 2每个实例的数据，mat4占用location 3到6
+layout(location = 3) in mat4 inInstanceTransform;
+
+void main() {
+    gl_Position = shadow.lightViewProj * (inInstanceTransform * (shadow.model * vec4(inPosition, 1.0)));  // view projection：只做矩阵乘向量
+}
@@ -0,0 +1,28 @@
+#version 450
+
+// terrain：按坡度和高度在草地、岩石和雪之间混合，太阳的漫反射加上环境光
+layout(std430, binding = 5) readonly buffer Frame {
+    mat4 viewProj;
+    vec4 planes[6];
+    vec4 camera;
+    vec4 origin;
+    vec4 heights;
+    vec4 sun;  // 指向太阳的方向
+} frame;
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in float fragHeight;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec3 normal = normalize(fragNormal);
+    float slope = 1.0 - normal.z;
+    vec3 grass = vec3(0.22, 0.32, 0.12);
+    vec3 rock = vec3(0.38, 0.35, 0.31);
+    vec3 snow = vec3(0.85, 0.87, 0.9);
+    vec3 albedo = mix(grass, rock, smoothstep(0.15, 0.35, slope));
+    albedo = mix(albedo, snow, smoothstep(0.75, 0.85, fragHeight) * (1.0 - smoothstep(0.3, 0.5, slope)));
+    float diffuse = max(dot(normal, frame.sun.xyz), 0.0);
+    outColor = vec4(albedo * (0.25 + 0.75 * diffuse), 1.0);
+}
@@ -0,0 +1,82 @@
+#version 450
+
+// terrain：每个实例是terrain_cull.comp输出的一个patch，(PATCH_QUADS + 1)²个顶点的网格位置由gl_VertexIndex得到
+// 靠近level范围边界时奇数顶点morph到上一级网格的格点上，到边界时和下一级的patch完全重合；高度在morph之后的位置双线性采样
+// level的顶点间距小于overview的采样间距时读取tile，tile不在缓存中时两者都读取overview
+layout(std430, binding = 2) readonly buffer Patches { uvec4 patches[]; };
+layout(std430, binding = 3) readonly buffer Heights { uint heights[]; };  // slot 0是overview，之后是tile缓存，每个uint两个采样
+layout(std430, binding = 5) readonly buffer Frame {
+    mat4 viewProj;
+    vec4 planes[6];
+    vec4 camera;  // w是level 0的范围
+    vec4 origin;  // 地形最小角，w是采样间距
+    vec4 heights;  // heightMin和heightScale
+    vec4 sun;
+    uvec4 grid;  // tilesPerSide、tileQuads、overview的level、最高level
+    uvec4 limits;  // 每个tile的uint数量、patch上限、节点列表容量、每边的根节点数量
+    uint tileSlots[];
+} frame;
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out float fragHeight;  // 0是最低处，1是最高处
+
+const uint PATCH_QUADS = 16;  // 和TerrainRenderer::PATCH_QUADS一致
+const float MORPH_START = 0.7;  // 到范围的这个比例开始morph
+
+float fetch(uint slot, uvec2 p) {
+    uint samples = frame.grid.y + 1u;
+    uint index = slot * frame.limits.x * 2u + p.y * samples + p.x;
+    uint word = heights[index >> 1];
+    return float((index & 1u) == 0u ? word & 0xffffu : word >> 16);
+}
+
+float bilinear(uint slot, vec2 p) {
+    vec2 cell = min(floor(p), vec2(float(frame.grid.y - 1u)));
+    vec2 f = clamp(p - cell, 0.0, 1.0);
+    uvec2 c = uvec2(cell);
+    float a = mix(fetch(slot, c), fetch(slot, c + uvec2(1, 0)), f.x);
+    float b = mix(fetch(slot, c + uvec2(0, 1)), fetch(slot, c + uvec2(1, 1)), f.x);
+    return mix(a, b, f.y);
+}
+
+// 采样坐标p所在的tile由所有patch按同样的规则选择，共享的顶点得到同样的高度
+float heightAt(vec2 p, bool detail) {
+    float total = float(frame.grid.x * frame.grid.y);
+    p = clamp(p, vec2(0.0), vec2(total));
+    float value;
+    uint slot = 0;
+    uvec2 tile = uvec2(0);
+    if (detail) {
+        tile = min(uvec2(p) / frame.grid.y, uvec2(frame.grid.x - 1u));
+        slot = frame.tileSlots[tile.y * frame.grid.x + tile.x];
+    }
+    if (slot != 0u) {
+        value = bilinear(slot, p - vec2(tile * frame.grid.y));
+    } else {
+        value = bilinear(0u, p / float(frame.grid.x));
+    }
+    return frame.heights.x + value * frame.heights.y;
+}
+
+void main() {
+    uvec4 patchInfo = patches[gl_InstanceIndex];
+    uint level = patchInfo.z;
+    float stepSize = float(1u << level);
+    bool detail = level < frame.grid.z;
+    float spacing = frame.origin.w;
+
+    vec2 gridPosition = vec2(float(uint(gl_VertexIndex) % (PATCH_QUADS + 1u)), float(uint(gl_VertexIndex) / (PATCH_QUADS + 1u)));
+    vec2 p = vec2(patchInfo.xy) + gridPosition * stepSize;
+    vec3 world = vec3(frame.origin.xy + p * spacing, frame.origin.z + heightAt(p, detail));
+    float range = frame.camera.w * stepSize;
+    float morph = clamp((distance(world, frame.camera.xyz) - range * MORPH_START) / (range * (1.0 - MORPH_START)), 0.0, 1.0);
+    p -= mod(gridPosition, 2.0) * stepSize * morph;
+
+    float height = heightAt(p, detail);
+    world = vec3(frame.origin.xy + p * spacing, frame.origin.z + height);
+    float dx = heightAt(p + vec2(stepSize, 0.0), detail) - heightAt(p - vec2(stepSize, 0.0), detail);
+    float dy = heightAt(p + vec2(0.0, stepSize), detail) - heightAt(p - vec2(0.0, stepSize), detail);
+    fragNormal = normalize(vec3(-dx, -dy, 2.0 * stepSize * spacing));
+    fragHeight = (height - frame.heights.x) / max(frame.heights.y * 65535.0, 1e-6);
+    gl_Position = frame.viewProj * vec4(world, 1.0);
+}
@@ -0,0 +1,45 @@
+#version 450
+
+// dynamic resolution：双线性采样缩小分辨率的场景，再按FSR1的RCAS的思路做对比度自适应的锐化
+// 锐化用上下左右4个邻居，局部对比度越高权重越小，避免在边缘产生光晕；sharpness为0时只有双线性放大
+// post processing：source是post_tonemap.comp输出的sRGB编码的UNORM时srgbSource不为0，锐化之后解码，由sRGB的swap chain重新编码
+layout(binding = 0) uniform sampler2D source;
+
+layout(push_constant) uniform Params {
+    vec2 targetTexelSize;  // 输出的一个像素在uv空间的大小，邻居按输出像素的间隔采样
+    float sharpness;
+    float srgbSource;
+} params;
+
+layout(location = 0) in vec2 fragUV;
+layout(location = 0) out vec4 outColor;
+
+vec3 decodeSrgb(vec3 encoded) {
+    vec3 low = encoded / 12.92;
+    vec3 high = pow((encoded + 0.055) / 1.055, vec3(2.4));
+    return mix(high, low, lessThanEqual(encoded, vec3(0.04045)));
+}
+
+vec3 finalColor(vec3 color) {
+    return params.srgbSource != 0.0 ? decodeSrgb(color) : color;
+}
+
+void main() {
+    vec3 center = texture(source, fragUV).rgb;
+    if (params.sharpness <= 0.0) {
+        outColor = vec4(finalColor(center), 1.0);
+        return;
+    }
+
+    vec3 north = texture(source, fragUV - vec2(0.0, params.targetTexelSize.y)).rgb;
+    vec3 west = texture(source, fragUV - vec2(params.targetTexelSize.x, 0.0)).rgb;
+    vec3 east = texture(source, fragUV + vec2(params.targetTexelSize.x, 0.0)).rgb;
+    vec3 south = texture(source, fragUV + vec2(0.0, params.targetTexelSize.y)).rgb;
+
+    vec3 minimum = min(center, min(min(north, west), min(east, south)));
+    vec3 maximum = max(center, max(max(north, west), max(east, south)));
+    vec3 amplitude = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, vec3(1e-5)), 0.0, 1.0));
+    vec3 weight = -amplitude / mix(8.0, 5.0, clamp(params.sharpness, 0.0, 1.0));
+    vec3 color = (center + (north + west + east + south) * weight) / (1.0 + 4.0 * weight);
+    outColor = vec4(finalColor(clamp(color, 0.0, 1.0)), 1.0);
+}
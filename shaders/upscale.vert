@@ -0,0 +1,9 @@
+#version 450
+
+// dynamic resolution：不需要顶点buffer，3个顶点组成覆盖整个屏幕的三角形
+layout(location = 0) out vec2 fragUV;
+
+void main() {
+    fragUV = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(fragUV * 2.0 - 1.0, 0.0, 1.0);
+}
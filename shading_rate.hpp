@@ -0,0 +1,409 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+#include "upload_context.hpp"
+
+// variable rate shading：VK_KHR_fragment_shading_rate有两种来源，per-draw的rate由vkCmdSetFragmentShadingRateKHR设置（DynamicStateCommands），
+// attachment的rate是一张R8_UINT image，每个texel决定render area中texelSize大小的一块的rate，两者由combiner op组合
+// 每帧forward之后用这一帧的color和depth生成下一帧的rate image：亮度对比度低或者按depth重投影的屏幕运动大的一块降低rate
+// rate image一直处于GENERAL layout，和hi-z一样所有访问都在同一个队列上，barrier按提交顺序生效
+struct ShadingRateSupport {
+    bool pipeline = false;  // per-draw的rate
+    bool attachment = false;  // rate image
+    bool nonTrivialCombinerOps = false;  // 不支持时attachment只能REPLACE per-draw的rate
+    VkExtent2D minTexelSize{};
+    VkExtent2D maxTexelSize{};
+    VkExtent2D maxRate{1, 1};  // 只使用1x1到2x2，这里是当前采样数支持的最大的一个
+};
+
+class ShadingRateImage {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 8;  // 和shading_rate.comp的local_size一致
+    using RetireFunction = std::function<void(std::function<void()>)>;
+
+    // variable rate shading：rate的编码是(log2(width) << 2) | log2(height)，和shader的输出一致
+    static uint32_t encodeRate(VkExtent2D rate) {
+        return ((rate.width >> 1) << 2) | (rate.height >> 1);
+    }
+
+    // variable rate shading：2x2在当前采样数下可用时才开启，rate image还需要R8_UINT的storage image和shader中的r8ui格式
+    static ShadingRateSupport query(VkInstance instance, VkPhysicalDevice physicalDevice, VkSampleCountFlagBits samples, bool extensionAvailable) {
+        ShadingRateSupport support;
+        if (!extensionAvailable) {
+            return support;
+        }
+        VkPhysicalDeviceFragmentShadingRateFeaturesKHR features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+        VkPhysicalDeviceFragmentShadingRatePropertiesKHR properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &properties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+        auto getRates = (PFN_vkGetPhysicalDeviceFragmentShadingRatesKHR) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFragmentShadingRatesKHR");
+        if (getRates == nullptr) {
+            return support;
+        }
+        uint32_t rateCount = 0;
+        getRates(physicalDevice, &rateCount, nullptr);
+        std::vector<VkPhysicalDeviceFragmentShadingRateKHR> rates(rateCount);
+        for (VkPhysicalDeviceFragmentShadingRateKHR& rate : rates) {
+            rate.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_KHR;
+        }
+        getRates(physicalDevice, &rateCount, rates.data());
+        for (const VkPhysicalDeviceFragmentShadingRateKHR& rate : rates) {
+            if (rate.fragmentSize.width == 2 && rate.fragmentSize.height == 2 && (rate.sampleCounts & samples)) {
+                support.maxRate = {2, 2};
+            }
+        }
+        if (support.maxRate.width == 1) {
+            return support;
+        }
+
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8_UINT, &formatProperties);
+        bool storage = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0 && features2.features.shaderStorageImageExtendedFormats;
+        support.pipeline = features.pipelineFragmentShadingRate;
+        support.attachment = features.attachmentFragmentShadingRate && storage;
+        support.nonTrivialCombinerOps = properties.fragmentShadingRateNonTrivialCombinerOps;
+        support.minTexelSize = properties.minFragmentShadingRateAttachmentTexelSize;
+        support.maxTexelSize = properties.maxFragmentShadingRateAttachmentTexelSize;
+        return support;
+    }
+
+    // variable rate shading：texelSize按设备的范围clamp，两端都是2的幂
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, const ShadingRateSupport& support,
+        uint32_t texelSize, uint32_t frameCount, RetireFunction retire) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_frameCount = frameCount;
+        m_retire = std::move(retire);
+        m_texelSize = {std::clamp(texelSize, support.minTexelSize.width, support.maxTexelSize.width),
+            std::clamp(texelSize, support.minTexelSize.height, support.maxTexelSize.height)};
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        if (vkCreateSampler(m_device, &samplerInfo, hostAllocator(), &m_sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shading rate sampler!");
+        }
+
+        // variable rate shading：0是color，1是depth，2是rate image，3是这一帧的参数
+        std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+        VkDescriptorType types[4] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = types[i];
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shading rate descriptor set layout!");
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shading rate pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shading rate shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shading rate compute pipeline!");
+        }
+
+        // variable rate shading：参数每帧由cpu写入，录制的命令只引用buffer，command cache重放时使用最新的值
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = sizeof(Params);
+            bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &frame.params) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create shading rate parameter buffer!");
+            }
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(m_device, frame.params, &memRequirements);
+            frame.paramsAllocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true,
+                MemoryCategory::uniform, 0, "shading rate params");
+            vkBindBufferMemory(m_device, frame.params, frame.paramsAllocation.memory, frame.paramsAllocation.offset);
+        }
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        destroyTarget(m_target);
+        m_target = {};
+        for (Frame& frame : m_frames) {
+            vkDestroyBuffer(m_device, frame.params, hostAllocator());
+            m_allocator->free(frame.paramsAllocation);
+        }
+        m_frames.clear();
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        vkDestroySampler(m_device, m_sampler, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // variable rate shading：按render area重新创建rate image并清成1x1，第一次生成之前也可以直接作为attachment
+    // layout转换和清除录制进upload context，调用者负责submit
+    void resize(VkExtent2D renderExtent, UploadContext& uploadContext) {
+        if (m_target.image != VK_NULL_HANDLE) {
+            Target old = m_target;
+            m_retire([this, old]() { destroyTarget(old); });
+        }
+        m_target = {};
+        m_target.renderExtent = renderExtent;
+        m_target.extent = {(renderExtent.width + m_texelSize.width - 1) / m_texelSize.width, (renderExtent.height + m_texelSize.height - 1) / m_texelSize.height};
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {m_target.extent.width, m_target.extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = VK_FORMAT_R8_UINT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateImage(m_device, &imageInfo, hostAllocator(), &m_target.image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shading rate image!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_device, m_target.image, &memRequirements);
+        m_target.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::attachment, 0, "shading rate image");
+        vkBindImageMemory(m_device, m_target.image, m_target.allocation.memory, m_target.allocation.offset);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_target.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R8_UINT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        if (vkCreateImageView(m_device, &viewInfo, hostAllocator(), &m_target.view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shading rate image view!");
+        }
+
+        VkDescriptorPoolSize poolSizes[3] = {{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 * m_frameCount}, {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, m_frameCount},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, m_frameCount}};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 3;
+        poolInfo.pPoolSizes = poolSizes;
+        poolInfo.maxSets = m_frameCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_target.descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shading rate descriptor pool!");
+        }
+        std::vector<VkDescriptorSetLayout> layouts(m_frameCount, m_descriptorSetLayout);
+        m_target.sets.resize(m_frameCount);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = m_target.descriptorPool;
+        allocInfo.descriptorSetCount = m_frameCount;
+        allocInfo.pSetLayouts = layouts.data();
+        if (vkAllocateDescriptorSets(m_device, &allocInfo, m_target.sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate shading rate descriptor sets!");
+        }
+        m_target.sourceViews.assign(m_frameCount, {VK_NULL_HANDLE, VK_NULL_HANDLE});
+
+        VkCommandBuffer commandBuffer = uploadContext.graphicsCommandBuffer();
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_target.image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkClearColorValue clear{};  // 0是1x1
+        vkCmdClearColorImage(commandBuffer, m_target.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear, 1, &barrier.subresourceRange);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    // variable rate shading：reprojection把这一帧的裁剪空间变换到上一帧的裁剪空间，depth重投影的位移就是相机运动造成的屏幕运动
+    // lumaThreshold是一块中亮度最大值和最小值的差，motionThreshold是每帧移动的像素数
+    void update(uint32_t frameIndex, const glm::mat4& reprojection, float lumaThreshold, float motionThreshold, VkExtent2D maxRate) {
+        Params params{};
+        params.reprojection = reprojection;
+        params.sourceSize = glm::ivec2(m_target.renderExtent.width, m_target.renderExtent.height);
+        params.rateSize = glm::ivec2(m_target.extent.width, m_target.extent.height);
+        params.texelSize = glm::ivec2(m_texelSize.width, m_texelSize.height);
+        params.lumaThreshold = lumaThreshold;
+        params.motionThreshold = motionThreshold;
+        params.maxRate = glm::uvec2(maxRate.width, maxRate.height);
+        memcpy(m_frames[frameIndex].paramsAllocation.mapped, &params, sizeof(params));
+    }
+
+    // variable rate shading：在render pass之外录制，color和depth此时处于SHADER_READ_ONLY_OPTIMAL
+    // 之前的barrier等待这一帧forward对rate image的读取，之后的barrier让下一帧的forward看到写入
+    void generate(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkImageView colorView, VkImageView depthView) {
+        std::array<VkImageView, 2>& sources = m_target.sourceViews[frameIndex];
+        if (sources[0] != colorView || sources[1] != depthView) {
+            writeSet(frameIndex, colorView, depthView);
+            sources = {colorView, depthView};
+        }
+
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR, VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_target.sets[frameIndex], 0, nullptr);
+        vkCmdDispatch(commandBuffer, (m_target.extent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (m_target.extent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+        memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR,
+            VK_ACCESS_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR);
+    }
+
+    VkImageView view() const { return m_target.view; }
+    VkExtent2D texelSize() const { return m_texelSize; }
+
+private:
+    // variable rate shading：布局和shading_rate.comp中的Params一致（std140）
+    struct Params {
+        glm::mat4 reprojection;
+        glm::ivec2 sourceSize;
+        glm::ivec2 rateSize;
+        glm::ivec2 texelSize;
+        float lumaThreshold;
+        float motionThreshold;
+        glm::uvec2 maxRate;
+    };
+
+    struct Frame {
+        VkBuffer params = VK_NULL_HANDLE;
+        Allocation paramsAllocation;
+    };
+
+    struct Target {
+        VkImage image = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkImageView view = VK_NULL_HANDLE;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        std::vector<VkDescriptorSet> sets;
+        std::vector<std::array<VkImageView, 2>> sourceViews;  // 每个set最近一次写入的color和depth view
+        VkExtent2D renderExtent{};
+        VkExtent2D extent{};
+    };
+
+    void writeSet(uint32_t frameIndex, VkImageView colorView, VkImageView depthView) {
+        VkDescriptorImageInfo colorInfo{m_sampler, colorView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkDescriptorImageInfo depthInfo{m_sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkDescriptorImageInfo rateInfo{VK_NULL_HANDLE, m_target.view, VK_IMAGE_LAYOUT_GENERAL};
+        VkDescriptorBufferInfo paramsInfo{m_frames[frameIndex].params, 0, sizeof(Params)};
+        const VkDescriptorImageInfo* imageInfos[3] = {&colorInfo, &depthInfo, &rateInfo};
+        VkDescriptorType types[4] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER};
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t i = 0; i < writes.size(); i++) {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = m_target.sets[frameIndex];
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = types[i];
+            if (i < 3) {
+                writes[i].pImageInfo = imageInfos[i];
+            } else {
+                writes[i].pBufferInfo = &paramsInfo;
+            }
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    void destroyTarget(const Target& target) {
+        if (target.image == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyDescriptorPool(m_device, target.descriptorPool, hostAllocator());
+        vkDestroyImageView(m_device, target.view, hostAllocator());
+        vkDestroyImage(m_device, target.image, hostAllocator());
+        Allocation allocation = target.allocation;
+        m_allocator->free(allocation);
+    }
+
+    static void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_frameCount = 0;
+    RetireFunction m_retire;
+    VkExtent2D m_texelSize{16, 16};
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    std::vector<Frame> m_frames;
+    Target m_target;
+};
@@ -0,0 +1,605 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "frustum_culling.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// shadow cache：方向光的cascaded shadow map，每个cascade是一张depth array的一层，片段着色器按view depth选择cascade
+// 静态的caster画进另一张cache array的同一层，只有cascade的矩阵、静态caster或者光源方向改变时才重新绘制
+// 有动态caster的cascade先把cache的一层复制到shadow map，再在上面画动态caster；没有动态caster时shadow map和cache一致，什么都不做
+// cascade i每2^i帧更新一次且错开帧，更新时使用的矩阵保存下来给片段着色器，没有更新的cascade继续使用上一次的矩阵和内容
+// 命令录制在自己的command buffer中，和场景的command buffer一起提交，command cache重放的场景命令只读取shadow map
+enum class ShadowCasters {
+    staticCasters,
+    dynamicCasters,
+};
+
+class ShadowCache {
+public:
+    static constexpr uint32_t CASCADE_COUNT = 3;
+    static constexpr VkFormat FORMAT = VK_FORMAT_D16_UNORM;  // 采样和depth attachment都是必须支持的格式
+    static constexpr float SPLIT_LAMBDA = 0.6f;  // 对数划分和均匀划分的混合比例
+
+    // shadow cache：shadow.vert的push constant，model是sceneModel乘上mesh的矩阵，实例矩阵从binding 2读取
+    struct PushConstants {
+        glm::mat4 lightViewProj;
+        glm::mat4 model;
+    };
+
+    // shadow cache：画某一组caster，调用之前已经绑定了pipeline和viewport，lightViewProj已经push
+    using DrawCasters = std::function<void(VkCommandBuffer, VkPipelineLayout, ShadowCasters)>;
+
+    struct Stats {
+        uint32_t staticRenders = 0;  // 这一帧重新绘制cache的cascade数量
+        uint32_t dynamicRenders = 0;  // 这一帧画了动态caster的cascade数量
+    };
+
+    // shadow cache：顶点格式和场景的pipeline一致（binding 0是顶点的位置，binding 2是实例），shader只读取location 0和实例矩阵
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& vertexCode,
+        const std::vector<VkVertexInputBindingDescription>& bindings, const std::vector<VkVertexInputAttributeDescription>& attributes, uint32_t mapSize,
+        VkCommandPool commandPool, uint32_t frameCount) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_mapSize = mapSize;
+
+        m_shadowMap = createLayers("shadow map", VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+        m_cache = createLayers("shadow cache", VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_shadowMap.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.format = FORMAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, CASCADE_COUNT};
+        if (vkCreateImageView(m_device, &viewInfo, hostAllocator(), &m_arrayView) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shadow map view!");
+        }
+
+        // shadow cache：硬件比较加上bilinear，范围外是白色边框（depth 1），cascade之外的片段不在阴影中
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+        samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        samplerInfo.compareEnable = VK_TRUE;
+        samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+        if (vkCreateSampler(m_device, &samplerInfo, hostAllocator(), &m_sampler) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shadow map sampler!");
+        }
+
+        // shadow cache：三个render pass只有layout和load op不同，彼此兼容，共用一个pipeline
+        // cache：清除之后绘制，结束时是TRANSFER_SRC；shadow map清除：直接绘制动态caster；shadow map加载：在复制过来的cache上绘制
+        m_cacheRenderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        m_clearRenderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_CLEAR, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        m_loadRenderPass = createRenderPass(VK_ATTACHMENT_LOAD_OP_LOAD, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        createFramebuffers(m_shadowMap, m_clearRenderPass);
+        createFramebuffers(m_cache, m_cacheRenderPass);
+
+        VkPushConstantRange pushConstantRange{VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstants)};
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shadow pipeline layout!");
+        }
+        createPipeline(pipelineCache, vertexCode, bindings, attributes);
+
+        m_commandBuffers.resize(frameCount);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = frameCount;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate shadow command buffers!");
+        }
+        m_commandPool = commandPool;
+        m_cascades = {};
+    }
+
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_commandBuffers.size()), m_commandBuffers.data());
+        m_commandBuffers.clear();
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        destroyLayers(m_shadowMap);
+        destroyLayers(m_cache);
+        vkDestroyRenderPass(m_device, m_cacheRenderPass, hostAllocator());
+        vkDestroyRenderPass(m_device, m_clearRenderPass, hostAllocator());
+        vkDestroyRenderPass(m_device, m_loadRenderPass, hostAllocator());
+        vkDestroyImageView(m_device, m_arrayView, hostAllocator());
+        vkDestroySampler(m_device, m_sampler, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // shadow cache：每帧录制之前调用，决定这一帧每个cascade要做什么，返回是否有需要录制的命令
+    // casterBounds是所有caster的世界空间包围盒，staticVersion在静态caster改变（包括caster在静态和动态之间切换）时增加
+    // stagger为false时每个cascade每帧更新，cached为false时不使用cache，静态caster和动态caster一样每次重新绘制
+    bool update(uint64_t frameNumber, const glm::mat4& view, const glm::mat4& proj, float zNear, float zFar, const glm::vec3& lightDirection,
+        const Aabb& casterBounds, uint64_t staticVersion, bool hasStatic, bool hasDynamic, bool stagger, bool cached) {
+        m_stats = {};
+        bool work = false;
+        glm::mat4 lightView = lightViewMatrix(lightDirection);
+        glm::mat4 inverseView = glm::inverse(view);
+        float tanY = 1.0f / std::abs(proj[1][1]);
+        float tanX = 1.0f / std::abs(proj[0][0]);
+
+        for (uint32_t i = 0; i < CASCADE_COUNT; i++) {
+            Cascade& cascade = m_cascades[i];
+            cascade.action = Action::none;
+            float nearSplit = splitDepth(i, zNear, zFar);
+            float farSplit = splitDepth(i + 1, zNear, zFar);
+            m_splits[i] = farSplit;
+
+            uint32_t period = stagger ? (1u << i) : 1u;
+            if (cascade.valid && frameNumber % period != i % period) {
+                continue;  // 没有轮到的cascade保留上一次的矩阵和内容
+            }
+
+            glm::mat4 viewProj = fitCascade(lightView, inverseView, tanX, tanY, nearSplit, farSplit, casterBounds);
+            bool cacheStale = !cached || !cascade.cacheValid || cascade.cacheViewProj != viewProj || cascade.cacheVersion != staticVersion
+                || cascade.cacheLight != lightDirection;
+            if (hasStatic) {
+                if (cacheStale) {
+                    cascade.cacheViewProj = viewProj;
+                    cascade.cacheVersion = staticVersion;
+                    cascade.cacheLight = lightDirection;
+                    cascade.cacheValid = true;
+                    cascade.holdsStatic = false;
+                    m_stats.staticRenders++;
+                }
+                if (hasDynamic) {
+                    cascade.action = cacheStale ? Action::renderStaticDynamic : Action::copyDynamic;
+                    cascade.holdsStatic = false;
+                    m_stats.dynamicRenders++;
+                } else if (cacheStale) {
+                    cascade.action = Action::renderStaticCopy;
+                    cascade.holdsStatic = true;
+                } else if (!cascade.holdsStatic) {
+                    cascade.action = Action::copy;
+                    cascade.holdsStatic = true;
+                }
+            } else if (hasDynamic || !cascade.valid || !cascade.holdsEmpty) {
+                // shadow cache：没有静态caster时不经过cache，清除之后直接画动态caster；只有清除值的一层和矩阵无关，不需要重新清除
+                cascade.action = Action::renderDynamic;
+                cascade.holdsStatic = false;
+                cascade.holdsEmpty = !hasDynamic;
+                if (hasDynamic) {
+                    m_stats.dynamicRenders++;
+                }
+            }
+            if (hasStatic) {
+                cascade.holdsEmpty = false;
+            }
+            if (cascade.action != Action::none) {
+                cascade.viewProj = viewProj;
+                cascade.valid = true;
+                work = true;
+            }
+        }
+        return work;
+    }
+
+    // shadow cache：录制update决定的命令，没有需要做的事情时返回VK_NULL_HANDLE
+    // 调用者保证这个frame in flight上一次的提交已经完成
+    VkCommandBuffer record(uint32_t frameIndex, const DrawCasters& drawCasters) {
+        bool work = false;
+        for (const Cascade& cascade : m_cascades) {
+            work = work || cascade.action != Action::none;
+        }
+        if (!work) {
+            return VK_NULL_HANDLE;
+        }
+
+        VkCommandBuffer commandBuffer = m_commandBuffers[frameIndex];
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording shadow command buffer!");
+        }
+
+        for (uint32_t i = 0; i < CASCADE_COUNT; i++) {
+            const Cascade& cascade = m_cascades[i];
+            switch (cascade.action) {
+                case Action::none:
+                    break;
+                case Action::renderDynamic:
+                    renderLayer(commandBuffer, m_clearRenderPass, m_shadowMap.framebuffers[i], cascade.viewProj, drawCasters, ShadowCasters::dynamicCasters);
+                    break;
+                case Action::renderStaticCopy:
+                    renderLayer(commandBuffer, m_cacheRenderPass, m_cache.framebuffers[i], cascade.cacheViewProj, drawCasters, ShadowCasters::staticCasters);
+                    copyLayer(commandBuffer, i, true);
+                    break;
+                case Action::copy:
+                    copyLayer(commandBuffer, i, true);
+                    break;
+                case Action::renderStaticDynamic:
+                    renderLayer(commandBuffer, m_cacheRenderPass, m_cache.framebuffers[i], cascade.cacheViewProj, drawCasters, ShadowCasters::staticCasters);
+                    copyLayer(commandBuffer, i, false);
+                    renderLayer(commandBuffer, m_loadRenderPass, m_shadowMap.framebuffers[i], cascade.viewProj, drawCasters, ShadowCasters::dynamicCasters);
+                    break;
+                case Action::copyDynamic:
+                    copyLayer(commandBuffer, i, false);
+                    renderLayer(commandBuffer, m_loadRenderPass, m_shadowMap.framebuffers[i], cascade.viewProj, drawCasters, ShadowCasters::dynamicCasters);
+                    break;
+            }
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record shadow command buffer!");
+        }
+        return commandBuffer;
+    }
+
+    // shadow cache：片段着色器使用的矩阵是这个cascade的内容绘制时的矩阵
+    const glm::mat4& cascadeViewProj(uint32_t cascade) const { return m_cascades[cascade].viewProj; }
+    // shadow cache：每个cascade远端的view depth，片段选择第一个远端比自己深度大的cascade
+    glm::vec4 splits() const { return glm::vec4(m_splits[0], m_splits[1], m_splits[2], 0.0f); }
+    VkImageView view() const { return m_arrayView; }
+    VkSampler sampler() const { return m_sampler; }
+    const Stats& stats() const { return m_stats; }
+
+private:
+    static_assert(CASCADE_COUNT <= 4, "cascade splits are packed into a vec4");
+
+    enum class Action {
+        none,
+        renderDynamic,  // 清除shadow map的一层，画动态caster
+        renderStaticCopy,  // 重新绘制cache，复制到shadow map
+        copy,  // cache没有变化，上次shadow map中还有动态caster，复制cache把它们去掉
+        renderStaticDynamic,  // 重新绘制cache，复制之后画动态caster
+        copyDynamic,  // 复制cache，画动态caster
+    };
+
+    struct Cascade {
+        glm::mat4 viewProj{1.0f};
+        glm::mat4 cacheViewProj{1.0f};
+        glm::vec3 cacheLight{0.0f};
+        uint64_t cacheVersion = 0;
+        bool cacheValid = false;
+        bool valid = false;
+        bool holdsStatic = false;  // shadow map的这一层和cache完全相同
+        bool holdsEmpty = false;  // shadow map的这一层只有清除值
+        Action action = Action::none;
+    };
+
+    struct Layers {
+        VkImage image = VK_NULL_HANDLE;
+        Allocation allocation;
+        std::array<VkImageView, CASCADE_COUNT> views{};
+        std::array<VkFramebuffer, CASCADE_COUNT> framebuffers{};
+    };
+
+    // shadow cache：对数划分让近处的cascade更小，和均匀划分按SPLIT_LAMBDA混合
+    static float splitDepth(uint32_t index, float zNear, float zFar) {
+        float t = static_cast<float>(index) / CASCADE_COUNT;
+        float logSplit = zNear * std::pow(zFar / zNear, t);
+        float uniformSplit = zNear + (zFar - zNear) * t;
+        return SPLIT_LAMBDA * logSplit + (1.0f - SPLIT_LAMBDA) * uniformSplit;
+    }
+
+    // shadow cache：光源空间只由方向决定，不跟随相机移动，cascade在这个空间中按texel对齐
+    static glm::mat4 lightViewMatrix(const glm::vec3& lightDirection) {
+        glm::vec3 up = std::abs(lightDirection.z) > 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+        return glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+    }
+
+    // shadow cache：用视锥体这一段的包围球而不是包围盒，相机旋转时大小不变；中心按texel的大小对齐，相机平移不到一个texel时矩阵不变
+    // 深度范围包含所有caster，按1个单位取整，caster的包围盒小幅变化时矩阵也不变
+    glm::mat4 fitCascade(const glm::mat4& lightView, const glm::mat4& inverseView, float tanX, float tanY, float nearSplit, float farSplit, const Aabb& casterBounds) const {
+        std::array<glm::vec3, 8> corners;
+        glm::vec3 center(0.0f);
+        for (uint32_t c = 0; c < 8; c++) {
+            float depth = (c & 4) ? farSplit : nearSplit;
+            glm::vec4 viewCorner((c & 1 ? 1.0f : -1.0f) * depth * tanX, (c & 2 ? 1.0f : -1.0f) * depth * tanY, -depth, 1.0f);
+            corners[c] = glm::vec3(lightView * inverseView * viewCorner);
+            center += corners[c] / 8.0f;
+        }
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners) {
+            radius = std::max(radius, glm::length(corner - center));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        float texel = 2.0f * radius / static_cast<float>(m_mapSize);
+        center.x = std::floor(center.x / texel) * texel;
+        center.y = std::floor(center.y / texel) * texel;
+
+        // lookAt的光源空间看向-z，z越大离光源越近
+        float maxZ = center.z + radius;
+        float minZ = center.z - radius;
+        if (casterBounds.min.x <= casterBounds.max.x) {
+            Aabb lightBounds = transformAabb(casterBounds, lightView);
+            maxZ = std::max(maxZ, lightBounds.max.z);
+            minZ = std::min(minZ, lightBounds.min.z);
+        }
+        maxZ = std::ceil(maxZ);
+        minZ = std::floor(minZ);
+        return glm::ortho(center.x - radius, center.x + radius, center.y - radius, center.y + radius, -maxZ, -minZ) * lightView;
+    }
+
+    Layers createLayers(const char* name, VkImageUsageFlags usage) {
+        Layers layers;
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {m_mapSize, m_mapSize, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = CASCADE_COUNT;
+        imageInfo.format = FORMAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateImage(m_device, &imageInfo, hostAllocator(), &layers.image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shadow map image!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_device, layers.image, &memRequirements);
+        layers.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::attachment, 0, name);
+        vkBindImageMemory(m_device, layers.image, layers.allocation.memory, layers.allocation.offset);
+
+        for (uint32_t i = 0; i < CASCADE_COUNT; i++) {
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = layers.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = FORMAT;
+            viewInfo.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, i, 1};
+            if (vkCreateImageView(m_device, &viewInfo, hostAllocator(), &layers.views[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create shadow map layer view!");
+            }
+        }
+        return layers;
+    }
+
+    void createFramebuffers(Layers& layers, VkRenderPass renderPass) {
+        for (uint32_t i = 0; i < CASCADE_COUNT; i++) {
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = renderPass;
+            framebufferInfo.attachmentCount = 1;
+            framebufferInfo.pAttachments = &layers.views[i];
+            framebufferInfo.width = m_mapSize;
+            framebufferInfo.height = m_mapSize;
+            framebufferInfo.layers = 1;
+            if (vkCreateFramebuffer(m_device, &framebufferInfo, hostAllocator(), &layers.framebuffers[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create shadow framebuffer!");
+            }
+        }
+    }
+
+    void destroyLayers(Layers& layers) {
+        for (uint32_t i = 0; i < CASCADE_COUNT; i++) {
+            vkDestroyFramebuffer(m_device, layers.framebuffers[i], hostAllocator());
+            vkDestroyImageView(m_device, layers.views[i], hostAllocator());
+        }
+        vkDestroyImage(m_device, layers.image, hostAllocator());
+        m_allocator->free(layers.allocation);
+        layers = {};
+    }
+
+    // shadow cache：进入时等待之前的采样、复制和depth写入，结束时让之后的片段着色器采样和复制读取看到写入
+    VkRenderPass createRenderPass(VkAttachmentLoadOp loadOp, VkImageLayout initialLayout, VkImageLayout finalLayout) {
+        VkAttachmentDescription attachment{};
+        attachment.format = FORMAT;
+        attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        attachment.loadOp = loadOp;
+        attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        attachment.initialLayout = initialLayout;
+        attachment.finalLayout = finalLayout;
+
+        VkAttachmentReference depthRef{0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.pDepthStencilAttachment = &depthRef;
+
+        std::array<VkSubpassDependency, 2> dependencies{};
+        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[0].dstSubpass = 0;
+        dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].srcSubpass = 0;
+        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+        dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &attachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+        renderPassInfo.pDependencies = dependencies.data();
+
+        VkRenderPass renderPass;
+        if (vkCreateRenderPass(m_device, &renderPassInfo, hostAllocator(), &renderPass) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shadow render pass!");
+        }
+        return renderPass;
+    }
+
+    // shadow cache：只有顶点阶段，正反面都写入depth，depth bias避免自阴影的条纹
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& vertexCode, const std::vector<VkVertexInputBindingDescription>& bindings,
+        const std::vector<VkVertexInputAttributeDescription>& attributes) {
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = vertexCode.size;
+        moduleInfo.pCode = vertexCode.words;
+        VkShaderModule module;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &module) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shadow shader module!");
+        }
+
+        VkPipelineShaderStageCreateInfo stage{};
+        stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        stage.module = module;
+        stage.pName = "main";
+
+        VkPipelineVertexInputStateCreateInfo vertexInput{};
+        vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInput.vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size());
+        vertexInput.pVertexBindingDescriptions = bindings.data();
+        vertexInput.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+        vertexInput.pVertexAttributeDescriptions = attributes.data();
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizer.cullMode = VK_CULL_MODE_NONE;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.depthBiasEnable = VK_TRUE;
+        rasterizer.depthBiasConstantFactor = 1.25f;
+        rasterizer.depthBiasSlopeFactor = 1.75f;
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = VK_TRUE;
+        depthStencil.depthWriteEnable = VK_TRUE;
+        depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+        VkPipelineColorBlendStateCreateInfo colorBlending{};  // 没有color attachment
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 1;
+        pipelineInfo.pStages = &stage;
+        pipelineInfo.pVertexInputState = &vertexInput;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = m_pipelineLayout;
+        pipelineInfo.renderPass = m_clearRenderPass;
+        pipelineInfo.subpass = 0;
+
+        VkResult result = vkCreateGraphicsPipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, module, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create shadow pipeline!");
+        }
+    }
+
+    void renderLayer(VkCommandBuffer commandBuffer, VkRenderPass renderPass, VkFramebuffer framebuffer, const glm::mat4& viewProj, const DrawCasters& drawCasters,
+        ShadowCasters casters) {
+        VkClearValue clearValue{};
+        clearValue.depthStencil = {1.0f, 0};
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = renderPass;
+        renderPassInfo.framebuffer = framebuffer;
+        renderPassInfo.renderArea = {{0, 0}, {m_mapSize, m_mapSize}};
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = &clearValue;
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+        VkViewport viewport{0.0f, 0.0f, float(m_mapSize), float(m_mapSize), 0.0f, 1.0f};
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        VkRect2D scissor{{0, 0}, {m_mapSize, m_mapSize}};
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, offsetof(PushConstants, lightViewProj), sizeof(glm::mat4), &viewProj);
+        drawCasters(commandBuffer, m_pipelineLayout, casters);
+
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    // shadow cache：cache的一层已经处于TRANSFER_SRC，shadow map的一层原来的内容不需要保留
+    // toShaderRead为false时之后还要加载这一层画动态caster，保持TRANSFER_DST给load render pass
+    void copyLayer(VkCommandBuffer commandBuffer, uint32_t layer, bool toShaderRead) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_shadowMap.image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, layer, 1};
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkImageCopy region{};
+        region.srcSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, layer, 1};
+        region.dstSubresource = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, layer, 1};
+        region.extent = {m_mapSize, m_mapSize, 1};
+        vkCmdCopyImage(commandBuffer, m_cache.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_shadowMap.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        if (toShaderRead) {
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    uint32_t m_mapSize = 0;
+    Layers m_shadowMap;
+    Layers m_cache;
+    VkImageView m_arrayView = VK_NULL_HANDLE;
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkRenderPass m_cacheRenderPass = VK_NULL_HANDLE;
+    VkRenderPass m_clearRenderPass = VK_NULL_HANDLE;
+    VkRenderPass m_loadRenderPass = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> m_commandBuffers;
+    std::array<Cascade, CASCADE_COUNT> m_cascades{};
+    std::array<float, CASCADE_COUNT> m_splits{};
+    Stats m_stats;
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "camera.hpp"
+#include "frame_queue.hpp"
+
+// simulation：之前相机和模型旋转在tickOneFrame中和渲染串行更新，模拟频率等于帧率，卡顿的帧会让模拟一起变慢或者跳一大步
+// 现在模拟以固定步长step运行，可以在自己的线程中，也可以由主线程每帧补齐落后的tick
+// 渲染线程读取最近两个tick的状态并按两次tick之间经过的时间插值，画面比模拟晚一个tick但是运动平滑
+// frame queue：每个tick把最近两个tick的状态作为一个快照发布到triple buffer，渲染线程取最新的快照，两边都不加锁
+struct SimulationState {
+    glm::vec3 cameraPosition{0.0f};
+    glm::vec3 cameraLookAt{0.0f};
+    float modelAngle = 0.0f;  // 所有mesh共同的旋转，弧度
+};
+
+class FixedStepSimulation {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // simulation：threaded为false时不创建线程，主线程调用update推进模拟
+    void start(const Camera& camera, float ticksPerSecond, bool threaded) {
+        m_camera = camera;
+        m_step = 1.0f / ticksPerSecond;
+        m_latest.current = captureState();
+        m_latest.previous = m_latest.current;
+        m_latest.currentTime = Clock::now();
+        m_nextTick = m_latest.currentTime + stepDuration();
+        m_snapshots.back() = m_latest;
+        m_snapshots.publish();
+        m_snapshots.update();  // 模拟线程和渲染线程都还没有开始，第一个快照直接交给读的一边
+        if (threaded) {
+            m_stop = false;
+            m_thread = std::thread(&FixedStepSimulation::run, this);
+        }
+    }
+
+    void stop() {
+        if (m_thread.joinable()) {
+            m_stop = true;
+            m_thread.join();
+        }
+    }
+
+    // simulation：输入在主线程的glfw回调中产生，time是回调时的时间
+    // input events：命令变化带着时间排队，覆盖这个时间的tick在tick内部分段积分；同一个线程按时间顺序调用
+    void pushCommand(Clock::time_point time, unsigned int command) {
+        std::lock_guard<std::mutex> lock(m_commandMutex);
+        m_commandEvents.push_back({time, command});
+    }
+
+    // shadow cache：暂停模型的旋转，角度停在当前的tick
+    void setAnimating(bool animating) { m_animating = animating; }
+
+    // simulation：没有模拟线程时由主线程调用，执行落后的所有tick
+    void update() {
+        if (!m_thread.joinable()) {
+            catchUp(Clock::now());
+        }
+    }
+
+    // simulation：按当前时间在上一个tick和最新tick之间插值
+    // frame queue：只在渲染的线程调用
+    SimulationState interpolated() {
+        m_snapshots.update();
+        const Snapshot& snapshot = m_snapshots.front();
+        float alpha = std::chrono::duration<float>(Clock::now() - snapshot.currentTime).count() / m_step;
+        alpha = glm::clamp(alpha, 0.0f, 1.0f);
+
+        SimulationState state;
+        state.cameraPosition = glm::mix(snapshot.previous.cameraPosition, snapshot.current.cameraPosition, alpha);
+        state.cameraLookAt = glm::mix(snapshot.previous.cameraLookAt, snapshot.current.cameraLookAt, alpha);
+        // shadow cache：两个tick的角度相同时结果严格不变，mix的两项相加会有舍入误差
+        state.modelAngle = snapshot.previous.modelAngle + (snapshot.current.modelAngle - snapshot.previous.modelAngle) * alpha;
+        return state;
+    }
+
+private:
+    struct Snapshot {
+        SimulationState previous;
+        SimulationState current;
+        Clock::time_point currentTime;  // current对应的tick时间
+    };
+
+    // simulation：落后超过MAX_CATCH_UP_TICKS时丢掉剩余的时间，避免模拟越来越落后
+    static constexpr int MAX_CATCH_UP_TICKS = 8;
+
+    void run() {
+        while (!m_stop) {
+            std::this_thread::sleep_until(m_nextTick);
+            catchUp(Clock::now());
+        }
+    }
+
+    void catchUp(Clock::time_point now) {
+        int ticks = 0;
+        while (m_nextTick <= now && ticks < MAX_CATCH_UP_TICKS) {
+            tick(m_nextTick);
+            m_nextTick += stepDuration();
+            ticks++;
+        }
+        if (m_nextTick <= now) {
+            m_nextTick = now + stepDuration();
+        }
+    }
+
+    // simulation：一个固定步长的tick，相机和模型旋转都只在这里修改
+    // input events：tick覆盖tickTime之前的一个step，更早的事件（落后太多被丢掉的时间里）放在tick开始，更晚的留给之后的tick
+    void tick(Clock::time_point tickTime) {
+        Clock::time_point tickStart = tickTime - stepDuration();
+        m_tickEvents.clear();
+        {
+            std::lock_guard<std::mutex> lock(m_commandMutex);
+            size_t taken = 0;
+            while (taken < m_commandEvents.size() && m_commandEvents[taken].time <= tickTime) {
+                float offset = std::chrono::duration<float>(m_commandEvents[taken].time - tickStart).count();
+                m_tickEvents.push_back({glm::max(offset, 0.0f), m_commandEvents[taken].command});
+                taken++;
+            }
+            m_commandEvents.erase(m_commandEvents.begin(), m_commandEvents.begin() + taken);
+        }
+        m_camera.update(m_step, m_tickEvents.data(), m_tickEvents.size());
+        SimulationState next = captureState();
+        next.modelAngle = m_latest.current.modelAngle + (m_animating ? glm::radians(90.0f) * m_step : 0.0f);  // 每秒转90度
+
+        m_latest.previous = m_latest.current;
+        m_latest.current = next;
+        m_latest.currentTime = tickTime;
+        m_snapshots.back() = m_latest;
+        m_snapshots.publish();
+    }
+
+    SimulationState captureState() const {
+        SimulationState state;
+        state.cameraPosition = m_camera.position();
+        state.cameraLookAt = m_camera.lookAt();
+        return state;
+    }
+
+    Clock::duration stepDuration() const {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(m_step));
+    }
+
+    Camera m_camera;  // simulation：模拟线程自己的相机，渲染使用插值后的位置
+    float m_step = 1.0f / 60.0f;
+    struct TimedCommand {
+        Clock::time_point time;
+        unsigned int command;
+    };
+    std::mutex m_commandMutex;  // 保护m_commandEvents，glfw回调和模拟线程都访问
+    std::vector<TimedCommand> m_commandEvents;
+    std::vector<CameraCommandEvent> m_tickEvents;  // 只在执行tick的线程使用
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_animating{true};
+    std::thread m_thread;
+    Clock::time_point m_nextTick;
+
+    Snapshot m_latest;  // 模拟一边最近两个tick的状态
+    TripleBuffer<Snapshot> m_snapshots;
+};
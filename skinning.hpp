@@ -0,0 +1,342 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "free_ranges.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// skinning：之前没有骨骼动画；蒙皮如果放在顶点着色器中，depth prepass、shadow和主pass每个pass都要重新蒙皮一次
+// 现在skinning.comp每帧在所有pass之前执行一次，蒙皮后的位置写进geometry buffer中这个mesh这一帧的顶点范围（每个frame in flight一份）
+// 调用者把mesh的vertexOffset换成这一帧的范围，之后所有pass和普通mesh一样绘制，顶点格式和pipeline都不变
+// 绑定姿势的float位置、joint编号和权重在host visible的source buffer中，joint矩阵每帧由cpu写入
+// 蒙皮结果之外的顶点属性（uv等）每次从绑定姿势的顶点范围拷贝，量化等变换由调用者合并进joint矩阵
+class ComputeSkinning {
+public:
+    static constexpr uint32_t WORKGROUP_SIZE = 64;  // 和skinning.comp的local_size_x一致
+    static constexpr uint32_t NO_SPACE = UINT32_MAX;
+
+    // skinning：和skinning.comp的SkinVertex一致，weights是4个unorm16
+    struct SkinVertex {
+        glm::vec4 position;
+        uint32_t joints;  // 4个8位的joint编号
+        uint32_t weights[2];
+        uint32_t padding;
+    };
+
+    // skinning：geometry buffer顶点区域的布局，单位是uint；交错格式时属性区域就是顶点本身，跳过开头的位置
+    struct VertexLayout {
+        uint32_t positionStride;
+        uint32_t attributeRegion;
+        uint32_t attributeStride;
+        uint32_t attributeSkip;
+        uint32_t attributeWords;
+        uint32_t compact;  // 位置是4个snorm16，否则是3个float
+    };
+
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& shaderCode, VkCommandPool commandPool,
+        uint32_t frameCount, uint32_t maxVertices, uint32_t maxJoints, VkBuffer geometryBuffer, VkDeviceSize vertexRegionSize, const VertexLayout& layout) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_commandPool = commandPool;
+        m_maxJoints = maxJoints;
+        m_layout = layout;
+        m_freeVertices.reset(maxVertices);
+        createPipeline(pipelineCache, shaderCode);
+
+        // skinning：ReBAR时source和joint buffer在device local的host visible内存中
+        VkMemoryPropertyFlags hostVisible = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        m_source = createBuffer(VkDeviceSize(maxVertices) * sizeof(SkinVertex), hostVisible, "skinning source");
+        m_frames.resize(frameCount);
+        for (Frame& frame : m_frames) {
+            frame.joints = createBuffer(VkDeviceSize(maxJoints) * sizeof(glm::mat4), hostVisible, "skinning joints");
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * frameCount};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = frameCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create skinning descriptor pool!");
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(frameCount, m_descriptorSetLayout);
+        std::vector<VkDescriptorSet> sets(frameCount);
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = m_descriptorPool;
+        setInfo.descriptorSetCount = frameCount;
+        setInfo.pSetLayouts = layouts.data();
+        if (vkAllocateDescriptorSets(m_device, &setInfo, sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate skinning descriptor sets!");
+        }
+
+        std::vector<VkCommandBuffer> commandBuffers(frameCount);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = frameCount;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate skinning command buffers!");
+        }
+
+        // skinning：geometry buffer只绑定顶点区域，和meshlet的set 2一样
+        for (uint32_t i = 0; i < frameCount; i++) {
+            Frame& frame = m_frames[i];
+            frame.descriptorSet = sets[i];
+            frame.commandBuffer = commandBuffers[i];
+            std::array<VkDescriptorBufferInfo, 3> bufferInfos = {{{m_source.buffer, 0, VK_WHOLE_SIZE}, {frame.joints.buffer, 0, VK_WHOLE_SIZE},
+                {geometryBuffer, 0, vertexRegionSize}}};
+            std::array<VkWriteDescriptorSet, 3> writes{};
+            for (uint32_t binding = 0; binding < writes.size(); binding++) {
+                writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[binding].dstSet = frame.descriptorSet;
+                writes[binding].dstBinding = binding;
+                writes[binding].descriptorCount = 1;
+                writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[binding].pBufferInfo = &bufferInfos[binding];
+            }
+            vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+    }
+
+    // skinning：调用者保证gpu已经空闲
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        for (Frame& frame : m_frames) {
+            vkFreeCommandBuffers(m_device, m_commandPool, 1, &frame.commandBuffer);
+            destroyBuffer(frame.joints);
+        }
+        m_frames.clear();
+        destroyBuffer(m_source);
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+
+    // skinning：source中的顶点范围，没有空间时返回NO_SPACE；写入的内容在下一次record之前可见（host coherent）
+    uint32_t allocateSource(uint32_t vertexCount) {
+        uint32_t first;
+        return m_freeVertices.take(vertexCount, first) ? first : NO_SPACE;
+    }
+    // skinning：调用者保证gpu已经不再读取这个范围
+    void freeSource(uint32_t first, uint32_t vertexCount) { m_freeVertices.give(first, vertexCount); }
+    SkinVertex* sourceVertices(uint32_t first) const { return static_cast<SkinVertex*>(m_source.allocation.mapped) + first; }
+
+    // skinning：权重按unorm16量化，四个权重的和由shader重新归一化
+    static SkinVertex packSkinVertex(const glm::vec3& position, const glm::uvec4& joints, glm::vec4 weights) {
+        SkinVertex vertex{};
+        vertex.position = glm::vec4(position, 1.0f);
+        vertex.joints = (joints.x & 0xff) | (joints.y & 0xff) << 8 | (joints.z & 0xff) << 16 | (joints.w & 0xff) << 24;
+        float sum = weights.x + weights.y + weights.z + weights.w;
+        weights = sum > 0.0f ? weights / sum : glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        auto unorm = [](float value) { return static_cast<uint32_t>(std::clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f); };
+        vertex.weights[0] = unorm(weights.x) | unorm(weights.y) << 16;
+        vertex.weights[1] = unorm(weights.z) | unorm(weights.w) << 16;
+        return vertex;
+    }
+
+    // skinning：这一帧的joint矩阵和dispatch从空开始
+    void beginFrame(uint32_t frameIndex) {
+        Frame& frame = m_frames[frameIndex];
+        frame.jointCount = 0;
+        frame.dispatches.clear();
+    }
+
+    // skinning：一个mesh这一帧的蒙皮，joint矩阵写进这一帧的joint buffer；容量不够时返回false，这个mesh保持之前写入的姿势
+    // bindVertex和outputVertex是geometry buffer中的顶点编号，joint编号相对于这个mesh的第一个矩阵
+    bool add(uint32_t frameIndex, const glm::mat4* joints, uint32_t jointCount, uint32_t sourceVertex, uint32_t vertexCount, uint32_t bindVertex,
+        uint32_t outputVertex) {
+        Frame& frame = m_frames[frameIndex];
+        if (frame.jointCount + jointCount > m_maxJoints || jointCount == 0 || vertexCount == 0) {
+            return false;
+        }
+        memcpy(static_cast<glm::mat4*>(frame.joints.allocation.mapped) + frame.jointCount, joints, sizeof(glm::mat4) * jointCount);
+        frame.dispatches.push_back({sourceVertex, vertexCount, bindVertex, outputVertex, frame.jointCount, jointCount});
+        frame.jointCount += jointCount;
+        return true;
+    }
+
+    // skinning：每个mesh一次dispatch，结束时的barrier让之后的vertex input读到蒙皮结果；没有mesh时返回VK_NULL_HANDLE
+    // 调用者保证这个frame in flight上一次的提交已经完成，输出和joint buffer都不再被读取
+    VkCommandBuffer record(uint32_t frameIndex) {
+        Frame& frame = m_frames[frameIndex];
+        if (frame.dispatches.empty()) {
+            return VK_NULL_HANDLE;
+        }
+        VkCommandBuffer commandBuffer = frame.commandBuffer;
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording skinning command buffer!");
+        }
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+        for (const Dispatch& dispatch : frame.dispatches) {
+            PushConstants constants{dispatch.sourceVertex, dispatch.vertexCount, dispatch.bindVertex, dispatch.outputVertex, dispatch.jointOffset,
+                dispatch.jointCount, m_layout};
+            vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+            vkCmdDispatch(commandBuffer, (dispatch.vertexCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+        }
+
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record skinning command buffer!");
+        }
+        return commandBuffer;
+    }
+
+    uint32_t dispatchCount(uint32_t frameIndex) const { return static_cast<uint32_t>(m_frames[frameIndex].dispatches.size()); }
+
+private:
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    struct Dispatch {
+        uint32_t sourceVertex;
+        uint32_t vertexCount;
+        uint32_t bindVertex;
+        uint32_t outputVertex;
+        uint32_t jointOffset;
+        uint32_t jointCount;
+    };
+
+    // skinning：和skinning.comp的push constant一致
+    struct PushConstants {
+        uint32_t sourceVertex;
+        uint32_t vertexCount;
+        uint32_t bindVertex;
+        uint32_t outputVertex;
+        uint32_t jointOffset;
+        uint32_t jointCount;
+        VertexLayout layout;
+    };
+
+    struct Frame {
+        Buffer joints;
+        uint32_t jointCount = 0;
+        std::vector<Dispatch> dispatches;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    };
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create skinning descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create skinning pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create skinning shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create skinning compute pipeline!");
+        }
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkMemoryPropertyFlags properties, const char* name) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create skinning buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        buffer.allocation = m_allocator->allocate(memRequirements, properties, true, MemoryCategory::geometry, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+        return buffer;
+    }
+
+    void destroyBuffer(Buffer& buffer) {
+        vkDestroyBuffer(m_device, buffer.buffer, hostAllocator());
+        m_allocator->free(buffer.allocation);
+        buffer = {};
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    uint32_t m_maxJoints = 0;
+    VertexLayout m_layout{};
+    FreeRanges m_freeVertices;
+    Buffer m_source;
+    std::vector<Frame> m_frames;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+};
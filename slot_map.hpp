@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// slot map：32位的generational handle，低INDEX_BITS位是slot，高位是generation，slot释放时generation加一，旧handle不会访问到新的值
+// 值紧密地存放在一个vector中，删除时把最后一个值移到空出来的位置；遍历所有值是连续内存，不经过slot
+// 查找是两次数组访问（slot -> dense index -> value），没有hash也没有指针跳转；插入和删除会移动值，不要长期保存值的引用
+// INVALID（全1）永远不是有效的handle：slot最多到INDEX_MASK - 1
+template <typename T, uint32_t IndexBits = 20>
+class SlotMap {
+public:
+    using Handle = uint32_t;
+    static constexpr Handle INVALID = UINT32_MAX;
+    static constexpr uint32_t INDEX_MASK = (1u << IndexBits) - 1;
+    static constexpr uint32_t GENERATION_MASK = UINT32_MAX >> IndexBits;
+
+    Handle insert(T value) {
+        uint32_t slot;
+        if (!m_freeSlots.empty()) {
+            slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        } else {
+            if (m_slots.size() >= INDEX_MASK) {
+                throw std::runtime_error("slot map is full!");
+            }
+            slot = static_cast<uint32_t>(m_slots.size());
+            m_slots.push_back({});
+        }
+        m_slots[slot].dense = static_cast<uint32_t>(m_values.size());
+        m_values.push_back(std::move(value));
+        m_denseToSlot.push_back(slot);
+        return makeHandle(slot, m_slots[slot].generation);
+    }
+
+    // slot map：最后一个值移到被删除的位置，它的slot指向新的dense index
+    void erase(Handle handle) {
+        uint32_t slot = checkedSlot(handle);
+        uint32_t dense = m_slots[slot].dense;
+        uint32_t last = static_cast<uint32_t>(m_values.size() - 1);
+        if (dense != last) {
+            m_values[dense] = std::move(m_values[last]);
+            m_denseToSlot[dense] = m_denseToSlot[last];
+            m_slots[m_denseToSlot[dense]].dense = dense;
+        }
+        m_values.pop_back();
+        m_denseToSlot.pop_back();
+        m_slots[slot].generation = (m_slots[slot].generation + 1) & GENERATION_MASK;
+        m_freeSlots.push_back(slot);
+    }
+
+    bool contains(Handle handle) const {
+        uint32_t slot = handle & INDEX_MASK;
+        return handle != INVALID && slot < m_slots.size() && m_slots[slot].generation == (handle >> IndexBits);
+    }
+
+    T& get(Handle handle) { return m_values[m_slots[checkedSlot(handle)].dense]; }
+    const T& get(Handle handle) const { return m_values[m_slots[checkedSlot(handle)].dense]; }
+
+    // slot map：dense数组的第index个值的handle，和遍历values()一起使用
+    Handle handleAt(size_t index) const {
+        uint32_t slot = m_denseToSlot[index];
+        return makeHandle(slot, m_slots[slot].generation);
+    }
+
+    size_t size() const { return m_values.size(); }
+    bool empty() const { return m_values.empty(); }
+
+    std::vector<T>& values() { return m_values; }
+    const std::vector<T>& values() const { return m_values; }
+    typename std::vector<T>::iterator begin() { return m_values.begin(); }
+    typename std::vector<T>::iterator end() { return m_values.end(); }
+    typename std::vector<T>::const_iterator begin() const { return m_values.begin(); }
+    typename std::vector<T>::const_iterator end() const { return m_values.end(); }
+
+    // slot map：已经发出的handle在clear之后仍然无效，generation保留
+    void clear() {
+        for (uint32_t slot : m_denseToSlot) {
+            m_slots[slot].generation = (m_slots[slot].generation + 1) & GENERATION_MASK;
+            m_freeSlots.push_back(slot);
+        }
+        m_values.clear();
+        m_denseToSlot.clear();
+    }
+
+private:
+    struct Slot {
+        uint32_t dense = 0;
+        uint32_t generation = 0;
+    };
+
+    static Handle makeHandle(uint32_t slot, uint32_t generation) { return (generation << IndexBits) | slot; }
+
+    uint32_t checkedSlot(Handle handle) const {
+        if (!contains(handle)) {
+            throw std::runtime_error("stale or invalid slot map handle!");
+        }
+        return handle & INDEX_MASK;
+    }
+
+    std::vector<T> m_values;
+    std::vector<uint32_t> m_denseToSlot;
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_freeSlots;
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "cpu_profiler.hpp"
+#include "frustum_culling.hpp"
+#include "job_pool.hpp"
+
+// software occlusion：gpu culling不可用的设备上，cpu把离相机最近的几个三角形少的物体画进低分辨率的depth buffer，再用它测试其它物体的包围盒
+// 剔除在录制命令之前完成，不需要读回gpu的结果，也不占用gpu时间；结果只延迟到这一帧的相机，不像occlusion query和hi-z要等上一帧
+// 三角形先变换并分到TILE_WIDTH x TILE_HEIGHT的tile中，每个tile是job pool中的一个job，tile之间没有共享的写入
+// 遮挡体是完整分辨率的mesh，不使用简化的lod，它们可能凸出到真实轮廓之外
+// 每个三角形只写它最远的顶点深度，像素中心被覆盖时写入；遮挡体画得比实际远，所以测试是保守的（像素中心之外的边缘除外）
+// SSE2和NEON一次处理一行中的4个像素，都不支持时逐个处理
+class SoftwareOcclusion {
+public:
+    static constexpr uint32_t TILE_WIDTH = 32;
+    static constexpr uint32_t TILE_HEIGHT = 16;
+
+    // software occlusion：宽高向上取整到tile的倍数；宽度是4的倍数，每行可以整组处理
+    void init(uint32_t width, uint32_t height) {
+        m_width = std::max((width + TILE_WIDTH - 1) / TILE_WIDTH, 1u) * TILE_WIDTH;
+        m_height = std::max((height + TILE_HEIGHT - 1) / TILE_HEIGHT, 1u) * TILE_HEIGHT;
+        m_tilesX = m_width / TILE_WIDTH;
+        m_tilesY = m_height / TILE_HEIGHT;
+        m_depth.assign(static_cast<size_t>(m_width) * m_height, 1.0f);
+        m_tileMaxDepth.assign(static_cast<size_t>(m_tilesX) * m_tilesY, 1.0f);
+        m_bins.assign(m_tileMaxDepth.size(), {});
+    }
+
+    bool initialized() const { return m_width > 0; }
+
+    // software occlusion：每帧开始时调用，viewProj用来测试包围盒
+    void begin(const glm::mat4& viewProj) {
+        m_viewProj = viewProj;
+        m_triangles.clear();
+    }
+
+    // software occlusion：triangles是物体空间中不带索引的三角形，每3个顶点一个；穿过near平面的三角形丢掉，少画遮挡体仍然是保守的
+    void addOccluder(const glm::vec3* triangles, size_t vertexCount, const glm::mat4& modelViewProj) {
+        for (size_t v = 0; v + 2 < vertexCount; v += 3) {
+            glm::vec4 clip[3];
+            bool clipped = false;
+            for (int k = 0; k < 3; k++) {
+                clip[k] = modelViewProj * glm::vec4(triangles[v + k], 1.0f);
+                clipped = clipped || clip[k].w <= 0.0f || clip[k].z < 0.0f;
+            }
+            if (clipped) {
+                continue;
+            }
+            ScreenTriangle triangle;
+            float depth = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                float inverseW = 1.0f / clip[k].w;
+                triangle.x[k] = (clip[k].x * inverseW * 0.5f + 0.5f) * m_width;
+                triangle.y[k] = (clip[k].y * inverseW * 0.5f + 0.5f) * m_height;
+                depth = std::max(depth, clip[k].z * inverseW);
+            }
+            triangle.depth = std::min(depth, 1.0f);
+            // 统一成逆时针，退化的三角形不覆盖任何像素中心
+            float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.y[1] - triangle.y[0]) * (triangle.x[2] - triangle.x[0]);
+            if (std::fabs(area) < 1e-6f) {
+                continue;
+            }
+            if (area < 0.0f) {
+                std::swap(triangle.x[1], triangle.x[2]);
+                std::swap(triangle.y[1], triangle.y[2]);
+            }
+            float minX = std::min({triangle.x[0], triangle.x[1], triangle.x[2]});
+            float maxX = std::max({triangle.x[0], triangle.x[1], triangle.x[2]});
+            float minY = std::min({triangle.y[0], triangle.y[1], triangle.y[2]});
+            float maxY = std::max({triangle.y[0], triangle.y[1], triangle.y[2]});
+            if (maxX < 0.0f || maxY < 0.0f || minX >= m_width || minY >= m_height) {
+                continue;
+            }
+            triangle.minX = static_cast<int>(std::max(minX, 0.0f));
+            triangle.minY = static_cast<int>(std::max(minY, 0.0f));
+            triangle.maxX = static_cast<int>(std::min(maxX, m_width - 1.0f));
+            triangle.maxY = static_cast<int>(std::min(maxY, m_height - 1.0f));
+            m_triangles.push_back(triangle);
+        }
+    }
+
+    size_t triangleCount() const { return m_triangles.size(); }
+
+    // software occlusion：清空depth，把三角形分到tile中，然后每个tile一个job光栅化
+    void rasterize(JobPool* pool) {
+        CPU_PROFILE_SCOPE("software occlusion raster");
+        for (std::vector<uint32_t>& bin : m_bins) {
+            bin.clear();
+        }
+        for (uint32_t t = 0; t < m_triangles.size(); t++) {
+            const ScreenTriangle& triangle = m_triangles[t];
+            for (int ty = triangle.minY / static_cast<int>(TILE_HEIGHT); ty <= triangle.maxY / static_cast<int>(TILE_HEIGHT); ty++) {
+                for (int tx = triangle.minX / static_cast<int>(TILE_WIDTH); tx <= triangle.maxX / static_cast<int>(TILE_WIDTH); tx++) {
+                    m_bins[ty * m_tilesX + tx].push_back(t);
+                }
+            }
+        }
+        auto rasterizeTile = [this](size_t tile) {
+            uint32_t tileX = static_cast<uint32_t>(tile % m_tilesX) * TILE_WIDTH;
+            uint32_t tileY = static_cast<uint32_t>(tile / m_tilesX) * TILE_HEIGHT;
+            for (uint32_t y = tileY; y < tileY + TILE_HEIGHT; y++) {
+                std::fill_n(&m_depth[static_cast<size_t>(y) * m_width + tileX], TILE_WIDTH, 1.0f);
+            }
+            for (uint32_t t : m_bins[tile]) {
+                rasterizeTriangle(m_triangles[t], tileX, tileY);
+            }
+            float maxDepth = 0.0f;
+            for (uint32_t y = tileY; y < tileY + TILE_HEIGHT; y++) {
+                const float* row = &m_depth[static_cast<size_t>(y) * m_width + tileX];
+                maxDepth = std::max(maxDepth, *std::max_element(row, row + TILE_WIDTH));
+            }
+            m_tileMaxDepth[tile] = maxDepth;
+        };
+        if (pool != nullptr && pool->threadCount() > 1 && !m_triangles.empty()) {
+            pool->parallelFor(m_bins.size(), rasterizeTile);
+        } else {
+            for (size_t tile = 0; tile < m_bins.size(); tile++) {
+                rasterizeTile(tile);
+            }
+        }
+    }
+
+    // software occlusion：世界空间的包围盒，最近的角比覆盖的所有像素都远时被遮挡；穿过near平面的包围盒总是可见
+    // 整个tile最远的深度都比包围盒近时跳过这个tile的像素
+    bool visible(const Aabb& box) const {
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 position((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = m_viewProj * glm::vec4(position, 1.0f);
+            if (clip.w <= 0.0f || clip.z < 0.0f) {
+                return true;
+            }
+            float inverseW = 1.0f / clip.w;
+            float x = (clip.x * inverseW * 0.5f + 0.5f) * m_width;
+            float y = (clip.y * inverseW * 0.5f + 0.5f) * m_height;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            minZ = std::min(minZ, clip.z * inverseW);
+        }
+        if (maxX < 0.0f || maxY < 0.0f || minX >= m_width || minY >= m_height) {
+            return true;  // 不在屏幕上，由frustum culling决定
+        }
+        int x0 = static_cast<int>(std::max(minX, 0.0f));
+        int y0 = static_cast<int>(std::max(minY, 0.0f));
+        int x1 = static_cast<int>(std::min(maxX, m_width - 1.0f));
+        int y1 = static_cast<int>(std::min(maxY, m_height - 1.0f));
+        for (int ty = y0 / static_cast<int>(TILE_HEIGHT); ty <= y1 / static_cast<int>(TILE_HEIGHT); ty++) {
+            for (int tx = x0 / static_cast<int>(TILE_WIDTH); tx <= x1 / static_cast<int>(TILE_WIDTH); tx++) {
+                if (m_tileMaxDepth[ty * m_tilesX + tx] < minZ) {
+                    continue;
+                }
+                int rowBegin = std::max(y0, ty * static_cast<int>(TILE_HEIGHT));
+                int rowEnd = std::min(y1, (ty + 1) * static_cast<int>(TILE_HEIGHT) - 1);
+                int columnBegin = std::max(x0, tx * static_cast<int>(TILE_WIDTH));
+                int columnEnd = std::min(x1, (tx + 1) * static_cast<int>(TILE_WIDTH) - 1);
+                for (int y = rowBegin; y <= rowEnd; y++) {
+                    const float* row = &m_depth[static_cast<size_t>(y) * m_width];
+                    for (int x = columnBegin; x <= columnEnd; x++) {
+                        if (row[x] >= minZ) {
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    struct ScreenTriangle {
+        float x[3];
+        float y[3];
+        float depth;  // 三个顶点中最远的深度
+        int minX, minY, maxX, maxY;  // 裁剪到屏幕的像素范围
+    };
+
+    // software occlusion：边函数在像素中心求值，三个都不小于0时像素被覆盖；x方向按4个像素一组，起点对齐到4，tile的宽度是4的倍数
+    void rasterizeTriangle(const ScreenTriangle& triangle, uint32_t tileX, uint32_t tileY) {
+        int x0 = std::max(triangle.minX, static_cast<int>(tileX)) & ~3;
+        int x1 = std::min(triangle.maxX, static_cast<int>(tileX + TILE_WIDTH - 1));
+        int y0 = std::max(triangle.minY, static_cast<int>(tileY));
+        int y1 = std::min(triangle.maxY, static_cast<int>(tileY + TILE_HEIGHT - 1));
+        if (x0 > x1 || y0 > y1) {
+            return;
+        }
+        // 边(i, j)：E(x, y) = a * x + b * y + c，逆时针三角形的内部为正
+        float a[3], b[3], c[3];
+        for (int e = 0; e < 3; e++) {
+            int i = e;
+            int j = (e + 1) % 3;
+            a[e] = triangle.y[i] - triangle.y[j];
+            b[e] = triangle.x[j] - triangle.x[i];
+            c[e] = triangle.x[i] * triangle.y[j] - triangle.x[j] * triangle.y[i];
+        }
+        for (int y = y0; y <= y1; y++) {
+            float py = y + 0.5f;
+            float* row = &m_depth[static_cast<size_t>(y) * m_width];
+            for (int x = x0; x <= x1; x += 4) {
+                float px = x + 0.5f;
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+                __m128 xs = _mm_add_ps(_mm_set1_ps(px), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+                __m128 covered = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int e = 0; e < 3; e++) {
+                    __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[e]), xs), _mm_set1_ps(b[e] * py + c[e]));
+                    covered = _mm_and_ps(covered, _mm_cmpge_ps(edge, _mm_setzero_ps()));
+                }
+                __m128 depth = _mm_loadu_ps(row + x);
+                __m128 written = _mm_min_ps(depth, _mm_set1_ps(triangle.depth));
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(covered, written), _mm_andnot_ps(covered, depth)));
+#elif defined(__ARM_NEON)
+                const float offsets[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+                float32x4_t xs = vaddq_f32(vdupq_n_f32(px), vld1q_f32(offsets));
+                uint32x4_t covered = vdupq_n_u32(0xFFFFFFFFu);
+                for (int e = 0; e < 3; e++) {
+                    float32x4_t edge = vmlaq_n_f32(vdupq_n_f32(b[e] * py + c[e]), xs, a[e]);
+                    covered = vandq_u32(covered, vcgeq_f32(edge, vdupq_n_f32(0.0f)));
+                }
+                float32x4_t depth = vld1q_f32(row + x);
+                vst1q_f32(row + x, vbslq_f32(covered, vminq_f32(depth, vdupq_n_f32(triangle.depth)), depth));
+#else
+                for (int lane = 0; lane < 4; lane++) {
+                    float sx = px + lane;
+                    bool covered = true;
+                    for (int e = 0; e < 3; e++) {
+                        covered = covered && a[e] * sx + b[e] * py + c[e] >= 0.0f;
+                    }
+                    if (covered) {
+                        row[x + lane] = std::min(row[x + lane], triangle.depth);
+                    }
+                }
+#endif
+            }
+        }
+    }
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_tilesX = 0;
+    uint32_t m_tilesY = 0;
+    glm::mat4 m_viewProj{1.0f};
+    std::vector<float> m_depth;  // 0是near，1是far，和vulkan的深度范围相同
+    std::vector<float> m_tileMaxDepth;
+    std::vector<ScreenTriangle> m_triangles;
+    std::vector<std::vector<uint32_t>> m_bins;  // 每个tile覆盖它的三角形编号，容量在帧之间复用
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+// staging decode：stb_image把像素解码到自己malloc的buffer，之后还要memcpy到staging空间再free
+// 这里替换stb的内存分配，解码线程先设置目标staging空间，stb分配和输出大小完全相同的buffer时直接返回staging指针
+// 这样像素直接写入映射的staging内存，少一次整图拷贝和一次临时分配，8K纹理时是几百MB的内存流量
+// 中间buffer碰巧同样大小时也可能拿到staging指针，stb释放后会重新可用；最终输出不是staging指针时调用者回退到memcpy
+// 注意staging内存一般是write-combined，cpu读取很慢；jpeg只顺序写输出，png的filter会读取输出中的上一行
+struct StagingDecodeTarget {
+    void* data = nullptr;
+    size_t size = 0;
+    bool inUse = false;
+};
+
+// staging decode：每个解码线程有自己的目标，多线程解码互不影响
+inline StagingDecodeTarget*& stagingDecodeTarget() {
+    thread_local StagingDecodeTarget* target = nullptr;
+    return target;
+}
+
+inline void* stagingDecodeMalloc(size_t size) {
+    StagingDecodeTarget* target = stagingDecodeTarget();
+    if (target && !target->inUse && size == target->size) {
+        target->inUse = true;
+        return target->data;
+    }
+    return malloc(size);
+}
+
+inline void stagingDecodeFree(void* p) {
+    StagingDecodeTarget* target = stagingDecodeTarget();
+    if (target && p == target->data) {
+        target->inUse = false;  // staging空间不能free，只是重新可用
+        return;
+    }
+    free(p);
+}
+
+inline void* stagingDecodeRealloc(void* p, size_t size) {
+    StagingDecodeTarget* target = stagingDecodeTarget();
+    if (target && p == target->data) {  // staging空间不能扩大，转移到堆上
+        void* copy = malloc(size);
+        if (copy) {
+            memcpy(copy, p, size < target->size ? size : target->size);
+            target->inUse = false;
+        }
+        return copy;
+    }
+    return realloc(p, size);
+}
+
+// staging decode：作用域内当前线程的stb分配可以使用target，离开作用域时恢复
+class ScopedStagingDecode {
+public:
+    ScopedStagingDecode(void* data, size_t size) : m_previous(stagingDecodeTarget()) {
+        m_target.data = data;
+        m_target.size = size;
+        stagingDecodeTarget() = &m_target;
+    }
+
+    ~ScopedStagingDecode() { stagingDecodeTarget() = m_previous; }
+
+    ScopedStagingDecode(const ScopedStagingDecode&) = delete;
+    ScopedStagingDecode& operator=(const ScopedStagingDecode&) = delete;
+
+private:
+    StagingDecodeTarget m_target;
+    StagingDecodeTarget* m_previous;
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+
+// staging ring：之前每次上传都创建staging buffer、映射、拷贝再销毁
+// 现在只创建一个持久映射的环形buffer，每次上传从head往后切一段，提交后打上ticket，gpu完成该ticket后这段空间回收
+// 这样上传不再有分配开销，多个上传可以同时共享同一个ring而不需要互相等待
+class StagingRing {
+public:
+    // staging ring：ring中的一段空间，buffer和offset用于拷贝命令，mapped用于cpu写入
+    struct Region {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+    };
+
+    // waitForTicket：ring空间不足时用于等待最早提交的上传完成，等待完成后需要调用retire
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkDeviceSize capacity, std::function<void(uint64_t)> waitForTicket) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_capacity = capacity;
+        m_waitForTicket = std::move(waitForTicket);
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = capacity;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &m_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create staging ring buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, m_buffer, &memRequirements);
+        m_allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true, MemoryCategory::staging, 0, "staging ring");
+        vkBindBufferMemory(m_device, m_buffer, m_allocation.memory, m_allocation.offset);
+    }
+
+    void cleanup() {
+        vkDestroyBuffer(m_device, m_buffer, hostAllocator());
+        m_allocator->free(m_allocation);
+    }
+
+    // staging ring：分配一段空间，空间不足时等待最早的上传完成再重试
+    Region allocate(VkDeviceSize size, VkDeviceSize alignment = 16) {
+        if (size > m_capacity) {
+            throw std::runtime_error("upload is larger than the staging ring!");
+        }
+
+        while (true) {
+            VkDeviceSize offset;
+            if (tryAllocate(size, alignment, offset)) {
+                Region region{};
+                region.buffer = m_buffer;
+                region.offset = offset;
+                region.size = size;
+                region.mapped = static_cast<char*>(m_allocation.mapped) + offset;
+                return region;
+            }
+
+            if (m_inFlight.empty()) {  // 剩下的空间都被还没提交的上传占用，再等也不会有空间
+                throw std::runtime_error("staging ring exhausted by uncommitted uploads!");
+            }
+            m_waitForTicket(m_inFlight.front().ticket);
+        }
+    }
+
+    // staging ring：把上次commit之后分配的空间都标记为属于ticket这次提交
+    void commit(uint64_t ticket) {
+        if (m_pendingBytes == 0) {
+            return;
+        }
+        m_inFlight.push_back({m_head, m_pendingBytes, ticket});
+        m_pendingBytes = 0;
+    }
+
+    // staging ring：completedTicket及之前的提交已经在gpu上完成，回收对应空间
+    void retire(uint64_t completedTicket) {
+        while (!m_inFlight.empty() && m_inFlight.front().ticket <= completedTicket) {
+            m_tail = m_inFlight.front().end;
+            m_used -= m_inFlight.front().bytes;
+            m_inFlight.pop_front();
+        }
+        if (m_used == 0) {  // ring为空时回到开头，减少回绕浪费
+            m_head = m_tail = 0;
+        }
+    }
+
+    VkDeviceSize capacity() const { return m_capacity; }
+    VkDeviceSize usedBytes() const { return m_used; }
+
+private:
+    struct InFlightRange {
+        VkDeviceSize end;  // 这次提交最后一段空间的结束位置，回收后成为新的tail
+        VkDeviceSize bytes;  // 包括对齐和回绕浪费的字节数
+        uint64_t ticket;
+    };
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    Allocation m_allocation;
+    VkDeviceSize m_capacity = 0;
+    std::function<void(uint64_t)> m_waitForTicket;
+
+    VkDeviceSize m_head = 0;  // 下一次分配的位置
+    VkDeviceSize m_tail = 0;  // 最早的未完成上传的起始位置
+    VkDeviceSize m_used = 0;
+    VkDeviceSize m_pendingBytes = 0;
+    std::deque<InFlightRange> m_inFlight;
+
+    bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset) {
+        VkDeviceSize alignedHead = (m_head + alignment - 1) / alignment * alignment;
+
+        if (m_used == 0) {
+            outOffset = 0;
+            consume(size, size);
+            return true;
+        }
+
+        if (m_head > m_tail) {
+            // 尾部空间足够则直接分配
+            if (alignedHead + size <= m_capacity) {
+                outOffset = alignedHead;
+                consume(alignedHead + size, alignedHead + size - m_head);
+                return true;
+            }
+            // 否则回绕到开头，尾部剩余空间作为浪费字节记到这次分配上
+            if (size <= m_tail) {
+                outOffset = 0;
+                consume(size, (m_capacity - m_head) + size);
+                return true;
+            }
+            return false;
+        }
+
+        // head < tail：只能使用head和tail之间的空间，head == tail且非空表示ring已满
+        if (m_head < m_tail && alignedHead + size <= m_tail) {
+            outOffset = alignedHead;
+            consume(alignedHead + size, alignedHead + size - m_head);
+            return true;
+        }
+        return false;
+    }
+
+    void consume(VkDeviceSize newHead, VkDeviceSize bytes) {
+        m_head = newHead;
+        m_used += bytes;
+        m_pendingBytes += bytes;
+    }
+};
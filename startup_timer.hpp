@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cpu_profiler.hpp"
+
+// startup timer：initVulkan中每个创建步骤用STARTUP_STEP包起来，自动计时，步骤名就是调用的代码
+// 每个步骤同时写进cpu profiler，导出的trace中可以看到启动阶段；第一帧提交后输出按顺序的耗时表和time to first frame
+// time to first frame从进程启动算起（g_processStartTime在main之前的静态初始化中取时间），包括glfw初始化等不在initVulkan中的时间
+// 模型在后台加载，第一帧绘制的是占位mesh，所以模型导入不计入time to first frame
+class StartupTimer {
+public:
+    using Clock = CpuProfiler::Clock;
+
+    // startup timer：init graph的worker步骤在job pool中记录，需要加锁
+    void record(const char* name, Clock::time_point start, Clock::time_point end) {
+        if (CpuProfiler::instance().enabled()) {
+            CpuProfiler::instance().record(name, start, end);
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_steps.push_back({name, milliseconds(g_processStartTime, start), milliseconds(start, end)});
+    }
+
+    bool firstFrameRecorded() const { return m_firstFrameMs >= 0.f; }
+    float firstFrameMs() const { return m_firstFrameMs; }
+
+    // startup timer：只有第一次调用生效，在第一帧提交之后调用
+    void firstFrame() {
+        if (firstFrameRecorded()) {
+            return;
+        }
+        Clock::time_point now = Clock::now();
+        if (CpuProfiler::instance().enabled()) {
+            CpuProfiler::instance().record("time to first frame", g_processStartTime, now);
+        }
+        m_firstFrameMs = milliseconds(g_processStartTime, now);
+    }
+
+    // startup timer：按执行顺序输出，最慢的几个步骤标上*，最后是步骤之外的时间（第一帧的录制和提交、没有包起来的代码）
+    void report(std::ostream& out) const {
+        float stepTotal = 0.f;
+        std::vector<float> durations;
+        for (const Step& step : m_steps) {
+            stepTotal += step.durationMs;
+            durations.push_back(step.durationMs);
+        }
+        std::sort(durations.begin(), durations.end(), std::greater<float>());
+        float slowThreshold = durations.size() > SLOWEST_MARKED ? durations[SLOWEST_MARKED - 1] : 0.f;
+
+        out << "startup: " << format(m_firstFrameMs) << " ms to first frame, " << m_steps.size() << " steps " << format(stepTotal) << " ms" << std::endl;
+        for (const Step& step : m_steps) {
+            float percent = m_firstFrameMs > 0.f ? step.durationMs * 100.f / m_firstFrameMs : 0.f;
+            out << (step.durationMs >= slowThreshold && step.durationMs > 0.f ? "  * " : "    ") << format(step.startMs) << " + " << format(step.durationMs) << " ms ("
+                << format(percent) << "%) " << step.name << std::endl;
+        }
+        out << "    other " << format(std::max(0.f, m_firstFrameMs - stepTotal)) << " ms" << std::endl;
+    }
+
+private:
+    static constexpr size_t SLOWEST_MARKED = 3;
+
+    struct Step {
+        const char* name;
+        float startMs;  // 相对进程启动
+        float durationMs;
+    };
+
+    static float milliseconds(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<float, std::chrono::milliseconds::period>(to - from).count();
+    }
+
+    static std::string format(float value) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.1f", value);
+        return buffer;
+    }
+
+    std::mutex m_mutex;  // 保护m_steps
+    std::vector<Step> m_steps;
+    float m_firstFrameMs = -1.f;
+};
+
+class StartupStepScope {
+public:
+    StartupStepScope(StartupTimer& timer, const char* name) : m_timer(timer), m_name(name), m_start(StartupTimer::Clock::now()) {}
+    ~StartupStepScope() { m_timer.record(m_name, m_start, StartupTimer::Clock::now()); }
+
+    StartupStepScope(const StartupStepScope&) = delete;
+    StartupStepScope& operator=(const StartupStepScope&) = delete;
+
+private:
+    StartupTimer& m_timer;
+    const char* m_name;
+    StartupTimer::Clock::time_point m_start;
+};
+
+// startup timer：步骤名是字符串字面量，满足cpu profiler对名字生命周期的要求
+#define STARTUP_STEP(timer, ...)                                     \
+    do {                                                             \
+        StartupStepScope startupStepScope(timer, #__VA_ARGS__);      \
+        __VA_ARGS__;                                                 \
+    } while (0)
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "frustum_culling.hpp"
+
+// static batching：导入的场景常有几百个共用材质、从不移动的小mesh，每个都是一次draw
+// 加载时把同一材质的静态mesh按空间位置分组，每组的顶点变换到模型空间后合并成一个mesh，一次draw画完
+// 分组先按场景包围盒划分的均匀网格（最长的轴分成gridResolution格），同一格内再按中心的morton顺序切成不超过maxVertices的batch
+// 一格中的mesh在空间上相邻，合并之后的包围盒仍然紧凑，视锥剔除和遮挡剔除按batch进行
+struct StaticBatchItem {
+    uint32_t material;  // 相同编号的item才会合并
+    Aabb bounds;  // 模型空间中的包围盒
+    uint32_t vertexCount;
+};
+
+struct StaticBatch {
+    std::vector<uint32_t> items;  // 在输入中的位置，按morton顺序
+    uint32_t vertexCount = 0;
+    Aabb bounds{glm::vec3(0.0f), glm::vec3(0.0f)};
+};
+
+// static batching：只有一个item的batch也会返回，调用者按原来的方式单独上传
+inline std::vector<StaticBatch> planStaticBatches(const std::vector<StaticBatchItem>& items, uint32_t gridResolution, uint32_t maxVertices) {
+    std::vector<StaticBatch> batches;
+    if (items.empty()) {
+        return batches;
+    }
+    Aabb scene = items[0].bounds;
+    for (const StaticBatchItem& item : items) {
+        scene.min = glm::min(scene.min, item.bounds.min);
+        scene.max = glm::max(scene.max, item.bounds.max);
+    }
+    glm::vec3 extent = glm::max(scene.max - scene.min, glm::vec3(1e-6f));
+    float cellSize = std::max(extent.x, std::max(extent.y, extent.z)) / static_cast<float>(std::max(gridResolution, 1u));
+
+    // static batching：每个轴10位的morton code，量化到整个场景的范围
+    auto spread = [](uint32_t v) {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    };
+    struct Entry {
+        uint32_t morton;
+        uint32_t item;
+    };
+    std::map<std::tuple<uint32_t, int32_t, int32_t, int32_t>, std::vector<Entry>> cells;
+    for (uint32_t i = 0; i < items.size(); i++) {
+        glm::vec3 center = (items[i].bounds.min + items[i].bounds.max) * 0.5f;
+        glm::ivec3 cell = glm::ivec3(glm::floor((center - scene.min) / cellSize));
+        glm::uvec3 q = glm::uvec3(glm::clamp((center - scene.min) / extent, 0.0f, 1.0f) * 1023.0f);
+        uint32_t morton = spread(q.x) | (spread(q.y) << 1) | (spread(q.z) << 2);
+        cells[std::make_tuple(items[i].material, cell.x, cell.y, cell.z)].push_back({morton, i});
+    }
+
+    for (auto& cell : cells) {
+        std::vector<Entry>& entries = cell.second;
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.morton < b.morton; });
+        StaticBatch batch;
+        for (const Entry& entry : entries) {
+            const StaticBatchItem& item = items[entry.item];
+            if (!batch.items.empty() && batch.vertexCount + item.vertexCount > maxVertices) {
+                batches.push_back(std::move(batch));
+                batch = StaticBatch{};
+            }
+            if (batch.items.empty()) {
+                batch.bounds = item.bounds;
+            }
+            batch.items.push_back(entry.item);
+            batch.vertexCount += item.vertexCount;
+            batch.bounds.min = glm::min(batch.bounds.min, item.bounds.min);
+            batch.bounds.max = glm::max(batch.bounds.max, item.bounds.max);
+        }
+        if (!batch.items.empty()) {
+            batches.push_back(std::move(batch));
+        }
+    }
+    return batches;
+}
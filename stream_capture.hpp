@@ -0,0 +1,117 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// stream capture：--record-stream把连续若干帧在renderer层面的命令流写入文件，VulkanTutorial_stream_replay在没有应用逻辑和场景资源的情况下回放
+// 记录的是每帧的相机、实例矩阵和排序之后的draw packet，以及draw用到的mesh的位置和索引；纹理、材质和着色不记录，回放只画depth
+// 同一个文件可以在不同的gpu或者不同版本的renderer上回放，得到可重复的A/B对比
+// 文件格式：header之后是所有mesh，然后是所有帧，都是小端的原始数据；mesh的位置已经解量化，draw的model已经乘上sceneModel
+struct StreamMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;  // 16位索引记录时转换成32位
+};
+
+struct StreamDraw {
+    uint32_t mesh;  // 在StreamCapture::meshes中的位置
+    uint32_t firstIndex;  // lod：相对于mesh的第一个索引
+    uint32_t indexCount;
+    glm::mat4 model;
+};
+static_assert(sizeof(StreamDraw) == 3 * sizeof(uint32_t) + sizeof(glm::mat4), "StreamDraw is written to the file as is");
+
+struct StreamFrame {
+    glm::mat4 viewProj;
+    std::vector<glm::mat4> instances;  // instancing：这一帧实例buffer中的矩阵，每个draw都绘制全部实例
+    std::vector<StreamDraw> draws;
+};
+
+struct StreamCapture {
+    static constexpr uint32_t MAGIC = 0x43535456;  // "VTSC"
+    static constexpr uint32_t VERSION = 1;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<StreamMesh> meshes;
+    std::vector<StreamFrame> frames;
+
+    bool write(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            return false;
+        }
+        uint32_t header[6] = {MAGIC, VERSION, width, height, static_cast<uint32_t>(meshes.size()), static_cast<uint32_t>(frames.size())};
+        writeArray(file, header, 6);
+        for (const StreamMesh& mesh : meshes) {
+            uint32_t counts[2] = {static_cast<uint32_t>(mesh.positions.size()), static_cast<uint32_t>(mesh.indices.size())};
+            writeArray(file, counts, 2);
+            writeArray(file, mesh.positions.data(), mesh.positions.size());
+            writeArray(file, mesh.indices.data(), mesh.indices.size());
+        }
+        for (const StreamFrame& frame : frames) {
+            writeArray(file, &frame.viewProj, 1);
+            uint32_t counts[2] = {static_cast<uint32_t>(frame.instances.size()), static_cast<uint32_t>(frame.draws.size())};
+            writeArray(file, counts, 2);
+            writeArray(file, frame.instances.data(), frame.instances.size());
+            writeArray(file, frame.draws.data(), frame.draws.size());
+        }
+        return static_cast<bool>(file);
+    }
+
+    // stream capture：版本不同或者draw引用了不存在的mesh时返回false
+    bool read(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        uint32_t header[6] = {};
+        if (!readArray(file, header, 6) || header[0] != MAGIC || header[1] != VERSION) {
+            return false;
+        }
+        width = header[2];
+        height = header[3];
+        meshes.resize(header[4]);
+        frames.resize(header[5]);
+        for (StreamMesh& mesh : meshes) {
+            uint32_t counts[2] = {};
+            if (!readArray(file, counts, 2)) {
+                return false;
+            }
+            mesh.positions.resize(counts[0]);
+            mesh.indices.resize(counts[1]);
+            if (!readArray(file, mesh.positions.data(), mesh.positions.size()) || !readArray(file, mesh.indices.data(), mesh.indices.size())) {
+                return false;
+            }
+        }
+        for (StreamFrame& frame : frames) {
+            uint32_t counts[2] = {};
+            if (!readArray(file, &frame.viewProj, 1) || !readArray(file, counts, 2)) {
+                return false;
+            }
+            frame.instances.resize(counts[0]);
+            frame.draws.resize(counts[1]);
+            if (!readArray(file, frame.instances.data(), frame.instances.size()) || !readArray(file, frame.draws.data(), frame.draws.size())) {
+                return false;
+            }
+            for (const StreamDraw& draw : frame.draws) {
+                if (draw.mesh >= meshes.size() || uint64_t(draw.firstIndex) + draw.indexCount > meshes[draw.mesh].indices.size()) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    template<typename T>
+    static void writeArray(std::ofstream& file, const T* data, size_t count) {
+        file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(sizeof(T) * count));
+    }
+
+    template<typename T>
+    static bool readArray(std::ifstream& file, T* data, size_t count) {
+        file.read(reinterpret_cast<char*>(data), static_cast<std::streamsize>(sizeof(T) * count));
+        return static_cast<bool>(file);
+    }
+};
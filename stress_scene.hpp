@@ -0,0 +1,150 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// stress scene：--stress按参数生成程序化的场景，不读取模型和纹理文件，实例数、mesh数、纹理数、材质数、光源数和运动的实例比例可以分别改变
+// 和--benchmark一起使用时相机路径和时间步长不变，每次只改变一个参数重复运行，就能测出renderer在这个维度上的扩展性，参数记录在benchmark的csv中
+// instancing：每个draw绘制全部实例，所以每个网格格子中都放着全部的mesh，画出的物体数是instances * meshes
+struct StressSceneSettings {
+    uint32_t instances = 1024;  // 网格格子的数量，网格尽量接近正方形
+    uint32_t meshes = 16;  // 不同的mesh，三角形数量从几十到几千
+    uint32_t textures = 8;  // 不同的纹理，为0时使用TEXTURE_PATH
+    uint32_t materials = 16;  // 纹理和baseColorFactor的不同组合，每个mesh一个材质，所以最多有meshes个
+    uint32_t lights = 1024;  // clustered lighting的光源数
+    float motion = 0.25f;  // 每帧旋转的实例的比例，0到1
+    uint32_t seed = 1;  // 同一个seed生成的场景相同
+
+    // stress scene："instances=4096,meshes=64,lights=256"，没有给出的参数保持默认值；名字或者值不对时返回false
+    bool parse(const std::string& text) {
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ',')) {
+            size_t equals = item.find('=');
+            if (equals == std::string::npos) {
+                return false;
+            }
+            std::string key = item.substr(0, equals);
+            std::string value = item.substr(equals + 1);
+            char* end = nullptr;
+            if (key == "motion") {
+                motion = std::strtof(value.c_str(), &end);
+                if (end == value.c_str() || *end != '\0' || !(motion >= 0.0f && motion <= 1.0f)) {
+                    return false;
+                }
+                continue;
+            }
+            unsigned long number = std::strtoul(value.c_str(), &end, 10);
+            if (end == value.c_str() || *end != '\0' || number > UINT32_MAX) {
+                return false;
+            }
+            uint32_t* field = key == "instances" ? &instances
+                : key == "meshes"                ? &meshes
+                : key == "textures"              ? &textures
+                : key == "materials"             ? &materials
+                : key == "lights"                ? &lights
+                : key == "seed"                  ? &seed
+                                                 : nullptr;
+            if (field == nullptr) {
+                return false;
+            }
+            *field = static_cast<uint32_t>(number);
+        }
+        return instances > 0 && meshes > 0 && materials > 0;
+    }
+
+    // benchmark：写进csv的参数，用空格分隔，不和csv的逗号冲突
+    std::string label() const {
+        std::ostringstream stream;
+        stream << "instances=" << instances << " meshes=" << meshes << " textures=" << textures << " materials=" << std::min(materials, meshes)
+               << " lights=" << lights << " motion=" << motion << " seed=" << seed;
+        return stream.str();
+    }
+};
+
+inline uint32_t stressHash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// stress scene：0到1之间的伪随机数，同样的参数总是得到同样的值
+inline float stressRandom(uint32_t seed, uint32_t index, uint32_t channel) {
+    return static_cast<float>(stressHash(seed * 0x9e3779b9u ^ stressHash(index * 16 + channel)) & 0xffffff) / static_cast<float>(0x1000000);
+}
+
+struct StressMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<uint16_t> indices;
+};
+
+// stress scene：平放在z = 0上的环面，放得进边长1的格子；环向8到64段、管向6到32段，最多2145个顶点，16位索引足够
+inline StressMesh generateStressMesh(uint32_t index, uint32_t seed) {
+    uint32_t rings = 8 + static_cast<uint32_t>(stressRandom(seed, index, 0) * 57.0f);
+    uint32_t sides = 6 + static_cast<uint32_t>(stressRandom(seed, index, 1) * 27.0f);
+    float tube = 0.08f + stressRandom(seed, index, 2) * 0.1f;
+    float radius = 0.45f - tube;
+    StressMesh mesh;
+    mesh.positions.reserve(static_cast<size_t>(rings + 1) * (sides + 1));
+    mesh.uvs.reserve(mesh.positions.capacity());
+    for (uint32_t ring = 0; ring <= rings; ring++) {
+        float u = static_cast<float>(ring) / rings;
+        float theta = u * 6.28318531f;
+        for (uint32_t side = 0; side <= sides; side++) {
+            float v = static_cast<float>(side) / sides;
+            float phi = v * 6.28318531f;
+            float distance = radius + tube * std::cos(phi);
+            mesh.positions.push_back(glm::vec3(distance * std::cos(theta), distance * std::sin(theta), tube * std::sin(phi)));
+            mesh.uvs.push_back(glm::vec2(u * 4.0f, v));
+        }
+    }
+    mesh.indices.reserve(static_cast<size_t>(rings) * sides * 6);
+    for (uint32_t ring = 0; ring < rings; ring++) {
+        for (uint32_t side = 0; side < sides; side++) {
+            uint16_t a = static_cast<uint16_t>(ring * (sides + 1) + side);
+            uint16_t b = static_cast<uint16_t>(a + sides + 1);
+            mesh.indices.insert(mesh.indices.end(), {a, b, static_cast<uint16_t>(a + 1), static_cast<uint16_t>(a + 1), b, static_cast<uint16_t>(b + 1)});
+        }
+    }
+    return mesh;
+}
+
+// stress scene：64x64的未压缩tga棋盘格，两种颜色由index决定；texture cache把它当作内存中的文件解码，和磁盘上的纹理走同一条路径
+inline std::vector<char> generateStressTexture(uint32_t index, uint32_t seed) {
+    const uint32_t size = 64;
+    const uint32_t checker = 8 << (index % 3);
+    std::vector<char> file(18 + size * size * 4, 0);
+    file[2] = 2;  // 未压缩的true color
+    file[12] = static_cast<char>(size & 0xff);
+    file[13] = static_cast<char>(size >> 8);
+    file[14] = static_cast<char>(size & 0xff);
+    file[15] = static_cast<char>(size >> 8);
+    file[16] = 32;
+    file[17] = 0x28;  // 8位alpha，原点在左上角
+    glm::vec3 colors[2];
+    for (uint32_t c = 0; c < 2; c++) {
+        colors[c] = glm::vec3(stressRandom(seed, index, 3 + c * 3), stressRandom(seed, index, 4 + c * 3), stressRandom(seed, index, 5 + c * 3));
+    }
+    for (uint32_t y = 0; y < size; y++) {
+        for (uint32_t x = 0; x < size; x++) {
+            const glm::vec3& color = colors[((x / checker) + (y / checker)) & 1];
+            char* pixel = &file[18 + (y * size + x) * 4];
+            pixel[0] = static_cast<char>(color.b * 255.0f);
+            pixel[1] = static_cast<char>(color.g * 255.0f);
+            pixel[2] = static_cast<char>(color.r * 255.0f);
+            pixel[3] = static_cast<char>(255);
+        }
+    }
+    return file;
+}
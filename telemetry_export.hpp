@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "memory_allocator.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// telemetry：显示节点上没有人看窗口标题，帧时间、gpu耗时、显存预算和上传队列以固定大小的二进制记录发布给外部的dashboard
+// 两种输出：shm:<name>写入posix共享内存段，dashboard映射同一个段随时读取最新的一条；unix:<path>向本地的datagram socket发送每一条记录
+// 发布不等待读者：共享内存用seqlock，socket是非阻塞的，没有读者或者缓冲区满时记录被丢弃，渲染线程不会被dashboard拖慢
+// 其它平台open返回false
+struct TelemetryScope {
+    char name[24];  // gpu profiler的scope名字，超出的部分截断，总是以0结尾
+    float avgMs;
+    float maxMs;
+};
+
+// telemetry：小端、没有padding的记录，字段改变时增加VERSION；dashboard按size跳过不认识的尾部
+struct TelemetryRecord {
+    static constexpr uint32_t MAGIC = 0x4d4c5456;  // "VTLM"
+    static constexpr uint16_t VERSION = 1;
+    static constexpr uint32_t MAX_SCOPES = 8;
+
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint64_t sequence;  // 发布的序号，dashboard用它发现丢失的datagram
+    uint64_t frame;
+    uint64_t timestampNs;  // system clock，不同节点的记录可以按时间对齐
+    // frame stats：最近FrameTimeStats::WINDOW帧的统计
+    float averageFps;
+    float p50Ms;
+    float p95Ms;
+    float p99Ms;
+    float maxMs;
+    float onePercentLowFps;
+    uint32_t hitches;
+    float gpuFrameMs;  // 最近读到的整帧gpu耗时，没有timestamp时为0
+    uint32_t scopeCount;
+    // upload：这一帧授权的拷贝数、等待授权的请求数和gpu还没有完成的上传batch数
+    uint32_t uploadCopies;
+    uint32_t uploadPending;
+    uint32_t uploadBatchesInFlight;
+    uint64_t uploadBytes;
+    // memory budget：device local堆的使用量和预算，budgetExtension为false时是估算值
+    uint64_t deviceLocalUsage;
+    uint64_t deviceLocalBudget;
+    uint64_t hostBytes;  // memory report：TRACK_HOST_ALLOCATIONS关闭时为0
+    uint64_t categoryBytes[static_cast<size_t>(MemoryCategory::count)];  // 按MemoryCategory的顺序
+    TelemetryScope scopes[MAX_SCOPES];
+};
+static_assert(sizeof(TelemetryRecord) == 112 + 8 * static_cast<size_t>(MemoryCategory::count) + TelemetryRecord::MAX_SCOPES * sizeof(TelemetryScope),
+    "TelemetryRecord is published as is and must not contain padding");
+
+class TelemetryExport {
+public:
+    // telemetry：共享内存段的布局，sequence为奇数时记录正在写入
+    // 读者：读取sequence（acquire），是奇数就重试；复制record；再读一次sequence，和第一次不同就重试
+    struct Segment {
+        std::atomic<uint32_t> sequence;
+        uint32_t reserved;
+        TelemetryRecord record;
+    };
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "the telemetry seqlock is shared with another process");
+
+    TelemetryExport() = default;
+    TelemetryExport(const TelemetryExport&) = delete;
+    TelemetryExport& operator=(const TelemetryExport&) = delete;
+    ~TelemetryExport() { close(); }
+
+    // telemetry：target是shm:<name>或者unix:<path>，格式不对或者创建失败时返回false
+    bool open(const std::string& target) {
+        close();
+#ifndef _WIN32
+        if (target.rfind("shm:", 0) == 0) {
+            return openSharedMemory(target.substr(4));
+        }
+        if (target.rfind("unix:", 0) == 0) {
+            return openSocket(target.substr(5));
+        }
+#endif
+        return false;
+    }
+
+    bool active() const { return m_segment != nullptr || m_socket >= 0; }
+
+    // telemetry：magic、version、size、sequence和timestamp在这里填写，其它字段由调用者填写
+    void publish(TelemetryRecord& record) {
+        if (!active()) {
+            return;
+        }
+        record.magic = TelemetryRecord::MAGIC;
+        record.version = TelemetryRecord::VERSION;
+        record.size = static_cast<uint16_t>(sizeof(TelemetryRecord));
+        record.sequence = m_sequence++;
+        record.timestampNs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+#ifndef _WIN32
+        if (m_segment) {
+            uint32_t sequence = m_segment->sequence.load(std::memory_order_relaxed);
+            m_segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(&m_segment->record, &record, sizeof(record));
+            m_segment->sequence.store(sequence + 2, std::memory_order_release);
+        } else {
+            // telemetry：没有读者（ENOENT、ECONNREFUSED）或者缓冲区满（EAGAIN）时丢弃这一条
+            sendto(m_socket, &record, sizeof(record), 0, reinterpret_cast<const sockaddr*>(&m_address), sizeof(m_address));
+        }
+#endif
+    }
+
+    void close() {
+#ifndef _WIN32
+        if (m_segment) {
+            munmap(m_segment, sizeof(Segment));
+            shm_unlink(m_name.c_str());  // telemetry：已经映射这个段的dashboard仍然可以读取最后一条记录
+            m_segment = nullptr;
+        }
+        if (m_socket >= 0) {
+            ::close(m_socket);
+            m_socket = -1;
+        }
+#endif
+    }
+
+private:
+#ifndef _WIN32
+    bool openSharedMemory(const std::string& name) {
+        m_name = name.empty() || name[0] != '/' ? "/" + name : name;
+        int fd = shm_open(m_name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        if (ftruncate(fd, sizeof(Segment)) != 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);  // 映射建立后可以关闭fd
+        if (mapped == MAP_FAILED) {
+            shm_unlink(m_name.c_str());
+            return false;
+        }
+        m_segment = new (mapped) Segment{};  // ftruncate之后的内容都是0，sequence从偶数开始
+        return true;
+    }
+
+    bool openSocket(const std::string& path) {
+        if (path.size() >= sizeof(m_address.sun_path)) {
+            return false;
+        }
+        m_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (m_socket < 0) {
+            return false;
+        }
+        fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL, 0) | O_NONBLOCK);
+        std::memset(&m_address, 0, sizeof(m_address));
+        m_address.sun_family = AF_UNIX;
+        std::memcpy(m_address.sun_path, path.c_str(), path.size());
+        return true;
+    }
+
+    sockaddr_un m_address{};
+#endif
+    Segment* m_segment = nullptr;
+    std::string m_name;
+    int m_socket = -1;
+    uint64_t m_sequence = 0;
+};
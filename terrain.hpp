@@ -0,0 +1,735 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "frustum_culling.hpp"
+#include "host_memory.hpp"
+#include "job_pool.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+
+// terrain：高度图文件的header；高度 = heightMin + 采样值 * heightScale，采样值是uint16
+struct TerrainFileHeader {
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t tilesPerSide = 0;  // 2的幂
+    uint32_t tileQuads = 0;  // 每个tile的边长，单位是采样间距
+    float spacing = 0.0f;  // 相邻采样的世界距离
+    float heightMin = 0.0f;
+    float heightScale = 0.0f;
+    uint32_t padding = 0;
+};
+
+// terrain：高度图文件，tilesPerSide²个tile，每个tile (tileQuads + 1)²个采样，相邻tile共享边上的一行
+// header之后是每个tile的高度范围（vec2）和overview，然后是按行排列的tile；overview每隔tilesPerSide个采样取一个，大小和一个tile相同
+// open只读取header、高度范围和overview，tile由readTile按需读取，可以在多个线程中同时调用
+class TerrainFile {
+public:
+    static constexpr uint32_t MAGIC = 0x4e525254;  // "TRRN"
+    static constexpr uint32_t VERSION = 1;
+
+    bool open(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        TerrainFileHeader header;
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || header.magic != MAGIC || header.version != VERSION || header.tilesPerSide == 0 || (header.tilesPerSide & (header.tilesPerSide - 1)) != 0
+            || header.tileQuads == 0 || header.tileQuads % header.tilesPerSide != 0) {
+            return false;
+        }
+        m_path = path;
+        m_header = header;
+        m_ranges.resize(tileCount());
+        m_overview.resize(tileSampleCount());
+        file.read(reinterpret_cast<char*>(m_ranges.data()), static_cast<std::streamsize>(m_ranges.size() * sizeof(glm::vec2)));
+        file.read(reinterpret_cast<char*>(m_overview.data()), static_cast<std::streamsize>(tileBytes()));
+        return static_cast<bool>(file);
+    }
+
+    const TerrainFileHeader& header() const { return m_header; }
+    uint32_t tileCount() const { return m_header.tilesPerSide * m_header.tilesPerSide; }
+    uint32_t tileSampleCount() const { return (m_header.tileQuads + 1) * (m_header.tileQuads + 1); }
+    size_t tileBytes() const { return size_t(tileSampleCount()) * sizeof(uint16_t); }
+    const std::vector<glm::vec2>& ranges() const { return m_ranges; }
+    const std::vector<uint16_t>& overview() const { return m_overview; }
+
+    bool readTile(uint32_t tile, uint16_t* samples) const {
+        std::ifstream file(m_path, std::ios::binary);
+        if (!file.is_open() || tile >= tileCount()) {
+            return false;
+        }
+        file.seekg(static_cast<std::streamoff>(tilesOffset() + tile * tileBytes()));
+        file.read(reinterpret_cast<char*>(samples), static_cast<std::streamsize>(tileBytes()));
+        return static_cast<bool>(file);
+    }
+
+    // terrain：程序化地形，value noise的fBm，半径flatRadius之内压平到最低处附近，外面逐渐恢复起伏；地形的中心在原点
+    static bool generate(const std::string& path, uint32_t tilesPerSide, uint32_t tileQuads, float spacing, float amplitude, float flatRadius, uint32_t seed) {
+        uint32_t samples = tilesPerSide * tileQuads + 1;
+        std::vector<float> heights(size_t(samples) * samples);
+        float center = float(samples - 1) * 0.5f;
+        float heightMin = 1e30f;
+        float heightMax = -1e30f;
+        for (uint32_t y = 0; y < samples; y++) {
+            for (uint32_t x = 0; x < samples; x++) {
+                glm::vec2 world = (glm::vec2(float(x), float(y)) - center) * spacing;
+                float height = 0.0f;
+                float frequency = 0.15f;
+                float weight = 1.0f;
+                for (uint32_t octave = 0; octave < 7; octave++) {
+                    height += valueNoise(world * frequency, seed + octave) * weight;
+                    frequency *= 2.0f;
+                    weight *= 0.5f;
+                }
+                float flatten = glm::smoothstep(flatRadius, flatRadius * 2.0f, glm::length(world));
+                height = height * amplitude * flatten;
+                heights[size_t(y) * samples + x] = height;
+                heightMin = std::min(heightMin, height);
+                heightMax = std::max(heightMax, height);
+            }
+        }
+
+        TerrainFileHeader header;
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.tilesPerSide = tilesPerSide;
+        header.tileQuads = tileQuads;
+        header.spacing = spacing;
+        header.heightMin = heightMin;
+        header.heightScale = std::max(heightMax - heightMin, 1e-6f) / 65535.0f;
+        std::vector<uint16_t> quantized(heights.size());
+        for (size_t i = 0; i < heights.size(); i++) {
+            quantized[i] = static_cast<uint16_t>(std::lround((heights[i] - heightMin) / header.heightScale));
+        }
+
+        uint32_t tileSamples = tileQuads + 1;
+        std::vector<glm::vec2> ranges(size_t(tilesPerSide) * tilesPerSide);
+        std::vector<uint16_t> overview(size_t(tileSamples) * tileSamples);
+        std::vector<uint16_t> tiles(ranges.size() * overview.size());
+        for (uint32_t tile = 0; tile < ranges.size(); tile++) {
+            uint32_t firstX = (tile % tilesPerSide) * tileQuads;
+            uint32_t firstY = (tile / tilesPerSide) * tileQuads;
+            uint16_t low = 0xffff;
+            uint16_t high = 0;
+            for (uint32_t y = 0; y < tileSamples; y++) {
+                for (uint32_t x = 0; x < tileSamples; x++) {
+                    uint16_t value = quantized[size_t(firstY + y) * samples + firstX + x];
+                    tiles[size_t(tile) * overview.size() + y * tileSamples + x] = value;
+                    low = std::min(low, value);
+                    high = std::max(high, value);
+                }
+            }
+            ranges[tile] = glm::vec2(heightMin + low * header.heightScale, heightMin + high * header.heightScale);
+        }
+        for (uint32_t y = 0; y < tileSamples; y++) {
+            for (uint32_t x = 0; x < tileSamples; x++) {
+                overview[size_t(y) * tileSamples + x] = quantized[size_t(y * tilesPerSide) * samples + x * tilesPerSide];
+            }
+        }
+
+        std::string tempPath = path + ".tmp";
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(ranges.data()), static_cast<std::streamsize>(ranges.size() * sizeof(glm::vec2)));
+        file.write(reinterpret_cast<const char*>(overview.data()), static_cast<std::streamsize>(overview.size() * sizeof(uint16_t)));
+        file.write(reinterpret_cast<const char*>(tiles.data()), static_cast<std::streamsize>(tiles.size() * sizeof(uint16_t)));
+        file.close();
+        if (!file) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        std::remove(path.c_str());  // 有些平台上rename不会覆盖已有文件
+        return std::rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    size_t tilesOffset() const { return sizeof(TerrainFileHeader) + m_ranges.size() * sizeof(glm::vec2) + tileBytes(); }
+
+    static float lattice(int32_t x, int32_t y, uint32_t seed) {
+        uint32_t h = static_cast<uint32_t>(x) * 0x8da6b343u ^ static_cast<uint32_t>(y) * 0xd8163841u ^ seed * 0xcb1ab31fu;
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        return float(h & 0xffffff) / 8388607.5f - 1.0f;
+    }
+
+    // terrain：[-1, 1]之间的value noise，格点之间用smoothstep插值
+    static float valueNoise(glm::vec2 p, uint32_t seed) {
+        glm::vec2 cell = glm::floor(p);
+        glm::vec2 f = p - cell;
+        glm::vec2 t = f * f * (3.0f - 2.0f * f);
+        int32_t x = static_cast<int32_t>(cell.x);
+        int32_t y = static_cast<int32_t>(cell.y);
+        float a = glm::mix(lattice(x, y, seed), lattice(x + 1, y, seed), t.x);
+        float b = glm::mix(lattice(x, y + 1, seed), lattice(x + 1, y + 1, seed), t.x);
+        return glm::mix(a, b, t.y);
+    }
+
+    std::string m_path;
+    TerrainFileHeader m_header;
+    std::vector<glm::vec2> m_ranges;
+    std::vector<uint16_t> m_overview;
+};
+
+// terrain：CDLOD四叉树地形；每帧在compute shader中从根节点逐级向下选择，节点和level l的范围（lodRange * 2^l的球）相交时分成四个子节点
+// 否则整个节点作为一个PATCH_QUADS²的patch绘制；最高level范围之外的节点和视锥之外的节点直接丢弃，所以patch数量只取决于范围，和地形大小无关
+// 所有patch共用一份索引，顶点的位置由gl_VertexIndex和patch的起点、level得到，顶点着色器在靠近范围边界时把奇数顶点morph到上一级的网格，相邻level之间没有裂缝
+// 高度按tile从文件流式读取：相机附近的tile在job pool中读取，每帧最多上传uploadsPerFrame个到高度buffer的LRU缓存；slot 0是overview，不在缓存中的tile使用它
+// 顶点间距不小于overview采样间距的level只读取overview，和tile的采样在这些格点上完全相同
+// 所有节点、patch和draw参数只有一份，和ParticleSystem一样，开头的barrier等待上一帧的draw读完
+class TerrainRenderer {
+public:
+    static constexpr uint32_t PATCH_QUADS = 16;  // 和terrain_cull.comp、terrain.vert一致
+    static constexpr uint32_t WORKGROUP_SIZE = 64;  // 和terrain_cull.comp的local_size_x一致
+    static constexpr uint32_t READS_IN_FLIGHT = 8;  // 同时在job pool中读取的tile数量
+
+    // terrain：origin是地形中心的世界位置；levels个level，level l的顶点间距是2^l个采样
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache, const SpirvCode& cullCode, VkCommandPool commandPool, JobPool& jobPool,
+        TerrainFile&& file, uint32_t frameCount, const glm::vec3& origin, float lodRange, uint32_t levels, uint32_t cacheTiles, uint32_t uploadsPerFrame,
+        uint32_t maxPatches) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_commandPool = commandPool;
+        m_jobPool = &jobPool;
+        m_file = std::move(file);
+        m_lodRange = lodRange;
+        m_levels = std::max(levels, 1u);
+        m_uploadsPerFrame = std::max(uploadsPerFrame, 1u);
+        m_maxPatches = maxPatches;
+
+        const TerrainFileHeader& header = m_file.header();
+        uint32_t totalQuads = header.tilesPerSide * header.tileQuads;
+        float extent = float(totalQuads) * header.spacing;
+        m_origin = origin - glm::vec3(extent * 0.5f, extent * 0.5f, 0.0f);
+        m_rootsPerSide = (totalQuads + (PATCH_QUADS << (m_levels - 1)) - 1) / (PATCH_QUADS << (m_levels - 1));
+        m_overviewLevel = 0;
+        while ((1u << m_overviewLevel) < header.tilesPerSide) {
+            m_overviewLevel++;
+        }
+        // terrain：读取tile的level最远在上一级的范围附近，再加一个tile的对角线
+        float tileDiagonal = float(header.tileQuads) * header.spacing * 1.5f;
+        m_streamRadius = m_overviewLevel == 0 ? 0.0f : lodRange * float(1u << m_overviewLevel) + tileDiagonal;
+        m_tileWords = (m_file.tileSampleCount() + 1) / 2;
+
+        createPipeline(pipelineCache, cullCode);
+
+        VkBufferUsageFlags storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        m_nodes = createBuffer(VkDeviceSize(maxPatches) * sizeof(glm::uvec2) * 2, storage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "terrain nodes");
+        m_state = createBuffer(sizeof(State), storage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "terrain state");
+        m_patches = createBuffer(VkDeviceSize(maxPatches) * sizeof(glm::uvec4), storage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "terrain patches");
+        m_heights = createBuffer(VkDeviceSize(cacheTiles + 1) * m_tileWords * sizeof(uint32_t), storage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "terrain heights");
+        m_ranges = createBuffer(m_file.ranges().size() * sizeof(glm::vec2), storage, host, "terrain tile ranges");
+        memcpy(m_ranges.allocation.mapped, m_file.ranges().data(), m_file.ranges().size() * sizeof(glm::vec2));
+
+        // terrain：patch的索引，(PATCH_QUADS + 1)²个顶点在uint16之内
+        std::vector<uint16_t> indices;
+        for (uint32_t y = 0; y < PATCH_QUADS; y++) {
+            for (uint32_t x = 0; x < PATCH_QUADS; x++) {
+                uint16_t corner = static_cast<uint16_t>(y * (PATCH_QUADS + 1) + x);
+                uint16_t above = static_cast<uint16_t>(corner + PATCH_QUADS + 1);
+                indices.insert(indices.end(), {corner, static_cast<uint16_t>(corner + 1), static_cast<uint16_t>(above + 1), corner, static_cast<uint16_t>(above + 1), above});
+            }
+        }
+        m_indices = createBuffer(indices.size() * sizeof(uint16_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, host, "terrain patch indices");
+        memcpy(m_indices.allocation.mapped, indices.data(), indices.size() * sizeof(uint16_t));
+
+        m_tileSlots.assign(m_file.tileCount(), 0);
+        m_tileStates.assign(m_file.tileCount(), TileState::absent);
+        m_slotTiles.assign(cacheTiles + 1, NO_TILE);
+        m_slotLastUsed.assign(cacheTiles + 1, 0);
+        for (uint32_t slot = cacheTiles; slot > 0; slot--) {
+            m_freeSlots.push_back(slot);
+        }
+        m_overviewUploaded = false;
+
+        m_frameData.resize(frameCount);
+        for (Frame& frame : m_frameData) {
+            frame.data = createBuffer(sizeof(FrameHeader) + m_file.tileCount() * sizeof(uint32_t), storage, host, "terrain frame data");
+            frame.staging = createBuffer(VkDeviceSize(m_uploadsPerFrame) * m_file.tileBytes(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, host, "terrain tile staging");
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNT * frameCount};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = frameCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create terrain descriptor pool!");
+        }
+        std::vector<VkDescriptorSetLayout> setLayouts(frameCount, m_descriptorSetLayout);
+        std::vector<VkDescriptorSet> sets(frameCount);
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = m_descriptorPool;
+        setInfo.descriptorSetCount = frameCount;
+        setInfo.pSetLayouts = setLayouts.data();
+        if (vkAllocateDescriptorSets(m_device, &setInfo, sets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate terrain descriptor sets!");
+        }
+        for (uint32_t i = 0; i < frameCount; i++) {
+            Frame& frame = m_frameData[i];
+            frame.descriptorSet = sets[i];
+            std::array<VkDescriptorBufferInfo, BINDING_COUNT> bufferInfos = {{{m_nodes.buffer, 0, VK_WHOLE_SIZE}, {m_state.buffer, 0, VK_WHOLE_SIZE},
+                {m_patches.buffer, 0, VK_WHOLE_SIZE}, {m_heights.buffer, 0, VK_WHOLE_SIZE}, {m_ranges.buffer, 0, VK_WHOLE_SIZE}, {frame.data.buffer, 0, VK_WHOLE_SIZE}}};
+            std::array<VkWriteDescriptorSet, BINDING_COUNT> writes{};
+            for (uint32_t binding = 0; binding < writes.size(); binding++) {
+                writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[binding].dstSet = frame.descriptorSet;
+                writes[binding].dstBinding = binding;
+                writes[binding].descriptorCount = 1;
+                writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                writes[binding].pBufferInfo = &bufferInfos[binding];
+            }
+            vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+        }
+
+        std::vector<VkCommandBuffer> commandBuffers(frameCount);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = frameCount;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate terrain command buffers!");
+        }
+        for (uint32_t i = 0; i < frameCount; i++) {
+            m_frameData[i].commandBuffer = commandBuffers[i];
+        }
+    }
+
+    // terrain：调用者保证gpu已经空闲；先等待还在读取的tile，job会写入m_completed
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        m_jobPool->wait(m_readCounter);
+        m_completed.clear();
+        for (Frame& frame : m_frameData) {
+            vkFreeCommandBuffers(m_device, m_commandPool, 1, &frame.commandBuffer);
+            destroyBuffer(frame.data);
+            destroyBuffer(frame.staging);
+        }
+        m_frameData.clear();
+        for (Buffer* buffer : {&m_nodes, &m_state, &m_patches, &m_heights, &m_ranges, &m_indices}) {
+            destroyBuffer(*buffer);
+        }
+        m_freeSlots.clear();
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+    // terrain：绘制的pipeline使用这个layout，set 0是每个frame in flight的descriptor set，和compute剔除共享
+    VkPipelineLayout pipelineLayout() const { return m_pipelineLayout; }
+    uint32_t residentTiles() const { return static_cast<uint32_t>(m_slotTiles.size() - 1 - m_freeSlots.size()); }
+
+    // terrain：请求相机附近的tile，上传读取完成的tile，写入这一帧的参数并录制四叉树选择；sunDirection指向太阳
+    // 调用者保证这个frame in flight上一次的提交已经完成，command buffer、staging和参数buffer可以重新写入
+    VkCommandBuffer record(uint32_t frameIndex, const glm::mat4& viewProj, const glm::vec3& cameraPosition, const glm::vec3& sunDirection) {
+        Frame& frame = m_frameData[frameIndex];
+        m_frameNumber++;
+        requestTiles(cameraPosition);
+
+        VkCommandBuffer commandBuffer = frame.commandBuffer;
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording terrain command buffer!");
+        }
+        uploadTiles(commandBuffer, frame);
+
+        FrameHeader* data = static_cast<FrameHeader*>(frame.data.allocation.mapped);
+        const TerrainFileHeader& header = m_file.header();
+        data->viewProj = viewProj;
+        std::array<glm::vec4, 6> planes = FrustumCuller::extractPlanes(viewProj);
+        std::copy(planes.begin(), planes.end(), data->planes);
+        data->camera = glm::vec4(cameraPosition, m_lodRange);
+        data->origin = glm::vec4(m_origin, header.spacing);
+        data->heights = glm::vec4(header.heightMin, header.heightScale, 0.0f, 0.0f);
+        data->sun = glm::vec4(sunDirection, 0.0f);
+        data->grid = glm::uvec4(header.tilesPerSide, header.tileQuads, m_overviewLevel, m_levels - 1);
+        data->limits = glm::uvec4(m_tileWords, m_maxPatches, m_maxPatches, m_rootsPerSide);
+        memcpy(data + 1, m_tileSlots.data(), m_tileSlots.size() * sizeof(uint32_t));
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &frame.descriptorSet, 0, nullptr);
+        // terrain：上一帧的draw读完patch和draw参数之后才能改写
+        barrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+        dispatch(commandBuffer, PASS_RESET, 0, 0, 1);
+        computeBarrier(commandBuffer);
+        // terrain：根节点由线程编号得到，子节点写进列表0；之后每一级读取上一级写入的列表，线程数由FINISH写入
+        uint32_t list = 1;
+        for (uint32_t level = m_levels; level > 0; level--) {
+            if (level == m_levels) {
+                dispatch(commandBuffer, PASS_SELECT, level - 1, list, groups(m_rootsPerSide * m_rootsPerSide));
+            } else {
+                dispatchIndirect(commandBuffer, PASS_SELECT, level - 1, list);
+            }
+            computeBarrier(commandBuffer);
+            dispatch(commandBuffer, PASS_FINISH, level - 1, list, 1);
+            barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+            list ^= 1;
+        }
+        barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record terrain command buffer!");
+        }
+        return commandBuffer;
+    }
+
+    // terrain：调用之前已经开始了场景的render pass；pipeline使用pipelineLayout()，绑定的set和索引会覆盖场景的绑定
+    // 录制的命令和相机、patch数量无关，参数在这一帧的buffer中，instanceCount由gpu写入，command cache可以一直复用
+    void draw(VkCommandBuffer commandBuffer, uint32_t frameIndex, VkPipeline pipeline, VkExtent2D extent) const {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        VkViewport viewport{0.0f, 0.0f, float(extent.width), float(extent.height), 0.0f, 1.0f};
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        VkRect2D scissor{{0, 0}, extent};
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_frameData[frameIndex].descriptorSet, 0, nullptr);
+        vkCmdBindIndexBuffer(commandBuffer, m_indices.buffer, 0, VK_INDEX_TYPE_UINT16);
+        vkCmdDrawIndexedIndirect(commandBuffer, m_state.buffer, offsetof(State, draw), 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+private:
+    static constexpr uint32_t BINDING_COUNT = 6;
+    static constexpr uint32_t NO_TILE = ~0u;
+    // terrain：和terrain_cull.comp中的pass编号一致
+    static constexpr uint32_t PASS_RESET = 0;
+    static constexpr uint32_t PASS_SELECT = 1;
+    static constexpr uint32_t PASS_FINISH = 2;
+
+    enum class TileState : uint8_t {
+        absent,
+        requested,
+        resident,
+        failed,  // 读取失败的tile一直使用overview
+    };
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+    };
+
+    // terrain：和terrain_cull.comp的State一致，dispatch和draw直接作为indirect参数
+    struct State {
+        uint32_t listCount[2];
+        uint32_t patchCount;
+        uint32_t padding;
+        VkDispatchIndirectCommand dispatch;
+        uint32_t padding2;
+        VkDrawIndexedIndirectCommand draw;
+    };
+
+    // terrain：和shader中的Frame一致，后面紧接着每个tile在高度缓存中的slot，0表示使用overview
+    struct FrameHeader {
+        glm::mat4 viewProj;
+        glm::vec4 planes[6];
+        glm::vec4 camera;  // w是level 0的范围
+        glm::vec4 origin;  // 地形最小角的世界位置，w是采样间距
+        glm::vec4 heights;  // heightMin和heightScale
+        glm::vec4 sun;
+        glm::uvec4 grid;  // tilesPerSide、tileQuads、overview的level、最高level
+        glm::uvec4 limits;  // 每个tile的uint数量、patch上限、节点列表容量、每边的根节点数量
+    };
+
+    struct Frame {
+        Buffer data;
+        Buffer staging;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    };
+
+    struct LoadedTile {
+        uint32_t tile = 0;
+        bool ok = false;
+        std::vector<uint16_t> samples;
+    };
+
+    static uint32_t groups(uint32_t count) { return (count + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE; }
+
+    // terrain：范围之内的tile标记为这一帧使用过，没有读取的按距离从近到远提交读取，同时在读取的数量不超过READS_IN_FLIGHT
+    void requestTiles(const glm::vec3& cameraPosition) {
+        const TerrainFileHeader& header = m_file.header();
+        float tileSize = float(header.tileQuads) * header.spacing;
+        m_wanted.clear();
+        for (uint32_t tile = 0; tile < m_file.tileCount(); tile++) {
+            glm::vec2 range = m_file.ranges()[tile];
+            glm::vec3 boundsMin = m_origin + glm::vec3(float(tile % header.tilesPerSide) * tileSize, float(tile / header.tilesPerSide) * tileSize, range.x);
+            glm::vec3 boundsMax = boundsMin + glm::vec3(tileSize, tileSize, range.y - range.x);
+            float distance = glm::length(glm::clamp(cameraPosition, boundsMin, boundsMax) - cameraPosition);
+            if (distance >= m_streamRadius) {
+                continue;
+            }
+            if (m_tileStates[tile] == TileState::resident) {
+                m_slotLastUsed[m_tileSlots[tile]] = m_frameNumber;
+            } else if (m_tileStates[tile] == TileState::absent) {
+                m_wanted.push_back({distance, tile});
+            }
+        }
+        std::sort(m_wanted.begin(), m_wanted.end());
+        for (const std::pair<float, uint32_t>& wanted : m_wanted) {
+            if (m_readsInFlight >= READS_IN_FLIGHT) {
+                break;
+            }
+            uint32_t tile = wanted.second;
+            m_tileStates[tile] = TileState::requested;
+            m_readsInFlight++;
+            m_jobPool->submit([this, tile]() {
+                LoadedTile loaded;
+                loaded.tile = tile;
+                loaded.samples.resize(m_file.tileSampleCount());
+                loaded.ok = m_file.readTile(tile, loaded.samples.data());
+                std::lock_guard<std::mutex> lock(m_completedMutex);
+                m_completed.push_back(std::move(loaded));
+            }, &m_readCounter);
+        }
+    }
+
+    // terrain：第一帧上传overview，之后每帧最多uploadsPerFrame个读取完成的tile；缓存满时替换这一帧没有用到的最久未使用的tile
+    // 被替换的slot可能还在被之前的帧读取，开头的barrier等待之前提交的顶点着色器；这一帧的tile表在上传之后写入，之前的帧仍然使用自己的表
+    void uploadTiles(VkCommandBuffer commandBuffer, Frame& frame) {
+        std::vector<LoadedTile> loaded;
+        {
+            std::lock_guard<std::mutex> lock(m_completedMutex);
+            uint32_t count = std::min<uint32_t>(static_cast<uint32_t>(m_completed.size()), m_uploadsPerFrame - (m_overviewUploaded ? 0 : 1));
+            loaded.assign(std::make_move_iterator(m_completed.begin()), std::make_move_iterator(m_completed.begin() + count));
+            m_completed.erase(m_completed.begin(), m_completed.begin() + count);
+        }
+        if (loaded.empty() && m_overviewUploaded) {
+            return;
+        }
+
+        std::vector<VkBufferCopy> copies;
+        auto stage = [&](const uint16_t* samples, uint32_t slot) {
+            VkDeviceSize offset = VkDeviceSize(copies.size()) * m_file.tileBytes();
+            memcpy(static_cast<char*>(frame.staging.allocation.mapped) + offset, samples, m_file.tileBytes());
+            copies.push_back({offset, VkDeviceSize(slot) * m_tileWords * sizeof(uint32_t), m_file.tileBytes()});
+        };
+        if (!m_overviewUploaded) {
+            stage(m_file.overview().data(), 0);
+            m_overviewUploaded = true;
+        }
+        for (LoadedTile& tile : loaded) {
+            m_readsInFlight--;
+            if (!tile.ok) {
+                m_tileStates[tile.tile] = TileState::failed;
+                continue;
+            }
+            uint32_t slot = allocateSlot();
+            if (slot == 0) {  // terrain：缓存中的tile这一帧都在使用，之后重新读取
+                m_tileStates[tile.tile] = TileState::absent;
+                continue;
+            }
+            stage(tile.samples.data(), slot);
+            m_slotTiles[slot] = tile.tile;
+            m_slotLastUsed[slot] = m_frameNumber;
+            m_tileSlots[tile.tile] = slot;
+            m_tileStates[tile.tile] = TileState::resident;
+        }
+        if (copies.empty()) {
+            return;
+        }
+        barrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+        vkCmdCopyBuffer(commandBuffer, frame.staging.buffer, m_heights.buffer, static_cast<uint32_t>(copies.size()), copies.data());
+        barrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    // terrain：返回0表示没有可以替换的slot
+    uint32_t allocateSlot() {
+        if (!m_freeSlots.empty()) {
+            uint32_t slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+            return slot;
+        }
+        uint32_t oldest = 0;
+        for (uint32_t slot = 1; slot < m_slotTiles.size(); slot++) {
+            if (m_slotLastUsed[slot] < m_frameNumber && (oldest == 0 || m_slotLastUsed[slot] < m_slotLastUsed[oldest])) {
+                oldest = slot;
+            }
+        }
+        if (oldest != 0) {
+            uint32_t evicted = m_slotTiles[oldest];
+            m_tileSlots[evicted] = 0;
+            m_tileStates[evicted] = TileState::absent;
+        }
+        return oldest;
+    }
+
+    void dispatch(VkCommandBuffer commandBuffer, uint32_t pass, uint32_t level, uint32_t list, uint32_t groupCount) {
+        glm::uvec4 control(pass, level, list, 0);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(control), &control);
+        vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+    }
+
+    // terrain：线程数是上一次FINISH写入的节点数量
+    void dispatchIndirect(VkCommandBuffer commandBuffer, uint32_t pass, uint32_t level, uint32_t list) {
+        glm::uvec4 control(pass, level, list, 0);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(control), &control);
+        vkCmdDispatchIndirect(commandBuffer, m_state.buffer, offsetof(State, dispatch));
+    }
+
+    static void barrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = srcAccess;
+        memoryBarrier.dstAccessMask = dstAccess;
+        vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    static void computeBarrier(VkCommandBuffer commandBuffer) {
+        barrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, BINDING_COUNT> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create terrain descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(glm::uvec4);
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create terrain pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create terrain shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create terrain compute pipeline!");
+        }
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, const char* name) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create terrain buffer!");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        MemoryCategory category = (usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) != 0 ? MemoryCategory::staging : MemoryCategory::geometry;
+        buffer.allocation = m_allocator->allocate(memRequirements, properties, true, category, 0, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+        return buffer;
+    }
+
+    void destroyBuffer(Buffer& buffer) {
+        vkDestroyBuffer(m_device, buffer.buffer, hostAllocator());
+        m_allocator->free(buffer.allocation);
+        buffer = {};
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    JobPool* m_jobPool = nullptr;
+    TerrainFile m_file;
+    glm::vec3 m_origin{0.0f};  // 地形最小角
+    float m_lodRange = 1.0f;
+    float m_streamRadius = 0.0f;
+    uint32_t m_levels = 1;
+    uint32_t m_overviewLevel = 0;  // 顶点间距达到overview采样间距的第一个level
+    uint32_t m_rootsPerSide = 1;
+    uint32_t m_tileWords = 0;
+    uint32_t m_uploadsPerFrame = 1;
+    uint32_t m_maxPatches = 0;
+    uint64_t m_frameNumber = 0;
+    bool m_overviewUploaded = false;
+    // terrain：tile和高度缓存slot的双向映射，slot 0是overview
+    std::vector<uint32_t> m_tileSlots;
+    std::vector<TileState> m_tileStates;
+    std::vector<uint32_t> m_slotTiles;
+    std::vector<uint64_t> m_slotLastUsed;
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<std::pair<float, uint32_t>> m_wanted;
+    uint32_t m_readsInFlight = 0;
+    JobPool::Counter m_readCounter;
+    std::mutex m_completedMutex;
+    std::vector<LoadedTile> m_completed;
+    Buffer m_nodes;
+    Buffer m_state;
+    Buffer m_patches;
+    Buffer m_heights;
+    Buffer m_ranges;
+    Buffer m_indices;
+    std::vector<Frame> m_frameData;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+};
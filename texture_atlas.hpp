@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// texture atlas：小纹理（贴花、ui、细节贴图）各自创建image和view浪费分配和descriptor
+// 导入时把同格式的小纹理打包进一张大图，每张小纹理只记录uv的缩放和偏移
+struct AtlasRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+// texture atlas：shelf packing，按行从左到右放置，放不下时另起一行，行高是这一行最高的纹理
+// 输入按高度从大到小排序时浪费最少；每个矩形四周留padding，避免过滤和低级mip采样到相邻纹理
+class ShelfPacker {
+public:
+    void init(uint32_t size, uint32_t padding) {
+        m_size = size;
+        m_padding = padding;
+        m_shelfX = 0;
+        m_shelfY = 0;
+        m_shelfHeight = 0;
+    }
+
+    bool pack(uint32_t width, uint32_t height, AtlasRect& rect) {
+        uint32_t paddedWidth = width + 2 * m_padding;
+        uint32_t paddedHeight = height + 2 * m_padding;
+        if (paddedWidth > m_size || paddedHeight > m_size) {
+            return false;
+        }
+
+        if (m_shelfX + paddedWidth > m_size) {  // 这一行放不下，另起一行
+            m_shelfY += m_shelfHeight;
+            m_shelfX = 0;
+            m_shelfHeight = 0;
+        }
+        if (m_shelfY + paddedHeight > m_size) {
+            return false;
+        }
+
+        rect = {m_shelfX + m_padding, m_shelfY + m_padding, width, height};
+        m_shelfX += paddedWidth;
+        m_shelfHeight = std::max(m_shelfHeight, paddedHeight);
+        return true;
+    }
+
+    bool empty() const { return m_shelfX == 0 && m_shelfY == 0; }
+
+private:
+    uint32_t m_size = 0;
+    uint32_t m_padding = 0;
+    uint32_t m_shelfX = 0;
+    uint32_t m_shelfY = 0;
+    uint32_t m_shelfHeight = 0;
+};
+
+// texture atlas：把rgba8像素拷贝到atlas的rect中，边缘像素向padding区域延伸，相当于clamp to edge
+inline void blitToAtlas(const uint8_t* src, uint8_t* atlas, uint32_t atlasSize, const AtlasRect& rect, uint32_t padding) {
+    const uint32_t texelSize = 4;
+    for (uint32_t y = 0; y < rect.height + 2 * padding; y++) {
+        uint32_t srcY = std::min(y > padding ? y - padding : 0, rect.height - 1);
+        uint8_t* dstRow = atlas + (static_cast<size_t>(rect.y - padding + y) * atlasSize + (rect.x - padding)) * texelSize;
+        const uint8_t* srcRow = src + static_cast<size_t>(srcY) * rect.width * texelSize;
+
+        for (uint32_t x = 0; x < padding; x++) {
+            memcpy(dstRow + x * texelSize, srcRow, texelSize);
+            memcpy(dstRow + (padding + rect.width + x) * texelSize, srcRow + (rect.width - 1) * texelSize, texelSize);
+        }
+        memcpy(dstRow + padding * texelSize, srcRow, static_cast<size_t>(rect.width) * texelSize);
+    }
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "asset_pack.hpp"
+#include "async_io.hpp"
+#include "mapped_file.hpp"
+#include "memory_allocator.hpp"
+#include "deletion_queue.hpp"
+#include "slot_map.hpp"
+
+// texture cache：纹理的gpu资源，image view只包含已经常驻的mip
+struct Texture {
+    VkImage image = VK_NULL_HANDLE;
+    Allocation allocation{};
+    VkImageView view = VK_NULL_HANDLE;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t mipLevels = 1;
+    uint32_t residentLevel = 0;  // texture streaming：view的baseMipLevel
+    uint32_t bindlessIndex = UINT32_MAX;  // bindless：view在纹理数组中的index
+    uint32_t atlasPage = UINT32_MAX;  // texture atlas：打包进atlas时image和view属于这个page
+    float uvScale[2] = {1.0f, 1.0f};  // texture atlas：纹理在page中的区域
+    float uvOffset[2] = {0.0f, 0.0f};
+};
+
+// slot map：generational handle，释放之后旧的handle再使用会抛出异常，不会读到复用这个slot的另一张纹理
+using TextureHandle = uint32_t;
+const TextureHandle INVALID_TEXTURE_HANDLE = UINT32_MAX;
+
+// texture cache：按路径和文件内容hash去重，多个模型共享同一张纹理时只解码和上传一次
+// 路径相同直接命中；路径不同但内容相同（比如拷贝到不同目录的同一张图）也会命中，并记录为这个纹理的别名
+// 引用计数归零时销毁交给deletion queue，等使用它的帧完成后再释放
+class TextureCache {
+public:
+    // texture cache：没有命中的纹理，fileData是path的文件内容；mapped file：没有reader时是文件的映射，解码直接读取映射的内存
+    struct LoadRequest {
+        TextureHandle handle;
+        std::string path;
+        FileBytes fileData;
+    };
+
+    // loader：解码并上传一批纹理，返回的texture和requests一一对应，一批纹理可以并行解码；destroyer：销毁纹理的vulkan对象
+    using Loader = std::function<std::vector<Texture>(const std::vector<LoadRequest>& requests)>;
+    using Destroyer = std::function<void(const Texture&)>;
+
+    // async io：reader不为空时一批中所有要读取的文件先一起提交，读取和前面文件的hash、后面的解码上传重叠
+    // mapped file：reader为空时一批中所有的文件先映射并prefetch，内核的预读代替异步读取，内容不复制到堆上
+    void init(DeletionQueue& deletionQueue, Loader loader, Destroyer destroyer, AsyncFileReader* reader = nullptr) {
+        m_deletionQueue = &deletionQueue;
+        m_loader = std::move(loader);
+        m_destroyer = std::move(destroyer);
+        m_reader = reader;
+    }
+
+    // texture cache：已经加载过时增加引用计数，否则读取文件、计算hash，hash也没有命中才调用loader
+    TextureHandle acquire(const std::string& path) {
+        return acquire(std::vector<std::string>{path})[0];
+    }
+
+    // texture cache：一次获取多张纹理，所有没有命中的纹理交给loader一起加载
+    // 同一批中重复的路径或内容只加载一次
+    std::vector<TextureHandle> acquire(const std::vector<std::string>& paths) {
+        return acquire(paths, std::vector<std::vector<char>>(paths.size()));
+    }
+
+    // texture cache：fileData不为空时直接使用，不读取文件，比如gltf中嵌入的图片，path只作为去重的key
+    std::vector<TextureHandle> acquire(const std::vector<std::string>& paths, std::vector<std::vector<char>> fileDatas) {
+        std::vector<TextureHandle> handles;
+        std::vector<LoadRequest> requests;
+        PendingReads pending;
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (fileDatas[i].empty() && m_byPath.count(paths[i]) == 0 && pending.ids.count(paths[i]) == 0 && pending.mapped.count(paths[i]) == 0
+                && !AssetPack::instance().contains(paths[i])) {  // asset pack：pack中的文件不需要读取
+                if (m_reader != nullptr) {
+                    pending.ids[paths[i]] = m_reader->read(paths[i]);
+                } else {
+                    MappedFile file;
+                    if (file.open(paths[i])) {
+                        file.prefetch();
+                        pending.mapped.emplace(paths[i], std::move(file));
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < paths.size(); i++) {
+            const std::string& path = paths[i];
+            auto byPath = m_byPath.find(path);
+            if (byPath != m_byPath.end()) {
+                m_entries.get(byPath->second).refCount++;
+                handles.push_back(byPath->second);
+                continue;
+            }
+
+            FileBytes fileData = fileDatas[i].empty() ? takeFile(path, pending) : FileBytes(std::move(fileDatas[i]));
+            uint64_t hash = hashContent(fileData.view());
+
+            auto byHash = m_byHash.find(hash);
+            if (byHash != m_byHash.end()) {
+                Entry& entry = m_entries.get(byHash->second);
+                entry.refCount++;
+                entry.paths.push_back(path);
+                m_byPath[path] = byHash->second;
+                handles.push_back(byHash->second);
+                continue;
+            }
+
+            // 先登记到map中，同一批后面重复的纹理直接命中，texture在loader返回后填入
+            TextureHandle handle = m_entries.insert(Entry{});
+            Entry& entry = m_entries.get(handle);
+            entry.refCount = 1;
+            entry.hash = hash;
+            entry.paths = {path};
+            m_byPath[path] = handle;
+            m_byHash[hash] = handle;
+            handles.push_back(handle);
+            requests.push_back({handle, path, std::move(fileData)});
+        }
+
+        if (!requests.empty()) {
+            std::vector<Texture> textures = m_loader(requests);
+            for (size_t i = 0; i < requests.size(); i++) {
+                m_entries.get(requests[i].handle).texture = textures[i];
+            }
+        }
+        return handles;
+    }
+
+    void addRef(TextureHandle handle) {
+        m_entries.get(handle).refCount++;
+    }
+
+    // texture cache：retireAfter是最后一次可能使用这张纹理的提交编号
+    void release(TextureHandle handle, uint64_t retireAfter) {
+        Entry& entry = m_entries.get(handle);
+        if (entry.refCount == 0) {
+            throw std::runtime_error("texture released more times than acquired!");
+        }
+        if (--entry.refCount > 0) {
+            return;
+        }
+
+        for (const std::string& path : entry.paths) {
+            m_byPath.erase(path);
+        }
+        m_byHash.erase(entry.hash);
+
+        Texture texture = entry.texture;
+        Destroyer destroyer = m_destroyer;
+        m_deletionQueue->push(retireAfter, [destroyer, texture]() {
+            destroyer(texture);
+        });
+
+        m_entries.erase(handle);
+    }
+
+    // residency：handle是否还指向一张纹理，释放之后的旧handle返回false
+    bool contains(TextureHandle handle) const { return m_entries.contains(handle); }
+    Texture& get(TextureHandle handle) { return m_entries.get(handle).texture; }
+    const Texture& get(TextureHandle handle) const { return m_entries.get(handle).texture; }
+
+    size_t size() const { return m_entries.size(); }
+    // defragment：按存放顺序遍历所有纹理，index小于size()，erase会改变之后的顺序
+    TextureHandle handleAt(size_t index) const { return m_entries.handleAt(index); }
+
+    // texture cache：程序退出时销毁所有还被引用的纹理，调用前gpu必须空闲
+    void cleanup() {
+        for (const Entry& entry : m_entries) {
+            m_destroyer(entry.texture);
+        }
+        m_entries.clear();
+        m_byPath.clear();
+        m_byHash.clear();
+    }
+
+private:
+    struct Entry {
+        Texture texture;
+        uint32_t refCount = 0;
+        uint64_t hash = 0;
+        std::vector<std::string> paths;
+    };
+
+    // async io：这一批提交的读取，按提交顺序取用，先完成的其它文件由reader暂存
+    // mapped file：没有reader时是这一批已经映射的文件
+    struct PendingReads {
+        std::unordered_map<std::string, AsyncFileReader::ReadId> ids;
+        std::unordered_map<std::string, MappedFile> mapped;
+    };
+
+    FileBytes takeFile(const std::string& path, PendingReads& pending) {
+        auto mapped = pending.mapped.find(path);
+        if (mapped != pending.mapped.end()) {
+            FileBytes fileData(std::move(mapped->second));
+            pending.mapped.erase(mapped);
+            return fileData;
+        }
+        auto id = pending.ids.find(path);
+        if (id == pending.ids.end()) {
+            return readFile(path);
+        }
+        AsyncFileReader::Completion completion = m_reader->wait(id->second);
+        if (!completion.ok) {
+            throw std::runtime_error("failed to open texture file: " + path);
+        }
+        return FileBytes(std::move(completion.data));
+    }
+
+    // asset pack：pack在整个运行期间保持映射，直接引用pack中的内容
+    static FileBytes readFile(const std::string& path) {
+        AssetPack::Blob blob = AssetPack::instance().find(path);
+        if (blob.data != nullptr) {
+            return FileBytes::borrow(blob.data, blob.size);
+        }
+
+        MappedFile file;
+        if (!file.open(path)) {
+            throw std::runtime_error("failed to open texture file: " + path);
+        }
+        return FileBytes(std::move(file));
+    }
+
+    // texture cache：64位FNV-1a，用于去重而不是安全用途，碰撞概率可以忽略
+    static uint64_t hashContent(std::span<const char> data) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : data) {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    DeletionQueue* m_deletionQueue = nullptr;
+    Loader m_loader;
+    Destroyer m_destroyer;
+    AsyncFileReader* m_reader = nullptr;
+    SlotMap<Entry> m_entries;  // slot map：所有常驻的纹理紧密存放
+    std::unordered_map<std::string, TextureHandle> m_byPath;
+    std::unordered_map<uint64_t, TextureHandle> m_byHash;
+};
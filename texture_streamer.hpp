@@ -0,0 +1,114 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// texture streaming：纹理启动时只上传低分辨率的mip尾部，更高精度的mip由后台线程按需从磁盘读取
+// 后台线程只负责io，上传、layout转换和image view切换都在主线程完成，vulkan对象不跨线程使用
+// level按从低精度到高精度的顺序加载，常驻的mip始终是连续的[residentLevel, mipLevels)
+class TextureStreamer {
+public:
+    using LevelLoader = std::function<std::vector<char>(uint32_t level)>;
+
+    struct LoadedLevel {
+        uint32_t level;
+        std::vector<char> data;
+    };
+
+    // texture streaming：residentLevel及更低精度的level已经常驻，后台线程等待request再读取更高精度的level
+    void start(uint32_t residentLevel, LevelLoader loader) {
+        m_loader = std::move(loader);
+        m_nextLevel = residentLevel;
+        m_requestedLevel = residentLevel;
+        m_stop = false;
+        m_thread = std::thread(&TextureStreamer::run, this);
+    }
+
+    void stop() {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_one();
+        m_thread.join();
+    }
+
+    bool isRunning() const { return m_thread.joinable(); }
+
+    // idle rendering：还有请求的level没有读完或者读完的level没有被取走
+    bool busy() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_requestedLevel < m_nextLevel || !m_loaded.empty();
+    }
+
+    // texture streaming：请求level及更低精度的mip常驻，只会向更高精度请求，已经加载的mip不会被回收
+    void request(uint32_t level) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (level >= m_requestedLevel) {
+                return;
+            }
+            m_requestedLevel = level;
+        }
+        m_condition.notify_one();
+    }
+
+    // texture streaming：主线程取出后台读取完成的level，后台线程的异常在这里重新抛出
+    bool popLoaded(LoadedLevel& loaded) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+        if (m_loaded.empty()) {
+            return false;
+        }
+        loaded = std::move(m_loaded.front());
+        m_loaded.pop_front();
+        return true;
+    }
+
+private:
+    void run() {
+        while (true) {
+            uint32_t level;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this]() { return m_stop || m_requestedLevel < m_nextLevel; });
+                if (m_stop) {
+                    return;
+                }
+                level = --m_nextLevel;
+            }
+
+            // 读取时不持有锁，主线程可以继续request和popLoaded
+            try {
+                std::vector<char> data = m_loader(level);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_loaded.push_back({level, std::move(data)});
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_error = std::current_exception();
+                return;
+            }
+        }
+    }
+
+    LevelLoader m_loader;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+    uint32_t m_nextLevel = 0;  // 下一个读取的是m_nextLevel - 1
+    uint32_t m_requestedLevel = 0;
+    std::deque<LoadedLevel> m_loaded;
+    std::exception_ptr m_error;
+};
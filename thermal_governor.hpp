@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#ifdef __APPLE__
+#include <objc/message.h>
+#include <objc/runtime.h>
+#endif
+
+// thermal governor：笔记本和无风扇的kiosk全速运行一段时间之后会降频，帧率随之不可预测地下降
+// governor在降频之前主动降低帧率上限和dynamic resolution的比例上限，长时间运行时交付的帧率保持稳定
+// 两种信号：操作系统报告的温度状态（macOS的NSProcessInfo.thermalState，linux的thermal zone和passive trip point），以及每像素gpu耗时的上升趋势
+// 内容不变时每像素耗时上升说明时钟在下降；每次改变level之后重新建立基准，帧率上限让gpu降低时钟的影响不会被当作降频
+// 放宽比收紧慢得多：os报告正常并且RELAX_SECONDS内没有上升才放宽一级，避免在两个level之间来回切换
+enum class ThermalState : uint32_t {
+    unknown,  // 平台不提供或者读取失败，只使用耗时趋势
+    nominal,
+    fair,
+    serious,
+    critical,
+};
+
+struct ThermalLevel {
+    float frameRateCap;  // 0表示不限制，和frame limiter的上限取较小的一个
+    float maxResolutionScale;  // 和quality tier的比例上限取较小的一个
+};
+
+class ThermalGovernor {
+public:
+    static constexpr float POLL_SECONDS = 2.0f;  // 读取os状态的间隔，sysfs和objc调用不需要每帧执行
+    static constexpr float FILTER_SECONDS = 5.0f;  // 耗时滤波的时间常数
+    static constexpr float SETTLE_SECONDS = 10.0f;  // 改变level之后等待新的设置反映到耗时上，再记录基准
+    static constexpr float BASELINE_RISE_SECONDS = 300.0f;  // 基准跟随耗时缓慢上升，场景慢慢变重不会一直被当作降频
+    static constexpr float DRIFT_RATIO = 1.12f;  // 滤波之后的耗时超过基准这个倍数时收紧一级
+    static constexpr float RELAX_SECONDS = 120.0f;
+    static constexpr uint32_t LEVEL_COUNT = 4;
+
+    static const char* name(ThermalState state) {
+        static const char* NAMES[] = {"unknown", "nominal", "fair", "serious", "critical"};
+        return NAMES[static_cast<uint32_t>(state)];
+    }
+
+    static ThermalLevel settings(uint32_t level) {
+        static const ThermalLevel LEVELS[LEVEL_COUNT] = {
+            {0.0f, 1.0f},
+            {60.0f, 0.9f},
+            {45.0f, 0.8f},
+            {30.0f, 0.7f},
+        };
+        return LEVELS[std::min(level, LEVEL_COUNT - 1)];
+    }
+
+    // thermal governor：enabled为false时level一直是0，benchmark时关闭，结果可以比较
+    void init(bool enabled) {
+        m_enabled = enabled;
+        m_level = 0;
+        m_osState = enabled ? readOsState() : ThermalState::unknown;
+        m_pollTimer = 0.0f;
+        resetTrend();
+    }
+
+    uint32_t level() const { return m_level; }
+    ThermalLevel settings() const { return settings(m_level); }
+    ThermalState osState() const { return m_osState; }
+
+    // thermal governor：每帧调用一次，pixelCostMs是最近一次完成的帧的gpu时间除以渲染分辨率比例的平方，没有结果时传入0；返回true表示level改变
+    bool update(float pixelCostMs, float deltaTime) {
+        if (!m_enabled) {
+            return false;
+        }
+        m_pollTimer += deltaTime;
+        if (m_pollTimer >= POLL_SECONDS) {
+            m_pollTimer = 0.0f;
+            m_osState = readOsState();
+        }
+        m_sinceChange += deltaTime;
+        if (pixelCostMs > 0.0f) {
+            float alpha = std::min(deltaTime / FILTER_SECONDS, 1.0f);
+            m_filteredMs = m_filteredMs == 0.0f ? pixelCostMs : m_filteredMs + (pixelCostMs - m_filteredMs) * alpha;
+        }
+
+        // os状态决定level的下限，fair时已经开始限制，serious和critical之后系统自己也会降频
+        uint32_t floor = m_osState == ThermalState::critical ? 3 : m_osState == ThermalState::serious ? 2 : m_osState == ThermalState::fair ? 1 : 0;
+        uint32_t level = std::max(m_level, floor);
+        if (m_sinceChange >= SETTLE_SECONDS && m_filteredMs > 0.0f) {
+            if (m_baselineMs == 0.0f || m_filteredMs < m_baselineMs) {
+                m_baselineMs = m_filteredMs;
+            } else {
+                m_baselineMs += (m_filteredMs - m_baselineMs) * std::min(deltaTime / BASELINE_RISE_SECONDS, 1.0f);
+            }
+            bool drifting = m_filteredMs > m_baselineMs * DRIFT_RATIO;
+            if (drifting) {
+                level = std::max(level, std::min(m_level + 1, LEVEL_COUNT - 1));
+            }
+            m_calmSeconds = !drifting && floor < m_level ? m_calmSeconds + deltaTime : 0.0f;
+            if (m_calmSeconds >= RELAX_SECONDS) {
+                level = m_level - 1;
+            }
+        }
+        if (level == m_level) {
+            return false;
+        }
+        m_level = level;
+        resetTrend();
+        return true;
+    }
+
+    // thermal governor：每个平台自己的温度状态，不支持的平台返回unknown
+    static ThermalState readOsState() {
+#if defined(__APPLE__)
+        // NSProcessInfoThermalState：0 nominal、1 fair、2 serious、3 critical；通过objc runtime直接调用，main.cpp不需要编译成objective-c++
+        Class processInfoClass = objc_getClass("NSProcessInfo");
+        if (processInfoClass == nullptr) {
+            return ThermalState::unknown;
+        }
+        id processInfo = reinterpret_cast<id (*)(Class, SEL)>(objc_msgSend)(processInfoClass, sel_registerName("processInfo"));
+        long state = reinterpret_cast<long (*)(id, SEL)>(objc_msgSend)(processInfo, sel_registerName("thermalState"));
+        return static_cast<ThermalState>(std::clamp(state, 0L, 3L) + 1);
+#elif defined(__linux__)
+        // thermal zone：每个zone和自己的trip point比较，取距离最小的；接近passive trip point时是fair，超过时内核开始降频
+        int margin = INT32_MAX;  // 距离passive trip point的千分之一摄氏度
+        int criticalMargin = INT32_MAX;
+        for (uint32_t zone = 0; zone < MAX_THERMAL_ZONES; zone++) {
+            std::string path = "/sys/class/thermal/thermal_zone" + std::to_string(zone) + "/";
+            int temperature = 0;
+            if (!readInt(path + "temp", temperature)) {
+                break;
+            }
+            for (uint32_t trip = 0; trip < MAX_TRIP_POINTS; trip++) {
+                std::string type;
+                int tripTemperature = 0;
+                std::ifstream typeFile(path + "trip_point_" + std::to_string(trip) + "_type");
+                if (!(typeFile >> type) || !readInt(path + "trip_point_" + std::to_string(trip) + "_temp", tripTemperature) || tripTemperature <= 0) {
+                    continue;
+                }
+                if (type == "passive") {
+                    margin = std::min(margin, tripTemperature - temperature);
+                } else if (type == "critical" || type == "hot") {
+                    criticalMargin = std::min(criticalMargin, tripTemperature - temperature);
+                }
+            }
+        }
+        if (margin == INT32_MAX && criticalMargin == INT32_MAX) {
+            return ThermalState::unknown;
+        }
+        if (criticalMargin <= CRITICAL_MARGIN) {
+            return ThermalState::critical;
+        }
+        if (margin <= 0) {
+            return ThermalState::serious;
+        }
+        return margin <= FAIR_MARGIN ? ThermalState::fair : ThermalState::nominal;
+#else
+        return ThermalState::unknown;
+#endif
+    }
+
+private:
+    static constexpr uint32_t MAX_THERMAL_ZONES = 32;
+    static constexpr uint32_t MAX_TRIP_POINTS = 8;
+    static constexpr int FAIR_MARGIN = 8000;  // 距离passive trip point 8摄氏度以内
+    static constexpr int CRITICAL_MARGIN = 5000;
+
+    static bool readInt(const std::string& path, int& value) {
+        std::ifstream file(path);
+        return static_cast<bool>(file >> value);
+    }
+
+    void resetTrend() {
+        m_filteredMs = 0.0f;
+        m_baselineMs = 0.0f;
+        m_sinceChange = 0.0f;
+        m_calmSeconds = 0.0f;
+    }
+
+    bool m_enabled = false;
+    uint32_t m_level = 0;
+    ThermalState m_osState = ThermalState::unknown;
+    float m_pollTimer = 0.0f;
+    float m_filteredMs = 0.0f;
+    float m_baselineMs = 0.0f;  // 改变level之后稳定下来的最低耗时，缓慢跟随上升
+    float m_sinceChange = 0.0f;
+    float m_calmSeconds = 0.0f;  // os正常并且耗时没有上升的连续时间
+};
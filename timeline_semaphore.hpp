@@ -0,0 +1,103 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include "host_memory.hpp"
+
+// timeline semaphore：vulkan 1.2（之前是VK_KHR_timeline_semaphore）的semaphore带一个单调递增的64位值
+// 每次提交signal一个更大的值，cpu查询当前值就知道哪些提交已经完成，等待某个值不需要fence，也不需要reset
+// 图形队列上的所有提交（每帧的渲染和上传）共用一个timeline，值按提交顺序分配，frame pacing、deletion queue和上传都和这个值比较
+// 值只能在提交它的线程上分配，目前所有提交都在主线程
+class TimelineSemaphore {
+public:
+    static bool supported(VkPhysicalDevice physicalDevice) {
+        VkPhysicalDeviceTimelineSemaphoreFeatures features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        return features.timelineSemaphore;
+    }
+
+    // timeline semaphore：1.2的设备返回core函数，否则返回扩展的KHR函数
+    void init(VkDevice device) {
+        m_device = device;
+        m_getCounterValue = (PFN_vkGetSemaphoreCounterValue) vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValue");
+        m_waitSemaphores = (PFN_vkWaitSemaphores) vkGetDeviceProcAddr(device, "vkWaitSemaphores");
+        if (m_getCounterValue == nullptr || m_waitSemaphores == nullptr) {
+            m_getCounterValue = (PFN_vkGetSemaphoreCounterValue) vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+            m_waitSemaphores = (PFN_vkWaitSemaphores) vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+        }
+        if (m_getCounterValue == nullptr || m_waitSemaphores == nullptr) {
+            throw std::runtime_error("failed to load timeline semaphore functions!");
+        }
+
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(m_device, &semaphoreInfo, hostAllocator(), &m_semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timeline semaphore!");
+        }
+    }
+
+    void cleanup() {
+        if (m_semaphore != VK_NULL_HANDLE) {
+            vkDestroySemaphore(m_device, m_semaphore, hostAllocator());
+            m_semaphore = VK_NULL_HANDLE;
+        }
+    }
+
+    VkSemaphore handle() const { return m_semaphore; }
+
+    // timeline semaphore：分配下一次提交signal的值，调用者必须把它提交出去，否则等待之后的值会永远阻塞
+    uint64_t nextValue() { return ++m_submitted; }
+    uint64_t submittedValue() const { return m_submitted; }
+
+    // timeline semaphore：gpu已经完成的值，缓存起来避免每次比较都查询驱动
+    uint64_t completedValue() {
+        uint64_t value = 0;
+        if (m_getCounterValue(m_device, m_semaphore, &value) == VK_SUCCESS) {
+            m_completed = std::max(m_completed, value);
+        }
+        return m_completed;
+    }
+
+    bool isComplete(uint64_t value) {
+        return value <= m_completed || value <= completedValue();
+    }
+
+    // timeline semaphore：阻塞直到value完成，value为0或者已经完成时马上返回
+    void wait(uint64_t value) {
+        if (isComplete(value)) {
+            return;
+        }
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &m_semaphore;
+        waitInfo.pValues = &value;
+        if (m_waitSemaphores(m_device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+            throw std::runtime_error("failed to wait for timeline semaphore!");
+        }
+        m_completed = std::max(m_completed, value);
+    }
+
+private:
+    VkDevice m_device = VK_NULL_HANDLE;
+    VkSemaphore m_semaphore = VK_NULL_HANDLE;
+    uint64_t m_submitted = 0;
+    uint64_t m_completed = 0;
+    PFN_vkGetSemaphoreCounterValue m_getCounterValue = nullptr;
+    PFN_vkWaitSemaphores m_waitSemaphores = nullptr;
+};
@@ -0,0 +1,75 @@
+// asset pack：把处理好的资源打包成VulkanTutorial读取的assets.pack
+//   VulkanTutorial_pack [--store] assets.pack models/AC_Unit.meshcache textures/texture_astc.ktx2 textures/texture.jpg ...
+// 文件按参数的顺序写入，按加载顺序列出时启动时的读取是顺序的；--store不压缩，否则每个blob压缩后节省超过1/8时使用LZ4
+// ktx2纹理分块压缩，运行时level数据由compute shader解压，cpu只解压header；其它资源整体压缩，由cpu解压
+// mesh cache需要先运行一次程序生成，pack中的缓存不再和源文件比较hash，模型或者顶点格式改变后需要重新打包
+// mesh codec：mesh cache的顶点和索引编码之后再打包，运行时由compute shader解码；不是当前版本的缓存时原样打包
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../asset_pack.hpp"
+
+int main(int argc, char** argv) {
+    bool compress = true;
+    int first = 1;
+    if (first < argc && std::string(argv[first]) == "--store") {
+        compress = false;
+        first++;
+    }
+    if (argc - first < 2) {
+        std::fprintf(stderr, "usage: %s [--store] output.pack file...\n", argv[0]);
+        return 1;
+    }
+
+    std::string output = argv[first];
+    std::vector<AssetPackSource> files;
+    std::set<std::string> names;
+    for (int i = first + 1; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::ate | std::ios::binary);
+        if (!file.is_open()) {
+            std::fprintf(stderr, "failed to open %s\n", argv[i]);
+            return 1;
+        }
+        AssetPackSource source;
+        source.name = AssetPack::assetName(argv[i]);
+        if (source.name.size() > 5 && source.name.compare(source.name.size() - 5, 5, ".ktx2") == 0) {
+            source.compression = AssetCompression::lz4Blocks;
+        }
+        if (!names.insert(source.name).second) {
+            std::fprintf(stderr, "duplicate asset name %s: assets are looked up by file name\n", source.name.c_str());
+            return 1;
+        }
+        source.data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(source.data.data(), static_cast<std::streamsize>(source.data.size()));
+        if (source.name.size() > 10 && source.name.compare(source.name.size() - 10, 10, ".meshcache") == 0) {
+            std::vector<char> encoded;
+            if (encodeMeshCache(source.data.data(), source.data.size(), encoded)) {
+                std::printf("%s: encoded %zu -> %zu bytes\n", source.name.c_str(), source.data.size(), encoded.size());
+                source.data = std::move(encoded);
+            } else {
+                std::fprintf(stderr, "%s is not a current mesh cache, packed without encoding\n", source.name.c_str());
+            }
+        }
+        files.push_back(std::move(source));
+    }
+
+    if (!writeAssetPack(output, files, compress)) {
+        std::fprintf(stderr, "failed to write %s\n", output.c_str());
+        return 1;
+    }
+
+    AssetPack& pack = AssetPack::instance();
+    pack.open(output);
+    for (const AssetPackSource& source : files) {
+        if (pack.find(source.name).size != source.data.size()) {
+            std::fprintf(stderr, "verification failed for %s\n", source.name.c_str());
+            return 1;
+        }
+    }
+    std::printf("%s: %zu assets\n", output.c_str(), files.size());
+    return 0;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "batch_transform.hpp"
+#include "cpu_profiler.hpp"
+#include "job_pool.hpp"
+
+// transform store：entity的位置、旋转、缩放和世界矩阵分别存放在连续的数组中（SoA），update只遍历需要的数组
+// entity按层级深度分组，update逐层计算世界矩阵，同一层的entity之间没有依赖，数量达到parallelMinEntities时分块在job pool中计算
+// 只有自己的局部变换被修改过（dirty）或者父节点的世界矩阵在这次update中改变的entity才重新计算
+// entity的编号是create返回的index，父节点必须先创建
+class TransformStore {
+public:
+    static constexpr uint32_t INVALID_ENTITY = UINT32_MAX;
+    static constexpr size_t CHUNK_SIZE = 1024;  // 一个job计算的entity数量
+
+    void clear() {
+        m_positions.clear();
+        m_rotations.clear();
+        m_scales.clear();
+        m_parents.clear();
+        m_dirty.clear();
+        m_worldChanged.clear();
+        m_world.clear();
+        m_depths.clear();
+        m_levels.clear();
+        m_changed.clear();
+    }
+
+    uint32_t create(uint32_t parent = INVALID_ENTITY, const glm::vec3& position = glm::vec3(0.0f), const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+        const glm::vec3& scale = glm::vec3(1.0f)) {
+        uint32_t entity = static_cast<uint32_t>(m_positions.size());
+        uint32_t depth = parent == INVALID_ENTITY ? 0 : m_depths[parent] + 1;
+        m_positions.push_back(position);
+        m_rotations.push_back(rotation);
+        m_scales.push_back(scale);
+        m_parents.push_back(parent);
+        m_dirty.push_back(1);
+        m_worldChanged.push_back(0);
+        m_world.push_back(glm::mat4(1.0f));
+        m_depths.push_back(depth);
+        if (m_levels.size() <= depth) {
+            m_levels.resize(depth + 1);
+        }
+        m_levels[depth].push_back(entity);
+        return entity;
+    }
+
+    size_t size() const { return m_positions.size(); }
+
+    void setPosition(uint32_t entity, const glm::vec3& position) {
+        m_positions[entity] = position;
+        m_dirty[entity] = 1;
+    }
+
+    void setRotation(uint32_t entity, const glm::quat& rotation) {
+        m_rotations[entity] = rotation;
+        m_dirty[entity] = 1;
+    }
+
+    void setScale(uint32_t entity, const glm::vec3& scale) {
+        m_scales[entity] = scale;
+        m_dirty[entity] = 1;
+    }
+
+    const glm::mat4& world(uint32_t entity) const { return m_world[entity]; }
+
+    // transform store：上一次update中世界矩阵改变的entity，按层级从上到下排列
+    const std::vector<uint32_t>& changed() const { return m_changed; }
+
+    // transform store：pool为nullptr时只在调用者线程计算；不能在job中调用
+    void update(JobPool* pool, size_t parallelMinEntities) {
+        CPU_PROFILE_SCOPE("transform update");
+        m_changed.clear();
+        for (const std::vector<uint32_t>& level : m_levels) {
+            size_t chunkCount = (level.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            m_chunkChanged.resize(std::max(m_chunkChanged.size(), chunkCount));
+            auto updateChunk = [&](size_t chunk) {
+                std::vector<uint32_t>& changed = m_chunkChanged[chunk];
+                changed.clear();
+                size_t end = std::min(level.size(), (chunk + 1) * CHUNK_SIZE);
+                for (size_t i = chunk * CHUNK_SIZE; i < end; i++) {
+                    if (updateEntity(level[i])) {
+                        changed.push_back(level[i]);
+                    }
+                }
+            };
+            if (pool != nullptr && level.size() >= parallelMinEntities && chunkCount > 1 && pool->threadCount() > 1) {
+                pool->parallelFor(chunkCount, updateChunk);
+            } else {
+                for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+                    updateChunk(chunk);
+                }
+            }
+            for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+                m_changed.insert(m_changed.end(), m_chunkChanged[chunk].begin(), m_chunkChanged[chunk].end());
+            }
+        }
+    }
+
+private:
+    // transform store：父节点在上一层，这一层开始之前已经计算完成；每个entity只写自己的元素，不需要同步
+    bool updateEntity(uint32_t entity) {
+        uint32_t parent = m_parents[entity];
+        bool parentChanged = parent != INVALID_ENTITY && m_worldChanged[parent];
+        if (!m_dirty[entity] && !parentChanged) {
+            m_worldChanged[entity] = 0;
+            return false;
+        }
+        // batch transform：TRS直接组合成矩阵，父节点的乘法使用simd
+        glm::mat4 local = BatchTransform::compose(m_positions[entity], m_rotations[entity], m_scales[entity]);
+        m_world[entity] = parent == INVALID_ENTITY ? local : BatchTransform::multiply(m_world[parent], local);
+        m_dirty[entity] = 0;
+        m_worldChanged[entity] = 1;
+        return true;
+    }
+
+    std::vector<glm::vec3> m_positions;
+    std::vector<glm::quat> m_rotations;
+    std::vector<glm::vec3> m_scales;
+    std::vector<uint32_t> m_parents;
+    std::vector<uint8_t> m_dirty;  // uint8_t而不是vector<bool>，不同线程写相邻的元素
+    std::vector<uint8_t> m_worldChanged;
+    std::vector<glm::mat4> m_world;
+    std::vector<uint32_t> m_depths;
+    std::vector<std::vector<uint32_t>> m_levels;  // 每一层的entity
+    std::vector<std::vector<uint32_t>> m_chunkChanged;  // 每个job自己的输出，合并进m_changed
+    std::vector<uint32_t> m_changed;
+};
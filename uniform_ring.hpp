@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+
+// uniform ring：之前每个frame in flight有一个只放一个ubo的buffer，每个draw都需要自己的buffer和descriptor set
+// 现在每帧一个持久映射的大buffer，按minUniformBufferOffsetAlignment对齐切成slice，每帧从头线性写入
+// descriptor使用VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC，绑定descriptor set时传入dynamic offset选择slice，一个descriptor set可以服务所有draw
+class UniformRing {
+public:
+    // blockRange：descriptor的range，也就是shader一次能看到的最大uniform block大小
+    // extraUsage：比如descriptor buffer需要查询buffer的device address
+    void init(VkDevice device, DeviceMemoryAllocator& allocator, VkDeviceSize minOffsetAlignment, VkDeviceSize blockRange, VkDeviceSize frameCapacity, uint32_t frameCount,
+        VkBufferUsageFlags extraUsage = 0) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_alignment = minOffsetAlignment > 0 ? minOffsetAlignment : 1;
+        m_blockRange = blockRange;
+        m_frameCapacity = frameCapacity;
+
+        m_frames.resize(frameCount);
+        for (auto& frame : m_frames) {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = frameCapacity;
+            bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | extraUsage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &frame.buffer) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create uniform ring buffer!");
+            }
+
+            VkMemoryRequirements memRequirements;
+            vkGetBufferMemoryRequirements(m_device, frame.buffer, &memRequirements);
+            frame.allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true, MemoryCategory::uniform, 0, "uniform ring");
+            vkBindBufferMemory(m_device, frame.buffer, frame.allocation.memory, frame.allocation.offset);
+        }
+    }
+
+    void cleanup() {
+        for (auto& frame : m_frames) {
+            vkDestroyBuffer(m_device, frame.buffer, hostAllocator());
+            m_allocator->free(frame.allocation);
+        }
+        m_frames.clear();
+    }
+
+    // uniform ring：开始写入某一帧，调用者需要保证gpu已经完成上次使用这一帧的命令（等待in flight fence之后）
+    void beginFrame(uint32_t frameIndex) {
+        m_currentFrame = frameIndex;
+        m_frames[frameIndex].head = 0;
+    }
+
+    // uniform ring：写入一个uniform block，返回绑定descriptor set时使用的dynamic offset
+    uint32_t push(const void* data, VkDeviceSize size) {
+        if (size > m_blockRange) {
+            throw std::runtime_error("uniform block is larger than the descriptor range!");
+        }
+
+        Frame& frame = m_frames[m_currentFrame];
+        // 最后一个slice的offset加上range不能超出buffer，否则绑定时越界
+        if (frame.head + m_blockRange > m_frameCapacity) {
+            throw std::runtime_error("uniform ring frame capacity exceeded!");
+        }
+
+        VkDeviceSize offset = frame.head;
+        memcpy(static_cast<char*>(frame.allocation.mapped) + offset, data, static_cast<size_t>(size));
+        frame.head = (offset + size + m_alignment - 1) / m_alignment * m_alignment;
+        return static_cast<uint32_t>(offset);
+    }
+
+    template<typename T>
+    uint32_t push(const T& data) {
+        return push(&data, sizeof(T));
+    }
+
+    // late latch：改写这一帧已经push的uniform block中的一段，offset是buffer中的字节位置，在提交之前调用
+    void overwrite(uint32_t frameIndex, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+        Frame& frame = m_frames[frameIndex];
+        if (offset + size > frame.head) {
+            throw std::runtime_error("uniform ring overwrite outside the pushed blocks!");
+        }
+        memcpy(static_cast<char*>(frame.allocation.mapped) + offset, data, static_cast<size_t>(size));
+    }
+
+    VkBuffer buffer(uint32_t frameIndex) const { return m_frames[frameIndex].buffer; }
+    VkDeviceSize blockRange() const { return m_blockRange; }
+    VkDeviceSize usedBytes(uint32_t frameIndex) const { return m_frames[frameIndex].head; }
+
+private:
+    struct Frame {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkDeviceSize head = 0;
+    };
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkDeviceSize m_alignment = 1;
+    VkDeviceSize m_blockRange = 0;
+    VkDeviceSize m_frameCapacity = 0;
+    uint32_t m_currentFrame = 0;
+    std::vector<Frame> m_frames;
+};
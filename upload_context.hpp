@@ -0,0 +1,433 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "device_group.hpp"
+#include "host_memory.hpp"
+#include "staging_ring.hpp"
+#include "timeline_semaphore.hpp"
+
+// upload context：之前每次拷贝和layout转换都单独提交并vkQueueWaitIdle，启动时就是一连串gpu停顿
+// 现在把多个拷贝和barrier录制进同一个command buffer，一次提交，调用者拿到ticket后可以轮询或等待
+// timeline semaphore：上传的最后一次提交在图形队列上signal和渲染共用的timeline，完成与否和帧一样通过timeline值判断，不再使用fence
+// 同一个队列上后提交的渲染命令会被上传末尾的barrier保证顺序，所以渲染不需要在cpu上等待上传完成
+//
+// transfer queue：如果设备有只支持传输的queue family（独立显卡的DMA引擎），拷贝在该队列上执行，和渲染并行
+// EXCLUSIVE资源跨queue family使用需要转移所有权：传输队列release，图形队列acquire，两者之间用传输队列自己的timeline同步
+// 所以上传的资源最后都需要调用handoffBuffer/handoffImage，同一队列时它们只是普通的barrier
+//
+// batch pool：command buffer从TRANSIENT的pool中分配一次，之后随batch一起回收，timeline到达后放回空闲列表重置复用，不再每次allocate/free
+// 开始新的batch之前先回收已完成的batch，连续上传很多资源时batch的数量停在同时在gpu上的提交数量
+// command pool需要外部同步，一个UploadContext只能在一个线程中使用，其它线程需要上传时创建自己的UploadContext
+class UploadContext {
+public:
+    // timeline：图形队列的timeline，上传和渲染的提交都从它分配值
+    // device group：使用device group时不能使用独立的传输队列，上传在所有设备上执行，每个设备上都复制一份资源
+    void init(VkDevice device, uint32_t transferFamily, VkQueue transferQueue, uint32_t graphicsFamily, VkQueue graphicsQueue, StagingRing& stagingRing,
+        TimelineSemaphore& timeline, DeviceGroup* deviceGroup = nullptr) {
+        m_device = device;
+        m_deviceGroup = deviceGroup != nullptr && deviceGroup->active() ? deviceGroup : nullptr;
+        m_timeline = &timeline;
+        m_transferFamily = transferFamily;
+        m_transferQueue = transferQueue;
+        m_graphicsFamily = graphicsFamily;
+        m_graphicsQueue = graphicsQueue;
+        m_stagingRing = &stagingRing;
+
+        m_transferPool = createPool(transferFamily);
+        if (usesDedicatedQueue()) {
+            m_acquirePool = createPool(graphicsFamily);  // acquire barrier需要在图形队列上执行
+            m_transferTimeline.init(device);  // transfer queue：只有传输队列signal，值和ticket无关
+        }
+    }
+
+    void cleanup() {
+        waitIdle();  // 提交未完成的录制并等待，之后所有batch都在空闲列表中
+        m_transferTimeline.cleanup();
+        vkDestroyCommandPool(m_device, m_transferPool, hostAllocator());
+        if (m_acquirePool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(m_device, m_acquirePool, hostAllocator());
+        }
+    }
+
+    bool usesDedicatedQueue() const { return m_transferFamily != m_graphicsFamily; }
+
+    // upload context：返回正在录制的command buffer，没有则从空闲batch中取一个开始录制
+    VkCommandBuffer commandBuffer() {
+        if (!m_recording) {
+            beginBatch();
+        }
+        return m_current.commandBuffer;
+    }
+
+    // upload context：在图形队列上执行的command buffer，排在这次上传的拷贝和acquire之后
+    // 比如vkCmdBlitImage生成mipmap需要图形队列，传输队列不支持；同一队列时就是commandBuffer()
+    VkCommandBuffer graphicsCommandBuffer() {
+        if (!usesDedicatedQueue()) {
+            return commandBuffer();
+        }
+
+        commandBuffer();
+        if (!m_current.graphicsRecording) {
+            if (m_current.graphicsCommandBuffer == VK_NULL_HANDLE) {
+                m_current.graphicsCommandBuffer = allocateCommandBuffer(m_acquirePool);
+            }
+            vkResetCommandBuffer(m_current.graphicsCommandBuffer, 0);
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            vkBeginCommandBuffer(m_current.graphicsCommandBuffer, &beginInfo);
+            m_current.graphicsRecording = true;
+        }
+        return m_current.graphicsCommandBuffer;
+    }
+
+    // upload context：这次上传在gpu上完成后执行callback，用于销毁只在上传期间使用的临时对象
+    void deferUntilComplete(std::function<void()> callback) {
+        commandBuffer();
+        m_current.completionCallbacks.push_back(std::move(callback));
+    }
+
+    // upload context：录制中的上传将会得到的ticket
+    uint64_t pendingTicket() const { return m_nextTicket; }
+
+    // transfer queue：buffer上传完成，交给图形队列在dstStage以dstAccess读取
+    void handoffBuffer(VkBuffer buffer, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        if (!usesDedicatedQueue()) {
+            barrier.dstAccessMask = dstAccess;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            vkCmdPipelineBarrier(commandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+            return;
+        }
+
+        // release：dstAccessMask在release中被忽略，可见性由acquire负责
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = m_transferFamily;
+        barrier.dstQueueFamilyIndex = m_graphicsFamily;
+        vkCmdPipelineBarrier(commandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+        // acquire：除了access mask之外必须和release完全一致
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        m_current.acquireBufferBarriers.push_back(barrier);
+        m_current.acquireStages |= dstStage;
+    }
+
+    // transfer queue：CONCURRENT的buffer不需要转移所有权，跨队列时acquire提交等待的semaphore已经保证写入对图形队列可见
+    void handoffSharedBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+        if (usesDedicatedQueue()) {
+            commandBuffer();  // 保证有录制中的batch，submit时会生成acquire提交和semaphore等待
+            return;
+        }
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.buffer = buffer;
+        barrier.offset = offset;
+        barrier.size = size;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        vkCmdPipelineBarrier(commandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    // transfer queue：image上传完成，从oldLayout转换到newLayout并交给图形队列
+    // 图形相关的stage（比如fragment shader）在传输队列上不可用，所以转移所有权时layout转换放在release和acquire两边同时声明
+    void handoffImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.image = image;
+        barrier.subresourceRange = range;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        if (!usesDedicatedQueue()) {
+            barrier.dstAccessMask = dstAccess;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            vkCmdPipelineBarrier(commandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+            return;
+        }
+
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = m_transferFamily;
+        barrier.dstQueueFamilyIndex = m_graphicsFamily;
+        vkCmdPipelineBarrier(commandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = dstAccess;
+        m_current.acquireImageBarriers.push_back(barrier);
+        m_current.acquireStages |= dstStage;
+    }
+
+    // upload context：提交当前录制的所有上传，返回ticket，没有录制内容则返回最近一次的ticket
+    uint64_t submit() {
+        if (!m_recording) {
+            return m_nextTicket - 1;
+        }
+
+        if (vkEndCommandBuffer(m_current.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record upload command buffer!");
+        }
+
+        m_current.ticket = m_nextTicket++;
+        m_stagingRing->commit(m_current.ticket);  // staging ring：录制期间分配的ring空间归属于这次提交
+
+        m_current.timelineValue = m_timeline->nextValue();
+        VkSemaphore timelineSemaphore = m_timeline->handle();
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &m_current.timelineValue;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_current.commandBuffer;
+
+        if (m_deviceGroup != nullptr) {
+            m_deviceGroup->submit(m_graphicsQueue, submitInfo, m_deviceGroup->allDevicesMask(), *m_timeline, m_current.timelineValue);
+        } else if (!usesDedicatedQueue()) {
+            submitInfo.pNext = &timelineInfo;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &timelineSemaphore;
+            if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit upload command buffer!");
+            }
+        } else {
+            // transfer queue：传输队列完成后signal自己的timeline，图形队列等待这个值后执行acquire，acquire提交signal图形队列的timeline表示整个上传完成
+            uint64_t transferValue = m_transferTimeline.nextValue();
+            VkSemaphore transferSemaphore = m_transferTimeline.handle();
+            VkTimelineSemaphoreSubmitInfo transferTimelineInfo{};
+            transferTimelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+            transferTimelineInfo.signalSemaphoreValueCount = 1;
+            transferTimelineInfo.pSignalSemaphoreValues = &transferValue;
+            submitInfo.pNext = &transferTimelineInfo;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &transferSemaphore;
+            if (vkQueueSubmit(m_transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit upload command buffer!");
+            }
+
+            recordAcquire();
+
+            // acquire之后执行图形队列上的上传工作，同一次提交中command buffer按顺序执行，acquire barrier对后面的command buffer同样生效
+            VkCommandBuffer graphicsCommandBuffers[2] = {m_current.acquireCommandBuffer, VK_NULL_HANDLE};
+            uint32_t graphicsCommandBufferCount = 1;
+            if (m_current.graphicsRecording) {
+                if (vkEndCommandBuffer(m_current.graphicsCommandBuffer) != VK_SUCCESS) {
+                    throw std::runtime_error("failed to record upload graphics command buffer!");
+                }
+                graphicsCommandBuffers[graphicsCommandBufferCount++] = m_current.graphicsCommandBuffer;
+                m_current.graphicsRecording = false;
+            }
+
+            VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            timelineInfo.waitSemaphoreValueCount = 1;
+            timelineInfo.pWaitSemaphoreValues = &transferValue;
+            VkSubmitInfo acquireInfo{};
+            acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            acquireInfo.pNext = &timelineInfo;
+            acquireInfo.waitSemaphoreCount = 1;
+            acquireInfo.pWaitSemaphores = &transferSemaphore;
+            acquireInfo.pWaitDstStageMask = &waitStage;
+            acquireInfo.commandBufferCount = graphicsCommandBufferCount;
+            acquireInfo.pCommandBuffers = graphicsCommandBuffers;
+            acquireInfo.signalSemaphoreCount = 1;
+            acquireInfo.pSignalSemaphores = &timelineSemaphore;
+            if (vkQueueSubmit(m_graphicsQueue, 1, &acquireInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit upload acquire command buffer!");
+            }
+        }
+
+        m_current.acquireBufferBarriers.clear();
+        m_current.acquireImageBarriers.clear();
+        m_current.acquireStages = 0;
+
+        m_inFlight.push_back(std::move(m_current));  // batch pool：command buffer和数组的容量跟着batch走
+        m_current = Batch{};
+        m_recording = false;
+        return m_inFlight.back().ticket;
+    }
+
+    // upload context：非阻塞地检查已完成的提交，回收command buffer和staging ring空间
+    void poll() {
+        while (!m_inFlight.empty() && m_timeline->isComplete(m_inFlight.front().timelineValue)) {
+            retireFront();
+        }
+    }
+
+    // idle rendering：没有录制中或者gpu还没有完成的上传
+    bool idle() {
+        poll();
+        return !m_recording && m_inFlight.empty();
+    }
+
+    // telemetry：已经提交、gpu还没有完成的batch数，调用之前先poll
+    size_t inFlightBatches() const { return m_inFlight.size(); }
+
+    bool isComplete(uint64_t ticket) {
+        poll();
+        return ticket <= m_completedTicket;
+    }
+
+    // upload context：阻塞等待ticket完成，如果ticket还在录制中会先提交
+    void wait(uint64_t ticket) {
+        if (m_recording && ticket >= m_nextTicket) {
+            submit();
+        }
+        while (!m_inFlight.empty() && m_inFlight.front().ticket <= ticket) {
+            m_timeline->wait(m_inFlight.front().timelineValue);
+            retireFront();
+        }
+    }
+
+    void waitIdle() {
+        submit();
+        wait(m_nextTicket - 1);
+    }
+
+    uint64_t completedTicket() const { return m_completedTicket; }
+
+    // batch pool：到目前为止分配过的batch数量，也就是command buffer分配的次数（专用传输队列时每个batch多一个acquire的command buffer）
+    size_t batchCount() const { return m_batchCount; }
+
+private:
+    struct Batch {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;  // transfer queue：图形队列上执行acquire barrier
+        VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;  // transfer queue：acquire之后图形队列上的上传工作
+        bool graphicsRecording = false;
+        uint64_t ticket = 0;
+        uint64_t timelineValue = 0;  // timeline semaphore：图形队列timeline上表示这次上传完成的值
+        std::vector<VkBufferMemoryBarrier> acquireBufferBarriers;
+        std::vector<VkImageMemoryBarrier> acquireImageBarriers;
+        VkPipelineStageFlags acquireStages = 0;
+        std::vector<std::function<void()>> completionCallbacks;
+    };
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    uint32_t m_transferFamily = 0;
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    uint32_t m_graphicsFamily = 0;
+    VkQueue m_graphicsQueue = VK_NULL_HANDLE;
+    VkCommandPool m_transferPool = VK_NULL_HANDLE;
+    VkCommandPool m_acquirePool = VK_NULL_HANDLE;
+    StagingRing* m_stagingRing = nullptr;
+    TimelineSemaphore* m_timeline = nullptr;
+    DeviceGroup* m_deviceGroup = nullptr;  // device group：只在有多个设备时设置
+    TimelineSemaphore m_transferTimeline;
+
+    Batch m_current;
+    bool m_recording = false;
+    std::deque<Batch> m_inFlight;
+    std::vector<Batch> m_freeBatches;
+
+    uint64_t m_nextTicket = 1;
+    uint64_t m_completedTicket = 0;
+    size_t m_batchCount = 0;
+
+    VkCommandPool createPool(uint32_t queueFamilyIndex) {
+        // 上传用的command buffer生命周期很短并且会反复重置，所以使用TRANSIENT和RESET
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+        VkCommandPool pool;
+        if (vkCreateCommandPool(m_device, &poolInfo, hostAllocator(), &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+        return pool;
+    }
+
+    VkCommandBuffer allocateCommandBuffer(VkCommandPool pool) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = pool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+        return commandBuffer;
+    }
+
+    void beginBatch() {
+        if (m_freeBatches.empty()) {
+            poll();  // batch pool：先回收gpu已经完成的batch，只有都还在使用中才分配新的command buffer
+        }
+        if (!m_freeBatches.empty()) {
+            m_current = std::move(m_freeBatches.back());
+            m_freeBatches.pop_back();
+            vkResetCommandBuffer(m_current.commandBuffer, 0);
+        } else {
+            m_current = Batch{};
+            m_current.commandBuffer = allocateCommandBuffer(m_transferPool);
+            m_batchCount++;
+            if (usesDedicatedQueue()) {
+                m_current.acquireCommandBuffer = allocateCommandBuffer(m_acquirePool);
+            }
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;  // 告诉驱动只使用一次command buffer
+
+        vkBeginCommandBuffer(m_current.commandBuffer, &beginInfo);
+        m_recording = true;
+    }
+
+    // transfer queue：把收集到的acquire barrier录制进图形队列的command buffer
+    void recordAcquire() {
+        VkCommandBuffer commandBuffer = m_current.acquireCommandBuffer;
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        if (!m_current.acquireBufferBarriers.empty() || !m_current.acquireImageBarriers.empty()) {
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_current.acquireStages, 0,
+                0, nullptr,
+                static_cast<uint32_t>(m_current.acquireBufferBarriers.size()), m_current.acquireBufferBarriers.data(),
+                static_cast<uint32_t>(m_current.acquireImageBarriers.size()), m_current.acquireImageBarriers.data());
+        }
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record upload acquire command buffer!");
+        }
+    }
+
+    // 按提交顺序回收，保证completedTicket单调递增，小于它的ticket都已完成
+    void retireFront() {
+        m_completedTicket = m_inFlight.front().ticket;
+        m_stagingRing->retire(m_completedTicket);
+        for (auto& callback : m_inFlight.front().completionCallbacks) {
+            callback();
+        }
+        m_inFlight.front().completionCallbacks.clear();
+        m_freeBatches.push_back(std::move(m_inFlight.front()));
+        m_inFlight.pop_front();
+    }
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+// upload scheduler：上传的优先级，可见的资源在前，同样可见时距离近的在前
+struct UploadPriority {
+    bool visible = true;
+    float distance = 0.0f;
+
+    bool operator<(const UploadPriority& other) const {
+        if (visible != other.visible) {
+            return visible;
+        }
+        return distance < other.distance;
+    }
+};
+
+// upload scheduler：每帧拷贝的字节数和拷贝命令数有上限，很多资源同时加载完成时它们的上传分散到之后的帧，不集中在一帧中造成卡顿
+// 上传之前先request，beginFrame按优先级从高到低授权，直到这一帧的预算用完；priority在每次beginFrame时重新计算，相机移动时顺序跟着变化
+// 授权严格按优先级顺序，放不下的请求不会被后面更小的请求越过，同一个资源按顺序提交的多个请求按顺序授权
+// 一帧中第一个授权的请求不受预算限制，超出的字节数从之后的帧中扣除，单个比每帧预算还大的上传不会永远等待
+// 只在主线程使用
+class UploadScheduler {
+public:
+    using RequestId = uint64_t;
+
+    struct FrameStats {
+        uint64_t bytes = 0;
+        uint32_t copies = 0;
+        uint32_t granted = 0;
+        size_t pending = 0;
+    };
+
+    void init(uint64_t bytesPerFrame, uint32_t copiesPerFrame) {
+        m_bytesPerFrame = bytesPerFrame;
+        m_copiesPerFrame = copiesPerFrame;
+        m_byteCredit = static_cast<int64_t>(bytesPerFrame);
+    }
+
+    // upload scheduler：copies是这次上传录制的拷贝命令数，直接写入host visible内存时为0
+    RequestId request(uint64_t bytes, uint32_t copies, std::function<UploadPriority()> priority) {
+        RequestId id = m_nextId++;
+        m_pending.push_back({id, bytes, copies, std::move(priority), {}});
+        return id;
+    }
+
+    // upload scheduler：每帧在恢复等待上传的task之前调用一次
+    void beginFrame() {
+        m_byteCredit = std::min(m_byteCredit + static_cast<int64_t>(m_bytesPerFrame), static_cast<int64_t>(m_bytesPerFrame));
+        m_stats = {};
+        for (Request& request : m_pending) {
+            request.current = request.priority();
+        }
+        std::stable_sort(m_pending.begin(), m_pending.end(), [](const Request& a, const Request& b) { return a.current < b.current; });
+
+        uint32_t copiesLeft = m_copiesPerFrame;
+        size_t count = 0;
+        for (; count < m_pending.size() && m_byteCredit > 0; count++) {
+            const Request& request = m_pending[count];
+            bool fits = static_cast<int64_t>(request.bytes) <= m_byteCredit && request.copies <= copiesLeft;
+            if (!fits && count > 0) {
+                break;
+            }
+            m_byteCredit -= static_cast<int64_t>(request.bytes);
+            copiesLeft -= std::min(request.copies, copiesLeft);
+            m_stats.bytes += request.bytes;
+            m_stats.copies += request.copies;
+            m_granted.insert(request.id);
+        }
+        m_pending.erase(m_pending.begin(), m_pending.begin() + count);
+        m_stats.granted = static_cast<uint32_t>(count);
+        m_stats.pending = m_pending.size();
+    }
+
+    // upload scheduler：返回true之后调用者在这一帧录制上传，id不再有效
+    bool granted(RequestId id) { return m_granted.erase(id) > 0; }
+
+    bool idle() const { return m_pending.empty() && m_granted.empty(); }
+    const FrameStats& frameStats() const { return m_stats; }
+
+private:
+    struct Request {
+        RequestId id;
+        uint64_t bytes;
+        uint32_t copies;
+        std::function<UploadPriority()> priority;
+        UploadPriority current;
+    };
+
+    uint64_t m_bytesPerFrame = 0;
+    uint32_t m_copiesPerFrame = 0;
+    int64_t m_byteCredit = 0;  // 这一帧剩余的字节数，上一帧超出预算时为负
+    RequestId m_nextId = 1;
+    std::vector<Request> m_pending;
+    std::unordered_set<RequestId> m_granted;
+    FrameStats m_stats;
+};
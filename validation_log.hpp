@@ -0,0 +1,172 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// validation log：之前debugCallback在驱动调用的线程上同步写stderr，每条verbose消息都会让录制和提交停下来等输出
+// 现在回调只在锁内按message id计数，每个id只有前几次的消息进入队列，每秒进入队列的总数也有上限，后台线程负责格式化和输出
+// PERFORMANCE类型的消息不逐条输出，按id汇总次数和第一次的内容，退出时和被限制的消息数量一起输出报告
+// 回调可能在任意线程上被调用（包括录制线程和驱动自己的线程），所以只做计数和拷贝字符串
+class ValidationLog {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // validation log：perIdLimit是每个id逐条输出的次数，perSecondLimit是每秒逐条输出的总数
+    void init(uint32_t perIdLimit, uint32_t perSecondLimit) {
+        m_perIdLimit = perIdLimit;
+        m_perSecondLimit = perSecondLimit;
+        m_windowStart = Clock::now();
+        m_stop = false;
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    // validation log：vkDestroyInstance之后调用，销毁instance时的消息也会被输出
+    void cleanup() {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_one();
+        m_thread.join();
+        report();
+    }
+
+    // validation log：VKAPI_ATTR和VKAPI_CALL确保函数具有vulkan调用需要的签名，pUserData是这个对象
+    static VKAPI_ATTR VkBool32 VKAPI_CALL callback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType,
+        const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
+        static_cast<ValidationLog*>(pUserData)->add(messageSeverity, messageType, pCallbackData);
+        return VK_FALSE;
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        std::string firstMessage;
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+        bool performance = false;
+        uint64_t count = 0;
+        uint64_t suppressed = 0;  // 超过perIdLimit或者每秒上限没有逐条输出的次数
+    };
+
+    struct Pending {
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+        std::string message;
+        uint64_t count;  // 这个id到这条为止的次数
+    };
+
+    void add(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT type, const VkDebugUtilsMessengerCallbackDataEXT* data) {
+        const char* message = data->pMessage != nullptr ? data->pMessage : "";
+        const char* name = data->pMessageIdName != nullptr ? data->pMessageIdName : "";
+        // validation log：一些消息（比如loader的消息）没有id，用名字和内容区分
+        uint64_t key = data->messageIdNumber != 0 ? static_cast<uint32_t>(data->messageIdNumber) : std::hash<std::string>{}(std::string(name) + message);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Entry& entry = m_entries[key];
+        if (entry.count++ == 0) {
+            entry.name = name;
+            entry.firstMessage = message;
+            entry.severity = severity;
+            entry.performance = (type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT) != 0;
+        }
+        if (entry.performance) {
+            return;  // 只进入报告
+        }
+
+        Clock::time_point now = Clock::now();
+        if (now - m_windowStart >= std::chrono::seconds(1)) {
+            m_windowStart = now;
+            m_windowCount = 0;
+        }
+        if (entry.count > m_perIdLimit || m_windowCount >= m_perSecondLimit) {
+            entry.suppressed++;
+            return;
+        }
+        m_windowCount++;
+        m_pending.push_back({severity, message, entry.count});
+        m_condition.notify_one();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_condition.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+            if (m_pending.empty() && m_stop) {
+                return;
+            }
+            std::deque<Pending> batch;
+            batch.swap(m_pending);
+            lock.unlock();
+            for (const Pending& pending : batch) {
+                std::fprintf(stderr, "validation layer (%s): %s\n", severityName(pending.severity), pending.message.c_str());
+                if (pending.count == m_perIdLimit) {
+                    std::fprintf(stderr, "validation layer: further messages with this id are counted in the exit report\n");
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    void report() {
+        std::vector<const Entry*> performance;
+        std::vector<const Entry*> suppressed;
+        for (const auto& [key, entry] : m_entries) {
+            if (entry.performance) {
+                performance.push_back(&entry);
+            } else if (entry.suppressed > 0) {
+                suppressed.push_back(&entry);
+            }
+        }
+        auto byCount = [](const Entry* a, const Entry* b) { return a->count > b->count; };
+        std::sort(performance.begin(), performance.end(), byCount);
+        std::sort(suppressed.begin(), suppressed.end(), byCount);
+
+        if (!performance.empty()) {
+            std::fprintf(stderr, "validation performance warnings:\n");
+            for (const Entry* entry : performance) {
+                std::fprintf(stderr, "  %8llu x %s: %s\n", static_cast<unsigned long long>(entry->count), entry->name.c_str(), entry->firstMessage.c_str());
+            }
+        }
+        if (!suppressed.empty()) {
+            std::fprintf(stderr, "validation messages not logged individually:\n");
+            for (const Entry* entry : suppressed) {
+                std::fprintf(stderr, "  %8llu of %llu x (%s) %s\n", static_cast<unsigned long long>(entry->suppressed),
+                    static_cast<unsigned long long>(entry->count), severityName(entry->severity), entry->name.c_str());
+            }
+        }
+    }
+
+    static const char* severityName(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+        switch (severity) {
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT: return "error";
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT: return "warning";
+            case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT: return "info";
+            default: return "verbose";
+        }
+    }
+
+    uint32_t m_perIdLimit = 0;
+    uint32_t m_perSecondLimit = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    std::deque<Pending> m_pending;
+    Clock::time_point m_windowStart;
+    uint32_t m_windowCount = 0;
+    bool m_stop = false;
+    std::thread m_thread;
+};
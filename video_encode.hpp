@@ -0,0 +1,1121 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "device_capabilities.hpp"
+#include "host_memory.hpp"
+#include "memory_allocator.hpp"
+#include "shader_registry.hpp"
+#include "timeline_semaphore.hpp"
+
+// video encode：用VK_KHR_video_encode_h264把渲染结果编码成H.264，数据一直在gpu上，cpu只读取编码后的码流
+// 图形队列在这一帧的场景之后把color target拷贝到buffer，compute转换成NV12，再拷贝到编码的输入image（CONCURRENT，图形和编码队列共用）
+// 编码队列有自己的command pool和timeline，提交等待这一帧图形timeline的值；码流写入host visible的buffer，之后的帧看到编码timeline完成时写到文件
+// 只用IDR和P帧，一个参考帧，两个DPB slot交替；每idrPeriod帧一个IDR，IDR之前重复SPS/PPS，中途接入的viewer可以从IDR开始解码
+// 支持CBR时使用CBR，码率稳定，虚拟缓冲只有两帧，每帧的大小接近，延迟不会因为个别大帧抖动；输入的slot都在使用中时丢弃这一帧，渲染不等待编码
+class VideoEncoder {
+public:
+    static constexpr uint32_t MAX_SLOTS = 4;
+    static constexpr uint32_t DPB_SLOTS = 2;
+    static constexpr uint32_t LOG2_MAX_FRAME_NUM = 4;  // frame_num在0到15之间循环
+
+    struct Settings {
+        uint32_t slotCount = 3;
+        uint32_t frameRate = 60;
+        uint32_t bitrate = 8000000;  // 比特每秒
+        uint32_t idrPeriod = 60;
+    };
+
+    // video encode：设备支持编码H.264的queue family，没有时返回空；扩展和synchronization2由调用者检查
+    static std::optional<uint32_t> findQueueFamily(VkPhysicalDevice physicalDevice) {
+        uint32_t count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties2(physicalDevice, &count, nullptr);
+        std::vector<VkQueueFamilyVideoPropertiesKHR> videoProperties(count);
+        std::vector<VkQueueFamilyProperties2> properties(count);
+        for (uint32_t i = 0; i < count; i++) {
+            videoProperties[i].sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_VIDEO_PROPERTIES_KHR;
+            properties[i].sType = VK_STRUCTURE_TYPE_QUEUE_FAMILY_PROPERTIES_2;
+            properties[i].pNext = &videoProperties[i];
+        }
+        vkGetPhysicalDeviceQueueFamilyProperties2(physicalDevice, &count, properties.data());
+        for (uint32_t i = 0; i < count; i++) {
+            if ((properties[i].queueFamilyProperties.queueFlags & VK_QUEUE_VIDEO_ENCODE_BIT_KHR)
+                && (videoProperties[i].videoCodecOperations & VK_VIDEO_CODEC_OPERATION_ENCODE_H264_BIT_KHR)) {
+                return i;
+            }
+        }
+        return std::nullopt;
+    }
+
+    static bool supported(const DeviceCapabilities& capabilities) {
+        return capabilities.synchronization2 && capabilities.hasExtension(VK_KHR_VIDEO_QUEUE_EXTENSION_NAME)
+            && capabilities.hasExtension(VK_KHR_VIDEO_ENCODE_QUEUE_EXTENSION_NAME) && capabilities.hasExtension(VK_KHR_VIDEO_ENCODE_H264_EXTENSION_NAME);
+    }
+
+    static std::vector<const char*> extensions() {
+        return {VK_KHR_VIDEO_QUEUE_EXTENSION_NAME, VK_KHR_VIDEO_ENCODE_QUEUE_EXTENSION_NAME, VK_KHR_VIDEO_ENCODE_H264_EXTENSION_NAME};
+    }
+
+    // video encode：extent是画面大小，编码的大小按宏块对齐；graphicsFamily的command pool用来录制转换，encodeFamily的队列执行编码
+    // 设备不支持这个profile或者需要的格式时返回false，encoder保持未初始化
+    bool init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache pipelineCache,
+        const SpirvCode& convertCode, VkCommandPool graphicsCommandPool, uint32_t graphicsFamily, uint32_t encodeFamily, VkQueue encodeQueue,
+        VkExtent2D extent, const Settings& settings, const std::string& outputPath) {
+        m_device = device;
+        m_allocator = &allocator;
+        m_graphicsCommandPool = graphicsCommandPool;
+        m_encodeQueue = encodeQueue;
+        m_encodeFamily = encodeFamily;
+        m_settings = settings;
+        m_settings.slotCount = std::clamp(settings.slotCount, 1u, MAX_SLOTS);
+        m_settings.idrPeriod = std::max(settings.idrPeriod, 1u);
+        m_visibleExtent = extent;
+        m_codedExtent = {(extent.width + 15) & ~15u, (extent.height + 15) & ~15u};
+        loadFunctions(instance);
+
+        if (!queryCapabilities(physicalDevice)) {
+            m_device = VK_NULL_HANDLE;
+            return false;
+        }
+        m_output.open(outputPath, std::ios::binary);
+        if (!m_output) {
+            throw std::runtime_error("failed to open video encode output!");
+        }
+
+        std::array<uint32_t, 2> families = {graphicsFamily, encodeFamily};
+        createSession();
+        createSessionParameters();
+        createDpb();
+        createPipeline(pipelineCache, convertCode);
+        createSlots(families, graphicsFamily != encodeFamily);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = encodeFamily;
+        if (vkCreateCommandPool(m_device, &poolInfo, hostAllocator(), &m_encodeCommandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video encode command pool!");
+        }
+        allocateCommandBuffers(m_encodeCommandPool, [](Slot& slot) -> VkCommandBuffer& { return slot.encodeCommands; });
+        allocateCommandBuffers(m_graphicsCommandPool, [](Slot& slot) -> VkCommandBuffer& { return slot.convertCommands; });
+        m_timeline.init(device);
+        return true;
+    }
+
+    // video encode：调用者保证两个队列都已经空闲，剩下的码流写到文件
+    void cleanup() {
+        if (m_device == VK_NULL_HANDLE) {
+            return;
+        }
+        collect();
+        if (m_encodedFrames > 0) {
+            std::cout << "video encode: " << m_encodedFrames << " frames, " << m_droppedFrames << " dropped, average "
+                << (m_encodedBytes / m_encodedFrames) << " bytes per frame" << std::endl;
+        }
+        m_output.close();
+        m_timeline.cleanup();
+        vkDestroyCommandPool(m_device, m_encodeCommandPool, hostAllocator());
+        for (Slot& slot : m_slots) {
+            vkFreeCommandBuffers(m_device, m_graphicsCommandPool, 1, &slot.convertCommands);
+            vkDestroyImageView(m_device, slot.inputView, hostAllocator());
+            vkDestroyImage(m_device, slot.input, hostAllocator());
+            m_allocator->free(slot.inputAllocation);
+            for (Buffer* buffer : {&slot.source, &slot.luma, &slot.chroma}) {
+                destroyBuffer(*buffer);
+            }
+        }
+        m_slots.clear();
+        destroyBuffer(m_bitstream);
+        vkDestroyQueryPool(m_device, m_queryPool, hostAllocator());
+        vkDestroyDescriptorPool(m_device, m_descriptorPool, hostAllocator());
+        vkDestroyPipeline(m_device, m_pipeline, hostAllocator());
+        vkDestroyPipelineLayout(m_device, m_pipelineLayout, hostAllocator());
+        vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, hostAllocator());
+        for (VkImageView view : m_dpbViews) {
+            vkDestroyImageView(m_device, view, hostAllocator());
+        }
+        vkDestroyImage(m_device, m_dpb, hostAllocator());
+        m_allocator->free(m_dpbAllocation);
+        m_destroyVideoSessionParameters(m_device, m_sessionParameters, hostAllocator());
+        m_destroyVideoSession(m_device, m_session, hostAllocator());
+        for (Allocation& allocation : m_sessionAllocations) {
+            m_allocator->free(allocation);
+        }
+        m_sessionAllocations.clear();
+        m_device = VK_NULL_HANDLE;
+    }
+
+    bool initialized() const { return m_device != VK_NULL_HANDLE; }
+    uint64_t encodedFrames() const { return m_encodedFrames; }
+
+    // video encode：在这一帧的场景命令之后提交，image在layout中，转换之后回到同一个layout；没有空闲的slot时返回VK_NULL_HANDLE，这一帧不编码
+    VkCommandBuffer recordInput(VkImage image, VkFormat format, VkExtent2D extent, VkImageLayout layout) {
+        m_pendingSlot = NO_SLOT;
+        bool bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+        if (!bgra && format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB) {
+            return VK_NULL_HANDLE;
+        }
+        uint32_t slotIndex = NO_SLOT;
+        for (uint32_t i = 0; i < m_slots.size(); i++) {
+            if (!m_slots[i].encoding) {
+                slotIndex = i;
+                break;
+            }
+        }
+        if (slotIndex == NO_SLOT) {
+            m_droppedFrames++;
+            return VK_NULL_HANDLE;
+        }
+        Slot& slot = m_slots[slotIndex];
+        VkDeviceSize sourceSize = VkDeviceSize(extent.width) * extent.height * 4;
+        if (slot.source.size < sourceSize) {
+            destroyBuffer(slot.source);
+            slot.source = createBuffer(sourceSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                MemoryCategory::attachment, "video encode source");
+            writeDescriptors(slot);
+        }
+
+        VkCommandBuffer commandBuffer = slot.convertCommands;
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording video convert command buffer!");
+        }
+
+        // video encode：和frame capture一样，color target可能由render pass、dynamic rendering或者post process的compute写入
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = layout;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {extent.width, extent.height, 1};
+        vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.source.buffer, 1, &region);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = layout;
+        VkMemoryBarrier copyBarrier{};
+        copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        copyBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        copyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 1,
+            &copyBarrier, 0, nullptr, 1, &barrier);
+
+        ConvertParams params{};
+        params.source = {extent.width, extent.height, bgra ? 1u : 0u, 0};
+        params.target = {m_codedExtent.width, m_codedExtent.height, m_visibleExtent.width, m_visibleExtent.height};
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &slot.descriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ConvertParams), &params);
+        vkCmdDispatch(commandBuffer, (m_codedExtent.width / 4 + 7) / 8, (m_codedExtent.height / 2 + 7) / 8, 1);
+
+        // video encode：输入image之前的内容不需要保留，编码队列上次读取它的提交已经完成（slot不在encoding状态）
+        VkImageMemoryBarrier inputBarrier{};
+        inputBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        inputBarrier.srcAccessMask = 0;
+        inputBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        inputBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        inputBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        inputBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        inputBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        inputBarrier.image = slot.input;
+        inputBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        VkMemoryBarrier convertBarrier{};
+        convertBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        convertBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        convertBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &convertBarrier, 0, nullptr, 1, &inputBarrier);
+
+        // video encode：亮度和CbCr分别拷贝到NV12的两个plane，buffer和plane都是紧密排列的
+        std::array<VkBufferImageCopy, 2> planeCopies{};
+        planeCopies[0].imageSubresource = {VK_IMAGE_ASPECT_PLANE_0_BIT, 0, 0, 1};
+        planeCopies[0].imageExtent = {m_codedExtent.width, m_codedExtent.height, 1};
+        planeCopies[1].imageSubresource = {VK_IMAGE_ASPECT_PLANE_1_BIT, 0, 0, 1};
+        planeCopies[1].imageExtent = {m_codedExtent.width / 2, m_codedExtent.height / 2, 1};
+        vkCmdCopyBufferToImage(commandBuffer, slot.luma.buffer, slot.input, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &planeCopies[0]);
+        vkCmdCopyBufferToImage(commandBuffer, slot.chroma.buffer, slot.input, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &planeCopies[1]);
+
+        // video encode：image是CONCURRENT的，不需要转移所有权；编码队列的提交等待这次提交的timeline，semaphore保证了可见性
+        inputBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        inputBarrier.dstAccessMask = 0;
+        inputBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        inputBarrier.newLayout = VK_IMAGE_LAYOUT_VIDEO_ENCODE_SRC_KHR;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &inputBarrier);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record video convert command buffer!");
+        }
+        m_pendingSlot = slotIndex;
+        return commandBuffer;
+    }
+
+    // video encode：recordInput返回的command buffer已经在图形队列提交，graphicsValue是那次提交signal的值
+    // 编码命令在这里录制并提交到编码队列，不等待cpu
+    void submit(VkSemaphore graphicsTimeline, uint64_t graphicsValue) {
+        if (m_pendingSlot == NO_SLOT) {
+            return;
+        }
+        Slot& slot = m_slots[m_pendingSlot];
+        uint32_t slotIndex = m_pendingSlot;
+        m_pendingSlot = NO_SLOT;
+
+        bool idr = m_frameCount % m_settings.idrPeriod == 0;
+        if (idr) {
+            m_framesSinceIdr = 0;
+            m_idrCount++;
+        }
+        uint32_t setupSlot = m_frameCount % DPB_SLOTS;
+        uint32_t referenceSlot = (m_frameCount + DPB_SLOTS - 1) % DPB_SLOTS;
+        slot.idr = idr;
+        recordEncode(slot, slotIndex, idr, setupSlot, referenceSlot);
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        uint64_t encodeValue = m_timeline.nextValue();
+        VkSemaphore signalSemaphore = m_timeline.handle();
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = &graphicsValue;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &encodeValue;
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &graphicsTimeline;
+        submitInfo.pWaitDstStageMask = &waitStage;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &slot.encodeCommands;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &signalSemaphore;
+        if (vkQueueSubmit(m_encodeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit video encode command buffer!");
+        }
+        slot.encodeValue = encodeValue;
+        slot.encoding = true;
+
+        // video encode：这一帧成为下一帧的参考
+        DpbSlot& written = m_dpbState[setupSlot];
+        written.valid = true;
+        written.frameNum = m_framesSinceIdr % (1u << LOG2_MAX_FRAME_NUM);
+        written.pictureOrderCount = static_cast<int32_t>(m_framesSinceIdr * 2);
+        written.idr = idr;
+        m_framesSinceIdr++;
+        m_frameCount++;
+        m_sessionReset = true;
+    }
+
+    // video encode：每帧调用一次，只查询timeline，不等待；编码完成的slot把码流写到文件后回到空闲
+    // slot按提交顺序编码，按提交顺序写出，前一个没有完成时后面的也不写
+    void collect() {
+        uint64_t completed = m_timeline.completedValue();
+        while (true) {
+            Slot* next = nullptr;
+            for (Slot& slot : m_slots) {
+                if (slot.encoding && (next == nullptr || slot.encodeValue < next->encodeValue)) {
+                    next = &slot;
+                }
+            }
+            if (next == nullptr || next->encodeValue > completed) {
+                return;
+            }
+            writeBitstream(*next);
+            next->encoding = false;
+        }
+    }
+
+private:
+    static constexpr uint32_t NO_SLOT = ~0u;
+
+    struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation allocation;
+        VkDeviceSize size = 0;
+    };
+
+    struct Slot {
+        Buffer source;  // color target拷贝出来的RGBA或者BGRA
+        Buffer luma;
+        Buffer chroma;
+        VkImage input = VK_NULL_HANDLE;  // NV12，编码的输入
+        Allocation inputAllocation;
+        VkImageView inputView = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        VkCommandBuffer convertCommands = VK_NULL_HANDLE;
+        VkCommandBuffer encodeCommands = VK_NULL_HANDLE;
+        VkDeviceSize bitstreamOffset = 0;
+        uint64_t encodeValue = 0;
+        bool encoding = false;
+        bool idr = false;
+    };
+
+    struct DpbSlot {
+        bool valid = false;
+        bool idr = false;
+        uint32_t frameNum = 0;
+        int32_t pictureOrderCount = 0;
+    };
+
+    struct ConvertParams {
+        std::array<uint32_t, 4> source;
+        std::array<uint32_t, 4> target;
+    };
+
+    template <typename Function>
+    void loadDeviceFunction(Function& function, const char* name) {
+        function = (Function) vkGetDeviceProcAddr(m_device, name);
+        if (function == nullptr) {
+            throw std::runtime_error("failed to load video encode functions!");
+        }
+    }
+
+    void loadFunctions(VkInstance instance) {
+        m_getVideoCapabilities = (PFN_vkGetPhysicalDeviceVideoCapabilitiesKHR) vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceVideoCapabilitiesKHR");
+        m_getVideoFormatProperties = (PFN_vkGetPhysicalDeviceVideoFormatPropertiesKHR) vkGetInstanceProcAddr(instance,
+            "vkGetPhysicalDeviceVideoFormatPropertiesKHR");
+        if (m_getVideoCapabilities == nullptr || m_getVideoFormatProperties == nullptr) {
+            throw std::runtime_error("failed to load video encode functions!");
+        }
+        loadDeviceFunction(m_createVideoSession, "vkCreateVideoSessionKHR");
+        loadDeviceFunction(m_destroyVideoSession, "vkDestroyVideoSessionKHR");
+        loadDeviceFunction(m_getVideoSessionMemoryRequirements, "vkGetVideoSessionMemoryRequirementsKHR");
+        loadDeviceFunction(m_bindVideoSessionMemory, "vkBindVideoSessionMemoryKHR");
+        loadDeviceFunction(m_createVideoSessionParameters, "vkCreateVideoSessionParametersKHR");
+        loadDeviceFunction(m_destroyVideoSessionParameters, "vkDestroyVideoSessionParametersKHR");
+        loadDeviceFunction(m_getEncodedVideoSessionParameters, "vkGetEncodedVideoSessionParametersKHR");
+        loadDeviceFunction(m_cmdBeginVideoCoding, "vkCmdBeginVideoCodingKHR");
+        loadDeviceFunction(m_cmdEndVideoCoding, "vkCmdEndVideoCodingKHR");
+        loadDeviceFunction(m_cmdControlVideoCoding, "vkCmdControlVideoCodingKHR");
+        loadDeviceFunction(m_cmdEncodeVideo, "vkCmdEncodeVideoKHR");
+        // synchronization2：1.3的设备返回core函数，否则返回扩展的KHR函数
+        m_cmdPipelineBarrier2 = (PFN_vkCmdPipelineBarrier2) vkGetDeviceProcAddr(m_device, "vkCmdPipelineBarrier2");
+        if (m_cmdPipelineBarrier2 == nullptr) {
+            loadDeviceFunction(m_cmdPipelineBarrier2, "vkCmdPipelineBarrier2KHR");
+        }
+    }
+
+    // video encode：profile的结构体链在整个生命周期中被session、image、buffer和query pool的创建信息引用，所以是成员
+    void initProfile() {
+        m_usageInfo = {};
+        m_usageInfo.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_USAGE_INFO_KHR;
+        m_usageInfo.videoUsageHints = VK_VIDEO_ENCODE_USAGE_STREAMING_BIT_KHR;
+        m_usageInfo.videoContentHints = VK_VIDEO_ENCODE_CONTENT_RENDERED_BIT_KHR;
+        m_usageInfo.tuningMode = VK_VIDEO_ENCODE_TUNING_MODE_LOW_LATENCY_KHR;
+        m_h264Profile = {};
+        m_h264Profile.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_PROFILE_INFO_KHR;
+        m_h264Profile.pNext = &m_usageInfo;
+        m_h264Profile.stdProfileIdc = STD_VIDEO_H264_PROFILE_IDC_MAIN;
+        m_profile = {};
+        m_profile.sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_INFO_KHR;
+        m_profile.pNext = &m_h264Profile;
+        m_profile.videoCodecOperation = VK_VIDEO_CODEC_OPERATION_ENCODE_H264_BIT_KHR;
+        m_profile.chromaSubsampling = VK_VIDEO_CHROMA_SUBSAMPLING_420_BIT_KHR;
+        m_profile.lumaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
+        m_profile.chromaBitDepth = VK_VIDEO_COMPONENT_BIT_DEPTH_8_BIT_KHR;
+        m_profileList = {};
+        m_profileList.sType = VK_STRUCTURE_TYPE_VIDEO_PROFILE_LIST_INFO_KHR;
+        m_profileList.profileCount = 1;
+        m_profileList.pProfiles = &m_profile;
+    }
+
+    // video encode：image的用法必须在格式查询的结果中，NV12需要支持拷贝写入，因为转换的结果用buffer拷贝进去
+    bool findFormat(VkPhysicalDevice physicalDevice, VkImageUsageFlags usage, VkImageUsageFlags required, VkVideoFormatPropertiesKHR& result) {
+        VkPhysicalDeviceVideoFormatInfoKHR formatInfo{};
+        formatInfo.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VIDEO_FORMAT_INFO_KHR;
+        formatInfo.pNext = &m_profileList;
+        formatInfo.imageUsage = usage;
+        uint32_t count = 0;
+        if (m_getVideoFormatProperties(physicalDevice, &formatInfo, &count, nullptr) != VK_SUCCESS || count == 0) {
+            return false;
+        }
+        std::vector<VkVideoFormatPropertiesKHR> properties(count);
+        for (VkVideoFormatPropertiesKHR& property : properties) {
+            property.sType = VK_STRUCTURE_TYPE_VIDEO_FORMAT_PROPERTIES_KHR;
+        }
+        m_getVideoFormatProperties(physicalDevice, &formatInfo, &count, properties.data());
+        for (const VkVideoFormatPropertiesKHR& property : properties) {
+            if (property.format == VK_FORMAT_G8_B8R8_2PLANE_420_UNORM && (property.imageUsageFlags & required) == required) {
+                result = property;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool queryCapabilities(VkPhysicalDevice physicalDevice) {
+        initProfile();
+        m_h264Capabilities = {};
+        m_h264Capabilities.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_CAPABILITIES_KHR;
+        m_encodeCapabilities = {};
+        m_encodeCapabilities.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_CAPABILITIES_KHR;
+        m_encodeCapabilities.pNext = &m_h264Capabilities;
+        m_capabilities = {};
+        m_capabilities.sType = VK_STRUCTURE_TYPE_VIDEO_CAPABILITIES_KHR;
+        m_capabilities.pNext = &m_encodeCapabilities;
+        if (m_getVideoCapabilities(physicalDevice, &m_profile, &m_capabilities) != VK_SUCCESS) {
+            std::cout << "video encode: H.264 main profile is not supported" << std::endl;
+            return false;
+        }
+        VkVideoEncodeFeedbackFlagsKHR feedback = VK_VIDEO_ENCODE_FEEDBACK_BITSTREAM_BUFFER_OFFSET_BIT_KHR | VK_VIDEO_ENCODE_FEEDBACK_BITSTREAM_BYTES_WRITTEN_BIT_KHR;
+        const char* reason = nullptr;
+        if (m_codedExtent.width < m_capabilities.minCodedExtent.width || m_codedExtent.height < m_capabilities.minCodedExtent.height
+            || m_codedExtent.width > m_capabilities.maxCodedExtent.width || m_codedExtent.height > m_capabilities.maxCodedExtent.height) {
+            reason = "the frame size is outside the coded extent limits";
+        } else if (m_capabilities.maxDpbSlots < DPB_SLOTS || m_capabilities.maxActiveReferencePictures < 1 || m_h264Capabilities.maxPPictureL0ReferenceCount < 1) {
+            reason = "P frames with one reference are not supported";
+        } else if ((m_encodeCapabilities.supportedEncodeFeedbackFlags & feedback) != feedback) {
+            reason = "bitstream feedback is not supported";
+        } else if (!findFormat(physicalDevice, VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR, VK_IMAGE_USAGE_TRANSFER_DST_BIT, m_inputFormat)) {
+            reason = "no NV12 input format that can be written by copies";
+        } else if (!findFormat(physicalDevice, VK_IMAGE_USAGE_VIDEO_ENCODE_DPB_BIT_KHR, 0, m_dpbFormat)) {
+            reason = "no NV12 reference picture format";
+        }
+        if (reason != nullptr) {
+            std::cout << "video encode: disabled, " << reason << std::endl;
+            return false;
+        }
+        // video encode：CBR让每帧的大小稳定，不支持时由驱动决定码率控制
+        m_rateControlMode = (m_encodeCapabilities.rateControlModes & VK_VIDEO_ENCODE_RATE_CONTROL_MODE_CBR_BIT_KHR)
+            ? VK_VIDEO_ENCODE_RATE_CONTROL_MODE_CBR_BIT_KHR : VK_VIDEO_ENCODE_RATE_CONTROL_MODE_DEFAULT_KHR;
+        m_bitrate = std::min<uint64_t>(m_settings.bitrate, m_encodeCapabilities.maxBitrate);
+        return true;
+    }
+
+    void createSession() {
+        VkVideoSessionCreateInfoKHR sessionInfo{};
+        sessionInfo.sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_CREATE_INFO_KHR;
+        sessionInfo.queueFamilyIndex = m_encodeFamily;
+        sessionInfo.pVideoProfile = &m_profile;
+        sessionInfo.pictureFormat = m_inputFormat.format;
+        sessionInfo.maxCodedExtent = m_codedExtent;
+        sessionInfo.referencePictureFormat = m_dpbFormat.format;
+        sessionInfo.maxDpbSlots = DPB_SLOTS;
+        sessionInfo.maxActiveReferencePictures = 1;
+        sessionInfo.pStdHeaderVersion = &m_capabilities.stdHeaderVersion;
+        if (m_createVideoSession(m_device, &sessionInfo, hostAllocator(), &m_session) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video session!");
+        }
+
+        // video encode：session的内存由应用分配，每个bind index一块，驱动给出的类型之外没有其它要求
+        uint32_t count = 0;
+        m_getVideoSessionMemoryRequirements(m_device, m_session, &count, nullptr);
+        std::vector<VkVideoSessionMemoryRequirementsKHR> requirements(count);
+        for (VkVideoSessionMemoryRequirementsKHR& requirement : requirements) {
+            requirement.sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_MEMORY_REQUIREMENTS_KHR;
+        }
+        m_getVideoSessionMemoryRequirements(m_device, m_session, &count, requirements.data());
+        std::vector<VkBindVideoSessionMemoryInfoKHR> binds(count);
+        for (uint32_t i = 0; i < count; i++) {
+            binds[i].sType = VK_STRUCTURE_TYPE_BIND_VIDEO_SESSION_MEMORY_INFO_KHR;
+            Allocation allocation = m_allocator->allocate(requirements[i].memoryRequirements, 0, false, MemoryCategory::other,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "video session");
+            binds[i].memoryBindIndex = requirements[i].memoryBindIndex;
+            binds[i].memory = allocation.memory;
+            binds[i].memoryOffset = allocation.offset;
+            binds[i].memorySize = requirements[i].memoryRequirements.size;
+            m_sessionAllocations.push_back(allocation);
+        }
+        if (count > 0 && m_bindVideoSessionMemory(m_device, m_session, count, binds.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to bind video session memory!");
+        }
+    }
+
+    // video encode：SPS/PPS，编码的大小按宏块对齐，用cropping还原画面大小；VUI标明BT.709、limited range和帧率
+    void createSessionParameters() {
+        StdVideoH264SequenceParameterSetVui vui{};
+        vui.flags.video_signal_type_present_flag = 1;
+        vui.flags.color_description_present_flag = 1;
+        vui.flags.timing_info_present_flag = 1;
+        vui.flags.fixed_frame_rate_flag = 1;
+        vui.video_format = 5;  // unspecified
+        vui.colour_primaries = 1;  // BT.709
+        vui.transfer_characteristics = 1;
+        vui.matrix_coefficients = 1;
+        vui.num_units_in_tick = 1;
+        vui.time_scale = m_settings.frameRate * 2;  // 一帧两个tick
+
+        StdVideoH264SequenceParameterSet sps{};
+        sps.flags.frame_mbs_only_flag = 1;
+        sps.flags.direct_8x8_inference_flag = 1;
+        sps.flags.vui_parameters_present_flag = 1;
+        sps.profile_idc = STD_VIDEO_H264_PROFILE_IDC_MAIN;
+        sps.level_idc = std::min(m_h264Capabilities.maxLevelIdc, STD_VIDEO_H264_LEVEL_IDC_5_1);
+        sps.chroma_format_idc = STD_VIDEO_H264_CHROMA_FORMAT_IDC_420;
+        sps.seq_parameter_set_id = 0;
+        sps.log2_max_frame_num_minus4 = LOG2_MAX_FRAME_NUM - 4;
+        sps.pic_order_cnt_type = STD_VIDEO_H264_POC_TYPE_2;  // 没有B帧，显示顺序就是解码顺序
+        sps.max_num_ref_frames = 1;
+        sps.pic_width_in_mbs_minus1 = m_codedExtent.width / 16 - 1;
+        sps.pic_height_in_map_units_minus1 = m_codedExtent.height / 16 - 1;
+        if (m_codedExtent.width != m_visibleExtent.width || m_codedExtent.height != m_visibleExtent.height) {
+            sps.flags.frame_cropping_flag = 1;
+            sps.frame_crop_right_offset = (m_codedExtent.width - m_visibleExtent.width) / 2;  // 4:2:0的单位是两个像素
+            sps.frame_crop_bottom_offset = (m_codedExtent.height - m_visibleExtent.height) / 2;
+        }
+        sps.pSequenceParameterSetVui = &vui;
+
+        StdVideoH264PictureParameterSet pps{};
+        pps.flags.deblocking_filter_control_present_flag = 1;
+        pps.flags.entropy_coding_mode_flag = (m_h264Capabilities.stdSyntaxFlags & VK_VIDEO_ENCODE_H264_STD_ENTROPY_CODING_MODE_FLAG_SET_BIT_KHR) ? 1 : 0;
+        pps.seq_parameter_set_id = 0;
+        pps.pic_parameter_set_id = 0;
+        pps.num_ref_idx_l0_default_active_minus1 = 0;
+
+        VkVideoEncodeH264SessionParametersAddInfoKHR addInfo{};
+        addInfo.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_SESSION_PARAMETERS_ADD_INFO_KHR;
+        addInfo.stdSPSCount = 1;
+        addInfo.pStdSPSs = &sps;
+        addInfo.stdPPSCount = 1;
+        addInfo.pStdPPSs = &pps;
+        VkVideoEncodeH264SessionParametersCreateInfoKHR h264Info{};
+        h264Info.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_SESSION_PARAMETERS_CREATE_INFO_KHR;
+        h264Info.maxStdSPSCount = 1;
+        h264Info.maxStdPPSCount = 1;
+        h264Info.pParametersAddInfo = &addInfo;
+        VkVideoSessionParametersCreateInfoKHR parametersInfo{};
+        parametersInfo.sType = VK_STRUCTURE_TYPE_VIDEO_SESSION_PARAMETERS_CREATE_INFO_KHR;
+        parametersInfo.pNext = &h264Info;
+        parametersInfo.videoSession = m_session;
+        if (m_createVideoSessionParameters(m_device, &parametersInfo, hostAllocator(), &m_sessionParameters) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video session parameters!");
+        }
+
+        // video encode：驱动可能修改了参数，写到码流中的SPS/PPS从驱动取得
+        VkVideoEncodeH264SessionParametersGetInfoKHR h264Get{};
+        h264Get.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_SESSION_PARAMETERS_GET_INFO_KHR;
+        h264Get.writeStdSPS = VK_TRUE;
+        h264Get.writeStdPPS = VK_TRUE;
+        VkVideoEncodeSessionParametersGetInfoKHR getInfo{};
+        getInfo.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_SESSION_PARAMETERS_GET_INFO_KHR;
+        getInfo.pNext = &h264Get;
+        getInfo.videoSessionParameters = m_sessionParameters;
+        size_t size = 0;
+        if (m_getEncodedVideoSessionParameters(m_device, &getInfo, nullptr, &size, nullptr) != VK_SUCCESS) {
+            throw std::runtime_error("failed to get encoded video session parameters!");
+        }
+        m_parameterSets.resize(size);
+        if (m_getEncodedVideoSessionParameters(m_device, &getInfo, nullptr, &size, m_parameterSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to get encoded video session parameters!");
+        }
+        m_parameterSets.resize(size);
+    }
+
+    VkImage createVideoImage(const VkVideoFormatPropertiesKHR& format, VkImageUsageFlags usage, uint32_t layers, const std::array<uint32_t, 2>& families,
+        bool concurrent, Allocation& allocation, const char* name) {
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.pNext = &m_profileList;
+        imageInfo.flags = format.imageCreateFlags;
+        imageInfo.imageType = format.imageType;
+        imageInfo.format = format.format;
+        imageInfo.extent = {m_codedExtent.width, m_codedExtent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = layers;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = format.imageTiling;
+        imageInfo.usage = usage;
+        imageInfo.sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.queueFamilyIndexCount = concurrent ? static_cast<uint32_t>(families.size()) : 0;
+        imageInfo.pQueueFamilyIndices = concurrent ? families.data() : nullptr;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImage image;
+        if (vkCreateImage(m_device, &imageInfo, hostAllocator(), &image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video encode image!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_device, image, &memRequirements);
+        allocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, format.imageTiling == VK_IMAGE_TILING_LINEAR,
+            MemoryCategory::attachment, 0, name);
+        vkBindImageMemory(m_device, image, allocation.memory, allocation.offset);
+        return image;
+    }
+
+    VkImageView createVideoImageView(VkImage image, VkFormat format, uint32_t layer) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, layer, 1};
+        VkImageView view;
+        if (vkCreateImageView(m_device, &viewInfo, hostAllocator(), &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video encode image view!");
+        }
+        return view;
+    }
+
+    // video encode：两个DPB slot放在同一个image的两层，设备不支持分开的参考image时也可以使用
+    void createDpb() {
+        std::array<uint32_t, 2> families{};
+        m_dpb = createVideoImage(m_dpbFormat, VK_IMAGE_USAGE_VIDEO_ENCODE_DPB_BIT_KHR, DPB_SLOTS, families, false, m_dpbAllocation, "video encode dpb");
+        for (uint32_t i = 0; i < DPB_SLOTS; i++) {
+            m_dpbViews[i] = createVideoImageView(m_dpb, m_dpbFormat.format, i);
+            m_dpbState[i] = {};
+        }
+    }
+
+    void createSlots(const std::array<uint32_t, 2>& families, bool concurrent) {
+        VkDeviceSize lumaSize = VkDeviceSize(m_codedExtent.width) * m_codedExtent.height;
+        VkDeviceSize alignment = std::max<VkDeviceSize>(m_capabilities.minBitstreamBufferOffsetAlignment, 1);
+        VkDeviceSize sizeAlignment = std::max<VkDeviceSize>(m_capabilities.minBitstreamBufferSizeAlignment, 1);
+        // video encode：一帧的码流不会超过未压缩的NV12大小
+        m_bitstreamSlotSize = (lumaSize * 3 / 2 + alignment - 1) / alignment * alignment;
+        m_bitstreamSlotSize = (m_bitstreamSlotSize + sizeAlignment - 1) / sizeAlignment * sizeAlignment;
+        m_bitstream = createBuffer(m_bitstreamSlotSize * m_settings.slotCount, VK_BUFFER_USAGE_VIDEO_ENCODE_DST_BIT_KHR,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::staging, "video encode bitstream",
+            VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &m_profileList);
+
+        VkQueryPoolVideoEncodeFeedbackCreateInfoKHR feedbackInfo{};
+        feedbackInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_VIDEO_ENCODE_FEEDBACK_CREATE_INFO_KHR;
+        feedbackInfo.pNext = &m_profile;
+        feedbackInfo.encodeFeedbackFlags = VK_VIDEO_ENCODE_FEEDBACK_BITSTREAM_BUFFER_OFFSET_BIT_KHR | VK_VIDEO_ENCODE_FEEDBACK_BITSTREAM_BYTES_WRITTEN_BIT_KHR;
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.pNext = &feedbackInfo;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_VIDEO_ENCODE_FEEDBACK_KHR;
+        queryPoolInfo.queryCount = m_settings.slotCount;
+        if (vkCreateQueryPool(m_device, &queryPoolInfo, hostAllocator(), &m_queryPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video encode query pool!");
+        }
+
+        VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * m_settings.slotCount};
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = m_settings.slotCount;
+        if (vkCreateDescriptorPool(m_device, &poolInfo, hostAllocator(), &m_descriptorPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video encode descriptor pool!");
+        }
+
+        m_slots.resize(m_settings.slotCount);
+        for (uint32_t i = 0; i < m_settings.slotCount; i++) {
+            Slot& slot = m_slots[i];
+            slot.input = createVideoImage(m_inputFormat, VK_IMAGE_USAGE_VIDEO_ENCODE_SRC_BIT_KHR | VK_IMAGE_USAGE_TRANSFER_DST_BIT, 1, families, concurrent,
+                slot.inputAllocation, "video encode input");
+            slot.inputView = createVideoImageView(slot.input, m_inputFormat.format, 0);
+            slot.luma = createBuffer(lumaSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                MemoryCategory::attachment, "video encode luma");
+            slot.chroma = createBuffer(lumaSize / 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                MemoryCategory::attachment, "video encode chroma");
+            slot.source = createBuffer(VkDeviceSize(m_visibleExtent.width) * m_visibleExtent.height * 4,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::attachment,
+                "video encode source");
+            slot.bitstreamOffset = m_bitstreamSlotSize * i;
+
+            VkDescriptorSetAllocateInfo setInfo{};
+            setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            setInfo.descriptorPool = m_descriptorPool;
+            setInfo.descriptorSetCount = 1;
+            setInfo.pSetLayouts = &m_descriptorSetLayout;
+            if (vkAllocateDescriptorSets(m_device, &setInfo, &slot.descriptorSet) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate video encode descriptor sets!");
+            }
+            writeDescriptors(slot);
+        }
+    }
+
+    // video encode：slot不在使用中时调用，source buffer变大之后重新写入
+    void writeDescriptors(const Slot& slot) {
+        std::array<VkDescriptorBufferInfo, 3> bufferInfos = {{{slot.source.buffer, 0, VK_WHOLE_SIZE}, {slot.luma.buffer, 0, VK_WHOLE_SIZE},
+            {slot.chroma.buffer, 0, VK_WHOLE_SIZE}}};
+        std::array<VkWriteDescriptorSet, 3> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); binding++) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = slot.descriptorSet;
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            writes[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    template <typename Member>
+    void allocateCommandBuffers(VkCommandPool commandPool, Member member) {
+        std::vector<VkCommandBuffer> commandBuffers(m_slots.size());
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate video encode command buffers!");
+        }
+        for (size_t i = 0; i < m_slots.size(); i++) {
+            member(m_slots[i]) = commandBuffers[i];
+        }
+    }
+
+    void createPipeline(VkPipelineCache pipelineCache, const SpirvCode& shaderCode) {
+        std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+        for (uint32_t i = 0; i < bindings.size(); i++) {
+            bindings[i].binding = i;
+            bindings[i].descriptorCount = 1;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        layoutInfo.pBindings = bindings.data();
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, hostAllocator(), &m_descriptorSetLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video encode descriptor set layout!");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.size = sizeof(ConvertParams);
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &m_descriptorSetLayout;
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, hostAllocator(), &m_pipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video encode pipeline layout!");
+        }
+
+        VkShaderModuleCreateInfo moduleInfo{};
+        moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        moduleInfo.codeSize = shaderCode.size;
+        moduleInfo.pCode = shaderCode.words;
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &moduleInfo, hostAllocator(), &shaderModule) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video convert shader module!");
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = shaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = m_pipelineLayout;
+        VkResult result = vkCreateComputePipelines(m_device, pipelineCache, 1, &pipelineInfo, hostAllocator(), &m_pipeline);
+        vkDestroyShaderModule(m_device, shaderModule, hostAllocator());
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video convert pipeline!");
+        }
+    }
+
+    // video encode：码率控制的状态由第一次编码之前的control命令设置，之后每次begin都要带上同样的状态
+    void fillRateControl() {
+        m_rateControlLayer = {};
+        m_rateControlLayer.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_RATE_CONTROL_LAYER_INFO_KHR;
+        m_rateControlLayer.averageBitrate = m_bitrate;
+        m_rateControlLayer.maxBitrate = m_bitrate;
+        m_rateControlLayer.frameRateNumerator = m_settings.frameRate;
+        m_rateControlLayer.frameRateDenominator = 1;
+        m_h264RateControl = {};
+        m_h264RateControl.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_RATE_CONTROL_INFO_KHR;
+        m_h264RateControl.flags = VK_VIDEO_ENCODE_H264_RATE_CONTROL_REGULAR_GOP_BIT_KHR | VK_VIDEO_ENCODE_H264_RATE_CONTROL_REFERENCE_PATTERN_FLAT_BIT_KHR;
+        m_h264RateControl.gopFrameCount = m_settings.idrPeriod;
+        m_h264RateControl.idrPeriod = m_settings.idrPeriod;
+        m_h264RateControl.consecutiveBFrameCount = 0;
+        m_h264RateControl.temporalLayerCount = 1;
+        m_rateControl = {};
+        m_rateControl.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_RATE_CONTROL_INFO_KHR;
+        m_rateControl.pNext = &m_h264RateControl;
+        m_rateControl.rateControlMode = m_rateControlMode;
+        if (m_rateControlMode != VK_VIDEO_ENCODE_RATE_CONTROL_MODE_DEFAULT_KHR) {
+            m_rateControl.layerCount = 1;
+            m_rateControl.pLayers = &m_rateControlLayer;
+            m_rateControl.virtualBufferSizeInMs = 2000 / std::max(m_settings.frameRate, 1u);  // 两帧
+            m_rateControl.initialVirtualBufferSizeInMs = 1000 / std::max(m_settings.frameRate, 1u);
+        }
+    }
+
+    void recordEncode(Slot& slot, uint32_t slotIndex, bool idr, uint32_t setupSlot, uint32_t referenceSlot) {
+        VkCommandBuffer commandBuffer = slot.encodeCommands;
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording video encode command buffer!");
+        }
+        vkCmdResetQueryPool(commandBuffer, m_queryPool, slotIndex, 1);
+
+        // video encode：第一次编码之前DPB从UNDEFINED转换，之后一直是DPB layout
+        if (!m_sessionReset) {
+            VkImageMemoryBarrier2 dpbBarrier{};
+            dpbBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            dpbBarrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+            dpbBarrier.dstStageMask = VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR;
+            dpbBarrier.dstAccessMask = VK_ACCESS_2_VIDEO_ENCODE_READ_BIT_KHR | VK_ACCESS_2_VIDEO_ENCODE_WRITE_BIT_KHR;
+            dpbBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            dpbBarrier.newLayout = VK_IMAGE_LAYOUT_VIDEO_ENCODE_DPB_KHR;
+            dpbBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            dpbBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            dpbBarrier.image = m_dpb;
+            dpbBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, DPB_SLOTS};
+            VkDependencyInfo dependency{};
+            dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            dependency.imageMemoryBarrierCount = 1;
+            dependency.pImageMemoryBarriers = &dpbBarrier;
+            m_cmdPipelineBarrier2(commandBuffer, &dependency);
+            fillRateControl();
+        }
+
+        bool useReference = !idr && m_dpbState[referenceSlot].valid;
+        std::array<StdVideoEncodeH264ReferenceInfo, 2> stdReferences{};
+        std::array<VkVideoEncodeH264DpbSlotInfoKHR, 2> h264Slots{};
+        std::array<VkVideoPictureResourceInfoKHR, 2> pictures{};
+        std::array<VkVideoReferenceSlotInfoKHR, 2> slots{};
+        uint32_t frameNum = m_framesSinceIdr % (1u << LOG2_MAX_FRAME_NUM);
+        int32_t pictureOrderCount = static_cast<int32_t>(m_framesSinceIdr * 2);
+        for (uint32_t i = 0; i < 2; i++) {
+            bool setup = i == 0;
+            const DpbSlot& state = m_dpbState[referenceSlot];
+            stdReferences[i].primary_pic_type = setup ? (idr ? STD_VIDEO_H264_PICTURE_TYPE_IDR : STD_VIDEO_H264_PICTURE_TYPE_P)
+                : (state.idr ? STD_VIDEO_H264_PICTURE_TYPE_IDR : STD_VIDEO_H264_PICTURE_TYPE_P);
+            stdReferences[i].FrameNum = setup ? frameNum : state.frameNum;
+            stdReferences[i].PicOrderCnt = setup ? pictureOrderCount : state.pictureOrderCount;
+            h264Slots[i] = {};
+            h264Slots[i].sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_DPB_SLOT_INFO_KHR;
+            h264Slots[i].pStdReferenceInfo = &stdReferences[i];
+            pictures[i] = {};
+            pictures[i].sType = VK_STRUCTURE_TYPE_VIDEO_PICTURE_RESOURCE_INFO_KHR;
+            pictures[i].codedExtent = m_codedExtent;
+            pictures[i].baseArrayLayer = 0;
+            pictures[i].imageViewBinding = m_dpbViews[setup ? setupSlot : referenceSlot];
+            slots[i] = {};
+            slots[i].sType = VK_STRUCTURE_TYPE_VIDEO_REFERENCE_SLOT_INFO_KHR;
+            slots[i].pNext = &h264Slots[i];
+            slots[i].slotIndex = static_cast<int32_t>(setup ? setupSlot : referenceSlot);
+            slots[i].pPictureResource = &pictures[i];
+        }
+
+        // video encode：begin列出这次会用到的picture，正在写入的slot还没有关联图像，slotIndex为-1
+        std::array<VkVideoReferenceSlotInfoKHR, 2> beginSlots = slots;
+        beginSlots[0].pNext = nullptr;
+        beginSlots[0].slotIndex = -1;
+        VkVideoBeginCodingInfoKHR beginCoding{};
+        beginCoding.sType = VK_STRUCTURE_TYPE_VIDEO_BEGIN_CODING_INFO_KHR;
+        beginCoding.pNext = m_sessionReset ? &m_rateControl : nullptr;
+        beginCoding.videoSession = m_session;
+        beginCoding.videoSessionParameters = m_sessionParameters;
+        beginCoding.referenceSlotCount = useReference ? 2 : 1;
+        beginCoding.pReferenceSlots = beginSlots.data();
+        m_cmdBeginVideoCoding(commandBuffer, &beginCoding);
+
+        if (!m_sessionReset) {
+            VkVideoCodingControlInfoKHR control{};
+            control.sType = VK_STRUCTURE_TYPE_VIDEO_CODING_CONTROL_INFO_KHR;
+            control.pNext = &m_rateControl;
+            control.flags = VK_VIDEO_CODING_CONTROL_RESET_BIT_KHR | VK_VIDEO_CODING_CONTROL_ENCODE_RATE_CONTROL_BIT_KHR;
+            m_cmdControlVideoCoding(commandBuffer, &control);
+        }
+
+        StdVideoEncodeH264SliceHeader sliceHeader{};
+        sliceHeader.slice_type = idr ? STD_VIDEO_H264_SLICE_TYPE_I : STD_VIDEO_H264_SLICE_TYPE_P;
+        sliceHeader.cabac_init_idc = STD_VIDEO_H264_CABAC_INIT_IDC_0;
+        sliceHeader.disable_deblocking_filter_idc = STD_VIDEO_H264_DISABLE_DEBLOCKING_FILTER_IDC_DISABLED;  // 语法元素为0，去块滤波开启
+        VkVideoEncodeH264NaluSliceInfoKHR slice{};
+        slice.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_NALU_SLICE_INFO_KHR;
+        slice.pStdSliceHeader = &sliceHeader;
+
+        StdVideoEncodeH264ReferenceListsInfo referenceLists{};
+        std::fill(std::begin(referenceLists.RefPicList0), std::end(referenceLists.RefPicList0), STD_VIDEO_H264_NO_REFERENCE_PICTURE);
+        std::fill(std::begin(referenceLists.RefPicList1), std::end(referenceLists.RefPicList1), STD_VIDEO_H264_NO_REFERENCE_PICTURE);
+        if (useReference) {
+            referenceLists.RefPicList0[0] = static_cast<uint8_t>(referenceSlot);
+        }
+
+        StdVideoEncodeH264PictureInfo stdPicture{};
+        stdPicture.flags.IdrPicFlag = idr ? 1 : 0;
+        stdPicture.flags.is_reference = 1;
+        stdPicture.seq_parameter_set_id = 0;
+        stdPicture.pic_parameter_set_id = 0;
+        stdPicture.idr_pic_id = static_cast<uint16_t>(m_idrCount - 1);
+        stdPicture.primary_pic_type = idr ? STD_VIDEO_H264_PICTURE_TYPE_IDR : STD_VIDEO_H264_PICTURE_TYPE_P;
+        stdPicture.frame_num = frameNum;
+        stdPicture.PicOrderCnt = pictureOrderCount;
+        stdPicture.pRefLists = &referenceLists;
+        VkVideoEncodeH264PictureInfoKHR h264Picture{};
+        h264Picture.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_H264_PICTURE_INFO_KHR;
+        h264Picture.naluSliceEntryCount = 1;
+        h264Picture.pNaluSliceEntries = &slice;
+        h264Picture.pStdPictureInfo = &stdPicture;
+
+        VkVideoEncodeInfoKHR encodeInfo{};
+        encodeInfo.sType = VK_STRUCTURE_TYPE_VIDEO_ENCODE_INFO_KHR;
+        encodeInfo.pNext = &h264Picture;
+        encodeInfo.dstBuffer = m_bitstream.buffer;
+        encodeInfo.dstBufferOffset = slot.bitstreamOffset;
+        encodeInfo.dstBufferRange = m_bitstreamSlotSize;
+        encodeInfo.srcPictureResource = {};
+        encodeInfo.srcPictureResource.sType = VK_STRUCTURE_TYPE_VIDEO_PICTURE_RESOURCE_INFO_KHR;
+        encodeInfo.srcPictureResource.codedExtent = m_codedExtent;
+        encodeInfo.srcPictureResource.imageViewBinding = slot.inputView;
+        encodeInfo.pSetupReferenceSlot = &slots[0];
+        encodeInfo.referenceSlotCount = useReference ? 1 : 0;
+        encodeInfo.pReferenceSlots = &slots[1];
+        vkCmdBeginQuery(commandBuffer, m_queryPool, slotIndex, 0);
+        m_cmdEncodeVideo(commandBuffer, &encodeInfo);
+        vkCmdEndQuery(commandBuffer, m_queryPool, slotIndex);
+
+        VkVideoEndCodingInfoKHR endCoding{};
+        endCoding.sType = VK_STRUCTURE_TYPE_VIDEO_END_CODING_INFO_KHR;
+        m_cmdEndVideoCoding(commandBuffer, &endCoding);
+
+        VkBufferMemoryBarrier2 hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+        hostBarrier.srcStageMask = VK_PIPELINE_STAGE_2_VIDEO_ENCODE_BIT_KHR;
+        hostBarrier.srcAccessMask = VK_ACCESS_2_VIDEO_ENCODE_WRITE_BIT_KHR;
+        hostBarrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+        hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.buffer = m_bitstream.buffer;
+        hostBarrier.offset = slot.bitstreamOffset;
+        hostBarrier.size = m_bitstreamSlotSize;
+        VkDependencyInfo dependency{};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency.bufferMemoryBarrierCount = 1;
+        dependency.pBufferMemoryBarriers = &hostBarrier;
+        m_cmdPipelineBarrier2(commandBuffer, &dependency);
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record video encode command buffer!");
+        }
+    }
+
+    // video encode：feedback给出码流在slot中的偏移和长度；IDR之前写SPS/PPS
+    void writeBitstream(const Slot& slot) {
+        uint32_t slotIndex = static_cast<uint32_t>(&slot - m_slots.data());
+        std::array<uint64_t, 3> feedback{};  // 偏移、字节数、状态
+        VkResult result = vkGetQueryPoolResults(m_device, m_queryPool, slotIndex, 1, sizeof(feedback), feedback.data(), sizeof(feedback),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_STATUS_BIT_KHR);
+        if (result != VK_SUCCESS || static_cast<int64_t>(feedback[2]) != VK_QUERY_RESULT_STATUS_COMPLETE_KHR) {
+            std::cerr << "video encode: frame failed with status " << static_cast<int64_t>(feedback[2]) << std::endl;
+            m_droppedFrames++;
+            return;
+        }
+        if (slot.idr) {
+            m_output.write(reinterpret_cast<const char*>(m_parameterSets.data()), static_cast<std::streamsize>(m_parameterSets.size()));
+        }
+        const char* data = static_cast<const char*>(m_bitstream.allocation.mapped) + slot.bitstreamOffset + feedback[0];
+        m_output.write(data, static_cast<std::streamsize>(feedback[1]));
+        m_encodedFrames++;
+        m_encodedBytes += feedback[1];
+    }
+
+    Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryCategory category, const char* name,
+        VkMemoryPropertyFlags preferred = 0, const void* next = nullptr) {
+        Buffer buffer;
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.pNext = next;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(m_device, &bufferInfo, hostAllocator(), &buffer.buffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create video encode buffer!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(m_device, buffer.buffer, &memRequirements);
+        buffer.allocation = m_allocator->allocate(memRequirements, properties, true, category, preferred, name);
+        vkBindBufferMemory(m_device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+        buffer.size = size;
+        return buffer;
+    }
+
+    void destroyBuffer(Buffer& buffer) {
+        if (buffer.buffer == VK_NULL_HANDLE) {
+            return;
+        }
+        vkDestroyBuffer(m_device, buffer.buffer, hostAllocator());
+        m_allocator->free(buffer.allocation);
+        buffer = {};
+    }
+
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    VkCommandPool m_graphicsCommandPool = VK_NULL_HANDLE;
+    VkCommandPool m_encodeCommandPool = VK_NULL_HANDLE;
+    VkQueue m_encodeQueue = VK_NULL_HANDLE;
+    uint32_t m_encodeFamily = 0;
+    TimelineSemaphore m_timeline;  // 编码队列自己的timeline
+    Settings m_settings;
+    VkExtent2D m_visibleExtent{};
+    VkExtent2D m_codedExtent{};
+    std::ofstream m_output;
+
+    VkVideoEncodeUsageInfoKHR m_usageInfo{};
+    VkVideoEncodeH264ProfileInfoKHR m_h264Profile{};
+    VkVideoProfileInfoKHR m_profile{};
+    VkVideoProfileListInfoKHR m_profileList{};
+    VkVideoEncodeH264CapabilitiesKHR m_h264Capabilities{};
+    VkVideoEncodeCapabilitiesKHR m_encodeCapabilities{};
+    VkVideoCapabilitiesKHR m_capabilities{};
+    VkVideoFormatPropertiesKHR m_inputFormat{};
+    VkVideoFormatPropertiesKHR m_dpbFormat{};
+    VkVideoEncodeRateControlFlagBitsKHR m_rateControlMode = VK_VIDEO_ENCODE_RATE_CONTROL_MODE_DEFAULT_KHR;
+    uint64_t m_bitrate = 0;
+    VkVideoEncodeRateControlLayerInfoKHR m_rateControlLayer{};
+    VkVideoEncodeH264RateControlInfoKHR m_h264RateControl{};
+    VkVideoEncodeRateControlInfoKHR m_rateControl{};
+
+    VkVideoSessionKHR m_session = VK_NULL_HANDLE;
+    VkVideoSessionParametersKHR m_sessionParameters = VK_NULL_HANDLE;
+    std::vector<Allocation> m_sessionAllocations;
+    std::vector<uint8_t> m_parameterSets;  // Annex B格式的SPS和PPS
+    bool m_sessionReset = false;  // 第一次编码时重置session并设置码率控制
+    VkImage m_dpb = VK_NULL_HANDLE;
+    Allocation m_dpbAllocation;
+    std::array<VkImageView, DPB_SLOTS> m_dpbViews{};
+    std::array<DpbSlot, DPB_SLOTS> m_dpbState{};
+
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkQueryPool m_queryPool = VK_NULL_HANDLE;
+    Buffer m_bitstream;
+    VkDeviceSize m_bitstreamSlotSize = 0;
+    std::vector<Slot> m_slots;
+    uint32_t m_pendingSlot = NO_SLOT;
+
+    uint64_t m_frameCount = 0;  // 提交编码的帧数
+    uint64_t m_framesSinceIdr = 0;
+    uint32_t m_idrCount = 0;
+    uint64_t m_encodedFrames = 0;
+    uint64_t m_droppedFrames = 0;
+    uint64_t m_encodedBytes = 0;
+
+    PFN_vkGetPhysicalDeviceVideoCapabilitiesKHR m_getVideoCapabilities = nullptr;
+    PFN_vkGetPhysicalDeviceVideoFormatPropertiesKHR m_getVideoFormatProperties = nullptr;
+    PFN_vkCreateVideoSessionKHR m_createVideoSession = nullptr;
+    PFN_vkDestroyVideoSessionKHR m_destroyVideoSession = nullptr;
+    PFN_vkGetVideoSessionMemoryRequirementsKHR m_getVideoSessionMemoryRequirements = nullptr;
+    PFN_vkBindVideoSessionMemoryKHR m_bindVideoSessionMemory = nullptr;
+    PFN_vkCreateVideoSessionParametersKHR m_createVideoSessionParameters = nullptr;
+    PFN_vkDestroyVideoSessionParametersKHR m_destroyVideoSessionParameters = nullptr;
+    PFN_vkGetEncodedVideoSessionParametersKHR m_getEncodedVideoSessionParameters = nullptr;
+    PFN_vkCmdBeginVideoCodingKHR m_cmdBeginVideoCoding = nullptr;
+    PFN_vkCmdEndVideoCodingKHR m_cmdEndVideoCoding = nullptr;
+    PFN_vkCmdControlVideoCodingKHR m_cmdControlVideoCoding = nullptr;
+    PFN_vkCmdEncodeVideoKHR m_cmdEncodeVideo = nullptr;
+    PFN_vkCmdPipelineBarrier2 m_cmdPipelineBarrier2 = nullptr;
+};
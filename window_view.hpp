@@ -0,0 +1,448 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include "GLFW/glfw3.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "device_dispatch.hpp"
+#include "host_memory.hpp"
+#include "image_barriers.hpp"
+#include "memory_allocator.hpp"
+
+// multiple views：主窗口之外的一个窗口，有自己的surface、swap chain、depth和同步对象，device、pipeline layout、geometry和纹理与主窗口共享
+// 多个显示器时第i个额外窗口放在第i+1个显示器上；view直接画进swap chain image，不经过render graph和后处理
+// 这一帧所有view的command buffer和主窗口在同一次vkQueueSubmit中提交，所有swap chain在同一次vkQueuePresentKHR中present
+// acquire的timeout是0，image还没有空出来时这一帧跳过这个view，额外的窗口不会让主窗口等待
+class WindowView {
+public:
+    using RetireFunction = std::function<void(std::function<void()>)>;
+
+    // multiple views：只能在主线程调用，glfw的窗口函数和回调都在主线程；onActivity在窗口需要重绘、大小改变和关闭时调用
+    void createWindow(uint32_t index, int width, int height, std::function<void()> onActivity) {
+        m_onActivity = std::move(onActivity);
+        std::string title = "Vulkan view " + std::to_string(index + 1);
+        m_window = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
+        if (m_window == nullptr) {
+            throw std::runtime_error("failed to create view window!");
+        }
+        int monitorCount = 0;
+        GLFWmonitor** monitors = glfwGetMonitors(&monitorCount);
+        if (static_cast<int>(index) + 1 < monitorCount) {
+            int x, y;
+            glfwGetMonitorPos(monitors[index + 1], &x, &y);
+            glfwSetWindowPos(m_window, x + 32, y + 32);
+        }
+
+        glfwSetWindowUserPointer(m_window, this);
+        glfwSetFramebufferSizeCallback(m_window, framebufferResizeCallback);
+        glfwSetWindowRefreshCallback(m_window, windowRefreshCallback);
+        glfwSetWindowCloseCallback(m_window, windowCloseCallback);
+        glfwGetFramebufferSize(m_window, &width, &height);
+        storeFramebufferSize(width, height);
+    }
+
+    // multiple views：queueFamily是提交和present这个view的图形队列，不能present到这个surface时抛出异常
+    // retire：重建swap chain时旧的资源可能还在被in flight的帧使用，由调用者的deletion queue在这些帧完成后销毁
+    void init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, DeviceMemoryAllocator& allocator, uint32_t queueFamily, VkFormat depthFormat,
+        bool depthHasStencil, uint32_t frameCount, RetireFunction retire) {
+        m_physicalDevice = physicalDevice;
+        m_device = device;
+        m_allocator = &allocator;
+        m_depthFormat = depthFormat;
+        m_depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT | (depthHasStencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+        m_retire = std::move(retire);
+
+        if (glfwCreateWindowSurface(instance, m_window, hostAllocator(), &m_surface) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create view window surface!");
+        }
+        VkBool32 presentSupport = VK_FALSE;
+        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, queueFamily, m_surface, &presentSupport);
+        if (!presentSupport) {
+            throw std::runtime_error("failed to find present support for view window!");
+        }
+
+        VkSurfaceFormatKHR surfaceFormat = chooseSurfaceFormat();
+        m_format = surfaceFormat.format;
+        m_colorSpace = surfaceFormat.colorSpace;
+        createSwapchain();
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+        if (vkCreateCommandPool(m_device, &poolInfo, hostAllocator(), &m_commandPool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create view command pool!");
+        }
+        m_commandBuffers.resize(frameCount);
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = frameCount;
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate view command buffers!");
+        }
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        m_acquireSemaphores.resize(frameCount);
+        for (VkSemaphore& semaphore : m_acquireSemaphores) {
+            if (vkCreateSemaphore(m_device, &semaphoreInfo, hostAllocator(), &semaphore) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create view semaphore!");
+            }
+        }
+    }
+
+    // multiple views：调用者已经vkDeviceWaitIdle；窗口在主线程销毁，没有调用过init时只销毁窗口
+    void cleanup(VkInstance instance) {
+        if (m_device != VK_NULL_HANDLE) {
+            destroySwapchainResources(m_swapchain, m_imageViews, m_renderFinishedSemaphores, m_depthImage, m_depthView, m_depthAllocation);
+            for (VkSemaphore semaphore : m_acquireSemaphores) {
+                vkDestroySemaphore(m_device, semaphore, hostAllocator());
+            }
+            m_acquireSemaphores.clear();
+            vkDestroyCommandPool(m_device, m_commandPool, hostAllocator());
+            vkDestroySurfaceKHR(instance, m_surface, hostAllocator());
+            m_device = VK_NULL_HANDLE;
+        }
+        if (m_window != nullptr) {
+            glfwDestroyWindow(m_window);
+            m_window = nullptr;
+        }
+    }
+
+    // multiple views：渲染的线程每帧调用，返回false时这一帧不绘制这个view（窗口已经关闭、最小化或者还没有空出来的image）
+    // 窗口大小改变或者上次present返回out of date时先重建swap chain
+    bool acquire(uint32_t frame) {
+        m_acquired = false;
+        if (glfwWindowShouldClose(m_window)) {
+            return false;
+        }
+        if (m_resized.exchange(false, std::memory_order_acquire)) {
+            recreateSwapchain();
+        }
+        if (m_swapchain == VK_NULL_HANDLE) {
+            return false;
+        }
+        VkResult result = vkAcquireNextImageKHR(m_device, m_swapchain, 0, m_acquireSemaphores[frame], VK_NULL_HANDLE, &m_imageIndex);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            m_resized = true;
+            return false;
+        }
+        if (result == VK_NOT_READY || result == VK_TIMEOUT) {
+            return false;
+        }
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            throw std::runtime_error("failed to acquire view swap chain image!");
+        }
+        m_acquired = true;
+        return true;
+    }
+
+    bool acquired() const { return m_acquired; }
+
+    // multiple views：开始录制这一帧的command buffer，color和depth转换到attachment的layout并开始dynamic rendering
+    VkCommandBuffer begin(uint32_t frame, PFN_vkCmdBeginRendering beginRendering) {
+        VkCommandBuffer commandBuffer = m_commandBuffers[frame];
+        vkResetCommandBuffer(commandBuffer, 0);
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (DeviceDispatch::beginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording view command buffer!");
+        }
+
+        // multiple views：color在等待acquire的阶段转换；depth每帧清空，只需要等待上一帧的depth写入
+        ImageBarrierBatch& barriers = m_barriers;  // heap tracker：每帧复用
+        barriers.add(imageBarrier(m_images[m_imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 0,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT), VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        barriers.add(imageBarrier(m_depthImage, m_depthAspect, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT),
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT);
+        barriers.record(commandBuffer);
+
+        VkRenderingAttachmentInfo colorAttachment{};
+        colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        colorAttachment.imageView = m_imageViews[m_imageIndex];
+        colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+        colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        colorAttachment.clearValue.color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+        VkRenderingAttachmentInfo depthAttachment{};
+        depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+        depthAttachment.imageView = m_depthView;
+        depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+        depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        depthAttachment.clearValue.depthStencil = {1.0f, 0};
+
+        VkRenderingInfo renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+        renderingInfo.renderArea = {{0, 0}, m_extent};
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachments = &colorAttachment;
+        renderingInfo.pDepthAttachment = &depthAttachment;
+        beginRendering(commandBuffer, &renderingInfo);
+        return commandBuffer;
+    }
+
+    // multiple views：结束dynamic rendering，image转换到present的layout
+    void end(VkCommandBuffer commandBuffer, PFN_vkCmdEndRendering endRendering) {
+        endRendering(commandBuffer);
+        VkImageMemoryBarrier barrier = imageBarrier(m_images[m_imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0);
+        DeviceDispatch::cmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        if (DeviceDispatch::endCommandBuffer(commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record view command buffer!");
+        }
+    }
+
+    // multiple views：vkQueuePresentKHR的pResults中这个swap chain的结果，out of date或者suboptimal时下一帧重建
+    void presented(VkResult result) {
+        m_acquired = false;
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            m_resized = true;
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("failed to present view swap chain image!");
+        }
+    }
+
+    VkSwapchainKHR swapchain() const { return m_swapchain; }
+    uint32_t imageIndex() const { return m_imageIndex; }
+    VkSemaphore acquireSemaphore(uint32_t frame) const { return m_acquireSemaphores[frame]; }
+    VkSemaphore renderFinishedSemaphore() const { return m_renderFinishedSemaphores[m_imageIndex]; }  // 每个image一个，present可能还在等待上一次的
+    VkFormat format() const { return m_format; }
+    VkExtent2D extent() const { return m_extent; }
+
+private:
+    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+        auto view = reinterpret_cast<WindowView*>(glfwGetWindowUserPointer(window));
+        view->storeFramebufferSize(width, height);
+        view->m_resized = true;
+        view->m_onActivity();
+    }
+
+    static void windowRefreshCallback(GLFWwindow* window) {
+        reinterpret_cast<WindowView*>(glfwGetWindowUserPointer(window))->m_onActivity();
+    }
+
+    // multiple views：关闭额外的窗口只隐藏它，这个view不再绘制，程序在主窗口关闭时退出
+    static void windowCloseCallback(GLFWwindow* window) {
+        glfwHideWindow(window);
+        reinterpret_cast<WindowView*>(glfwGetWindowUserPointer(window))->m_onActivity();
+    }
+
+    // multiple views：glfwGetFramebufferSize只能在主线程调用，渲染线程从这里读取，宽和高打包进一个原子变量
+    void storeFramebufferSize(int width, int height) {
+        m_framebufferSize.store((uint64_t(uint32_t(width)) << 32) | uint32_t(height), std::memory_order_relaxed);
+    }
+
+    VkSurfaceFormatKHR chooseSurfaceFormat() {
+        uint32_t formatCount = 0;
+        vkGetPhysicalDeviceSurfaceFormatsKHR(m_physicalDevice, m_surface, &formatCount, nullptr);
+        std::vector<VkSurfaceFormatKHR> formats(formatCount);
+        vkGetPhysicalDeviceSurfaceFormatsKHR(m_physicalDevice, m_surface, &formatCount, formats.data());
+        if (formats.empty()) {
+            throw std::runtime_error("failed to find view surface format!");
+        }
+        for (const VkSurfaceFormatKHR& format : formats) {
+            if (format.format == VK_FORMAT_B8G8R8A8_SRGB && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                return format;
+            }
+        }
+        return formats[0];
+    }
+
+    // multiple views：fifo所有设备都支持；窗口最小化时extent为0，不创建swap chain，acquire返回false直到窗口恢复
+    void createSwapchain() {
+        VkSurfaceCapabilitiesKHR capabilities;
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physicalDevice, m_surface, &capabilities);
+        m_extent = capabilities.currentExtent;
+        if (m_extent.width == std::numeric_limits<uint32_t>::max()) {
+            uint64_t size = m_framebufferSize.load(std::memory_order_relaxed);
+            m_extent.width = std::clamp(uint32_t(size >> 32), capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+            m_extent.height = std::clamp(uint32_t(size), capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+        }
+        if (m_extent.width == 0 || m_extent.height == 0) {
+            return;
+        }
+
+        uint32_t imageCount = capabilities.minImageCount + 1;
+        if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount) {
+            imageCount = capabilities.maxImageCount;
+        }
+        VkSwapchainCreateInfoKHR createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        createInfo.surface = m_surface;
+        createInfo.minImageCount = imageCount;
+        createInfo.imageFormat = m_format;
+        createInfo.imageColorSpace = m_colorSpace;
+        createInfo.imageExtent = m_extent;
+        createInfo.imageArrayLayers = 1;
+        createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        createInfo.preTransform = capabilities.currentTransform;
+        createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        createInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        createInfo.clipped = VK_TRUE;
+        createInfo.oldSwapchain = m_retiredSwapchain;
+        if (vkCreateSwapchainKHR(m_device, &createInfo, hostAllocator(), &m_swapchain) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create view swap chain!");
+        }
+
+        vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, nullptr);
+        m_images.resize(imageCount);
+        vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, m_images.data());
+        m_imageViews.resize(imageCount);
+        m_renderFinishedSemaphores.resize(imageCount);
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        for (uint32_t i = 0; i < imageCount; i++) {
+            m_imageViews[i] = createImageView(m_images[i], m_format, VK_IMAGE_ASPECT_COLOR_BIT);
+            if (vkCreateSemaphore(m_device, &semaphoreInfo, hostAllocator(), &m_renderFinishedSemaphores[i]) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create view semaphore!");
+            }
+        }
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {m_extent.width, m_extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = m_depthFormat;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateImage(m_device, &imageInfo, hostAllocator(), &m_depthImage) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create view depth image!");
+        }
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(m_device, m_depthImage, &memRequirements);
+        m_depthAllocation = m_allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false, MemoryCategory::attachment, 0, "view depth");
+        vkBindImageMemory(m_device, m_depthImage, m_depthAllocation.memory, m_depthAllocation.offset);
+        m_depthView = createImageView(m_depthImage, m_depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+    }
+
+    // multiple views：新的swap chain用旧的作为oldSwapchain创建，旧的image、depth和semaphore交给retire在in flight的帧完成后销毁
+    void recreateSwapchain() {
+        VkSwapchainKHR oldSwapchain = m_swapchain;
+        std::vector<VkImageView> oldViews = std::move(m_imageViews);
+        std::vector<VkSemaphore> oldSemaphores = std::move(m_renderFinishedSemaphores);
+        VkImage oldDepthImage = m_depthImage;
+        VkImageView oldDepthView = m_depthView;
+        Allocation oldDepthAllocation = m_depthAllocation;
+        m_swapchain = VK_NULL_HANDLE;
+        m_imageViews.clear();
+        m_renderFinishedSemaphores.clear();
+        m_images.clear();
+        m_depthImage = VK_NULL_HANDLE;
+        m_depthView = VK_NULL_HANDLE;
+        m_depthAllocation = {};
+
+        m_retiredSwapchain = oldSwapchain;
+        createSwapchain();
+        m_retiredSwapchain = VK_NULL_HANDLE;
+        if (oldSwapchain != VK_NULL_HANDLE) {
+            m_retire([this, oldSwapchain, oldViews, oldSemaphores, oldDepthImage, oldDepthView, oldDepthAllocation]() mutable {
+                destroySwapchainResources(oldSwapchain, oldViews, oldSemaphores, oldDepthImage, oldDepthView, oldDepthAllocation);
+            });
+        }
+    }
+
+    void destroySwapchainResources(VkSwapchainKHR& swapchain, std::vector<VkImageView>& views, std::vector<VkSemaphore>& semaphores, VkImage& depthImage,
+        VkImageView& depthView, Allocation& depthAllocation) {
+        for (VkImageView view : views) {
+            vkDestroyImageView(m_device, view, hostAllocator());
+        }
+        views.clear();
+        for (VkSemaphore semaphore : semaphores) {
+            vkDestroySemaphore(m_device, semaphore, hostAllocator());
+        }
+        semaphores.clear();
+        if (depthImage != VK_NULL_HANDLE) {
+            vkDestroyImageView(m_device, depthView, hostAllocator());
+            vkDestroyImage(m_device, depthImage, hostAllocator());
+            m_allocator->free(depthAllocation);
+            depthImage = VK_NULL_HANDLE;
+            depthView = VK_NULL_HANDLE;
+        }
+        if (swapchain != VK_NULL_HANDLE) {
+            vkDestroySwapchainKHR(m_device, swapchain, hostAllocator());
+            swapchain = VK_NULL_HANDLE;
+        }
+    }
+
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange = {aspect, 0, 1, 0, 1};
+        VkImageView view;
+        if (vkCreateImageView(m_device, &viewInfo, hostAllocator(), &view) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create view image view!");
+        }
+        return view;
+    }
+
+    static VkImageMemoryBarrier imageBarrier(VkImage image, VkImageAspectFlags aspect, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess,
+        VkAccessFlags dstAccess) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = image;
+        barrier.subresourceRange = {aspect, 0, 1, 0, 1};
+        barrier.srcAccessMask = srcAccess;
+        barrier.dstAccessMask = dstAccess;
+        return barrier;
+    }
+
+    GLFWwindow* m_window = nullptr;
+    std::function<void()> m_onActivity;
+    std::atomic<uint64_t> m_framebufferSize{0};
+    std::atomic<bool> m_resized{false};  // 主线程的回调和渲染的线程都会设置
+
+    VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+    VkDevice m_device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* m_allocator = nullptr;
+    RetireFunction m_retire;
+    VkSurfaceKHR m_surface = VK_NULL_HANDLE;
+    VkFormat m_format = VK_FORMAT_UNDEFINED;
+    VkColorSpaceKHR m_colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+    VkExtent2D m_extent{};
+    VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
+    VkSwapchainKHR m_retiredSwapchain = VK_NULL_HANDLE;
+    std::vector<VkImage> m_images;
+    std::vector<VkImageView> m_imageViews;
+    std::vector<VkSemaphore> m_renderFinishedSemaphores;
+    VkFormat m_depthFormat = VK_FORMAT_UNDEFINED;
+    VkImageAspectFlags m_depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    VkImage m_depthImage = VK_NULL_HANDLE;
+    VkImageView m_depthView = VK_NULL_HANDLE;
+    Allocation m_depthAllocation{};
+
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> m_commandBuffers;  // 每个frame in flight一个
+    std::vector<VkSemaphore> m_acquireSemaphores;  // 每个frame in flight一个
+    uint32_t m_imageIndex = 0;
+    bool m_acquired = false;
+    ImageBarrierBatch m_barriers;
+};
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// world streaming：world manifest中的一个模型，position是模型原点在世界中的位置
+struct WorldEntry {
+    std::string path;
+    glm::vec3 position{0.0f};
+};
+
+// world streaming：每行一个模型“路径 x y z”，#开头的行和空行跳过；相对路径相对于manifest所在的目录
+inline std::vector<WorldEntry> loadWorldManifest(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("failed to open world manifest: " + path);
+    }
+    std::string baseDir = path.substr(0, path.find_last_of("/\\") + 1);
+    std::vector<WorldEntry> entries;
+    std::string line;
+    for (uint32_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        std::istringstream stream(line);
+        WorldEntry entry;
+        if (!(stream >> entry.path >> entry.position.x >> entry.position.y >> entry.position.z)) {
+            throw std::runtime_error("failed to parse world manifest line " + std::to_string(lineNumber) + ": " + path);
+        }
+        if (entry.path[0] != '/' && entry.path.find(':') == std::string::npos) {
+            entry.path = baseDir + entry.path;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
+
+// world streaming：放不进显存的世界按xy平面上的网格分成chunk，chunk中的模型一起加载和卸载
+// 每帧按相机当前位置和预测位置中较近的一个到chunk包围盒的距离决定哪些chunk需要常驻：距离小于loadRadius时加载，大于unloadRadius时卸载，
+// 两个半径之间保持原来的状态，相机在边界附近来回移动时chunk不会反复加载
+// 加载有两个预算：每帧最多开始maxLoadsPerFrame个chunk，同时最多maxLoadsInFlight个chunk在导入或上传；常驻的字节数不超过update传入的预算，
+// 放不下时卸载比要加载的chunk更远的常驻chunk，仍然放不下就等待；预算变小时先卸载最远的chunk
+// 这里只做决定，模型的请求、上传和释放由调用者完成，完成之后通过modelFinished和unloaded告诉streamer
+class WorldStreamer {
+public:
+    enum class ChunkState {
+        unloaded,
+        loading,  // 模型在导入或上传中，不会被卸载
+        resident,
+    };
+
+    struct Settings {
+        float chunkSize = 16.0f;
+        float loadRadius = 24.0f;
+        float unloadRadius = 32.0f;
+        float predictionSeconds = 1.0f;  // camera：按速度外推的时间
+        uint32_t maxLoadsPerFrame = 1;
+        uint32_t maxLoadsInFlight = 2;
+    };
+
+    struct Chunk {
+        glm::vec3 boundsMin{FLT_MAX};
+        glm::vec3 boundsMax{-FLT_MAX};
+        std::vector<uint32_t> entries;  // 在manifest中的index
+        ChunkState state = ChunkState::unloaded;
+        uint32_t pendingModels = 0;
+        uint64_t residentBytes = 0;
+        uint64_t lastBytes = 0;  // 上一次常驻时的大小，再次加载之前用来估计需要的预算；没有加载过的chunk按已知chunk的平均大小估计
+    };
+
+    // world streaming：模型按原点所在的网格分组，包围盒是网格本身（z方向是模型原点的范围），模型超出网格的部分不计入距离
+    void init(std::vector<WorldEntry> entries, const Settings& settings) {
+        m_entries = std::move(entries);
+        m_settings = settings;
+        m_chunks.clear();
+        std::map<std::pair<int64_t, int64_t>, uint32_t> cells;
+        for (uint32_t i = 0; i < m_entries.size(); i++) {
+            const glm::vec3& position = m_entries[i].position;
+            int64_t x = static_cast<int64_t>(std::floor(position.x / settings.chunkSize));
+            int64_t y = static_cast<int64_t>(std::floor(position.y / settings.chunkSize));
+            auto [cell, inserted] = cells.try_emplace({x, y}, static_cast<uint32_t>(m_chunks.size()));
+            if (inserted) {
+                Chunk chunk;
+                chunk.boundsMin = glm::vec3(x * settings.chunkSize, y * settings.chunkSize, position.z);
+                chunk.boundsMax = glm::vec3((x + 1) * settings.chunkSize, (y + 1) * settings.chunkSize, position.z);
+                m_chunks.push_back(std::move(chunk));
+            }
+            Chunk& chunk = m_chunks[cell->second];
+            chunk.boundsMin.z = std::min(chunk.boundsMin.z, position.z);
+            chunk.boundsMax.z = std::max(chunk.boundsMax.z, position.z);
+            chunk.entries.push_back(i);
+        }
+        m_residentBytes = 0;
+        m_loadsInFlight = 0;
+    }
+
+    bool initialized() const { return !m_chunks.empty(); }
+
+    // world streaming：load和unload是这一帧需要开始加载和卸载的chunk，调用者对unload中的chunk释放模型之后调用unloaded
+    // 卸载在加载之前决定，为这一帧的加载腾出的预算已经算在里面
+    void update(const glm::vec3& position, const glm::vec3& predicted, uint64_t budgetBytes, std::vector<uint32_t>& load, std::vector<uint32_t>& unload) {
+        load.clear();
+        unload.clear();
+        m_priorities.resize(m_chunks.size());
+        for (uint32_t i = 0; i < m_chunks.size(); i++) {
+            m_priorities[i] = std::min(distance(m_chunks[i], position), distance(m_chunks[i], predicted));
+        }
+
+        // 离开unloadRadius的chunk
+        uint64_t keptBytes = 0;
+        m_resident.clear();
+        for (uint32_t i = 0; i < m_chunks.size(); i++) {
+            if (m_chunks[i].state != ChunkState::resident) {
+                continue;
+            }
+            if (m_priorities[i] > m_settings.unloadRadius) {
+                unload.push_back(i);
+            } else {
+                m_resident.push_back(i);
+                keptBytes += m_chunks[i].residentBytes;
+            }
+        }
+        std::sort(m_resident.begin(), m_resident.end(), [this](uint32_t a, uint32_t b) { return m_priorities[a] > m_priorities[b]; });  // 最远的在前
+
+        // 预算变小：从最远的开始卸载
+        size_t evicted = 0;
+        while (keptBytes > budgetBytes && evicted < m_resident.size()) {
+            keptBytes -= m_chunks[m_resident[evicted]].residentBytes;
+            unload.push_back(m_resident[evicted++]);
+        }
+
+        // 需要加载的chunk按距离排序，每个在预算不够时卸载比它更远的常驻chunk
+        m_candidates.clear();
+        for (uint32_t i = 0; i < m_chunks.size(); i++) {
+            if (m_chunks[i].state == ChunkState::unloaded && m_priorities[i] <= m_settings.loadRadius) {
+                m_candidates.push_back(i);
+            }
+        }
+        std::sort(m_candidates.begin(), m_candidates.end(), [this](uint32_t a, uint32_t b) { return m_priorities[a] < m_priorities[b]; });
+        uint64_t knownBytes = 0;
+        uint64_t knownChunks = 0;
+        for (const Chunk& chunk : m_chunks) {
+            knownBytes += chunk.lastBytes;
+            knownChunks += chunk.lastBytes > 0 ? 1 : 0;
+        }
+        uint64_t averageBytes = knownChunks > 0 ? knownBytes / knownChunks : 0;
+        auto estimate = [averageBytes](const Chunk& chunk) { return chunk.lastBytes > 0 ? chunk.lastBytes : averageBytes; };
+        uint64_t loadingBytes = 0;
+        for (const Chunk& chunk : m_chunks) {
+            loadingBytes += chunk.state == ChunkState::loading ? estimate(chunk) : 0;
+        }
+        uint32_t inFlight = m_loadsInFlight;
+        for (uint32_t candidate : m_candidates) {
+            if (load.size() >= m_settings.maxLoadsPerFrame || inFlight >= m_settings.maxLoadsInFlight) {
+                break;
+            }
+            uint64_t needed = estimate(m_chunks[candidate]);
+            size_t farther = evicted;
+            uint64_t freed = 0;
+            while (keptBytes - freed + loadingBytes + needed > budgetBytes && farther < m_resident.size()
+                && m_priorities[m_resident[farther]] > m_priorities[candidate]) {
+                freed += m_chunks[m_resident[farther++]].residentBytes;
+            }
+            if (keptBytes - freed + loadingBytes + needed > budgetBytes) {
+                break;  // 更近的chunk放不下时不越过它加载更远的chunk
+            }
+            for (; evicted < farther; evicted++) {
+                unload.push_back(m_resident[evicted]);
+            }
+            keptBytes -= freed;
+            loadingBytes += needed;
+            load.push_back(candidate);
+            inFlight++;
+        }
+    }
+
+    // world streaming：chunk的模型已经全部请求，modelCount为0的chunk直接常驻
+    void loadStarted(uint32_t chunk, uint32_t modelCount) {
+        Chunk& c = m_chunks[chunk];
+        c.state = ChunkState::loading;
+        c.pendingModels = modelCount;
+        c.residentBytes = 0;
+        m_loadsInFlight++;
+        if (modelCount == 0) {
+            finishLoad(c);
+        }
+    }
+
+    // world streaming：一个模型resident或者失败（bytes为0），chunk的模型全部完成后chunk常驻
+    void modelFinished(uint32_t chunk, uint64_t bytes) {
+        Chunk& c = m_chunks[chunk];
+        c.residentBytes += bytes;
+        m_residentBytes += bytes;
+        if (--c.pendingModels == 0) {
+            finishLoad(c);
+        }
+    }
+
+    void unloaded(uint32_t chunk) {
+        Chunk& c = m_chunks[chunk];
+        m_residentBytes -= c.residentBytes;
+        c.lastBytes = c.residentBytes;
+        c.residentBytes = 0;
+        c.state = ChunkState::unloaded;
+    }
+
+    size_t chunkCount() const { return m_chunks.size(); }
+    const Chunk& chunk(uint32_t index) const { return m_chunks[index]; }
+    const WorldEntry& entry(uint32_t index) const { return m_entries[index]; }
+    uint64_t residentBytes() const { return m_residentBytes; }
+    uint32_t loadsInFlight() const { return m_loadsInFlight; }
+
+    bool busy() const { return m_loadsInFlight > 0; }
+
+private:
+    static float distance(const Chunk& chunk, const glm::vec3& point) {
+        glm::vec3 closest = glm::clamp(point, chunk.boundsMin, chunk.boundsMax);
+        return glm::length(point - closest);
+    }
+
+    void finishLoad(Chunk& chunk) {
+        chunk.state = ChunkState::resident;
+        chunk.lastBytes = chunk.residentBytes;
+        m_loadsInFlight--;
+    }
+
+    std::vector<WorldEntry> m_entries;
+    Settings m_settings;
+    std::vector<Chunk> m_chunks;
+    uint64_t m_residentBytes = 0;
+    uint32_t m_loadsInFlight = 0;
+    // update的临时数组，容量在帧之间复用
+    std::vector<float> m_priorities;
+    std::vector<uint32_t> m_resident;
+    std::vector<uint32_t> m_candidates;
+};